@@ -63,8 +63,60 @@ add_executable(${PROJECT_NAME} ${src_files} ${shaders})
 # Include Verzeichnis zum Projekt hinzufügen
 target_include_directories(${PROJECT_NAME} PUBLIC ${OPENGL_INCLUDE_DIR} ${LIB_DIR}/include)
 
+########################### Gemeinsame Module #################################
+
+# Die Module, die alle Übungen gleich verwenden (Container, Arena, Jobsystem,
+# Profiler, State-Cache, GPU-Speicher, Texturen, ...), liegen einmal in
+# common/src und werden als statische Bibliothek zu jeder Übung gelinkt.
+# Optimierungen daran kommen so bei allen Übungen gleichzeitig an.
+set(COMMON_DIR ${CMAKE_CURRENT_SOURCE_DIR}/../common)
+set(COMMON_LIB_NAME ${PROJECT_NAME}_common)
+file(GLOB common_src_files CONFIGURE_DEPENDS
+    "${COMMON_DIR}/src/*.h"
+    "${COMMON_DIR}/src/*.c"
+)
+find_package(Threads REQUIRED)
+add_library(${COMMON_LIB_NAME} STATIC ${common_src_files})
+
+# Include-Verzeichnisse und Bibliotheken werden an alle Ziele weitergegeben,
+# die die gemeinsamen Module linken.
+target_include_directories(${COMMON_LIB_NAME} PUBLIC ${COMMON_DIR}/src ${OPENGL_INCLUDE_DIR} ${LIB_DIR}/include)
+target_link_libraries(${COMMON_LIB_NAME} PUBLIC
+    ${CMAKE_DL_LIBS}
+    ${OPENGL_gl_LIBRARY}
+    $<$<OR:$<CONFIG:Debug>,$<CONFIG:RelWithDebInfo>>:${LIB_DIR}/bin/fhwcg64d.lib>
+    $<$<CONFIG:Release>:${LIB_DIR}/bin/fhwcg64.lib>
+    ${LIB_DIR}/bin/glfw3.lib
+    Threads::Threads
+)
+if(UNIX AND NOT APPLE)
+    # timer_create des Sampling-Profilers liegt vor glibc 2.34 in librt
+    target_link_libraries(${COMMON_LIB_NAME} PUBLIC m rt)
+endif()
+if(WIN32)
+    # Der UDP-Sink des Metrik-Loggers braucht Winsock
+    target_link_libraries(${COMMON_LIB_NAME} PUBLIC ws2_32)
+endif()
+
+# Höchste Instrumentierungsstufe, die übersetzt wird (siehe instrument.h):
+# 0: aus, Profiler-, Label- und Timeline-Makros werden zu nichts
+# 1: nur GPU-Debug-Labels
+# 2: Labels, CPU/GPU-Zeitmessung und Timeline
+# Zur Laufzeit kann die Stufe bis zu diesem Wert gewählt werden. Die
+# Definition wird an alle Ziele weitergegeben, die die Module linken.
+set(INSTRUMENT_LEVEL 2 CACHE STRING "Instrumentation level compiled in (0 off, 1 labels, 2 full)")
+set_property(CACHE INSTRUMENT_LEVEL PROPERTY STRINGS 0 1 2)
+target_compile_definitions(${COMMON_LIB_NAME} PUBLIC INSTRUMENT_LEVEL=${INSTRUMENT_LEVEL})
+
+if(MSVC)
+    target_compile_options(${COMMON_LIB_NAME} PRIVATE /W4 /WX /wd4996 /wd4204 /wd4127)
+else()
+    target_compile_options(${COMMON_LIB_NAME} PRIVATE -Wall -Wno-long-long -Werror)
+endif()
+
 # Bibliotheken zum Projekt hinzufügen
 target_link_libraries(${PROJECT_NAME}
+    ${COMMON_LIB_NAME}
     ${CMAKE_DL_LIBS}
     ${OPENGL_gl_LIBRARY}
     $<$<OR:$<CONFIG:Debug>,$<CONFIG:RelWithDebInfo>>:${LIB_DIR}/bin/fhwcg64d.lib>
@@ -156,6 +208,13 @@ if(EXISTS "${CMAKE_CURRENT_SOURCE_DIR}/res")
             res_link ALL 
             COMMAND ${CMAKE_COMMAND} -E create_symlink
                 "${CMAKE_CURRENT_SOURCE_DIR}/res" "${CMAKE_CURRENT_BINARY_DIR}/res")
+
+        # Die gemeinsamen Shader (common/res, z. B. gpuprim) ebenso:
+        add_custom_target(
+            common_res_link ALL
+            COMMAND ${CMAKE_COMMAND} -E create_symlink
+                "${COMMON_DIR}" "${CMAKE_CURRENT_BINARY_DIR}/common")
+        target_compile_definitions(${PROJECT_NAME} PRIVATE COMMON_RESOURCE_PATH="common/")
     endif()
 else()
     message(STATUS "CG: No resource directory in use.")
@@ -176,6 +235,75 @@ else()
             "${CMAKE_CURRENT_SOURCE_DIR}/res" "${CMAKE_CURRENT_BINARY_DIR}/res")
 endif()
 
+############################ Ressourcen-Archiv ################################
+
+# Das Werkzeug common/tools/respack.c packt alle Ressourcen der Übung und die
+# gemeinsamen Shader in eine Datei neben dem Programm, die beim Start einmal
+# gemappt wird (siehe common/src/resarchive.h). Shader liegen darin mit
+# aufgelösten #includes, Bilder dekodiert mit allen Mipmap-Stufen. Fehlt das
+# Archiv, lädt das Programm wie bisher die einzelnen Dateien.
+#
+# Die Einträge heißen wie die Pfade, die das Programm öffnet. Bilder in den
+# Verzeichnissen aus RESOURCE_CUBEMAP_DIRS (relativ zu res, vor dem Einbinden
+# dieser Datei zu setzen) sind Würfelseiten und werden nicht gespiegelt.
+if(EXISTS "${CMAKE_CURRENT_SOURCE_DIR}/res")
+    set(RESPACK_NAME ${PROJECT_NAME}_respack)
+    add_executable(${RESPACK_NAME} ${COMMON_DIR}/tools/respack.c)
+    target_link_libraries(${RESPACK_NAME} ${COMMON_LIB_NAME})
+    if(MSVC)
+        target_compile_options(${RESPACK_NAME} PRIVATE /W4 /WX /wd4996 /wd4204 /wd4127)
+    else()
+        target_compile_options(${RESPACK_NAME} PRIVATE -Wall -Wno-long-long -Werror)
+    endif()
+
+    if(WIN32)
+        set(RESPACK_RES_PREFIX "${RESOURCE_REL_PATH}/")
+        set(RESPACK_COMMON_PREFIX "${COMMON_RESOURCE_REL_PATH}/")
+    else()
+        # Die Namen der Symlinks
+        set(RESPACK_RES_PREFIX "res/")
+        set(RESPACK_COMMON_PREFIX "common/")
+    endif()
+
+    # Eine Zeile pro Datei: Name, Pfad und Flags, durch Tabs getrennt
+    file(GLOB_RECURSE res_files CONFIGURE_DEPENDS "${CMAKE_CURRENT_SOURCE_DIR}/res/*")
+    file(GLOB_RECURSE common_res_files CONFIGURE_DEPENDS "${COMMON_DIR}/res/*")
+    set(respack_manifest "")
+    foreach(_file IN LISTS res_files)
+        file(RELATIVE_PATH _rel "${CMAKE_CURRENT_SOURCE_DIR}/res" "${_file}")
+        set(_flags "")
+        foreach(_dir IN LISTS RESOURCE_CUBEMAP_DIRS)
+            if(_rel MATCHES "^${_dir}/")
+                set(_flags "cubemap")
+            endif()
+        endforeach()
+        string(APPEND respack_manifest "${RESPACK_RES_PREFIX}${_rel}\t${_file}\t${_flags}\n")
+    endforeach()
+    foreach(_file IN LISTS common_res_files)
+        file(RELATIVE_PATH _rel "${COMMON_DIR}" "${_file}")
+        string(APPEND respack_manifest "${RESPACK_COMMON_PREFIX}${_rel}\t${_file}\t\n")
+    endforeach()
+
+    # Nur bei geändertem Inhalt neu schreiben, sonst würde jedes Konfigurieren neu packen
+    set(RESPACK_MANIFEST "${CMAKE_CURRENT_BINARY_DIR}/resources.manifest")
+    file(WRITE "${RESPACK_MANIFEST}.in" "${respack_manifest}")
+    configure_file("${RESPACK_MANIFEST}.in" "${RESPACK_MANIFEST}" COPYONLY)
+
+    set(RESPACK_ARCHIVE "${CMAKE_CURRENT_BINARY_DIR}/resources.pak")
+    add_custom_command(
+        OUTPUT "${RESPACK_ARCHIVE}"
+        COMMAND ${RESPACK_NAME} "${RESPACK_MANIFEST}" "${RESPACK_ARCHIVE}"
+        DEPENDS ${RESPACK_NAME} "${RESPACK_MANIFEST}" ${res_files} ${common_res_files}
+        COMMENT "Packing resources into resources.pak")
+    add_custom_target(${PROJECT_NAME}_resources ALL DEPENDS "${RESPACK_ARCHIVE}")
+
+    if(WIN32)
+        # Wie die Ressourcen relativ zum Arbeitsverzeichnis des Programms
+        file(RELATIVE_PATH RESARCHIVE_REL_PATH "${CMAKE_CURRENT_BINARY_DIR}/$<CONFIG>" "${RESPACK_ARCHIVE}")
+        target_compile_definitions(${PROJECT_NAME} PRIVATE RESARCHIVE_PATH="${RESARCHIVE_REL_PATH}")
+    endif()
+endif()
+
 ########################## Help Server Einstellungen ##########################
 
 # Standardmäßig wollen wir gar nichts verändern, der Wert kann aber überschrieben werden
@@ -0,0 +1,245 @@
+/**
+ * @file alloctrack.c
+ * @brief Implementation of the allocation tracking
+ *
+ * Allocations come from the worker threads as well, all counters are
+ * guarded by one spin lock. Its cost only matters with the tracking
+ * enabled, which is a diagnostic build. Sites are found by their name in an
+ * open addressing table, so an array type used in several files counts once.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "alloctrack.h"
+#include "thread.h"
+
+/**
+ * Counters of one call site.
+ */
+typedef struct {
+    const char *site;           // NULL for a free table slot
+    long frameCount;
+    size_t frameBytes;
+    long totalCount;
+    size_t totalBytes;
+    long peakFrameCount;        // most allocations in one frame
+    long steadyFrames;          // allocating frames after the warm-up
+} AllocSite;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+static struct {
+    AllocSite sites[ALLOCTRACK_MAX_SITES];
+    AllocSite other;            // sites beyond the table
+    int siteCount;
+    volatile long lock;
+
+    long frame;
+    long frameAllocs, frameFrees;
+    size_t frameBytes;
+    long totalAllocs, totalFrees;
+    long steadyAllocFrames;     // frames after the warm-up that allocated
+    int reports;
+} g_track = { .other = { .site = "(other sites)" } };
+
+/**
+ * Takes the lock of all counters.
+ */
+static void lock(void) {
+    while (ATOMIC_EXCHANGE(&g_track.lock, 1)) {
+    }
+}
+
+/**
+ * Releases the lock of all counters.
+ */
+static void unlock(void) {
+    ATOMIC_EXCHANGE(&g_track.lock, 0);
+}
+
+/**
+ * Finds or adds the counters of a site, the lock must be held.
+ * @param site Call site.
+ * @return The counters.
+ */
+static AllocSite* findSite(const char *site) {
+    uint32_t hash = 2166136261u;
+    for (const char *c = site; *c; ++c) {
+        hash = (hash ^ (unsigned char) *c) * 16777619u;
+    }
+
+    size_t idx = hash % ALLOCTRACK_MAX_SITES;
+    for (int probe = 0; probe < ALLOCTRACK_MAX_SITES; ++probe) {
+        AllocSite *s = &g_track.sites[idx];
+        if (s->site && (s->site == site || strcmp(s->site, site) == 0)) {
+            return s;
+        }
+        if (!s->site) {
+            // Keeps one slot free, so every probe ends
+            if (g_track.siteCount >= ALLOCTRACK_MAX_SITES - 1) {
+                return &g_track.other;
+            }
+            s->site = site;
+            ++g_track.siteCount;
+            return s;
+        }
+        idx = (idx + 1) % ALLOCTRACK_MAX_SITES;
+    }
+    return &g_track.other;
+}
+
+/**
+ * Counts an allocation.
+ * @param size Size in bytes.
+ * @param site Call site.
+ */
+static void countAllocation(size_t size, const char *site) {
+    lock();
+    AllocSite *s = findSite(site);
+    ++s->frameCount;
+    s->frameBytes += size;
+    ++s->totalCount;
+    s->totalBytes += size;
+    ++g_track.frameAllocs;
+    g_track.frameBytes += size;
+    ++g_track.totalAllocs;
+    unlock();
+}
+
+/**
+ * Strips the directories of a site, __FILE__ may be a full path.
+ * @param site Call site.
+ * @return File name and line.
+ */
+static const char* shortName(const char *site) {
+    const char *slash = strrchr(site, '/');
+    const char *backslash = strrchr(site, '\\');
+    const char *last = slash > backslash ? slash : backslash;
+    return last ? last + 1 : site;
+}
+
+/**
+ * Orders sites by their number of allocations, most first.
+ */
+static int compareSites(const void *a, const void *b) {
+    long ca = ((const AllocSite*) a)->totalCount;
+    long cb = ((const AllocSite*) b)->totalCount;
+    return (ca < cb) - (ca > cb);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void* alloctrack_malloc(size_t size, const char *site) {
+    countAllocation(size, site);
+    return malloc(size);
+}
+
+void* alloctrack_calloc(size_t count, size_t size, const char *site) {
+    countAllocation(count * size, site);
+    return calloc(count, size);
+}
+
+void* alloctrack_realloc(void *ptr, size_t size, const char *site) {
+    countAllocation(size, site);
+    return realloc(ptr, size);
+}
+
+void alloctrack_free(void *ptr) {
+    if (ptr) {
+        alloctrack_countFree();
+    }
+    free(ptr);
+}
+
+void alloctrack_count(size_t size, const char *site) {
+    countAllocation(size, site);
+}
+
+void alloctrack_countFree(void) {
+    lock();
+    ++g_track.frameFrees;
+    ++g_track.totalFrees;
+    unlock();
+}
+
+void alloctrack_beginFrame(void) {
+    lock();
+    bool steady = g_track.frame++ >= ALLOCTRACK_WARMUP_FRAMES;
+    if (g_track.frameAllocs == 0) {
+        g_track.frameFrees = 0;
+        unlock();
+        return;
+    }
+
+    AllocSite *busiest = NULL;
+    for (int i = 0; i <= ALLOCTRACK_MAX_SITES; ++i) {
+        AllocSite *s = i < ALLOCTRACK_MAX_SITES ? &g_track.sites[i] : &g_track.other;
+        if (s->frameCount == 0) {
+            continue;
+        }
+        if (!busiest || s->frameCount > busiest->frameCount) {
+            busiest = s;
+        }
+        if (s->frameCount > s->peakFrameCount) {
+            s->peakFrameCount = s->frameCount;
+        }
+        s->steadyFrames += steady;
+    }
+
+    if (steady) {
+        ++g_track.steadyAllocFrames;
+        if (g_track.reports < ALLOCTRACK_MAX_FRAME_REPORTS) {
+            printf("Frame %ld allocated %ld times (%zu bytes, %ld frees), most at %s (%ld times, %zu bytes)\n",
+                   g_track.frame - 1, g_track.frameAllocs, g_track.frameBytes, g_track.frameFrees,
+                   shortName(busiest->site), busiest->frameCount, busiest->frameBytes);
+            if (++g_track.reports == ALLOCTRACK_MAX_FRAME_REPORTS) {
+                printf("Further allocating frames are only counted\n");
+            }
+        }
+    }
+
+    for (int i = 0; i <= ALLOCTRACK_MAX_SITES; ++i) {
+        AllocSite *s = i < ALLOCTRACK_MAX_SITES ? &g_track.sites[i] : &g_track.other;
+        s->frameCount = 0;
+        s->frameBytes = 0;
+    }
+    g_track.frameAllocs = g_track.frameFrees = 0;
+    g_track.frameBytes = 0;
+    unlock();
+}
+
+long alloctrack_getTotalAllocs(void) {
+    lock();
+    long total = g_track.totalAllocs;
+    unlock();
+    return total;
+}
+
+void alloctrack_cleanup(void) {
+    lock();
+    if (g_track.totalAllocs == 0) {
+        unlock();
+        return;
+    }
+
+    AllocSite sorted[ALLOCTRACK_MAX_SITES + 1];
+    int count = 0;
+    for (int i = 0; i < ALLOCTRACK_MAX_SITES; ++i) {
+        if (g_track.sites[i].site) {
+            sorted[count++] = g_track.sites[i];
+        }
+    }
+    if (g_track.other.totalCount > 0) {
+        sorted[count++] = g_track.other;
+    }
+    qsort(sorted, count, sizeof(AllocSite), compareSites);
+
+    printf("Allocations: %ld allocs, %ld frees in %ld frames, %ld frames after the warm-up allocated\n",
+           g_track.totalAllocs, g_track.totalFrees, g_track.frame, g_track.steadyAllocFrames);
+    for (int i = 0; i < count && i < ALLOCTRACK_REPORT_SITES; ++i) {
+        const AllocSite *s = &sorted[i];
+        printf("  %-32s %8ld allocs %10.1f KB  peak %ld/frame  %ld steady frames\n",
+               shortName(s->site), s->totalCount, s->totalBytes / 1024.0, s->peakFrameCount, s->steadyFrames);
+    }
+    unlock();
+}
@@ -0,0 +1,116 @@
+/**
+ * @file alloctrack.h
+ * @brief Opt-in tracking of heap allocations per call site
+ *
+ * Modules allocate through TRACKED_MALLOC, TRACKED_CALLOC, TRACKED_REALLOC
+ * and TRACKED_FREE, the dynamic arrays of array.h do as well. Without
+ * ALLOCTRACK_ENABLED they are the plain C functions. With it, every call
+ * is counted with its size under the file and line it came from, array
+ * growth under the name of the array type.
+ *
+ * After a warm-up every frame that still allocates is reported with its
+ * busiest site, steady-state frames should not allocate at all. On exit
+ * the sites with the most allocations are listed.
+ *
+ * The file is kept identical in the 3D exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef ALLOCTRACK_H
+#define ALLOCTRACK_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Frames after the start that may allocate without a report */
+#define ALLOCTRACK_WARMUP_FRAMES 120
+
+/** Reported allocating frames, later ones are only counted */
+#define ALLOCTRACK_MAX_FRAME_REPORTS 32
+
+/** Sites listed in the exit report */
+#define ALLOCTRACK_REPORT_SITES 10
+
+/** Distinct sites that can be told apart, later ones share one entry */
+#define ALLOCTRACK_MAX_SITES 512
+
+#define ALLOCTRACK_STR(x) #x
+#define ALLOCTRACK_XSTR(x) ALLOCTRACK_STR(x)
+
+/** Name of the calling file and line */
+#define ALLOCTRACK_SITE __FILE__ ":" ALLOCTRACK_XSTR(__LINE__)
+
+#ifdef ALLOCTRACK_ENABLED
+    #define TRACKED_MALLOC(size) alloctrack_malloc(size, ALLOCTRACK_SITE)
+    #define TRACKED_CALLOC(count, size) alloctrack_calloc(count, size, ALLOCTRACK_SITE)
+    #define TRACKED_REALLOC(ptr, size) alloctrack_realloc(ptr, size, ALLOCTRACK_SITE)
+    #define TRACKED_FREE(ptr) alloctrack_free(ptr)
+#else
+    #define TRACKED_MALLOC(size) malloc(size)
+    #define TRACKED_CALLOC(count, size) calloc(count, size)
+    #define TRACKED_REALLOC(ptr, size) realloc(ptr, size)
+    #define TRACKED_FREE(ptr) free(ptr)
+#endif
+
+/**
+ * Allocates and counts the allocation, use TRACKED_MALLOC.
+ * @param size Size in bytes.
+ * @param site Call site, must be a string literal.
+ * @return The block as malloc returns it.
+ */
+void* alloctrack_malloc(size_t size, const char *site);
+
+/**
+ * Allocates zeroed memory and counts the allocation, use TRACKED_CALLOC.
+ * @param count Number of elements.
+ * @param size Size of one element.
+ * @param site Call site, must be a string literal.
+ * @return The block as calloc returns it.
+ */
+void* alloctrack_calloc(size_t count, size_t size, const char *site);
+
+/**
+ * Resizes a block and counts it as an allocation, use TRACKED_REALLOC.
+ * @param ptr Block or NULL.
+ * @param size New size in bytes.
+ * @param site Call site, must be a string literal.
+ * @return The block as realloc returns it.
+ */
+void* alloctrack_realloc(void *ptr, size_t size, const char *site);
+
+/**
+ * Frees a block and counts the free, use TRACKED_FREE.
+ * @param ptr Block or NULL.
+ */
+void alloctrack_free(void *ptr);
+
+/**
+ * Counts an allocation made by another allocator, e.g. bigalloc.
+ * @param size Size in bytes.
+ * @param site Call site, must outlive the program.
+ */
+void alloctrack_count(size_t size, const char *site);
+
+/**
+ * Counts a free made by another allocator.
+ */
+void alloctrack_countFree(void);
+
+/**
+ * Closes the counts of the last frame and reports it if it allocated
+ * after the warm-up. Call once per frame from the main loop.
+ */
+void alloctrack_beginFrame(void);
+
+/**
+ * Returns the number of allocations counted so far.
+ * @return Allocations since the start, 0 without ALLOCTRACK_ENABLED.
+ */
+long alloctrack_getTotalAllocs(void);
+
+/**
+ * Prints the sites with the most allocations.
+ */
+void alloctrack_cleanup(void);
+
+#endif // ALLOCTRACK_H
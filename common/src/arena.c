@@ -0,0 +1,179 @@
+/**
+ * @file arena.c
+ * @brief Implementation of the linear arenas
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "arena.h"
+#include "alloctrack.h"
+
+/**
+ * Heap block of a request that did not fit, freed on the next reset.
+ */
+struct ArenaOverflow {
+    ArenaOverflow *next;
+};
+
+/** Size of the overflow header, keeps the payload aligned */
+#define OVERFLOW_HEADER ((sizeof(ArenaOverflow) + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1))
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global arena state.
+ */
+static struct {
+    Arena frame;
+    Arena rebuild;
+    ArenaStats stats;
+} g_arenas = { 0 };
+
+/**
+ * Rounds a size up to the alignment.
+ * @param size Size in bytes.
+ * @return The aligned size.
+ */
+static size_t alignUp(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+}
+
+/**
+ * Allocates a block from the heap. malloc aligns to 16 bytes on the
+ * 64 bit targets, which also keeps the block visible to the fhwcg leak
+ * check in debug builds.
+ * @param a The arena, counts the allocation.
+ * @param size Size in bytes.
+ * @return The block.
+ */
+static unsigned char* allocBlock(Arena *a, size_t size) {
+    a->heapAllocs++;
+    unsigned char *block = TRACKED_MALLOC(size);
+    assert(block && "malloc failed in arena allocBlock");
+    assert(((uintptr_t) block % ARENA_ALIGNMENT) == 0 && "malloc is not aligned for the arena");
+    return block;
+}
+
+/**
+ * Records the current use of an arena in its peak.
+ * @param a The arena.
+ */
+static void updatePeak(Arena *a) {
+    size_t use = a->used + a->overflowBytes;
+    if (use > a->peak) {
+        a->peak = use;
+    }
+}
+
+/**
+ * Sets up an arena.
+ * @param a The arena.
+ * @param capacity Initial block size.
+ */
+static void initArena(Arena *a, size_t capacity) {
+    memset(a, 0, sizeof(Arena));
+    a->capacity = alignUp(capacity);
+    a->base = allocBlock(a, a->capacity);
+}
+
+/**
+ * Frees the overflow of an arena and grows its block to the peak use,
+ * so the next round of the same allocations fits. The peak is kept, the
+ * block only ever grows.
+ * @param a The arena, must be empty.
+ */
+static void compact(Arena *a) {
+    while (a->overflow) {
+        ArenaOverflow *next = a->overflow->next;
+        TRACKED_FREE(a->overflow);
+        a->overflow = next;
+    }
+
+    if (a->peak > a->capacity) {
+        TRACKED_FREE(a->base);
+        a->capacity = alignUp(a->peak + a->peak / 2);
+        a->base = allocBlock(a, a->capacity);
+    }
+    a->overflowBytes = 0;
+}
+
+/**
+ * Frees an arena.
+ * @param a The arena.
+ */
+static void freeArena(Arena *a) {
+    a->used = 0;
+    a->peak = 0;
+    compact(a);
+    TRACKED_FREE(a->base);
+    memset(a, 0, sizeof(Arena));
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void arena_init(void) {
+    initArena(&g_arenas.frame, ARENA_FRAME_CAPACITY);
+    initArena(&g_arenas.rebuild, ARENA_REBUILD_CAPACITY);
+}
+
+void arena_cleanup(void) {
+    freeArena(&g_arenas.frame);
+    freeArena(&g_arenas.rebuild);
+    memset(&g_arenas.stats, 0, sizeof(ArenaStats));
+}
+
+void arena_beginFrame(void) {
+    Arena *frame = &g_arenas.frame;
+    g_arenas.stats.frameBytes = frame->peak;
+
+    arena_release(frame, 0);
+    frame->peak = 0;
+
+    g_arenas.stats.heapAllocs = frame->heapAllocs + g_arenas.rebuild.heapAllocs;
+    g_arenas.stats.frameCapacity = frame->capacity;
+    g_arenas.stats.rebuildCapacity = g_arenas.rebuild.capacity;
+    frame->heapAllocs = 0;
+    g_arenas.rebuild.heapAllocs = 0;
+}
+
+Arena* arena_frame(void) {
+    return &g_arenas.frame;
+}
+
+Arena* arena_rebuild(void) {
+    return &g_arenas.rebuild;
+}
+
+void* arena_alloc(Arena *a, size_t size) {
+    size = alignUp(size);
+
+    if (a->used + size <= a->capacity) {
+        void *p = a->base + a->used;
+        a->used += size;
+        updatePeak(a);
+        return p;
+    }
+
+    ArenaOverflow *block = (ArenaOverflow*) allocBlock(a, OVERFLOW_HEADER + size);
+    block->next = a->overflow;
+    a->overflow = block;
+    a->overflowBytes += size;
+    updatePeak(a);
+    return (unsigned char*) block + OVERFLOW_HEADER;
+}
+
+ArenaMark arena_mark(const Arena *a) {
+    return a->used;
+}
+
+void arena_release(Arena *a, ArenaMark mark) {
+    assert(mark <= a->used && "arena released past its use");
+    a->used = mark;
+    if (mark == 0) {
+        compact(a);
+    }
+}
+
+void arena_getStats(ArenaStats *stats) {
+    *stats = g_arenas.stats;
+}
@@ -0,0 +1,113 @@
+/**
+ * @file arena.h
+ * @brief Linear arenas for per-frame and per-rebuild scratch memory
+ *
+ * Scratch arrays are bumped off a preallocated block instead of taking
+ * a malloc and free each. The frame arena is reset at the start of every
+ * frame, the rebuild arena is released by marks around mesh rebuilds.
+ * A request that does not fit is served from the heap and the block is
+ * grown to the peak use on the next reset, so steady-state frames do no
+ * heap allocations. Both arenas are for the main thread only.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Alignment of every allocation, enough for SIMD loads */
+#define ARENA_ALIGNMENT 16
+
+/** Initial block sizes */
+#define ARENA_FRAME_CAPACITY (1 << 20)
+#define ARENA_REBUILD_CAPACITY (1 << 18)
+
+/** Heap block of a request that did not fit into the arena */
+typedef struct ArenaOverflow ArenaOverflow;
+
+/**
+ * A linear arena.
+ */
+typedef struct {
+    unsigned char *base;
+    size_t capacity;
+    size_t used;
+    size_t peak;                // highest use including overflow, per frame for the frame arena
+    size_t overflowBytes;
+    ArenaOverflow *overflow;
+    int heapAllocs;             // heap allocations since the last stats snapshot
+} Arena;
+
+/** Position in an arena to release back to */
+typedef size_t ArenaMark;
+
+/**
+ * Arena usage of the last frame.
+ */
+typedef struct {
+    int heapAllocs;             // heap allocations of both arenas
+    size_t frameBytes;          // peak use of the frame arena
+    size_t frameCapacity;
+    size_t rebuildCapacity;
+} ArenaStats;
+
+/**
+ * Creates the frame and the rebuild arena.
+ */
+void arena_init(void);
+
+/**
+ * Frees both arenas.
+ */
+void arena_cleanup(void);
+
+/**
+ * Resets the frame arena and takes the stats of the last frame.
+ * Call at the start of every frame, before anything allocates from it.
+ */
+void arena_beginFrame(void);
+
+/**
+ * Returns the frame arena, allocations live until the next frame.
+ * @return The frame arena.
+ */
+Arena* arena_frame(void);
+
+/**
+ * Returns the rebuild arena, allocations live until released.
+ * @return The rebuild arena.
+ */
+Arena* arena_rebuild(void);
+
+/**
+ * Allocates uninitialized, ARENA_ALIGNMENT aligned memory.
+ * @param a The arena.
+ * @param size Size in bytes.
+ * @return The memory, never NULL.
+ */
+void* arena_alloc(Arena *a, size_t size);
+
+/**
+ * Returns the current position of an arena.
+ * @param a The arena.
+ * @return The mark.
+ */
+ArenaMark arena_mark(const Arena *a);
+
+/**
+ * Frees everything allocated after a mark. Releasing to the start of
+ * the arena also frees the overflow and grows the block to the peak.
+ * @param a The arena.
+ * @param mark Mark taken with arena_mark.
+ */
+void arena_release(Arena *a, ArenaMark mark);
+
+/**
+ * Fills in the arena usage of the last frame.
+ * @param stats Destination.
+ */
+void arena_getStats(ArenaStats *stats);
+
+#endif // ARENA_H
@@ -0,0 +1,148 @@
+/**
+ * @file array.h
+ * @brief Generic dynamic arrays
+ *
+ * DEFINE_ARRAY_TYPE generates a typed array with init, free, clear,
+ * reserve, shrink, push, popBack, removeSwap and the bulk operations
+ * appendN and resizeUninit. Storage grows geometrically through realloc,
+ * bulk operations grow at most once. Element types that can't be assigned,
+ * like the cglm vectors, use DEFINE_ARRAY_BASE, which leaves out push.
+ * With ALLOCTRACK_ENABLED the storage is counted under the array type name.
+ *
+ * The file is kept identical in all exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include <fhwcg/fhwcg.h>
+
+#ifdef ALLOCTRACK_ENABLED
+    #include "alloctrack.h"
+    #define ARRAY_REALLOC(ptr, size, name) alloctrack_realloc(ptr, size, name)
+    #define ARRAY_FREE(ptr) alloctrack_free(ptr)
+#else
+    #define ARRAY_REALLOC(ptr, size, name) realloc(ptr, size)
+    #define ARRAY_FREE(ptr) free(ptr)
+#endif
+
+/** Capacity of the first allocation */
+#define ARRAY_MIN_CAPACITY 8
+
+/**
+ * Alignment of the storage. malloc and realloc return 16 byte aligned
+ * blocks on the 64 bit targets, enough for SSE loads of vec4 columns.
+ */
+#define ARRAY_ALIGNMENT 16
+#define ARRAY_IS_ALIGNED(ptr) (((uintptr_t) (ptr) % ARRAY_ALIGNMENT) == 0)
+
+/**
+ * Growth policy, doubles the capacity but at least to the requested size.
+ * @param capacity Current capacity.
+ * @param min_capacity Required capacity.
+ * @return The new capacity.
+ */
+static inline size_t array_grownCapacity(size_t capacity, size_t min_capacity) {
+    size_t new_cap = capacity ? capacity * 2 : ARRAY_MIN_CAPACITY;
+    return new_cap < min_capacity ? min_capacity : new_cap;
+}
+
+/**
+ * Defines a dynamic array type without push, for any given element TYPE.
+ * resizeUninit and appendN reserve once for the whole range,
+ * removeSwap moves the last element into the gap and does not keep the order.
+ *
+ * @param TYPE Element type stored in the array
+ * @param NAME Name of the generated array type
+ */
+#define DEFINE_ARRAY_BASE(TYPE, NAME)                                          \
+typedef struct {                                                               \
+    TYPE *data;                                                                \
+    size_t size;                                                               \
+    size_t capacity;                                                           \
+} NAME;                                                                        \
+                                                                               \
+static inline void NAME##_init(NAME *arr) {                                    \
+    arr->data = NULL;                                                          \
+    arr->size = 0;                                                             \
+    arr->capacity = 0;                                                         \
+}                                                                              \
+                                                                               \
+static inline void NAME##_free(NAME *arr) {                                    \
+    ARRAY_FREE(arr->data);                                                     \
+    arr->data = NULL;                                                          \
+    arr->size = 0;                                                             \
+    arr->capacity = 0;                                                         \
+}                                                                              \
+                                                                               \
+static inline void NAME##_clear(NAME *arr) {                                   \
+    arr->size = 0;                                                             \
+}                                                                              \
+                                                                               \
+static inline void NAME##_setCapacity(NAME *arr, size_t capacity) {            \
+    TYPE *data = ARRAY_REALLOC(arr->data, capacity * sizeof(TYPE), #NAME);     \
+    assert(data && "realloc failed in " #NAME "_setCapacity");                 \
+    assert(ARRAY_IS_ALIGNED(data) && #NAME " storage is not aligned");         \
+    arr->data = data;                                                          \
+    arr->capacity = capacity;                                                  \
+}                                                                              \
+                                                                               \
+static inline void NAME##_reserve(NAME *arr, size_t min_capacity) {            \
+    if (arr->capacity < min_capacity) {                                        \
+        NAME##_setCapacity(arr, array_grownCapacity(arr->capacity, min_capacity));\
+    }                                                                          \
+}                                                                              \
+                                                                               \
+static inline void NAME##_shrink(NAME *arr) {                                  \
+    if (arr->size == 0) {                                                      \
+        NAME##_free(arr);                                                      \
+    } else if (arr->size < arr->capacity) {                                    \
+        NAME##_setCapacity(arr, arr->size);                                    \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+static inline TYPE* NAME##_resizeUninit(NAME *arr, size_t size) {              \
+    NAME##_reserve(arr, size);                                                 \
+    arr->size = size;                                                          \
+    return arr->data;                                                          \
+}                                                                              \
+                                                                               \
+static inline void NAME##_appendN(NAME *arr, const TYPE *src, size_t n) {      \
+    NAME##_reserve(arr, arr->size + n);                                        \
+    memcpy(&arr->data[arr->size], src, n * sizeof(TYPE));                      \
+    arr->size += n;                                                            \
+}                                                                              \
+                                                                               \
+static inline void NAME##_removeSwap(NAME *arr, size_t idx) {                  \
+    assert(idx < arr->size && #NAME "_removeSwap out of range");               \
+    arr->size--;                                                               \
+    if (idx != arr->size) {                                                    \
+        memcpy(&arr->data[idx], &arr->data[arr->size], sizeof(TYPE));          \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+static inline void NAME##_popBack(NAME *arr) {                                 \
+    if (arr->size > 0) {                                                       \
+        arr->size--;                                                           \
+    }                                                                          \
+}
+
+/**
+ * Defines a dynamic array type with all functions of DEFINE_ARRAY_BASE
+ * and push for any given assignable element TYPE.
+ *
+ * @param TYPE Element type stored in the array
+ * @param NAME Name of the generated array type
+ */
+#define DEFINE_ARRAY_TYPE(TYPE, NAME)                                          \
+DEFINE_ARRAY_BASE(TYPE, NAME)                                                  \
+                                                                               \
+static inline void NAME##_push(NAME *arr, TYPE value) {                        \
+    if (arr->size >= arr->capacity)                                            \
+        NAME##_reserve(arr, arr->size + 1);                                    \
+    arr->data[arr->size++] = value;                                            \
+}
+
+#endif // ARRAY_H
@@ -0,0 +1,878 @@
+/**
+ * @file benchresult.c
+ * @brief Implementation of the benchmark results
+ *
+ * The reader is a small recursive descent parser that walks objects and
+ * arrays member by member and skips everything it does not know, so later
+ * fields don't break older readers. The build section describes the
+ * compiler flags the common modules were compiled with, the exercises use
+ * the same ones.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "benchresult.h"
+#include "instrument.h"
+
+#include <ctype.h>
+#include <time.h>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/utsname.h>
+    #include <unistd.h>
+#endif
+
+/** Capacity of the first sample allocation of a loaded metric, a power of two */
+#define MIN_SAMPLE_CAPACITY 8
+
+/** Two-sided 99% quantiles of Student's t distribution for 1 to 30 degrees of freedom */
+static const double T_QUANTILES[] = {
+    63.657, 9.925, 5.841, 4.604, 4.032, 3.707, 3.499, 3.355, 3.250, 3.169,
+    3.106, 3.055, 3.012, 2.977, 2.947, 2.921, 2.898, 2.878, 2.861, 2.845,
+    2.831, 2.819, 2.807, 2.797, 2.787, 2.779, 2.771, 2.763, 2.756, 2.750
+};
+
+/** Two-sided 99% quantile of the normal distribution */
+#define Z_QUANTILE 2.5758
+
+/** JSON names of the sections, indexed by BenchSection */
+static const char *g_sectionNames[] = {"machine", "build", "config"};
+
+/**
+ * Parser state of a metadata section.
+ */
+typedef struct {
+    BenchResult *result;
+    BenchSection section;
+} SectionContext;
+
+/**
+ * Member handler of parseObject.
+ * @param p Position of the value.
+ * @param key Member name.
+ * @param user Data of the caller.
+ * @return Position after the value or NULL on a syntax error.
+ */
+typedef const char *(*MemberFn)(const char *p, const char *key, void *user);
+
+/**
+ * Element handler of parseArray.
+ * @param p Position of the element.
+ * @param user Data of the caller.
+ * @return Position after the element or NULL on a syntax error.
+ */
+typedef const char *(*ElementFn)(const char *p, void *user);
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Copies a string, truncated to the destination.
+ * @param dest Destination.
+ * @param size Size of the destination, at least 1.
+ * @param src The string.
+ */
+static void copyText(char *dest, size_t size, const char *src) {
+    size_t len = strlen(src);
+    len = len < size ? len : size - 1;
+    memcpy(dest, src, len);
+    dest[len] = '\0';
+}
+
+/**
+ * Skips whitespace.
+ * @param p Position in the text.
+ * @return First position that is no whitespace.
+ */
+static const char *skipSpace(const char *p) {
+    while (*p && isspace((unsigned char) *p)) {
+        ++p;
+    }
+    return p;
+}
+
+/**
+ * Consumes one character after optional whitespace.
+ * @param p Position in the text, NULL after an earlier error.
+ * @param c Expected character.
+ * @return Position after it or NULL if something else follows.
+ */
+static const char *expect(const char *p, char c) {
+    if (!p) {
+        return NULL;
+    }
+    p = skipSpace(p);
+    return *p == c ? p + 1 : NULL;
+}
+
+/**
+ * Parses a string, \u escapes are not decoded.
+ * @param p Position before the opening quote, NULL after an earlier error.
+ * @param dest Destination, truncated to its size, NULL to skip the string.
+ * @param size Size of the destination.
+ * @return Position after the closing quote or NULL.
+ */
+static const char *parseString(const char *p, char *dest, size_t size) {
+    p = expect(p, '"');
+    if (!p) {
+        return NULL;
+    }
+
+    size_t len = 0;
+    while (*p && *p != '"') {
+        char c = *p++;
+        if (c == '\\') {
+            c = *p++;
+            if (c == '\0') {
+                return NULL;
+            }
+            c = c == 'n' ? '\n' : (c == 't' ? '\t' : c);
+        }
+        if (dest && len + 1 < size) {
+            dest[len++] = c;
+        }
+    }
+    if (dest && size > 0) {
+        dest[len] = '\0';
+    }
+    return *p == '"' ? p + 1 : NULL;
+}
+
+/**
+ * Parses a string, number or literal as text.
+ * @param p Position before the value.
+ * @param dest Destination, truncated to its size.
+ * @param size Size of the destination.
+ * @return Position after the value or NULL.
+ */
+static const char *parseScalar(const char *p, char *dest, size_t size) {
+    p = skipSpace(p);
+    if (*p == '"') {
+        return parseString(p, dest, size);
+    }
+
+    const char *start = p;
+    while (isalnum((unsigned char) *p) || *p == '-' || *p == '+' || *p == '.') {
+        ++p;
+    }
+    if (p == start) {
+        return NULL;
+    }
+    snprintf(dest, size, "%.*s", (int) (p - start), start);
+    return p;
+}
+
+/**
+ * Skips a value of any type, including nested objects and arrays.
+ * @param p Position before the value.
+ * @return Position after the value or NULL.
+ */
+static const char *skipValue(const char *p) {
+    p = skipSpace(p);
+    if (*p != '{' && *p != '[') {
+        char text[64];
+        return parseScalar(p, text, sizeof(text));
+    }
+
+    int depth = 0;
+    while (*p) {
+        if (*p == '"') {
+            p = parseString(p, NULL, 0);
+            if (!p) {
+                return NULL;
+            }
+            continue;
+        }
+        if (*p == '{' || *p == '[') {
+            ++depth;
+        } else if ((*p == '}' || *p == ']') && --depth == 0) {
+            return p + 1;
+        }
+        ++p;
+    }
+    return NULL;
+}
+
+/**
+ * Walks the members of an object.
+ * @param p Position before the opening brace, NULL after an earlier error.
+ * @param fn Called for every member.
+ * @param user Passed to fn.
+ * @return Position after the closing brace or NULL.
+ */
+static const char *parseObject(const char *p, MemberFn fn, void *user) {
+    p = expect(p, '{');
+    if (p && *skipSpace(p) == '}') {
+        return skipSpace(p) + 1;
+    }
+
+    while (p) {
+        char key[64];
+        p = expect(parseString(p, key, sizeof(key)), ':');
+        if (!p || !(p = fn(p, key, user))) {
+            return NULL;
+        }
+        p = skipSpace(p);
+        if (*p != ',') {
+            return *p == '}' ? p + 1 : NULL;
+        }
+        ++p;
+    }
+    return NULL;
+}
+
+/**
+ * Walks the elements of an array.
+ * @param p Position before the opening bracket, NULL after an earlier error.
+ * @param fn Called for every element.
+ * @param user Passed to fn.
+ * @return Position after the closing bracket or NULL.
+ */
+static const char *parseArray(const char *p, ElementFn fn, void *user) {
+    p = expect(p, '[');
+    if (p && *skipSpace(p) == ']') {
+        return skipSpace(p) + 1;
+    }
+
+    while (p) {
+        if (!(p = fn(p, user))) {
+            return NULL;
+        }
+        p = skipSpace(p);
+        if (*p != ',') {
+            return *p == ']' ? p + 1 : NULL;
+        }
+        ++p;
+    }
+    return NULL;
+}
+
+/**
+ * Reads a member of a metadata section.
+ */
+static const char *parseInfoMember(const char *p, const char *key, void *user) {
+    SectionContext *ctx = user;
+    char value[128];
+    p = skipSpace(p);
+    if (*p == '{' || *p == '[') {
+        return skipValue(p);
+    }
+    p = parseScalar(p, value, sizeof(value));
+    if (p) {
+        benchresult_setInfo(ctx->result, ctx->section, key, value);
+    }
+    return p;
+}
+
+/**
+ * Appends one sample to a loaded metric.
+ */
+static const char *parseSample(const char *p, void *user) {
+    BenchMetric *m = user;
+    char text[64];
+    p = parseScalar(p, text, sizeof(text));
+    if (!p || m->count >= BENCHRESULT_MAX_SAMPLES) {
+        return p;
+    }
+
+    // The capacity doubles whenever the count reaches a power of two
+    if (m->count == 0 || (m->count >= MIN_SAMPLE_CAPACITY && (m->count & (m->count - 1)) == 0)) {
+        int capacity = m->count == 0 ? MIN_SAMPLE_CAPACITY : m->count * 2;
+        double *samples = realloc(m->samples, capacity * sizeof(double));
+        if (!samples) {
+            return NULL;
+        }
+        m->samples = samples;
+    }
+    m->samples[m->count++] = strtod(text, NULL);
+    return p;
+}
+
+/**
+ * Reads a member of a metric, the statistics are computed from the samples.
+ */
+static const char *parseMetricMember(const char *p, const char *key, void *user) {
+    BenchMetric *m = user;
+    if (strcmp(key, "name") == 0) {
+        return parseString(p, m->name, sizeof(m->name));
+    }
+    if (strcmp(key, "unit") == 0) {
+        return parseString(p, m->unit, sizeof(m->unit));
+    }
+    if (strcmp(key, "better") == 0) {
+        char better[16];
+        p = parseString(p, better, sizeof(better));
+        m->higherIsBetter = p && strcmp(better, "higher") == 0;
+        return p;
+    }
+    if (strcmp(key, "samples") == 0) {
+        return parseArray(p, parseSample, m);
+    }
+    return skipValue(p);
+}
+
+/**
+ * Reads one metric, metrics without samples are dropped.
+ */
+static const char *parseMetric(const char *p, void *user) {
+    BenchResult *result = user;
+    if (result->metricCount >= BENCHRESULT_MAX_METRICS) {
+        return skipValue(p);
+    }
+
+    BenchMetric *m = &result->metrics[result->metricCount];
+    memset(m, 0, sizeof(*m));
+    p = parseObject(p, parseMetricMember, m);
+    if (p && m->count > 0) {
+        ++result->metricCount;
+    } else {
+        free(m->samples);
+        m->samples = NULL;
+    }
+    return p;
+}
+
+/**
+ * Reads a top-level member of a result.
+ */
+static const char *parseResultMember(const char *p, const char *key, void *user) {
+    BenchResult *result = user;
+    if (strcmp(key, "program") == 0) {
+        return parseString(p, result->program, sizeof(result->program));
+    }
+    if (strcmp(key, "date") == 0) {
+        return parseString(p, result->date, sizeof(result->date));
+    }
+    if (strcmp(key, "args") == 0) {
+        return parseString(p, result->args, sizeof(result->args));
+    }
+    if (strcmp(key, "metrics") == 0) {
+        return parseArray(p, parseMetric, result);
+    }
+    for (int s = 0; s < BS_COUNT; ++s) {
+        if (strcmp(key, g_sectionNames[s]) == 0) {
+            SectionContext ctx = { result, (BenchSection) s };
+            return parseObject(p, parseInfoMember, &ctx);
+        }
+    }
+    return skipValue(p);
+}
+
+/**
+ * Reads a whole file.
+ * @param path File name.
+ * @return Zero terminated contents to be freed or NULL.
+ */
+static char *readFile(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *text = size >= 0 ? malloc((size_t) size + 1) : NULL;
+    if (text) {
+        size_t got = fread(text, 1, (size_t) size, file);
+        text[got] = '\0';
+    }
+    fclose(file);
+    return text;
+}
+
+/**
+ * Writes a string with JSON escapes.
+ * @param file Destination.
+ * @param text The string.
+ */
+static void writeString(FILE *file, const char *text) {
+    fputc('"', file);
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if ((unsigned char) *c < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned char) *c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/**
+ * Checks whether a metadata value can be written as a JSON number.
+ * @param text The value.
+ * @return True for decimal numbers, not for inf or nan.
+ */
+static bool isNumber(const char *text) {
+    if (!isdigit((unsigned char) text[0]) && !(text[0] == '-' && isdigit((unsigned char) text[1]))) {
+        return false;
+    }
+    char *end;
+    strtod(text, &end);
+    return *end == '\0';
+}
+
+/**
+ * Computes mean, sample standard deviation and minimum of a metric.
+ * @param m The metric.
+ * @param mean Destination for the mean.
+ * @param stddev Destination for the standard deviation, 0 for a single sample.
+ * @param min Destination for the minimum, may be NULL.
+ */
+static void metricStats(const BenchMetric *m, double *mean, double *stddev, double *min) {
+    double sum = 0.0, lowest = m->samples[0];
+    for (int i = 0; i < m->count; ++i) {
+        sum += m->samples[i];
+        lowest = fmin(lowest, m->samples[i]);
+    }
+    *mean = sum / m->count;
+
+    double variance = 0.0;
+    for (int i = 0; i < m->count; ++i) {
+        variance += (m->samples[i] - *mean) * (m->samples[i] - *mean);
+    }
+    *stddev = m->count > 1 ? sqrt(variance / (m->count - 1)) : 0.0;
+    if (min) {
+        *min = lowest;
+    }
+}
+
+/**
+ * Returns the two-sided 99% quantile of Student's t distribution.
+ * Beyond the table the Cornish-Fisher expansion around the normal
+ * quantile is within 0.01 of the exact value.
+ * @param df Degrees of freedom, at least 1.
+ * @return The quantile.
+ */
+static double tQuantile(double df) {
+    int n = NK_LEN(T_QUANTILES);
+    if (df <= n) {
+        return T_QUANTILES[glm_imax((int) df, 1) - 1];
+    }
+    return Z_QUANTILE + (Z_QUANTILE * Z_QUANTILE * Z_QUANTILE + Z_QUANTILE) / (4.0 * df);
+}
+
+/**
+ * Tests whether the means of two metrics differ with Welch's t-test,
+ * which does not assume equal variances or sample counts.
+ * @param a First metric, at least two samples.
+ * @param b Second metric, at least two samples.
+ * @return True if the difference is significant.
+ */
+static bool differs(const BenchMetric *a, const BenchMetric *b) {
+    double meanA, stddevA, meanB, stddevB;
+    metricStats(a, &meanA, &stddevA, NULL);
+    metricStats(b, &meanB, &stddevB, NULL);
+
+    double varA = stddevA * stddevA / a->count;
+    double varB = stddevB * stddevB / b->count;
+    if (varA + varB <= 0.0) {
+        return meanA != meanB;
+    }
+
+    // Welch-Satterthwaite degrees of freedom
+    double df = (varA + varB) * (varA + varB)
+        / (varA * varA / (a->count - 1) + varB * varB / (b->count - 1));
+    double t = fabs(meanA - meanB) / sqrt(varA + varB);
+    return t > tQuantile(df);
+}
+
+/**
+ * Finds a metric by name.
+ * @param result Result to search.
+ * @param name Metric name.
+ * @return The metric or NULL.
+ */
+static const BenchMetric *findMetric(const BenchResult *result, const char *name) {
+    for (int i = 0; i < result->metricCount; ++i) {
+        if (strcmp(result->metrics[i].name, name) == 0) {
+            return &result->metrics[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Finds a metadata value.
+ * @param result Result to search.
+ * @param section Section of the entry.
+ * @param key Name of the entry.
+ * @return The value or NULL.
+ */
+static const char *findInfo(const BenchResult *result, BenchSection section, const char *key) {
+    for (int i = 0; i < result->infoCount; ++i) {
+        if (result->info[i].section == section && strcmp(result->info[i].key, key) == 0) {
+            return result->info[i].value;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Reads the CPU model name.
+ * @param dest Destination.
+ * @param size Size of the destination.
+ */
+static void cpuName(char *dest, size_t size) {
+    snprintf(dest, size, "unknown");
+#ifdef _WIN32
+    const char *id = getenv("PROCESSOR_IDENTIFIER");
+    if (id) {
+        copyText(dest, size, id);
+    }
+#else
+    FILE *file = fopen("/proc/cpuinfo", "r");
+    if (!file) {
+        return;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char *colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) == 0 && colon) {
+            copyText(dest, size, skipSpace(colon + 1));
+            dest[strcspn(dest, "\r\n")] = '\0';
+            break;
+        }
+    }
+    fclose(file);
+#endif
+}
+
+/**
+ * Fills in the machine section.
+ * @param result The result.
+ */
+static void collectMachine(BenchResult *result) {
+    char text[128];
+#ifdef _WIN32
+    DWORD size = sizeof(text);
+    if (!GetComputerNameA(text, &size)) {
+        snprintf(text, sizeof(text), "unknown");
+    }
+    benchresult_setInfo(result, BS_MACHINE, "host", text);
+    benchresult_setInfo(result, BS_MACHINE, "os", "Windows");
+
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int cores = (int) info.dwNumberOfProcessors;
+#else
+    if (gethostname(text, sizeof(text)) != 0) {
+        snprintf(text, sizeof(text), "unknown");
+    }
+    text[sizeof(text) - 1] = '\0';
+    benchresult_setInfo(result, BS_MACHINE, "host", text);
+
+    struct utsname name;
+    if (uname(&name) == 0) {
+        snprintf(text, sizeof(text), "%.32s %.48s %.32s", name.sysname, name.release, name.machine);
+        benchresult_setInfo(result, BS_MACHINE, "os", text);
+    }
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    cpuName(text, sizeof(text));
+    benchresult_setInfo(result, BS_MACHINE, "cpu", text);
+    snprintf(text, sizeof(text), "%d", cores);
+    benchresult_setInfo(result, BS_MACHINE, "cores", text);
+}
+
+/**
+ * Fills in the build section from the predefined macros.
+ * @param result The result.
+ */
+static void collectBuild(BenchResult *result) {
+    char text[128];
+#if defined(__clang__)
+    snprintf(text, sizeof(text), "clang %s", __clang_version__);
+#elif defined(__GNUC__)
+    snprintf(text, sizeof(text), "gcc %s", __VERSION__);
+#elif defined(_MSC_VER)
+    snprintf(text, sizeof(text), "msvc %d", _MSC_FULL_VER);
+#else
+    snprintf(text, sizeof(text), "unknown");
+#endif
+    benchresult_setInfo(result, BS_BUILD, "compiler", text);
+
+#ifdef NDEBUG
+    benchresult_setInfo(result, BS_BUILD, "type", "release");
+#else
+    benchresult_setInfo(result, BS_BUILD, "type", "debug");
+#endif
+
+    text[0] = '\0';
+#if defined(__OPTIMIZE__) || (defined(_MSC_VER) && defined(NDEBUG))
+    strcat(text, " optimized");
+#endif
+#ifdef __FAST_MATH__
+    strcat(text, " fast-math");
+#endif
+#if defined(__AVX2__)
+    strcat(text, " avx2");
+#elif defined(__AVX__)
+    strcat(text, " avx");
+#elif defined(__SSE4_1__)
+    strcat(text, " sse4.1");
+#endif
+#ifdef ALLOCTRACK_ENABLED
+    strcat(text, " alloctrack");
+#endif
+    benchresult_setInfo(result, BS_BUILD, "flags", text[0] ? text + 1 : "none");
+
+    snprintf(text, sizeof(text), "%d", INSTRUMENT_LEVEL);
+    benchresult_setInfo(result, BS_BUILD, "instrumentLevel", text);
+}
+
+/**
+ * Writes one metadata section.
+ * @param file Destination.
+ * @param result The result.
+ * @param section The section.
+ */
+static void writeSection(FILE *file, const BenchResult *result, BenchSection section) {
+    fprintf(file, "  \"%s\": {", g_sectionNames[section]);
+    bool first = true;
+    for (int i = 0; i < result->infoCount; ++i) {
+        const BenchInfo *info = &result->info[i];
+        if (info->section != section) {
+            continue;
+        }
+        fprintf(file, "%s\n    ", first ? "" : ",");
+        writeString(file, info->key);
+        fprintf(file, ": ");
+        if (isNumber(info->value)) {
+            fprintf(file, "%s", info->value);
+        } else {
+            writeString(file, info->value);
+        }
+        first = false;
+    }
+    fprintf(file, "%s},\n", first ? " " : "\n  ");
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void benchresult_init(BenchResult *result, const char *program, int argc, char **argv) {
+    memset(result, 0, sizeof(*result));
+    copyText(result->program, sizeof(result->program), program);
+
+    time_t now = time(NULL);
+    strftime(result->date, sizeof(result->date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    size_t len = 0;
+    for (int i = 1; i < argc && len < sizeof(result->args); ++i) {
+        len += snprintf(result->args + len, sizeof(result->args) - len, "%s%s", i > 1 ? " " : "", argv[i]);
+    }
+
+    collectMachine(result);
+    collectBuild(result);
+}
+
+void benchresult_free(BenchResult *result) {
+    for (int i = 0; i < result->metricCount; ++i) {
+        free(result->metrics[i].samples);
+    }
+    memset(result, 0, sizeof(*result));
+}
+
+void benchresult_setInfo(BenchResult *result, BenchSection section, const char *key, const char *value) {
+    int idx = 0;
+    while (idx < result->infoCount
+           && (result->info[idx].section != section || strcmp(result->info[idx].key, key) != 0)) {
+        ++idx;
+    }
+    if (idx == BENCHRESULT_MAX_INFO) {
+        return;
+    }
+    if (idx == result->infoCount) {
+        ++result->infoCount;
+    }
+
+    BenchInfo *info = &result->info[idx];
+    info->section = section;
+    copyText(info->key, sizeof(info->key), key);
+    copyText(info->value, sizeof(info->value), value);
+}
+
+void benchresult_add(BenchResult *result, const char *name, const char *unit, bool higherIsBetter,
+                     const double *samples, int count) {
+    assert(count > 0 && "A metric needs a sample");
+    if (result->metricCount >= BENCHRESULT_MAX_METRICS) {
+        return;
+    }
+
+    count = glm_imin(count, BENCHRESULT_MAX_SAMPLES);
+    double *copy = malloc(count * sizeof(double));
+    if (!copy) {
+        return;
+    }
+    memcpy(copy, samples, count * sizeof(double));
+
+    BenchMetric *m = &result->metrics[result->metricCount++];
+    copyText(m->name, sizeof(m->name), name);
+    copyText(m->unit, sizeof(m->unit), unit);
+    m->higherIsBetter = higherIsBetter;
+    m->samples = copy;
+    m->count = count;
+}
+
+void benchresult_addFloats(BenchResult *result, const char *name, const char *unit, bool higherIsBetter,
+                           const float *samples, int count) {
+    assert(count > 0 && "A metric needs a sample");
+    count = glm_imin(count, BENCHRESULT_MAX_SAMPLES);
+    double *converted = malloc(count * sizeof(double));
+    if (!converted) {
+        return;
+    }
+    for (int i = 0; i < count; ++i) {
+        converted[i] = samples[i];
+    }
+    benchresult_add(result, name, unit, higherIsBetter, converted, count);
+    free(converted);
+}
+
+bool benchresult_write(const BenchResult *result, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        printf("Failed to write '%s'!\n", path);
+        return false;
+    }
+
+    fprintf(file, "{\n  \"program\": ");
+    writeString(file, result->program);
+    fprintf(file, ",\n  \"date\": ");
+    writeString(file, result->date);
+    fprintf(file, ",\n  \"args\": ");
+    writeString(file, result->args);
+    fprintf(file, ",\n");
+    for (int s = 0; s < BS_COUNT; ++s) {
+        writeSection(file, result, (BenchSection) s);
+    }
+
+    fprintf(file, "  \"metrics\": [");
+    for (int i = 0; i < result->metricCount; ++i) {
+        const BenchMetric *m = &result->metrics[i];
+        double mean, stddev, min;
+        metricStats(m, &mean, &stddev, &min);
+
+        fprintf(file, "%s\n    { \"name\": ", i > 0 ? "," : "");
+        writeString(file, m->name);
+        fprintf(file, ", \"unit\": ");
+        writeString(file, m->unit);
+        fprintf(file, ", \"better\": \"%s\", \"mean\": %.6g, \"stddev\": %.6g, \"min\": %.6g,\n      \"samples\": [",
+                m->higherIsBetter ? "higher" : "lower", mean, stddev, min);
+        for (int j = 0; j < m->count; ++j) {
+            fprintf(file, "%s%.6g", j > 0 ? ", " : "", m->samples[j]);
+        }
+        fprintf(file, "] }");
+    }
+    fprintf(file, "%s]\n}\n", result->metricCount > 0 ? "\n  " : "");
+
+    bool ok = !ferror(file);
+    fclose(file);
+    if (!ok) {
+        printf("Failed to write '%s'!\n", path);
+    }
+    return ok;
+}
+
+bool benchresult_isResultFile(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    int c;
+    do {
+        c = fgetc(file);
+    } while (c != EOF && isspace(c));
+    fclose(file);
+    return c == '{';
+}
+
+bool benchresult_load(BenchResult *result, const char *path) {
+    memset(result, 0, sizeof(*result));
+    char *text = readFile(path);
+    if (!text) {
+        printf("Failed to open '%s'!\n", path);
+        return false;
+    }
+
+    const char *end = parseObject(text, parseResultMember, result);
+    free(text);
+    if (!end) {
+        printf("'%s' is no valid benchmark result!\n", path);
+        benchresult_free(result);
+        return false;
+    }
+    return true;
+}
+
+int benchresult_compare(const BenchResult *baseline, const BenchResult *result, double threshold) {
+    printf("Baseline %s of %s\n", baseline->program, baseline->date);
+    for (int i = 0; i < result->infoCount; ++i) {
+        const BenchInfo *info = &result->info[i];
+        const char *before = findInfo(baseline, info->section, info->key);
+        if (info->section != BS_CONFIG && before && strcmp(before, info->value) != 0) {
+            printf("  %s %s differs: baseline '%s', now '%s'\n",
+                   g_sectionNames[info->section], info->key, before, info->value);
+        }
+    }
+    printf("%-44s %-12s %18s %18s %8s  %s\n", "metric", "unit", "baseline", "current", "change", "verdict");
+
+    int regressed = 0, compared = 0;
+    for (int i = 0; i < result->metricCount; ++i) {
+        const BenchMetric *m = &result->metrics[i];
+        const BenchMetric *base = findMetric(baseline, m->name);
+        double mean, stddev;
+        metricStats(m, &mean, &stddev, NULL);
+        if (!base) {
+            printf("%-44s %-12s %18s %11.4g +-%4.1f%% %8s  new\n", m->name, m->unit, "-",
+                   mean, mean != 0.0 ? 100.0 * stddev / fabs(mean) : 0.0, "");
+            continue;
+        }
+
+        double baseMean, baseStddev;
+        metricStats(base, &baseMean, &baseStddev, NULL);
+        double change = baseMean != 0.0 ? 100.0 * (mean - baseMean) / fabs(baseMean) : 0.0;
+        double worse = m->higherIsBetter ? -change : change;
+
+        // A single run can't tell noise from change, the threshold alone decides
+        bool testable = m->count > 1 && base->count > 1;
+        const char *verdict;
+        if (!testable) {
+            verdict = worse > threshold ? "REGRESSED" : "untested";
+        } else if (!differs(m, base)) {
+            verdict = "same";
+        } else if (worse > threshold) {
+            verdict = "REGRESSED";
+        } else {
+            verdict = worse > 0.0 ? "worse" : "better";
+        }
+
+        printf("%-44s %-12s %11.4g +-%4.1f%% %11.4g +-%4.1f%% %+7.1f%%  %s\n", m->name, m->unit,
+               baseMean, baseMean != 0.0 ? 100.0 * baseStddev / fabs(baseMean) : 0.0,
+               mean, mean != 0.0 ? 100.0 * stddev / fabs(mean) : 0.0, change, verdict);
+        ++compared;
+        if (strcmp(verdict, "REGRESSED") == 0) {
+            fprintf(stderr, "FAIL %s: %.4g %s, baseline %.4g (%+.1f%%)\n", m->name, mean, m->unit, baseMean, change);
+            ++regressed;
+        }
+    }
+
+    for (int i = 0; i < baseline->metricCount; ++i) {
+        const BenchMetric *base = &baseline->metrics[i];
+        if (!findMetric(result, base->name)) {
+            double mean, stddev;
+            metricStats(base, &mean, &stddev, NULL);
+            printf("%-44s %-12s %11.4g +-%4.1f%% %18s %8s  missing\n", base->name, base->unit,
+                   mean, mean != 0.0 ? 100.0 * stddev / fabs(mean) : 0.0, "-", "");
+        }
+    }
+
+    printf("%d metrics compared, %d regressed by more than %.1f%%\n", compared, regressed, threshold);
+    return regressed;
+}
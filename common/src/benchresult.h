@@ -0,0 +1,169 @@
+/**
+ * @file benchresult.h
+ * @brief Benchmark results as JSON and their comparison against a baseline
+ *
+ * A result holds the samples of every metric of one benchmark run, e.g.
+ * the time per operation of every batch or of every repeated run, next to
+ * the machine and build it was measured on:
+ *
+ *     {
+ *       "program": "...", "date": "...", "args": "...",
+ *       "machine": { "host": ..., "os": ..., "cpu": ..., "cores": ... },
+ *       "build": { "compiler": ..., "type": ..., "flags": ..., "instrumentLevel": ... },
+ *       "config": { ... },
+ *       "metrics": [ { "name": ..., "unit": ..., "better": "lower",
+ *                      "mean": ..., "stddev": ..., "min": ..., "samples": [ ... ] }, ... ]
+ *     }
+ *
+ * Comparing a result to a baseline prints one line per metric with the
+ * relative change of the mean. Whether a change is more than noise is
+ * decided by Welch's t-test at 99% confidence over the samples of both
+ * sides. A metric regresses if it got worse by more than the
+ * threshold and the change is significant. Metrics with a single sample on
+ * either side can't be tested and regress on the threshold alone.
+ *
+ * The file is kept identical in all exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef BENCHRESULT_H
+#define BENCHRESULT_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Metrics of one result, later ones are dropped */
+#define BENCHRESULT_MAX_METRICS 256
+
+/** Samples of one metric, later ones are dropped */
+#define BENCHRESULT_MAX_SAMPLES 4096
+
+/** Entries of the machine, build and config sections together */
+#define BENCHRESULT_MAX_INFO 32
+
+/** Longest metric name, including the terminator */
+#define BENCHRESULT_NAME_LENGTH 96
+
+/** Default allowed slowdown against a baseline, in percent */
+#define BENCHRESULT_DEFAULT_THRESHOLD 5.0
+
+/**
+ * Sections of the metadata.
+ */
+typedef enum {
+    BS_MACHINE,
+    BS_BUILD,
+    BS_CONFIG,
+    BS_COUNT
+} BenchSection;
+
+/**
+ * One metadata entry, numbers are kept as their text.
+ */
+typedef struct {
+    BenchSection section;
+    char key[32];
+    char value[128];
+} BenchInfo;
+
+/**
+ * Samples of one metric.
+ */
+typedef struct {
+    char name[BENCHRESULT_NAME_LENGTH];
+    char unit[16];
+    bool higherIsBetter;
+    double *samples;
+    int count;
+} BenchMetric;
+
+/**
+ * A benchmark result, either measured or loaded.
+ */
+typedef struct {
+    char program[64];
+    char date[32];          // UTC, ISO 8601
+    char args[256];
+    BenchInfo info[BENCHRESULT_MAX_INFO];
+    int infoCount;
+    BenchMetric metrics[BENCHRESULT_MAX_METRICS];
+    int metricCount;
+} BenchResult;
+
+/**
+ * Starts an empty result and fills in the date, machine and build.
+ * @param result Result to initialize.
+ * @param program Name of the benchmark.
+ * @param argc Argument count, 0 if there are none.
+ * @param argv Arguments, joined into the args field.
+ */
+void benchresult_init(BenchResult *result, const char *program, int argc, char **argv);
+
+/**
+ * Frees the samples of a result.
+ * @param result The result, empty afterwards.
+ */
+void benchresult_free(BenchResult *result);
+
+/**
+ * Sets a metadata entry, replacing one with the same key.
+ * @param result The result.
+ * @param section Section of the entry.
+ * @param key Name of the entry.
+ * @param value Text of the value, written as a number if it is one.
+ */
+void benchresult_setInfo(BenchResult *result, BenchSection section, const char *key, const char *value);
+
+/**
+ * Adds a metric with its samples.
+ * @param result The result.
+ * @param name Name, unique within the result.
+ * @param unit Unit of the samples.
+ * @param higherIsBetter True for rates, false for times.
+ * @param samples Samples, copied.
+ * @param count Number of samples, at least one.
+ */
+void benchresult_add(BenchResult *result, const char *name, const char *unit, bool higherIsBetter,
+                     const double *samples, int count);
+
+/**
+ * Adds a metric with float samples, see benchresult_add.
+ */
+void benchresult_addFloats(BenchResult *result, const char *name, const char *unit, bool higherIsBetter,
+                           const float *samples, int count);
+
+/**
+ * Writes a result as JSON.
+ * @param result The result.
+ * @param path File name.
+ * @return False if the file can't be written.
+ */
+bool benchresult_write(const BenchResult *result, const char *path);
+
+/**
+ * Checks whether a file holds a JSON result, e.g. to tell it from
+ * an older text baseline.
+ * @param path File name.
+ * @return True if the file starts with a JSON object.
+ */
+bool benchresult_isResultFile(const char *path);
+
+/**
+ * Reads a result written by benchresult_write.
+ * @param result Destination, initialized by the call.
+ * @param path File name.
+ * @return False if the file can't be read or parsed, the reason was printed.
+ */
+bool benchresult_load(BenchResult *result, const char *path);
+
+/**
+ * Compares a result to a baseline and prints one line per metric,
+ * differences of the machine and build first.
+ * @param baseline The baseline.
+ * @param result The new result.
+ * @param threshold Allowed change for the worse, in percent.
+ * @return Number of regressed metrics.
+ */
+int benchresult_compare(const BenchResult *baseline, const BenchResult *result, double threshold);
+
+#endif // BENCHRESULT_H
@@ -0,0 +1,226 @@
+/**
+ * @file bigalloc.c
+ * @brief Implementation of the large array allocation
+ *
+ * A header of one cache line in front of every block records where the
+ * block came from. Heap blocks are over-allocated and aligned by hand.
+ * Mappings without MAP_HUGETLB are over-mapped by one huge page and
+ * trimmed, so the kernel can back them with transparent huge pages from
+ * the first byte on.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "bigalloc.h"
+#include "jobs.h"
+#include "alloctrack.h"
+
+#ifdef __linux__
+    #include <sys/mman.h>
+    #define BIGALLOC_MMAP
+#endif
+
+/** Bytes touched per first touch step, one small page */
+#define TOUCH_PAGE 4096
+
+/** Minimum small pages per first touch chunk */
+#define TOUCH_MIN_PAGES 64
+
+/**
+ * Placed right in front of every block, one cache line long.
+ */
+typedef union {
+    struct {
+        void *base;         // start of the heap block or mapping
+        size_t mapped;      // length of the mapping, 0 for heap blocks
+        size_t capacity;    // usable bytes behind the header
+    } info;
+    char pad[BIGALLOC_ALIGNMENT];
+} BlockHeader;
+
+/**
+ * Input of the parallel first touch of a new mapping.
+ */
+typedef struct {
+    char *dst;
+    const char *src;
+    size_t copyBytes;       // bytes of src copied to dst, the rest is only touched
+    size_t size;
+} TouchJob;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Returns the header of a block.
+ * @param ptr Block.
+ * @return Its header.
+ */
+static BlockHeader* header(void *ptr) {
+    return (BlockHeader*) ptr - 1;
+}
+
+/**
+ * Allocates a heap block with the header in front.
+ * @param size Usable bytes.
+ * @return The block, NULL on failure.
+ */
+static void* allocHeap(size_t size) {
+    char *base = malloc(sizeof(BlockHeader) + size + BIGALLOC_ALIGNMENT - 1);
+    if (!base) {
+        return NULL;
+    }
+
+    uintptr_t data = ((uintptr_t) base + sizeof(BlockHeader) + BIGALLOC_ALIGNMENT - 1)
+        & ~(uintptr_t) (BIGALLOC_ALIGNMENT - 1);
+    BlockHeader *h = (BlockHeader*) data - 1;
+    h->info.base = base;
+    h->info.mapped = 0;
+    h->info.capacity = size;
+    return (void*) data;
+}
+
+#ifdef BIGALLOC_MMAP
+/**
+ * Maps a block with the header in front, backed by huge pages if possible.
+ * @param size Usable bytes.
+ * @return The block, NULL if nothing could be mapped.
+ */
+static void* allocMapped(size_t size) {
+    size_t length = (sizeof(BlockHeader) + size + BIGALLOC_HUGE_PAGE - 1) / BIGALLOC_HUGE_PAGE * BIGALLOC_HUGE_PAGE;
+    char *base = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    // Only succeeds with pages reserved in /proc/sys/vm/nr_hugepages
+    base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+    if (base == MAP_FAILED) {
+        char *raw = mmap(NULL, length + BIGALLOC_HUGE_PAGE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            return NULL;
+        }
+
+        // Trims the mapping to a huge page aligned range
+        base = (char*) (((uintptr_t) raw + BIGALLOC_HUGE_PAGE - 1) & ~(uintptr_t) (BIGALLOC_HUGE_PAGE - 1));
+        if (base > raw) {
+            munmap(raw, base - raw);
+        }
+        size_t tail = (raw + length + BIGALLOC_HUGE_PAGE) - (base + length);
+        if (tail) {
+            munmap(base + length, tail);
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(base, length, MADV_HUGEPAGE);
+#endif
+    }
+
+    BlockHeader *h = (BlockHeader*) base;
+    h->info.base = base;
+    h->info.mapped = length;
+    h->info.capacity = length - sizeof(BlockHeader);
+    return h + 1;
+}
+#endif
+
+/**
+ * Copies and first touches a range of small pages of a new mapping.
+ * @param begin First page.
+ * @param end One past the last page.
+ * @param chunk Unused.
+ * @param userData The TouchJob.
+ */
+static void touchJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    const TouchJob *job = userData;
+    size_t first = (size_t) begin * TOUCH_PAGE;
+    size_t last = (size_t) end * TOUCH_PAGE;
+    if (last > job->size) last = job->size;
+
+    size_t copyEnd = last < job->copyBytes ? last : job->copyBytes;
+    if (copyEnd > first) {
+        memcpy(job->dst + first, job->src + first, copyEnd - first);
+    }
+    for (size_t p = copyEnd > first ? copyEnd : first; p < last; p += TOUCH_PAGE) {
+        job->dst[p] = 0;
+    }
+}
+
+/**
+ * Fills a new block with the old contents and touches the rest, in
+ * parallel for mapped blocks.
+ * @param dst New block.
+ * @param src Old block or NULL.
+ * @param copyBytes Bytes to copy from src.
+ * @param size Usable bytes of the new block that are touched.
+ */
+static void fillBlock(void *dst, const void *src, size_t copyBytes, size_t size) {
+    if (!header(dst)->info.mapped) {
+        if (copyBytes) {
+            memcpy(dst, src, copyBytes);
+        }
+        return;
+    }
+
+    // The header page was touched by the allocating thread already
+    TouchJob job = { dst, src, copyBytes, size };
+    int pages = (int) ((size + TOUCH_PAGE - 1) / TOUCH_PAGE);
+    jobs_parallelFor(pages, TOUCH_MIN_PAGES, touchJob, &job);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void* bigalloc_realloc(void *ptr, size_t size, const char *site) {
+    if (size == 0) {
+        bigalloc_free(ptr);
+        return NULL;
+    }
+
+#ifdef ALLOCTRACK_ENABLED
+    alloctrack_count(size, site ? site : ALLOCTRACK_SITE);
+#else
+    NK_UNUSED(site);
+#endif
+
+    // Mappings keep their room, a shrink to less than half gives it back
+    size_t oldCapacity = ptr ? header(ptr)->info.capacity : 0;
+    if (ptr && header(ptr)->info.mapped && size <= oldCapacity && size > oldCapacity / 2) {
+        return ptr;
+    }
+
+    void *block = NULL;
+#ifdef BIGALLOC_MMAP
+    if (size >= BIGALLOC_HUGE_THRESHOLD) {
+        block = allocMapped(size);
+    }
+#endif
+    if (!block) {
+        block = allocHeap(size);
+        if (!block) {
+            return NULL;
+        }
+    }
+
+    fillBlock(block, ptr, oldCapacity < size ? oldCapacity : size, size);
+    bigalloc_free(ptr);
+    return block;
+}
+
+void bigalloc_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+#ifdef ALLOCTRACK_ENABLED
+    alloctrack_countFree();
+#endif
+
+    BlockHeader *h = header(ptr);
+#ifdef BIGALLOC_MMAP
+    if (h->info.mapped) {
+        munmap(h->info.base, h->info.mapped);
+        return;
+    }
+#endif
+    free(h->info.base);
+}
@@ -0,0 +1,58 @@
+/**
+ * @file bigalloc.h
+ * @brief Allocation of large simulation arrays
+ *
+ * Every block is aligned to a cache line, so aligned SIMD loads work on
+ * the first element and no element of two arrays shares a line. Blocks
+ * from BIGALLOC_HUGE_THRESHOLD on are mapped on their own on Linux: with
+ * MAP_HUGETLB where huge pages are reserved, otherwise aligned to the huge
+ * page size and marked for transparent huge pages. Their pages are touched
+ * first by the job pool, split like jobs_parallelFor splits a loop over
+ * the block, so on NUMA machines the pages of a chunk tend to sit on the
+ * node of the worker that processes it. Other platforms use the heap.
+ *
+ * Blocks grow in place while the mapping has room. Blocks must be freed
+ * with bigalloc_free.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef BIGALLOC_H
+#define BIGALLOC_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Alignment of every block */
+#define BIGALLOC_ALIGNMENT 64
+
+/** Blocks from this size on are mapped separately and first touched in parallel */
+#define BIGALLOC_HUGE_THRESHOLD ((size_t) 2 << 20)
+
+/** Huge page size the mappings are rounded and aligned to */
+#define BIGALLOC_HUGE_PAGE ((size_t) 2 << 20)
+
+#ifdef ALLOCTRACK_ENABLED
+    #include "alloctrack.h"
+    /** Resizes a block, counted at the calling site with ALLOCTRACK_ENABLED */
+    #define BIG_REALLOC(ptr, size) bigalloc_realloc(ptr, size, ALLOCTRACK_SITE)
+#else
+    #define BIG_REALLOC(ptr, size) bigalloc_realloc(ptr, size, NULL)
+#endif
+
+/**
+ * Allocates, grows or shrinks a block like realloc, the contents up to the
+ * smaller size are kept. New bytes are undefined.
+ * @param ptr Block of bigalloc_realloc or NULL.
+ * @param size New size in bytes, 0 frees the block.
+ * @param site Counted under this name with ALLOCTRACK_ENABLED, may be NULL.
+ * @return The block aligned to BIGALLOC_ALIGNMENT, NULL for size 0 or on failure.
+ */
+void* bigalloc_realloc(void *ptr, size_t size, const char *site);
+
+/**
+ * Frees a block of bigalloc_realloc.
+ * @param ptr Block or NULL.
+ */
+void bigalloc_free(void *ptr);
+
+#endif // BIGALLOC_H
@@ -0,0 +1,31 @@
+/**
+ * @file fastmath.c
+ * @brief Batch versions of the fast approximations
+ *
+ * Plain loops over the inline versions. They have no dependencies
+ * between elements, so the compiler can vectorize them.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "fastmath.h"
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void fastmath_expBatch(const float *x, float *dest, int count) {
+    for (int i = 0; i < count; ++i) {
+        dest[i] = fastmath_exp(x[i]);
+    }
+}
+
+void fastmath_rsqrtBatch(const float *x, float *dest, int count) {
+    for (int i = 0; i < count; ++i) {
+        dest[i] = fastmath_rsqrt(x[i]);
+    }
+}
+
+void fastmath_normalizeBatch(vec3 *v, int count) {
+    for (int i = 0; i < count; ++i) {
+        fastmath_vec3_normalize(v[i], v[i]);
+    }
+}
@@ -0,0 +1,124 @@
+/**
+ * @file fastmath.h
+ * @brief Fast approximations of exp, rsqrt and normalize for the physics loops
+ *
+ * The scalar versions are inline and branch-free apart from the range
+ * clamps, so every step maps one to one onto SIMD lanes. The batch
+ * versions run them over arrays and are what the SIMD kernels replace.
+ *
+ * Accuracy against libm:
+ * - fastmath_exp: relative error below FASTMATH_EXP_MAX_REL_ERROR for
+ *   x in [FASTMATH_EXP_MIN, FASTMATH_EXP_MAX], the input is clamped to it.
+ * - fastmath_rsqrt: relative error below FASTMATH_RSQRT_MAX_REL_ERROR for
+ *   normal positive x. Starts from the SSE estimate on x86 and the
+ *   integer estimate elsewhere, both refined with one Newton step.
+ * - fastmath_vec3_normalize: length within FASTMATH_RSQRT_MAX_REL_ERROR of 1.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <fhwcg/fhwcg.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define FASTMATH_X86 1
+    #include <immintrin.h>
+#endif
+
+/** Input range of fastmath_exp, the result stays a normal float */
+#define FASTMATH_EXP_MIN -87.0f
+#define FASTMATH_EXP_MAX 88.0f
+
+/** Documented error bounds, checked by the benchmark */
+#define FASTMATH_EXP_MAX_REL_ERROR 2e-7f
+#ifdef FASTMATH_X86
+    #define FASTMATH_RSQRT_MAX_REL_ERROR 5e-7f
+#else
+    #define FASTMATH_RSQRT_MAX_REL_ERROR 2e-3f
+#endif
+
+/** Vectors shorter than this are normalized to zero */
+#define FASTMATH_MIN_LENGTH 1e-5f
+
+/**
+ * exp(x) from 2^n * p(r) with x = n * ln2 + r, |r| <= ln2 / 2
+ * and a degree 7 polynomial (Cephes coefficients).
+ * @param x Exponent, clamped to [FASTMATH_EXP_MIN, FASTMATH_EXP_MAX].
+ * @return Approximation of exp(x).
+ */
+static inline float fastmath_exp(float x) {
+    x = x < FASTMATH_EXP_MIN ? FASTMATH_EXP_MIN : (x > FASTMATH_EXP_MAX ? FASTMATH_EXP_MAX : x);
+
+    // ln2 in two parts, so r keeps its low bits
+    float n = floorf(x * 1.44269504f + 0.5f);
+    float r = x - n * 0.693359375f;
+    r = r + n * 2.12194440e-4f;
+
+    float p = 1.9875691500e-4f;
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    p = p * r * r + r + 1.0f;
+
+    // 2^n straight into the exponent bits
+    union { int32_t i; float f; } scale = { .i = ((int32_t)n + 127) << 23 };
+    return p * scale.f;
+}
+
+/**
+ * 1 / sqrt(x) with one Newton step.
+ * @param x Positive input, 0 gives a large but finite result on x86 only.
+ * @return Approximation of 1 / sqrt(x).
+ */
+static inline float fastmath_rsqrt(float x) {
+#ifdef FASTMATH_X86
+    float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+#else
+    union { float f; int32_t i; } bits = { .f = x };
+    bits.i = 0x5f375a86 - (bits.i >> 1);
+    float y = bits.f;
+#endif
+    return y * (1.5f - 0.5f * x * y * y);
+}
+
+/**
+ * Normalizes a vector, vectors shorter than FASTMATH_MIN_LENGTH become zero.
+ * @param v Vector to normalize.
+ * @param dest Destination, may be v.
+ */
+static inline void fastmath_vec3_normalize(const vec3 v, vec3 dest) {
+    float len2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+    float inv = len2 > FASTMATH_MIN_LENGTH * FASTMATH_MIN_LENGTH ? fastmath_rsqrt(len2) : 0.0f;
+    dest[0] = v[0] * inv;
+    dest[1] = v[1] * inv;
+    dest[2] = v[2] * inv;
+}
+
+/**
+ * Computes exp for every element.
+ * @param x Exponents.
+ * @param dest Destination, may be x.
+ * @param count Number of elements.
+ */
+void fastmath_expBatch(const float *x, float *dest, int count);
+
+/**
+ * Computes 1 / sqrt for every element.
+ * @param x Positive inputs.
+ * @param dest Destination, may be x.
+ * @param count Number of elements.
+ */
+void fastmath_rsqrtBatch(const float *x, float *dest, int count);
+
+/**
+ * Normalizes every vector in place, see fastmath_vec3_normalize.
+ * @param v Vectors to normalize.
+ * @param count Number of vectors.
+ */
+void fastmath_normalizeBatch(vec3 *v, int count);
+
+#endif // FASTMATH_H
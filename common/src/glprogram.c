@@ -0,0 +1,228 @@
+/**
+ * @file glprogram.c
+ * @brief Implementation of the GL programs
+ *
+ * The uniform locations are kept in a small array per program, searched
+ * by the hash of the name. A program has few uniforms, so a linear search
+ * beats a table. Names the program lacks are cached with location -1, a
+ * setter then skips the GL call.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "glprogram.h"
+#include "alloctrack.h"
+
+/**
+ * A cached uniform location.
+ */
+typedef struct {
+    uint64_t hash;      // of the name
+    char *name;
+    GLint location;
+} UniformSlot;
+
+struct GlProgram {
+    GLuint id;
+    bool stageFailed;   // a stage did not compile
+    bool linked;
+    UniformSlot *uniforms;
+    int uniformCount, uniformCapacity;
+};
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Hashes a uniform name.
+ * @param name The name.
+ * @return 64 bit FNV-1a of the name.
+ */
+static uint64_t hashName(const char *name) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const unsigned char *p = (const unsigned char*) name; *p; ++p) {
+        h = (h ^ *p) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+/**
+ * Frees the cached uniform locations.
+ * @param program The program.
+ */
+static void freeUniforms(GlProgram *program) {
+    for (int i = 0; i < program->uniformCount; ++i) {
+        TRACKED_FREE(program->uniforms[i].name);
+    }
+    TRACKED_FREE(program->uniforms);
+    program->uniforms = NULL;
+    program->uniformCount = program->uniformCapacity = 0;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+GlProgram* glprogram_create(void) {
+    GlProgram *program = TRACKED_CALLOC(1, sizeof(GlProgram));
+    assert(program && "calloc failed in glprogram_create");
+    program->id = glCreateProgram();
+    return program;
+}
+
+void glprogram_attachStage(GlProgram *program, GLuint stage) {
+    if (!stage) {
+        program->stageFailed = true;
+        return;
+    }
+    glAttachShader(program->id, stage);
+    // Only flagged while attached, freed with the program
+    glDeleteShader(stage);
+}
+
+bool glprogram_link(const char *name, GlProgram *program) {
+    if (program->stageFailed) {
+        printf("Program %s not linked, a stage did not compile\n", name);
+        return false;
+    }
+
+    glLinkProgram(program->id);
+    program->linked = shader_linkStatus(program->id);
+    if (program->linked) {
+        debug_labelObjectByType(GL_PROGRAM, program->id, name);
+    }
+    // Locations change with every link
+    freeUniforms(program);
+    return program->linked;
+}
+
+void glprogram_delete(GlProgram **program) {
+    if (!*program) {
+        return;
+    }
+    glDeleteProgram((*program)->id);
+    freeUniforms(*program);
+    TRACKED_FREE(*program);
+    *program = NULL;
+}
+
+GLuint glprogram_id(const GlProgram *program) {
+    return program->id;
+}
+
+GLint glprogram_location(GlProgram *program, const char *name) {
+    assert(program->linked && "uniform of a program that is not linked");
+
+    uint64_t hash = hashName(name);
+    for (int i = 0; i < program->uniformCount; ++i) {
+        const UniformSlot *slot = &program->uniforms[i];
+        if (slot->hash == hash && strcmp(slot->name, name) == 0) {
+            return slot->location;
+        }
+    }
+
+    if (program->uniformCount == program->uniformCapacity) {
+        int capacity = program->uniformCapacity ? program->uniformCapacity * 2 : 16;
+        UniformSlot *uniforms = TRACKED_REALLOC(program->uniforms, capacity * sizeof(UniformSlot));
+        assert(uniforms && "realloc failed in glprogram_location");
+        program->uniforms = uniforms;
+        program->uniformCapacity = capacity;
+    }
+
+    size_t length = strlen(name) + 1;
+    UniformSlot *slot = &program->uniforms[program->uniformCount++];
+    slot->hash = hash;
+    slot->name = TRACKED_MALLOC(length);
+    assert(slot->name && "malloc failed in glprogram_location");
+    memcpy(slot->name, name, length);
+    slot->location = glGetUniformLocation(program->id, name);
+    return slot->location;
+}
+
+void glprogram_setInt(GlProgram *program, const char *name, GLint value) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniform1i(location, value);
+    }
+}
+
+void glprogram_setUint(GlProgram *program, const char *name, GLuint value) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniform1ui(location, value);
+    }
+}
+
+void glprogram_setBool(GlProgram *program, const char *name, bool value) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniform1i(location, value);
+    }
+}
+
+void glprogram_setFloat(GlProgram *program, const char *name, GLfloat value) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniform1f(location, value);
+    }
+}
+
+void glprogram_setVec2(GlProgram *program, const char *name, vec2 *value) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniform2fv(location, 1, *value);
+    }
+}
+
+void glprogram_setVec3(GlProgram *program, const char *name, vec3 *value) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniform3fv(location, 1, *value);
+    }
+}
+
+void glprogram_setVec4(GlProgram *program, const char *name, vec4 *value) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniform4fv(location, 1, *value);
+    }
+}
+
+void glprogram_setMat3(GlProgram *program, const char *name, mat3 *value) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniformMatrix3fv(location, 1, GL_FALSE, (const GLfloat*) *value);
+    }
+}
+
+void glprogram_setMat4(GlProgram *program, const char *name, mat4 *value) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniformMatrix4fv(location, 1, GL_FALSE, (const GLfloat*) *value);
+    }
+}
+
+void glprogram_setIntN(GlProgram *program, const char *name, GLint *values, GLsizei count) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniform1iv(location, count, values);
+    }
+}
+
+void glprogram_setFloatN(GlProgram *program, const char *name, GLfloat *values, GLsizei count) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniform1fv(location, count, values);
+    }
+}
+
+void glprogram_setVec3N(GlProgram *program, const char *name, vec3 *values, GLsizei count) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniform3fv(location, count, (const GLfloat*) values);
+    }
+}
+
+void glprogram_setVec4N(GlProgram *program, const char *name, vec4 *values, GLsizei count) {
+    GLint location = glprogram_location(program, name);
+    if (location >= 0) {
+        glUniform4fv(location, count, (const GLfloat*) values);
+    }
+}
@@ -0,0 +1,87 @@
+/**
+ * @file glprogram.h
+ * @brief Shader programs built on the GL directly
+ *
+ * fhwcg only compiles stage files and hides the program name of its
+ * shaders. Programs whose stages come from the resource archive or carry
+ * variant defines (shadervariant.h) are built here with glCreateProgram,
+ * glAttachShader and glLinkProgram instead. The uniform setters mirror the
+ * ones of fhwcg, the locations are looked up once per program and name.
+ *
+ * Like with fhwcg, the setters need the program in use
+ * (glstate_useProgram). All functions must be called from the thread
+ * owning the GL context.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef GLPROGRAM_H
+#define GLPROGRAM_H
+
+#include <fhwcg/fhwcg.h>
+
+/** A program with its cached uniform locations */
+typedef struct GlProgram GlProgram;
+
+/**
+ * Creates an empty program, see shadervariant_attachFile for its stages.
+ * @return The program.
+ */
+GlProgram* glprogram_create(void);
+
+/**
+ * Links the attached stages. The stages stay attached, they are freed
+ * with the program.
+ * @param name Name of the program for the error log and the debug label.
+ * @param program The program.
+ * @return False if a stage failed or the program did not link.
+ */
+bool glprogram_link(const char *name, GlProgram *program);
+
+/**
+ * Deletes a program and sets the pointer to NULL.
+ * @param program The program, may point to NULL.
+ */
+void glprogram_delete(GlProgram **program);
+
+/**
+ * Returns the GL name of a program.
+ * @param program The program.
+ * @return The name as returned by glCreateProgram.
+ */
+GLuint glprogram_id(const GlProgram *program);
+
+/**
+ * Attaches a compiled stage, it is freed with the program.
+ * @param program The program.
+ * @param stage The stage, 0 if it failed to compile, the program does not link then.
+ */
+void glprogram_attachStage(GlProgram *program, GLuint stage);
+
+/**
+ * Returns the location of a uniform, cached after the first lookup.
+ * @param program The program, linked.
+ * @param name Name of the uniform.
+ * @return The location, -1 if the program has no such active uniform.
+ */
+GLint glprogram_location(GlProgram *program, const char *name);
+
+/*
+ * Uniform setters of the program in use, as the shader_set* of fhwcg.
+ * Names the program does not use are skipped.
+ */
+void glprogram_setInt(GlProgram *program, const char *name, GLint value);
+void glprogram_setUint(GlProgram *program, const char *name, GLuint value);
+void glprogram_setBool(GlProgram *program, const char *name, bool value);
+void glprogram_setFloat(GlProgram *program, const char *name, GLfloat value);
+void glprogram_setVec2(GlProgram *program, const char *name, vec2 *value);
+void glprogram_setVec3(GlProgram *program, const char *name, vec3 *value);
+void glprogram_setVec4(GlProgram *program, const char *name, vec4 *value);
+void glprogram_setMat3(GlProgram *program, const char *name, mat3 *value);
+void glprogram_setMat4(GlProgram *program, const char *name, mat4 *value);
+void glprogram_setIntN(GlProgram *program, const char *name, GLint *values, GLsizei count);
+void glprogram_setFloatN(GlProgram *program, const char *name, GLfloat *values, GLsizei count);
+void glprogram_setVec3N(GlProgram *program, const char *name, vec3 *values, GLsizei count);
+void glprogram_setVec4N(GlProgram *program, const char *name, vec4 *values, GLsizei count);
+
+#endif // GLPROGRAM_H
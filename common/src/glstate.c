@@ -0,0 +1,190 @@
+/**
+ * @file glstate.c
+ * @brief Implementation of the OpenGL state filter
+ *
+ * Every cached value may be unknown, in which case the next change is
+ * issued regardless of its value. The cache starts unknown and is reset
+ * at the start of every frame and after shader reloads.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "glstate.h"
+
+/** Cached value that is not known */
+#define STATE_UNKNOWN -1
+
+/**
+ * Cached capabilities.
+ */
+typedef enum {
+    CAP_BLEND,
+    CAP_CULL_FACE,
+    CAP_DEPTH_TEST,
+    CAP_COUNT
+} CachedCap;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global state cache.
+ */
+static struct {
+    int caps[CAP_COUNT];
+    GLint polygonMode;
+    GLint cullFace;
+    GLint depthFunc;
+    GLint depthMask;
+    GLint colorMask;
+    GLint vao;
+    const void *program;    // Shader or GlProgram in use
+    bool shaderKnown;
+
+    GlStateStats frame;
+    GlStateStats last;
+} g_state = {
+    .caps = {STATE_UNKNOWN, STATE_UNKNOWN, STATE_UNKNOWN},
+    .polygonMode = STATE_UNKNOWN,
+    .cullFace = STATE_UNKNOWN,
+    .depthFunc = STATE_UNKNOWN,
+    .depthMask = STATE_UNKNOWN,
+    .colorMask = STATE_UNKNOWN,
+    .vao = STATE_UNKNOWN
+};
+
+/**
+ * Maps a capability to its cache slot.
+ * @param cap The capability.
+ * @return Cache slot or -1 if it is not cached.
+ */
+static int capSlot(GLenum cap) {
+    switch (cap) {
+        case GL_BLEND: return CAP_BLEND;
+        case GL_CULL_FACE: return CAP_CULL_FACE;
+        case GL_DEPTH_TEST: return CAP_DEPTH_TEST;
+        default: return -1;
+    }
+}
+
+/**
+ * Updates a cached value and counts the change.
+ * @param cached The cached value.
+ * @param value The requested value.
+ * @return True if the change has to be issued.
+ */
+static bool changeState(GLint *cached, GLint value) {
+    if (*cached == value) {
+        g_state.frame.stateSkipped++;
+        return false;
+    }
+    *cached = value;
+    g_state.frame.stateChanges++;
+    return true;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void glstate_beginFrame(void) {
+    g_state.last = g_state.frame;
+    memset(&g_state.frame, 0, sizeof(GlStateStats));
+    glstate_invalidate();
+}
+
+void glstate_invalidate(void) {
+    for (int i = 0; i < CAP_COUNT; ++i) {
+        g_state.caps[i] = STATE_UNKNOWN;
+    }
+    g_state.polygonMode = STATE_UNKNOWN;
+    g_state.cullFace = STATE_UNKNOWN;
+    g_state.depthFunc = STATE_UNKNOWN;
+    g_state.depthMask = STATE_UNKNOWN;
+    g_state.colorMask = STATE_UNKNOWN;
+    g_state.vao = STATE_UNKNOWN;
+    g_state.shaderKnown = false;
+}
+
+void glstate_setEnabled(GLenum cap, bool enabled) {
+    int slot = capSlot(cap);
+    if (slot < 0) {
+        g_state.frame.stateChanges++;
+    } else if (!changeState(&g_state.caps[slot], enabled)) {
+        return;
+    }
+
+    if (enabled) {
+        glEnable(cap);
+    } else {
+        glDisable(cap);
+    }
+}
+
+void glstate_polygonMode(GLenum mode) {
+    if (changeState(&g_state.polygonMode, (GLint) mode)) {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+}
+
+void glstate_cullFace(GLenum face) {
+    if (changeState(&g_state.cullFace, (GLint) face)) {
+        glCullFace(face);
+    }
+}
+
+void glstate_depthFunc(GLenum func) {
+    if (changeState(&g_state.depthFunc, (GLint) func)) {
+        glDepthFunc(func);
+    }
+}
+
+void glstate_depthMask(bool write) {
+    if (changeState(&g_state.depthMask, write)) {
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+}
+
+void glstate_colorMask(bool write) {
+    if (changeState(&g_state.colorMask, write)) {
+        GLboolean w = write ? GL_TRUE : GL_FALSE;
+        glColorMask(w, w, w, w);
+    }
+}
+
+void glstate_bindVertexArray(GLuint vao) {
+    if (g_state.vao == (GLint) vao) {
+        g_state.frame.bindsSkipped++;
+        return;
+    }
+    g_state.vao = (GLint) vao;
+    g_state.frame.binds++;
+    glBindVertexArray(vao);
+}
+
+void glstate_forgetVertexArray(void) {
+    g_state.vao = STATE_UNKNOWN;
+}
+
+void glstate_useShader(Shader *shader) {
+    if (g_state.shaderKnown && g_state.program == shader) {
+        g_state.frame.bindsSkipped++;
+        return;
+    }
+    g_state.program = shader;
+    g_state.shaderKnown = true;
+    g_state.frame.binds++;
+    shader_useShader(shader);
+}
+
+void glstate_useProgram(GlProgram *program) {
+    if (g_state.shaderKnown && g_state.program == program) {
+        g_state.frame.bindsSkipped++;
+        return;
+    }
+    g_state.program = program;
+    g_state.shaderKnown = true;
+    g_state.frame.binds++;
+    glUseProgram(glprogram_id(program));
+}
+
+void glstate_getStats(GlStateStats *stats) {
+    *stats = g_state.last;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file glstate.h
+ * @brief Filter for redundant OpenGL state changes
+ *
+ * All rendering code sets capabilities, the polygon mode, the culled
+ * face, depth and color masks, the vertex array and the shader through
+ * this module. Changes
+ * to the value that is already set are skipped and counted, so the
+ * profiler can show how many state changes a frame really needed.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <fhwcg/fhwcg.h>
+#include "glprogram.h"
+
+/**
+ * State change counters of one frame.
+ */
+typedef struct {
+    int stateChanges, stateSkipped;
+    int binds, bindsSkipped;
+} GlStateStats;
+
+/**
+ * Starts a new frame: keeps the counters of the last frame and forgets
+ * the cached state, since the GUI changes it behind our back.
+ */
+void glstate_beginFrame(void);
+
+/**
+ * Forgets the cached state so the next change of every value is issued.
+ * Needed after code outside this module touched the state.
+ */
+void glstate_invalidate(void);
+
+/**
+ * Enables or disables a capability (glEnable/glDisable).
+ * Only GL_BLEND, GL_CULL_FACE and GL_DEPTH_TEST are cached,
+ * other capabilities are always passed through.
+ * @param cap The capability.
+ * @param enabled Whether it should be enabled.
+ */
+void glstate_setEnabled(GLenum cap, bool enabled);
+
+/**
+ * Sets the polygon mode for front and back faces.
+ * @param mode GL_FILL, GL_LINE or GL_POINT.
+ */
+void glstate_polygonMode(GLenum mode);
+
+/**
+ * Sets the faces that are culled.
+ * @param face GL_FRONT, GL_BACK or GL_FRONT_AND_BACK.
+ */
+void glstate_cullFace(GLenum face);
+
+/**
+ * Sets the depth comparison function.
+ * @param func GL_LESS, GL_EQUAL, ...
+ */
+void glstate_depthFunc(GLenum func);
+
+/**
+ * Enables or disables depth writes.
+ * @param write Whether depth is written.
+ */
+void glstate_depthMask(bool write);
+
+/**
+ * Enables or disables color writes for all channels.
+ * @param write Whether color is written.
+ */
+void glstate_colorMask(bool write);
+
+/**
+ * Binds a vertex array object.
+ * @param vao The vertex array, 0 unbinds.
+ */
+void glstate_bindVertexArray(GLuint vao);
+
+/**
+ * Marks the vertex array binding as unknown, after a library call
+ * (e.g. mesh_drawMesh) bound its own vertex array.
+ */
+void glstate_forgetVertexArray(void);
+
+/**
+ * Activates a shader.
+ * @param shader The shader.
+ */
+void glstate_useShader(Shader *shader);
+
+/**
+ * Activates a program built by glprogram.
+ * @param program The program.
+ */
+void glstate_useProgram(GlProgram *program);
+
+/**
+ * Returns the counters of the last finished frame.
+ * @param stats Destination for the counters.
+ */
+void glstate_getStats(GlStateStats *stats);
+
+#endif // GLSTATE_H
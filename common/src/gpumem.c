@@ -0,0 +1,280 @@
+/**
+ * @file gpumem.c
+ * @brief Implementation of the GPU memory accounting
+ *
+ * The tracked objects are few, a linear search finds them faster than a
+ * hash map would pay off. Buffers, textures and renderbuffers have separate
+ * name spaces, so the kind is part of the key.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "gpumem.h"
+#include "array.h"
+
+/**
+ * Name spaces of GL objects.
+ */
+typedef enum {
+    OK_BUFFER,
+    OK_TEXTURE,
+    OK_RENDERBUFFER
+} ObjectKind;
+
+/**
+ * One tracked object.
+ */
+typedef struct {
+    GLuint name;
+    ObjectKind kind;
+    GpuMemCategory category;
+    size_t bytes;
+} GpuMemObject;
+
+DEFINE_ARRAY_TYPE(GpuMemObject, ObjectArr)
+
+////////////////////////    LOCAL    ////////////////////////////
+
+static struct {
+    ObjectArr objects;
+    GpuMemStats stats;
+} g_mem = { 0 };
+
+static const char *const g_categoryNames[GPUMEM_COUNT] = {
+    "Geometry", "Instances", "Compute", "Staging", "Uniforms", "Textures", "Targets"
+};
+
+static const char *const g_kindNames[] = { "Buffer", "Texture", "Renderbuffer" };
+
+/**
+ * Finds a tracked object.
+ * @param kind Name space.
+ * @param name Object name.
+ * @return Index in the object array, -1 if not tracked.
+ */
+static long findObject(ObjectKind kind, GLuint name) {
+    for (size_t i = 0; i < g_mem.objects.size; ++i) {
+        if (g_mem.objects.data[i].name == name && g_mem.objects.data[i].kind == kind) {
+            return (long) i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Adds bytes to a category and raises the high-water marks.
+ * @param category The category.
+ * @param bytes Bytes added.
+ */
+static void addBytes(GpuMemCategory category, size_t bytes) {
+    GpuMemStats *s = &g_mem.stats;
+    s->bytes[category] += bytes;
+    s->totalBytes += bytes;
+    if (s->bytes[category] > s->peak[category]) {
+        s->peak[category] = s->bytes[category];
+    }
+    if (s->totalBytes > s->totalPeak) {
+        s->totalPeak = s->totalBytes;
+    }
+}
+
+/**
+ * Removes bytes from a category.
+ * @param category The category.
+ * @param bytes Bytes removed, at most what the category holds.
+ */
+static void removeBytes(GpuMemCategory category, size_t bytes) {
+    g_mem.stats.bytes[category] -= bytes;
+    g_mem.stats.totalBytes -= bytes;
+}
+
+/**
+ * Sets the size of an object, tracking it on first use.
+ * @param kind Name space.
+ * @param category Use of the object.
+ * @param name Object name, 0 is ignored.
+ * @param bytes New size.
+ */
+static void setObject(ObjectKind kind, GpuMemCategory category, GLuint name, size_t bytes) {
+    if (name == 0) {
+        return;
+    }
+
+    long idx = findObject(kind, name);
+    if (idx < 0) {
+        ObjectArr_push(&g_mem.objects, (GpuMemObject) {
+            .name = name, .kind = kind, .category = category, .bytes = 0
+        });
+        idx = (long) g_mem.objects.size - 1;
+    }
+
+    // The old store is gone once the new one exists, only the new size counts
+    GpuMemObject *o = &g_mem.objects.data[idx];
+    removeBytes(o->category, o->bytes);
+    o->category = category;
+    o->bytes = bytes;
+    addBytes(category, bytes);
+}
+
+/**
+ * Stops tracking deleted objects.
+ * @param kind Name space.
+ * @param n Number of objects.
+ * @param names Object names.
+ */
+static void forgetObjects(ObjectKind kind, GLsizei n, const GLuint *names) {
+    for (GLsizei i = 0; i < n; ++i) {
+        long idx = names[i] ? findObject(kind, names[i]) : -1;
+        if (idx >= 0) {
+            removeBytes(g_mem.objects.data[idx].category, g_mem.objects.data[idx].bytes);
+            ObjectArr_removeSwap(&g_mem.objects, (size_t) idx);
+        }
+    }
+}
+
+/**
+ * Gets the bytes per texel of an uncompressed format.
+ * @param format Sized internal format.
+ * @return Bytes per texel, 4 for unknown formats.
+ */
+static size_t texelBytes(GLenum format) {
+    switch (format) {
+        case GL_R8:
+            return 1;
+        case GL_RG8:
+        case GL_R16F:
+            return 2;
+        case GL_RGB8:
+            return 3;
+        case GL_RGB16F:
+            return 6;
+        case GL_RG32F:
+        case GL_RGBA16F:
+            return 8;
+        case GL_RGB32F:
+            return 12;
+        case GL_RGBA32F:
+            return 16;
+        default:
+            return 4;
+    }
+}
+
+/**
+ * Formats a size for the log and the GUI.
+ * @param buf Destination.
+ * @param size Size of buf.
+ * @param bytes The size.
+ */
+static void formatBytes(char *buf, size_t size, size_t bytes) {
+    if (bytes >= (1u << 20)) {
+        snprintf(buf, size, "%.1f MB", bytes / (1024.0 * 1024.0));
+    } else {
+        snprintf(buf, size, "%.1f KB", bytes / 1024.0);
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void gpumem_setBuffer(GpuMemCategory category, GLuint buffer, size_t bytes) {
+    setObject(OK_BUFFER, category, buffer, bytes);
+}
+
+void gpumem_setTexture(GpuMemCategory category, GLuint texture, size_t bytes) {
+    setObject(OK_TEXTURE, category, texture, bytes);
+}
+
+void gpumem_setRenderbuffer(GpuMemCategory category, GLuint renderbuffer, size_t bytes) {
+    setObject(OK_RENDERBUFFER, category, renderbuffer, bytes);
+}
+
+void gpumem_trackTexture(GpuMemCategory category, GLenum target, GLuint texture) {
+    glBindTexture(target, texture);
+
+    // The faces of a cube map are queried one by one, they all have the same size
+    GLenum levelTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+    size_t faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+
+    size_t bytes = 0;
+    for (int level = 0; level < 16; ++level) {
+        GLint width = 0, height = 0, depth = 0, compressed = GL_FALSE;
+        glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_WIDTH, &width);
+        if (width == 0) {
+            break;
+        }
+        glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_COMPRESSED, &compressed);
+
+        if (compressed) {
+            GLint size = 0;
+            glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            bytes += (size_t) size;
+        } else {
+            GLint format = 0;
+            glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_HEIGHT, &height);
+            glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_DEPTH, &depth);
+            glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_INTERNAL_FORMAT, &format);
+            bytes += gpumem_imageBytes((GLenum) format, width, height, depth);
+        }
+    }
+
+    glBindTexture(target, 0);
+    gpumem_setTexture(category, texture, bytes * faces);
+}
+
+size_t gpumem_imageBytes(GLenum format, int width, int height, int depth) {
+    return texelBytes(format) * (size_t) glm_imax(width, 0) * (size_t) glm_imax(height, 1)
+        * (size_t) glm_imax(depth, 1);
+}
+
+void gpumem_deleteBuffers(GLsizei n, const GLuint *buffers) {
+    forgetObjects(OK_BUFFER, n, buffers);
+    glDeleteBuffers(n, buffers);
+}
+
+void gpumem_deleteTextures(GLsizei n, const GLuint *textures) {
+    forgetObjects(OK_TEXTURE, n, textures);
+    glDeleteTextures(n, textures);
+}
+
+void gpumem_deleteRenderbuffers(GLsizei n, const GLuint *renderbuffers) {
+    forgetObjects(OK_RENDERBUFFER, n, renderbuffers);
+    glDeleteRenderbuffers(n, renderbuffers);
+}
+
+void gpumem_getStats(GpuMemStats *stats) {
+    *stats = g_mem.stats;
+    stats->objects = (int) g_mem.objects.size;
+}
+
+const char* gpumem_categoryName(GpuMemCategory category) {
+    return category < GPUMEM_COUNT ? g_categoryNames[category] : "Unknown";
+}
+
+void gpumem_report(void) {
+    char now[32], peak[32];
+    formatBytes(now, sizeof(now), g_mem.stats.totalBytes);
+    formatBytes(peak, sizeof(peak), g_mem.stats.totalPeak);
+    printf("GPU memory: %s in %d objects (peak %s)\n", now, (int) g_mem.objects.size, peak);
+
+    for (int i = 0; i < GPUMEM_COUNT; ++i) {
+        if (g_mem.stats.peak[i] == 0) {
+            continue;
+        }
+        formatBytes(now, sizeof(now), g_mem.stats.bytes[i]);
+        formatBytes(peak, sizeof(peak), g_mem.stats.peak[i]);
+        printf("  %-10s %10s (peak %s)\n", g_categoryNames[i], now, peak);
+    }
+}
+
+void gpumem_cleanup(void) {
+    gpumem_report();
+
+    for (size_t i = 0; i < g_mem.objects.size; ++i) {
+        const GpuMemObject *o = &g_mem.objects.data[i];
+        printf("GPU memory: %s %u (%s, %zu bytes) was not deleted\n",
+               g_kindNames[o->kind], o->name, g_categoryNames[o->category], o->bytes);
+    }
+
+    ObjectArr_free(&g_mem.objects);
+    memset(&g_mem.stats, 0, sizeof(g_mem.stats));
+}
@@ -0,0 +1,135 @@
+/**
+ * @file gpumem.h
+ * @brief Accounting of the GPU memory held by buffers and textures
+ *
+ * Every allocation site reports the size of the object it just created or
+ * resized, every deletion goes through the delete functions of this module.
+ * The sizes are summed per category with their high-water marks, so the
+ * profiler can show where the video memory goes and whether it only grows.
+ * Sizes are what the data needs, drivers may add padding and mip tails.
+ *
+ * All functions must be called from the thread owning the GL context.
+ * The file is kept identical in the 3D exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef GPUMEM_H
+#define GPUMEM_H
+
+#include <fhwcg/fhwcg.h>
+
+/**
+ * What an object is used for.
+ */
+typedef enum {
+    GPUMEM_GEOMETRY,    // vertex and index buffers of meshes, surfaces and lines
+    GPUMEM_INSTANCES,   // per instance attributes and draw commands
+    GPUMEM_COMPUTE,     // storage buffers of the simulations
+    GPUMEM_STAGING,     // pixel and readback buffers
+    GPUMEM_UNIFORMS,    // uniform buffers
+    GPUMEM_TEXTURES,    // sampled textures
+    GPUMEM_TARGETS,     // render targets
+    GPUMEM_COUNT
+} GpuMemCategory;
+
+/**
+ * Current and peak bytes per category.
+ */
+typedef struct {
+    size_t bytes[GPUMEM_COUNT];
+    size_t peak[GPUMEM_COUNT];
+    size_t totalBytes;
+    size_t totalPeak;   // highest sum, not the sum of the category peaks
+    int objects;
+} GpuMemStats;
+
+/**
+ * Sets the size of a buffer, replacing an earlier size of the same buffer.
+ * @param category Use of the buffer.
+ * @param buffer Buffer name.
+ * @param bytes Size of the data store.
+ */
+void gpumem_setBuffer(GpuMemCategory category, GLuint buffer, size_t bytes);
+
+/**
+ * Sets the size of a texture, replacing an earlier size of the same texture.
+ * @param category Use of the texture.
+ * @param texture Texture name.
+ * @param bytes Size of all levels and layers.
+ */
+void gpumem_setTexture(GpuMemCategory category, GLuint texture, size_t bytes);
+
+/**
+ * Sets the size of a renderbuffer, replacing an earlier size of the same renderbuffer.
+ * @param category Use of the renderbuffer.
+ * @param renderbuffer Renderbuffer name.
+ * @param bytes Size of the storage.
+ */
+void gpumem_setRenderbuffer(GpuMemCategory category, GLuint renderbuffer, size_t bytes);
+
+/**
+ * Sets the size of a texture from the levels it has on the GPU.
+ * Queries the texture, so call it once after uploading, not per frame.
+ * @param category Use of the texture.
+ * @param target GL_TEXTURE_2D, GL_TEXTURE_3D or GL_TEXTURE_CUBE_MAP.
+ * @param texture Texture name, the binding of target is changed.
+ */
+void gpumem_trackTexture(GpuMemCategory category, GLenum target, GLuint texture);
+
+/**
+ * Computes the size of an uncompressed image.
+ * @param format Sized internal format, unknown formats count 4 bytes per texel.
+ * @param width Width in texels.
+ * @param height Height in texels.
+ * @param depth Depth or layers, 1 for 2D images.
+ * @return Size in bytes.
+ */
+size_t gpumem_imageBytes(GLenum format, int width, int height, int depth);
+
+/**
+ * Deletes buffers and removes them from the accounting.
+ * @param n Number of buffers.
+ * @param buffers Buffer names, 0 is ignored.
+ */
+void gpumem_deleteBuffers(GLsizei n, const GLuint *buffers);
+
+/**
+ * Deletes textures and removes them from the accounting.
+ * @param n Number of textures.
+ * @param textures Texture names, 0 is ignored.
+ */
+void gpumem_deleteTextures(GLsizei n, const GLuint *textures);
+
+/**
+ * Deletes renderbuffers and removes them from the accounting.
+ * @param n Number of renderbuffers.
+ * @param renderbuffers Renderbuffer names, 0 is ignored.
+ */
+void gpumem_deleteRenderbuffers(GLsizei n, const GLuint *renderbuffers);
+
+/**
+ * Gets the current sizes and high-water marks.
+ * @param stats Destination.
+ */
+void gpumem_getStats(GpuMemStats *stats);
+
+/**
+ * Gets the display name of a category.
+ * @param category The category.
+ * @return Name for the GUI and the log.
+ */
+const char* gpumem_categoryName(GpuMemCategory category);
+
+/**
+ * Prints the sizes and high-water marks of all categories.
+ */
+void gpumem_report(void);
+
+/**
+ * Prints the final report, lists objects that were never deleted and
+ * frees the bookkeeping.
+ */
+void gpumem_cleanup(void);
+
+#endif // GPUMEM_H
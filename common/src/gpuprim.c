@@ -0,0 +1,673 @@
+/**
+ * @file gpuprim.c
+ * @brief Implementation of the compute shader building blocks
+ *
+ * Every primitive is a short sequence of dispatches with a storage barrier
+ * after each. Work groups beyond the dispatch limit of one dimension are
+ * spread over a second one, the shaders flatten the group index again.
+ *
+ * A scan needs one level of block totals per factor of 512 values, each
+ * level has its own scratch buffer. The radix sort counts the digits per
+ * tile, scans the counts with the scan and scatters, ping-ponging between
+ * the caller's buffers and a scratch pair.
+ *
+ * The parity check reads every result back, it stalls the pipeline and
+ * is only meant for GPUPRIM_CHECK runs.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "gpuprim.h"
+#include "gpumem.h"
+#include "glstate.h"
+#include "alloctrack.h"
+#include "rng.h"
+#include "glprogram.h"
+#include "shadervariant.h"
+#include "resarchive.h"
+
+/** Must match GROUP_SIZE in the gpuprim shaders */
+#define GROUP_SIZE 256
+
+/** Values scanned or reduced per work group, two per thread */
+#define BLOCK_SIZE (2 * GROUP_SIZE)
+
+/** Digits of a radix sort pass */
+#define RADIX (1 << GPUPRIM_RADIX_BITS)
+
+/** Levels of block totals, enough for BLOCK_SIZE^4 values */
+#define MAX_SCAN_LEVELS 4
+
+/** Work groups per dispatch dimension guaranteed by GL */
+#define MAX_GROUPS_X 65535
+
+/** Passes of scan.comp */
+#define SCAN_PASS_BLOCKS 0
+#define SCAN_PASS_ADD 1
+
+/** Passes of radixSort.comp */
+#define RADIX_PASS_COUNT 0
+#define RADIX_PASS_SCATTER 1
+
+/** Upper bound of a shader file path */
+#define MAX_PATH_LENGTH 256
+
+/** Relative error allowed between GPU and CPU float sums */
+#define CHECK_FLOAT_TOLERANCE 1e-4f
+
+/**
+ * Programs of the primitives.
+ */
+typedef enum {
+    PROGRAM_SCAN,
+    PROGRAM_REDUCE,
+    PROGRAM_COMPACT,
+    PROGRAM_RADIX_SORT,
+    PROGRAM_COUNT
+} ProgramId;
+
+/** Source file of every program, relative to the shader directory */
+static const char *g_programFiles[PROGRAM_COUNT] = {
+    [PROGRAM_SCAN] = "scan.comp",
+    [PROGRAM_REDUCE] = "reduce.comp",
+    [PROGRAM_COMPACT] = "compact.comp",
+    [PROGRAM_RADIX_SORT] = "radixSort.comp"
+};
+
+/**
+ * A scratch buffer that only grows.
+ */
+typedef struct {
+    GLuint buffer;
+    size_t bytes;
+} Scratch;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Programs and scratch buffers.
+ */
+static struct {
+    char shaderDir[MAX_PATH_LENGTH];
+    GlProgram *programs[PROGRAM_COUNT];
+    bool attempted[PROGRAM_COUNT];   // built once, successful or not
+
+    Scratch scanSums[MAX_SCAN_LEVELS];
+    Scratch reduce[2];
+    Scratch offsets;
+    Scratch sortKeys;
+    Scratch sortValues;
+    Scratch histogram;
+} g_prim = { 0 };
+
+/**
+ * Returns a program, building it on its first use.
+ * A program that failed to build is only tried again after a reload.
+ * @param id The program.
+ * @return The program, NULL if it did not build.
+ */
+static GlProgram* getProgram(ProgramId id) {
+    if (g_prim.programs[id] || g_prim.attempted[id]) {
+        return g_prim.programs[id];
+    }
+    g_prim.attempted[id] = true;
+
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s%s", g_prim.shaderDir, g_programFiles[id]);
+
+    GlProgram *program = glprogram_create();
+    shadervariant_attachFile(program, GL_COMPUTE_SHADER, path, 0, NULL);
+    if (!glprogram_link(g_programFiles[id], program)) {
+        glprogram_delete(&program);
+        return NULL;
+    }
+    g_prim.programs[id] = program;
+    return program;
+}
+
+/**
+ * Deletes all programs.
+ */
+static void deletePrograms(void) {
+    for (int i = 0; i < PROGRAM_COUNT; ++i) {
+        if (g_prim.programs[i]) {
+            // The address may be reused by the next program
+            glstate_invalidate();
+            glprogram_delete(&g_prim.programs[i]);
+        }
+        g_prim.programs[i] = NULL;
+        g_prim.attempted[i] = false;
+    }
+}
+
+/**
+ * Grows a scratch buffer to hold at least the given bytes.
+ * Contents are undefined after growing.
+ * @param scratch The scratch buffer.
+ * @param bytes Needed size.
+ * @return The buffer.
+ */
+static GLuint ensureScratch(Scratch *scratch, size_t bytes) {
+    if (bytes <= scratch->bytes && scratch->buffer) {
+        return scratch->buffer;
+    }
+
+    size_t size = scratch->bytes * 2 > bytes ? scratch->bytes * 2 : bytes;
+    if (!scratch->buffer) {
+        glGenBuffers(1, &scratch->buffer);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, scratch->buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr) size, NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    gpumem_setBuffer(GPUMEM_COMPUTE, scratch->buffer, size);
+    scratch->bytes = size;
+    return scratch->buffer;
+}
+
+/**
+ * Deletes a scratch buffer.
+ * @param scratch The scratch buffer.
+ */
+static void deleteScratch(Scratch *scratch) {
+    if (scratch->buffer) {
+        gpumem_deleteBuffers(1, &scratch->buffer);
+    }
+    scratch->buffer = 0;
+    scratch->bytes = 0;
+}
+
+/**
+ * Returns the number of blocks covering a count.
+ * @param count Number of values.
+ * @param block Values per block.
+ * @return Number of blocks.
+ */
+static int numBlocks(int count, int block) {
+    return (count + block - 1) / block;
+}
+
+/**
+ * Dispatches work groups, spread over two dimensions past the limit of
+ * one, and makes their writes visible to the next pass.
+ * @param groups Number of work groups, at least one.
+ */
+static void dispatch(int groups) {
+    int x = groups < MAX_GROUPS_X ? groups : MAX_GROUPS_X;
+    int y = numBlocks(groups, x);
+    glDispatchCompute((GLuint) x, (GLuint) y, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+/**
+ * Scans one level: the blocks, their totals one level down and then adds
+ * the scanned totals. The scan program must have been built.
+ * @param in Values to scan.
+ * @param out Destination, may be in.
+ * @param count Number of values, at least one.
+ * @param level Level of the block totals.
+ */
+static void scanLevel(GLuint in, GLuint out, int count, int level) {
+    assert(level < MAX_SCAN_LEVELS && "scan longer than MAX_SCAN_LEVELS levels of blocks");
+    GlProgram *program = g_prim.programs[PROGRAM_SCAN];
+    int groups = numBlocks(count, BLOCK_SIZE);
+    GLuint sums = ensureScratch(&g_prim.scanSums[level], groups * sizeof(GLuint));
+
+    glstate_useProgram(program);
+    glprogram_setInt(program, "u_pass", SCAN_PASS_BLOCKS);
+    glprogram_setUint(program, "u_count", (GLuint) count);
+    glprogram_setUint(program, "u_groups", (GLuint) groups);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, in);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, out);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, sums);
+    dispatch(groups);
+
+    if (groups == 1) {
+        return;
+    }
+
+    scanLevel(sums, sums, groups, level + 1);
+
+    // The level below changed the uniforms and bindings
+    glstate_useProgram(program);
+    glprogram_setInt(program, "u_pass", SCAN_PASS_ADD);
+    glprogram_setUint(program, "u_count", (GLuint) count);
+    glprogram_setUint(program, "u_groups", (GLuint) groups);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, out);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, sums);
+    dispatch(groups);
+}
+
+/**
+ * Writes one 32-bit value into a buffer.
+ * @param buffer Destination buffer.
+ * @param index Index of the value.
+ * @param value The value.
+ */
+static void writeValue(GLuint buffer, int index, GLuint value) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr) index * sizeof(GLuint), sizeof(GLuint), &value);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+/**
+ * Copies values between buffers on the GPU.
+ * @param src Source buffer.
+ * @param dest Destination buffer.
+ * @param count Number of 32-bit values.
+ */
+static void copyValues(GLuint src, GLuint dest, int count) {
+    glBindBuffer(GL_COPY_READ_BUFFER, src);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dest);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr) count * sizeof(GLuint));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+/**
+ * Creates a storage buffer for the parity check.
+ * @param data Initial contents, NULL leaves them undefined.
+ * @param count Number of 32-bit values.
+ * @return The buffer.
+ */
+static GLuint createCheckBuffer(const void *data, int count) {
+    GLuint buffer;
+    size_t bytes = (size_t) (count > 0 ? count : 1) * sizeof(GLuint);
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr) bytes, data, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    gpumem_setBuffer(GPUMEM_COMPUTE, buffer, bytes);
+    return buffer;
+}
+
+/**
+ * Reads 32-bit values back for the parity check, waits for the GPU.
+ * @param buffer Source buffer.
+ * @param dest Destination.
+ * @param count Number of values.
+ */
+static void readCheckBuffer(GLuint buffer, void *dest, int count) {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr) count * sizeof(GLuint), dest);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+/**
+ * Compares GPU and CPU values and prints the first mismatch.
+ * @param name Name of the primitive.
+ * @param count Number of values of the run.
+ * @param gpu Values of the GPU.
+ * @param cpu Expected values.
+ * @param n Number of values to compare.
+ * @return True if all values are equal.
+ */
+static bool compareValues(const char *name, int count, const GLuint *gpu, const GLuint *cpu, int n) {
+    for (int i = 0; i < n; ++i) {
+        if (gpu[i] != cpu[i]) {
+            printf("gpuprim check: %s of %d values differs at %d: %u instead of %u\n", name, count, i, gpu[i], cpu[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Key and original index, sorting them by both gives a stable sort.
+ */
+typedef struct {
+    GLuint key;
+    int index;
+} KeyIndex;
+
+/**
+ * Orders by key, then by original index.
+ * @param a First KeyIndex.
+ * @param b Second KeyIndex.
+ * @return Negative, zero or positive like strcmp.
+ */
+static int compareKeyIndex(const void *a, const void *b) {
+    const KeyIndex *ka = a, *kb = b;
+    if (ka->key != kb->key) {
+        return ka->key < kb->key ? -1 : 1;
+    }
+    return ka->index - kb->index;
+}
+
+/**
+ * Checks the reductions against the CPU.
+ * @param count Number of values.
+ * @param uints Random uints.
+ * @param floats Random floats.
+ * @return Number of mismatching operations.
+ */
+static int checkReduce(int count, const GLuint *uints, const float *floats) {
+    GLuint uintIn = createCheckBuffer(uints, count);
+    GLuint floatIn = createCheckBuffer(floats, count);
+    GLuint out = createCheckBuffer(NULL, GPUPRIM_OP_COUNT);
+
+    GLuint sum = 0, lo = 0xffffffffu, hi = 0;
+    double fsum = 0.0, fabsSum = 0.0;
+    float flo = INFINITY, fhi = -INFINITY;
+    for (int i = 0; i < count; ++i) {
+        sum += uints[i];
+        lo = uints[i] < lo ? uints[i] : lo;
+        hi = uints[i] > hi ? uints[i] : hi;
+        fsum += floats[i];
+        fabsSum += fabs(floats[i]);
+        flo = fminf(flo, floats[i]);
+        fhi = fmaxf(fhi, floats[i]);
+    }
+
+    for (int op = 0; op < GPUPRIM_OP_COUNT; ++op) {
+        bool isFloat = op >= GPUPRIM_SUM_FLOAT;
+        gpuprim_reduce(isFloat ? floatIn : uintIn, count, (GpuPrimOp) op, out, op);
+    }
+    GLuint result[GPUPRIM_OP_COUNT];
+    readCheckBuffer(out, result, GPUPRIM_OP_COUNT);
+
+    int failed = 0;
+    GLuint expected[] = { sum, lo, hi };
+    if (!compareValues("uint reduce", count, result, expected, 3)) {
+        ++failed;
+    }
+
+    float gpu[3];
+    memcpy(gpu, &result[GPUPRIM_SUM_FLOAT], sizeof(gpu));
+    float tolerance = (float) (fabsSum * CHECK_FLOAT_TOLERANCE) + 1e-6f;
+    if (fabsf(gpu[0] - (float) fsum) > tolerance || gpu[1] != flo || gpu[2] != fhi) {
+        printf("gpuprim check: float reduce of %d values gives %g %g %g instead of %g %g %g\n",
+            count, gpu[0], gpu[1], gpu[2], fsum, flo, fhi);
+        ++failed;
+    }
+
+    gpumem_deleteBuffers(1, &uintIn);
+    gpumem_deleteBuffers(1, &floatIn);
+    gpumem_deleteBuffers(1, &out);
+    return failed;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void gpuprim_init(const char *shaderDir) {
+    snprintf(g_prim.shaderDir, sizeof(g_prim.shaderDir), "%s", shaderDir);
+
+    const char *env = getenv("GPUPRIM_CHECK");
+    if (!env || !*env || strcmp(env, "0") == 0) {
+        return;
+    }
+
+    // Single blocks, partial blocks and every level of block totals
+    static const int sizes[] = { 1, 255, 256, 511, 512, 513, 4097, 262147, (1 << 20) + 7 };
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        failed += gpuprim_check(sizes[i], RNG_DEFAULT_SEED + i);
+    }
+    int extra = atoi(env);
+    if (extra > 1) {
+        failed += gpuprim_check(extra, RNG_DEFAULT_SEED);
+    }
+    printf("gpuprim check: %s\n", failed == 0 ? "all primitives match" : "MISMATCHES, see above");
+}
+
+void gpuprim_cleanup(void) {
+    deletePrograms();
+    for (int i = 0; i < MAX_SCAN_LEVELS; ++i) {
+        deleteScratch(&g_prim.scanSums[i]);
+    }
+    deleteScratch(&g_prim.reduce[0]);
+    deleteScratch(&g_prim.reduce[1]);
+    deleteScratch(&g_prim.offsets);
+    deleteScratch(&g_prim.sortKeys);
+    deleteScratch(&g_prim.sortValues);
+    deleteScratch(&g_prim.histogram);
+}
+
+void gpuprim_reload(void) {
+    deletePrograms();
+
+    // The archived sources may be older than the edited files
+    resarchive_invalidateKind(RES_SHADER);
+}
+
+bool gpuprim_scan(GLuint in, GLuint out, int count) {
+    assert(count >= 0 && "negative count");
+    if (!getProgram(PROGRAM_SCAN)) {
+        return false;
+    }
+    if (count > 0) {
+        scanLevel(in, out, count, 0);
+    }
+    return true;
+}
+
+bool gpuprim_reduce(GLuint in, int count, GpuPrimOp op, GLuint out, int outIndex) {
+    assert(count >= 0 && "negative count");
+    GlProgram *program = getProgram(PROGRAM_REDUCE);
+    if (!program) {
+        return false;
+    }
+
+    if (count == 0) {
+        static const GLuint identities[GPUPRIM_OP_COUNT] = {
+            [GPUPRIM_SUM_UINT] = 0u, [GPUPRIM_MIN_UINT] = 0xffffffffu, [GPUPRIM_MAX_UINT] = 0u,
+            [GPUPRIM_SUM_FLOAT] = 0u, [GPUPRIM_MIN_FLOAT] = 0x7f800000u, [GPUPRIM_MAX_FLOAT] = 0xff800000u
+        };
+        writeValue(out, outIndex, identities[op]);
+        return true;
+    }
+
+    glstate_useProgram(program);
+    glprogram_setInt(program, "u_op", (GLint) op);
+
+    // Every round leaves one value per block until a single block is left
+    GLuint src = in;
+    int remaining = count;
+    int target = 0;
+    for (;;) {
+        int groups = numBlocks(remaining, BLOCK_SIZE);
+        bool last = groups == 1;
+        GLuint dest = last ? out : ensureScratch(&g_prim.reduce[target], groups * sizeof(GLuint));
+
+        glprogram_setUint(program, "u_count", (GLuint) remaining);
+        glprogram_setUint(program, "u_groups", (GLuint) groups);
+        glprogram_setUint(program, "u_outIndex", last ? (GLuint) outIndex : 0u);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, src);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, dest);
+        dispatch(groups);
+
+        if (last) {
+            return true;
+        }
+        src = dest;
+        remaining = groups;
+        target = 1 - target;
+    }
+}
+
+bool gpuprim_compact(GLuint flags, GLuint values, int count, GLuint out, GLuint countBuffer, int countIndex) {
+    assert(count >= 0 && "negative count");
+    GlProgram *program = getProgram(PROGRAM_COMPACT);
+    if (!program || !getProgram(PROGRAM_SCAN)) {
+        return false;
+    }
+
+    if (count == 0) {
+        writeValue(countBuffer, countIndex, 0u);
+        return true;
+    }
+
+    GLuint offsets = ensureScratch(&g_prim.offsets, count * sizeof(GLuint));
+    scanLevel(flags, offsets, count, 0);
+
+    glstate_useProgram(program);
+    glprogram_setUint(program, "u_count", (GLuint) count);
+    glprogram_setUint(program, "u_countIndex", (GLuint) countIndex);
+    glprogram_setBool(program, "u_useValues", values != 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, flags);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, offsets);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, values ? values : flags);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, out);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, countBuffer);
+    dispatch(numBlocks(count, GROUP_SIZE));
+    return true;
+}
+
+bool gpuprim_sort(GLuint keys, GLuint values, int count, int bits) {
+    assert(count >= 0 && "negative count");
+    assert(bits > 0 && bits <= 32 && "key bits out of range");
+    GlProgram *program = getProgram(PROGRAM_RADIX_SORT);
+    if (!program || !getProgram(PROGRAM_SCAN)) {
+        return false;
+    }
+    if (count < 2) {
+        return true;
+    }
+
+    int groups = numBlocks(count, GROUP_SIZE);
+    GLuint histogram = ensureScratch(&g_prim.histogram, (size_t) RADIX * groups * sizeof(GLuint));
+    GLuint src[2] = { keys, values };
+    GLuint dest[2] = {
+        ensureScratch(&g_prim.sortKeys, count * sizeof(GLuint)),
+        values ? ensureScratch(&g_prim.sortValues, count * sizeof(GLuint)) : 0
+    };
+
+    int passes = numBlocks(bits, GPUPRIM_RADIX_BITS);
+    for (int pass = 0; pass < passes; ++pass) {
+        glstate_useProgram(program);
+        glprogram_setInt(program, "u_pass", RADIX_PASS_COUNT);
+        glprogram_setUint(program, "u_count", (GLuint) count);
+        glprogram_setUint(program, "u_groups", (GLuint) groups);
+        glprogram_setUint(program, "u_shift", (GLuint) (pass * GPUPRIM_RADIX_BITS));
+        glprogram_setBool(program, "u_useValues", values != 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, src[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, histogram);
+        dispatch(groups);
+
+        scanLevel(histogram, histogram, RADIX * groups, 0);
+
+        // The scan changed the program and bindings 0 to 2
+        glstate_useProgram(program);
+        glprogram_setInt(program, "u_pass", RADIX_PASS_SCATTER);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, src[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, values ? src[1] : src[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, dest[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, values ? dest[1] : dest[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, histogram);
+        dispatch(groups);
+
+        for (int i = 0; i < 2; ++i) {
+            GLuint swap = src[i];
+            src[i] = dest[i];
+            dest[i] = swap;
+        }
+    }
+
+    // An odd number of passes leaves the result in the scratch pair
+    if (src[0] != keys) {
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        copyValues(src[0], keys, count);
+        if (values) {
+            copyValues(src[1], values, count);
+        }
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    return true;
+}
+
+int gpuprim_check(int count, uint64_t seed) {
+    Rng rng;
+    rng_seed(&rng, seed);
+
+    GLuint *data = TRACKED_MALLOC(count * sizeof(GLuint));
+    GLuint *flags = TRACKED_MALLOC(count * sizeof(GLuint));
+    float *floats = TRACKED_MALLOC(count * sizeof(float));
+    GLuint *expected = TRACKED_MALLOC((count + 1) * sizeof(GLuint));
+    GLuint *result = TRACKED_MALLOC((count + 1) * sizeof(GLuint));
+    KeyIndex *pairs = TRACKED_MALLOC(count * sizeof(KeyIndex));
+    for (int i = 0; i < count; ++i) {
+        data[i] = rng_next(&rng);
+        flags[i] = rng_next(&rng) & 1u;
+        floats[i] = rng_range(&rng, -1.0f, 1.0f);
+    }
+
+    int failed = 0;
+    GLuint in = createCheckBuffer(data, count);
+    GLuint flagBuffer = createCheckBuffer(flags, count);
+    GLuint out = createCheckBuffer(NULL, count + 1);
+
+    // Scan
+    GLuint run = 0;
+    for (int i = 0; i < count; ++i) {
+        expected[i] = run;
+        run += data[i];
+    }
+    gpuprim_scan(in, out, count);
+    readCheckBuffer(out, result, count);
+    failed += !compareValues("scan", count, result, expected, count);
+
+    // Reductions
+    failed += checkReduce(count, data, floats) > 0;
+
+    // Compaction of the values, the count goes behind them
+    int kept = 0;
+    for (int i = 0; i < count; ++i) {
+        if (flags[i]) {
+            expected[kept++] = data[i];
+        }
+    }
+    expected[kept] = (GLuint) kept;
+    gpuprim_compact(flagBuffer, in, count, out, out, count);
+    readCheckBuffer(out, result, count + 1);
+    result[kept] = result[count];
+    failed += !compareValues("compact", count, result, expected, kept + 1);
+
+    // Sorts by all and by the low 10 bits, the values are the original indices
+    static const int sortBits[] = { 32, 10 };
+    for (int s = 0; s < 2; ++s) {
+        GLuint mask = sortBits[s] == 32 ? 0xffffffffu : (1u << sortBits[s]) - 1u;
+        for (int i = 0; i < count; ++i) {
+            pairs[i] = (KeyIndex) { data[i] & mask, i };
+            result[i] = (GLuint) i;
+        }
+        qsort(pairs, count, sizeof(KeyIndex), compareKeyIndex);
+
+        GLuint keys = createCheckBuffer(NULL, count);
+        GLuint indices = createCheckBuffer(result, count);
+        for (int i = 0; i < count; ++i) {
+            result[i] = data[i] & mask;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, keys);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr) count * sizeof(GLuint), result);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        gpuprim_sort(keys, indices, count, sortBits[s]);
+
+        readCheckBuffer(keys, result, count);
+        for (int i = 0; i < count; ++i) {
+            expected[i] = pairs[i].key;
+        }
+        bool ok = compareValues(sortBits[s] == 32 ? "sort keys" : "10 bit sort keys", count, result, expected, count);
+
+        readCheckBuffer(indices, result, count);
+        for (int i = 0; i < count; ++i) {
+            expected[i] = (GLuint) pairs[i].index;
+        }
+        ok = compareValues(sortBits[s] == 32 ? "sort values" : "10 bit sort values", count, result, expected, count) && ok;
+        failed += !ok;
+
+        gpumem_deleteBuffers(1, &keys);
+        gpumem_deleteBuffers(1, &indices);
+    }
+
+    gpumem_deleteBuffers(1, &in);
+    gpumem_deleteBuffers(1, &flagBuffer);
+    gpumem_deleteBuffers(1, &out);
+    TRACKED_FREE(data);
+    TRACKED_FREE(flags);
+    TRACKED_FREE(floats);
+    TRACKED_FREE(expected);
+    TRACKED_FREE(result);
+    TRACKED_FREE(pairs);
+    return failed;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file gpuprim.h
+ * @brief Compute shader building blocks: scan, reduction, compaction, radix sort
+ *
+ * Culling, neighbor grids, Morton orders and depth sorting all need the
+ * same few parallel steps over storage buffers of 32-bit values. They are
+ * implemented once here:
+ *
+ * - scan: work-efficient exclusive prefix sum (Blelloch), blocks of 512
+ *   values per work group, the block totals are scanned recursively
+ * - reduce: sum, min or max of uints or floats down to one value
+ * - compact: keeps the values or indices whose flag is set, in order,
+ *   and writes their count, e.g. into an indirect draw command
+ * - sort: stable LSD radix sort of uint keys with uint values,
+ *   4 bits per pass, only as many passes as the key bits need
+ *
+ * All buffers hold tightly packed 32-bit values starting at offset 0.
+ * The programs are built from the files in the shader directory on their
+ * first use, scratch buffers are grown on demand and kept. Storage buffer
+ * bindings 0 to 4 and the current program are changed by every call.
+ * Results are visible to later shader storage reads, other uses
+ * (attributes, indirect commands, copies) need their own barrier.
+ *
+ * GPUPRIM_CHECK=1 runs every primitive on random data of several sizes
+ * at init and compares it with a CPU implementation, GPUPRIM_CHECK=<n>
+ * adds a run of n values.
+ *
+ * All functions must be called from the thread owning the GL context.
+ * The file is kept identical in all exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef GPUPRIM_H
+#define GPUPRIM_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Bits sorted per radix sort pass */
+#define GPUPRIM_RADIX_BITS 4
+
+/**
+ * Operations of a reduction.
+ */
+typedef enum {
+    GPUPRIM_SUM_UINT,
+    GPUPRIM_MIN_UINT,
+    GPUPRIM_MAX_UINT,
+    GPUPRIM_SUM_FLOAT,
+    GPUPRIM_MIN_FLOAT,
+    GPUPRIM_MAX_FLOAT,
+    GPUPRIM_OP_COUNT
+} GpuPrimOp;
+
+/**
+ * Sets the directory of the programs and runs the parity check if
+ * GPUPRIM_CHECK is set. Call once the GL context exists.
+ * @param shaderDir Directory of scan.comp and the others, with a trailing slash.
+ */
+void gpuprim_init(const char *shaderDir);
+
+/**
+ * Deletes the programs and scratch buffers.
+ */
+void gpuprim_cleanup(void);
+
+/**
+ * Drops the programs, they are built again from their files on the next use,
+ * not from the resource archive.
+ */
+void gpuprim_reload(void);
+
+/**
+ * Exclusive prefix sum of uints, wrapping on overflow.
+ * Scanning count + 1 values with a trailing 0 puts the total at the end.
+ * @param in Values to scan.
+ * @param out Destination, may be in.
+ * @param count Number of values.
+ * @return False if the program could not be built.
+ */
+bool gpuprim_scan(GLuint in, GLuint out, int count);
+
+/**
+ * Reduces uints or floats to one value, which stays on the GPU.
+ * No values give the identity of the operation.
+ * @param in Values to reduce.
+ * @param count Number of values.
+ * @param op Operation and type of the values.
+ * @param out Destination buffer of the result.
+ * @param outIndex Index of the 32-bit result in out.
+ * @return False if the program could not be built.
+ */
+bool gpuprim_reduce(GLuint in, int count, GpuPrimOp op, GLuint out, int outIndex);
+
+/**
+ * Copies the values whose flag is 1 to the front of out, keeping their
+ * order, and writes how many there are.
+ * @param flags One uint per value, 0 or 1.
+ * @param values Values to keep, 0 keeps the indices instead.
+ * @param count Number of values.
+ * @param out Destination, at least as many values as are kept.
+ * @param countBuffer Destination of the kept count.
+ * @param countIndex Index of the 32-bit count in countBuffer.
+ * @return False if a program could not be built.
+ */
+bool gpuprim_compact(GLuint flags, GLuint values, int count, GLuint out, GLuint countBuffer, int countIndex);
+
+/**
+ * Sorts uint keys ascending, stable, moving the values along.
+ * The result ends up in keys and values again.
+ * @param keys Keys to sort.
+ * @param values One value per key, 0 sorts the keys only.
+ * @param count Number of keys.
+ * @param bits Low key bits to sort by, at most 32, higher bits are ignored.
+ * @return False if a program could not be built.
+ */
+bool gpuprim_sort(GLuint keys, GLuint values, int count, int bits);
+
+/**
+ * Runs every primitive on random data and compares it with a CPU
+ * implementation, printing one line per mismatch.
+ * @param count Number of values.
+ * @param seed Seed of the random data.
+ * @return Number of primitives that did not match.
+ */
+int gpuprim_check(int count, uint64_t seed);
+
+#endif // GPUPRIM_H
@@ -0,0 +1,228 @@
+/**
+ * @file guicache.c
+ * @brief Implementation of the GUI cache
+ *
+ * The GUI backend sets glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+ * on every draw, so no state set before gui_render reaches its blending.
+ * The target takes that blending as it is, see guicache.h for what the
+ * composite does with the alpha. The GUI is drawn last in the frame and
+ * its state changes are forgotten by the next frame anyway, so the
+ * composite sets its state directly as well.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "guicache.h"
+#include "gpumem.h"
+#include "headless.h"
+
+/** Weight of the newest frame in the reuse share */
+#define REUSE_SMOOTHING 0.05f
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Watched memory region.
+ */
+typedef struct {
+    const void *data;
+    size_t size;
+} GuiWatch;
+
+/**
+ * Target and rebuild state.
+ */
+static struct {
+    bool enabled;
+    float rate;
+    GLuint fbo, color;
+    GLuint vao;                 // empty, the composite triangle comes from gl_VertexID
+    int width, height;
+    bool valid;                 // the target holds the last built GUI
+    int inputFrames;            // frames left to rebuild after input
+    double lastBuild;
+    float reuse;
+
+    GuiWatch watches[GUICACHE_MAX_WATCHES];
+    int watchCount;
+    uint32_t watchHash;
+} g_cache = { .enabled = false, .rate = GUICACHE_DEFAULT_RATE };
+
+/**
+ * Hashes all watched regions.
+ * @return FNV-1a hash of their bytes.
+ */
+static uint32_t hashWatches(void) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < g_cache.watchCount; ++i) {
+        const unsigned char *bytes = g_cache.watches[i].data;
+        for (size_t b = 0; b < g_cache.watches[i].size; ++b) {
+            hash = (hash ^ bytes[b]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+/**
+ * Deletes the target, the next rebuild creates it again.
+ */
+static void deleteTarget(void) {
+    glDeleteFramebuffers(1, &g_cache.fbo);
+    gpumem_deleteTextures(1, &g_cache.color);
+    g_cache.fbo = g_cache.color = 0;
+    g_cache.width = g_cache.height = 0;
+    g_cache.valid = false;
+}
+
+/**
+ * Creates the target if it does not match the framebuffer size.
+ * @param width Framebuffer width.
+ * @param height Framebuffer height.
+ * @return False if the target is not complete.
+ */
+static bool ensureTarget(int width, int height) {
+    if (g_cache.fbo && g_cache.width == width && g_cache.height == height) {
+        return true;
+    }
+    deleteTarget();
+
+    glGenTextures(1, &g_cache.color);
+    glBindTexture(GL_TEXTURE_2D, g_cache.color);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    gpumem_setTexture(GPUMEM_TARGETS, g_cache.color, gpumem_imageBytes(GL_RGBA8, width, height, 1));
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &g_cache.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_cache.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, g_cache.color, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless_framebuffer());
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("GUI cache target incomplete (0x%x), drawing the GUI directly\n", status);
+        deleteTarget();
+        g_cache.enabled = false;
+        return false;
+    }
+
+    g_cache.width = width;
+    g_cache.height = height;
+    return true;
+}
+
+/**
+ * Checks whether the GUI has to be built this frame.
+ * @param now Current time in seconds.
+ * @return True for a rebuild, false to reuse the target.
+ */
+static bool needsRebuild(double now) {
+    uint32_t hash = hashWatches();
+    bool changed = hash != g_cache.watchHash;
+    g_cache.watchHash = hash;
+
+    bool due = g_cache.rate > 0.0f && now - g_cache.lastBuild >= 1.0 / g_cache.rate;
+    if (g_cache.inputFrames > 0) {
+        --g_cache.inputFrames;
+        return true;
+    }
+    return !g_cache.valid || changed || due;
+}
+
+/**
+ * Draws the GUI into the target.
+ * @param ctx Program context.
+ * @param func Function building the GUI content.
+ */
+static void buildTarget(ProgContext ctx, Fhwcg_Gui_Func func) {
+    // The clear color belongs to the scene
+    GLfloat clearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, g_cache.fbo);
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+    gui_render(ctx, func);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, headless_framebuffer());
+    g_cache.valid = true;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void guicache_onInput(void) {
+    g_cache.inputFrames = GUICACHE_GRACE_FRAMES;
+}
+
+void guicache_watch(const void *data, size_t size) {
+    assert(g_cache.watchCount < GUICACHE_MAX_WATCHES && "Too many watched GUI regions");
+    g_cache.watches[g_cache.watchCount++] = (GuiWatch) { data, size };
+}
+
+void guicache_render(ProgContext ctx, Fhwcg_Gui_Func func, GuiCompositeFn composite) {
+    int width, height;
+    window_getFramebufferSize(ctx, &width, &height);
+    if (!g_cache.enabled || width <= 0 || height <= 0 || !ensureTarget(width, height)) {
+        gui_render(ctx, func);
+        return;
+    }
+
+    double now = glfwGetTime();
+    bool rebuild = needsRebuild(now);
+    if (rebuild) {
+        buildTarget(ctx, func);
+        g_cache.lastBuild = now;
+    }
+    g_cache.reuse = glm_lerp(g_cache.reuse, rebuild ? 0.0f : 1.0f, REUSE_SMOOTHING);
+
+    glViewport(0, 0, width, height);
+    if (!composite(g_cache.color)) {
+        // Without the shader the cache cannot be shown
+        g_cache.enabled = false;
+        gui_render(ctx, func);
+        return;
+    }
+
+    if (!g_cache.vao) {
+        glGenVertexArrays(1, &g_cache.vao);
+    }
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_SCISSOR_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glBindVertexArray(g_cache.vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+}
+
+void guicache_setEnabled(bool enabled) {
+    g_cache.enabled = enabled;
+    g_cache.valid = false;
+}
+
+bool guicache_isEnabled(void) {
+    return g_cache.enabled;
+}
+
+void guicache_setRate(float rate) {
+    g_cache.rate = glm_max(rate, 0.0f);
+}
+
+float guicache_getRate(void) {
+    return g_cache.rate;
+}
+
+float guicache_getReuse(void) {
+    return g_cache.reuse;
+}
+
+void guicache_cleanup(void) {
+    deleteTarget();
+    glDeleteVertexArrays(1, &g_cache.vao);
+    g_cache.vao = 0;
+}
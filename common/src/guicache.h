@@ -0,0 +1,106 @@
+/**
+ * @file guicache.h
+ * @brief Reuse of the drawn GUI while nothing it shows changed
+ *
+ * gui_render builds the whole Nuklear command list and draws it every
+ * frame, which costs measurable CPU time at high frame rates. With the
+ * cache enabled the GUI is drawn into an offscreen target instead and only
+ * rebuilt after input, a change of a watched memory region, a resize or
+ * once per refresh interval. All other frames blend the target over the
+ * scene. The refresh interval keeps values the program changes by itself,
+ * like timings and counters, current at a lower rate than the scene.
+ *
+ * The GUI keeps its own blend state while it draws into the target, which
+ * is cleared to transparent black. The colors end up premultiplied, but
+ * the alpha of a layer is its coverage squared. The composite pass takes
+ * the square root of the alpha, which is exact for a single layer, like
+ * the antialiased border of a window. Over an opaque panel the alpha stays
+ * above 0.75, and the square root puts the coverage of antialiased text
+ * within 14 percent of the direct drawing.
+ *
+ * The composite pass belongs to the shaders of the exercise,
+ * guicache_render takes the function that activates it.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef GUICACHE_H
+#define GUICACHE_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Default GUI rebuilds per second without input, 0 only rebuilds on changes */
+#define GUICACHE_DEFAULT_RATE 30.0f
+
+/** Frames rebuilt after the last input, widgets may react a frame late */
+#define GUICACHE_GRACE_FRAMES 2
+
+/** Most memory regions watched at once */
+#define GUICACHE_MAX_WATCHES 8
+
+/**
+ * Marks the GUI for a rebuild, call from every input callback.
+ */
+void guicache_onInput(void);
+
+/**
+ * Watches a memory region, a change of its bytes rebuilds the GUI.
+ * Meant for state the GUI shows that the program changes by itself.
+ * @param data Start of the region, must stay valid.
+ * @param size Size in bytes.
+ */
+void guicache_watch(const void *data, size_t size);
+
+/**
+ * Activates the composite pass and binds the cached GUI to unit 0.
+ * The pass outputs the color as is and the square root of the alpha.
+ * @param textureId Color texture of the cache.
+ * @return False if the pass is not available, the GUI is drawn directly then.
+ */
+typedef bool (*GuiCompositeFn)(GLuint textureId);
+
+/**
+ * Draws the GUI like gui_render, from the cache if nothing changed.
+ * Call at the same place as gui_render, with the default framebuffer bound.
+ * @param ctx Program context.
+ * @param func Function building the GUI content.
+ * @param composite Activates the composite pass of the exercise.
+ */
+void guicache_render(ProgContext ctx, Fhwcg_Gui_Func func, GuiCompositeFn composite);
+
+/**
+ * Enables or disables the cache, disabled the GUI is drawn directly.
+ * @param enabled True to reuse the drawn GUI.
+ */
+void guicache_setEnabled(bool enabled);
+
+/**
+ * Returns whether the cache is enabled.
+ * @return True if the drawn GUI is reused.
+ */
+bool guicache_isEnabled(void);
+
+/**
+ * Sets the rebuilds per second without input.
+ * @param rate Rebuilds per second, 0 to only rebuild on changes.
+ */
+void guicache_setRate(float rate);
+
+/**
+ * Returns the rebuilds per second without input.
+ * @return Rebuilds per second.
+ */
+float guicache_getRate(void);
+
+/**
+ * Returns the share of the recent frames that reused the cache.
+ * @return Smoothed share in [0, 1].
+ */
+float guicache_getReuse(void);
+
+/**
+ * Deletes the target.
+ */
+void guicache_cleanup(void);
+
+#endif // GUICACHE_H
@@ -0,0 +1,173 @@
+/**
+ * @file headless.c
+ * @brief Implementation of the offscreen rendering
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "headless.h"
+#include "gpumem.h"
+
+/**
+ * State of the offscreen mode.
+ */
+static struct {
+    bool active;
+    int width;              // from HEADLESS, 0 keeps the program default
+    int height;
+    long frameLimit;        // from HEADLESS_FRAMES, 0 for no limit
+    long frames;
+
+    GLuint fbo;
+    GLuint color;
+    GLuint depth;
+    int targetWidth;
+    int targetHeight;
+} g_headless = { 0 };
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Checks whether an environment variable is set and not empty.
+ * @param name Name of the variable.
+ * @return True if it holds a value.
+ */
+static bool hasEnv(const char *name) {
+    const char *value = getenv(name);
+    return value && value[0];
+}
+
+/**
+ * Deletes the offscreen target.
+ */
+static void deleteTarget(void) {
+    if (!g_headless.fbo) {
+        return;
+    }
+    glDeleteFramebuffers(1, &g_headless.fbo);
+    GLuint renderbuffers[] = { g_headless.color, g_headless.depth };
+    gpumem_deleteRenderbuffers(2, renderbuffers);
+    g_headless.fbo = 0;
+    g_headless.color = 0;
+    g_headless.depth = 0;
+    g_headless.targetWidth = 0;
+    g_headless.targetHeight = 0;
+}
+
+/**
+ * Creates a renderbuffer of the target.
+ * @param format Internal format.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @return The renderbuffer.
+ */
+static GLuint createRenderbuffer(GLenum format, int width, int height) {
+    GLuint rb;
+    glGenRenderbuffers(1, &rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, format, width, height);
+    gpumem_setRenderbuffer(GPUMEM_TARGETS, rb, gpumem_imageBytes(format, width, height, 1));
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    return rb;
+}
+
+/**
+ * (Re)creates the offscreen target if the size changed.
+ * @param width Framebuffer width.
+ * @param height Framebuffer height.
+ */
+static void ensureTarget(int width, int height) {
+    if (g_headless.fbo && g_headless.targetWidth == width && g_headless.targetHeight == height) {
+        return;
+    }
+    deleteTarget();
+
+    g_headless.color = createRenderbuffer(GL_RGBA8, width, height);
+    g_headless.depth = createRenderbuffer(GL_DEPTH24_STENCIL8, width, height);
+
+    glGenFramebuffers(1, &g_headless.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_headless.fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, g_headless.color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, g_headless.depth);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    assert(status == GL_FRAMEBUFFER_COMPLETE && "headless target incomplete");
+    NK_UNUSED(status);
+
+    g_headless.targetWidth = width;
+    g_headless.targetHeight = height;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void headless_init(void) {
+    const char *mode = getenv("HEADLESS");
+    if (!mode || !mode[0] || strcmp(mode, "0") == 0) {
+        return;
+    }
+    g_headless.active = true;
+
+    int width, height;
+    if (sscanf(mode, "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+        g_headless.width = width;
+        g_headless.height = height;
+    }
+
+    const char *frames = getenv("HEADLESS_FRAMES");
+    if (frames && frames[0]) {
+        long limit = strtol(frames, NULL, 10);
+        g_headless.frameLimit = limit > 0 ? limit : 0;
+    }
+
+    // Without a display server the context comes from EGL, surfaceless
+    if (!hasEnv("DISPLAY") && !hasEnv("WAYLAND_DISPLAY")) {
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+        printf("Headless: no display, using EGL on the GLFW null platform\n");
+    }
+}
+
+void headless_cleanup(void) {
+    deleteTarget();
+    memset(&g_headless, 0, sizeof(g_headless));
+}
+
+bool headless_isActive(void) {
+    return g_headless.active;
+}
+
+void headless_windowSize(int *width, int *height) {
+    if (g_headless.width > 0) {
+        *width = g_headless.width;
+        *height = g_headless.height;
+    }
+}
+
+WindowFlags headless_windowFlags(WindowFlags flags) {
+    if (!g_headless.active) {
+        return flags;
+    }
+    flags &= ~(WINDOW_FLAGS_VSYNC | WINDOW_FLAGS_MAXIMIZED | WINDOW_FLAGS_FULLSCREEN);
+    return (WindowFlags) (flags | WINDOW_FLAGS_HEADLESS);
+}
+
+void headless_beginFrame(ProgContext ctx) {
+    if (!g_headless.active) {
+        return;
+    }
+
+    int width, height;
+    window_getFramebufferSize(ctx, &width, &height);
+    ensureTarget(glm_imax(width, 1), glm_imax(height, 1));
+    glBindFramebuffer(GL_FRAMEBUFFER, g_headless.fbo);
+}
+
+GLuint headless_framebuffer(void) {
+    return g_headless.fbo;
+}
+
+bool headless_endFrame(void) {
+    if (!g_headless.active) {
+        return true;
+    }
+    ++g_headless.frames;
+    return g_headless.frameLimit == 0 || g_headless.frames < g_headless.frameLimit;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file headless.h
+ * @brief Offscreen rendering on machines without a display
+ *
+ * HEADLESS=1 opens no visible window, HEADLESS=<width>x<height> sets the
+ * frame size as well. Without a display, neither DISPLAY nor
+ * WAYLAND_DISPLAY set, GLFW runs on its null platform, which creates the
+ * GL context through EGL without any surface. Otherwise a hidden GLFW
+ * window is used.
+ *
+ * In both cases the default framebuffer can't be relied on, so every frame
+ * is drawn into an FBO of the framebuffer size. Modules that would bind
+ * framebuffer 0 bind headless_framebuffer() instead, it is 0 with a
+ * visible window. Frame capture reads from that FBO as well.
+ *
+ * HEADLESS_FRAMES=<n> closes the window after n frames, a benchmark
+ * playback closes it on its own. Without HEADLESS every call costs one
+ * branch.
+ *
+ * The file is kept identical in all exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <fhwcg/fhwcg.h>
+
+/**
+ * Reads the mode from the environment and selects the GLFW platform.
+ * Call before the window is opened.
+ */
+void headless_init(void);
+
+/**
+ * Frees the offscreen target.
+ */
+void headless_cleanup(void);
+
+/**
+ * Checks whether the program runs offscreen.
+ * @return True with HEADLESS set.
+ */
+bool headless_isActive(void);
+
+/**
+ * Replaces the window size by the one of HEADLESS=<width>x<height>.
+ * @param width Window width, overwritten if a size was given.
+ * @param height Window height, overwritten if a size was given.
+ */
+void headless_windowSize(int *width, int *height);
+
+/**
+ * Returns the window flags to open the window with: offscreen the window
+ * is hidden, without vsync, not maximized and not fullscreen.
+ * @param flags Flags the program would use.
+ * @return The flags to use.
+ */
+WindowFlags headless_windowFlags(WindowFlags flags);
+
+/**
+ * Resizes the offscreen target to the framebuffer and binds it.
+ * Call once per frame before anything is drawn.
+ * @param ctx Program context.
+ */
+void headless_beginFrame(ProgContext ctx);
+
+/**
+ * Returns the framebuffer frames end up in.
+ * @return The offscreen target, 0 with a visible window.
+ */
+GLuint headless_framebuffer(void);
+
+/**
+ * Counts the frame against HEADLESS_FRAMES. Call once per frame after
+ * the buffer swap.
+ * @return False once the frame limit is reached and the window should close.
+ */
+bool headless_endFrame(void);
+
+#endif // HEADLESS_H
@@ -0,0 +1,133 @@
+/**
+ * @file hitch.c
+ * @brief Implementation of the hitch detector
+ *
+ * The frame times live in a ring of HITCH_WINDOW entries, the median is
+ * taken from a sorted copy every frame. The frame boundaries are kept as
+ * timer values, the dump starts at the boundary HITCH_DUMP_FRAMES frames
+ * back.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "hitch.h"
+#include "timeline.h"
+
+#include <time.h>
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global detector state.
+ */
+static struct {
+    bool enabled;
+    float factor;
+
+    float times[HITCH_WINDOW];
+    int timeCount;
+    int timePos;
+
+    uint64_t bounds[HITCH_DUMP_FRAMES + 1];     // timer values at the frame starts
+    int boundPos;
+
+    int cooldown;
+    int hitches;
+} g_hitch = { 0 };
+
+/**
+ * Orders frame times ascending.
+ */
+static int compareFloats(const void *a, const void *b) {
+    float fa = *(const float*) a;
+    float fb = *(const float*) b;
+    return (fa > fb) - (fa < fb);
+}
+
+/**
+ * Returns the median of the frame times in the window.
+ * @return Median in ms.
+ */
+static float median(void) {
+    float sorted[HITCH_WINDOW];
+    memcpy(sorted, g_hitch.times, g_hitch.timeCount * sizeof(float));
+    qsort(sorted, g_hitch.timeCount, sizeof(float), compareFloats);
+    return sorted[g_hitch.timeCount / 2];
+}
+
+/**
+ * Writes the timeline of the last frames to a timestamped file.
+ * @param frameMs Time of the hitch.
+ * @param medianMs Median it was compared against.
+ */
+static void dumpHitch(float frameMs, float medianMs) {
+    time_t now = time(NULL);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+
+    char path[96];
+    snprintf(path, sizeof(path), HITCH_FILE_PREFIX "%s_%02d_%.0fms.json",
+             stamp, g_hitch.hitches % 100, frameMs);
+    ++g_hitch.hitches;
+
+    // The oldest boundary is the start of the first written frame
+    uint64_t since = g_hitch.bounds[g_hitch.boundPos];
+    printf("Hitch: frame took %.1f ms, median %.1f ms\n", frameMs, medianMs);
+    timeline_dump(path, since);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void hitch_init(void) {
+    const char *config = getenv("HITCH_DETECT");
+    if (!config || !config[0]) {
+        return;
+    }
+
+    float factor = (float) atof(config);
+    g_hitch.factor = factor > 1.0f ? factor : HITCH_FACTOR;
+    g_hitch.enabled = true;
+
+    uint64_t now = glfwGetTimerValue();
+    for (int i = 0; i <= HITCH_DUMP_FRAMES; ++i) {
+        g_hitch.bounds[i] = now;
+    }
+
+    timeline_startRing();
+    printf("Hitch detection: frames over %.1fx the median are written to %s*.json\n",
+           g_hitch.factor, HITCH_FILE_PREFIX);
+}
+
+void hitch_frame(float frameMs) {
+    if (!g_hitch.enabled) {
+        return;
+    }
+
+    // The frame that just ended ends here, the oldest boundary starts the dump
+    g_hitch.bounds[g_hitch.boundPos] = glfwGetTimerValue();
+    g_hitch.boundPos = (g_hitch.boundPos + 1) % (HITCH_DUMP_FRAMES + 1);
+
+    if (frameMs <= 0.0f) {
+        return;
+    }
+
+    if (g_hitch.cooldown > 0) {
+        --g_hitch.cooldown;
+    } else if (g_hitch.timeCount == HITCH_WINDOW && timeline_isActive()) {
+        float medianMs = median();
+        if (frameMs > medianMs * g_hitch.factor && frameMs > medianMs + HITCH_MIN_MS) {
+            dumpHitch(frameMs, medianMs);
+            g_hitch.cooldown = HITCH_COOLDOWN_FRAMES;
+            // Leave the hitch out of the window, the median stays at the usual frame
+            return;
+        }
+    }
+
+    g_hitch.times[g_hitch.timePos] = frameMs;
+    g_hitch.timePos = (g_hitch.timePos + 1) % HITCH_WINDOW;
+    g_hitch.timeCount = glm_imin(g_hitch.timeCount + 1, HITCH_WINDOW);
+}
+
+bool hitch_isEnabled(void) {
+    return g_hitch.enabled;
+}
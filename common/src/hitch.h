@@ -0,0 +1,64 @@
+/**
+ * @file hitch.h
+ * @brief Detects frame hitches and dumps the timeline around them
+ *
+ * Every frame time is compared against the rolling median of the last
+ * HITCH_WINDOW frames. A frame longer than the median times the factor
+ * (and at least HITCH_MIN_MS longer) is a hitch: the timeline scopes of
+ * the last HITCH_DUMP_FRAMES frames are written to a timestamped
+ * HITCH_FILE_PREFIX file. The timeline runs as a ring capture for this,
+ * so the scopes of all threads are recorded all the time.
+ *
+ * Enabled by the HITCH_DETECT environment variable, which holds the
+ * factor, values of 1 or less use HITCH_FACTOR. Without it every call
+ * costs one branch.
+ *
+ * The file is kept identical in the 3D exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef HITCH_H
+#define HITCH_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Frames of the rolling median */
+#define HITCH_WINDOW 120
+
+/** Default threshold relative to the median */
+#define HITCH_FACTOR 3.0f
+
+/** Least a hitch exceeds the median by, so fast frames don't trigger on jitter */
+#define HITCH_MIN_MS 8.0f
+
+/** Frames written per hitch, the hitch is the last of them */
+#define HITCH_DUMP_FRAMES 30
+
+/** Frames after a hitch without detection, writing the dump hitches as well */
+#define HITCH_COOLDOWN_FRAMES 60
+
+/** Prefix of the written files, followed by date, time and frame time */
+#define HITCH_FILE_PREFIX "hitch_"
+
+/**
+ * Reads the factor from the environment and starts the ring capture.
+ * Call after timeline_setThreadName of the main thread.
+ */
+void hitch_init(void);
+
+/**
+ * Adds the time of the frame that just ended and dumps the timeline if
+ * it is a hitch. Call once per frame from the main thread, at the start
+ * of the next frame. Frames of 0 ms (after an idle sleep) are skipped.
+ * @param frameMs Time of the frame.
+ */
+void hitch_frame(float frameMs);
+
+/**
+ * Checks whether hitches are detected.
+ * @return True if enabled by the environment.
+ */
+bool hitch_isEnabled(void);
+
+#endif // HITCH_H
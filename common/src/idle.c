@@ -0,0 +1,80 @@
+/**
+ * @file idle.c
+ * @brief Implementation of the idle frame pacing
+ *
+ * A sleep that ends before the timeout was woken by an event, which is
+ * treated like activity, so widgets reacting one frame late still update.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "idle.h"
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Idle state.
+ */
+static struct {
+    bool enabled;
+    bool idle;
+    bool slept;         // the last wait slept, the next frame time includes it
+    int activeFrames;   // frames left before going idle
+    int held;           // keys and mouse buttons held down
+} g_idle = { true, false, false, IDLE_GRACE_FRAMES, 0 };
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void idle_onInput(int action) {
+    if (action == GLFW_PRESS) {
+        ++g_idle.held;
+    } else if (action == GLFW_RELEASE && g_idle.held > 0) {
+        --g_idle.held;
+    }
+    g_idle.activeFrames = IDLE_GRACE_FRAMES;
+}
+
+void idle_endFrame(bool busy) {
+    if (busy || !g_idle.enabled || g_idle.held > 0) {
+        g_idle.activeFrames = IDLE_GRACE_FRAMES;
+    } else if (g_idle.activeFrames > 0) {
+        --g_idle.activeFrames;
+    }
+    g_idle.idle = g_idle.activeFrames == 0;
+}
+
+void idle_wait(void) {
+    if (!g_idle.idle) {
+        return;
+    }
+
+    double start = glfwGetTime();
+    glfwWaitEventsTimeout(IDLE_TIMEOUT);
+    if (glfwGetTime() - start < IDLE_TIMEOUT) {
+        g_idle.activeFrames = IDLE_GRACE_FRAMES;
+    }
+    g_idle.slept = true;
+}
+
+float idle_frameTime(float dt) {
+    if (g_idle.slept) {
+        g_idle.slept = false;
+        return 0.0f;
+    }
+    return dt;
+}
+
+bool idle_isIdle(void) {
+    return g_idle.idle;
+}
+
+void idle_setEnabled(bool enabled) {
+    g_idle.enabled = enabled;
+    if (!enabled) {
+        g_idle.idle = false;
+    }
+}
+
+bool idle_isEnabled(void) {
+    return g_idle.enabled;
+}
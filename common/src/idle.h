@@ -0,0 +1,68 @@
+/**
+ * @file idle.h
+ * @brief Event-driven frame pacing while the scene is static
+ *
+ * Once the scene reports nothing to animate for IDLE_GRACE_FRAMES frames
+ * and no key or mouse button is held, the main loop sleeps in
+ * glfwWaitEventsTimeout instead of rendering continuously. Any event,
+ * state change or the timeout draws the next frame.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Longest sleep while idle in seconds, the GUI still refreshes at this rate */
+#define IDLE_TIMEOUT 0.5
+
+/** Frames drawn after the last activity before going idle */
+#define IDLE_GRACE_FRAMES 3
+
+/**
+ * Tracks held keys and mouse buttons, call from the key and mouse button callbacks.
+ * @param action GLFW_PRESS, GLFW_REPEAT or GLFW_RELEASE.
+ */
+void idle_onInput(int action);
+
+/**
+ * Ends a frame. The loop goes idle once the scene was static for
+ * IDLE_GRACE_FRAMES frames in a row.
+ * @param busy Whether the scene animates or waits for background work.
+ */
+void idle_endFrame(bool busy);
+
+/**
+ * Sleeps until an event arrives or IDLE_TIMEOUT passes if the loop is idle,
+ * call before window_startNewFrame.
+ */
+void idle_wait(void);
+
+/**
+ * Corrects the frame time for a sleep, so time-based updates do not jump.
+ * @param dt Time since the previous frame.
+ * @return 0 for the first frame after a sleep, dt otherwise.
+ */
+float idle_frameTime(float dt);
+
+/**
+ * Returns whether the loop is idle.
+ * @return True while the loop sleeps between frames.
+ */
+bool idle_isIdle(void);
+
+/**
+ * Enables or disables the idle mode.
+ * @param enabled False to render continuously.
+ */
+void idle_setEnabled(bool enabled);
+
+/**
+ * Returns whether the idle mode is enabled.
+ * @return True if the loop may sleep.
+ */
+bool idle_isEnabled(void);
+
+#endif // IDLE_H
@@ -0,0 +1,71 @@
+/**
+ * @file inputqueue.c
+ * @brief Implementation of the input event coalescing
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "inputqueue.h"
+
+/**
+ * Pending movement and held keys.
+ */
+static struct {
+    bool moved;
+    bool hasPosition;       // false until the first event, it has no movement
+    double x, y;
+    double dx, dy;
+    int events;
+    bool keys[GLFW_KEY_LAST + 1];
+} g_inputQueue = { 0 };
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void inputqueue_mouseMove(double x, double y) {
+    if (g_inputQueue.hasPosition) {
+        g_inputQueue.dx += x - g_inputQueue.x;
+        g_inputQueue.dy += y - g_inputQueue.y;
+    }
+    g_inputQueue.x = x;
+    g_inputQueue.y = y;
+    g_inputQueue.hasPosition = true;
+    g_inputQueue.moved = true;
+    ++g_inputQueue.events;
+}
+
+void inputqueue_flush(ProgContext ctx, InputMoveFn fn) {
+    if (!g_inputQueue.moved) {
+        return;
+    }
+
+    InputMove move = {
+        .x = (float) g_inputQueue.x,
+        .y = (float) g_inputQueue.y,
+        .dx = (float) g_inputQueue.dx,
+        .dy = (float) g_inputQueue.dy,
+        .events = g_inputQueue.events
+    };
+    g_inputQueue.moved = false;
+    g_inputQueue.dx = 0.0;
+    g_inputQueue.dy = 0.0;
+    g_inputQueue.events = 0;
+
+    fn(ctx, &move);
+}
+
+bool inputqueue_key(int key, int action) {
+    if (key < 0 || key > GLFW_KEY_LAST) {
+        return action != GLFW_REPEAT;
+    }
+
+    bool down = action != GLFW_RELEASE;
+    if (g_inputQueue.keys[key] == down) {
+        return false;
+    }
+    g_inputQueue.keys[key] = down;
+    return true;
+}
+
+bool inputqueue_isKeyDown(int key) {
+    return key >= 0 && key <= GLFW_KEY_LAST && g_inputQueue.keys[key];
+}
@@ -0,0 +1,71 @@
+/**
+ * @file inputqueue.h
+ * @brief Per-frame coalescing of mouse movement and key state
+ *
+ * High polling rate mice deliver many cursor events per frame. The
+ * callbacks only record them here, the handler runs once per frame with
+ * the last position and the movement summed over all events. A mouse
+ * button or key event flushes the pending movement first, so handlers
+ * still see the position a click happened at.
+ *
+ * Key events are checked against the held state: repeats and presses of
+ * held keys or releases of keys that are not held change nothing.
+ *
+ * All functions are called on the main thread, the callbacks run inside
+ * the event polling of window_startNewFrame.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef INPUTQUEUE_H
+#define INPUTQUEUE_H
+
+#include <fhwcg/fhwcg.h>
+
+/**
+ * Coalesced mouse movement since the last flush.
+ */
+typedef struct {
+    float x, y;     // last cursor position
+    float dx, dy;   // sum of the movements
+    int events;     // raw events merged into this one
+} InputMove;
+
+/**
+ * Handler of the coalesced mouse movement.
+ * @param ctx Program context.
+ * @param move The movement.
+ */
+typedef void (*InputMoveFn)(ProgContext ctx, const InputMove *move);
+
+/**
+ * Records a cursor position, call from the mouse movement callback.
+ * @param x Cursor x coordinate.
+ * @param y Cursor y coordinate.
+ */
+void inputqueue_mouseMove(double x, double y);
+
+/**
+ * Runs the handler once if the cursor moved since the last flush.
+ * Call once per frame before the logic and on every mouse button event.
+ * @param ctx Program context.
+ * @param fn Handler of the movement.
+ */
+void inputqueue_flush(ProgContext ctx, InputMoveFn fn);
+
+/**
+ * Records a key event in the held state.
+ * @param key GLFW key.
+ * @param action GLFW_PRESS, GLFW_REPEAT or GLFW_RELEASE.
+ * @return True if the event changes the held state of the key.
+ */
+bool inputqueue_key(int key, int action);
+
+/**
+ * Returns whether a key is held.
+ * @param key GLFW key.
+ * @return True between its press and release.
+ */
+bool inputqueue_isKeyDown(int key);
+
+#endif // INPUTQUEUE_H
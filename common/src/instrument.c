@@ -0,0 +1,33 @@
+/**
+ * @file instrument.c
+ * @brief Implementation of the instrumentation level
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "instrument.h"
+#include "timeline.h"
+
+int g_instrumentLevel = INSTRUMENT_LEVEL;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/** Level requested for the next frame */
+static int g_requestedLevel = INSTRUMENT_LEVEL;
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void instrument_setLevel(int level) {
+    g_requestedLevel = glm_imin(glm_imax(level, INSTRUMENT_OFF), INSTRUMENT_LEVEL);
+    if (g_requestedLevel < INSTRUMENT_FULL) {
+        timeline_stop();
+    }
+}
+
+int instrument_getLevel(void) {
+    return g_requestedLevel;
+}
+
+void instrument_beginFrame(void) {
+    g_instrumentLevel = g_requestedLevel;
+}
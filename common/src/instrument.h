@@ -0,0 +1,75 @@
+/**
+ * @file instrument.h
+ * @brief Instrumentation level of the profiler, debug labels and timeline
+ *
+ * Three tiers:
+ * - INSTRUMENT_OFF: nothing is recorded,
+ * - INSTRUMENT_LABELS: the profiler scopes only push GPU debug labels,
+ * - INSTRUMENT_FULL: labels, CPU and GPU scope timing and the timeline.
+ *
+ * INSTRUMENT_LEVEL is the highest tier compiled in, set by the
+ * INSTRUMENT_LEVEL cache variable of common.cmake. Below a tier its macros
+ * compile to nothing, at INSTRUMENT_OFF profiler_pushScope and
+ * profiler_popScope vanish as well, so hot loops can be instrumented
+ * freely. Up to the compiled tier the level can be lowered and raised at
+ * runtime, changes take effect with the next profiler_beginFrame so no
+ * scope is opened and closed at different levels.
+ *
+ * The quality governor, dynamic resolution, the frame pacer and the
+ * render benchmark measure through the profiler scopes. Below
+ * INSTRUMENT_FULL they see no work and hold their highest setting.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Instrumentation tiers */
+#define INSTRUMENT_OFF 0
+#define INSTRUMENT_LABELS 1
+#define INSTRUMENT_FULL 2
+
+#ifndef INSTRUMENT_LEVEL
+    #define INSTRUMENT_LEVEL INSTRUMENT_FULL
+#endif
+
+#if INSTRUMENT_LEVEL >= INSTRUMENT_LABELS
+    /** Whether a tier is active in the running frame */
+    #define INSTRUMENT_ACTIVE(tier) (g_instrumentLevel >= (tier))
+    /** Pushes a GPU debug label, name must be a string literal */
+    #define INSTRUMENT_PUSH_LABEL(name) \
+        do { if (INSTRUMENT_ACTIVE(INSTRUMENT_LABELS)) debug_pushRenderScope(name); } while (0)
+    /** Pops the innermost GPU debug label */
+    #define INSTRUMENT_POP_LABEL() \
+        do { if (INSTRUMENT_ACTIVE(INSTRUMENT_LABELS)) debug_popRenderScope(); } while (0)
+#else
+    #define INSTRUMENT_ACTIVE(tier) 0
+    #define INSTRUMENT_PUSH_LABEL(name) ((void) 0)
+    #define INSTRUMENT_POP_LABEL() ((void) 0)
+#endif
+
+/** Level of the running frame, read by the macros */
+extern int g_instrumentLevel;
+
+/**
+ * Requests a level for the next frames, clamped to INSTRUMENT_LEVEL.
+ * Lowering it below INSTRUMENT_FULL stops a running timeline capture.
+ * @param level One of the tiers.
+ */
+void instrument_setLevel(int level);
+
+/**
+ * Returns the requested level.
+ * @return The level the next frame runs at.
+ */
+int instrument_getLevel(void);
+
+/**
+ * Applies the requested level, called by profiler_beginFrame.
+ */
+void instrument_beginFrame(void);
+
+#endif // INSTRUMENT_H
@@ -0,0 +1,429 @@
+/**
+ * @file jobs.c
+ * @brief Implementation of the work-stealing thread pool
+ *
+ * Every worker owns a deque of work items: it pushes and pops at the
+ * bottom, idle threads steal from the top, so the oldest and usually
+ * largest pieces of work move. Deque 0 belongs to all threads outside
+ * the pool. The deques are guarded by one mutex each, the items are
+ * coarse enough that a lock-free deque would not pay off.
+ *
+ * A thread waiting for a loop or graph runs pending items until its
+ * counter drops to zero, so nested loops cannot deadlock. Workers sleep
+ * on a condition variable while no item is queued anywhere.
+ *
+ * Items remember the hardware counter phase of the thread that started
+ * the loop or submitted the graph, a thread running an item of another
+ * phase counts it in that phase.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "jobs.h"
+#include "timeline.h"
+#include "perfcount.h"
+#include "thread.h"
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+    #define THREAD_LOCAL __declspec(thread)
+    #define ATOMIC_ADD_FETCH(p, v) (_InterlockedExchangeAdd(p, v) + (v))
+#else
+    #define THREAD_LOCAL __thread
+    #define ATOMIC_ADD_FETCH(p, v) __sync_add_and_fetch(p, v)
+#endif
+
+/** Items per deque, a full deque runs further items right away */
+#define DEQUE_CAPACITY 256
+
+/**
+ * A chunk of a parallel loop or a graph task.
+ */
+typedef struct {
+    JobFn fn;
+    void *userData;
+    int begin, end, chunk;
+    volatile long *pending;     // chunks of the loop not finished yet
+    JobGraphTask *task;         // set for graph tasks instead
+    int perfPhase;              // phase of the thread that started the loop or graph
+} WorkItem;
+
+/**
+ * Deque of one thread, the indices only grow.
+ */
+typedef struct {
+    Mutex mutex;
+    WorkItem items[DEQUE_CAPACITY];
+    int top;                    // next item to steal
+    int bottom;                 // one past the newest item
+} WorkDeque;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global pool state.
+ */
+static struct {
+    Thread threads[JOBS_MAX_THREADS];
+    int threadCount;
+    bool running;
+
+    WorkDeque deques[JOBS_MAX_THREADS];
+    int dequeCount;             // fixed while the workers run, unlike the thread count
+    volatile long queued;       // items in all deques
+    volatile long sleepers;     // workers waiting for items
+    volatile long nextWorker;   // deque index of the next started worker
+
+    Mutex mutex;                // guards the sleep
+    Cond workCond;
+} g_pool = { 0 };
+
+/** Deque of the current thread, 0 outside the pool */
+static THREAD_LOCAL int t_deque = 0;
+
+/**
+ * Pushes an item onto the bottom of the deque of the current thread.
+ * @param item The item.
+ * @return False if the deque is full.
+ */
+static bool pushItem(const WorkItem *item) {
+    WorkDeque *d = &g_pool.deques[t_deque];
+    MUTEX_LOCK(&d->mutex);
+    bool full = d->bottom - d->top >= DEQUE_CAPACITY;
+    if (!full) {
+        d->items[d->bottom++ % DEQUE_CAPACITY] = *item;
+    }
+    MUTEX_UNLOCK(&d->mutex);
+    if (full) {
+        return false;
+    }
+
+    // Counted before the sleepers are read, a worker going to sleep reads them the other way round
+    ATOMIC_ADD_FETCH(&g_pool.queued, 1);
+    if (ATOMIC_LOAD(&g_pool.sleepers) > 0) {
+        MUTEX_LOCK(&g_pool.mutex);
+        COND_BROADCAST(&g_pool.workCond);
+        MUTEX_UNLOCK(&g_pool.mutex);
+    }
+    return true;
+}
+
+/**
+ * Takes an item from a deque.
+ * @param idx Index of the deque.
+ * @param steal Take the oldest item instead of the newest.
+ * @param item Destination for the item.
+ * @return False if the deque is empty.
+ */
+static bool takeItem(int idx, bool steal, WorkItem *item) {
+    WorkDeque *d = &g_pool.deques[idx];
+    MUTEX_LOCK(&d->mutex);
+    bool found = d->bottom > d->top;
+    if (found) {
+        *item = steal ? d->items[d->top++ % DEQUE_CAPACITY] : d->items[--d->bottom % DEQUE_CAPACITY];
+    }
+    MUTEX_UNLOCK(&d->mutex);
+
+    if (found) {
+        ATOMIC_ADD_FETCH(&g_pool.queued, -1);
+    }
+    return found;
+}
+
+/**
+ * Finds an item, first in the own deque, then in the others.
+ * @param item Destination for the item.
+ * @return False if no item is queued.
+ */
+static bool findItem(WorkItem *item) {
+    if (takeItem(t_deque, false, item)) {
+        return true;
+    }
+
+    for (int i = 1; i < g_pool.dequeCount; ++i) {
+        if (takeItem((t_deque + i) % g_pool.dequeCount, true, item)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void runItem(const WorkItem *item);
+
+/**
+ * Queues a graph task whose dependencies finished, runs it right away
+ * without a pool or if the deque is full.
+ * @param task The task.
+ */
+static void scheduleTask(JobGraphTask *task) {
+    WorkItem item = { .task = task, .perfPhase = task->graph->perfPhase };
+    if (!g_pool.running || !pushItem(&item)) {
+        runItem(&item);
+    }
+}
+
+/**
+ * Runs a graph task and releases the tasks waiting for it.
+ * @param task The task.
+ */
+static void runTask(JobGraphTask *task) {
+    if (task->loopFn) {
+        jobs_parallelFor(task->count, task->minChunk, task->loopFn, task->userData);
+    } else {
+        task->fn(task->userData);
+    }
+
+    JobGraph *graph = task->graph;
+    for (int i = 0; i < task->successorCount; ++i) {
+        JobGraphTask *next = &graph->tasks[task->successors[i]];
+        if (ATOMIC_ADD_FETCH(&next->waiting, -1) == 0) {
+            scheduleTask(next);
+        }
+    }
+    ATOMIC_ADD_FETCH(&graph->remaining, -1);
+}
+
+/**
+ * Runs a work item.
+ * @param item The item.
+ */
+static void runItem(const WorkItem *item) {
+    bool counted = item->perfPhase != PERFCOUNT_NONE && item->perfPhase != PERFCOUNT_CURRENT();
+    if (counted) {
+        perfcount_beginPhase(item->perfPhase);
+    }
+
+    if (item->task) {
+        runTask(item->task);
+    } else {
+        item->fn(item->begin, item->end, item->chunk, item->userData);
+    }
+
+    if (counted) {
+        PERFCOUNT_END();
+    }
+    if (!item->task) {
+        ATOMIC_ADD_FETCH(item->pending, -1);
+    }
+}
+
+/**
+ * Runs queued items until a counter dropped to zero.
+ * @param counter Counter decremented by other threads.
+ */
+static void helpUntilDone(volatile long *counter) {
+    WorkItem item;
+    while (ATOMIC_LOAD(counter) > 0) {
+        if (findItem(&item)) {
+            runItem(&item);
+        } else {
+            // The rest is running on other threads
+            THREAD_YIELD();
+        }
+    }
+}
+
+/**
+ * Worker thread main loop.
+ */
+static void workerLoop(void) {
+    WorkItem item;
+    while (true) {
+        if (findItem(&item)) {
+            TIMELINE_BEGIN("Jobs");
+            runItem(&item);
+            TIMELINE_END();
+            continue;
+        }
+
+        MUTEX_LOCK(&g_pool.mutex);
+        ATOMIC_ADD_FETCH(&g_pool.sleepers, 1);
+        while (g_pool.running && ATOMIC_LOAD(&g_pool.queued) == 0) {
+            COND_WAIT(&g_pool.workCond, &g_pool.mutex);
+        }
+        ATOMIC_ADD_FETCH(&g_pool.sleepers, -1);
+        bool running = g_pool.running;
+        MUTEX_UNLOCK(&g_pool.mutex);
+
+        if (!running) {
+            break;
+        }
+    }
+}
+
+/**
+ * Worker thread entry.
+ */
+static THREAD_ENTRY(workerMain) {
+    NK_UNUSED(arg);
+    t_deque = (int) ATOMIC_ADD_FETCH(&g_pool.nextWorker, 1);
+    timeline_setThreadName("Worker");
+    workerLoop();
+    THREAD_RETURN;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void jobs_init(int threadCount) {
+    threadCount = glm_imin(glm_imax(threadCount, 1), JOBS_MAX_THREADS);
+
+    MUTEX_INIT(&g_pool.mutex);
+    COND_INIT(&g_pool.workCond);
+    for (int i = 0; i < threadCount; ++i) {
+        MUTEX_INIT(&g_pool.deques[i].mutex);
+        g_pool.deques[i].top = g_pool.deques[i].bottom = 0;
+    }
+    g_pool.queued = 0;
+    g_pool.sleepers = 0;
+    g_pool.nextWorker = 0;
+    g_pool.running = true;
+    g_pool.dequeCount = threadCount;
+
+    // Thread 0 stands for the callers outside the pool, its deque is shared
+    g_pool.threadCount = 1;
+    for (int i = 1; i < threadCount; ++i) {
+        if (!THREAD_CREATE(&g_pool.threads[i], workerMain)) {
+            printf("Could not create worker thread %d!\n", i);
+            break;
+        }
+        g_pool.threadCount++;
+    }
+}
+
+void jobs_cleanup(void) {
+    MUTEX_LOCK(&g_pool.mutex);
+    g_pool.running = false;
+    COND_BROADCAST(&g_pool.workCond);
+    MUTEX_UNLOCK(&g_pool.mutex);
+
+    for (int i = 1; i < g_pool.threadCount; ++i) {
+        THREAD_JOIN(g_pool.threads[i]);
+    }
+
+    for (int i = 0; i < g_pool.dequeCount; ++i) {
+        MUTEX_DESTROY(&g_pool.deques[i].mutex);
+    }
+    COND_DESTROY(&g_pool.workCond);
+    MUTEX_DESTROY(&g_pool.mutex);
+    g_pool.threadCount = 0;
+}
+
+void jobs_setThreadCount(int threadCount) {
+    if (threadCount == g_pool.threadCount) {
+        return;
+    }
+
+    jobs_cleanup();
+    jobs_init(threadCount);
+}
+
+int jobs_getThreadCount(void) {
+    return g_pool.threadCount;
+}
+
+int jobs_getHardwareThreads(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int n = (int)info.dwNumberOfProcessors;
+#else
+    int n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return glm_imin(glm_imax(n, 1), JOBS_MAX_THREADS);
+}
+
+int jobs_chunkCount(int count, int minChunk) {
+    if (count <= 0) {
+        return 0;
+    }
+
+    int threads = (g_pool.threadCount > 0) ? g_pool.threadCount : 1;
+    int maxChunks = (count + minChunk - 1) / minChunk;
+    return (maxChunks < threads) ? maxChunks : threads;
+}
+
+void jobs_parallelFor(int count, int minChunk, JobFn fn, void *userData) {
+    int numChunks = jobs_chunkCount(count, minChunk);
+    if (numChunks == 0) {
+        return;
+    }
+
+    // Not worth waking anyone up
+    if (numChunks == 1) {
+        fn(0, count, 0, userData);
+        return;
+    }
+
+    // Pushed last to first, so the own thread continues in order
+    volatile long pending = numChunks - 1;
+    int perfPhase = PERFCOUNT_CURRENT();
+    for (int chunk = numChunks - 1; chunk >= 1; --chunk) {
+        WorkItem item = {
+            fn, userData,
+            (int)((long long)count * chunk / numChunks),
+            (int)((long long)count * (chunk + 1) / numChunks),
+            chunk, &pending, NULL, perfPhase
+        };
+        if (!pushItem(&item)) {
+            runItem(&item);
+        }
+    }
+
+    fn(0, (int)((long long)count / numChunks), 0, userData);
+    helpUntilDone(&pending);
+}
+
+void jobs_graphReset(JobGraph *graph) {
+    graph->taskCount = 0;
+    graph->remaining = 0;
+}
+
+int jobs_graphAdd(JobGraph *graph, JobTaskFn fn, void *userData) {
+    assert(graph->taskCount < JOBS_MAX_GRAPH_TASKS && "too many tasks in the job graph");
+
+    int idx = graph->taskCount++;
+    graph->tasks[idx] = (JobGraphTask) { .graph = graph, .fn = fn, .userData = userData };
+    return idx;
+}
+
+int jobs_graphAddParallel(JobGraph *graph, int count, int minChunk, JobFn fn, void *userData) {
+    int idx = jobs_graphAdd(graph, NULL, userData);
+    JobGraphTask *task = &graph->tasks[idx];
+    task->loopFn = fn;
+    task->count = count;
+    task->minChunk = minChunk;
+    return idx;
+}
+
+void jobs_graphDepend(JobGraph *graph, int task, int dependency) {
+    // Earlier dependencies only, so a graph cannot have cycles
+    assert(dependency < task && task < graph->taskCount && "job graph dependency must be added before its task");
+
+    JobGraphTask *dep = &graph->tasks[dependency];
+    dep->successors[dep->successorCount++] = task;
+    graph->tasks[task].dependencyCount++;
+}
+
+void jobs_graphSubmit(JobGraph *graph) {
+    // Every counter is set before the first task can finish and read them
+    graph->remaining = graph->taskCount;
+    graph->perfPhase = PERFCOUNT_CURRENT();
+    for (int i = 0; i < graph->taskCount; ++i) {
+        graph->tasks[i].waiting = graph->tasks[i].dependencyCount;
+    }
+
+    for (int i = 0; i < graph->taskCount; ++i) {
+        if (graph->tasks[i].dependencyCount == 0) {
+            scheduleTask(&graph->tasks[i]);
+        }
+    }
+}
+
+void jobs_graphWait(JobGraph *graph) {
+    helpUntilDone(&graph->remaining);
+}
+
+void jobs_graphRun(JobGraph *graph) {
+    jobs_graphSubmit(graph);
+    jobs_graphWait(graph);
+}
@@ -0,0 +1,172 @@
+/**
+ * @file jobs.h
+ * @brief Work-stealing thread pool for parallel loops and task graphs
+ *
+ * All data parallel work of a program runs on this one pool. Loops are
+ * split into chunks, and a frame can be described as a small graph of
+ * tasks whose dependencies decide the order. Every thread waiting for
+ * a loop or graph runs pending work meanwhile, so loops may be started
+ * from within tasks and loops.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Upper bound for worker threads (including the calling thread) */
+#define JOBS_MAX_THREADS 64
+
+/** Most tasks in one graph */
+#define JOBS_MAX_GRAPH_TASKS 16
+
+/**
+ * Function processing the index range [begin, end).
+ * @param begin First index of the chunk.
+ * @param end One past the last index of the chunk.
+ * @param chunk Index of the chunk in [0, number of chunks).
+ * @param userData User pointer passed to jobs_parallelFor.
+ */
+typedef void (*JobFn)(int begin, int end, int chunk, void *userData);
+
+/**
+ * Function of a single task in a graph.
+ * @param userData User pointer passed to jobs_graphAdd.
+ */
+typedef void (*JobTaskFn)(void *userData);
+
+/**
+ * One task of a graph, the fields are private to jobs.c.
+ */
+typedef struct JobGraph JobGraph;
+typedef struct {
+    JobGraph *graph;
+    JobTaskFn fn;               // single task, or
+    JobFn loopFn;               // parallel loop over [0, count)
+    int count, minChunk;
+    void *userData;
+
+    int successors[JOBS_MAX_GRAPH_TASKS];
+    int successorCount;
+    int dependencyCount;
+    volatile long waiting;      // dependencies not finished yet
+} JobGraphTask;
+
+/**
+ * Small task graph, rebuilt or reused every frame. The fields are
+ * private to jobs.c.
+ */
+struct JobGraph {
+    JobGraphTask tasks[JOBS_MAX_GRAPH_TASKS];
+    int taskCount;
+    volatile long remaining;    // tasks not finished yet
+    int perfPhase;              // hardware counter phase of the submitting thread
+};
+
+/**
+ * Starts the pool.
+ * @param threadCount Number of threads including the calling thread.
+ */
+void jobs_init(int threadCount);
+
+/**
+ * Stops and joins all worker threads.
+ */
+void jobs_cleanup(void);
+
+/**
+ * Restarts the pool with a different number of threads.
+ * @param threadCount Number of threads including the calling thread.
+ */
+void jobs_setThreadCount(int threadCount);
+
+/**
+ * Returns the number of threads including the calling thread.
+ * @return Current thread count.
+ */
+int jobs_getThreadCount(void);
+
+/**
+ * Returns the number of logical processors of the machine.
+ * @return Hardware thread count, clamped to JOBS_MAX_THREADS.
+ */
+int jobs_getHardwareThreads(void);
+
+/**
+ * Returns how many chunks jobs_parallelFor will use for a range.
+ * @param count Number of indices.
+ * @param minChunk Minimum number of indices per chunk.
+ * @return Number of chunks (at most the thread count).
+ */
+int jobs_chunkCount(int count, int minChunk);
+
+/**
+ * Splits [0, count) into chunks and processes them on all threads.
+ * The calling thread takes part and the function returns once every
+ * chunk is finished, so consecutive calls are separated by a barrier.
+ * Calls from different threads and from within jobs may overlap, the
+ * pool itself must only be restarted while no other thread uses it.
+ * @param count Number of indices.
+ * @param minChunk Minimum number of indices per chunk.
+ * @param fn Function called once per chunk.
+ * @param userData User pointer passed to fn.
+ */
+void jobs_parallelFor(int count, int minChunk, JobFn fn, void *userData);
+
+/**
+ * Removes all tasks from a graph.
+ * @param graph The graph.
+ */
+void jobs_graphReset(JobGraph *graph);
+
+/**
+ * Adds a single task to a graph.
+ * @param graph The graph, must not be running.
+ * @param fn Function of the task.
+ * @param userData User pointer passed to fn.
+ * @return Index of the task for jobs_graphDepend.
+ */
+int jobs_graphAdd(JobGraph *graph, JobTaskFn fn, void *userData);
+
+/**
+ * Adds a task running jobs_parallelFor to a graph.
+ * @param graph The graph, must not be running.
+ * @param count Number of indices.
+ * @param minChunk Minimum number of indices per chunk.
+ * @param fn Function called once per chunk.
+ * @param userData User pointer passed to fn.
+ * @return Index of the task for jobs_graphDepend.
+ */
+int jobs_graphAddParallel(JobGraph *graph, int count, int minChunk, JobFn fn, void *userData);
+
+/**
+ * Lets a task start only after another one finished.
+ * @param graph The graph, must not be running.
+ * @param task Index of the dependent task.
+ * @param dependency Index of the task it waits for, added before it.
+ */
+void jobs_graphDepend(JobGraph *graph, int task, int dependency);
+
+/**
+ * Starts all tasks without dependencies and returns at once, the calling
+ * thread is free for other work, e.g. GL submission, until
+ * jobs_graphWait. The graph must not change until then.
+ * @param graph The graph.
+ */
+void jobs_graphSubmit(JobGraph *graph);
+
+/**
+ * Runs pending work until every task of a submitted graph finished.
+ * @param graph The graph.
+ */
+void jobs_graphWait(JobGraph *graph);
+
+/**
+ * Submits a graph and waits for it.
+ * @param graph The graph.
+ */
+void jobs_graphRun(JobGraph *graph);
+
+#endif // JOBS_H
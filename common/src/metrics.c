@@ -0,0 +1,554 @@
+/**
+ * @file metrics.c
+ * @brief Implementation of the metrics logger
+ *
+ * The ring has one producer, the main thread closing records, and one
+ * consumer, the drain thread. Both only advance their own index, so
+ * publishing an index with a sequentially consistent exchange is enough.
+ * The counters are added from any thread and swapped out when a record
+ * closes. Sinks are a small table of functions, only the drain thread
+ * calls them after metrics_init opened the sink.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+// Winsock has to come before windows.h, which thread.h includes
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#endif
+
+#include "metrics.h"
+#include "thread.h"
+#include "alloctrack.h"
+#include "perfcount.h"
+
+#include <ctype.h>
+
+#ifdef _WIN32
+    typedef SOCKET Socket;
+    #define SOCKET_INVALID INVALID_SOCKET
+    #define SOCKET_CLOSE(s) closesocket(s)
+#else
+    #include <sys/socket.h>
+    #include <netdb.h>
+
+    typedef int Socket;
+    #define SOCKET_INVALID (-1)
+    #define SOCKET_CLOSE(s) close(s)
+#endif
+
+/** Largest StatsD datagram, stays below common MTUs */
+#define STATSD_PACKET_SIZE 1400
+
+/** Upper bound of the gauges of one hardware counter phase */
+#define STATSD_PHASE_BYTES 640
+
+/**
+ * One closed record.
+ */
+typedef struct {
+    double time;            // seconds since metrics_init at the end of the record
+    int frames;
+    float frameP50, frameP95, frameP99, frameMax;
+    float stepsPerFrame;
+    float backlogMs;        // at the end of the record
+    int balls, particles;   // at the end of the record
+    long uploadBytes;
+    long allocations;
+    long rebuilds;
+    long dropped;           // records lost to a full ring before this one
+
+    PerfPhase hw[METRICS_HW_PHASES];    // counts of the record, not totals
+    int hwPhases;
+} MetricsRecord;
+
+/**
+ * Output of the drain thread.
+ */
+typedef struct {
+    bool (*open)(const char *target);
+    void (*write)(const MetricsRecord *record);
+    void (*close)(void);
+} MetricsSink;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global logger state.
+ */
+static struct {
+    bool enabled;
+    const MetricsSink *sink;
+    const char *prefix;
+
+    // Open record, main thread only
+    float frameMs[METRICS_MAX_FRAMES];
+    int frames;
+    float spanMs;
+    float maxMs;
+    double time;
+    long allocBase;
+    long dropped;
+    PerfPhase hwBase[METRICS_HW_PHASES];    // totals at the start of the open record
+
+    volatile long counters[METRIC_COUNTER_COUNT];
+
+    MetricsRecord ring[METRICS_RING_SIZE];
+    volatile long head;     // next record to write, main thread
+    volatile long tail;     // next record to drain, drain thread
+
+    Thread thread;
+    bool hasThread;
+    volatile long stop;
+} g_metrics = { 0 };
+
+/**
+ * State of the CSV sink.
+ */
+static struct {
+    FILE *file;
+    FILE *hwFile;
+} g_csv = { 0 };
+
+/**
+ * State of the UDP sink.
+ */
+static struct {
+    Socket socket;
+    struct sockaddr_storage addr;
+    int addrLen;
+} g_udp = { .socket = SOCKET_INVALID };
+
+/**
+ * Opens the CSV file and writes the header if the file is new.
+ * @param target Path, empty for METRICS_CSV_FILE.
+ * @return False if the file cannot be opened.
+ */
+static bool csvOpen(const char *target) {
+    const char *path = target[0] ? target : METRICS_CSV_FILE;
+    g_csv.file = fopen(path, "a");
+    if (!g_csv.file) {
+        printf("Metrics: could not open %s!\n", path);
+        return false;
+    }
+
+    fseek(g_csv.file, 0, SEEK_END);
+    if (ftell(g_csv.file) == 0) {
+        fprintf(g_csv.file, "time_s,frames,frame_p50_ms,frame_p95_ms,frame_p99_ms,frame_max_ms,"
+            "steps_per_frame,backlog_ms,balls,particles,upload_bytes,allocations,rebuilds,dropped\n");
+    }
+    printf("Metrics: writing to %s\n", path);
+
+    if (perfcount_isEnabled()) {
+        // metrics.csv becomes metrics_hw.csv, other names get the suffix appended
+        char hwPath[512];
+        const char *ext = strrchr(path, '.');
+        int stem = ext && strcmp(ext, ".csv") == 0 ? (int) (ext - path) : (int) strlen(path);
+        snprintf(hwPath, sizeof(hwPath), "%.*s" METRICS_HW_SUFFIX "%s", stem, path, path + stem);
+
+        g_csv.hwFile = fopen(hwPath, "a");
+        if (!g_csv.hwFile) {
+            printf("Metrics: could not open %s!\n", hwPath);
+            return true;
+        }
+        fseek(g_csv.hwFile, 0, SEEK_END);
+        if (ftell(g_csv.hwFile) == 0) {
+            fprintf(g_csv.hwFile, "time_s,phase,calls");
+            for (int c = 0; c < PC_COUNT; ++c) {
+                fprintf(g_csv.hwFile, ",%s", perfcount_counterName((PerfCounter) c));
+            }
+            fprintf(g_csv.hwFile, "\n");
+        }
+        printf("Metrics: writing hardware counters to %s\n", hwPath);
+    }
+    return true;
+}
+
+/**
+ * Appends one CSV row, flushed so the file can be followed live.
+ * @param r The record.
+ */
+static void csvWrite(const MetricsRecord *r) {
+    fprintf(g_csv.file, "%.3f,%d,%.3f,%.3f,%.3f,%.3f,%.2f,%.3f,%d,%d,%ld,%ld,%ld,%ld\n",
+        r->time, r->frames, r->frameP50, r->frameP95, r->frameP99, r->frameMax,
+        r->stepsPerFrame, r->backlogMs, r->balls, r->particles,
+        r->uploadBytes, r->allocations, r->rebuilds, r->dropped);
+    fflush(g_csv.file);
+
+    if (!g_csv.hwFile) {
+        return;
+    }
+    for (int i = 0; i < r->hwPhases; ++i) {
+        const PerfPhase *p = &r->hw[i];
+        if (p->calls == 0) {
+            continue;
+        }
+        fprintf(g_csv.hwFile, "%.3f,%s,%ld", r->time, p->name, p->calls);
+        for (int c = 0; c < PC_COUNT; ++c) {
+            // Unavailable counters stay empty instead of reading as 0
+            if (perfcount_hasCounter((PerfCounter) c)) {
+                fprintf(g_csv.hwFile, ",%ld", p->counts[c]);
+            } else {
+                fprintf(g_csv.hwFile, ",");
+            }
+        }
+        fprintf(g_csv.hwFile, "\n");
+    }
+    fflush(g_csv.hwFile);
+}
+
+/**
+ * Closes the CSV file.
+ */
+static void csvClose(void) {
+    fclose(g_csv.file);
+    g_csv.file = NULL;
+    if (g_csv.hwFile) {
+        fclose(g_csv.hwFile);
+        g_csv.hwFile = NULL;
+    }
+}
+
+/**
+ * Resolves the StatsD address and opens the socket.
+ * @param target "<host>:<port>", the port after the last colon.
+ * @return False if the address cannot be resolved or no socket is available.
+ */
+static bool udpOpen(const char *target) {
+    char host[256];
+    const char *colon = strrchr(target, ':');
+    size_t hostLen = colon ? (size_t) (colon - target) : 0;
+    if (hostLen == 0 || hostLen >= sizeof(host) || !colon[1]) {
+        printf("Metrics: expected udp:<host>:<port>, got udp:%s!\n", target);
+        return false;
+    }
+    memcpy(host, target, hostLen);
+    host[hostLen] = '\0';
+
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        printf("Metrics: could not start Winsock!\n");
+        return false;
+    }
+#endif
+
+    struct addrinfo hints = { 0 };
+    struct addrinfo *info = NULL;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, colon + 1, &hints, &info) == 0 && info) {
+        g_udp.socket = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        memcpy(&g_udp.addr, info->ai_addr, info->ai_addrlen);
+        g_udp.addrLen = (int) info->ai_addrlen;
+        freeaddrinfo(info);
+    } else {
+        printf("Metrics: could not resolve %s!\n", target);
+    }
+
+    if (g_udp.socket == SOCKET_INVALID) {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return false;
+    }
+
+    printf("Metrics: sending to %s\n", target);
+    return true;
+}
+
+/**
+ * Appends one StatsD gauge to a packet.
+ * @param packet The packet.
+ * @param used Bytes already used, advanced by the gauge.
+ * @param name Metric name after the prefix.
+ * @param value Gauge value.
+ */
+static void statsdGauge(char *packet, int *used, const char *name, double value) {
+    int n = snprintf(packet + *used, STATSD_PACKET_SIZE - *used, "%s.%s:%g|g\n", g_metrics.prefix, name, value);
+    if (n > 0 && *used + n < STATSD_PACKET_SIZE) {
+        *used += n;
+    }
+}
+
+/**
+ * Sends a packet and empties it.
+ * @param packet The packet.
+ * @param used Bytes used, reset to 0.
+ */
+static void statsdSend(char *packet, int *used) {
+    // Gauges are newline separated, the last one needs none
+    if (*used > 0) {
+        sendto(g_udp.socket, packet, *used - 1, 0, (const struct sockaddr*) &g_udp.addr, g_udp.addrLen);
+    }
+    *used = 0;
+}
+
+/**
+ * Appends the hardware counters of one phase as StatsD gauges.
+ * @param packet The packet.
+ * @param used Bytes already used, advanced by the gauges.
+ * @param p Counts of the phase.
+ */
+static void statsdPhase(char *packet, int *used, const PerfPhase *p) {
+    // Phase names become lower case metric names without spaces
+    char phase[64];
+    int length = 0;
+    for (const char *s = p->name; *s && length < (int) sizeof(phase) - 1; ++s) {
+        phase[length++] = isalnum((unsigned char) *s) ? (char) tolower((unsigned char) *s) : '_';
+    }
+    phase[length] = '\0';
+
+    char name[128];
+    snprintf(name, sizeof(name), "hw.%s.calls", phase);
+    statsdGauge(packet, used, name, (double) p->calls);
+    for (int c = 0; c < PC_COUNT; ++c) {
+        if (perfcount_hasCounter((PerfCounter) c)) {
+            snprintf(name, sizeof(name), "hw.%s.%s", phase, perfcount_counterName((PerfCounter) c));
+            statsdGauge(packet, used, name, (double) p->counts[c]);
+        }
+    }
+    if (p->counts[PC_CYCLES] > 0 && perfcount_hasCounter(PC_INSTRUCTIONS)) {
+        snprintf(name, sizeof(name), "hw.%s.ipc", phase);
+        statsdGauge(packet, used, name, (double) p->counts[PC_INSTRUCTIONS] / p->counts[PC_CYCLES]);
+    }
+}
+
+/**
+ * Sends one record as StatsD gauges, the hardware counters in further datagrams.
+ * @param r The record.
+ */
+static void udpWrite(const MetricsRecord *r) {
+    char packet[STATSD_PACKET_SIZE];
+    int used = 0;
+    statsdGauge(packet, &used, "frame.p50_ms", r->frameP50);
+    statsdGauge(packet, &used, "frame.p95_ms", r->frameP95);
+    statsdGauge(packet, &used, "frame.p99_ms", r->frameP99);
+    statsdGauge(packet, &used, "frame.max_ms", r->frameMax);
+    statsdGauge(packet, &used, "frames", r->frames);
+    statsdGauge(packet, &used, "physics.steps_per_frame", r->stepsPerFrame);
+    statsdGauge(packet, &used, "physics.backlog_ms", r->backlogMs);
+    statsdGauge(packet, &used, "balls", r->balls);
+    statsdGauge(packet, &used, "particles", r->particles);
+    statsdGauge(packet, &used, "gpu.upload_bytes", (double) r->uploadBytes);
+    statsdGauge(packet, &used, "allocations", (double) r->allocations);
+    statsdGauge(packet, &used, "rebuilds", (double) r->rebuilds);
+    statsdGauge(packet, &used, "dropped", (double) r->dropped);
+    statsdSend(packet, &used);
+
+    // A phase fits into STATSD_PHASE_BYTES, a packet holds as many whole phases as fit
+    for (int i = 0; i < r->hwPhases; ++i) {
+        if (r->hw[i].calls == 0) {
+            continue;
+        }
+        if (used > STATSD_PACKET_SIZE - STATSD_PHASE_BYTES) {
+            statsdSend(packet, &used);
+        }
+        statsdPhase(packet, &used, &r->hw[i]);
+    }
+    statsdSend(packet, &used);
+}
+
+/**
+ * Closes the socket.
+ */
+static void udpClose(void) {
+    SOCKET_CLOSE(g_udp.socket);
+    g_udp.socket = SOCKET_INVALID;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+/** Available sinks */
+static const MetricsSink CSV_SINK = { csvOpen, csvWrite, csvClose };
+static const MetricsSink UDP_SINK = { udpOpen, udpWrite, udpClose };
+
+/**
+ * Writes all records pushed so far, drain thread only.
+ */
+static void drain(void) {
+    long head = ATOMIC_LOAD(&g_metrics.head);
+    long tail = g_metrics.tail;
+    while (tail != head) {
+        g_metrics.sink->write(&g_metrics.ring[tail & (METRICS_RING_SIZE - 1)]);
+        ++tail;
+    }
+    ATOMIC_EXCHANGE(&g_metrics.tail, tail);
+}
+
+/**
+ * Drain thread entry, drains until stopped and once more after that.
+ */
+static THREAD_ENTRY(drainMain) {
+    NK_UNUSED(arg);
+    while (!ATOMIC_LOAD(&g_metrics.stop)) {
+        drain();
+        THREAD_SLEEP_MS(METRICS_DRAIN_MS);
+    }
+    drain();
+    THREAD_RETURN;
+}
+
+/**
+ * Orders frame times ascending.
+ */
+static int compareFloats(const void *a, const void *b) {
+    float fa = *(const float*) a;
+    float fb = *(const float*) b;
+    return (fa > fb) - (fa < fb);
+}
+
+/**
+ * Returns a percentile of sorted values, nearest rank.
+ * @param sorted Ascending values.
+ * @param count Number of values, at least one.
+ * @param p Percentile in [0, 100].
+ * @return The value.
+ */
+static float percentile(const float *sorted, int count, float p) {
+    int rank = (int) ceilf(p / 100.0f * count) - 1;
+    return sorted[rank < 0 ? 0 : (rank >= count ? count - 1 : rank)];
+}
+
+/**
+ * Closes the open record and pushes it into the ring, main thread only.
+ * @param backlogMs Accumulator backlog at the end of the record.
+ * @param balls Number of balls at the end of the record.
+ * @param particles Number of particles at the end of the record.
+ */
+static void closeRecord(float backlogMs, int balls, int particles) {
+    long head = g_metrics.head;
+    long frames = g_metrics.frames;
+    int samples = frames < METRICS_MAX_FRAMES ? (int) frames : METRICS_MAX_FRAMES;
+    qsort(g_metrics.frameMs, samples, sizeof(float), compareFloats);
+
+    long allocs = alloctrack_getTotalAllocs();
+    long steps = ATOMIC_EXCHANGE(&g_metrics.counters[METRIC_STEPS], 0);
+
+    MetricsRecord record = {
+        .time = g_metrics.time,
+        .frames = (int) frames,
+        .frameP50 = percentile(g_metrics.frameMs, samples, 50.0f),
+        .frameP95 = percentile(g_metrics.frameMs, samples, 95.0f),
+        .frameP99 = percentile(g_metrics.frameMs, samples, 99.0f),
+        .frameMax = g_metrics.maxMs,
+        .stepsPerFrame = (float) steps / frames,
+        .backlogMs = backlogMs,
+        .balls = balls,
+        .particles = particles,
+        .uploadBytes = ATOMIC_EXCHANGE(&g_metrics.counters[METRIC_UPLOAD_BYTES], 0),
+        .allocations = allocs - g_metrics.allocBase,
+        .rebuilds = ATOMIC_EXCHANGE(&g_metrics.counters[METRIC_REBUILDS], 0),
+        .dropped = g_metrics.dropped
+    };
+    g_metrics.allocBase = allocs;
+
+    // Totals only grow, the record takes the difference to the last one
+    record.hwPhases = glm_imin(perfcount_getPhaseCount(), METRICS_HW_PHASES);
+    for (int i = 0; i < record.hwPhases; ++i) {
+        PerfPhase totals;
+        perfcount_getTotals(i, &totals);
+        PerfPhase *p = &record.hw[i];
+        p->name = totals.name;
+        p->calls = totals.calls - g_metrics.hwBase[i].calls;
+        for (int c = 0; c < PC_COUNT; ++c) {
+            p->counts[c] = totals.counts[c] - g_metrics.hwBase[i].counts[c];
+        }
+        g_metrics.hwBase[i] = totals;
+    }
+
+    g_metrics.frames = 0;
+    g_metrics.spanMs = 0.0f;
+    g_metrics.maxMs = 0.0f;
+
+    // A slow sink costs records, never frames
+    if (head - ATOMIC_LOAD(&g_metrics.tail) >= METRICS_RING_SIZE) {
+        ++g_metrics.dropped;
+        return;
+    }
+    g_metrics.ring[head & (METRICS_RING_SIZE - 1)] = record;
+    ATOMIC_EXCHANGE(&g_metrics.head, head + 1);
+    g_metrics.dropped = 0;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void metrics_init(const char *name) {
+    const char *config = getenv("METRICS_SINK");
+    if (!config || !config[0]) {
+        return;
+    }
+
+    const char *prefix = getenv("METRICS_PREFIX");
+    g_metrics.prefix = prefix && prefix[0] ? prefix : name;
+
+    const char *target = "";
+    if (strncmp(config, "csv", 3) == 0 && (config[3] == '\0' || config[3] == ':')) {
+        g_metrics.sink = &CSV_SINK;
+        target = config[3] ? config + 4 : "";
+    } else if (strncmp(config, "udp:", 4) == 0) {
+        g_metrics.sink = &UDP_SINK;
+        target = config + 4;
+    } else {
+        printf("Metrics: unknown sink %s, expected csv[:<path>] or udp:<host>:<port>!\n", config);
+        return;
+    }
+
+    if (!g_metrics.sink->open(target)) {
+        g_metrics.sink = NULL;
+        return;
+    }
+
+    g_metrics.allocBase = alloctrack_getTotalAllocs();
+    g_metrics.stop = 0;
+    g_metrics.hasThread = THREAD_CREATE(&g_metrics.thread, drainMain);
+    if (!g_metrics.hasThread) {
+        printf("Metrics: could not start the drain thread!\n");
+        g_metrics.sink->close();
+        g_metrics.sink = NULL;
+        return;
+    }
+    g_metrics.enabled = true;
+}
+
+void metrics_cleanup(void) {
+    if (!g_metrics.enabled) {
+        return;
+    }
+
+    ATOMIC_EXCHANGE(&g_metrics.stop, 1);
+    THREAD_JOIN(g_metrics.thread);
+    g_metrics.sink->close();
+    memset(&g_metrics, 0, sizeof(g_metrics));
+}
+
+bool metrics_isEnabled(void) {
+    return g_metrics.enabled;
+}
+
+void metrics_frame(float frameMs, float backlogMs, int balls, int particles) {
+    if (!g_metrics.enabled) {
+        return;
+    }
+
+    if (g_metrics.frames < METRICS_MAX_FRAMES) {
+        g_metrics.frameMs[g_metrics.frames] = frameMs;
+    }
+    ++g_metrics.frames;
+    g_metrics.maxMs = glm_max(g_metrics.maxMs, frameMs);
+    g_metrics.spanMs += frameMs;
+    g_metrics.time += frameMs / 1000.0;
+
+    if (g_metrics.spanMs >= METRICS_INTERVAL_MS) {
+        closeRecord(backlogMs, balls, particles);
+    }
+}
+
+void metrics_count(MetricCounter counter, long amount) {
+    if (!g_metrics.enabled) {
+        return;
+    }
+    ATOMIC_ADD(&g_metrics.counters[counter], amount);
+}
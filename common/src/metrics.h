@@ -0,0 +1,98 @@
+/**
+ * @file metrics.h
+ * @brief Continuous per-second metrics written to a file or a UDP socket
+ *
+ * The main thread feeds every frame into the open record. Once a record
+ * spans METRICS_INTERVAL_MS it is closed and pushed into a single-producer
+ * ring without locking, a background thread drains the ring into the sink.
+ * A full ring drops the record instead of waiting for the sink.
+ *
+ * The sink is chosen by the METRICS_SINK environment variable:
+ * - "csv:<path>" appends CSV rows to a file, "csv" alone to METRICS_CSV_FILE,
+ * - "udp:<host>:<port>" sends every record as StatsD gauges in one datagram,
+ *   named <prefix>.<metric> with the prefix from METRICS_PREFIX.
+ * Without the variable nothing is recorded and every call costs one branch.
+ *
+ * With hardware counters enabled (see perfcount.h) every record also
+ * carries the counts of the first METRICS_HW_PHASES phases. The CSV sink
+ * writes them to a second file, one row per phase and record, named like
+ * the CSV file with METRICS_HW_SUFFIX before the extension. The UDP sink
+ * sends them as <prefix>.hw.<phase>.<counter> gauges in further datagrams.
+ *
+ * The file is kept identical in all exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Time span of one record */
+#define METRICS_INTERVAL_MS 1000.0f
+
+/** Frame times kept per record for the percentiles, later frames are only counted */
+#define METRICS_MAX_FRAMES 2048
+
+/** Closed records waiting for the sink, a power of two */
+#define METRICS_RING_SIZE 64
+
+/** Pause of the background thread between two drains */
+#define METRICS_DRAIN_MS 200
+
+/** Default file of the CSV sink */
+#define METRICS_CSV_FILE "metrics.csv"
+
+/** Hardware counter phases written per record */
+#define METRICS_HW_PHASES 16
+
+/** Marks the CSV file of the hardware counters */
+#define METRICS_HW_SUFFIX "_hw"
+
+/**
+ * Counters that can be increased from any thread.
+ */
+typedef enum {
+    METRIC_STEPS,           // fixed physics steps
+    METRIC_UPLOAD_BYTES,    // bytes uploaded to the GPU
+    METRIC_REBUILDS,        // rebuilds of derived data, e.g. the surface or an SDF
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+/**
+ * Reads the sink from the environment and starts the background thread.
+ * @param name Default StatsD prefix, must outlive the program.
+ */
+void metrics_init(const char *name);
+
+/**
+ * Writes all closed records and stops the thread, the open record is discarded.
+ */
+void metrics_cleanup(void);
+
+/**
+ * Checks whether records are written.
+ * @return True if a sink is open.
+ */
+bool metrics_isEnabled(void);
+
+/**
+ * Adds one frame to the open record and closes it once it spans
+ * METRICS_INTERVAL_MS. Call once per frame from the main thread.
+ * Counts an application does not have are passed as 0.
+ * @param frameMs Wall-clock time of the frame.
+ * @param backlogMs Simulation time left in the fixed step accumulator.
+ * @param balls Number of simulated balls.
+ * @param particles Number of simulated particles.
+ */
+void metrics_frame(float frameMs, float backlogMs, int balls, int particles);
+
+/**
+ * Increases a counter of the open record, safe from any thread.
+ * @param counter The counter.
+ * @param amount Amount to add.
+ */
+void metrics_count(MetricCounter counter, long amount);
+
+#endif // METRICS_H
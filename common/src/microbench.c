@@ -0,0 +1,202 @@
+/**
+ * @file microbench.c
+ * @brief Implementation of the kernel benchmark driver
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "microbench.h"
+
+#include <float.h>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+/** Most samples of one kernel */
+#define MAX_SAMPLES 1000
+
+/** Largest batch, ends the calibration of kernels slower than expected */
+#define MAX_ITERATIONS (1 << 28)
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/** Written once per batch, volatile so the results count as used */
+static volatile float g_sink = 0.0f;
+
+/** Samples of all kernels run so far */
+static BenchResult g_result;
+
+/** Result of an earlier run, loaded with -b */
+static BenchResult g_baseline;
+
+/** State of microbench_random */
+static uint32_t g_randomState = 0x2545f491u;
+
+/**
+ * Returns a monotonic timestamp.
+ * @return Time in seconds.
+ */
+static double now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/**
+ * Times one batch.
+ * @param fn The kernel.
+ * @param ctx Data of the kernel.
+ * @param iterations Batch size.
+ * @return Duration in seconds.
+ */
+static double timeBatch(MicroBenchFn fn, void *ctx, int iterations) {
+    double start = now();
+    fn(ctx, iterations);
+    return now() - start;
+}
+
+/**
+ * Prints the command line options.
+ * @param program Name of the benchmark executable.
+ */
+static void printUsage(const char *program) {
+    printf("Usage: %s [-s samples] [-w warmup] [-f filter] [-o output] [-b baseline] [-p threshold]\n", program);
+    printf("  samples   timed batches per kernel, default %d\n", MICROBENCH_DEFAULT_SAMPLES);
+    printf("  warmup    untimed batches per kernel, default %d\n", MICROBENCH_DEFAULT_WARMUP);
+    printf("  filter    only kernels whose name contains it\n");
+    printf("  output    JSON result of the run\n");
+    printf("  baseline  JSON result of an earlier run, kernels slower beyond their noise fail\n");
+    printf("  threshold allowed slowdown in percent, default %.0f\n", BENCHRESULT_DEFAULT_THRESHOLD);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool microbench_parseArgs(const char *program, int argc, char **argv, MicroBenchConfig *cfg) {
+    cfg->samples = MICROBENCH_DEFAULT_SAMPLES;
+    cfg->warmup = MICROBENCH_DEFAULT_WARMUP;
+    cfg->filter = NULL;
+    cfg->output = NULL;
+    cfg->baseline = NULL;
+    cfg->threshold = BENCHRESULT_DEFAULT_THRESHOLD;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (i + 1 >= argc || strlen(arg) != 2 || arg[0] != '-') {
+            printUsage(program);
+            return false;
+        }
+
+        const char *value = argv[++i];
+        switch (arg[1]) {
+            case 's':
+                cfg->samples = atoi(value);
+                break;
+            case 'w':
+                cfg->warmup = atoi(value);
+                break;
+            case 'f':
+                cfg->filter = value;
+                break;
+            case 'o':
+                cfg->output = value;
+                break;
+            case 'b':
+                cfg->baseline = value;
+                break;
+            case 'p':
+                cfg->threshold = atof(value);
+                break;
+            default:
+                printUsage(program);
+                return false;
+        }
+    }
+
+    if (cfg->samples < 2 || cfg->samples > MAX_SAMPLES || cfg->warmup < 0 || cfg->threshold < 0.0) {
+        printUsage(program);
+        return false;
+    }
+    if (cfg->baseline && !benchresult_load(&g_baseline, cfg->baseline)) {
+        return false;
+    }
+
+    benchresult_init(&g_result, program, argc, argv);
+    char text[16];
+    snprintf(text, sizeof(text), "%d", cfg->samples);
+    benchresult_setInfo(&g_result, BS_CONFIG, "samples", text);
+    snprintf(text, sizeof(text), "%d", cfg->warmup);
+    benchresult_setInfo(&g_result, BS_CONFIG, "warmup", text);
+
+    printf("%d samples (+%d warmup) of at least %.1f ms\n", cfg->samples, cfg->warmup, MICROBENCH_MIN_SAMPLE_MS);
+    printf("%-28s %12s %10s %8s %10s %12s\n", "kernel", "ns/op", "stddev", "cv", "min", "ops/sample");
+    return true;
+}
+
+void microbench_run(const MicroBenchConfig *cfg, const char *name, MicroBenchFn fn, void *ctx) {
+    if (cfg->filter && !strstr(name, cfg->filter)) {
+        return;
+    }
+
+    int iterations = 1;
+    while (iterations < MAX_ITERATIONS && timeBatch(fn, ctx, iterations) * 1000.0 < MICROBENCH_MIN_SAMPLE_MS) {
+        iterations *= 2;
+    }
+
+    for (int i = 0; i < cfg->warmup; ++i) {
+        timeBatch(fn, ctx, iterations);
+    }
+
+    double ns[MAX_SAMPLES];
+    double sum = 0.0, best = DBL_MAX;
+    for (int i = 0; i < cfg->samples; ++i) {
+        ns[i] = timeBatch(fn, ctx, iterations) * 1e9 / iterations;
+        sum += ns[i];
+        best = ns[i] < best ? ns[i] : best;
+    }
+
+    double mean = sum / cfg->samples;
+    double variance = 0.0;
+    for (int i = 0; i < cfg->samples; ++i) {
+        variance += (ns[i] - mean) * (ns[i] - mean);
+    }
+    double stddev = sqrt(variance / (cfg->samples - 1));
+
+    printf("%-28s %12.2f %10.2f %7.1f%% %10.2f %12d\n",
+        name, mean, stddev, mean > 0.0 ? 100.0 * stddev / mean : 0.0, best, iterations);
+    benchresult_add(&g_result, name, "ns/op", false, ns, cfg->samples);
+}
+
+int microbench_finish(const MicroBenchConfig *cfg) {
+    bool ok = !cfg->output || benchresult_write(&g_result, cfg->output);
+    if (cfg->baseline) {
+        printf("\n");
+        ok &= benchresult_compare(&g_baseline, &g_result, cfg->threshold) == 0;
+    }
+
+    benchresult_free(&g_result);
+    benchresult_free(&g_baseline);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void microbench_consume(float value) {
+    g_sink += value;
+}
+
+float microbench_random(void) {
+    // xorshift32, the same sequence on every platform
+    g_randomState ^= g_randomState << 13;
+    g_randomState ^= g_randomState >> 17;
+    g_randomState ^= g_randomState << 5;
+    return (g_randomState >> 8) * (1.0f / 16777216.0f);
+}
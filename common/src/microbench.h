@@ -0,0 +1,92 @@
+/**
+ * @file microbench.h
+ * @brief Driver for benchmarks of single kernels
+ *
+ * A kernel is called in batches of iterations, the batch size is doubled
+ * until one batch takes MICROBENCH_MIN_SAMPLE_MS, so the timer resolution
+ * and the call of the batch do not show in the result. After the warm-up
+ * batches every sample batch yields one time per operation, printed as
+ * mean, standard deviation and minimum.
+ *
+ * The samples of all kernels can be written as a result (benchresult.h)
+ * and compared to the result of an earlier run, kernels that got slower
+ * by more than the threshold beyond their noise fail the run.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <fhwcg/fhwcg.h>
+#include "benchresult.h"
+
+#define MICROBENCH_DEFAULT_SAMPLES 30
+#define MICROBENCH_DEFAULT_WARMUP 5
+
+/** Shortest batch, shorter ones are grown */
+#define MICROBENCH_MIN_SAMPLE_MS 2.0
+
+/** Number of prepared inputs a kernel cycles through, a power of two */
+#define MICROBENCH_INPUTS 1024
+
+/**
+ * Runs a kernel for a number of operations.
+ * @param ctx Data of the kernel.
+ * @param iterations Number of operations.
+ */
+typedef void (*MicroBenchFn)(void *ctx, int iterations);
+
+/**
+ * Settings of all runs, parsed from the command line.
+ */
+typedef struct {
+    int samples;
+    int warmup;
+    const char *filter;     // only kernels with this in their name, NULL for all
+    const char *output;     // JSON result, NULL for none
+    const char *baseline;   // JSON result to compare to, NULL for none
+    double threshold;       // allowed slowdown against the baseline in percent
+} MicroBenchConfig;
+
+/**
+ * Parses -s samples, -w warmup, -f filter, -o output, -b baseline and
+ * -p threshold and loads the baseline.
+ * @param program Name of the benchmark executable, for the usage and the result.
+ * @param argc Argument count.
+ * @param argv Arguments.
+ * @param cfg Destination, filled with the defaults first.
+ * @return False if the arguments are invalid, the usage was printed then.
+ */
+bool microbench_parseArgs(const char *program, int argc, char **argv, MicroBenchConfig *cfg);
+
+/**
+ * Benchmarks one kernel and prints its line.
+ * @param cfg Settings.
+ * @param name Kernel name.
+ * @param fn The kernel.
+ * @param ctx Data passed to the kernel.
+ */
+void microbench_run(const MicroBenchConfig *cfg, const char *name, MicroBenchFn fn, void *ctx);
+
+/**
+ * Writes the result and compares it to the baseline.
+ * @param cfg Settings.
+ * @return EXIT_FAILURE if the result can't be written or a kernel regressed.
+ */
+int microbench_finish(const MicroBenchConfig *cfg);
+
+/**
+ * Keeps a result alive, so the compiler cannot drop the kernel.
+ * Call once per batch with a sum of the results.
+ * @param value Any result.
+ */
+void microbench_consume(float value);
+
+/**
+ * Returns a reproducible random number.
+ * @return A number in [0, 1).
+ */
+float microbench_random(void);
+
+#endif // MICROBENCH_H
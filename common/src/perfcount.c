@@ -0,0 +1,434 @@
+/**
+ * @file perfcount.c
+ * @brief Implementation of the hardware performance counters
+ *
+ * The counters of a thread form one perf_event group led by the first
+ * counter that opened, so a single read returns all of them together with
+ * the time the group was enabled and actually counting. The phase stack
+ * and the group live in thread local storage, a registry only keeps the
+ * file descriptors so perfcount_cleanup can close them. Threads that end
+ * keep their registry entry, after PERFCOUNT_MAX_THREADS registrations new
+ * threads are not counted.
+ *
+ * Totals are added with atomics from every thread. Phases are registered
+ * under a mutex and published by their count, lookups read without it.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "perfcount.h"
+
+volatile int g_perfcountActive = 0;
+
+/** Short names indexed by PerfCounter */
+static const char *const g_counterNames[PC_COUNT] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+#ifdef __linux__
+
+#include "thread.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Open phase of a thread.
+ */
+typedef struct {
+    int phase;
+    bool call;          // begun by name, work of job items is not a call
+    long start[PC_COUNT];
+} OpenPhase;
+
+/**
+ * Counters and phase stack of one thread.
+ */
+typedef struct {
+    bool registered;
+    int leader;                 // group leader, -1 without counters
+    int slots[PC_COUNT];        // position in the group read, -1 if unavailable
+    int opened;
+
+    OpenPhase stack[PERFCOUNT_MAX_DEPTH];
+    int depth;                  // may exceed PERFCOUNT_MAX_DEPTH, deeper phases are not counted
+} ThreadCounters;
+
+/** Counters of the calling thread, opened on its first phase */
+static __thread ThreadCounters t_counters = { 0 };
+
+/**
+ * Global counter state.
+ */
+static struct {
+    bool enabled;
+    bool available[PC_COUNT];   // opened on the main thread
+
+    int fds[PERFCOUNT_MAX_THREADS][PC_COUNT];
+    volatile long threadCount;  // registrations, may exceed PERFCOUNT_MAX_THREADS
+
+    Mutex mutex;                // guards the registration of phases
+    const char *names[PERFCOUNT_MAX_PHASES];
+    volatile long phaseCount;
+    volatile long calls[PERFCOUNT_MAX_PHASES];
+    volatile long totals[PERFCOUNT_MAX_PHASES][PC_COUNT];
+
+    // Windows, main thread only
+    PerfPhase base[PERFCOUNT_MAX_PHASES];
+    PerfPhase window[PERFCOUNT_MAX_PHASES];
+    double windowStart;
+    int windowFrames;
+} g_perf = { 0 };
+
+/**
+ * Sets the perf_event type and config of a counter.
+ * @param counter The counter.
+ * @param attr Attributes of the event.
+ */
+static void counterConfig(PerfCounter counter, struct perf_event_attr *attr) {
+    attr->type = PERF_TYPE_HARDWARE;
+    switch (counter) {
+        case PC_CYCLES:
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PC_INSTRUCTIONS:
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PC_L1D_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_L1D
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PC_LLC_MISSES:
+            attr->config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        default:
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+}
+
+/**
+ * Opens the counters of the calling thread as one group.
+ * @param tc Counters of the calling thread.
+ * @param fds Destination for the file descriptors, -1 for unavailable ones.
+ */
+static void openGroup(ThreadCounters *tc, int fds[PC_COUNT]) {
+    tc->leader = -1;
+    tc->opened = 0;
+    for (int c = 0; c < PC_COUNT; ++c) {
+        struct perf_event_attr attr = { 0 };
+        attr.size = sizeof(attr);
+        counterConfig((PerfCounter) c, &attr);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        fds[c] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, tc->leader, 0);
+        tc->slots[c] = fds[c] >= 0 ? tc->opened++ : -1;
+        if (fds[c] >= 0 && tc->leader < 0) {
+            tc->leader = fds[c];
+        }
+    }
+}
+
+/**
+ * Returns the counters of the calling thread, opens them on the first call.
+ * @return Counters of the calling thread, without any if it is not counted.
+ */
+static ThreadCounters *threadCounters(void) {
+    ThreadCounters *tc = &t_counters;
+    if (tc->registered) {
+        return tc;
+    }
+    tc->registered = true;
+    tc->leader = -1;
+
+    long idx = ATOMIC_ADD(&g_perf.threadCount, 1);
+    if (idx < PERFCOUNT_MAX_THREADS) {
+        openGroup(tc, g_perf.fds[idx]);
+    }
+    return tc;
+}
+
+/**
+ * Reads the scaled counters of a thread.
+ * @param tc Counters of the calling thread.
+ * @param counts Destination, 0 for unavailable counters.
+ */
+static void readCounts(const ThreadCounters *tc, long counts[PC_COUNT]) {
+    memset(counts, 0, PC_COUNT * sizeof(long));
+    if (tc->leader < 0) {
+        return;
+    }
+
+    // nr, time enabled, time running, one value per opened counter
+    uint64_t values[3 + PC_COUNT];
+    if (read(tc->leader, values, sizeof(values)) < (ssize_t) (3 * sizeof(uint64_t)) || values[2] == 0) {
+        return;
+    }
+
+    // Multiplexed groups only counted part of the time, extrapolate to all of it
+    double scale = (double) values[1] / (double) values[2];
+    for (int c = 0; c < PC_COUNT; ++c) {
+        if (tc->slots[c] >= 0 && (uint64_t) tc->slots[c] < values[0]) {
+            counts[c] = (long) (values[3 + tc->slots[c]] * scale);
+        }
+    }
+}
+
+/**
+ * Begins a phase on the calling thread.
+ * @param phase Index of the phase or PERFCOUNT_NONE.
+ * @param call Count the phase as called.
+ */
+static void beginPhase(int phase, bool call) {
+    ThreadCounters *tc = threadCounters();
+    if (tc->depth++ >= PERFCOUNT_MAX_DEPTH) {
+        return;
+    }
+
+    OpenPhase *open = &tc->stack[tc->depth - 1];
+    open->phase = phase;
+    open->call = call;
+    if (phase != PERFCOUNT_NONE) {
+        readCounts(tc, open->start);
+    }
+}
+
+/**
+ * Finds a phase by name or registers a new one.
+ * @param name Phase name.
+ * @return Phase index or PERFCOUNT_NONE if the table is full.
+ */
+static int findPhase(const char *name) {
+    long count = ATOMIC_LOAD(&g_perf.phaseCount);
+    for (long i = 0; i < count; ++i) {
+        if (g_perf.names[i] == name) {
+            return (int) i;
+        }
+    }
+
+    MUTEX_LOCK(&g_perf.mutex);
+    int idx = PERFCOUNT_NONE;
+    count = g_perf.phaseCount;
+    for (long i = 0; i < count && idx == PERFCOUNT_NONE; ++i) {
+        if (g_perf.names[i] == name) {
+            idx = (int) i;
+        }
+    }
+    if (idx == PERFCOUNT_NONE && count < PERFCOUNT_MAX_PHASES) {
+        g_perf.names[count] = name;
+        idx = (int) count;
+        ATOMIC_EXCHANGE(&g_perf.phaseCount, count + 1);
+    }
+    MUTEX_UNLOCK(&g_perf.mutex);
+    return idx;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void perfcount_init(void) {
+    const char *config = getenv("PERF_COUNTERS");
+    if (!config || !config[0] || g_perf.enabled) {
+        return;
+    }
+
+    // The main thread opens its counters first, they tell what the machine offers
+    ThreadCounters *tc = threadCounters();
+    if (tc->leader < 0) {
+        printf("Performance counters: not available (%s), check /proc/sys/kernel/perf_event_paranoid\n",
+               strerror(errno));
+        return;
+    }
+
+    printf("Performance counters:");
+    for (int c = 0; c < PC_COUNT; ++c) {
+        g_perf.available[c] = tc->slots[c] >= 0;
+        if (g_perf.available[c]) {
+            printf(" %s", g_counterNames[c]);
+        }
+    }
+    printf("\n");
+
+    MUTEX_INIT(&g_perf.mutex);
+    g_perf.windowStart = glfwGetTime();
+    g_perf.enabled = true;
+    g_perfcountActive = 1;
+}
+
+void perfcount_cleanup(void) {
+    if (!g_perf.enabled) {
+        return;
+    }
+    g_perfcountActive = 0;
+
+    long threads = glm_imin((int) g_perf.threadCount, PERFCOUNT_MAX_THREADS);
+    for (long t = 0; t < threads; ++t) {
+        for (int c = 0; c < PC_COUNT; ++c) {
+            if (g_perf.fds[t][c] >= 0) {
+                close(g_perf.fds[t][c]);
+            }
+        }
+    }
+    MUTEX_DESTROY(&g_perf.mutex);
+    memset(&g_perf, 0, sizeof(g_perf));
+}
+
+bool perfcount_isEnabled(void) {
+    return g_perf.enabled;
+}
+
+bool perfcount_hasCounter(PerfCounter counter) {
+    return g_perf.available[counter];
+}
+
+void perfcount_begin(const char *name) {
+    beginPhase(findPhase(name), true);
+}
+
+void perfcount_beginPhase(int phase) {
+    beginPhase(phase, false);
+}
+
+void perfcount_end(void) {
+    ThreadCounters *tc = threadCounters();
+    if (tc->depth <= 0 || tc->depth-- > PERFCOUNT_MAX_DEPTH) {
+        return;
+    }
+
+    const OpenPhase *open = &tc->stack[tc->depth];
+    if (open->phase == PERFCOUNT_NONE) {
+        return;
+    }
+
+    long now[PC_COUNT];
+    readCounts(tc, now);
+    for (int c = 0; c < PC_COUNT; ++c) {
+        ATOMIC_ADD(&g_perf.totals[open->phase][c], now[c] - open->start[c]);
+    }
+    if (open->call) {
+        ATOMIC_ADD(&g_perf.calls[open->phase], 1);
+    }
+}
+
+int perfcount_current(void) {
+    const ThreadCounters *tc = &t_counters;
+    if (tc->depth <= 0) {
+        return PERFCOUNT_NONE;
+    }
+    return tc->stack[glm_imin(tc->depth, PERFCOUNT_MAX_DEPTH) - 1].phase;
+}
+
+void perfcount_endFrame(void) {
+    if (!g_perf.enabled) {
+        return;
+    }
+
+    ++g_perf.windowFrames;
+    double now = glfwGetTime();
+    if ((now - g_perf.windowStart) * 1000.0 < PERFCOUNT_WINDOW_MS) {
+        return;
+    }
+
+    int count = perfcount_getPhaseCount();
+    for (int i = 0; i < count; ++i) {
+        PerfPhase totals;
+        perfcount_getTotals(i, &totals);
+
+        PerfPhase *w = &g_perf.window[i];
+        w->name = totals.name;
+        w->calls = totals.calls - g_perf.base[i].calls;
+        for (int c = 0; c < PC_COUNT; ++c) {
+            w->counts[c] = totals.counts[c] - g_perf.base[i].counts[c];
+        }
+        w->frames = g_perf.windowFrames;
+        g_perf.base[i] = totals;
+    }
+    g_perf.windowStart = now;
+    g_perf.windowFrames = 0;
+}
+
+int perfcount_getPhaseCount(void) {
+    return (int) ATOMIC_LOAD(&g_perf.phaseCount);
+}
+
+void perfcount_getTotals(int idx, PerfPhase *phase) {
+    phase->name = g_perf.names[idx];
+    phase->calls = ATOMIC_LOAD(&g_perf.calls[idx]);
+    for (int c = 0; c < PC_COUNT; ++c) {
+        phase->counts[c] = ATOMIC_LOAD(&g_perf.totals[idx][c]);
+    }
+    phase->frames = 0;
+}
+
+void perfcount_getWindow(int idx, PerfPhase *phase) {
+    *phase = g_perf.window[idx];
+    phase->name = g_perf.names[idx];
+}
+
+#else // __linux__
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void perfcount_init(void) {
+    const char *config = getenv("PERF_COUNTERS");
+    if (config && config[0]) {
+        printf("Performance counters: only available on Linux\n");
+    }
+}
+
+void perfcount_cleanup(void) {
+}
+
+bool perfcount_isEnabled(void) {
+    return false;
+}
+
+bool perfcount_hasCounter(PerfCounter counter) {
+    NK_UNUSED(counter);
+    return false;
+}
+
+void perfcount_begin(const char *name) {
+    NK_UNUSED(name);
+}
+
+void perfcount_beginPhase(int phase) {
+    NK_UNUSED(phase);
+}
+
+void perfcount_end(void) {
+}
+
+int perfcount_current(void) {
+    return PERFCOUNT_NONE;
+}
+
+void perfcount_endFrame(void) {
+}
+
+int perfcount_getPhaseCount(void) {
+    return 0;
+}
+
+void perfcount_getTotals(int idx, PerfPhase *phase) {
+    NK_UNUSED(idx);
+    memset(phase, 0, sizeof(*phase));
+}
+
+void perfcount_getWindow(int idx, PerfPhase *phase) {
+    NK_UNUSED(idx);
+    memset(phase, 0, sizeof(*phase));
+}
+
+#endif // __linux__
+
+const char *perfcount_counterName(PerfCounter counter) {
+    return g_counterNames[counter];
+}
@@ -0,0 +1,170 @@
+/**
+ * @file perfcount.h
+ * @brief Hardware performance counters per phase (Linux perf_event)
+ *
+ * Code marks phases with PERFCOUNT_BEGIN and PERFCOUNT_END, profiler
+ * scopes are phases as well. Every thread opens one group of counters on
+ * its first phase: cycles, instructions, L1 data cache read misses, last
+ * level cache misses and branch misses, user space only. A phase reads the
+ * group when it begins and ends and adds the difference to the totals of
+ * its name, so phases on several threads or nested phases all count.
+ * Loop chunks and graph tasks of the job pool count in the phase that
+ * started them, so a parallel phase includes the work of the workers.
+ *
+ * Totals only grow. perfcount_endFrame closes a window every
+ * PERFCOUNT_WINDOW_MS, the profiler panel shows the last window per frame
+ * and the metrics logger takes its own differences of the totals.
+ *
+ * Enabled by the PERF_COUNTERS environment variable on Linux. Counters the
+ * CPU or kernel does not offer (e.g. in virtual machines) stay unavailable,
+ * a restrictive perf_event_paranoid leaves all of them unavailable. More
+ * counters than the PMU holds are multiplexed and scaled by the kernel's
+ * enabled and running times. Without the variable, and on other platforms,
+ * a phase costs one load and a branch. Defining PERFCOUNT_DISABLED or an
+ * INSTRUMENT_LEVEL below INSTRUMENT_FULL compiles the phases out.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <fhwcg/fhwcg.h>
+#include "instrument.h"
+
+/** Distinct phase names, later ones are not counted */
+#define PERFCOUNT_MAX_PHASES 32
+
+/** Nesting depth of phases per thread */
+#define PERFCOUNT_MAX_DEPTH 8
+
+/** Threads that can open counters, later threads are not counted */
+#define PERFCOUNT_MAX_THREADS 64
+
+/** Span of one window of the profiler panel */
+#define PERFCOUNT_WINDOW_MS 500.0
+
+/** Marks "no phase", e.g. for work started outside of any phase */
+#define PERFCOUNT_NONE (-1)
+
+/**
+ * Hardware counters of a phase.
+ */
+typedef enum {
+    PC_CYCLES,
+    PC_INSTRUCTIONS,
+    PC_L1D_MISSES,
+    PC_LLC_MISSES,
+    PC_BRANCH_MISSES,
+    PC_COUNT
+} PerfCounter;
+
+/**
+ * Counts of one phase, either totals or one window.
+ */
+typedef struct {
+    const char *name;
+    long calls;             // begun by name, continued work of job items not included
+    long counts[PC_COUNT];
+    int frames;             // frames of the window, 0 for totals
+} PerfPhase;
+
+#if defined(PERFCOUNT_DISABLED) || INSTRUMENT_LEVEL < INSTRUMENT_FULL
+    #define PERFCOUNT_BEGIN(name) ((void) 0)
+    #define PERFCOUNT_END() ((void) 0)
+    #define PERFCOUNT_CURRENT() PERFCOUNT_NONE
+#else
+    /** Begins a phase on the calling thread, name must be a string literal */
+    #define PERFCOUNT_BEGIN(name) do { if (g_perfcountActive) perfcount_begin(name); } while (0)
+    /** Ends the innermost phase of the calling thread */
+    #define PERFCOUNT_END() do { if (g_perfcountActive) perfcount_end(); } while (0)
+    /** Innermost phase of the calling thread, PERFCOUNT_NONE if there is none */
+    #define PERFCOUNT_CURRENT() (g_perfcountActive ? perfcount_current() : PERFCOUNT_NONE)
+#endif
+
+/** Whether counters are read, read by the phase macros */
+extern volatile int g_perfcountActive;
+
+/**
+ * Reads the environment and checks that counters can be opened.
+ * Call from the main thread before any phase.
+ */
+void perfcount_init(void);
+
+/**
+ * Stops counting and closes the counters of all threads.
+ */
+void perfcount_cleanup(void);
+
+/**
+ * Checks whether phases are counted.
+ * @return True if enabled and at least one counter is available.
+ */
+bool perfcount_isEnabled(void);
+
+/**
+ * Checks whether a counter could be opened.
+ * @param counter The counter.
+ * @return False if the CPU or kernel does not offer it.
+ */
+bool perfcount_hasCounter(PerfCounter counter);
+
+/**
+ * Returns a short name of a counter, e.g. for column headers.
+ * @param counter The counter.
+ * @return Name in lower case without spaces.
+ */
+const char *perfcount_counterName(PerfCounter counter);
+
+/**
+ * Begins a phase on the calling thread, use PERFCOUNT_BEGIN.
+ * @param name Phase name, compared by pointer, must outlive the program.
+ */
+void perfcount_begin(const char *name);
+
+/**
+ * Continues a phase by its index on the calling thread, e.g. one returned
+ * by perfcount_current on another thread. The counts are added, the calls
+ * are not. PERFCOUNT_NONE is ignored but still has to be ended.
+ * @param phase Index of the phase.
+ */
+void perfcount_beginPhase(int phase);
+
+/**
+ * Ends the innermost phase of the calling thread, use PERFCOUNT_END.
+ */
+void perfcount_end(void);
+
+/**
+ * Returns the innermost phase of the calling thread, use PERFCOUNT_CURRENT.
+ * @return Index of the phase or PERFCOUNT_NONE.
+ */
+int perfcount_current(void);
+
+/**
+ * Counts a frame and closes the window once it spans PERFCOUNT_WINDOW_MS.
+ * Call once per frame from the main thread.
+ */
+void perfcount_endFrame(void);
+
+/**
+ * Returns the number of phases seen so far.
+ * @return Phase count.
+ */
+int perfcount_getPhaseCount(void);
+
+/**
+ * Returns the totals of a phase since perfcount_init.
+ * @param idx Phase index in [0, perfcount_getPhaseCount()).
+ * @param phase Destination.
+ */
+void perfcount_getTotals(int idx, PerfPhase *phase);
+
+/**
+ * Returns the counts of a phase in the last closed window.
+ * @param idx Phase index in [0, perfcount_getPhaseCount()).
+ * @param phase Destination, frames is 0 before the first window closed.
+ */
+void perfcount_getWindow(int idx, PerfPhase *phase);
+
+#endif // PERFCOUNT_H
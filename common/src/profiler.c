@@ -0,0 +1,443 @@
+/**
+ * @file profiler.c
+ * @brief Implementation of the frame profiler
+ *
+ * CPU time is measured with glfwGetTime. GPU time uses timestamp
+ * queries, which, unlike GL_TIME_ELAPSED, may be nested. Results are
+ * read PROFILER_LATENCY frames later so the CPU never waits on the GPU.
+ *
+ * Counted scopes additionally run one begin/end query per pipeline
+ * counter. Only one query per target can be active, so at most one
+ * counted scope is counting at a time.
+ *
+ * Every timed scope is also a phase of the hardware counters, see
+ * perfcount.h.
+ *
+ * The instrumentation level is latched in profiler_beginFrame, so every
+ * scope of a frame is pushed and popped at the same level. The scope
+ * functions are defined with parenthesized names, at INSTRUMENT_OFF the
+ * macros of the header would replace them.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "profiler.h"
+#include "perfcount.h"
+
+/** Frames in flight before query results are read */
+#define PROFILER_LATENCY 3
+
+/** Maximum nesting depth of scopes */
+#define PROFILER_MAX_DEPTH 8
+
+// ARB_pipeline_statistics_query, not part of the loader
+#ifndef GL_VERTEX_SHADER_INVOCATIONS_ARB
+#define GL_VERTEX_SHADER_INVOCATIONS_ARB 0x82F0
+#endif
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+/**
+ * Pipeline counters of counted scopes.
+ */
+typedef enum {
+    COUNTER_PRIMITIVES,
+    COUNTER_SAMPLES,
+    COUNTER_VERTEX_INVOCATIONS,
+    COUNTER_FRAGMENT_INVOCATIONS,
+    COUNTER_COUNT
+} ProfilerCounter;
+
+/** Query targets indexed by ProfilerCounter */
+static const GLenum g_counterTargets[COUNTER_COUNT] = {
+    GL_PRIMITIVES_GENERATED,
+    GL_SAMPLES_PASSED,
+    GL_VERTEX_SHADER_INVOCATIONS_ARB,
+    GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+};
+
+/** Counters that need ARB_pipeline_statistics_query start here */
+#define COUNTER_FIRST_ARB COUNTER_VERTEX_INVOCATIONS
+
+/**
+ * One profiled scope.
+ */
+typedef struct {
+    const char *name;
+    int depth;
+
+    float cpuMs[PROFILER_HISTORY];
+    float gpuMs[PROFILER_HISTORY];
+
+    // Current frame
+    double cpuStart;
+    double cpuAccum;
+    float lastGpuMs;
+
+    // Begin/end timestamp per frame in flight
+    GLuint queries[PROFILER_LATENCY][2];
+    bool pending[PROFILER_LATENCY];
+    bool gpuOpen;
+
+    // Pipeline counters per frame in flight, created on the first counted push
+    bool counted;
+    GLuint counters[PROFILER_LATENCY][COUNTER_COUNT];
+    bool countPending[PROFILER_LATENCY];
+    GLuint64 lastCounts[COUNTER_COUNT];
+} ProfilerScope;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global profiler state.
+ */
+static struct {
+    ProfilerScope scopes[PROFILER_MAX_SCOPES];
+    int scopeCount;
+
+    int stack[PROFILER_MAX_DEPTH];
+    int depth;
+
+    float frameMs[PROFILER_HISTORY];
+    double frameStart;
+
+    int frame;
+    int historyPos;
+    int historyFill;
+    bool initialized;
+
+    int countingScope;          // scope whose counter queries are active, -1 for none
+    bool pipelineStats;         // ARB_pipeline_statistics_query is supported
+} g_prof = { 0 };
+
+/**
+ * Finds a scope by name or registers a new one.
+ * @param name Scope name.
+ * @return Scope index or -1 if the table is full.
+ */
+static int findScope(const char *name) {
+    for (int i = 0; i < g_prof.scopeCount; ++i) {
+        if (g_prof.scopes[i].name == name) {
+            return i;
+        }
+    }
+
+    if (g_prof.scopeCount >= PROFILER_MAX_SCOPES) {
+        return -1;
+    }
+
+    int idx = g_prof.scopeCount++;
+    ProfilerScope *s = &g_prof.scopes[idx];
+    s->name = name;
+    s->depth = g_prof.depth;
+    glGenQueries(2 * PROFILER_LATENCY, &s->queries[0][0]);
+    return idx;
+}
+
+/**
+ * Checks whether the context supports an extension.
+ * @param name Extension name.
+ * @return True if it is listed by the context.
+ */
+static bool hasExtension(const char *name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char *ext = (const char*) glGetStringi(GL_EXTENSIONS, i);
+        if (ext && strcmp(ext, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns the number of counters queried in this context.
+ * @return Counter count.
+ */
+static int activeCounters(void) {
+    return g_prof.pipelineStats ? COUNTER_COUNT : COUNTER_FIRST_ARB;
+}
+
+/**
+ * Reads the counters of a counted scope issued in a slot, if they arrived.
+ * @param s The scope.
+ * @param slot Frame in flight.
+ */
+static void collectCounters(ProfilerScope *s, int slot) {
+    if (!s->countPending[slot]) {
+        return;
+    }
+
+    // Only complete sets are taken, so the counters stay from one frame
+    int count = activeCounters();
+    GLint available = 1;
+    for (int c = 0; c < count && available; ++c) {
+        glGetQueryObjectiv(s->counters[slot][c], GL_QUERY_RESULT_AVAILABLE, &available);
+    }
+    if (available) {
+        for (int c = 0; c < count; ++c) {
+            glGetQueryObjectui64v(s->counters[slot][c], GL_QUERY_RESULT, &s->lastCounts[c]);
+        }
+    }
+    s->countPending[slot] = false;
+}
+
+/**
+ * Computes average and maximum of the filled part of a history array.
+ * @param values History values.
+ * @param avg Destination for the average.
+ * @param max Destination for the maximum.
+ */
+static void historyStats(const float *values, float *avg, float *max) {
+    *avg = 0.0f;
+    *max = 0.0f;
+    if (g_prof.historyFill == 0) {
+        return;
+    }
+
+    for (int i = 0; i < g_prof.historyFill; ++i) {
+        *avg += values[i];
+        if (values[i] > *max) *max = values[i];
+    }
+    *avg /= g_prof.historyFill;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void profiler_init(void) {
+    memset(&g_prof, 0, sizeof(g_prof));
+    g_prof.frameStart = glfwGetTime();
+    g_prof.countingScope = -1;
+    g_prof.pipelineStats = hasExtension("GL_ARB_pipeline_statistics_query");
+    g_prof.initialized = true;
+}
+
+void profiler_cleanup(void) {
+    for (int i = 0; i < g_prof.scopeCount; ++i) {
+        glDeleteQueries(2 * PROFILER_LATENCY, &g_prof.scopes[i].queries[0][0]);
+        if (g_prof.scopes[i].counted) {
+            glDeleteQueries(COUNTER_COUNT * PROFILER_LATENCY, &g_prof.scopes[i].counters[0][0]);
+        }
+    }
+    g_prof.scopeCount = 0;
+    g_prof.initialized = false;
+}
+
+void profiler_beginFrame(void) {
+    instrument_beginFrame();
+    if (!g_prof.initialized) {
+        return;
+    }
+
+    g_prof.frame++;
+    int slot = g_prof.frame % PROFILER_LATENCY;
+
+    // Collect the results issued PROFILER_LATENCY frames ago
+    for (int i = 0; i < g_prof.scopeCount; ++i) {
+        ProfilerScope *s = &g_prof.scopes[i];
+        s->cpuAccum = 0.0;
+        s->gpuOpen = false;
+        collectCounters(s, slot);
+
+        if (!s->pending[slot]) {
+            continue;
+        }
+
+        GLint available = 0;
+        glGetQueryObjectiv(s->queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 begin, end;
+            glGetQueryObjectui64v(s->queries[slot][0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(s->queries[slot][1], GL_QUERY_RESULT, &end);
+            s->lastGpuMs = (float)((end - begin) / 1.0e6);
+        }
+        s->pending[slot] = false;
+    }
+}
+
+void profiler_endFrame(void) {
+    if (!g_prof.initialized) {
+        return;
+    }
+
+    double now = glfwGetTime();
+    int pos = g_prof.historyPos;
+
+    g_prof.frameMs[pos] = (float)((now - g_prof.frameStart) * 1000.0);
+    g_prof.frameStart = now;
+
+    // Untimed frames carry no work, older GPU results are not repeated
+    bool timed = INSTRUMENT_ACTIVE(INSTRUMENT_FULL);
+    for (int i = 0; i < g_prof.scopeCount; ++i) {
+        ProfilerScope *s = &g_prof.scopes[i];
+        s->cpuMs[pos] = (float)(s->cpuAccum * 1000.0);
+        s->gpuMs[pos] = timed ? s->lastGpuMs : 0.0f;
+        if (!timed) {
+            s->lastGpuMs = 0.0f;
+        }
+    }
+
+    g_prof.historyPos = (pos + 1) % PROFILER_HISTORY;
+    if (g_prof.historyFill < PROFILER_HISTORY) {
+        g_prof.historyFill++;
+    }
+    perfcount_endFrame();
+}
+
+void (profiler_pushScope)(const char *name) {
+    if (!INSTRUMENT_ACTIVE(INSTRUMENT_LABELS)) {
+        return;
+    }
+    debug_pushRenderScope(name);
+    if (!INSTRUMENT_ACTIVE(INSTRUMENT_FULL)) {
+        return;
+    }
+    PERFCOUNT_BEGIN(name);
+    if (!g_prof.initialized || g_prof.depth >= PROFILER_MAX_DEPTH) {
+        g_prof.depth++;
+        return;
+    }
+
+    int idx = findScope(name);
+    g_prof.stack[g_prof.depth++] = idx;
+    if (idx < 0) {
+        return;
+    }
+
+    ProfilerScope *s = &g_prof.scopes[idx];
+    s->cpuStart = glfwGetTime();
+
+    // Only the first occurrence per frame is timed on the GPU
+    int slot = g_prof.frame % PROFILER_LATENCY;
+    if (!s->pending[slot] && !s->gpuOpen) {
+        glQueryCounter(s->queries[slot][0], GL_TIMESTAMP);
+        s->gpuOpen = true;
+    }
+}
+
+void (profiler_pushCountedScope)(const char *name) {
+    (profiler_pushScope)(name);
+    if (!INSTRUMENT_ACTIVE(INSTRUMENT_FULL) || !g_prof.initialized || g_prof.depth > PROFILER_MAX_DEPTH || g_prof.countingScope >= 0) {
+        return;
+    }
+
+    int idx = g_prof.stack[g_prof.depth - 1];
+    if (idx < 0) {
+        return;
+    }
+
+    ProfilerScope *s = &g_prof.scopes[idx];
+    if (!s->counted) {
+        glGenQueries(COUNTER_COUNT * PROFILER_LATENCY, &s->counters[0][0]);
+        s->counted = true;
+    }
+
+    // Like the timestamps, only the first occurrence per frame is counted
+    int slot = g_prof.frame % PROFILER_LATENCY;
+    if (s->countPending[slot]) {
+        return;
+    }
+    for (int c = 0; c < activeCounters(); ++c) {
+        glBeginQuery(g_counterTargets[c], s->counters[slot][c]);
+    }
+    g_prof.countingScope = idx;
+}
+
+void (profiler_popScope)(void) {
+    if (!INSTRUMENT_ACTIVE(INSTRUMENT_LABELS)) {
+        return;
+    }
+    debug_popRenderScope();
+    if (!INSTRUMENT_ACTIVE(INSTRUMENT_FULL) || g_prof.depth <= 0) {
+        return;
+    }
+    PERFCOUNT_END();
+
+    g_prof.depth--;
+    if (!g_prof.initialized || g_prof.depth >= PROFILER_MAX_DEPTH) {
+        return;
+    }
+
+    int idx = g_prof.stack[g_prof.depth];
+    if (idx < 0) {
+        return;
+    }
+
+    ProfilerScope *s = &g_prof.scopes[idx];
+    s->cpuAccum += glfwGetTime() - s->cpuStart;
+
+    int slot = g_prof.frame % PROFILER_LATENCY;
+    if (s->gpuOpen && !s->pending[slot]) {
+        glQueryCounter(s->queries[slot][1], GL_TIMESTAMP);
+        s->pending[slot] = true;
+    }
+
+    if (g_prof.countingScope == idx) {
+        for (int c = 0; c < activeCounters(); ++c) {
+            glEndQuery(g_counterTargets[c]);
+        }
+        s->countPending[slot] = true;
+        g_prof.countingScope = -1;
+    }
+}
+
+bool profiler_hasPipelineStats(void) {
+    return g_prof.pipelineStats;
+}
+
+int profiler_getScopeCount(void) {
+    return g_prof.scopeCount;
+}
+
+void profiler_getScopeStats(int idx, ProfilerStats *stats) {
+    ProfilerScope *s = &g_prof.scopes[idx];
+    stats->name = s->name;
+    stats->depth = s->depth;
+    historyStats(s->cpuMs, &stats->cpuAvg, &stats->cpuMax);
+    historyStats(s->gpuMs, &stats->gpuAvg, &stats->gpuMax);
+
+    stats->counted = s->counted;
+    stats->primitives = s->lastCounts[COUNTER_PRIMITIVES];
+    stats->samples = s->lastCounts[COUNTER_SAMPLES];
+    stats->vertexInvocations = s->lastCounts[COUNTER_VERTEX_INVOCATIONS];
+    stats->fragmentInvocations = s->lastCounts[COUNTER_FRAGMENT_INVOCATIONS];
+}
+
+void profiler_getLastFrameWork(float *cpuMs, float *gpuMs) {
+    *cpuMs = 0.0f;
+    *gpuMs = 0.0f;
+    if (g_prof.historyFill == 0) {
+        return;
+    }
+
+    int pos = (g_prof.historyPos + PROFILER_HISTORY - 1) % PROFILER_HISTORY;
+    for (int i = 0; i < g_prof.scopeCount; ++i) {
+        if (g_prof.scopes[i].depth == 0) {
+            *cpuMs += g_prof.scopes[i].cpuMs[pos];
+            *gpuMs += g_prof.scopes[i].gpuMs[pos];
+        }
+    }
+}
+
+void profiler_getLastScopeWork(int idx, float *cpuMs, float *gpuMs) {
+    *cpuMs = 0.0f;
+    *gpuMs = 0.0f;
+    if (g_prof.historyFill == 0) {
+        return;
+    }
+
+    int pos = (g_prof.historyPos + PROFILER_HISTORY - 1) % PROFILER_HISTORY;
+    *cpuMs = g_prof.scopes[idx].cpuMs[pos];
+    *gpuMs = g_prof.scopes[idx].gpuMs[pos];
+}
+
+void profiler_getFrameStats(ProfilerStats *stats) {
+    stats->name = "Frame";
+    stats->depth = 0;
+    historyStats(g_prof.frameMs, &stats->cpuAvg, &stats->cpuMax);
+    stats->gpuAvg = 0.0f;
+    stats->gpuMax = 0.0f;
+    stats->counted = false;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file profiler.h
+ * @brief CPU/GPU frame profiler with rolling history
+ *
+ * Scopes push debug labels from INSTRUMENT_LABELS on and are timed at
+ * INSTRUMENT_FULL, at INSTRUMENT_OFF the scope functions compile to
+ * nothing. Timings of frames below INSTRUMENT_FULL are zero.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <fhwcg/fhwcg.h>
+#include "instrument.h"
+
+/** Maximum number of distinct scopes */
+#define PROFILER_MAX_SCOPES 16
+
+/** Number of frames kept in the rolling history */
+#define PROFILER_HISTORY 120
+
+/**
+ * Averaged timings of one scope (or the whole frame) in milliseconds.
+ * Counted scopes also carry the pipeline counters of the last frame
+ * whose results arrived.
+ */
+typedef struct {
+    const char *name;
+    int depth;
+    float cpuAvg, cpuMax;
+    float gpuAvg, gpuMax;
+
+    bool counted;                   // opened with profiler_pushCountedScope
+    GLuint64 primitives;            // GL_PRIMITIVES_GENERATED
+    GLuint64 samples;               // GL_SAMPLES_PASSED
+    GLuint64 vertexInvocations;     // 0 without ARB_pipeline_statistics_query
+    GLuint64 fragmentInvocations;   // 0 without ARB_pipeline_statistics_query
+} ProfilerStats;
+
+/**
+ * Creates the timer queries.
+ */
+void profiler_init(void);
+
+/**
+ * Deletes the timer queries.
+ */
+void profiler_cleanup(void);
+
+/**
+ * Starts a new frame and collects GPU results of older frames.
+ */
+void profiler_beginFrame(void);
+
+/**
+ * Ends the frame and pushes all timings into the history.
+ */
+void profiler_endFrame(void);
+
+/**
+ * Opens a named scope: pushes a debug render scope and starts the
+ * CPU timer and a GPU timestamp query.
+ * @param name Scope name, must be a string literal (compared by pointer).
+ */
+void profiler_pushScope(const char *name);
+
+/**
+ * Opens a named scope like profiler_pushScope and also counts the
+ * primitives and samples drawn in it, with ARB_pipeline_statistics_query
+ * the vertex and fragment shader invocations as well. Counting queries
+ * cannot nest, a counted scope inside another one is only timed.
+ * @param name Scope name, must be a string literal (compared by pointer).
+ */
+void profiler_pushCountedScope(const char *name);
+
+/**
+ * Closes the innermost scope opened with profiler_pushScope or
+ * profiler_pushCountedScope.
+ */
+void profiler_popScope(void);
+
+#if INSTRUMENT_LEVEL == INSTRUMENT_OFF
+    #define profiler_pushScope(name) ((void) 0)
+    #define profiler_pushCountedScope(name) ((void) 0)
+    #define profiler_popScope() ((void) 0)
+#endif
+
+/**
+ * Returns whether the shader invocations are counted.
+ * @return True if ARB_pipeline_statistics_query is supported.
+ */
+bool profiler_hasPipelineStats(void);
+
+/**
+ * Returns the number of scopes seen so far.
+ * @return Scope count.
+ */
+int profiler_getScopeCount(void);
+
+/**
+ * Returns the averaged timings of a scope.
+ * @param idx Scope index in [0, profiler_getScopeCount()).
+ * @param stats Destination for the timings.
+ */
+void profiler_getScopeStats(int idx, ProfilerStats *stats);
+
+/**
+ * Returns the work time of the last finished frame: the summed CPU and
+ * GPU times of all top-level scopes. Unlike the frame time it does not
+ * include waiting for vsync. The GPU time lags a few frames behind.
+ * @param cpuMs Destination for the CPU time.
+ * @param gpuMs Destination for the GPU time.
+ */
+void profiler_getLastFrameWork(float *cpuMs, float *gpuMs);
+
+/**
+ * Returns the timings of a scope in the last finished frame.
+ * The GPU time lags a few frames behind, like in profiler_getLastFrameWork.
+ * @param idx Scope index in [0, profiler_getScopeCount()).
+ * @param cpuMs Destination for the CPU time.
+ * @param gpuMs Destination for the GPU time.
+ */
+void profiler_getLastScopeWork(int idx, float *cpuMs, float *gpuMs);
+
+/**
+ * Returns the averaged frame time (CPU) in the history.
+ * @param stats Destination for the timings, GPU fields are unused.
+ */
+void profiler_getFrameStats(ProfilerStats *stats);
+
+#endif // PROFILER_H
@@ -0,0 +1,103 @@
+/**
+ * @file quality.c
+ * @brief Implementation of the adaptive quality governor
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "quality.h"
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global governor state.
+ */
+static struct {
+    int level;
+    float smoothedMs;
+    int overFrames;
+    int underFrames;
+    int cooldown;
+
+    // Work time right before a level was entered and the time it saved,
+    // negative until measured after the cooldown
+    float enterMs[QUALITY_MAX_LEVELS];
+    float savedMs[QUALITY_MAX_LEVELS];
+} g_quality = { 0 };
+
+/**
+ * Switches to a level and starts the cooldown.
+ * @param level New level.
+ */
+static void setLevel(int level) {
+    if (level > g_quality.level) {
+        g_quality.enterMs[level] = g_quality.smoothedMs;
+        g_quality.savedMs[level] = -1.0f;
+    }
+    g_quality.level = level;
+    g_quality.overFrames = 0;
+    g_quality.underFrames = 0;
+    g_quality.cooldown = QUALITY_COOLDOWN_FRAMES;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void quality_reset(void) {
+    memset(&g_quality, 0, sizeof(g_quality));
+}
+
+int quality_update(float workMs, float budgetMs, int maxLevel) {
+    if (maxLevel > QUALITY_MAX_LEVELS - 1) maxLevel = QUALITY_MAX_LEVELS - 1;
+    if (maxLevel < 0) maxLevel = 0;
+
+    if (g_quality.smoothedMs <= 0.0f) {
+        g_quality.smoothedMs = workMs;
+    } else {
+        g_quality.smoothedMs += QUALITY_SMOOTHING * (workMs - g_quality.smoothedMs);
+    }
+
+    if (g_quality.level > maxLevel) {
+        setLevel(maxLevel);
+    }
+
+    if (g_quality.cooldown > 0) {
+        if (--g_quality.cooldown == 0 && g_quality.level > 0
+            && g_quality.savedMs[g_quality.level] < 0.0f) {
+            float saved = g_quality.enterMs[g_quality.level] - g_quality.smoothedMs;
+            g_quality.savedMs[g_quality.level] = saved > 0.0f ? saved : 0.0f;
+        }
+        return g_quality.level;
+    }
+
+    if (g_quality.smoothedMs > budgetMs) {
+        g_quality.underFrames = 0;
+        if (++g_quality.overFrames >= QUALITY_DEGRADE_FRAMES && g_quality.level < maxLevel) {
+            setLevel(g_quality.level + 1);
+        }
+        return g_quality.level;
+    }
+    g_quality.overFrames = 0;
+
+    // The level below would add back what this one saved
+    float restoredMs = g_quality.smoothedMs;
+    if (g_quality.level > 0) {
+        restoredMs += g_quality.savedMs[g_quality.level];
+    }
+
+    if (g_quality.level > 0 && restoredMs < QUALITY_RESTORE_RATIO * budgetMs) {
+        if (++g_quality.underFrames >= QUALITY_RESTORE_FRAMES) {
+            setLevel(g_quality.level - 1);
+        }
+    } else {
+        g_quality.underFrames = 0;
+    }
+    return g_quality.level;
+}
+
+int quality_getLevel(void) {
+    return g_quality.level;
+}
+
+float quality_getSmoothedMs(void) {
+    return g_quality.smoothedMs;
+}
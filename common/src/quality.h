@@ -0,0 +1,66 @@
+/**
+ * @file quality.h
+ * @brief Adaptive quality governor for visual-only work
+ *
+ * Watches the work time of every frame and raises a quality level while the
+ * smoothed time stays over the budget. Level 0 is full quality, what a level
+ * turns off is up to the caller. Every level remembers how much time it saved
+ * when it was entered, and is only left again once the frame still fits into
+ * QUALITY_RESTORE_RATIO of the budget with that time added back. Together with
+ * the cooldown after every change this keeps the level from oscillating.
+ *
+ * The file is kept identical in all exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef QUALITY_H
+#define QUALITY_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Highest level a caller may use */
+#define QUALITY_MAX_LEVELS 8
+
+/** Weight of the newest frame in the smoothed work time */
+#define QUALITY_SMOOTHING 0.1f
+
+/** Share of the budget a restored level has to fit into */
+#define QUALITY_RESTORE_RATIO 0.85f
+
+/** Consecutive frames over budget before the level is raised */
+#define QUALITY_DEGRADE_FRAMES 10
+
+/** Consecutive frames with headroom before the level is lowered */
+#define QUALITY_RESTORE_FRAMES 60
+
+/** Frames after a change before the next one, covers the GPU timer latency */
+#define QUALITY_COOLDOWN_FRAMES 30
+
+/**
+ * Returns to full quality and forgets the measured savings.
+ */
+void quality_reset(void);
+
+/**
+ * Feeds the work time of a frame and adapts the level.
+ * @param workMs Work time of the frame, the larger of CPU and GPU time.
+ * @param budgetMs Frame budget.
+ * @param maxLevel Cheapest level, at most QUALITY_MAX_LEVELS - 1.
+ * @return Level to render the next frame with.
+ */
+int quality_update(float workMs, float budgetMs, int maxLevel);
+
+/**
+ * Returns the current level.
+ * @return Level, 0 is full quality.
+ */
+int quality_getLevel(void);
+
+/**
+ * Returns the smoothed work time.
+ * @return Work time in milliseconds.
+ */
+float quality_getSmoothedMs(void);
+
+#endif // QUALITY_H
@@ -0,0 +1,474 @@
+/**
+ * @file rendbench.c
+ * @brief Implementation of the rendering benchmark
+ *
+ * The frame time is taken between two rendbench_endFrame calls, so it
+ * covers the whole loop including the swap. Scope times come from the
+ * profiler per frame and are summed by scope index, scopes seen for the
+ * first time during the run count as 0 in the frames before. Every full
+ * block appends one row of averages to the block table, the frame time
+ * statistics of a block are taken from the frame times at the end.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "rendbench.h"
+#include "profiler.h"
+#include "array.h"
+#include "rng.h"
+#include "benchresult.h"
+
+/**
+ * One keyframe of a camera path.
+ */
+typedef struct {
+    float time;
+    vec3 pos;
+    vec3 dir;
+} CameraKey;
+
+DEFINE_ARRAY_TYPE(CameraKey, KeyArr)
+DEFINE_ARRAY_TYPE(float, FloatArr)
+
+/**
+ * Summed timings of one profiler scope.
+ */
+typedef struct {
+    float cpuSum, cpuMax;
+    float gpuSum, gpuMax;
+} ScopeSums;
+
+/** Columns of the block table: CPU and GPU work, then CPU and GPU time per scope */
+#define BLOCK_COLUMNS (2 + 2 * PROFILER_MAX_SCOPES)
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global benchmark state.
+ */
+static struct {
+    bool playing;
+    bool finished;
+    const char *name;
+    const char *pathFile;
+    char outFile[256];
+    const char *baselineFile;
+    double threshold;       // percent
+
+    KeyArr keys;
+    float time;             // position on the path in seconds
+    int warmup;             // frames left before measuring
+    double lastFrame;       // glfwGetTime at the last rendbench_endFrame
+
+    FloatArr frameMs;
+    ScopeSums scopes[PROFILER_MAX_SCOPES];
+    float cpuWorkSum, gpuWorkSum;
+
+    FloatArr blocks;                // BLOCK_COLUMNS averages per full block
+    float blockSums[BLOCK_COLUMNS];
+    int blockFrames;
+
+    FILE *record;
+    double recordStart;
+    float lastRecorded;
+} g_bench = { 0 };
+
+/** Whether the last playback regressed, kept past rendbench_cleanup */
+static bool g_regressed = false;
+
+/**
+ * Reads a camera path file.
+ * @param path File name.
+ * @return False if the file can't be read or has less than two keyframes.
+ */
+static bool loadPath(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("Rendering benchmark: can't open camera path %s!\n", path);
+        return false;
+    }
+
+    CameraKey key;
+    while (fscanf(file, "%f %f %f %f %f %f %f", &key.time,
+                  &key.pos[0], &key.pos[1], &key.pos[2],
+                  &key.dir[0], &key.dir[1], &key.dir[2]) == 7) {
+        // Keys out of order would stall the interpolation
+        if (g_bench.keys.size > 0 && key.time <= g_bench.keys.data[g_bench.keys.size - 1].time) {
+            continue;
+        }
+        glm_vec3_normalize(key.dir);
+        KeyArr_push(&g_bench.keys, key);
+    }
+    fclose(file);
+
+    if (g_bench.keys.size < 2) {
+        printf("Rendering benchmark: camera path %s needs at least two keyframes!\n", path);
+        KeyArr_free(&g_bench.keys);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Interpolates the camera path, directions are lerped and normalized.
+ * @param time Time on the path, clamped to its ends.
+ * @param pos Destination for the position.
+ * @param dir Destination for the direction.
+ */
+static void samplePath(float time, vec3 pos, vec3 dir) {
+    CameraKey *keys = g_bench.keys.data;
+    size_t last = g_bench.keys.size - 1;
+
+    size_t i = 0;
+    while (i < last - 1 && keys[i + 1].time <= time) {
+        ++i;
+    }
+
+    float t = glm_clamp((time - keys[i].time) / (keys[i + 1].time - keys[i].time), 0.0f, 1.0f);
+    glm_vec3_lerp(keys[i].pos, keys[i + 1].pos, t, pos);
+    glm_vec3_lerp(keys[i].dir, keys[i + 1].dir, t, dir);
+
+    // Opposite directions lerp through zero, keep the earlier one then
+    if (glm_vec3_norm2(dir) < 1e-6f) {
+        glm_vec3_copy(keys[i].dir, dir);
+    }
+    glm_vec3_normalize(dir);
+}
+
+/**
+ * Orders frame times ascending.
+ */
+static int compareFloats(const void *a, const void *b) {
+    float fa = *(const float*) a;
+    float fb = *(const float*) b;
+    return (fa > fb) - (fa < fb);
+}
+
+/**
+ * Returns a percentile of sorted values, nearest rank.
+ * @param sorted Ascending values.
+ * @param count Number of values, at least one.
+ * @param p Percentile in [0, 100].
+ * @return The value.
+ */
+static float percentile(const float *sorted, int count, float p) {
+    int rank = (int) ceilf(p / 100.0f * count) - 1;
+    return sorted[rank < 0 ? 0 : (rank >= count ? count - 1 : rank)];
+}
+
+/**
+ * Adds the profiler timings of the last finished frame to the sums.
+ */
+static void collectScopes(void) {
+    int count = profiler_getScopeCount();
+    for (int i = 0; i < count; ++i) {
+        float cpuMs, gpuMs;
+        profiler_getLastScopeWork(i, &cpuMs, &gpuMs);
+
+        ScopeSums *s = &g_bench.scopes[i];
+        s->cpuSum += cpuMs;
+        s->gpuSum += gpuMs;
+        s->cpuMax = glm_max(s->cpuMax, cpuMs);
+        s->gpuMax = glm_max(s->gpuMax, gpuMs);
+        g_bench.blockSums[2 + 2 * i] += cpuMs;
+        g_bench.blockSums[3 + 2 * i] += gpuMs;
+    }
+
+    float cpuWork, gpuWork;
+    profiler_getLastFrameWork(&cpuWork, &gpuWork);
+    g_bench.cpuWorkSum += cpuWork;
+    g_bench.gpuWorkSum += gpuWork;
+    g_bench.blockSums[0] += cpuWork;
+    g_bench.blockSums[1] += gpuWork;
+}
+
+/**
+ * Appends the averages of the current block to the block table and starts the next one.
+ */
+static void closeBlock(void) {
+    for (int c = 0; c < BLOCK_COLUMNS; ++c) {
+        FloatArr_push(&g_bench.blocks, g_bench.blockSums[c] / g_bench.blockFrames);
+    }
+    memset(g_bench.blockSums, 0, sizeof(g_bench.blockSums));
+    g_bench.blockFrames = 0;
+}
+
+/**
+ * Adds the frame time statistics of every block to a result.
+ * @param result Destination.
+ * @param blocks Number of blocks.
+ */
+static void addFrameMetrics(BenchResult *result, int blocks) {
+    static const char *names[] = {"frame avg", "frame p50", "frame p95", "frame p99", "frame max"};
+    float *samples = malloc(NK_LEN(names) * blocks * sizeof(float));
+    if (!samples) {
+        return;
+    }
+    int frames = (int) g_bench.frameMs.size;
+
+    for (int b = 0; b < blocks; ++b) {
+        // The only block may be shorter
+        int first = b * RENDBENCH_BLOCK_FRAMES;
+        int count = glm_imin(RENDBENCH_BLOCK_FRAMES, frames - first);
+        float sorted[RENDBENCH_BLOCK_FRAMES];
+        float sum = 0.0f;
+        for (int i = 0; i < count; ++i) {
+            sorted[i] = g_bench.frameMs.data[first + i];
+            sum += sorted[i];
+        }
+        qsort(sorted, count, sizeof(float), compareFloats);
+
+        samples[b] = sum / count;
+        samples[blocks + b] = percentile(sorted, count, 50.0f);
+        samples[2 * blocks + b] = percentile(sorted, count, 95.0f);
+        samples[3 * blocks + b] = percentile(sorted, count, 99.0f);
+        samples[4 * blocks + b] = sorted[count - 1];
+    }
+
+    for (int m = 0; m < NK_LEN(names); ++m) {
+        benchresult_addFloats(result, names[m], "ms", false, samples + m * blocks, blocks);
+    }
+    free(samples);
+}
+
+/**
+ * Adds the work and scope times of every block to a result.
+ * @param result Destination.
+ * @param blocks Number of blocks.
+ */
+static void addScopeMetrics(BenchResult *result, int blocks) {
+    float *samples = malloc(blocks * sizeof(float));
+    if (!samples) {
+        return;
+    }
+    int count = profiler_getScopeCount();
+    for (int c = 0; c < 2 + 2 * count; ++c) {
+        for (int b = 0; b < blocks; ++b) {
+            samples[b] = g_bench.blocks.data[b * BLOCK_COLUMNS + c];
+        }
+
+        char name[BENCHRESULT_NAME_LENGTH];
+        if (c < 2) {
+            snprintf(name, sizeof(name), "work %s", c == 0 ? "cpu" : "gpu");
+        } else {
+            ProfilerStats stats;
+            profiler_getScopeStats((c - 2) / 2, &stats);
+            snprintf(name, sizeof(name), "%s %s", stats.name, c % 2 == 0 ? "cpu" : "gpu");
+        }
+        benchresult_addFloats(result, name, "ms", false, samples, blocks);
+    }
+    free(samples);
+}
+
+/**
+ * Prints a summary of all measured frames.
+ */
+static void printSummary(void) {
+    int frames = (int) g_bench.frameMs.size;
+    float *sorted = g_bench.frameMs.data;
+    float sum = 0.0f;
+    for (int i = 0; i < frames; ++i) {
+        sum += sorted[i];
+    }
+    qsort(sorted, frames, sizeof(float), compareFloats);
+
+    float avg = sum / frames;
+    float p50 = percentile(sorted, frames, 50.0f);
+    float p95 = percentile(sorted, frames, 95.0f);
+    float p99 = percentile(sorted, frames, 99.0f);
+
+    printf("Rendering benchmark: %d frames, avg %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           frames, avg, p50, p95, p99, sorted[frames - 1]);
+    printf("Rendering benchmark: work avg cpu %.3f ms, gpu %.3f ms\n",
+           g_bench.cpuWorkSum / frames, g_bench.gpuWorkSum / frames);
+
+    int count = profiler_getScopeCount();
+    for (int i = 0; i < count; ++i) {
+        ProfilerStats stats;
+        profiler_getScopeStats(i, &stats);
+        const ScopeSums *s = &g_bench.scopes[i];
+        printf("Rendering benchmark: %*s%-*s cpu avg %.3f max %.3f ms, gpu avg %.3f max %.3f ms\n",
+               2 * stats.depth, "", 24 - 2 * stats.depth, stats.name,
+               s->cpuSum / frames, s->cpuMax, s->gpuSum / frames, s->gpuMax);
+    }
+}
+
+/**
+ * Writes the measured frames as a result, prints a summary and compares
+ * the result to the baseline.
+ */
+static void writeReport(void) {
+    int frames = (int) g_bench.frameMs.size;
+    if (frames == 0) {
+        return;
+    }
+
+    // A shorter last block only counts if there is no full one
+    if (g_bench.blocks.size == 0) {
+        closeBlock();
+    }
+    int blocks = (int) (g_bench.blocks.size / BLOCK_COLUMNS);
+
+    static BenchResult result;
+    benchresult_init(&result, g_bench.name, 0, NULL);
+    char text[32];
+    benchresult_setInfo(&result, BS_CONFIG, "cameraPath", g_bench.pathFile);
+    snprintf(text, sizeof(text), "%llu", (unsigned long long) RENDBENCH_SEED);
+    benchresult_setInfo(&result, BS_CONFIG, "seed", text);
+    snprintf(text, sizeof(text), "%.3f", RENDBENCH_STEP * 1000.0f);
+    benchresult_setInfo(&result, BS_CONFIG, "stepMs", text);
+    snprintf(text, sizeof(text), "%d", RENDBENCH_WARMUP_FRAMES);
+    benchresult_setInfo(&result, BS_CONFIG, "warmupFrames", text);
+    snprintf(text, sizeof(text), "%d", frames);
+    benchresult_setInfo(&result, BS_CONFIG, "frames", text);
+    snprintf(text, sizeof(text), "%d", RENDBENCH_BLOCK_FRAMES);
+    benchresult_setInfo(&result, BS_CONFIG, "blockFrames", text);
+
+    // The blocks read the frame times in order, the summary sorts them
+    addFrameMetrics(&result, blocks);
+    addScopeMetrics(&result, blocks);
+    printSummary();
+
+    if (benchresult_write(&result, g_bench.outFile)) {
+        printf("Rendering benchmark: report written to %s\n", g_bench.outFile);
+    }
+
+    if (g_bench.baselineFile) {
+        static BenchResult baseline;
+        if (benchresult_load(&baseline, g_bench.baselineFile)) {
+            g_regressed = benchresult_compare(&baseline, &result, g_bench.threshold) > 0;
+            benchresult_free(&baseline);
+        } else {
+            g_regressed = true;
+        }
+    }
+    benchresult_free(&result);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void rendbench_init(const char *name) {
+    g_bench.name = name;
+
+    const char *record = getenv("RENDER_BENCH_RECORD");
+    if (record && record[0]) {
+        g_bench.record = fopen(record, "w");
+        if (!g_bench.record) {
+            printf("Rendering benchmark: can't record to %s!\n", record);
+        }
+        g_bench.recordStart = -1.0;
+        return;
+    }
+
+    const char *path = getenv("RENDER_BENCH");
+    if (!path || !path[0] || !loadPath(path)) {
+        return;
+    }
+
+    const char *out = getenv("RENDER_BENCH_OUT");
+    if (out && out[0]) {
+        snprintf(g_bench.outFile, sizeof(g_bench.outFile), "%s", out);
+    } else {
+        snprintf(g_bench.outFile, sizeof(g_bench.outFile), "%s_bench.json", name);
+    }
+
+    // One entry per frame of the path, the run never reallocates
+    float duration = g_bench.keys.data[g_bench.keys.size - 1].time - g_bench.keys.data[0].time;
+    size_t frames = (size_t) ceilf(duration / RENDBENCH_STEP) + 1;
+    FloatArr_reserve(&g_bench.frameMs, frames);
+    FloatArr_reserve(&g_bench.blocks, (frames / RENDBENCH_BLOCK_FRAMES + 1) * BLOCK_COLUMNS);
+
+    const char *baseline = getenv("RENDER_BENCH_BASELINE");
+    const char *threshold = getenv("RENDER_BENCH_THRESHOLD");
+    g_bench.baselineFile = baseline && baseline[0] ? baseline : NULL;
+    g_bench.threshold = threshold && threshold[0] ? atof(threshold) : BENCHRESULT_DEFAULT_THRESHOLD;
+
+    g_bench.pathFile = path;
+    g_bench.time = g_bench.keys.data[0].time;
+    g_bench.warmup = RENDBENCH_WARMUP_FRAMES;
+    g_bench.playing = true;
+    rng_setSeed(RENDBENCH_SEED);
+}
+
+void rendbench_cleanup(void) {
+    if (g_bench.finished) {
+        writeReport();
+    }
+    if (g_bench.record) {
+        fclose(g_bench.record);
+    }
+
+    KeyArr_free(&g_bench.keys);
+    FloatArr_free(&g_bench.frameMs);
+    FloatArr_free(&g_bench.blocks);
+    memset(&g_bench, 0, sizeof(g_bench));
+}
+
+int rendbench_exitCode(void) {
+    return g_regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+bool rendbench_isPlaying(void) {
+    return g_bench.playing;
+}
+
+WindowFlags rendbench_windowFlags(WindowFlags flags) {
+    return g_bench.playing ? (WindowFlags) (flags & ~WINDOW_FLAGS_VSYNC) : flags;
+}
+
+float rendbench_frameTime(float dt) {
+    return g_bench.playing ? RENDBENCH_STEP : dt;
+}
+
+void rendbench_camera(vec3 pos, vec3 dir) {
+    if (g_bench.playing) {
+        samplePath(g_bench.time, pos, dir);
+        return;
+    }
+    if (!g_bench.record) {
+        return;
+    }
+
+    double now = glfwGetTime();
+    if (g_bench.recordStart < 0.0) {
+        g_bench.recordStart = now;
+        g_bench.lastRecorded = -RENDBENCH_RECORD_INTERVAL;
+    }
+
+    float time = (float) (now - g_bench.recordStart);
+    if (time - g_bench.lastRecorded >= RENDBENCH_RECORD_INTERVAL) {
+        fprintf(g_bench.record, "%.3f %f %f %f %f %f %f\n", time,
+                pos[0], pos[1], pos[2], dir[0], dir[1], dir[2]);
+        g_bench.lastRecorded = time;
+    }
+}
+
+bool rendbench_endFrame(void) {
+    if (!g_bench.playing) {
+        return true;
+    }
+
+    double now = glfwGetTime();
+    double last = g_bench.lastFrame;
+    g_bench.lastFrame = now;
+
+    // The warmup also gives the first measured frame a start time
+    if (g_bench.warmup > 0) {
+        --g_bench.warmup;
+        return true;
+    }
+
+    FloatArr_push(&g_bench.frameMs, (float) ((now - last) * 1000.0));
+    collectScopes();
+    if (++g_bench.blockFrames == RENDBENCH_BLOCK_FRAMES) {
+        closeBlock();
+    }
+
+    g_bench.time += RENDBENCH_STEP;
+    if (g_bench.time > g_bench.keys.data[g_bench.keys.size - 1].time) {
+        g_bench.playing = false;
+        g_bench.finished = true;
+        return false;
+    }
+    return true;
+}
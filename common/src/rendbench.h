@@ -0,0 +1,111 @@
+/**
+ * @file rendbench.h
+ * @brief Reproducible rendering benchmark along a recorded camera path
+ *
+ * A camera path is a text file with one keyframe per line:
+ * "<time> <pos x y z> <dir x y z>". It is recorded from the camera the
+ * user flies and played back with linear interpolation between keyframes.
+ *
+ * During playback every frame advances the simulation and the path by
+ * RENDBENCH_STEP, no matter how long it took, so every run draws the same
+ * frames. The window is opened without vsync, the random numbers are
+ * seeded with RENDBENCH_SEED and the first RENDBENCH_WARMUP_FRAMES frames
+ * hold the first keyframe without being measured. Once the path ends the
+ * window closes and the report is written as a result (benchresult.h).
+ * The measured frames are split into blocks of RENDBENCH_BLOCK_FRAMES,
+ * every block is one sample of the average, p50, p95, p99 and maximum of
+ * the frame times and of the CPU and GPU times per profiler scope, so a
+ * single playback already shows how noisy every metric is. The summary of
+ * all frames is printed.
+ *
+ * Both modes are chosen by environment variables:
+ * - RENDER_BENCH=<path> plays the camera path back,
+ * - RENDER_BENCH_OUT=<file> names the JSON report, "<name>_bench.json" by default,
+ * - RENDER_BENCH_BASELINE=<file> compares the report to an earlier one,
+ * - RENDER_BENCH_THRESHOLD=<percent> sets the allowed slowdown against it,
+ * - RENDER_BENCH_RECORD=<path> records the camera path instead.
+ * Without them every call costs one branch.
+ *
+ * The file is kept identical in all exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef RENDBENCH_H
+#define RENDBENCH_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Simulated time per frame during playback, in seconds */
+#define RENDBENCH_STEP (1.0f / 60.0f)
+
+/** Frames at the first keyframe before measuring starts */
+#define RENDBENCH_WARMUP_FRAMES 60
+
+/** Seed of the random numbers during playback */
+#define RENDBENCH_SEED 0xbe7c5eedull
+
+/** Minimum time between two recorded keyframes, in seconds */
+#define RENDBENCH_RECORD_INTERVAL 0.1f
+
+/** Measured frames per sample of the report, a shorter last block is dropped unless it is the only one */
+#define RENDBENCH_BLOCK_FRAMES 120
+
+/**
+ * Reads the mode from the environment, loads the camera path and seeds
+ * the random numbers. Call before the window is opened and before any
+ * other thread starts.
+ * @param name Program name for the default report file.
+ */
+void rendbench_init(const char *name);
+
+/**
+ * Writes the report of a finished playback, compares it to the baseline
+ * and closes a recording. Call before profiler_cleanup, the report reads
+ * the scope names.
+ */
+void rendbench_cleanup(void);
+
+/**
+ * Returns the exit code of the program, valid after rendbench_cleanup.
+ * @return EXIT_FAILURE if the playback regressed against the baseline.
+ */
+int rendbench_exitCode(void);
+
+/**
+ * Checks whether a camera path is played back.
+ * @return True during playback, until the window closed.
+ */
+bool rendbench_isPlaying(void);
+
+/**
+ * Returns the window flags to open the window with: vsync is dropped
+ * during playback.
+ * @param flags Flags the program would use.
+ * @return The flags to use.
+ */
+WindowFlags rendbench_windowFlags(WindowFlags flags);
+
+/**
+ * Returns the simulated time of the frame.
+ * @param dt Measured frame time in seconds.
+ * @return RENDBENCH_STEP during playback, dt otherwise.
+ */
+float rendbench_frameTime(float dt);
+
+/**
+ * Replaces the camera by the path during playback, appends it to the
+ * path while recording. Call once per frame with the final camera.
+ * @param pos Camera position, overwritten during playback.
+ * @param dir Camera direction, overwritten during playback.
+ */
+void rendbench_camera(vec3 pos, vec3 dir);
+
+/**
+ * Measures the frame and advances the path. Call once per frame after
+ * profiler_endFrame and the buffer swap.
+ * @return False once the path was played back and the window should close.
+ */
+bool rendbench_endFrame(void);
+
+#endif // RENDBENCH_H
@@ -0,0 +1,301 @@
+/**
+ * @file resarchive.c
+ * @brief Implementation of the resource archive
+ *
+ * The whole file is mapped read only, the table is checked once when it
+ * is opened so the lookups can trust every offset. Invalidated entries
+ * are kept in a byte per entry beside the mapping, the mapping itself is
+ * never written. Invalidating one kind writes no byte that a lookup of
+ * another kind reads.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "resarchive.h"
+#include "alloctrack.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * The mapped archive.
+ */
+static struct {
+    const unsigned char *base;      // NULL if no archive is open
+    size_t size;
+    const ResArchiveHeader *header;
+    const ResArchiveEntry *entries;
+    const ResArchiveDependency *dependencies;
+    const char *strings;
+    unsigned char *invalid;         // one flag per entry
+#ifdef _WIN32
+    HANDLE file, mapping;
+#endif
+} g_archive = { 0 };
+
+/**
+ * Maps a whole file read only.
+ * @param path Path of the file.
+ * @return False if it could not be mapped.
+ */
+static bool mapFile(const char *path) {
+#ifdef _WIN32
+    g_archive.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (g_archive.file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    g_archive.mapping = GetFileSizeEx(g_archive.file, &size) && size.QuadPart > 0
+        ? CreateFileMappingA(g_archive.file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    g_archive.base = g_archive.mapping ? MapViewOfFile(g_archive.mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!g_archive.base) {
+        if (g_archive.mapping) {
+            CloseHandle(g_archive.mapping);
+        }
+        CloseHandle(g_archive.file);
+        return false;
+    }
+    g_archive.size = (size_t) size.QuadPart;
+    return true;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping stays valid without the descriptor
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    g_archive.base = base;
+    g_archive.size = (size_t) st.st_size;
+    return true;
+#endif
+}
+
+/**
+ * Unmaps the file mapped by mapFile.
+ */
+static void unmapFile(void) {
+#ifdef _WIN32
+    UnmapViewOfFile(g_archive.base);
+    CloseHandle(g_archive.mapping);
+    CloseHandle(g_archive.file);
+#else
+    munmap((void*) g_archive.base, g_archive.size);
+#endif
+}
+
+/**
+ * Checks that a range lies inside the mapping.
+ * @param offset Start of the range.
+ * @param size Length of the range.
+ * @return True if it does.
+ */
+static bool inFile(uint64_t offset, uint64_t size) {
+    return offset <= g_archive.size && size <= g_archive.size - offset;
+}
+
+/**
+ * Checks that a name lies inside the string table and is terminated there.
+ * @param name Offset of the name in the string table.
+ * @return True if it does.
+ */
+static bool validName(uint32_t name) {
+    uint64_t size = g_archive.header->stringSize;
+    return name < size && memchr(g_archive.strings + name, '\0', size - name) != NULL;
+}
+
+/**
+ * Checks the payload of a texture entry.
+ * @param entry The entry.
+ * @return True if the header and all levels fit into the payload.
+ */
+static bool validTexture(const ResArchiveEntry *entry) {
+    if (entry->size < sizeof(ResArchiveTexture)) {
+        return false;
+    }
+
+    const ResArchiveTexture *tex = (const ResArchiveTexture*) (g_archive.base + entry->offset);
+    if (tex->levelCount < 1 || tex->levelCount > RESARCHIVE_MAX_LEVELS) {
+        return false;
+    }
+    for (int i = 0; i < tex->levelCount; ++i) {
+        const ResArchiveLevel *l = &tex->levels[i];
+        if (l->width <= 0 || l->height <= 0 || l->size != (uint32_t) l->width * l->height * 4
+            || l->offset > entry->size || l->size > entry->size - l->offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Checks the header and every entry of the mapped file.
+ * @return False if anything points outside the file or is out of order.
+ */
+static bool validate(void) {
+    if (g_archive.size < sizeof(ResArchiveHeader)) {
+        return false;
+    }
+
+    const ResArchiveHeader *h = (const ResArchiveHeader*) g_archive.base;
+    if (h->magic != RESARCHIVE_MAGIC || h->version != RESARCHIVE_VERSION
+        || !inFile(sizeof(ResArchiveHeader), (uint64_t) h->entryCount * sizeof(ResArchiveEntry))
+        || !inFile(h->dependencyOffset, (uint64_t) h->dependencyCount * sizeof(ResArchiveDependency))
+        || !inFile(h->stringOffset, h->stringSize)
+        || h->dependencyOffset % RESARCHIVE_ALIGNMENT != 0) {
+        return false;
+    }
+
+    g_archive.header = h;
+    g_archive.entries = (const ResArchiveEntry*) (h + 1);
+    g_archive.dependencies = (const ResArchiveDependency*) (g_archive.base + h->dependencyOffset);
+    g_archive.strings = (const char*) g_archive.base + h->stringOffset;
+
+    for (uint32_t i = 0; i < h->dependencyCount; ++i) {
+        if (!validName(g_archive.dependencies[i].name)) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < h->entryCount; ++i) {
+        const ResArchiveEntry *e = &g_archive.entries[i];
+        bool ok = (i == 0 || g_archive.entries[i - 1].hash <= e->hash)
+            && e->offset % RESARCHIVE_ALIGNMENT == 0
+            && inFile(e->offset, e->size + (e->kind == RES_SHADER ? 1 : 0))
+            && validName(e->name)
+            && e->firstDependency <= h->dependencyCount
+            && e->dependencyCount <= h->dependencyCount - e->firstDependency;
+
+        if (ok && e->kind == RES_SHADER) {
+            ok = g_archive.base[e->offset + e->size] == '\0';
+        } else if (ok && e->kind == RES_TEXTURE) {
+            ok = validTexture(e);
+        } else if (ok) {
+            ok = e->kind == RES_RAW;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Finds the index of an entry, ignoring invalidation.
+ * @param name Name of the entry.
+ * @return The index, -1 if it is missing or no archive is open.
+ */
+static long findIndex(const char *name) {
+    if (!g_archive.base) {
+        return -1;
+    }
+
+    uint64_t hash = resarchive_hash(name);
+    uint32_t lo = 0, hi = g_archive.header->entryCount;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (g_archive.entries[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // Names with the same hash lie next to each other
+    for (uint32_t i = lo; i < g_archive.header->entryCount && g_archive.entries[i].hash == hash; ++i) {
+        if (strcmp(g_archive.strings + g_archive.entries[i].name, name) == 0) {
+            return (long) i;
+        }
+    }
+    return -1;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+uint64_t resarchive_hash(const char *name) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const unsigned char *p = (const unsigned char*) name; *p; ++p) {
+        h = (h ^ *p) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+bool resarchive_open(const char *path) {
+    resarchive_close();
+    if (!mapFile(path)) {
+        return false;
+    }
+
+    if (!validate()) {
+        printf("Resource archive %s is broken, loading the files.\n", path);
+        unmapFile();
+        memset(&g_archive, 0, sizeof(g_archive));
+        return false;
+    }
+
+    g_archive.invalid = TRACKED_CALLOC(g_archive.header->entryCount + 1, 1);
+    assert(g_archive.invalid && "calloc failed in resarchive_open");
+    return true;
+}
+
+void resarchive_close(void) {
+    if (!g_archive.base) {
+        return;
+    }
+
+    unmapFile();
+    TRACKED_FREE(g_archive.invalid);
+    memset(&g_archive, 0, sizeof(g_archive));
+}
+
+const ResArchiveEntry* resarchive_find(const char *name) {
+    long i = findIndex(name);
+    if (i < 0 || g_archive.invalid[i]) {
+        return NULL;
+    }
+    return &g_archive.entries[i];
+}
+
+const void* resarchive_data(const ResArchiveEntry *entry) {
+    return g_archive.base + entry->offset;
+}
+
+const char* resarchive_dependency(const ResArchiveEntry *entry, uint32_t index, int64_t *mtime) {
+    assert(index < entry->dependencyCount && "dependency index out of range");
+    const ResArchiveDependency *d = &g_archive.dependencies[entry->firstDependency + index];
+    if (mtime) {
+        *mtime = d->mtime;
+    }
+    return g_archive.strings + d->name;
+}
+
+void resarchive_invalidateKind(ResKind kind) {
+    if (!g_archive.base) {
+        return;
+    }
+    for (uint32_t i = 0; i < g_archive.header->entryCount; ++i) {
+        if (g_archive.entries[i].kind == (uint32_t) kind) {
+            g_archive.invalid[i] = 1;
+        }
+    }
+}
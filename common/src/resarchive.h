@@ -0,0 +1,166 @@
+/**
+ * @file resarchive.h
+ * @brief Packed resource archive, memory mapped at startup
+ *
+ * The build step common/tools/respack.c packs the resources of an
+ * exercise into one file: shader sources with their #include lines
+ * already resolved, images decoded to RGBA8 with all mipmap levels, and
+ * every other file as is. resarchive_open maps the file, lookups return
+ * views into the mapping without copying or touching the file system.
+ *
+ * Entries are named by the path the program would open, e.g.
+ * RESOURCE_PATH "shader/simple/simple.vert", so a loader asks the archive
+ * first and falls back to the file when the name is missing. A reload
+ * invalidates the entries of a kind, their sources may have been edited
+ * after packing, and they are missing from then on.
+ *
+ * The table is sorted by the FNV-1a hash of the names and searched
+ * binary. Lookups may run on any thread. Opening and closing only on the
+ * main thread while no lookup runs, invalidating while no lookup of the
+ * same kind runs.
+ *
+ * The file is kept identical in all exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef RESARCHIVE_H
+#define RESARCHIVE_H
+
+#include <fhwcg/fhwcg.h>
+
+/** "RPK1" in little endian */
+#define RESARCHIVE_MAGIC 0x314b5052u
+
+/** Increased whenever the file layout changes */
+#define RESARCHIVE_VERSION 1
+
+/** Alignment of every payload in the file */
+#define RESARCHIVE_ALIGNMENT 16
+
+/** Upper bound of mipmap levels of a packed image, as in texcache.h */
+#define RESARCHIVE_MAX_LEVELS 16
+
+/** Path of the archive, next to the executable as written by the build step */
+#ifndef RESARCHIVE_PATH
+    #define RESARCHIVE_PATH "resources.pak"
+#endif
+
+/**
+ * Kind of a packed file.
+ */
+typedef enum {
+    RES_RAW,        // the file as is
+    RES_SHADER,     // text with resolved includes, NUL terminated
+    RES_TEXTURE     // ResArchiveTexture followed by the levels
+} ResKind;
+
+/** Texture rows are stored bottom up like texcache, top down otherwise */
+#define RESARCHIVE_TEX_FLIPPED 1u
+
+/**
+ * Header at the start of the archive, the entries follow it.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t dependencyCount;
+    uint64_t dependencyOffset;  // of the ResArchiveDependency table
+    uint64_t stringOffset;      // of the NUL terminated names
+    uint64_t stringSize;
+} ResArchiveHeader;
+
+/**
+ * One packed file. Offsets are from the start of the archive, names
+ * from the start of the string table.
+ */
+typedef struct {
+    uint64_t hash;              // of the name
+    uint64_t offset;
+    uint64_t size;              // of the payload, without the NUL of a shader
+    int64_t mtime;              // of the source file when it was packed
+    uint32_t name;
+    uint32_t kind;              // ResKind
+    uint32_t firstDependency;
+    uint32_t dependencyCount;   // files included by a shader, recursively
+} ResArchiveEntry;
+
+/**
+ * A file a shader entry was resolved from, for the file watcher.
+ */
+typedef struct {
+    uint32_t name;
+    uint32_t reserved;
+    int64_t mtime;              // when it was packed
+} ResArchiveDependency;
+
+/**
+ * One level of a packed image, offsets are from the start of the payload.
+ */
+typedef struct {
+    int32_t width, height;
+    uint32_t size;
+    uint32_t offset;
+} ResArchiveLevel;
+
+/**
+ * Payload header of a RES_TEXTURE entry, tightly packed RGBA8 levels follow.
+ */
+typedef struct {
+    uint32_t flags;             // RESARCHIVE_TEX_*
+    int32_t levelCount;
+    ResArchiveLevel levels[RESARCHIVE_MAX_LEVELS];
+} ResArchiveTexture;
+
+/**
+ * Returns the hash the entries are sorted by.
+ * @param name Name of the entry.
+ * @return 64 bit FNV-1a of the name.
+ */
+uint64_t resarchive_hash(const char *name);
+
+/**
+ * Maps an archive and checks its table. Closes a previously opened one.
+ * @param path Path of the archive.
+ * @return False if it is missing or broken, every lookup misses then.
+ */
+bool resarchive_open(const char *path);
+
+/**
+ * Unmaps the archive, views handed out before become invalid.
+ */
+void resarchive_close(void);
+
+/**
+ * Looks up an entry.
+ * @param name Path of the file the entry was packed from.
+ * @return The entry, NULL if no archive is open, the name is missing
+ *         or the entry was invalidated.
+ */
+const ResArchiveEntry* resarchive_find(const char *name);
+
+/**
+ * Returns the payload of an entry, a view into the mapping.
+ * @param entry Entry returned by resarchive_find.
+ * @return The payload, entry->size bytes.
+ */
+const void* resarchive_data(const ResArchiveEntry *entry);
+
+/**
+ * Returns a file a shader entry was resolved from.
+ * @param entry Entry returned by resarchive_find.
+ * @param index Index below entry->dependencyCount.
+ * @param mtime Output for the modification time when it was packed, may be NULL.
+ * @return Path of the file.
+ */
+const char* resarchive_dependency(const ResArchiveEntry *entry, uint32_t index, int64_t *mtime);
+
+/**
+ * Hides all entries of a kind from later lookups, the loaders read the
+ * files instead.
+ * @param kind The kind.
+ */
+void resarchive_invalidateKind(ResKind kind);
+
+#endif // RESARCHIVE_H
@@ -0,0 +1,192 @@
+/**
+ * @file resscale.c
+ * @brief Implementation of the dynamic resolution
+ *
+ * The scale only goes up once the predicted GPU time of the next step still
+ * fits the target, so it settles instead of toggling between two steps.
+ * Without the upscale shader the target is copied with a linear blit.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "resscale.h"
+#include "glstate.h"
+#include "gpumem.h"
+#include "headless.h"
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Offscreen target and controller state.
+ */
+static struct {
+    GLuint fbo, color, depth;
+    GLuint vao;                 // empty, the upscale triangle comes from gl_VertexID
+    ResScaleUpscaleFn upscale;
+    int width, height;          // allocated size, the framebuffer size
+    int drawWidth, drawHeight;  // part drawn to this frame
+    bool active;                // drawing is redirected into the target
+    bool unsupported;           // the target could not be created
+
+    float scale;
+    float smoothedMs;           // GPU time, predicted for the current scale
+    int cooldown;
+} g_res = { .scale = 1.0f };
+
+/**
+ * Deletes the target, the next resscale_begin creates it again.
+ */
+static void deleteTarget(void) {
+    glDeleteFramebuffers(1, &g_res.fbo);
+    gpumem_deleteTextures(1, &g_res.color);
+    gpumem_deleteRenderbuffers(1, &g_res.depth);
+    g_res.fbo = g_res.color = g_res.depth = 0;
+    g_res.width = g_res.height = 0;
+}
+
+/**
+ * Creates the target if it does not match the framebuffer size.
+ * @param width Framebuffer width.
+ * @param height Framebuffer height.
+ * @return False if the target is not complete.
+ */
+static bool ensureTarget(int width, int height) {
+    if (g_res.fbo && g_res.width == width && g_res.height == height) {
+        return true;
+    }
+    deleteTarget();
+
+    glGenTextures(1, &g_res.color);
+    glBindTexture(GL_TEXTURE_2D, g_res.color);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    gpumem_setTexture(GPUMEM_TARGETS, g_res.color, gpumem_imageBytes(GL_RGBA8, width, height, 1));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &g_res.depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, g_res.depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    gpumem_setRenderbuffer(GPUMEM_TARGETS, g_res.depth, gpumem_imageBytes(GL_DEPTH24_STENCIL8, width, height, 1));
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &g_res.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_res.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, g_res.color, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, g_res.depth);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless_framebuffer());
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Resolution target incomplete (0x%x), drawing at full resolution\n", status);
+        deleteTarget();
+        g_res.unsupported = true;
+        return false;
+    }
+
+    g_res.width = width;
+    g_res.height = height;
+    return true;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void resscale_init(ResScaleUpscaleFn upscale) {
+    g_res.upscale = upscale;
+    glGenVertexArrays(1, &g_res.vao);
+    resscale_reset();
+}
+
+void resscale_cleanup(void) {
+    deleteTarget();
+    glstate_forgetVertexArray();
+    glDeleteVertexArrays(1, &g_res.vao);
+    g_res.vao = 0;
+}
+
+void resscale_reset(void) {
+    g_res.scale = 1.0f;
+    g_res.smoothedMs = 0.0f;
+    g_res.cooldown = 0;
+}
+
+float resscale_update(float gpuMs, float budgetMs, float minScale) {
+    minScale = glm_clamp(minScale, RESSCALE_MIN_SCALE, 1.0f);
+    float old = g_res.scale;
+    float scale = glm_clamp(old, minScale, 1.0f);
+
+    if (gpuMs > 0.0f && budgetMs > 0.0f) {
+        g_res.smoothedMs = g_res.smoothedMs > 0.0f
+            ? glm_lerp(g_res.smoothedMs, gpuMs, RESSCALE_SMOOTHING)
+            : gpuMs;
+
+        if (g_res.cooldown > 0) {
+            --g_res.cooldown;
+        } else {
+            // Fill cost grows with the pixel count, the square of the scale
+            float fit = old * sqrtf(RESSCALE_TARGET_RATIO * budgetMs / g_res.smoothedMs);
+            fit = glm_clamp(fit, old - RESSCALE_MAX_STEP, old + RESSCALE_MAX_STEP);
+
+            // Rounded down, a larger step is only taken if it fits
+            scale = floorf(fit / RESSCALE_STEP + 1e-3f) * RESSCALE_STEP;
+            scale = glm_clamp(scale, minScale, 1.0f);
+        }
+    }
+
+    if (fabsf(scale - old) > 1e-4f) {
+        // The history was measured at the old scale
+        g_res.smoothedMs *= (scale * scale) / (old * old);
+        g_res.scale = scale;
+        g_res.cooldown = RESSCALE_COOLDOWN_FRAMES;
+    }
+    return g_res.scale;
+}
+
+float resscale_getScale(void) {
+    return g_res.scale;
+}
+
+void resscale_begin(int width, int height) {
+    g_res.active = false;
+    if (g_res.scale >= 1.0f || g_res.unsupported || width <= 0 || height <= 0) {
+        return;
+    }
+    if (!ensureTarget(width, height)) {
+        return;
+    }
+
+    g_res.drawWidth = glm_imax((int) roundf(width * g_res.scale), 1);
+    g_res.drawHeight = glm_imax((int) roundf(height * g_res.scale), 1);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_res.fbo);
+    glViewport(0, 0, g_res.drawWidth, g_res.drawHeight);
+    g_res.active = true;
+}
+
+void resscale_end(float sharpness) {
+    if (!g_res.active) {
+        return;
+    }
+    g_res.active = false;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, headless_framebuffer());
+    glViewport(0, 0, g_res.width, g_res.height);
+
+    vec2 uvScale = {(float) g_res.drawWidth / g_res.width, (float) g_res.drawHeight / g_res.height};
+    vec2 texelSize = {1.0f / g_res.width, 1.0f / g_res.height};
+    if (!g_res.upscale(g_res.color, uvScale, texelSize, sharpness)) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, g_res.fbo);
+        glBlitFramebuffer(0, 0, g_res.drawWidth, g_res.drawHeight, 0, 0, g_res.width, g_res.height,
+                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, headless_framebuffer());
+        return;
+    }
+
+    glstate_setEnabled(GL_DEPTH_TEST, false);
+    glstate_setEnabled(GL_BLEND, false);
+    glstate_setEnabled(GL_CULL_FACE, false);
+    glstate_polygonMode(GL_FILL);
+    glstate_bindVertexArray(g_res.vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
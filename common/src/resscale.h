@@ -0,0 +1,104 @@
+/**
+ * @file resscale.h
+ * @brief Dynamic resolution for the 3D scene
+ *
+ * The scene is drawn into an offscreen target at a fraction of the
+ * framebuffer size and upscaled to the backbuffer with a bilinear pass and an
+ * optional sharpening filter. The GUI is drawn at native resolution on top.
+ *
+ * The scale is steered by the GPU time of the finished frames: the scene's
+ * fill cost grows with the pixel count, so the scale moves by the square root
+ * of the ratio between RESSCALE_TARGET_RATIO of the budget and the smoothed
+ * GPU time. Changes are quantized to RESSCALE_STEP and held for
+ * RESSCALE_COOLDOWN_FRAMES, which covers the GPU timer latency. At scale 1
+ * the scene is drawn straight into the backbuffer.
+ *
+ * The target is allocated at framebuffer size and only its lower left part
+ * is drawn to, so changing the scale never reallocates it.
+ *
+ * The upscale pass belongs to the shaders of the exercise, resscale_init
+ * takes the function that activates it.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef RESSCALE_H
+#define RESSCALE_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Share of the budget the GPU time is steered to */
+#define RESSCALE_TARGET_RATIO 0.9f
+
+/** Weight of the newest frame in the smoothed GPU time */
+#define RESSCALE_SMOOTHING 0.2f
+
+/** Granularity of the scale */
+#define RESSCALE_STEP 0.05f
+
+/** Largest change of the scale at once */
+#define RESSCALE_MAX_STEP 0.15f
+
+/** Frames after a change before the next one */
+#define RESSCALE_COOLDOWN_FRAMES 15
+
+/** Lowest scale a caller may ask for */
+#define RESSCALE_MIN_SCALE 0.25f
+
+/**
+ * Activates the upscale pass and binds the target to unit 0.
+ * @param textureId Color texture of the target.
+ * @param uvScale Part of the target that was drawn to.
+ * @param texelSize Size of one texel of the target in UV.
+ * @param sharpness Strength of the sharpening filter, 0 for plain bilinear.
+ * @return False if the pass is not available, the target is blitted then.
+ */
+typedef bool (*ResScaleUpscaleFn)(GLuint textureId, vec2 uvScale, vec2 texelSize, float sharpness);
+
+/**
+ * Creates the upscale geometry, the target is created on first use.
+ * @param upscale Activates the upscale pass of the exercise.
+ */
+void resscale_init(ResScaleUpscaleFn upscale);
+
+/**
+ * Deletes the target.
+ */
+void resscale_cleanup(void);
+
+/**
+ * Forgets the GPU time history and returns to full resolution.
+ */
+void resscale_reset(void);
+
+/**
+ * Feeds the GPU time of the last finished frame to the controller.
+ * @param gpuMs GPU time of the frame in ms, 0 if not known yet.
+ * @param budgetMs Frame budget in ms.
+ * @param minScale Lowest scale to use, clamped to [RESSCALE_MIN_SCALE, 1].
+ * @return The scale to draw the next frame with.
+ */
+float resscale_update(float gpuMs, float budgetMs, float minScale);
+
+/**
+ * Returns the current scale.
+ * @return Scale in [RESSCALE_MIN_SCALE, 1].
+ */
+float resscale_getScale(void);
+
+/**
+ * Redirects drawing into the target at the current scale and sets the
+ * viewport to the scaled size. Does nothing at scale 1.
+ * @param width Framebuffer width.
+ * @param height Framebuffer height.
+ */
+void resscale_begin(int width, int height);
+
+/**
+ * Upscales the target to the backbuffer and restores the full viewport.
+ * Does nothing if resscale_begin did not redirect.
+ * @param sharpness Strength of the sharpening filter, 0 for plain bilinear.
+ */
+void resscale_end(float sharpness);
+
+#endif // RESSCALE_H
@@ -0,0 +1,117 @@
+/**
+ * @file rng.c
+ * @brief Implementation of the xoshiro128** generator
+ *
+ * Every thread owns one generator. Threads are numbered in the order of
+ * their first draw after a reseed, thread n uses seed + n so the streams
+ * differ while the thread that called rng_setSeed stays reproducible.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "rng.h"
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+    #define THREAD_LOCAL __declspec(thread)
+    #define ATOMIC_INC(p) _InterlockedIncrement(p)
+#else
+    #define THREAD_LOCAL __thread
+    #define ATOMIC_INC(p) __sync_add_and_fetch(p, 1)
+#endif
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Per-thread generator, reseeded when its epoch is outdated.
+ */
+typedef struct {
+    Rng rng;
+    long epoch;
+} ThreadRng;
+
+static THREAD_LOCAL ThreadRng g_threadRng = { {{0}}, 0 };
+
+/** Seed of the thread generators, bumping the epoch reseeds them */
+static uint64_t g_seed = RNG_DEFAULT_SEED;
+static volatile long g_epoch = 1;
+
+/** Number of streams handed out since the last reseed */
+static volatile long g_streams = 0;
+
+/**
+ * splitmix64 step, used to expand a seed into the generator state.
+ * @param x State, advanced in place.
+ * @return Next output.
+ */
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Rotates a 32 bit value left.
+ * @param x Value.
+ * @param k Bits to rotate by.
+ * @return Rotated value.
+ */
+static inline uint32_t rotl(uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void rng_seed(Rng *rng, uint64_t seed) {
+    uint64_t a = splitmix64(&seed);
+    uint64_t b = splitmix64(&seed);
+    rng->s[0] = (uint32_t)a;
+    rng->s[1] = (uint32_t)(a >> 32);
+    rng->s[2] = (uint32_t)b;
+    rng->s[3] = (uint32_t)(b >> 32);
+}
+
+uint32_t rng_next(Rng *rng) {
+    uint32_t *s = rng->s;
+    uint32_t result = rotl(s[1] * 5, 7) * 9;
+    uint32_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 11);
+
+    return result;
+}
+
+float rng_float(Rng *rng) {
+    // Upper 24 bits fill the float mantissa exactly
+    return (float)(rng_next(rng) >> 8) * (1.0f / 16777216.0f);
+}
+
+float rng_range(Rng *rng, float min, float max) {
+    return min + rng_float(rng) * (max - min);
+}
+
+void rng_setSeed(uint64_t seed) {
+    g_seed = seed;
+    g_streams = 0;
+    long epoch = ATOMIC_INC(&g_epoch);
+
+    // The caller owns stream 0
+    rng_seed(&g_threadRng.rng, seed + (uint64_t)ATOMIC_INC(&g_streams) - 1);
+    g_threadRng.epoch = epoch;
+}
+
+Rng* rng_thread(void) {
+    long epoch = g_epoch;
+    if (g_threadRng.epoch != epoch) {
+        uint64_t stream = (uint64_t)ATOMIC_INC(&g_streams) - 1;
+        rng_seed(&g_threadRng.rng, g_seed + stream);
+        g_threadRng.epoch = epoch;
+    }
+    return &g_threadRng.rng;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file rng.h
+ * @brief Small seedable random number generator
+ *
+ * xoshiro128** with a splitmix64 seeded state. Generators can be used
+ * directly or through rng_thread(), which hands every thread its own
+ * generator so random numbers can be drawn without locking.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/** Seed used until rng_setSeed is called */
+#define RNG_DEFAULT_SEED 0x5eed5eedull
+
+/**
+ * Generator state.
+ */
+typedef struct {
+    uint32_t s[4];
+} Rng;
+
+/**
+ * Seeds a generator.
+ * Equal seeds give equal sequences on every platform.
+ * @param rng Generator to seed.
+ * @param seed Seed value, 0 is allowed.
+ */
+void rng_seed(Rng *rng, uint64_t seed);
+
+/**
+ * Returns the next 32 random bits.
+ * @param rng Generator.
+ * @return Uniformly distributed value.
+ */
+uint32_t rng_next(Rng *rng);
+
+/**
+ * Returns a float in [0, 1).
+ * @param rng Generator.
+ * @return Uniformly distributed value.
+ */
+float rng_float(Rng *rng);
+
+/**
+ * Returns a float in [min, max).
+ * @param rng Generator.
+ * @param min Lower bound.
+ * @param max Upper bound.
+ * @return Uniformly distributed value.
+ */
+float rng_range(Rng *rng, float min, float max);
+
+/**
+ * Sets the seed of the per-thread generators.
+ * The calling thread gets stream 0 and is reseeded immediately,
+ * other threads reseed with their own stream on their next draw.
+ * @param seed Seed value.
+ */
+void rng_setSeed(uint64_t seed);
+
+/**
+ * Returns the generator of the calling thread.
+ * @return Thread local generator, seeded from the current seed.
+ */
+Rng* rng_thread(void);
+
+#endif // RNG_H
@@ -0,0 +1,636 @@
+/**
+ * @file sampler.c
+ * @brief Implementation of the sampling profiler
+ *
+ * The timer counts the CPU time of the main thread and is delivered to its
+ * thread id, so only the main thread is interrupted and the handler is the
+ * only writer of the buffer. backtrace() runs once before the timer starts,
+ * that loads the unwinder, later calls neither allocate nor lock in
+ * practice. The stack seen by the handler starts with the handler and the
+ * signal trampoline, the recorded frames start at the interrupted
+ * instruction taken from the signal context.
+ *
+ * Caller frames are stored as return address - 1, so they resolve to the
+ * call and not to the next function when the call was the last instruction.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifdef __linux__
+    #define _GNU_SOURCE
+#endif
+
+#include "sampler.h"
+
+#ifdef __linux__
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <link.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#ifndef sigev_notify_thread_id
+    #define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/** Addresses passed to one addr2line call */
+#define ADDR2LINE_CHUNK 256
+
+/** Longest symbol name kept */
+#define NAME_LENGTH 256
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * One sample, frames[0] is the sampled instruction, the others the callers.
+ */
+typedef struct {
+    uintptr_t frames[SAMPLER_MAX_DEPTH];
+    int depth;
+} Sample;
+
+/**
+ * A distinct address and the function it belongs to.
+ */
+typedef struct {
+    uintptr_t addr;
+    char *name;
+    int func;       // index into the functions, set after all names are known
+} Symbol;
+
+/**
+ * A distinct function name and its counts.
+ */
+typedef struct {
+    const char *name;
+    int self;
+    int total;
+    int lastSample;     // sample that counted total last, counts recursion once
+} Function;
+
+/**
+ * Global sampler state.
+ */
+static struct {
+    bool enabled;
+    int hz;
+    timer_t timer;
+    uint64_t startTimer;
+    double startCpu;            // CPU time of the main thread in s
+
+    Sample *samples;
+    volatile long count;        // written by the handler only
+    volatile long dropped;
+
+    Symbol *symbols;
+    int symbolCount;
+    Function *funcs;
+    int funcCount;
+    int *stackFuncs;            // function indices of all samples, SAMPLER_MAX_DEPTH per sample
+} g_sampler = { 0 };
+
+/**
+ * Returns the instruction the signal interrupted.
+ * @param ucontext Context passed to the handler.
+ * @return Instruction pointer or 0 on unknown architectures.
+ */
+static uintptr_t contextPc(void *ucontext) {
+    const ucontext_t *uc = ucontext;
+#if defined(__x86_64__)
+    return (uintptr_t) uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+    return (uintptr_t) uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+    return (uintptr_t) uc->uc_mcontext.pc;
+#else
+    NK_UNUSED(uc);
+    return 0;
+#endif
+}
+
+/**
+ * SIGPROF handler, records the stack of the interrupted main thread.
+ */
+static void onSample(int sig, siginfo_t *info, void *ucontext) {
+    NK_UNUSED(sig);
+    NK_UNUSED(info);
+
+    long index = g_sampler.count;
+    if (index >= SAMPLER_CAPACITY) {
+        ++g_sampler.dropped;
+        return;
+    }
+
+    int savedErrno = errno;
+    void *frames[SAMPLER_MAX_DEPTH + 4];
+    int n = backtrace(frames, NK_LEN(frames));
+    uintptr_t pc = contextPc(ucontext);
+
+    // Skip the handler and the trampoline, keep only the pc if it is not on the stack
+    int first = n;
+    for (int i = 0; i < n; ++i) {
+        if ((uintptr_t) frames[i] == pc) {
+            first = i;
+            break;
+        }
+    }
+
+    Sample *s = &g_sampler.samples[index];
+    s->frames[0] = pc;
+    s->depth = 1;
+    for (int i = first + 1; i < n && s->depth < SAMPLER_MAX_DEPTH; ++i) {
+        s->frames[s->depth++] = (uintptr_t) frames[i] - 1;
+    }
+
+    g_sampler.count = index + 1;
+    errno = savedErrno;
+}
+
+/**
+ * Returns the CPU time the calling thread has used.
+ * @return Time in s.
+ */
+static double threadCpuSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (double) now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/**
+ * Stops the timer, no sample arrives afterwards.
+ */
+static void stopTimer(void) {
+    timer_delete(g_sampler.timer);
+    signal(SIGPROF, SIG_IGN);
+}
+
+/**
+ * Orders addresses ascending.
+ */
+static int compareAddrs(const void *a, const void *b) {
+    uintptr_t ua = *(const uintptr_t*) a;
+    uintptr_t ub = *(const uintptr_t*) b;
+    return (ua > ub) - (ua < ub);
+}
+
+/**
+ * Orders symbols by name.
+ */
+static int compareSymbolNames(const void *a, const void *b) {
+    return strcmp((*(const Symbol* const*) a)->name, (*(const Symbol* const*) b)->name);
+}
+
+/**
+ * Finds the symbol of an address.
+ * @param addr Address of a recorded frame.
+ * @return Symbol, every recorded address has one.
+ */
+static Symbol *findSymbol(uintptr_t addr) {
+    int lo = 0, hi = g_sampler.symbolCount - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (g_sampler.symbols[mid].addr < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    assert(g_sampler.symbols[lo].addr == addr && "address was not symbolized");
+    return &g_sampler.symbols[lo];
+}
+
+/**
+ * Copies a name, cutting it at NAME_LENGTH.
+ * @param name Name to copy.
+ * @return Allocated copy.
+ */
+static char *copyName(const char *name) {
+    size_t length = strnlen(name, NAME_LENGTH - 1);
+    char *copy = malloc(length + 1);
+    assert(copy && "malloc failed in sampler copyName");
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/**
+ * Resolves the static functions of the executable, which dladdr can't see,
+ * by running addr2line over its debug or symbol table.
+ * @param pending Symbols without a name, all inside the executable.
+ * @param count Number of pending symbols.
+ * @param exeBase Load address of the executable.
+ */
+static void resolveWithAddr2line(Symbol **pending, int count, uintptr_t exeBase) {
+    // The child's /proc/self/exe would be addr2line, pass the real path
+    char exePath[512];
+    ssize_t pathLength = readlink("/proc/self/exe", exePath, sizeof(exePath) - 1);
+    if (pathLength <= 0) {
+        return;
+    }
+    exePath[pathLength] = '\0';
+
+    // Position independent executables are looked up by offset
+    const ElfW(Ehdr) *header = (const ElfW(Ehdr)*) exeBase;
+    uintptr_t bias = header->e_type == ET_DYN ? exeBase : 0;
+
+    size_t commandSize = sizeof(exePath) + 64 + ADDR2LINE_CHUNK * 20;
+    char *command = malloc(commandSize);
+    assert(command && "malloc failed in sampler resolveWithAddr2line");
+
+    for (int begin = 0; begin < count; begin += ADDR2LINE_CHUNK) {
+        int end = glm_imin(begin + ADDR2LINE_CHUNK, count);
+        int length = snprintf(command, commandSize, "addr2line -f -C -e '%s'", exePath);
+        for (int i = begin; i < end; ++i) {
+            length += snprintf(command + length, commandSize - length, " %#lx",
+                               (unsigned long) (pending[i]->addr - bias));
+        }
+        strcat(command, " 2>/dev/null");
+
+        FILE *pipe = popen(command, "r");
+        if (!pipe) {
+            break;
+        }
+
+        // Two lines per address: function, then file and line
+        char function[NAME_LENGTH];
+        char location[NAME_LENGTH * 2];
+        for (int i = begin; i < end; ++i) {
+            if (!fgets(function, sizeof(function), pipe) || !fgets(location, sizeof(location), pipe)) {
+                break;
+            }
+            function[strcspn(function, "\r\n")] = '\0';
+            if (strcmp(function, "??") != 0 && function[0]) {
+                pending[i]->name = copyName(function);
+            }
+        }
+        pclose(pipe);
+    }
+
+    free(command);
+}
+
+/**
+ * Names every recorded address and groups the addresses by function.
+ */
+static void symbolize(void) {
+    long sampleCount = g_sampler.count;
+
+    // Distinct addresses of all frames
+    size_t frameCount = 0;
+    for (long i = 0; i < sampleCount; ++i) {
+        frameCount += g_sampler.samples[i].depth;
+    }
+    uintptr_t *addrs = malloc(frameCount * sizeof(uintptr_t));
+    assert(addrs && "malloc failed in sampler symbolize");
+    size_t pos = 0;
+    for (long i = 0; i < sampleCount; ++i) {
+        const Sample *s = &g_sampler.samples[i];
+        memcpy(addrs + pos, s->frames, s->depth * sizeof(uintptr_t));
+        pos += s->depth;
+    }
+    qsort(addrs, frameCount, sizeof(uintptr_t), compareAddrs);
+
+    g_sampler.symbols = malloc(frameCount * sizeof(Symbol));
+    assert(g_sampler.symbols && "malloc failed in sampler symbolize");
+    g_sampler.symbolCount = 0;
+    for (size_t i = 0; i < frameCount; ++i) {
+        if (i == 0 || addrs[i] != addrs[i - 1]) {
+            g_sampler.symbols[g_sampler.symbolCount++] = (Symbol) { .addr = addrs[i] };
+        }
+    }
+    free(addrs);
+
+    // Exported symbols by dladdr, the rest of the executable by addr2line
+    Dl_info exeInfo = { 0 };
+    dladdr((void*) sampler_init, &exeInfo);
+
+    Symbol **pending = malloc(g_sampler.symbolCount * sizeof(Symbol*));
+    assert(pending && "malloc failed in sampler symbolize");
+    int pendingCount = 0;
+    for (int i = 0; i < g_sampler.symbolCount; ++i) {
+        Symbol *sym = &g_sampler.symbols[i];
+        Dl_info info;
+        if (!dladdr((void*) sym->addr, &info)) {
+            continue;
+        }
+        if (info.dli_sname) {
+            sym->name = copyName(info.dli_sname);
+        } else if (info.dli_fbase == exeInfo.dli_fbase) {
+            pending[pendingCount++] = sym;
+        }
+    }
+    if (pendingCount > 0 && exeInfo.dli_fbase) {
+        resolveWithAddr2line(pending, pendingCount, (uintptr_t) exeInfo.dli_fbase);
+    }
+    free(pending);
+
+    // Anything left is named by its module and offset
+    for (int i = 0; i < g_sampler.symbolCount; ++i) {
+        Symbol *sym = &g_sampler.symbols[i];
+        if (sym->name) {
+            continue;
+        }
+        char name[NAME_LENGTH];
+        Dl_info info;
+        if (dladdr((void*) sym->addr, &info) && info.dli_fname) {
+            const char *module = strrchr(info.dli_fname, '/');
+            module = module ? module + 1 : info.dli_fname;
+            snprintf(name, sizeof(name), "%s+%#lx", module[0] ? module : "exe",
+                     (unsigned long) (sym->addr - (uintptr_t) info.dli_fbase));
+        } else {
+            snprintf(name, sizeof(name), "%#lx", (unsigned long) sym->addr);
+        }
+        sym->name = copyName(name);
+    }
+
+    // Addresses of the same function share an index
+    Symbol **byName = malloc(g_sampler.symbolCount * sizeof(Symbol*));
+    g_sampler.funcs = malloc(g_sampler.symbolCount * sizeof(Function));
+    assert(byName && g_sampler.funcs && "malloc failed in sampler symbolize");
+    for (int i = 0; i < g_sampler.symbolCount; ++i) {
+        byName[i] = &g_sampler.symbols[i];
+    }
+    qsort(byName, g_sampler.symbolCount, sizeof(Symbol*), compareSymbolNames);
+    g_sampler.funcCount = 0;
+    for (int i = 0; i < g_sampler.symbolCount; ++i) {
+        if (i == 0 || strcmp(byName[i]->name, byName[i - 1]->name) != 0) {
+            g_sampler.funcs[g_sampler.funcCount++] = (Function) { .name = byName[i]->name, .lastSample = -1 };
+        }
+        byName[i]->func = g_sampler.funcCount - 1;
+    }
+    free(byName);
+
+    // Counts, a function counts once per sample in the cumulative table
+    g_sampler.stackFuncs = malloc(sampleCount * SAMPLER_MAX_DEPTH * sizeof(int));
+    assert(g_sampler.stackFuncs && "malloc failed in sampler symbolize");
+    for (long i = 0; i < sampleCount; ++i) {
+        const Sample *s = &g_sampler.samples[i];
+        int *funcs = g_sampler.stackFuncs + i * SAMPLER_MAX_DEPTH;
+        for (int d = 0; d < s->depth; ++d) {
+            funcs[d] = findSymbol(s->frames[d])->func;
+            Function *f = &g_sampler.funcs[funcs[d]];
+            if (f->lastSample != i) {
+                f->lastSample = (int) i;
+                ++f->total;
+            }
+        }
+        ++g_sampler.funcs[funcs[0]].self;
+    }
+}
+
+/**
+ * Orders function indices by descending self count.
+ */
+static int compareSelf(const void *a, const void *b) {
+    int sa = g_sampler.funcs[*(const int*) a].self;
+    int sb = g_sampler.funcs[*(const int*) b].self;
+    return (sb > sa) - (sb < sa);
+}
+
+/**
+ * Orders function indices by descending cumulative count.
+ */
+static int compareTotal(const void *a, const void *b) {
+    int ta = g_sampler.funcs[*(const int*) a].total;
+    int tb = g_sampler.funcs[*(const int*) b].total;
+    return (tb > ta) - (tb < ta);
+}
+
+/**
+ * Orders sample indices by their stacks, equal stacks end up adjacent.
+ */
+static int compareStacks(const void *a, const void *b) {
+    long ia = *(const long*) a;
+    long ib = *(const long*) b;
+    int da = g_sampler.samples[ia].depth;
+    int db = g_sampler.samples[ib].depth;
+    if (da != db) {
+        return (da > db) - (da < db);
+    }
+    return memcmp(g_sampler.stackFuncs + ia * SAMPLER_MAX_DEPTH,
+                  g_sampler.stackFuncs + ib * SAMPLER_MAX_DEPTH, da * sizeof(int));
+}
+
+/**
+ * Writes one table of the report.
+ * @param file Report file.
+ * @param title Table heading.
+ * @param order Function indices sorted for this table.
+ * @param cumulative Rank by the cumulative instead of the self count.
+ */
+static void writeTable(FILE *file, const char *title, const int *order, bool cumulative) {
+    long sampleCount = g_sampler.count;
+    fprintf(file, "\n%s\n%8s %7s %8s %7s  %s\n", title, "self", "self%", "total", "total%", "function");
+
+    int lines = glm_imin(g_sampler.funcCount, SAMPLER_REPORT_LINES);
+    for (int i = 0; i < lines; ++i) {
+        const Function *f = &g_sampler.funcs[order[i]];
+        if ((cumulative ? f->total : f->self) == 0) {
+            break;
+        }
+        fprintf(file, "%8d %6.2f%% %8d %6.2f%%  %s\n",
+                f->self, 100.0 * f->self / sampleCount,
+                f->total, 100.0 * f->total / sampleCount, f->name);
+    }
+}
+
+/**
+ * Writes the flat and cumulative tables.
+ * @return False if the file can't be written.
+ */
+static bool writeReport(void) {
+    FILE *file = fopen(SAMPLER_REPORT_FILE, "w");
+    if (!file) {
+        printf("Could not create %s!\n", SAMPLER_REPORT_FILE);
+        return false;
+    }
+
+    double seconds = (double) (glfwGetTimerValue() - g_sampler.startTimer) / glfwGetTimerFrequency();
+    double cpuSeconds = threadCpuSeconds() - g_sampler.startCpu;
+    fprintf(file, "Main thread samples: %ld, %ld dropped, %.1f s CPU time of %.1f s wall time\n",
+            g_sampler.count, g_sampler.dropped, cpuSeconds, seconds);
+    fprintf(file, "Rate: %d Hz requested, %.0f Hz taken\n", g_sampler.hz,
+            cpuSeconds > 0.0 ? (g_sampler.count + g_sampler.dropped) / cpuSeconds : 0.0);
+
+    int *order = malloc(g_sampler.funcCount * sizeof(int));
+    assert(order && "malloc failed in sampler writeReport");
+    for (int i = 0; i < g_sampler.funcCount; ++i) {
+        order[i] = i;
+    }
+    qsort(order, g_sampler.funcCount, sizeof(int), compareSelf);
+    writeTable(file, "Flat (samples in the function itself)", order, false);
+    qsort(order, g_sampler.funcCount, sizeof(int), compareTotal);
+    writeTable(file, "Cumulative (samples with the function on the stack)", order, true);
+    free(order);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+/**
+ * Writes one line per distinct stack, outermost function first.
+ * @return False if the file can't be written.
+ */
+static bool writeFolded(void) {
+    FILE *file = fopen(SAMPLER_FOLDED_FILE, "w");
+    if (!file) {
+        printf("Could not create %s!\n", SAMPLER_FOLDED_FILE);
+        return false;
+    }
+
+    long sampleCount = g_sampler.count;
+    long *order = malloc(sampleCount * sizeof(long));
+    assert(order && "malloc failed in sampler writeFolded");
+    for (long i = 0; i < sampleCount; ++i) {
+        order[i] = i;
+    }
+    qsort(order, sampleCount, sizeof(long), compareStacks);
+
+    for (long i = 0; i < sampleCount;) {
+        long runEnd = i + 1;
+        while (runEnd < sampleCount && compareStacks(&order[i], &order[runEnd]) == 0) {
+            ++runEnd;
+        }
+
+        int depth = g_sampler.samples[order[i]].depth;
+        const int *funcs = g_sampler.stackFuncs + order[i] * SAMPLER_MAX_DEPTH;
+        for (int d = depth - 1; d >= 0; --d) {
+            fprintf(file, "%s%c", g_sampler.funcs[funcs[d]].name, d > 0 ? ';' : ' ');
+        }
+        fprintf(file, "%ld\n", runEnd - i);
+        i = runEnd;
+    }
+    free(order);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+/**
+ * Frees the samples and the symbol tables.
+ */
+static void freeAll(void) {
+    for (int i = 0; i < g_sampler.symbolCount; ++i) {
+        free(g_sampler.symbols[i].name);
+    }
+    free(g_sampler.symbols);
+    free(g_sampler.funcs);
+    free(g_sampler.stackFuncs);
+    free(g_sampler.samples);
+    g_sampler.symbols = NULL;
+    g_sampler.funcs = NULL;
+    g_sampler.stackFuncs = NULL;
+    g_sampler.samples = NULL;
+    g_sampler.symbolCount = 0;
+    g_sampler.funcCount = 0;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void sampler_init(void) {
+    const char *config = getenv("SAMPLE_PROFILE");
+    if (!config || !config[0] || g_sampler.enabled) {
+        return;
+    }
+
+    int hz = atoi(config);
+    g_sampler.hz = hz > 0 ? glm_imin(hz, SAMPLER_MAX_HZ) : SAMPLER_DEFAULT_HZ;
+    g_sampler.count = 0;
+    g_sampler.dropped = 0;
+    g_sampler.samples = malloc(SAMPLER_CAPACITY * sizeof(Sample));
+    if (!g_sampler.samples) {
+        printf("Sampling profiler: could not allocate the sample buffer\n");
+        return;
+    }
+
+    // Loads the unwinder now instead of in the first handler call
+    void *warmup[4];
+    backtrace(warmup, NK_LEN(warmup));
+
+    struct sigaction action = { 0 };
+    action.sa_sigaction = onSample;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    struct sigevent event = { 0 };
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = (pid_t) syscall(SYS_gettid);
+
+    long intervalNs = 1000000000L / g_sampler.hz;
+    struct itimerspec spec = { 0 };
+    spec.it_interval.tv_sec = intervalNs / 1000000000L;
+    spec.it_interval.tv_nsec = intervalNs % 1000000000L;
+    spec.it_value = spec.it_interval;
+
+    if (sigaction(SIGPROF, &action, NULL) != 0
+            || timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &g_sampler.timer) != 0) {
+        printf("Sampling profiler: could not create the timer (%s)\n", strerror(errno));
+        signal(SIGPROF, SIG_IGN);
+        freeAll();
+        return;
+    }
+    if (timer_settime(g_sampler.timer, 0, &spec, NULL) != 0) {
+        printf("Sampling profiler: could not start the timer (%s)\n", strerror(errno));
+        stopTimer();
+        freeAll();
+        return;
+    }
+
+    g_sampler.startTimer = glfwGetTimerValue();
+    g_sampler.startCpu = threadCpuSeconds();
+    g_sampler.enabled = true;
+    printf("Sampling profiler: main thread at %d Hz, written to %s and %s on exit\n",
+           g_sampler.hz, SAMPLER_REPORT_FILE, SAMPLER_FOLDED_FILE);
+}
+
+void sampler_cleanup(void) {
+    if (!g_sampler.enabled) {
+        return;
+    }
+    stopTimer();
+    g_sampler.enabled = false;
+
+    if (g_sampler.count == 0) {
+        printf("Sampling profiler: no samples taken\n");
+        freeAll();
+        return;
+    }
+
+    symbolize();
+    bool ok = writeReport() && writeFolded();
+    printf("Sampling profiler: %ld samples (%ld dropped)%s\n", g_sampler.count, g_sampler.dropped,
+           ok ? "" : ", writing the report failed");
+    freeAll();
+}
+
+bool sampler_isEnabled(void) {
+    return g_sampler.enabled;
+}
+
+#else // __linux__
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void sampler_init(void) {
+    const char *config = getenv("SAMPLE_PROFILE");
+    if (config && config[0]) {
+        printf("Sampling profiler: only available on Linux\n");
+    }
+}
+
+void sampler_cleanup(void) {
+}
+
+bool sampler_isEnabled(void) {
+    return false;
+}
+
+#endif // __linux__
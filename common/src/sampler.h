@@ -0,0 +1,77 @@
+/**
+ * @file sampler.h
+ * @brief Statistical profiler of the main thread (Linux)
+ *
+ * A timer on the CPU time of the main thread sends it SIGPROF at the
+ * sampling rate. The handler records the interrupted instruction pointer
+ * and up to SAMPLER_MAX_DEPTH - 1 callers into a buffer allocated up
+ * front, nothing is locked or allocated while sampling. Samples that find
+ * the buffer full are counted and dropped.
+ *
+ * When sampling stops the addresses are symbolized, by dladdr for exported
+ * symbols and by addr2line for the static functions of the executable, and
+ * two files are written:
+ * - SAMPLER_REPORT_FILE: the functions with the most samples, flat (the
+ *   sample hit the function itself) and cumulative (the function was on
+ *   the stack),
+ * - SAMPLER_FOLDED_FILE: one "outer;...;inner count" line per distinct
+ *   stack, the input of flamegraph.pl and compatible viewers.
+ *
+ * Enabled by the SAMPLE_PROFILE environment variable, which holds the rate
+ * in Hz, values of 0 or less use SAMPLER_DEFAULT_HZ. Without it, and on
+ * other platforms, nothing is sampled. Stacks are unwound through the
+ * unwind tables, frame pointers are not needed.
+ *
+ * The kernel checks CPU time timers once per scheduler tick, so rates above
+ * its tick rate (commonly 250 or 1000 Hz) are not reached. The report lists
+ * the rate actually taken. Time the main thread sleeps or waits, e.g. for
+ * vsync, is not sampled.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Default sampling rate, prime so it does not lock onto the frame rate */
+#define SAMPLER_DEFAULT_HZ 997
+
+/** Highest accepted sampling rate */
+#define SAMPLER_MAX_HZ 20000
+
+/** Frames recorded per sample, the sampled function included */
+#define SAMPLER_MAX_DEPTH 16
+
+/** Samples kept, later ones are dropped, about two minutes at the default rate */
+#define SAMPLER_CAPACITY (1 << 17)
+
+/** Functions listed per table of the report */
+#define SAMPLER_REPORT_LINES 40
+
+/** Flat and cumulative report */
+#define SAMPLER_REPORT_FILE "samples.txt"
+
+/** Folded stacks for flame graphs */
+#define SAMPLER_FOLDED_FILE "samples.folded"
+
+/**
+ * Reads the rate from the environment and starts sampling the calling
+ * thread. Call from the main thread, early in main.
+ */
+void sampler_init(void);
+
+/**
+ * Stops sampling and writes the report and the folded stacks.
+ * Call from the main thread before exiting.
+ */
+void sampler_cleanup(void);
+
+/**
+ * Checks whether the main thread is sampled.
+ * @return True while the timer runs.
+ */
+bool sampler_isEnabled(void);
+
+#endif // SAMPLER_H
@@ -0,0 +1,121 @@
+/**
+ * @file shadervariant.c
+ * @brief Implementation of the shader variants
+ *
+ * A stage is handed to the GL as three strings, the text up to the
+ * #version line, the defines and the rest. An archived stage is passed
+ * from the mapping without a copy, a file is read and its includes are
+ * resolved by stb_include first, relative to the directory of the file
+ * like in fhwcg. A #line directive after the defines keeps the line
+ * numbers of compile errors.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "shadervariant.h"
+#include <fhwcg/stb_include.h>
+#include "resarchive.h"
+
+/** Upper bound of the injected defines of a variant */
+#define MAX_DEFINES_LENGTH 512
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Finds the end of the #version line, the defines must follow it.
+ * @param text Source text.
+ * @param line Output for the number of lines up to and including it.
+ * @return Offset after the line, 0 without a #version line.
+ */
+static long versionEnd(const char *text, int *line) {
+    const char *p = text;
+    *line = 0;
+
+    while (*p) {
+        const char *start = p;
+        while (*start == ' ' || *start == '\t') ++start;
+        const char *eol = strchr(p, '\n');
+        ++*line;
+
+        if (strncmp(start, "#version", 8) == 0) {
+            return eol ? (long) (eol - text + 1) : (long) strlen(text);
+        }
+        if (!eol) {
+            break;
+        }
+        p = eol + 1;
+    }
+
+    *line = 0;
+    return 0;
+}
+
+/**
+ * Compiles a stage with the defines of a variant key.
+ * @param type Stage type.
+ * @param file Path of the source file, for the error log.
+ * @param text Source with resolved includes, NUL terminated.
+ * @param key Bit i set defines flags[i].
+ * @param flags Define names, one per bit of the key.
+ * @return The stage, 0 if it did not compile.
+ */
+static GLuint compileSource(GLenum type, const char *file, const char *text, unsigned key,
+    const char *const *flags) {
+    int line;
+    long split = versionEnd(text, &line);
+
+    char defines[MAX_DEFINES_LENGTH];
+    int length = 0;
+    defines[0] = '\0';
+    if (key) {
+        if (split > 0 && text[split - 1] != '\n') {
+            length += snprintf(defines + length, sizeof(defines) - length, "\n");
+        }
+        for (int i = 0; i < SHADERVARIANT_MAX_FLAGS; ++i) {
+            if (key & (1u << i)) {
+                length += snprintf(defines + length, sizeof(defines) - length, "#define %s 1\n", flags[i]);
+            }
+        }
+        snprintf(defines + length, sizeof(defines) - length, "#line %d\n", line + 1);
+    }
+
+    const GLchar *sources[3] = { text, defines, text + split };
+    GLint lengths[3] = { (GLint) split, -1, -1 };
+    GLuint stage = glCreateShader(type);
+    glShaderSource(stage, 3, sources, lengths);
+    glCompileShader(stage);
+
+    if (!shader_compileStatus(stage, file)) {
+        glDeleteShader(stage);
+        return 0;
+    }
+    return stage;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool shadervariant_attachFile(GlProgram *program, GLenum type, const char *file, unsigned key,
+    const char *const *flags) {
+    assert(key < SHADERVARIANT_MAX_KEYS && "variant key has more than SHADERVARIANT_MAX_FLAGS flags");
+
+    GLuint stage = 0;
+    const ResArchiveEntry *entry = resarchive_find(file);
+    if (entry && entry->kind == RES_SHADER) {
+        stage = compileSource(type, file, resarchive_data(entry), key, flags);
+    } else {
+        char error[256];
+        char *dir = utils_getDirectory(file);
+        char *text = stb_include_file((char*) file, NULL, dir, error);
+        free(dir);
+
+        if (text) {
+            stage = compileSource(type, file, text, key, flags);
+            free(text);
+        } else {
+            printf("%s\n", error);
+        }
+    }
+
+    glprogram_attachStage(program, stage);
+    return stage != 0;
+}
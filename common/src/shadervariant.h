@@ -0,0 +1,46 @@
+/**
+ * @file shadervariant.h
+ * @brief Compile-time permutations of shader programs
+ *
+ * A variant of a stage file gets a #define for every flag of its key,
+ * inserted right after the #version line. The sources test the flags with
+ * #ifdef instead of branching on a uniform bool, so every variant only
+ * contains the code it runs. The programs are kept per key by the caller,
+ * a key is a bit mask over the flag names of the program.
+ *
+ * The programs are built on the GL directly (glprogram.h). A stage
+ * packed into the open resource archive (resarchive.h) is compiled from
+ * the mapping, with its includes already resolved, any other stage from
+ * its file with the includes resolved by stb_include like fhwcg does.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef SHADERVARIANT_H
+#define SHADERVARIANT_H
+
+#include <fhwcg/fhwcg.h>
+#include "glprogram.h"
+
+/** Upper bound of flags per program */
+#define SHADERVARIANT_MAX_FLAGS 4
+
+/** Number of keys of a program with the most flags */
+#define SHADERVARIANT_MAX_KEYS (1 << SHADERVARIANT_MAX_FLAGS)
+
+/**
+ * Compiles a stage file with the defines of a variant key and attaches it.
+ * The #include lines are resolved first, the defines then go right after
+ * #version, so included code sees them too. Key 0 compiles the file as is.
+ * @param program Program to attach to.
+ * @param type Stage type.
+ * @param file Path of the source file.
+ * @param key Bit i set defines flags[i].
+ * @param flags Define names, one per bit of the key.
+ * @return False if the file could not be read or did not compile, the
+ *         program does not link then.
+ */
+bool shadervariant_attachFile(GlProgram *program, GLenum type, const char *file, unsigned key,
+    const char *const *flags);
+
+#endif // SHADERVARIANT_H
@@ -0,0 +1,422 @@
+/**
+ * @file texcache.c
+ * @brief Implementation of the texture cache
+ *
+ * A cache file holds a header with the hash of the source image and the
+ * internal format, followed by every mipmap level as stored by the GL.
+ * Files that do not match are treated as missing and are rewritten.
+ * Compression is done once by the driver when the file is created.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "texcache.h"
+#include "gpumem.h"
+#include "resarchive.h"
+
+#ifdef _WIN32
+    #include <direct.h>
+    #define MAKE_DIR(path) _mkdir(path)
+#else
+    #include <sys/stat.h>
+    #define MAKE_DIR(path) mkdir(path, 0755)
+#endif
+
+/** "TXC1" in little endian */
+#define TEXCACHE_MAGIC 0x31435854u
+
+/** Increased whenever the file layout changes */
+#define TEXCACHE_VERSION 1
+
+/** Chunk size for hashing the source file */
+#define HASH_CHUNK 65536
+
+/**
+ * Header at the start of a cache file.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    int32_t internalFormat;
+    int32_t compressed;
+    int32_t levels;
+} CacheHeader;
+
+/**
+ * Header in front of every stored mipmap level.
+ */
+typedef struct {
+    int32_t width, height;
+    uint32_t size;
+} LevelHeader;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Hashes the content of a file with 64 bit FNV-1a.
+ * @param filename Path of the file.
+ * @param hash Destination for the hash.
+ * @return False if the file could not be read.
+ */
+static bool hashFile(const char *filename, uint64_t *hash) {
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        return false;
+    }
+
+    unsigned char *buf = malloc(HASH_CHUNK);
+    assert(buf && "malloc failed in texcache hashFile");
+
+    uint64_t h = 0xcbf29ce484222325ull;
+    size_t read;
+    while ((read = fread(buf, 1, HASH_CHUNK, f)) > 0) {
+        for (size_t i = 0; i < read; ++i) {
+            h = (h ^ buf[i]) * 0x100000001b3ull;
+        }
+    }
+
+    free(buf);
+    fclose(f);
+    *hash = h;
+    return true;
+}
+
+/**
+ * Returns the internal format for a storage format.
+ * @param format The storage format.
+ * @return The internal format, GL_RGBA8 if the format is not supported.
+ */
+static GLenum internalFormatOf(TexCacheFormat format) {
+    switch (format) {
+        case TC_BC1:
+            return GLAD_GL_EXT_texture_compression_s3tc ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGBA8;
+        case TC_BC7:
+            return GLAD_GL_VERSION_4_2 ? GL_COMPRESSED_RGBA_BPTC_UNORM : GL_RGBA8;
+        case TC_RGBA8:
+        default:
+            return GL_RGBA8;
+    }
+}
+
+/**
+ * Returns the number of mipmap levels of a full chain.
+ * @param width Width of level 0.
+ * @param height Height of level 0.
+ * @return Number of levels.
+ */
+static int levelCount(int width, int height) {
+    int levels = 1;
+    for (int size = glm_imax(width, height); size > 1; size >>= 1) {
+        ++levels;
+    }
+    return glm_imin(levels, TEXCACHE_MAX_LEVELS);
+}
+
+/**
+ * Discards all pending GL errors.
+ */
+static void clearErrors(void) {
+    while (glGetError() != GL_NO_ERROR) {}
+}
+
+/**
+ * Reads all levels of a cache file.
+ * @param image Destination, cachePath and hash must be set.
+ * @param internalFormat The internal format the caller asks for.
+ * @return False if the file is missing or does not match.
+ */
+static bool readCacheFile(TexCacheImage *image, GLenum internalFormat) {
+    FILE *f = fopen(image->cachePath, "rb");
+    if (!f) {
+        return false;
+    }
+
+    // A file written after a compression fallback holds RGBA8
+    CacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1
+        && header.magic == TEXCACHE_MAGIC && header.version == TEXCACHE_VERSION
+        && header.sourceHash == image->hash
+        && header.levels >= 1 && header.levels <= TEXCACHE_MAX_LEVELS
+        && ((header.compressed && (GLenum) header.internalFormat == internalFormat)
+            || (!header.compressed && header.internalFormat == GL_RGBA8));
+
+    for (int level = 0; ok && level < header.levels; ++level) {
+        LevelHeader lh;
+        ok = fread(&lh, sizeof(lh), 1, f) == 1 && lh.width > 0 && lh.height > 0 && lh.size > 0;
+        if (!ok) {
+            break;
+        }
+
+        unsigned char *data = realloc(image->data, image->dataSize + lh.size);
+        assert(data && "realloc failed in texcache readCacheFile");
+        image->data = data;
+
+        image->levels[level] = (TexCacheLevel) {
+            .width = lh.width, .height = lh.height, .size = lh.size, .offset = image->dataSize
+        };
+        ok = fread(image->data + image->dataSize, 1, lh.size, f) == lh.size;
+        image->dataSize += lh.size;
+    }
+    fclose(f);
+
+    if (!ok) {
+        free(image->data);
+        image->data = NULL;
+        image->dataSize = 0;
+        return false;
+    }
+
+    image->cached = true;
+    image->compressed = header.compressed != 0;
+    image->internalFormat = header.internalFormat;
+    image->levelCount = header.levels;
+    return true;
+}
+
+/**
+ * Points an image at its levels in the resource archive.
+ * Only flipped 2D images match, cubemap faces are packed top down.
+ * @param filename Path of the image file, the name of the entry.
+ * @param image Destination, stays cleared on a miss.
+ * @return False if the archive does not hold the image.
+ */
+static bool readArchive(const char *filename, TexCacheImage *image) {
+    const ResArchiveEntry *entry = resarchive_find(filename);
+    if (!entry || entry->kind != RES_TEXTURE) {
+        return false;
+    }
+
+    const ResArchiveTexture *tex = resarchive_data(entry);
+    if (!(tex->flags & RESARCHIVE_TEX_FLIPPED)) {
+        return false;
+    }
+
+    // Stored as RGBA8 like a cache file written after a compression fallback
+    image->cached = true;
+    image->mapped = true;
+    image->compressed = false;
+    image->internalFormat = GL_RGBA8;
+    image->levelCount = tex->levelCount;
+    for (int i = 0; i < tex->levelCount; ++i) {
+        const ResArchiveLevel *l = &tex->levels[i];
+        image->levels[i] = (TexCacheLevel) {
+            .width = l->width, .height = l->height, .size = l->size, .offset = l->offset
+        };
+    }
+    image->data = (unsigned char*) tex;
+    image->dataSize = (size_t) entry->size;
+    return true;
+}
+
+/**
+ * Re-specifies all levels of the bound texture in a compressed format.
+ * Restores the RGBA8 levels if the driver cannot compress to the format.
+ * @param internalFormat The compressed internal format.
+ * @param levels Number of mipmap levels.
+ * @return False if the texture stayed uncompressed.
+ */
+static bool compressLevels(GLenum internalFormat, int levels) {
+    GLint width[TEXCACHE_MAX_LEVELS], height[TEXCACHE_MAX_LEVELS];
+    size_t offset[TEXCACHE_MAX_LEVELS];
+    size_t total = 0;
+    for (int level = 0; level < levels; ++level) {
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width[level]);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height[level]);
+        offset[level] = total;
+        total += (size_t) width[level] * height[level] * 4;
+    }
+
+    unsigned char *pixels = malloc(total);
+    assert(pixels && "malloc failed in texcache compressLevels");
+    for (int level = 0; level < levels; ++level) {
+        glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, pixels + offset[level]);
+    }
+
+    clearErrors();
+    bool ok = true;
+    for (int level = 0; level < levels && ok; ++level) {
+        glTexImage2D(GL_TEXTURE_2D, level, internalFormat, width[level], height[level], 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, pixels + offset[level]);
+
+        GLint isCompressed = GL_FALSE;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &isCompressed);
+        ok = glGetError() == GL_NO_ERROR && isCompressed;
+    }
+
+    if (!ok) {
+        for (int level = 0; level < levels; ++level) {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, width[level], height[level], 0,
+                GL_RGBA, GL_UNSIGNED_BYTE, pixels + offset[level]);
+        }
+    }
+
+    free(pixels);
+    return ok;
+}
+
+/**
+ * Writes all levels of the bound texture to a cache file.
+ * A temporary file is renamed at the end, so readers never see a partial file.
+ * @param path Path of the cache file.
+ * @param hash Hash of the source image.
+ * @param levels Number of mipmap levels.
+ */
+static void storeCache(const char *path, uint64_t hash, int levels) {
+    MAKE_DIR(TEXCACHE_DIR);
+
+    char tmpPath[300];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    FILE *f = fopen(tmpPath, "wb");
+    if (!f) {
+        return;
+    }
+
+    GLint internalFormat, compressed;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+
+    CacheHeader header = {
+        .magic = TEXCACHE_MAGIC,
+        .version = TEXCACHE_VERSION,
+        .sourceHash = hash,
+        .internalFormat = internalFormat,
+        .compressed = compressed ? 1 : 0,
+        .levels = levels
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    void *data = NULL;
+    for (int level = 0; level < levels && ok; ++level) {
+        LevelHeader lh;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &lh.width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &lh.height);
+
+        if (compressed) {
+            GLint size;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            lh.size = (uint32_t) size;
+        } else {
+            lh.size = (uint32_t) lh.width * lh.height * 4;
+        }
+
+        void *tmp = realloc(data, lh.size);
+        assert(tmp && "realloc failed in texcache storeCache");
+        data = tmp;
+
+        if (compressed) {
+            glGetCompressedTexImage(GL_TEXTURE_2D, level, data);
+        } else {
+            glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        }
+
+        ok = fwrite(&lh, sizeof(lh), 1, f) == 1 && fwrite(data, 1, lh.size, f) == lh.size;
+    }
+
+    free(data);
+    fclose(f);
+
+    if (!ok || rename(tmpPath, path) != 0) {
+        remove(tmpPath);
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool texcache_readImage(const char *filename, TexCacheFormat format, TexCacheImage *image) {
+    memset(image, 0, sizeof(TexCacheImage));
+    if (readArchive(filename, image)) {
+        return true;
+    }
+    image->internalFormat = internalFormatOf(format);
+
+    if (hashFile(filename, &image->hash)) {
+        snprintf(image->cachePath, sizeof(image->cachePath), TEXCACHE_DIR "%016llx-%d.tex",
+            (unsigned long long) image->hash, (int) format);
+        if (readCacheFile(image, image->internalFormat)) {
+            return true;
+        }
+    }
+
+    // Same orientation as texture_loadTexture, the flag is per thread
+    int width, height, channels;
+    stbi_set_flip_vertically_on_load_thread(1);
+    image->data = stbi_load(filename, &width, &height, &channels, 4);
+    if (!image->data) {
+        printf("Error: Could not read image file %s\n", filename);
+        return false;
+    }
+
+    image->levelCount = 1;
+    image->levels[0] = (TexCacheLevel) {
+        .width = width, .height = height, .size = (uint32_t) width * height * 4, .offset = 0
+    };
+    image->dataSize = image->levels[0].size;
+    return true;
+}
+
+void texcache_uploadImage(GLuint tex, const TexCacheImage *image, const unsigned char *pixels) {
+    glBindTexture(GL_TEXTURE_2D, tex);
+
+    for (int level = 0; level < image->levelCount; ++level) {
+        const TexCacheLevel *l = &image->levels[level];
+        const void *src = (const void*) ((uintptr_t) pixels + l->offset);
+        if (image->compressed) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, image->internalFormat,
+                l->width, l->height, 0, (GLsizei) l->size, src);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, l->width, l->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, src);
+        }
+    }
+}
+
+void texcache_finishTexture(GLuint tex, const TexCacheImage *image, GLenum wrapping) {
+    glBindTexture(GL_TEXTURE_2D, tex);
+
+    int levels = image->levelCount;
+    if (!image->cached) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+        levels = levelCount(image->levels[0].width, image->levels[0].height);
+
+        if (image->internalFormat != GL_RGBA8 && !compressLevels(image->internalFormat, levels)) {
+            printf("Texture cache: cannot compress %s, keeping RGBA8.\n", image->cachePath);
+        }
+        if (image->cachePath[0]) {
+            storeCache(image->cachePath, image->hash, levels);
+        }
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapping);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapping);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Queried, the levels may have been compressed by the driver
+    gpumem_trackTexture(GPUMEM_TEXTURES, GL_TEXTURE_2D, tex);
+}
+
+void texcache_freeImage(TexCacheImage *image) {
+    // Mapped levels belong to the archive
+    if (image->cached && !image->mapped) {
+        free(image->data);
+    } else if (!image->cached) {
+        stbi_image_free(image->data);
+    }
+    image->data = NULL;
+    image->dataSize = 0;
+}
+
+GLuint texcache_loadTexture(const char *filename, GLenum wrapping, TexCacheFormat format) {
+    GLuint tex;
+    glGenTextures(1, &tex);
+
+    TexCacheImage image;
+    if (texcache_readImage(filename, format, &image)) {
+        texcache_uploadImage(tex, &image, image.data);
+        texcache_finishTexture(tex, &image, wrapping);
+        texcache_freeImage(&image);
+    }
+    return tex;
+}
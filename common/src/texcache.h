@@ -0,0 +1,114 @@
+/**
+ * @file texcache.h
+ * @brief On-disk cache of decoded and mipmapped textures
+ *
+ * The first load of an image decodes it with stb_image, builds the
+ * mipmaps and writes all levels to TEXCACHE_DIR, keyed by a hash of the
+ * image file. Later loads upload the stored levels directly and skip
+ * decoding and mipmap generation.
+ *
+ * Loading is split into texcache_readImage, which does no GL calls and
+ * may run on any thread, and the GL side texcache_uploadImage and
+ * texcache_finishTexture.
+ *
+ * An image packed into the open resource archive (resarchive.h) is read
+ * from there instead, its RGBA8 levels are uploaded straight from the
+ * mapping without hashing, decoding or copying.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef TEXCACHE_H
+#define TEXCACHE_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Directory of the cache files, relative to the working directory */
+#define TEXCACHE_DIR "texcache/"
+
+/** Upper bound of mipmap levels, enough for 32k textures */
+#define TEXCACHE_MAX_LEVELS 16
+
+/**
+ * Storage format of cached textures.
+ * Compressed formats fall back to TC_RGBA8 if the GL cannot compress them.
+ */
+typedef enum {
+    TC_RGBA8,
+    TC_BC1,  // GL_EXT_texture_compression_s3tc, no alpha
+    TC_BC7   // GL 4.2 BPTC
+} TexCacheFormat;
+
+/**
+ * One mipmap level inside the image data.
+ */
+typedef struct {
+    int width, height;
+    uint32_t size;
+    size_t offset;
+} TexCacheLevel;
+
+/**
+ * Texture data prepared without GL calls.
+ * Holds either all levels from a cache file or the archive, or the
+ * decoded RGBA8 level 0.
+ */
+typedef struct {
+    char cachePath[256];    // empty if the image file could not be hashed
+    uint64_t hash;
+    bool cached;
+    bool compressed;
+    GLenum internalFormat;  // stored format if cached, requested format otherwise
+    int levelCount;
+    TexCacheLevel levels[TEXCACHE_MAX_LEVELS];
+    bool mapped;            // data points into the resource archive
+    unsigned char *data;
+    size_t dataSize;
+} TexCacheImage;
+
+/**
+ * Reads an image from the cache, or decodes it on a miss.
+ * Does no GL calls and may be called from any thread.
+ * @param filename Path of the image file.
+ * @param format Storage format of the texture.
+ * @param image Destination, must be freed with texcache_freeImage.
+ * @return False if the image could not be read.
+ */
+bool texcache_readImage(const char *filename, TexCacheFormat format, TexCacheImage *image);
+
+/**
+ * Specifies the levels of a texture from image data.
+ * @param tex The texture, its previous content is replaced.
+ * @param image The image.
+ * @param pixels Start of the level data, image->data or NULL if a pixel
+ *               unpack buffer holding image->data is bound.
+ */
+void texcache_uploadImage(GLuint tex, const TexCacheImage *image, const unsigned char *pixels);
+
+/**
+ * Completes an uploaded texture. On a miss the mipmaps are built, the
+ * levels compressed and written to the cache. No pixel unpack buffer
+ * may be bound.
+ * @param tex The texture.
+ * @param image The uploaded image.
+ * @param wrapping Wrapping mode for S and T.
+ */
+void texcache_finishTexture(GLuint tex, const TexCacheImage *image, GLenum wrapping);
+
+/**
+ * Frees the data of an image.
+ * @param image The image.
+ */
+void texcache_freeImage(TexCacheImage *image);
+
+/**
+ * Loads a mipmapped texture synchronously, through the cache if possible.
+ * The texture uses trilinear filtering.
+ * @param filename Path of the image file.
+ * @param wrapping Wrapping mode for S and T.
+ * @param format Storage format of the texture.
+ * @return The OpenGL texture, valid even if the image could not be read.
+ */
+GLuint texcache_loadTexture(const char *filename, GLenum wrapping, TexCacheFormat format);
+
+#endif // TEXCACHE_H
@@ -0,0 +1,247 @@
+/**
+ * @file texstream.c
+ * @brief Implementation of the asynchronous texture loader
+ *
+ * Requests live in a fixed array and move from queued to read on the
+ * worker and to done on the GL thread. The worker only touches requests
+ * in the queued state, the GL thread only those that are read, so the
+ * mutex only guards the states and the queue counters.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "texstream.h"
+#include "thread.h"
+#include "gpumem.h"
+
+/** Gray placeholder, visible but not distracting */
+#define PLACEHOLDER_COLOR { 128, 128, 128, 255 }
+
+/**
+ * State of a request.
+ */
+typedef enum {
+    REQUEST_QUEUED,
+    REQUEST_READ,
+    REQUEST_FAILED,
+    REQUEST_DONE
+} RequestState;
+
+/**
+ * One requested texture.
+ */
+typedef struct {
+    RequestState state;
+    const char *filename;
+    GLenum wrapping;
+    TexCacheFormat format;
+    GLuint tex;
+    TexCacheImage image;
+} Request;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global loader state.
+ */
+static struct {
+    Request requests[TEXSTREAM_MAX_REQUESTS];
+    int requestCount;
+    int nextQueued;
+    bool running;
+
+    Thread thread;
+    bool hasThread;
+    Mutex mutex;
+    Cond queueCond;
+
+    GLuint pbo;
+    size_t pboSize;
+} g_stream = { 0 };
+
+/**
+ * Reads the queued requests in order until the loader stops.
+ */
+static void workerLoop(void) {
+    MUTEX_LOCK(&g_stream.mutex);
+    while (true) {
+        while (g_stream.running && g_stream.nextQueued == g_stream.requestCount) {
+            COND_WAIT(&g_stream.queueCond, &g_stream.mutex);
+        }
+
+        if (!g_stream.running) {
+            break;
+        }
+
+        Request *req = &g_stream.requests[g_stream.nextQueued++];
+        MUTEX_UNLOCK(&g_stream.mutex);
+
+        bool ok = texcache_readImage(req->filename, req->format, &req->image);
+
+        MUTEX_LOCK(&g_stream.mutex);
+        req->state = ok ? REQUEST_READ : REQUEST_FAILED;
+    }
+    MUTEX_UNLOCK(&g_stream.mutex);
+}
+
+/**
+ * Worker thread entry.
+ */
+static THREAD_ENTRY(workerMain) {
+    NK_UNUSED(arg);
+    workerLoop();
+    THREAD_RETURN;
+}
+
+/**
+ * Creates a texture holding the placeholder.
+ * @param wrapping Wrapping mode for S and T.
+ * @return The texture.
+ */
+static GLuint createPlaceholder(GLenum wrapping) {
+    const unsigned char pixel[4] = PLACEHOLDER_COLOR;
+
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+    gpumem_setTexture(GPUMEM_TEXTURES, tex, gpumem_imageBytes(GL_RGBA8, 1, 1, 1));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapping);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapping);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return tex;
+}
+
+/**
+ * Uploads an image through the pixel unpack buffer.
+ * The buffer storage is orphaned on every upload, so the driver never
+ * waits for the previous transfer.
+ * @param req The request, its image is freed afterwards.
+ */
+static void uploadRequest(Request *req) {
+    const TexCacheImage *image = &req->image;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, g_stream.pbo);
+    if (image->dataSize > g_stream.pboSize) {
+        g_stream.pboSize = image->dataSize;
+    }
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, g_stream.pboSize, NULL, GL_STREAM_DRAW);
+    gpumem_setBuffer(GPUMEM_STAGING, g_stream.pbo, g_stream.pboSize);
+
+    void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, image->dataSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (dst) {
+        memcpy(dst, image->data, image->dataSize);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        texcache_uploadImage(req->tex, image, NULL);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        texcache_uploadImage(req->tex, image, image->data);
+    }
+
+    texcache_finishTexture(req->tex, image, req->wrapping);
+    texcache_freeImage(&req->image);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void texstream_init(void) {
+    MUTEX_INIT(&g_stream.mutex);
+    COND_INIT(&g_stream.queueCond);
+    g_stream.running = true;
+    g_stream.requestCount = 0;
+    g_stream.nextQueued = 0;
+
+    glGenBuffers(1, &g_stream.pbo);
+    g_stream.pboSize = 0;
+
+    g_stream.hasThread = THREAD_CREATE(&g_stream.thread, workerMain);
+    if (!g_stream.hasThread) {
+        printf("Could not create texture loader thread, loading synchronously!\n");
+    }
+}
+
+void texstream_cleanup(void) {
+    MUTEX_LOCK(&g_stream.mutex);
+    g_stream.running = false;
+    COND_BROADCAST(&g_stream.queueCond);
+    MUTEX_UNLOCK(&g_stream.mutex);
+
+    if (g_stream.hasThread) {
+        THREAD_JOIN(g_stream.thread);
+        g_stream.hasThread = false;
+    }
+
+    for (int i = 0; i < g_stream.requestCount; ++i) {
+        if (g_stream.requests[i].state == REQUEST_READ) {
+            texcache_freeImage(&g_stream.requests[i].image);
+        }
+    }
+    g_stream.requestCount = 0;
+    g_stream.nextQueued = 0;
+
+    gpumem_deleteBuffers(1, &g_stream.pbo);
+    g_stream.pbo = 0;
+
+    COND_DESTROY(&g_stream.queueCond);
+    MUTEX_DESTROY(&g_stream.mutex);
+}
+
+GLuint texstream_loadTexture(const char *filename, GLenum wrapping, TexCacheFormat format) {
+    if (!g_stream.hasThread || g_stream.requestCount >= TEXSTREAM_MAX_REQUESTS) {
+        return texcache_loadTexture(filename, wrapping, format);
+    }
+
+    GLuint tex = createPlaceholder(wrapping);
+
+    MUTEX_LOCK(&g_stream.mutex);
+    Request *req = &g_stream.requests[g_stream.requestCount];
+    memset(req, 0, sizeof(Request));
+    req->state = REQUEST_QUEUED;
+    req->filename = filename;
+    req->wrapping = wrapping;
+    req->format = format;
+    req->tex = tex;
+    g_stream.requestCount++;
+    COND_BROADCAST(&g_stream.queueCond);
+    MUTEX_UNLOCK(&g_stream.mutex);
+
+    return tex;
+}
+
+void texstream_update(void) {
+    int uploads = 0;
+    for (int i = 0; i < g_stream.requestCount && uploads < TEXSTREAM_UPLOADS_PER_UPDATE; ++i) {
+        Request *req = &g_stream.requests[i];
+
+        MUTEX_LOCK(&g_stream.mutex);
+        RequestState state = req->state;
+        MUTEX_UNLOCK(&g_stream.mutex);
+
+        if (state == REQUEST_READ) {
+            uploadRequest(req);
+            ++uploads;
+        }
+        if (state == REQUEST_READ || state == REQUEST_FAILED) {
+            MUTEX_LOCK(&g_stream.mutex);
+            req->state = REQUEST_DONE;
+            MUTEX_UNLOCK(&g_stream.mutex);
+        }
+    }
+}
+
+int texstream_getPendingCount(void) {
+    int pending = 0;
+    MUTEX_LOCK(&g_stream.mutex);
+    for (int i = 0; i < g_stream.requestCount; ++i) {
+        if (g_stream.requests[i].state != REQUEST_DONE) {
+            ++pending;
+        }
+    }
+    MUTEX_UNLOCK(&g_stream.mutex);
+    return pending;
+}
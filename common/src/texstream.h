@@ -0,0 +1,57 @@
+/**
+ * @file texstream.h
+ * @brief Asynchronous texture loading with placeholder textures
+ *
+ * A requested texture is created at once with a 1x1 placeholder and
+ * keeps its id. A worker thread reads or decodes the image through the
+ * texture cache and texstream_update uploads it on the GL thread through
+ * a pixel unpack buffer, replacing the placeholder content.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef TEXSTREAM_H
+#define TEXSTREAM_H
+
+#include <fhwcg/fhwcg.h>
+#include "texcache.h"
+
+/** Maximum number of textures requested over the program run */
+#define TEXSTREAM_MAX_REQUESTS 32
+
+/** Number of finished images uploaded per texstream_update call */
+#define TEXSTREAM_UPLOADS_PER_UPDATE 1
+
+/**
+ * Starts the worker thread.
+ */
+void texstream_init(void);
+
+/**
+ * Stops the worker thread and frees all images not yet uploaded.
+ * Textures keep their placeholder and stay owned by the caller.
+ */
+void texstream_cleanup(void);
+
+/**
+ * Requests a mipmapped texture with trilinear filtering.
+ * Falls back to a synchronous load if all request slots are used.
+ * @param filename Path of the image file, must stay valid until uploaded.
+ * @param wrapping Wrapping mode for S and T.
+ * @param format Storage format of the texture.
+ * @return The OpenGL texture, showing the placeholder until uploaded.
+ */
+GLuint texstream_loadTexture(const char *filename, GLenum wrapping, TexCacheFormat format);
+
+/**
+ * Uploads finished images, call once per frame on the GL thread.
+ */
+void texstream_update(void);
+
+/**
+ * Returns how many requested textures still show the placeholder.
+ * @return Number of pending textures.
+ */
+int texstream_getPendingCount(void);
+
+#endif // TEXSTREAM_H
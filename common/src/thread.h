@@ -0,0 +1,74 @@
+/**
+ * @file thread.h
+ * @brief Minimal thread, mutex and condition variable wrappers
+ *
+ * Uses Win32 threads on Windows and pthreads everywhere else.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+
+    typedef HANDLE Thread;
+    typedef CRITICAL_SECTION Mutex;
+    typedef CONDITION_VARIABLE Cond;
+
+    #define MUTEX_INIT(m)       InitializeCriticalSection(m)
+    #define MUTEX_DESTROY(m)    DeleteCriticalSection(m)
+    #define MUTEX_LOCK(m)       EnterCriticalSection(m)
+    #define MUTEX_UNLOCK(m)     LeaveCriticalSection(m)
+    #define COND_INIT(c)        InitializeConditionVariable(c)
+    #define COND_DESTROY(c)
+    #define COND_WAIT(c, m)     SleepConditionVariableCS(c, m, INFINITE)
+    #define COND_BROADCAST(c)   WakeAllConditionVariable(c)
+
+    /** Declares a thread entry function taking an unused argument */
+    #define THREAD_ENTRY(name)  DWORD WINAPI name(LPVOID arg)
+    #define THREAD_RETURN       return 0
+    #define THREAD_CREATE(t, fn) ((*(t) = CreateThread(NULL, 0, fn, NULL, 0, NULL)) != NULL)
+    #define THREAD_JOIN(t)      do { WaitForSingleObject(t, INFINITE); CloseHandle(t); } while (0)
+    #define THREAD_SLEEP_MS(ms) Sleep(ms)
+    #define THREAD_YIELD()      SwitchToThread()
+
+    /** Sequentially consistent load, exchange and add of a volatile long */
+    #define ATOMIC_LOAD(p)      InterlockedCompareExchange(p, 0, 0)
+    #define ATOMIC_EXCHANGE(p, v) InterlockedExchange(p, v)
+    #define ATOMIC_ADD(p, v)    InterlockedExchangeAdd(p, v)
+#else
+    #include <pthread.h>
+    #include <sched.h>
+    #include <unistd.h>
+
+    typedef pthread_t Thread;
+    typedef pthread_mutex_t Mutex;
+    typedef pthread_cond_t Cond;
+
+    #define MUTEX_INIT(m)       pthread_mutex_init(m, NULL)
+    #define MUTEX_DESTROY(m)    pthread_mutex_destroy(m)
+    #define MUTEX_LOCK(m)       pthread_mutex_lock(m)
+    #define MUTEX_UNLOCK(m)     pthread_mutex_unlock(m)
+    #define COND_INIT(c)        pthread_cond_init(c, NULL)
+    #define COND_DESTROY(c)     pthread_cond_destroy(c)
+    #define COND_WAIT(c, m)     pthread_cond_wait(c, m)
+    #define COND_BROADCAST(c)   pthread_cond_broadcast(c)
+
+    /** Declares a thread entry function taking an unused argument */
+    #define THREAD_ENTRY(name)  void* name(void *arg)
+    #define THREAD_RETURN       return NULL
+    #define THREAD_CREATE(t, fn) (pthread_create(t, NULL, fn, NULL) == 0)
+    #define THREAD_JOIN(t)      pthread_join(t, NULL)
+    #define THREAD_SLEEP_MS(ms) usleep((ms) * 1000)
+    #define THREAD_YIELD()      sched_yield()
+
+    /** Sequentially consistent load, exchange and add of a volatile long */
+    #define ATOMIC_LOAD(p)      __atomic_load_n(p, __ATOMIC_SEQ_CST)
+    #define ATOMIC_EXCHANGE(p, v) __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+    #define ATOMIC_ADD(p, v)    __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST)
+#endif
+
+#endif // THREAD_H
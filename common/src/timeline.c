@@ -0,0 +1,353 @@
+/**
+ * @file timeline.c
+ * @brief Implementation of the Chrome trace export
+ *
+ * Every thread registers one buffer on its first event. Only the owner
+ * writes a buffer: it fills the next event and then publishes the new
+ * count. The exporting thread reads up to the published count. Buffers
+ * belong to the capture of their epoch, an owner seeing a newer capture
+ * empties its buffer first, so starting a capture never touches buffers of
+ * other threads.
+ *
+ * In ring mode the count keeps growing and the events wrap around, so a
+ * buffer always holds the latest TIMELINE_EVENTS_PER_THREAD events. A dump
+ * reads the buffers while their owners keep writing, it skips the oldest
+ * TIMELINE_RING_SLACK events, which an owner may be overwriting.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "timeline.h"
+#include "thread.h"
+
+#ifdef _MSC_VER
+    #define THREAD_LOCAL __declspec(thread)
+    #define ATOMIC_INC(p) _InterlockedIncrement(p)
+#else
+    #define THREAD_LOCAL __thread
+    #define ATOMIC_INC(p) __sync_add_and_fetch(p, 1)
+#endif
+
+/** Oldest events of a ring skipped by a dump, owners may write them meanwhile */
+#define TIMELINE_RING_SLACK 1024
+
+/**
+ * One recorded timestamp.
+ */
+typedef struct {
+    const char *name;   // NULL for the end of a scope
+    uint64_t time;      // glfwGetTimerValue ticks
+} TimelineEvent;
+
+/**
+ * Events of one thread.
+ */
+typedef struct {
+    TimelineEvent *events;
+    volatile long count;    // published events
+    volatile long epoch;    // capture the events belong to
+    long dropped;
+    const char *name;
+} ThreadBuffer;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+volatile int g_timelineActive = 0;
+
+/** Buffer of the calling thread, NULL before its first event */
+static THREAD_LOCAL ThreadBuffer *t_buffer = NULL;
+
+/** Name of the calling thread, may be set before its buffer exists */
+static THREAD_LOCAL const char *t_name = NULL;
+
+/**
+ * Registered buffers and the running capture.
+ */
+static struct {
+    ThreadBuffer buffers[TIMELINE_MAX_THREADS];
+    volatile long threadCount;  // registrations, may exceed TIMELINE_MAX_THREADS
+    volatile long epoch;        // current capture, 0 before the first
+    volatile int ring;          // events wrap instead of being dropped
+    uint64_t startTime;
+    int fileIndex;
+} g_timeline = { 0 };
+
+/** Stands in for the buffer of threads beyond TIMELINE_MAX_THREADS */
+static ThreadBuffer g_untraced = { 0 };
+
+/**
+ * Returns the buffer of the calling thread for the running capture.
+ * @return The buffer, without events if the thread is not traced.
+ */
+static ThreadBuffer* threadBuffer(void) {
+    ThreadBuffer *buf = t_buffer;
+    if (!buf) {
+        long idx = ATOMIC_INC(&g_timeline.threadCount) - 1;
+        if (idx >= TIMELINE_MAX_THREADS) {
+            t_buffer = &g_untraced;
+            return t_buffer;
+        }
+
+        buf = &g_timeline.buffers[idx];
+        buf->events = malloc(TIMELINE_EVENTS_PER_THREAD * sizeof(TimelineEvent));
+        assert(buf->events && "malloc failed in timeline threadBuffer");
+        buf->name = t_name;
+        t_buffer = buf;
+    }
+
+    // The count is emptied before the epoch is adopted, an exporter
+    // seeing the new epoch never reads events of the old capture
+    long epoch = ATOMIC_LOAD(&g_timeline.epoch);
+    if (buf->events && buf->epoch != epoch) {
+        ATOMIC_EXCHANGE(&buf->count, 0);
+        ATOMIC_EXCHANGE(&buf->epoch, epoch);
+        buf->dropped = 0;
+    }
+    return buf;
+}
+
+/**
+ * Appends an event to the buffer of the calling thread.
+ * @param name Scope name, NULL for the end of a scope.
+ */
+static void record(const char *name) {
+    ThreadBuffer *buf = threadBuffer();
+    if (!buf->events) {
+        return;
+    }
+
+    long count = buf->count;
+    if (count >= TIMELINE_EVENTS_PER_THREAD && !g_timeline.ring) {
+        ++buf->dropped;
+        return;
+    }
+    TimelineEvent *e = &buf->events[count & (TIMELINE_EVENTS_PER_THREAD - 1)];
+    e->name = name;
+    e->time = glfwGetTimerValue();
+    ATOMIC_EXCHANGE(&buf->count, count + 1);
+}
+
+/**
+ * Converts timer ticks to microseconds since the given origin.
+ * @param time Timer ticks.
+ * @param origin Timer ticks of the trace start.
+ * @return Microseconds.
+ */
+static double toMicroseconds(uint64_t time, uint64_t origin) {
+    uint64_t ticks = time > origin ? time - origin : 0;
+    return (double) ticks * 1e6 / (double) glfwGetTimerFrequency();
+}
+
+/**
+ * Writes the events of one buffer recorded after a point in time. End
+ * events without a begin in the written range are skipped, scopes still
+ * open are closed at the stop time.
+ * @param f Destination.
+ * @param buf The buffer.
+ * @param tid Thread id in the trace.
+ * @param since Timer ticks of the first written event, also the trace origin.
+ * @param stopTime Timer ticks at the stop.
+ * @param first Whether nothing was written before, cleared on output.
+ * @return Number of written events.
+ */
+static long writeBuffer(FILE *f, const ThreadBuffer *buf, int tid, uint64_t since, uint64_t stopTime, bool *first) {
+    long epoch = ATOMIC_LOAD(&buf->epoch);
+    long count = ATOMIC_LOAD(&buf->count);
+    if (!buf->events || epoch != g_timeline.epoch || count == 0) {
+        return 0;
+    }
+
+    long begin = 0;
+    if (count > TIMELINE_EVENTS_PER_THREAD) {
+        begin = count - TIMELINE_EVENTS_PER_THREAD + TIMELINE_RING_SLACK;
+    }
+    while (begin < count && buf->events[begin & (TIMELINE_EVENTS_PER_THREAD - 1)].time < since) {
+        ++begin;
+    }
+    if (begin == count) {
+        return 0;
+    }
+
+    char defaultName[32];
+    snprintf(defaultName, sizeof(defaultName), "Thread %d", tid);
+    fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            *first ? "" : ",", tid, buf->name ? buf->name : defaultName);
+    *first = false;
+
+    long written = 0;
+    int depth = 0;
+    for (long i = begin; i < count; ++i) {
+        const TimelineEvent *e = &buf->events[i & (TIMELINE_EVENTS_PER_THREAD - 1)];
+        if (e->name) {
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"B\",\"pid\":1,\"tid\":%d,\"ts\":%.3f}",
+                    e->name, tid, toMicroseconds(e->time, since));
+            ++depth;
+        } else if (depth > 0) {
+            fprintf(f, ",\n{\"ph\":\"E\",\"pid\":1,\"tid\":%d,\"ts\":%.3f}", tid, toMicroseconds(e->time, since));
+            --depth;
+        } else {
+            continue;
+        }
+        ++written;
+    }
+
+    for (; depth > 0; --depth) {
+        fprintf(f, ",\n{\"ph\":\"E\",\"pid\":1,\"tid\":%d,\"ts\":%.3f}", tid, toMicroseconds(stopTime, since));
+    }
+
+    if (buf->dropped > 0) {
+        printf("Timeline: %ld events of thread %d dropped, the buffer holds %d\n",
+               buf->dropped, tid, TIMELINE_EVENTS_PER_THREAD);
+    }
+    return written;
+}
+
+/**
+ * Opens the next free TIMELINE_FILE_PREFIX file.
+ * @param path Destination for the file name.
+ * @param size Size of path.
+ * @return The file, NULL if all names are taken or it can't be created.
+ */
+static FILE* openNextFile(char *path, size_t size) {
+    FILE *f = NULL;
+    for (; g_timeline.fileIndex < 1000 && !f; ++g_timeline.fileIndex) {
+        snprintf(path, size, TIMELINE_FILE_PREFIX "%03d.json", g_timeline.fileIndex);
+        FILE *existing = fopen(path, "r");
+        if (existing) {
+            fclose(existing);
+            continue;
+        }
+        f = fopen(path, "w");
+    }
+    return f;
+}
+
+/**
+ * Writes the events of all threads recorded after a point in time.
+ * @param f Destination, closed afterwards.
+ * @param path File name for the messages.
+ * @param since Timer ticks of the first written event.
+ * @param stopTime Timer ticks at the stop.
+ * @return False if the file could not be written.
+ */
+static bool writeTrace(FILE *f, const char *path, uint64_t since, uint64_t stopTime) {
+    // Threads still finishing an event write past the counts read here
+    long threads = glm_imin((int) ATOMIC_LOAD(&g_timeline.threadCount), TIMELINE_MAX_THREADS);
+    long events = 0;
+    bool first = true;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (long i = 0; i < threads; ++i) {
+        events += writeBuffer(f, &g_timeline.buffers[i], (int) i + 1, since, stopTime, &first);
+    }
+    fprintf(f, "\n]}\n");
+
+    bool ok = !ferror(f);
+    fclose(f);
+    if (ok) {
+        printf("Timeline written to %s (%ld events)\n", path, events);
+    } else {
+        printf("Timeline could not be written to %s\n", path);
+    }
+    return ok;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void timeline_begin(const char *name) {
+    record(name);
+}
+
+void timeline_end(void) {
+    record(NULL);
+}
+
+void timeline_setThreadName(const char *name) {
+    t_name = name;
+    if (t_buffer && t_buffer != &g_untraced) {
+        t_buffer->name = name;
+    }
+}
+
+void timeline_start(void) {
+    if (g_timelineActive || instrument_getLevel() < INSTRUMENT_FULL) {
+        return;
+    }
+
+    g_timeline.startTime = glfwGetTimerValue();
+    g_timeline.ring = 0;
+    ATOMIC_INC(&g_timeline.epoch);
+    g_timelineActive = 1;
+    printf("Timeline capture started\n");
+}
+
+void timeline_startRing(void) {
+    if (g_timelineActive || instrument_getLevel() < INSTRUMENT_FULL) {
+        return;
+    }
+
+    g_timeline.startTime = glfwGetTimerValue();
+    g_timeline.ring = 1;
+    ATOMIC_INC(&g_timeline.epoch);
+    g_timelineActive = 1;
+}
+
+bool timeline_stop(void) {
+    if (!g_timelineActive) {
+        return true;
+    }
+    g_timelineActive = 0;
+    uint64_t stopTime = glfwGetTimerValue();
+    if (g_timeline.ring) {
+        return true;
+    }
+
+    char path[64];
+    FILE *f = openNextFile(path, sizeof(path));
+    if (!f) {
+        printf("Timeline capture could not be written\n");
+        return false;
+    }
+    return writeTrace(f, path, g_timeline.startTime, stopTime);
+}
+
+bool timeline_dump(const char *path, uint64_t since) {
+    if (!g_timelineActive) {
+        return false;
+    }
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        printf("Timeline could not be written to %s\n", path);
+        return false;
+    }
+    return writeTrace(f, path, since > g_timeline.startTime ? since : g_timeline.startTime, glfwGetTimerValue());
+}
+
+void timeline_toggle(void) {
+    if (g_timeline.ring && g_timelineActive) {
+        char path[64];
+        FILE *f = openNextFile(path, sizeof(path));
+        if (f) {
+            writeTrace(f, path, g_timeline.startTime, glfwGetTimerValue());
+        }
+    } else if (g_timelineActive) {
+        timeline_stop();
+    } else {
+        timeline_start();
+    }
+}
+
+void timeline_cleanup(void) {
+    timeline_stop();
+
+    long threads = glm_imin((int) g_timeline.threadCount, TIMELINE_MAX_THREADS);
+    for (long i = 0; i < threads; ++i) {
+        free(g_timeline.buffers[i].events);
+    }
+    memset(&g_timeline, 0, sizeof(g_timeline));
+    t_buffer = NULL;
+}
+
+bool timeline_isActive(void) {
+    return g_timelineActive != 0;
+}
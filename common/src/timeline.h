@@ -0,0 +1,116 @@
+/**
+ * @file timeline.h
+ * @brief Timed scopes of all threads exported as a Chrome trace
+ *
+ * Code is instrumented with TIMELINE_BEGIN and TIMELINE_END. While a
+ * capture runs, every thread appends begin and end timestamps to its own
+ * buffer without locking. Stopping the capture writes all buffers as Chrome
+ * trace JSON, which chrome://tracing and ui.perfetto.dev open.
+ *
+ * A ring capture runs until the program ends and keeps only the latest
+ * events of every thread, timeline_dump writes the recent part of it
+ * while it keeps running.
+ *
+ * Without a capture a scope costs one load and a branch. Defining
+ * TIMELINE_DISABLED or an INSTRUMENT_LEVEL below INSTRUMENT_FULL compiles
+ * the scopes out entirely, captures are then refused.
+ *
+ * The file is kept identical in the 3D exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <fhwcg/fhwcg.h>
+#include "instrument.h"
+
+/** Events a thread can record per capture, later ones are dropped */
+#define TIMELINE_EVENTS_PER_THREAD (1 << 16)
+
+/** Threads that can record, later threads are not traced */
+#define TIMELINE_MAX_THREADS 64
+
+/** Prefix of the written files, followed by a running number */
+#define TIMELINE_FILE_PREFIX "timeline_"
+
+#if defined(TIMELINE_DISABLED) || INSTRUMENT_LEVEL < INSTRUMENT_FULL
+    #define TIMELINE_BEGIN(name) ((void) 0)
+    #define TIMELINE_END() ((void) 0)
+#else
+    /** Opens a scope, name must be a string literal */
+    #define TIMELINE_BEGIN(name) do { if (g_timelineActive) timeline_begin(name); } while (0)
+    /** Closes the innermost scope of the calling thread */
+    #define TIMELINE_END() do { if (g_timelineActive) timeline_end(); } while (0)
+#endif
+
+/** Whether a capture runs, read by the scope macros */
+extern volatile int g_timelineActive;
+
+/**
+ * Records the begin of a scope on the calling thread, use TIMELINE_BEGIN.
+ * @param name Name of the scope, must outlive the capture.
+ */
+void timeline_begin(const char *name);
+
+/**
+ * Records the end of the innermost scope on the calling thread, use TIMELINE_END.
+ */
+void timeline_end(void);
+
+/**
+ * Names the calling thread in the exported trace.
+ * @param name Thread name, must outlive the program.
+ */
+void timeline_setThreadName(const char *name);
+
+/**
+ * Starts a capture, events of earlier captures are discarded.
+ * Does nothing below INSTRUMENT_FULL.
+ */
+void timeline_start(void);
+
+/**
+ * Starts a ring capture: the buffers wrap instead of dropping events.
+ * Does nothing while a capture runs or below INSTRUMENT_FULL.
+ */
+void timeline_startRing(void);
+
+/**
+ * Stops the capture and writes it to the next free TIMELINE_FILE_PREFIX file,
+ * a ring capture is stopped without writing it.
+ * Does nothing without a running capture.
+ * @return False if the file could not be written.
+ */
+bool timeline_stop(void);
+
+/**
+ * Writes the events of the running capture recorded after a point in
+ * time without stopping it. Meant for ring captures, the oldest events of
+ * a wrapped buffer are skipped since their thread may overwrite them.
+ * @param path File to write.
+ * @param since glfwGetTimerValue ticks of the first event to write.
+ * @return False without a capture or if the file could not be written.
+ */
+bool timeline_dump(const char *path, uint64_t since);
+
+/**
+ * Starts a capture or stops and writes the running one.
+ * A running ring capture is written and keeps running.
+ */
+void timeline_toggle(void);
+
+/**
+ * Writes a running capture and frees all buffers.
+ * Call once every other thread has finished.
+ */
+void timeline_cleanup(void);
+
+/**
+ * Checks whether a capture runs.
+ * @return True while recording.
+ */
+bool timeline_isActive(void);
+
+#endif // TIMELINE_H
@@ -0,0 +1,565 @@
+/**
+ * @file trace.c
+ * @brief Implementation of the simulation trace recorder and replay
+ *
+ * The recorder fills one of two buffers on the main thread while the writer
+ * thread writes the other one, so a frame only costs the encode and a copy.
+ * The writer only touches the buffer handed to it, the mutex only guards
+ * the hand-off.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "trace.h"
+#include "thread.h"
+#include "array.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+DEFINE_ARRAY_TYPE(unsigned char, ByteArr)
+DEFINE_ARRAY_TYPE(uint64_t, OffsetArr)
+
+/**
+ * Encoding of the records of a frame.
+ */
+typedef enum {
+    FRAME_RAW,
+    FRAME_DELTA
+} FrameEncoding;
+
+/**
+ * Header in front of every frame, followed by the globals and the payload.
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t encoding;
+    uint32_t payloadSize;
+    uint32_t reserved;
+} FrameHeader;
+
+/** No buffer is waiting for the writer */
+#define NO_PENDING -1
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global recorder state.
+ */
+static struct {
+    bool recording;
+    FILE *file;
+    TraceHeader header;
+    uint64_t offset;            // file offset of the next frame
+    OffsetArr frameOffsets;
+
+    ByteArr prev;               // records of the previous frame, delta base
+    uint32_t prevCount;
+    int sinceKeyframe;
+
+    ByteArr buffers[2];
+    int active;                 // buffer filled by the main thread
+
+    Thread thread;
+    bool hasThread;
+    Mutex mutex;
+    Cond cond;
+    int pending;                // buffer handed to the writer or NO_PENDING
+    bool stop;
+} g_rec = { 0 };
+
+/**
+ * Global replay state.
+ */
+static struct {
+    bool open;
+    const unsigned char *base;
+    size_t size;
+    TraceHeader header;
+    const uint64_t *frameOffsets;
+
+    ByteArr records;            // decoded records of decodedFrame
+    int decodedFrame;
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} g_replay = { 0 };
+
+/**
+ * Writes the pending buffer until the recorder stops.
+ */
+static void writerLoop(void) {
+    MUTEX_LOCK(&g_rec.mutex);
+    while (true) {
+        while (!g_rec.stop && g_rec.pending == NO_PENDING) {
+            COND_WAIT(&g_rec.cond, &g_rec.mutex);
+        }
+
+        if (g_rec.pending == NO_PENDING) {
+            break;
+        }
+
+        ByteArr *buffer = &g_rec.buffers[g_rec.pending];
+        MUTEX_UNLOCK(&g_rec.mutex);
+
+        if (fwrite(buffer->data, 1, buffer->size, g_rec.file) != buffer->size) {
+            printf("Trace writer could not write %zu bytes!\n", buffer->size);
+        }
+        ByteArr_clear(buffer);
+
+        MUTEX_LOCK(&g_rec.mutex);
+        g_rec.pending = NO_PENDING;
+        COND_BROADCAST(&g_rec.cond);
+    }
+    MUTEX_UNLOCK(&g_rec.mutex);
+}
+
+/**
+ * Writer thread entry.
+ */
+static THREAD_ENTRY(writerMain) {
+    NK_UNUSED(arg);
+    writerLoop();
+    THREAD_RETURN;
+}
+
+/**
+ * Hands the active buffer to the writer and switches to the other one.
+ * Waits only if the writer is still busy with the previous buffer.
+ */
+static void submitBuffer(void) {
+    ByteArr *buffer = &g_rec.buffers[g_rec.active];
+    if (buffer->size == 0) {
+        return;
+    }
+
+    if (!g_rec.hasThread) {
+        fwrite(buffer->data, 1, buffer->size, g_rec.file);
+        ByteArr_clear(buffer);
+        return;
+    }
+
+    MUTEX_LOCK(&g_rec.mutex);
+    while (g_rec.pending != NO_PENDING) {
+        COND_WAIT(&g_rec.cond, &g_rec.mutex);
+    }
+    g_rec.pending = g_rec.active;
+    COND_BROADCAST(&g_rec.cond);
+    MUTEX_UNLOCK(&g_rec.mutex);
+
+    g_rec.active ^= 1;
+}
+
+/**
+ * XORs the records with the previous frame and run-length encodes the zero
+ * words as pairs of (zero count, literal count) followed by the literals.
+ * @param records Records of the frame.
+ * @param words Number of 32 bit words of the records.
+ * @param dst Output, room for 2 * words + 2 words.
+ * @return Size of the encoded payload in bytes.
+ */
+static uint32_t encodeDelta(const uint32_t *records, uint32_t words, uint32_t *dst) {
+    const uint32_t *prev = (const uint32_t*) g_rec.prev.data;
+    uint32_t *out = dst;
+    uint32_t i = 0;
+
+    while (i < words) {
+        uint32_t zeros = 0;
+        while (i + zeros < words && records[i + zeros] == prev[i + zeros]) {
+            ++zeros;
+        }
+        i += zeros;
+
+        uint32_t *literalCount = out + 1;
+        out[0] = zeros;
+        out += 2;
+
+        uint32_t literals = 0;
+        while (i < words && records[i] != prev[i]) {
+            *out++ = records[i] ^ prev[i];
+            ++literals;
+            ++i;
+        }
+        *literalCount = literals;
+    }
+
+    return (uint32_t) ((out - dst) * sizeof(uint32_t));
+}
+
+/**
+ * Applies a delta payload to the decoded records of the previous frame.
+ * @param src Encoded payload.
+ * @param size Payload size in bytes.
+ * @param records Records of the previous frame, updated in place.
+ * @param words Number of 32 bit words of the records.
+ * @return False if the payload is malformed.
+ */
+static bool decodeDelta(const uint32_t *src, uint32_t size, uint32_t *records, uint32_t words) {
+    const uint32_t *end = src + size / sizeof(uint32_t);
+    uint32_t i = 0;
+
+    while (src + 2 <= end) {
+        uint32_t zeros = src[0];
+        uint32_t literals = src[1];
+        src += 2;
+
+        if (zeros > words - i || literals > words - i - zeros || literals > (uint32_t) (end - src)) {
+            return false;
+        }
+        i += zeros;
+        for (uint32_t k = 0; k < literals; ++k) {
+            records[i++] ^= *src++;
+        }
+    }
+    return src == end && i == words;
+}
+
+/**
+ * Returns the header of a frame of the replay.
+ * @param frame Frame index.
+ * @return The header or NULL if it lies outside the file.
+ */
+static const FrameHeader* replayFrameHeader(int frame) {
+    const TraceHeader *h = &g_replay.header;
+    uint64_t offset = g_replay.frameOffsets[frame];
+    if (offset + sizeof(FrameHeader) + h->globalsSize > g_replay.size) {
+        return NULL;
+    }
+
+    const FrameHeader *fh = (const FrameHeader*) (g_replay.base + offset);
+    uint64_t end = offset + sizeof(FrameHeader) + h->globalsSize + fh->payloadSize;
+    return end <= g_replay.size ? fh : NULL;
+}
+
+/**
+ * Decodes a frame into the replay records on top of the last decoded frame.
+ * @param frame Frame index.
+ * @return False if the frame is malformed.
+ */
+static bool decodeFrame(int frame) {
+    const TraceHeader *h = &g_replay.header;
+    const FrameHeader *fh = replayFrameHeader(frame);
+    if (!fh) {
+        return false;
+    }
+
+    const unsigned char *payload = (const unsigned char*) (fh + 1) + h->globalsSize;
+    size_t bytes = (size_t) fh->count * h->recordSize;
+
+    if (fh->encoding == FRAME_RAW) {
+        if (fh->payloadSize != bytes) {
+            return false;
+        }
+        memcpy(ByteArr_resizeUninit(&g_replay.records, bytes), payload, bytes);
+    } else {
+        if (g_replay.records.size != bytes || g_replay.decodedFrame != frame - 1) {
+            return false;
+        }
+        if (!decodeDelta((const uint32_t*) payload, fh->payloadSize,
+                (uint32_t*) g_replay.records.data, (uint32_t) (bytes / sizeof(uint32_t)))) {
+            return false;
+        }
+    }
+
+    g_replay.decodedFrame = frame;
+    return true;
+}
+
+/**
+ * Maps a file read-only into memory.
+ * @param filename Path of the file.
+ * @return False if the file could not be mapped.
+ */
+static bool mapFile(const char *filename) {
+#ifdef _WIN32
+    g_replay.file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (g_replay.file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(g_replay.file, &size);
+    g_replay.size = (size_t) size.QuadPart;
+    g_replay.mapping = CreateFileMappingA(g_replay.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    g_replay.base = g_replay.mapping ? MapViewOfFile(g_replay.mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!g_replay.base) {
+        if (g_replay.mapping) {
+            CloseHandle(g_replay.mapping);
+        }
+        CloseHandle(g_replay.file);
+        return false;
+    }
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    g_replay.size = (size_t) st.st_size;
+    void *base = mmap(NULL, g_replay.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    g_replay.base = base;
+#endif
+    return true;
+}
+
+/**
+ * Unmaps the replay file.
+ */
+static void unmapFile(void) {
+#ifdef _WIN32
+    UnmapViewOfFile(g_replay.base);
+    CloseHandle(g_replay.mapping);
+    CloseHandle(g_replay.file);
+#else
+    munmap((void*) g_replay.base, g_replay.size);
+#endif
+    g_replay.base = NULL;
+    g_replay.size = 0;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool trace_beginRecord(const char *filename, const TraceLayout *layout) {
+    assert(!g_rec.recording && "trace recording already running");
+    assert(layout->recordSize % sizeof(uint32_t) == 0 && "trace records must be a multiple of 4 bytes");
+
+    g_rec.file = fopen(filename, "wb");
+    if (!g_rec.file) {
+        printf("Could not create trace file %s!\n", filename);
+        return false;
+    }
+
+    TraceHeader *h = &g_rec.header;
+    memset(h, 0, sizeof(TraceHeader));
+    memcpy(h->magic, TRACE_MAGIC, sizeof(h->magic));
+    h->version = TRACE_VERSION;
+    h->kind = layout->kind;
+    h->flags = layout->delta ? TRACE_FLAG_DELTA : 0;
+    h->globalsSize = layout->globalsSize;
+    h->recordSize = layout->recordSize;
+    h->fixedDt = layout->fixedDt;
+
+    // The header is rewritten with the frame count and table offset at the end
+    fwrite(h, sizeof(TraceHeader), 1, g_rec.file);
+    g_rec.offset = sizeof(TraceHeader);
+
+    OffsetArr_init(&g_rec.frameOffsets);
+    ByteArr_init(&g_rec.prev);
+    ByteArr_init(&g_rec.buffers[0]);
+    ByteArr_init(&g_rec.buffers[1]);
+    ByteArr_reserve(&g_rec.buffers[0], TRACE_WRITE_BUFFER_SIZE);
+    ByteArr_reserve(&g_rec.buffers[1], TRACE_WRITE_BUFFER_SIZE);
+    g_rec.prevCount = 0;
+    g_rec.sinceKeyframe = 0;
+    g_rec.active = 0;
+
+    MUTEX_INIT(&g_rec.mutex);
+    COND_INIT(&g_rec.cond);
+    g_rec.pending = NO_PENDING;
+    g_rec.stop = false;
+    g_rec.hasThread = THREAD_CREATE(&g_rec.thread, writerMain);
+    if (!g_rec.hasThread) {
+        printf("Could not create trace writer thread, writing synchronously!\n");
+    }
+
+    g_rec.recording = true;
+    return true;
+}
+
+void trace_recordFrame(const void *globals, const void *records, uint32_t count) {
+    if (!g_rec.recording) {
+        return;
+    }
+
+    const TraceHeader *h = &g_rec.header;
+    size_t bytes = (size_t) count * h->recordSize;
+    uint32_t words = (uint32_t) (bytes / sizeof(uint32_t));
+
+    bool delta = (h->flags & TRACE_FLAG_DELTA) && g_rec.frameOffsets.size > 0
+        && count == g_rec.prevCount && g_rec.sinceKeyframe < TRACE_KEYFRAME_INTERVAL;
+
+    // Room for the worst case delta, alternating equal and changed words
+    size_t maxFrame = sizeof(FrameHeader) + h->globalsSize + (2 * (size_t) words + 2) * sizeof(uint32_t);
+    ByteArr *buffer = &g_rec.buffers[g_rec.active];
+    if (buffer->size > 0 && buffer->size + maxFrame > TRACE_WRITE_BUFFER_SIZE) {
+        submitBuffer();
+        buffer = &g_rec.buffers[g_rec.active];
+    }
+    ByteArr_reserve(buffer, buffer->size + maxFrame);
+
+    unsigned char *dst = buffer->data + buffer->size;
+    FrameHeader *fh = (FrameHeader*) dst;
+    memcpy(dst + sizeof(FrameHeader), globals, h->globalsSize);
+    unsigned char *payload = dst + sizeof(FrameHeader) + h->globalsSize;
+
+    fh->count = count;
+    fh->reserved = 0;
+    if (delta) {
+        fh->encoding = FRAME_DELTA;
+        fh->payloadSize = encodeDelta(records, words, (uint32_t*) payload);
+        ++g_rec.sinceKeyframe;
+    } else {
+        fh->encoding = FRAME_RAW;
+        fh->payloadSize = (uint32_t) bytes;
+        memcpy(payload, records, bytes);
+        g_rec.sinceKeyframe = 1;
+    }
+
+    if (h->flags & TRACE_FLAG_DELTA) {
+        memcpy(ByteArr_resizeUninit(&g_rec.prev, bytes), records, bytes);
+        g_rec.prevCount = count;
+    }
+
+    size_t frameSize = sizeof(FrameHeader) + h->globalsSize + fh->payloadSize;
+    buffer->size += frameSize;
+    OffsetArr_push(&g_rec.frameOffsets, g_rec.offset);
+    g_rec.offset += frameSize;
+}
+
+void trace_endRecord(void) {
+    if (!g_rec.recording) {
+        return;
+    }
+
+    submitBuffer();
+
+    MUTEX_LOCK(&g_rec.mutex);
+    g_rec.stop = true;
+    COND_BROADCAST(&g_rec.cond);
+    MUTEX_UNLOCK(&g_rec.mutex);
+
+    if (g_rec.hasThread) {
+        THREAD_JOIN(g_rec.thread);
+        g_rec.hasThread = false;
+    }
+
+    TraceHeader *h = &g_rec.header;
+    h->frameCount = (uint32_t) g_rec.frameOffsets.size;
+    h->indexOffset = g_rec.offset;
+    fwrite(g_rec.frameOffsets.data, sizeof(uint64_t), g_rec.frameOffsets.size, g_rec.file);
+    fseek(g_rec.file, 0, SEEK_SET);
+    fwrite(h, sizeof(TraceHeader), 1, g_rec.file);
+    fclose(g_rec.file);
+    g_rec.file = NULL;
+
+    COND_DESTROY(&g_rec.cond);
+    MUTEX_DESTROY(&g_rec.mutex);
+
+    OffsetArr_free(&g_rec.frameOffsets);
+    ByteArr_free(&g_rec.prev);
+    ByteArr_free(&g_rec.buffers[0]);
+    ByteArr_free(&g_rec.buffers[1]);
+    g_rec.recording = false;
+}
+
+bool trace_isRecording(void) {
+    return g_rec.recording;
+}
+
+int trace_getRecordedFrames(void) {
+    return g_rec.recording ? (int) g_rec.frameOffsets.size : (int) g_rec.header.frameCount;
+}
+
+bool trace_openReplay(const char *filename, TraceLayout *layout) {
+    trace_closeReplay();
+
+    if (!mapFile(filename)) {
+        printf("Could not open trace file %s!\n", filename);
+        return false;
+    }
+
+    TraceHeader *h = &g_replay.header;
+    bool valid = g_replay.size >= sizeof(TraceHeader);
+    if (valid) {
+        memcpy(h, g_replay.base, sizeof(TraceHeader));
+        valid = memcmp(h->magic, TRACE_MAGIC, sizeof(h->magic)) == 0
+            && h->version == TRACE_VERSION
+            && h->kind == (uint32_t) layout->kind
+            && h->globalsSize == layout->globalsSize
+            && h->recordSize == layout->recordSize
+            && h->frameCount > 0
+            && h->indexOffset <= g_replay.size
+            && (g_replay.size - h->indexOffset) / sizeof(uint64_t) >= h->frameCount;
+    }
+
+    if (!valid) {
+        printf("Trace file %s does not match this simulation!\n", filename);
+        unmapFile();
+        return false;
+    }
+
+    g_replay.frameOffsets = (const uint64_t*) (g_replay.base + h->indexOffset);
+    ByteArr_init(&g_replay.records);
+    g_replay.decodedFrame = -1;
+    g_replay.open = true;
+
+    layout->fixedDt = h->fixedDt;
+    layout->delta = (h->flags & TRACE_FLAG_DELTA) != 0;
+    return true;
+}
+
+const void* trace_readFrame(int frame, const void **globals, uint32_t *count) {
+    assert(g_replay.open && frame >= 0 && frame < (int) g_replay.header.frameCount && "trace frame out of range");
+
+    if (frame != g_replay.decodedFrame) {
+        // Delta frames build on their predecessor, start at the last keyframe
+        int start = frame;
+        if (frame != g_replay.decodedFrame + 1) {
+            const FrameHeader *fh;
+            while (start > 0 && (fh = replayFrameHeader(start)) && fh->encoding != FRAME_RAW) {
+                --start;
+            }
+        }
+
+        for (int f = start; f <= frame; ++f) {
+            if (!decodeFrame(f)) {
+                printf("Trace frame %d is malformed!\n", f);
+                *globals = NULL;
+                *count = 0;
+                g_replay.decodedFrame = -1;
+                return NULL;
+            }
+        }
+    }
+
+    const FrameHeader *fh = replayFrameHeader(frame);
+    *globals = fh + 1;
+    *count = fh->count;
+    return g_replay.records.data;
+}
+
+void trace_closeReplay(void) {
+    if (!g_replay.open) {
+        return;
+    }
+
+    unmapFile();
+    ByteArr_free(&g_replay.records);
+    g_replay.frameOffsets = NULL;
+    g_replay.decodedFrame = -1;
+    g_replay.open = false;
+}
+
+bool trace_isReplaying(void) {
+    return g_replay.open;
+}
+
+int trace_getReplayFrames(void) {
+    return g_replay.open ? (int) g_replay.header.frameCount : 0;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file trace.h
+ * @brief Binary snapshot trace of the simulation state for record and replay
+ *
+ * A trace file starts with a TraceHeader, followed by one frame per fixed
+ * step and a frame offset table at the end. Every frame holds a fixed-size
+ * globals block and count fixed-size element records. With TRACE_FLAG_DELTA
+ * the records are XORed with the previous frame and zero words are run-length
+ * encoded, a raw keyframe is written every TRACE_KEYFRAME_INTERVAL frames
+ * and whenever the element count changes.
+ *
+ * Recording hands filled buffers to a writer thread, replay maps the file
+ * into memory and decodes frames on demand. One trace is recorded and one
+ * replayed at a time, both from the main thread.
+ *
+ * The file is kept identical in all exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <fhwcg/fhwcg.h>
+
+/** File magic and format version */
+#define TRACE_MAGIC "TRC1"
+#define TRACE_VERSION 1
+
+/** Records are delta-compressed against the previous frame */
+#define TRACE_FLAG_DELTA 1u
+
+/** Maximum distance between two raw frames in a delta trace */
+#define TRACE_KEYFRAME_INTERVAL 64
+
+/** Size of one writer buffer, a frame that does not fit grows it */
+#define TRACE_WRITE_BUFFER_SIZE (4 << 20)
+
+/**
+ * Simulation a trace was recorded from.
+ */
+typedef enum {
+    TRACE_BALLS = 1,
+    TRACE_PARTICLES = 2
+} TraceKind;
+
+/**
+ * File header, all fields little endian.
+ */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t kind;
+    uint32_t flags;
+    uint32_t globalsSize;       // bytes of the per-frame globals block
+    uint32_t recordSize;        // bytes of one element record, multiple of 4
+    uint32_t frameCount;
+    float fixedDt;
+    uint64_t indexOffset;       // file offset of the uint64_t frame offsets
+} TraceHeader;
+
+/**
+ * Describes the layout of the frames of a trace.
+ */
+typedef struct {
+    TraceKind kind;
+    uint32_t globalsSize;
+    uint32_t recordSize;
+    float fixedDt;
+    bool delta;
+} TraceLayout;
+
+/**
+ * Starts recording to a file, the previous recording must be stopped.
+ * @param filename Path of the trace file, replaced if it exists.
+ * @param layout Frame layout.
+ * @return False if the file could not be created.
+ */
+bool trace_beginRecord(const char *filename, const TraceLayout *layout);
+
+/**
+ * Appends a frame to the recording. Only copies into the writer buffer,
+ * the file is written on the writer thread.
+ * @param globals Globals block of layout.globalsSize bytes.
+ * @param records count element records of layout.recordSize bytes.
+ * @param count Number of element records.
+ */
+void trace_recordFrame(const void *globals, const void *records, uint32_t count);
+
+/**
+ * Flushes the pending frames, writes the frame table and closes the file.
+ */
+void trace_endRecord(void);
+
+/**
+ * Returns whether a recording is running.
+ * @return True while recording.
+ */
+bool trace_isRecording(void);
+
+/**
+ * Returns the number of frames recorded so far.
+ * @return Frame count of the running or last recording.
+ */
+int trace_getRecordedFrames(void);
+
+/**
+ * Maps a trace file for replay, the previous replay is closed.
+ * @param filename Path of the trace file.
+ * @param layout Expected layout, fixedDt is filled in from the file.
+ * @return False if the file is missing or does not match the layout.
+ */
+bool trace_openReplay(const char *filename, TraceLayout *layout);
+
+/**
+ * Decodes a frame of the replay. Sequential reads decode one frame,
+ * random access decodes from the previous keyframe.
+ * @param frame Frame index, 0 to trace_getReplayFrames() - 1.
+ * @param globals Output: globals block, valid until the next call.
+ * @param count Output: number of element records.
+ * @return The records, valid until the next call.
+ */
+const void* trace_readFrame(int frame, const void **globals, uint32_t *count);
+
+/**
+ * Unmaps the replay file.
+ */
+void trace_closeReplay(void);
+
+/**
+ * Returns whether a replay file is open.
+ * @return True while replaying.
+ */
+bool trace_isReplaying(void);
+
+/**
+ * Returns the number of frames of the open replay.
+ * @return Frame count, 0 without replay.
+ */
+int trace_getReplayFrames(void);
+
+#endif // TRACE_H
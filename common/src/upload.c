@@ -0,0 +1,377 @@
+/**
+ * @file upload.c
+ * @brief Implementation of the upload scheduler
+ *
+ * Jobs live in a fixed array of slots. An id is the slot plus a multiple
+ * of UPLOAD_MAX_JOBS counting the reuses of the slot, so a stale id never
+ * matches a later job in the same slot.
+ *
+ * One update maps the ring region of its frame unsynchronized, the fence
+ * of the region was waited for before, fills it from the best jobs and
+ * then copies each filled range into its destination on the GPU.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "upload.h"
+#include "gpumem.h"
+#include "metrics.h"
+#include "timeline.h"
+
+/** Timeout per fence wait in nanoseconds */
+#define FENCE_TIMEOUT_NS 1000000ULL
+
+/**
+ * One pending upload.
+ */
+typedef struct {
+    UploadDesc desc;
+    size_t copied;
+    long due;           // frame at which the job has to be done
+    long order;         // submission count, breaks ties
+    int id;
+    bool used;
+} Job;
+
+/**
+ * A range of the ring copied into a destination.
+ */
+typedef struct {
+    int slot;
+    size_t ringOffset;
+    size_t destOffset;
+    size_t bytes;
+} Copy;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global scheduler state.
+ */
+static struct {
+    Job jobs[UPLOAD_MAX_JOBS];
+    int pending;
+    long frame;
+    long submitted;
+    size_t budget;
+
+    GLuint ring;
+    size_t regionSize;  // budget the ring was created for
+    GLsync fences[UPLOAD_RING_REGIONS];
+    int region;
+
+    UploadStats stats;
+} g_upload = { .budget = UPLOAD_DEFAULT_BUDGET };
+
+/**
+ * Finds the slot of a pending job.
+ * @param id Job id.
+ * @return The job, NULL if it is no longer pending.
+ */
+static Job* findJob(int id) {
+    if (id < 0) {
+        return NULL;
+    }
+
+    Job *job = &g_upload.jobs[id % UPLOAD_MAX_JOBS];
+    return (job->used && job->id == id) ? job : NULL;
+}
+
+/**
+ * Frees the slot of a job and calls its done callback.
+ * The slot is free before the callback, which may submit again.
+ * @param job The job, all bytes copied.
+ */
+static void completeJob(Job *job) {
+    UploadDoneFn done = job->desc.done;
+    void *userData = job->desc.userData;
+    job->used = false;
+    --g_upload.pending;
+    ++g_upload.stats.jobs;
+
+    if (done) {
+        done(userData);
+    }
+}
+
+/**
+ * Copies the bytes of a job not yet copied straight into its destination.
+ * @param job The job.
+ * @return Number of bytes copied.
+ */
+static size_t copyRemaining(Job *job) {
+    size_t bytes = job->desc.bytes - job->copied;
+    if (bytes > 0) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, job->desc.buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr) (job->desc.offset + job->copied), (GLsizeiptr) bytes,
+            (const char *) job->desc.data + job->copied);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        job->copied = job->desc.bytes;
+    }
+    return bytes;
+}
+
+/**
+ * Blocks until the GPU finished reading the given ring region.
+ * @param region Region index.
+ */
+static void waitRegion(int region) {
+    GLsync fence = g_upload.fences[region];
+    if (!fence) {
+        return;
+    }
+
+    GLenum res;
+    do {
+        res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+    } while (res == GL_TIMEOUT_EXPIRED);
+
+    glDeleteSync(fence);
+    g_upload.fences[region] = NULL;
+}
+
+/**
+ * Waits for all regions and deletes the ring.
+ */
+static void deleteRing(void) {
+    for (int r = 0; r < UPLOAD_RING_REGIONS; ++r) {
+        waitRegion(r);
+    }
+    gpumem_deleteBuffers(1, &g_upload.ring);
+    g_upload.ring = 0;
+    g_upload.regionSize = 0;
+    g_upload.region = 0;
+}
+
+/**
+ * Creates the ring for the current budget if it was made for another one.
+ */
+static void updateRing(void) {
+    if (g_upload.ring && g_upload.regionSize == g_upload.budget) {
+        return;
+    }
+
+    deleteRing();
+    size_t size = g_upload.budget * UPLOAD_RING_REGIONS;
+    glGenBuffers(1, &g_upload.ring);
+    glBindBuffer(GL_COPY_READ_BUFFER, g_upload.ring);
+    glBufferData(GL_COPY_READ_BUFFER, (GLsizeiptr) size, NULL, GL_STREAM_COPY);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    gpumem_setBuffer(GPUMEM_STAGING, g_upload.ring, size);
+    g_upload.regionSize = g_upload.budget;
+}
+
+/**
+ * Picks the job served next: the highest priority, then the nearest
+ * deadline, then the oldest.
+ * @return The job, NULL if no job waits for bytes.
+ */
+static Job* nextJob(void) {
+    Job *best = NULL;
+    for (int i = 0; i < UPLOAD_MAX_JOBS; ++i) {
+        Job *job = &g_upload.jobs[i];
+        if (!job->used || job->copied == job->desc.bytes) {
+            continue;
+        }
+        if (!best || job->desc.priority > best->desc.priority
+            || (job->desc.priority == best->desc.priority
+                && (job->due < best->due || (job->due == best->due && job->order < best->order)))) {
+            best = job;
+        }
+    }
+    return best;
+}
+
+/**
+ * Fills the ring region of this frame from the best jobs and copies
+ * the filled ranges into their destinations.
+ * @return Number of bytes copied.
+ */
+static size_t copyBudget(void) {
+    updateRing();
+    int region = g_upload.region;
+    g_upload.region = (region + 1) % UPLOAD_RING_REGIONS;
+    waitRegion(region);
+
+    Copy copies[UPLOAD_MAX_JOBS];
+    int copyCount = 0;
+    size_t used = 0;
+    size_t base = (size_t) region * g_upload.regionSize;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, g_upload.ring);
+    char *dst = glMapBufferRange(GL_COPY_READ_BUFFER, (GLintptr) base, (GLsizeiptr) g_upload.regionSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!dst) {
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        return 0;
+    }
+
+    Job *job;
+    while (used < g_upload.regionSize && copyCount < UPLOAD_MAX_JOBS && (job = nextJob())) {
+        size_t bytes = job->desc.bytes - job->copied;
+        if (bytes > g_upload.regionSize - used) {
+            bytes = g_upload.regionSize - used;
+        }
+
+        memcpy(dst + used, (const char *) job->desc.data + job->copied, bytes);
+        copies[copyCount++] = (Copy) {
+            .slot = (int) (job - g_upload.jobs),
+            .ringOffset = base + used,
+            .destOffset = job->desc.offset + job->copied,
+            .bytes = bytes
+        };
+        job->copied += bytes;
+        used += bytes;
+    }
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+    for (int i = 0; i < copyCount; ++i) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, g_upload.jobs[copies[i].slot].desc.buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+            (GLintptr) copies[i].ringOffset, (GLintptr) copies[i].destOffset, (GLsizeiptr) copies[i].bytes);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    if (copyCount > 0) {
+        g_upload.fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    return used;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void upload_init(void) {
+    memset(g_upload.jobs, 0, sizeof(g_upload.jobs));
+    memset(&g_upload.stats, 0, sizeof(g_upload.stats));
+    g_upload.pending = 0;
+    g_upload.frame = 0;
+    g_upload.submitted = 0;
+}
+
+void upload_cleanup(void) {
+    for (int i = 0; i < UPLOAD_MAX_JOBS; ++i) {
+        if (g_upload.jobs[i].used) {
+            upload_finish(g_upload.jobs[i].id);
+        }
+    }
+    deleteRing();
+}
+
+int upload_submit(const UploadDesc *desc) {
+    assert(desc->buffer && "Upload without destination");
+
+    int slot = -1;
+    for (int i = 0; i < UPLOAD_MAX_JOBS && slot < 0; ++i) {
+        if (!g_upload.jobs[i].used) {
+            slot = i;
+        }
+    }
+
+    // No free slot: done at once, like an overdue job
+    if (slot < 0) {
+        Job overflow = { .desc = *desc };
+        metrics_count(METRIC_UPLOAD_BYTES, (long) copyRemaining(&overflow));
+        ++g_upload.stats.forced;
+        ++g_upload.stats.jobs;
+        if (desc->done) {
+            desc->done(desc->userData);
+        }
+        return UPLOAD_NONE;
+    }
+
+    Job *job = &g_upload.jobs[slot];
+    job->desc = *desc;
+    job->copied = 0;
+    job->due = g_upload.frame + 1 + (desc->deadline > 0 ? desc->deadline : 0);
+    job->order = g_upload.submitted++;
+
+    // Count the reuses of the slot, wrapped so ids stay positive
+    int reuse = (job->id / UPLOAD_MAX_JOBS + 1) % (1 << 24);
+    job->id = reuse * UPLOAD_MAX_JOBS + slot;
+    job->used = true;
+    ++g_upload.pending;
+    return job->id;
+}
+
+void upload_cancel(int id) {
+    Job *job = findJob(id);
+    if (job) {
+        job->used = false;
+        --g_upload.pending;
+    }
+}
+
+void upload_finish(int id) {
+    Job *job = findJob(id);
+    if (job) {
+        metrics_count(METRIC_UPLOAD_BYTES, (long) copyRemaining(job));
+        completeJob(job);
+    }
+}
+
+bool upload_isPending(int id) {
+    return findJob(id) != NULL;
+}
+
+void upload_update(void) {
+    ++g_upload.frame;
+    g_upload.stats.lastFrameBytes = 0;
+    if (g_upload.pending == 0) {
+        return;
+    }
+
+    TIMELINE_BEGIN("Uploads");
+    size_t bytes = 0;
+
+    // Overdue jobs and everything without a budget go straight into the destination
+    for (int i = 0; i < UPLOAD_MAX_JOBS; ++i) {
+        Job *job = &g_upload.jobs[i];
+        if (job->used && (job->due <= g_upload.frame || g_upload.budget == 0)) {
+            size_t copied = copyRemaining(job);
+            if (copied > 0 && g_upload.budget > 0) {
+                ++g_upload.stats.forced;
+            }
+            bytes += copied;
+        }
+    }
+
+    if (g_upload.budget > 0) {
+        bytes += copyBudget();
+    }
+
+    // Callbacks last, they may submit into the freed slots
+    for (int i = 0; i < UPLOAD_MAX_JOBS; ++i) {
+        Job *job = &g_upload.jobs[i];
+        if (job->used && job->copied == job->desc.bytes) {
+            completeJob(job);
+        }
+    }
+
+    metrics_count(METRIC_UPLOAD_BYTES, (long) bytes);
+    g_upload.stats.lastFrameBytes = bytes;
+    if (bytes > g_upload.stats.peakFrameBytes) {
+        g_upload.stats.peakFrameBytes = bytes;
+    }
+    TIMELINE_END();
+}
+
+void upload_setBudget(size_t bytes) {
+    g_upload.budget = bytes;
+}
+
+int upload_getPendingCount(void) {
+    return g_upload.pending;
+}
+
+void upload_getStats(UploadStats *stats) {
+    *stats = g_upload.stats;
+    stats->pending = g_upload.pending;
+    stats->budget = g_upload.budget;
+    stats->pendingBytes = 0;
+    for (int i = 0; i < UPLOAD_MAX_JOBS; ++i) {
+        if (g_upload.jobs[i].used) {
+            stats->pendingBytes += g_upload.jobs[i].desc.bytes - g_upload.jobs[i].copied;
+        }
+    }
+}
@@ -0,0 +1,135 @@
+/**
+ * @file upload.h
+ * @brief Buffer uploads spread over frames under a byte budget
+ *
+ * Large uploads arrive in bursts, e.g. a rebuilt surface, and would spike
+ * a single frame. Modules submit them as jobs instead, upload_update then
+ * copies at most the budget per frame into a staging ring and from there
+ * into the destination buffers. Jobs are served by priority, a job that
+ * reached its deadline is finished at once regardless of the budget.
+ *
+ * The destination should not be drawn while its job is pending, the owner
+ * keeps drawing the old buffer and swaps in the new one from the done
+ * callback. The source data is read until the job is done.
+ *
+ * The ring has UPLOAD_RING_REGIONS regions of the budget, one per frame,
+ * and a region is only rewritten once the fence of its last frame passed.
+ * A budget of 0 uploads every job in the next update without the ring.
+ *
+ * All functions must be called from the thread owning the GL context.
+ * The file is kept identical in all exercises.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Jobs pending at the same time, a further job is uploaded at once */
+#define UPLOAD_MAX_JOBS 32
+
+/** Frames the staging ring spans */
+#define UPLOAD_RING_REGIONS 3
+
+/** Default bytes copied per frame */
+#define UPLOAD_DEFAULT_BUDGET (4 << 20)
+
+/** Marks "no job" */
+#define UPLOAD_NONE (-1)
+
+/**
+ * Called once all bytes of a job were copied, later GL commands see them.
+ */
+typedef void (*UploadDoneFn)(void *userData);
+
+/**
+ * One buffer upload.
+ */
+typedef struct {
+    GLuint buffer;          // destination
+    size_t offset;          // in the destination
+    const void *data;       // read until the job is done
+    size_t bytes;
+    int priority;           // higher first
+    int deadline;           // updates until the job has to be done, 0 for the next one
+    UploadDoneFn done;      // may be NULL
+    void *userData;
+} UploadDesc;
+
+/**
+ * Upload counters.
+ */
+typedef struct {
+    int pending;            // jobs
+    size_t pendingBytes;
+    size_t lastFrameBytes;  // copied by the last update, deadlines included
+    size_t peakFrameBytes;
+    size_t budget;
+    long jobs;              // done since init
+    long forced;            // finished by their deadline over the budget
+} UploadStats;
+
+/**
+ * Prepares the scheduler, the ring is created on the first update.
+ */
+void upload_init(void);
+
+/**
+ * Finishes all pending jobs and deletes the ring.
+ */
+void upload_cleanup(void);
+
+/**
+ * Queues an upload. With all job slots taken it is uploaded and done at once.
+ * @param desc The upload, copied.
+ * @return Id of the job, UPLOAD_NONE if it is already done.
+ */
+int upload_submit(const UploadDesc *desc);
+
+/**
+ * Drops a pending job without calling its done callback, e.g. once its
+ * data is superseded. Bytes already copied stay in the destination.
+ * @param id Job id, ignored if the job is no longer pending.
+ */
+void upload_cancel(int id);
+
+/**
+ * Finishes a pending job at once, e.g. before its destination is written
+ * otherwise. Calls its done callback.
+ * @param id Job id, ignored if the job is no longer pending.
+ */
+void upload_finish(int id);
+
+/**
+ * Checks whether a job still waits for bytes.
+ * @param id Job id.
+ * @return True until its done callback was called.
+ */
+bool upload_isPending(int id);
+
+/**
+ * Copies up to the budget of the pending jobs. Call once per frame.
+ */
+void upload_update(void);
+
+/**
+ * Sets the bytes copied per frame, the ring is resized on the next update.
+ * @param bytes Budget, 0 for unlimited.
+ */
+void upload_setBudget(size_t bytes);
+
+/**
+ * Returns the number of pending jobs.
+ * @return Job count.
+ */
+int upload_getPendingCount(void);
+
+/**
+ * Gets the upload counters.
+ * @param stats Destination.
+ */
+void upload_getStats(UploadStats *stats);
+
+#endif // UPLOAD_H
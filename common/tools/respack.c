@@ -0,0 +1,570 @@
+/**
+ * @file respack.c
+ * @brief Build step packing the resources of an exercise into one archive
+ *
+ * Usage: respack <manifest> <archive>
+ *
+ * Every line of the manifest names one file as "<name>\t<path>[\t<flags>]",
+ * written by common.cmake. The name is the path the program opens, the
+ * path where the file lies at build time. The only flag is "cubemap".
+ *
+ * Shader sources get their #include lines replaced by the included text,
+ * recursively and relative to the including file like stb_include, with
+ * #line directives keeping the line numbers of compile errors. The files
+ * they were resolved from are listed as dependencies of the entry.
+ *
+ * Images are decoded to RGBA8. 2D textures are flipped like texcache does
+ * and get every mipmap level, box filtered on the CPU. Cubemap faces keep
+ * their top left origin and only have level 0, like the skybox loads them.
+ * No compressed formats are written, compressing needs the GL.
+ *
+ * See resarchive.h for the layout. The archive is written to a temporary
+ * file first, so a failed run leaves the previous archive.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "resarchive.h"
+
+#include <ctype.h>
+#include <sys/stat.h>
+
+/** Upper bound of a manifest line and of a path */
+#define MAX_LINE_LENGTH 1024
+
+/** Upper bound of nested #include lines */
+#define MAX_INCLUDE_DEPTH 16
+
+/** Upper bound of files included by one shader */
+#define MAX_DEPENDENCIES 32
+
+/**
+ * Growing byte buffer.
+ */
+typedef struct {
+    unsigned char *data;
+    size_t size, capacity;
+} Buffer;
+
+/**
+ * A file included by a shader.
+ */
+typedef struct {
+    char name[MAX_LINE_LENGTH];
+    int64_t mtime;
+} Dependency;
+
+/**
+ * One file of the manifest with its packed payload.
+ */
+typedef struct {
+    char name[MAX_LINE_LENGTH];
+    char path[MAX_LINE_LENGTH];
+    bool cubemap;
+    ResKind kind;
+    int64_t mtime;
+    Buffer payload;
+    Dependency deps[MAX_DEPENDENCIES];
+    int depCount;
+    uint64_t hash;
+} Item;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Appends bytes to a buffer.
+ * @param b The buffer.
+ * @param data Bytes to append, NULL appends zeros.
+ * @param size Number of bytes.
+ */
+static void append(Buffer *b, const void *data, size_t size) {
+    if (b->size + size > b->capacity) {
+        size_t capacity = b->capacity ? b->capacity : 4096;
+        while (capacity < b->size + size) {
+            capacity *= 2;
+        }
+        unsigned char *grown = realloc(b->data, capacity);
+        if (!grown) {
+            fprintf(stderr, "respack: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        b->data = grown;
+        b->capacity = capacity;
+    }
+
+    if (data) {
+        memcpy(b->data + b->size, data, size);
+    } else {
+        memset(b->data + b->size, 0, size);
+    }
+    b->size += size;
+}
+
+/**
+ * Appends a string to a buffer, without its NUL.
+ * @param b The buffer.
+ * @param text The string.
+ */
+static void appendText(Buffer *b, const char *text) {
+    append(b, text, strlen(text));
+}
+
+/**
+ * Pads a buffer with zeros to the archive alignment.
+ * @param b The buffer.
+ */
+static void alignBuffer(Buffer *b) {
+    size_t padded = (b->size + RESARCHIVE_ALIGNMENT - 1) / RESARCHIVE_ALIGNMENT * RESARCHIVE_ALIGNMENT;
+    append(b, NULL, padded - b->size);
+}
+
+/**
+ * Returns the modification time of a file.
+ * @param path Path of the file.
+ * @return The time, 0 if the file does not exist.
+ */
+static int64_t fileTime(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (int64_t) st.st_mtime : 0;
+}
+
+/**
+ * Reads a whole file into a buffer.
+ * @param path Path of the file.
+ * @param b Destination, the contents are appended.
+ * @return False if the file could not be read.
+ */
+static bool readFile(const char *path, Buffer *b) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+
+    unsigned char chunk[65536];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        append(b, chunk, read);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+/**
+ * Checks the extension of a path, ignoring case.
+ * @param path The path.
+ * @param list Extensions with their dot, NULL terminated.
+ * @return True if the path ends in one of them.
+ */
+static bool hasExtension(const char *path, const char *const *list) {
+    const char *dot = strrchr(path, '.');
+    if (!dot) {
+        return false;
+    }
+    for (int i = 0; list[i]; ++i) {
+        const char *a = dot, *b = list[i];
+        while (*a && *b && tolower((unsigned char) *a) == *b) {
+            ++a;
+            ++b;
+        }
+        if (!*a && !*b) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns the length of the directory part of a path.
+ * @param path The path.
+ * @return Length including the last separator, 0 without one.
+ */
+static int dirLength(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *backslash = strrchr(path, '\\');
+    if (backslash > slash) {
+        slash = backslash;
+    }
+    return slash ? (int) (slash - path + 1) : 0;
+}
+
+/**
+ * Adds an included file to the dependencies of a shader, once.
+ * @param item The shader.
+ * @param name Name of the file as the program would open it.
+ * @param path Path of the file at build time.
+ */
+static void addDependency(Item *item, const char *name, const char *path) {
+    for (int i = 0; i < item->depCount; ++i) {
+        if (strcmp(item->deps[i].name, name) == 0) {
+            return;
+        }
+    }
+    if (item->depCount < MAX_DEPENDENCIES) {
+        Dependency *d = &item->deps[item->depCount++];
+        snprintf(d->name, sizeof(d->name), "%s", name);
+        d->mtime = fileTime(path);
+    }
+}
+
+/**
+ * Appends a shader source with its #include lines resolved.
+ * @param item The shader, collects the included files.
+ * @param name Name of the source as the program would open it.
+ * @param path Path of the source at build time.
+ * @param out Destination of the text.
+ * @param depth Nesting depth of the source.
+ * @return False if the source or an included file could not be read.
+ */
+static bool resolveShader(Item *item, const char *name, const char *path, Buffer *out, int depth) {
+    if (depth > MAX_INCLUDE_DEPTH) {
+        fprintf(stderr, "respack: includes nested too deep in %s\n", path);
+        return false;
+    }
+
+    Buffer text = { 0 };
+    if (!readFile(path, &text)) {
+        fprintf(stderr, "respack: cannot read %s\n", path);
+        return false;
+    }
+    append(&text, "", 1);
+
+    bool ok = true;
+    int lineNumber = 0;
+    char *line = (char*) text.data;
+    while (ok && *line) {
+        char *eol = strchr(line, '\n');
+        char *next = eol ? eol + 1 : line + strlen(line);
+        ++lineNumber;
+
+        const char *p = line;
+        while (*p == ' ' || *p == '\t') ++p;
+        const char *open = strncmp(p, "#include", 8) == 0 ? strchr(p, '"') : NULL;
+        const char *close = open && open < next ? strchr(open + 1, '"') : NULL;
+
+        if (close && close < next) {
+            char includeName[MAX_LINE_LENGTH], includePath[MAX_LINE_LENGTH];
+            int length = (int) (close - open - 1);
+            snprintf(includeName, sizeof(includeName), "%.*s%.*s", dirLength(name), name, length, open + 1);
+            snprintf(includePath, sizeof(includePath), "%.*s%.*s", dirLength(path), path, length, open + 1);
+            addDependency(item, includeName, includePath);
+
+            char directive[32];
+            appendText(out, "#line 1\n");
+            ok = resolveShader(item, includeName, includePath, out, depth + 1);
+            snprintf(directive, sizeof(directive), "\n#line %d\n", lineNumber + 1);
+            appendText(out, directive);
+        } else {
+            append(out, line, (size_t) (next - line));
+        }
+        line = next;
+    }
+
+    free(text.data);
+    return ok;
+}
+
+/**
+ * Halves an RGBA8 level with a box filter, odd edges are clamped.
+ * @param src The level.
+ * @param width Width of the level.
+ * @param height Height of the level.
+ * @param dst Destination of max(width / 2, 1) * max(height / 2, 1) pixels.
+ */
+static void downsample(const unsigned char *src, int width, int height, unsigned char *dst) {
+    int w = width > 1 ? width / 2 : 1;
+    int h = height > 1 ? height / 2 : 1;
+
+    for (int y = 0; y < h; ++y) {
+        int y0 = glm_imin(2 * y, height - 1), y1 = glm_imin(2 * y + 1, height - 1);
+        for (int x = 0; x < w; ++x) {
+            int x0 = glm_imin(2 * x, width - 1), x1 = glm_imin(2 * x + 1, width - 1);
+            for (int c = 0; c < 4; ++c) {
+                int sum = src[((size_t) y0 * width + x0) * 4 + c] + src[((size_t) y0 * width + x1) * 4 + c]
+                        + src[((size_t) y1 * width + x0) * 4 + c] + src[((size_t) y1 * width + x1) * 4 + c];
+                dst[((size_t) y * w + x) * 4 + c] = (unsigned char) ((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+/**
+ * Decodes an image into a texture payload.
+ * @param item The image.
+ * @return False if it could not be decoded.
+ */
+static bool packTexture(Item *item) {
+    int width, height, channels;
+    stbi_set_flip_vertically_on_load(item->cubemap ? 0 : 1);
+    unsigned char *pixels = stbi_load(item->path, &width, &height, &channels, 4);
+    if (!pixels) {
+        fprintf(stderr, "respack: cannot decode %s\n", item->path);
+        return false;
+    }
+
+    ResArchiveTexture header = { 0 };
+    header.flags = item->cubemap ? 0 : RESARCHIVE_TEX_FLIPPED;
+    append(&item->payload, NULL, sizeof(header));
+
+    unsigned char *level = pixels;
+    for (int i = 0; i < RESARCHIVE_MAX_LEVELS; ++i) {
+        uint32_t size = (uint32_t) width * height * 4;
+        header.levels[i] = (ResArchiveLevel) {
+            .width = width, .height = height, .size = size, .offset = (uint32_t) item->payload.size
+        };
+        append(&item->payload, level, size);
+        header.levelCount = i + 1;
+
+        if (item->cubemap || (width == 1 && height == 1)) {
+            break;
+        }
+
+        int w = width > 1 ? width / 2 : 1, h = height > 1 ? height / 2 : 1;
+        unsigned char *next = malloc((size_t) w * h * 4);
+        if (!next) {
+            fprintf(stderr, "respack: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        downsample(level, width, height, next);
+
+        if (level != pixels) {
+            free(level);
+        }
+        level = next;
+        width = w;
+        height = h;
+    }
+
+    if (level != pixels) {
+        free(level);
+    }
+    stbi_image_free(pixels);
+    memcpy(item->payload.data, &header, sizeof(header));
+    return true;
+}
+
+/**
+ * Builds the payload of a manifest file.
+ * @param item The file, name and path are set.
+ * @return False if it could not be read.
+ */
+static bool packItem(Item *item) {
+    static const char *const shaderExt[] = { ".vert", ".frag", ".geom", ".comp", ".tesc", ".tese", ".glsl", NULL };
+    static const char *const imageExt[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp", NULL };
+
+    item->hash = resarchive_hash(item->name);
+    item->mtime = fileTime(item->path);
+
+    if (hasExtension(item->path, shaderExt)) {
+        item->kind = RES_SHADER;
+        return resolveShader(item, item->name, item->path, &item->payload, 0);
+    }
+    if (hasExtension(item->path, imageExt)) {
+        item->kind = RES_TEXTURE;
+        return packTexture(item);
+    }
+
+    item->kind = RES_RAW;
+    if (!readFile(item->path, &item->payload)) {
+        fprintf(stderr, "respack: cannot read %s\n", item->path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Orders items by the hash of their name, then by the name.
+ */
+static int compareItems(const void *a, const void *b) {
+    const Item *x = a, *y = b;
+    if (x->hash != y->hash) {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+/**
+ * Reads the manifest.
+ * @param path Path of the manifest.
+ * @param count Output for the number of items.
+ * @return The items, NULL if the manifest could not be read.
+ */
+static Item* readManifest(const char *path, int *count) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "respack: cannot read manifest %s\n", path);
+        return NULL;
+    }
+
+    Item *items = NULL;
+    int capacity = 0;
+    *count = 0;
+
+    char line[3 * MAX_LINE_LENGTH];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *path = strchr(line, '\t');
+        if (!path) {
+            continue;
+        }
+        *path++ = '\0';
+        char *flags = strchr(path, '\t');
+        if (flags) {
+            *flags++ = '\0';
+        }
+
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            Item *grown = realloc(items, capacity * sizeof(Item));
+            if (!grown) {
+                fprintf(stderr, "respack: out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+            items = grown;
+        }
+
+        if (strlen(line) >= MAX_LINE_LENGTH || strlen(path) >= MAX_LINE_LENGTH) {
+            fprintf(stderr, "respack: path too long in manifest: %s\n", path);
+            continue;
+        }
+
+        Item *item = &items[(*count)++];
+        memset(item, 0, sizeof(Item));
+        memcpy(item->name, line, strlen(line) + 1);
+        memcpy(item->path, path, strlen(path) + 1);
+        item->cubemap = flags && strstr(flags, "cubemap") != NULL;
+    }
+
+    fclose(f);
+    return items;
+}
+
+/**
+ * Lays out and writes the archive.
+ * @param path Path of the archive.
+ * @param items The packed items, sorted.
+ * @param count Number of items.
+ * @return False if the file could not be written.
+ */
+static bool writeArchive(const char *path, Item *items, int count) {
+    Buffer strings = { 0 };
+    Buffer deps = { 0 };
+    ResArchiveEntry *entries = calloc(count ? count : 1, sizeof(ResArchiveEntry));
+    if (!entries) {
+        fprintf(stderr, "respack: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Payloads start behind the table
+    size_t tableSize = sizeof(ResArchiveHeader) + (size_t) count * sizeof(ResArchiveEntry);
+    uint64_t offset = (tableSize + RESARCHIVE_ALIGNMENT - 1) / RESARCHIVE_ALIGNMENT * RESARCHIVE_ALIGNMENT;
+    size_t tablePad = (size_t) offset - tableSize;
+    uint32_t depCount = 0;
+
+    for (int i = 0; i < count; ++i) {
+        Item *item = &items[i];
+        ResArchiveEntry *e = &entries[i];
+        e->hash = item->hash;
+        e->offset = offset;
+        e->size = item->payload.size;
+        e->mtime = item->mtime;
+        e->kind = item->kind;
+        e->name = (uint32_t) strings.size;
+        append(&strings, item->name, strlen(item->name) + 1);
+
+        e->firstDependency = depCount;
+        e->dependencyCount = (uint32_t) item->depCount;
+        for (int d = 0; d < item->depCount; ++d) {
+            ResArchiveDependency dep = { .name = (uint32_t) strings.size, .mtime = item->deps[d].mtime };
+            append(&strings, item->deps[d].name, strlen(item->deps[d].name) + 1);
+            append(&deps, &dep, sizeof(dep));
+            ++depCount;
+        }
+
+        // Shader text is NUL terminated behind its size
+        if (item->kind == RES_SHADER) {
+            append(&item->payload, "", 1);
+        }
+        alignBuffer(&item->payload);
+        offset += item->payload.size;
+    }
+
+    ResArchiveHeader header = {
+        .magic = RESARCHIVE_MAGIC,
+        .version = RESARCHIVE_VERSION,
+        .entryCount = (uint32_t) count,
+        .dependencyCount = depCount,
+        .dependencyOffset = offset,
+        .stringOffset = offset + deps.size,
+        .stringSize = strings.size
+    };
+
+    char tmpPath[MAX_LINE_LENGTH + 8];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    FILE *f = fopen(tmpPath, "wb");
+    if (!f) {
+        fprintf(stderr, "respack: cannot write %s\n", tmpPath);
+        return false;
+    }
+
+    static const unsigned char zeros[RESARCHIVE_ALIGNMENT] = { 0 };
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(entries, sizeof(ResArchiveEntry), count, f) == (size_t) count
+        && fwrite(zeros, 1, tablePad, f) == tablePad;
+    for (int i = 0; ok && i < count; ++i) {
+        ok = fwrite(items[i].payload.data, 1, items[i].payload.size, f) == items[i].payload.size;
+    }
+    ok = ok && fwrite(deps.data, 1, deps.size, f) == deps.size
+            && fwrite(strings.data, 1, strings.size, f) == strings.size;
+    ok = fclose(f) == 0 && ok;
+
+    free(entries);
+    free(deps.data);
+    free(strings.data);
+
+    // rename does not replace an existing file on Windows
+    remove(path);
+    if (!ok || rename(tmpPath, path) != 0) {
+        fprintf(stderr, "respack: cannot write %s\n", path);
+        remove(tmpPath);
+        return false;
+    }
+    return true;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: respack <manifest> <archive>\n");
+        return EXIT_FAILURE;
+    }
+
+    int count = -1;
+    Item *items = readManifest(argv[1], &count);
+    if (!items && count < 0) {
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    size_t bytes = 0;
+    for (int i = 0; i < count && ok; ++i) {
+        ok = packItem(&items[i]);
+        bytes += items[i].payload.size;
+    }
+
+    if (ok) {
+        qsort(items, count, sizeof(Item), compareItems);
+        ok = writeArchive(argv[2], items, count);
+    }
+    if (ok) {
+        printf("respack: %d files, %zu bytes packed into %s\n", count, bytes, argv[2]);
+    }
+
+    for (int i = 0; i < count; ++i) {
+        free(items[i].payload.data);
+    }
+    free(items);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,231 @@
+/**
+ * @file mathbench.c
+ * @brief Benchmarks of the curve kernels of utils.c
+ *
+ * Every kernel cycles through MICROBENCH_INPUTS prepared inputs, so one
+ * batch does not evaluate the same point over and over. The curve
+ * evaluations are timed with cached coefficients, as the game calls them,
+ * and with the coefficients rebuilt on every call. Uniform sampling of a
+ * whole curve is timed per vertex and with the batch sampler.
+ *
+ * Usage: cg2_ueb01_mathbench [-s samples] [-w warmup] [-f filter]
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include <fhwcg/fhwcg.h>
+#include "utils.h"
+#include "curvesample.h"
+#include "microbench.h"
+
+/** Control points of the benchmarked spline */
+#define SPLINE_POINTS 16
+
+/** Points of one convex hull */
+#define HULL_POINTS 64
+
+/** Vertices of one normal calculation */
+#define NORMAL_VERTICES 256
+
+/** Uniform vertices of one curve sampling */
+#define SAMPLE_VERTICES 1001
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Inputs of the curve kernels.
+ */
+typedef struct {
+    vec2 ctrl[SPLINE_POINTS];
+    float t[MICROBENCH_INPUTS];
+    bool rebuild;               // recalculate the coefficients on every call
+} CurveInput;
+
+/**
+ * Inputs of the uniform curve sampling, the spline of CurveInput.
+ */
+typedef struct {
+    vec2 *ctrl;
+    bool simd;
+    vec2 vertices[SAMPLE_VERTICES];
+    vec2 tangents[SAMPLE_VERTICES];
+    vec3 normals[SAMPLE_VERTICES];
+} SampleInput;
+
+/**
+ * Inputs of the convex hull, the points are sorted in place by the kernel.
+ */
+typedef struct {
+    vec2 source[HULL_POINTS];
+    vec2 points[HULL_POINTS];
+    vec2 hull[HULL_POINTS + 1];
+} HullInput;
+
+/**
+ * Inputs of the normal calculation.
+ */
+typedef struct {
+    vec2 tangents[NORMAL_VERTICES];
+    vec3 normals[NORMAL_VERTICES];
+} NormalInput;
+
+/**
+ * Evaluates the spline.
+ * @param ctx CurveInput.
+ * @param iterations Evaluations.
+ */
+static void benchSpline(void *ctx, int iterations) {
+    CurveInput *in = ctx;
+    bool update = true;
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        vec2 pos, tangent;
+        update |= in->rebuild;
+        utils_evalSpline(in->ctrl, SPLINE_POINTS, in->t[i & (MICROBENCH_INPUTS - 1)], pos, tangent, &update);
+        sum += pos[0] + tangent[1];
+    }
+    microbench_consume(sum);
+}
+
+/**
+ * Evaluates the Bezier curve of the first four control points.
+ * @param ctx CurveInput.
+ * @param iterations Evaluations.
+ */
+static void benchBezier(void *ctx, int iterations) {
+    CurveInput *in = ctx;
+    bool update = true;
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        vec2 pos, tangent;
+        update |= in->rebuild;
+        utils_evalBezier(in->ctrl, 4, in->t[i & (MICROBENCH_INPUTS - 1)], pos, tangent, &update);
+        sum += pos[0] + tangent[1];
+    }
+    microbench_consume(sum);
+}
+
+/**
+ * Samples the spline at uniform steps one utils_evalSpline call per
+ * vertex and calculates the normals, as the batch sampler replaces it.
+ * @param ctx SampleInput.
+ * @param iterations Curves, each of SAMPLE_VERTICES vertices.
+ */
+static void benchSamplePerVertex(void *ctx, int iterations) {
+    SampleInput *in = ctx;
+    float step = 1.0f / (SAMPLE_VERTICES - 1);
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        for (int k = 0; k < SAMPLE_VERTICES; ++k) {
+            float T = (k == SAMPLE_VERTICES - 1) ? 1.0f : k * step;
+            utils_evalSpline(in->ctrl, SPLINE_POINTS, T, in->vertices[k], in->tangents[k], NULL);
+        }
+        utils_calcNormals(in->tangents, in->normals, SAMPLE_VERTICES);
+        sum += in->vertices[i % SAMPLE_VERTICES][0] + in->normals[i % SAMPLE_VERTICES][1];
+    }
+    microbench_consume(sum);
+}
+
+/**
+ * Samples the spline at uniform steps with the batch sampler.
+ * @param ctx SampleInput.
+ * @param iterations Curves, each of SAMPLE_VERTICES vertices.
+ */
+static void benchSampleBatch(void *ctx, int iterations) {
+    SampleInput *in = ctx;
+    int numSegments;
+    const float *coeffs = utils_getSegments(&numSegments);
+    float step = 1.0f / (SAMPLE_VERTICES - 1);
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        curvesample_uniform(in->simd, coeffs, numSegments, step, SAMPLE_VERTICES,
+                            0, SAMPLE_VERTICES - 1, in->vertices, in->normals);
+        sum += in->vertices[i % SAMPLE_VERTICES][0] + in->normals[i % SAMPLE_VERTICES][1];
+    }
+    microbench_consume(sum);
+}
+
+/**
+ * Builds the convex hull of a fresh copy of the points, the copy is timed as well.
+ * @param ctx HullInput.
+ * @param iterations Hulls.
+ */
+static void benchConvexHull(void *ctx, int iterations) {
+    HullInput *in = ctx;
+    int sum = 0;
+    for (int i = 0; i < iterations; ++i) {
+        memcpy(in->points, in->source, sizeof(in->points));
+        sum += utils_convexHullVec2(in->points, in->hull, HULL_POINTS);
+    }
+    microbench_consume((float) sum);
+}
+
+/**
+ * Calculates the normals of all vertices.
+ * @param ctx NormalInput.
+ * @param iterations Calls, each over NORMAL_VERTICES vertices.
+ */
+static void benchNormals(void *ctx, int iterations) {
+    NormalInput *in = ctx;
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        utils_calcNormals(in->tangents, in->normals, NORMAL_VERTICES);
+        sum += in->normals[i & (NORMAL_VERTICES - 1)][0];
+    }
+    microbench_consume(sum);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+int main(int argc, char **argv) {
+    MicroBenchConfig cfg;
+    if (!microbench_parseArgs(PROGRAM_NAME, argc, argv, &cfg)) {
+        return EXIT_FAILURE;
+    }
+
+    CurveInput curve = { 0 };
+    for (int i = 0; i < SPLINE_POINTS; ++i) {
+        curve.ctrl[i][0] = (float) i / (SPLINE_POINTS - 1);
+        curve.ctrl[i][1] = microbench_random();
+    }
+    for (int i = 0; i < MICROBENCH_INPUTS; ++i) {
+        curve.t[i] = microbench_random();
+    }
+
+    HullInput hull;
+    for (int i = 0; i < HULL_POINTS; ++i) {
+        hull.source[i][0] = microbench_random();
+        hull.source[i][1] = microbench_random();
+    }
+
+    NormalInput normals;
+    for (int i = 0; i < NORMAL_VERTICES; ++i) {
+        float angle = GLM_PIf * 2.0f * i / NORMAL_VERTICES;
+        normals.tangents[i][0] = cosf(angle);
+        normals.tangents[i][1] = sinf(angle);
+    }
+
+    curve.rebuild = false;
+    microbench_run(&cfg, "evalSpline", benchSpline, &curve);
+    microbench_run(&cfg, "evalBezier", benchBezier, &curve);
+    curve.rebuild = true;
+    microbench_run(&cfg, "evalSpline rebuild", benchSpline, &curve);
+    microbench_run(&cfg, "evalBezier rebuild", benchBezier, &curve);
+
+    // The samplers use the cached spline coefficients
+    static SampleInput sample;
+    sample.ctrl = curve.ctrl;
+    bool update = true;
+    vec2 p;
+    utils_evalSpline(curve.ctrl, SPLINE_POINTS, 0.0f, p, NULL, &update);
+    microbench_run(&cfg, "sample per vertex (1001 vertices)", benchSamplePerVertex, &sample);
+    microbench_run(&cfg, "sample batch scalar (1001 vertices)", benchSampleBatch, &sample);
+    if (curvesample_isSimdSupported()) {
+        sample.simd = true;
+        microbench_run(&cfg, "sample batch avx (1001 vertices)", benchSampleBatch, &sample);
+    }
+
+    microbench_run(&cfg, "convexHullVec2 (64 points)", benchConvexHull, &hull);
+    microbench_run(&cfg, "calcNormals (256 vertices)", benchNormals, &normals);
+    return microbench_finish(&cfg);
+}
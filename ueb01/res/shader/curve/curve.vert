@@ -0,0 +1,49 @@
+#version 430
+
+// Must match CURVE_MAX_SEGMENTS in utils.h
+#define MAX_SEGMENTS 17
+
+/** Power form coefficients (a, b, c, d) of every segment, x then y */
+layout(std140, binding = 0) uniform CurveSegments {
+    vec4 u_segments[2 * MAX_SEGMENTS];
+};
+
+uniform int u_numSegments;
+uniform int u_numVertices;
+uniform float u_step;               // parameter distance of two vertices
+
+uniform mat4 u_mvpMatrix;
+uniform mat4 u_modelViewMatrix;
+uniform mat4 u_normalMatrix;
+
+out VS_OUT {
+    vec3 pos;
+    vec3 normal;
+} vs_out;
+
+/**
+ * Curve Vertex Shader, evaluates the curve at the parameter of gl_VertexID.
+ * Drawn without vertex buffer, the last vertex always ends on T = 1.
+ * Feeds the line strip (gl_Position) and the normal geometry shader (vs_out),
+ * same as utils_evalSpline / utils_evalBezier and utils_calcNormals.
+ */
+void main(void) {
+    float T = gl_VertexID >= u_numVertices - 1 ? 1.0 : min(float(gl_VertexID) * u_step, 1.0);
+
+    float segmentPos = T * float(u_numSegments);
+    int i = min(int(floor(segmentPos)), u_numSegments - 1);
+    float t = segmentPos - float(i);
+
+    vec4 basis = vec4(t * t * t, t * t, t, 1.0);
+    vec4 deriv = vec4(3.0 * t * t, 2.0 * t, 1.0, 0.0) * float(u_numSegments);
+    vec4 cx = u_segments[2 * i];
+    vec4 cy = u_segments[2 * i + 1];
+
+    vec3 pos = vec3(dot(cx, basis), dot(cy, basis), 0.0);
+    vec2 tangent = vec2(dot(cx, deriv), dot(cy, deriv));
+    vec3 normal = normalize(vec3(-tangent.y, tangent.x, 0.0));
+
+    gl_Position = u_mvpMatrix * vec4(pos, 1.0);
+    vs_out.pos = vec3(u_modelViewMatrix * vec4(pos, 1.0));
+    vs_out.normal = normalize(vec3(u_normalMatrix * vec4(normal, 0.0)));
+}
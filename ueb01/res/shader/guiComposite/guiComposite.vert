@@ -0,0 +1,10 @@
+#version 430 core
+
+/**
+ * Fullscreen triangle from the vertex id, no vertex buffer needed.
+ * Everything beyond the viewport is clipped.
+ */
+void main(void) {
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
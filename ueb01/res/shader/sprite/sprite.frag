@@ -0,0 +1,12 @@
+#version 430 core
+
+in vec3 v_color;
+
+out vec4 fragColor;
+
+/**
+ * Einstiegspunkt des Shaders. Setzt die Farbe der Instanz.
+ */
+void main(void) {
+    fragColor = vec4(v_color, 1.0);
+}
@@ -0,0 +1,39 @@
+#version 430 core
+
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec3 norm;
+layout (location = 2) in vec2 tex;
+
+// Pro Instanz
+layout (location = 3) in vec4 i_transform; // Verschiebung xy, Skalierung xy
+layout (location = 4) in vec4 i_anim;      // Drift-Amplitude, Drift-Phase, Rotationsgeschwindigkeit, Rotationsoffset
+layout (location = 5) in vec3 i_color;
+
+uniform mat4 u_mvpMatrix;
+uniform float u_time;
+uniform float u_driftSpeed;
+uniform bool u_animate;
+
+out vec3 v_color;
+
+/**
+ * Einstiegspunkt des Shaders. Skaliert, dreht und verschiebt die Vertices
+ * einer Instanz, Drift und Rotation werden aus der Zeit berechnet.
+ */
+void main(void) {
+    float drift = 0.0;
+    float angle = 0.0;
+    if (u_animate) {
+        drift = i_anim.x * sin(u_time * u_driftSpeed + i_anim.y);
+        angle = u_time * i_anim.z + i_anim.w;
+    }
+
+    vec2 scaled = pos.xy * i_transform.zw;
+    float c = cos(angle);
+    float s = sin(angle);
+    vec2 rotated = vec2(c * scaled.x - s * scaled.y, s * scaled.x + c * scaled.y);
+
+    vec2 world = rotated + i_transform.xy + vec2(drift, 0.0);
+    gl_Position = u_mvpMatrix * vec4(world, pos.z, 1.0);
+    v_color = i_color;
+}
@@ -0,0 +1,15 @@
+#version 430
+
+in vec3 v_color;
+in float v_dist;
+flat in float v_halfWidth;
+
+out vec4 fragColor;
+
+/**
+ * Einstiegspunkt des Shaders. Blendet die Kante der Linie über einen Pixel aus.
+ */
+void main(void) {
+    float alpha = clamp(v_halfWidth + 0.5 - abs(v_dist), 0.0, 1.0);
+    fragColor = vec4(v_color, alpha);
+}
@@ -0,0 +1,120 @@
+#version 430
+
+// Must match Vertex of the fhwcg mesh: position, normal, texture coordinates
+#define VERTEX_FLOATS 8
+
+// Antialiasing border added to both sides of a line in pixels
+#define AA_PIXELS 1.0
+
+// Miters longer than this times the half width are cut
+#define MITER_LIMIT 4.0
+
+/** Vertices of the line strip, read directly from its vertex buffer */
+layout(std430, binding = 0) readonly buffer Vertices {
+    float vertices[];
+};
+
+uniform mat4 u_mvpMatrix;
+uniform vec2 u_viewport;            // viewport size in pixels
+uniform int u_numVertices;
+uniform bool u_closed;              // last vertex equals the first, join around it
+uniform float u_width;              // line width in pixels
+uniform vec3 u_color;
+uniform float u_normalLength = 0.1;
+uniform vec3 u_normalColor = vec3(1, 1, 1);
+
+out vec3 v_color;
+out float v_dist;                   // signed distance to the line center in pixels
+flat out float v_halfWidth;
+
+/** Corners of the two triangles of a quad: end of the segment, side of the line */
+const ivec2 CORNERS[6] = ivec2[6](
+    ivec2(0, -1), ivec2(1, -1), ivec2(1, 1),
+    ivec2(0, -1), ivec2(1, 1), ivec2(0, 1)
+);
+
+vec3 vertexPos(int i) {
+    return vec3(vertices[i * VERTEX_FLOATS], vertices[i * VERTEX_FLOATS + 1], vertices[i * VERTEX_FLOATS + 2]);
+}
+
+vec3 vertexNormal(int i) {
+    return vec3(vertices[i * VERTEX_FLOATS + 3], vertices[i * VERTEX_FLOATS + 4], vertices[i * VERTEX_FLOATS + 5]);
+}
+
+vec2 toScreen(vec4 clip) {
+    return clip.xy / clip.w * 0.5 * u_viewport;
+}
+
+/**
+ * Index of a neighbour of the strip, -1 at an open end.
+ * A closed strip skips the duplicated first vertex.
+ */
+int neighbour(int i) {
+    if (i >= 0 && i < u_numVertices) {
+        return i;
+    }
+    if (!u_closed) {
+        return -1;
+    }
+    return i < 0 ? u_numVertices - 2 : 1;
+}
+
+/**
+ * Thick Line Vertex Shader, expands every instance to a screen space quad.
+ * Instances below u_numVertices - 1 are the segments of the strip, mitered
+ * with their neighbours. The instances after them are the normals, one
+ * per vertex with u_normalLength, drawn one pixel wide.
+ * Drawn without vertex attributes, 6 vertices per instance.
+ */
+void main(void) {
+    ivec2 corner = CORNERS[gl_VertexID];
+    int numSegments = u_numVertices - 1;
+    bool isNormal = gl_InstanceID >= numSegments;
+
+    int a = isNormal ? gl_InstanceID - numSegments : gl_InstanceID;
+    vec3 posA = vertexPos(a);
+    vec3 posB = isNormal ? posA + vertexNormal(a) * u_normalLength : vertexPos(a + 1);
+
+    vec4 clipA = u_mvpMatrix * vec4(posA, 1.0);
+    vec4 clipB = u_mvpMatrix * vec4(posB, 1.0);
+    vec4 clip = corner.x == 0 ? clipA : clipB;
+
+    vec2 delta = toScreen(clipB) - toScreen(clipA);
+    float halfWidth = isNormal ? 0.5 : 0.5 * u_width;
+
+    // Degenerate segments collapse to a point
+    if (dot(delta, delta) < 1e-8) {
+        gl_Position = clip;
+        v_color = isNormal ? u_normalColor : u_color;
+        v_dist = 0.0;
+        v_halfWidth = halfWidth;
+        return;
+    }
+
+    vec2 dir = normalize(delta);
+    vec2 side = vec2(-dir.y, dir.x);
+    vec2 offset = side;
+
+    // Miter with the neighbouring segment at this end
+    if (!isNormal) {
+        int other = corner.x == 0 ? neighbour(a - 1) : neighbour(a + 2);
+        if (other >= 0) {
+            vec2 otherScreen = toScreen(u_mvpMatrix * vec4(vertexPos(other), 1.0));
+            vec2 otherDelta = corner.x == 0 ? toScreen(clipA) - otherScreen : otherScreen - toScreen(clipB);
+            if (dot(otherDelta, otherDelta) >= 1e-8) {
+                vec2 tangent = normalize(dir + normalize(otherDelta));
+                vec2 miter = vec2(-tangent.y, tangent.x);
+                float scale = 1.0 / max(dot(miter, side), 1.0 / MITER_LIMIT);
+                offset = miter * scale;
+            }
+        }
+    }
+
+    float extent = halfWidth + AA_PIXELS;
+    vec2 screen = toScreen(clip) + offset * extent * float(corner.y);
+
+    gl_Position = vec4(screen / (0.5 * u_viewport) * clip.w, clip.zw);
+    v_color = isNormal ? u_normalColor : u_color;
+    v_dist = extent * float(corner.y);
+    v_halfWidth = halfWidth;
+}
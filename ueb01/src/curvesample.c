@@ -0,0 +1,291 @@
+/**
+ * @file curvesample.c
+ * @brief Implementation of the batch curve sampling
+ *
+ * Both kernels split the vertex range into runs of vertices in the same
+ * segment, found with the scalar parameter mapping, so a run needs the
+ * coefficients of only one segment. The AVX kernel broadcasts them once
+ * per run and evaluates position and derivative of 8 vertices per
+ * iteration, the vertices after the last full iteration fill the unused
+ * lanes of one more.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "curvesample.h"
+#include "utils.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define CURVESAMPLE_X86 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define TARGET_AVX
+    #else
+        #define TARGET_AVX __attribute__((target("avx")))
+    #endif
+#endif
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Parameter of a uniform vertex.
+ * @param k Index of the vertex.
+ * @param step Parameter step between two vertices.
+ * @param numVertices Number of vertices, the last one lies on T = 1.
+ * @return Parameter clamped to [0, 1].
+ */
+static float vertexParam(int k, float step, int numVertices) {
+    float T = (k == numVertices - 1) ? 1.0f : k * step;
+    return glm_clamp(T, 0.0f, 1.0f);
+}
+
+/**
+ * Segment of a parameter, mapped like utils_evalSpline.
+ * @param T Parameter in [0, 1].
+ * @param numSegments Number of segments.
+ * @return Index of the segment.
+ */
+static int segmentOf(float T, int numSegments) {
+    int i = (int) floorf(T * numSegments);
+    return glm_imin(i, numSegments - 1);
+}
+
+/**
+ * Evaluates one vertex and its normal.
+ * @param coeffs Segment coefficients.
+ * @param numSegments Number of segments.
+ * @param T Parameter in [0, 1].
+ * @param vertex Output position.
+ * @param normal Output unit normal.
+ */
+static void sampleScalar(const float *coeffs, int numSegments, float T, vec2 vertex, vec3 normal) {
+    int i = segmentOf(T, numSegments);
+    float t = T * numSegments - i;
+    const float *x = coeffs + i * CURVE_SEGMENT_FLOATS;
+    const float *y = x + 4;
+
+    vertex[0] = ((x[0] * t + x[1]) * t + x[2]) * t + x[3];
+    vertex[1] = ((y[0] * t + y[1]) * t + y[2]) * t + y[3];
+
+    float tx = ((3.0f * x[0] * t + 2.0f * x[1]) * t + x[2]) * (float) numSegments;
+    float ty = ((3.0f * y[0] * t + 2.0f * y[1]) * t + y[2]) * (float) numSegments;
+
+    // cross(-tangent, z) like utils_calcNormals
+    normal[0] = -ty;
+    normal[1] = tx;
+    normal[2] = 0.0f;
+    glm_vec3_normalize(normal);
+}
+
+/**
+ * Index of the last vertex of a run starting at k in the given segment.
+ * @param k First vertex of the run.
+ * @param segment Segment of vertex k.
+ * @param numSegments Number of segments.
+ * @param step Parameter step between two vertices.
+ * @param numVertices Number of vertices.
+ * @param last Last vertex of the sampled range.
+ * @return Last vertex of the range in the same segment.
+ */
+static int runEnd(int k, int segment, int numSegments, float step, int numVertices, int last) {
+    if (segment == numSegments - 1) {
+        return last;
+    }
+
+    // Estimate the first vertex of the next segment, then correct the rounding
+    int next = (int) ceilf((float) (segment + 1) / (numSegments * step));
+    next = glm_imax(glm_imin(next, last + 1), k + 1);
+    while (next - 1 > k && segmentOf(vertexParam(next - 1, step, numVertices), numSegments) > segment) {
+        --next;
+    }
+    while (next <= last && segmentOf(vertexParam(next, step, numVertices), numSegments) == segment) {
+        ++next;
+    }
+    return next - 1;
+}
+
+/**
+ * Samples a range of vertices one at a time.
+ * @param coeffs Segment coefficients.
+ * @param numSegments Number of segments.
+ * @param step Parameter step between two vertices.
+ * @param numVertices Number of vertices.
+ * @param first First vertex.
+ * @param last Last vertex (inclusive).
+ * @param vertices Output positions.
+ * @param normals Output normals.
+ */
+static void uniformScalar(const float *coeffs, int numSegments, float step, int numVertices,
+                          int first, int last, vec2 *vertices, vec3 *normals) {
+    for (int k = first; k <= last; ++k) {
+        sampleScalar(coeffs, numSegments, vertexParam(k, step, numVertices), vertices[k], normals[k]);
+    }
+}
+
+#ifdef CURVESAMPLE_X86
+
+/**
+ * Samples a run of vertices in one segment, 8 per iteration.
+ * The last vertex of the curve is not part of the run, its parameter
+ * is not k * step.
+ * @param coeffs Coefficients of the segment.
+ * @param segment Index of the segment.
+ * @param numSegments Number of segments.
+ * @param step Parameter step between two vertices.
+ * @param first First vertex of the run.
+ * @param last Last vertex of the run (inclusive).
+ * @param vertices Output positions.
+ * @param normals Output normals.
+ */
+TARGET_AVX
+static void runAvx(const float *coeffs, int segment, int numSegments, float step,
+                   int first, int last, vec2 *vertices, vec3 *normals) {
+    const __m256 ax = _mm256_set1_ps(coeffs[0]), bx = _mm256_set1_ps(coeffs[1]);
+    const __m256 cx = _mm256_set1_ps(coeffs[2]), dx = _mm256_set1_ps(coeffs[3]);
+    const __m256 ay = _mm256_set1_ps(coeffs[4]), by = _mm256_set1_ps(coeffs[5]);
+    const __m256 cy = _mm256_set1_ps(coeffs[6]), dy = _mm256_set1_ps(coeffs[7]);
+    const __m256 ax3 = _mm256_set1_ps(3.0f * coeffs[0]), bx2 = _mm256_set1_ps(2.0f * coeffs[1]);
+    const __m256 ay3 = _mm256_set1_ps(3.0f * coeffs[4]), by2 = _mm256_set1_ps(2.0f * coeffs[5]);
+
+    const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 stepV = _mm256_set1_ps(step);
+    const __m256 scale = _mm256_set1_ps((float) numSegments);
+    const __m256 start = _mm256_set1_ps((float) segment);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 epsilon = _mm256_set1_ps(FLT_EPSILON);
+
+    float px[CURVESAMPLE_LANES], py[CURVESAMPLE_LANES];
+    float nx[CURVESAMPLE_LANES], ny[CURVESAMPLE_LANES];
+
+    for (int k = first; k <= last; k += CURVESAMPLE_LANES) {
+        // Same operations as vertexParam and sampleScalar, lane by lane
+        __m256 T = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps((float) k), lanes), stepV);
+        T = _mm256_min_ps(_mm256_max_ps(T, zero), one);
+        __m256 t = _mm256_sub_ps(_mm256_mul_ps(T, scale), start);
+
+        __m256 x = _mm256_add_ps(_mm256_mul_ps(ax, t), bx);
+        x = _mm256_add_ps(_mm256_mul_ps(x, t), cx);
+        x = _mm256_add_ps(_mm256_mul_ps(x, t), dx);
+        __m256 y = _mm256_add_ps(_mm256_mul_ps(ay, t), by);
+        y = _mm256_add_ps(_mm256_mul_ps(y, t), cy);
+        y = _mm256_add_ps(_mm256_mul_ps(y, t), dy);
+
+        __m256 tx = _mm256_add_ps(_mm256_mul_ps(ax3, t), bx2);
+        tx = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(tx, t), cx), scale);
+        __m256 ty = _mm256_add_ps(_mm256_mul_ps(ay3, t), by2);
+        ty = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(ty, t), cy), scale);
+
+        // Normal (-ty, tx), zero below FLT_EPSILON like glm_vec3_normalize
+        __m256 norm = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(ty, ty), _mm256_mul_ps(tx, tx)));
+        __m256 inv = _mm256_and_ps(_mm256_div_ps(one, norm), _mm256_cmp_ps(norm, epsilon, _CMP_GE_OQ));
+        __m256 normalX = _mm256_mul_ps(_mm256_sub_ps(zero, ty), inv);
+        __m256 normalY = _mm256_mul_ps(tx, inv);
+
+        int count = glm_imin(last - k + 1, CURVESAMPLE_LANES);
+        if (count == CURVESAMPLE_LANES) {
+            // Interleave to x0 y0 x1 y1 ... straight into the vertices
+            __m256 lo = _mm256_unpacklo_ps(x, y);
+            __m256 hi = _mm256_unpackhi_ps(x, y);
+            _mm256_storeu_ps(vertices[k], _mm256_permute2f128_ps(lo, hi, 0x20));
+            _mm256_storeu_ps(vertices[k + 4], _mm256_permute2f128_ps(lo, hi, 0x31));
+        } else {
+            _mm256_storeu_ps(px, x);
+            _mm256_storeu_ps(py, y);
+            for (int j = 0; j < count; ++j) {
+                vertices[k + j][0] = px[j];
+                vertices[k + j][1] = py[j];
+            }
+        }
+
+        _mm256_storeu_ps(nx, normalX);
+        _mm256_storeu_ps(ny, normalY);
+        for (int j = 0; j < count; ++j) {
+            normals[k + j][0] = nx[j];
+            normals[k + j][1] = ny[j];
+            normals[k + j][2] = 0.0f;
+        }
+    }
+}
+
+/**
+ * Samples a range of vertices run by run with the AVX kernel.
+ * @param coeffs Segment coefficients.
+ * @param numSegments Number of segments.
+ * @param step Parameter step between two vertices.
+ * @param numVertices Number of vertices.
+ * @param first First vertex.
+ * @param last Last vertex (inclusive).
+ * @param vertices Output positions.
+ * @param normals Output normals.
+ */
+static void uniformAvx(const float *coeffs, int numSegments, float step, int numVertices,
+                       int first, int last, vec2 *vertices, vec3 *normals) {
+    // The last vertex of the curve is pinned to T = 1
+    int end = glm_imin(last, numVertices - 2);
+
+    for (int k = first; k <= end; ) {
+        int segment = segmentOf(vertexParam(k, step, numVertices), numSegments);
+        int runLast = runEnd(k, segment, numSegments, step, numVertices, end);
+        runAvx(coeffs + segment * CURVE_SEGMENT_FLOATS, segment, numSegments, step,
+               k, runLast, vertices, normals);
+        k = runLast + 1;
+    }
+
+    if (last == numVertices - 1) {
+        sampleScalar(coeffs, numSegments, 1.0f, vertices[last], normals[last]);
+    }
+}
+
+/**
+ * Checks for AVX support of CPU and operating system.
+ * @return True if AVX instructions can be used.
+ */
+static bool cpuHasAvx(void) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    return osxsave && avx && ((_xgetbv(0) & 0x6) == 0x6);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+#endif
+}
+
+#endif // CURVESAMPLE_X86
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool curvesample_isSimdSupported(void) {
+#ifdef CURVESAMPLE_X86
+    static int hasAvx = -1;
+    if (hasAvx < 0) {
+        hasAvx = cpuHasAvx() ? 1 : 0;
+    }
+    return hasAvx == 1;
+#else
+    return false;
+#endif
+}
+
+void curvesample_uniform(bool simd, const float *coeffs, int numSegments, float step, int numVertices,
+                         int first, int last, vec2 *vertices, vec3 *normals) {
+    assert(numSegments > 0 && "curve without segments");
+    first = glm_imax(first, 0);
+    last = glm_imin(last, numVertices - 1);
+    if (first > last) {
+        return;
+    }
+
+#ifdef CURVESAMPLE_X86
+    if (simd && curvesample_isSimdSupported()) {
+        uniformAvx(coeffs, numSegments, step, numVertices, first, last, vertices, normals);
+        return;
+    }
+#endif
+    NK_UNUSED(simd);
+    uniformScalar(coeffs, numSegments, step, numVertices, first, last, vertices, normals);
+}
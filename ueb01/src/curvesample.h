@@ -0,0 +1,51 @@
+/**
+ * @file curvesample.h
+ * @brief Batch sampling of the curve at uniform parameter steps
+ *
+ * Evaluates a whole range of the uniform curve vertices from the segment
+ * coefficients of utils_getSegments in one call, instead of one call of
+ * the curve function per vertex. The vertices are walked segment by
+ * segment, the AVX kernel evaluates 8 parameters of a segment per
+ * iteration. Normals come from the analytic derivative and are written
+ * right away, like utils_calcNormals would from the tangents.
+ *
+ * The mapping of a parameter to its segment and the arithmetic are the
+ * ones of utils_evalSpline and utils_evalBezier (a Bezier curve is a
+ * single segment), so both kernels produce the same vertices as the
+ * curve functions.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef CURVESAMPLE_H
+#define CURVESAMPLE_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Parameters evaluated per iteration of the AVX kernel */
+#define CURVESAMPLE_LANES 8
+
+/**
+ * Checks whether the AVX kernel can run.
+ * @return True on x86 if CPU and operating system support AVX.
+ */
+bool curvesample_isSimdSupported(void);
+
+/**
+ * Samples a range of the uniform curve vertices. Vertex k lies at
+ * T = k * step, the last of numVertices always on T = 1.
+ * Without AVX support the scalar kernel is used.
+ * @param simd Whether to use the AVX kernel.
+ * @param coeffs Segment coefficients as returned by utils_getSegments.
+ * @param numSegments Number of segments, at least 1.
+ * @param step Parameter step between two vertices.
+ * @param numVertices Number of vertices of the whole curve.
+ * @param first Index of the first vertex to sample.
+ * @param last Index of the last vertex to sample (inclusive).
+ * @param vertices Output positions, indexed by vertex.
+ * @param normals Output unit normals, indexed by vertex.
+ */
+void curvesample_uniform(bool simd, const float *coeffs, int numSegments, float step, int numVertices,
+                         int first, int last, vec2 *vertices, vec3 *normals);
+
+#endif // CURVESAMPLE_H
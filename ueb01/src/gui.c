@@ -10,6 +10,8 @@
 
 #include "gui.h"
 #include "input.h"
+#include "idle.h"
+#include "guicache.h"
 #include "logic.h"
 #include "utils.h"
 
@@ -106,6 +108,25 @@ static void gui_renderMenu(ProgContext ctx, InputData* input)
                 input->paused = !input->paused;
             }
 
+            gui_layoutRowDynamic(ctx, 20, 2);
+            bool idleEnabled = idle_isEnabled();
+            if (gui_checkbox(ctx, "Idle", &idleEnabled)) {
+                idle_setEnabled(idleEnabled);
+            }
+            gui_label(ctx, idle_isIdle() ? "sleeping" : "rendering", NK_TEXT_RIGHT);
+            gui_layoutRowDynamic(ctx, 20, 2);
+            bool guiCacheEnabled = guicache_isEnabled();
+            if (gui_checkbox(ctx, "GUI Cache", &guiCacheEnabled)) {
+                guicache_setEnabled(guiCacheEnabled);
+            }
+            char reuseStr[24];
+            snprintf(reuseStr, sizeof(reuseStr), "%.0f%% reused", guicache_getReuse() * 100.0f);
+            gui_label(ctx, reuseStr, NK_TEXT_RIGHT);
+            gui_layoutRowDynamic(ctx, 20, 1);
+            float guiRate = guicache_getRate();
+            gui_propertyFloat(ctx, "GUI Hz", 0.0f, &guiRate, 120.0f, 5.0f, 1.0f);
+            guicache_setRate(guiRate);
+
             gui_treePop(ctx);
         }
 
@@ -141,20 +162,37 @@ static void gui_renderMenu(ProgContext ctx, InputData* input)
 
             gui_propertyFloat(ctx, "width", 0.01f, &input->curve.width, 20.0f, 0.001f, 0.5f);
 
-            float newRes = input->curve.resolution;
-            gui_propertyFloat(ctx, "resolution", 0.0002f, &newRes, 0.99f, 0.001f, 0.005f);
-            if (!glm_eq(newRes, input->curve.resolution)) {
-                input->curve.resolution = newRes;
+            if (gui_checkbox(ctx, "Adaptive", &input->curve.adaptive)) {
                 input->curve.resolutionChanged = true;
             }
 
+            if (input->curve.adaptive) {
+                float newTol = input->curve.tolerance;
+                gui_propertyFloat(ctx, "tolerance (px)", 0.05f, &newTol, 10.0f, 0.05f, 0.01f);
+                if (!glm_eq(newTol, input->curve.tolerance)) {
+                    input->curve.tolerance = newTol;
+                    input->curve.resolutionChanged = true;
+                }
+            } else {
+                if (gui_checkbox(ctx, "GPU Evaluation", &input->curve.gpuEval)) {
+                    input->curve.resolutionChanged = true;
+                }
+
+                float newRes = input->curve.resolution;
+                gui_propertyFloat(ctx, "resolution", 0.0002f, &newRes, 0.99f, 0.001f, 0.005f);
+                if (!glm_eq(newRes, input->curve.resolution)) {
+                    input->curve.resolution = newRes;
+                    input->curve.resolutionChanged = true;
+                }
+            }
+
             gui_treePop(ctx);
         }
 
         if (gui_treePush(ctx, NK_TREE_TAB, "Game", NK_MINIMIZED)) {
             gui_layoutRowDynamic(ctx, 25, 1);
-            char infoStr[10];
-            snprintf(infoStr, 9, "Level: %d", input->game.currentLevel + 1);
+            char infoStr[24];
+            snprintf(infoStr, sizeof(infoStr), "Level: %d", input->game.currentLevel + 1);
             gui_labelColor(ctx, infoStr, NK_TEXT_CENTERED, (ivec3){100, 100, 255});
             
             gui_layoutRowDynamic(ctx, 10, 2);
@@ -175,7 +213,7 @@ static void gui_renderMenu(ProgContext ctx, InputData* input)
             
             gui_checkbox(ctx, "Colliders", &input->game.showColliders);
 
-            gui_propertyFloat(ctx, "speed", 0.01f, &input->game.airplane.defaultSpeed, 1.0f, 0.001f, 0.0005f);
+            gui_propertyFloat(ctx, "speed", 0.05f, &input->game.airplane.defaultSpeed, 3.0f, 0.01f, 0.005f);
     
             gui_treePop(ctx);
         } 
@@ -10,10 +10,13 @@
  */
 
 #include "input.h"
+#include "idle.h"
+#include "guicache.h"
 #include "rendering.h"
 #include "shader.h"
 #include "utils.h"
 #include "logic.h"
+#include "inputqueue.h"
 
 ////////////////////////    LOCAL    ////////////////////////////
 
@@ -30,8 +33,10 @@ static InputData g_input;
  */
 static void input_keyEvent(ProgContext ctx, int key, int action, int mods) {
     NK_UNUSED(mods);
+    idle_onInput(action);
+    guicache_onInput();
 
-    if (action != GLFW_PRESS) {
+    if (!inputqueue_key(key, action) || action != GLFW_PRESS) {
         return;
     }
 
@@ -105,6 +110,9 @@ static void input_keyEvent(ProgContext ctx, int key, int action, int mods) {
         case GLFW_KEY_4:
         case GLFW_KEY_5:
         case GLFW_KEY_6:
+        case GLFW_KEY_7:
+        case GLFW_KEY_8:
+        case GLFW_KEY_9:
             loadLevel(key - GLFW_KEY_1, data);
             break;
         
@@ -126,9 +134,27 @@ static void input_frameBufferSizeEvent(ProgContext ctx, int width, int height) {
     rendering_resize(width, height, getInputData()->curve.buttonCount);
 }
 
+/**
+ * Handles the mouse movement coalesced over a frame.
+ * Updates mouse position in InputData, hit-tests and drags the control point buttons.
+ *
+ * @param ctx Program context
+ * @param move Last position and summed movement
+ */
+static void input_handleMouseMove(ProgContext ctx, const InputMove *move) {
+    NK_UNUSED(ctx);
+
+    InputData* data = getInputData();
+    data->mouse.xPos = move->x;
+    data->mouse.yPos = move->y;
+
+    rendering_mouseMoved(data->mouse.xPos, data->mouse.yPos);
+}
+
 /**
  * Callback for mouse button events (press and release).
- * Stores button and action in InputData
+ * Stores button and action in InputData and starts or stops dragging
+ * a control point button at the position of the click.
  *
  * @param ctx Program context
  * @param button Mouse button identifier
@@ -136,17 +162,21 @@ static void input_frameBufferSizeEvent(ProgContext ctx, int width, int height) {
  * @param mods Unsued modifier keys
  */
 static void input_mouseButtonEvent(ProgContext ctx, int button, int action, int mods) {
-    NK_UNUSED(ctx);
     NK_UNUSED(mods);
+    idle_onInput(action);
+    guicache_onInput();
+    inputqueue_flush(ctx, input_handleMouseMove);
 
     InputData* data = getInputData();
     data->mouse.button = button;
     data->mouse.action = action;
+
+    rendering_mouseButton(button, action);
 }
 
 /**
  * Callback for mouse movement events.
- * Updates mouse position in InputData.
+ * Only records the position, input_flushEvents handles it once per frame.
  *
  * @param ctx Program context
  * @param x Mouse X coordinate
@@ -154,10 +184,34 @@ static void input_mouseButtonEvent(ProgContext ctx, int button, int action, int
  */
 static void input_mouseMoveEvent(ProgContext ctx, double x, double y) {
     NK_UNUSED(ctx);
+    guicache_onInput();
+    inputqueue_mouseMove(x, y);
+}
 
-    InputData* data = getInputData();
-    data->mouse.xPos = (float) x;
-    data->mouse.yPos = (float) y;
+/**
+ * Callback for mouse wheel events, only the GUI reacts to them.
+ *
+ * @param ctx Program context
+ * @param x Horizontal scroll offset
+ * @param y Vertical scroll offset
+ */
+static void input_mouseScrollEvent(ProgContext ctx, double x, double y) {
+    NK_UNUSED(ctx);
+    NK_UNUSED(x);
+    NK_UNUSED(y);
+    guicache_onInput();
+}
+
+/**
+ * Callback for text input, only the GUI reacts to it.
+ *
+ * @param ctx Program context
+ * @param codepoint Unicode codepoint of the typed character
+ */
+static void input_textEvent(ProgContext ctx, unsigned int codepoint) {
+    NK_UNUSED(ctx);
+    NK_UNUSED(codepoint);
+    guicache_onInput();
 }
 
 
@@ -175,6 +229,9 @@ void input_init(ProgContext ctx) {
     g_input.mouse.xPos = 0;
     g_input.mouse.yPos = 0;
     g_input.curve.resolution = 0.02f;
+    g_input.curve.adaptive = true;
+    g_input.curve.gpuEval = true;
+    g_input.curve.tolerance = 0.25f;
     g_input.curve.width = 2.0f;
     g_input.curve.drawPolygon = false;
     g_input.curve.drawConvexHull = false;
@@ -190,9 +247,15 @@ InputData* getInputData(void) {
     return &g_input;
 }
 
+void input_flushEvents(ProgContext ctx) {
+    inputqueue_flush(ctx, input_handleMouseMove);
+}
+
 void input_registerCallbacks(ProgContext ctx) {
     window_setKeyboardCallback(ctx, input_keyEvent);
     window_setMouseButtonCallback(ctx, input_mouseButtonEvent);
     window_setMouseMovementCallback(ctx, input_mouseMoveEvent);
+    window_setMouseScrollCallback(ctx, input_mouseScrollEvent);
+    window_setTextCallback(ctx, input_textEvent);
     window_setFramebufferSizeCallback(ctx, input_frameBufferSizeEvent);
 }
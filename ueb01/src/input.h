@@ -26,9 +26,10 @@
  * @param numPoints Number of control points
  * @param t Parameter value [0,1] along the curve
  * @param dest Output: calculated point on curve at parameter t
+ * @param tangent Output: derivative of the curve at parameter t (NULL to skip)
  * @param updateCoeffs Pointer to flag indicating if coefficients need recalculation
  */
-typedef void (*CurveEvalFn)(vec2* ctrl, int numPoints, float t, vec2 dest, bool *updateCoeffs);
+typedef void (*CurveEvalFn)(vec2* ctrl, int numPoints, float t, vec2 dest, vec2 tangent, bool *updateCoeffs);
 
 /** Struct containing all data for application state
 * - GUI
@@ -53,6 +54,9 @@ typedef struct {
         CurveEvalFn curveEval;
         float width;
         float resolution;
+        bool adaptive;  // Tessellate by flatness instead of uniform steps
+        bool gpuEval;  // Evaluate uniform steps in the vertex shader from the segment coefficients
+        float tolerance;  // Maximum deviation of the adaptive line strip in pixels
         bool drawPolygon;
         bool drawConvexHull;
         bool showNormals;
@@ -69,7 +73,7 @@ typedef struct {
             float rotation;
             vec2 vertices[3];
             float colliderRadius;
-            float defaultSpeed;
+            float defaultSpeed;  // Scene units per second along the curve
         } airplane;
         struct {
             vec2 *pos;
@@ -104,4 +108,12 @@ InputData* getInputData(void);
  */
 void input_registerCallbacks(ProgContext ctx);
 
+/**
+ * Handles the mouse movement recorded since the last call.
+ * Call once per frame after the events were polled.
+ *
+ * @param ctx Program Context
+ */
+void input_flushEvents(ProgContext ctx);
+
 #endif // INPUT_H
\ No newline at end of file
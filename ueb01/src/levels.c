@@ -0,0 +1,485 @@
+/**
+ * @file levels.c
+ * @brief Implementation of the level file compiler and loader.
+ *
+ * The blob is written to a temporary file and renamed at the end, so the
+ * loader never maps a partial file. A blob that does not match its header,
+ * the hash of the source or the limits of the game is treated as missing.
+ * All checks run once at load, levels_get only reads the table.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "levels.h"
+#include "input.h"
+#include "rendering.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+/** "LVL1" in little endian */
+#define LEVELS_MAGIC 0x314c564cu
+
+/** Increased whenever the blob layout changes */
+#define LEVELS_VERSION 1
+
+/** Chunk size for hashing the source file */
+#define HASH_CHUNK 65536
+
+/** Longest line of the source */
+#define LINE_LENGTH 256
+
+/** Fewest control points of a curve */
+#define MIN_BUTTONS 4
+
+/**
+ * Header at the start of the blob, followed by levelCount records
+ * and pointCount positions.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t levelCount;
+    uint32_t pointCount;
+} LevelFileHeader;
+
+/**
+ * Level table entry, the positions are indices into the point array.
+ */
+typedef struct {
+    uint32_t firstStar;
+    uint32_t starCount;
+    uint32_t firstCloud;
+    uint32_t cloudCount;
+    float starRadius;
+    float cloudRadius;
+    int32_t buttonCount;
+    uint32_t reserved;
+} LevelRecord;
+
+/**
+ * Level read from the source, appended to the blob once it is complete.
+ */
+typedef struct {
+    LevelRecord record;
+    vec2 stars[MAX_STARS];
+    vec2 clouds[MAX_STARS];
+    int line;
+} LevelDraft;
+
+/**
+ * Blob contents while compiling.
+ */
+typedef struct {
+    LevelRecord *records;
+    int levelCount, levelCapacity;
+    vec2 *points;
+    int pointCount, pointCapacity;
+} LevelBuilder;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Mapped blob.
+ */
+static struct {
+    const unsigned char *base;
+    size_t size;
+    const LevelRecord *records;
+    vec2 *points;
+    int count;
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} g_levels = { 0 };
+
+/**
+ * Hashes the content of a file with 64 bit FNV-1a.
+ * @param filename Path of the file.
+ * @param hash Destination for the hash.
+ * @return False if the file could not be read.
+ */
+static bool hashFile(const char *filename, uint64_t *hash) {
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        return false;
+    }
+
+    unsigned char *buf = malloc(HASH_CHUNK);
+    assert(buf && "malloc failed in levels hashFile");
+
+    uint64_t h = 0xcbf29ce484222325ull;
+    size_t read;
+    while ((read = fread(buf, 1, HASH_CHUNK, f)) > 0) {
+        for (size_t i = 0; i < read; ++i) {
+            h = (h ^ buf[i]) * 0x100000001b3ull;
+        }
+    }
+
+    free(buf);
+    fclose(f);
+    *hash = h;
+    return true;
+}
+
+/**
+ * Appends positions to the point array of the blob.
+ * @param builder Blob contents.
+ * @param points Positions to append.
+ * @param n Number of positions.
+ * @return Index of the first appended position.
+ */
+static uint32_t appendPoints(LevelBuilder *builder, vec2 *points, int n) {
+    if (builder->pointCount + n > builder->pointCapacity) {
+        builder->pointCapacity = glm_imax(builder->pointCapacity * 2, builder->pointCount + n);
+        vec2 *tmp = realloc(builder->points, builder->pointCapacity * sizeof(vec2));
+        assert(tmp && "realloc failed in levels appendPoints");
+        builder->points = tmp;
+    }
+
+    uint32_t first = (uint32_t) builder->pointCount;
+    memcpy(builder->points + first, points, n * sizeof(vec2));
+    builder->pointCount += n;
+    return first;
+}
+
+/**
+ * Appends a complete level to the blob.
+ * Levels the game cannot play are reported and left out.
+ * @param builder Blob contents.
+ * @param draft The level read from the source.
+ * @param source Path of the source for messages.
+ */
+static void finishLevel(LevelBuilder *builder, LevelDraft *draft, const char *source) {
+    LevelRecord *r = &draft->record;
+    if (r->buttonCount < MIN_BUTTONS || r->buttonCount > BUTTON_COUNT) {
+        printf("%s:%d: level needs %d to %d buttons, skipped.\n", source, draft->line, MIN_BUTTONS, BUTTON_COUNT);
+        return;
+    }
+
+    if (builder->levelCount == builder->levelCapacity) {
+        builder->levelCapacity = glm_imax(builder->levelCapacity * 2, 16);
+        LevelRecord *tmp = realloc(builder->records, builder->levelCapacity * sizeof(LevelRecord));
+        assert(tmp && "realloc failed in levels finishLevel");
+        builder->records = tmp;
+    }
+
+    r->firstStar = appendPoints(builder, draft->stars, (int) r->starCount);
+    r->firstCloud = appendPoints(builder, draft->clouds, (int) r->cloudCount);
+    builder->records[builder->levelCount++] = *r;
+}
+
+/**
+ * Starts a new level with the default radii.
+ * @param draft The level to reset.
+ * @param line Line of the level keyword.
+ */
+static void startLevel(LevelDraft *draft, int line) {
+    memset(&draft->record, 0, sizeof(LevelRecord));
+    draft->record.starRadius = LEVEL_STAR_RADIUS;
+    draft->record.cloudRadius = LEVEL_CLOUD_RADIUS;
+    draft->line = line;
+}
+
+/**
+ * Adds a position to a star or cloud list of a level.
+ * @param list The positions of the list.
+ * @param count Number of positions in the list.
+ * @param line The source line holding the position.
+ * @return False if the line holds no position or the list is full.
+ */
+static bool addPosition(vec2 *list, uint32_t *count, const char *line) {
+    vec2 p;
+    if (*count >= MAX_STARS || sscanf(line, "%*s %f %f", &p[0], &p[1]) != 2) {
+        return false;
+    }
+
+    glm_vec2_copy(p, list[(*count)++]);
+    return true;
+}
+
+/**
+ * Reads the source into a blob.
+ * Lines that cannot be read are reported and skipped.
+ * @param source Path of the source.
+ * @param builder Destination for the blob contents.
+ * @return False if the source could not be opened.
+ */
+static bool parseSource(const char *source, LevelBuilder *builder) {
+    FILE *f = fopen(source, "r");
+    if (!f) {
+        return false;
+    }
+
+    LevelDraft *draft = malloc(sizeof(LevelDraft));
+    assert(draft && "malloc failed in levels parseSource");
+    bool inLevel = false;
+
+    char line[LINE_LENGTH];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), f)) {
+        ++lineNumber;
+
+        char key[32];
+        if (sscanf(line, "%31s", key) != 1 || key[0] == '#') {
+            continue;
+        }
+
+        if (strcmp(key, "level") == 0) {
+            if (inLevel) {
+                finishLevel(builder, draft, source);
+            }
+            startLevel(draft, lineNumber);
+            inLevel = true;
+            continue;
+        }
+
+        LevelRecord *r = &draft->record;
+        bool ok = inLevel;
+        if (!ok) {
+            // Outside of a level
+        } else if (strcmp(key, "buttons") == 0) {
+            ok = sscanf(line, "%*s %d", &r->buttonCount) == 1;
+        } else if (strcmp(key, "starRadius") == 0) {
+            ok = sscanf(line, "%*s %f", &r->starRadius) == 1;
+        } else if (strcmp(key, "cloudRadius") == 0) {
+            ok = sscanf(line, "%*s %f", &r->cloudRadius) == 1;
+        } else if (strcmp(key, "star") == 0) {
+            ok = addPosition(draft->stars, &r->starCount, line);
+        } else if (strcmp(key, "cloud") == 0) {
+            ok = addPosition(draft->clouds, &r->cloudCount, line);
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            printf("%s:%d: cannot read '%s', skipped.\n", source, lineNumber, key);
+        }
+    }
+
+    if (inLevel) {
+        finishLevel(builder, draft, source);
+    }
+
+    free(draft);
+    fclose(f);
+    return true;
+}
+
+/**
+ * Compiles the source into the blob.
+ * @param source Path of the source.
+ * @param blob Path of the blob.
+ * @param hash Hash of the source.
+ * @return False if the source has no levels or the blob could not be written.
+ */
+static bool compileSource(const char *source, const char *blob, uint64_t hash) {
+    LevelBuilder builder = { 0 };
+    if (!parseSource(source, &builder) || builder.levelCount == 0) {
+        free(builder.records);
+        free(builder.points);
+        return false;
+    }
+
+    char tmpPath[300];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", blob);
+    FILE *f = fopen(tmpPath, "wb");
+    bool ok = f != NULL;
+
+    if (ok) {
+        LevelFileHeader header = {
+            .magic = LEVELS_MAGIC,
+            .version = LEVELS_VERSION,
+            .sourceHash = hash,
+            .levelCount = (uint32_t) builder.levelCount,
+            .pointCount = (uint32_t) builder.pointCount
+        };
+        ok = fwrite(&header, sizeof(header), 1, f) == 1
+            && fwrite(builder.records, sizeof(LevelRecord), builder.levelCount, f) == (size_t) builder.levelCount
+            && fwrite(builder.points, sizeof(vec2), builder.pointCount, f) == (size_t) builder.pointCount;
+        fclose(f);
+    }
+
+    free(builder.records);
+    free(builder.points);
+
+    if (!ok || (remove(blob), rename(tmpPath, blob) != 0)) {
+        remove(tmpPath);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Maps a file read-only into memory.
+ * @param filename Path of the file.
+ * @return False if the file could not be mapped.
+ */
+static bool mapFile(const char *filename) {
+#ifdef _WIN32
+    g_levels.file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (g_levels.file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(g_levels.file, &size);
+    g_levels.size = (size_t) size.QuadPart;
+    g_levels.mapping = CreateFileMappingA(g_levels.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    g_levels.base = g_levels.mapping ? MapViewOfFile(g_levels.mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!g_levels.base) {
+        if (g_levels.mapping) {
+            CloseHandle(g_levels.mapping);
+        }
+        CloseHandle(g_levels.file);
+        return false;
+    }
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    g_levels.size = (size_t) st.st_size;
+    void *base = mmap(NULL, g_levels.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    g_levels.base = base;
+#endif
+    return true;
+}
+
+/**
+ * Unmaps the blob.
+ */
+static void unmapFile(void) {
+    if (!g_levels.base) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(g_levels.base);
+    CloseHandle(g_levels.mapping);
+    CloseHandle(g_levels.file);
+#else
+    munmap((void*) g_levels.base, g_levels.size);
+#endif
+    g_levels.base = NULL;
+    g_levels.size = 0;
+}
+
+/**
+ * Checks the mapped blob and sets up the level table.
+ * @param checkHash Whether the blob has to match the source.
+ * @param hash Hash of the source.
+ * @return False if the blob is not usable.
+ */
+static bool openBlob(bool checkHash, uint64_t hash) {
+    const LevelFileHeader *header = (const LevelFileHeader*) g_levels.base;
+    if (g_levels.size < sizeof(LevelFileHeader)
+        || header->magic != LEVELS_MAGIC || header->version != LEVELS_VERSION
+        || (checkHash && header->sourceHash != hash) || header->levelCount == 0) {
+        return false;
+    }
+
+    uint64_t expected = sizeof(LevelFileHeader)
+        + (uint64_t) header->levelCount * sizeof(LevelRecord)
+        + (uint64_t) header->pointCount * sizeof(vec2);
+    if (expected != g_levels.size) {
+        return false;
+    }
+
+    const LevelRecord *records = (const LevelRecord*) (header + 1);
+    for (uint32_t i = 0; i < header->levelCount; ++i) {
+        const LevelRecord *r = &records[i];
+        if (r->starCount > MAX_STARS || r->cloudCount > MAX_STARS
+            || (uint64_t) r->firstStar + r->starCount > header->pointCount
+            || (uint64_t) r->firstCloud + r->cloudCount > header->pointCount
+            || r->buttonCount < MIN_BUTTONS || r->buttonCount > BUTTON_COUNT) {
+            return false;
+        }
+    }
+
+    g_levels.records = records;
+    g_levels.points = (vec2*) (records + header->levelCount);
+    g_levels.count = (int) header->levelCount;
+    return true;
+}
+
+/**
+ * Maps the blob and sets up the level table.
+ * @param checkHash Whether the blob has to match the source.
+ * @param hash Hash of the source.
+ * @return False if the blob is missing or not usable.
+ */
+static bool mapBlob(bool checkHash, uint64_t hash) {
+    if (!mapFile(LEVELS_BLOB)) {
+        return false;
+    }
+    if (!openBlob(checkHash, hash)) {
+        unmapFile();
+        return false;
+    }
+    return true;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool levels_load(void) {
+    levels_unload();
+
+    uint64_t hash = 0;
+    bool hasSource = hashFile(LEVELS_SOURCE, &hash);
+    if (mapBlob(hasSource, hash)) {
+        return true;
+    }
+
+    if (!hasSource || !compileSource(LEVELS_SOURCE, LEVELS_BLOB, hash) || !mapBlob(true, hash)) {
+        printf("Levels: no valid levels in %s or %s!\n", LEVELS_SOURCE, LEVELS_BLOB);
+        return false;
+    }
+    return true;
+}
+
+void levels_unload(void) {
+    unmapFile();
+    g_levels.records = NULL;
+    g_levels.points = NULL;
+    g_levels.count = 0;
+}
+
+int levels_count(void) {
+    return g_levels.count;
+}
+
+bool levels_get(int index, Level *dest) {
+    if (index < 0 || index >= g_levels.count) {
+        return false;
+    }
+
+    const LevelRecord *r = &g_levels.records[index];
+    dest->stars = g_levels.points + r->firstStar;
+    dest->starCount = (int) r->starCount;
+    dest->starRadius = r->starRadius;
+    dest->clouds = g_levels.points + r->firstCloud;
+    dest->cloudCount = (int) r->cloudCount;
+    dest->cloudRadius = r->cloudRadius;
+    dest->buttonCount = r->buttonCount;
+    return true;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file levels.h
+ * @brief Level files: a text source compiled to a memory-mapped binary.
+ *
+ * Levels are written in LEVELS_SOURCE, one block per level:
+ *
+ *     level
+ *     buttons 5
+ *     starRadius 0.05
+ *     cloudRadius 0.08
+ *     star -0.6 -0.2
+ *     cloud 0.1 -0.2
+ *
+ * Lines starting with # are comments, missing radii are LEVEL_STAR_RADIUS
+ * and LEVEL_CLOUD_RADIUS.
+ *
+ * The source is compiled once into LEVELS_BLOB: a LevelFileHeader, a table
+ * of LevelRecord and the positions of all levels as vec2. The blob is keyed
+ * by a hash of the source and rebuilt when the source changes. At startup
+ * the blob is mapped into memory, switching the level only reads its table
+ * entry. A blob without a source is used as is, so generated level sets can
+ * ship without their source.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef LEVELS_H
+#define LEVELS_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Human-readable level source */
+#define LEVELS_SOURCE RESOURCE_PATH "levels/levels.txt"
+
+/** Compiled levels, written next to the program */
+#define LEVELS_BLOB "levels.bin"
+
+/** Default collider radii */
+#define LEVEL_STAR_RADIUS 0.05f
+#define LEVEL_CLOUD_RADIUS 0.08f
+
+/**
+ * Level data.
+ * Defines all properties for a level including:
+ * star positions, cloud positions, collision radii and control point count.
+ * The positions point into the mapped blob and are read-only.
+ */
+typedef struct {
+    vec2 *stars;
+    int starCount;
+    float starRadius;
+    vec2 *clouds;
+    int cloudCount;
+    float cloudRadius;
+    int buttonCount;
+} Level;
+
+/**
+ * Maps the compiled levels, compiles the source first if the blob is
+ * missing or does not match the source.
+ *
+ * @return False if there are no valid levels.
+ */
+bool levels_load(void);
+
+/**
+ * Unmaps the levels. Level data returned before is invalid afterwards.
+ */
+void levels_unload(void);
+
+/**
+ * Returns the number of loaded levels.
+ *
+ * @return Number of levels, 0 if none are loaded.
+ */
+int levels_count(void);
+
+/**
+ * Returns a level from the level table.
+ *
+ * @param index Index of the level
+ * @param dest Destination for the level data
+ * @return False if the index is out of range
+ */
+bool levels_get(int index, Level *dest);
+
+#endif // LEVELS_H
\ No newline at end of file
@@ -4,95 +4,130 @@
  *
  * Manages all game mechanics including:
  * - Airplane movement along the curve with speed along curve slope.
- * - Collision detection (stars, clouds, airplane vertices)
+ * - Swept collision detection (stars, clouds, airplane vertices) with
+ *   spatial buckets, independent of the frame rate
  * - Level progression and win/lose conditions
- * - Six pre-defined levels with increasing difficulty
+ * - Levels read from the level file, see levels.h
  *
  * @authors Nikolaos Tsetsas, Noah Schmidt
  */
 
 #include "logic.h"
 #include "input.h"
+#include "levels.h"
 #include "model.h"
 #include "utils.h"
 
 /** Game constants*/
-#define AIRPLANE_START_T 0.0f
-#define AIRPLANE_COLLIDER_RADIUS 0.03f
-#define AIRPLANE_DEFAULT_SPEED 0.2f
-#define CLOUD_COLLISION_RADIUS 0.08f
-#define STAR_COLLISION_RADIUS 0.05f
+#define AIRPLANE_START_DISTANCE 0.0f
+#define AIRPLANE_DEFAULT_SPEED 0.6f
 
-#define LEVEL_COUNT 6
+/** Longest distance along the curve between two collision tests */
+#define SWEEP_STEP AIRPLANE_COLLIDER_RADIUS
+
+/** Spatial buckets: uniform grid over [-BUCKET_EXTENT, BUCKET_EXTENT]², outside is clamped */
+#define BUCKET_DIM 8
+#define BUCKET_EXTENT 2.0f
+#define BUCKET_CELL_SIZE (2.0f * BUCKET_EXTENT / BUCKET_DIM)
+#define BUCKET_CAPACITY MAX_STARS
 
 /**
- * Level data.
- * Defines all properties for a level including:
- * star positions, cloud positions, collision radii and control point count.
+ * Stars or clouds of a level sorted into grid cells.
+ * The objects of cell c are items[cellStart[c] .. cellStart[c + 1]).
  */
 typedef struct {
-    vec2 *stars;
-    int starCount;
-    float starRadius;
-    vec2 *clouds;
-    int cloudCount;
-    float cloudRadius;
-    int buttonCount;
-} Level;
+    int cellStart[BUCKET_DIM * BUCKET_DIM + 1];
+    int items[BUCKET_CAPACITY];
+    float radius;       // collider radius of the objects
+} Bucket;
 
 ////////////////////////    LOCAL    ////////////////////////////
 
-// Level 1
-static vec2 starsLevel1[]  = { {0.0f, -0.4f} };
-static vec2 cloudsLevel1[] = { 0 }; // none
-
-// Level 2
-static vec2 starsLevel2[]  = { {-0.6f, -0.2f}, {0.2f, 0.2f}, {0.6f, -0.4f} };
-static vec2 cloudsLevel2[] = { { 0.1f, -0.2f } };
-
-// Level 3
-static vec2 starsLevel3[]  = { {-1.0f, 0.7f}, {0.0f, 0.8f} };
-static vec2 cloudsLevel3[] = { {-0.6f, 0.5f}, {0.8f, 0.6f} };
-
-// Level 4
-static vec2 starsLevel4[]  = { {-0.7f, -0.4f}, {-0.3f, 0.2f}, {0.3f, -0.2f}, {0.7f, -0.6f} };
-static vec2 cloudsLevel4[] = { {-0.4f, 0.5f}, {0.2f, 0.7f}, {0.8f, 0.2f} };
-
-// Level 5
-static vec2 starsLevel5[]  = { {-0.8f, -0.6f}, {-0.4f, 0.0f}, {0.0f, 0.6f}, {0.4f, -0.2f}, {0.8f, 0.4f} };
-static vec2 cloudsLevel5[] = { {-0.6f, 0.4f}, {-0.2f, 0.8f}, {0.2f, 0.7f}, {0.6f, 0.8f} };
-
-// Level 6
-static vec2 starsLevel6[] = {
-    {-0.9f,-0.8f}, {-0.8f,-0.6f}, {-0.7f,-0.7f}, {-0.6f,-0.4f}, {-0.5f,-0.2f},
-    {-0.4f, 0.0f}, {-0.3f, 0.2f}, {-0.2f, 0.4f}, {-0.1f, 0.6f}, { 0.0f, 0.8f},
-    { 0.1f, 0.6f}, { 0.2f, 0.4f}, { 0.3f, 0.2f}, { 0.4f, 0.0f}, { 0.5f,-0.2f},
-    { 0.6f,-0.4f}, { 0.7f,-0.6f}, { 0.8f,-0.8f}, { 0.9f,-0.5f}, {-0.9f, 0.5f},
-    {-0.7f, 0.7f}, {-0.5f, 0.8f}, {-0.3f, 0.9f}, {-0.1f,-0.9f}, { 0.1f,-0.7f},
-    { 0.3f,-0.9f}, { 0.5f, 0.9f}, { 0.7f, 0.5f}, { 0.9f, 0.1f}, {-0.8f, 0.1f},
-    {-0.6f, 0.3f}, {-0.4f, 0.5f}, {-0.2f,-0.5f}, { 0.0f,-0.3f}, { 0.2f,-0.1f},
-    { 0.4f, 0.1f}, { 0.6f, 0.3f}, { 0.8f, 0.5f}, { 0.9f,-0.3f}, {-0.9f,-0.1f}
-};
-static vec2 cloudsLevel6[] = { {-0.1f, 0.1f} };
-
 /**
- * Array of all levels
+ * Level used when no level file could be loaded
  */
-static Level levels[LEVEL_COUNT] = {
-    { starsLevel1, 1, STAR_COLLISION_RADIUS, cloudsLevel1, 0, CLOUD_COLLISION_RADIUS, 4 },
-    { starsLevel2, 3, STAR_COLLISION_RADIUS, cloudsLevel2, 1, CLOUD_COLLISION_RADIUS, 5 },
-    { starsLevel3, 2, STAR_COLLISION_RADIUS * 1.7f, cloudsLevel3, 2, CLOUD_COLLISION_RADIUS * 2.5f, 6 },
-    { starsLevel4, 4, STAR_COLLISION_RADIUS, cloudsLevel4, 3, CLOUD_COLLISION_RADIUS, 8 },
-    { starsLevel5, 5, STAR_COLLISION_RADIUS, cloudsLevel5, 4, CLOUD_COLLISION_RADIUS, 10 },
-    { starsLevel6, 40, STAR_COLLISION_RADIUS, cloudsLevel6, 1, CLOUD_COLLISION_RADIUS, 20 } 
-};
-
-/** Current position of airplane along curve [0.0, 1.0] */
-static float g_curveT = AIRPLANE_START_T;
+static vec2 fallbackStars[] = { {0.0f, -0.4f} };
+static Level fallbackLevel = { fallbackStars, 1, LEVEL_STAR_RADIUS, NULL, 0, LEVEL_CLOUD_RADIUS, 4 };
+
+/** Current distance of airplane along curve [0.0, curve length] */
+static float g_curveDist = AIRPLANE_START_DISTANCE;
 
 /** Current level */
 static int g_currLevel = 0;
 
+/** Data of the current level, points into the level file */
+static Level g_level;
+
+/** Spatial buckets of the current level */
+static Bucket g_starBucket, g_cloudBucket;
+
+/**
+ * Grid cell of a position along one axis, clamped to the grid.
+ *
+ * @param v Coordinate
+ * @return Cell index in [0, BUCKET_DIM)
+ */
+static int bucketCell(float v) {
+    int cell = (int) floorf((v + BUCKET_EXTENT) / BUCKET_CELL_SIZE);
+    return glm_imin(glm_imax(cell, 0), BUCKET_DIM - 1);
+}
+
+/**
+ * Sorts positions into the grid cells of a bucket (counting sort).
+ *
+ * @param bucket Bucket to fill
+ * @param pos Object positions
+ * @param n Number of objects, at most BUCKET_CAPACITY
+ * @param radius Collider radius of the objects
+ */
+static void buildBucket(Bucket *bucket, vec2 *pos, int n, float radius) {
+    n = glm_imin(n, BUCKET_CAPACITY);
+    bucket->radius = radius;
+    memset(bucket->cellStart, 0, sizeof(bucket->cellStart));
+
+    int cells[BUCKET_CAPACITY];
+    for (int i = 0; i < n; ++i) {
+        cells[i] = bucketCell(pos[i][1]) * BUCKET_DIM + bucketCell(pos[i][0]);
+        bucket->cellStart[cells[i] + 1]++;
+    }
+
+    for (int c = 0; c < BUCKET_DIM * BUCKET_DIM; ++c) {
+        bucket->cellStart[c + 1] += bucket->cellStart[c];
+    }
+
+    int cursor[BUCKET_DIM * BUCKET_DIM];
+    memcpy(cursor, bucket->cellStart, sizeof(cursor));
+    for (int i = 0; i < n; ++i) {
+        bucket->items[cursor[cells[i]]++] = i;
+    }
+}
+
+/**
+ * Collects the objects of a bucket whose cells overlap a box.
+ * Every object is returned once, as cells do not share objects.
+ *
+ * @param bucket Bucket to search
+ * @param min Lower corner of the box
+ * @param max Upper corner of the box
+ * @param dest Output object indices, room for BUCKET_CAPACITY
+ * @return Number of objects
+ */
+static int queryBucket(const Bucket *bucket, vec2 min, vec2 max, int *dest) {
+    int count = 0;
+    int x0 = bucketCell(min[0] - bucket->radius), x1 = bucketCell(max[0] + bucket->radius);
+    int y0 = bucketCell(min[1] - bucket->radius), y1 = bucketCell(max[1] + bucket->radius);
+
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            int c = y * BUCKET_DIM + x;
+            for (int k = bucket->cellStart[c]; k < bucket->cellStart[c + 1]; ++k) {
+                dest[count++] = bucket->items[k];
+            }
+        }
+    }
+    return count;
+}
+
 /**
  * Copies level data into InputData structure.
  * Updates star positions, cloud positions, collision radii, collection flags
@@ -114,6 +149,9 @@ static void setLevelData(InputData *data, Level *level) {
     data->game.clouds.n = level->cloudCount;
     data->game.clouds.colliderRadius = level->cloudRadius;
 
+    buildBucket(&g_starBucket, level->stars, level->starCount, level->starRadius);
+    buildBucket(&g_cloudBucket, level->clouds, level->cloudCount, level->cloudRadius);
+
     // Reset star collection flags
     for (int i = 0; i < level->starCount; ++i) {
         data->game.collected[i] = false;
@@ -127,6 +165,32 @@ static void setLevelData(InputData *data, Level *level) {
     data->curve.buttonsChanged = true;
 }
 
+/**
+ * Number of playable levels, the fallback level if none are loaded.
+ *
+ * @return Number of levels
+ */
+static int levelCount(void) {
+    return glm_imax(levels_count(), 1);
+}
+
+/**
+ * Makes a level the current one and applies it.
+ * Falls back to the built-in level if the level cannot be read.
+ *
+ * @param data Pointer to InputData to update
+ * @param idx Level index
+ */
+static void selectLevel(InputData *data, int idx) {
+    g_currLevel = idx;
+    if (!levels_get(idx, &g_level)) {
+        g_level = fallbackLevel;
+    }
+    setLevelData(data, &g_level);
+    data->game.currentLevel = g_currLevel;
+    initButtons(g_level.buttonCount);
+}
+
 /**
  * Goes to the next level.
  * Updates level data and puts according control point buttons.
@@ -134,10 +198,7 @@ static void setLevelData(InputData *data, Level *level) {
  * @param data Pointer to InputData to update
  */
 static void loadNextLevel(InputData *data) {
-    g_currLevel = (g_currLevel + 1) % LEVEL_COUNT;
-    setLevelData(data, &levels[g_currLevel]);
-    data->game.currentLevel = g_currLevel;
-    initButtons(levels[g_currLevel].buttonCount);
+    selectLevel(data, (g_currLevel + 1) % levelCount());
 }
 
 /**
@@ -148,27 +209,7 @@ static void loadNextLevel(InputData *data) {
  * @param data Pointer to InputData to update
  */
 static void reloadLevel(InputData *data) {
-    setLevelData(data, &levels[g_currLevel]);
-}
-
-/**
- * Checks for collision between airplane and cloud obstacle.
- * Tests all three airplane vertices against all clouds using circle-circle collision.
- *
- * @param data Pointer to InputData containing airplane and cloud positions
- * @return true if any airplane vertex collides with any cloud, false otherwise
- */
-static bool checkCloudCollision(InputData *data) {
-    for (int c = 0; c < data->game.clouds.n; ++c) {
-        for (int i = 0; i < 3; ++i) {
-            if (utils_circleInCircle(data->game.airplane.vertices[i], data->game.airplane.colliderRadius,
-                               data->game.clouds.pos[c], data->game.clouds.colliderRadius)) {
-                return true;
-            }
-        }
-    }
-
-    return false;
+    setLevelData(data, &g_level);
 }
 
 /**
@@ -196,132 +237,213 @@ static void checkWin(InputData *data) {
 }
 
 /**
- * Updates airplane position, rotation and collision geometry each frame.
- *
- * Physics simulation:
- * 1. Calculate tangent at current curve position for rotation
- * 2. Apply slope-dependent speed (faster downhill, slower uphill)
- * 3. Advance curve parameter based on speed and delta time
- * 4. Evaluate curve position and offset airplane perpendicular to tangent
- * 5. Calculate rotation angle from tangent direction
- * 7. Check for cloud collision and reset if hit
+ * Calculates the airplane pose at a distance along the curve.
+ * The airplane is offset perpendicular to the tangent, its tip points along it.
  *
- * @param data Pointer to InputData containing airplane and game state
+ * @param data Pointer to InputData containing the curve function
  * @param ctrl Array of control points defining the curve
  * @param n Number of control points
+ * @param dist Distance along the curve
+ * @param position Output airplane position
+ * @param angle Output rotation angle (NULL to skip)
+ * @param vertices Output airplane vertices
  */
-static void airplaneUpdate(InputData *data, vec2 *ctrl, int n) {
-    vec2 T;
+static void airplanePose(InputData *data, vec2 *ctrl, int n, float dist,
+                         vec2 position, float *angle, vec2 vertices[3]) {
+    vec2 P = GLM_VEC2_ZERO_INIT, T = GLM_VEC2_ZERO_INIT;
 
-    // Calc tangent
-    utils_getTangent(data->curve.curveEval, ctrl, n, g_curveT, T);
+    // position and tangent on spline
+    data->curve.curveEval(ctrl, n, utils_arcLengthToT(dist), P, T, NULL);
     glm_vec2_normalize(T);
 
-    // slope-dependent speed
-    if (data->game.isFlying) {
-        float slopeInfluence = 1.3f;
-        float slopeFactor = 1.0f - slopeInfluence * T[1];
-        slopeFactor = glm_clamp(slopeFactor, 0.5f, 5.0f);
-        g_curveT += data->deltaTime * data->game.airplane.defaultSpeed * slopeFactor;
-        if (g_curveT >= 1.0f) {
-            g_curveT = AIRPLANE_START_T;
-            data->game.isFlying = false;
-            checkWin(data);
-        }
-    } else {
-        g_curveT = AIRPLANE_START_T;
-    }
-
-    // position on spline
-    vec2 P;
-    data->curve.curveEval(ctrl, n, g_curveT, P, false);
-
     // rotation (tip points along tangent)
-    float angle = atan2f(T[1], T[0]) - (float)M_PI_2;
+    float rotation = atan2f(T[1], T[0]) - (float)M_PI_2;
 
     vec2 offsetDir = { -T[1], T[0] };
-    float offset = 0.05f;
-    vec2 Poffset = { P[0] + offsetDir[0]*offset, P[1] + offsetDir[1]*offset };
-
-    // Update airplane pos and rot
-    data->game.airplane.position[0] = Poffset[0];
-    data->game.airplane.position[1] = Poffset[1];
-    data->game.airplane.rotation = angle;
+    position[0] = P[0] + offsetDir[0] * AIRPLANE_CURVE_OFFSET;
+    position[1] = P[1] + offsetDir[1] * AIRPLANE_CURVE_OFFSET;
 
-    vec2 local[3] = { {0, 0.16f}, {-0.08f, -0.08f}, {0.08f, -0.08f} };
-    float cosA = cosf(angle);
-    float sinA = sinf(angle);
+    vec2 local[3] = AIRPLANE_SHAPE_INIT;
+    float cosA = cosf(rotation);
+    float sinA = sinf(rotation);
 
     for (int i = 0; i < 3; ++i) {
-        data->game.airplane.vertices[i][0] = cosA * local[i][0] - sinA * local[i][1] + Poffset[0];
-        data->game.airplane.vertices[i][1] = sinA * local[i][0] + cosA * local[i][1] + Poffset[1];
+        vertices[i][0] = cosA * local[i][0] - sinA * local[i][1] + position[0];
+        vertices[i][1] = sinA * local[i][0] + cosA * local[i][1] + position[1];
     }
 
-    if (data->game.isFlying && checkCloudCollision(data)) {
-        g_curveT = AIRPLANE_START_T;
-        data->game.isFlying = false;
-        reloadLevel(data);
+    if (angle != NULL) {
+        *angle = rotation;
     }
 }
 
 /**
- * Checks for collision between airplane and collectible stars.
- * Tests all three airplane vertices against all uncollected stars.
- * Marks stars as collected when hit. Only checks during flight.
+ * Tests the paths of the airplane vertices between two poses against a bucket.
+ * Each vertex path is a capsule with the airplane collider radius.
  *
- * @param data Pointer to InputData containing airplane and star positions
+ * @param data Pointer to InputData containing the airplane collider radius
+ * @param bucket Stars or clouds of the level
+ * @param pos Object positions of the bucket
+ * @param from Airplane vertices at the start
+ * @param to Airplane vertices at the end
+ * @param hit Output flags, set for every hit object
+ * @return true if any object was hit
  */
-static void checkStarCollision(InputData *data) {
-    if (!data->game.isFlying) {
-        return;
+static bool sweepBucket(InputData *data, const Bucket *bucket, vec2 *pos,
+                        vec2 from[3], vec2 to[3], bool *hit) {
+    vec2 min = { from[0][0], from[0][1] };
+    vec2 max = { from[0][0], from[0][1] };
+    for (int i = 0; i < 3; ++i) {
+        glm_vec2_minv(min, from[i], min);
+        glm_vec2_minv(min, to[i], min);
+        glm_vec2_maxv(max, from[i], max);
+        glm_vec2_maxv(max, to[i], max);
     }
+    float r = data->game.airplane.colliderRadius;
+    glm_vec2_subs(min, r, min);
+    glm_vec2_adds(max, r, max);
 
-     for (int s = 0; s < data->game.stars.n; ++s) {
-        if (data->game.collected[s]) continue;
+    int candidates[BUCKET_CAPACITY];
+    int count = queryBucket(bucket, min, max, candidates);
 
+    bool any = false;
+    for (int k = 0; k < count; ++k) {
+        int o = candidates[k];
         for (int i = 0; i < 3; ++i) {
-            if (utils_circleInCircle(data->game.airplane.vertices[i], data->game.airplane.colliderRadius,
-                               data->game.stars.pos[s], data->game.stars.colliderRadius)) {
-                data->game.collected[s] = true;
+            if (utils_circleInCapsule(pos[o], bucket->radius, from[i], to[i], r)) {
+                hit[o] = true;
+                any = true;
                 break;
             }
         }
     }
+    return any;
+}
+
+/**
+ * Sweeps the airplane along the curve and handles all collisions on the way.
+ * The path is split into steps of at most SWEEP_STEP, so fast flights and
+ * low frame rates cannot tunnel through stars or clouds.
+ * Collects every star touched before a cloud is hit.
+ *
+ * @param data Pointer to InputData containing airplane, stars and clouds
+ * @param ctrl Array of control points defining the curve
+ * @param n Number of control points
+ * @param from Distance along the curve at the start
+ * @param to Distance along the curve at the end
+ * @return true if a cloud was hit
+ */
+static bool sweepAirplane(InputData *data, vec2 *ctrl, int n, float from, float to) {
+    int steps = glm_imax((int) ceilf((to - from) / SWEEP_STEP), 1);
+
+    vec2 position, prev[3], next[3];
+    airplanePose(data, ctrl, n, from, position, NULL, prev);
+
+    for (int s = 1; s <= steps; ++s) {
+        airplanePose(data, ctrl, n, from + (to - from) * s / steps, position, NULL, next);
+
+        sweepBucket(data, &g_starBucket, data->game.stars.pos, prev, next, data->game.collected);
+
+        bool cloudHit[BUCKET_CAPACITY] = { false };
+        if (sweepBucket(data, &g_cloudBucket, data->game.clouds.pos, prev, next, cloudHit)) {
+            return true;
+        }
+
+        memcpy(prev, next, sizeof(prev));
+    }
+    return false;
+}
+
+/**
+ * Updates airplane position, rotation and collision geometry each frame.
+ *
+ * Physics simulation:
+ * 1. Calculate tangent at current curve position for the slope
+ * 2. Apply slope-dependent speed (faster downhill, slower uphill)
+ * 3. Advance distance along the curve based on speed and delta time,
+ *    the arc length table maps it to the curve parameter
+ * 4. Sweep the airplane over the travelled distance, collect stars
+ *    and reset on a cloud hit
+ * 5. Check the win condition at the end of the curve
+ * 6. Evaluate the pose at the new distance
+ *
+ * @param data Pointer to InputData containing airplane and game state
+ * @param ctrl Array of control points defining the curve
+ * @param n Number of control points
+ */
+static void airplaneUpdate(InputData *data, vec2 *ctrl, int n) {
+    vec2 P = GLM_VEC2_ZERO_INIT, T = GLM_VEC2_ZERO_INIT;
+
+    // Calc tangent
+    data->curve.curveEval(ctrl, n, utils_arcLengthToT(g_curveDist), P, T, NULL);
+    glm_vec2_normalize(T);
+
+    // slope-dependent speed
+    if (data->game.isFlying) {
+        float slopeInfluence = 1.3f;
+        float slopeFactor = 1.0f - slopeInfluence * T[1];
+        slopeFactor = glm_clamp(slopeFactor, 0.5f, 5.0f);
+
+        float length = utils_curveLength();
+        float target = g_curveDist + data->deltaTime * data->game.airplane.defaultSpeed * slopeFactor;
+        bool finished = target >= length;
+        target = glm_min(target, length);
+
+        if (sweepAirplane(data, ctrl, n, g_curveDist, target)) {
+            g_curveDist = AIRPLANE_START_DISTANCE;
+            data->game.isFlying = false;
+            reloadLevel(data);
+        } else if (finished) {
+            g_curveDist = AIRPLANE_START_DISTANCE;
+            data->game.isFlying = false;
+            checkWin(data);
+        } else {
+            g_curveDist = target;
+        }
+    } else {
+        g_curveDist = AIRPLANE_START_DISTANCE;
+    }
+
+    // Update airplane pos and rot
+    airplanePose(data, ctrl, n, g_curveDist, data->game.airplane.position,
+                 &data->game.airplane.rotation, data->game.airplane.vertices);
 }
 
 ////////////////////////    PUBLIC    ////////////////////////////
 
 void logic_update(InputData *data, vec2 *ctrl, int n) {
     airplaneUpdate(data, ctrl, n);
-    checkStarCollision(data);
-    checkCloudCollision(data);
 }
 
 void logic_init() {
     InputData *data = getInputData();
     data->game.airplane.colliderRadius = AIRPLANE_COLLIDER_RADIUS;
     data->game.airplane.defaultSpeed = AIRPLANE_DEFAULT_SPEED;
-    reloadLevel(data);
-    initButtons(levels[g_currLevel].buttonCount);
+    levels_load();
+    selectLevel(data, 0);
+}
+
+void logic_cleanup(void) {
+    levels_unload();
 }
 
 void logic_skipLevel(InputData *data) {
     data->game.isFlying = false;
-    g_curveT = AIRPLANE_START_T;
+    g_curveDist = AIRPLANE_START_DISTANCE;
     loadNextLevel(data);
 }
 
 void logic_restartLevel(InputData *data) {
     data->game.isFlying = false;
-    g_curveT = AIRPLANE_START_T;
+    g_curveDist = AIRPLANE_START_DISTANCE;
     reloadLevel(data);
 }
 
 void loadLevel(int idx, InputData *data) {
     data->game.isFlying = false;
-    g_curveT = AIRPLANE_START_T;
-    g_currLevel = idx;
-    setLevelData(data, &levels[g_currLevel]);
-    data->game.currentLevel = g_currLevel;
-    initButtons(levels[g_currLevel].buttonCount);
+    g_curveDist = AIRPLANE_START_DISTANCE;
+    if (idx < 0 || idx >= levelCount()) {
+        return;
+    }
+    selectLevel(data, idx);
 }
@@ -5,7 +5,7 @@
  * Functions for game state, level progression and airplane "physics".
  * Handles collision detection, level loading and win/lose conditions.
  *
- * The game consists of 6 levels with varying difficulty:
+ * The levels are read from the level file (see levels.h) and consist of:
  * - Collectible stars (must collect all to win)
  * - Cloud obstacles (collision causes level restart)
  * - Airplane follows the curve with slope-dependent speed
@@ -19,6 +19,15 @@
 #include <fhwcg/fhwcg.h>
 #include "input.h"
 
+/** Airplane collider radius, also the radius of the swept vertex paths */
+#define AIRPLANE_COLLIDER_RADIUS 0.03f
+
+/** Distance of the airplane from the curve along the curve normal */
+#define AIRPLANE_CURVE_OFFSET 0.05f
+
+/** Airplane triangle in local coordinates, the tip points along the tangent (+y) */
+#define AIRPLANE_SHAPE_INIT { {0.0f, 0.16f}, {-0.08f, -0.08f}, {0.08f, -0.08f} }
+
 /**
  * Updates game logic per frame - called in rendering_draw().
  * Updates airplane position and rotation along the curve
@@ -39,10 +48,16 @@ void logic_update(InputData *data, vec2 *ctrl, int n);
  */
 void logic_init();
 
+/**
+ * Releases the level file.
+ * Called once during program shutdown.
+ */
+void logic_cleanup(void);
+
 /**
  * Skips to the next level.
  * Stops airplane flight, resets curve parameter and loads the next level.
- * Wraps around to level 1 after level 6.
+ * Wraps around to level 1 after the last level.
  *
  * @param data Pointer to InputData to update game state
  */
@@ -60,7 +75,7 @@ void logic_restartLevel(InputData *data);
 /**
  * Loads a specific level by index.
  * Stops airplane flight, resets curve parameter and loads level configuration.
- * Used for level selection via num keys.
+ * Used for level selection via num keys, indices without a level are ignored.
  *
  * @param idx Level index
  * @param data Pointer to InputData to update game state
@@ -10,9 +10,13 @@
 
 #include <fhwcg/fhwcg.h>
 #include "gui.h"
+#include "guicache.h"
+#include "gpumem.h"
 #include "input.h"
+#include "idle.h"
 #include "rendering.h"
 #include "model.h"
+#include "shader.h"
 #include "logic.h"
 
 #define DEFAULT_WINDOW_WIDTH 700
@@ -28,12 +32,31 @@ static void init(ProgContext ctx) {
     rendering_init();
     rendering_resize(DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT, BUTTON_COUNT);
     logic_init();
+
+    // The game changes these without input
+    InputData *d = getInputData();
+    guicache_watch(&d->game.currentLevel, sizeof(d->game.currentLevel));
+    guicache_watch(d->game.collected, sizeof(d->game.collected));
+    guicache_watch(&d->game.isFlying, sizeof(d->game.isFlying));
+}
+
+/**
+ * Checks whether the scene changes without input.
+ * The clouds drift and the airplane flies until the game is paused.
+ *
+ * @return true if the next frame differs from the last one
+ */
+static bool isSceneBusy(void) {
+    return !getInputData()->paused;
 }
 
 static void cleanup(ProgContext ctx) {
     gui_cleanup(ctx);
+    logic_cleanup();
     model_cleanup();
+    guicache_cleanup();
     rendering_cleanup();
+    gpumem_cleanup();
     window_cleanup(ctx);
 }
 
@@ -54,16 +77,20 @@ int main(void) {
 
     // rendering loop
     while (window_startNewFrame(ctx)) {
-        
-        getInputData()->deltaTime = getInputData()->paused ? 0.0f : (float) window_getDeltaTime(ctx);
+        input_flushEvents(ctx);
+
+        float dt = idle_frameTime((float) window_getDeltaTime(ctx));
+        getInputData()->deltaTime = getInputData()->paused ? 0.0f : dt;
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         rendering_draw();
-        gui_render(ctx, gui_renderContent);
+        guicache_render(ctx, gui_renderContent, shader_setGuiComposite);
 
         // switch front- and back-buffer
         window_swapBuffers(ctx);
+        idle_endFrame(isSceneBusy());
+        idle_wait();
     }
 
     cleanup(ctx);
@@ -3,7 +3,8 @@
  * @brief Implementation of model creation and rendering.
  *
  * Creates unit models (circle, square, star, triangle) as static
- * meshes and manages a curve with VAO/VBO for real-time updates.
+ * meshes and instanced sprites and manages a curve with VAO/VBO for
+ * real-time updates, or a segment block for evaluation in the shader.
  * Handles vertex setup and buffer updates.
  *
  * @authors Nikolaos Tsetsas, Noah Schmidt
@@ -13,6 +14,7 @@
 #include "shader.h"
 #include "rendering.h"
 #include "input.h"
+#include "utils.h"
 
 #define CIRCLE_VERTEX_COUNT 64
 #define STAR_VERTEX_COUNT 10
@@ -23,8 +25,87 @@
 /** Array of pointers to mesh models (circle, square, star, triangle) */
 static Mesh *g_models[MODEL_MESH_COUNT];
 
-/** VAO and VBO for curve */
-static GLuint g_curveVAO = 0, g_curveVBO = 0;
+/**
+ * Instanced sprite geometry per model type.
+ * Only the circle and the star have sprites, vao is 0 otherwise.
+ */
+static struct {
+    GLuint vao, vbo, instanceVBO;
+    int numVertices;
+    GLenum mode;
+} g_sprites[MODEL_MESH_COUNT];
+
+/** VAOs and VBOs for the curve buffers */
+static GLuint g_curveVAO[CURVE_BUFFER_COUNT], g_curveVBO[CURVE_BUFFER_COUNT];
+
+/** Shape of the last update of each curve buffer, for the thick line joins and normals */
+static struct {
+    bool closed;
+    bool hasNormals;
+} g_curveShape[CURVE_BUFFER_COUNT];
+
+/**
+ * Curve evaluated in the vertex shader: an empty VAO, the vertices
+ * come from gl_VertexID, and the segment coefficients as uniform block.
+ */
+static struct {
+    GLuint vao, ubo;
+    int numSegments;
+} g_curveGpu;
+
+/**
+ * Sets the position, normal and texture coordinate attributes
+ * of the Vertex layout for the bound VAO and VBO.
+ */
+static void setupVertexAttribs(void) {
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+}
+
+/**
+ * Creates the instanced sprite of a model from its vertices.
+ * Instance attributes (locations 3-5) come from a separate buffer.
+ *
+ * @param model The model type
+ * @param vertices Vertices of the unit model
+ * @param numVertices Number of vertices
+ * @param mode OpenGL primitive mode
+ */
+static void model_initSprite(ModelType model, const Vertex *vertices, int numVertices, GLenum mode) {
+    glGenVertexArrays(1, &g_sprites[model].vao);
+    glGenBuffers(1, &g_sprites[model].vbo);
+    glGenBuffers(1, &g_sprites[model].instanceVBO);
+    g_sprites[model].numVertices = numVertices;
+    g_sprites[model].mode = mode;
+
+    glBindVertexArray(g_sprites[model].vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_sprites[model].vbo);
+    glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(Vertex), vertices, GL_STATIC_DRAW);
+    setupVertexAttribs();
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_sprites[model].instanceVBO);
+
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)offsetof(SpriteInstance, transform));
+    glVertexAttribDivisor(3, 1);
+
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)offsetof(SpriteInstance, anim));
+    glVertexAttribDivisor(4, 1);
+
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)offsetof(SpriteInstance, color));
+    glVertexAttribDivisor(5, 1);
+
+    glBindVertexArray(0);
+}
 
 /**
  * Creates a unit square mesh in the xy-plane.
@@ -65,6 +146,7 @@ static void model_initCircle(void) {
 
     circleVertices[CIRCLE_VERTEX_COUNT + 1] = circleVertices[1];
     g_models[MODEL_CIRCLE] = mesh_createMesh("Circle", circleVertices, CIRCLE_VERTEX_COUNT + 2, NULL, 0, GL_TRIANGLE_FAN);
+    model_initSprite(MODEL_CIRCLE, circleVertices, CIRCLE_VERTEX_COUNT + 2, GL_TRIANGLE_FAN);
 }
 
 /**
@@ -91,6 +173,7 @@ static void model_initStar(void) {
     starVertices[STAR_VERTEX_COUNT + 1] = starVertices[1];
 
     g_models[MODEL_STAR] = mesh_createMesh("Star", starVertices, STAR_VERTEX_COUNT + 2, NULL, 0, GL_TRIANGLE_FAN);
+    model_initSprite(MODEL_STAR, starVertices, STAR_VERTEX_COUNT + 2, GL_TRIANGLE_FAN);
 }
 
 /**
@@ -108,29 +191,64 @@ static void model_initTriangle(void) {
 }
 
 /**
- * Initializes the curve's VAO and VBO.
+ * Initializes the VAO and VBO of a curve buffer.
+ * @param buffer The curve buffer.
+ * @param maxVertices Number of vertices to reserve.
  */
-static void model_initCurve(void) {
-    glGenVertexArrays(1, &g_curveVAO);
-    glGenBuffers(1, &g_curveVBO);
+static void model_initCurve(CurveBuffer buffer, int maxVertices) {
+    glGenVertexArrays(1, &g_curveVAO[buffer]);
+    glGenBuffers(1, &g_curveVBO[buffer]);
 
-    glBindVertexArray(g_curveVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, g_curveVBO);
+    glBindVertexArray(g_curveVAO[buffer]);
+    glBindBuffer(GL_ARRAY_BUFFER, g_curveVBO[buffer]);
 
     // dynamic draw and reservation for largest possible curve
-    glBufferData(GL_ARRAY_BUFFER, CURVE_MAX_VERTICES * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, maxVertices * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    setupVertexAttribs();
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glBindVertexArray(0);
+}
 
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+/**
+ * Writes a range of vertices into a curve buffer.
+ *
+ * @param buffer The curve buffer.
+ * @param vertices Vertex positions of the whole curve.
+ * @param normalVertices Normals of the whole curve (NULL for none).
+ * @param first Index of the first vertex to write.
+ * @param numVertices Number of vertices to write.
+ * @param invalidate Map flag invalidating the old contents.
+ */
+static void writeCurve(CurveBuffer buffer, vec2 *vertices, vec3 *normalVertices,
+                       int first, int numVertices, GLbitfield invalidate) {
+    // Write straight into the buffer, no staging copy
+    glBindBuffer(GL_ARRAY_BUFFER, g_curveVBO[buffer]);
+    Vertex *curveData = glMapBufferRange(
+        GL_ARRAY_BUFFER, first * sizeof(Vertex), numVertices * sizeof(Vertex),
+        GL_MAP_WRITE_BIT | invalidate
+    );
+    if (curveData == NULL) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+
+    for (int i = 0; i < numVertices; ++i) {
+        int v = first + i;
+        curveData[i].position[0] = vertices[v][0];
+        curveData[i].position[1] = vertices[v][1];
+        curveData[i].position[2] = 0.0f;
 
+        curveData[i].normal[0] = (normalVertices == NULL) ? 0 : normalVertices[v][0];
+        curveData[i].normal[1] = (normalVertices == NULL) ? 0 : normalVertices[v][1];
+        curveData[i].normal[2] = (normalVertices == NULL) ? 0 : normalVertices[v][2];
 
-    glBindVertexArray(0);
+        curveData[i].texCoords[0] = 0.0f;
+        curveData[i].texCoords[1] = 0.0f;
+    }
+
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 
@@ -141,7 +259,15 @@ void model_init(void) {
     model_initSquare();
     model_initStar();
     model_initTriangle();
-    model_initCurve();
+    model_initCurve(CURVE_BUFFER_CURVE, CURVE_MAX_VERTICES);
+    model_initCurve(CURVE_BUFFER_POLYGON, BUTTON_COUNT);
+    model_initCurve(CURVE_BUFFER_HULL, BUTTON_COUNT + 1);
+
+    glGenVertexArrays(1, &g_curveGpu.vao);
+    glGenBuffers(1, &g_curveGpu.ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, g_curveGpu.ubo);
+    glBufferData(GL_UNIFORM_BUFFER, CURVE_MAX_SEGMENTS * CURVE_SEGMENT_FLOATS * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
 void model_cleanup(void) {
@@ -153,9 +279,23 @@ void model_cleanup(void) {
         mesh_disposeMesh(&(g_models[i]));
         g_models[i] = NULL;
     }
+
+    for (int i = 0; i < MODEL_MESH_COUNT; ++i) {
+        if (g_sprites[i].vao == 0) {
+            continue;
+        }
+
+        glDeleteBuffers(1, &g_sprites[i].vbo);
+        glDeleteBuffers(1, &g_sprites[i].instanceVBO);
+        glDeleteVertexArrays(1, &g_sprites[i].vao);
+        g_sprites[i].vao = 0;
+    }
     
-    glDeleteBuffers(1, &g_curveVBO);
-    glDeleteVertexArrays(1, &g_curveVAO);
+    glDeleteBuffers(CURVE_BUFFER_COUNT, g_curveVBO);
+    glDeleteVertexArrays(CURVE_BUFFER_COUNT, g_curveVAO);
+
+    glDeleteBuffers(1, &g_curveGpu.ubo);
+    glDeleteVertexArrays(1, &g_curveGpu.vao);
 }
 
 void model_draw(ModelType model) {
@@ -167,36 +307,92 @@ void model_draw(ModelType model) {
     mesh_drawMesh(g_models[model]);
 }
 
-void model_drawCurve(int numVertices, float lineWidth) {
-    glBindVertexArray(g_curveVAO);
+void model_drawSprites(ModelType model, const SpriteInstance *instances, int count) {
+    if (model >= MODEL_MESH_COUNT || g_sprites[model].vao == 0 || count <= 0) {
+        return;
+    }
 
-    shader_setMVP();
-    glLineWidth(lineWidth);
-    glDrawArrays(GL_LINE_STRIP, 0, numVertices);
+    // Orphan the instance buffer, the data changes every frame
+    glBindBuffer(GL_ARRAY_BUFFER, g_sprites[model].instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(SpriteInstance), instances, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    if (getInputData()->curve.showNormals) {
-        shader_setNormals();
-        glDrawArrays(GL_POINTS, 0, numVertices);
+    glBindVertexArray(g_sprites[model].vao);
+    glDrawArraysInstanced(g_sprites[model].mode, 0, g_sprites[model].numVertices, count);
+    glBindVertexArray(0);
+}
+
+void model_drawCurve(CurveBuffer buffer, int numVertices, float lineWidth, vec3 color) {
+    if (numVertices < 2 ||
+        !shader_setThickLine(numVertices, g_curveShape[buffer].closed, lineWidth, color)) {
+        return;
     }
 
+    // Segments first, the normals follow as further instances of the same draw
+    int instances = numVertices - 1;
+    if (g_curveShape[buffer].hasNormals && getInputData()->curve.showNormals) {
+        instances += numVertices;
+    }
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, g_curveVBO[buffer]);
+    glBindVertexArray(g_curveVAO[buffer]);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, instances);
     glBindVertexArray(0);
+
+    glDisable(GL_BLEND);
 }
 
-void model_updateCurve(vec2 *vertices, vec3 *normalVertices, int numVertices) {
-    Vertex curveData[CURVE_MAX_VERTICES];
+void model_updateCurve(CurveBuffer buffer, vec2 *vertices, vec3 *normalVertices, int numVertices) {
+    if (numVertices <= 0) {
+        return;
+    }
 
-    for (int i = 0; i < numVertices; ++i) {
-        curveData[i].position[0] = vertices[i][0];
-        curveData[i].position[1] = vertices[i][1];
-        curveData[i].position[2] = 0.0f;
+    writeCurve(buffer, vertices, normalVertices, 0, numVertices, GL_MAP_INVALIDATE_BUFFER_BIT);
+    g_curveShape[buffer].closed = numVertices > 2 &&
+        glm_vec2_distance2(vertices[0], vertices[numVertices - 1]) < EPSILON * EPSILON;
+    g_curveShape[buffer].hasNormals = normalVertices != NULL;
+}
 
-        curveData[i].normal[0] = (normalVertices == NULL) ? 0 : normalVertices[i][0];
-        curveData[i].normal[1] = (normalVertices == NULL) ? 0 : normalVertices[i][1];
-        curveData[i].normal[2] = (normalVertices == NULL) ? 0 : normalVertices[i][2];
+void model_updateCurveRange(CurveBuffer buffer, vec2 *vertices, vec3 *normalVertices, int first, int numVertices) {
+    if (numVertices <= 0) {
+        return;
+    }
+
+    // The rest of the buffer stays valid
+    writeCurve(buffer, vertices, normalVertices, first, numVertices, GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+void model_updateCurveSegments(const float *coeffs, int numSegments) {
+    g_curveGpu.numSegments = glm_clamp(numSegments, 0, CURVE_MAX_SEGMENTS);
+    if (g_curveGpu.numSegments == 0) {
+        return;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, g_curveGpu.ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, g_curveGpu.numSegments * CURVE_SEGMENT_FLOATS * sizeof(float), coeffs);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void model_drawCurveGpu(int numVertices, float step, float lineWidth, vec3 color) {
+    if (g_curveGpu.numSegments == 0 || numVertices < 2) {
+        return;
+    }
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, g_curveGpu.ubo);
+    glBindVertexArray(g_curveGpu.vao);
+
+    if (shader_setCurveEval(g_curveGpu.numSegments, numVertices, step, color)) {
+        glLineWidth(lineWidth);
+        glDrawArrays(GL_LINE_STRIP, 0, numVertices);
+    }
+
+    if (getInputData()->curve.showNormals &&
+        shader_setCurveEvalNormals(g_curveGpu.numSegments, numVertices, step)) {
+        glDrawArrays(GL_POINTS, 0, numVertices);
     }
 
-    glBindVertexArray(g_curveVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, g_curveVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, numVertices * sizeof(Vertex), curveData);
     glBindVertexArray(0);
 }
@@ -34,14 +34,36 @@ typedef enum {
 } ModelType;
 
 /**
- * Initializes all models. Creates  meshes (circle, square, star, triangle)
- * and VAO/VBO for curve model.
+ * Per-instance data of an instanced sprite.
+ * Drift and rotation are evaluated in the vertex shader from the time.
+ */
+typedef struct {
+    vec4 transform;  // offset x/y, scale x/y
+    vec4 anim;       // drift amplitude, drift phase, rotation speed, rotation offset
+    vec3 color;
+} SpriteInstance;
+
+/**
+ * Line strip buffers of MODEL_CURVE.
+ * Each one keeps its own VBO, so a buffer is only rewritten when its
+ * geometry changes.
+ */
+typedef enum {
+    CURVE_BUFFER_CURVE,
+    CURVE_BUFFER_POLYGON,
+    CURVE_BUFFER_HULL,
+    CURVE_BUFFER_COUNT
+} CurveBuffer;
+
+/**
+ * Initializes all models. Creates  meshes (circle, square, star, triangle),
+ * instanced sprites (circle, star) and VAO/VBO for curve model.
  */
 void model_init(void);
 
 /**
  * Cleans up all model resources.
- * Disposes meshes and deletes curve VAO/VBO.
+ * Disposes meshes and deletes curve VAOs/VBOs.
  */
 void model_cleanup(void);
 
@@ -55,22 +77,70 @@ void model_cleanup(void);
 void model_draw(ModelType model);
 
 /**
- * Draws the curve as a line strip.
- * Also renders normal vectors if enabled in settings.
+ * Draws instances of a model in one draw call with the sprite shader.
+ * The sprite shader has to be active (see shader_setSpriteData).
  *
+ * @param model The model type to draw (MODEL_CIRCLE or MODEL_STAR)
+ * @param instances Per-instance offset, scale, animation and color
+ * @param count Number of instances
+ */
+void model_drawSprites(ModelType model, const SpriteInstance *instances, int count);
+
+/**
+ * Draws a curve buffer as an antialiased thick line strip in one draw.
+ * The segments are expanded to mitered screen space quads in the shader,
+ * so the width does not depend on glLineWidth.
+ * Also renders normal vectors if enabled in settings and the buffer has some.
+ *
+ * @param buffer The curve buffer to draw
  * @param numVertices Number of vertices in the curve
- * @param lineWidth Width of the curve line
+ * @param lineWidth Width of the curve line in pixels
+ * @param color Color of the curve line
  */
-void model_drawCurve(int numVertices, float lineWidth);
+void model_drawCurve(CurveBuffer buffer, int numVertices, float lineWidth, vec3 color);
 
 /**
- * Updates the curve vertex buffer with new positions and normals
- * for dynamic rendering.
+ * Updates a curve vertex buffer with new positions and normals.
+ * The buffer keeps its contents until the next update.
  *
+ * @param buffer The curve buffer to update
  * @param vertices 2D Vector of vertex positions
- * @param normalVertices 3D Vector of 3D normal vectors
+ * @param normalVertices 3D Vector of 3D normal vectors (NULL for none)
+ * @param numVertices Number of vertices to update
+ */
+void model_updateCurve(CurveBuffer buffer, vec2 *vertices, vec3 *normalVertices, int numVertices);
+
+/**
+ * Updates a range of a curve vertex buffer, the other vertices are kept.
+ * The closed state of the buffer is the one of the last full update.
+ *
+ * @param buffer The curve buffer to update
+ * @param vertices 2D Vector of the positions of the whole curve
+ * @param normalVertices 3D Vector of the normals of the whole curve (NULL for none)
+ * @param first Index of the first vertex to update
  * @param numVertices Number of vertices to update
  */
-void model_updateCurve(vec2 *vertices, vec3 *normalVertices, int numVertices);
+void model_updateCurveRange(CurveBuffer buffer, vec2 *vertices, vec3 *normalVertices, int first, int numVertices);
+
+/**
+ * Uploads the segment coefficients for the evaluation in the shader.
+ *
+ * @param coeffs Coefficients, CURVE_SEGMENT_FLOATS per segment (see utils_getSegments)
+ * @param numSegments Number of segments
+ */
+void model_updateCurveSegments(const float *coeffs, int numSegments);
+
+/**
+ * Draws the curve of the uploaded segments as a line strip, every vertex
+ * is evaluated in the vertex shader. Changing the resolution only changes
+ * numVertices and step, nothing is uploaded.
+ * Also renders normal vectors if enabled in settings.
+ *
+ * @param numVertices Number of vertices, the last one ends on T = 1
+ * @param step Parameter distance of two vertices
+ * @param lineWidth Width of the curve line
+ * @param color Color of the curve
+ */
+void model_drawCurveGpu(int numVertices, float step, float lineWidth, vec3 color);
 
 #endif // MODEL_H
\ No newline at end of file
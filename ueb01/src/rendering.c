@@ -18,7 +18,9 @@
 #include "model.h"
 #include "shader.h"
 #include "utils.h"
-#include "logic.h"
+#include "curvesample.h"
+#include "logic.h"
+#include "instrument.h"
 
 /** Button management*/
 #define BUTTON_DETECTION_RANGE 0.8f
@@ -52,13 +54,27 @@
 #define CLOUD_TOP_SIZE 0.75f
 #define CLOUD_FAR_SIZE 0.6f
 
+/** Cloud drift animation */
+#define CLOUD_DRIFT_AMPLITUDE 0.015f
+#define CLOUD_DRIFT_SPEED 0.3f
+#define CLOUD_DRIFT_PHASE 1.5f
+
+/** Number of circles per cloud */
+#define CLOUD_PUFF_COUNT 8
+
+/** Maximum number of sprites per instanced draw */
+#define MAX_SPRITES 512
+
 ////////////////////////    LOCAL    ////////////////////////////
 
 /** Global rendering data (viewport, projection bounds, screen resolution) */
 static RenderingData g_renderingData;
 
-/** Pointer to the button currently being dragged (NULL if none) */
-static Circle *g_draggedButton = NULL;
+/** Button interaction, updated by the mouse events */
+static struct {
+    int hovered;    // index of the button under the mouse, -1 if none
+    int dragged;    // index of the button being dragged, -1 if none
+} g_buttonState = {-1, -1};
 
 /** Flag if buttons have been initialized */
 static bool g_buttonInitialized = false;
@@ -69,6 +85,16 @@ static Circle *g_buttons[BUTTON_COUNT];
 /** Storage array for all button data */
 static Circle g_buttonStorage[BUTTON_COUNT];
 
+/** Convex hull in CURVE_BUFFER_HULL, rebuilt when a button moves */
+static struct {
+    int count;
+    int buttonCount;
+    bool valid;
+} g_hull;
+
+/** Instance data of the current sprite draw */
+static SpriteInstance g_spriteInstances[MAX_SPRITES];
+
 /** VAO and VBO for background gradient quad*/
 static GLuint g_backgroundVAO = 0, g_backgroundVBO = 0;
 
@@ -77,106 +103,119 @@ static GLuint g_backgroundVAO = 0, g_backgroundVBO = 0;
  */
 static struct {
     vec2 vertices[CURVE_MAX_VERTICES];
+    vec2 tangents[CURVE_MAX_VERTICES];      // adaptive tessellation only
     vec3 normalVertices[CURVE_MAX_VERTICES];
     int numVertices;
 } curve;
 
 /**
- * Handles mouse interaction with control point buttons.
+ * Appends a sprite instance to g_spriteInstances.
  *
- * Detects button clicks/drags, updates button positions during dragging,
- * and draws all buttons with colors based on state:
- * - Black: disabled (first/last button or during flight)
- * - Magenta: currently being dragged
- * - Red: hovered
- * - White: normal state
- *
- * First and last buttons are fixed and cannot be dragged.
- * Button dragging is clamped to stay within screen bounds.
- *
- * @param data Pointer to InputData containing mouse state and settings
+ * @param count Number of instances so far
+ * @param pos Center of the sprite
+ * @param scaleX Scale in x direction
+ * @param scaleY Scale in y direction
+ * @param anim Drift amplitude, drift phase, rotation speed and rotation offset
+ * @param color Color of the sprite
+ * @return New number of instances
  */
-static void checkAndDrawButtons(InputData *data) {
-    bool foundSelected = false;
-
-    debug_pushRenderScope("Buttons");
-    scene_pushMatrix();
+static int addSprite(int count, vec2 pos, float scaleX, float scaleY, vec4 anim, vec3 color) {
+    if (count >= MAX_SPRITES) {
+        return count;
+    }
 
-    int btnCnt = data->curve.buttonCount;
+    SpriteInstance *s = &g_spriteInstances[count];
+    s->transform[0] = pos[0];
+    s->transform[1] = pos[1];
+    s->transform[2] = scaleX;
+    s->transform[3] = scaleY;
+    glm_vec4_copy(anim, s->anim);
+    glm_vec3_copy(color, s->color);
+    return count + 1;
+}
 
-    // Loop through all buttons
-    for (int i = 0; i < btnCnt; ++i) {
-        scene_pushMatrix();
-        Circle *btn = g_buttons[i];
+/**
+ * Tests if a button can be dragged.
+ * First and last buttons are fixed, all buttons are fixed during flight.
+ *
+ * @param data Pointer to InputData containing the button count and game state
+ * @param i Index of the button
+ * @return True if the button can be dragged
+ */
+static bool isButtonEnabled(InputData *data, int i) {
+    return i > 0 && i < data->curve.buttonCount - 1 && !data->game.isFlying;
+}
 
-        // Handle disabled buttons
-        if (i == 0 || i == btnCnt - 1 || data->game.isFlying) {
-            shader_setColor(BUTTON_DISABLED_COLOR);
-            scene_translate(btn->center[0], btn->center[1], 0);
-            scene_scale(btn->r, btn->r, 1);
-            model_draw(MODEL_CIRCLE);
+/**
+ * Converts a mouse position in window coordinates to scene coordinates.
+ *
+ * @param x Mouse X coordinate
+ * @param y Mouse Y coordinate
+ * @param dest Output position in the scene
+ */
+static void screenToScene(float x, float y, vec2 dest) {
+    float mouseX_ndc = x / g_renderingData.screenRes[0];
+    float mouseY_ndc = 1.0f - y / g_renderingData.screenRes[1];
+    dest[0] = g_renderingData.left + mouseX_ndc * (g_renderingData.right - g_renderingData.left);
+    dest[1] = g_renderingData.bottom + mouseY_ndc * (g_renderingData.top - g_renderingData.bottom);
+}
 
-            scene_popMatrix();
+/**
+ * Finds the first enabled button under the mouse.
+ *
+ * @param data Pointer to InputData containing the button count and game state
+ * @param mouse Mouse position in scene coordinates
+ * @return Index of the button, -1 if none
+ */
+static int findButton(InputData *data, vec2 mouse) {
+    for (int i = 0; i < data->curve.buttonCount; ++i) {
+        if (!isButtonEnabled(data, i)) {
             continue;
         }
 
-        // Check if mouse over this button
-        bool isInside = utils_isMouseInCircle(data->mouse.xPos, data->mouse.yPos, btn, &g_renderingData, BUTTON_DETECTION_RANGE);
-
-        // Handle mouse press / dragging
-        if (data->mouse.action == GLFW_PRESS && isInside && !g_draggedButton) {
-            g_draggedButton = btn;
-            foundSelected = true;
+        float radius = BUTTON_DETECTION_RANGE * g_buttons[i]->r;
+        if (glm_vec2_distance2(mouse, g_buttons[i]->center) <= radius * radius) {
+            return i;
         }
+    }
+    return -1;
+}
 
-        // Handle mouse stop drag
-        if (data->mouse.action == GLFW_RELEASE && g_draggedButton == btn) {
-            g_draggedButton = NULL;
-        }
-
-        // Button colors
-        if (!foundSelected && isInside) {
-            foundSelected = true;
-            if (data->mouse.button == GLFW_MOUSE_BUTTON_LEFT && data->mouse.action == GLFW_PRESS && g_draggedButton == btn) {
-                shader_setColor(BUTTON_SELECTED_COLOR);
-            } else if (g_draggedButton == NULL) {
-                shader_setColor(BUTTON_HOVER_COLOR);
-            } else {
-                shader_setColor(BUTTON_NORMAL_COLOR);
-            }
-        } else {
-            shader_setColor(BUTTON_NORMAL_COLOR);
-        }
-
-        // update drag position
-        if (g_draggedButton == btn && data->mouse.action != GLFW_RELEASE) {
-
-            // Convert mouse screen coord to world
-            float mouseX_ndc = (float)data->mouse.xPos / g_renderingData.screenRes[0];
-            float mouseY_ndc = 1.0f - (float)data->mouse.yPos / g_renderingData.screenRes[1];
-            float sceneX = g_renderingData.left + mouseX_ndc * (g_renderingData.right - g_renderingData.left);
-            float sceneY = g_renderingData.bottom + mouseY_ndc * (g_renderingData.top - g_renderingData.bottom);
+/**
+ * Draws all control point buttons in one instanced draw call.
+ * Colors by the state of the last mouse event:
+ * - Black: disabled (first/last button or during flight)
+ * - Magenta: currently being dragged
+ * - Red: hovered
+ * - White: normal state
+ *
+ * @param data Pointer to InputData containing the button count and game state
+ */
+static void drawButtons(InputData *data) {
+    INSTRUMENT_PUSH_LABEL("Buttons");
 
-            // Clamp button pos
-            float d = BUTTON_DRAG_EDGE_DISTANCE;
-            btn->center[0] = glm_clamp(sceneX, g_renderingData.left + d, g_renderingData.right - d);
-            btn->center[1] = glm_clamp(sceneY, g_renderingData.bottom + d, g_renderingData.top - d);
+    int count = 0;
+    for (int i = 0; i < data->curve.buttonCount; ++i) {
+        Circle *btn = g_buttons[i];
 
-            // Mark curve for recalc
-            data->curve.buttonsChanged = true;
-            shader_setColor(BUTTON_SELECTED_COLOR);
+        vec3 color;
+        if (!isButtonEnabled(data, i)) {
+            glm_vec3_copy(BUTTON_DISABLED_COLOR, color);
+        } else if (g_buttonState.dragged == i) {
+            glm_vec3_copy(BUTTON_SELECTED_COLOR, color);
+        } else if (g_buttonState.hovered == i && g_buttonState.dragged < 0) {
+            glm_vec3_copy(BUTTON_HOVER_COLOR, color);
+        } else {
+            glm_vec3_copy(BUTTON_NORMAL_COLOR, color);
         }
 
-        // Render button
-        scene_translate(btn->center[0], btn->center[1], 0);
-        scene_scale(btn->r, btn->r, 1);
-        model_draw(MODEL_CIRCLE);
-
-        scene_popMatrix();
+        count = addSprite(count, btn->center, btn->r, btn->r, GLM_VEC4_ZERO, color);
     }
 
-    scene_popMatrix();
-    debug_popRenderScope();
+    shader_setSpriteData(0.0f, 0.0f, false);
+    model_drawSprites(MODEL_CIRCLE, g_spriteInstances, count);
+
+    INSTRUMENT_POP_LABEL();
 }
 
 /**
@@ -191,19 +230,60 @@ static void checkAndDrawButtons(InputData *data) {
 static void drawControlPolygon(vec2 *ctrl, int n) {
     scene_pushMatrix();
 
-    model_updateCurve(ctrl, NULL, n);
-    shader_setColor(VEC3(0,1,1));
-    model_drawCurve(n, 2.0f);
+    model_updateCurve(CURVE_BUFFER_POLYGON, ctrl, NULL, n);
+    model_drawCurve(CURVE_BUFFER_POLYGON, n, 2.0f, VEC3(0,1,1));
 
     scene_popMatrix();
 }
 
+/**
+ * Number of uniform samples of the curve for a step size.
+ * Vertex k lies at T = k * step, the last one always on T = 1.
+ *
+ * @param step Resolution step size for curve sampling
+ * @return Number of vertices
+ */
+static int uniformVertexCount(float step) {
+    return glm_clamp((int) floorf(1.0f / step + 1e-4f) + 1, 2, CURVE_MAX_VERTICES);
+}
+
+/**
+ * Samples a range of the uniform curve vertices with their normals into
+ * curve.vertices and curve.normalVertices in one batch.
+ * curve.numVertices has to be set.
+ *
+ * @param data Pointer to InputData containing the curve function
+ * @param ctrl 2D vector of control point positions
+ * @param n Number of control points
+ * @param step Resolution step size for curve sampling
+ * @param first Index of the first vertex
+ * @param last Index of the last vertex (inclusive)
+ */
+static void sampleCurve(InputData *data, vec2 *ctrl, int n, float step, int first, int last) {
+    // One evaluation updates the coefficients
+    vec2 p;
+    data->curve.curveEval(ctrl, n, 0.0f, p, NULL, &data->curve.buttonsChanged);
+
+    int numSegments;
+    const float *coeffs = utils_getSegments(&numSegments);
+    if (numSegments < 1) {
+        return;
+    }
+    curvesample_uniform(true, coeffs, numSegments, step, curve.numVertices, first, last,
+                        curve.vertices, curve.normalVertices);
+}
+
 /**
  * Evaluates and renders the curve (spline or bezier).
  *
  * Only recalculates curve vertices if resolution or control points have changed.
- * Samples the curve function in steps from t=0.0 to t=1.0,
+ * Tessellates the curve adaptively within the pixel tolerance or samples
+ * the curve function in steps from t=0.0 to t=1.0,
  * calculates normal vectors and draws as a red line strip.
+ * With GPU evaluation the uniform steps are evaluated in the vertex shader,
+ * only the segment coefficients are uploaded when the control points change.
+ * Dragging a single control point only resamples and uploads the vertices
+ * of the segments using it.
  *
  * @param data Pointer to InputData containing curve settings and flags
  * @param ctrl 2D vector of control point positions
@@ -214,29 +294,73 @@ static void drawControlPolygon(vec2 *ctrl, int n) {
 static void drawCurve(InputData *data, vec2 *ctrl, float step, float width, int n) {
     scene_pushMatrix();
 
+    if (!data->curve.adaptive && data->curve.gpuEval) {
+        if (data->curve.resolutionChanged || data->curve.buttonsChanged) {
+            // One evaluation updates the coefficients
+            vec2 p;
+            data->curve.curveEval(ctrl, n, 0.0f, p, NULL, &data->curve.buttonsChanged);
+
+            int numSegments;
+            const float *coeffs = utils_getSegments(&numSegments);
+            model_updateCurveSegments(coeffs, numSegments);
+
+            data->curve.resolutionChanged = false;
+            data->curve.buttonsChanged = false;
+        }
+
+        model_drawCurveGpu(uniformVertexCount(step), step, width, VEC3(1, 0, 0));
+
+        scene_popMatrix();
+        return;
+    }
+
     // Recalc curve vertices if needed
     if (data->curve.resolutionChanged || data->curve.buttonsChanged) {
+        int first = 0;
+        int last;
+        bool partial = false;
+
+        if (data->curve.adaptive) {
+            // Pixel tolerance in scene units
+            float pixelSize = (g_renderingData.right - g_renderingData.left) / g_renderingData.screenRes[0];
+            curve.numVertices = utils_tessellateCurve(
+                data->curve.curveEval, ctrl, n, data->curve.tolerance * pixelSize,
+                curve.vertices, curve.tangents, CURVE_MAX_VERTICES, &data->curve.buttonsChanged
+            );
+            last = curve.numVertices - 1;
+            utils_calcNormals(curve.tangents, curve.normalVertices, curve.numVertices);
+        } else {
+            // Update the coefficients first, a dragged button only changes its segments
+            vec2 p;
+            data->curve.curveEval(ctrl, n, 0.0f, p, NULL, &data->curve.buttonsChanged);
+
+            float T0, T1;
+            partial = !data->curve.resolutionChanged && utils_getUpdatedRange(&T0, &T1);
+            if (partial) {
+                first = (int) ceilf(T0 / step - 1e-4f);
+                last = glm_imin((int) floorf(T1 / step + 1e-4f), curve.numVertices - 1);
+            } else {
+                curve.numVertices = uniformVertexCount(step);
+                last = curve.numVertices - 1;
+            }
 
-        // Reset vertex count and sample curve
-        curve.numVertices = 0;
-        for (float T = 0.0f; T <= 1.0f && curve.numVertices < CURVE_MAX_VERTICES; T += step) {
-            // Eval curve at T!
-            data->curve.curveEval(ctrl, n, T, curve.vertices[curve.numVertices], &data->curve.buttonsChanged);
-            curve.numVertices++;
+            sampleCurve(data, ctrl, n, step, first, last);
         }
 
-        // always interpolate last step
-        data->curve.curveEval(ctrl, n, 1.0f, curve.vertices[curve.numVertices - 1], &data->curve.buttonsChanged);
+        int count = last - first + 1;
 
-        utils_calcNormals(curve.vertices, curve.normalVertices, curve.numVertices);
+        // The curve keeps its own buffer, upload only the changed geometry
+        if (partial) {
+            model_updateCurveRange(CURVE_BUFFER_CURVE, curve.vertices, curve.normalVertices, first, count);
+        } else {
+            model_updateCurve(CURVE_BUFFER_CURVE, curve.vertices, curve.normalVertices, curve.numVertices);
+        }
 
         data->curve.resolutionChanged = false;
+        data->curve.buttonsChanged = false;
     }
 
-    model_updateCurve(curve.vertices, curve.normalVertices, curve.numVertices);
-    if (data->curve.buttonsChanged) data->curve.buttonsChanged = false;
-    shader_setColor(VEC3(1, 0, 0));
-    model_drawCurve(curve.numVertices, width);
+    model_drawCurve(CURVE_BUFFER_CURVE, curve.numVertices, width, VEC3(1, 0, 0));
 
     scene_popMatrix();
 }
@@ -246,110 +370,117 @@ static void drawCurve(InputData *data, vec2 *ctrl, float step, float width, int
  *
  * Takes smallest convex polygon containing all button positions
  * and draws it as a green line loop.
+ * The hull stays in its buffer until a button moves.
  *
  * @note Only called if InputData.curve.drawConvexHull is enabled.
  *
+ * @param data Pointer to InputData containing the button change flag
  * @param btnCnt Number of control point buttons
  */
-static void drawConvexHull(int btnCnt) {
-    vec2 points[BUTTON_COUNT];
-    for (int i = 0; i < btnCnt; ++i) {
-        glm_vec2_copy(g_buttons[i]->center, points[i]);
+static void drawConvexHull(InputData *data, int btnCnt) {
+    if (!g_hull.valid || data->curve.buttonsChanged || g_hull.buttonCount != btnCnt) {
+        vec2 points[BUTTON_COUNT];
+        for (int i = 0; i < btnCnt; ++i) {
+            glm_vec2_copy(g_buttons[i]->center, points[i]);
+        }
+
+        vec2 hull[BUTTON_COUNT + 1];
+        g_hull.count = utils_convexHullVec2(points, hull, btnCnt);
+        g_hull.buttonCount = btnCnt;
+        g_hull.valid = true;
+
+        model_updateCurve(CURVE_BUFFER_HULL, hull, NULL, g_hull.count);
     }
 
-    vec2 hull[BUTTON_COUNT + 1];
-    int hullCount = utils_convexHullVec2(points, hull, btnCnt);
+    model_drawCurve(CURVE_BUFFER_HULL, g_hull.count, 2.0f, VEC3(0,1,0));
+}
 
-    model_updateCurve(hull, NULL, hullCount);
-    shader_setColor(VEC3(0,1,0));
-    model_drawCurve(hullCount, 2.0f);
+/**
+ * Draws a collider circle for every position in one instanced draw call.
+ *
+ * @param pos Collider centers
+ * @param n Number of colliders
+ * @param radius Collider radius
+ * @param skip Colliders to leave out (NULL for none)
+ */
+static void drawColliders(vec2 *pos, int n, float radius, bool *skip) {
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        if (skip && skip[i]) continue;
+        count = addSprite(count, pos[i], radius, radius, GLM_VEC4_ZERO, COLLIDER_COLOR);
+    }
+    model_drawSprites(MODEL_CIRCLE, g_spriteInstances, count);
 }
 
 /**
  * Renders animated cloud obstacles.
  *
  * Each cloud consists of 8 overlapping circles of varying sizes to create
- * a fluffy appearance. Clouds slowly drift horizontally using sine.
- * Collision circles are drawn if showColliders is enabled.
+ * a fluffy appearance. Clouds slowly drift horizontally using sine,
+ * evaluated in the sprite shader. All circles go out in one instanced
+ * draw call, collision circles in a second one if showColliders is enabled.
  *
  * Animation pauses when game is paused.
  *
  * @param data Pointer to InputData containing cloud positions and settings
  */
 static void drawClouds(InputData *data) {
-    scene_pushMatrix();
-
-    vec2 pos;
+    // Cloud composition
+    static const vec2 offsets[CLOUD_PUFF_COUNT] = {
+        { 0.0f, 0.0f },      // Center
+        { -0.04f, 0.01f },   // Left
+        { 0.04f, 0.01f },    // Right
+        { -0.02f, -0.02f },  // Bottom left
+        { 0.02f, -0.02f },   // Bottom right
+        { 0.0f, 0.025f },    // Top
+        { -0.06f, 0.0f },    // Far left
+        { 0.06f, 0.0f },     // Far right
+    };
 
-    // Loop through all clouds
-    for (int i = 0; i < data->game.clouds.n; i++) {
-        glm_vec2_copy(data->game.clouds.pos[i], pos);
+    static const float sizes[CLOUD_PUFF_COUNT] = {
+        CLOUD_CENTER_SIZE,   // Center
+        CLOUD_SIDE_SIZE,     // Left
+        CLOUD_SIDE_SIZE,     // Right
+        CLOUD_BOTTOM_SIZE,   // Bottom left
+        CLOUD_BOTTOM_SIZE,   // Bottom right
+        CLOUD_TOP_SIZE,      // Top
+        CLOUD_FAR_SIZE,      // Far left
+        CLOUD_FAR_SIZE,      // Far right
+    };
 
-        // Soft drift animation
-        float drift = 0.015f * sinf((float)glfwGetTime() * 0.3f + i * 1.5f);
-        if (!data->paused) {
-            pos[0] += drift;
-        }
+    shader_setSpriteData((float) glfwGetTime(), CLOUD_DRIFT_SPEED, !data->paused);
 
-        // Cloud composition
-        vec2 offsets[] = {
-            { 0.0f, 0.0f },      // Center
-            { -0.04f, 0.01f },   // Left
-            { 0.04f, 0.01f },    // Right
-            { -0.02f, -0.02f },  // Bottom left
-            { 0.02f, -0.02f },   // Bottom right
-            { 0.0f, 0.025f },    // Top
-            { -0.06f, 0.0f },    // Far left
-            { 0.06f, 0.0f },     // Far right
-        };
-
-        float sizes[] = {
-            CLOUD_CENTER_SIZE,   // Center
-            CLOUD_SIDE_SIZE,     // Left
-            CLOUD_SIDE_SIZE,     // Right
-            CLOUD_BOTTOM_SIZE,   // Bottom left
-            CLOUD_BOTTOM_SIZE,   // Bottom right
-            CLOUD_TOP_SIZE,      // Top
-            CLOUD_FAR_SIZE,      // Far left
-            CLOUD_FAR_SIZE,      // Far right
-        };
-
-        // Draw cloud parts from back to front for proper layering
-        for (int j = 7; j >= 0; j--) {
-            scene_pushMatrix();
+    int count = 0;
+    float baseSize = data->game.clouds.colliderRadius * 0.9f;
+    for (int i = 0; i < data->game.clouds.n; i++) {
+        vec4 anim = { CLOUD_DRIFT_AMPLITUDE, i * CLOUD_DRIFT_PHASE, 0.0f, 0.0f };
 
-            float baseSize = data->game.clouds.colliderRadius * 0.9f;
+        // Cloud parts from back to front for proper layering
+        for (int j = CLOUD_PUFF_COUNT - 1; j >= 0; j--) {
+            vec2 pos;
+            glm_vec2_add(data->game.clouds.pos[i], (float*) offsets[j], pos);
             float scale = baseSize * sizes[j];
 
-            scene_translate(pos[0] + offsets[j][0], pos[1] + offsets[j][1], 0.0f);
-            scene_scale(scale, scale * 0.85f, 1.0f);
-
             // Gradient from white center to gray edges
             float brightness = 0.85f + 0.15f * sizes[j];
-            shader_setColor((vec3){brightness, brightness, brightness * 1.05f});
+            vec3 color = { brightness, brightness, brightness * 1.05f };
 
-            model_draw(MODEL_CIRCLE);
-            scene_popMatrix();
-        }
-
-        // Collider visualization
-        if (data->game.showColliders) {
-            scene_pushMatrix();
-            scene_translate(data->game.clouds.pos[i][0], data->game.clouds.pos[i][1], 0.0f);
-            scene_scale(data->game.clouds.colliderRadius, data->game.clouds.colliderRadius, 1.0f);
-            shader_setColor(COLLIDER_COLOR);
-            model_draw(MODEL_CIRCLE);
-            scene_popMatrix();
+            count = addSprite(count, pos, scale, scale * 0.85f, anim, color);
         }
     }
+    model_drawSprites(MODEL_CIRCLE, g_spriteInstances, count);
 
-    scene_popMatrix();
+    // Collider visualization
+    if (data->game.showColliders) {
+        drawColliders(data->game.clouds.pos, data->game.clouds.n, data->game.clouds.colliderRadius, NULL);
+    }
 }
 
 /**
  * Renders collectible stars with rotation animation.
  *
- * Draws stars with continuous rotation based on game time.
+ * Draws all stars in one instanced draw call, the rotation based on game
+ * time is evaluated in the sprite shader.
  *
  * Collision circles are drawn if showColliders is enabled.
  * Animation pauses when game is paused.
@@ -357,43 +488,24 @@ static void drawClouds(InputData *data) {
  * @param data Pointer to InputData containing star positions and collection state
  */
 static void drawStars(InputData *data) {
-    scene_pushMatrix();
+    shader_setSpriteData((float) glfwGetTime(), CLOUD_DRIFT_SPEED, !data->paused);
 
-    vec2 pos;
+    int count = 0;
+    float scale = data->game.stars.colliderRadius * 2.0f;
     for (int i = 0; i < data->game.stars.n; i++) {
         if (data->game.collected[i]) {
             continue;
         }
 
-        glm_vec2_copy(data->game.stars.pos[i], pos);
-
-        float angleOffset = (float) i * 10.3f;
-        float rotationAngle = (float) glfwGetTime() * STAR_ROTATION_SPEED + angleOffset;
-        if (data->paused) {
-            rotationAngle = 0;
-        }
-
-        // star
-        scene_pushMatrix();
-        scene_translate(pos[0], pos[1], 0.0f);
-        scene_rotate(rotationAngle * 180.0f / (float)M_PI, 0.0f, 0.0f, 1.0f);
-        scene_scale(data->game.stars.colliderRadius * 2.0f, data->game.stars.colliderRadius * 2.0f, 1.0f);
-        shader_setColor(STAR_COLOR);
-        model_draw(MODEL_STAR);
-        scene_popMatrix();
-
-        // collider
-        if (data->game.showColliders) {
-            scene_pushMatrix();
-            scene_translate(pos[0], pos[1], 0.0f);
-            scene_scale(data->game.stars.colliderRadius, data->game.stars.colliderRadius, 1.0f);
-            shader_setColor(COLLIDER_COLOR);
-            model_draw(MODEL_CIRCLE);
-            scene_popMatrix();
-        }
+        vec4 anim = { 0.0f, 0.0f, STAR_ROTATION_SPEED, (float) i * 10.3f };
+        count = addSprite(count, data->game.stars.pos[i], scale, scale, anim, STAR_COLOR);
     }
+    model_drawSprites(MODEL_STAR, g_spriteInstances, count);
 
-    scene_popMatrix();
+    // collider
+    if (data->game.showColliders) {
+        drawColliders(data->game.stars.pos, data->game.stars.n, data->game.stars.colliderRadius, data->game.collected);
+    }
 }
 
 /**
@@ -471,13 +583,8 @@ static void initCurve(void) {
         ctrl[k][1] = g_buttons[k]->center[1];
     }
 
-    for (float T = 0.0f; T <= 1.0f && curve.numVertices < CURVE_MAX_VERTICES; T += input->curve.resolution) {
-        input->curve.curveEval(ctrl, btnCnt, T, curve.vertices[curve.numVertices], &input->curve.buttonsChanged);
-        curve.numVertices++;
-    }
-
-    input->curve.curveEval(ctrl, btnCnt, 1.0f, curve.vertices[curve.numVertices - 1], &input->curve.buttonsChanged);
-    utils_calcNormals(curve.vertices, curve.normalVertices, curve.numVertices);
+    curve.numVertices = uniformVertexCount(input->curve.resolution);
+    sampleCurve(input, ctrl, btnCnt, input->curve.resolution, 0, curve.numVertices - 1);
 }
 
 /**
@@ -521,6 +628,9 @@ static void updateEdgeButtons(int btnCnt) {
 ////////////////////////    LOCAL    ////////////////////////////
 
 void initButtons(int btnCnt) { 
+    g_buttonState.hovered = -1;
+    g_buttonState.dragged = -1;
+
     for (int i = 0; i < btnCnt; i++) { 
         g_buttons[i] = &g_buttonStorage[i];
         g_buttons[i]->r = BUTTON_RADIUS;
@@ -593,10 +703,10 @@ void rendering_draw(void) {
     }
     glDisable(GL_DEPTH_TEST);
 
-    debug_pushRenderScope("Scene");
+    INSTRUMENT_PUSH_LABEL("Scene");
     scene_pushMatrix();
 
-    checkAndDrawButtons(input);
+    drawButtons(input);
 
     int btnCnt = input->curve.buttonCount;
     vec2 ctrl[BUTTON_COUNT];
@@ -609,7 +719,7 @@ void rendering_draw(void) {
         drawControlPolygon(ctrl, btnCnt);
     }
     if (input->curve.drawConvexHull) {
-        drawConvexHull(btnCnt);
+        drawConvexHull(input, btnCnt);
     }
 
     drawCurve(input, ctrl, input->curve.resolution, input->curve.width, btnCnt);
@@ -620,7 +730,7 @@ void rendering_draw(void) {
     drawAirplane(input);
 
     scene_popMatrix();
-    debug_popRenderScope();
+    INSTRUMENT_POP_LABEL();
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 }
 
@@ -640,6 +750,10 @@ void rendering_resize(int width, int height, int btnCnt) {
     g_renderingData.screenRes[1] = height;
 
     g_renderingData.aspect = (float) width / height;
+    shader_setViewport(width, height);
+
+    // The adaptive tessellation depends on the pixel size
+    getInputData()->curve.resolutionChanged = true;
 
     g_renderingData.left   = -BOUNDS * (g_renderingData.aspect >= 1 ? g_renderingData.aspect : 1);
     g_renderingData.right  =  BOUNDS * (g_renderingData.aspect >= 1 ? g_renderingData.aspect : 1);
@@ -653,7 +767,46 @@ void rendering_resize(int width, int height, int btnCnt) {
 
     if (g_buttonInitialized) {
         updateEdgeButtons(btnCnt);
+        g_hull.valid = false;
     } else {
         initButtons(btnCnt);
     }
 }
+
+void rendering_mouseMoved(float x, float y) {
+    if (!g_buttonInitialized || g_renderingData.screenRes[0] == 0) {
+        return;
+    }
+
+    InputData *data = getInputData();
+
+    vec2 mouse;
+    screenToScene(x, y, mouse);
+
+    if (g_buttonState.dragged >= 0 && !isButtonEnabled(data, g_buttonState.dragged)) {
+        g_buttonState.dragged = -1;
+    }
+    g_buttonState.hovered = findButton(data, mouse);
+
+    int i = g_buttonState.dragged;
+    if (i < 0) {
+        return;
+    }
+
+    // Clamp button pos
+    float d = BUTTON_DRAG_EDGE_DISTANCE;
+    g_buttons[i]->center[0] = glm_clamp(mouse[0], g_renderingData.left + d, g_renderingData.right - d);
+    g_buttons[i]->center[1] = glm_clamp(mouse[1], g_renderingData.bottom + d, g_renderingData.top - d);
+
+    // Mark curve for recalc, only the segments using this button
+    data->curve.buttonsChanged = true;
+    utils_markControlPointDirty(i);
+}
+
+void rendering_mouseButton(int button, int action) {
+    if (action == GLFW_RELEASE) {
+        g_buttonState.dragged = -1;
+    } else if (action == GLFW_PRESS && button == GLFW_MOUSE_BUTTON_LEFT) {
+        g_buttonState.dragged = g_buttonState.hovered;
+    }
+}
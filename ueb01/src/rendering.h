@@ -85,4 +85,24 @@ void rendering_cleanup(void);
  */
 void rendering_resize(int width, int height, int btnCnt);
 
+/**
+ * Handles mouse movement.
+ * Converts the position to the scene once, updates the hovered button
+ * and moves the dragged one.
+ *
+ * @param x Mouse X coordinate in window coordinates
+ * @param y Mouse Y coordinate in window coordinates
+ */
+void rendering_mouseMoved(float x, float y);
+
+/**
+ * Handles mouse button events.
+ * Pressing the left button on a hovered button starts dragging it,
+ * releasing any button stops.
+ *
+ * @param button Mouse button identifier
+ * @param action Action performed for button
+ */
+void rendering_mouseButton(int button, int action);
+
 #endif // RENDERING_H
\ No newline at end of file
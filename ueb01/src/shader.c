@@ -3,10 +3,13 @@
  * @brief Implementation of shader loading and uniforms.
  *
  * Handles loading shader files, compilation, linking, and reloading.
- * Manages three shader programs:
+ * Manages these shader programs:
  * - simple (colored rendering),
  * - gradient (background),
- * - normalPoint (normal vector visualization with geometry shader).
+ * - sprite (instanced clouds and stars),
+ * - curve (curve evaluated per vertex from the segment coefficients, with its normals),
+ * - thickLine (line strips and their normals as antialiased screen space quads),
+ * - guiComposite (cached GUI over the scene).
  *
  * @authors Nikolaos Tsetsas, Noah Schmidt
  */
@@ -22,10 +25,18 @@
 /**
  * Shader programs:
  * - simple (basic color)
- * - normal (normal visualization)
  * - gradient (background gradient)
+ * - sprite (instanced 2D sprites)
+ * - curve (curve evaluation and its normals)
+ * - thickLine (thick line strips)
+ * - guiComposite (cached GUI)
  */
-static Shader *shader = NULL, *normalPointShader = NULL, *gradientShader = NULL;
+static Shader *shader = NULL, *gradientShader = NULL, *spriteShader = NULL;
+static Shader *curveShader = NULL, *curveNormalShader = NULL, *thickLineShader = NULL;
+static Shader *guiCompositeShader = NULL;
+
+/** Viewport size in pixels, the thick lines are expanded in screen space */
+static vec2 g_viewport = {1.0f, 1.0f};
 
 /**
  * Helper function to delete a shader and set pointer to NULL.
@@ -39,12 +50,30 @@ static void cleanup(Shader *s) {
     }
 }
 
+/**
+ * Sets the curve evaluation uniforms of a shader using curve.vert.
+ *
+ * @param s The shader, has to be active
+ * @param numSegments Number of segments in the segment block
+ * @param numVertices Number of vertices of the line strip
+ * @param step Parameter distance of two vertices
+ */
+static void setCurveUniforms(Shader *s, int numSegments, int numVertices, float step) {
+    shader_setInt(s, "u_numSegments", numSegments);
+    shader_setInt(s, "u_numVertices", numVertices);
+    shader_setFloat(s, "u_step", step);
+}
+
 ////////////////////////    PUBLIC    ////////////////////////////
 
 void shader_cleanup(void) {
     cleanup(shader);
-    cleanup(normalPointShader);
     cleanup(gradientShader);
+    cleanup(spriteShader);
+    cleanup(curveShader);
+    cleanup(curveNormalShader);
+    cleanup(thickLineShader);
+    cleanup(guiCompositeShader);
 }
 
 void shader_load(void) {
@@ -70,17 +99,66 @@ void shader_load(void) {
         gradientShader = newGradientShader;
     }
 
-    Shader *newNormalShader = shader_createShader();
-    shader_attachShaderFile(newNormalShader, GL_VERTEX_SHADER, RESOURCE_PATH "shader/normalPoint/normalPoint.vert");
-    shader_attachShaderFile(newNormalShader, GL_GEOMETRY_SHADER, RESOURCE_PATH "shader/normalPoint/normalPoint.geom");
-    shader_attachShaderFile(newNormalShader, GL_FRAGMENT_SHADER, RESOURCE_PATH "shader/normalPoint/normalPoint.frag");
-
-    if (shader_buildShader("NormalStrip", newNormalShader)) {
-        cleanup(normalPointShader);
-        normalPointShader = newNormalShader;
-        shader_useShader(normalPointShader);
-        shader_setFloat(normalPointShader, "u_normalLength", NORMAL_LENGTH);
-        shader_setVec3(normalPointShader, "u_color", &NORMAL_COLOR);
+    Shader *newSpriteShader = shader_createVeFrShader(
+        "Sprite",
+        RESOURCE_PATH "shader/sprite/sprite.vert",
+        RESOURCE_PATH "shader/sprite/sprite.frag"
+    );
+
+    if (newSpriteShader) {
+        cleanup(spriteShader);
+        spriteShader = newSpriteShader;
+    }
+
+    Shader *newCurveShader = shader_createVeFrShader(
+        "Curve",
+        RESOURCE_PATH "shader/curve/curve.vert",
+        RESOURCE_PATH "shader/simple/simple.frag"
+    );
+
+    if (newCurveShader) {
+        cleanup(curveShader);
+        curveShader = newCurveShader;
+    }
+
+    Shader *newCurveNormalShader = shader_createShader();
+    shader_attachShaderFile(newCurveNormalShader, GL_VERTEX_SHADER, RESOURCE_PATH "shader/curve/curve.vert");
+    shader_attachShaderFile(newCurveNormalShader, GL_GEOMETRY_SHADER, RESOURCE_PATH "shader/normalPoint/normalPoint.geom");
+    shader_attachShaderFile(newCurveNormalShader, GL_FRAGMENT_SHADER, RESOURCE_PATH "shader/normalPoint/normalPoint.frag");
+
+    if (shader_buildShader("CurveNormals", newCurveNormalShader)) {
+        cleanup(curveNormalShader);
+        curveNormalShader = newCurveNormalShader;
+        shader_useShader(curveNormalShader);
+        shader_setFloat(curveNormalShader, "u_normalLength", NORMAL_LENGTH);
+        shader_setVec3(curveNormalShader, "u_color", &NORMAL_COLOR);
+    }
+
+    Shader *newThickLineShader = shader_createVeFrShader(
+        "ThickLine",
+        RESOURCE_PATH "shader/thickLine/thickLine.vert",
+        RESOURCE_PATH "shader/thickLine/thickLine.frag"
+    );
+
+    if (newThickLineShader) {
+        cleanup(thickLineShader);
+        thickLineShader = newThickLineShader;
+        shader_useShader(thickLineShader);
+        shader_setFloat(thickLineShader, "u_normalLength", NORMAL_LENGTH);
+        shader_setVec3(thickLineShader, "u_normalColor", &NORMAL_COLOR);
+    }
+
+    Shader *newGuiCompositeShader = shader_createVeFrShader(
+        "GuiComposite",
+        RESOURCE_PATH "shader/guiComposite/guiComposite.vert",
+        RESOURCE_PATH "shader/guiComposite/guiComposite.frag"
+    );
+
+    if (newGuiCompositeShader) {
+        cleanup(guiCompositeShader);
+        guiCompositeShader = newGuiCompositeShader;
+        shader_useShader(guiCompositeShader);
+        shader_setInt(guiCompositeShader, "u_gui", 0);
     }
 }
 
@@ -97,15 +175,57 @@ void shader_setColor(vec3 color) {
     shader_setVec3(shader, "u_color", (vec3*) color);
 }
 
-void shader_setNormals(void) {
-    shader_useShader(normalPointShader);
+bool shader_setThickLine(int numVertices, bool closed, float width, vec3 color) {
+    if (!thickLineShader) {
+        return false;
+    }
+
+    shader_useShader(thickLineShader);
+    mat4 mat;
+    scene_getMVP(mat);
+    shader_setMat4(thickLineShader, "u_mvpMatrix", &mat);
+    shader_setVec2(thickLineShader, "u_viewport", &g_viewport);
+    shader_setInt(thickLineShader, "u_numVertices", numVertices);
+    shader_setBool(thickLineShader, "u_closed", closed);
+    shader_setFloat(thickLineShader, "u_width", width);
+    shader_setVec3(thickLineShader, "u_color", (vec3*) color);
+    return true;
+}
+
+void shader_setViewport(int width, int height) {
+    g_viewport[0] = (float) width;
+    g_viewport[1] = (float) height;
+}
+
+bool shader_setCurveEval(int numSegments, int numVertices, float step, vec3 color) {
+    if (!curveShader) {
+        return false;
+    }
+
+    shader_useShader(curveShader);
+    mat4 mat;
+    scene_getMVP(mat);
+    shader_setMat4(curveShader, "u_mvpMatrix", &mat);
+    shader_setVec3(curveShader, "u_color", (vec3*) color);
+    setCurveUniforms(curveShader, numSegments, numVertices, step);
+    return true;
+}
+
+bool shader_setCurveEvalNormals(int numSegments, int numVertices, float step) {
+    if (!curveNormalShader) {
+        return false;
+    }
+
+    shader_useShader(curveNormalShader);
     mat4 mat;
     scene_getMV(mat);
-    shader_setMat4(normalPointShader, "u_modelViewMatrix", &mat);
+    shader_setMat4(curveNormalShader, "u_modelViewMatrix", &mat);
     scene_getN(mat);
-    shader_setMat4(normalPointShader, "u_normalMatrix", &mat);
+    shader_setMat4(curveNormalShader, "u_normalMatrix", &mat);
     scene_getP(mat);
-    shader_setMat4(normalPointShader, "u_projMatrix", &mat);
+    shader_setMat4(curveNormalShader, "u_projMatrix", &mat);
+    setCurveUniforms(curveNormalShader, numSegments, numVertices, step);
+    return true;
 }
 
 void shader_renderGradient(void) {
@@ -117,3 +237,24 @@ void shader_renderGradient(void) {
     shader_setVec3(gradientShader, "u_bottomColor", &bottomColor);
 }
 
+void shader_setSpriteData(float time, float driftSpeed, bool animate) {
+    shader_useShader(spriteShader);
+
+    mat4 mat;
+    scene_getMVP(mat);
+    shader_setMat4(spriteShader, "u_mvpMatrix", &mat);
+    shader_setFloat(spriteShader, "u_time", time);
+    shader_setFloat(spriteShader, "u_driftSpeed", driftSpeed);
+    shader_setBool(spriteShader, "u_animate", animate);
+}
+
+bool shader_setGuiComposite(GLuint textureId) {
+    if (!guiCompositeShader) {
+        return false;
+    }
+
+    shader_useShader(guiCompositeShader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    return true;
+}
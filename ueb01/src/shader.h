@@ -3,7 +3,8 @@
  * @brief Shader program management and uniforms.
  *
  * Has functions to load, activate and configure shader programs.
- * Manages simple color shader, gradient shader and normal visualization shader.
+ * Manages simple color shader, gradient shader, sprite shader, curve evaluation
+ * shaders and thick line shader.
  *
  * @authors Nikolaos Tsetsas, Noah Schmidt
  */
@@ -20,7 +21,7 @@ void shader_cleanup(void);
 
 /**
  * Loads and compiles all shader programs.
- * Creates simple shader, gradient shader and normal shader.
+ * Creates simple shader, gradient shader, sprite shader, curve shaders and thick line shader.
  * If compilation succeeds, replaces existing shaders.
  */
 void shader_load(void);
@@ -39,16 +40,73 @@ void shader_setMVP(void);
  */
 void shader_setColor(vec3 color);
 
-/**
- * Activates the normal shader and sets uniforms
- * Prepares matrices for geometry shader which generates visible normal vectors.
- */
-void shader_setNormals(void);
-
 /**
  * Activates gradient shader and sets its color uniforms.
  * Configures top and bottom colors for vertical gradient rendering.
  */
 void shader_renderGradient(void);
 
+/**
+ * Activates the thick line shader and sets its uniforms.
+ * The line strip is read from the bound shader storage buffer 0,
+ * every segment is one instance of 6 vertices, the normals of the
+ * vertices follow as further instances.
+ *
+ * @param numVertices Number of vertices of the line strip
+ * @param closed Whether the last vertex equals the first and is joined with it
+ * @param width Line width in pixels
+ * @param color Color of the line
+ * @return False if the shader is not available
+ */
+bool shader_setThickLine(int numVertices, bool closed, float width, vec3 color);
+
+/**
+ * Sets the viewport size the thick lines are expanded in.
+ *
+ * @param width Viewport width in pixels
+ * @param height Viewport height in pixels
+ */
+void shader_setViewport(int width, int height);
+
+/**
+ * Activates the curve shader, which evaluates the curve per vertex
+ * from the segment block, and sets its uniforms.
+ *
+ * @param numSegments Number of segments in the segment block
+ * @param numVertices Number of vertices of the line strip
+ * @param step Parameter distance of two vertices
+ * @param color Color of the curve
+ * @return False if the shader is not available
+ */
+bool shader_setCurveEval(int numSegments, int numVertices, float step, vec3 color);
+
+/**
+ * Activates the shader drawing the normals of the evaluated curve
+ * and sets its uniforms. Drawn as points, the normalPoint geometry
+ * shader generates the normal vectors.
+ *
+ * @param numSegments Number of segments in the segment block
+ * @param numVertices Number of vertices of the line strip
+ * @param step Parameter distance of two vertices
+ * @return False if the shader is not available
+ */
+bool shader_setCurveEvalNormals(int numSegments, int numVertices, float step);
+
+/**
+ * Activates sprite shader and sets MVP matrix and animation uniforms.
+ *
+ * @param time Current time in seconds
+ * @param driftSpeed Angular speed of the horizontal drift
+ * @param animate If false, sprites are drawn without drift and rotation
+ */
+void shader_setSpriteData(float time, float driftSpeed, bool animate);
+
+/**
+ * Activates the GUI composite shader and binds the cached GUI to unit 0.
+ *
+ * @param textureId Color texture of the GUI cache
+ * @return False if the shader is not available
+ */
+bool shader_setGuiComposite(GLuint textureId);
+
 #endif // SHADER_H
\ No newline at end of file
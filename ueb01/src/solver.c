@@ -0,0 +1,330 @@
+/**
+ * @file solver.c
+ * @brief Implementation of the batched candidate flight test
+ *
+ * Both kernels walk the spline segment by segment with the coefficients
+ * of utils_evalSpline, place the airplane triangle like logic.c (offset
+ * along the normal, tip along the tangent, no trigonometry needed) and
+ * sweep each vertex from the previous sample as a capsule like
+ * utils_circleInCapsule. The SSE kernel runs the SOLVER_LANES candidates
+ * in the lanes of one register, the scalar kernel one candidate at a time.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "solver.h"
+#include "logic.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define SOLVER_X86 1
+    #include <immintrin.h>
+#endif
+
+/** Segments shorter than this are tested as points */
+#define SOLVER_EPSILON 1e-12f
+
+/** Bit mask of all lanes */
+#define SOLVER_ALL_LANES ((1 << SOLVER_LANES) - 1)
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Power form coefficients (a, b, c, d) of a B-spline segment,
+ * the rows of splineMatrix in utils.c applied to 4 control points.
+ * @param g Control point coordinates of the segment.
+ * @param dest Output coefficients.
+ */
+static void splineCoeffs(const float g[4], float dest[4]) {
+    dest[0] = (-g[0] + 3.0f * g[1] - 3.0f * g[2] + g[3]) / 6.0f;
+    dest[1] = (3.0f * g[0] - 6.0f * g[1] + 3.0f * g[2]) / 6.0f;
+    dest[2] = (-3.0f * g[0] + 3.0f * g[2]) / 6.0f;
+    dest[3] = (g[0] + 4.0f * g[1] + g[2]) / 6.0f;
+}
+
+/**
+ * Squared distance of a point to a segment.
+ * @param cx X of the point.
+ * @param cy Y of the point.
+ * @param ax X of the segment start.
+ * @param ay Y of the segment start.
+ * @param bx X of the segment end.
+ * @param by Y of the segment end.
+ * @return Squared distance to the closest point of the segment.
+ */
+static float segmentDistance2(float cx, float cy, float ax, float ay, float bx, float by) {
+    float abx = bx - ax, aby = by - ay;
+    float acx = cx - ax, acy = cy - ay;
+    float lenSq = abx * abx + aby * aby;
+    float t = lenSq > SOLVER_EPSILON ? glm_clamp((acx * abx + acy * aby) / lenSq, 0.0f, 1.0f) : 0.0f;
+    float dx = acx - abx * t, dy = acy - aby * t;
+    return dx * dx + dy * dy;
+}
+
+/**
+ * Reference kernel, flies one candidate.
+ * @param level The level to solve.
+ * @param numPoints Number of control points.
+ * @param batch Control points of the candidates.
+ * @param lane Lane of the candidate.
+ * @param result Output result.
+ */
+static void flyScalar(const Level *level, int numPoints, const SolverBatch *batch, int lane, SolverResult *result) {
+    const vec2 shape[3] = AIRPLANE_SHAPE_INIT;
+    float starR = level->starRadius + AIRPLANE_COLLIDER_RADIUS;
+    float cloudR = level->cloudRadius + AIRPLANE_COLLIDER_RADIUS;
+    starR *= starR;
+    cloudR *= cloudR;
+
+    uint64_t collected = 0;
+    float prevX[3], prevY[3];
+
+    for (int i = 0; i < numPoints - 3; ++i) {
+        float gx[4], gy[4], cx[4], cy[4];
+        for (int k = 0; k < 4; ++k) {
+            gx[k] = batch->x[i + k][lane];
+            gy[k] = batch->y[i + k][lane];
+        }
+        splineCoeffs(gx, cx);
+        splineCoeffs(gy, cy);
+
+        for (int k = i == 0 ? 0 : 1; k <= SOLVER_SAMPLES_PER_SEGMENT; ++k) {
+            float t = (float) k / SOLVER_SAMPLES_PER_SEGMENT;
+            float px = ((cx[0] * t + cx[1]) * t + cx[2]) * t + cx[3];
+            float py = ((cy[0] * t + cy[1]) * t + cy[2]) * t + cy[3];
+            float dx = (3.0f * cx[0] * t + 2.0f * cx[1]) * t + cx[2];
+            float dy = (3.0f * cy[0] * t + 2.0f * cy[1]) * t + cy[2];
+
+            float inv = 1.0f / sqrtf(glm_max(dx * dx + dy * dy, SOLVER_EPSILON));
+            dx *= inv;
+            dy *= inv;
+            px -= dy * AIRPLANE_CURVE_OFFSET;
+            py += dx * AIRPLANE_CURVE_OFFSET;
+
+            float vx[3], vy[3];
+            for (int v = 0; v < 3; ++v) {
+                vx[v] = px + dy * shape[v][0] + dx * shape[v][1];
+                vy[v] = py - dx * shape[v][0] + dy * shape[v][1];
+            }
+
+            if (i == 0 && k == 0) {
+                memcpy(prevX, vx, sizeof(vx));
+                memcpy(prevY, vy, sizeof(vy));
+                continue;
+            }
+
+            for (int o = 0; o < level->cloudCount; ++o) {
+                for (int v = 0; v < 3; ++v) {
+                    if (segmentDistance2(level->clouds[o][0], level->clouds[o][1],
+                                         prevX[v], prevY[v], vx[v], vy[v]) <= cloudR) {
+                        result->collected = collected;
+                        result->cloudHit = true;
+                        return;
+                    }
+                }
+            }
+
+            for (int o = 0; o < level->starCount; ++o) {
+                for (int v = 0; v < 3 && !(collected >> o & 1); ++v) {
+                    if (segmentDistance2(level->stars[o][0], level->stars[o][1],
+                                         prevX[v], prevY[v], vx[v], vy[v]) <= starR) {
+                        collected |= 1ull << o;
+                    }
+                }
+            }
+
+            memcpy(prevX, vx, sizeof(vx));
+            memcpy(prevY, vy, sizeof(vy));
+        }
+    }
+
+    result->collected = collected;
+    result->cloudHit = false;
+}
+
+#ifdef SOLVER_X86
+
+/**
+ * Power form coefficients of a segment for all lanes.
+ * @param g Lane-interleaved control point coordinates of the segment.
+ * @param dest Output coefficients.
+ */
+static void splineCoeffsSse(const float (*g)[SOLVER_LANES], __m128 dest[4]) {
+    const __m128 sixth = _mm_set1_ps(1.0f / 6.0f);
+    const __m128 three = _mm_set1_ps(3.0f);
+    __m128 g0 = _mm_loadu_ps(g[0]), g1 = _mm_loadu_ps(g[1]);
+    __m128 g2 = _mm_loadu_ps(g[2]), g3 = _mm_loadu_ps(g[3]);
+
+    __m128 g02 = _mm_sub_ps(g0, g2);
+    dest[0] = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(g3, g0), _mm_mul_ps(three, _mm_sub_ps(g1, g2))), sixth);
+    dest[1] = _mm_mul_ps(_mm_mul_ps(three, _mm_sub_ps(_mm_add_ps(g0, g2), _mm_add_ps(g1, g1))), sixth);
+    dest[2] = _mm_mul_ps(_mm_mul_ps(three, _mm_sub_ps(_mm_setzero_ps(), g02)), sixth);
+    dest[3] = _mm_mul_ps(_mm_add_ps(_mm_add_ps(g0, g2), _mm_mul_ps(_mm_set1_ps(4.0f), g1)), sixth);
+}
+
+/**
+ * Lanes whose swept segments come within a radius of a point.
+ * @param cx X of the point, broadcast.
+ * @param cy Y of the point, broadcast.
+ * @param ax X of the segment starts.
+ * @param ay Y of the segment starts.
+ * @param bx X of the segment ends.
+ * @param by Y of the segment ends.
+ * @param r2 Squared radius, broadcast.
+ * @return All bits set in the lanes within the radius.
+ */
+static inline __m128 capsuleHitSse(__m128 cx, __m128 cy, __m128 ax, __m128 ay, __m128 bx, __m128 by, __m128 r2) {
+    __m128 abx = _mm_sub_ps(bx, ax), aby = _mm_sub_ps(by, ay);
+    __m128 acx = _mm_sub_ps(cx, ax), acy = _mm_sub_ps(cy, ay);
+    __m128 lenSq = _mm_max_ps(_mm_add_ps(_mm_mul_ps(abx, abx), _mm_mul_ps(aby, aby)), _mm_set1_ps(SOLVER_EPSILON));
+    __m128 t = _mm_div_ps(_mm_add_ps(_mm_mul_ps(acx, abx), _mm_mul_ps(acy, aby)), lenSq);
+    t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    __m128 dx = _mm_sub_ps(acx, _mm_mul_ps(abx, t));
+    __m128 dy = _mm_sub_ps(acy, _mm_mul_ps(aby, t));
+    return _mm_cmple_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), r2);
+}
+
+/**
+ * Lanes whose airplane touched a point since the previous sample.
+ * @param px X of the point.
+ * @param py Y of the point.
+ * @param prevX X of the previous vertices.
+ * @param prevY Y of the previous vertices.
+ * @param vx X of the current vertices.
+ * @param vy Y of the current vertices.
+ * @param r2 Squared radius, broadcast.
+ * @return Bit per lane.
+ */
+static inline int airplaneHitSse(float px, float py, const __m128 prevX[3], const __m128 prevY[3],
+                                 const __m128 vx[3], const __m128 vy[3], __m128 r2) {
+    __m128 cx = _mm_set1_ps(px), cy = _mm_set1_ps(py);
+    __m128 hit = capsuleHitSse(cx, cy, prevX[0], prevY[0], vx[0], vy[0], r2);
+    hit = _mm_or_ps(hit, capsuleHitSse(cx, cy, prevX[1], prevY[1], vx[1], vy[1], r2));
+    hit = _mm_or_ps(hit, capsuleHitSse(cx, cy, prevX[2], prevY[2], vx[2], vy[2], r2));
+    return _mm_movemask_ps(hit);
+}
+
+/**
+ * SSE kernel, flies all candidates of a batch in the lanes of one register.
+ * @param level The level to solve.
+ * @param numPoints Number of control points.
+ * @param batch Control points of the candidates.
+ * @param results Output results.
+ */
+static void flySse(const Level *level, int numPoints, const SolverBatch *batch, SolverResult *results) {
+    const vec2 shape[3] = AIRPLANE_SHAPE_INIT;
+    float starR = level->starRadius + AIRPLANE_COLLIDER_RADIUS;
+    float cloudR = level->cloudRadius + AIRPLANE_COLLIDER_RADIUS;
+    const __m128 starR2 = _mm_set1_ps(starR * starR);
+    const __m128 cloudR2 = _mm_set1_ps(cloudR * cloudR);
+    const __m128 offset = _mm_set1_ps(AIRPLANE_CURVE_OFFSET);
+    const __m128 half = _mm_set1_ps(0.5f), threeHalves = _mm_set1_ps(1.5f);
+
+    uint64_t collected[SOLVER_LANES] = { 0 };
+    int cloudHit = 0;
+    __m128 prevX[3], prevY[3];
+    for (int v = 0; v < 3; ++v) {
+        prevX[v] = prevY[v] = _mm_setzero_ps();
+    }
+
+    for (int i = 0; i < numPoints - 3 && cloudHit != SOLVER_ALL_LANES; ++i) {
+        __m128 cx[4], cy[4];
+        splineCoeffsSse(batch->x + i, cx);
+        splineCoeffsSse(batch->y + i, cy);
+        __m128 cx0x3 = _mm_mul_ps(cx[0], _mm_set1_ps(3.0f)), cx1x2 = _mm_add_ps(cx[1], cx[1]);
+        __m128 cy0x3 = _mm_mul_ps(cy[0], _mm_set1_ps(3.0f)), cy1x2 = _mm_add_ps(cy[1], cy[1]);
+
+        for (int k = i == 0 ? 0 : 1; k <= SOLVER_SAMPLES_PER_SEGMENT; ++k) {
+            __m128 t = _mm_set1_ps((float) k / SOLVER_SAMPLES_PER_SEGMENT);
+            __m128 px = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(cx[0], t), cx[1]), t), cx[2]), t), cx[3]);
+            __m128 py = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(cy[0], t), cy[1]), t), cy[2]), t), cy[3]);
+            __m128 dx = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(cx0x3, t), cx1x2), t), cx[2]);
+            __m128 dy = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(cy0x3, t), cy1x2), t), cy[2]);
+
+            // Estimate refined with one Newton step
+            __m128 lenSq = _mm_max_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_set1_ps(SOLVER_EPSILON));
+            __m128 inv = _mm_rsqrt_ps(lenSq);
+            inv = _mm_mul_ps(inv, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, lenSq), _mm_mul_ps(inv, inv))));
+            dx = _mm_mul_ps(dx, inv);
+            dy = _mm_mul_ps(dy, inv);
+            px = _mm_sub_ps(px, _mm_mul_ps(dy, offset));
+            py = _mm_add_ps(py, _mm_mul_ps(dx, offset));
+
+            __m128 vx[3], vy[3];
+            for (int v = 0; v < 3; ++v) {
+                __m128 lx = _mm_set1_ps(shape[v][0]), ly = _mm_set1_ps(shape[v][1]);
+                vx[v] = _mm_add_ps(px, _mm_add_ps(_mm_mul_ps(dy, lx), _mm_mul_ps(dx, ly)));
+                vy[v] = _mm_add_ps(py, _mm_sub_ps(_mm_mul_ps(dy, ly), _mm_mul_ps(dx, lx)));
+            }
+
+            if (i == 0 && k == 0) {
+                memcpy(prevX, vx, sizeof(vx));
+                memcpy(prevY, vy, sizeof(vy));
+                continue;
+            }
+
+            // Stars touched in the same step as a cloud do not count
+            for (int o = 0; o < level->cloudCount; ++o) {
+                cloudHit |= airplaneHitSse(level->clouds[o][0], level->clouds[o][1], prevX, prevY, vx, vy, cloudR2);
+            }
+            if (cloudHit == SOLVER_ALL_LANES) {
+                break;
+            }
+
+            for (int o = 0; o < level->starCount; ++o) {
+                int hit = airplaneHitSse(level->stars[o][0], level->stars[o][1], prevX, prevY, vx, vy, starR2) & ~cloudHit;
+                for (int lane = 0; hit != 0; ++lane, hit >>= 1) {
+                    collected[lane] |= (uint64_t) (hit & 1) << o;
+                }
+            }
+
+            memcpy(prevX, vx, sizeof(vx));
+            memcpy(prevY, vy, sizeof(vy));
+        }
+    }
+
+    for (int lane = 0; lane < SOLVER_LANES; ++lane) {
+        results[lane].collected = collected[lane];
+        results[lane].cloudHit = (cloudHit >> lane & 1) != 0;
+    }
+}
+
+#endif // SOLVER_X86
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool solver_isSimdSupported(void) {
+#ifdef SOLVER_X86
+    return true;
+#else
+    return false;
+#endif
+}
+
+int solver_evalBatch(bool simd, const Level *level, int numPoints, const SolverBatch *batch, SolverResult *results) {
+    SolverResult local[SOLVER_LANES];
+    if (results == NULL) {
+        results = local;
+    }
+
+#ifdef SOLVER_X86
+    if (simd) {
+        flySse(level, numPoints, batch, results);
+    }
+#else
+    simd = false;
+#endif
+    if (!simd) {
+        for (int lane = 0; lane < SOLVER_LANES; ++lane) {
+            flyScalar(level, numPoints, batch, lane, &results[lane]);
+        }
+    }
+
+    uint64_t all = level->starCount >= 64 ? ~0ull : (1ull << level->starCount) - 1;
+    int solved = 0;
+    for (int lane = 0; lane < SOLVER_LANES; ++lane) {
+        if (!results[lane].cloudHit && results[lane].collected == all) {
+            solved |= 1 << lane;
+        }
+    }
+    return solved;
+}
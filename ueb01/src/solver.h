@@ -0,0 +1,63 @@
+/**
+ * @file solver.h
+ * @brief Batched flight test of candidate curves against a level
+ *
+ * Flies the airplane along several B-spline candidates at once and reports
+ * which of them collect every star without touching a cloud. The curve is
+ * the one of utils_evalSpline, the airplane pose and the swept vertex
+ * capsules are the ones of logic.c. The kernel is stateless and can run on
+ * any number of threads.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <fhwcg/fhwcg.h>
+#include "levels.h"
+#include "rendering.h"
+
+/** Candidate curves per batch, one per SIMD lane */
+#define SOLVER_LANES 4
+
+/** Curve samples per spline segment, consecutive samples are swept */
+#define SOLVER_SAMPLES_PER_SEGMENT 16
+
+/**
+ * Control points of SOLVER_LANES candidates, lane-interleaved so one load
+ * fetches a control point of every candidate.
+ */
+typedef struct {
+    float x[BUTTON_COUNT][SOLVER_LANES];
+    float y[BUTTON_COUNT][SOLVER_LANES];
+} SolverBatch;
+
+/**
+ * Outcome of one candidate.
+ */
+typedef struct {
+    uint64_t collected;     // bit per star
+    bool cloudHit;
+} SolverResult;
+
+/**
+ * Checks whether the SIMD kernel can run.
+ * @return True on x86 with SSE.
+ */
+bool solver_isSimdSupported(void);
+
+/**
+ * Flies the airplane along every candidate of a batch.
+ * A candidate stops collecting stars once it hits a cloud.
+ * Without SIMD support the scalar kernel is used.
+ * @param simd Whether to use the SIMD kernel.
+ * @param level The level to solve, at most 64 stars.
+ * @param numPoints Number of control points per candidate, at least 4.
+ * @param batch Control points of the candidates.
+ * @param results Destination for SOLVER_LANES results, may be NULL.
+ * @return Bit per lane, set if the candidate solves the level.
+ */
+int solver_evalBatch(bool simd, const Level *level, int numPoints, const SolverBatch *batch, SolverResult *results);
+
+#endif // SOLVER_H
\ No newline at end of file
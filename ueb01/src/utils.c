@@ -11,7 +11,8 @@
  *
  * Additional utilities include:
  * - Convex hull calc
- * - Tangent calc
+ * - Adaptive curve tessellation
+ * - Arc length parameterization
  * - Normal vector calc
  * - Collision detection
  *
@@ -22,9 +23,6 @@
 #include "rendering.h"
 #include "input.h"
 
-/** Maximum number of curve segments (each segment requires 4 control points) */
-#define MAX_SEGMENTS (BUTTON_COUNT - 3)
-
 /**
  * Represents a curve segment with coefficients.
  * Each segment is defined by: P(t) = at³ + bt² + ct + d
@@ -36,18 +34,63 @@ typedef struct {
 } Segment;
 
 /** Array of curve segments */
-static Segment segments[MAX_SEGMENTS];
+static Segment segments[CURVE_MAX_SEGMENTS];
+
+/** Number of valid segments in segments */
+static int segmentCount;
+
+/** Basis matrix the segments were computed with */
+static const vec4 *coeffBasis;
+
+/** Range of control points moved since the last update, empty if first > last */
+static struct {
+    int first, last;
+} dirtyPoints = {1, 0};
+
+/** Range of segments recomputed by the last update */
+static struct {
+    int first, last;
+} updatedSegments;
+
+/** Arc length samples per curve segment */
+#define ARC_SAMPLES_PER_SEGMENT 32
+
+/**
+ * Arc length table of the current coefficients.
+ * lengths[k] is the curve length from T=0 to T=k/numSamples.
+ */
+static struct {
+    float lengths[CURVE_MAX_SEGMENTS * ARC_SAMPLES_PER_SEGMENT + 1];
+    int numSamples;
+} arcTable;
+
+/** Maximum subdivision depth of the adaptive tessellation per segment */
+#define MAX_TESSELLATION_DEPTH 16
+
+/**
+ * State of one adaptive tessellation run.
+ */
+typedef struct {
+    CurveEvalFn curveFn;
+    vec2 *ctrl;
+    int numPoints;
+    float toleranceSq;
+    vec2 *vertices;
+    vec2 *tangents;
+    int maxVertices;
+    int count;
+} Tessellation;
 
 /**
  * B-spline basis matrix for cubic curves.
  * Provides C2 continuity (smooth acceleration).
- * Multiplied by 1/6 during coefficient calculation.
+ * The factor 1/6 is already folded in.
  */
 static const mat4 splineMatrix = {
-        { -1,  3, -3,  1 },
-        {  3, -6,  3,  0 },
-        { -3,  0,  3,  0 },
-        {  1,  4,  1,  0 }
+        { -1 / 6.0f,  3 / 6.0f, -3 / 6.0f,  1 / 6.0f },
+        {  3 / 6.0f, -6 / 6.0f,  3 / 6.0f,  0        },
+        { -3 / 6.0f,  0,         3 / 6.0f,  0        },
+        {  1 / 6.0f,  4 / 6.0f,  1 / 6.0f,  0        }
 };
 
 /**
@@ -65,116 +108,213 @@ static const mat4 bezierMatrix = {
 ////////////////////////    LOCAL    ////////////////////////////
 
 /**
- * Finds point with the lowest Y coordinate (tie-breaking with lowest X).
- * Used as starting point for convex hull algorithm.
+ * Evaluates a segment in power form and optionally its derivative.
+ * P(t) = ((at+b)t+c)t+d, P'(t) = (3at+2b)t+c
  *
- * @param points 2D vector of 2D points
- * @param n Number of points
- * @return Index of the lowest point
+ * @param s Segment to evaluate
+ * @param t Local parameter in range [0, 1]
+ * @param scale Factor dt/dT from the global to the local parameter
+ * @param dest Output point
+ * @param tangent Output derivative dP/dT (NULL to skip)
  */
-static int findLowestPointVec2(vec2* points, int n) {
-    int minIdx = 0;
-    for (int i = 1; i < n; ++i) {
-        if (points[i][1] < points[minIdx][1] ||
-            (fabsf(points[i][1] - points[minIdx][1]) < EPSILON && points[i][0] < points[minIdx][0])) {
-            minIdx = i;
-        }
+static void evalSegment(const Segment *s, float t, float scale, vec2 dest, vec2 tangent) {
+    dest[0] = ((s->coeffsX[0] * t + s->coeffsX[1]) * t + s->coeffsX[2]) * t + s->coeffsX[3];
+    dest[1] = ((s->coeffsY[0] * t + s->coeffsY[1]) * t + s->coeffsY[2]) * t + s->coeffsY[3];
+
+    if (tangent != NULL) {
+        tangent[0] = ((3.0f * s->coeffsX[0] * t + 2.0f * s->coeffsX[1]) * t + s->coeffsX[2]) * scale;
+        tangent[1] = ((3.0f * s->coeffsY[0] * t + 2.0f * s->coeffsY[1]) * t + s->coeffsY[2]) * scale;
     }
-    return minIdx;
 }
 
 /**
- * Calculates angle between two points in range [0, 2π).
- * Used to determine hull traversal direction.
+ * Orders points by x, then by y, for qsort.
  *
- * @param from Starting point
- * @param to Ending point
- * @return Angle in radians [0, 2π)
+ * @param a First point
+ * @param b Second point
+ * @return Negative, zero or positive like strcmp
  */
-static float angleBetweenVec2(vec2 from, vec2 to) {
-    vec2 v;
-    glm_vec2_sub(to, from, v);
-    float angle = atan2f(v[1], v[0]);
-    if (angle < 0) angle += 2.0f * (float) M_PI;
-    return angle;
+static int compareVec2(const void *a, const void *b) {
+    const float *p = a;
+    const float *q = b;
+    if (p[0] != q[0]) {
+        return p[0] < q[0] ? -1 : 1;
+    }
+    if (p[1] != q[1]) {
+        return p[1] < q[1] ? -1 : 1;
+    }
+    return 0;
 }
 
 /**
- * Calcs coefficients for all segments of B-spline curve.
- * Matrix multiplication: Coefficients = (1/6) * BasisMatrix * GeometryVector
+ * Cross product of (a - o) and (b - o).
+ * Positive if o, a, b turn counterclockwise.
  *
- * Each segment i uses control points [i, i+1, i+2, i+3].
+ * @param o Common origin
+ * @param a First point
+ * @param b Second point
+ * @return z component of the cross product
+ */
+static float turnVec2(vec2 o, vec2 a, vec2 b) {
+    return (a[0] - o[0]) * (b[1] - o[1]) - (a[1] - o[1]) * (b[0] - o[0]);
+}
+
+/**
+ * Rebuilds the arc length table from the segment coefficients.
+ * Sums the chords between ARC_SAMPLES_PER_SEGMENT points per segment.
+ * The lengths before the first changed segment are kept.
  *
- * @param ctrl 2D vector of control points
- * @param numPoints Total number of control points (>= 4)
+ * @param firstSegment First segment with changed coefficients
+ * @param numSegments Number of valid segments
  */
-static void updateSplineCoefficients(vec2 *ctrl, int numPoints) {
-    int numSegments = numPoints - 3;
+static void updateArcLengthTable(int firstSegment, int numSegments) {
+    arcTable.numSamples = numSegments * ARC_SAMPLES_PER_SEGMENT;
+    arcTable.lengths[0] = 0.0f;
 
-    // Process each segment of curve
-    for (int i = 0; i < numSegments; ++i) {
-        // Get geometry vectors
-        float Gx[4] = { ctrl[i][0], ctrl[i+1][0], ctrl[i+2][0], ctrl[i+3][0] };
-        float Gy[4] = { ctrl[i][1], ctrl[i+1][1], ctrl[i+2][1], ctrl[i+3][1] };
-
-        vec4 Cx = GLM_VEC4_ZERO_INIT;
-        vec4 Cy = GLM_VEC4_ZERO_INIT;
-
-        // Matrix multiplication C= M*G
-        for (int row = 0; row < 4; ++row) {
-            for (int col = 0; col < 4; ++col) {
-                Cx[row] += splineMatrix[row][col] * Gx[col];
-                Cy[row] += splineMatrix[row][col] * Gy[col];
-            }
-            Cx[row] /= 6.0f;
-            Cy[row] /= 6.0f;
-        }
+    vec2 prev, p;
+    evalSegment(&segments[firstSegment], 0.0f, 1.0f, prev, NULL);
 
-        // Store coefficients for segment
-        glm_vec4_copy(Cx, segments[i].coeffsX);
-        glm_vec4_copy(Cy, segments[i].coeffsY);
+    for (int i = firstSegment; i < numSegments; ++i) {
+        for (int k = 1; k <= ARC_SAMPLES_PER_SEGMENT; ++k) {
+            evalSegment(&segments[i], (float) k / ARC_SAMPLES_PER_SEGMENT, 1.0f, p, NULL);
+
+            int idx = i * ARC_SAMPLES_PER_SEGMENT + k;
+            arcTable.lengths[idx] = arcTable.lengths[idx - 1] + glm_vec2_distance(prev, p);
+            glm_vec2_copy(p, prev);
+        }
     }
 }
 
 /**
- * Calcs coefficients for all segments of Bezier curve.
+ * Calcs the coefficients of one segment.
  * Matrix multiplication: Coefficients = BasisMatrix * GeometryVector
  *
- * For Bezier curves: only one segment (4 control points) is used.
+ * Segment i uses control points [i, i+1, i+2, i+3].
+ *
+ * @param basis Basis matrix of the curve type
+ * @param ctrl 2D vector of control points
+ * @param i Index of the segment
+ */
+static void updateSegment(const mat4 basis, vec2 *ctrl, int i) {
+    // Get geometry vectors
+    vec4 Gx = { ctrl[i][0], ctrl[i+1][0], ctrl[i+2][0], ctrl[i+3][0] };
+    vec4 Gy = { ctrl[i][1], ctrl[i+1][1], ctrl[i+2][1], ctrl[i+3][1] };
+
+    // Matrix multiplication C = M*G, one row per coefficient
+    for (int row = 0; row < 4; ++row) {
+        segments[i].coeffsX[row] = glm_vec4_dot((float*) basis[row], Gx);
+        segments[i].coeffsY[row] = glm_vec4_dot((float*) basis[row], Gy);
+    }
+}
+
+/**
+ * Calcs the coefficients of the curve.
+ * If only marked control points moved since the last update with the
+ * same basis and point count, only the segments using them are recomputed.
+ * A B-spline segment uses 4 control points, so a point changes at most 4 segments.
  *
+ * @param basis Basis matrix of the curve type (splineMatrix or bezierMatrix)
  * @param ctrl 2D vector of control points
- * @param numPoints Total number of control points
+ * @param numPoints Total number of control points (>= 4)
  */
-static void updateBezierCoefficients(vec2 *ctrl, int numPoints) {
+static void updateCoefficients(const mat4 basis, vec2 *ctrl, int numPoints) {
     int numSegments = numPoints - 3;
+    int first = 0;
+    int last = numSegments - 1;
+
+    bool local = dirtyPoints.first <= dirtyPoints.last
+        && coeffBasis == (const vec4*) basis && segmentCount == numSegments;
+    if (local) {
+        first = glm_imax(dirtyPoints.first - 3, 0);
+        last = glm_imin(dirtyPoints.last, numSegments - 1);
+    }
 
-    // Proces each segment
-    for (int i = 0; i < numSegments; ++i) {
-        // Get geometry vectors
-        float Gx[4] = { ctrl[i][0], ctrl[i+1][0], ctrl[i+2][0], ctrl[i+3][0] };
-        float Gy[4] = { ctrl[i][1], ctrl[i+1][1], ctrl[i+2][1], ctrl[i+3][1] };
-
-        float Cx[4] = {0}, Cy[4] = {0};
-
-        // Matrix mult. C = M*G
-        for (int row = 0; row < 4; ++row) {
-            for (int col = 0; col < 4; ++col) {
-                Cx[row] += bezierMatrix[row][col] * Gx[col];
-                Cy[row] += bezierMatrix[row][col] * Gy[col];
-            }
-        }
+    for (int i = first; i <= last; ++i) {
+        updateSegment(basis, ctrl, i);
+    }
 
-        glm_vec4_copy(Cx, segments[i].coeffsX);
-        glm_vec4_copy(Cy, segments[i].coeffsY);
+    coeffBasis = (const vec4*) basis;
+    segmentCount = numSegments;
+    updatedSegments.first = first;
+    updatedSegments.last = last;
+    dirtyPoints.first = 1;
+    dirtyPoints.last = 0;
+
+    updateArcLengthTable(first, numSegments);
+}
+
+/**
+ * Tests if a cubic piece of the curve is flat enough to be drawn as one line.
+ * The piece is converted to Bezier form from its end points and derivatives,
+ * the curve lies inside the hull of these control points, so the distance
+ * of the inner control points to the chord bounds the error.
+ *
+ * @param p0 Start point
+ * @param d0 Derivative dP/dT at the start
+ * @param p1 End point
+ * @param d1 Derivative dP/dT at the end
+ * @param h Parameter length of the piece
+ * @param toleranceSq Squared maximum distance to the chord
+ * @return true if the chord is within the tolerance
+ */
+static bool isFlat(vec2 p0, vec2 d0, vec2 p1, vec2 d1, float h, float toleranceSq) {
+    vec2 chord, b1, b2;
+    glm_vec2_sub(p1, p0, chord);
+
+    // inner Bezier control points relative to p0
+    glm_vec2_scale(d0, h / 3.0f, b1);
+    glm_vec2_scale(d1, -h / 3.0f, b2);
+    glm_vec2_add(b2, chord, b2);
+
+    float lenSq = glm_vec2_norm2(chord);
+    if (lenSq < EPSILON) {
+        return glm_vec2_norm2(b1) <= toleranceSq && glm_vec2_norm2(b2) <= toleranceSq;
+    }
+
+    float c1 = glm_vec2_cross(chord, b1);
+    float c2 = glm_vec2_cross(chord, b2);
+    return c1 * c1 <= toleranceSq * lenSq && c2 * c2 <= toleranceSq * lenSq;
+}
+
+/**
+ * Subdivides the curve between two parameters until the pieces are flat
+ * and appends the end points of the pieces (without the start point).
+ *
+ * @param tess Tessellation state
+ * @param t0 Start parameter
+ * @param p0 Start point
+ * @param d0 Derivative at the start
+ * @param t1 End parameter
+ * @param p1 End point
+ * @param d1 Derivative at the end
+ * @param depth Remaining subdivision depth
+ */
+static void subdivideCurve(Tessellation *tess, float t0, vec2 p0, vec2 d0,
+                           float t1, vec2 p1, vec2 d1, int depth) {
+    if (depth > 0 && tess->count < tess->maxVertices - 1
+        && !isFlat(p0, d0, p1, d1, t1 - t0, tess->toleranceSq)) {
+        float tm = 0.5f * (t0 + t1);
+        vec2 pm, dm;
+        tess->curveFn(tess->ctrl, tess->numPoints, tm, pm, dm, NULL);
+
+        subdivideCurve(tess, t0, p0, d0, tm, pm, dm, depth - 1);
+        subdivideCurve(tess, tm, pm, dm, t1, p1, d1, depth - 1);
+        return;
+    }
+
+    if (tess->count < tess->maxVertices) {
+        glm_vec2_copy(p1, tess->vertices[tess->count]);
+        glm_vec2_copy(d1, tess->tangents[tess->count]);
+        tess->count++;
     }
 }
 
 ////////////////////////    PUBLIC    ////////////////////////////
 
-void utils_evalSpline(vec2 *ctrl, int numPoints, float T, vec2 dest, bool *updateCoeffs) {
+void utils_evalSpline(vec2 *ctrl, int numPoints, float T, vec2 dest, vec2 tangent, bool *updateCoeffs) {
     // Update coefficients if change
     if (updateCoeffs != NULL && *updateCoeffs) {
-        updateSplineCoefficients(ctrl, numPoints);
+        updateCoefficients(splineMatrix, ctrl, numPoints);
         *updateCoeffs = false;
     }
 
@@ -187,95 +327,147 @@ void utils_evalSpline(vec2 *ctrl, int numPoints, float T, vec2 dest, bool *updat
     if (i >= numSegments) i = numSegments - 1;
     float t = segmentPos - i;
 
-    Segment *s = &segments[i];
-
-    // p(t)=((at+b)t+c)t+d == p(t)=at3+bt2+ct+d
-    float x = ((s->coeffsX[0] * t + s->coeffsX[1]) * t + s->coeffsX[2]) * t + s->coeffsX[3];
-    float y = ((s->coeffsY[0] * t + s->coeffsY[1]) * t + s->coeffsY[2]) * t + s->coeffsY[3];
-
-    dest[0] = x;
-    dest[1] = y;
+    evalSegment(&segments[i], t, (float) numSegments, dest, tangent);
 }
 
-void utils_evalBezier(vec2 *ctrl, int numPoints, float T, vec2 dest, bool *updateCoeffs) {
+void utils_evalBezier(vec2 *ctrl, int numPoints, float T, vec2 dest, vec2 tangent, bool *updateCoeffs) {
     if (numPoints != 4) {
         return;
     }
 
     if (updateCoeffs != NULL && *updateCoeffs) {
-        updateBezierCoefficients(ctrl, numPoints);
+        updateCoefficients(bezierMatrix, ctrl, numPoints);
         *updateCoeffs = false;
     }
 
-    Segment *s = &segments[0];
-    float t = glm_clamp(T, 0.0f, 1.0f);
+    evalSegment(&segments[0], glm_clamp(T, 0.0f, 1.0f), 1.0f, dest, tangent);
+}
+
+int utils_tessellateCurve(CurveEvalFn curveFn, vec2 *ctrl, int numPoints, float tolerance,
+                          vec2 *vertices, vec2 *tangents, int maxVertices, bool *updateCoeffs) {
+    int numSegments = numPoints - 3;
+    if (numSegments < 1 || maxVertices < 2) {
+        return 0;
+    }
+
+    Tessellation tess = {
+        .curveFn = curveFn,
+        .ctrl = ctrl,
+        .numPoints = numPoints,
+        .toleranceSq = tolerance * tolerance,
+        .vertices = vertices,
+        .tangents = tangents,
+        .maxVertices = maxVertices,
+        .count = 1
+    };
+
+    vec2 p0, d0;
+    curveFn(ctrl, numPoints, 0.0f, p0, d0, updateCoeffs);
+    glm_vec2_copy(p0, vertices[0]);
+    glm_vec2_copy(d0, tangents[0]);
+
+    // Every segment is one cubic, so pieces never cross a knot
+    for (int i = 0; i < numSegments; ++i) {
+        float t0 = (float) i / numSegments;
+        float t1 = (float) (i + 1) / numSegments;
+        vec2 p1, d1;
+        curveFn(ctrl, numPoints, t1, p1, d1, NULL);
 
-    // p(t)=((at+b)t+c)t+d == p(t)=at3+bt2+ct+d
-    float x = ((s->coeffsX[0] * t + s->coeffsX[1]) * t + s->coeffsX[2]) * t + s->coeffsX[3];
-    float y = ((s->coeffsY[0] * t + s->coeffsY[1]) * t + s->coeffsY[2]) * t + s->coeffsY[3];
+        subdivideCurve(&tess, t0, p0, d0, t1, p1, d1, MAX_TESSELLATION_DEPTH);
 
-    dest[0] = x;
-    dest[1] = y;
+        glm_vec2_copy(p1, p0);
+        glm_vec2_copy(d1, d0);
+    }
+
+    // always end on the last point, even if the budget ran out
+    glm_vec2_copy(p0, vertices[tess.count - 1]);
+    glm_vec2_copy(d0, tangents[tess.count - 1]);
+    return tess.count;
 }
 
-int utils_convexHullVec2(vec2* points, vec2* hull, int n) {
-    if (n < 3) {
-        return 0;
+void utils_markControlPointDirty(int index) {
+    if (dirtyPoints.first > dirtyPoints.last) {
+        dirtyPoints.first = index;
+        dirtyPoints.last = index;
+        return;
     }
 
-    int hullCount = 0;
+    dirtyPoints.first = glm_imin(dirtyPoints.first, index);
+    dirtyPoints.last = glm_imax(dirtyPoints.last, index);
+}
 
-    // Find starting point
-    int start = findLowestPointVec2(points, n);
-    int current = start;
-    float lastAngle = -1.0f; // previous angle in radians
-
-    // Wrapping
-    do {
-        // add curr. point to hull
-        glm_vec2_copy(points[current], hull[hullCount++]);
-
-        int nextPoint = -1;
-        float minAngle = 2.0f * (float)M_PI + 1.0f; // larger than max angle
-
-        // Find next hull vertex counterclockwise
-        for (int i = 0; i < n; ++i) {
-            if (i == current) continue;
-
-            float angle = angleBetweenVec2(points[current], points[i]);
-            float relativeAngle = angle - lastAngle;
-            if (relativeAngle <= 0) relativeAngle += 2.0f * (float)M_PI;
-
-            if (relativeAngle < minAngle - EPSILON) {
-                minAngle = relativeAngle;
-                nextPoint = i;
-            } else if (fabsf(relativeAngle - minAngle) < EPSILON) {
-                // same angle, pick farther point
-                float da = glm_vec2_distance2(points[current], points[nextPoint]);
-                float db = glm_vec2_distance2(points[current], points[i]);
-                if (db > da) nextPoint = i;
-            }
-        }
+bool utils_getUpdatedRange(float *T0, float *T1) {
+    if (segmentCount <= 0) {
+        return false;
+    }
 
-        lastAngle = angleBetweenVec2(points[current], points[nextPoint]);
-        current = nextPoint;
+    *T0 = (float) updatedSegments.first / segmentCount;
+    *T1 = (float) (updatedSegments.last + 1) / segmentCount;
+    return updatedSegments.first > 0 || updatedSegments.last < segmentCount - 1;
+}
 
-    } while (current != start);
+const float* utils_getSegments(int *numSegments) {
+    *numSegments = segmentCount;
+    return (const float*) segments;
+}
 
-    glm_vec2_copy(hull[0], hull[hullCount++]);
+float utils_curveLength(void) {
+    return arcTable.lengths[arcTable.numSamples];
+}
 
-    return hullCount;
+float utils_arcLengthToT(float s) {
+    int numSamples = arcTable.numSamples;
+    if (numSamples == 0 || s <= 0.0f) {
+        return 0.0f;
+    }
+    if (s >= arcTable.lengths[numSamples]) {
+        return 1.0f;
+    }
+
+    // first sample with lengths[hi] >= s
+    int lo = 0, hi = numSamples;
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+        if (arcTable.lengths[mid] < s) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    float span = arcTable.lengths[hi] - arcTable.lengths[lo];
+    float frac = span > EPSILON ? (s - arcTable.lengths[lo]) / span : 0.0f;
+    return ((float) lo + frac) / (float) numSamples;
 }
 
-void utils_getTangent(CurveEvalFn curveFn, vec2 *ctrl, int n, float t, vec2 tangent) {
-    float eps = 0.001f; // small offset for numerical derivative
-    vec2 p1, p2;
+int utils_convexHullVec2(vec2* points, vec2* hull, int n) {
+    if (n < 3) {
+        return 0;
+    }
+
+    // Andrew's monotone chain, only cross products
+    qsort(points, n, sizeof(vec2), compareVec2);
+
+    int hullCount = 0;
 
-    curveFn(ctrl, n, t, p1, NULL);
-    curveFn(ctrl, n, t + eps, p2, NULL);
+    // Lower hull from left to right, drop points not turning counterclockwise
+    for (int i = 0; i < n; ++i) {
+        while (hullCount >= 2 && turnVec2(hull[hullCount - 2], hull[hullCount - 1], points[i]) <= 0.0f) {
+            hullCount--;
+        }
+        glm_vec2_copy(points[i], hull[hullCount++]);
+    }
+
+    // Upper hull from right to left, ends on the first point again
+    int lowerCount = hullCount + 1;
+    for (int i = n - 2; i >= 0; --i) {
+        while (hullCount >= lowerCount && turnVec2(hull[hullCount - 2], hull[hullCount - 1], points[i]) <= 0.0f) {
+            hullCount--;
+        }
+        glm_vec2_copy(points[i], hull[hullCount++]);
+    }
 
-    glm_vec2_sub(p2, p1, tangent);
-    glm_vec2_normalize(tangent);
+    return hullCount;
 }
 
 bool utils_circleInCircle(vec2 c1, float r1, vec2 c2, float r2) {
@@ -286,35 +478,28 @@ bool utils_circleInCircle(vec2 c1, float r1, vec2 c2, float r2) {
     return distSq <= radiusSum * radiusSum;
 }
 
-bool utils_isMouseInCircle(float mouseX, float mouseY, Circle *c, RenderingData *rd, float range) {
-    float mouseX_ndc = (float) mouseX / rd->screenRes[0];
-    float mouseY_ndc = 1.0f - (float) mouseY / rd->screenRes[1];
+bool utils_circleInCapsule(vec2 c, float r, vec2 a, vec2 b, float capsuleRadius) {
+    vec2 ab, ac;
+    glm_vec2_sub(b, a, ab);
+    glm_vec2_sub(c, a, ac);
 
-    float sceneX = rd->left + mouseX_ndc * (rd->right - rd->left);
-    float sceneY = rd->bottom + mouseY_ndc * (rd->top - rd->bottom);
+    // Closest point on the segment
+    float lenSq = glm_vec2_norm2(ab);
+    float t = lenSq > EPSILON ? glm_clamp(glm_vec2_dot(ac, ab) / lenSq, 0.0f, 1.0f) : 0.0f;
 
-    float dx = sceneX - c->center[0];
-    float dy = sceneY - c->center[1];
+    vec2 closest;
+    glm_vec2_scale(ab, t, closest);
+    glm_vec2_add(a, closest, closest);
 
-    float radius = range * c->r;
-    return (dx*dx + dy*dy) <= (radius * radius);
+    float radiusSum = r + capsuleRadius;
+    return glm_vec2_distance2(c, closest) <= radiusSum * radiusSum;
 }
 
-void utils_calcNormals(vec2 *vertices, vec3 *normalDest, int n) {
-
+void utils_calcNormals(vec2 *tangents, vec3 *normalDest, int n) {
     for (int i = 0; i < n; ++i) {
-    vec3 diff, normal;
-
-        int left = (i == 0) ? 0 : i - 1;
-        int right = (i == n - 1) ? n - 1 : i + 1;
-
-        diff[0] = vertices[left][0] - vertices[right][0];
-        diff[1] = vertices[left][1] - vertices[right][1];
-        diff[2] = 0.0f;
-
-        glm_vec3_cross(diff, (vec3) {0, 0, 1}, normal);
+        // cross(-tangent, z), same side as the former finite differences
+        vec3 normal = { -tangents[i][1], tangents[i][0], 0.0f };
         glm_vec3_normalize(normal);
-
         glm_vec3_copy(normal, normalDest[i]);
     }
 }
@@ -8,6 +8,7 @@
  * - Circle-circle collision detection
  * - Normal vector calculation for curve vertices
  * - Tangent vector computation for curve orientation
+ * - Arc length parameterization for constant speed motion
  * - Mouse-circle intersection testing for UI interaction
  *
  * @authors Nikolaos Tsetsas, Noah Schmidt
@@ -22,14 +23,24 @@
 
 #define VEC2(x, y) ((vec2) {x, y})
 
+/** Maximum number of curve segments (each segment requires 4 control points) */
+#define CURVE_MAX_SEGMENTS (BUTTON_COUNT - 3)
+
+/** Floats per segment of utils_getSegments: coefficients (a, b, c, d) of x, then of y */
+#define CURVE_SEGMENT_FLOATS 8
+
 /**
  * Computes convex hull with 2D points
  * -> smallest convex polygon surrounding all points
  *
- * @param points 2D vector of input points
- * @param hull Output 2D vector for convex hull vertices
+ * Andrew's monotone chain in O(n log n), works for any number of points.
+ * The hull is counterclockwise from the leftmost point and closed,
+ * the last vertex repeats the first. Collinear points are left out.
+ *
+ * @param points 2D vector of input points, sorted in place
+ * @param hull Output 2D vector for convex hull vertices, room for n + 1
  * @param n Number of input points
- * @return Number of vertices in the convex hull
+ * @return Number of vertices in the convex hull, 0 for less than 3 points
  */
 int utils_convexHullVec2(vec2* points, vec2* hull, int n);
 
@@ -42,9 +53,10 @@ int utils_convexHullVec2(vec2* points, vec2* hull, int n);
  * @param numPoints Number of control points (must be 4)
  * @param T Parameter value in range [0, 1] where 0=start, 1=end
  * @param dest Output parameter - resulting 2D point on the curve at parameter T
+ * @param tangent Output parameter - derivative dP/dT at parameter T (NULL to skip)
  * @param updateCoeffs Pointer to flag indicating if coefficients need recalculation
  */
-void utils_evalBezier(vec2 *ctrl, int numPoints, float T, vec2 dest, bool *updateCoeffs);
+void utils_evalBezier(vec2 *ctrl, int numPoints, float T, vec2 dest, vec2 tangent, bool *updateCoeffs);
 
 /**
  * Evaluates B-spline curve
@@ -53,21 +65,77 @@ void utils_evalBezier(vec2 *ctrl, int numPoints, float T, vec2 dest, bool *updat
  * @param numPoints Number of control points
  * @param T Parameter value in range [0, 1] where 0=start, 1=end
  * @param dest Output parameter - resulting 2D point on the curve at parameter T
+ * @param tangent Output parameter - derivative dP/dT at parameter T (NULL to skip)
  * @param updateCoeffs Pointer to flag indicating if coefficients need recalculation
  */
-void utils_evalSpline(vec2 *ctrl, int numPoints, float T, vec2 dest, bool *updateCoeffs);
+void utils_evalSpline(vec2 *ctrl, int numPoints, float T, vec2 dest, vec2 tangent, bool *updateCoeffs);
 
 /**
- * Calculates tangent at a point on a curve
- * The tangent indicates the direction of the curve at the given parameter value.
+ * Tessellates the curve adaptively into a line strip.
+ * Each curve segment is halved until its pieces deviate at most
+ * tolerance from their chord, so straight parts get few vertices
+ * and tight bends many.
  *
  * @param curveFn Function pointer to curve evaluation function (spline or bezier)
  * @param ctrl 2D vector of control points
- * @param n Number of control points
- * @param t Parameter value in range [0, 1]
- * @param tangent Output parameter - normalized tangent vector at parameter t
+ * @param numPoints Number of control points
+ * @param tolerance Maximum distance between curve and line strip
+ * @param vertices Output array for the vertex positions
+ * @param tangents Output array for the tangents at the vertices
+ * @param maxVertices Capacity of the output arrays
+ * @param updateCoeffs Pointer to flag indicating if coefficients need recalculation
+ * @return Number of written vertices
+ */
+int utils_tessellateCurve(CurveEvalFn curveFn, vec2 *ctrl, int numPoints, float tolerance,
+                          vec2 *vertices, vec2 *tangents, int maxVertices, bool *updateCoeffs);
+
+/**
+ * Marks a moved control point. The next coefficient update only
+ * recomputes the segments using the marked points, as long as the
+ * curve type and the number of control points stay the same.
+ * Unmarked changes need a full update, so only mark points whose
+ * move is the only change since the last update.
+ *
+ * @param index Index of the moved control point
+ */
+void utils_markControlPointDirty(int index);
+
+/**
+ * Returns the parameter range of the segments recomputed by the
+ * last coefficient update.
+ *
+ * @param T0 Output start of the range
+ * @param T1 Output end of the range
+ * @return False if the whole curve was recomputed
+ */
+bool utils_getUpdatedRange(float *T0, float *T1);
+
+/**
+ * Returns the power form coefficients of the last coefficient update,
+ * CURVE_SEGMENT_FLOATS per segment. The layout is the std140 layout
+ * of the segment block in curve.vert.
+ *
+ * @param numSegments Output number of segments
+ * @return Coefficients of all segments
+ */
+const float* utils_getSegments(int *numSegments);
+
+/**
+ * Returns the length of the curve from the last coefficient update.
+ * The arc length table is rebuilt together with the coefficients.
+ *
+ * @return Curve length in scene units
+ */
+float utils_curveLength(void);
+
+/**
+ * Maps a distance along the curve to the curve parameter.
+ * Binary search in the arc length table with linear interpolation.
+ *
+ * @param s Distance from the curve start, clamped to [0, utils_curveLength()]
+ * @return Parameter value in range [0, 1]
  */
-void utils_getTangent(CurveEvalFn curveFn, vec2 *ctrl, int n, float t, vec2 tangent);
+float utils_arcLengthToT(float s);
 
 /**
  * Tests if two circles overlap.
@@ -80,26 +148,28 @@ void utils_getTangent(CurveEvalFn curveFn, vec2 *ctrl, int n, float t, vec2 tang
  */
 bool utils_circleInCircle(vec2 c1, float r1, vec2 c2, float r2);
 
+/**
+ * Tests if a circle overlaps a capsule, the area swept by a circle
+ * moving along a line segment.
+ *
+ * @param c Center position of the circle
+ * @param r Radius of the circle
+ * @param a Start of the capsule segment
+ * @param b End of the capsule segment
+ * @param capsuleRadius Radius of the capsule
+ * @return true if circle and capsule overlap, false otherwise
+ */
+bool utils_circleInCapsule(vec2 c, float r, vec2 a, vec2 b, float capsuleRadius);
+
 /**
  * Calculates normal vectors for each vertex in a curve.
  * Normals are perpendicular to the curve tangent and point to the "outside".
- * Uses finite differences and cross product for calculation.
+ * Uses the exact tangents from the curve evaluation.
  *
- * @param vertices 2D vector of curve vertex positions
+ * @param tangents 2D vector of curve tangents (any length)
  * @param normalDest Output array for normal vectors
  * @param n Number of vertices
  */
-void utils_calcNormals(vec2 *vertices, vec3 *normalDest, int n);
-
-/**
- * Tests if the mouse cursor is currently inside the given circle.
- * @param mouseX Position of the mouse in x.
- * @param mouse Position of the mouse in y.
- * @param c Circle data.
- * @param rd Screen data.
- * @param range Range factor for the collision radius.
- * @returns If the mouse cursor is currently inside the given circle.
- */
-bool utils_isMouseInCircle(float mouseX, float mouseY, Circle *c, RenderingData *rd, float range);
+void utils_calcNormals(vec2 *tangents, vec3 *normalDest, int n);
 
-#endif // UTILS_H
+#endif // UTILS_H
\ No newline at end of file
@@ -0,0 +1,584 @@
+/**
+ * @file levelgen.c
+ * @brief Headless generator of solvable levels
+ *
+ * Places stars and clouds at random and searches control point
+ * configurations that collect every star without touching a cloud.
+ * Candidates are flown SOLVER_LANES at a time by the solver kernel and the
+ * batches are split over worker threads in chunks. Every candidate is
+ * derived from the seed and its index only, so the first solution found
+ * does not depend on the thread count. A solution of the kernel is
+ * replayed with utils_evalSpline and utils_circleInCapsule, the code the
+ * game flies with, before the level is accepted.
+ *
+ * The levels are written in the format of levels.h, the solution and all
+ * statistics as comments, so the output can be appended to levels.txt.
+ *
+ * Usage: cg2_ueb01_levelgen [-n levels] [-b buttons] [-s stars] [-c clouds]
+ *                           [-k candidates] [-t threads] [-r seed] [-x simd] [-o file]
+ *   candidates  search budget per layout
+ *   threads     worker threads including the main thread
+ *   simd        0 to use the scalar kernel
+ *   file        level source output, stdout if omitted
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include <fhwcg/fhwcg.h>
+#include "levels.h"
+#include "logic.h"
+#include "solver.h"
+#include "utils.h"
+#include "thread.h"
+
+#define DEFAULT_LEVELS 1
+#define DEFAULT_BUTTONS 8
+#define DEFAULT_STARS 5
+#define DEFAULT_CLOUDS 3
+#define DEFAULT_CANDIDATES (1 << 20)
+#define DEFAULT_SEED 42
+#define MAX_THREADS 64
+
+/** Layouts tried per level before giving up */
+#define MAX_LAYOUTS 64
+
+/** Batches a worker takes at once */
+#define CHUNK_BATCHES 64
+
+/** Stars and clouds are placed in [-LAYOUT_EXTENT, LAYOUT_EXTENT]² */
+#define LAYOUT_EXTENT 0.9f
+
+/** Smallest gap between two objects of a layout, added to their radii */
+#define LAYOUT_SPACING 0.1f
+
+/** Largest random offset of a candidate control point */
+#define CANDIDATE_JITTER 0.3f
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Generator configuration parsed from the command line.
+ */
+typedef struct {
+    int levels;
+    int buttons;
+    int stars;
+    int clouds;
+    int64_t candidates;
+    int threads;
+    bool simd;
+    uint64_t seed;
+    const char *output;
+} GenConfig;
+
+/**
+ * Layout being generated, the Level points into it.
+ */
+typedef struct {
+    vec2 stars[MAX_STARS];
+    vec2 clouds[MAX_STARS];
+    Level level;
+} Layout;
+
+/**
+ * State of one search, shared by all workers.
+ */
+static struct {
+    const Level *level;
+    int numPoints;
+    bool simd;
+    uint64_t seed;
+    int64_t batchCount;
+
+    Mutex mutex;
+    int64_t nextBatch;
+    int64_t foundBatch;     // first batch with a solution, batchCount if none
+    int foundLane;
+    int64_t evaluated;      // batches flown
+} g_search;
+
+/**
+ * Advances a splitmix64 state.
+ * @param state Generator state.
+ * @return Next 64 random bits.
+ */
+static uint64_t nextRandom(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Uniform random float.
+ * @param state Generator state.
+ * @param min Lower bound.
+ * @param max Upper bound.
+ * @return Random value in [min, max).
+ */
+static float randomRange(uint64_t *state, float min, float max) {
+    return min + (max - min) * (float) (nextRandom(state) >> 40) / (float) (1 << 24);
+}
+
+/**
+ * Rounds a position to the precision of the level file,
+ * so the written level is the one that was solved.
+ * @param v Position to round.
+ */
+static void roundPosition(vec2 v) {
+    v[0] = roundf(v[0] * 1000.0f) / 1000.0f;
+    v[1] = roundf(v[1] * 1000.0f) / 1000.0f;
+}
+
+/**
+ * Checks a position against existing positions.
+ * @param v Position to check.
+ * @param others Positions to keep away from.
+ * @param count Number of positions.
+ * @param gap Smallest distance to them.
+ * @return True if no position is closer than the gap.
+ */
+static bool isFree(vec2 v, vec2 *others, int count, float gap) {
+    for (int i = 0; i < count; ++i) {
+        if (glm_vec2_distance2(v, others[i]) < gap * gap) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Places a position at random with gaps to the stars and clouds placed so far.
+ * @param state Generator state.
+ * @param dest Output position.
+ * @param layout Layout with the placed objects.
+ * @param stars Number of placed stars.
+ * @param starGap Smallest distance to the stars.
+ * @param clouds Number of placed clouds.
+ * @param cloudGap Smallest distance to the clouds.
+ * @return False if no free position was found.
+ */
+static bool placeObject(uint64_t *state, vec2 dest, Layout *layout, int stars, float starGap, int clouds, float cloudGap) {
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        dest[0] = randomRange(state, -LAYOUT_EXTENT, LAYOUT_EXTENT);
+        dest[1] = randomRange(state, -LAYOUT_EXTENT, LAYOUT_EXTENT);
+        roundPosition(dest);
+
+        if (isFree(dest, layout->stars, stars, starGap) && isFree(dest, layout->clouds, clouds, cloudGap)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Generates a random layout.
+ * @param cfg Generator configuration.
+ * @param state Generator state.
+ * @param layout Output layout.
+ * @return False if the objects do not fit.
+ */
+static bool generateLayout(const GenConfig *cfg, uint64_t *state, Layout *layout) {
+    Level *level = &layout->level;
+    *level = (Level) {
+        .stars = layout->stars, .starCount = cfg->stars, .starRadius = LEVEL_STAR_RADIUS,
+        .clouds = layout->clouds, .cloudCount = cfg->clouds, .cloudRadius = LEVEL_CLOUD_RADIUS,
+        .buttonCount = cfg->buttons
+    };
+
+    for (int i = 0; i < cfg->stars; ++i) {
+        if (!placeObject(state, layout->stars[i], layout, i, 2.0f * level->starRadius + LAYOUT_SPACING, 0, 0.0f)) {
+            return false;
+        }
+    }
+
+    // Clouds keep the airplane width away from every star
+    float starGap = level->starRadius + level->cloudRadius + 2.0f * AIRPLANE_COLLIDER_RADIUS + LAYOUT_SPACING;
+    for (int i = 0; i < cfg->clouds; ++i) {
+        if (!placeObject(state, layout->clouds[i], layout, cfg->stars, starGap, i, 2.0f * level->cloudRadius)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Orders waypoints by x, for qsort.
+ * @param a First waypoint.
+ * @param b Second waypoint.
+ * @return Negative, zero or positive like strcmp.
+ */
+static int compareWaypoints(const void *a, const void *b) {
+    float ka = ((const float*) a)[2], kb = ((const float*) b)[2];
+    return (ka > kb) - (ka < kb);
+}
+
+/**
+ * Derives a candidate from its index: a polyline from the left to the right
+ * edge through the stars in a jittered x order, resampled to the control
+ * points and offset at random.
+ * @param level The level to solve.
+ * @param numPoints Number of control points.
+ * @param seed Seed of the search.
+ * @param index Candidate index.
+ * @param ctrl Output control points.
+ */
+static void generateCandidate(const Level *level, int numPoints, uint64_t seed, int64_t index, vec2 *ctrl) {
+    uint64_t state = seed ^ ((uint64_t) index * 0xd1342543de82ef95ull);
+    nextRandom(&state);
+
+    // Waypoints x, y and sort key
+    float waypoints[MAX_STARS + 2][3];
+    int count = 0;
+    float shuffle = randomRange(&state, 0.0f, 0.6f);
+    waypoints[count][0] = -1.0f;
+    waypoints[count][1] = randomRange(&state, -LAYOUT_EXTENT, LAYOUT_EXTENT);
+    waypoints[count++][2] = -INFINITY;
+    for (int i = 0; i < level->starCount; ++i) {
+        waypoints[count][0] = level->stars[i][0];
+        waypoints[count][1] = level->stars[i][1];
+        waypoints[count++][2] = level->stars[i][0] + randomRange(&state, -shuffle, shuffle);
+    }
+    waypoints[count][0] = 1.0f;
+    waypoints[count][1] = randomRange(&state, -LAYOUT_EXTENT, LAYOUT_EXTENT);
+    waypoints[count++][2] = INFINITY;
+    qsort(waypoints, count, sizeof(waypoints[0]), compareWaypoints);
+
+    float length = 0.0f;
+    for (int i = 1; i < count; ++i) {
+        length += hypotf(waypoints[i][0] - waypoints[i - 1][0], waypoints[i][1] - waypoints[i - 1][1]);
+    }
+
+    // Resample at equal distances along the polyline
+    float jitter = randomRange(&state, 0.0f, CANDIDATE_JITTER);
+    int segment = 1;
+    float segmentStart = 0.0f;
+    for (int p = 0; p < numPoints; ++p) {
+        float s = length * p / (numPoints - 1);
+        float segmentLength = 0.0f;
+        while (segment < count) {
+            segmentLength = hypotf(waypoints[segment][0] - waypoints[segment - 1][0],
+                                   waypoints[segment][1] - waypoints[segment - 1][1]);
+            if (segment == count - 1 || segmentStart + segmentLength >= s) {
+                break;
+            }
+            segmentStart += segmentLength;
+            ++segment;
+        }
+
+        float t = segmentLength > EPSILON ? glm_clamp((s - segmentStart) / segmentLength, 0.0f, 1.0f) : 0.0f;
+        ctrl[p][0] = glm_lerp(waypoints[segment - 1][0], waypoints[segment][0], t) + randomRange(&state, -jitter, jitter);
+        ctrl[p][1] = glm_lerp(waypoints[segment - 1][1], waypoints[segment][1], t) + randomRange(&state, -jitter, jitter);
+    }
+}
+
+/**
+ * Fills a batch with consecutive candidates.
+ * @param batchIndex Index of the batch.
+ * @param batch Output control points.
+ */
+static void fillBatch(int64_t batchIndex, SolverBatch *batch) {
+    vec2 ctrl[BUTTON_COUNT];
+    for (int lane = 0; lane < SOLVER_LANES; ++lane) {
+        generateCandidate(g_search.level, g_search.numPoints, g_search.seed, batchIndex * SOLVER_LANES + lane, ctrl);
+        for (int p = 0; p < g_search.numPoints; ++p) {
+            batch->x[p][lane] = ctrl[p][0];
+            batch->y[p][lane] = ctrl[p][1];
+        }
+    }
+}
+
+/**
+ * Worker of a search: takes chunks of batches until the budget is used up
+ * or no earlier batch than the first solution is left.
+ */
+static THREAD_ENTRY(searchWorker) {
+    NK_UNUSED(arg);
+    SolverBatch batch;
+
+    for (;;) {
+        MUTEX_LOCK(&g_search.mutex);
+        int64_t begin = g_search.nextBatch;
+        int64_t end = begin + CHUNK_BATCHES < g_search.foundBatch ? begin + CHUNK_BATCHES : g_search.foundBatch;
+        g_search.nextBatch = end;
+        MUTEX_UNLOCK(&g_search.mutex);
+        if (begin >= end) {
+            break;
+        }
+
+        int64_t b = begin;
+        for (; b < end; ++b) {
+            fillBatch(b, &batch);
+            int solved = solver_evalBatch(g_search.simd, g_search.level, g_search.numPoints, &batch, NULL);
+            if (solved != 0) {
+                int lane = 0;
+                while (!(solved >> lane & 1)) {
+                    ++lane;
+                }
+
+                MUTEX_LOCK(&g_search.mutex);
+                if (b < g_search.foundBatch) {
+                    g_search.foundBatch = b;
+                    g_search.foundLane = lane;
+                }
+                MUTEX_UNLOCK(&g_search.mutex);
+                ++b;
+                break;
+            }
+        }
+
+        MUTEX_LOCK(&g_search.mutex);
+        g_search.evaluated += b - begin;
+        MUTEX_UNLOCK(&g_search.mutex);
+    }
+
+    THREAD_RETURN;
+}
+
+/**
+ * Searches a solution of a level on all threads.
+ * @param cfg Generator configuration.
+ * @param level The level to solve.
+ * @param seed Seed of the candidates.
+ * @param ctrl Output control points of the solution.
+ * @param evaluated Output number of candidates flown.
+ * @return Index of the solution, -1 if the budget was used up.
+ */
+static int64_t searchSolution(const GenConfig *cfg, const Level *level, uint64_t seed, vec2 *ctrl, int64_t *evaluated) {
+    g_search.level = level;
+    g_search.numPoints = cfg->buttons;
+    g_search.simd = cfg->simd;
+    g_search.seed = seed;
+    g_search.batchCount = (cfg->candidates + SOLVER_LANES - 1) / SOLVER_LANES;
+    g_search.nextBatch = 0;
+    g_search.foundBatch = g_search.batchCount;
+    g_search.foundLane = 0;
+    g_search.evaluated = 0;
+
+    Thread threads[MAX_THREADS];
+    int started = 0;
+    while (started < cfg->threads - 1 && THREAD_CREATE(&threads[started], searchWorker)) {
+        ++started;
+    }
+    searchWorker(NULL);
+    for (int i = 0; i < started; ++i) {
+        THREAD_JOIN(threads[i]);
+    }
+
+    *evaluated = g_search.evaluated * SOLVER_LANES;
+    if (g_search.foundBatch >= g_search.batchCount) {
+        return -1;
+    }
+
+    int64_t index = g_search.foundBatch * SOLVER_LANES + g_search.foundLane;
+    generateCandidate(level, cfg->buttons, seed, index, ctrl);
+    return index;
+}
+
+/**
+ * Flies a solution with the curve and collision code of the game,
+ * at four times the sample density of the kernel.
+ * @param level The level to solve.
+ * @param ctrl Control points of the solution.
+ * @param n Number of control points.
+ * @return True if every star is collected without touching a cloud.
+ */
+static bool replaySolution(const Level *level, vec2 *ctrl, int n) {
+    const vec2 shape[3] = AIRPLANE_SHAPE_INIT;
+    bool collected[MAX_STARS] = { false };
+    bool updateCoeffs = true;
+    vec2 prev[3], next[3];
+
+    int steps = (n - 3) * SOLVER_SAMPLES_PER_SEGMENT * 4;
+    for (int s = 0; s <= steps; ++s) {
+        vec2 P, T;
+        utils_evalSpline(ctrl, n, (float) s / steps, P, T, &updateCoeffs);
+        glm_vec2_normalize(T);
+
+        float rotation = atan2f(T[1], T[0]) - (float) M_PI_2;
+        float cosA = cosf(rotation), sinA = sinf(rotation);
+        vec2 position = { P[0] - T[1] * AIRPLANE_CURVE_OFFSET, P[1] + T[0] * AIRPLANE_CURVE_OFFSET };
+        for (int v = 0; v < 3; ++v) {
+            next[v][0] = cosA * shape[v][0] - sinA * shape[v][1] + position[0];
+            next[v][1] = sinA * shape[v][0] + cosA * shape[v][1] + position[1];
+        }
+
+        for (int v = 0; v < 3 && s > 0; ++v) {
+            for (int o = 0; o < level->cloudCount; ++o) {
+                if (utils_circleInCapsule(level->clouds[o], level->cloudRadius, prev[v], next[v], AIRPLANE_COLLIDER_RADIUS)) {
+                    return false;
+                }
+            }
+            for (int o = 0; o < level->starCount; ++o) {
+                collected[o] |= utils_circleInCapsule(level->stars[o], level->starRadius, prev[v], next[v], AIRPLANE_COLLIDER_RADIUS);
+            }
+        }
+        memcpy(prev, next, sizeof(prev));
+    }
+
+    for (int o = 0; o < level->starCount; ++o) {
+        if (!collected[o]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Writes a level in the format of levels.h, the solution as comments.
+ * @param out Destination.
+ * @param level The level.
+ * @param ctrl Control points of the solution.
+ * @param index Number of the level.
+ * @param candidate Index of the solution among the candidates.
+ */
+static void writeLevel(FILE *out, const Level *level, vec2 *ctrl, int index, int64_t candidate) {
+    fprintf(out, "\n# Generated level %d, solved by candidate %lld\n", index + 1, (long long) candidate);
+    fprintf(out, "level\nbuttons %d\n", level->buttonCount);
+    for (int i = 0; i < level->starCount; ++i) {
+        fprintf(out, "star %.3f %.3f\n", level->stars[i][0], level->stars[i][1]);
+    }
+    for (int i = 0; i < level->cloudCount; ++i) {
+        fprintf(out, "cloud %.3f %.3f\n", level->clouds[i][0], level->clouds[i][1]);
+    }
+    for (int i = 0; i < level->buttonCount; ++i) {
+        fprintf(out, "# control %.4f %.4f\n", ctrl[i][0], ctrl[i][1]);
+    }
+    fflush(out);
+}
+
+/**
+ * Prints the usage string.
+ */
+static void printUsage(void) {
+    printf("Usage: " PROGRAM_NAME " [-n levels] [-b buttons] [-s stars] [-c clouds]"
+           " [-k candidates] [-t threads] [-r seed] [-x simd] [-o file]\n");
+    printf("  candidates  search budget per layout\n");
+    printf("  threads     worker threads including the main thread\n");
+    printf("  simd        0 to use the scalar kernel\n");
+    printf("  file        level source output, stdout if omitted\n");
+}
+
+/**
+ * Parses the command line into a configuration.
+ * @param argc Argument count.
+ * @param argv Argument values.
+ * @param cfg Configuration to fill, prefilled with defaults.
+ * @return False if the arguments are invalid.
+ */
+static bool parseArgs(int argc, char **argv, GenConfig *cfg) {
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0' || i + 1 >= argc) {
+            return false;
+        }
+
+        char *arg = argv[++i];
+        switch (opt[1]) {
+            case 'n': cfg->levels = atoi(arg); break;
+            case 'b': cfg->buttons = atoi(arg); break;
+            case 's': cfg->stars = atoi(arg); break;
+            case 'c': cfg->clouds = atoi(arg); break;
+            case 'k': cfg->candidates = strtoll(arg, NULL, 10); break;
+            case 't': cfg->threads = atoi(arg); break;
+            case 'r': cfg->seed = strtoull(arg, NULL, 10); break;
+            case 'x': cfg->simd = atoi(arg) != 0; break;
+            case 'o': cfg->output = arg; break;
+            default:
+                return false;
+        }
+    }
+    return cfg->levels > 0 && cfg->buttons >= 4 && cfg->buttons <= BUTTON_COUNT
+        && cfg->stars > 0 && cfg->stars <= MAX_STARS && cfg->clouds >= 0 && cfg->clouds <= MAX_STARS
+        && cfg->candidates > 0 && cfg->threads > 0 && cfg->threads <= MAX_THREADS;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+int main(int argc, char **argv) {
+    GenConfig cfg = {
+        .levels = DEFAULT_LEVELS,
+        .buttons = DEFAULT_BUTTONS,
+        .stars = DEFAULT_STARS,
+        .clouds = DEFAULT_CLOUDS,
+        .candidates = DEFAULT_CANDIDATES,
+        .threads = 1,
+        .simd = true,
+        .seed = DEFAULT_SEED,
+        .output = NULL
+    };
+
+    if (!parseArgs(argc, argv, &cfg)) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    // Only the timer is used, no window is created
+    if (!glfwInit()) {
+        printf("Failed to initialize GLFW!\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = stdout;
+    if (cfg.output) {
+        out = fopen(cfg.output, "w");
+        if (!out) {
+            printf("Failed to open '%s'!\n", cfg.output);
+            glfwTerminate();
+            return EXIT_FAILURE;
+        }
+    }
+
+    cfg.simd = cfg.simd && solver_isSimdSupported();
+    MUTEX_INIT(&g_search.mutex);
+
+    int64_t total = 0;
+    int generated = 0;
+    double start = glfwGetTime();
+
+    for (int l = 0; l < cfg.levels; ++l) {
+        bool solved = false;
+        for (int attempt = 0; attempt < MAX_LAYOUTS && !solved; ++attempt) {
+            uint64_t state = cfg.seed ^ ((uint64_t) (l * MAX_LAYOUTS + attempt) << 32);
+            nextRandom(&state);
+
+            Layout layout;
+            if (!generateLayout(&cfg, &state, &layout)) {
+                continue;
+            }
+
+            vec2 ctrl[BUTTON_COUNT];
+            int64_t evaluated;
+            int64_t candidate = searchSolution(&cfg, &layout.level, nextRandom(&state), ctrl, &evaluated);
+            total += evaluated;
+
+            if (candidate < 0) {
+                printf("# Level %d, layout %d: no solution in %lld candidates\n", l + 1, attempt + 1, (long long) evaluated);
+            } else if (!replaySolution(&layout.level, ctrl, cfg.buttons)) {
+                printf("# Level %d, layout %d: candidate %lld rejected by the replay\n", l + 1, attempt + 1, (long long) candidate);
+            } else {
+                writeLevel(out, &layout.level, ctrl, l, candidate);
+                solved = true;
+            }
+        }
+
+        if (solved) {
+            ++generated;
+        } else {
+            printf("# Level %d: no solvable layout in %d attempts\n", l + 1, MAX_LAYOUTS);
+        }
+    }
+
+    double elapsed = glfwGetTime() - start;
+    printf("# %d of %d levels, %lld candidates in %.3f s, %.0f candidates/s (%s kernel, %d threads)\n",
+        generated, cfg.levels, (long long) total, elapsed, elapsed > 0.0 ? total / elapsed : 0.0,
+        cfg.simd ? "SSE" : "scalar", cfg.threads);
+
+    MUTEX_DESTROY(&g_search.mutex);
+    if (out != stdout) {
+        fclose(out);
+    }
+    glfwTerminate();
+
+    return generated == cfg.levels ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file mathbench.c
+ * @brief Benchmarks of the patch and curve kernels of utils.c
+ *
+ * Every kernel cycles through MICROBENCH_INPUTS prepared inputs, so one
+ * batch does not evaluate the same point over and over.
+ *
+ * Usage: cg2_ueb02_mathbench [-s samples] [-w warmup] [-f filter]
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include <fhwcg/fhwcg.h>
+#include "utils.h"
+#include "logic.h"
+#include "input.h"
+#include "microbench.h"
+
+/** Patches the patch kernels cycle through, a power of two */
+#define PATCHES 64
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Inputs of the patch kernels.
+ */
+typedef struct {
+    mat4 geometry[PATCHES];
+    Patch patches[PATCHES];
+    float s[MICROBENCH_INPUTS], t[MICROBENCH_INPUTS];
+} PatchInput;
+
+/**
+ * Inputs of the Bezier kernel.
+ */
+typedef struct {
+    vec3 points[MICROBENCH_INPUTS];
+    float t[MICROBENCH_INPUTS];
+} PointInput;
+
+/**
+ * Builds the polynomial form of patches.
+ * @param ctx PatchInput.
+ * @param iterations Patches built.
+ */
+static void benchPolynomialPatch(void *ctx, int iterations) {
+    PatchInput *in = ctx;
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        Patch *p = &in->patches[i & (PATCHES - 1)];
+        utils_calculatePolynomialPatch(p, in->geometry[i & (PATCHES - 1)]);
+        sum += p->coeffsY[1][2];
+    }
+    microbench_consume(sum);
+}
+
+/**
+ * Evaluates patches at single points.
+ * @param ctx PatchInput.
+ * @param iterations Evaluations.
+ */
+static void benchEvalPatchLocal(void *ctx, int iterations) {
+    PatchInput *in = ctx;
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        int k = i & (MICROBENCH_INPUTS - 1);
+        PatchEvalResult r = utils_evalPatchLocal(&in->patches[i & (PATCHES - 1)], in->s[k], in->t[k]);
+        sum += r.value + r.dsd + r.dtd;
+    }
+    microbench_consume(sum);
+}
+
+/**
+ * Evaluates a cubic Bezier curve through four of the points.
+ * @param ctx PointInput.
+ * @param iterations Evaluations.
+ */
+static void benchBezier3D(void *ctx, int iterations) {
+    PointInput *in = ctx;
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        int k = i & (MICROBENCH_INPUTS - 4);
+        vec3 out;
+        utils_evalBezier3D(in->points[k], in->points[k + 1], in->points[k + 2], in->points[k + 3], in->t[k], out);
+        sum += out[0] + out[1] + out[2];
+    }
+    microbench_consume(sum);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+/**
+ * Stands in for input.c, which needs a window. Only the height functions
+ * read the input data and they are not benchmarked.
+ * @return Never a valid pointer.
+ */
+InputData* getInputData(void) {
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    MicroBenchConfig cfg;
+    if (!microbench_parseArgs(PROGRAM_NAME, argc, argv, &cfg)) {
+        return EXIT_FAILURE;
+    }
+
+    static PatchInput patch;
+    for (int p = 0; p < PATCHES; ++p) {
+        for (int i = 0; i < 16; ++i) {
+            patch.geometry[p][i / 4][i % 4] = microbench_random() * 2.0f - 1.0f;
+        }
+        utils_calculatePolynomialPatch(&patch.patches[p], patch.geometry[p]);
+    }
+    for (int i = 0; i < MICROBENCH_INPUTS; ++i) {
+        patch.s[i] = microbench_random();
+        patch.t[i] = microbench_random();
+    }
+
+    static PointInput point;
+    for (int i = 0; i < MICROBENCH_INPUTS; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            point.points[i][c] = microbench_random() * 4.0f - 2.0f;
+        }
+        point.t[i] = microbench_random();
+    }
+
+    microbench_run(&cfg, "calculatePolynomialPatch", benchPolynomialPatch, &patch);
+    microbench_run(&cfg, "evalPatchLocal", benchEvalPatchLocal, &patch);
+    microbench_run(&cfg, "evalBezier3D", benchBezier3D, &point);
+    return microbench_finish(&cfg);
+}
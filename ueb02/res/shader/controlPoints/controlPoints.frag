@@ -0,0 +1,19 @@
+#version 430
+
+uniform vec3 u_color = vec3(0, 0, 0);
+uniform vec3 u_selectedColor = vec3(1, 0, 0);
+
+flat in int v_selected;
+
+out vec4 fragColor;
+
+/**
+ * Control Point Fragment Shader, cuts the point sprite to a disc.
+ */
+void main(void) {
+    vec2 d = gl_PointCoord * 2.0 - 1.0;
+    if (dot(d, d) > 1.0) {
+        discard;
+    }
+    fragColor = vec4(v_selected != 0 ? u_selectedColor : u_color, 1.0);
+}
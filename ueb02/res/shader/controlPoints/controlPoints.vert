@@ -0,0 +1,50 @@
+#version 430
+
+layout (location = 0) in float height;
+
+uniform mat4 u_mvpMatrix;
+uniform int u_dim;                  // control points per row
+uniform int u_selected;             // index of the selected control point
+uniform int u_detailRadius;         // rows and columns around the selection that are always shown
+uniform float u_pixelScale;         // pixels per world unit at a clip w of 1
+uniform float u_spacing;            // world distance of neighboring control points
+uniform float u_minSpacing;         // pixels between two shown control points
+uniform float u_radius;             // world radius of a control point
+uniform float u_selectedRadius;     // world radius of the selected control point
+
+flat out int v_selected;
+
+/** Largest decimation stride, keeps the shift in range */
+#define MAX_STRIDE_LEVEL 16
+
+/**
+ * Control Point Vertex Shader, one point sprite per control point.
+ * Only the heights are stored, x and z follow from the index.
+ * Where neighboring points would be closer than u_minSpacing pixels only
+ * every stride-th row and column is shown, the stride is a power of two
+ * so coarser levels keep a subset of the finer ones. Dropped points are
+ * moved out of the clip volume.
+ */
+void main(void) {
+    ivec2 cell = ivec2(gl_VertexID % u_dim, gl_VertexID / u_dim);
+    gl_Position = u_mvpMatrix * vec4(cell.x * u_spacing, height, cell.y * u_spacing, 1);
+    float w = max(gl_Position.w, 1e-4);
+
+    ivec2 selected = ivec2(u_selected % u_dim, u_selected / u_dim);
+    bool detail = all(lessThanEqual(abs(cell - selected), ivec2(u_detailRadius)));
+
+    float spacing = u_spacing * u_pixelScale / w;
+    if (!detail && spacing < u_minSpacing) {
+        int level = min(int(ceil(log2(u_minSpacing / spacing))), MAX_STRIDE_LEVEL);
+        int stride = 1 << level;
+        if (cell.x % stride != 0 || cell.y % stride != 0) {
+            gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+            gl_PointSize = 1.0;
+            return;
+        }
+    }
+
+    v_selected = gl_VertexID == u_selected ? 1 : 0;
+    float radius = v_selected != 0 ? u_selectedRadius : u_radius;
+    gl_PointSize = max(2.0 * radius * u_pixelScale / w, 2.0);
+}
@@ -1,240 +1,310 @@
-/**
- * @file input.c
- * @brief Implementation of input event handling and callbacks.
- *
- * Manages keyboard, mouse, and window resize events.
- * Updates InputData structure based on user input and event to handlers
- * like shader reload, fullscreen toggle, level selection, etc.
- *
- * @authors Nikolaos Tsetsas, Noah Schmidt
- */
-
-#include <fhwcg/fhwcg.h>
-
-#include "input.h"
-#include "rendering.h"
-#include "shader.h"
-#include "utils.h"
-#include "logic.h"
-
-#define CAM_START_POS VEC3(0, 2, 1.8f)
-#define CAM_SPEED 0.5f
-#define CAM_FAST_SPEED (CAM_SPEED * 3.0f)
-#define CAM_SENSITIVITY 0.1f
-#define CAM_YAW -90
-#define CAM_PITCH -50
-
-#define SURFACE_START_DIM 5
-#define CONTROL_POINT_OFFSET 0.1f
-#define SELECTED_CONTROL_POINT_Y_CHANGE 0.01f
-
-////////////////////////    LOCAL    ////////////////////////////
-
-/** Global application state containing all input, settings. */
-static InputData g_input = { 0 };
-
-/**
- * Callback to handle all keyboard input.
- *
- * @param ctx Program Context
- * @param key Pressed key
- * @param action Corresponding action to pressed key
- * @param mods Unused modifiert keys
- */
-static void input_keyEvent(ProgContext ctx, int key, int action, int mods) {
-    NK_UNUSED(mods);
-
-    InputData* data = getInputData();
-    camera_keyboardCallback(data->cam.data, key, action);
-
-    data->selection.pressingUp = (key == GLFW_KEY_UP) && (action != GLFW_RELEASE);
-    data->selection.pressingDown = (key == GLFW_KEY_DOWN) && (action != GLFW_RELEASE);
-
-    if (action != GLFW_PRESS) {
-        return;
-    }
-
-    switch (key) {
-        case GLFW_KEY_ESCAPE:
-            window_shouldCloseWindow(ctx);
-            break;
-        
-        case GLFW_KEY_F1:
-            data->showHelp = !data->showHelp;
-            break;
-
-        case GLFW_KEY_F2:
-            data->isFullscreen = !data->isFullscreen;
-            window_setFullscreen(ctx, data->isFullscreen);
-            break;
-
-        case GLFW_KEY_F3:
-            data->showWireframe = !data->showWireframe;
-            break;
-
-        case GLFW_KEY_F4:
-            data->showMenu = !data->showMenu;
-            break;
-
-        case GLFW_KEY_R:
-            shader_load();
-            break;
-
-        case GLFW_KEY_P:
-            data->paused = !data->paused;
-            break;
-
-        case GLFW_KEY_N:
-            data->showNormals = !data->showNormals;
-            break;
-
-        case GLFW_KEY_1:
-        case GLFW_KEY_2:
-        case GLFW_KEY_3:
-        case GLFW_KEY_4:
-        case GLFW_KEY_5:
-        case GLFW_KEY_6:
-        case GLFW_KEY_7:
-            utils_applyHeightFunction((HeightFuncType) (key - GLFW_KEY_1));
-            break;
-
-        case GLFW_KEY_RIGHT:
-            data->selection.selectedCp = (data->selection.selectedCp + data->selection.skipCnt) 
-            % data->surface.controlPoints.size;
-            break;
-
-         case GLFW_KEY_LEFT:
-            data->selection.selectedCp = (data->selection.selectedCp - data->selection.skipCnt) 
-            % data->surface.controlPoints.size;
-            break;
-
-        case GLFW_KEY_C:
-            if (!data->cam.isFlying) {
-                data->cam.isFlying = true;
-                data->cam.flight.t = 0.000001f;
-            }
-            break;
-
-        case GLFW_KEY_V:
-            data->cam.flight.showPath = !data->cam.flight.showPath;
-            break;
-
-        case GLFW_KEY_T:
-            data->surface.useTexture = !data->surface.useTexture;
-            break;
-
-        case GLFW_KEY_Z:
-            data->surface.currentTextureIndex = (data->surface.currentTextureIndex + 1) % 3;
-            break;
-        
-        default:
-            break;
-    }
-}
-
-/**
- * Callback for window resize events.
- * Updates rendering viewport and button if window size changes.
- *
- * @param ctx Program context
- * @param width New framebuffer width
- * @param height New framebuffer height
- */
-static void input_frameBufferSizeEvent(ProgContext ctx, int width, int height) {
-    NK_UNUSED(ctx);
-    rendering_resize(width, height);
-}
-
-/**
- * Callback for mouse button events (press and release).
- * Stores button and action in InputData
- *
- * @param ctx Program context
- * @param button Mouse button identifier
- * @param action Action performed for button
- * @param mods Unsued modifier keys
- */
-static void input_mouseButtonEvent(ProgContext ctx, int button, int action, int mods) {
-    NK_UNUSED(mods);
-    NK_UNUSED(ctx);
-
-    InputData* data = getInputData();
-    camera_mouseButtonCallback(data->cam.data, button, action);
-}
-
-/**
- * Callback for mouse movement events.
- * Updates mouse position in InputData.
- *
- * @param ctx Program context
- * @param x Mouse X coordinate
- * @param y Mouse Y coordinate
- */
-static void input_mouseMoveEvent(ProgContext ctx, double x, double y) {
-    InputData* data = getInputData();
-    camera_mouseMoveCallback(data->cam.data, ctx, (float) x, (float) y);
-}
-
-
-////////////////////////     PUBLIC    ////////////////////////////
-
-void input_init(ProgContext ctx) {
-    g_input.isFullscreen = false;
-    g_input.showHelp = false;
-    g_input.showMenu = true;
-    g_input.showWireframe = false;
-    g_input.paused = false;
-    g_input.showNormals = false;
-
-    g_input.cam.data = camera_createCamera(
-        ctx, CAM_START_POS, 
-        CAM_SPEED, CAM_FAST_SPEED, 
-        CAM_SENSITIVITY, CAM_YAW, CAM_PITCH
-    );
-    camera_getPosition(g_input.cam.data, g_input.cam.pos);
-    camera_getFront(g_input.cam.data, g_input.cam.dir);
-    g_input.cam.isFlying = false;
-    g_input.cam.flight.duration = 1.0f;
-    g_input.cam.flight.t = 1.0f;
-
-    g_input.surface.dimension = SURFACE_START_DIM;
-    g_input.surface.resolution = SURFACE_START_DIM;
-    g_input.surface.dimensionChanged = true;
-    g_input.surface.resolutionChanged = true;
-    g_input.surface.offsetChanged = true;
-    g_input.surface.showControlPoints = true;
-    g_input.surface.showSurface = true;
-    g_input.surface.controlPointOffset = CONTROL_POINT_OFFSET;
-    g_input.surface.useTexture = false;
-    g_input.surface.currentTextureIndex = 0;
-    g_input.surface.textureTiling = 4.0f;  // Texture repeats 4 times across surface
-    g_input.surface.extremesValid = false;
-    vec3arr_init(&g_input.surface.controlPoints);
-
-    g_input.selection.selectedCp = 0;
-    g_input.selection.skipCnt = 1;
-    g_input.selection.selectedYChange = SELECTED_CONTROL_POINT_Y_CHANGE;
-    g_input.selection.pressingDown = false;
-    g_input.selection.pressingUp = false;
-
-    g_input.pointLight.visualize = false;
-    g_input.pointLight.enabled = true;
-    g_input.pointLight.ambientFactor = 0.3f;
-    g_input.pointLight.speed = 1.0f;
-    g_input.pointLight.rotationRadius = 0.5f;
-    glm_vec3_copy(VEC3(1.0f, 0.09f, 0.032f), g_input.pointLight.falloff);
-    glm_vec3_copy(VEC3(0.8f, 1.0f, 1.0f), g_input.pointLight.color);
-    glm_vec3_copy(VEC3(0, 0, 0), g_input.pointLight.posWS);
-
-}
-
-InputData* getInputData(void) {
-    return &g_input;
-}
-
-void input_registerCallbacks(ProgContext ctx) {
-    window_setKeyboardCallback(ctx, input_keyEvent);
-    window_setMouseButtonCallback(ctx, input_mouseButtonEvent);
-    window_setMouseMovementCallback(ctx, input_mouseMoveEvent);
-    window_setFramebufferSizeCallback(ctx, input_frameBufferSizeEvent);
-}
+/**
+ * @file input.c
+ * @brief Implementation of input event handling and callbacks.
+ *
+ * Manages keyboard, mouse, and window resize events.
+ * Updates InputData structure based on user input and event to handlers
+ * like shader reload, fullscreen toggle, level selection, etc.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include <fhwcg/fhwcg.h>
+
+#include "input.h"
+#include "idle.h"
+#include "guicache.h"
+#include "rendering.h"
+#include "shader.h"
+#include "resarchive.h"
+#include "utils.h"
+#include "logic.h"
+#include "inputqueue.h"
+#include "surfacecache.h"
+
+#define CAM_START_POS VEC3(0, 2, 1.8f)
+#define CAM_SPEED 0.5f
+#define CAM_FAST_SPEED (CAM_SPEED * 3.0f)
+#define CAM_SENSITIVITY 0.1f
+#define CAM_YAW -90
+#define CAM_PITCH -50
+
+#define SURFACE_START_DIM 5
+#define CONTROL_POINT_OFFSET 0.1f
+#define SELECTED_CONTROL_POINT_Y_CHANGE 0.01f
+#define QUALITY_BUDGET_MS 14.0f
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/** Global application state containing all input, settings. */
+static InputData g_input = { 0 };
+
+/**
+ * Callback to handle all keyboard input.
+ *
+ * @param ctx Program Context
+ * @param key Pressed key
+ * @param action Corresponding action to pressed key
+ * @param mods Unused modifiert keys
+ */
+static void input_keyEvent(ProgContext ctx, int key, int action, int mods) {
+    NK_UNUSED(mods);
+    idle_onInput(action);
+    guicache_onInput();
+
+    // Repeats and duplicate events of held keys change nothing
+    bool changed = inputqueue_key(key, action);
+    InputData* data = getInputData();
+    if (changed) {
+        camera_keyboardCallback(data->cam.data, key, action);
+    }
+
+    data->selection.pressingUp = inputqueue_isKeyDown(GLFW_KEY_UP);
+    data->selection.pressingDown = inputqueue_isKeyDown(GLFW_KEY_DOWN);
+
+    if (!changed || action != GLFW_PRESS) {
+        return;
+    }
+
+    switch (key) {
+        case GLFW_KEY_ESCAPE:
+            window_shouldCloseWindow(ctx);
+            break;
+        
+        case GLFW_KEY_F1:
+            data->showHelp = !data->showHelp;
+            break;
+
+        case GLFW_KEY_F2:
+            data->isFullscreen = !data->isFullscreen;
+            window_setFullscreen(ctx, data->isFullscreen);
+            break;
+
+        case GLFW_KEY_F3:
+            data->showWireframe = !data->showWireframe;
+            break;
+
+        case GLFW_KEY_F4:
+            data->showMenu = !data->showMenu;
+            break;
+
+        case GLFW_KEY_R:
+            // The edited sources are newer than the archive
+            resarchive_invalidateKind(RES_SHADER);
+            shader_load();
+            break;
+
+        case GLFW_KEY_P:
+            data->paused = !data->paused;
+            break;
+
+        case GLFW_KEY_N:
+            data->showNormals = !data->showNormals;
+            break;
+
+        case GLFW_KEY_1:
+        case GLFW_KEY_2:
+        case GLFW_KEY_3:
+        case GLFW_KEY_4:
+        case GLFW_KEY_5:
+        case GLFW_KEY_6:
+        case GLFW_KEY_7:
+            utils_applyHeightFunction((HeightFuncType) (key - GLFW_KEY_1));
+            break;
+
+        case GLFW_KEY_RIGHT:
+            data->selection.selectedCp = (data->selection.selectedCp + data->selection.skipCnt) 
+            % data->surface.heights.size;
+            break;
+
+         case GLFW_KEY_LEFT:
+            data->selection.selectedCp = (data->selection.selectedCp - data->selection.skipCnt) 
+            % data->surface.heights.size;
+            break;
+
+        case GLFW_KEY_C:
+            if (!data->cam.isFlying) {
+                data->cam.isFlying = true;
+                data->cam.flight.t = 0.000001f;
+            }
+            break;
+
+        case GLFW_KEY_V:
+            data->cam.flight.showPath = !data->cam.flight.showPath;
+            break;
+
+        case GLFW_KEY_T:
+            data->surface.useTexture = !data->surface.useTexture;
+            break;
+
+        case GLFW_KEY_Z:
+            data->surface.currentTextureIndex = (data->surface.currentTextureIndex + 1) % 3;
+            break;
+        
+        default:
+            break;
+    }
+}
+
+/**
+ * Callback for window resize events.
+ * Updates rendering viewport and button if window size changes.
+ *
+ * @param ctx Program context
+ * @param width New framebuffer width
+ * @param height New framebuffer height
+ */
+static void input_frameBufferSizeEvent(ProgContext ctx, int width, int height) {
+    NK_UNUSED(ctx);
+    rendering_resize(width, height);
+}
+
+/**
+ * Handles the mouse movement coalesced over a frame, the camera turns
+ * once by the whole movement.
+ *
+ * @param ctx Program context
+ * @param move Last position and summed movement
+ */
+static void input_handleMouseMove(ProgContext ctx, const InputMove *move) {
+    InputData* data = getInputData();
+    camera_mouseMoveCallback(data->cam.data, ctx, move->x, move->y);
+}
+
+/**
+ * Callback for mouse button events (press and release).
+ * Stores button and action in InputData
+ *
+ * @param ctx Program context
+ * @param button Mouse button identifier
+ * @param action Action performed for button
+ * @param mods Unsued modifier keys
+ */
+static void input_mouseButtonEvent(ProgContext ctx, int button, int action, int mods) {
+    NK_UNUSED(mods);
+    idle_onInput(action);
+    guicache_onInput();
+    inputqueue_flush(ctx, input_handleMouseMove);
+
+    InputData* data = getInputData();
+    camera_mouseButtonCallback(data->cam.data, button, action);
+}
+
+/**
+ * Callback for mouse movement events.
+ * Only records the position, input_flushEvents handles it once per frame.
+ *
+ * @param ctx Program context
+ * @param x Mouse X coordinate
+ * @param y Mouse Y coordinate
+ */
+static void input_mouseMoveEvent(ProgContext ctx, double x, double y) {
+    NK_UNUSED(ctx);
+    guicache_onInput();
+    inputqueue_mouseMove(x, y);
+}
+
+/**
+ * Callback for mouse wheel events, only the GUI reacts to them.
+ *
+ * @param ctx Program context
+ * @param x Horizontal scroll offset
+ * @param y Vertical scroll offset
+ */
+static void input_mouseScrollEvent(ProgContext ctx, double x, double y) {
+    NK_UNUSED(ctx);
+    NK_UNUSED(x);
+    NK_UNUSED(y);
+    guicache_onInput();
+}
+
+/**
+ * Callback for text input, only the GUI reacts to it.
+ *
+ * @param ctx Program context
+ * @param codepoint Unicode codepoint of the typed character
+ */
+static void input_textEvent(ProgContext ctx, unsigned int codepoint) {
+    NK_UNUSED(ctx);
+    NK_UNUSED(codepoint);
+    guicache_onInput();
+}
+
+
+////////////////////////     PUBLIC    ////////////////////////////
+
+void input_init(ProgContext ctx) {
+    g_input.isFullscreen = false;
+    g_input.showHelp = false;
+    g_input.showMenu = true;
+    g_input.showWireframe = false;
+    g_input.paused = false;
+    g_input.showNormals = false;
+
+    g_input.cam.data = camera_createCamera(
+        ctx, CAM_START_POS, 
+        CAM_SPEED, CAM_FAST_SPEED, 
+        CAM_SENSITIVITY, CAM_YAW, CAM_PITCH
+    );
+    camera_getPosition(g_input.cam.data, g_input.cam.pos);
+    camera_getFront(g_input.cam.data, g_input.cam.dir);
+    g_input.cam.isFlying = false;
+    g_input.cam.flight.duration = 1.0f;
+    g_input.cam.flight.t = 1.0f;
+
+    g_input.surface.dimension = SURFACE_START_DIM;
+    g_input.surface.resolution = SURFACE_START_DIM;
+    g_input.surface.dimensionChanged = true;
+    g_input.surface.resolutionChanged = true;
+    g_input.surface.offsetChanged = true;
+    g_input.surface.showControlPoints = true;
+    g_input.surface.showSurface = true;
+    g_input.surface.tessellate = true;
+    g_input.surface.controlPointOffset = CONTROL_POINT_OFFSET;
+    g_input.surface.useTexture = false;
+    g_input.surface.currentTextureIndex = 0;
+    g_input.surface.textureTiling = 4.0f;  // Texture repeats 4 times across surface
+    g_input.surface.extremesValid = false;
+    g_input.surface.normalStride = 1;
+    g_input.surface.cacheBudgetMB = SURFACECACHE_DEFAULT_BUDGET_MB;
+    FloatArr_init(&g_input.surface.heights);
+
+    g_input.quality.enabled = true;
+    g_input.quality.budgetMs = QUALITY_BUDGET_MS;
+    g_input.quality.level = QL_FULL;
+    g_input.quality.normals = g_input.showNormals;
+    g_input.quality.tessDetail = 1.0f;
+
+    g_input.selection.selectedCp = 0;
+    g_input.selection.skipCnt = 1;
+    g_input.selection.selectedYChange = SELECTED_CONTROL_POINT_Y_CHANGE;
+    g_input.selection.pressingDown = false;
+    g_input.selection.pressingUp = false;
+
+    g_input.pointLight.visualize = false;
+    g_input.pointLight.enabled = true;
+    g_input.pointLight.ambientFactor = 0.3f;
+    g_input.pointLight.speed = 1.0f;
+    g_input.pointLight.rotationRadius = 0.5f;
+    glm_vec3_copy(VEC3(1.0f, 0.09f, 0.032f), g_input.pointLight.falloff);
+    glm_vec3_copy(VEC3(0.8f, 1.0f, 1.0f), g_input.pointLight.color);
+    glm_vec3_copy(VEC3(0, 0, 0), g_input.pointLight.posWS);
+
+}
+
+InputData* getInputData(void) {
+    return &g_input;
+}
+
+void input_flushEvents(ProgContext ctx) {
+    inputqueue_flush(ctx, input_handleMouseMove);
+}
+
+void input_registerCallbacks(ProgContext ctx) {
+    window_setKeyboardCallback(ctx, input_keyEvent);
+    window_setMouseButtonCallback(ctx, input_mouseButtonEvent);
+    window_setMouseMovementCallback(ctx, input_mouseMoveEvent);
+    window_setMouseScrollCallback(ctx, input_mouseScrollEvent);
+    window_setTextCallback(ctx, input_textEvent);
+    window_setFramebufferSizeCallback(ctx, input_frameBufferSizeEvent);
+}
@@ -1,110 +1,144 @@
-/**
- * @file input.h
- * @brief Manage input and application state.
- *
- * Defines InputData struct containing all application states including
- * - user input (mouse, keyboard),
- * - curve settings,
- * - game state
- *
- * Provides functions to initialize input handling and register event callbacks.
- *
- * @authors Nikolaos Tsetsas, Noah Schmidt
- */
-
-#ifndef INPUT_H
-#define INPUT_H
-
-#include <fhwcg/fhwcg.h>
-
-typedef struct {
-    size_t size;
-    size_t capacity;
-    vec3 *data;
-} Vec3Arr;
-
-/** Struct containing all data for application state. */
-typedef struct {
-    bool isFullscreen;
-    bool showWireframe;
-    bool showHelp;
-    bool showMenu;
-    float deltaTime;
-    bool showNormals;
-    bool paused;
-
-    struct {
-        Camera *data;
-        vec3 pos, dir;
-        bool isFlying;
-        struct {
-            vec3 p0, p1, p2, p3;
-            float t;
-            float duration;
-            bool showPath;
-        } flight;
-    } cam;
-
-    struct {
-        int dimension;
-        int resolution;
-        float controlPointOffset;
-        bool resolutionChanged;
-        bool dimensionChanged;
-        bool offsetChanged;
-        bool showControlPoints;
-        bool showSurface;
-        Vec3Arr controlPoints;
-        bool useTexture;
-        int currentTextureIndex;
-        float textureTiling;  // Texture repeat factor
-        vec3 minPoint;
-        vec3 maxPoint;
-        bool extremesValid;
-    } surface;
-
-    struct {
-        float selectedYChange;
-        int selectedCp;
-        int skipCnt;
-        bool pressingUp, pressingDown;
-    } selection;
-
-    struct {
-        vec3 posWS;
-        vec3 color;
-        vec3 falloff;  // x: constant, y: linear, z: quadratic
-        bool enabled;
-        float ambientFactor;
-        bool visualize;
-        vec3 center;
-        float currAngle;
-        float rotationRadius;
-        float speed;
-    } pointLight;
-
-} InputData;
-
-/**
- * Initializes all default values for input struct
- *
- * @param ctx Program context
- */
-void input_init(ProgContext ctx);
-
-/**
- * Returns pointer to InputData struct
- * Allows other modules to access and modify values
- *
- * @return Pointer to InputData
- */
-InputData* getInputData(void);
-
-/**
- * Register all callback functions (w/ GLFW)
- *
- * @param ctx Program Context
- */
-void input_registerCallbacks(ProgContext ctx);
-
+/**
+ * @file input.h
+ * @brief Manage input and application state.
+ *
+ * Defines InputData struct containing all application states including
+ * - user input (mouse, keyboard),
+ * - curve settings,
+ * - game state
+ *
+ * Provides functions to initialize input handling and register event callbacks.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <fhwcg/fhwcg.h>
+#include "array.h"
+
+/**
+ * Dynamic array for float elements.
+ * Stores ctrl point heights
+ */
+DEFINE_ARRAY_BASE(float, FloatArr)
+
+/**
+ * Levels of the quality governor, every level keeps the reductions of the levels below.
+ */
+typedef enum {
+    QL_FULL,
+    QL_NO_NORMALS,      // no surface normals, the surface is tessellated again
+    QL_COARSE_TESS,     // half the tessellation detail
+    QL_COUNT
+} QualityLevel;
+
+/** Struct containing all data for application state. */
+typedef struct {
+    bool isFullscreen;
+    bool showWireframe;
+    bool showHelp;
+    bool showMenu;
+    float deltaTime;
+    bool showNormals;
+    bool paused;
+
+    struct {
+        Camera *data;
+        vec3 pos, dir;
+        bool isFlying;
+        struct {
+            vec3 p0, p1, p2, p3;
+            float t;
+            float duration;
+            bool showPath;
+        } flight;
+    } cam;
+
+    struct {
+        int dimension;
+        int resolution;
+        float controlPointOffset;
+        bool resolutionChanged;
+        bool dimensionChanged;
+        bool offsetChanged;
+        bool showControlPoints;
+        bool showSurface;
+        bool tessellate;  // Evaluate the surface on the GPU
+        FloatArr heights;  // control point heights row by row, x and z follow from index, dimension and offset
+        bool useTexture;
+        int currentTextureIndex;
+        float textureTiling;  // Texture repeat factor
+        int normalStride;  // Vertices between two shown surface normals
+        vec3 minPoint;
+        vec3 maxPoint;
+        bool extremesValid;
+        int cacheBudgetMB;  // Memory budget of the built surface cache
+    } surface;
+
+    // Quality governor, the settings below level are derived every frame
+    // from showNormals and are the ones to draw with
+    struct {
+        bool enabled;
+        float budgetMs;
+        QualityLevel level;
+        float workMs;
+
+        bool normals;
+        float tessDetail;   // 1 is full detail
+    } quality;
+
+    struct {
+        float selectedYChange;
+        int selectedCp;
+        int skipCnt;
+        bool pressingUp, pressingDown;
+    } selection;
+
+    struct {
+        vec3 posWS;
+        vec3 color;
+        vec3 falloff;  // x: constant, y: linear, z: quadratic
+        bool enabled;
+        float ambientFactor;
+        bool visualize;
+        vec3 center;
+        float currAngle;
+        float rotationRadius;
+        float speed;
+    } pointLight;
+
+} InputData;
+
+/**
+ * Initializes all default values for input struct
+ *
+ * @param ctx Program context
+ */
+void input_init(ProgContext ctx);
+
+/**
+ * Returns pointer to InputData struct
+ * Allows other modules to access and modify values
+ *
+ * @return Pointer to InputData
+ */
+InputData* getInputData(void);
+
+/**
+ * Register all callback functions (w/ GLFW)
+ *
+ * @param ctx Program Context
+ */
+void input_registerCallbacks(ProgContext ctx);
+
+/**
+ * Handles the mouse movement recorded since the last call.
+ * Call once per frame after the events were polled.
+ *
+ * @param ctx Program Context
+ */
+void input_flushEvents(ProgContext ctx);
+
 #endif // INPUT_H
\ No newline at end of file
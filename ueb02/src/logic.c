@@ -12,6 +12,8 @@
 #include "input.h"
 #include "model.h"
 #include "utils.h"
+#include "arena.h"
+#include "surfacecache.h"
 
 #include <fhwcg/fhwcg.h>
 
@@ -19,45 +21,43 @@
 #define CAMERA_HEIGHT_OFFSET 0.2f // Offset for 2nd and 3rd Ctrl.point of Bezier
 #define LIGHT_OFFSET_Y 0.35f
 
-DEFINE_ARRAY_TYPE(Patch, PatchArr)
-
 ////////////////////////    LOCAL    ////////////////////////////
 
-/** Global array storing all polynomial patches for the surface */
+/** Global array storing all polynomial patches for the surface, checked out from g_currentSurface */
 static PatchArr g_patches;
 
+/** Cache entry of the drawn surface, NULL before the first build */
+static SurfaceEntry *g_currentSurface = NULL;
+
 /**
- * Updates control points when dimension or offset changes.
+ * Updates control point heights when the dimension changes.
  * Preserves existing heights where possible and interpolates new points.
+ * x and z are not stored, a new offset needs no update.
  *
- * @param cp Pointer to control points array to update
+ * @param heights Pointer to control point heights to update
  * @param newDim New dimension (grid size) for control points
- * @param cpOffset Spacing offset between control points
  */
-static void updateControlPoints(Vec3Arr *cp, int newDim, float cpOffset) {
-    int oldDim = (int)sqrtf((float)cp->size);
-    if (oldDim * oldDim != (int)cp->size) {
+static void updateControlPoints(FloatArr *heights, int newDim) {
+    int oldDim = (int)sqrtf((float)heights->size);
+    if (oldDim * oldDim != (int)heights->size) {
         oldDim = 0;
     }
+    if (oldDim == newDim) {
+        return;
+    }
 
-    float newStep = (1.0f / (newDim - 1)) + cpOffset;
-    Vec3Arr newPoints;
-    vec3arr_init(&newPoints);
-    vec3arr_reserve(&newPoints, newDim * newDim);
+    const float *old = heights->data;
+    FloatArr newHeights;
+    FloatArr_init(&newHeights);
+    FloatArr_resizeUninit(&newHeights, newDim * newDim);
 
     for (int i = 0; i < newDim; ++i) {
         for (int j = 0; j < newDim; ++j) {
-            vec3 p;
-            p[0] = j * newStep;
-            p[2] = i * newStep;
-
             float height = 0.0f;
-            bool reused = false;
 
             // Reuse height from old grid if within bounds
             if (i < oldDim && j < oldDim && oldDim > 0) {
-                height = cp->data[i * oldDim + j][1];
-                reused = true;
+                height = old[i * oldDim + j];
             } else if (oldDim > 0) {
                 // Interpolate from neighboring old points
                 float sum = 0.0f;
@@ -71,7 +71,7 @@ static void updateControlPoints(Vec3Arr *cp, int newDim, float cpOffset) {
                         int oi = ni + di;
                         int oj = nj + dj;
                         if (oi >= 0 && oi < oldDim && oj >= 0 && oj < oldDim) {
-                            sum += cp->data[oi * oldDim + oj][1];
+                            sum += old[oi * oldDim + oj];
                             count++;
                         }
                     }
@@ -85,13 +85,35 @@ static void updateControlPoints(Vec3Arr *cp, int newDim, float cpOffset) {
                 height = RANDOM_HEIGHT(0.5f);
             }
 
-            p[1] = height;
-            vec3arr_push(&newPoints, p);
+            newHeights.data[i * newDim + j] = height;
         }
     }
 
-    vec3arr_free(cp);
-    *cp = newPoints;
+    FloatArr_free(heights);
+    *heights = newHeights;
+}
+
+/**
+ * Calculates a single polynomial patch from its 4×4 grid of control points.
+ *
+ * @param heights Control point heights, row by row
+ * @param dimension Grid dimension (number of control points per axis)
+ * @param i Patch index in s-direction
+ * @param j Patch index in t-direction
+ * @param patch Output: calculated patch
+ */
+static void computePatch(const float *heights, int dimension, int i, int j, Patch *patch) {
+    mat4 geometryTerm = GLM_MAT4_ZERO_INIT;
+
+    // Extract 4×4 height values for this patch, four contiguous rows
+    for (int u = 0; u < 4; ++u) {
+        const float *row = &heights[(i + u) * dimension + j];
+        for (int v = 0; v < 4; ++v) {
+            geometryTerm[v][u] = row[v];
+        }
+    }
+
+    utils_calculatePolynomialPatch(patch, geometryTerm);
 }
 
 /**
@@ -99,30 +121,38 @@ static void updateControlPoints(Vec3Arr *cp, int newDim, float cpOffset) {
  * Creates (dimension-3)×(dimension-3) patches, each defined by a 4×4 grid
  * of control points.
  *
- * @param cp Pointer to control points array
+ * @param heights Control point heights, row by row
  * @param dimension Grid dimension (number of control points per axis)
  */
-static void updatePatchesFromControlPoints(Vec3Arr *cp, int dimension) {
-    PatchArr_clear(&g_patches);
-    Patch patch;
-
-    for (int i = 0; i < dimension - 3; ++i) {
-        for (int j = 0; j < dimension - 3; ++j) {
-            mat4 geometryTerm = GLM_MAT4_ZERO_INIT;
-
-            // Extract 4×4 height values for this patch
-            for (int u = 0; u < 4; ++u) {
-                for (int v = 0; v < 4; ++v) {
-                    geometryTerm[v][u] = cp->data[(i + u) * dimension + (j + v)][1];
-                }
-            }
+static void updatePatchesFromControlPoints(const float *heights, int dimension) {
+    int patchCount = dimension - 3;
+    Patch *patches = PatchArr_resizeUninit(&g_patches, patchCount * patchCount);
 
-            utils_calculatePolynomialPatch(&patch, geometryTerm);
-            PatchArr_push(&g_patches, patch);
+    for (int i = 0; i < patchCount; ++i) {
+        for (int j = 0; j < patchCount; ++j) {
+            computePatch(heights, dimension, i, j, &patches[i * patchCount + j]);
         }
     }
 }
 
+/**
+ * Uploads rows of patches for the tessellated surface.
+ * Rows of patches are contiguous in the coefficient buffer.
+ *
+ * @param data Input data
+ * @param firstRow First patch row in s-direction
+ * @param rowCount Number of patch rows
+ */
+static void uploadPatchRows(InputData *data, int firstRow, int rowCount) {
+    int dimension = data->surface.dimension;
+    int patchCount = dimension - 3;
+    float cpStep = utils_controlPointStep(dimension, data->surface.controlPointOffset);
+    float step = cpStep * (dimension - 1) / (patchCount * 3.0f);
+
+    int first = firstRow * patchCount;
+    model_updateSurfacePatches(&g_patches.data[first], first, rowCount * patchCount, patchCount, step, step);
+}
+
 /**
  * Computes patch coordinates
  *
@@ -167,12 +197,138 @@ static void update_extremes(float h,
     }
 }
 
+/**
+ * Returns uninitialized scratch vertices from the frame arena,
+ * they stay valid until the next frame.
+ *
+ * @param count Required number of vertices
+ * @return Scratch vertices
+ */
+static Vertex* reserveSurfaceScratch(int count) {
+    return arena_alloc(arena_frame(), count * sizeof(Vertex));
+}
+
+/**
+ * Sample positions along one axis of the regular sample grid, grouped by
+ * patch. s and t use the same spacing, so one table serves both axes.
+ */
+typedef struct {
+    float *local;   // local parameter of every sample
+    int *first;     // first sample of every patch, patchCount + 1 entries
+} SampleAxis;
+
+/**
+ * Fills the sample axis of a resolution from the frame arena. Samples on
+ * a patch seam belong to the patch starting there, the last one to the
+ * last patch, like in compute_patch_coords, so every seam vertex is
+ * evaluated once and shared by both patches.
+ *
+ * @param gridSize Number of samples per axis
+ * @param patchCount Number of patches per axis
+ * @param axis Output: sample axis
+ */
+static void buildSampleAxis(int gridSize, int patchCount, SampleAxis *axis) {
+    axis->local = arena_alloc(arena_frame(), gridSize * sizeof(float));
+    axis->first = arena_alloc(arena_frame(), (patchCount + 1) * sizeof(int));
+
+    int patch = -1;
+    for (int i = 0; i < gridSize; ++i) {
+        int samplePatch;
+        compute_patch_coords((float)i / (gridSize - 1), patchCount, &samplePatch, &axis->local[i]);
+        while (patch < samplePatch) {
+            axis->first[++patch] = i;
+        }
+    }
+    while (patch < patchCount) {
+        axis->first[++patch] = gridSize;
+    }
+}
+
+/**
+ * Samples a rectangle of the regular surface sample grid patch by patch.
+ * Every patch evaluates all of its samples in the rectangle while its
+ * coefficients stay in registers, each row contracts them with the s basis
+ * once, so a sample only costs three dot products with the t basis.
+ *
+ * @param axis Sample axis of the resolution
+ * @param gridSize Number of samples per axis
+ * @param patchCount Number of patches per axis
+ * @param firstS First sample row
+ * @param lastS Last sample row (inclusive)
+ * @param firstT First sample column
+ * @param lastT Last sample column (inclusive)
+ * @param stepX Control point spacing in X
+ * @param stepZ Control point spacing in Z
+ * @param textureTiling Texture repeat factor
+ * @param dest Output vertices, row-major with lastT - firstT + 1 per row
+ */
+static void sampleSurfaceRect(const SampleAxis *axis, int gridSize, int patchCount,
+    int firstS, int lastS, int firstT, int lastT,
+    float stepX, float stepZ, float textureTiling, Vertex *dest) {
+    int width = lastT - firstT + 1;
+
+    for (int ps = 0; ps < patchCount; ++ps) {
+        int beginS = glm_imax(axis->first[ps], firstS);
+        int endS = glm_imin(axis->first[ps + 1], lastS + 1);
+        if (beginS >= endS) continue;
+
+        for (int pt = 0; pt < patchCount; ++pt) {
+            int beginT = glm_imax(axis->first[pt], firstT);
+            int endT = glm_imin(axis->first[pt + 1], lastT + 1);
+            if (beginT >= endT) continue;
+
+            mat4 coeffs;
+            glm_mat4_copy(g_patches.data[ps * patchCount + pt].coeffsY, coeffs);
+
+            for (int i = beginS; i < endS; ++i) {
+                float s = axis->local[i];
+                vec4 sVec  = { s*s*s, s*s, s, 1.0f };
+                vec4 dsVec = { 3*s*s, 2*s, 1.0f, 0.0f };
+
+                // s^T * C and ds^T * C, the value is row * tVec
+                vec4 row, rowDs;
+                for (int k = 0; k < 4; ++k) {
+                    row[k] = glm_vec4_dot(coeffs[k], sVec);
+                    rowDs[k] = glm_vec4_dot(coeffs[k], dsVec);
+                }
+
+                float z = (ps * 3 + s * 3) * stepZ;
+                float texS = (float)i / (gridSize - 1) * textureTiling;
+                Vertex *rowDest = &dest[(i - firstS) * width];
+
+                for (int j = beginT; j < endT; ++j) {
+                    float t = axis->local[j];
+                    vec4 tVec  = { t*t*t, t*t, t, 1.0f };
+                    vec4 dtVec = { 3*t*t, 2*t, 1.0f, 0.0f };
+                    Vertex *v = &rowDest[j - firstT];
+
+                    // world position
+                    v->position[0] = (pt * 3 + t * 3) * stepX;
+                    v->position[1] = glm_vec4_dot(row, tVec);
+                    v->position[2] = z;
+
+                    // normal from partial derivatives
+                    vec3 n;
+                    vec3 rs = { 0.0f, glm_vec4_dot(rowDs, tVec), stepZ };
+                    vec3 rt = { stepX, glm_vec4_dot(row, dtVec), 0.0f };
+                    glm_vec3_cross(rs, rt, n);
+                    glm_vec3_normalize_to(n, v->normal);
+
+                    // TexCoords with tiling
+                    v->texCoords[0] = texS;
+                    v->texCoords[1] = (float)j / (gridSize - 1) * textureTiling;
+                }
+            }
+        }
+    }
+}
+
 /**
  * Generates complete surface mesh from patches.
  * Evaluates each patch at regular intervals to create a smooth surface.
  * Computes positions, normals, and texture coordinates for all vertices.
  *
- * @param cp Control points array
+ * @param cpStep Control point spacing, see utils_controlPointStep
  * @param samples Number of samples per patch (grid resolution)
  * @param dimension Control point grid dimension
  * @param textureTiling Texture repeat factor
@@ -181,102 +337,98 @@ static void update_extremes(float h,
  * @param extremesValid Output: whether extreme points are valid
  * @param computeExtremes Whether to compute min/max points
  */
-void generateSurfaceVertices(Vec3Arr *cp, int samples, int dimension, float textureTiling, vec3 minPoint, vec3 maxPoint,
+void generateSurfaceVertices(float cpStep, int samples, int dimension, float textureTiling, vec3 minPoint, vec3 maxPoint,
     bool *extremesValid, bool computeExtremes) {
     int patchCount = dimension - 3;
     int gridSize   = (samples < 2) ? 2 : samples;
     int totalVerts = gridSize * gridSize;
 
-    vec3 *positions = malloc(sizeof(vec3) * totalVerts);
-    vec3 *normals   = malloc(sizeof(vec3) * totalVerts);
-    vec2 *texcoords = malloc(sizeof(vec2) * totalVerts);
-    vec3 n;
+    Vertex *vertices = reserveSurfaceScratch(totalVerts);
 
-    float maxX = cp->data[dimension-1][0];
-    float maxZ = cp->data[(dimension-1)*dimension][2];
-    float stepX = maxX / (patchCount * 3.0f);
-    float stepZ = maxZ / (patchCount * 3.0f);
+    float stepX = cpStep * (dimension - 1) / (patchCount * 3.0f);
+    float stepZ = stepX;
 
     float minH =  1e10f;
     float maxH = -1e10f;
     vec3 locMin = {0.0f, 0.0f, 0.0f};
     vec3 locMax = {0.0f, 0.0f, 0.0f};
 
-    // Sample surface at regular grid intervals
-    for (int i = 0; i < gridSize; ++i) {
-        float T_s = (float)i / (gridSize - 1); // global s
-        int patch_s;
-        float local_s;
-
-        compute_patch_coords(T_s, patchCount, &patch_s, &local_s);
-
-        for (int j = 0; j < gridSize; ++j) {
-            float T_t = (float)j / (gridSize - 1); // global t
-            int patch_t;
-            float local_t;
-
-            compute_patch_coords(T_t, patchCount, &patch_t, &local_t);
+    // Sample surface at regular grid intervals, patch by patch
+    SampleAxis axis;
+    buildSampleAxis(gridSize, patchCount, &axis);
+    sampleSurfaceRect(&axis, gridSize, patchCount, 0, gridSize - 1, 0, gridSize - 1,
+        stepX, stepZ, textureTiling, vertices);
 
-            Patch *p = &g_patches.data[patch_s * patchCount + patch_t];
-            PatchEvalResult res = utils_evalPatchLocal(p, local_s, local_t);
-
-            int idx = i * gridSize + j;
-
-            // world position
-            positions[idx][0] = (patch_t * 3 + local_t * 3) * stepX;
-            positions[idx][2] = (patch_s * 3 + local_s * 3) * stepZ;
-            positions[idx][1] = res.value;
-
-            // normal from partial derivatives
-            vec3 rs = { 0.0f, res.dsd, stepZ };
-            vec3 rt = { stepX, res.dtd, 0.0f };
-            glm_vec3_cross(rs, rt, n);
-            glm_vec3_normalize_to(n, normals[idx]);
-
-            // TexCoords with tiling
-            texcoords[idx][0] = T_s * textureTiling;
-            texcoords[idx][1] = T_t * textureTiling;
-
-            // extreme points based on interpolated surface
-            // extremes
-            if (computeExtremes) {
-                update_extremes(res.value, positions[idx],
-                                &minH, &maxH,
-                                locMin, locMax);
-            }
+    if (computeExtremes) {
+        for (int idx = 0; idx < totalVerts; ++idx) {
+            GLfloat *position = vertices[idx].position;
+            update_extremes(position[1], position,
+                            &minH, &maxH,
+                            locMin, locMax);
         }
-    }
 
-    if (computeExtremes) {
         glm_vec3_copy(locMin, minPoint);
         glm_vec3_copy(locMax, maxPoint);
         *extremesValid = true;
     }
 
-    model_updateSurface(positions, normals, texcoords, gridSize);
-    free(positions);
-    free(normals);
-    free(texcoords);
+    model_updateSurface(vertices, gridSize);
 }
 
 /**
- * Complete surface rebuild: updates control points, recalculates patches,
- * and generates new surface mesh.
+ * Switches to the surface of the current settings. The drawn surface goes
+ * back into the surface cache with its patches and extremes. A cached
+ * surface of the new configuration only gets its patches back and its
+ * vertex buffer bound, otherwise patches and vertices are built into a
+ * new cache entry.
  *
- * @param cp Control points array
- * @param dimension Control point grid dimension
- * @param samples Surface sampling resolution
- * @param cpOffset Control point spacing offset
- * @param textureTiling Texture repeat factor
- * @param minPoint Output: lowest point on surface
- * @param maxPoint Output: highest point on surface
- * @param extremesValid Output: whether extreme points are valid
+ * @param data Input data
+ * @param updatePoints Whether the control point grid is rebuilt first (dimension or offset changed)
  */
-static void rebuildSurface(Vec3Arr *cp, int dimension, int samples, float cpOffset, float textureTiling, vec3 minPoint,
-    vec3 maxPoint, bool *extremesValid) {
-    updateControlPoints(cp, dimension, cpOffset);
-    updatePatchesFromControlPoints(cp, dimension);
-    generateSurfaceVertices(cp, samples, dimension, textureTiling, minPoint, maxPoint, extremesValid, true);
+static void switchSurface(InputData *data, bool updatePoints) {
+    FloatArr *heights = &data->surface.heights;
+    int dimension = data->surface.dimension;
+    int gridSize = (data->surface.resolution < 2) ? 2 : data->surface.resolution;
+
+    if (g_currentSurface) {
+        PatchArr_free(&g_currentSurface->patches);
+        g_currentSurface->patches = g_patches;
+        PatchArr_init(&g_patches);
+        glm_vec3_copy(data->surface.minPoint, g_currentSurface->minPoint);
+        glm_vec3_copy(data->surface.maxPoint, g_currentSurface->maxPoint);
+        g_currentSurface->extremesValid = data->surface.extremesValid;
+        g_currentSurface = NULL;
+    }
+
+    if (updatePoints) {
+        updateControlPoints(heights, dimension);
+    }
+
+    SurfaceKey key;
+    surfacecache_makeKey(heights->data, dimension, gridSize, data->surface.controlPointOffset,
+        data->surface.textureTiling, &key);
+    SurfaceEntry *entry = surfacecache_find(&key, heights->data);
+
+    if (entry) {
+        PatchArr_free(&g_patches);
+        g_patches = entry->patches;
+        PatchArr_init(&entry->patches);
+        glm_vec3_copy(entry->minPoint, data->surface.minPoint);
+        glm_vec3_copy(entry->maxPoint, data->surface.maxPoint);
+        data->surface.extremesValid = entry->extremesValid;
+        model_bindSurfaceBuffer(entry->vbo, gridSize);
+    } else {
+        entry = surfacecache_insert(&key, heights->data);
+        model_bindSurfaceBuffer(entry->vbo, gridSize);
+        updatePatchesFromControlPoints(heights->data, dimension);
+        float cpStep = utils_controlPointStep(dimension, data->surface.controlPointOffset);
+        generateSurfaceVertices(cpStep, gridSize, dimension, data->surface.textureTiling,
+            data->surface.minPoint, data->surface.maxPoint, &data->surface.extremesValid, true);
+    }
+    uploadPatchRows(data, 0, dimension - 3);
+
+    g_currentSurface = entry;
+    surfacecache_trim(entry);
 }
 
 /**
@@ -284,18 +436,22 @@ static void rebuildSurface(Vec3Arr *cp, int dimension, int samples, float cpOffs
  * Handles up/down arrow key presses to adjust selected control point height.
  *
  * @param data input data
+ * @return true if the height of the selected control point changed
  */
-static void checkSelectionState(InputData *data) {
+static bool checkSelectionState(InputData *data) {
+    bool heightChanged = false;
 
     if (data->selection.pressingUp) {
-        data->surface.controlPoints.data[data->selection.selectedCp][1] += data->selection.selectedYChange;
-        data->surface.dimensionChanged = true;
+        data->surface.heights.data[data->selection.selectedCp] += data->selection.selectedYChange;
+        heightChanged = true;
     }
 
     if (data->selection.pressingDown) {
-        data->surface.controlPoints.data[data->selection.selectedCp][1] -= data->selection.selectedYChange;
-        data->surface.dimensionChanged = true;
+        data->surface.heights.data[data->selection.selectedCp] -= data->selection.selectedYChange;
+        heightChanged = true;
     }
+
+    return heightChanged;
 }
 
 /**
@@ -329,49 +485,170 @@ static float evalSurfaceAt(int dimension, float T_s, float T_t) {
     return res.value;
 }
 
+/**
+ * Returns the range of sample indices on one axis that are evaluated
+ * from the patches lo..hi. The range is widened by one sample on each
+ * side, resampling an unchanged vertex is harmless.
+ *
+ * @param lo First patch index
+ * @param hi Last patch index
+ * @param patchCount Number of patches per axis
+ * @param gridSize Number of samples per axis
+ * @param first Output: first sample index
+ * @param last Output: last sample index
+ */
+static void patchSampleRange(int lo, int hi, int patchCount, int gridSize, int *first, int *last) {
+    float samplesPerPatch = (float)(gridSize - 1) / patchCount;
+    *first = (int)floorf(lo * samplesPerPatch) - 1;
+    *last = (int)ceilf((hi + 1) * samplesPerPatch) + 1;
+    *first = CLAMP(*first, 0, gridSize - 1);
+    *last = CLAMP(*last, 0, gridSize - 1);
+}
+
+/**
+ * Checks whether a point lies inside the x/z rectangle spanned by two corners.
+ *
+ * @param p Point to test
+ * @param lo Corner with the smallest coordinates
+ * @param hi Corner with the largest coordinates
+ * @return true if p is inside the rectangle
+ */
+static bool insideRectXZ(const vec3 p, const GLfloat *lo, const GLfloat *hi) {
+    return p[0] >= lo[0] && p[0] <= hi[0] && p[2] >= lo[2] && p[2] <= hi[2];
+}
+
+/**
+ * Updates the surface after the height of a single control point changed.
+ * A control point only influences the up to 4×4 patches containing it,
+ * so only those patches are recalculated and only the vertex rectangle
+ * sampled from them is resampled and uploaded.
+ * Falls back to a full resample if a previous extreme point lies in the
+ * rectangle and no new extreme was found there.
+ *
+ * @param data Input data
+ * @param cpIdx Index of the changed control point
+ */
+static void updateSurfaceLocal(InputData *data, int cpIdx) {
+    const float *heights = data->surface.heights.data;
+    int dimension = data->surface.dimension;
+    int patchCount = dimension - 3;
+    int gridSize = (data->surface.resolution < 2) ? 2 : data->surface.resolution;
+    float textureTiling = data->surface.textureTiling;
+
+    // 1. Recalculate the influenced patches
+    int cpS = cpIdx / dimension;
+    int cpT = cpIdx % dimension;
+    int loS = CLAMP(cpS - 3, 0, patchCount - 1), hiS = CLAMP(cpS, 0, patchCount - 1);
+    int loT = CLAMP(cpT - 3, 0, patchCount - 1), hiT = CLAMP(cpT, 0, patchCount - 1);
+
+    for (int i = loS; i <= hiS; ++i) {
+        for (int j = loT; j <= hiT; ++j) {
+            computePatch(heights, dimension, i, j, &g_patches.data[i * patchCount + j]);
+        }
+    }
+    uploadPatchRows(data, loS, hiS - loS + 1);
+
+    // 2. Resample the vertex rectangle evaluated from those patches
+    int firstS, lastS, firstT, lastT;
+    patchSampleRange(loS, hiS, patchCount, gridSize, &firstS, &lastS);
+    patchSampleRange(loT, hiT, patchCount, gridSize, &firstT, &lastT);
+    int width = lastT - firstT + 1;
+    int height = lastS - firstS + 1;
+
+    float cpStep = utils_controlPointStep(dimension, data->surface.controlPointOffset);
+    float stepX = cpStep * (dimension - 1) / (patchCount * 3.0f);
+    float stepZ = stepX;
+
+    Vertex *region = reserveSurfaceScratch(width * height);
+
+    SampleAxis axis;
+    buildSampleAxis(gridSize, patchCount, &axis);
+    sampleSurfaceRect(&axis, gridSize, patchCount, firstS, lastS, firstT, lastT,
+        stepX, stepZ, textureTiling, region);
+
+    int minIdx = 0, maxIdx = 0;
+    for (int idx = 0; idx < width * height; ++idx) {
+        if (region[idx].position[1] < region[minIdx].position[1]) minIdx = idx;
+        if (region[idx].position[1] > region[maxIdx].position[1]) maxIdx = idx;
+    }
+
+    // 3. Update extremes, a lost extreme inside the rectangle needs a full search.
+    const GLfloat *rectLo = region[0].position;
+    const GLfloat *rectHi = region[width * height - 1].position;
+    bool fullResample = !data->surface.extremesValid;
+
+    if (region[maxIdx].position[1] >= data->surface.maxPoint[1]) {
+        glm_vec3_copy(region[maxIdx].position, data->surface.maxPoint);
+    } else if (insideRectXZ(data->surface.maxPoint, rectLo, rectHi)) {
+        fullResample = true;
+    }
+
+    if (region[minIdx].position[1] <= data->surface.minPoint[1]) {
+        glm_vec3_copy(region[minIdx].position, data->surface.minPoint);
+    } else if (insideRectXZ(data->surface.minPoint, rectLo, rectHi)) {
+        fullResample = true;
+    }
+
+    if (fullResample) {
+        generateSurfaceVertices(cpStep, gridSize, dimension, textureTiling,
+            data->surface.minPoint, data->surface.maxPoint, &data->surface.extremesValid, true);
+    } else {
+        model_updateSurfaceRegion(region, gridSize, firstT, firstS, width, height);
+    }
+}
+
+/**
+ * Updates everything that depends on the surface geometry
+ * after the surface was rebuilt or locally updated.
+ *
+ * @param data Input data
+ */
+static void surfaceChanged(InputData *data) {
+    vec3 first, last, center;
+    utils_getControlPoint(data, 0, first);
+    utils_getControlPoint(data, data->surface.heights.size - 1, last);
+    glm_vec3_add(first, last, center);
+    glm_vec3_scale(center, 0.5f, center);
+    center[1] += LIGHT_OFFSET_Y;
+    glm_vec3_copy(center, data->pointLight.center);
+
+    // Update camera flight path when surface geometry changes
+    logic_initCameraFlight(data);
+}
+
 ////////////////////////    PUBLIC    ////////////////////////////
 
 void logic_update(InputData *data) {
-    checkSelectionState(data);
+    // A height edit only touches the patches around the control point,
+    // pending structural changes rebuild everything anyway
+    if (checkSelectionState(data)) {
+        if (data->surface.dimensionChanged || data->surface.offsetChanged || data->surface.resolutionChanged) {
+            data->surface.dimensionChanged = true;
+        } else {
+            updateSurfaceLocal(data, data->selection.selectedCp);
+            float height = data->surface.heights.data[data->selection.selectedCp];
+            surfacecache_setHeight(g_currentSurface, data->selection.selectedCp, height);
+            model_updateControlPoint(data->selection.selectedCp, height);
+            surfaceChanged(data);
+        }
+    }
+
+    surfacecache_setBudget((size_t) data->surface.cacheBudgetMB << 20);
+    surfacecache_trim(g_currentSurface);
 
     // Calculate all polynomials if geometry matrix changed
     if (data->surface.dimensionChanged || data->surface.offsetChanged) {
-        rebuildSurface(
-            &data->surface.controlPoints,
-            data->surface.dimension,
-            data->surface.resolution,
-            data->surface.controlPointOffset,
-            data->surface.textureTiling,
-            data->surface.minPoint,
-            data->surface.maxPoint,
-            &data->surface.extremesValid
-        );
+        switchSurface(data, true);
+        model_updateControlPoints(data->surface.heights.data, data->surface.heights.size);
         data->surface.offsetChanged = false;
         data->surface.dimensionChanged = false;
         data->surface.resolutionChanged = false;
 
-        vec3 center;
-        glm_vec3_add(data->surface.controlPoints.data[0],
-                    data->surface.controlPoints.data[data->surface.controlPoints.size - 1], center);
-        glm_vec3_scale(center, 0.5f, center);
-        center[1] += LIGHT_OFFSET_Y;
-        glm_vec3_copy(center, data->pointLight.center);
-
-        // Update camera flight path when surface geometry changes
-        logic_initCameraFlight(data);
+        surfaceChanged(data);
     }
 
     if (data->surface.resolutionChanged) {
-        generateSurfaceVertices(
-            &data->surface.controlPoints,
-            data->surface.resolution,
-            data->surface.dimension,
-            data->surface.textureTiling,
-            data->surface.minPoint,
-            data->surface.maxPoint,
-            &data->surface.extremesValid,
-            true
-        );
+        switchSurface(data, false);
         data->surface.resolutionChanged = false;
         logic_initCameraFlight(data);
     }
@@ -410,8 +687,10 @@ void logic_init(void) {
 }
 
 void logic_cleanup(void) {
+    surfacecache_cleanup();
+    g_currentSurface = NULL;
     PatchArr_free(&g_patches);
-    vec3arr_free(&getInputData()->surface.controlPoints);
+    FloatArr_free(&getInputData()->surface.heights);
 }
 
 void logic_initCameraFlight(InputData *data) {
@@ -438,8 +717,9 @@ void logic_initCameraFlight(InputData *data) {
     data->cam.flight.p2[2] = data->cam.flight.p0[2] + 2.0f * line[2] / 3.0f;
 
     // Get dimensions
-    float maxX = data->surface.controlPoints.data[data->surface.dimension-1][0];
-    float maxZ = data->surface.controlPoints.data[(data->surface.dimension-1)*data->surface.dimension][2];
+    float maxX = utils_controlPointStep(data->surface.dimension, data->surface.controlPointOffset)
+        * (data->surface.dimension - 1);
+    float maxZ = maxX;
 
     // Calculate y coordinates from surface at those x,z positions
     // For P1: convert world coords to normalized surface coords, then evaluate
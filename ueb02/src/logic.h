@@ -18,6 +18,8 @@ typedef struct {
     int degS, degT;
 } Patch;
 
+DEFINE_ARRAY_TYPE(Patch, PatchArr)
+
 typedef struct {
     float value;  // q(s,t)
     float dsd;    // ∂q/∂s
@@ -1,83 +1,185 @@
-/**
- * @file main.c
- * @brief Main entry point and game loop
- *
- * Initializes all subsystems (input, GUI, rendering, models, game logic) and runs
- * the main rendering loop. Manages program lifecycle from startup to shutdown.
- *
- * @authors Nikolaos Tsetsas, Noah Schmidt
- */
-
-#include <fhwcg/fhwcg.h>
-#include "gui.h"
-#include "input.h"
-#include "rendering.h"
-#include "model.h"
-#include "logic.h"
-
-#define DEFAULT_WINDOW_WIDTH 800
-#define DEFAULT_WINDOW_HEIGHT 500
-
-////////////////////////    LOCAL    ////////////////////////////
-
-/**
- * Initializes all modules.
- * @param ctx The Program Context.
- */
-static void init(ProgContext ctx) {
-    input_init(ctx);
-    input_registerCallbacks(ctx);
-    logic_init();
-    gui_init(ctx);
-    model_init();
-    rendering_init();
-    rendering_resize(DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT);
-}
-
-/**
- * Cleans all modules.
- * @param ctx The Program Context.
- */
-static void cleanup(ProgContext ctx) {
-    gui_cleanup(ctx);
-    model_cleanup();
-    rendering_cleanup();
-    logic_cleanup();
-    window_cleanup(ctx);
-}
-
-////////////////////////    PUBLIC    ////////////////////////////
-
-int main(void) {
-
-    ProgContext ctx = window_init(
-        PROGRAM_NAME, 
-        DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT, 
-        1, 
-        HELP_SERVER_FLAGS | WINDOW_FLAGS_VSYNC
-    );
-
-    init(ctx);
-
-    glClearColor(0.4f, 0.4f, 0.8f, 1.0f);
-
-    // rendering loop
-    while (window_startNewFrame(ctx)) {
-        InputData *d = getInputData();
-        float dt = (float) window_getDeltaTime(ctx);
-        d->deltaTime = d->paused ? 0.0f : dt;
-        camera_updateCamera(d->cam.data, dt);
-        logic_update(d);
-
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        rendering_draw();
-        gui_render(ctx, gui_renderContent);
-
-        // switch front- and back-buffer
-        window_swapBuffers(ctx);
-    }
-
-    cleanup(ctx);
-    return EXIT_SUCCESS;
-}
+/**
+ * @file main.c
+ * @brief Main entry point and game loop
+ *
+ * Initializes all subsystems (input, GUI, rendering, models, game logic) and runs
+ * the main rendering loop. Manages program lifecycle from startup to shutdown.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include <fhwcg/fhwcg.h>
+#include "gui.h"
+#include "guicache.h"
+#include "gpumem.h"
+#include "input.h"
+#include "idle.h"
+#include "rendering.h"
+#include "model.h"
+#include "shader.h"
+#include "logic.h"
+#include "glstate.h"
+#include "texstream.h"
+#include "arena.h"
+#include "profiler.h"
+#include "quality.h"
+#include "rendbench.h"
+#include "headless.h"
+#include "resarchive.h"
+
+#define DEFAULT_WINDOW_WIDTH 800
+#define DEFAULT_WINDOW_HEIGHT 500
+
+/** Tessellation detail of the coarse quality level */
+#define QUALITY_COARSE_TESS 0.5f
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Initializes all modules.
+ * @param ctx The Program Context.
+ */
+static void init(ProgContext ctx) {
+    arena_init();
+    profiler_init();
+    input_init(ctx);
+    input_registerCallbacks(ctx);
+    logic_init();
+    gui_init(ctx);
+    // Missing without the build step, the files are loaded then
+    resarchive_open(RESARCHIVE_PATH);
+    texstream_init();
+    model_init();
+    rendering_init();
+    int width, height;
+    window_getFramebufferSize(ctx, &width, &height);
+    rendering_resize(width, height);
+
+    // Rebuilds, the light animation and the governor change these without input
+    InputData *d = getInputData();
+    guicache_watch(&d->surface, sizeof(d->surface));
+    guicache_watch(&d->selection, sizeof(d->selection));
+    guicache_watch(&d->quality.level, sizeof(d->quality.level));
+
+    // A benchmark compares fixed settings, the governor would adapt them to the run
+    if (rendbench_isPlaying()) {
+        d->quality.enabled = false;
+    }
+}
+
+/**
+ * Feeds the work time of the last frame to the quality governor and
+ * derives the settings to draw with from its level.
+ */
+static void updateQuality(void) {
+    InputData *d = getInputData();
+
+    if (d->quality.enabled) {
+        float cpuMs, gpuMs;
+        profiler_getLastFrameWork(&cpuMs, &gpuMs);
+        d->quality.level = (QualityLevel) quality_update(fmaxf(cpuMs, gpuMs), d->quality.budgetMs, QL_COUNT - 1);
+        d->quality.workMs = quality_getSmoothedMs();
+    } else {
+        quality_reset();
+        d->quality.level = QL_FULL;
+        d->quality.workMs = 0.0f;
+    }
+
+    d->quality.normals = d->showNormals && d->quality.level < QL_NO_NORMALS;
+    d->quality.tessDetail = d->quality.level < QL_COARSE_TESS ? 1.0f : QUALITY_COARSE_TESS;
+}
+
+/**
+ * Checks whether the scene changes without input: the light orbits and
+ * the camera flies until paused, streamed textures arrive at any time.
+ *
+ * @return true if the next frame differs from the last one
+ */
+static bool isSceneBusy(void) {
+    return !getInputData()->paused || texstream_getPendingCount() > 0
+        || rendbench_isPlaying() || headless_isActive();
+}
+
+/**
+ * Cleans all modules.
+ * @param ctx The Program Context.
+ */
+static void cleanup(ProgContext ctx) {
+    gui_cleanup(ctx);
+    texstream_cleanup();
+    model_cleanup();
+    guicache_cleanup();
+    rendering_cleanup();
+    logic_cleanup();
+    rendbench_cleanup();
+    profiler_cleanup();
+    arena_cleanup();
+    headless_cleanup();
+    resarchive_close();
+    gpumem_cleanup();
+    window_cleanup(ctx);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+int main(void) {
+
+    rendbench_init("ueb02");
+    headless_init();
+    int width = DEFAULT_WINDOW_WIDTH, height = DEFAULT_WINDOW_HEIGHT;
+    headless_windowSize(&width, &height);
+    ProgContext ctx = window_init(
+        PROGRAM_NAME,
+        width, height,
+        1,
+        headless_windowFlags(rendbench_windowFlags(HELP_SERVER_FLAGS | WINDOW_FLAGS_VSYNC))
+    );
+
+    init(ctx);
+
+    glClearColor(0.4f, 0.4f, 0.8f, 1.0f);
+
+    // rendering loop
+    while (window_startNewFrame(ctx)) {
+        profiler_beginFrame();
+        glstate_beginFrame();
+        headless_beginFrame(ctx);
+        input_flushEvents(ctx);
+        arena_beginFrame();
+        texstream_update();
+        InputData *d = getInputData();
+        float dt = rendbench_frameTime(idle_frameTime((float) window_getDeltaTime(ctx)));
+        d->deltaTime = d->paused ? 0.0f : dt;
+        camera_updateCamera(d->cam.data, dt);
+        updateQuality();
+        profiler_pushScope("Logic");
+        logic_update(d);
+        profiler_popScope();
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        profiler_pushScope("Rendering");
+        rendering_draw();
+        profiler_popScope();
+
+        profiler_pushScope("GUI");
+        guicache_render(ctx, gui_renderContent, shader_setGuiComposite);
+        profiler_popScope();
+
+        profiler_endFrame();
+
+        // switch front- and back-buffer
+        window_swapBuffers(ctx);
+        if (!rendbench_endFrame()) {
+            window_shouldCloseWindow(ctx);
+        }
+        if (!headless_endFrame()) {
+            window_shouldCloseWindow(ctx);
+        }
+        idle_endFrame(isSceneBusy());
+        idle_wait();
+    }
+
+    cleanup(ctx);
+    return rendbench_exitCode();
+}
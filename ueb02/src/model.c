@@ -13,12 +13,17 @@
 #include "shader.h"
 #include "rendering.h"
 #include "input.h"
+#include "glstate.h"
+#include "texstream.h"
+#include "arena.h"
+#include "gpumem.h"
 
 #define SPHERE_NUM_SLICES 12
 #define SPHERE_NUM_STACKS SPHERE_NUM_SLICES
 
 #define SURFACE_DEFAULT_SIZE 16
 #define NUM_TEXTURES 3
+#define NORMAL_GROUP_SIZE 64     // must match normalLines.comp
 
 ///////////////////////    LOCAL    ////////////////////////////
 
@@ -28,20 +33,263 @@ static Mesh *g_models[MODEL_MESH_COUNT];
 /** Texture IDs for surface textures */
 static GLuint g_textureIds[NUM_TEXTURES] = {0};
 
+/**
+ * Surface mesh. The vertex buffers belong to the surface cache, the vao
+ * reads the bound one through binding point 0.
+ */
 static struct {
-    GLuint vao, vbo, ebo;
-    size_t vertexBufferSize;
+    GLuint vao, vbo, ebo;       // vbo: bound vertex buffer, not owned
     size_t indexBufferSize;
     int numVertices;
     int numIndices;
+    int indexDim;
 } g_surface = {
     .vao = 0, .vbo = 0, .ebo = 0,
-    .vertexBufferSize = SURFACE_DEFAULT_SIZE * sizeof(Vertex),
     .indexBufferSize = SURFACE_DEFAULT_SIZE * 6 * sizeof(GLuint),
     .numVertices = 0,
-    .numIndices = 0
+    .numIndices = 0,
+    .indexDim = 0
 };
 
+/**
+ * Tessellated surface data.
+ * One mat4 of coefficients per patch in a shader storage buffer,
+ * drawn as one vertex per patch without vertex attributes.
+ */
+static struct {
+    GLuint vao, ssbo;
+    size_t bufferSize;
+    int patchCount;
+    vec2 step;
+} g_surfaceTess = {0};
+
+/**
+ * One vertex of a normal line, must match LineVertex in normalLines.comp.
+ */
+typedef struct {
+    vec4 pos;       // w: 0 at the base, 1 at the tip
+    vec4 normal;
+} NormalVertex;
+
+/**
+ * Normal lines of a model, two vertices per shown normal drawn as GL_LINES.
+ */
+typedef struct {
+    GLuint vao, vbo;
+    size_t bufferSize;
+    int numVertices;
+} NormalLines;
+
+/** Normal lines of the mesh models, built once */
+static NormalLines g_modelNormals[MODEL_MESH_COUNT];
+
+/**
+ * Normal lines of the sampled surface mesh.
+ * Rebuilt by the compute shader when drawn after the surface or the stride changed.
+ */
+static struct {
+    NormalLines lines;
+    int stride;
+    bool stale;
+} g_surfaceNormals = {0};
+
+/**
+ * Positions or heights only vertex buffer, uploaded when its points change.
+ */
+typedef struct {
+    GLuint vao, vbo;
+    int components;     // floats per point
+    int capacity;       // points the buffer can hold
+    int numVertices;
+} PointBuffer;
+
+/**
+ * Line strip drawn via the Simple-Shader, e.g. the camera flight path.
+ * Drawing it is a single call.
+ */
+static PointBuffer g_path = {0};
+
+/**
+ * Control points drawn as point sprites via the Control-Point-Shader.
+ * Decimated in the vertex shader, drawing all of them is a single call.
+ * Holds only the heights, the shader places them on the grid.
+ */
+static PointBuffer g_controlPoints = {0};
+
+/**
+ * Creates the vao and vbo of normal lines.
+ * @param lines The normal lines to initialize.
+ */
+static void initNormalLines(NormalLines *lines) {
+    glGenVertexArrays(1, &lines->vao);
+    glGenBuffers(1, &lines->vbo);
+    lines->bufferSize = 0;
+    lines->numVertices = 0;
+
+    glstate_bindVertexArray(lines->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, lines->vbo);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(NormalVertex), (void*)offsetof(NormalVertex, pos));
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(NormalVertex), (void*)offsetof(NormalVertex, normal));
+
+    glstate_bindVertexArray(0);
+}
+
+/**
+ * Creates the vao and vbo of a point buffer, positions only.
+ * @param points The point buffer to initialize.
+ * @param components Floats per point, 3 for positions, 1 for heights.
+ */
+static void initPointBuffer(PointBuffer *points, int components) {
+    glGenVertexArrays(1, &points->vao);
+    glGenBuffers(1, &points->vbo);
+    points->components = components;
+    points->capacity = 0;
+    points->numVertices = 0;
+
+    glstate_bindVertexArray(points->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, points->vbo);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, components, GL_FLOAT, GL_FALSE, components * sizeof(float), (void*)0);
+
+    glstate_bindVertexArray(0);
+}
+
+/**
+ * Replaces the points of a point buffer, the buffer only grows.
+ * @param buffer The point buffer.
+ * @param points The new points, components floats each.
+ * @param count Number of points.
+ */
+static void uploadPoints(PointBuffer *buffer, const float *points, int count) {
+    buffer->numVertices = count > 0 ? count : 0;
+    if (count <= 0) {
+        return;
+    }
+
+    GLsizeiptr size = (GLsizeiptr) count * buffer->components * sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
+    if (count > buffer->capacity) {
+        glBufferData(GL_ARRAY_BUFFER, size, points, GL_DYNAMIC_DRAW);
+        buffer->capacity = count;
+    } else {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, points);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+ * Deletes the vao and vbo of a point buffer.
+ * @param points The point buffer to delete.
+ */
+static void deletePointBuffer(PointBuffer *points) {
+    glDeleteBuffers(1, &points->vbo);
+    glDeleteVertexArrays(1, &points->vao);
+    memset(points, 0, sizeof(*points));
+}
+
+/**
+ * Deletes the vao and vbo of normal lines.
+ * @param lines The normal lines to delete.
+ */
+static void deleteNormalLines(NormalLines *lines) {
+    glDeleteBuffers(1, &lines->vbo);
+    glDeleteVertexArrays(1, &lines->vao);
+    memset(lines, 0, sizeof(NormalLines));
+}
+
+/**
+ * Builds one normal line per vertex of a static mesh model.
+ * @param model The model the vertices belong to.
+ * @param vertices The vertices of the model.
+ * @param numVertices Number of vertices.
+ */
+static void initModelNormals(ModelType model, const Vertex *vertices, int numVertices) {
+    NormalLines *lines = &g_modelNormals[model];
+    initNormalLines(lines);
+
+    Arena *scratch = arena_rebuild();
+    ArenaMark mark = arena_mark(scratch);
+    NormalVertex *dest = arena_alloc(scratch, 2 * numVertices * sizeof(NormalVertex));
+
+    for (int i = 0; i < numVertices; ++i) {
+        const Vertex *v = &vertices[i];
+        for (int tip = 0; tip < 2; ++tip) {
+            NormalVertex *nv = &dest[2 * i + tip];
+            memcpy(nv->pos, v->position, sizeof(v->position));
+            memcpy(nv->normal, v->normal, sizeof(v->normal));
+            nv->pos[3] = (float) tip;
+            nv->normal[3] = 0.0f;
+        }
+    }
+
+    lines->bufferSize = 2 * numVertices * sizeof(NormalVertex);
+    lines->numVertices = 2 * numVertices;
+    glBindBuffer(GL_ARRAY_BUFFER, lines->vbo);
+    glBufferData(GL_ARRAY_BUFFER, lines->bufferSize, dest, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    arena_release(scratch, mark);
+}
+
+/**
+ * Rebuilds the surface normal lines on the GPU if the surface or the stride changed.
+ * Every stride-th vertex per axis gets a line, so large grids stay readable.
+ * @param stride Distance between two shown normals in vertices.
+ * @return False if there are no lines to draw.
+ */
+static bool updateSurfaceNormals(int stride) {
+    int dim = g_surface.indexDim;
+    NormalLines *lines = &g_surfaceNormals.lines;
+    stride = stride < 1 ? 1 : stride;
+
+    if (dim <= 0 || g_surface.numVertices != dim * dim) {
+        return false;
+    }
+    if (!g_surfaceNormals.stale && g_surfaceNormals.stride == stride) {
+        return lines->numVertices > 0;
+    }
+    if (!shader_setNormalGen(dim, stride)) {
+        return false;
+    }
+
+    int perAxis = (dim + stride - 1) / stride;
+    int numLines = perAxis * perAxis;
+    size_t required = 2 * numLines * sizeof(NormalVertex);
+
+    if (required > lines->bufferSize) {
+        lines->bufferSize = required;
+        glBindBuffer(GL_ARRAY_BUFFER, lines->vbo);
+        glBufferData(GL_ARRAY_BUFFER, lines->bufferSize, NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // The surface vertices are read as raw floats
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, g_surface.vbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, lines->vbo);
+    glDispatchCompute((numLines + NORMAL_GROUP_SIZE - 1) / NORMAL_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    lines->numVertices = 2 * numLines;
+    g_surfaceNormals.stride = stride;
+    g_surfaceNormals.stale = false;
+    return true;
+}
+
+/**
+ * Draws normal lines in a single call via the Normal-Shader.
+ * @param lines The normal lines to draw.
+ */
+static void drawNormalLines(const NormalLines *lines) {
+    shader_setNormals();
+    glstate_bindVertexArray(lines->vao);
+    glDrawArrays(GL_LINES, 0, lines->numVertices);
+}
+
 /**
  * Creates a unit Sphere mesh.
  * Center: (0,0)
@@ -52,42 +300,125 @@ static void model_initSphere(void) {
 }
 
 /**
- * Initializes the vao, vbo and ebo for the surface mesh.
- * VBO and EBO are supposed to change dynamically.
+ * Builds the normal lines of the unit sphere.
+ * Same tessellation as mesh_createSphere.
+ */
+static void model_initSphereNormals(void) {
+    int numSlices = SPHERE_NUM_SLICES;
+    int numStacks = SPHERE_NUM_STACKS;
+    int numVertices = (numSlices + 1) * (numStacks + 1);
+
+    Arena *scratch = arena_rebuild();
+    ArenaMark mark = arena_mark(scratch);
+    Vertex *vertices = arena_alloc(scratch, sizeof(Vertex) * numVertices);
+
+    int iv = 0;
+    for (int stack = 0; stack <= numStacks; stack++) {
+        float stackAngle = ((float)M_PI) / 2 - stack * ((float)M_PI) / numStacks;
+        float xy = cosf(stackAngle);
+        float z = sinf(stackAngle);
+
+        for (int slice = 0; slice <= numSlices; slice++) {
+            float sliceAngle = ((float)M_PI) * slice * 2 / numSlices;
+            float x = xy * cosf(sliceAngle);
+            float y = xy * sinf(sliceAngle);
+
+            // Unit sphere: the position is the normal
+            vertices[iv++] = Vertex3(x, y, z, x, y, z);
+        }
+    }
+
+    initModelNormals(MODEL_SPHERE, vertices, numVertices);
+    arena_release(scratch, mark);
+}
+
+/**
+ * Initializes the vao and ebo for the surface mesh.
+ * The vertex buffer is bound with model_bindSurfaceBuffer, the EBO
+ * only changes with the surface dimension.
  */
 static void model_initSurface(void) {
     glGenVertexArrays(1, &g_surface.vao);
-    glGenBuffers(1, &g_surface.vbo);
     glGenBuffers(1, &g_surface.ebo);
+    g_surface.vbo = 0;
+    g_surface.indexDim = 0;
 
-    glBindVertexArray(g_surface.vao);
+    glGenVertexArrays(1, &g_surfaceTess.vao);
+    glGenBuffers(1, &g_surfaceTess.ssbo);
 
-    // Vertex Buffer (Dynamic)
-    glBindBuffer(GL_ARRAY_BUFFER, g_surface.vbo);
-    glBufferData(GL_ARRAY_BUFFER, g_surface.vertexBufferSize, NULL, GL_DYNAMIC_DRAW);
+    initNormalLines(&g_surfaceNormals.lines);
+    g_surfaceNormals.stale = true;
+
+    glstate_bindVertexArray(g_surface.vao);
 
-    // Index Buffer (Dynamic)
+    // Index Buffer (only rewritten when the dimension changes)
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_surface.ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_surface.indexBufferSize, NULL, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_surface.indexBufferSize, NULL, GL_STATIC_DRAW);
 
-    // Vertex Attribute Layout
+    // Vertex Attribute Layout, switching the surface only rebinds binding point 0
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position));
+    glVertexAttribBinding(0, 0);
 
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, normal));
+    glVertexAttribBinding(1, 0);
 
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+    glVertexAttribFormat(2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, texCoords));
+    glVertexAttribBinding(2, 0);
 
-    glBindVertexArray(0);
+    glstate_bindVertexArray(0);
+}
+
+/**
+ * Regenerates the triangle indices of the surface grid.
+ * Expects the surface vao to be bound.
+ * @param dim The dimension of the 2D-Surface (#vertices == dim^2).
+ */
+static void updateSurfaceIndices(int dim) {
+    int numIndices = (dim - 1) * (dim - 1) * 6;
+    Arena *scratch = arena_rebuild();
+    ArenaMark mark = arena_mark(scratch);
+    GLuint *indices = arena_alloc(scratch, numIndices * sizeof(GLuint));
+
+    // Indizes erzeugen
+    int idx = 0;
+    for (int y = 0; y < dim - 1; y++) {
+        for (int x = 0; x < dim - 1; x++) {
+            GLuint v0 = y * dim + x;
+            GLuint v1 = v0 + 1;
+            GLuint v2 = v0 + dim;
+            GLuint v3 = v2 + 1;
+
+            indices[idx++] = v0; indices[idx++] = v2; indices[idx++] = v1;
+            indices[idx++] = v2; indices[idx++] = v3; indices[idx++] = v1;
+        }
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_surface.ebo);
+
+    if (numIndices * sizeof(GLuint) > g_surface.indexBufferSize) {
+        g_surface.indexBufferSize = numIndices * sizeof(GLuint);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_surface.indexBufferSize, NULL, GL_STATIC_DRAW);
+    }
+
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, numIndices * sizeof(GLuint), indices);
+
+    g_surface.numIndices = numIndices;
+    g_surface.indexDim = dim;
+
+    arena_release(scratch, mark);
 }
 
 ///////////////////////    PUBLIC    ////////////////////////////
 
 void model_init(void) {
     model_initSphere();
+    model_initSphereNormals();
     model_initSurface();
+    initPointBuffer(&g_path, 3);
+    initPointBuffer(&g_controlPoints, 1);
     model_loadTextures();
 }
 
@@ -99,18 +430,9 @@ void model_loadTextures(void) {
     };
     
     for (int i = 0; i < NUM_TEXTURES; i++) {
-        g_textureIds[i] = texture_loadTexture(texturePaths[i], GL_REPEAT);
-        
-        // Set texture parameters
-        glBindTexture(GL_TEXTURE_2D, g_textureIds[i]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        // Streamed in through the cache, the JPEGs have no alpha
+        g_textureIds[i] = texstream_loadTexture(texturePaths[i], GL_REPEAT, TC_BC1);
     }
-    
-    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 GLuint model_getTextureId(int index) {
@@ -128,6 +450,7 @@ void model_cleanup(void) {
 
         mesh_disposeMesh(&(g_models[i]));
         g_models[i] = NULL;
+        deleteNormalLines(&g_modelNormals[i]);
     }
     
     // Cleanup textures
@@ -137,9 +460,19 @@ void model_cleanup(void) {
         }
     }
     
-    glDeleteBuffers(1, &g_surface.vbo);
     glDeleteBuffers(1, &g_surface.ebo);
+    g_surface.vbo = 0;
+    g_surface.numVertices = 0;
     glDeleteVertexArrays(1, &g_surface.vao);
+    deleteNormalLines(&g_surfaceNormals.lines);
+
+    glDeleteBuffers(1, &g_surfaceTess.ssbo);
+    glDeleteVertexArrays(1, &g_surfaceTess.vao);
+    g_surfaceTess.bufferSize = 0;
+    g_surfaceTess.patchCount = 0;
+
+    deletePointBuffer(&g_path);
+    deletePointBuffer(&g_controlPoints);
 }
 
 void model_draw(ModelType model, bool drawNormals, mat4 *viewMat, mat4 *modelviewMat) {
@@ -149,10 +482,10 @@ void model_draw(ModelType model, bool drawNormals, mat4 *viewMat, mat4 *modelvie
 
     shader_setMVP(viewMat, modelviewMat);
     mesh_drawMesh(g_models[model]);
+    glstate_forgetVertexArray();
 
     if (drawNormals) {
-        shader_setNormals();
-        mesh_drawMesh(g_models[model]);
+        drawNormalLines(&g_modelNormals[model]);
     }
 }
 
@@ -163,78 +496,164 @@ void model_drawSimple(ModelType model) {
 
     shader_setSimpleMVP();
     mesh_drawMesh(g_models[model]);
+    glstate_forgetVertexArray();
 }
 
-void model_drawSurface(bool drawNormals, mat4 *viewMat, mat4 *modelviewMat) {
-    glBindVertexArray(g_surface.vao);
+void model_updatePath(const vec3 *points, int count) {
+    uploadPoints(&g_path, (const float *) points, count);
+}
 
-    shader_setMVP(viewMat, modelviewMat);
-    glDrawElements(GL_TRIANGLES, g_surface.numIndices, GL_UNSIGNED_INT, 0);
+void model_drawPath(void) {
+    if (g_path.numVertices < 2) {
+        return;
+    }
 
-    if (drawNormals) {
-        shader_setNormals();
-        glDrawElements(GL_TRIANGLES, g_surface.numIndices, GL_UNSIGNED_INT, 0);
+    shader_setSimpleMVP();
+    glstate_bindVertexArray(g_path.vao);
+    glDrawArrays(GL_LINE_STRIP, 0, g_path.numVertices);
+}
+
+void model_updateControlPoints(const float *heights, int count) {
+    uploadPoints(&g_controlPoints, heights, count);
+}
+
+void model_updateControlPoint(int index, float height) {
+    if (index < 0 || index >= g_controlPoints.numVertices) {
+        return;
     }
 
-    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, g_controlPoints.vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, index * sizeof(float), sizeof(float), &height);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void model_updateSurface(vec3 *vertices, vec3 *normals, vec2 *texcoords, int dim) {
-    int numVertices = dim * dim;
-    int numIndices = (dim - 1) * (dim - 1) * 6;
+void model_drawControlPoints(void) {
+    if (g_controlPoints.numVertices == 0) {
+        return;
+    }
 
-    Vertex *vdata = malloc(numVertices * sizeof(Vertex));
-    GLuint *indices = malloc(numIndices * sizeof(GLuint));
+    glstate_setEnabled(GL_PROGRAM_POINT_SIZE, true);
+    glstate_bindVertexArray(g_controlPoints.vao);
+    glDrawArrays(GL_POINTS, 0, g_controlPoints.numVertices);
+}
 
-    for (int y = 0; y < dim; y++) {
-        for (int x = 0; x < dim; x++) {
-            int i = y * dim + x;
+void model_drawSurface(bool drawNormals, int normalStride, bool tessellate, float tessDetail, float textureTiling,
+    mat4 *viewMat, mat4 *modelviewMat) {
+    if (model_isSurfaceTessellated(drawNormals, tessellate)
+        && shader_setSurfaceTessData(viewMat, modelviewMat, g_surfaceTess.patchCount, g_surfaceTess.step,
+            tessDetail, textureTiling)) {
+        glstate_bindVertexArray(g_surfaceTess.vao);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, g_surfaceTess.ssbo);
+        glPatchParameteri(GL_PATCH_VERTICES, 1);
+        glDrawArrays(GL_PATCHES, 0, g_surfaceTess.patchCount * g_surfaceTess.patchCount);
+        return;
+    }
 
-            glm_vec3_copy(vertices[i], vdata[i].position);
-            glm_vec3_copy(normals[i], vdata[i].normal);
-            glm_vec2_copy(texcoords[i], vdata[i].texCoords);
-        }
+    if (g_surface.vbo == 0) {
+        return;
     }
 
-    // Indizes erzeugen
-    int idx = 0;
-    for (int y = 0; y < dim - 1; y++) {
-        for (int x = 0; x < dim - 1; x++) {
-            GLuint v0 = y * dim + x;
-            GLuint v1 = v0 + 1;
-            GLuint v2 = v0 + dim;
-            GLuint v3 = v2 + 1;
+    glstate_bindVertexArray(g_surface.vao);
 
-            indices[idx++] = v0; indices[idx++] = v2; indices[idx++] = v1;
-            indices[idx++] = v2; indices[idx++] = v3; indices[idx++] = v1;
+    shader_setMVP(viewMat, modelviewMat);
+    glDrawElements(GL_TRIANGLES, g_surface.numIndices, GL_UNSIGNED_INT, 0);
+
+    if (drawNormals && updateSurfaceNormals(normalStride)) {
+        drawNormalLines(&g_surfaceNormals.lines);
+    }
+}
+
+bool model_isSurfaceTessellated(bool drawNormals, bool tessellate) {
+    return tessellate && !drawNormals && g_surfaceTess.patchCount > 0 && shader_hasSurfaceTess();
+}
+
+void model_updateSurfacePatches(const Patch *patches, int first, int count, int patchCount, float stepX, float stepZ) {
+    size_t required = (size_t) patchCount * patchCount * sizeof(mat4);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_surfaceTess.ssbo);
+    if (required > g_surfaceTess.bufferSize) {
+        g_surfaceTess.bufferSize = required;
+        glBufferData(GL_SHADER_STORAGE_BUFFER, g_surfaceTess.bufferSize, NULL, GL_DYNAMIC_DRAW);
+    }
+
+    if (count > 0) {
+        mat4 *dest = glMapBufferRange(
+            GL_SHADER_STORAGE_BUFFER, first * sizeof(mat4), count * sizeof(mat4),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+        );
+        if (dest) {
+            for (int i = 0; i < count; ++i) {
+                memcpy(dest[i], patches[i].coeffsY, sizeof(mat4));
+            }
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
         }
     }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-    glBindVertexArray(g_surface.vao);
+    g_surfaceTess.patchCount = patchCount;
+    g_surfaceTess.step[0] = stepX;
+    g_surfaceTess.step[1] = stepZ;
+}
+
+GLuint model_createSurfaceBuffer(int dim) {
+    size_t bytes = (size_t) dim * dim * sizeof(Vertex);
+    GLuint vbo;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    gpumem_setBuffer(GPUMEM_GEOMETRY, vbo, bytes);
+    return vbo;
+}
 
-    if (numVertices * sizeof(Vertex) > g_surface.vertexBufferSize) {
-        g_surface.vertexBufferSize = numVertices * sizeof(Vertex);
-        glBindBuffer(GL_ARRAY_BUFFER, g_surface.vbo);
-        glBufferData(GL_ARRAY_BUFFER, g_surface.vertexBufferSize, NULL, GL_DYNAMIC_DRAW);
+void model_deleteSurfaceBuffer(GLuint vbo) {
+    if (vbo == g_surface.vbo) {
+        g_surface.vbo = 0;
+        g_surface.numVertices = 0;
     }
+    gpumem_deleteBuffers(1, &vbo);
+}
 
-    if (numIndices * sizeof(GLuint) > g_surface.indexBufferSize) {
-        g_surface.indexBufferSize = numIndices * sizeof(GLuint);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_surface.ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_surface.indexBufferSize, NULL, GL_DYNAMIC_DRAW);
+void model_bindSurfaceBuffer(GLuint vbo, int dim) {
+    glstate_bindVertexArray(g_surface.vao);
+    glBindVertexBuffer(0, vbo, 0, sizeof(Vertex));
+
+    // Topology only depends on the dimension
+    if (dim != g_surface.indexDim) {
+        updateSurfaceIndices(dim);
     }
 
+    glstate_bindVertexArray(0);
+
+    g_surface.vbo = vbo;
+    g_surface.numVertices = dim * dim;
+    g_surfaceNormals.stale = true;
+}
+
+void model_updateSurface(const Vertex *vertices, int dim) {
+    assert(g_surface.vbo != 0 && g_surface.numVertices == dim * dim && "surface buffer of another dimension bound");
+
     glBindBuffer(GL_ARRAY_BUFFER, g_surface.vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, numVertices * sizeof(Vertex), vdata);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, dim * dim * sizeof(Vertex), vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_surface.ebo);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, numIndices * sizeof(GLuint), indices);
+    g_surfaceNormals.stale = true;
+}
 
-    glBindVertexArray(0);
+void model_updateSurfaceRegion(const Vertex *vertices, int dim, int x, int y, int width, int height) {
+    assert(g_surface.numVertices == dim * dim);
+    glBindBuffer(GL_ARRAY_BUFFER, g_surface.vbo);
 
-    g_surface.numVertices = numVertices;
-    g_surface.numIndices  = numIndices;
+    if (width == dim) {
+        // Full rows are contiguous in the buffer
+        glBufferSubData(GL_ARRAY_BUFFER, y * dim * sizeof(Vertex), width * height * sizeof(Vertex), vertices);
+    } else {
+        for (int row = 0; row < height; ++row) {
+            GLintptr offset = ((y + row) * dim + x) * sizeof(Vertex);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, width * sizeof(Vertex), vertices + row * width);
+        }
+    }
 
-    free(vdata);
-    free(indices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    g_surfaceNormals.stale = true;
 }
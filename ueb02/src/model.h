@@ -12,6 +12,7 @@
 #define MODEL_H
 
 #include <fhwcg/fhwcg.h>
+#include "logic.h"
 
 /**
  * Enum of model types.
@@ -72,21 +73,116 @@ void model_draw(ModelType model, bool drawNormals, mat4 *viewMat, mat4 *modelVie
  */
 void model_drawSimple(ModelType model);
 
+/**
+ * Uploads the points of the line strip drawn by model_drawPath.
+ * Only needs to be called when the points change.
+ * @param points The points in drawing order.
+ * @param count Number of points.
+ */
+void model_updatePath(const vec3 *points, int count);
+
+/**
+ * Draws the uploaded line strip via the Simple-Shader in a single call.
+ * The color is set with shader_setColor before.
+ */
+void model_drawPath(void);
+
+/**
+ * Uploads all control points drawn by model_drawControlPoints.
+ * Only needs to be called when the grid is rebuilt.
+ * @param heights The control point heights, row by row.
+ * @param count Number of control points.
+ */
+void model_updateControlPoints(const float *heights, int count);
+
+/**
+ * Uploads a single edited control point.
+ * @param index Index of the control point.
+ * @param height The new height.
+ */
+void model_updateControlPoint(int index, float height);
+
+/**
+ * Draws all uploaded control points as point sprites in a single call.
+ * The Control-Point-Shader is set with shader_setControlPoints before.
+ */
+void model_drawControlPoints(void);
+
 /**
  * Draws the Surface via the Model-Shader.
+ * Normals are drawn as one line buffer, rebuilt by a compute shader
+ * only after the surface or the stride changed.
+ * Tessellated drawing evaluates the uploaded patches on the GPU and
+ * falls back to the sampled mesh if unavailable or normals are drawn.
  * @param drawNormals If the Normals of the surface should be drawn.
+ * @param normalStride Distance between two shown normals in vertices.
+ * @param tessellate If the surface should be tessellated on the GPU.
+ * @param tessDetail Scale of the tessellation levels, 1 is full detail.
+ * @param textureTiling Texture repeat factor for the tessellated surface.
  * @param viewMat The View-Matrix for the Model-Shader.
  * @param modelviewMat The Model-View-Matrix for the Model-Shader.
  */
-void model_drawSurface(bool drawNormals, mat4 *viewMat, mat4 *modelviewMat);
+void model_drawSurface(bool drawNormals, int normalStride, bool tessellate, float tessDetail, float textureTiling,
+    mat4 *viewMat, mat4 *modelviewMat);
+
+/**
+ * Returns if model_drawSurface draws the tessellated surface with these settings.
+ * @param drawNormals If the Normals of the surface should be drawn.
+ * @param tessellate If the surface should be tessellated on the GPU.
+ * @return true if the tessellated surface is drawn.
+ */
+bool model_isSurfaceTessellated(bool drawNormals, bool tessellate);
+
+/**
+ * Uploads polynomial patch coefficients for the tessellated surface.
+ * @param patches The patches to upload.
+ * @param first Index of the first patch to upload.
+ * @param count Number of patches to upload.
+ * @param patchCount Number of patches per axis.
+ * @param stepX Control point spacing in X.
+ * @param stepZ Control point spacing in Z.
+ */
+void model_updateSurfacePatches(const Patch *patches, int first, int count, int patchCount, float stepX, float stepZ);
+
+/**
+ * Creates a vertex buffer for a surface with room for its vertices.
+ * The caller owns it, the surface cache keeps one per built surface.
+ * @param dim The dimension of the 2D-Surface (#vertices == dim^2).
+ * @return The buffer.
+ */
+GLuint model_createSurfaceBuffer(int dim);
+
+/**
+ * Deletes a surface vertex buffer, the surface draws nothing if it was bound.
+ * @param vbo The buffer.
+ */
+void model_deleteSurfaceBuffer(GLuint vbo);
+
+/**
+ * Draws the surface from a vertex buffer of model_createSurfaceBuffer.
+ * Only rebinds the buffer, the indices are rewritten if the dimension changed.
+ * @param vbo The buffer.
+ * @param dim The dimension of the 2D-Surface (#vertices == dim^2).
+ */
+void model_bindSurfaceBuffer(GLuint vbo, int dim);
+
+/**
+ * Uploads all vertices of the surface into the bound vertex buffer.
+ * @param vertices The interleaved vertices of the surface (no indice vertices).
+ * @param dim The dimension of the 2D-Surface, must match the bound buffer.
+ */
+void model_updateSurface(const Vertex *vertices, int dim);
 
 /**
- * Dynamically updates the surface mesh based on the given main vertices.
- * @param vertices The main vertices of the surface (no indice vertices).
- * @param normals The normals belonging to the vertices.
- * @param texcoords The texture coordinates belonging to the vertices.
+ * Uploads a rectangle of surface vertices into the current surface mesh.
+ * The surface dimension must match the last model_updateSurface call.
+ * @param vertices The vertices of the rectangle (width * height, row by row).
  * @param dim The dimension of the 2D-Surface (#vertices == dim^2).
+ * @param x First column of the rectangle.
+ * @param y First row of the rectangle.
+ * @param width Number of columns of the rectangle.
+ * @param height Number of rows of the rectangle.
  */
-void model_updateSurface(vec3 *vertices, vec3 *normals, vec2 *texcoords, int dim);
+void model_updateSurfaceRegion(const Vertex *vertices, int dim, int x, int y, int width, int height);
 
 #endif // MODEL_H
@@ -19,6 +19,9 @@
 #include "shader.h"
 #include "utils.h"
 #include "logic.h"
+#include "glstate.h"
+#include "rendbench.h"
+#include "instrument.h"
 
 /** Projection data*/
 #define NEAR_PLANE 0.0001f
@@ -26,7 +29,10 @@
 #define FOV_Y 45
 
 /** Colors*/
-#define SELECTED_COLOR VEC3(1, 0, 0)
+#define FLIGHT_PATH_COLOR VEC3(1, 1, 0)
+
+/** Line segments the camera flight path is sampled into */
+#define FLIGHT_PATH_SEGMENTS 128
 
 /**
  * Rendering viewport and projection data.
@@ -43,6 +49,32 @@ typedef struct {
 /** Global rendering data (viewport, projection bounds, screen resolution) */
 static RenderingData g_renderingData;
 
+/** Control points the path buffer was last sampled from */
+static struct {
+    vec3 ctrl[4];
+    bool uploaded;
+} g_flightPath = {0};
+
+/**
+ * Draws all control points as point sprites in a single call.
+ * Dense regions are thinned out by the shader, the selected control point
+ * and its neighborhood are always shown. Selected one is red and larger.
+ *
+ * @param data Input data containing control points
+ */
+static void drawControlPoints(InputData *data) {
+    int dim = data->surface.dimension;
+    if (dim < 2 || data->surface.heights.size != dim * dim) {
+        return;
+    }
+
+    float pixelScale = g_renderingData.screenRes[1] / (2.0f * tanf(glm_rad(FOV_Y) / 2.0f));
+    float spacing = utils_controlPointStep(dim, data->surface.controlPointOffset);
+    if (shader_setControlPoints(dim, data->selection.selectedCp, pixelScale, spacing)) {
+        model_drawControlPoints();
+    }
+}
+
 /**
  * Sets the View-Matrix based on the current active camera.
  */
@@ -51,6 +83,7 @@ static void updateCamera(InputData *data) {
         camera_getPosition(data->cam.data, data->cam.pos);
         camera_getFront(data->cam.data, data->cam.dir);
     }
+    rendbench_camera(data->cam.pos, data->cam.dir);
 
     scene_look(data->cam.pos, data->cam.dir, GLM_YUP);
     shader_setCamPos(data->cam.pos);
@@ -91,13 +124,40 @@ static void updatePointLight(InputData *data) {
     }
 }
 
+/**
+ * Resamples the camera flight path into the path buffer after
+ * logic_initCameraFlight moved its control points.
+ *
+ * @param data Input data containing flight path control points
+ */
+static void updateCamFlightPath(InputData *data) {
+    vec3 ctrl[4];
+    glm_vec3_copy(data->cam.flight.p0, ctrl[0]);
+    glm_vec3_copy(data->cam.flight.p1, ctrl[1]);
+    glm_vec3_copy(data->cam.flight.p2, ctrl[2]);
+    glm_vec3_copy(data->cam.flight.p3, ctrl[3]);
+    if (g_flightPath.uploaded && memcmp(ctrl, g_flightPath.ctrl, sizeof(ctrl)) == 0) {
+        return;
+    }
+
+    vec3 points[FLIGHT_PATH_SEGMENTS + 1];
+    for (int i = 0; i <= FLIGHT_PATH_SEGMENTS; ++i) {
+        float t = (float)i / (float)FLIGHT_PATH_SEGMENTS;
+        utils_evalBezier3D(ctrl[0], ctrl[1], ctrl[2], ctrl[3], t, points[i]);
+    }
+    model_updatePath(points, FLIGHT_PATH_SEGMENTS + 1);
+
+    memcpy(g_flightPath.ctrl, ctrl, sizeof(ctrl));
+    g_flightPath.uploaded = true;
+}
+
 ////////////////////////    LOCAL    ////////////////////////////
 
 void rendering_init(void) {
     memset(&g_renderingData, 0, sizeof(RenderingData));
 
     // OpenGL Flags
-    glCullFace(GL_BACK);
+    glstate_cullFace(GL_BACK);
     glFrontFace(GL_CCW);
     shader_load();
 }
@@ -105,16 +165,11 @@ void rendering_init(void) {
 void rendering_draw(void) {
     InputData* data = getInputData();
 
-    if(data->showWireframe) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        glDisable(GL_CULL_FACE);
-    } else {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glEnable(GL_CULL_FACE);
-    }
-    glEnable(GL_DEPTH_TEST);
+    glstate_polygonMode(data->showWireframe ? GL_LINE : GL_FILL);
+    glstate_setEnabled(GL_CULL_FACE, !data->showWireframe);
+    glstate_setEnabled(GL_DEPTH_TEST, true);
 
-    debug_pushRenderScope("Scene");
+    INSTRUMENT_PUSH_LABEL("Scene");
     scene_pushMatrix();
 
     updateCamera(data);
@@ -122,22 +177,7 @@ void rendering_draw(void) {
     scene_getMV(viewMat);
 
     if (data->surface.showControlPoints) {
-        for (int i = 0; i < data->surface.controlPoints.size; ++i) {
-            scene_pushMatrix();
-
-            bool isSelected = data->selection.selectedCp == i;
-
-            scene_translateV(data->surface.controlPoints.data[i]);
-            scene_scaleV(isSelected ? VEC3X(0.1f) : VEC3X(0.01f));
-            vec3 *idxColor = (data->selection.selectedCp == i) ? 
-                &SELECTED_COLOR : &VEC3X(i / data->surface.controlPoints.size)
-            ;
-
-            shader_setColor(*idxColor);
-            model_drawSimple(MODEL_SPHERE);
-
-            scene_popMatrix();
-        }
+        drawControlPoints(data);
     }
 
     if (data->surface.showSurface) {
@@ -152,34 +192,22 @@ void rendering_draw(void) {
             shader_setTexture(0, false);
         }
         
-        model_drawSurface(data->showNormals, &viewMat, &modelviewMat);
+        model_drawSurface(
+            data->quality.normals, data->surface.normalStride, data->surface.tessellate,
+            data->quality.tessDetail, data->surface.textureTiling, &viewMat, &modelviewMat
+        );
     }
 
-    // Draw camera flight path if enabled
+    // Draw camera flight path if enabled, one line strip resampled only on change
     if (data->cam.flight.showPath) {
-        const int SEG = 128;
-        vec3 p;
-        for (int i = 0; i <= SEG; ++i) {
-            float t = (float)i / (float)SEG;
-            utils_evalBezier3D(
-                data->cam.flight.p0,
-                data->cam.flight.p1,
-                data->cam.flight.p2,
-                data->cam.flight.p3,
-                t, p
-            );
-            scene_pushMatrix();
-            scene_translateV(p);
-            scene_scaleV(VEC3X(0.003f));
-            shader_setColor(VEC3(1, 1, 0));
-            model_drawSimple(MODEL_SPHERE);
-            scene_popMatrix();
-        }
+        updateCamFlightPath(data);
+        shader_setColor(FLIGHT_PATH_COLOR);
+        model_drawPath();
     }
 
     scene_popMatrix();
-    debug_popRenderScope();
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    INSTRUMENT_POP_LABEL();
+    glstate_polygonMode(GL_FILL);
 }
 
 void rendering_cleanup(void) {
@@ -6,7 +6,11 @@
  * Manages three shader programs:
  * - simple (colored rendering),
  * - gradient (background),
- * - normalPoint (normal vector visualization with geometry shader).
+ * - normal (precomputed normal lines, tips moved out in view space),
+ * - normal generation (compute shader building the surface normal lines),
+ * - control points (decimated point sprites),
+ * - gui composite (cached GUI over the scene),
+ * - surface tessellation (model shading, surface evaluated on the GPU).
  *
  * @authors Nikolaos Tsetsas, Noah Schmidt
  */
@@ -15,13 +19,25 @@
 
 #include "shader.h"
 #include "rendering.h"
+#include "glstate.h"
+#include "shadervariant.h"
 
 #define NORMAL_COLOR ((vec3) {1, 0, 0})
 #define NORMAL_LENGTH 0.1f
+#define CONTROL_POINT_COLOR ((vec3) {0, 0, 0})
+#define CONTROL_POINT_SELECTED_COLOR ((vec3) {1, 0, 0})
+#define CONTROL_POINT_RADIUS 0.01f
+#define CONTROL_POINT_SELECTED_RADIUS 0.1f
+#define CONTROL_POINT_MIN_SPACING 4.0f  // pixels between two shown control points
+#define CONTROL_POINT_DETAIL_RADIUS 8   // rows and columns around the selection that are always shown
+#define TESS_PIXELS_PER_SEGMENT 8.0f
+#define TESS_MAX_LEVEL 64.0f
 
 ////////////////////////    LOCAL    ////////////////////////////
 
-static Shader *modelShader, *simpleShader, *normalShader;
+static Shader *modelShader, *simpleShader, *normalShader, *controlPointShader;
+static Shader *guiCompositeShader, *surfaceTessShader;
+static GlProgram *normalGenShader;
 
 /**
  * Helper function to delete a shader and set pointer to NULL.
@@ -30,11 +46,26 @@ static Shader *modelShader, *simpleShader, *normalShader;
  */
 static void cleanup(Shader *s) {
     if (s) {
+        // The address may be reused by the next shader
+        glstate_invalidate();
         shader_deleteShader(&s);
         s = NULL;
     }
 }
 
+/**
+ * Helper function to delete a program built by glprogram and set the pointer to NULL.
+ *
+ * @param p Pointer to the program pointer to clean up
+ */
+static void cleanupProgram(GlProgram **p) {
+    if (*p) {
+        // The address may be reused by the next program
+        glstate_invalidate();
+        glprogram_delete(p);
+    }
+}
+
 /**
  * Transforms the given vec3 from world to view space based on 
  * the current Stack.
@@ -51,12 +82,62 @@ static void worldToView(vec3 vec, vec3 dest, bool isPos) {
     glm_vec3_copy((vec3) {vecWS[0], vecWS[1], vecWS[2]}, dest);
 }
 
+/**
+ * Creates and compiles the compute shader building the surface normal lines.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createNormalGenShader(void) {
+    GlProgram* program = glprogram_create();
+    shadervariant_attachFile(program, GL_COMPUTE_SHADER, RESOURCE_PATH "shader/normalLines/normalLines.comp", 0, NULL);
+
+    if (!glprogram_link("normal generation", program)) {
+        glprogram_delete(&program);
+        return NULL;
+    }
+    return program;
+}
+
+/**
+ * Creates and compiles the surface tessellation shader.
+ * Shares the fragment stage with the model shader.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static Shader* createSurfaceTessShader(void) {
+    Shader* shader = shader_createShader();
+    shader_attachShaderFile(shader, GL_VERTEX_SHADER,          RESOURCE_PATH "shader/surfaceTess/surfaceTess.vert");
+    shader_attachShaderFile(shader, GL_TESS_CONTROL_SHADER,    RESOURCE_PATH "shader/surfaceTess/surfaceTess.tesc");
+    shader_attachShaderFile(shader, GL_TESS_EVALUATION_SHADER, RESOURCE_PATH "shader/surfaceTess/surfaceTess.tese");
+    shader_attachShaderFile(shader, GL_FRAGMENT_SHADER,        RESOURCE_PATH "shader/model/model.frag");
+
+    if (!shader_buildShader("surface tessellation", shader)) {
+        shader_deleteShader(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Collects the shaders using the model fragment stage.
+ * @param dest Output for the shaders, two entries.
+ * @return Number of available shaders.
+ */
+static int getLitShaders(Shader **dest) {
+    int count = 0;
+    if (modelShader) dest[count++] = modelShader;
+    if (surfaceTessShader) dest[count++] = surfaceTessShader;
+    return count;
+}
+
 ////////////////////////    PUBLIC    ////////////////////////////
 
 void shader_cleanup(void) {
     cleanup(modelShader);
     cleanup(simpleShader);
     cleanup(normalShader);
+    cleanupProgram(&normalGenShader);
+    cleanup(controlPointShader);
+    cleanup(guiCompositeShader);
+    cleanup(surfaceTessShader);
 }
 
 void shader_load(void) {
@@ -82,19 +163,66 @@ void shader_load(void) {
         modelShader = newShader;
     }
 
-    newShader = shader_createNormalsShader(FHWCG_SHADER_PATH);
+    newShader = shader_createVeFrShader(
+        "normal lines",
+        RESOURCE_PATH "shader/normalLines/normalLines.vert",
+        RESOURCE_PATH "shader/normalLines/normalLines.frag"
+    );
     if (newShader) {
         cleanup(normalShader);
         normalShader = newShader;
 
-        shader_useShader(normalShader);
+        glstate_useShader(normalShader);
         shader_setFloat(normalShader, "u_normalLength", NORMAL_LENGTH);
         shader_setVec3(normalShader, "u_color", &NORMAL_COLOR);
     }
+
+    GlProgram *newProgram = createNormalGenShader();
+    if (newProgram) {
+        cleanupProgram(&normalGenShader);
+        normalGenShader = newProgram;
+    }
+
+    newShader = shader_createVeFrShader(
+        "control points",
+        RESOURCE_PATH "shader/controlPoints/controlPoints.vert",
+        RESOURCE_PATH "shader/controlPoints/controlPoints.frag"
+    );
+    if (newShader) {
+        cleanup(controlPointShader);
+        controlPointShader = newShader;
+
+        glstate_useShader(controlPointShader);
+        shader_setVec3(controlPointShader, "u_color", &CONTROL_POINT_COLOR);
+        shader_setVec3(controlPointShader, "u_selectedColor", &CONTROL_POINT_SELECTED_COLOR);
+        shader_setFloat(controlPointShader, "u_radius", CONTROL_POINT_RADIUS);
+        shader_setFloat(controlPointShader, "u_selectedRadius", CONTROL_POINT_SELECTED_RADIUS);
+        shader_setFloat(controlPointShader, "u_minSpacing", CONTROL_POINT_MIN_SPACING);
+        shader_setInt(controlPointShader, "u_detailRadius", CONTROL_POINT_DETAIL_RADIUS);
+    }
+
+    newShader = shader_createVeFrShader(
+        "gui composite",
+        RESOURCE_PATH "shader/guiComposite/guiComposite.vert",
+        RESOURCE_PATH "shader/guiComposite/guiComposite.frag"
+    );
+    if (newShader) {
+        cleanup(guiCompositeShader);
+        guiCompositeShader = newShader;
+
+        glstate_useShader(guiCompositeShader);
+        shader_setInt(guiCompositeShader, "u_gui", 0);
+    }
+
+    newShader = createSurfaceTessShader();
+    if (newShader) {
+        cleanup(surfaceTessShader);
+        surfaceTessShader = newShader;
+    }
 }
 
 void shader_setMVP(mat4 *viewMat, mat4 *modelviewMat) {
-    shader_useShader(modelShader);
+    glstate_useShader(modelShader);
 
     mat4 mat;
     scene_getMVP(mat);
@@ -104,12 +232,12 @@ void shader_setMVP(mat4 *viewMat, mat4 *modelviewMat) {
 }
 
 void shader_setColor(vec3 color) {
-    shader_useShader(simpleShader);
+    glstate_useShader(simpleShader);
     shader_setVec3(simpleShader, "u_color", (vec3*) color);
 }
 
 void shader_setNormals(void) {
-    shader_useShader(normalShader);
+    glstate_useShader(normalShader);
     mat4 mat;
     scene_getMV(mat);
     shader_setMat4(normalShader, "u_modelViewMatrix", &mat);
@@ -119,8 +247,35 @@ void shader_setNormals(void) {
     shader_setMat4(normalShader, "u_projMatrix", &mat);
 }
 
+bool shader_setNormalGen(int dim, int stride) {
+    if (!normalGenShader) {
+        return false;
+    }
+
+    glstate_useProgram(normalGenShader);
+    glprogram_setInt(normalGenShader, "u_dim", dim);
+    glprogram_setInt(normalGenShader, "u_stride", stride);
+    return true;
+}
+
+bool shader_setControlPoints(int dim, int selected, float pixelScale, float spacing) {
+    if (!controlPointShader) {
+        return false;
+    }
+
+    glstate_useShader(controlPointShader);
+    mat4 mat;
+    scene_getMVP(mat);
+    shader_setMat4(controlPointShader, "u_mvpMatrix", &mat);
+    shader_setInt(controlPointShader, "u_dim", dim);
+    shader_setInt(controlPointShader, "u_selected", selected);
+    shader_setFloat(controlPointShader, "u_pixelScale", pixelScale);
+    shader_setFloat(controlPointShader, "u_spacing", spacing);
+    return true;
+}
+
 void shader_setSimpleMVP(void) {
-    shader_useShader(simpleShader);
+    glstate_useShader(simpleShader);
 
     mat4 mat;
     scene_getMVP(mat);
@@ -128,29 +283,87 @@ void shader_setSimpleMVP(void) {
 }
 
 void shader_setTexture(GLuint textureId, bool useTexture) {
-    shader_useShader(modelShader);
-    
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, textureId);
-    
-    shader_setInt(modelShader, "u_texture", 0);
-    shader_setBool(modelShader, "u_useTexture", useTexture);
+
+    Shader *lit[2];
+    int count = getLitShaders(lit);
+    for (int i = 0; i < count; ++i) {
+        glstate_useShader(lit[i]);
+        shader_setInt(lit[i], "u_texture", 0);
+        shader_setBool(lit[i], "u_useTexture", useTexture);
+    }
 }
 
 void shader_setCamPos(vec3 camPosWS) {
-    shader_useShader(modelShader);
     vec3 camPosVS = {0};
     worldToView(camPosWS, camPosVS, true);
-    shader_setVec3(modelShader, "u_camPosVS", (vec3*)camPosVS);
+
+    Shader *lit[2];
+    int count = getLitShaders(lit);
+    for (int i = 0; i < count; ++i) {
+        glstate_useShader(lit[i]);
+        shader_setVec3(lit[i], "u_camPosVS", (vec3*)camPosVS);
+    }
 }
 
 void shader_setPointLight(vec3 color, vec3 posWS, vec3 falloff, bool enabled, float ambientFactor) {
-    shader_useShader(modelShader);
     vec3 posVS = {0};
     worldToView(posWS, posVS, true);
-    shader_setVec3(modelShader, "u_pointLight.posVS", &posVS);
-    shader_setVec3(modelShader, "u_pointLight.color", (vec3*)color);
-    shader_setVec3(modelShader, "u_pointLight.falloff", (vec3*)falloff);
-    shader_setBool(modelShader, "u_pointLight.enabled", enabled);
-    shader_setFloat(modelShader, "u_pointLight.ambientFactor", ambientFactor);
+
+    Shader *lit[2];
+    int count = getLitShaders(lit);
+    for (int i = 0; i < count; ++i) {
+        Shader *s = lit[i];
+        glstate_useShader(s);
+        shader_setVec3(s, "u_pointLight.posVS", &posVS);
+        shader_setVec3(s, "u_pointLight.color", (vec3*)color);
+        shader_setVec3(s, "u_pointLight.falloff", (vec3*)falloff);
+        shader_setBool(s, "u_pointLight.enabled", enabled);
+        shader_setFloat(s, "u_pointLight.ambientFactor", ambientFactor);
+    }
+}
+
+bool shader_hasSurfaceTess(void) {
+    return surfaceTessShader != NULL;
+}
+
+bool shader_setSurfaceTessData(mat4 *viewMat, mat4 *modelviewMat, int patchCount, vec2 step, float detail,
+    float textureTiling) {
+    if (!surfaceTessShader) {
+        return false;
+    }
+
+    Shader *s = surfaceTessShader;
+    glstate_useShader(s);
+
+    mat4 mat;
+    scene_getMVP(mat);
+    shader_setMat4(s, "u_mvpMatrix", &mat);
+    shader_setMat4(s, "u_viewMatrix", viewMat);
+    shader_setMat4(s, "u_modelviewMatrix", modelviewMat);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    vec2 viewportSize = {(float) viewport[2], (float) viewport[3]};
+
+    shader_setInt(s, "u_patchCount", patchCount);
+    shader_setVec2(s, "u_step", (vec2*) step);
+    shader_setVec2(s, "u_viewport", &viewportSize);
+    // Less detail means longer segments and a lower cap
+    shader_setFloat(s, "u_pixelsPerSegment", TESS_PIXELS_PER_SEGMENT / detail);
+    shader_setFloat(s, "u_maxLevel", fmaxf(TESS_MAX_LEVEL * detail, 1.0f));
+    shader_setFloat(s, "u_textureTiling", textureTiling);
+    return true;
+}
+
+bool shader_setGuiComposite(GLuint textureId) {
+    if (!guiCompositeShader) {
+        return false;
+    }
+
+    glstate_useShader(guiCompositeShader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    return true;
 }
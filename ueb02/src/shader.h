@@ -41,30 +41,48 @@ void shader_setColor(vec3 color);
 
 /**
  * Activates the normal shader and sets uniforms
- * Prepares matrices for geometry shader which generates visible normal vectors.
+ * Prepares matrices for the vertex shader which moves out the tips of the normal lines.
  */
 void shader_setNormals(void);
 
+/**
+ * Activates the compute shader building the surface normal lines and sets its uniforms.
+ * @param dim The dimension of the surface (#vertices == dim^2).
+ * @param stride Distance between two shown normals in vertices.
+ * @return False if the shader is not available.
+ */
+bool shader_setNormalGen(int dim, int stride);
+
+/**
+ * Activates the control point shader and sets its per-frame uniforms.
+ * @param dim The dimension of the control point grid.
+ * @param selected Index of the selected control point.
+ * @param pixelScale Pixels per world unit at a view distance of 1.
+ * @param spacing World distance of neighboring control points.
+ * @return False if the shader is not available.
+ */
+bool shader_setControlPoints(int dim, int selected, float pixelScale, float spacing);
+
 /**
  * Sets the current Stack MVP-Matrix for the Simple-Shader.
  */
 void shader_setSimpleMVP(void);
 
 /**
- * Sets which texture to use for the Model-Shader.
+ * Sets which texture to use for the Model- and Surface-Tessellation-Shader.
  * @param textureId The id to use from now on.
  * @param useTexture If the texture should be used.
  */
 void shader_setTexture(GLuint textureId, bool useTexture);
 
 /**
- * Sets the camera position for the Model-Shader.
+ * Sets the camera position for the Model- and Surface-Tessellation-Shader.
  * @param camPosWS The camera world position.
  */
 void shader_setCamPos(vec3 camPosWS);
 
 /**
- * Sets all point light attributes for the Model-Shader.
+ * Sets all point light attributes for the Model- and Surface-Tessellation-Shader.
  * @param color The color of the light.
  * @param posWS The camera position in world space.
  * @param falloff The attenuation falloff values.
@@ -73,4 +91,31 @@ void shader_setCamPos(vec3 camPosWS);
  */
 void shader_setPointLight(vec3 color, vec3 posWS, vec3 falloff, bool enabled, float ambientFactor);
 
+/**
+ * Returns if the surface tessellation shader was built successfully.
+ * @return true if the shader is available.
+ */
+bool shader_hasSurfaceTess(void);
+
+/**
+ * Activates the surface tessellation shader and sets its uniforms.
+ * Lighting, camera and texture are shared with the Model-Shader setters.
+ * @param viewMat pointer to the View-Matrix
+ * @param modelviewMat pointer to the combined Model-View-Matrix
+ * @param patchCount Number of patches per axis.
+ * @param step Control point spacing in X and Z.
+ * @param detail Scale of the tessellation levels, 1 is full detail.
+ * @param textureTiling Texture repeat factor.
+ * @return False if the shader is not available.
+ */
+bool shader_setSurfaceTessData(mat4 *viewMat, mat4 *modelviewMat, int patchCount, vec2 step, float detail,
+    float textureTiling);
+
+/**
+ * Activates the GUI composite shader and binds the cached GUI to unit 0.
+ * @param textureId Color texture of the GUI cache.
+ * @return False if the shader is not available.
+ */
+bool shader_setGuiComposite(GLuint textureId);
+
 #endif // SHADER_H
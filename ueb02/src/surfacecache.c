@@ -0,0 +1,224 @@
+/**
+ * @file surfacecache.c
+ * @brief Implementation of the surface cache
+ *
+ * The entries live in a fixed array and never move, the least recently
+ * used one is found by a scan over the few slots.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "surfacecache.h"
+#include "model.h"
+#include "alloctrack.h"
+
+/**
+ * Entries and counts of the cache.
+ */
+static struct {
+    SurfaceEntry entries[SURFACECACHE_MAX_ENTRIES];
+    size_t budget;
+    long clock;
+    long hits, misses, evictions;
+} g_cache = { .budget = (size_t) SURFACECACHE_DEFAULT_BUDGET_MB << 20 };
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * splitmix64 finalizer, spreads every input bit over the result.
+ * @param x Value to mix.
+ * @return Mixed value.
+ */
+static uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/**
+ * Bit pattern of a float, -0 and +0 count as the same height.
+ * @param f The float.
+ * @return Its bits.
+ */
+static uint32_t floatBits(float f) {
+    uint32_t bits;
+    f += 0.0f;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+/**
+ * Hash term of one control point height.
+ * @param index Index of the control point.
+ * @param height Its height.
+ * @return The term summed into the key hash.
+ */
+static uint64_t heightTerm(int index, float height) {
+    return mix64(((uint64_t) (uint32_t) index << 32) | floatBits(height));
+}
+
+/**
+ * Bytes held by an entry: vertex buffer, heights and patches.
+ * @param e The entry.
+ * @return Size in bytes.
+ */
+static size_t entryBytes(const SurfaceEntry *e) {
+    size_t dim = (size_t) e->key.dimension;
+    size_t res = (size_t) e->key.resolution;
+    size_t patches = (dim - 3) * (dim - 3);
+    return res * res * sizeof(Vertex) + dim * dim * sizeof(float) + patches * sizeof(Patch);
+}
+
+/**
+ * Frees an entry and its vertex buffer.
+ * @param e The entry.
+ */
+static void freeEntry(SurfaceEntry *e) {
+    model_deleteSurfaceBuffer(e->vbo);
+    TRACKED_FREE(e->heights);
+    PatchArr_free(&e->patches);
+    memset(e, 0, sizeof(*e));
+}
+
+/**
+ * Returns the least recently used entry.
+ * @param keep Entry that is not returned, may be NULL.
+ * @return The entry, NULL if there is none besides keep.
+ */
+static SurfaceEntry* leastRecentlyUsed(const SurfaceEntry *keep) {
+    SurfaceEntry *lru = NULL;
+    for (int i = 0; i < SURFACECACHE_MAX_ENTRIES; ++i) {
+        SurfaceEntry *e = &g_cache.entries[i];
+        if (e->used && e != keep && (!lru || e->lastUsed < lru->lastUsed)) {
+            lru = e;
+        }
+    }
+    return lru;
+}
+
+/**
+ * Sums the bytes of all entries.
+ * @return Size in bytes.
+ */
+static size_t totalBytes(void) {
+    size_t bytes = 0;
+    for (int i = 0; i < SURFACECACHE_MAX_ENTRIES; ++i) {
+        if (g_cache.entries[i].used) {
+            bytes += entryBytes(&g_cache.entries[i]);
+        }
+    }
+    return bytes;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void surfacecache_makeKey(const float *heights, int dimension, int resolution, float offset, float tiling,
+                          SurfaceKey *key) {
+    key->dimension = dimension;
+    key->resolution = resolution;
+    key->offset = offset;
+    key->tiling = tiling;
+
+    uint64_t hash = mix64(((uint64_t) (uint32_t) dimension << 32) | (uint32_t) resolution);
+    hash ^= mix64(((uint64_t) floatBits(offset) << 32) | floatBits(tiling));
+    for (int i = 0; i < dimension * dimension; ++i) {
+        hash += heightTerm(i, heights[i]);
+    }
+    key->hash = hash;
+}
+
+SurfaceEntry* surfacecache_find(const SurfaceKey *key, const float *heights) {
+    for (int i = 0; i < SURFACECACHE_MAX_ENTRIES; ++i) {
+        SurfaceEntry *e = &g_cache.entries[i];
+        if (!e->used || e->key.hash != key->hash || e->key.dimension != key->dimension
+            || e->key.resolution != key->resolution || e->key.offset != key->offset
+            || e->key.tiling != key->tiling) {
+            continue;
+        }
+
+        bool same = true;
+        for (int k = 0; k < key->dimension * key->dimension && same; ++k) {
+            same = floatBits(e->heights[k]) == floatBits(heights[k]);
+        }
+        if (same) {
+            e->lastUsed = ++g_cache.clock;
+            ++g_cache.hits;
+            return e;
+        }
+    }
+
+    ++g_cache.misses;
+    return NULL;
+}
+
+SurfaceEntry* surfacecache_insert(const SurfaceKey *key, const float *heights) {
+    SurfaceEntry *e = NULL;
+    for (int i = 0; i < SURFACECACHE_MAX_ENTRIES && !e; ++i) {
+        if (!g_cache.entries[i].used) {
+            e = &g_cache.entries[i];
+        }
+    }
+    if (!e) {
+        e = leastRecentlyUsed(NULL);
+        freeEntry(e);
+        ++g_cache.evictions;
+    }
+
+    int count = key->dimension * key->dimension;
+    e->key = *key;
+    e->heights = TRACKED_MALLOC(count * sizeof(float));
+    memcpy(e->heights, heights, count * sizeof(float));
+    PatchArr_init(&e->patches);
+    e->extremesValid = false;
+    e->vbo = model_createSurfaceBuffer(key->resolution);
+    e->lastUsed = ++g_cache.clock;
+    e->used = true;
+    return e;
+}
+
+void surfacecache_setHeight(SurfaceEntry *entry, int index, float height) {
+    assert(index >= 0 && index < entry->key.dimension * entry->key.dimension && "control point out of range");
+    entry->key.hash -= heightTerm(index, entry->heights[index]);
+    entry->key.hash += heightTerm(index, height);
+    entry->heights[index] = height;
+}
+
+void surfacecache_setBudget(size_t bytes) {
+    g_cache.budget = bytes;
+}
+
+void surfacecache_trim(const SurfaceEntry *keep) {
+    size_t bytes = totalBytes();
+    while (bytes > g_cache.budget) {
+        SurfaceEntry *lru = leastRecentlyUsed(keep);
+        if (!lru) {
+            break;
+        }
+        bytes -= entryBytes(lru);
+        freeEntry(lru);
+        ++g_cache.evictions;
+    }
+}
+
+void surfacecache_getStats(SurfaceCacheStats *stats) {
+    stats->entries = 0;
+    for (int i = 0; i < SURFACECACHE_MAX_ENTRIES; ++i) {
+        stats->entries += g_cache.entries[i].used;
+    }
+    stats->bytes = totalBytes();
+    stats->budget = g_cache.budget;
+    stats->hits = g_cache.hits;
+    stats->misses = g_cache.misses;
+    stats->evictions = g_cache.evictions;
+}
+
+void surfacecache_cleanup(void) {
+    for (int i = 0; i < SURFACECACHE_MAX_ENTRIES; ++i) {
+        if (g_cache.entries[i].used) {
+            freeEntry(&g_cache.entries[i]);
+        }
+    }
+    g_cache.clock = 0;
+    g_cache.hits = g_cache.misses = g_cache.evictions = 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file surfacecache.h
+ * @brief LRU cache of built surfaces keyed by their configuration
+ *
+ * A built surface is its patch array, its extreme points and a vertex
+ * buffer with the sampled vertices. The key is a hash of the control point
+ * heights together with dimension, resolution, offset and texture tiling,
+ * the heights are kept in the entry as well to rule out collisions.
+ * Switching back to a cached configuration then only rebinds its buffer.
+ *
+ * One entry is current: its vertex buffer is the drawn one and its patches
+ * are checked out to logic.c, height edits change it in place. The other
+ * entries are evicted least recently used first once the cache holds more
+ * than its memory budget, the current one stays.
+ *
+ * The heights enter the hash as a sum of per point terms, so editing a
+ * single control point updates the key in constant time.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef SURFACECACHE_H
+#define SURFACECACHE_H
+
+#include <fhwcg/fhwcg.h>
+#include "logic.h"
+
+/** Most surfaces kept at once */
+#define SURFACECACHE_MAX_ENTRIES 32
+
+/** Default memory budget in MiB */
+#define SURFACECACHE_DEFAULT_BUDGET_MB 128
+
+/**
+ * Configuration a surface was built from.
+ */
+typedef struct {
+    uint64_t hash;      // configuration and heights
+    int dimension;      // control points per axis
+    int resolution;     // samples per axis
+    float offset;       // control point offset
+    float tiling;       // texture repeat factor
+} SurfaceKey;
+
+/**
+ * A built surface.
+ */
+typedef struct {
+    SurfaceKey key;
+    float *heights;         // control point heights, dimension^2
+    PatchArr patches;       // empty while the entry is current
+    vec3 minPoint, maxPoint;
+    bool extremesValid;
+    GLuint vbo;             // resolution^2 vertices
+    long lastUsed;
+    bool used;
+} SurfaceEntry;
+
+/**
+ * Counts of the cache.
+ */
+typedef struct {
+    int entries;
+    size_t bytes;           // vertex buffers, heights and patches
+    size_t budget;
+    long hits, misses, evictions;
+} SurfaceCacheStats;
+
+/**
+ * Builds the key of a configuration.
+ * @param heights Control point heights, row by row.
+ * @param dimension Control points per axis.
+ * @param resolution Samples per axis.
+ * @param offset Control point offset.
+ * @param tiling Texture repeat factor.
+ * @param key Output key.
+ */
+void surfacecache_makeKey(const float *heights, int dimension, int resolution, float offset, float tiling,
+                          SurfaceKey *key);
+
+/**
+ * Looks up a built surface and marks it as most recently used.
+ * @param key Key of the configuration.
+ * @param heights Control point heights the key was built from.
+ * @return The entry, NULL if the configuration is not cached.
+ */
+SurfaceEntry* surfacecache_find(const SurfaceKey *key, const float *heights);
+
+/**
+ * Adds an entry for a configuration with an empty vertex buffer of its
+ * resolution. Evicts the least recently used entry if all are taken.
+ * @param key Key of the configuration.
+ * @param heights Control point heights the key was built from.
+ * @return The entry, patches and extremes are filled in by the caller.
+ */
+SurfaceEntry* surfacecache_insert(const SurfaceKey *key, const float *heights);
+
+/**
+ * Changes one control point height of an entry and its key.
+ * @param entry The entry.
+ * @param index Index of the control point.
+ * @param height The new height.
+ */
+void surfacecache_setHeight(SurfaceEntry *entry, int index, float height);
+
+/**
+ * Sets the memory budget.
+ * @param bytes Budget in bytes.
+ */
+void surfacecache_setBudget(size_t bytes);
+
+/**
+ * Evicts least recently used entries until the cache fits its budget.
+ * @param keep Entry that is never evicted, may be NULL.
+ */
+void surfacecache_trim(const SurfaceEntry *keep);
+
+/**
+ * Returns the counts of the cache.
+ * @param stats Destination.
+ */
+void surfacecache_getStats(SurfaceCacheStats *stats);
+
+/**
+ * Frees all entries with their vertex buffers.
+ */
+void surfacecache_cleanup(void);
+
+#endif // SURFACECACHE_H
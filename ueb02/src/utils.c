@@ -18,7 +18,7 @@
 
 ////////////////////////    LOCAL    ////////////////////////////
 
-typedef void (*HeightFunc)(vec3 *cp, int x, int z, int dimension);
+typedef void (*HeightFunc)(float *height, int x, int z, int dimension);
 
 /**
  * B-spline basis matrix (transposed).
@@ -45,61 +45,61 @@ static mat4 splineMatrix = {
 /**
  * Height function: Flat plane at y=0.
  *
- * @param cp Pointer to control point to modify
+ * @param height Height of the control point to set
  * @param x X grid index
  * @param z Z grid index
  * @param dimension Grid dimension
  */
-static void height_flat(vec3 *cp, int x, int z, int dimension) {
+static void height_flat(float *height, int x, int z, int dimension) {
     NK_UNUSED(dimension);
     NK_UNUSED(x);
     NK_UNUSED(z);
 
-    (*cp)[1] = 0.0f;
+    *height = 0.0f;
 }
 
 /**
  * Height function: Sinus pattern.
  * Creates a wave surface using sin(x)·cos(z).
  *
- * @param cp Pointer to control point to modify
+ * @param height Height of the control point to set
  * @param x X grid index
  * @param z Z grid index
  * @param dimension Grid dimension
  */
-static void height_sin(vec3 *cp, int x, int z, int dimension) {
+static void height_sin(float *height, int x, int z, int dimension) {
     NK_UNUSED(dimension);
 
     float freq = 0.5f;
-    (*cp)[1] = sinf(x * freq) * cosf(z * freq) * 2.0f;
+    *height = sinf(x * freq) * cosf(z * freq) * 2.0f;
 }
 
 /**
  * Height function: Cosine pattern.
  * Creates rolling hills using cos(x) + sin(z).
  *
- * @param cp Pointer to control point to modify
+ * @param height Height of the control point to set
  * @param x X grid index
  * @param z Z grid index
  * @param dimension Grid dimension
  */
-static void height_cos(vec3 *cp, int x, int z, int dimension) {
+static void height_cos(float *height, int x, int z, int dimension) {
     NK_UNUSED(dimension);
 
     float freq = 0.4f;
-    (*cp)[1] = cosf(x * freq) + sinf(z * freq);
+    *height = cosf(x * freq) + sinf(z * freq);
 }
 
 /**
  * Height function: Gauss bell curve.
  * Creates a smooth peak at the center of the surface.
  *
- * @param cp Pointer to control point to modify
+ * @param height Height of the control point to set
  * @param x X grid index
  * @param z Z grid index
  * @param dimension Grid dimension
  */
-static void height_gauss(vec3 *cp, int x, int z, int dimension) {
+static void height_gauss(float *height, int x, int z, int dimension) {
     float cx = (dimension - 1) / 2.0f;
     float cz = (dimension - 1) / 2.0f;
     float sigma = dimension / 4.0f;
@@ -108,37 +108,37 @@ static void height_gauss(vec3 *cp, int x, int z, int dimension) {
     float dz = z - cz;
     float dist2 = dx * dx + dz * dz;
 
-    (*cp)[1] = expf(-dist2 / (2.0f * sigma * sigma)) * 5.0f;
+    *height = expf(-dist2 / (2.0f * sigma * sigma)) * 5.0f;
 }
 
 /**
  * Height function: Random noise.
  * Generates random heights for a rough, irregular surface.
  *
- * @param cp Pointer to control point to modify
+ * @param height Height of the control point to set
  * @param x X grid index
  * @param z Z grid index
  * @param dimension Grid dimension
  */
-static void height_random(vec3 *cp, int x, int z, int dimension) {
+static void height_random(float *height, int x, int z, int dimension) {
     NK_UNUSED(dimension);
     NK_UNUSED(x);
     NK_UNUSED(z);
 
     float r = ((float)rand() / RAND_MAX) * 5.0f - 2.5f;
-    (*cp)[1] = r;
+    *height = r;
 }
 
 /**
  * Height function: hill.
  * Creates a smooth hill that rises from edges to center
  *
- * @param cp Pointer to control point to modify
+ * @param height Height of the control point to set
  * @param x X grid index
  * @param z Z grid index
  * @param dimension Grid dimension
  */
-static void height_hill(vec3 *cp, int x, int z, int dimension) {
+static void height_hill(float *height, int x, int z, int dimension) {
     float cx = (dimension - 1) / 2.0f;
     float cz = (dimension - 1) / 2.0f;
 
@@ -146,24 +146,24 @@ static void height_hill(vec3 *cp, int x, int z, int dimension) {
     float dz = (z - cz) / cz;
     float dist = sqrtf(dx * dx + dz * dz);
 
-    float height = cosf(dist * (float)M_PI / 2.0f);
-    if (height < 0.0f) height = 0.0f;
-    (*cp)[1] = height * 5.0f;
+    float h = cosf(dist * (float)M_PI / 2.0f);
+    if (h < 0.0f) h = 0.0f;
+    *height = h * 5.0f;
 }
 
 /**
  * Height function: Exponential.
  * Creates a sharp peak at origin with exponential falloff.
  *
- * @param cp Pointer to control point to modify
+ * @param height Height of the control point to set
  * @param x X grid index
  * @param z Z grid index
  * @param dimension Grid dimension
  */
-static void height_exp(vec3 *cp, int x, int z, int dimension) {
+static void height_exp(float *height, int x, int z, int dimension) {
     NK_UNUSED(dimension);
     float exp = expf(-(x * x + z * z) / 100.0f);
-    (*cp)[1] = exp * 10.0f;
+    *height = exp * 10.0f;
 }
 
 /**
@@ -181,6 +181,18 @@ static HeightFunc g_heightFuncs[HF_COUNT] = {
 
 ////////////////////////    PUBLIC    ////////////////////////////
 
+float utils_controlPointStep(int dimension, float offset) {
+    return (1.0f / (dimension - 1)) + offset;
+}
+
+void utils_getControlPoint(const InputData *data, int idx, vec3 dest) {
+    int dimension = data->surface.dimension;
+    float step = utils_controlPointStep(dimension, data->surface.controlPointOffset);
+    dest[0] = (idx % dimension) * step;
+    dest[1] = data->surface.heights.data[idx];
+    dest[2] = (idx / dimension) * step;
+}
+
 void utils_applyHeightFunction(HeightFuncType funcType) {
     if (funcType < 0 || funcType >= HF_COUNT) {
         return;
@@ -191,8 +203,7 @@ void utils_applyHeightFunction(HeightFuncType funcType) {
 
     for (int z = 0; z < dimension; ++z) {
         for (int x = 0; x < dimension; ++x) {
-            int idx = z * dimension + x;
-            g_heightFuncs[funcType](&data->surface.controlPoints.data[idx], x, z, dimension);
+            g_heightFuncs[funcType](&data->surface.heights.data[z * dimension + x], x, z, dimension);
         }
     }
 
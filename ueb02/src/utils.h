@@ -17,6 +17,7 @@
 #define UTILS_H
 
 #include <fhwcg/fhwcg.h>
+#include "array.h"
 #include "rendering.h"
 #include "input.h"
 #include "logic.h"
@@ -24,49 +25,7 @@
 #define VEC3(x, y, z) ((vec3){(float) x, (float) y, (float) z})
 #define VEC3X(x) ((vec3){(float) x, (float) x, (float) x})
 #define VEC2(x, y) ((vec2) {x, y})
-
-#define DEFINE_ARRAY_TYPE(TYPE, NAME)                                          \
-typedef struct {                                                               \
-    TYPE *data;                                                                \
-    size_t size;                                                               \
-    size_t capacity;                                                           \
-} NAME;                                                                        \
-                                                                               \
-static inline void NAME##_init(NAME *arr) {                                    \
-    arr->data = NULL;                                                          \
-    arr->size = 0;                                                             \
-    arr->capacity = 0;                                                         \
-}                                                                              \
-                                                                               \
-static inline void NAME##_free(NAME *arr) {                                    \
-    free(arr->data);                                                           \
-    arr->data = NULL;                                                          \
-    arr->size = 0;                                                             \
-    arr->capacity = 0;                                                         \
-}                                                                              \
-                                                                               \
-static inline void NAME##_clear(NAME *arr) {                                   \
-    arr->size = 0;                                                             \
-}                                                                              \
-                                                                               \
-static inline void NAME##_reserve(NAME *arr, size_t min_capacity) {            \
-    if (arr->capacity < min_capacity) {                                        \
-        size_t new_cap = arr->capacity ? arr->capacity * 2 : 8;                \
-        if (new_cap < min_capacity) new_cap = min_capacity;                    \
-        TYPE *new_data = malloc(new_cap * sizeof(TYPE));                       \
-        assert(new_data && "malloc failed in " #NAME "_reserve");              \
-        if (arr->data) memcpy(new_data, arr->data, arr->size * sizeof(TYPE));  \
-        free(arr->data);                                                       \
-        arr->data = new_data;                                                  \
-        arr->capacity = new_cap;                                               \
-    }                                                                          \
-}                                                                              \
-                                                                               \
-static inline void NAME##_push(NAME *arr, TYPE value) {                        \
-    if (arr->size >= arr->capacity)                                            \
-        NAME##_reserve(arr, arr->size + 1);                                    \
-    arr->data[arr->size++] = value;                                            \
-}
+#define CLAMP(x, min, max) ((x < min) ? min : (x > max) ? max : x)
 
 typedef enum {
     HF_FLAT,
@@ -87,74 +46,26 @@ typedef struct {
 } BezierCameraPath;
 
 /**
- * Initializes a vec3 array.
- * @param arr Pointer to the vec3 array.
- */
-static inline void vec3arr_init(Vec3Arr *arr) {
-    arr->size = 0;
-    arr->capacity = 0;
-    arr->data = NULL;
-}
-
-/**
- * Frees a vec3 array.
- * @param arr Pointer to the vec3 array.
- */
-static inline void vec3arr_free(Vec3Arr *arr) {
-    free(arr->data);
-    arr->data = NULL;
-    arr->size = 0;
-    arr->capacity = 0;
-}
-
-/**
- * Resets a vec3 array.
- * @warning Does not free the elements.
- * @param arr Pointer to the vec3 array.
- */
-static inline void vec3arr_clear(Vec3Arr *arr) {
-    arr->size = 0;
-}
-
-/**
- * Reserves the given amount for elements of a vec3 array.
- * Does not reduce the current capacity!
- * @param arr Pointer to the vec3 array.
- * @param min_capacity The new capacity of the array.
+ * Applies the given heigth modification to all control points of the surface.
+ * @param funcType The Type of the Height-Function. 
  */
-static inline void vec3arr_reserve(Vec3Arr *arr, size_t min_capacity) {
-    if (arr->capacity < min_capacity) {
-        size_t new_cap = arr->capacity ? arr->capacity * 2 : 8;
-        if (new_cap < min_capacity)
-            new_cap = min_capacity;
-        vec3 *new_data = (vec3*) malloc(new_cap * sizeof(vec3));
-        assert(new_data && "vec3arr_reserve: malloc failed");
-        if (arr->data) {
-            memcpy(new_data, arr->data, arr->size * sizeof(vec3));
-            free(arr->data);
-        }
-        arr->data = new_data;
-        arr->capacity = new_cap;
-    }
-}
+void utils_applyHeightFunction(HeightFuncType funcType);
 
 /**
- * Adds a new element to the vec3 array.
- * @param arr Pointer to the vec3 array.
- * @param value The new Element of the array.
+ * Returns the spacing of neighboring control points in x and z.
+ * @param dimension Control points per axis.
+ * @param offset Control point offset.
+ * @return Distance of two neighboring control points.
  */
-static inline void vec3arr_push(Vec3Arr *arr, vec3 value) {
-    if (arr->size >= arr->capacity) {
-        vec3arr_reserve(arr, arr->size + 1);
-    }
-    glm_vec3_copy(value, arr->data[arr->size++]);
-}
+float utils_controlPointStep(int dimension, float offset);
 
 /**
- * Applies the given heigth modification to all control points of the surface.
- * @param funcType The Type of the Height-Function. 
+ * Returns the position of a control point, x and z follow from its index.
+ * @param data Input data with dimension, offset and heights.
+ * @param idx Index of the control point, row by row.
+ * @param dest Output position.
  */
-void utils_applyHeightFunction(HeightFuncType funcType);
+void utils_getControlPoint(const InputData *data, int idx, vec3 dest);
 
 /**
  * Calculates the polynomial for the given control points and 
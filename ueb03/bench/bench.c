@@ -0,0 +1,638 @@
+/**
+ * @file bench.c
+ * @brief Headless stress benchmark for the fixed-step ball physics
+ *
+ * Builds a surface of the given dimension and height function, spawns
+ * the given numbers of balls and black holes deterministically from the
+ * seed and runs a fixed number of steps for every combination, repeated
+ * from the same start for a number of samples. Prints one CSV row per run
+ * with the mean time of every step phase in microseconds over the
+ * repetitions. The samples
+ * of all runs can be written as a result (benchresult.h). GL-bound modules
+ * are replaced by stubs.c.
+ *
+ * Every run checks that no ball left the walls or turned NaN, the surface
+ * is checked for NaN once. With a baseline, the JSON result or the CSV of
+ * an earlier run, the step and rebuild times of the matching rows must not
+ * exceed it by more than the tolerance. Against a JSON result every phase
+ * is compared and the slowdown has to be significant beyond the noise of
+ * the repetitions as well. Failed checks are printed to stderr and make
+ * the exit code non-zero, so the benchmark doubles as a regression test.
+ *
+ * Usage: cg2_ueb03_bench [-s steps] [-w warmup] [-n repeats] [-b balls] [-k blackholes]
+ *                        [-d dimension] [-e resolution] [-m maze] [-f heightfunc]
+ *                        [-i integrator] [-g solver] [-t threads] [-r seed]
+ *                        [-x fastmath] [-o file] [-j output] [-c baseline] [-p tolerance]
+ *   repeats            runs per scenario from the same start
+ *   balls, blackholes  comma separated lists, e.g. 100,1000,5000
+ *   maze               cells per axis of a maze of obstacles, 0 for the random ones
+ *   heightfunc         flat, sin, cos, gauss, random, hill, exp, tiltx, tiltz or noise
+ *   integrator         euler, symplectic, verlet or rk4
+ *   solver             penalty, xpbd-gs or xpbd-jacobi, an XPBD solver
+ *                      replaces the integrator in the CSV key
+ *   threads            job pool size, 1 solves every pass on the main thread
+ *   fastmath           1 to use the fastmath distances
+ *   file               CSV output, stdout if omitted
+ *   output             JSON result of the run
+ *   baseline           JSON result or CSV of an earlier run with the same steps
+ *   tolerance          allowed slowdown against the baseline in percent
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include <fhwcg/fhwcg.h>
+#include "input.h"
+#include "logic.h"
+#include "physics.h"
+#include "utils.h"
+#include "rng.h"
+#include "jobs.h"
+#include "benchresult.h"
+
+#define DEFAULT_STEPS 500
+#define DEFAULT_WARMUP 50
+#define DEFAULT_REPEATS 5
+#define MAX_REPEATS 64
+#define DEFAULT_SEED 42
+#define MAX_RUNS 16
+#define DEFAULT_TOLERANCE 25.0f
+
+/** Rows read from a baseline */
+#define MAX_BASELINE_ROWS 64
+
+/** Leading CSV columns identifying a run, balls to threads */
+#define KEY_COLUMNS 6
+
+/** CSV column of the mean step time */
+#define TOTAL_COLUMN 7
+
+/** Samples per direction of the surface NaN check */
+#define SURFACE_CHECK_SAMPLES 64
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/** Names accepted for -f, indexed by HeightFuncType */
+static const char *g_heightNames[] = {"flat", "sin", "cos", "gauss", "random", "hill", "exp", "tiltx", "tiltz", "noise"};
+
+/** Names accepted for -i, indexed by Integrator */
+static const char *g_integratorNames[] = {"euler", "symplectic", "verlet", "rk4"};
+
+/** Names accepted for -g, indexed by ContactSolver */
+static const char *g_solverNames[] = {"penalty", "xpbd-gs", "xpbd-jacobi"};
+
+/** CSV column names of the phases, indexed by PhysicsPhase */
+static const char *g_phaseNames[] = {"extern", "wall", "ball", "obstacle", "blackhole", "broadphase", "integrate"};
+
+/**
+ * Benchmark configuration parsed from the command line.
+ */
+typedef struct {
+    int steps;
+    int warmup;
+    int repeats;
+    int dimension;
+    HeightFuncType heightFunc;
+    Integrator integrator;
+    ContactSolver solver;
+    int threads;
+    bool fastMath;
+    uint64_t seed;
+    int balls[MAX_RUNS];
+    int numBalls;
+    int blackHoles[MAX_RUNS];
+    int numBlackHoles;
+    int resolution;
+    int mazeCells;      // 0 for the random obstacles
+    const char *output;
+    const char *result;     // JSON result
+    const char *baseline;
+    float tolerance;    // percent
+} BenchConfig;
+
+/**
+ * Times of one run of a baseline.
+ */
+typedef struct {
+    char key[128];      // the KEY_COLUMNS leading columns
+    double totalUs;
+    double rebuildUs;   // 0 if the baseline has no rebuild column
+} BaselineRow;
+
+/** Rows of a CSV baseline, empty without -c */
+static BaselineRow g_baseline[MAX_BASELINE_ROWS];
+static int g_baselineRows = 0;
+
+/** Samples of all runs */
+static BenchResult g_result;
+
+/** JSON baseline, compared once all runs are done */
+static BenchResult g_baselineResult;
+static bool g_hasBaselineResult = false;
+
+/**
+ * Looks up a name in a table.
+ * @param name Name to look up.
+ * @param names Table of accepted names.
+ * @param count Number of entries in the table.
+ * @return Index of the name or -1 if unknown.
+ */
+static int findName(const char *name, const char **names, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Parses a comma separated list of counts.
+ * @param arg Argument string (modified).
+ * @param dest Destination for at most MAX_RUNS counts.
+ * @param min Smallest accepted count.
+ * @return Number of counts parsed, 0 if an entry is invalid.
+ */
+static int parseCounts(char *arg, int *dest, int min) {
+    int num = 0;
+    for (char *tok = strtok(arg, ","); tok && num < MAX_RUNS; tok = strtok(NULL, ",")) {
+        char *end;
+        long count = strtol(tok, &end, 10);
+        if (*end != '\0' || count < min) {
+            printf("Invalid count '%s'!\n", tok);
+            return 0;
+        }
+        dest[num++] = (int) count;
+    }
+    return num;
+}
+
+/**
+ * Prints the usage string.
+ */
+static void printUsage(void) {
+    printf("Usage: " PROGRAM_NAME " [-s steps] [-w warmup] [-n repeats] [-b balls] [-k blackholes] [-d dimension]"
+           " [-e resolution] [-m maze] [-f heightfunc] [-i integrator] [-g solver] [-t threads] [-r seed] [-x fastmath]"
+           " [-o file] [-j output] [-c baseline] [-p tolerance]\n");
+    printf("  repeats            runs per scenario from the same start, 1 to %d\n", MAX_REPEATS);
+    printf("  balls, blackholes  comma separated, e.g. 100,1000,5000\n");
+    printf("  maze               cells per axis of a maze of obstacles, 0 for the random ones\n");
+    printf("  heightfunc         flat, sin, cos, gauss, random, hill, exp, tiltx, tiltz or noise\n");
+    printf("  integrator         euler, symplectic, verlet or rk4\n");
+    printf("  solver             penalty, xpbd-gs or xpbd-jacobi\n");
+    printf("  threads            job pool size, 1 solves every pass on the main thread\n");
+    printf("  fastmath           1 to use the fastmath distances\n");
+    printf("  file               CSV output, stdout if omitted\n");
+    printf("  output             JSON result of the run\n");
+    printf("  baseline           JSON result or CSV of an earlier run, slower rows fail\n");
+    printf("  tolerance          allowed slowdown in percent, default %.0f\n", DEFAULT_TOLERANCE);
+}
+
+/**
+ * Parses the command line into a configuration.
+ * @param argc Argument count.
+ * @param argv Argument values.
+ * @param cfg Configuration to fill, prefilled with defaults.
+ * @return False if the arguments are invalid.
+ */
+static bool parseArgs(int argc, char **argv, BenchConfig *cfg) {
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0' || i + 1 >= argc) {
+            return false;
+        }
+
+        char *arg = argv[++i];
+        switch (opt[1]) {
+            case 's': cfg->steps = atoi(arg); break;
+            case 'w': cfg->warmup = atoi(arg); break;
+            case 'n': cfg->repeats = atoi(arg); break;
+            case 'd': cfg->dimension = atoi(arg); break;
+            case 'e': cfg->resolution = atoi(arg); break;
+            case 'm': cfg->mazeCells = atoi(arg); break;
+            case 't': cfg->threads = atoi(arg); break;
+            case 'r': cfg->seed = strtoull(arg, NULL, 10); break;
+            case 'x': cfg->fastMath = atoi(arg) != 0; break;
+            case 'o': cfg->output = arg; break;
+            case 'j': cfg->result = arg; break;
+            case 'c': cfg->baseline = arg; break;
+            case 'p': cfg->tolerance = (float) atof(arg); break;
+            case 'b':
+                cfg->numBalls = parseCounts(arg, cfg->balls, 1);
+                if (cfg->numBalls == 0) return false;
+                break;
+            case 'k':
+                cfg->numBlackHoles = parseCounts(arg, cfg->blackHoles, 0);
+                if (cfg->numBlackHoles == 0) return false;
+                break;
+            case 'f': {
+                int func = findName(arg, g_heightNames, NK_LEN(g_heightNames));
+                if (func < 0) {
+                    printf("Unknown height function '%s'!\n", arg);
+                    return false;
+                }
+                cfg->heightFunc = (HeightFuncType) func;
+                break;
+            }
+            case 'i': {
+                int integrator = findName(arg, g_integratorNames, NK_LEN(g_integratorNames));
+                if (integrator < 0) {
+                    printf("Unknown integrator '%s'!\n", arg);
+                    return false;
+                }
+                cfg->integrator = (Integrator) integrator;
+                break;
+            }
+            case 'g': {
+                int solver = findName(arg, g_solverNames, NK_LEN(g_solverNames));
+                if (solver < 0) {
+                    printf("Unknown solver '%s'!\n", arg);
+                    return false;
+                }
+                cfg->solver = (ContactSolver) solver;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return cfg->steps > 0 && cfg->warmup >= 0 && cfg->repeats >= 1 && cfg->repeats <= MAX_REPEATS
+        && cfg->dimension >= 4 && cfg->resolution >= 2
+        && cfg->threads > 0 && cfg->tolerance >= 0.0f && cfg->mazeCells >= 0;
+}
+
+/**
+ * Reads a JSON result or the rows of a baseline CSV.
+ * @param path Baseline file.
+ * @return False if the file cannot be read.
+ */
+static bool loadBaseline(const char *path) {
+    if (benchresult_isResultFile(path)) {
+        g_hasBaselineResult = benchresult_load(&g_baselineResult, path);
+        return g_hasBaselineResult;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        printf("Failed to open '%s'!\n", path);
+        return false;
+    }
+
+    // Older baselines have no rebuild column
+    char line[1024];
+    int rebuildColumn = -1;
+    if (fgets(line, sizeof(line), f)) {
+        int column = 0;
+        for (char *tok = strtok(line, ",\r\n"); tok; tok = strtok(NULL, ",\r\n"), ++column) {
+            if (strcmp(tok, "rebuild_us") == 0) {
+                rebuildColumn = column;
+            }
+        }
+    }
+
+    while (g_baselineRows < MAX_BASELINE_ROWS && fgets(line, sizeof(line), f)) {
+        int len = 0, commas = 0;
+        while (line[len] && commas < KEY_COLUMNS) {
+            commas += line[len++] == ',';
+        }
+        if (commas < KEY_COLUMNS) {
+            continue;
+        }
+
+        BaselineRow *row = &g_baseline[g_baselineRows++];
+        snprintf(row->key, sizeof(row->key), "%.*s", len - 1, line);
+        row->totalUs = row->rebuildUs = 0.0;
+        int column = 0;
+        for (char *tok = strtok(line, ",\r\n"); tok; tok = strtok(NULL, ",\r\n"), ++column) {
+            if (column == TOTAL_COLUMN) {
+                row->totalUs = atof(tok);
+            } else if (column == rebuildColumn) {
+                row->rebuildUs = atof(tok);
+            }
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+
+/**
+ * Compares a time to its baseline.
+ * @param cfg Benchmark configuration.
+ * @param key Run of the time.
+ * @param what Name of the time.
+ * @param us Measured time.
+ * @param baselineUs Time of the baseline, 0 if there is none.
+ * @return False if the time exceeds the baseline by more than the tolerance.
+ */
+static bool checkTime(const BenchConfig *cfg, const char *key, const char *what, double us, double baselineUs) {
+    if (baselineUs <= 0.0 || us <= baselineUs * (1.0 + cfg->tolerance / 100.0)) {
+        return true;
+    }
+    fprintf(stderr, "FAIL %s: %s %.3f us, baseline %.3f us (+%.0f%%)\n",
+        key, what, us, baselineUs, 100.0 * (us / baselineUs - 1.0));
+    return false;
+}
+
+/**
+ * Finds the baseline row of a run.
+ * @param key Leading CSV columns of the run.
+ * @return The row or NULL.
+ */
+static const BaselineRow* findBaseline(const char *key) {
+    for (int i = 0; i < g_baselineRows; ++i) {
+        if (strcmp(g_baseline[i].key, key) == 0) {
+            return &g_baseline[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Samples the surface on a regular grid.
+ * @return Number of samples with a NaN position or normal.
+ */
+static int countInvalidSurfacePoints(void) {
+    int count = 0;
+    for (int i = 0; i < SURFACE_CHECK_SAMPLES; ++i) {
+        for (int j = 0; j < SURFACE_CHECK_SAMPLES; ++j) {
+            vec3 pos = {0}, normal = {0};
+            logic_evalSplineGlobal((float) i / (SURFACE_CHECK_SAMPLES - 1), (float) j / (SURFACE_CHECK_SAMPLES - 1),
+                pos, normal);
+            bool valid = true;
+            for (int c = 0; c < 3; ++c) {
+                valid &= isfinite(pos[c]) && isfinite(normal[c]);
+            }
+            count += !valid;
+        }
+    }
+    return count;
+}
+
+/**
+ * Builds the surface of the configuration and waits for it.
+ * The height function is applied to the fresh control points,
+ * so the surface is built twice.
+ * @param cfg Benchmark configuration.
+ * @return Time of the second build in seconds.
+ */
+static double buildSurface(const BenchConfig *cfg) {
+    InputData *data = getInputData();
+    rng_setSeed(cfg->seed);
+
+    data->surface.dimension = cfg->dimension;
+    data->surface.dimensionChanged = true;
+    data->surface.resolution = cfg->resolution;
+    data->surface.resolutionChanged = true;
+    logic_update(data);
+    logic_finishRebuild(data);
+
+    double start = glfwGetTime();
+    utils_applyHeightFunction(cfg->heightFunc);
+    logic_update(data);
+    logic_finishRebuild(data);
+    return glfwGetTime() - start;
+}
+
+/**
+ * Respawns the balls and black holes of one run.
+ * @param balls Number of balls.
+ * @param blackHoles Number of black holes.
+ */
+static void spawnScenario(int balls, int blackHoles) {
+    physics_init();
+
+    while (physics_getBlackHoleCount() > blackHoles) {
+        physics_removeBlackHole();
+    }
+    while (physics_getBlackHoleCount() < blackHoles) {
+        physics_addBlackHole();
+    }
+
+    while (physics_getBallCount() > balls) {
+        physics_removeBall();
+    }
+    while (physics_getBallCount() < balls) {
+        physics_addBall();
+    }
+    physics_orderBallsRandom();
+}
+
+/**
+ * Returns the mean of the samples of a run.
+ * @param samples Samples, one per repetition.
+ * @param count Number of samples.
+ * @return The mean.
+ */
+static double mean(const double *samples, int count) {
+    double sum = 0.0;
+    for (int i = 0; i < count; ++i) {
+        sum += samples[i];
+    }
+    return sum / count;
+}
+
+/**
+ * Runs exactly one fixed physics step.
+ * @param data Input state.
+ */
+static void runStep(InputData *data) {
+    data->deltaTime = 0.0f;
+    data->physics.dtAccumulator = data->physics.fixedDt;
+    physics_update();
+}
+
+/**
+ * Benchmarks one ball and black hole count on a fresh scenario,
+ * writes its CSV row and checks it.
+ * @param cfg Benchmark configuration.
+ * @param balls Number of balls.
+ * @param blackHoles Number of black holes.
+ * @param rebuild Time of the surface build in seconds.
+ * @param out CSV destination.
+ * @return Number of failed checks.
+ */
+static int runBenchmark(const BenchConfig *cfg, int balls, int blackHoles, double rebuild, FILE *out) {
+    InputData *data = getInputData();
+
+    // Every repetition starts the same scenario again, the last one is checked
+    double stepUs[MAX_REPEATS], phaseUs[PP_COUNT][MAX_REPEATS];
+    for (int r = 0; r < cfg->repeats; ++r) {
+        rng_setSeed(cfg->seed);
+        spawnScenario(balls, blackHoles);
+        for (int i = 0; i < cfg->warmup; ++i) {
+            runStep(data);
+        }
+
+        physics_resetPhaseTimes();
+        double start = glfwGetTime();
+        for (int i = 0; i < cfg->steps; ++i) {
+            runStep(data);
+        }
+        stepUs[r] = (glfwGetTime() - start) * 1e6 / cfg->steps;
+
+        double seconds[PP_COUNT];
+        int steps = physics_getPhaseTimes(seconds);
+        if (steps == 0) {
+            steps = 1;
+        }
+        for (int p = 0; p < PP_COUNT; ++p) {
+            phaseUs[p][r] = seconds[p] * 1e6 / steps;
+        }
+    }
+
+    // Penalty rows keep the key of older baselines
+    const char *method = cfg->solver == CS_PENALTY ? g_integratorNames[cfg->integrator] : g_solverNames[cfg->solver];
+    char key[128];
+    snprintf(key, sizeof(key), "%d,%d,%d,%s,%s,%d", balls, blackHoles, cfg->dimension,
+        g_heightNames[cfg->heightFunc], method, jobs_getThreadCount());
+    double totalUs = mean(stepUs, cfg->repeats);
+
+    fprintf(out, "%s,%d,%.3f", key, cfg->steps, totalUs);
+    for (int p = 0; p < PP_COUNT; ++p) {
+        fprintf(out, ",%.3f", mean(phaseUs[p], cfg->repeats));
+    }
+    fprintf(out, ",%d,%d,%.3f\n", physics_getBallCount(), physics_getSleepingBallCount(), rebuild * 1e6);
+    fflush(out);
+
+    char name[160];
+    snprintf(name, sizeof(name), "%s step", key);
+    benchresult_add(&g_result, name, "us", false, stepUs, cfg->repeats);
+    for (int p = 0; p < PP_COUNT; ++p) {
+        snprintf(name, sizeof(name), "%s %s", key, g_phaseNames[p]);
+        benchresult_add(&g_result, name, "us", false, phaseUs[p], cfg->repeats);
+    }
+
+    int failed = 0;
+    int invalid = physics_countInvalidBalls();
+    if (invalid > 0) {
+        fprintf(stderr, "FAIL %s: %d balls outside the walls or NaN\n", key, invalid);
+        ++failed;
+    }
+
+    if (cfg->baseline && !g_hasBaselineResult) {
+        const BaselineRow *row = findBaseline(key);
+        if (!row) {
+            fprintf(stderr, "No baseline for %s\n", key);
+        } else {
+            failed += !checkTime(cfg, key, "step", totalUs, row->totalUs);
+            failed += !checkTime(cfg, key, "rebuild", rebuild * 1e6, row->rebuildUs);
+        }
+    }
+    return failed;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+int main(int argc, char **argv) {
+    input_initDefaults();
+    InputData *data = getInputData();
+
+    BenchConfig cfg = {
+        .steps = DEFAULT_STEPS,
+        .warmup = DEFAULT_WARMUP,
+        .repeats = DEFAULT_REPEATS,
+        .dimension = data->surface.dimension,
+        .heightFunc = HF_HILL,
+        .integrator = data->physics.integrator,
+        .solver = data->physics.solver,
+        .threads = data->surface.threadCount,
+        .seed = DEFAULT_SEED,
+        .balls = {100, 1000, 5000},
+        .numBalls = 3,
+        .blackHoles = {5},
+        .numBlackHoles = 1,
+        .resolution = data->surface.resolution,
+        .mazeCells = 0,
+        .output = NULL,
+        .result = NULL,
+        .baseline = NULL,
+        .tolerance = DEFAULT_TOLERANCE
+    };
+
+    // The lists are split in place by the parser
+    benchresult_init(&g_result, PROGRAM_NAME, argc, argv);
+    if (!parseArgs(argc, argv, &cfg)) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    if (cfg.baseline && !loadBaseline(cfg.baseline)) {
+        return EXIT_FAILURE;
+    }
+
+    // Only the timer is used, no window is created
+    if (!glfwInit()) {
+        printf("Failed to initialize GLFW!\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = stdout;
+    if (cfg.output) {
+        out = fopen(cfg.output, "w");
+        if (!out) {
+            printf("Failed to open '%s'!\n", cfg.output);
+            glfwTerminate();
+            return EXIT_FAILURE;
+        }
+    }
+
+    data->game.paused = false;
+    data->physics.integrator = cfg.integrator;
+    data->physics.solver = cfg.solver;
+    data->physics.fastMath = cfg.fastMath;
+    if (cfg.mazeCells > 0) {
+        data->game.layout = OL_MAZE;
+        data->game.mazeCells = cfg.mazeCells;
+    }
+    data->surface.threadCount = cfg.threads;
+    logic_init();
+    double rebuild = buildSurface(&cfg);
+
+    // The surface is built once, its time is a single sample
+    char name[BENCHRESULT_NAME_LENGTH];
+    double rebuildUs = rebuild * 1e6;
+    snprintf(name, sizeof(name), "%d,%s rebuild", cfg.dimension, g_heightNames[cfg.heightFunc]);
+    benchresult_add(&g_result, name, "us", false, &rebuildUs, 1);
+
+    int failed = 0;
+    int invalidPoints = countInvalidSurfacePoints();
+    if (invalidPoints > 0) {
+        fprintf(stderr, "FAIL surface: %d of %d samples NaN\n", invalidPoints,
+            SURFACE_CHECK_SAMPLES * SURFACE_CHECK_SAMPLES);
+        ++failed;
+    }
+
+    fprintf(out, "balls,blackholes,dimension,heightfunc,integrator,threads,steps,total_us");
+    for (int p = 0; p < PP_COUNT; ++p) {
+        fprintf(out, ",%s_us", g_phaseNames[p]);
+    }
+    fprintf(out, ",active,sleeping,rebuild_us\n");
+
+    for (int k = 0; k < cfg.numBlackHoles; ++k) {
+        for (int b = 0; b < cfg.numBalls; ++b) {
+            failed += runBenchmark(&cfg, cfg.balls[b], cfg.blackHoles[k], rebuild, out);
+        }
+    }
+
+    if (cfg.result && !benchresult_write(&g_result, cfg.result)) {
+        ++failed;
+    }
+    if (g_hasBaselineResult) {
+        printf("\n");
+        failed += benchresult_compare(&g_baselineResult, &g_result, cfg.tolerance);
+        benchresult_free(&g_baselineResult);
+    }
+    benchresult_free(&g_result);
+
+    logic_cleanup();
+    if (out != stdout) {
+        fclose(out);
+    }
+    glfwTerminate();
+
+    if (failed > 0) {
+        fprintf(stderr, "%d checks failed\n", failed);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
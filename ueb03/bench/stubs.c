@@ -0,0 +1,171 @@
+/**
+ * @file stubs.c
+ * @brief No-op replacements for the GL-bound modules used by the benchmark
+ *
+ * The physics and surface modules upload the surface mesh, submit balls to
+ * the render queue and open profiler scopes. None of them can run without
+ * a GL context, so the benchmark links these stubs instead. The surface
+ * reports itself as tessellated, so the sampled mesh is never generated.
+ * The GPU ball solve and the GPU noise heights report themselves as unavailable.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "model.h"
+#include "renderqueue.h"
+#include "rendering.h"
+#include "shader.h"
+#include "profiler.h"
+#include "ballcompute.h"
+#include "guicache.h"
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool model_isSurfaceTessellated(bool drawNormals, bool tessellate) {
+    NK_UNUSED(drawNormals);
+    NK_UNUSED(tessellate);
+    return true;
+}
+
+void model_updateSurfacePatches(const Patch *patches, int first, int count, int patchCount, float stepX, float stepZ) {
+    NK_UNUSED(patches);
+    NK_UNUSED(first);
+    NK_UNUSED(count);
+    NK_UNUSED(patchCount);
+    NK_UNUSED(stepX);
+    NK_UNUSED(stepZ);
+}
+
+void model_updateSurface(const Vertex *vertices, int dim) {
+    NK_UNUSED(vertices);
+    NK_UNUSED(dim);
+}
+
+bool model_generateSurface(int dim, vec3 minPoint, vec3 maxPoint) {
+    NK_UNUSED(dim);
+    NK_UNUSED(minPoint);
+    NK_UNUSED(maxPoint);
+    return false;
+}
+
+void model_updateSurfaceRegion(const Vertex *vertices, int dim, int x, int y, int width, int height) {
+    NK_UNUSED(vertices);
+    NK_UNUSED(dim);
+    NK_UNUSED(x);
+    NK_UNUSED(y);
+    NK_UNUSED(width);
+    NK_UNUSED(height);
+}
+
+void model_updateAmbientOcclusion(const uint8_t *ao, int dim, vec2 extent, int x, int y, int width, int height) {
+    NK_UNUSED(ao);
+    NK_UNUSED(dim);
+    NK_UNUSED(extent);
+    NK_UNUSED(x);
+    NK_UNUSED(y);
+    NK_UNUSED(width);
+    NK_UNUSED(height);
+}
+
+void model_updateNormalMap(const uint8_t *normals, int dim, vec2 extent, int x, int y, int width, int height) {
+    NK_UNUSED(normals);
+    NK_UNUSED(dim);
+    NK_UNUSED(extent);
+    NK_UNUSED(x);
+    NK_UNUSED(y);
+    NK_UNUSED(width);
+    NK_UNUSED(height);
+}
+
+bool model_generateNoiseHeights(vec3 *controlPoints, int dim, uint32_t seed, const NoiseSettings *noise) {
+    NK_UNUSED(controlPoints);
+    NK_UNUSED(dim);
+    NK_UNUSED(seed);
+    NK_UNUSED(noise);
+    return false;
+}
+
+void renderqueue_addModel(ModelType model, const Material *mat, vec3 pos, float scale, vec3 color, bool drawNormals) {
+    NK_UNUSED(model);
+    NK_UNUSED(mat);
+    NK_UNUSED(pos);
+    NK_UNUSED(scale);
+    NK_UNUSED(color);
+    NK_UNUSED(drawNormals);
+}
+
+RenderBatch renderqueue_reserveModels(ModelType model, const Material *mat, int count, bool drawNormals) {
+    return (RenderBatch) { .count = count, .model = model, .mat = mat, .drawNormals = drawNormals };
+}
+
+void renderqueue_setModel(const RenderBatch *batch, int idx, vec3 pos, float scale, vec3 color) {
+    NK_UNUSED(batch);
+    NK_UNUSED(idx);
+    NK_UNUSED(pos);
+    NK_UNUSED(scale);
+    NK_UNUSED(color);
+}
+
+void renderqueue_addCustom(RenderCallback draw, void *userData, vec3 center) {
+    NK_UNUSED(draw);
+    NK_UNUSED(userData);
+    NK_UNUSED(center);
+}
+
+void model_drawInstancedBuffer(ModelType model, const Material *mat, mat4 *viewMat,
+                               GLuint buffer, GLsizei stride, int count) {
+    NK_UNUSED(model);
+    NK_UNUSED(mat);
+    NK_UNUSED(viewMat);
+    NK_UNUSED(buffer);
+    NK_UNUSED(stride);
+    NK_UNUSED(count);
+}
+
+void ballcompute_upload(int count, const GpuBall *balls) {
+    NK_UNUSED(count);
+    NK_UNUSED(balls);
+}
+
+void ballcompute_download(int count, GpuBall *dest) {
+    NK_UNUSED(count);
+    NK_UNUSED(dest);
+}
+
+bool ballcompute_setParams(InputData *data, vec3 *blackHoles, int blackHoleCount,
+                           vec3 goal, float goalRadius, vec2 walls) {
+    NK_UNUSED(data);
+    NK_UNUSED(blackHoles);
+    NK_UNUSED(blackHoleCount);
+    NK_UNUSED(goal);
+    NK_UNUSED(goalRadius);
+    NK_UNUSED(walls);
+    return false;
+}
+
+void ballcompute_step(void) {}
+
+bool ballcompute_readEvents(int *captured, bool *goalReached) {
+    NK_UNUSED(captured);
+    NK_UNUSED(goalReached);
+    return false;
+}
+
+GLuint ballcompute_getBallBuffer(void) {
+    return 0;
+}
+
+void rendering_resize(int width, int height) {
+    NK_UNUSED(width);
+    NK_UNUSED(height);
+}
+
+void shader_load(void) {}
+
+void (profiler_pushScope)(const char *name) {
+    NK_UNUSED(name);
+}
+
+void (profiler_popScope)(void) {}
+
+void guicache_onInput(void) {}
@@ -0,0 +1,15 @@
+#version 430 core
+
+uniform sampler2D u_gui;    // premultiplied colors and squared coverage of the cached GUI
+
+out vec4 fragColor;
+
+/**
+ * Returns the cached GUI texel of the fragment, blended premultiplied
+ * over the scene. The GUI blended its alpha like its colors, so the
+ * alpha is the square of the coverage of a single layer.
+ */
+void main(void) {
+    vec4 gui = texelFetch(u_gui, ivec2(gl_FragCoord.xy), 0);
+    fragColor = vec4(gui.rgb, sqrt(gui.a));
+}
@@ -1,14 +1,14 @@
 #version 430
 
-out vec4 fragColor;
+layout (location = 0) out vec4 fragColor;
+layout (location = 1) out float fragRevealage;  // weighted blended transparency only
 
-#define HEIGHT_LOWEST       -5.0
-#define HEIGHT_VERY_LOW     -1.0
-#define HEIGHT_LOW          -0.25
-#define HEIGHT_MEDIUM       0.001
-#define HEIGHT_HIGH         0.25
-#define HEIGHT_VERY_HIGH    0.6
-#define HEIGHT_HIGHEST      2.0
+// Rows of the height band lookup texture, must match model.c
+#define BAND_ROWS 4
+#define BAND_ROW_COLOR 0      // w: shininess
+#define BAND_ROW_AMBIENT 1
+#define BAND_ROW_SPECULAR 2
+#define BAND_ROW_EMISSION 3
 
 struct Material {
     vec3 ambient;
@@ -19,110 +19,49 @@ struct Material {
     float alpha;
 };
 
-struct HeightData {
-    float heightY;
-    vec3 color;
-    Material mat;
-}; 
-
-const HeightData HEIGHTDATA_LOWEST = HeightData(
-    HEIGHT_LOWEST,
-    vec3(0.0, 0.0, 1.0),
-    Material(
-        vec3(0.05, 0.05, 0.1),
-        vec3(0.1, 0.1, 0.3),
-        vec3(0.1, 0.1, 0.2),
-        vec3(0.0),
-        8.0,
-        1.0
-    )
-);
-
-const HeightData HEIGHTDATA_VERY_LOW = HeightData(
-    HEIGHT_VERY_LOW,
-    vec3(0.1, 0.0, 0.7),
-    Material(
-        vec3(0.05, 0.05, 0.1),
-        vec3(0.1, 0.1, 0.5),
-        vec3(0.05, 0.05, 0.2),
-        vec3(0.0),
-        12.0,
-        1.0
-    )
-);
-
-const HeightData HEIGHTDATA_LOW = HeightData(
-    HEIGHT_LOW,
-    vec3(0.0, 0.0, 0.5),
-    Material(
-        vec3(0.05, 0.05, 0.1),
-        vec3(0.1, 0.1, 0.4),
-        vec3(0.05, 0.05, 0.1),
-        vec3(0.0),
-        16.0,
-        1.0
-    )
-);
-
-const HeightData HEIGHTDATA_MEDIUM = HeightData(
-    HEIGHT_MEDIUM,
-    vec3(0.0, 0.5, 0.0),
-    Material(
-        vec3(0.05, 0.1, 0.05),
-        vec3(0.1, 0.4, 0.1),
-        vec3(0.05, 0.2, 0.05),
-        vec3(0.0),
-        20.0,
-        1.0
-    )
-);
-
-const HeightData HEIGHTDATA_HIGH = HeightData(
-    HEIGHT_HIGH,
-    vec3(0.5, 0.5, 0.0),
-    Material(
-        vec3(0.1, 0.1, 0.05),
-        vec3(0.6, 0.6, 0.2),
-        vec3(0.3, 0.3, 0.1),
-        vec3(0.0),
-        32.0,
-        1.0
-    )
-);
-
-const HeightData HEIGHTDATA_VERY_HIGH = HeightData(
-    HEIGHT_VERY_HIGH,
-    vec3(0.5, 0.2, 0.3),
-    Material(
-        vec3(0.1, 0.05, 0.05),
-        vec3(0.6, 0.3, 0.3),
-        vec3(0.4, 0.2, 0.2),
-        vec3(0.2, 0.1, 0.05),
-        48.0,
-        1.0
-    )
-);
-
-const HeightData HEIGHTDATA_HIGHEST = HeightData(
-    HEIGHT_HIGHEST,
-    vec3(0.5, 0.1, 0.1),
-    Material(
-        vec3(0.1, 0.05, 0.05),
-        vec3(0.6, 0.2, 0.2),
-        vec3(0.4, 0.1, 0.1),
-        vec3(0.5, 0.2, 0.1),
-        64.0,
-        1.0
-    )
-);
+#ifdef HEIGHTMAP_MARCH
+
+// Fullscreen pass, the inputs come from a ray march of the heightmap instead
+#define MARCH_MAX_STEPS 160     // bounds the cost per pixel for any grid size
+#define MARCH_REFINE_STEPS 6    // bisection steps inside the hit cell
+#define MARCH_EPSILON 1e-3      // step past a cell border, in cells
+
+uniform mat4 u_mvpMatrix;
+uniform mat4 u_invMvpMatrix;
+uniform mat4 u_modelviewMatrix;
+uniform mat4 u_viewMatrix;
+uniform vec4 u_viewport;        // x, y, width, height
+
+uniform int u_gridDim;
+uniform vec2 u_gridExtent;
+uniform float u_textureTiling = 1.0;
+
+uniform sampler2D u_heightTexture;
+uniform sampler2D u_gradientTexture;
+uniform sampler2D u_minMaxTexture;  // x: min, y: max height, cells at level 0
+uniform int u_minMaxLevels;
+
+struct FragInput {
+    vec2 TexCoords;
+    vec3 PositionWS;
+    vec3 NormalVS;
+    vec3 PositionVS;
+    int MaterialIndex;
+};
+FragInput fs_in;
+
+#else
 
 in VS_OUT {
     vec2 TexCoords;
     vec3 PositionWS;
     vec3 NormalVS;
     vec3 PositionVS;
+    flat int MaterialIndex;  // -1: height dependent material
 } fs_in;
 
+#endif
+
 struct PointLight {
     vec3 posVS;
     vec3 color;
@@ -131,12 +70,70 @@ struct PointLight {
     float ambientFactor;
 };
 
+#define MAX_MATERIALS 32
+
+// Light clusters per axis, must match lightgrid.h
+#define LIGHTGRID_X 16
+#define LIGHTGRID_Y 9
+#define LIGHTGRID_Z 24
+
+// Material in std140 layout, w of ambient: shininess, w of diffuse: alpha
+struct MaterialData {
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 emission;
+};
+
+// Camera and light, set once per frame
+layout (std140, binding = 0) uniform FrameData {
+    vec4 u_camPosVS;
+    vec4 u_lightPosVS;    // w: enabled
+    vec4 u_lightColor;    // w: ambient factor
+    vec4 u_lightFalloff;
+    vec4 u_clusterProj;   // xy: projection scale, z: first slice depth, w: slices per log depth
+    vec4 u_shadowLight;   // xyz: world space position of the shadow cube, w: 1 if it is sampled
+    vec4 u_shadowParams;  // x: near, y: far, z: bias, w: 1 while drawing into the shadow cube
+    int u_clusterLightCount;
+};
+
+// Clustered point lights in view space, w of the position: radius
+struct ClusterLight {
+    vec4 posRadius;
+    vec4 color;
+};
+
+layout (std430, binding = 6) readonly buffer ClusterLights {
+    ClusterLight u_clusterLights[];
+};
+
+// Per cluster: offset into the index list and number of lights
+layout (std430, binding = 7) readonly buffer ClusterRanges {
+    uvec2 u_clusterRanges[];
+};
+
+layout (std430, binding = 8) readonly buffer ClusterIndices {
+    uint u_clusterIndices[];
+};
+
+// All materials, indexed per draw
+layout (std140, binding = 1) uniform MaterialBlock {
+    MaterialData u_materials[MAX_MATERIALS];
+};
+
+// USE_TEXTURE: the texture replaces the diffuse color of the height bands
 uniform sampler2D u_texture;
-uniform bool u_useTexture = false;
-uniform vec3 u_camPosVS;
-uniform PointLight u_pointLight;
-uniform bool u_useMaterial;
-uniform Material u_material;
+uniform sampler2D u_heightBands;
+uniform vec2 u_heightBandRange;  // x: height of the left texture edge, y: 1 / height span
+uniform bool u_oit = false;  // write the weighted blended transparency targets
+uniform samplerCubeShadow u_shadowMap;
+uniform sampler2D u_aoTexture;   // baked occlusion of the surface
+uniform vec4 u_aoTransform;      // xy: scale, zw: offset from world xz to texture coordinates
+uniform float u_aoStrength = 0.0;
+uniform bool u_normalMap = false;    // baked normals of the surface replace the interpolated ones
+uniform sampler2D u_normalTexture;   // xz of the world space normal, y follows from the unit length
+uniform vec4 u_normalTransform;      // xy: scale, zw: offset from world xz to texture coordinates
+uniform mat3 u_normalViewMatrix;     // world to view space
 
 /**
  * Computes Phong lighting contribution for a given light direction and view direction.
@@ -165,78 +162,352 @@ vec3 phongLight(vec3 N, vec3 L, vec3 V, vec3 lightColor, vec3 matDiffuse, vec3 m
     return clamp(result, 0.0, 1.0);
 }
 
+/**
+ * Looks up how much of the point light reaches a fragment in the shadow cube.
+ * The face of the cube is the major axis of the direction from the light,
+ * its depth is the distance along that axis through the face projection.
+ * @param posWS     world position of the fragment
+ *
+ * @returns 1 if lit, 0 if shadowed, filtered in between
+ */
+float shadowFactor(vec3 posWS) {
+    if (u_shadowLight.w < 0.5) {
+        return 1.0;
+    }
+
+    vec3 dir = posWS - u_shadowLight.xyz;
+    vec3 a = abs(dir);
+    float n = u_shadowParams.x;
+    float f = u_shadowParams.y;
+    float axis = max(max(max(a.x, a.y), a.z) - u_shadowParams.z, n);
+    float depth = (f + n) / (2.0 * (f - n)) - f * n / ((f - n) * axis) + 0.5;
+    return texture(u_shadowMap, vec4(dir, depth));
+}
+
 /**
  * Calculates the light contribution of the pointl light.
+ * @param light     the point light
  * @param N         normal of the material
  * @param V         normal to the camera (view)
  * @param fragPos   view position of the fragment
  * @param m         normal the material properties (diff, spec, ...)
+ * @param shadow    share of the light reaching the fragment
  +
  * @returns the point light contribution 
  */
-vec3 pointLightContribution(vec3 N, vec3 V, vec3 fragPos, Material m) {
-    if (!u_pointLight.enabled) return vec3(0.0);
+vec3 pointLightContribution(PointLight light, vec3 N, vec3 V, vec3 fragPos, Material m, float shadow) {
+    if (!light.enabled) return vec3(0.0);
 
-    vec3 L = normalize(u_pointLight.posVS - fragPos);
-    float dist = length(u_pointLight.posVS - fragPos);
-    float att = 1.0 / (u_pointLight.falloff.x + u_pointLight.falloff.y * dist + u_pointLight.falloff.z * dist * dist);
+    vec3 L = normalize(light.posVS - fragPos);
+    float dist = length(light.posVS - fragPos);
+    float att = 1.0 / (light.falloff.x + light.falloff.y * dist + light.falloff.z * dist * dist);
 
-    vec3 ambient  = m.ambient * u_pointLight.color * u_pointLight.ambientFactor;
-    vec3 lighting = phongLight(N, L, V, u_pointLight.color, m.diffuse.rgb, m.specular, m.shininess) * att;
+    vec3 ambient  = m.ambient * light.color * light.ambientFactor;
+    vec3 lighting = phongLight(N, L, V, light.color, m.diffuse.rgb, m.specular, m.shininess) * att * shadow;
 
     return ambient + lighting + (m.emission * 0.3);
 }
 
 /**
- * Extracts the HeightData related to the fragment world position.
+ * Sums the clustered point lights of the fragment's cluster.
+ * Uses the falloff of the point light, faded to zero at the light radius.
+ * @param N         normal of the material
+ * @param V         normal to the camera (view)
+ * @param fragPos   view position of the fragment
+ * @param m         the material properties
+ *
+ * @returns the contribution of the clustered lights
+ */
+vec3 clusterLightsContribution(vec3 N, vec3 V, vec3 fragPos, Material m) {
+    float depth = max(-fragPos.z, 1e-5);
+    vec2 ndc = u_clusterProj.xy * fragPos.xy / depth;
+    ivec2 tile = clamp(ivec2((ndc * 0.5 + 0.5) * vec2(LIGHTGRID_X, LIGHTGRID_Y)),
+                       ivec2(0), ivec2(LIGHTGRID_X - 1, LIGHTGRID_Y - 1));
+    int slice = clamp(int(floor(log(depth / u_clusterProj.z) * u_clusterProj.w)), 0, LIGHTGRID_Z - 1);
+    uvec2 range = u_clusterRanges[(slice * LIGHTGRID_Y + tile.y) * LIGHTGRID_X + tile.x];
+
+    vec3 result = vec3(0.0);
+    for (uint i = range.x; i < range.x + range.y; ++i) {
+        ClusterLight light = u_clusterLights[u_clusterIndices[i]];
+        vec3 toLight = light.posRadius.xyz - fragPos;
+        float dist = length(toLight);
+        float fade = clamp(1.0 - dist * dist / (light.posRadius.w * light.posRadius.w), 0.0, 1.0);
+        float att = fade * fade / (u_lightFalloff.x + u_lightFalloff.y * dist + u_lightFalloff.z * dist * dist);
+
+        vec3 L = toLight / max(dist, 1e-5);
+        result += phongLight(N, L, V, light.color.rgb, m.diffuse, m.specular, m.shininess) * att;
+    }
+    return result;
+}
+
+/**
+ * Returns the normal of a fragment, for the surface from the baked
+ * normal map if it is set.
+ * @returns the normalized view space normal
+ */
+vec3 fragmentNormal(void) {
+    if (fs_in.MaterialIndex < 0 && u_normalMap) {
+        vec2 xz = texture(u_normalTexture, fs_in.PositionWS.xz * u_normalTransform.xy + u_normalTransform.zw).rg;
+        xz = xz * 2.0 - 1.0;
+        vec3 normal = vec3(xz.x, sqrt(max(1.0 - dot(xz, xz), 0.0)), xz.y);
+        return normalize(u_normalViewMatrix * normal);
+    }
+    return normalize(fs_in.NormalVS);
+}
+
+/**
+ * Unpacks a material of the material buffer.
+ * @param idx Index into the material array.
+ * @returns the material.
+ */
+Material getMaterial(int idx) {
+    MaterialData d = u_materials[idx];
+    return Material(d.ambient.rgb, d.diffuse.rgb, d.specular.rgb, d.emission.rgb, d.ambient.w, d.diffuse.w);
+}
+
+/**
+ * Reads one row of the height band lookup texture.
+ * @param u Normalized height.
+ * @param row Row to read.
+ * @returns the filtered texel.
+ */
+vec4 bandTexel(float u, int row) {
+    return texture(u_heightBands, vec2(u, (float(row) + 0.5) / float(BAND_ROWS)));
+}
+
+/**
+ * Looks up the material of the height band at the fragment height.
+ * The diffuse color is the band color.
  * @param height The height of the fragment in world space.
- * @returns the HeightData related to the fragment world position.
+ * @returns the material of the band.
+ */
+Material getHeightMaterial(float height) {
+    float u = (height - u_heightBandRange.x) * u_heightBandRange.y;
+    vec4 color = bandTexel(u, BAND_ROW_COLOR);
+    return Material(
+        bandTexel(u, BAND_ROW_AMBIENT).rgb,
+        color.rgb,
+        bandTexel(u, BAND_ROW_SPECULAR).rgb,
+        bandTexel(u, BAND_ROW_EMISSION).rgb,
+        color.w,
+        1.0
+    );
+}
+
+/**
+ * Weight of a transparent fragment, favors near and opaque fragments
+ * (McGuire and Bavoil, equation 7).
+ * @param depthVS   view space depth of the fragment
+ * @param alpha     coverage of the fragment
+ *
+ * @returns the weight of the fragment
+ */
+float oitWeight(float depthVS, float alpha) {
+    float z = abs(depthVS);
+    float w = 10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0));
+    return alpha * clamp(w, 1e-2, 3e3);
+}
+
+#ifdef HEIGHTMAP_MARCH
+
+/**
+ * Height of the surface between the grid vertices, bilinear like the sampled mesh.
+ * @param g Grid position in cells.
+ * @returns the height.
  */
-HeightData getHeightData(float height) {
-    if (height < HEIGHT_VERY_LOW)
-        return HEIGHTDATA_LOWEST;
-    else if (height < HEIGHT_LOW)
-        return HEIGHTDATA_VERY_LOW;
-    else if (height < HEIGHT_MEDIUM)
-        return HEIGHTDATA_LOW;
-    else if (height < HEIGHT_HIGH)
-        return HEIGHTDATA_MEDIUM;
-    else if (height < HEIGHT_VERY_HIGH)
-        return HEIGHTDATA_HIGH;
-    else if (height < HEIGHT_HIGHEST)
-        return HEIGHTDATA_VERY_HIGH;
-    else
-        return HEIGHTDATA_HIGHEST;
+float gridHeight(vec2 g) {
+    return texture(u_heightTexture, (g + 0.5) / float(u_gridDim)).r;
 }
 
+/**
+ * Intersects a ray with an axis-aligned box.
+ * @param ro      Ray origin
+ * @param invRd   Inverse ray direction
+ * @param lo      Minimum corner of the box
+ * @param hi      Maximum corner of the box
+ *
+ * @returns the entry and exit parameters, entry > exit if the box is missed
+ */
+vec2 intersectBox(vec3 ro, vec3 invRd, vec3 lo, vec3 hi) {
+    vec3 t0 = (lo - ro) * invRd;
+    vec3 t1 = (hi - ro) * invRd;
+    vec3 tMin = min(t0, t1);
+    vec3 tMax = max(t0, t1);
+    return vec2(max(max(tMin.x, tMin.y), tMin.z), min(min(tMax.x, tMax.y), tMax.z));
+}
+
+/**
+ * Marches a ray in grid space through the min/max pyramid.
+ * A texel whose maximum lies below the ray over its cells is skipped as a
+ * whole and the march climbs a level, otherwise it descends. Level 0 cells
+ * are bisected against the bilinear surface.
+ * @param ro      Ray origin, x and z in cells, y the height
+ * @param rd      Normalized ray direction
+ * @param t       Entry parameter, the hit parameter on return
+ * @param tEnd    Exit parameter
+ *
+ * @returns true on a hit
+ */
+bool marchPyramid(vec3 ro, vec3 rd, inout float t, float tEnd) {
+    int n = u_gridDim - 1;
+    int top = u_minMaxLevels - 1;
+    int level = top;
+    vec2 invRd = 1.0 / rd.xz;
+    vec2 towards = step(0.0, rd.xz);
+
+    for (int i = 0; i < MARCH_MAX_STEPS && t < tEnd; ++i) {
+        vec3 p = ro + rd * t;
+        ivec2 size = textureSize(u_minMaxTexture, level);
+        ivec2 texel = clamp(ivec2(floor(p.xz)) >> level, ivec2(0), size - 1);
+
+        // The last texel of a level reaches to the grid border
+        vec2 cellMin = vec2(texel << level);
+        vec2 cellMax = mix(vec2((texel + 1) << level), vec2(n), equal(texel, size - 1));
+        vec2 tSides = (mix(cellMin, cellMax, towards) - ro.xz) * invRd;
+        float tExit = min(min(tSides.x, tSides.y), tEnd);
+
+        float yEnter = p.y;
+        float yExit = ro.y + rd.y * tExit;
+        float maxHeight = texelFetch(u_minMaxTexture, texel, level).y;
+        if (min(yEnter, yExit) > maxHeight) {
+            t = tExit + MARCH_EPSILON;
+            level = min(level + 1, top);
+            continue;
+        }
+        if (level > 0) {
+            --level;
+            continue;
+        }
+
+        if (yEnter <= gridHeight(p.xz)) {
+            return true;
+        }
+        if (yExit <= gridHeight(ro.xz + rd.xz * tExit)) {
+            float a = t;
+            float b = tExit;
+            for (int k = 0; k < MARCH_REFINE_STEPS; ++k) {
+                float m = 0.5 * (a + b);
+                vec3 q = ro + rd * m;
+                if (q.y > gridHeight(q.xz)) {
+                    a = m;
+                } else {
+                    b = m;
+                }
+            }
+            t = b;
+            return true;
+        }
+        t = tExit + MARCH_EPSILON;
+    }
+    return false;
+}
+
+/**
+ * Casts the ray of the fragment against the heightmap and fills the
+ * fragment inputs and depth from the hit.
+ * @returns false if the ray misses the surface
+ */
+bool marchHeightmap(void) {
+    vec2 ndc = (gl_FragCoord.xy - u_viewport.xy) / u_viewport.zw * 2.0 - 1.0;
+    vec4 nearPoint = u_invMvpMatrix * vec4(ndc, -1.0, 1.0);
+    vec4 farPoint = u_invMvpMatrix * vec4(ndc, 1.0, 1.0);
+    vec3 roLocal = nearPoint.xyz / nearPoint.w;
+    vec3 rdLocal = farPoint.xyz / farPoint.w - roLocal;
+
+    // Grid space: x and z in cells, y stays the height
+    float n = float(u_gridDim - 1);
+    vec3 toGrid = vec3(n / u_gridExtent.x, 1.0, n / u_gridExtent.y);
+    vec3 ro = roLocal * toGrid;
+    vec3 rd = normalize(rdLocal * toGrid);
+    rd += vec3(equal(rd, vec3(0.0))) * 1e-7;
+
+    vec2 range = texelFetch(u_minMaxTexture, ivec2(0), u_minMaxLevels - 1).xy;
+    vec2 span = intersectBox(ro, 1.0 / rd, vec3(0.0, range.x, 0.0), vec3(n, range.y, n));
+    float t = max(span.x, 0.0);
+    if (t > span.y || !marchPyramid(ro, rd, t, span.y)) {
+        return false;
+    }
+
+    vec3 hit = ro + rd * t;
+    vec3 localPos = hit / toGrid;
+    vec2 gradient = texture(u_gradientTexture, (hit.xz + 0.5) / float(u_gridDim)).rg;
+    vec3 normal = normalize(vec3(-gradient.x, 1.0, -gradient.y));
+
+    mat4 model = inverse(u_viewMatrix) * u_modelviewMatrix;
+    fs_in.PositionWS = vec3(model * vec4(localPos, 1.0));
+    fs_in.PositionVS = vec3(u_modelviewMatrix * vec4(localPos, 1.0));
+    fs_in.NormalVS = normalize(transpose(inverse(mat3(u_modelviewMatrix))) * normal);
+    fs_in.TexCoords = (hit.xz / n).yx * u_textureTiling;
+    fs_in.MaterialIndex = -1;
+
+    // Balls and obstacles composite against the depth of the hit
+    vec4 clip = u_mvpMatrix * vec4(localPos, 1.0);
+    gl_FragDepth = (gl_DepthRange.diff * clip.z / clip.w + gl_DepthRange.near + gl_DepthRange.far) * 0.5;
+    return true;
+}
+
+#endif
+
 /**
  * Model Fragment Shader Main.
- * Extracts the height data based on the fragment world y position, 
+ * Looks up the height band material based on the fragment world y position, 
  * then applies shading.
  */
 void main(void) {
+#ifdef HEIGHTMAP_MARCH
+    if (!marchHeightmap()) {
+        discard;
+    }
+#endif
+
+    // Drawing the shadow cube, only the depth is needed
+    if (u_shadowParams.w > 0.5) {
+        return;
+    }
+
     Material mat;
 
-    if (u_useMaterial) {
-        mat = u_material;
+    if (fs_in.MaterialIndex >= 0) {
+        mat = getMaterial(fs_in.MaterialIndex);
     } else {
-        HeightData data = getHeightData(fs_in.PositionWS.y);
+        mat = getHeightMaterial(fs_in.PositionWS.y);
+
+#ifdef USE_TEXTURE
+        mat.diffuse = texture(u_texture, fs_in.TexCoords).rgb;
+#endif
+    }
+
+    PointLight light = PointLight(
+        u_lightPosVS.xyz, u_lightColor.rgb, u_lightFalloff.xyz, u_lightPosVS.w > 0.5, u_lightColor.w
+    );
 
-        mat = data.mat;
+    vec4 color;
+    if (light.enabled || u_clusterLightCount > 0) {
+        vec3 N = fragmentNormal();
+        vec3 V = normalize(u_camPosVS.xyz - fs_in.PositionVS);
 
-        if (u_useTexture) {
-            mat.diffuse = texture(u_texture, fs_in.TexCoords).rgb;
-        } else {
-            mat.diffuse = data.color;
+        // Without the point light only its ambient term stays
+        vec3 phongColor = light.enabled
+            ? pointLightContribution(light, N, V, fs_in.PositionVS, mat, shadowFactor(fs_in.PositionWS))
+            : mat.ambient * light.ambientFactor;
+        if (u_clusterLightCount > 0) {
+            phongColor += clusterLightsContribution(N, V, fs_in.PositionVS, mat);
         }
+        color = vec4(phongColor, mat.alpha);
+    } else {
+        color = vec4(mat.diffuse, mat.alpha);
+    }
+
+    // Baked occlusion of the surface, the objects on it are not part of the bake
+    if (fs_in.MaterialIndex < 0 && u_aoStrength > 0.0) {
+        float ao = texture(u_aoTexture, fs_in.PositionWS.xz * u_aoTransform.xy + u_aoTransform.zw).r;
+        color.rgb *= mix(1.0, ao, u_aoStrength);
     }
 
-    if (u_pointLight.enabled) {
-        vec3 N = normalize(fs_in.NormalVS);
-        vec3 V = normalize(u_camPosVS - fs_in.PositionVS);
-        vec3 phongColor = pointLightContribution(N, V, fs_in.PositionVS, mat);
-        fragColor = vec4(phongColor, mat.alpha);
+    if (u_oit) {
+        fragColor = vec4(color.rgb * color.a, color.a) * oitWeight(fs_in.PositionVS.z, color.a);
+        fragRevealage = color.a;
     } else {
-        fragColor = vec4(mat.diffuse, mat.alpha);
+        fragColor = color;
     }
 }
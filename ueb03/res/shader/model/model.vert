@@ -4,31 +4,94 @@ layout (location = 0) in vec3 pos;
 layout (location = 1) in vec3 norm;
 layout (location = 2) in vec2 tex;
 
+// Instance: xyz translation, w uniform scale
+layout (location = 3) in vec4 instOffsetScale;
+
+// Instance: xyz scale per axis, the color slot of the simple shader, not set by multi-draws
+layout (location = 4) in vec4 instAxisScale;
+
+// Multi-draw instance: index into the material buffer
+layout (location = 5) in int instMaterial;
+
+uniform bool u_instanced = false;
+uniform bool u_multiDraw = false;
+uniform int u_materialIndex = -1;  // -1: height dependent material
 uniform mat4 u_mvpMatrix;
 uniform mat4 u_modelviewMatrix;
 uniform mat4 u_viewMatrix;
 
+// Compact surface grid: pos.x is the height, norm.xy the octahedral normal
+uniform int u_gridDim = 0;
+uniform vec2 u_gridExtent;
+uniform float u_textureTiling = 1.0;
+
+// Heightmap: heights and derivatives dh/dx, dh/dz per grid vertex, used instead of pos and norm
+uniform bool u_heightmap = false;
+uniform sampler2D u_heightTexture;
+uniform sampler2D u_gradientTexture;
+
 out VS_OUT {
     vec2 TexCoords;
     vec3 PositionWS;
     vec3 NormalVS;
     vec3 PositionVS;
+    flat int MaterialIndex;
 } vs_out;
 
+/**
+ * Decodes a normal folded onto the octahedron.
+ */
+vec3 decodeOctNormal(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 /**
  * Model Vertex Shader Main.
  * Calculates the model and view space position of the vertex and
  * transforms the normal in the view space.
+ * Instanced draws place the vertex with the instance attributes first,
+ * scaled per axis unless multi-drawn,
+ * surface grid vertices are placed by their index. Multi-draws take the
+ * material per instance instead of from the uniform.
  */
 void main(void) {
+    vec3 localPos = pos;
+    vec3 normal = norm;
+    if (u_instanced) {
+        vec3 scale = u_multiDraw ? vec3(instOffsetScale.w) : instAxisScale.xyz * instOffsetScale.w;
+        localPos = pos * scale + instOffsetScale.xyz;
+        normal = norm / scale;
+    }
+    vec2 texCoords = tex;
+
+    if (u_gridDim > 0) {
+        ivec2 cell = ivec2(gl_VertexID % u_gridDim, gl_VertexID / u_gridDim);
+        vec2 uv = vec2(cell) / float(max(u_gridDim - 1, 1));
+        texCoords = uv.yx * u_textureTiling;
+
+        if (u_heightmap) {
+            float height = texelFetch(u_heightTexture, cell, 0).r;
+            vec2 gradient = texelFetch(u_gradientTexture, cell, 0).rg;
+            localPos = vec3(uv.x * u_gridExtent.x, height, uv.y * u_gridExtent.y);
+            normal = normalize(vec3(-gradient.x, 1.0, -gradient.y));
+        } else {
+            localPos = vec3(uv.x * u_gridExtent.x, pos.x, uv.y * u_gridExtent.y);
+            normal = decodeOctNormal(norm.xy);
+        }
+    }
+
     mat4 viewInverse = inverse(u_viewMatrix);
     mat4 model = viewInverse * u_modelviewMatrix;
-    vs_out.PositionWS = vec3(model * vec4(pos, 1.0));
-    vs_out.TexCoords = tex;
-    vs_out.PositionVS = vec3(u_modelviewMatrix * vec4(pos, 1.0));
+    vs_out.PositionWS = vec3(model * vec4(localPos, 1.0));
+    vs_out.TexCoords = texCoords;
+    vs_out.PositionVS = vec3(u_modelviewMatrix * vec4(localPos, 1.0));
 
     mat3 normalMatrix = transpose(inverse(mat3(u_modelviewMatrix)));
-    vs_out.NormalVS = normalize(normalMatrix * norm);
+    vs_out.NormalVS = normalize(normalMatrix * normal);
+    vs_out.MaterialIndex = u_multiDraw ? instMaterial : u_materialIndex;
 
-    gl_Position = u_mvpMatrix * vec4(pos, 1);
+    gl_Position = u_mvpMatrix * vec4(localPos, 1);
 }
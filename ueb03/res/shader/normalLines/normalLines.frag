@@ -0,0 +1,12 @@
+#version 430
+
+uniform vec3 u_color = vec3(1, 0, 0);
+
+out vec4 fragColor;
+
+/**
+ * Normal Lines Fragment Shader with a uniform color as output.
+ */
+void main(void) {
+    fragColor = vec4(u_color, 1.0);
+}
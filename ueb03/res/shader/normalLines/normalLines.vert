@@ -0,0 +1,20 @@
+#version 430
+
+layout (location = 0) in vec4 pos;      // w: 0 at the base, 1 at the tip
+layout (location = 1) in vec4 normal;
+
+uniform mat4 u_modelViewMatrix;
+uniform mat4 u_normalMatrix;
+uniform mat4 u_projMatrix;
+uniform float u_normalLength = 0.1;
+
+/**
+ * Normal Lines Vertex Shader.
+ * Moves the tip of every line along the view space normal,
+ * so the lines have the same length on every model.
+ */
+void main(void) {
+    vec3 posVS = vec3(u_modelViewMatrix * vec4(pos.xyz, 1));
+    vec3 normalVS = normalize(vec3(u_normalMatrix * vec4(normal.xyz, 0)));
+    gl_Position = u_projMatrix * vec4(posVS + normalVS * u_normalLength * pos.w, 1);
+}
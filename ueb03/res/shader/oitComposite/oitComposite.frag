@@ -0,0 +1,28 @@
+#version 430 core
+
+uniform sampler2D u_accum;      // weighted premultiplied colors, w: weighted alphas
+uniform sampler2D u_revealage;  // product of the transmissions
+
+out vec4 fragColor;
+
+/**
+ * Composites the weighted blended transparency over the scene, blended
+ * with the total coverage as alpha. Pixels without transparency are kept.
+ */
+void main(void) {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float revealage = texelFetch(u_revealage, texel, 0).r;
+    if (revealage >= 1.0) {
+        discard;
+    }
+
+    vec4 accum = texelFetch(u_accum, texel, 0);
+
+    // Many bright layers can overflow the half floats
+    if (isinf(max(max(abs(accum.r), abs(accum.g)), abs(accum.b)))) {
+        accum.rgb = vec3(accum.a);
+    }
+
+    vec3 average = accum.rgb / clamp(accum.a, 1e-4, 5e4);
+    fragColor = vec4(average, 1.0 - revealage);
+}
@@ -1,12 +1,15 @@
 #version 430
 
 uniform vec3 u_color = vec3(1, 1, 1); 
+uniform bool u_instanced = false;
 
+in vec3 vColor;
 out vec4 fragColor;
 
 /**
  * Simple Fragment Shader with a uniform color as output.
+ * Instanced draws use the color of their instance instead.
  */ 
 void main(void) {
-    fragColor = vec4(u_color, 1.0);
+    fragColor = vec4(u_instanced ? vColor : u_color, 1.0);
 }
\ No newline at end of file
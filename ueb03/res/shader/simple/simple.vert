@@ -4,11 +4,21 @@ layout (location = 0) in vec3 pos;
 layout (location = 1) in vec3 norm;
 layout (location = 2) in vec2 tex;
 
+// Instance: xyz translation, w uniform scale
+layout (location = 3) in vec4 instOffsetScale;
+layout (location = 4) in vec4 instColor;
+
+uniform bool u_instanced = false;
 uniform mat4 u_mvpMatrix;
 
+out vec3 vColor;
+
 /**
  * Simple Vertex Shader, transforms the vertex with the mvp-matrix.
+ * Instanced draws place the vertex and pick the color per instance.
  */
 void main(void) {
-    gl_Position = u_mvpMatrix * vec4(pos, 1);
+    vec3 localPos = u_instanced ? pos * instOffsetScale.w + instOffsetScale.xyz : pos;
+    vColor = instColor.rgb;
+    gl_Position = u_mvpMatrix * vec4(localPos, 1);
 }
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 430
+
+flat out int vPatch;
+
+/**
+ * Surface Tessellation Vertex Shader Main.
+ * Each patch is drawn as a single vertex, its index selects the coefficients.
+ */
+void main(void) {
+    vPatch = gl_VertexID;
+}
@@ -0,0 +1,34 @@
+#version 430 core
+
+uniform sampler2D u_scene;
+uniform vec2 u_uvScale;     // drawn part of the target in uv
+uniform vec2 u_texelSize;   // one texel of the target in uv
+uniform float u_sharpness = 0.0;
+
+in vec2 uv;
+out vec4 fragColor;
+
+/**
+ * Samples the drawn part of the target, clamped half a texel inside so the
+ * bilinear filter never reads the undrawn rest.
+ */
+vec3 fetch(vec2 st) {
+    return texture(u_scene, clamp(st, 0.5 * u_texelSize, u_uvScale - 0.5 * u_texelSize)).rgb;
+}
+
+/**
+ * Bilinear upscale of the scene with an optional unsharp mask against the
+ * four neighbors one source texel away.
+ */
+void main(void) {
+    vec2 st = uv * u_uvScale;
+    vec3 color = fetch(st);
+
+    if (u_sharpness > 0.0) {
+        vec3 blur = 0.25 * (fetch(st + vec2(u_texelSize.x, 0.0)) + fetch(st - vec2(u_texelSize.x, 0.0))
+                          + fetch(st + vec2(0.0, u_texelSize.y)) + fetch(st - vec2(0.0, u_texelSize.y)));
+        color = clamp(color + u_sharpness * (color - blur), 0.0, 1.0);
+    }
+
+    fragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,13 @@
+#version 430 core
+
+out vec2 uv;
+
+/**
+ * Fullscreen triangle from the vertex id, no vertex buffer needed.
+ * The triangle covers [0, 2] in uv, everything beyond 1 is clipped.
+ */
+void main(void) {
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    uv = pos;
+    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
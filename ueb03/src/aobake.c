@@ -0,0 +1,165 @@
+/**
+ * @file aobake.c
+ * @brief Implementation of the baked surface occlusion
+ *
+ * The samples are evenly spaced on both axes, so the grid offsets of all
+ * horizon lookups and their distances are computed once per bake and
+ * shared by every sample. Lookups leaving the grid end their direction.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "aobake.h"
+#include "jobs.h"
+#include "alloctrack.h"
+#include "timeline.h"
+
+#define AOBAKE_ROWS_PER_CHUNK 8
+
+/**
+ * One horizon lookup relative to the sample.
+ */
+typedef struct {
+    int dRow, dCol;
+    float invDist;      // 1 / world distance in the xz plane
+} HorizonTap;
+
+/**
+ * Input of the parallel bake.
+ */
+typedef struct {
+    AoBake *bake;
+    int firstCol, lastCol;
+    int firstRow;
+    HorizonTap taps[AOBAKE_DIRECTIONS][AOBAKE_STEPS];
+    int tapCount[AOBAKE_DIRECTIONS];
+} BakeJob;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Rounds the lookups of all directions to the grid. Lookups rounding to
+ * the sample itself or to the previous lookup are dropped.
+ * @param job Bake job, the bake must be resized.
+ */
+static void buildTaps(BakeJob *job) {
+    float cellX = job->bake->extent[0] / (job->bake->gridSize - 1);
+    float cellZ = job->bake->extent[1] / (job->bake->gridSize - 1);
+
+    for (int d = 0; d < AOBAKE_DIRECTIONS; ++d) {
+        float angle = 2.0f * GLM_PIf * d / AOBAKE_DIRECTIONS;
+        float dirX = cosf(angle);
+        float dirZ = sinf(angle);
+        job->tapCount[d] = 0;
+
+        for (int k = 1; k <= AOBAKE_STEPS; ++k) {
+            float r = AOBAKE_RADIUS * k / AOBAKE_STEPS;
+            int dCol = (int) roundf(dirX * r / cellX);
+            int dRow = (int) roundf(dirZ * r / cellZ);
+            int n = job->tapCount[d];
+            if ((dCol == 0 && dRow == 0) ||
+                (n > 0 && job->taps[d][n - 1].dCol == dCol && job->taps[d][n - 1].dRow == dRow)) {
+                continue;
+            }
+
+            float dist = sqrtf((dCol * cellX) * (dCol * cellX) + (dRow * cellZ) * (dRow * cellZ));
+            job->taps[d][n] = (HorizonTap) { dRow, dCol, 1.0f / dist };
+            ++job->tapCount[d];
+        }
+    }
+}
+
+/**
+ * Bakes the occlusion of a chunk of rows.
+ * @param begin First row relative to the first rebaked row.
+ * @param end One past the last row.
+ * @param chunk Unused.
+ * @param userData The BakeJob.
+ */
+static void bakeRowsJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    const BakeJob *job = userData;
+    const AoBake *bake = job->bake;
+    int size = bake->gridSize;
+
+    for (int i = job->firstRow + begin; i < job->firstRow + end; ++i) {
+        for (int j = job->firstCol; j <= job->lastCol; ++j) {
+            float h0 = bake->heights[i * size + j];
+            float occlusion = 0.0f;
+
+            for (int d = 0; d < AOBAKE_DIRECTIONS; ++d) {
+                float maxTan = 0.0f;
+                for (int k = 0; k < job->tapCount[d]; ++k) {
+                    const HorizonTap *tap = &job->taps[d][k];
+                    int row = i + tap->dRow;
+                    int col = j + tap->dCol;
+                    if (row < 0 || row >= size || col < 0 || col >= size) break;
+                    maxTan = fmaxf(maxTan, (bake->heights[row * size + col] - h0) * tap->invDist);
+                }
+                // Sine of the horizon elevation
+                occlusion += maxTan / sqrtf(1.0f + maxTan * maxTan);
+            }
+
+            float ao = 1.0f - occlusion / AOBAKE_DIRECTIONS;
+            bake->ao[i * size + j] = (uint8_t) (ao * 255.0f + 0.5f);
+        }
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void aobake_resize(AoBake *bake, int gridSize, float extentX, float extentZ) {
+    assert(gridSize >= 2 && "grid too small in aobake_resize");
+    int count = gridSize * gridSize;
+    if (count > bake->capacity) {
+        float *heights = TRACKED_REALLOC(bake->heights, count * sizeof(float));
+        uint8_t *ao = TRACKED_REALLOC(bake->ao, count * sizeof(uint8_t));
+        assert(heights && ao && "realloc failed in aobake_resize");
+        bake->heights = heights;
+        bake->ao = ao;
+        bake->capacity = count;
+    }
+    bake->gridSize = gridSize;
+    bake->extent[0] = extentX;
+    bake->extent[1] = extentZ;
+}
+
+void aobake_free(AoBake *bake) {
+    TRACKED_FREE(bake->heights);
+    TRACKED_FREE(bake->ao);
+    *bake = (AoBake) {0};
+}
+
+void aobake_update(AoBake *bake, const Vertex *vertices, int firstS, int lastS, int firstT, int lastT,
+                   int rebaked[4]) {
+    TIMELINE_BEGIN("Bake AO");
+    int size = bake->gridSize;
+    int width = lastT - firstT + 1;
+    for (int i = firstS; i <= lastS; ++i) {
+        const Vertex *row = &vertices[(i - firstS) * width];
+        for (int j = firstT; j <= lastT; ++j) {
+            bake->heights[i * size + j] = row[j - firstT].position[1];
+        }
+    }
+
+    // Samples within the radius of a changed height see it as their horizon
+    int reachX = (int) ceilf(AOBAKE_RADIUS * (size - 1) / bake->extent[0]);
+    int reachZ = (int) ceilf(AOBAKE_RADIUS * (size - 1) / bake->extent[1]);
+    int firstRow = glm_max(firstS - reachZ, 0);
+    int lastRow = glm_min(lastS + reachZ, size - 1);
+
+    BakeJob job = {
+        .bake = bake,
+        .firstCol = glm_max(firstT - reachX, 0),
+        .lastCol = glm_min(lastT + reachX, size - 1),
+        .firstRow = firstRow
+    };
+    buildTaps(&job);
+    jobs_parallelFor(lastRow - firstRow + 1, AOBAKE_ROWS_PER_CHUNK, bakeRowsJob, &job);
+
+    rebaked[0] = job.firstCol;
+    rebaked[1] = firstRow;
+    rebaked[2] = job.lastCol - job.firstCol + 1;
+    rebaked[3] = lastRow - firstRow + 1;
+    TIMELINE_END();
+}
@@ -0,0 +1,74 @@
+/**
+ * @file aobake.h
+ * @brief Ambient occlusion of the surface baked from its height grid
+ *
+ * Every sample of the regular surface grid searches AOBAKE_DIRECTIONS
+ * directions for the highest horizon within AOBAKE_RADIUS. The sine of
+ * the horizon elevation is the share of the hemisphere blocked in that
+ * direction, the occlusion is its mean over all directions. Rows are
+ * baked in parallel on the job pool.
+ *
+ * A local edit only rebakes the changed rectangle grown by the search
+ * radius, the samples outside cannot see a changed height.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef AOBAKE_H
+#define AOBAKE_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Horizon search directions per sample */
+#define AOBAKE_DIRECTIONS 8
+
+/** Height lookups per direction, evenly spaced up to the radius */
+#define AOBAKE_STEPS 6
+
+/** Reach of the horizon search in world units */
+#define AOBAKE_RADIUS 0.4f
+
+/**
+ * Height grid and the occlusion baked from it, both row-major with the
+ * rows along z like the surface vertices.
+ */
+typedef struct {
+    float *heights;
+    uint8_t *ao;        // 255 is unoccluded
+    int capacity;
+    int gridSize;
+    vec2 extent;        // x and z of the last sample, the first one is at the origin
+} AoBake;
+
+/**
+ * Resizes the grids to gridSize×gridSize samples spread over the extent.
+ * Keeps the contents if the size did not change, otherwise they are
+ * undefined until the whole grid was updated.
+ * @param bake Bake to resize.
+ * @param gridSize Samples per axis, at least 2.
+ * @param extentX x of the last sample column.
+ * @param extentZ z of the last sample row.
+ */
+void aobake_resize(AoBake *bake, int gridSize, float extentX, float extentZ);
+
+/**
+ * Frees the grids.
+ * @param bake Bake to free.
+ */
+void aobake_free(AoBake *bake);
+
+/**
+ * Takes the heights of a rectangle of samples and rebakes the occlusion
+ * they influence.
+ * @param bake Bake, resized to the surface grid.
+ * @param vertices Sampled rectangle, row-major.
+ * @param firstS First sample row of the rectangle.
+ * @param lastS Last sample row (inclusive).
+ * @param firstT First sample column of the rectangle.
+ * @param lastT Last sample column (inclusive).
+ * @param rebaked Output: x, y, width and height of the rebaked samples.
+ */
+void aobake_update(AoBake *bake, const Vertex *vertices, int firstS, int lastS, int firstT, int lastT,
+                   int rebaked[4]);
+
+#endif // AOBAKE_H
@@ -0,0 +1,374 @@
+/**
+ * @file ballcompute.c
+ * @brief Implementation of the GPU ball physics
+ *
+ * The balls live in two storage buffers, every step reads one and writes
+ * the other. The surface is the heightmap baked by model.c, sampled
+ * bilinearly instead of projecting onto the spline. Ball-ball contacts use
+ * a hashed grid rebuilt by counting sort every step: count per cell,
+ * scan the counts with gpuprim_scan, scatter the ball indices.
+ * Captures and the goal are atomic counters, read back through a fenced
+ * copy a frame later, so stepping never waits on the GPU.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "ballcompute.h"
+#include "model.h"
+#include "shader.h"
+#include "gpumem.h"
+#include "gpuprim.h"
+
+/** Must match GROUP_SIZE in ballPhysics.comp */
+#define GROUP_SIZE 256
+
+/** Passes of ballPhysics.comp */
+#define PASS_COUNT 0
+#define PASS_SCATTER 1
+#define PASS_STEP 2
+
+/** Collision bits of the uniform block */
+#define ENABLE_BALLS 1
+#define ENABLE_WALLS 2
+#define ENABLE_OBSTACLES 4
+
+/** Bounds of the hash table size, a power of two */
+#define MIN_TABLE_SIZE GROUP_SIZE
+#define MAX_TABLE_SIZE (1 << 20)
+
+/** Buffer bindings, must match ballPhysics.comp */
+#define BINDING_BALLS_IN 0
+#define BINDING_BALLS_OUT 1
+#define BINDING_CELL_START 2
+#define BINDING_CELL_CURSOR 3
+#define BINDING_SORTED 4
+#define BINDING_EVENTS 5
+#define BINDING_PARAMS 2
+
+/**
+ * Uniform block of ballPhysics.comp, std140 layout.
+ */
+typedef struct {
+    vec4 gravity;       // xyz gravity, w fixed dt
+    vec4 goal;          // xyz goal position, w goal radius
+    vec4 bounds;        // xy surface extent, zw wall position in x and z
+    vec4 material;      // x mass, y ball radius, z friction factor, w grid cell size
+    vec4 springs;       // x ball, y wall, z obstacle, w black hole strength
+    vec4 dampings;      // x ball, y wall, z obstacle, w black hole radius
+    vec4 capture;       // x capture radius, y black hole reach
+    GLint counts[4];    // x balls, y hash table size, z black holes, w obstacles
+    GLint options[4];   // x enabled collisions
+    vec4 blackHoles[BALLCOMPUTE_MAX_BLACK_HOLES];
+    vec4 obstacleCenters[BALLCOMPUTE_MAX_OBSTACLES];
+    vec4 obstacleExtents[BALLCOMPUTE_MAX_OBSTACLES];
+} BallParams;
+
+/**
+ * Event counters, std430 layout of ballPhysics.comp.
+ */
+typedef struct {
+    GLuint captured;
+    GLuint goalReached;
+} BallEvents;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * GPU simulation state.
+ */
+static struct {
+    GLuint balls[2];
+    int current;        // buffer with the balls of the last step
+    int count;
+    int capacity;
+
+    GLuint cellStart;
+    GLuint cellCursor;
+    GLuint sorted;
+    int tableSize;
+
+    GLuint events;
+    GLuint params;
+    bool collideBalls;
+
+    // Fenced copy of the event counters, read once the GPU is done
+    GLuint readback;
+    GLsync readbackFence;
+} g_state = { 0 };
+
+/**
+ * Returns the number of work groups needed for the given ball count.
+ * @param count Number of balls.
+ * @return Number of work groups.
+ */
+static int numGroups(int count) {
+    return (count + GROUP_SIZE - 1) / GROUP_SIZE;
+}
+
+/**
+ * (Re)allocates a storage buffer with optional initial data.
+ * @param buffer Buffer name.
+ * @param size Size in bytes.
+ * @param data Initial contents or NULL.
+ */
+static void allocBuffer(GLuint buffer, GLsizeiptr size, const void *data) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_DYNAMIC_COPY);
+    gpumem_setBuffer(GPUMEM_COMPUTE, buffer, (size_t) size);
+}
+
+/**
+ * Grows the ball and grid buffers to hold at least count balls.
+ * The hash table has about one entry per ball.
+ * Contents are undefined after growing.
+ * @param count Number of balls.
+ */
+static void ensureCapacity(int count) {
+    int tableSize = MIN_TABLE_SIZE;
+    while (tableSize < count && tableSize < MAX_TABLE_SIZE) {
+        tableSize *= 2;
+    }
+    if (tableSize != g_state.tableSize) {
+        allocBuffer(g_state.cellStart, (tableSize + 1) * sizeof(GLuint), NULL);
+        allocBuffer(g_state.cellCursor, (tableSize + 1) * sizeof(GLuint), NULL);
+        g_state.tableSize = tableSize;
+    }
+
+    if (count <= g_state.capacity) {
+        return;
+    }
+
+    int capacity = glm_imax(count, g_state.capacity * 2);
+    allocBuffer(g_state.balls[0], capacity * sizeof(GpuBall), NULL);
+    allocBuffer(g_state.balls[1], capacity * sizeof(GpuBall), NULL);
+    allocBuffer(g_state.sorted, capacity * sizeof(GLuint), NULL);
+    g_state.capacity = capacity;
+}
+
+/**
+ * Drops a queued event copy, it counts events of replaced balls.
+ */
+static void dropReadback(void) {
+    if (g_state.readbackFence) {
+        glDeleteSync(g_state.readbackFence);
+        g_state.readbackFence = NULL;
+    }
+}
+
+/**
+ * Runs one pass over all balls and makes its writes visible to the next pass.
+ * @param pass Pass of ballPhysics.comp.
+ * @param groups Number of work groups.
+ * @param barriers Barrier bits after the pass.
+ */
+static void dispatchPass(int pass, int groups, GLbitfield barriers) {
+    shader_setBallPhysicsPass(pass);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(barriers);
+}
+
+/**
+ * Binds the buffers of ballPhysics.comp.
+ */
+static void bindBuffers(void) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_BALLS_IN, g_state.balls[g_state.current]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_BALLS_OUT, g_state.balls[1 - g_state.current]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_CELL_START, g_state.cellStart);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_CELL_CURSOR, g_state.cellCursor);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_SORTED, g_state.sorted);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_EVENTS, g_state.events);
+    glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_PARAMS, g_state.params);
+}
+
+/**
+ * Turns the counts per cell into cell starts and scatter cursors.
+ * The counts have a trailing 0, so the scan ends with the ball count.
+ * Without the scan program every cell stays empty.
+ */
+static void buildCellStarts(void) {
+    if (!gpuprim_scan(g_state.cellCursor, g_state.cellStart, g_state.tableSize + 1)) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_state.cellStart);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, g_state.cellStart);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, g_state.cellCursor);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, g_state.tableSize * sizeof(GLuint));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void ballcompute_init(void) {
+    glGenBuffers(2, g_state.balls);
+    glGenBuffers(1, &g_state.cellStart);
+    glGenBuffers(1, &g_state.cellCursor);
+    glGenBuffers(1, &g_state.sorted);
+    g_state.capacity = 0;
+    g_state.tableSize = 0;
+    g_state.count = 0;
+
+    glGenBuffers(1, &g_state.events);
+    allocBuffer(g_state.events, sizeof(BallEvents), NULL);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenBuffers(1, &g_state.params);
+    glBindBuffer(GL_UNIFORM_BUFFER, g_state.params);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(BallParams), NULL, GL_DYNAMIC_DRAW);
+    gpumem_setBuffer(GPUMEM_UNIFORMS, g_state.params, sizeof(BallParams));
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glGenBuffers(1, &g_state.readback);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, g_state.readback);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(BallEvents), NULL, GL_STREAM_READ);
+    gpumem_setBuffer(GPUMEM_STAGING, g_state.readback, sizeof(BallEvents));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    g_state.readbackFence = NULL;
+}
+
+void ballcompute_cleanup(void) {
+    gpumem_deleteBuffers(2, g_state.balls);
+    gpumem_deleteBuffers(1, &g_state.cellStart);
+    gpumem_deleteBuffers(1, &g_state.cellCursor);
+    gpumem_deleteBuffers(1, &g_state.sorted);
+    gpumem_deleteBuffers(1, &g_state.events);
+    gpumem_deleteBuffers(1, &g_state.params);
+    dropReadback();
+    gpumem_deleteBuffers(1, &g_state.readback);
+    memset(&g_state, 0, sizeof(g_state));
+}
+
+void ballcompute_upload(int count, const GpuBall *balls) {
+    ensureCapacity(count);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_state.balls[0]);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(GpuBall), balls);
+    BallEvents events = { 0 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_state.events);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(events), &events);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    g_state.current = 0;
+    g_state.count = count;
+    dropReadback();
+}
+
+void ballcompute_download(int count, GpuBall *dest) {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_state.balls[g_state.current]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(GpuBall), dest);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+bool ballcompute_setParams(InputData *data, vec3 *blackHoles, int blackHoleCount,
+                           vec3 goal, float goalRadius, vec2 walls) {
+    float radius = data->physics.ballRadius;
+    BallParams p = { 0 };
+
+    vec2 extent;
+    if (!model_bindHeightmap(extent) || !shader_setBallPhysicsPass(PASS_STEP)) {
+        return false;
+    }
+
+    glm_vec4((vec3) { 0.0f, -data->physics.gravity, 0.0f }, data->physics.fixedDt, p.gravity);
+    glm_vec4(goal, goalRadius, p.goal);
+    p.bounds[0] = extent[0];
+    p.bounds[1] = extent[1];
+    p.bounds[2] = walls[0];
+    p.bounds[3] = walls[1];
+    glm_vec4_copy((vec4) { data->physics.mass, radius, data->physics.frictionFactor, 2.0f * radius }, p.material);
+    glm_vec4_copy((vec4) { data->physics.ball.spring, data->physics.wall.spring,
+                           data->physics.obs.spring, data->physics.blackHoleStrength }, p.springs);
+    glm_vec4_copy((vec4) { data->physics.ball.damping, data->physics.wall.damping,
+                           data->physics.obs.damping, data->physics.blackHoleRadius }, p.dampings);
+    p.capture[0] = data->physics.blackHoleCaptureRadius;
+    p.capture[1] = fmaxf(data->physics.blackHoleRadius, data->physics.blackHoleCaptureRadius);
+
+    p.counts[0] = g_state.count;
+    p.counts[1] = g_state.tableSize;
+    p.counts[2] = glm_imin(blackHoleCount, BALLCOMPUTE_MAX_BLACK_HOLES);
+    p.counts[3] = data->physics.obs.enabled ? glm_imin((int) data->game.obstacles.size, BALLCOMPUTE_MAX_OBSTACLES) : 0;
+
+    p.options[0] = (data->physics.ball.enabled ? ENABLE_BALLS : 0)
+        | (data->physics.wall.enabled ? ENABLE_WALLS : 0)
+        | (data->physics.obs.enabled ? ENABLE_OBSTACLES : 0);
+    g_state.collideBalls = data->physics.ball.enabled;
+
+    for (int i = 0; i < p.counts[2]; ++i) {
+        glm_vec4(blackHoles[i], 0.0f, p.blackHoles[i]);
+    }
+    for (int i = 0; i < p.counts[3]; ++i) {
+        Obstacle *o = &data->game.obstacles.data[i];
+        glm_vec4(o->center, 0.0f, p.obstacleCenters[i]);
+        glm_vec4_copy((vec4) { o->length, o->height, o->width, 0.0f }, p.obstacleExtents[i]);
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, g_state.params);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(p), &p);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return true;
+}
+
+void ballcompute_step(void) {
+    if (g_state.count == 0) {
+        return;
+    }
+
+    bindBuffers();
+
+    int groups = numGroups(g_state.count);
+    if (g_state.collideBalls) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_state.cellCursor);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        dispatchPass(PASS_COUNT, groups, GL_SHADER_STORAGE_BARRIER_BIT);
+        buildCellStarts();
+
+        // The scan changed the program and bindings
+        bindBuffers();
+        dispatchPass(PASS_SCATTER, groups, GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    dispatchPass(PASS_STEP, groups, GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    g_state.current = 1 - g_state.current;
+}
+
+bool ballcompute_readEvents(int *captured, bool *goalReached) {
+    bool read = false;
+    if (g_state.readbackFence) {
+        GLenum res = glClientWaitSync(g_state.readbackFence, 0, 0);
+        if (res == GL_TIMEOUT_EXPIRED) {
+            return false;
+        }
+
+        BallEvents events;
+        glBindBuffer(GL_COPY_READ_BUFFER, g_state.readback);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(events), &events);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        *captured = (int) events.captured;
+        *goalReached = events.goalReached != 0;
+        read = true;
+        dropReadback();
+    }
+
+    // Queue the copy of this frame
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, g_state.events);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, g_state.readback);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(BallEvents));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    g_state.readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return read;
+}
+
+GLuint ballcompute_getBallBuffer(void) {
+    return g_state.balls[g_state.current];
+}
@@ -0,0 +1,92 @@
+/**
+ * @file ballcompute.h
+ * @brief GPU ball physics on the surface heightmap using compute shaders
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef BALLCOMPUTE_H
+#define BALLCOMPUTE_H
+
+#include <fhwcg/fhwcg.h>
+#include "input.h"
+
+/** Black holes in the uniform block, further ones are ignored. Must match ballPhysics.comp */
+#define BALLCOMPUTE_MAX_BLACK_HOLES 32
+
+/** Obstacles in the uniform block. Must match ballPhysics.comp */
+#define BALLCOMPUTE_MAX_OBSTACLES 8
+
+/**
+ * Ball record of the storage buffers, std430 layout of ballPhysics.comp.
+ * center is also the instance translation and scale of the ball draw.
+ */
+typedef struct {
+    vec4 center;        // w: radius, 0 once captured
+    vec4 velocity;
+    vec4 contact;       // contact point on the surface
+    vec4 normal;        // surface normal at the contact point
+} GpuBall;
+
+/**
+ * Creates the ball, grid and parameter buffers.
+ */
+void ballcompute_init(void);
+
+/**
+ * Frees all buffers.
+ */
+void ballcompute_cleanup(void);
+
+/**
+ * Replaces the simulated balls and resets the event counters.
+ * @param count Number of balls.
+ * @param balls Ball records.
+ */
+void ballcompute_upload(int count, const GpuBall *balls);
+
+/**
+ * Reads all balls of the last step back, captured ones included.
+ * @param count Number of balls, as uploaded.
+ * @param dest Destination for the ball records.
+ */
+void ballcompute_download(int count, GpuBall *dest);
+
+/**
+ * Uploads the parameters of the next steps and binds the surface heightmap,
+ * rebaked first if the surface changed. Call once per frame before stepping.
+ * @param data Input data containing the physics and obstacles.
+ * @param blackHoles Black hole positions, at most BALLCOMPUTE_MAX_BLACK_HOLES are used.
+ * @param blackHoleCount Number of black holes.
+ * @param goal Goal position.
+ * @param goalRadius Goal radius.
+ * @param walls Position of the far walls in x and z, the near walls are at 0.
+ * @return False if there is no heightmap to sample or no shader.
+ */
+bool ballcompute_setParams(InputData *data, vec3 *blackHoles, int blackHoleCount,
+                           vec3 goal, float goalRadius, vec2 walls);
+
+/**
+ * Runs one fixed step: builds the ball grid by counting sort and steps all balls.
+ * Only valid after ballcompute_setParams succeeded in this frame.
+ */
+void ballcompute_step(void);
+
+/**
+ * Reads the event counters without a sync point.
+ * Queues a fenced copy and returns the copy queued in an earlier call once
+ * the GPU is done with it, so the events are usually one frame old.
+ * Call once per frame.
+ * @param captured Destination for the balls captured since the upload.
+ * @param goalReached Destination for whether a ball reached the goal since the upload.
+ * @return False if no copy is done yet, the destinations are untouched.
+ */
+bool ballcompute_readEvents(int *captured, bool *goalReached);
+
+/**
+ * Returns the buffer holding the balls of the last step, e.g. as instance data.
+ * @return Buffer with GpuBall records.
+ */
+GLuint ballcompute_getBallBuffer(void);
+
+#endif // BALLCOMPUTE_H
@@ -0,0 +1,443 @@
+/**
+ * @file decimate.c
+ * @brief Implementation of the quadric error simplification
+ *
+ * Every vertex carries the sum of the area weighted plane quadrics of its
+ * triangles. An interior vertex u knows its cheapest valid collapse onto a
+ * neighbour v, the error of the summed quadrics at v, and sits with that
+ * error in an indexed min-heap. A collapse only changes the triangles
+ * around v, so afterwards only v and its neighbours are re-evaluated.
+ *
+ * The triangles of a vertex are a linked list of corners, collapses move
+ * the corners of u to v and drop the corners of removed triangles.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "decimate.h"
+#include "alloctrack.h"
+
+/**
+ * Symmetric 4x4 quadric of a sum of planes (a, b, c, d):
+ * aa ab ac ad bb bc bd cc cd dd.
+ */
+typedef struct {
+    double q[10];
+} Quadric;
+
+/**
+ * Working state of one chunk.
+ */
+typedef struct {
+    int w, h;               // vertices per row and rows of the chunk
+    int numVerts, numTris;
+    int aliveTris;
+
+    vec3 *pos;              // chunk local positions
+    Quadric *quadrics;
+    int *tri;               // three vertices per triangle
+    bool *alive;            // per triangle
+    int *first;             // first corner of every vertex, -1 for none
+    int *next;              // next corner of the same vertex
+    bool *locked;           // border vertices and collapsed ones
+    int *target;            // cheapest valid collapse of every vertex
+    int *visited;           // stamp of the last visit, skips repeated neighbours
+    int *neighbours;        // scratch of collapse
+    int stamp;
+
+    float *cost;            // indexed min-heap of the vertices with a target
+    int *heap;
+    int *heapPos;           // position in the heap, -1 if not in it
+    int heapSize;
+} DecimateMesh;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Adds a plane to a quadric.
+ * @param q Quadric.
+ * @param n Unit normal of the plane.
+ * @param d Offset of the plane, n·p + d = 0 on it.
+ * @param weight Weight of the plane.
+ */
+static void quadricAddPlane(Quadric *q, const double n[3], double d, double weight) {
+    const double p[4] = { n[0], n[1], n[2], d };
+    int k = 0;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = i; j < 4; ++j) {
+            q->q[k++] += weight * p[i] * p[j];
+        }
+    }
+}
+
+/**
+ * Evaluates the summed error of two quadrics at a point.
+ * @param a First quadric.
+ * @param b Second quadric.
+ * @param p Point.
+ * @return Sum of the weighted squared plane distances.
+ */
+static double quadricError(const Quadric *a, const Quadric *b, const vec3 p) {
+    double q[10];
+    for (int k = 0; k < 10; ++k) {
+        q[k] = a->q[k] + b->q[k];
+    }
+    double x = p[0], y = p[1], z = p[2];
+    return x * (q[0] * x + 2.0 * (q[1] * y + q[2] * z + q[3]))
+         + y * (q[4] * y + 2.0 * (q[5] * z + q[6]))
+         + z * (q[7] * z + 2.0 * q[8])
+         + q[9];
+}
+
+/**
+ * Orientation of a triangle in the x/z grid plane, exact on grid coordinates.
+ * @param m Mesh.
+ * @param a First vertex.
+ * @param b Second vertex.
+ * @param c Third vertex.
+ * @return Twice the signed area, negative for the winding of the surface.
+ */
+static int orientation(const DecimateMesh *m, int a, int b, int c) {
+    int ax = a % m->w, az = a / m->w;
+    int bx = b % m->w, bz = b / m->w;
+    int cx = c % m->w, cz = c / m->w;
+    return (bx - ax) * (cz - az) - (bz - az) * (cx - ax);
+}
+
+/**
+ * Checks whether the triangle of a corner still contains a vertex.
+ * @param m Mesh.
+ * @param t Triangle.
+ * @param v Vertex.
+ * @return True if v is one of its corners.
+ */
+static bool triangleHas(const DecimateMesh *m, int t, int v) {
+    return m->tri[3 * t] == v || m->tri[3 * t + 1] == v || m->tri[3 * t + 2] == v;
+}
+
+/**
+ * Checks that moving u onto v flips or flattens none of the remaining
+ * triangles of u, so v lies in the kernel of the star of u.
+ * @param m Mesh.
+ * @param u Removed vertex.
+ * @param v Kept vertex.
+ * @return True if the collapse keeps a valid triangulation.
+ */
+static bool collapseValid(const DecimateMesh *m, int u, int v) {
+    for (int c = m->first[u]; c >= 0; c = m->next[c]) {
+        int t = c / 3;
+        if (!m->alive[t] || triangleHas(m, t, v)) {
+            continue;
+        }
+        int k[3] = { m->tri[3 * t], m->tri[3 * t + 1], m->tri[3 * t + 2] };
+        k[c % 3] = v;
+        if (orientation(m, k[0], k[1], k[2]) >= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Swaps two heap entries.
+ * @param m Mesh.
+ * @param i First position.
+ * @param j Second position.
+ */
+static void heapSwap(DecimateMesh *m, int i, int j) {
+    int a = m->heap[i], b = m->heap[j];
+    m->heap[i] = b;
+    m->heap[j] = a;
+    m->heapPos[b] = i;
+    m->heapPos[a] = j;
+}
+
+/**
+ * Restores the heap order around a position.
+ * @param m Mesh.
+ * @param i Position of a changed entry.
+ */
+static void heapFix(DecimateMesh *m, int i) {
+    while (i > 0 && m->cost[m->heap[i]] < m->cost[m->heap[(i - 1) / 2]]) {
+        heapSwap(m, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    for (;;) {
+        int smallest = i;
+        int l = 2 * i + 1, r = l + 1;
+        if (l < m->heapSize && m->cost[m->heap[l]] < m->cost[m->heap[smallest]]) smallest = l;
+        if (r < m->heapSize && m->cost[m->heap[r]] < m->cost[m->heap[smallest]]) smallest = r;
+        if (smallest == i) {
+            return;
+        }
+        heapSwap(m, i, smallest);
+        i = smallest;
+    }
+}
+
+/**
+ * Removes a vertex from the heap if it is in it.
+ * @param m Mesh.
+ * @param v Vertex.
+ */
+static void heapRemove(DecimateMesh *m, int v) {
+    int i = m->heapPos[v];
+    if (i < 0) {
+        return;
+    }
+    heapSwap(m, i, --m->heapSize);
+    m->heapPos[v] = -1;
+    if (i < m->heapSize) {
+        heapFix(m, i);
+    }
+}
+
+/**
+ * Finds the cheapest valid collapse of a vertex and updates its heap entry.
+ * @param m Mesh.
+ * @param u Vertex.
+ */
+static void updateTarget(DecimateMesh *m, int u) {
+    if (m->locked[u]) {
+        heapRemove(m, u);
+        return;
+    }
+
+    int best = -1;
+    double bestCost = DBL_MAX;
+    int stamp = ++m->stamp;
+    for (int c = m->first[u]; c >= 0; c = m->next[c]) {
+        int t = c / 3;
+        if (!m->alive[t]) {
+            continue;
+        }
+        for (int k = 1; k < 3; ++k) {
+            int v = m->tri[3 * t + (c % 3 + k) % 3];
+            if (m->visited[v] == stamp) {
+                continue;
+            }
+            m->visited[v] = stamp;
+            double cost = quadricError(&m->quadrics[u], &m->quadrics[v], m->pos[v]);
+            if (cost < bestCost && collapseValid(m, u, v)) {
+                best = v;
+                bestCost = cost;
+            }
+        }
+    }
+
+    if (best < 0) {
+        heapRemove(m, u);
+        return;
+    }
+    m->target[u] = best;
+    m->cost[u] = (float) bestCost;
+    if (m->heapPos[u] < 0) {
+        m->heap[m->heapSize] = u;
+        m->heapPos[u] = m->heapSize++;
+    }
+    heapFix(m, m->heapPos[u]);
+}
+
+/**
+ * Drops the corners of removed triangles from the list of a vertex.
+ * @param m Mesh.
+ * @param v Vertex.
+ */
+static void pruneCorners(DecimateMesh *m, int v) {
+    int *link = &m->first[v];
+    while (*link >= 0) {
+        if (m->alive[*link / 3]) {
+            link = &m->next[*link];
+        } else {
+            *link = m->next[*link];
+        }
+    }
+}
+
+/**
+ * Collapses u onto v and re-evaluates the vertices around v.
+ * @param m Mesh.
+ * @param u Removed vertex.
+ * @param v Kept vertex.
+ */
+static void collapse(DecimateMesh *m, int u, int v) {
+    int c = m->first[u];
+    while (c >= 0) {
+        int nextCorner = m->next[c];
+        int t = c / 3;
+        if (m->alive[t]) {
+            if (triangleHas(m, t, v)) {
+                m->alive[t] = false;
+                --m->aliveTris;
+            } else {
+                m->tri[c] = v;
+                m->next[c] = m->first[v];
+                m->first[v] = c;
+            }
+        }
+        c = nextCorner;
+    }
+    m->first[u] = -1;
+    m->locked[u] = true;
+    heapRemove(m, u);
+
+    for (int k = 0; k < 10; ++k) {
+        m->quadrics[v].q[k] += m->quadrics[u].q[k];
+    }
+
+    // Neighbours are collected first, updateTarget stamps its own visits
+    pruneCorners(m, v);
+    updateTarget(m, v);
+    int stamp = ++m->stamp;
+    int numNeighbours = 0;
+    for (c = m->first[v]; c >= 0; c = m->next[c]) {
+        int t = c / 3;
+        for (int k = 1; k < 3; ++k) {
+            int w = m->tri[3 * t + (c % 3 + k) % 3];
+            if (m->visited[w] != stamp) {
+                m->visited[w] = stamp;
+                m->neighbours[numNeighbours++] = w;
+            }
+        }
+    }
+    for (int i = 0; i < numNeighbours; ++i) {
+        updateTarget(m, m->neighbours[i]);
+    }
+}
+
+/**
+ * Sets up the full resolution triangulation of a chunk with the winding
+ * of the drawn surface and sums the quadrics of the vertices.
+ * @param m Mesh with allocated arrays and its size set.
+ * @param heights First grid height.
+ * @param heightStride Bytes between two heights.
+ * @param dim Vertices per grid side.
+ * @param spacing Distance of two grid vertices.
+ * @param x0 First column of the chunk.
+ * @param z0 First row of the chunk.
+ */
+static void initMesh(DecimateMesh *m, const float *heights, size_t heightStride, int dim, const vec2 spacing,
+                     int x0, int z0) {
+    for (int v = 0; v < m->numVerts; ++v) {
+        int x = v % m->w, z = v / m->w;
+        const char *h = (const char*) heights + ((size_t) (z0 + z) * dim + (x0 + x)) * heightStride;
+        glm_vec3_copy((vec3) { x * spacing[0], *(const float*) h, z * spacing[1] }, m->pos[v]);
+        memset(&m->quadrics[v], 0, sizeof(Quadric));
+        m->first[v] = -1;
+        m->locked[v] = x == 0 || z == 0 || x == m->w - 1 || z == m->h - 1;
+        m->heapPos[v] = -1;
+        m->visited[v] = 0;
+    }
+
+    int t = 0;
+    for (int z = 0; z < m->h - 1; ++z) {
+        for (int x = 0; x < m->w - 1; ++x) {
+            int v0 = z * m->w + x, v1 = v0 + 1, v2 = v0 + m->w, v3 = v2 + 1;
+            const int quad[2][3] = { { v0, v2, v1 }, { v2, v3, v1 } };
+            for (int k = 0; k < 2; ++k, ++t) {
+                memcpy(&m->tri[3 * t], quad[k], sizeof(quad[k]));
+                m->alive[t] = true;
+            }
+        }
+    }
+    m->aliveTris = m->numTris;
+
+    for (t = 0; t < m->numTris; ++t) {
+        const int *k = &m->tri[3 * t];
+        vec3 e1, e2, n;
+        glm_vec3_sub(m->pos[k[1]], m->pos[k[0]], e1);
+        glm_vec3_sub(m->pos[k[2]], m->pos[k[0]], e2);
+        glm_vec3_cross(e1, e2, n);
+        double len = glm_vec3_norm(n);
+        if (len > 0.0) {
+            const double unit[3] = { n[0] / len, n[1] / len, n[2] / len };
+            double d = -(unit[0] * m->pos[k[0]][0] + unit[1] * m->pos[k[0]][1] + unit[2] * m->pos[k[0]][2]);
+            for (int c = 0; c < 3; ++c) {
+                quadricAddPlane(&m->quadrics[k[c]], unit, d, 0.5 * len);
+            }
+        }
+        for (int c = 0; c < 3; ++c) {
+            m->next[3 * t + c] = m->first[k[c]];
+            m->first[k[c]] = 3 * t + c;
+        }
+    }
+
+    m->heapSize = 0;
+    for (int v = 0; v < m->numVerts; ++v) {
+        updateTarget(m, v);
+    }
+}
+
+/**
+ * Writes the remaining triangles as grid indices.
+ * @param m Mesh.
+ * @param dim Vertices per grid side.
+ * @param x0 First column of the chunk.
+ * @param z0 First row of the chunk.
+ * @param dest Output indices.
+ * @return Number of written indices.
+ */
+static int emitTriangles(const DecimateMesh *m, int dim, int x0, int z0, GLuint *dest) {
+    int count = 0;
+    for (int t = 0; t < m->numTris; ++t) {
+        if (!m->alive[t]) {
+            continue;
+        }
+        for (int c = 0; c < 3; ++c) {
+            int v = m->tri[3 * t + c];
+            dest[count++] = (GLuint) ((z0 + v / m->w) * dim + x0 + v % m->w);
+        }
+    }
+    return count;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void decimate_chunk(const float *heights, size_t heightStride, int dim, const vec2 spacing,
+                    int x0, int z0, int x1, int z1, const int *budgets, int levels,
+                    GLuint *dest, int *offsets) {
+    assert(x1 > x0 && z1 > z0 && x1 - x0 <= DECIMATE_MAX_CHUNK_QUADS && z1 - z0 <= DECIMATE_MAX_CHUNK_QUADS);
+    assert(levels > 0 && levels <= DECIMATE_MAX_LEVELS);
+
+    DecimateMesh m = {0};
+    m.w = x1 - x0 + 1;
+    m.h = z1 - z0 + 1;
+    m.numVerts = m.w * m.h;
+    m.numTris = 2 * (m.w - 1) * (m.h - 1);
+
+    // One block for all arrays, the larger elements first keep their alignment
+    size_t nv = m.numVerts, nt = m.numTris;
+    size_t bytes = nv * (sizeof(Quadric) + sizeof(vec3) + 6 * sizeof(int) + sizeof(float) + sizeof(bool))
+        + nt * (6 * sizeof(int) + sizeof(bool));
+    char *block = TRACKED_MALLOC(bytes);
+    assert(block && "malloc failed in decimate_chunk");
+    char *p = block;
+    m.quadrics = (Quadric*) p;  p += nv * sizeof(Quadric);
+    m.pos = (vec3*) p;          p += nv * sizeof(vec3);
+    m.tri = (int*) p;           p += nt * 3 * sizeof(int);
+    m.next = (int*) p;          p += nt * 3 * sizeof(int);
+    m.first = (int*) p;         p += nv * sizeof(int);
+    m.target = (int*) p;        p += nv * sizeof(int);
+    m.heap = (int*) p;          p += nv * sizeof(int);
+    m.heapPos = (int*) p;       p += nv * sizeof(int);
+    m.visited = (int*) p;       p += nv * sizeof(int);
+    m.neighbours = (int*) p;    p += nv * sizeof(int);
+    m.cost = (float*) p;        p += nv * sizeof(float);
+    m.locked = (bool*) p;       p += nv * sizeof(bool);
+    m.alive = (bool*) p;
+
+    initMesh(&m, heights, heightStride, dim, spacing, x0, z0);
+
+    int count = 0;
+    for (int l = 0; l < levels; ++l) {
+        while (m.aliveTris > budgets[l] && m.heapSize > 0) {
+            int u = m.heap[0];
+            collapse(&m, u, m.target[u]);
+        }
+        offsets[l] = count;
+        count += emitTriangles(&m, dim, x0, z0, dest + count);
+    }
+    offsets[levels] = count;
+
+    TRACKED_FREE(block);
+}
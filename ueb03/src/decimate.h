@@ -0,0 +1,54 @@
+/**
+ * @file decimate.h
+ * @brief Quadric error simplification of chunks of the sampled surface grid
+ *
+ * A chunk is a rectangle of the regular height grid, triangulated like the
+ * drawn surface. Interior vertices are removed by collapsing them onto a
+ * neighbouring vertex, always the collapse with the smallest quadric error
+ * first, so flat areas lose their triangles before curved ones. The
+ * vertices on the chunk border never move: neighbouring chunks keep the
+ * same border at every level and the mesh stays free of cracks without
+ * stitching. A collapse that would flip a triangle in the x/z plane is
+ * skipped, the result stays a valid height field triangulation.
+ *
+ * Only collapses onto existing vertices are done, so the simplified
+ * triangles index the original grid vertices.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef DECIMATE_H
+#define DECIMATE_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Largest chunk side in quads */
+#define DECIMATE_MAX_CHUNK_QUADS 32
+
+/** Most levels built from one chunk in one pass */
+#define DECIMATE_MAX_LEVELS 8
+
+/**
+ * Simplifies one chunk of a height grid to a series of triangle budgets
+ * in one pass. The budgets are descending, a budget below what the locked
+ * border allows keeps the coarsest reachable mesh.
+ * Safe to call from several threads for different chunks.
+ * @param heights Height of grid vertex 0, the others follow with heightStride.
+ * @param heightStride Bytes between the heights of two grid vertices.
+ * @param dim Vertices per grid side.
+ * @param spacing World distance of two grid vertices along x and z.
+ * @param x0 First vertex column of the chunk.
+ * @param z0 First vertex row of the chunk.
+ * @param x1 Last vertex column of the chunk, at most DECIMATE_MAX_CHUNK_QUADS after x0.
+ * @param z1 Last vertex row of the chunk, at most DECIMATE_MAX_CHUNK_QUADS after z0.
+ * @param budgets Triangle budget of every level.
+ * @param levels Number of levels, at most DECIMATE_MAX_LEVELS.
+ * @param dest Grid indices of all levels back to back, room for
+ *             levels * 6 * (x1 - x0) * (z1 - z0) indices.
+ * @param offsets First index of every level in dest, offsets[levels] is the total.
+ */
+void decimate_chunk(const float *heights, size_t heightStride, int dim, const vec2 spacing,
+                    int x0, int z0, int x1, int z1, const int *budgets, int levels,
+                    GLuint *dest, int *offsets);
+
+#endif // DECIMATE_H
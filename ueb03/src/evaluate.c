@@ -0,0 +1,312 @@
+/**
+ * @file evaluate.c
+ * @brief Implementation of the batched patch evaluation kernels
+ *
+ * The SIMD kernels evaluate 4 (SSE) or 8 (AVX) points per lane with
+ * broadcast patch coefficients and Horner's scheme, then transpose the
+ * value/∂s/∂t lanes back into PatchEvalResult structs.
+ * The scalar kernels are the reference versions.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "evaluate.h"
+#include "utils.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define EVALUATE_X86 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define TARGET_AVX
+    #else
+        #define TARGET_AVX __attribute__((target("avx")))
+    #endif
+#endif
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Reference kernel for arbitrary points, one point at a time.
+ * @param p Patch.
+ * @param s Local s values.
+ * @param t Local t values.
+ * @param begin First point.
+ * @param end One past the last point.
+ * @param dest Output results.
+ */
+static void pointsScalar(Patch *p, const float *s, const float *t, int begin, int end, PatchEvalResult *dest) {
+    for (int i = begin; i < end; ++i) {
+        dest[i] = utils_evalPatchLocal(p, s[i], t[i]);
+    }
+}
+
+/**
+ * Reference kernel for a patch row, one point at a time.
+ * @param row s^T * C of the patch.
+ * @param rowDs ds^T * C of the patch.
+ * @param t Local t values.
+ * @param begin First point.
+ * @param end One past the last point.
+ * @param dest Output results.
+ */
+static void rowScalar(vec4 row, vec4 rowDs, const float *t, int begin, int end, PatchEvalResult *dest) {
+    for (int i = begin; i < end; ++i) {
+        PatchBasis basis;
+        utils_patchBasis(t[i], &basis);
+        dest[i] = utils_evalPatchRowAt(row, rowDs, &basis);
+    }
+}
+
+#ifdef EVALUATE_X86
+
+/**
+ * Stores value, ∂s and ∂t lanes as 4 consecutive PatchEvalResults.
+ * @param dst First of 4 results, written as 12 floats.
+ * @param x The values.
+ * @param y The ∂s derivatives.
+ * @param z The ∂t derivatives.
+ */
+static inline void store3x4(float *dst, __m128 x, __m128 y, __m128 z) {
+    __m128 xy = _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0));
+    __m128 zx = _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0));
+    _mm_storeu_ps(dst, _mm_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0)));
+
+    __m128 yz = _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1));
+    xy = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2));
+    _mm_storeu_ps(dst + 4, _mm_shuffle_ps(yz, xy, _MM_SHUFFLE(2, 0, 2, 0)));
+
+    zx = _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2));
+    yz = _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3));
+    _mm_storeu_ps(dst + 8, _mm_shuffle_ps(zx, yz, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+/**
+ * Stores 8 value, ∂s and ∂t lanes as 8 consecutive PatchEvalResults.
+ */
+TARGET_AVX static inline void store3x8(float *dst, __m256 x, __m256 y, __m256 z) {
+    store3x4(dst, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z));
+    store3x4(dst + 12, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1));
+}
+
+/**
+ * SSE kernel for arbitrary points, 4 points per iteration.
+ * (C * t)[r] and (C * dt)[r] are built with Horner's scheme in t,
+ * the results with Horner's scheme in s.
+ */
+static void pointsSse(Patch *p, const float *s, const float *t, int begin, int end, PatchEvalResult *dest) {
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 three = _mm_set1_ps(3.0f);
+
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 sv = _mm_loadu_ps(s + i);
+        __m128 tv = _mm_loadu_ps(t + i);
+
+        __m128 c[4], cdt[4];
+        for (int r = 0; r < 4; ++r) {
+            __m128 c0 = _mm_set1_ps(p->coeffsY[0][r]);
+            __m128 c1 = _mm_set1_ps(p->coeffsY[1][r]);
+            __m128 c2 = _mm_set1_ps(p->coeffsY[2][r]);
+            __m128 c3 = _mm_set1_ps(p->coeffsY[3][r]);
+
+            c[r] = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c0, tv), c1), tv), c2), tv), c3);
+            cdt[r] = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(three, c0), tv),
+                _mm_mul_ps(two, c1)), tv), c2);
+        }
+
+        __m128 value = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(
+            _mm_mul_ps(c[0], sv), c[1]), sv), c[2]), sv), c[3]);
+        __m128 dsd = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(three, c[0]), sv),
+            _mm_mul_ps(two, c[1])), sv), c[2]);
+        __m128 dtd = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(
+            _mm_mul_ps(cdt[0], sv), cdt[1]), sv), cdt[2]), sv), cdt[3]);
+
+        store3x4(&dest[i].value, value, dsd, dtd);
+    }
+
+    pointsScalar(p, s, t, i, end, dest);
+}
+
+/**
+ * AVX kernel for arbitrary points, 8 points per iteration, see pointsSse.
+ */
+TARGET_AVX static void pointsAvx(Patch *p, const float *s, const float *t, int begin, int end, PatchEvalResult *dest) {
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 three = _mm256_set1_ps(3.0f);
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 sv = _mm256_loadu_ps(s + i);
+        __m256 tv = _mm256_loadu_ps(t + i);
+
+        __m256 c[4], cdt[4];
+        for (int r = 0; r < 4; ++r) {
+            __m256 c0 = _mm256_set1_ps(p->coeffsY[0][r]);
+            __m256 c1 = _mm256_set1_ps(p->coeffsY[1][r]);
+            __m256 c2 = _mm256_set1_ps(p->coeffsY[2][r]);
+            __m256 c3 = _mm256_set1_ps(p->coeffsY[3][r]);
+
+            c[r] = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(
+                _mm256_mul_ps(c0, tv), c1), tv), c2), tv), c3);
+            cdt[r] = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(three, c0), tv),
+                _mm256_mul_ps(two, c1)), tv), c2);
+        }
+
+        __m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(
+            _mm256_mul_ps(c[0], sv), c[1]), sv), c[2]), sv), c[3]);
+        __m256 dsd = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(three, c[0]), sv),
+            _mm256_mul_ps(two, c[1])), sv), c[2]);
+        __m256 dtd = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(
+            _mm256_mul_ps(cdt[0], sv), cdt[1]), sv), cdt[2]), sv), cdt[3]);
+
+        store3x8(&dest[i].value, value, dsd, dtd);
+    }
+
+    pointsSse(p, s, t, i, end, dest);
+}
+
+/**
+ * SSE kernel for a patch row, 4 points per iteration.
+ * All three results are cubics (or quadratics) in t with broadcast row coefficients.
+ */
+static void rowSse(vec4 row, vec4 rowDs, const float *t, int begin, int end, PatchEvalResult *dest) {
+    const __m128 r0 = _mm_set1_ps(row[0]), r1 = _mm_set1_ps(row[1]);
+    const __m128 r2 = _mm_set1_ps(row[2]), r3 = _mm_set1_ps(row[3]);
+    const __m128 d0 = _mm_set1_ps(rowDs[0]), d1 = _mm_set1_ps(rowDs[1]);
+    const __m128 d2 = _mm_set1_ps(rowDs[2]), d3 = _mm_set1_ps(rowDs[3]);
+    const __m128 r0x3 = _mm_set1_ps(3.0f * row[0]), r1x2 = _mm_set1_ps(2.0f * row[1]);
+
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 tv = _mm_loadu_ps(t + i);
+
+        __m128 value = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(r0, tv), r1), tv), r2), tv), r3);
+        __m128 dsd = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(d0, tv), d1), tv), d2), tv), d3);
+        __m128 dtd = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(r0x3, tv), r1x2), tv), r2);
+
+        store3x4(&dest[i].value, value, dsd, dtd);
+    }
+
+    rowScalar(row, rowDs, t, i, end, dest);
+}
+
+/**
+ * AVX kernel for a patch row, 8 points per iteration, see rowSse.
+ */
+TARGET_AVX static void rowAvx(vec4 row, vec4 rowDs, const float *t, int begin, int end, PatchEvalResult *dest) {
+    const __m256 r0 = _mm256_set1_ps(row[0]), r1 = _mm256_set1_ps(row[1]);
+    const __m256 r2 = _mm256_set1_ps(row[2]), r3 = _mm256_set1_ps(row[3]);
+    const __m256 d0 = _mm256_set1_ps(rowDs[0]), d1 = _mm256_set1_ps(rowDs[1]);
+    const __m256 d2 = _mm256_set1_ps(rowDs[2]), d3 = _mm256_set1_ps(rowDs[3]);
+    const __m256 r0x3 = _mm256_set1_ps(3.0f * row[0]), r1x2 = _mm256_set1_ps(2.0f * row[1]);
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 tv = _mm256_loadu_ps(t + i);
+
+        __m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(
+            _mm256_mul_ps(r0, tv), r1), tv), r2), tv), r3);
+        __m256 dsd = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(
+            _mm256_mul_ps(d0, tv), d1), tv), d2), tv), d3);
+        __m256 dtd = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(r0x3, tv), r1x2), tv), r2);
+
+        store3x8(&dest[i].value, value, dsd, dtd);
+    }
+
+    rowSse(row, rowDs, t, i, end, dest);
+}
+
+/**
+ * Checks for AVX support of CPU and operating system.
+ * @return True if AVX instructions can be used.
+ */
+static bool cpuHasAvx(void) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    return osxsave && avx && ((_xgetbv(0) & 0x6) == 0x6);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+#endif
+}
+
+#endif // EVALUATE_X86
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool evaluate_isSupported(SimdKernel kernel) {
+    switch (kernel) {
+        case SK_SCALAR:
+            return true;
+#ifdef EVALUATE_X86
+        case SK_SSE:
+            return true;
+        case SK_AVX: {
+            static int hasAvx = -1;
+            if (hasAvx < 0) {
+                hasAvx = cpuHasAvx() ? 1 : 0;
+            }
+            return hasAvx == 1;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+SimdKernel evaluate_bestKernel(void) {
+    for (int k = SK_COUNT - 1; k > SK_SCALAR; --k) {
+        if (evaluate_isSupported((SimdKernel)k)) {
+            return (SimdKernel)k;
+        }
+    }
+    return SK_SCALAR;
+}
+
+void evaluate_patchPoints(SimdKernel kernel, Patch *p, const float *s, const float *t, int count,
+    PatchEvalResult *dest) {
+    if (!evaluate_isSupported(kernel)) {
+        kernel = SK_SCALAR;
+    }
+
+    switch (kernel) {
+#ifdef EVALUATE_X86
+        case SK_AVX:
+            pointsAvx(p, s, t, 0, count, dest);
+            break;
+        case SK_SSE:
+            pointsSse(p, s, t, 0, count, dest);
+            break;
+#endif
+        case SK_SCALAR:
+        default:
+            pointsScalar(p, s, t, 0, count, dest);
+            break;
+    }
+}
+
+void evaluate_patchRow(SimdKernel kernel, vec4 row, vec4 rowDs, const float *t, int count,
+    PatchEvalResult *dest) {
+    if (!evaluate_isSupported(kernel)) {
+        kernel = SK_SCALAR;
+    }
+
+    switch (kernel) {
+#ifdef EVALUATE_X86
+        case SK_AVX:
+            rowAvx(row, rowDs, t, 0, count, dest);
+            break;
+        case SK_SSE:
+            rowSse(row, rowDs, t, 0, count, dest);
+            break;
+#endif
+        case SK_SCALAR:
+        default:
+            rowScalar(row, rowDs, t, 0, count, dest);
+            break;
+    }
+}
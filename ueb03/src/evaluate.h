@@ -0,0 +1,59 @@
+/**
+ * @file evaluate.h
+ * @brief Scalar and SIMD kernels for batched patch evaluation
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include <fhwcg/fhwcg.h>
+#include "input.h"
+#include "logic.h"
+
+/** Widest batch a kernel evaluates at once */
+#define EVALUATE_MAX_BATCH 8
+
+/**
+ * Checks whether the CPU can run a kernel.
+ * @param kernel Kernel to check.
+ * @return True if the kernel is available.
+ */
+bool evaluate_isSupported(SimdKernel kernel);
+
+/**
+ * Returns the widest kernel supported by the CPU.
+ * @return Best available kernel.
+ */
+SimdKernel evaluate_bestKernel(void);
+
+/**
+ * Evaluates count points (s[i], t[i]) on the same patch:
+ * value, ∂s and ∂t like utils_evalPatchLocal.
+ * Unsupported kernels fall back to SK_SCALAR.
+ * @param kernel Kernel to use.
+ * @param p Pointer to the Polynomial Patch.
+ * @param s Local s values.
+ * @param t Local t values.
+ * @param count Number of points.
+ * @param dest Output with count results.
+ */
+void evaluate_patchPoints(SimdKernel kernel, Patch *p, const float *s, const float *t, int count,
+    PatchEvalResult *dest);
+
+/**
+ * Evaluates count local t values on a patch row from utils_evalPatchRow,
+ * so all points share the s the row was built from.
+ * Unsupported kernels fall back to SK_SCALAR.
+ * @param kernel Kernel to use.
+ * @param row s^T * C of the patch.
+ * @param rowDs ds^T * C of the patch.
+ * @param t Local t values.
+ * @param count Number of points.
+ * @param dest Output with count results.
+ */
+void evaluate_patchRow(SimdKernel kernel, vec4 row, vec4 rowDs, const float *t, int count,
+    PatchEvalResult *dest);
+
+#endif // EVALUATE_H
@@ -0,0 +1,333 @@
+/**
+ * @file framegraph.c
+ * @brief Implementation of the pass list and the transient texture pool
+ *
+ * The declarations are rebuilt every frame and only hold a few small
+ * arrays, the physical textures live in a pool across frames. A pool entry
+ * is free for a texture if its format and mip chain match and the last
+ * pass of its current owner in this execution comes before the first pass
+ * of the texture. A free entry that is too small is reallocated larger
+ * before any pass runs, its earlier owners then use the larger one as well.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "framegraph.h"
+#include "gpumem.h"
+
+#define POOL_SIZE (2 * FRAMEGRAPH_MAX_TEXTURES)
+
+/**
+ * A declared transient texture.
+ */
+typedef struct {
+    const char *name;
+    GLenum format;
+    int width, height;
+    bool mipmapped;
+    int first, last;    // remaining passes using it, -1 if none
+    int physical;       // pool entry, -1 if none
+} TextureDecl;
+
+/**
+ * A declared pass.
+ */
+typedef struct {
+    const char *name;
+    bool enabled;
+    bool alive;         // survived the culling
+    FgPassFn fn;
+    void *userData;
+    FgTexture reads[FRAMEGRAPH_MAX_PASS_IO];
+    FgTexture writes[FRAMEGRAPH_MAX_PASS_IO];
+    int numReads, numWrites;
+} PassDecl;
+
+/**
+ * A physical texture of the pool.
+ */
+typedef struct {
+    GLuint texture;
+    GLenum format;
+    int width, height;
+    bool mipmapped;
+    size_t bytes;
+    int busyUntil;      // last pass of its owner in this execution, -1 if free
+    long lastUsed;      // execution it was last assigned in
+} PhysicalTexture;
+
+/**
+ * Declarations of the current pass list and the pool.
+ */
+static struct {
+    PassDecl passes[FRAMEGRAPH_MAX_PASSES];
+    int numPasses;
+    TextureDecl textures[FRAMEGRAPH_MAX_TEXTURES];  // 0 is the scene
+    int numTextures;
+
+    PhysicalTexture pool[POOL_SIZE];
+    int poolSize;
+    long executions;
+    FramegraphStats stats;
+} g_graph = { .numTextures = 1 };
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Returns the number of mip levels down to a single texel.
+ * @param size Largest side of level 0.
+ * @return Number of levels.
+ */
+static int levelCount(int size) {
+    int levels = 1;
+    while ((size >> levels) > 0) {
+        ++levels;
+    }
+    return levels;
+}
+
+/**
+ * (Re)allocates the texture of a pool entry with its current size.
+ * @param p The entry, its old texture is deleted.
+ */
+static void allocatePhysical(PhysicalTexture *p) {
+    gpumem_deleteTextures(1, &p->texture);
+
+    int levels = p->mipmapped ? levelCount(glm_imax(p->width, p->height)) : 1;
+    glGenTextures(1, &p->texture);
+    glBindTexture(GL_TEXTURE_2D, p->texture);
+    glTexStorage2D(GL_TEXTURE_2D, levels, p->format, p->width, p->height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, p->mipmapped ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    p->bytes = 0;
+    for (int level = 0; level < levels; ++level) {
+        p->bytes += gpumem_imageBytes(p->format, glm_imax(p->width >> level, 1), glm_imax(p->height >> level, 1), 1);
+    }
+    gpumem_setTexture(GPUMEM_TARGETS, p->texture, p->bytes);
+}
+
+/**
+ * Frees the pool entries no execution used for FRAMEGRAPH_KEEP_FRAMES.
+ */
+static void evictIdle(void) {
+    for (int i = 0; i < g_graph.poolSize; ) {
+        PhysicalTexture *p = &g_graph.pool[i];
+        if (g_graph.executions - p->lastUsed > FRAMEGRAPH_KEEP_FRAMES) {
+            gpumem_deleteTextures(1, &p->texture);
+            *p = g_graph.pool[--g_graph.poolSize];
+        } else {
+            ++i;
+        }
+    }
+}
+
+/**
+ * Culls the passes backwards from the ones writing the scene: a pass stays
+ * if it is enabled and writes the scene or a texture a later remaining
+ * pass reads.
+ */
+static void cullPasses(void) {
+    bool needed[FRAMEGRAPH_MAX_TEXTURES] = { false };
+    needed[FRAMEGRAPH_SCENE] = true;
+
+    for (int i = g_graph.numPasses - 1; i >= 0; --i) {
+        PassDecl *pass = &g_graph.passes[i];
+        pass->alive = false;
+        if (!pass->enabled) {
+            continue;
+        }
+        for (int w = 0; w < pass->numWrites && !pass->alive; ++w) {
+            pass->alive = needed[pass->writes[w]];
+        }
+        if (pass->alive) {
+            for (int r = 0; r < pass->numReads; ++r) {
+                needed[pass->reads[r]] = true;
+            }
+        }
+    }
+}
+
+/**
+ * Extends the lifetime of a texture to a pass.
+ * @param texture The texture.
+ * @param pass Index of the pass.
+ */
+static void touchTexture(FgTexture texture, int pass) {
+    TextureDecl *t = &g_graph.textures[texture];
+    if (t->first < 0) {
+        t->first = pass;
+    }
+    t->last = pass;
+}
+
+/**
+ * Finds a pool entry for a texture, reallocating a free one that is too
+ * small or adding a new one.
+ * @param t The texture with its lifetime set.
+ * @return Index of the entry.
+ */
+static int assignPhysical(const TextureDecl *t) {
+    int best = -1;
+    for (int i = 0; i < g_graph.poolSize; ++i) {
+        const PhysicalTexture *p = &g_graph.pool[i];
+        if (p->format != t->format || p->mipmapped != t->mipmapped || p->busyUntil >= t->first) {
+            continue;
+        }
+        bool fits = p->width >= t->width && p->height >= t->height;
+        bool bestFits = best >= 0 && g_graph.pool[best].width >= t->width && g_graph.pool[best].height >= t->height;
+        if (best < 0 || (fits && !bestFits) || (fits == bestFits && p->bytes < g_graph.pool[best].bytes)) {
+            best = i;
+        }
+    }
+
+    if (best < 0) {
+        assert(g_graph.poolSize < POOL_SIZE && "framegraph pool full");
+        best = g_graph.poolSize++;
+        g_graph.pool[best] = (PhysicalTexture) {
+            .format = t->format, .mipmapped = t->mipmapped, .width = t->width, .height = t->height
+        };
+        allocatePhysical(&g_graph.pool[best]);
+    } else {
+        PhysicalTexture *p = &g_graph.pool[best];
+        if (p->width < t->width || p->height < t->height) {
+            p->width = glm_imax(p->width, t->width);
+            p->height = glm_imax(p->height, t->height);
+            allocatePhysical(p);
+        }
+    }
+
+    g_graph.pool[best].busyUntil = t->last;
+    g_graph.pool[best].lastUsed = g_graph.executions;
+    return best;
+}
+
+/**
+ * Sets the lifetimes of the used textures and assigns their physical
+ * textures in the order of their first use.
+ */
+static void assignTextures(void) {
+    for (int i = 1; i < g_graph.numTextures; ++i) {
+        g_graph.textures[i].first = -1;
+        g_graph.textures[i].last = -1;
+        g_graph.textures[i].physical = -1;
+    }
+    for (int i = 0; i < g_graph.numPasses; ++i) {
+        const PassDecl *pass = &g_graph.passes[i];
+        if (!pass->alive) {
+            continue;
+        }
+        for (int r = 0; r < pass->numReads; ++r) {
+            if (pass->reads[r] != FRAMEGRAPH_SCENE) touchTexture(pass->reads[r], i);
+        }
+        for (int w = 0; w < pass->numWrites; ++w) {
+            if (pass->writes[w] != FRAMEGRAPH_SCENE) touchTexture(pass->writes[w], i);
+        }
+    }
+
+    // Few textures, a selection of the next first use is enough
+    for (int i = 0; i < g_graph.poolSize; ++i) {
+        g_graph.pool[i].busyUntil = -1;
+    }
+    for (;;) {
+        TextureDecl *next = NULL;
+        for (int i = 1; i < g_graph.numTextures; ++i) {
+            TextureDecl *t = &g_graph.textures[i];
+            if (t->first >= 0 && t->physical < 0 && (!next || t->first < next->first)) {
+                next = t;
+            }
+        }
+        if (!next) {
+            break;
+        }
+        next->physical = assignPhysical(next);
+        g_graph.stats.requestedBytes += gpumem_imageBytes(next->format, next->width, next->height, 1);
+        ++g_graph.stats.textures;
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void framegraph_cleanup(void) {
+    for (int i = 0; i < g_graph.poolSize; ++i) {
+        gpumem_deleteTextures(1, &g_graph.pool[i].texture);
+    }
+    memset(&g_graph, 0, sizeof(g_graph));
+    g_graph.numTextures = 1;
+}
+
+void framegraph_begin(void) {
+    g_graph.numPasses = 0;
+    g_graph.numTextures = 1;
+}
+
+FgTexture framegraph_texture(const char *name, GLenum format, int width, int height, bool mipmapped) {
+    assert(g_graph.numTextures < FRAMEGRAPH_MAX_TEXTURES && "too many framegraph textures");
+    FgTexture handle = g_graph.numTextures++;
+    g_graph.textures[handle] = (TextureDecl) {
+        .name = name,
+        .format = format,
+        .width = glm_imax(width, 1),
+        .height = glm_imax(height, 1),
+        .mipmapped = mipmapped,
+        .first = -1, .last = -1, .physical = -1
+    };
+    return handle;
+}
+
+int framegraph_pass(const char *name, bool enabled, FgPassFn fn, void *userData) {
+    assert(g_graph.numPasses < FRAMEGRAPH_MAX_PASSES && "too many framegraph passes");
+    int index = g_graph.numPasses++;
+    g_graph.passes[index] = (PassDecl) { .name = name, .enabled = enabled, .fn = fn, .userData = userData };
+    return index;
+}
+
+void framegraph_read(int pass, FgTexture texture) {
+    PassDecl *p = &g_graph.passes[pass];
+    assert(texture >= 0 && texture < g_graph.numTextures && "unknown framegraph texture");
+    assert(p->numReads < FRAMEGRAPH_MAX_PASS_IO && "too many reads of a framegraph pass");
+    p->reads[p->numReads++] = texture;
+}
+
+void framegraph_write(int pass, FgTexture texture) {
+    PassDecl *p = &g_graph.passes[pass];
+    assert(texture >= 0 && texture < g_graph.numTextures && "unknown framegraph texture");
+    assert(p->numWrites < FRAMEGRAPH_MAX_PASS_IO && "too many writes of a framegraph pass");
+    p->writes[p->numWrites++] = texture;
+}
+
+void framegraph_execute(void) {
+    ++g_graph.executions;
+    memset(&g_graph.stats, 0, sizeof(g_graph.stats));
+    g_graph.stats.passes = g_graph.numPasses;
+
+    evictIdle();
+    cullPasses();
+    assignTextures();
+
+    g_graph.stats.physical = 0;
+    for (int i = 0; i < g_graph.poolSize; ++i) {
+        g_graph.stats.allocatedBytes += g_graph.pool[i].bytes;
+        g_graph.stats.physical += g_graph.pool[i].lastUsed == g_graph.executions;
+    }
+
+    for (int i = 0; i < g_graph.numPasses; ++i) {
+        PassDecl *pass = &g_graph.passes[i];
+        if (pass->alive) {
+            pass->fn(pass->userData);
+        } else {
+            ++g_graph.stats.culled;
+        }
+    }
+}
+
+GLuint framegraph_getTexture(FgTexture texture) {
+    assert(texture > FRAMEGRAPH_SCENE && texture < g_graph.numTextures && "unknown framegraph texture");
+    int physical = g_graph.textures[texture].physical;
+    return physical >= 0 ? g_graph.pool[physical].texture : 0;
+}
+
+void framegraph_getStats(FramegraphStats *stats) {
+    *stats = g_graph.stats;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file framegraph.h
+ * @brief Pass list with transient render targets shared between passes
+ *
+ * Every frame the passes are declared in execution order with the textures
+ * they read and write. Before anything runs, passes that are disabled or
+ * whose results nobody reads are culled, going backwards from the passes
+ * that write the scene. Each remaining transient texture lives from the
+ * first to the last remaining pass that uses it. Textures with the same
+ * format whose lifetimes do not overlap get the same physical texture, so
+ * e.g. the Hi-Z depth copy and the transparency depth are one allocation.
+ *
+ * Physical textures grow to the largest size requested and are drawn from
+ * the lower left corner, like the targets of the passes always were. A
+ * physical texture no pass used for FRAMEGRAPH_KEEP_FRAMES executions is
+ * freed, the targets of a feature that was switched off go away on their own.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef FRAMEGRAPH_H
+#define FRAMEGRAPH_H
+
+#include <fhwcg/fhwcg.h>
+
+#define FRAMEGRAPH_MAX_PASSES 16
+#define FRAMEGRAPH_MAX_TEXTURES 16
+#define FRAMEGRAPH_MAX_PASS_IO 8        // reads plus writes of one pass
+#define FRAMEGRAPH_KEEP_FRAMES 120      // unused executions before a physical texture is freed
+
+/** The framebuffer bound at framegraph_execute, a pass writing it is never culled */
+#define FRAMEGRAPH_SCENE 0
+
+/**
+ * Handle of a declared texture, FRAMEGRAPH_SCENE for the scene.
+ */
+typedef int FgTexture;
+
+/**
+ * Function running a pass.
+ * @param userData Pointer given with the pass.
+ */
+typedef void (*FgPassFn)(void *userData);
+
+/**
+ * Counts of the last execution.
+ */
+typedef struct {
+    int passes;             // declared
+    int culled;             // skipped, disabled or unread
+    int textures;           // transient textures used by the remaining passes
+    int physical;           // physical textures they were assigned to
+    size_t requestedBytes;  // sum of the used transient textures
+    size_t allocatedBytes;  // all physical textures, including the idle ones
+} FramegraphStats;
+
+/**
+ * Deletes all physical textures.
+ */
+void framegraph_cleanup(void);
+
+/**
+ * Starts the declaration of a new pass list, the previous one is dropped.
+ */
+void framegraph_begin(void);
+
+/**
+ * Declares a transient texture of this pass list.
+ * @param name Name for the statistics and messages.
+ * @param format Sized internal format.
+ * @param width Width in texels.
+ * @param height Height in texels.
+ * @param mipmapped With the full mip chain of the physical size.
+ * @return The handle.
+ */
+FgTexture framegraph_texture(const char *name, GLenum format, int width, int height, bool mipmapped);
+
+/**
+ * Declares the next pass.
+ * @param name Name for the statistics and messages.
+ * @param enabled False culls the pass and everything only it reads.
+ * @param fn Function running the pass.
+ * @param userData Pointer given to fn.
+ * @return Index of the pass for framegraph_read and framegraph_write.
+ */
+int framegraph_pass(const char *name, bool enabled, FgPassFn fn, void *userData);
+
+/**
+ * Declares that a pass reads a texture.
+ * @param pass The pass.
+ * @param texture The texture.
+ */
+void framegraph_read(int pass, FgTexture texture);
+
+/**
+ * Declares that a pass writes a texture.
+ * @param pass The pass.
+ * @param texture The texture, FRAMEGRAPH_SCENE for the bound framebuffer.
+ */
+void framegraph_write(int pass, FgTexture texture);
+
+/**
+ * Culls the passes, assigns the physical textures and runs the remaining
+ * passes in declaration order.
+ */
+void framegraph_execute(void);
+
+/**
+ * Returns the physical texture of a transient texture. Only valid while
+ * the passes of framegraph_execute run, and only in passes that use it.
+ * @param texture The texture.
+ * @return The physical texture, 0 if no remaining pass uses it.
+ */
+GLuint framegraph_getTexture(FgTexture texture);
+
+/**
+ * Returns the counts of the last execution.
+ * @param stats Destination.
+ */
+void framegraph_getStats(FramegraphStats *stats);
+
+#endif // FRAMEGRAPH_H
@@ -0,0 +1,132 @@
+/**
+ * @file grid.c
+ * @brief Implementation of the 2D broad-phase grid
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "grid.h"
+#include "utils.h"
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Grows an array to at least the given number of elements.
+ * Contents are not preserved.
+ * @param ptr Pointer to the array pointer.
+ * @param capacity Current capacity, updated on growth.
+ * @param required Required number of elements.
+ * @param elemSize Size of one element.
+ */
+static void ensureCapacity(void **ptr, int *capacity, int required, size_t elemSize) {
+    if (*capacity >= required) {
+        return;
+    }
+
+    int newCap = *capacity ? *capacity * 2 : 64;
+    if (newCap < required) newCap = required;
+
+    free(*ptr);
+    *ptr = malloc(newCap * elemSize);
+    assert(*ptr && "malloc failed in grid ensureCapacity");
+    *capacity = newCap;
+}
+
+/**
+ * Converts one coordinate into a clamped cell coordinate.
+ * @param g Grid.
+ * @param v Coordinate.
+ * @param origin Grid origin on the same axis.
+ * @param dim Number of cells on the axis.
+ * @return Cell coordinate in [0, dim).
+ */
+static inline int toCell(const Grid *g, float v, float origin, int dim) {
+    int c = (int)floorf((v - origin) / g->cellSize);
+    return CLAMP(c, 0, dim - 1);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void grid_build(Grid *g, vec2 *points, int count, float cellSize) {
+    vec2 minP = {0.0f, 0.0f}, maxP = {0.0f, 0.0f};
+    if (count > 0) {
+        glm_vec2_copy(points[0], minP);
+        glm_vec2_copy(points[0], maxP);
+    }
+    for (int i = 1; i < count; ++i) {
+        glm_vec2_minv(minP, points[i], minP);
+        glm_vec2_maxv(maxP, points[i], maxP);
+    }
+
+    cellSize = fmaxf(cellSize, 1e-4f);
+    float extent = fmaxf(maxP[0] - minP[0], maxP[1] - minP[1]);
+    if (extent / cellSize > GRID_MAX_DIM - 1) {
+        cellSize = extent / (GRID_MAX_DIM - 1);
+    }
+
+    g->cellSize = cellSize;
+    glm_vec2_copy(minP, g->origin);
+    g->dimX = (int)((maxP[0] - minP[0]) / cellSize) + 1;
+    g->dimY = (int)((maxP[1] - minP[1]) / cellSize) + 1;
+    g->dimX = CLAMP(g->dimX, 1, GRID_MAX_DIM);
+    g->dimY = CLAMP(g->dimY, 1, GRID_MAX_DIM);
+    g->count = count;
+
+    int numCells = g->dimX * g->dimY;
+    int cellCap = g->cellCapacity;
+    ensureCapacity((void**)&g->cellStart, &cellCap, numCells + 1, sizeof(int));
+    g->cellCapacity = cellCap;
+
+    // Both point arrays share one capacity
+    if (g->pointCapacity < count) {
+        int cap = g->pointCapacity;
+        ensureCapacity((void**)&g->cellOf, &cap, count, sizeof(int));
+        cap = g->pointCapacity;
+        ensureCapacity((void**)&g->sortedIdx, &cap, count, sizeof(int));
+        g->pointCapacity = cap;
+    }
+
+    // 1. Count points per cell
+    memset(g->cellStart, 0, (numCells + 1) * sizeof(int));
+    for (int i = 0; i < count; ++i) {
+        int c[2];
+        grid_cellCoords(g, points[i], c);
+        int cell = c[1] * g->dimX + c[0];
+        g->cellOf[i] = cell;
+        g->cellStart[cell + 1]++;
+    }
+
+    // 2. Prefix sum -> start of each cell
+    for (int c = 0; c < numCells; ++c) {
+        g->cellStart[c + 1] += g->cellStart[c];
+    }
+
+    // 3. Scatter, cellStart[c] is used as write cursor and restored below
+    for (int i = 0; i < count; ++i) {
+        int slot = g->cellStart[g->cellOf[i]]++;
+        g->sortedIdx[slot] = i;
+    }
+
+    for (int c = numCells; c > 0; --c) {
+        g->cellStart[c] = g->cellStart[c - 1];
+    }
+    g->cellStart[0] = 0;
+}
+
+void grid_cellCoords(const Grid *g, const vec2 p, int cell[2]) {
+    cell[0] = toCell(g, p[0], g->origin[0], g->dimX);
+    cell[1] = toCell(g, p[1], g->origin[1], g->dimY);
+}
+
+void grid_cellRange(const Grid *g, int x, int y, int *begin, int *end) {
+    int cell = y * g->dimX + x;
+    *begin = g->cellStart[cell];
+    *end = g->cellStart[cell + 1];
+}
+
+void grid_free(Grid *g) {
+    free(g->cellStart);
+    free(g->cellOf);
+    free(g->sortedIdx);
+    memset(g, 0, sizeof(Grid));
+}
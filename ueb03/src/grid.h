@@ -0,0 +1,69 @@
+/**
+ * @file grid.h
+ * @brief 2D uniform grid for the ball-ball broad phase, rebuilt every step
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef GRID_H
+#define GRID_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Upper bound for cells per axis */
+#define GRID_MAX_DIM 256
+
+/**
+ * Uniform grid over the bounding rectangle of the inserted points.
+ * Built with a counting sort: cellStart[c]..cellStart[c + 1] indexes
+ * the points of cell c in sortedIdx.
+ */
+typedef struct {
+    int dimX, dimY;
+    float cellSize;
+    vec2 origin;
+
+    int *cellStart;     // dimX * dimY + 1 entries
+    int *cellOf;        // cell index per point
+    int *sortedIdx;     // point index per sorted slot
+
+    int cellCapacity;
+    int pointCapacity;
+    int count;
+} Grid;
+
+/**
+ * Rebuilds the grid from a set of points.
+ * The cell size grows if the bounds would need more than GRID_MAX_DIM cells per axis.
+ * @param g Grid to rebuild.
+ * @param points Point positions.
+ * @param count Number of points.
+ * @param cellSize Requested cell size (at least the interaction distance).
+ */
+void grid_build(Grid *g, vec2 *points, int count, float cellSize);
+
+/**
+ * Returns the clamped cell coordinates of a position.
+ * @param g Grid.
+ * @param p Position to look up.
+ * @param cell Destination for x and y cell coordinates.
+ */
+void grid_cellCoords(const Grid *g, const vec2 p, int cell[2]);
+
+/**
+ * Returns the sorted slot range of a cell.
+ * @param g Grid.
+ * @param x Cell x coordinate.
+ * @param y Cell y coordinate.
+ * @param begin Destination for the first slot.
+ * @param end Destination for one past the last slot.
+ */
+void grid_cellRange(const Grid *g, int x, int y, int *begin, int *end);
+
+/**
+ * Frees all grid memory.
+ * @param g Grid to free.
+ */
+void grid_free(Grid *g);
+
+#endif // GRID_H
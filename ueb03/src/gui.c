@@ -10,19 +10,72 @@
 
 #include "gui.h"
 #include "input.h"
+#include "idle.h"
+#include "guicache.h"
 #include "logic.h"
 #include "utils.h"
 #include "physics.h"
+#include "profiler.h"
+#include "perfcount.h"
+#include "instrument.h"
+#include "jobs.h"
+#include "evaluate.h"
+#include "glstate.h"
+#include "arena.h"
+#include "gpumem.h"
+#include "framegraph.h"
+#include "resscale.h"
+#include "surfacefile.h"
+#include "terraintiles.h"
+#include "obstacles.h"
+#include "lightgrid.h"
+#include "shadow.h"
 
 #define GUI_WINDOW_HELP "window_help"
 #define GUI_WINDOW_MENU "window_menu"
 #define GUI_WINDOW_STATUS "window_status"
+#define GUI_WINDOW_PROFILER "window_profiler"
 
 ////////////////////////     LOCAL    ////////////////////////////
 
 /* Booleans to toggle between spline and bezier */
 static bool g_showGameStatus = false;
 
+/** Dropdown options for the CPU patch evaluation kernel */
+static const char *kernelDropdown[] = {
+    "Scalar", "SSE", "AVX"
+};
+
+/** Dropdown options for the obstacle layout */
+static const char *obstacleLayoutDropdown[] = {
+    "Random", "Maze", "File"
+};
+
+/** Dropdown options for the time integrator */
+static const char *integratorDropdown[] = {
+    "Euler", "Symplectic Euler", "Verlet", "RK4"
+};
+
+/** Dropdown options for the contact solver */
+static const char *solverDropdown[] = {
+    "Penalty", "XPBD Gauss-Seidel", "XPBD Jacobi"
+};
+
+/** Dropdown options for the trace mode */
+static const char *replayModeDropdown[] = {
+    "Off", "Record", "Replay"
+};
+
+/** Dropdown options for the instrumentation level, cut at INSTRUMENT_LEVEL */
+static const char *instrumentDropdown[] = {
+    "Off", "Labels", "Full"
+};
+
+/** Names of the quality governor levels */
+static const char *qualityLevelNames[] = {
+    "Full", "Surface Normals", "No Normals"
+};
+
 /**
  * Constant array for help messages and their correspondant button.
  */
@@ -32,16 +85,20 @@ static const GuiHelpLine help[] = {
     {"Toggle Fullscreen", "F2"},
     {"Toggle Wireframe", "F3"},
     {"Toggle Menu", "F4"},
+    {"Toggle Profiler", "F5"},
+    {"Timeline Capture", "F6"},
     {"Reload Shaders", "R"},
     {"Height Functions", "1-7"},
     {"Tilt in X", "8"},
     {"Tilt in Z", "9"},
+    {"Noise Terrain", "0"},
     {"Pause", "P"},
     {"Normals", "N"},
     {"Camera Flight", "C"},
     {"Toggle Flight Path", "V"},
     {"Reset Game", "G"},
     {"Select CP", "Left/Right"},
+    {"Pick CP", "Right Click"},
     {"Adjust Height", "Up/Down"}
 };
 
@@ -153,28 +210,69 @@ void renderGame(ProgContext ctx, InputData *input)
         snprintf(infoStr, 49, "Active Balls: %d", physics_getBallCount());
         gui_label(ctx, infoStr, NK_TEXT_LEFT);
 
+        snprintf(infoStr, 49, "Captured Balls: %d", physics_getCapturedBallCount());
+        gui_label(ctx, infoStr, NK_TEXT_LEFT);
+
+        snprintf(infoStr, 49, "Sleeping Balls: %d", physics_getSleepingBallCount());
+        gui_label(ctx, infoStr, NK_TEXT_LEFT);
+
         snprintf(infoStr, 49, "Black Holes: %d", physics_getBlackHoleCount());
         gui_label(ctx, infoStr, NK_TEXT_LEFT);
 
         if (gui_treePush(ctx, NK_TREE_NODE, "Obstacles", NK_MINIMIZED))
         {
             gui_checkbox(ctx, "show", &input->game.showObstacles);
-            gui_propertyInt(ctx, "selected idx", 0, &input->game.selectedIdx, OBSTACLE_COUNT - 1, 1, 0.1f);
-
-            Obstacle *o = &input->game.obstacles[input->game.selectedIdx];
-            gui_propertyFloat(ctx, "T", 0.0f, &o->gT, 1.0f, 0.0001f, 0.01f);
-            gui_propertyFloat(ctx, "S", 0.0f, &o->gS, 1.0f, 0.0001f, 0.01f);
-            gui_propertyFloat(ctx, "width", 0.01f, &o->width, 1.0f, 0.0001f, 0.01f);
-            gui_propertyFloat(ctx, "length", 0.01f, &o->length, 1.0f, 0.0001f, 0.01f);
+            snprintf(infoStr, 49, "Count: %zu", input->game.obstacles.size);
+            gui_label(ctx, infoStr, NK_TEXT_LEFT);
+
+            gui_layoutRowDynamic(ctx, 25, 2);
+            gui_label(ctx, "Layout:", NK_TEXT_LEFT);
+            input->game.layout = gui_dropdown(ctx, obstacleLayoutDropdown, NK_LEN(obstacleLayoutDropdown),
+                input->game.layout, 20, nk_vec2(200, 200)
+            );
+
+            gui_layoutRowDynamic(ctx, 25, 1);
+            if (input->game.layout == OL_RANDOM) {
+                gui_propertyInt(ctx, "count", 0, &input->game.randomCount, OBSTACLES_MAX, 1, 10.0f);
+            } else if (input->game.layout == OL_MAZE) {
+                gui_propertyInt(ctx, "cells", 2, &input->game.mazeCells, OBSTACLES_MAZE_MAX_CELLS, 1, 0.2f);
+            }
 
-            if (gui_button(ctx, "switch direction"))
-            {
-                float temp = o->length;
-                o->length = o->width;
-                o->width = temp;
+            gui_layoutRowDynamic(ctx, 25, 3);
+            if (gui_button(ctx, "generate")) {
+                obstacles_regenerate(input);
+            }
+            if (gui_button(ctx, "save")) {
+                obstacles_save(OBSTACLES_FILE, input);
+            }
+            if (gui_button(ctx, "load")) {
+                obstacles_load(OBSTACLES_FILE, input);
             }
 
-            logic_evalSplineGlobal(o->gT, o->gS, o->center, o->normal);
+            gui_layoutRowDynamic(ctx, 25, 1);
+            if (input->game.obstacles.size > 0) {
+                int lastIdx = (int) input->game.obstacles.size - 1;
+                gui_propertyInt(ctx, "selected idx", 0, &input->game.selectedIdx, lastIdx, 1, 0.1f);
+
+                Obstacle *o = &input->game.obstacles.data[input->game.selectedIdx];
+                Obstacle old = *o;
+                gui_propertyFloat(ctx, "T", 0.0f, &o->gT, 1.0f, 0.0001f, 0.01f);
+                gui_propertyFloat(ctx, "S", 0.0f, &o->gS, 1.0f, 0.0001f, 0.01f);
+                gui_propertyFloat(ctx, "width", 0.01f, &o->width, 1.0f, 0.0001f, 0.01f);
+                gui_propertyFloat(ctx, "length", 0.01f, &o->length, 1.0f, 0.0001f, 0.01f);
+
+                if (gui_button(ctx, "switch direction"))
+                {
+                    float temp = o->length;
+                    o->length = o->width;
+                    o->width = temp;
+                }
+
+                logic_evalSplineGlobal(o->gT, o->gS, o->center, o->normal);
+                if (!glm_vec3_eqv(old.center, o->center) || old.width != o->width || old.length != o->length) {
+                    input->game.obstaclesChanged = true;
+                }
+            }
 
             gui_treePop(ctx);
         }
@@ -193,6 +291,57 @@ void renderGame(ProgContext ctx, InputData *input)
     }
 }
 
+void renderHeightBands(ProgContext ctx, InputData *input)
+{
+    if (gui_treePush(ctx, NK_TREE_NODE, "Height Bands", NK_MINIMIZED))
+    {
+        HeightBand *bands = input->surface.bands;
+        HeightBand old[HEIGHT_BAND_COUNT];
+        memcpy(old, bands, sizeof(old));
+
+        gui_layoutRowDynamic(ctx, 25, 1);
+        for (int i = 0; i < HEIGHT_BAND_COUNT; ++i)
+        {
+            char name[32];
+
+            // Bands stay ascending, the first one has no lower bound
+            if (i > 0)
+            {
+                float lo = i > 1 ? bands[i - 1].height : -100.0f;
+                float hi = i + 1 < HEIGHT_BAND_COUNT ? bands[i + 1].height : 100.0f;
+                snprintf(name, sizeof(name), "#band %d from", i);
+                gui_propertyFloat(ctx, name, lo, &bands[i].height, hi, 0.01f, 0.01f);
+            }
+            snprintf(name, sizeof(name), "band %d color", i);
+            gui_widgetColor3(ctx, name, bands[i].color);
+        }
+
+        input->surface.bandsChanged |= memcmp(old, bands, sizeof(old)) != 0;
+        gui_treePop(ctx);
+    }
+}
+
+void renderNoise(ProgContext ctx, InputData *input)
+{
+    if (gui_treePush(ctx, NK_TREE_NODE, "Noise Terrain", NK_MINIMIZED))
+    {
+        NoiseSettings *noise = &input->surface.noise;
+
+        gui_layoutRowDynamic(ctx, 25, 1);
+        gui_propertyInt(ctx, "octaves", 1, &noise->octaves, 8, 1, 1);
+        gui_propertyFloat(ctx, "frequency", 0.005f, &noise->frequency, 1.0f, 0.005f, 0.001f);
+        gui_propertyFloat(ctx, "amplitude", 0.0f, &noise->amplitude, 20.0f, 0.1f, 0.05f);
+        gui_propertyFloat(ctx, "gain", 0.0f, &noise->gain, 1.0f, 0.05f, 0.01f);
+        gui_checkbox(ctx, "Generate on GPU", &noise->gpu);
+
+        if (gui_button(ctx, "generate (0)"))
+        {
+            utils_applyHeightFunction(HF_NOISE);
+        }
+        gui_treePop(ctx);
+    }
+}
+
 void renderSurface(ProgContext ctx, InputData *input)
 {
     if (gui_treePush(ctx, NK_TREE_TAB, "Surface", NK_MINIMIZED))
@@ -211,9 +360,108 @@ void renderSurface(ProgContext ctx, InputData *input)
         gui_propertyFloat(ctx, "offset", 0, &input->surface.controlPointOffset, 2, 0.001f, 0.01f);
         input->surface.offsetChanged = !glm_eq(oldOffset, input->surface.controlPointOffset);
 
+        gui_layoutRowDynamic(ctx, 25, 2);
+        if (gui_button(ctx, "Save Surface"))
+        {
+            surfacefile_save(SURFACE_FILE, input);
+        }
+        if (gui_button(ctx, "Load Surface"))
+        {
+            surfacefile_load(SURFACE_FILE, input);
+        }
+        if (gui_button(ctx, "Generate Terrain"))
+        {
+            terraintiles_create(TERRAINTILES_FILE, input->surface.terrainTiles, input);
+        }
+        bool tiled = terraintiles_isOpen();
+        gui_checkbox(ctx, "Tiled Terrain", &tiled);
+        if (tiled != terraintiles_isOpen())
+        {
+            if (tiled)
+            {
+                terraintiles_open(TERRAINTILES_FILE);
+            }
+            else
+            {
+                terraintiles_close();
+            }
+        }
+        gui_layoutRowDynamic(ctx, 25, 1);
+        gui_propertyInt(ctx, "terrain tiles", TERRAINTILES_WINDOW_TILES, &input->surface.terrainTiles,
+            TERRAINTILES_MAX_TILES, 1, 0.5f);
+
+        TerrainTileStats tileStats;
+        terraintiles_getStats(&tileStats);
+        if (tileStats.open)
+        {
+            char tileInfo[64];
+            snprintf(tileInfo, sizeof(tileInfo), "Tile %d,%d of %d, %d resident, %d queued",
+                tileStats.originX, tileStats.originZ, tileStats.tilesPerAxis, tileStats.resident, tileStats.queued);
+            gui_label(ctx, tileInfo, NK_TEXT_LEFT);
+            snprintf(tileInfo, sizeof(tileInfo), "%ld tiles loaded, %ld moves", tileStats.loads, tileStats.shifts);
+            gui_label(ctx, tileInfo, NK_TEXT_LEFT);
+        }
+        if (gui_button(ctx, logic_isExporting() ? "Exporting..." : "Export PLY"))
+        {
+            logic_exportSurface(LOGIC_EXPORT_FILE, input);
+        }
+        gui_propertyInt(ctx, "export tris %", 1, &input->surface.exportPercent, 100, 1, 0.2f);
+
         gui_checkbox(ctx, "Control Points", &input->surface.showControlPoints);
         gui_checkbox(ctx, "Surface", &input->surface.showSurface);
+        gui_checkbox(ctx, "Tessellate (GPU)", &input->surface.tessellate);
+        gui_checkbox(ctx, "Chunked LOD", &input->surface.chunkLod);
+        gui_checkbox(ctx, "Quadric LOD", &input->surface.quadricLod);
+        gui_checkbox(ctx, "Heightmap (VTF)", &input->surface.heightmap);
+        gui_checkbox(ctx, "Heightmap Ray March", &input->surface.rayMarch);
+        gui_checkbox(ctx, "Cache Order Indices", &input->surface.cacheOrder);
+        gui_checkbox(ctx, "Resample Mesh on GPU", &input->surface.gpuMesh);
+        gui_propertyInt(ctx, "threads", 1, &input->surface.threadCount, jobs_getHardwareThreads(), 1, 0.1f);
+        gui_propertyInt(ctx, "upload KB/frame", 0, &input->surface.uploadBudgetKB, 65536, 256, 16.0f);
+
+        gui_layoutRowDynamic(ctx, 25, 2);
+        gui_label(ctx, "Kernel:", NK_TEXT_LEFT);
+        SimdKernel kernel = gui_dropdown(ctx, kernelDropdown, NK_LEN(kernelDropdown),
+            input->surface.kernel, 20, nk_vec2(200, 200)
+        );
+        if (evaluate_isSupported(kernel)) {
+            input->surface.kernel = kernel;
+        }
+
+        gui_layoutRowDynamic(ctx, 25, 1);
         gui_checkbox(ctx, "Normals", &input->showNormals);
+        gui_propertyInt(ctx, "Normal Stride", 1, &input->surface.normalStride, 32, 1, 1);
+        gui_checkbox(ctx, "Quality Governor", &input->quality.enabled);
+        gui_propertyFloat(ctx, "Budget ms", 1.0f, &input->quality.budgetMs, 100.0f, 0.5f, 0.05f);
+
+        gui_layoutRowDynamic(ctx, 25, 2);
+        char work[32];
+        snprintf(work, sizeof(work), "%.2f ms", input->quality.workMs);
+        gui_label(ctx, "Quality:", NK_TEXT_LEFT);
+        gui_label(ctx, qualityLevelNames[input->quality.level], NK_TEXT_RIGHT);
+        gui_label(ctx, "Work:", NK_TEXT_LEFT);
+        gui_label(ctx, work, NK_TEXT_RIGHT);
+        gui_layoutRowDynamic(ctx, 25, 1);
+
+        gui_checkbox(ctx, "Dynamic Resolution", &input->resolution.enabled);
+        gui_propertyFloat(ctx, "Min Scale", RESSCALE_MIN_SCALE, &input->resolution.minScale, 1.0f, RESSCALE_STEP, 0.01f);
+        gui_propertyFloat(ctx, "Sharpen", 0.0f, &input->resolution.sharpness, 1.0f, 0.05f, 0.01f);
+
+        gui_layoutRowDynamic(ctx, 25, 2);
+        char scale[32];
+        snprintf(scale, sizeof(scale), "%.0f %%", input->resolution.scale * 100.0f);
+        gui_label(ctx, "Scale:", NK_TEXT_LEFT);
+        gui_label(ctx, scale, NK_TEXT_RIGHT);
+        gui_layoutRowDynamic(ctx, 25, 1);
+
+        gui_propertyFloat(ctx, "Baked AO", 0.0f, &input->surface.aoStrength, 1.0f, 0.1f, 0.01f);
+
+        // The map is only baked while it is shown
+        bool oldNormalMap = input->surface.normalMap;
+        gui_checkbox(ctx, "Baked Normals", &input->surface.normalMap);
+        if (input->surface.normalMap && !oldNormalMap) {
+            input->surface.resolutionChanged = true;
+        }
         gui_checkbox(ctx, "Use Texture (T)", &input->surface.useTexture);
 
         if (input->surface.useTexture)
@@ -233,6 +481,9 @@ void renderSurface(ProgContext ctx, InputData *input)
             logic_printPolynomials();
         }
 
+        renderHeightBands(ctx, input);
+        renderNoise(ctx, input);
+
         gui_treePop(ctx);
     }
 }
@@ -245,6 +496,7 @@ void renderLight(ProgContext ctx, InputData *input)
 
         gui_checkbox(ctx, "enabled", &input->pointLight.enabled);
         gui_checkbox(ctx, "visualize", &input->pointLight.visualize);
+        gui_checkbox(ctx, "shadows", &input->pointLight.shadows);
         gui_widgetColor3(ctx, "color", input->pointLight.color);
         gui_propertyFloat(ctx, "falloff constant", 0.0f, &input->pointLight.falloff[0], 10.0f, 0.0001f, 0.01f);
         gui_propertyFloat(ctx, "falloff linear", 0.0f, &input->pointLight.falloff[1], 10.0f, 0.0001f, 0.01f);
@@ -254,6 +506,20 @@ void renderLight(ProgContext ctx, InputData *input)
         gui_propertyFloat(ctx, "radius", 0.001f, &input->pointLight.rotationRadius, 10.0f, 0.0001f, 0.01f);
         gui_widgetVec3(ctx, "center", input->pointLight.center, 10.0f, 0.001f, 0.01f);
 
+        char infoStr[50];
+        snprintf(infoStr, 49, "Static Shadow Redraws: %d", shadow_getStaticRedraws());
+        gui_label(ctx, infoStr, NK_TEXT_LEFT);
+
+        gui_label(ctx, "Clustered Lights", NK_TEXT_LEFT);
+        gui_propertyInt(ctx, "count", 0, &input->clusterLights.count, LIGHTGRID_MAX_LIGHTS, 1, 1.0f);
+        gui_propertyFloat(ctx, "light radius", 0.01f, &input->clusterLights.radius, 5.0f, 0.01f, 0.01f);
+        gui_propertyFloat(ctx, "intensity", 0.0f, &input->clusterLights.intensity, 10.0f, 0.01f, 0.05f);
+        gui_propertyFloat(ctx, "height", 0.0f, &input->clusterLights.height, 2.0f, 0.01f, 0.01f);
+        gui_propertyFloat(ctx, "orbit speed", 0.0f, &input->clusterLights.speed, 5.0f, 0.01f, 0.01f);
+        gui_checkbox(ctx, "visualize lights", &input->clusterLights.visualize);
+        snprintf(infoStr, 49, "Cluster Entries: %d", lightgrid_getIndexCount());
+        gui_label(ctx, infoStr, NK_TEXT_LEFT);
+
         gui_treePop(ctx);
     }
 }
@@ -307,6 +573,29 @@ void renderPhysicConstants(ProgContext ctx, InputData *input)
             gui_treePop(ctx);
         }
 
+        if (gui_treePush(ctx, NK_TREE_NODE, "Sleep", NK_MINIMIZED))
+        {
+            gui_checkbox(ctx, "enabled", &input->physics.sleep.enabled);
+            gui_propertyFloat(ctx, "velocity", 0.0f, &input->physics.sleep.velocity, 1.0f, 0.001f, 0.001f);
+            gui_propertyInt(ctx, "steps", 1, &input->physics.sleep.steps, 600, 1, 0.5f);
+            gui_treePop(ctx);
+        }
+
+        if (gui_treePush(ctx, NK_TREE_NODE, "Multi-Rate", NK_MINIMIZED))
+        {
+            gui_checkbox(ctx, "enabled", &input->physics.multiRate.enabled);
+            gui_propertyInt(ctx, "max level", 0, &input->physics.multiRate.maxLevel, PHYSICS_MAX_SUBSTEP_LEVEL, 1, 0.5f);
+            gui_propertyFloat(ctx, "safety", 0.05f, &input->physics.multiRate.safety, 1.0f, 0.05f, 0.01f);
+
+            char substeps[32];
+            snprintf(substeps, sizeof(substeps), "%d", physics_getBallSubsteps());
+            gui_layoutRowDynamic(ctx, 25, 2);
+            gui_label(ctx, "Ball Substeps:", NK_TEXT_LEFT);
+            gui_label(ctx, substeps, NK_TEXT_RIGHT);
+            gui_layoutRowDynamic(ctx, 25, 1);
+            gui_treePop(ctx);
+        }
+
         gui_treePop(ctx);
     }
 }
@@ -354,6 +643,55 @@ void renderPhysics(ProgContext ctx, InputData *input)
         gui_layoutRowDynamic(ctx, 25, 1);
 
         gui_propertyFloat(ctx, "fixed dt", 0.0001f, &input->physics.fixedDt, 1.0f, 0.0001f, 0.001f);
+        gui_propertyInt(ctx, "max steps", 1, &input->physics.maxSteps, 64, 1, 0.1f);
+        gui_checkbox(ctx, "interpolate", &input->physics.interpolate);
+        gui_checkbox(ctx, "sim thread", &input->physics.threaded);
+        gui_checkbox(ctx, "parallel solve", &input->physics.parallel);
+        gui_checkbox(ctx, "fast math", &input->physics.fastMath);
+        gui_checkbox(ctx, "swept contacts", &input->physics.sweep);
+        gui_checkbox(ctx, "GPU solve", &input->physics.gpu);
+
+        gui_layoutRowDynamic(ctx, 25, 2);
+        gui_label(ctx, "Integrator:", NK_TEXT_LEFT);
+        input->physics.integrator = gui_dropdown(ctx, integratorDropdown, NK_LEN(integratorDropdown),
+            input->physics.integrator, 20, nk_vec2(200, 200)
+        );
+
+        gui_label(ctx, "Contacts:", NK_TEXT_LEFT);
+        input->physics.solver = gui_dropdown(ctx, solverDropdown, NK_LEN(solverDropdown),
+            input->physics.solver, 20, nk_vec2(200, 200)
+        );
+        if (input->physics.solver != CS_PENALTY) {
+            gui_layoutRowDynamic(ctx, 25, 1);
+            gui_propertyInt(ctx, "iterations", 1, &input->physics.solverIterations,
+                PHYSICS_MAX_SOLVER_ITERATIONS, 1, 0.2f);
+            gui_propertyFloat(ctx, "compliance", 0.0f, &input->physics.compliance, 0.01f, 0.0001f, 0.0001f);
+            gui_layoutRowDynamic(ctx, 25, 2);
+        }
+
+        char stable[24];
+        float stableDt = physics_getStableDt();
+        if (stableDt <= 0.0f) {
+            snprintf(stable, sizeof(stable), "unstable");
+        } else if (stableDt == FLT_MAX) {
+            snprintf(stable, sizeof(stable), "any");
+        } else {
+            snprintf(stable, sizeof(stable), "%s%.4f", input->physics.fixedDt < stableDt ? "< " : "! < ", stableDt);
+        }
+        gui_label(ctx, "Stable dt:", NK_TEXT_LEFT);
+        gui_label(ctx, stable, NK_TEXT_RIGHT);
+
+        gui_label(ctx, "Trace:", NK_TEXT_LEFT);
+        input->physics.replayMode = gui_dropdown(ctx, replayModeDropdown, NK_LEN(replayModeDropdown),
+            input->physics.replayMode, 20, nk_vec2(200, 200)
+        );
+
+        char frames[16];
+        snprintf(frames, sizeof(frames), "%d", physics_getTraceFrames());
+        gui_label(ctx, "Trace Steps:", NK_TEXT_LEFT);
+        gui_label(ctx, frames, NK_TEXT_RIGHT);
+        gui_layoutRowDynamic(ctx, 25, 1);
+        gui_checkbox(ctx, "delta trace", &input->physics.traceDelta);
 
         gui_propertyFloat(ctx, "ball radius", 0.0001f, &input->physics.ballRadius, 20.0f, 0.0001f, 0.01f);
 
@@ -386,7 +724,36 @@ void renderGeneral(ProgContext ctx, InputData *input)
             input->paused = !input->paused;
         }
 
+        gui_layoutRowDynamic(ctx, 20, 2);
+        bool idleEnabled = idle_isEnabled();
+        if (gui_checkbox(ctx, "Idle", &idleEnabled))
+        {
+            idle_setEnabled(idleEnabled);
+        }
+        gui_label(ctx, idle_isIdle() ? "sleeping" : "rendering", NK_TEXT_RIGHT);
+        gui_layoutRowDynamic(ctx, 20, 2);
+        bool guiCacheEnabled = guicache_isEnabled();
+        if (gui_checkbox(ctx, "GUI Cache", &guiCacheEnabled))
+        {
+            guicache_setEnabled(guiCacheEnabled);
+        }
+        char reuseStr[24];
+        snprintf(reuseStr, sizeof(reuseStr), "%.0f%% reused", guicache_getReuse() * 100.0f);
+        gui_label(ctx, reuseStr, NK_TEXT_RIGHT);
+        gui_layoutRowDynamic(ctx, 20, 1);
+        float guiRate = guicache_getRate();
+        gui_propertyFloat(ctx, "GUI Hz", 0.0f, &guiRate, 120.0f, 5.0f, 1.0f);
+        guicache_setRate(guiRate);
+        gui_layoutRowDynamic(ctx, 20, 1);
+
         gui_checkbox(ctx, "Wireframe", &input->showWireframe);
+        gui_checkbox(ctx, "Depth Pre-Pass", &input->depthPrepass);
+        gui_checkbox(ctx, "Weighted Blended OIT", &input->oit);
+        gui_checkbox(ctx, "Multi-Draw Indirect", &input->multiDraw);
+        if (input->multiDraw) {
+            gui_checkbox(ctx, "Hi-Z Occlusion Culling", &input->occlusionCull);
+        }
+        gui_checkbox(ctx, "Profiler", &input->showProfiler);
 
         gui_treePop(ctx);
     }
@@ -497,6 +864,292 @@ static void gui_renderCameraControls(ProgContext ctx, InputData* input) {
     gui_end(ctx);
 }
 
+/**
+ * Renders one profiler row with average and maximum timings.
+ *
+ * @param ctx Program context
+ * @param stats Timings to show
+ * @param showGpu Whether the GPU column is filled
+ */
+static void gui_renderProfilerRow(ProgContext ctx, const ProfilerStats* stats, bool showGpu) {
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), "%*s%s", stats->depth * 2, "", stats->name);
+    gui_label(ctx, buf, NK_TEXT_LEFT);
+
+    snprintf(buf, sizeof(buf), "%.2f / %.2f", stats->cpuAvg, stats->cpuMax);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    if (showGpu) {
+        snprintf(buf, sizeof(buf), "%.2f / %.2f", stats->gpuAvg, stats->gpuMax);
+    } else {
+        snprintf(buf, sizeof(buf), "%d fps", stats->cpuAvg > 0.0f ? (int)(1000.0f / stats->cpuAvg) : 0);
+    }
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+}
+
+/**
+ * Formats a pipeline counter with a k or M suffix.
+ *
+ * @param buf Destination string
+ * @param size Size of the destination
+ * @param count Counter value
+ */
+static void gui_formatCount(char* buf, size_t size, GLuint64 count) {
+    if (count >= 1000000) {
+        snprintf(buf, size, "%.1fM", count / 1.0e6);
+    } else if (count >= 1000) {
+        snprintf(buf, size, "%.1fk", count / 1.0e3);
+    } else {
+        snprintf(buf, size, "%d", (int) count);
+    }
+}
+
+/**
+ * Renders the pipeline counters of a counted scope below its timings:
+ * primitives, vertex and fragment shader invocations if supported, and
+ * the samples that passed the depth test.
+ *
+ * @param ctx Program context
+ * @param stats Counters to show
+ */
+static void gui_renderCounterRow(ProgContext ctx, const ProfilerStats* stats) {
+    char buf[64], a[16], b[16];
+
+    gui_formatCount(a, sizeof(a), stats->primitives);
+    snprintf(buf, sizeof(buf), "%*s%s prim", stats->depth * 2 + 2, "", a);
+    gui_label(ctx, buf, NK_TEXT_LEFT);
+
+    if (profiler_hasPipelineStats()) {
+        gui_formatCount(a, sizeof(a), stats->vertexInvocations);
+        gui_formatCount(b, sizeof(b), stats->fragmentInvocations);
+        snprintf(buf, sizeof(buf), "%s vs %s fs", a, b);
+    } else {
+        buf[0] = '\0';
+    }
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    gui_formatCount(a, sizeof(a), stats->samples);
+    snprintf(buf, sizeof(buf), "%s px", a);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+}
+
+/**
+ * Renders one profiler row with the issued and skipped GL calls of the last frame.
+ *
+ * @param ctx Program context
+ * @param name Row label
+ * @param issued Number of calls passed to OpenGL
+ * @param skipped Number of redundant calls that were filtered
+ */
+static void gui_renderGlStateRow(ProgContext ctx, const char* name, int issued, int skipped) {
+    char buf[64];
+    gui_label(ctx, name, NK_TEXT_LEFT);
+
+    snprintf(buf, sizeof(buf), "%d set", issued);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    snprintf(buf, sizeof(buf), "%d skipped", skipped);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+}
+
+/**
+ * Renders the heap allocations of the scratch arenas and the frame arena use.
+ * Steady-state frames should show 0 allocations.
+ *
+ * @param ctx Program context
+ */
+static void gui_renderArenaRow(ProgContext ctx) {
+    ArenaStats stats;
+    arena_getStats(&stats);
+
+    char buf[64];
+    gui_label(ctx, "Heap allocs", NK_TEXT_LEFT);
+
+    snprintf(buf, sizeof(buf), "%d", stats.heapAllocs);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    snprintf(buf, sizeof(buf), "%u / %u KB", (unsigned) (stats.frameBytes / 1024),
+        (unsigned) (stats.frameCapacity / 1024));
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+}
+
+/**
+ * Renders the passes the frame graph ran and the memory of its transient
+ * targets, the sum of the used ones and what their shared textures take.
+ *
+ * @param ctx Program context
+ */
+static void gui_renderFrameGraphRow(ProgContext ctx) {
+    FramegraphStats stats;
+    framegraph_getStats(&stats);
+
+    char buf[64];
+    gui_label(ctx, "Frame graph", NK_TEXT_LEFT);
+
+    snprintf(buf, sizeof(buf), "%d / %d passes", stats.passes - stats.culled, stats.passes);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    snprintf(buf, sizeof(buf), "%.1f / %.1f MB", stats.requestedBytes / (1024.0 * 1024.0),
+        stats.allocatedBytes / (1024.0 * 1024.0));
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+}
+
+/**
+ * Renders the GPU memory of every used category and the total,
+ * each with its high-water mark.
+ *
+ * @param ctx Program context
+ */
+static void gui_renderGpuMemRows(ProgContext ctx) {
+    GpuMemStats stats;
+    gpumem_getStats(&stats);
+
+    char buf[64];
+    gui_label(ctx, "GPU memory", NK_TEXT_LEFT);
+    gui_label(ctx, "MB", NK_TEXT_RIGHT);
+    gui_label(ctx, "Peak MB", NK_TEXT_RIGHT);
+
+    for (int i = 0; i < GPUMEM_COUNT; ++i) {
+        if (stats.peak[i] == 0) {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "  %s", gpumem_categoryName((GpuMemCategory) i));
+        gui_label(ctx, buf, NK_TEXT_LEFT);
+
+        snprintf(buf, sizeof(buf), "%.2f", stats.bytes[i] / (1024.0 * 1024.0));
+        gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+        snprintf(buf, sizeof(buf), "%.2f", stats.peak[i] / (1024.0 * 1024.0));
+        gui_label(ctx, buf, NK_TEXT_RIGHT);
+    }
+
+    snprintf(buf, sizeof(buf), "  Total (%d)", stats.objects);
+    gui_label(ctx, buf, NK_TEXT_LEFT);
+
+    snprintf(buf, sizeof(buf), "%.2f", stats.totalBytes / (1024.0 * 1024.0));
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    snprintf(buf, sizeof(buf), "%.2f", stats.totalPeak / (1024.0 * 1024.0));
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+}
+
+/**
+ * Formats the misses per thousand instructions of the L1 data cache, the
+ * last level cache and the branches, "-" for unavailable counters.
+ *
+ * @param buf Destination string
+ * @param size Size of the destination
+ * @param phase Counts of a phase
+ */
+static void gui_formatMpki(char *buf, size_t size, const PerfPhase *phase) {
+    double perKilo = phase->counts[PC_INSTRUCTIONS] > 0 ? 1000.0 / phase->counts[PC_INSTRUCTIONS] : 0.0;
+    int used = 0;
+    for (int c = PC_L1D_MISSES; c <= PC_BRANCH_MISSES && used < (int) size; ++c) {
+        const char *sep = c > PC_L1D_MISSES ? "/" : "";
+        if (perfcount_hasCounter((PerfCounter) c)) {
+            used += snprintf(buf + used, size - used, "%s%.1f", sep, phase->counts[c] * perKilo);
+        } else {
+            used += snprintf(buf + used, size - used, "%s-", sep);
+        }
+    }
+}
+
+/**
+ * Renders the hardware counters of every phase in the last window:
+ * million cycles per frame, instructions per cycle and the misses per
+ * thousand instructions. Only shown with PERF_COUNTERS set.
+ *
+ * @param ctx Program context
+ */
+static void gui_renderPerfCountRows(ProgContext ctx) {
+    if (!perfcount_isEnabled()) {
+        return;
+    }
+
+    char buf[64];
+    gui_label(ctx, "HW counters", NK_TEXT_LEFT);
+    gui_label(ctx, "Mcyc / IPC", NK_TEXT_RIGHT);
+    gui_label(ctx, "MPKI L1/LL/br", NK_TEXT_RIGHT);
+
+    for (int i = 0; i < perfcount_getPhaseCount(); ++i) {
+        PerfPhase phase;
+        perfcount_getWindow(i, &phase);
+        if (phase.frames == 0 || phase.calls == 0) {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "  %s", phase.name);
+        gui_label(ctx, buf, NK_TEXT_LEFT);
+
+        long cycles = phase.counts[PC_CYCLES];
+        snprintf(buf, sizeof(buf), "%.2f / %.2f", cycles / 1.0e6 / phase.frames,
+            cycles > 0 ? (double) phase.counts[PC_INSTRUCTIONS] / cycles : 0.0);
+        gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+        gui_formatMpki(buf, sizeof(buf), &phase);
+        gui_label(ctx, buf, NK_TEXT_RIGHT);
+    }
+}
+
+/**
+ * Renders the profiler overlay with per scope CPU and GPU timings.
+ * Only displays if input->showProfiler is true.
+ *
+ * @param ctx Program context
+ * @param input Pointer to input data containing GUI state
+ */
+static void gui_renderProfiler(ProgContext ctx, InputData* input) {
+    if (!input->showProfiler) {
+        return;
+    }
+
+    int w;
+    window_getRealSize(ctx, &w, NULL);
+    float width = 330.0f;
+
+    if (gui_beginTitled(ctx, GUI_WINDOW_PROFILER, "Profiler (avg / max ms)",
+        nk_rect((float) w - width - 15, 15, width, 300),
+        NK_WINDOW_BORDER | NK_WINDOW_MOVABLE | NK_WINDOW_SCALABLE |
+        NK_WINDOW_MINIMIZABLE | NK_WINDOW_TITLE))
+    {
+        gui_layoutRowDynamic(ctx, 25, 2);
+        gui_label(ctx, "Instrumentation:", NK_TEXT_LEFT);
+        int level = gui_dropdown(ctx, instrumentDropdown, INSTRUMENT_LEVEL + 1,
+            instrument_getLevel(), 20, nk_vec2(200, 200)
+        );
+        if (level != instrument_getLevel()) {
+            instrument_setLevel(level);
+        }
+
+        gui_layoutRowDynamic(ctx, 18, 3);
+        gui_label(ctx, "Scope", NK_TEXT_LEFT);
+        gui_label(ctx, "CPU", NK_TEXT_RIGHT);
+        gui_label(ctx, "GPU", NK_TEXT_RIGHT);
+
+        ProfilerStats stats;
+        profiler_getFrameStats(&stats);
+        gui_renderProfilerRow(ctx, &stats, false);
+
+        for (int i = 0; i < profiler_getScopeCount(); ++i) {
+            profiler_getScopeStats(i, &stats);
+            gui_renderProfilerRow(ctx, &stats, true);
+            if (stats.counted) {
+                gui_renderCounterRow(ctx, &stats);
+            }
+        }
+
+        GlStateStats glStats;
+        glstate_getStats(&glStats);
+        gui_renderGlStateRow(ctx, "GL state", glStats.stateChanges, glStats.stateSkipped);
+        gui_renderGlStateRow(ctx, "GL binds", glStats.binds, glStats.bindsSkipped);
+        gui_renderArenaRow(ctx);
+        gui_renderFrameGraphRow(ctx);
+        gui_renderGpuMemRows(ctx);
+        gui_renderPerfCountRows(ctx);
+    }
+    gui_end(ctx);
+}
+
 ////////////////////////     PUBLIC    ////////////////////////////
 
 void gui_renderContent(ProgContext ctx) {
@@ -506,4 +1159,5 @@ void gui_renderContent(ProgContext ctx) {
     gui_renderMenu(ctx, input);
     gui_renderGameStatus(ctx);
     gui_renderCameraControls(ctx, input);
+    gui_renderProfiler(ctx, input);
 }
@@ -0,0 +1,103 @@
+/**
+ * @file heights.c
+ * @brief Implementation of the min/max height pyramid
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "heights.h"
+
+#include <float.h>
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/** Bounds of a region without samples */
+static const HeightBounds EMPTY_BOUNDS = {
+    .minPoint = {0.0f, FLT_MAX, 0.0f},
+    .maxPoint = {0.0f, -FLT_MAX, 0.0f}
+};
+
+/**
+ * Merges one bounds into another.
+ * On equal heights the bounds merged first win.
+ * @param dest Bounds to extend.
+ * @param src Bounds to merge.
+ */
+static void mergeBounds(HeightBounds *dest, const HeightBounds *src) {
+    if (src->minPoint[1] < dest->minPoint[1]) glm_vec3_copy((float*) src->minPoint, dest->minPoint);
+    if (src->maxPoint[1] > dest->maxPoint[1]) glm_vec3_copy((float*) src->maxPoint, dest->maxPoint);
+}
+
+/**
+ * Recombines one node from the up to 2×2 nodes below it.
+ * @param p Pyramid.
+ * @param level Level of the node (> 0).
+ * @param s Node row.
+ * @param t Node column.
+ */
+static void combineNode(HeightPyramid *p, int level, int s, int t) {
+    int childSize = p->size[level - 1];
+    const HeightBounds *children = &p->nodes[p->offset[level - 1]];
+    HeightBounds *node = &p->nodes[p->offset[level] + s * p->size[level] + t];
+
+    *node = EMPTY_BOUNDS;
+    for (int cs = 2 * s; cs <= 2 * s + 1 && cs < childSize; ++cs) {
+        for (int ct = 2 * t; ct <= 2 * t + 1 && ct < childSize; ++ct) {
+            mergeBounds(node, &children[cs * childSize + ct]);
+        }
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void heights_resize(HeightPyramid *p, int patchCount) {
+    if (patchCount < 1) patchCount = 1;
+    if (p->levelCount > 0 && p->size[0] == patchCount) {
+        return;
+    }
+
+    int total = 0;
+    int size = patchCount;
+    p->levelCount = 0;
+    for (;;) {
+        assert(p->levelCount < HEIGHTS_MAX_LEVELS && "too many patches in heights_resize");
+        p->offset[p->levelCount] = total;
+        p->size[p->levelCount] = size;
+        p->levelCount++;
+        total += size * size;
+        if (size == 1) break;
+        size = (size + 1) / 2;
+    }
+
+    if (p->capacity < total) {
+        free(p->nodes);
+        p->nodes = malloc(total * sizeof(HeightBounds));
+        assert(p->nodes && "malloc failed in heights_resize");
+        p->capacity = total;
+    }
+}
+
+void heights_free(HeightPyramid *p) {
+    free(p->nodes);
+    *p = (HeightPyramid) {0};
+}
+
+void heights_clear(HeightPyramid *p, int loS, int hiS, int loT, int hiT) {
+    for (int s = loS; s <= hiS; ++s) {
+        for (int t = loT; t <= hiT; ++t) {
+            *heights_leaf(p, s, t) = EMPTY_BOUNDS;
+        }
+    }
+}
+
+void heights_update(HeightPyramid *p, int loS, int hiS, int loT, int hiT) {
+    for (int level = 1; level < p->levelCount; ++level) {
+        loS >>= 1; hiS >>= 1;
+        loT >>= 1; hiT >>= 1;
+        for (int s = loS; s <= hiS; ++s) {
+            for (int t = loT; t <= hiT; ++t) {
+                combineNode(p, level, s, t);
+            }
+        }
+    }
+}
@@ -0,0 +1,120 @@
+/**
+ * @file heights.h
+ * @brief Min/max pyramid over the sampled heights of the surface patches
+ *
+ * Level 0 holds the lowest and highest sample of every patch, each
+ * higher level combines 2×2 nodes of the level below until a single
+ * root remains. Changing a rectangle of patches only recombines the
+ * nodes above it.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef HEIGHTS_H
+#define HEIGHTS_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Enough levels for 2^15 patches per axis */
+#define HEIGHTS_MAX_LEVELS 16
+
+/**
+ * Lowest and highest sample of a region.
+ * An empty region has minPoint[1] = FLT_MAX and maxPoint[1] = -FLT_MAX.
+ */
+typedef struct {
+    vec3 minPoint;
+    vec3 maxPoint;
+} HeightBounds;
+
+/**
+ * Min/max pyramid, all levels are stored row-major in one array.
+ */
+typedef struct {
+    HeightBounds *nodes;
+    int capacity;
+    int levelCount;
+    int offset[HEIGHTS_MAX_LEVELS];  // first node of each level
+    int size[HEIGHTS_MAX_LEVELS];    // nodes per axis of each level
+} HeightPyramid;
+
+/**
+ * Resizes the pyramid to patchCount×patchCount leaves.
+ * Keeps the nodes if the size did not change, otherwise they are undefined
+ * until every leaf is filled and heights_update has run.
+ * @param p Pyramid to resize.
+ * @param patchCount Number of patches per axis.
+ */
+void heights_resize(HeightPyramid *p, int patchCount);
+
+/**
+ * Frees the nodes of the pyramid.
+ * @param p Pyramid to free.
+ */
+void heights_free(HeightPyramid *p);
+
+/**
+ * Empties the leaves of a rectangle of patches.
+ * @param p Pyramid.
+ * @param loS First patch row.
+ * @param hiS Last patch row (inclusive).
+ * @param loT First patch column.
+ * @param hiT Last patch column (inclusive).
+ */
+void heights_clear(HeightPyramid *p, int loS, int hiS, int loT, int hiT);
+
+/**
+ * Recombines all nodes above a rectangle of changed leaves.
+ * @param p Pyramid.
+ * @param loS First patch row.
+ * @param hiS Last patch row (inclusive).
+ * @param loT First patch column.
+ * @param hiT Last patch column (inclusive).
+ */
+void heights_update(HeightPyramid *p, int loS, int hiS, int loT, int hiT);
+
+/**
+ * Returns the leaf of a patch.
+ * @param p Pyramid.
+ * @param s Patch row.
+ * @param t Patch column.
+ * @return Bounds of the patch.
+ */
+static inline HeightBounds* heights_leaf(HeightPyramid *p, int s, int t) {
+    return &p->nodes[s * p->size[0] + t];
+}
+
+/**
+ * Returns a node of the pyramid. Node (s, t) of level l covers the
+ * leaves [s * 2^l, (s + 1) * 2^l) × [t * 2^l, (t + 1) * 2^l).
+ * @param p Pyramid.
+ * @param level Level of the node, 0 are the leaves.
+ * @param s Node row.
+ * @param t Node column.
+ * @return Bounds of the node.
+ */
+static inline const HeightBounds* heights_node(const HeightPyramid *p, int level, int s, int t) {
+    return &p->nodes[p->offset[level] + s * p->size[level] + t];
+}
+
+/**
+ * Returns the bounds of the whole surface.
+ * @param p Pyramid.
+ * @return Bounds stored in the root.
+ */
+static inline const HeightBounds* heights_root(const HeightPyramid *p) {
+    return &p->nodes[p->offset[p->levelCount - 1]];
+}
+
+/**
+ * Adds a sample to a region.
+ * The first of several equal samples is kept.
+ * @param b Bounds of the region.
+ * @param pos Position of the sample.
+ */
+static inline void heights_addSample(HeightBounds *b, const vec3 pos) {
+    if (pos[1] < b->minPoint[1]) glm_vec3_copy((float*) pos, b->minPoint);
+    if (pos[1] > b->maxPoint[1]) glm_vec3_copy((float*) pos, b->maxPoint);
+}
+
+#endif // HEIGHTS_H
@@ -0,0 +1,182 @@
+/**
+ * @file hiz.c
+ * @brief Implementation of the Hi-Z pyramid
+ *
+ * The depth copy and the pyramid are transient textures of the frame graph,
+ * which grow to the largest viewport seen, only their lower left part is
+ * built. The depth is blitted into a depth texture of the scene's format,
+ * which is checked on the first build. If the copy fails the pyramid
+ * reports itself unavailable and nothing is culled.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "hiz.h"
+#include "shader.h"
+#include "glstate.h"
+#include "gpumem.h"
+
+#define HIZ_GROUP_SIZE 16   // must match hizBuild.comp
+#define HIZ_UNIT 7          // must match shader.c
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Targets of the last build and its viewport.
+ */
+static struct {
+    GLuint fbo, depth, pyramid;
+    bool checked;           // the framebuffer was complete once
+    bool verified;          // the depth copy worked once
+    bool unsupported;
+
+    int drawWidth, drawHeight, drawLevels;
+    bool valid;
+} g_hiz = { 0 };
+
+/**
+ * Returns the number of mip levels down to a single texel.
+ * @param size Largest side of level 0.
+ * @return Number of levels.
+ */
+static int levelCount(int size) {
+    int levels = 1;
+    while ((size >> levels) > 0) {
+        ++levels;
+    }
+    return levels;
+}
+
+/**
+ * Attaches the depth copy target to the framebuffer of the copy. The
+ * completeness only depends on the format, it is checked once.
+ * @param depth Depth copy target.
+ * @param sceneFbo Framebuffer to restore.
+ * @return False if the framebuffer is not complete.
+ */
+static bool attachDepth(GLuint depth, GLint sceneFbo) {
+    if (!g_hiz.fbo) {
+        glGenFramebuffers(1, &g_hiz.fbo);
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g_hiz.fbo);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+    GLenum status = GL_FRAMEBUFFER_COMPLETE;
+    if (!g_hiz.checked) {
+        glDrawBuffer(GL_NONE);
+        status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+        g_hiz.checked = true;
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sceneFbo);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Hi-Z targets incomplete (0x%x), no occlusion culling\n", status);
+        g_hiz.unsupported = true;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Copies the scene depth in the viewport, checks the copy on the first use.
+ * @param sceneFbo Framebuffer to copy from, bound again afterwards.
+ * @param viewport Viewport of the scene.
+ * @return False if the depth formats do not match.
+ */
+static bool copyDepth(GLint sceneFbo, const GLint *viewport) {
+    if (!g_hiz.verified) {
+        while (glGetError() != GL_NO_ERROR) {}
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g_hiz.fbo);
+    glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3],
+                      0, 0, viewport[2], viewport[3], GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+
+    if (!g_hiz.verified) {
+        if (glGetError() != GL_NO_ERROR) {
+            printf("Scene depth cannot be copied, no occlusion culling\n");
+            g_hiz.unsupported = true;
+            return false;
+        }
+        g_hiz.verified = true;
+    }
+    return true;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void hiz_cleanup(void) {
+    glDeleteFramebuffers(1, &g_hiz.fbo);
+    memset(&g_hiz, 0, sizeof(g_hiz));
+}
+
+void hiz_invalidate(void) {
+    g_hiz.valid = false;
+}
+
+bool hiz_build(GLuint depth, GLuint pyramid) {
+    g_hiz.valid = false;
+    if (g_hiz.unsupported || !depth || !pyramid) {
+        return false;
+    }
+
+    GLint viewport[4];
+    GLint sceneFbo;
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &sceneFbo);
+    int width = viewport[2];
+    int height = viewport[3];
+    if (width <= 0 || height <= 0 || !attachDepth(depth, sceneFbo) || !copyDepth(sceneFbo, viewport)) {
+        return false;
+    }
+    g_hiz.depth = depth;
+    g_hiz.pyramid = pyramid;
+
+    // Level 0 reads the depth copy, every further level the one below
+    glActiveTexture(GL_TEXTURE0 + HIZ_UNIT);
+    glBindTexture(GL_TEXTURE_2D, g_hiz.depth);
+    glActiveTexture(GL_TEXTURE0);
+
+    int levels = levelCount(glm_imax(width, height));
+    int srcWidth = width;
+    int srcHeight = height;
+    for (int level = 0; level < levels; ++level) {
+        int w = glm_imax(width >> level, 1);
+        int h = glm_imax(height >> level, 1);
+        if (!shader_setHizBuild(level, srcWidth, srcHeight, w, h)) {
+            return false;
+        }
+        glBindImageTexture(0, g_hiz.pyramid, level > 0 ? level - 1 : 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, g_hiz.pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((w + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (h + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        srcWidth = w;
+        srcHeight = h;
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    g_hiz.drawWidth = width;
+    g_hiz.drawHeight = height;
+    g_hiz.drawLevels = levels;
+    g_hiz.valid = true;
+    return true;
+}
+
+bool hiz_isValid(void) {
+    return g_hiz.valid;
+}
+
+bool hiz_bind(vec2 size, int *levels) {
+    if (!g_hiz.valid) {
+        return false;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + HIZ_UNIT);
+    glBindTexture(GL_TEXTURE_2D, g_hiz.pyramid);
+    glActiveTexture(GL_TEXTURE0);
+    size[0] = (float) g_hiz.drawWidth;
+    size[1] = (float) g_hiz.drawHeight;
+    *levels = g_hiz.drawLevels;
+    return true;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file hiz.h
+ * @brief Hierarchical-Z pyramid of the scene depth for occlusion culling
+ *
+ * The depth drawn so far is copied out of the bound framebuffer and reduced
+ * into a mip chain whose texels hold the farthest depth below them. A
+ * bounding rectangle is then tested with four texel fetches on the level
+ * where it spans at most 2x2 texels.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef HIZ_H
+#define HIZ_H
+
+#include <fhwcg/fhwcg.h>
+
+/**
+ * Deletes the framebuffer of the depth copy.
+ */
+void hiz_cleanup(void);
+
+/**
+ * Marks the pyramid as outdated, e.g. at the start of a new frame.
+ */
+void hiz_invalidate(void);
+
+/**
+ * Copies the depth of the bound framebuffer in the current viewport and
+ * builds the pyramid from it. The framebuffer stays bound.
+ * @param depth Depth copy target, GL_DEPTH24_STENCIL8 of at least the viewport size.
+ * @param pyramid Pyramid target, GL_R32F with the full mip chain of at least the viewport size.
+ *                Both stay in use until the next hiz_invalidate.
+ * @return False if the depth cannot be copied or the shader is missing.
+ */
+bool hiz_build(GLuint depth, GLuint pyramid);
+
+/**
+ * Returns if the pyramid was built since the last hiz_invalidate.
+ * @return true if hiz_bind can be used.
+ */
+bool hiz_isValid(void);
+
+/**
+ * Binds the pyramid to the texture unit read by the occlusion cull shader.
+ * @param size Destination for the size of level 0, the viewport it was built in.
+ * @param levels Destination for the number of built levels.
+ * @return False if the pyramid is not valid.
+ */
+bool hiz_bind(vec2 size, int *levels);
+
+#endif // HIZ_H
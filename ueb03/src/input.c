@@ -12,11 +12,20 @@
 #include <fhwcg/fhwcg.h>
 
 #include "input.h"
+#include "idle.h"
+#include "guicache.h"
+#include "timeline.h"
 #include "rendering.h"
 #include "shader.h"
+#include "resarchive.h"
 #include "utils.h"
 #include "logic.h"
 #include "physics.h"
+#include "jobs.h"
+#include "evaluate.h"
+#include "inputqueue.h"
+#include "terraintiles.h"
+#include "upload.h"
 
 #define CAM_START_POS VEC3(0, 2, 1.8f)
 #define CAM_SPEED 0.5f
@@ -29,10 +38,12 @@
 #define SURFACE_START_RES 100
 #define CONTROL_POINT_OFFSET 0.1f
 #define SELECTED_CONTROL_POINT_Y_CHANGE 0.01f
+#define UPLOAD_BUDGET_KB (UPLOAD_DEFAULT_BUDGET >> 10)
 
 #define DEFAULT_GRAVITY 9.81f
 #define DEFAULT_MASS 50.0f
 #define DEFAULT_FIXED_DT (1.0f / 120.0f);
+#define MAX_STEPS_PER_FRAME 8
 #define DEFAULT_BALL_RADIUS 0.05f
 
 #define WALL_SPRING_CONSTANT 200.0f
@@ -42,12 +53,41 @@
 #define WALL_DAMPING 0.9f
 #define BALL_DAMPING 0.6f
 #define OBSTACLE_DAMPING 0.75f
+#define SLEEP_VELOCITY 0.02f
+#define SLEEP_STEPS 60
+#define MULTIRATE_MAX_LEVEL 4
+#define MULTIRATE_SAFETY 0.5f
+#define SOLVER_ITERATIONS 4
+#define QUALITY_BUDGET_MS 14.0f
+#define RESOLUTION_MIN_SCALE 0.5f
+#define RESOLUTION_SHARPNESS 0.25f
+#define CLUSTER_LIGHT_RADIUS 0.4f
+#define CLUSTER_LIGHT_INTENSITY 1.5f
+#define CLUSTER_LIGHT_HEIGHT 0.1f
+#define CLUSTER_LIGHT_SPEED 0.2f
 
 ////////////////////////    LOCAL    ////////////////////////////
 
 /** Global application state containing all input, settings. */
 static InputData g_input = { 0 };
 
+/** Program context the camera belongs to */
+static ProgContext g_ctx = NULL;
+
+/** Mouse buttons held down, replayed to a recreated camera */
+static bool g_buttonsDown[GLFW_MOUSE_BUTTON_LAST + 1] = { false };
+
+/** Height bands of the surface shading, lowest first */
+static const HeightBand DEFAULT_HEIGHT_BANDS[HEIGHT_BAND_COUNT] = {
+    { -5.0f,   {0.0f, 0.0f, 1.0f}, {0.05f, 0.05f, 0.1f},  {0.1f, 0.1f, 0.2f},    {0.0f, 0.0f, 0.0f},   8.0f },
+    { -1.0f,   {0.1f, 0.0f, 0.7f}, {0.05f, 0.05f, 0.1f},  {0.05f, 0.05f, 0.2f},  {0.0f, 0.0f, 0.0f},  12.0f },
+    { -0.25f,  {0.0f, 0.0f, 0.5f}, {0.05f, 0.05f, 0.1f},  {0.05f, 0.05f, 0.1f},  {0.0f, 0.0f, 0.0f},  16.0f },
+    { 0.001f,  {0.0f, 0.5f, 0.0f}, {0.05f, 0.1f, 0.05f},  {0.05f, 0.2f, 0.05f},  {0.0f, 0.0f, 0.0f},  20.0f },
+    { 0.25f,   {0.5f, 0.5f, 0.0f}, {0.1f, 0.1f, 0.05f},   {0.3f, 0.3f, 0.1f},    {0.0f, 0.0f, 0.0f},  32.0f },
+    { 0.6f,    {0.5f, 0.2f, 0.3f}, {0.1f, 0.05f, 0.05f},  {0.4f, 0.2f, 0.2f},    {0.2f, 0.1f, 0.05f}, 48.0f },
+    { 2.0f,    {0.5f, 0.1f, 0.1f}, {0.1f, 0.05f, 0.05f},  {0.4f, 0.1f, 0.1f},    {0.5f, 0.2f, 0.1f},  64.0f }
+};
+
 /**
  * Callback to handle all keyboard input.
  *
@@ -58,14 +98,20 @@ static InputData g_input = { 0 };
  */
 static void input_keyEvent(ProgContext ctx, int key, int action, int mods) {
     NK_UNUSED(mods);
+    idle_onInput(action);
+    guicache_onInput();
 
+    // Repeats and duplicate events of held keys change nothing
+    bool changed = inputqueue_key(key, action);
     InputData* data = getInputData();
-    camera_keyboardCallback(data->cam.data, key, action);
+    if (changed) {
+        camera_keyboardCallback(data->cam.data, key, action);
+    }
 
-    data->selection.pressingUp = (key == GLFW_KEY_UP) && (action != GLFW_RELEASE);
-    data->selection.pressingDown = (key == GLFW_KEY_DOWN) && (action != GLFW_RELEASE);
+    data->selection.pressingUp = inputqueue_isKeyDown(GLFW_KEY_UP);
+    data->selection.pressingDown = inputqueue_isKeyDown(GLFW_KEY_DOWN);
 
-    if (action != GLFW_PRESS) {
+    if (!changed || action != GLFW_PRESS) {
         return;
     }
 
@@ -91,7 +137,17 @@ static void input_keyEvent(ProgContext ctx, int key, int action, int mods) {
             data->showMenu = !data->showMenu;
             break;
 
+        case GLFW_KEY_F5:
+            data->showProfiler = !data->showProfiler;
+            break;
+
+        case GLFW_KEY_F6:
+            timeline_toggle();
+            break;
+
         case GLFW_KEY_R:
+            // The edited sources are newer than the archive
+            resarchive_invalidateKind(RES_SHADER);
             shader_load();
             break;
 
@@ -104,7 +160,13 @@ static void input_keyEvent(ProgContext ctx, int key, int action, int mods) {
             break;
 
         case GLFW_KEY_G:
+            physics_lock();
             physics_resetGame();
+            physics_unlock();
+            break;
+
+        case GLFW_KEY_0:
+            utils_applyHeightFunction(HF_NOISE);
             break;
 
         case GLFW_KEY_1:
@@ -166,6 +228,25 @@ static void input_frameBufferSizeEvent(ProgContext ctx, int width, int height) {
     rendering_resize(width, height);
 }
 
+/**
+ * Handles the mouse movement coalesced over a frame, the camera turns
+ * once by the whole movement and the picking cursor takes the last position.
+ *
+ * @param ctx Program context
+ * @param move Last position and summed movement
+ */
+static void input_handleMouseMove(ProgContext ctx, const InputMove *move) {
+    InputData* data = getInputData();
+    camera_mouseMoveCallback(data->cam.data, ctx, move->x, move->y);
+
+    int width, height;
+    window_getRealSize(ctx, &width, &height);
+    if (width > 0 && height > 0) {
+        data->selection.cursor[0] = move->x / width;
+        data->selection.cursor[1] = move->y / height;
+    }
+}
+
 /**
  * Callback for mouse button events (press and release).
  * Stores button and action in InputData
@@ -177,43 +258,78 @@ static void input_frameBufferSizeEvent(ProgContext ctx, int width, int height) {
  */
 static void input_mouseButtonEvent(ProgContext ctx, int button, int action, int mods) {
     NK_UNUSED(mods);
-    NK_UNUSED(ctx);
+    idle_onInput(action);
+    guicache_onInput();
+    inputqueue_flush(ctx, input_handleMouseMove);
 
     InputData* data = getInputData();
     camera_mouseButtonCallback(data->cam.data, button, action);
+    if (button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST) {
+        g_buttonsDown[button] = action != GLFW_RELEASE;
+    }
+
+    if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) {
+        data->selection.pickRequested = true;
+    }
 }
 
 /**
  * Callback for mouse movement events.
- * Updates mouse position in InputData.
+ * Only records the position, input_flushEvents handles it once per frame.
  *
  * @param ctx Program context
  * @param x Mouse X coordinate
  * @param y Mouse Y coordinate
  */
 static void input_mouseMoveEvent(ProgContext ctx, double x, double y) {
-    InputData* data = getInputData();
-    camera_mouseMoveCallback(data->cam.data, ctx, (float) x, (float) y);
+    NK_UNUSED(ctx);
+    guicache_onInput();
+    inputqueue_mouseMove(x, y);
+}
+
+/**
+ * Callback for mouse wheel events, only the GUI reacts to them.
+ *
+ * @param ctx Program context
+ * @param x Horizontal scroll offset
+ * @param y Vertical scroll offset
+ */
+static void input_mouseScrollEvent(ProgContext ctx, double x, double y) {
+    NK_UNUSED(ctx);
+    NK_UNUSED(x);
+    NK_UNUSED(y);
+    guicache_onInput();
+}
+
+/**
+ * Callback for text input, only the GUI reacts to it.
+ *
+ * @param ctx Program context
+ * @param codepoint Unicode codepoint of the typed character
+ */
+static void input_textEvent(ProgContext ctx, unsigned int codepoint) {
+    NK_UNUSED(ctx);
+    NK_UNUSED(codepoint);
+    guicache_onInput();
 }
 
 
 ////////////////////////     PUBLIC    ////////////////////////////
 
-void input_init(ProgContext ctx) {
+void input_initDefaults(void) {
     g_input.isFullscreen = false;
     g_input.showHelp = false;
     g_input.showMenu = true;
+    g_input.showProfiler = false;
     g_input.showWireframe = false;
     g_input.paused = false;
     g_input.showNormals = false;
+    g_input.depthPrepass = false;
+    g_input.oit = true;
+    g_input.multiDraw = true;
+    g_input.occlusionCull = false;
 
-    g_input.cam.data = camera_createCamera(
-        ctx, CAM_START_POS,
-        CAM_SPEED, CAM_FAST_SPEED,
-        CAM_SENSITIVITY, CAM_YAW, CAM_PITCH
-    );
-    camera_getPosition(g_input.cam.data, g_input.cam.pos);
-    camera_getFront(g_input.cam.data, g_input.cam.dir);
+    glm_vec3_copy(CAM_START_POS, g_input.cam.pos);
     g_input.cam.isFlying = false;
     g_input.cam.flight.duration = 1.0f;
     g_input.cam.flight.t = 1.0f;
@@ -225,21 +341,46 @@ void input_init(ProgContext ctx) {
     g_input.surface.offsetChanged = true;
     g_input.surface.showControlPoints = true;
     g_input.surface.showSurface = true;
+    g_input.surface.tessellate = true;
+    g_input.surface.chunkLod = true;
+    g_input.surface.quadricLod = false;
+    g_input.surface.heightmap = false;
+    g_input.surface.rayMarch = false;
+    g_input.surface.cacheOrder = true;
+    g_input.surface.exportPercent = 100;
+    g_input.surface.terrainTiles = TERRAINTILES_DEFAULT_TILES;
+    g_input.surface.gpuMesh = true;
+    g_input.surface.normalStride = 1;
+    g_input.surface.threadCount = jobs_getHardwareThreads();
+    g_input.surface.uploadBudgetKB = UPLOAD_BUDGET_KB;
+    g_input.surface.kernel = evaluate_bestKernel();
     g_input.surface.controlPointOffset = CONTROL_POINT_OFFSET;
     g_input.surface.useTexture = false;
     g_input.surface.currentTextureIndex = 0;
     g_input.surface.textureTiling = 4.0f;
+    memcpy(g_input.surface.bands, DEFAULT_HEIGHT_BANDS, sizeof(DEFAULT_HEIGHT_BANDS));
+    g_input.surface.bandsChanged = true;
+    g_input.surface.aoStrength = 1.0f;
+    g_input.surface.normalMap = false;
+    g_input.surface.noise.octaves = 5;
+    g_input.surface.noise.frequency = 0.08f;
+    g_input.surface.noise.amplitude = 3.0f;
+    g_input.surface.noise.gain = 0.5f;
+    g_input.surface.noise.gpu = true;
     g_input.surface.extremesValid = false;
-    vec3arr_init(&g_input.surface.controlPoints);
+    Vec3Arr_init(&g_input.surface.controlPoints);
 
     g_input.selection.selectedCp = 0;
     g_input.selection.skipCnt = 1;
     g_input.selection.selectedYChange = SELECTED_CONTROL_POINT_Y_CHANGE;
     g_input.selection.pressingDown = false;
     g_input.selection.pressingUp = false;
+    g_input.selection.pickRequested = false;
+    glm_vec2_zero(g_input.selection.cursor);
 
     g_input.pointLight.visualize = false;
     g_input.pointLight.enabled = false;
+    g_input.pointLight.shadows = true;
     g_input.pointLight.ambientFactor = 0.3f;
     g_input.pointLight.speed = 1.0f;
     g_input.pointLight.rotationRadius = 0.5f;
@@ -247,9 +388,27 @@ void input_init(ProgContext ctx) {
     glm_vec3_copy(VEC3(0.8f, 1.0f, 1.0f), g_input.pointLight.color);
     glm_vec3_copy(VEC3(0, 0, 0), g_input.pointLight.posWS);
 
+    g_input.clusterLights.count = 0;
+    g_input.clusterLights.radius = CLUSTER_LIGHT_RADIUS;
+    g_input.clusterLights.intensity = CLUSTER_LIGHT_INTENSITY;
+    g_input.clusterLights.height = CLUSTER_LIGHT_HEIGHT;
+    g_input.clusterLights.speed = CLUSTER_LIGHT_SPEED;
+    g_input.clusterLights.visualize = false;
+
     g_input.physics.gravity = DEFAULT_GRAVITY;
     g_input.physics.mass = DEFAULT_MASS;
     g_input.physics.fixedDt = DEFAULT_FIXED_DT;
+    g_input.physics.maxSteps = MAX_STEPS_PER_FRAME;
+    g_input.physics.interpolate = true;
+    g_input.physics.threaded = false;
+    g_input.physics.parallel = true;
+    g_input.physics.fastMath = false;
+    g_input.physics.sweep = true;
+    g_input.physics.gpu = false;
+    g_input.physics.integrator = IG_SYMPLECTIC;
+    g_input.physics.solver = CS_PENALTY;
+    g_input.physics.solverIterations = SOLVER_ITERATIONS;
+    g_input.physics.compliance = 0.0f;
     g_input.physics.ballRadius = DEFAULT_BALL_RADIUS;
     g_input.physics.frictionFactor = FRICTION_FACTOR;
     g_input.physics.ballSpawnRadius = 1.0f;
@@ -257,6 +416,14 @@ void input_init(ProgContext ctx) {
     g_input.physics.blackHoleStrength = 5.0f;
     g_input.physics.blackHoleCaptureRadius = 0.1f;
     g_input.physics.kickStrength = 0.75;
+    g_input.physics.replayMode = RM_OFF;
+    g_input.physics.traceDelta = true;
+    g_input.physics.sleep.enabled = true;
+    g_input.physics.sleep.velocity = SLEEP_VELOCITY;
+    g_input.physics.sleep.steps = SLEEP_STEPS;
+    g_input.physics.multiRate.enabled = true;
+    g_input.physics.multiRate.maxLevel = MULTIRATE_MAX_LEVEL;
+    g_input.physics.multiRate.safety = MULTIRATE_SAFETY;
 
     g_input.physics.ball.damping = BALL_DAMPING;
     g_input.physics.ball.spring = BALL_SPRING_CONSTANT;
@@ -270,30 +437,117 @@ void input_init(ProgContext ctx) {
     g_input.physics.obs.spring = OBSTACLE_SPRING_CONSTANT;
     g_input.physics.obs.enabled = true;
 
-    g_input.game.obstacleCnt = OBSTACLE_COUNT;
+    ObstacleArr_init(&g_input.game.obstacles);
+    g_input.game.layout = OL_RANDOM;
+    g_input.game.randomCount = OBSTACLE_COUNT;
+    g_input.game.mazeCells = OBSTACLE_MAZE_CELLS;
+    g_input.game.obstaclesChanged = true;
     g_input.game.selectedIdx = 0;
     g_input.game.showObstacles = true;
     g_input.game.paused = true;
 
-    for (int i = 0; i < OBSTACLE_COUNT; ++i) {
-        Obstacle *o = &g_input.game.obstacles[i];
+    g_input.quality.enabled = true;
+    g_input.quality.budgetMs = QUALITY_BUDGET_MS;
+    g_input.quality.level = QL_FULL;
+    g_input.quality.surfaceNormals = g_input.showNormals;
+    g_input.quality.objectNormals = g_input.showNormals;
 
-        bool isParallel = (i >= 4);
-        o->gS = ((float) rand() / RAND_MAX);
-        o->gT = ((float) rand() / RAND_MAX);
-        o->width = isParallel ? 0.2f : 0.05f;
-        o->length = isParallel ? 0.05f : 0.2f;
-        o->height = OBSTACLE_HEIGHT;
-    }
+    g_input.resolution.enabled = true;
+    g_input.resolution.minScale = RESOLUTION_MIN_SCALE;
+    g_input.resolution.sharpness = RESOLUTION_SHARPNESS;
+    g_input.resolution.scale = 1.0f;
+}
+
+void input_init(ProgContext ctx) {
+    input_initDefaults();
+    g_ctx = ctx;
+
+    g_input.cam.data = camera_createCamera(
+        ctx, g_input.cam.pos,
+        CAM_SPEED, CAM_FAST_SPEED,
+        CAM_SENSITIVITY, CAM_YAW, CAM_PITCH
+    );
+    camera_getPosition(g_input.cam.data, g_input.cam.pos);
+    camera_getFront(g_input.cam.data, g_input.cam.dir);
 }
 
 InputData* getInputData(void) {
     return &g_input;
 }
 
+void input_getSimParams(const InputData *data, SimParams *dest) {
+    dest->fixedDt = data->physics.fixedDt;
+    glm_vec3_copy((vec3) { 0.0f, -data->physics.gravity, 0.0f }, dest->gravity);
+    dest->frictionFactor = data->physics.frictionFactor;
+    dest->mass = data->physics.mass;
+    dest->ballRadius = data->physics.ballRadius;
+
+    dest->ball = data->physics.ball;
+    dest->wall = data->physics.wall;
+    dest->obs = data->physics.obs;
+
+    dest->blackHoleStrength = data->physics.blackHoleStrength;
+    dest->blackHoleRadius = data->physics.blackHoleRadius;
+    dest->blackHoleCaptureRadius = data->physics.blackHoleCaptureRadius;
+
+    dest->sleep.enabled = data->physics.sleep.enabled;
+    dest->sleep.velocity = data->physics.sleep.velocity;
+    dest->sleep.steps = data->physics.sleep.steps;
+
+    dest->multiRate.enabled = data->physics.multiRate.enabled;
+    dest->multiRate.maxLevel = data->physics.multiRate.maxLevel;
+    dest->multiRate.safety = data->physics.multiRate.safety;
+
+    dest->integrator = data->physics.integrator;
+    dest->solver = data->physics.solver;
+    dest->solverIterations = data->physics.solverIterations;
+    dest->compliance = data->physics.compliance;
+    dest->kernel = data->surface.kernel;
+    dest->fastMath = data->physics.fastMath;
+    dest->sweep = data->physics.sweep;
+    dest->parallel = data->physics.parallel;
+    dest->surfaceReady = !data->surface.dimensionChanged && !data->surface.resolutionChanged;
+}
+
+void input_translateCamera(const vec3 delta) {
+    if (!g_input.cam.data) {
+        return;
+    }
+
+    // The camera has no setter, it is recreated with the same view direction
+    vec3 pos, front;
+    camera_getPosition(g_input.cam.data, pos);
+    camera_getFront(g_input.cam.data, front);
+    glm_vec3_add(pos, (float*) delta, pos);
+    float yaw = glm_deg(atan2f(front[2], front[0]));
+    float pitch = glm_deg(asinf(glm_clamp(front[1], -1.0f, 1.0f)));
+
+    camera_deleteCamera(&g_input.cam.data);
+    g_input.cam.data = camera_createCamera(g_ctx, pos, CAM_SPEED, CAM_FAST_SPEED, CAM_SENSITIVITY, yaw, pitch);
+    for (int key = GLFW_KEY_SPACE; key <= GLFW_KEY_LAST; ++key) {
+        if (inputqueue_isKeyDown(key)) {
+            camera_keyboardCallback(g_input.cam.data, key, GLFW_PRESS);
+        }
+    }
+    for (int button = 0; button <= GLFW_MOUSE_BUTTON_LAST; ++button) {
+        if (g_buttonsDown[button]) {
+            camera_mouseButtonCallback(g_input.cam.data, button, GLFW_PRESS);
+        }
+    }
+
+    glm_vec3_copy(pos, g_input.cam.pos);
+    glm_vec3_copy(front, g_input.cam.dir);
+}
+
+void input_flushEvents(ProgContext ctx) {
+    inputqueue_flush(ctx, input_handleMouseMove);
+}
+
 void input_registerCallbacks(ProgContext ctx) {
     window_setKeyboardCallback(ctx, input_keyEvent);
     window_setMouseButtonCallback(ctx, input_mouseButtonEvent);
     window_setMouseMovementCallback(ctx, input_mouseMoveEvent);
+    window_setMouseScrollCallback(ctx, input_mouseScrollEvent);
+    window_setTextCallback(ctx, input_textEvent);
     window_setFramebufferSizeCallback(ctx, input_frameBufferSizeEvent);
 }
\ No newline at end of file
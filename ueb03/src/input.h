@@ -16,19 +16,42 @@
 #define INPUT_H
 
 #include <fhwcg/fhwcg.h>
+#include "array.h"
 
 #define OBSTACLE_COUNT 6
+#define OBSTACLE_MAZE_CELLS 12
 #define OBSTACLE_HEIGHT 0.2f
+#define HEIGHT_BAND_COUNT 7
 
 /**
- * Dynamic array struct for vec3 elements.
+ * Dynamic array for vec3 elements.
  * Stores ctrl points
  */
+DEFINE_ARRAY_BASE(vec3, Vec3Arr)
+
+/**
+ * Shading of the surface from a height up to the next band.
+ * The diffuse color is the band color or the surface texture.
+ */
+typedef struct {
+    float height;       // lower bound, the first band has none
+    vec3 color;
+    vec3 ambient;
+    vec3 specular;
+    vec3 emission;
+    float shininess;
+} HeightBand;
+
+/**
+ * Fractal Brownian motion over gradient noise, used by the noise height function.
+ */
 typedef struct {
-    size_t size;
-    size_t capacity;
-    vec3 *data;
-} Vec3Arr;
+    int octaves;
+    float frequency;    // of the first octave, per control point
+    float amplitude;    // height scale of the sum
+    float gain;         // amplitude factor between octaves
+    bool gpu;           // generate large grids with the compute shader
+} NoiseSettings;
 
 /**
  * Struct for box obstacle
@@ -41,6 +64,11 @@ typedef struct {
     float gS, gT;
 } Obstacle;
 
+/**
+ * Dynamic array of the obstacles.
+ */
+DEFINE_ARRAY_TYPE(Obstacle, ObstacleArr)
+
 /**
  * Collision parameters for different collisions.
  */
@@ -50,15 +78,84 @@ typedef struct {
     bool enabled;
 } Collision;
 
+/**
+ * Kernel used for the batched patch evaluation on the CPU.
+ */
+typedef enum {
+    SK_SCALAR,
+    SK_SSE,
+    SK_AVX,
+    SK_COUNT
+} SimdKernel;
+
+/**
+ * Time integration scheme of the fixed step.
+ * The stability limits are for the penalty springs, see physics_getStableDt.
+ */
+typedef enum {
+    IG_EULER,           // explicit Euler, unstable for undamped springs
+    IG_SYMPLECTIC,      // semi-implicit Euler, dt < 2 / omega
+    IG_VERLET,          // velocity Verlet, dt < 2 / omega
+    IG_RK4,             // classic Runge-Kutta, dt < 2.78 / omega
+    IG_COUNT
+} Integrator;
+
+/**
+ * Contact handling of the ball step.
+ * The XPBD solvers project the predicted positions out of the contacts
+ * instead of adding spring forces, they are stable at any dt.
+ */
+typedef enum {
+    CS_PENALTY,             // penalty springs and velocity reflection
+    CS_XPBD_GAUSS_SEIDEL,   // position constraints solved one after another
+    CS_XPBD_JACOBI,         // position constraints solved at once, corrections averaged per ball
+    CS_COUNT
+} ContactSolver;
+
+/**
+ * How the obstacles are laid out, a game reset lays them out anew.
+ */
+typedef enum {
+    OL_RANDOM,      // randomly placed boxes
+    OL_MAZE,        // inner walls of a random maze
+    OL_FILE,        // loaded from a file, kept on reset
+    OL_COUNT
+} ObstacleLayout;
+
+/**
+ * Trace mode of the fixed-step ball update.
+ * RM_REPLAY shows recorded steps instead of integrating.
+ */
+typedef enum {
+    RM_OFF,
+    RM_RECORD,
+    RM_REPLAY
+} ReplayMode;
+
+/**
+ * Levels of the quality governor, every level keeps the reductions of the levels below.
+ */
+typedef enum {
+    QL_FULL,
+    QL_SURFACE_NORMALS, // normals only on the surface, objects are instanced again
+    QL_NO_NORMALS,      // no normals at all
+    QL_COUNT
+} QualityLevel;
+
 /** Struct containing all data for application state. */
 typedef struct {
     bool isFullscreen;
     bool showWireframe;
     bool showHelp;
     bool showMenu;
+    bool showProfiler;
     float deltaTime;
     bool showNormals;
     bool paused;
+    bool depthPrepass;  // Draw opaque objects depth-only before shading them
+    bool oit;           // Blend transparent objects order-independently instead of sorting them
+    bool multiDraw;     // Submit the instanceable objects with one multi-draw-indirect per shader
+    bool occlusionCull; // Cull the multi-drawn objects against a Hi-Z pyramid of the surface depth
 
     struct {
         Camera *data;
@@ -79,12 +176,31 @@ typedef struct {
         bool resolutionChanged;
         bool dimensionChanged;
         bool offsetChanged;
+        bool heightsChanged;  // Control point heights edited, no structural change
         bool showControlPoints;
         bool showSurface;
+        bool tessellate;  // Evaluate the surface on the GPU
+        bool chunkLod;  // Draw the sampled surface as culled LOD chunks
+        bool quadricLod;  // Chunk levels from quadric simplification instead of strided grids
+        bool heightmap;  // Fetch the sampled surface heights from the baked heightmap
+        bool rayMarch;  // Ray-march the baked heightmap in a fullscreen pass instead of drawing the mesh
+        bool cacheOrder;  // Emit the sampled surface indices in vertex cache order
+        int exportPercent;  // Triangles kept by the PLY export, below 100 quadric simplified
+        int terrainTiles;  // Tiles per axis of a generated tile file
+        bool gpuMesh;  // Resample the full mesh from the patches with a compute shader
+        int normalStride;  // Vertices between two shown surface normals
+        int threadCount;  // Threads for surface rebuilds and the ball passes
+        int uploadBudgetKB;  // Surface bytes uploaded per frame, 0 uploads a rebuild at once
+        SimdKernel kernel;  // Kernel for sampling and ball contacts
         Vec3Arr controlPoints;
         bool useTexture;
         int currentTextureIndex;
         float textureTiling;  // Texture repeat factor
+        HeightBand bands[HEIGHT_BAND_COUNT];  // Ascending by height
+        bool bandsChanged;  // Bands edited, the lookup texture is rebaked
+        float aoStrength;  // Share of the baked occlusion darkening the surface, 0 is off
+        bool normalMap;  // Light the surface with normals baked per patch instead of the vertex normals
+        NoiseSettings noise;  // Terrain of the noise height function
         vec3 minPoint;
         vec3 maxPoint;
         bool extremesValid;
@@ -95,6 +211,8 @@ typedef struct {
         int selectedCp;
         int skipCnt;
         bool pressingUp, pressingDown;
+        vec2 cursor;          // mouse position relative to the window, [0, 1] from top left
+        bool pickRequested;   // pick the control point under the cursor next frame
     } selection;
 
     struct {
@@ -104,16 +222,40 @@ typedef struct {
         bool enabled;
         float ambientFactor;
         bool visualize;
+        bool shadows;       // cached shadow cube, see shadow.h
         vec3 center;
         float currAngle;
         float rotationRadius;
         float speed;
     } pointLight;
 
+    struct {
+        int count;          // 0: clustered lighting off
+        float radius;       // influence ends here
+        float intensity;
+        float height;       // above the surface
+        float speed;        // orbits per second around their anchors
+        bool visualize;
+    } clusterLights;
+
     struct {
         float gravity;
         float fixedDt;
         float dtAccumulator;
+
+        // Step budget per frame, the backlog is capped to one budget
+        int maxSteps;
+        bool interpolate;
+        bool threaded;      // Step on a simulation thread at wall-clock rate
+        bool parallel;      // Solve the ball passes on the job pool
+        bool fastMath;      // fastmath rsqrt for the ball, obstacle and black hole distances
+        bool sweep;         // Sweep fast balls against walls and obstacles, no tunneling
+        bool gpu;           // Step the balls with compute shaders on the surface heightmap
+        Integrator integrator;
+        ContactSolver solver;
+        int solverIterations;   // Iterations of the XPBD position solve per step
+        float compliance;       // Inverse contact stiffness of the XPBD solve, 0 is rigid
+
         float mass;
         float ballRadius;
         float frictionFactor;
@@ -126,18 +268,102 @@ typedef struct {
         Collision ball;
         Collision wall;
         Collision obs;
+
+        // Balls below the velocity for the number of steps skip the simulation
+        struct {
+            bool enabled;
+            float velocity;
+            int steps;
+        } sleep;
+
+        // Balls in stiff contacts take up to 2^maxLevel substeps per fixed step
+        struct {
+            bool enabled;
+            int maxLevel;
+            float safety;   // Share of the stable dt a substep may use
+        } multiRate;
+
+        ReplayMode replayMode;
+        bool traceDelta;    // Delta-compress recorded steps against the previous one
     } physics;
 
     struct {
-        Obstacle obstacles[OBSTACLE_COUNT];
+        ObstacleArr obstacles;
+        ObstacleLayout layout;
+        int randomCount;        // obstacles of OL_RANDOM
+        int mazeCells;          // cells per axis of OL_MAZE
         int selectedIdx;
-        int obstacleCnt;
+        bool obstaclesChanged;  // Obstacles added, removed or moved, rebuild their broad phase
         bool showObstacles;
         bool paused;
     } game;
 
+    // Quality governor, the settings below level are derived every frame
+    // from showNormals and are the ones to draw with
+    struct {
+        bool enabled;
+        float budgetMs;
+        QualityLevel level;
+        float workMs;
+
+        bool surfaceNormals;
+        bool objectNormals;
+    } quality;
+
+    // Dynamic resolution of the scene, scale is derived every frame
+    // from the GPU time and the quality budget
+    struct {
+        bool enabled;
+        float minScale;
+        float sharpness;    // Unsharp mask strength of the upscale
+        float scale;
+    } resolution;
+
 } InputData;
 
+/**
+ * Parameters of one fixed physics step, copied from InputData before the step.
+ * The physics and spline kernels only read this copy, so GUI edits during a
+ * step neither race with the workers nor change the step halfway through.
+ */
+typedef struct {
+    float fixedDt;
+    vec3 gravity;       // Gravity acceleration, pointing down
+    float frictionFactor;
+    float mass;
+    float ballRadius;
+
+    Collision ball;
+    Collision wall;
+    Collision obs;
+
+    float blackHoleStrength;
+    float blackHoleRadius;
+    float blackHoleCaptureRadius;
+
+    struct {
+        bool enabled;
+        float velocity;
+        int steps;
+    } sleep;
+
+    struct {
+        bool enabled;
+        int maxLevel;
+        float safety;
+    } multiRate;
+
+    Integrator integrator;
+    ContactSolver solver;
+    int solverIterations;
+    float compliance;
+    SimdKernel kernel;
+    bool fastMath;
+    bool sweep;
+    bool parallel;
+    bool surfaceReady;  // Surface is not being rebuilt, the spline can be evaluated
+} SimParams;
+
 /**
  * Initializes all default values for input struct
  *
@@ -145,6 +371,12 @@ typedef struct {
  */
 void input_init(ProgContext ctx);
 
+/**
+ * Sets the default values that do not need a GL context or camera.
+ * Called by input_init, used on its own by the headless benchmark.
+ */
+void input_initDefaults(void);
+
 /**
  * Returns pointer to InputData struct
  * Allows other modules to access and modify values
@@ -153,6 +385,14 @@ void input_init(ProgContext ctx);
  */
 InputData* getInputData(void);
 
+/**
+ * Copies the parameters of the next physics step.
+ *
+ * @param data Input data to copy from
+ * @param dest Destination
+ */
+void input_getSimParams(const InputData *data, SimParams *dest);
+
 /**
  * Register all callback functions (w/ GLFW)
  *
@@ -160,4 +400,20 @@ InputData* getInputData(void);
  */
 void input_registerCallbacks(ProgContext ctx);
 
+/**
+ * Handles the mouse movement recorded since the last call.
+ * Call once per frame after the events were polled.
+ *
+ * @param ctx Program Context
+ */
+void input_flushEvents(ProgContext ctx);
+
+/**
+ * Moves the camera by a world translation and keeps its view direction,
+ * e.g. when the surface shows a shifted part of the terrain.
+ *
+ * @param delta World translation
+ */
+void input_translateCamera(const vec3 delta);
+
 #endif // INPUT_H
\ No newline at end of file
@@ -0,0 +1,244 @@
+/**
+ * @file instanced.c
+ * @brief Implementation of the instanced rendering
+ *
+ * All meshes read the same interleaved instance buffer. It is
+ * re-specified before every upload so consecutive draws of different
+ * object classes do not wait on each other.
+ *
+ * The meshes share one vertex and index buffer and one VAO, a draw selects
+ * its mesh by base vertex and first index, so switching meshes binds nothing.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "instanced.h"
+#include "glstate.h"
+#include "gpumem.h"
+#include "metrics.h"
+
+/** Initial number of staged instances */
+#define START_CAPACITY 64
+
+/**
+ * Range of a mesh in the shared buffers.
+ */
+struct CGMesh {
+    GLint baseVertex;
+    GLuint firstIndex;
+    GLsizei numVertices, numIndices;
+    GLenum mode;
+};
+
+/**
+ * Per-instance data, xyz translation and w uniform scale.
+ */
+typedef struct {
+    vec4 offsetScale;
+    vec4 color;
+} InstanceData;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Instance buffer and client side staging.
+ */
+static struct {
+    GLuint buffer;
+    InstanceData *staged;
+    int size;
+    int capacity;
+} g_instances = { 0 };
+
+/**
+ * Shared mesh buffers and their CPU copies.
+ */
+static struct {
+    GLuint vao, vbo, ebo;
+    Vertex *vertices;
+    GLuint *indices;
+    int numVertices, numIndices;
+} g_pool = { 0 };
+
+/**
+ * Grows the staging to hold at least count instances.
+ * @param count Required number of instances.
+ */
+static void reserve(int count) {
+    if (count <= g_instances.capacity) {
+        return;
+    }
+
+    int capacity = g_instances.capacity ? g_instances.capacity * 2 : START_CAPACITY;
+    if (capacity < count) capacity = count;
+
+    InstanceData *tmp = realloc(g_instances.staged, capacity * sizeof(InstanceData));
+    assert(tmp && "realloc failed in instanced reserve");
+    g_instances.staged = tmp;
+    g_instances.capacity = capacity;
+}
+
+/**
+ * Sets up the vertex array on the shared mesh buffers and the instance buffer.
+ */
+static void setupVertexArray(void) {
+    glstate_bindVertexArray(g_pool.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_pool.vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+
+    // Per-instance attributes, the buffer keeps its name when it is re-specified
+    glBindBuffer(GL_ARRAY_BUFFER, g_instances.buffer);
+    glEnableVertexAttribArray(INSTANCED_LOC_OFFSET_SCALE);
+    glVertexAttribPointer(INSTANCED_LOC_OFFSET_SCALE, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+        (void*)offsetof(InstanceData, offsetScale));
+    glVertexAttribDivisor(INSTANCED_LOC_OFFSET_SCALE, 1);
+    glEnableVertexAttribArray(INSTANCED_LOC_COLOR);
+    glVertexAttribPointer(INSTANCED_LOC_COLOR, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+        (void*)offsetof(InstanceData, color));
+    glVertexAttribDivisor(INSTANCED_LOC_COLOR, 1);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_pool.ebo);
+    glstate_bindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+ * Issues the instanced draw call of a mesh, the shared vertex array must be bound.
+ * @param m Mesh to draw.
+ * @param count Number of instances.
+ */
+static void drawMesh(CGMesh *m, int count) {
+    if (m->numIndices) {
+        glDrawElementsInstancedBaseVertex(m->mode, m->numIndices, GL_UNSIGNED_INT,
+            (const void*)(m->firstIndex * sizeof(GLuint)), count, m->baseVertex);
+    } else {
+        glDrawArraysInstanced(m->mode, m->baseVertex, m->numVertices, count);
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+CGMesh* instanced_createMesh(
+    const Vertex *vertices, const int numVerts,
+    const GLuint *indices, const int numInd,
+    GLenum mode
+) {
+    CGMesh *m = malloc(sizeof(CGMesh));
+    assert(m && "malloc failed in instanced_createMesh");
+
+    Vertex *v = realloc(g_pool.vertices, (g_pool.numVertices + numVerts) * sizeof(Vertex));
+    assert(v && "realloc failed in instanced_createMesh");
+    memcpy(v + g_pool.numVertices, vertices, numVerts * sizeof(Vertex));
+    g_pool.vertices = v;
+    if (numInd) {
+        GLuint *i = realloc(g_pool.indices, (g_pool.numIndices + numInd) * sizeof(GLuint));
+        assert(i && "realloc failed in instanced_createMesh");
+        memcpy(i + g_pool.numIndices, indices, numInd * sizeof(GLuint));
+        g_pool.indices = i;
+    }
+
+    // Indices stay relative to the mesh, baseVertex offsets them
+    m->baseVertex = g_pool.numVertices;
+    m->firstIndex = g_pool.numIndices;
+    m->numVertices = numVerts;
+    m->numIndices = numInd;
+    m->mode = mode;
+    g_pool.numVertices += numVerts;
+    g_pool.numIndices += numInd;
+
+    // Meshes are only added at startup, the buffers are re-specified as a whole
+    glBindBuffer(GL_ARRAY_BUFFER, g_pool.vbo);
+    glBufferData(GL_ARRAY_BUFFER, g_pool.numVertices * sizeof(Vertex), g_pool.vertices, GL_STATIC_DRAW);
+    gpumem_setBuffer(GPUMEM_GEOMETRY, g_pool.vbo, g_pool.numVertices * sizeof(Vertex));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glstate_bindVertexArray(g_pool.vao);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_pool.numIndices * sizeof(GLuint), g_pool.indices, GL_STATIC_DRAW);
+    gpumem_setBuffer(GPUMEM_GEOMETRY, g_pool.ebo, g_pool.numIndices * sizeof(GLuint));
+    glstate_bindVertexArray(0);
+    return m;
+}
+
+void instanced_disposeMesh(CGMesh *m) {
+    free(m);
+}
+
+void instanced_init(void) {
+    glGenBuffers(1, &g_instances.buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, g_instances.buffer);
+    glBufferData(GL_ARRAY_BUFFER, START_CAPACITY * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+    gpumem_setBuffer(GPUMEM_INSTANCES, g_instances.buffer, START_CAPACITY * sizeof(InstanceData));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    reserve(START_CAPACITY);
+
+    glGenVertexArrays(1, &g_pool.vao);
+    glGenBuffers(1, &g_pool.vbo);
+    glGenBuffers(1, &g_pool.ebo);
+    setupVertexArray();
+}
+
+void instanced_cleanup(void) {
+    gpumem_deleteBuffers(1, &g_instances.buffer);
+    free(g_instances.staged);
+    memset(&g_instances, 0, sizeof(g_instances));
+
+    gpumem_deleteBuffers(1, &g_pool.vbo);
+    gpumem_deleteBuffers(1, &g_pool.ebo);
+    glDeleteVertexArrays(1, &g_pool.vao);
+    free(g_pool.vertices);
+    free(g_pool.indices);
+    memset(&g_pool, 0, sizeof(g_pool));
+}
+
+void instanced_add(vec3 pos, float scale, vec3 color) {
+    reserve(g_instances.size + 1);
+
+    InstanceData *inst = &g_instances.staged[g_instances.size++];
+    glm_vec4(pos, scale, inst->offsetScale);
+    glm_vec4(color, 1.0f, inst->color);
+}
+
+void instanced_draw(CGMesh *m) {
+    int count = g_instances.size;
+    g_instances.size = 0;
+    if (count == 0) {
+        return;
+    }
+
+    // Orphan the previous contents instead of waiting for draws still reading them
+    glBindBuffer(GL_ARRAY_BUFFER, g_instances.buffer);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(InstanceData), g_instances.staged, GL_STREAM_DRAW);
+    gpumem_setBuffer(GPUMEM_INSTANCES, g_instances.buffer, count * sizeof(InstanceData));
+    metrics_count(METRIC_UPLOAD_BYTES, (long) (count * sizeof(InstanceData)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glstate_bindVertexArray(g_pool.vao);
+    drawMesh(m, count);
+}
+
+void instanced_drawBuffer(CGMesh *m, GLuint buffer, GLsizei stride, int count) {
+    if (count == 0) {
+        return;
+    }
+
+    glstate_bindVertexArray(g_pool.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(INSTANCED_LOC_OFFSET_SCALE, 4, GL_FLOAT, GL_FALSE, stride, (void*) 0);
+    glDisableVertexAttribArray(INSTANCED_LOC_COLOR);
+    glVertexAttrib4f(INSTANCED_LOC_COLOR, 1.0f, 1.0f, 1.0f, 1.0f);
+
+    drawMesh(m, count);
+
+    // Back to the shared instance buffer
+    glBindBuffer(GL_ARRAY_BUFFER, g_instances.buffer);
+    glVertexAttribPointer(INSTANCED_LOC_OFFSET_SCALE, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+        (void*)offsetof(InstanceData, offsetScale));
+    glEnableVertexAttribArray(INSTANCED_LOC_COLOR);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,83 @@
+/**
+ * @file instanced.h
+ * @brief Instanced rendering of many copies of one mesh
+ *
+ * Instances are collected with instanced_add and drawn with a single
+ * instanced draw call per mesh. Every instance has a translation, a
+ * uniform scale and a color. The Model-Shader has no use for the color
+ * and reads it as a scale per axis instead.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef INSTANCED_H
+#define INSTANCED_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Attribute locations of the per-instance data in the shaders */
+#define INSTANCED_LOC_OFFSET_SCALE 3
+#define INSTANCED_LOC_COLOR 4
+
+/** Range of a mesh in the shared buffers, all meshes read the instance buffer through one VAO */
+typedef struct CGMesh CGMesh;
+
+/**
+ * Creates a mesh from vertex and index data.
+ * @param vertices Array of vertex data.
+ * @param numVerts Number of vertices.
+ * @param indices Array of indices (NULL for non-indexed).
+ * @param numInd Number of indices (0 for non-indexed).
+ * @param mode OpenGL primitive mode (GL_TRIANGLES, ...).
+ * @return Pointer to created mesh.
+ */
+CGMesh* instanced_createMesh(
+    const Vertex *vertices, const int numVerts,
+    const GLuint *indices, const int numInd,
+    GLenum mode
+);
+
+/**
+ * Frees a mesh, its range in the shared buffers stays until instanced_cleanup.
+ * @param m Pointer to mesh to dispose.
+ */
+void instanced_disposeMesh(CGMesh *m);
+
+/**
+ * Creates the shared instance buffer.
+ * Must be called before the first instanced_createMesh.
+ */
+void instanced_init(void);
+
+/**
+ * Frees the instance buffer, the staged instances and the mesh buffers.
+ */
+void instanced_cleanup(void);
+
+/**
+ * Stages one instance for the next instanced_draw.
+ * @param pos Translation of the instance.
+ * @param scale Uniform scale of the instance.
+ * @param color Color of the instance (used by the simple shader).
+ */
+void instanced_add(vec3 pos, float scale, vec3 color);
+
+/**
+ * Uploads the staged instances and draws them with one draw call.
+ * The staging is empty afterwards.
+ * @param m Mesh to draw.
+ */
+void instanced_draw(CGMesh *m);
+
+/**
+ * Draws instances from a buffer filled elsewhere, e.g. by a compute shader.
+ * Reads the translation and scale from a vec4 at the start of every record,
+ * all instances are white. The staging is not touched.
+ * @param m Mesh to draw.
+ * @param buffer Buffer with the instance records.
+ * @param stride Size of one record in bytes.
+ * @param count Number of instances.
+ */
+void instanced_drawBuffer(CGMesh *m, GLuint buffer, GLsizei stride, int count);
+
+#endif // INSTANCED_H
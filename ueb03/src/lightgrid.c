@@ -0,0 +1,244 @@
+/**
+ * @file lightgrid.c
+ * @brief Implementation of the clustered light grid
+ *
+ * Binning is done by counting sort: the first pass counts the lights per
+ * cluster, a prefix sum turns the counts into offsets, the second pass
+ * writes the light indices. A light covers the slices its depth range
+ * overlaps, within every slice the tiles of its bounding rectangle between
+ * the slice's depths. Near and far plane come from the projection matrix.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "lightgrid.h"
+#include "shader.h"
+#include "gpumem.h"
+#include "alloctrack.h"
+#include "timeline.h"
+
+#define LIGHTGRID_CLUSTERS (LIGHTGRID_X * LIGHTGRID_Y * LIGHTGRID_Z)
+
+/** Depth of the first slice, closer fragments use the first slice too */
+#define LIGHTGRID_MIN_NEAR 0.05f
+
+/** Storage buffer bindings, must match model.frag */
+#define BINDING_LIGHTS 6
+#define BINDING_CLUSTERS 7
+#define BINDING_INDICES 8
+
+/**
+ * One light in view space, std430 layout of model.frag.
+ */
+typedef struct {
+    vec4 posRadius;     // xyz view space position, w radius
+    vec4 color;
+} GpuLight;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Buffers and the CPU copies of the last build.
+ */
+static struct {
+    GLuint lights, clusters, indices;
+
+    GpuLight gpuLights[LIGHTGRID_MAX_LIGHTS];
+    GLuint ranges[LIGHTGRID_CLUSTERS][2];   // offset, count
+    GLuint *indexList;
+    int indexCapacity;
+    int indexCount;
+
+    float scaleX, scaleY;   // projection scale of x and y
+    float near, far;
+    float sliceScale;       // slices per logarithmic depth unit
+} g_grid = { 0 };
+
+/**
+ * Returns the slice containing a depth.
+ * @param depth Positive view space depth.
+ * @return Slice index, clamped to the grid.
+ */
+static int sliceOf(float depth) {
+    int slice = (int) floorf(logf(depth / g_grid.near) * g_grid.sliceScale);
+    return glm_clamp(slice, 0, LIGHTGRID_Z - 1);
+}
+
+/**
+ * Returns the depth a slice starts at.
+ * @param slice Slice index, LIGHTGRID_Z for the far end.
+ * @return Positive view space depth.
+ */
+static float sliceDepth(int slice) {
+    return g_grid.near * expf(slice / g_grid.sliceScale);
+}
+
+/**
+ * Finds the tiles of one axis a sphere covers between two depths.
+ * The projected extent of a side is largest at the near depth if it lies
+ * off-axis towards it, at the far depth otherwise.
+ * @param center View space coordinate of the center on the axis.
+ * @param radius Radius of the sphere.
+ * @param scale Projection scale of the axis.
+ * @param dNear Near depth, positive.
+ * @param dFar Far depth, positive.
+ * @param tiles Tiles along the axis.
+ * @param first Output: first covered tile.
+ * @param last Output: last covered tile.
+ * @return False if the sphere is outside the frustum on this axis.
+ */
+static bool tileRange(float center, float radius, float scale, float dNear, float dFar,
+                      int tiles, int *first, int *last) {
+    float lo = center - radius;
+    float hi = center + radius;
+    float ndcLo = scale * lo / (lo >= 0.0f ? dFar : dNear);
+    float ndcHi = scale * hi / (hi >= 0.0f ? dNear : dFar);
+    if (ndcLo > 1.0f || ndcHi < -1.0f) {
+        return false;
+    }
+
+    *first = glm_clamp((int) floorf((ndcLo * 0.5f + 0.5f) * tiles), 0, tiles - 1);
+    *last = glm_clamp((int) floorf((ndcHi * 0.5f + 0.5f) * tiles), 0, tiles - 1);
+    return true;
+}
+
+/**
+ * Counts a light in the clusters it touches or writes its index there.
+ * Counting increases the count of the ranges, writing uses the count as
+ * cursor behind the offset.
+ * @param light Index into the view space lights.
+ * @param write False to count, true to write the index.
+ */
+static void binLight(int light, bool write) {
+    const GpuLight *l = &g_grid.gpuLights[light];
+    float depth = -l->posRadius[2];
+    float radius = l->posRadius[3];
+    float zMin = glm_max(depth - radius, g_grid.near);
+    float zMax = glm_min(depth + radius, g_grid.far);
+    if (zMin >= zMax) {
+        return;
+    }
+
+    int lastSlice = sliceOf(zMax);
+    for (int z = sliceOf(zMin); z <= lastSlice; ++z) {
+        float dNear = glm_max(sliceDepth(z), zMin);
+        float dFar = glm_min(sliceDepth(z + 1), zMax);
+
+        int x0, x1, y0, y1;
+        if (!tileRange(l->posRadius[0], radius, g_grid.scaleX, dNear, dFar, LIGHTGRID_X, &x0, &x1) ||
+            !tileRange(l->posRadius[1], radius, g_grid.scaleY, dNear, dFar, LIGHTGRID_Y, &y0, &y1)) {
+            continue;
+        }
+
+        for (int y = y0; y <= y1; ++y) {
+            GLuint (*row)[2] = &g_grid.ranges[(z * LIGHTGRID_Y + y) * LIGHTGRID_X];
+            for (int x = x0; x <= x1; ++x) {
+                if (write) {
+                    g_grid.indexList[row[x][0] + row[x][1]] = (GLuint) light;
+                }
+                ++row[x][1];
+            }
+        }
+    }
+}
+
+/**
+ * Turns the counts of the ranges into offsets and resets the counts.
+ * Grows the index list to the total.
+ */
+static void prefixSum(void) {
+    GLuint offset = 0;
+    for (int i = 0; i < LIGHTGRID_CLUSTERS; ++i) {
+        g_grid.ranges[i][0] = offset;
+        offset += g_grid.ranges[i][1];
+        g_grid.ranges[i][1] = 0;
+    }
+    g_grid.indexCount = (int) offset;
+
+    if (g_grid.indexCount > g_grid.indexCapacity) {
+        int capacity = glm_max(g_grid.indexCount, g_grid.indexCapacity * 2);
+        GLuint *list = TRACKED_REALLOC(g_grid.indexList, capacity * sizeof(GLuint));
+        assert(list && "realloc failed in prefixSum");
+        g_grid.indexList = list;
+        g_grid.indexCapacity = capacity;
+    }
+}
+
+/**
+ * Replaces the contents of a storage buffer and binds it.
+ * @param buffer Buffer name, created if 0.
+ * @param binding Binding point.
+ * @param size Size in bytes, at least one element so the binding is valid.
+ * @param data New contents.
+ */
+static void uploadBuffer(GLuint *buffer, GLuint binding, GLsizeiptr size, const void *data) {
+    if (!*buffer) {
+        glGenBuffers(1, buffer);
+    }
+
+    // Orphaning, the draws of the last frame may still read the old store
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_STREAM_DRAW);
+    gpumem_setBuffer(GPUMEM_UNIFORMS, *buffer, (size_t) size);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, *buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void lightgrid_cleanup(void) {
+    gpumem_deleteBuffers(1, &g_grid.lights);
+    gpumem_deleteBuffers(1, &g_grid.clusters);
+    gpumem_deleteBuffers(1, &g_grid.indices);
+    TRACKED_FREE(g_grid.indexList);
+    memset(&g_grid, 0, sizeof(g_grid));
+}
+
+void lightgrid_build(const LightGridLight *lights, int count) {
+    count = glm_min(count, LIGHTGRID_MAX_LIGHTS);
+
+    mat4 view, proj;
+    scene_getMV(view);
+    scene_getP(proj);
+    g_grid.scaleX = proj[0][0];
+    g_grid.scaleY = proj[1][1];
+    g_grid.near = glm_max(proj[3][2] / (proj[2][2] - 1.0f), LIGHTGRID_MIN_NEAR);
+    g_grid.far = proj[3][2] / (proj[2][2] + 1.0f);
+    g_grid.sliceScale = LIGHTGRID_Z / logf(g_grid.far / g_grid.near);
+
+    vec4 clusterProj = { g_grid.scaleX, g_grid.scaleY, g_grid.near, g_grid.sliceScale };
+    shader_setLightClusters(clusterProj, count);
+    g_grid.indexCount = 0;
+    if (count == 0) {
+        return;
+    }
+
+    TIMELINE_BEGIN("Light Grid");
+    for (int i = 0; i < count; ++i) {
+        GpuLight *l = &g_grid.gpuLights[i];
+        vec4 pos = { lights[i].pos[0], lights[i].pos[1], lights[i].pos[2], 1.0f };
+        glm_mat4_mulv(view, pos, l->posRadius);
+        l->posRadius[3] = lights[i].radius;
+        vec4 color = { lights[i].color[0], lights[i].color[1], lights[i].color[2], 0.0f };
+        glm_vec4_copy(color, l->color);
+    }
+
+    memset(g_grid.ranges, 0, sizeof(g_grid.ranges));
+    for (int i = 0; i < count; ++i) {
+        binLight(i, false);
+    }
+    prefixSum();
+    for (int i = 0; i < count; ++i) {
+        binLight(i, true);
+    }
+
+    uploadBuffer(&g_grid.lights, BINDING_LIGHTS, count * sizeof(GpuLight), g_grid.gpuLights);
+    uploadBuffer(&g_grid.clusters, BINDING_CLUSTERS, sizeof(g_grid.ranges), g_grid.ranges);
+    uploadBuffer(&g_grid.indices, BINDING_INDICES,
+        glm_max(g_grid.indexCount, 1) * sizeof(GLuint), g_grid.indexList);
+    TIMELINE_END();
+}
+
+int lightgrid_getIndexCount(void) {
+    return g_grid.indexCount;
+}
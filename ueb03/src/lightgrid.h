@@ -0,0 +1,58 @@
+/**
+ * @file lightgrid.h
+ * @brief Clustered forward shading of many point lights
+ *
+ * The view frustum is split into LIGHTGRID_X x LIGHTGRID_Y tiles on the
+ * screen and LIGHTGRID_Z slices in depth, spaced exponentially so the
+ * clusters stay roughly cubic. Every frame the lights are binned on the
+ * CPU into the clusters their bounding spheres touch, and the lights, the
+ * per-cluster ranges and the light index list are uploaded as storage
+ * buffers. The model fragment stage finds the cluster of the fragment and
+ * only shades the lights listed there.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef LIGHTGRID_H
+#define LIGHTGRID_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Clusters per axis, must match model.frag */
+#define LIGHTGRID_X 16
+#define LIGHTGRID_Y 9
+#define LIGHTGRID_Z 24
+
+/** Most lights binned per frame */
+#define LIGHTGRID_MAX_LIGHTS 512
+
+/**
+ * A point light in world space, its influence ends at the radius.
+ */
+typedef struct {
+    vec3 pos;
+    float radius;
+    vec3 color;     // premultiplied with the intensity
+} LightGridLight;
+
+/**
+ * Deletes the buffers and the index list.
+ */
+void lightgrid_cleanup(void);
+
+/**
+ * Bins the lights into the clusters of the current view and projection
+ * and uploads the grid. Call once per frame after the camera is set.
+ * No lights turn the clustered lighting off.
+ * @param lights Lights in world space.
+ * @param count Number of lights, at most LIGHTGRID_MAX_LIGHTS are used.
+ */
+void lightgrid_build(const LightGridLight *lights, int count);
+
+/**
+ * Returns the number of light indices of the last build.
+ * @return Sum of the lights over all clusters.
+ */
+int lightgrid_getIndexCount(void);
+
+#endif // LIGHTGRID_H
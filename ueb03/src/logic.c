@@ -13,12 +13,32 @@
 #include "model.h"
 #include "utils.h"
 #include "physics.h"
+#include "profiler.h"
+#include "jobs.h"
+#include "evaluate.h"
+#include "thread.h"
+#include "heights.h"
+#include "aobake.h"
+#include "normalbake.h"
+#include "timeline.h"
+#include "perfcount.h"
+#include "alloctrack.h"
+#include "metrics.h"
+#include "decimate.h"
 
 #include <fhwcg/fhwcg.h>
+#include <float.h>
 
-#define RANDOM_HEIGHT(scale) ((((float)rand() / RAND_MAX) - 0.5f) * scale)
+#define RANDOM_HEIGHT(scale) ((RAND01 - 0.5f) * scale)
 #define CAMERA_HEIGHT_OFFSET 0.2f // Offset for 2nd and 3rd Ctrl.point of Bezier
 #define LIGHT_OFFSET_Y 0.35f
+#define PATCH_ROWS_PER_CHUNK 4
+#define SAMPLE_ROWS_PER_CHUNK 8
+#define SAMPLE_BLOCK 64
+#define PROJECT_ITERATIONS 4      // Newton steps of the closest point projection
+#define PROJECT_EPSILON 1e-5f     // convergence threshold in normalized params
+#define EXPORT_BUFFER_SIZE (4 << 20)  // output buffer of the mesh export
+#define EXPORT_FACE_SIZE 13       // PLY face: uchar count and three int indices
 
 DEFINE_ARRAY_TYPE(Patch, PatchArr)
 
@@ -27,9 +47,270 @@ DEFINE_ARRAY_TYPE(Patch, PatchArr)
 /** Global array storing all polynomial patches for the surface */
 static PatchArr g_patches;
 
+/** Interleaved surface vertices, reused across rebuilds and only grown */
+static struct {
+    Vertex *data;
+    int capacity;
+    bool meshStale;  // Local edits skipped the mesh while it was tessellated
+} g_surfaceScratch = {0};
+
+/**
+ * One sample position along an axis of the regular sample grid.
+ * s and t use the same spacing, so one table serves both axes.
+ */
+typedef struct {
+    int patch;         // patch index along the axis
+    float global;      // global parameter in [0, 1]
+    float world;       // patch * 3 + local * 3, scaled by the axis step
+    PatchBasis basis;  // power basis of the local parameter
+} SampleAxis;
+
+/**
+ * Sample positions of one resolution,
+ * rebuilt when resolution or dimension changes
+ */
+typedef struct {
+    SampleAxis *data;
+    float *local;      // local parameters, contiguous for the batch kernels
+    int gridSize;
+    int patchCount;
+} SampleAxisTable;
+
+/** Sample positions of the current surface */
+static SampleAxisTable g_sampleAxis = {0};
+
+/**
+ * Per-surface constants for spline evaluation,
+ * refreshed whenever the patches are rebuilt
+ */
+typedef struct {
+    int patchCount;
+    float maxX, maxZ;
+    float stepX, stepZ;
+} SurfaceEval;
+
+/** Evaluation constants of the current surface */
+static SurfaceEval g_surfaceEval = {0};
+
+/** Min/max pyramid over the sampled heights of the current patches */
+static HeightPyramid g_heights = {0};
+
+/**
+ * Occlusion baked from the heights of the current surface. Follows every
+ * local edit, also while the mesh itself is stale or generated on the GPU.
+ */
+static AoBake g_ao = {0};
+
+/**
+ * Normals baked from the current patches, empty while the normal map is
+ * off. Follows every local edit like the occlusion.
+ */
+static NormalBake g_normals = {0};
+
+/**
+ * Min/max pyramid with one leaf per control point, for ray picking.
+ * Follows the control points directly, not the rebuilt surface.
+ */
+static struct {
+    HeightPyramid heights;
+    int dimension;
+    float step;    // control point spacing in x and z
+} g_cpPick = {0};
+
+/**
+ * Everything a complete surface build produces.
+ * Swapped with the current surface instead of copied.
+ */
+typedef struct {
+    PatchArr patches;
+    SampleAxisTable axis;
+    SurfaceEval eval;
+    Vertex *vertices;
+    int capacity;
+    int gridSize;
+    HeightPyramid heights;
+    AoBake ao;
+    NormalBake normals;
+} SurfaceBuild;
+
+/**
+ * Parameters of a complete surface build, taken from the input data
+ * so the build does not touch it.
+ */
+typedef struct {
+    Vec3Arr controlPoints;
+    int dimension;
+    int resolution;
+    float textureTiling;
+    SimdKernel kernel;
+    bool normalMap;    // bake the normal map
+    bool structural;   // dimension or offset changed, physics is reset on swap
+    vec3 shift;        // terrain translation, balls and camera follow on swap
+} RebuildRequest;
+
+/**
+ * Background surface rebuild. Requests submitted while the worker is busy
+ * replace the pending one, so a slider drag only builds the latest state.
+ * All fields except current and work are guarded by the mutex.
+ */
+static struct {
+    Thread thread;
+    Mutex mutex;
+    Cond cond;
+    bool threadStarted;
+    bool running;
+    bool requested;           // request holds parameters not picked up yet
+    bool busy;                // worker is building current into work
+    bool ready;               // result holds a build not swapped in yet
+    bool resultStructural;
+    vec3 resultShift;
+    RebuildRequest request;
+    RebuildRequest current;   // owned by the building thread
+    SurfaceBuild work;        // owned by the building thread
+    SurfaceBuild result;
+} g_rebuild;
+
+/**
+ * Background export of the sampled surface. Only running is shared, the
+ * rest belongs to the main thread while no export runs and to the export
+ * thread while one does.
+ */
+static struct {
+    Thread thread;
+    bool threadStarted;
+    volatile long running;
+    Vec3Arr controlPoints;    // snapshot of the exported surface
+    int dimension;
+    int gridSize;
+    float textureTiling;
+    SimdKernel kernel;
+    int percent;              // triangles kept, below 100 quadric simplified
+    char path[256];
+} g_export = {0};
+
+/**
+ * Simplified triangles of one chunk of the exported grid.
+ */
+typedef struct {
+    int x0, z0, x1, z1;       // vertex range, inclusive
+    GLuint *indices;
+    int count;
+} ExportChunk;
+
+/**
+ * Input of the export simplification jobs.
+ */
+typedef struct {
+    const Vertex *grid;
+    int gridSize;
+    vec2 spacing;
+    ExportChunk *chunks;
+} ExportDecimation;
+
+/**
+ * Linear blend of the old control points index and index + 1
+ * for one new control point, the same along both axes.
+ */
+typedef struct {
+    int index;
+    float weight;  // weight of index + 1
+} ResampleTap;
+
+/** Buffers of the control point resampling, reused and only grown */
+static struct {
+    Vec3Arr points;    // swapped with the control points
+    float *rows;       // old rows resampled to the new width
+    int rowsCapacity;
+    ResampleTap *taps; // one per new index
+    int tapsCapacity;
+} g_cpResample = {0};
+
+/**
+ * Input of the parallel control point resampling.
+ */
+typedef struct {
+    const vec3 *src;
+    vec3 *dest;
+    float *rows;
+    const ResampleTap *taps;
+    int oldDim;
+    int newDim;
+    float step;
+} ResampleJob;
+
+/**
+ * Grows a scratch buffer to at least count elements.
+ * Contents are not preserved when it grows.
+ *
+ * @param data Scratch buffer, may be NULL
+ * @param capacity Capacity of the buffer in elements
+ * @param count Required number of elements
+ * @param size Size of one element
+ * @return The scratch buffer
+ */
+static void* reserveScratch(void *data, int *capacity, int count, size_t size) {
+    if (*capacity < count) {
+        TRACKED_FREE(data);
+        data = TRACKED_MALLOC(count * size);
+        assert(data && "malloc failed in reserveScratch");
+        *capacity = count;
+    }
+    return data;
+}
+
+/**
+ * Horizontal pass: resamples the old rows [begin, end) to the new width.
+ *
+ * @param begin First old row
+ * @param end One past the last old row
+ * @param chunk Chunk index (unused)
+ * @param userData ResampleJob
+ */
+static void resampleRowsJob(int begin, int end, int chunk, void *userData) {
+    (void) chunk;
+    ResampleJob *job = userData;
+
+    for (int r = begin; r < end; ++r) {
+        const vec3 *src = &job->src[r * job->oldDim];
+        float *dest = &job->rows[r * job->newDim];
+        for (int j = 0; j < job->newDim; ++j) {
+            ResampleTap t = job->taps[j];
+            dest[j] = glm_lerp(src[t.index][1], src[t.index + 1][1], t.weight);
+        }
+    }
+}
+
+/**
+ * Vertical pass: blends the resampled rows into the new rows [begin, end)
+ * and places the control points on the grid.
+ *
+ * @param begin First new row
+ * @param end One past the last new row
+ * @param chunk Chunk index (unused)
+ * @param userData ResampleJob
+ */
+static void resampleColumnsJob(int begin, int end, int chunk, void *userData) {
+    (void) chunk;
+    ResampleJob *job = userData;
+
+    for (int i = begin; i < end; ++i) {
+        ResampleTap t = job->taps[i];
+        const float *a = &job->rows[t.index * job->newDim];
+        const float *b = a + job->newDim;
+        vec3 *dest = &job->dest[i * job->newDim];
+        for (int j = 0; j < job->newDim; ++j) {
+            dest[j][0] = j * job->step;
+            dest[j][1] = glm_lerp(a[j], b[j], t.weight);
+            dest[j][2] = i * job->step;
+        }
+    }
+}
+
 /**
  * Updates control points when dimension or offset changes.
- * Preserves existing heights where possible and interpolates new points.
+ * Keeps the heights and only moves the points if the dimension is unchanged.
+ * A new dimension resamples the old heights bilinearly, so the surface keeps
+ * its shape over the normalized grid. Without old points the heights are random.
  *
  * @param cp Pointer to control points array to update
  * @param newDim New dimension (grid size) for control points
@@ -42,269 +323,808 @@ static void updateControlPoints(Vec3Arr *cp, int newDim, float cpOffset) {
     }
 
     float newStep = (1.0f / (newDim - 1)) + cpOffset;
-    Vec3Arr newPoints;
-    vec3arr_init(&newPoints);
-    vec3arr_reserve(&newPoints, newDim * newDim);
 
-    for (int i = 0; i < newDim; ++i) {
-        for (int j = 0; j < newDim; ++j) {
-            vec3 p;
-            p[0] = j * newStep;
-            p[2] = i * newStep;
-
-            float height = 0.0f;
-            bool reused = false;
-
-            // Reuse height from old grid if within bounds
-            if (i < oldDim && j < oldDim && oldDim > 0) {
-                height = cp->data[i * oldDim + j][1];
-                reused = true;
-            } else if (oldDim > 0) {
-                // Interpolate from neighboring old points
-                float sum = 0.0f;
-                int count = 0;
-
-                int ni = (int)roundf((float)i * (oldDim - 1) / (newDim - 1));
-                int nj = (int)roundf((float)j * (oldDim - 1) / (newDim - 1));
-
-                for (int di = -1; di <= 1; ++di) {
-                    for (int dj = -1; dj <= 1; ++dj) {
-                        int oi = ni + di;
-                        int oj = nj + dj;
-                        if (oi >= 0 && oi < oldDim && oj >= 0 && oj < oldDim) {
-                            sum += cp->data[oi * oldDim + oj][1];
-                            count++;
-                        }
-                    }
-                }
-
-                if (count > 0)
-                    height = sum / count;
-
-                height += RANDOM_HEIGHT(0.2f);
-            } else {
-                height = RANDOM_HEIGHT(0.5f);
+    // Offset only, the heights stay where they are
+    if (oldDim == newDim) {
+        for (int i = 0; i < newDim; ++i) {
+            for (int j = 0; j < newDim; ++j) {
+                cp->data[i * newDim + j][0] = j * newStep;
+                cp->data[i * newDim + j][2] = i * newStep;
             }
+        }
+        return;
+    }
+
+    Vec3Arr *dest = &g_cpResample.points;
+    Vec3Arr_resizeUninit(dest, newDim * newDim);
 
-            p[1] = height;
-            vec3arr_push(&newPoints, p);
+    if (oldDim < 2) {
+        for (int i = 0; i < newDim; ++i) {
+            for (int j = 0; j < newDim; ++j) {
+                glm_vec3_copy((vec3) { j * newStep, RANDOM_HEIGHT(0.5f), i * newStep }, dest->data[i * newDim + j]);
+            }
         }
+    } else {
+        g_cpResample.taps = reserveScratch(g_cpResample.taps, &g_cpResample.tapsCapacity, newDim, sizeof(ResampleTap));
+        g_cpResample.rows = reserveScratch(g_cpResample.rows, &g_cpResample.rowsCapacity, oldDim * newDim, sizeof(float));
+
+        // Square grids, one tap table serves both passes
+        float scale = (float)(oldDim - 1) / (newDim - 1);
+        for (int j = 0; j < newDim; ++j) {
+            float pos = j * scale;
+            int index = glm_min((int) pos, oldDim - 2);
+            g_cpResample.taps[j] = (ResampleTap) { index, pos - index };
+        }
+
+        ResampleJob job = {
+            .src = (const vec3*) cp->data,
+            .dest = dest->data,
+            .rows = g_cpResample.rows,
+            .taps = g_cpResample.taps,
+            .oldDim = oldDim,
+            .newDim = newDim,
+            .step = newStep
+        };
+        jobs_parallelFor(oldDim, SAMPLE_ROWS_PER_CHUNK, resampleRowsJob, &job);
+        jobs_parallelFor(newDim, SAMPLE_ROWS_PER_CHUNK, resampleColumnsJob, &job);
     }
 
-    vec3arr_free(cp);
-    *cp = newPoints;
+    // The old points become the scratch of the next resampling
+    Vec3Arr tmp = *cp;
+    *cp = *dest;
+    *dest = tmp;
 }
 
 /**
- * Generates polynomial patches from control points using B-spline basis.
- * Creates (dimension-3)×(dimension-3) patches, each defined by a 4×4 grid
- * of control points.
+ * Calculates a single polynomial patch from its 4×4 grid of control points.
  *
  * @param cp Pointer to control points array
  * @param dimension Grid dimension (number of control points per axis)
+ * @param i Patch index in s-direction
+ * @param j Patch index in t-direction
+ * @param patch Output: calculated patch
  */
-static void updatePatchesFromControlPoints(Vec3Arr *cp, int dimension) {
-    PatchArr_clear(&g_patches);
-    Patch patch;
+static void computePatch(Vec3Arr *cp, int dimension, int i, int j, Patch *patch) {
+    mat4 geometryTerm = GLM_MAT4_ZERO_INIT;
+
+    // Extract 4×4 height values for this patch
+    for (int u = 0; u < 4; ++u) {
+        for (int v = 0; v < 4; ++v) {
+            geometryTerm[v][u] = cp->data[(i + u) * dimension + (j + v)][1];
+        }
+    }
 
-    for (int i = 0; i < dimension - 3; ++i) {
-        for (int j = 0; j < dimension - 3; ++j) {
-            mat4 geometryTerm = GLM_MAT4_ZERO_INIT;
+    utils_calculatePolynomialPatch(patch, geometryTerm);
+}
 
-            // Extract 4×4 height values for this patch
-            for (int u = 0; u < 4; ++u) {
-                for (int v = 0; v < 4; ++v) {
-                    geometryTerm[v][u] = cp->data[(i + u) * dimension + (j + v)][1];
-                }
-            }
+/**
+ * Input of the parallel patch computation.
+ */
+typedef struct {
+    Vec3Arr *cp;
+    int dimension;
+    Patch *dest;
+} PatchJob;
 
-            utils_calculatePolynomialPatch(&patch, geometryTerm);
-            PatchArr_push(&g_patches, patch);
+/**
+ * Computes all patches of the patch rows [begin, end).
+ *
+ * @param begin First patch row
+ * @param end One past the last patch row
+ * @param chunk Chunk index (unused)
+ * @param userData PatchJob
+ */
+static void patchRowsJob(int begin, int end, int chunk, void *userData) {
+    (void) chunk;
+    PatchJob *job = userData;
+    int patchCount = job->dimension - 3;
+
+    for (int i = begin; i < end; ++i) {
+        for (int j = 0; j < patchCount; ++j) {
+            computePatch(job->cp, job->dimension, i, j, &job->dest[i * patchCount + j]);
         }
     }
 }
 
 /**
- * Generates complete surface mesh from patches.
- * Evaluates each patch at regular intervals to create a smooth surface.
- * Computes positions, normals, and texture coordinates for all vertices.
+ * Generates polynomial patches from control points using B-spline basis.
+ * Creates (dimension-3)×(dimension-3) patches, each defined by a 4×4 grid
+ * of control points. Only writes to its outputs.
  *
- * @param cp Control points array
- * @param samples Number of samples per patch (grid resolution)
- * @param dimension Control point grid dimension
- * @param textureTiling Texture repeat factor
- * @param minPoint Output: lowest point on surface
- * @param maxPoint Output: highest point on surface
- * @param extremesValid Output: whether extreme points are valid
- * @param computeExtremes Whether to compute min/max points
+ * @param cp Pointer to control points array
+ * @param dimension Grid dimension (number of control points per axis)
+ * @param patches Output: calculated patches
+ * @param eval Output: evaluation constants of the surface
  */
-void generateSurfaceVertices(Vec3Arr *cp, int samples, int dimension, float textureTiling, vec3 minPoint, vec3 maxPoint,
-    bool *extremesValid, bool computeExtremes) {
+static void computePatches(Vec3Arr *cp, int dimension, PatchArr *patches, SurfaceEval *eval) {
     int patchCount = dimension - 3;
-    int gridSize   = (samples < 2) ? 2 : samples;
-    int totalVerts = gridSize * gridSize;
 
-    vec3 *positions = malloc(sizeof(vec3) * totalVerts);
-    vec3 *normals   = malloc(sizeof(vec3) * totalVerts);
-    vec2 *texcoords = malloc(sizeof(vec2) * totalVerts);
+    Patch *dest = PatchArr_resizeUninit(patches, patchCount * patchCount);
+
+    PatchJob job = { .cp = cp, .dimension = dimension, .dest = dest };
+    jobs_parallelFor(patchCount, PATCH_ROWS_PER_CHUNK, patchRowsJob, &job);
+
+    eval->patchCount = patchCount;
+    eval->maxX = cp->data[dimension - 1][0];
+    eval->maxZ = cp->data[(dimension - 1) * dimension][2];
+    eval->stepX = eval->maxX / (patchCount * 3.0f);
+    eval->stepZ = eval->maxZ / (patchCount * 3.0f);
+}
+
+/**
+ * Grows a vertex buffer to at least count vertices.
+ * Contents are not preserved when it grows.
+ *
+ * @param data Vertex buffer
+ * @param capacity Capacity of the buffer
+ * @param count Required number of vertices
+ * @return The vertex buffer
+ */
+static Vertex* reserveVertices(Vertex **data, int *capacity, int count) {
+    if (*capacity < count) {
+        TRACKED_FREE(*data);
+        *data = TRACKED_MALLOC(count * sizeof(Vertex));
+        assert(*data && "malloc failed in reserveVertices");
+        *capacity = count;
+    }
+    return *data;
+}
+
+/**
+ * Returns the surface scratch buffer with room for at least count vertices.
+ * Contents are not preserved when it grows.
+ *
+ * @param count Required number of vertices
+ * @return Scratch vertices
+ */
+static Vertex* reserveSurfaceScratch(int count) {
+    return reserveVertices(&g_surfaceScratch.data, &g_surfaceScratch.capacity, count);
+}
 
-    float maxX = cp->data[dimension-1][0];
-    float maxZ = cp->data[(dimension-1)*dimension][2];
-    float stepX = maxX / (patchCount * 3.0f);
-    float stepZ = maxZ / (patchCount * 3.0f);
+/**
+ * Fills a sample axis table for a resolution, if it is not up to date.
+ * Must run before sampling, the sampling jobs only read the table.
+ *
+ * @param axis Table to fill
+ * @param gridSize Number of samples per axis
+ * @param patchCount Number of patches per axis
+ */
+static void updateSampleAxis(SampleAxisTable *axis, int gridSize, int patchCount) {
+    if (axis->gridSize == gridSize && axis->patchCount == patchCount) {
+        return;
+    }
 
-    float minH =  1e10f;
-    float maxH = -1e10f;
-    vec3 locMin = {0.0f, 0.0f, 0.0f};
-    vec3 locMax = {0.0f, 0.0f, 0.0f};
+    TRACKED_FREE(axis->data);
+    TRACKED_FREE(axis->local);
+    axis->data = TRACKED_MALLOC(gridSize * sizeof(SampleAxis));
+    axis->local = TRACKED_MALLOC(gridSize * sizeof(float));
+    assert(axis->data && axis->local && "malloc failed in updateSampleAxis");
+    axis->gridSize = gridSize;
+    axis->patchCount = patchCount;
 
-    // Sample surface at regular grid intervals
     for (int i = 0; i < gridSize; ++i) {
-        float T_s = (float)i / (gridSize - 1); // global s
-        float global_s = T_s * patchCount;
-        int patch_s = (int)floor(global_s);
-        if (patch_s >= patchCount) patch_s = patchCount - 1;
-        if (patch_s < 0) patch_s = 0;
-        float local_s = global_s - patch_s;
-
-        for (int j = 0; j < gridSize; ++j) {
-            float T_t = (float)j / (gridSize - 1); // global t
-            float global_t = T_t * patchCount;
-            int patch_t = (int)floor(global_t);
-            if (patch_t >= patchCount) patch_t = patchCount - 1;
-            if (patch_t < 0) patch_t = 0;
-            float local_t = global_t - patch_t;
-
-            Patch *p = &g_patches.data[patch_s * patchCount + patch_t];
-            PatchEvalResult res = utils_evalPatchLocal(p, local_s, local_t);
-
-            int idx = i * gridSize + j;
+        SampleAxis *a = &axis->data[i];
+        a->global = (float)i / (gridSize - 1);
+
+        float global = a->global * patchCount;
+        int patch = (int)floor(global);
+        if (patch >= patchCount) patch = patchCount - 1;
+        if (patch < 0) patch = 0;
+        float local = global - patch;
+
+        a->patch = patch;
+        a->world = patch * 3 + local * 3;
+        axis->local[i] = local;
+        utils_patchBasis(local, &a->basis);
+    }
+}
+
+/**
+ * Samples a part of one row of the regular surface sample grid.
+ * Contracts a patch with the row's s basis once per patch crossing and
+ * the batch kernel evaluates the columns on it.
+ *
+ * @param axis Sample axis table of the resolution
+ * @param patchRow Patches of the patch row containing the sample row
+ * @param i Sample row
+ * @param firstT First sample column
+ * @param lastT Last sample column (inclusive)
+ * @param stepX Control point spacing in X
+ * @param stepZ Control point spacing in Z
+ * @param textureTiling Texture repeat factor
+ * @param kernel Kernel for the batch evaluation
+ * @param rowDest Output: lastT - firstT + 1 vertices
+ */
+static void sampleSurfaceRow(const SampleAxisTable *axis, Patch *patchRow, int i, int firstT, int lastT,
+    float stepX, float stepZ, float textureTiling, SimdKernel kernel, Vertex *rowDest) {
+    const SampleAxis *as = &axis->data[i];
+    PatchEvalResult results[SAMPLE_BLOCK];
+
+    int j = firstT;
+    while (j <= lastT) {
+        // Columns of one patch share s^T * C, at most SAMPLE_BLOCK at once
+        int patch = axis->data[j].patch;
+        int blockEnd = j + 1;
+        while (blockEnd <= lastT && blockEnd - j < SAMPLE_BLOCK && axis->data[blockEnd].patch == patch) {
+            ++blockEnd;
+        }
+
+        vec4 row, rowDs;
+        utils_evalPatchRow(&patchRow[patch], &as->basis, row, rowDs);
+        evaluate_patchRow(kernel, row, rowDs, &axis->local[j], blockEnd - j, results);
+
+        for (int k = j; k < blockEnd; ++k) {
+            const SampleAxis *at = &axis->data[k];
+            const PatchEvalResult *res = &results[k - j];
+            Vertex *v = &rowDest[k - firstT];
 
             // world position
-            positions[idx][0] = (patch_t * 3 + local_t * 3) * stepX;
-            positions[idx][2] = (patch_s * 3 + local_s * 3) * stepZ;
-            positions[idx][1] = res.value;
-            
+            v->position[0] = at->world * stepX;
+            v->position[1] = res->value;
+            v->position[2] = as->world * stepZ;
+
             // normal from partial derivatives
-            utils_getNormal(res.dsd, res.dtd, stepX, stepZ, normals[idx]);
+            utils_getNormal(res->dsd, res->dtd, stepX, stepZ, v->normal);
 
             // TexCoords with tiling
-            texcoords[idx][0] = T_s * textureTiling;
-            texcoords[idx][1] = T_t * textureTiling;
-
-            // extreme points based on interpolated surface
-            if (computeExtremes) {
-                float h = positions[idx][1];
-                if (h > maxH) {
-                    maxH = h;
-                    glm_vec3_copy(positions[idx], locMax);
-                }
-                if (h < minH) {
-                    minH = h;
-                    glm_vec3_copy(positions[idx], locMin);
-                }
-            }
+            v->texCoords[0] = as->global * textureTiling;
+            v->texCoords[1] = at->global * textureTiling;
         }
+        j = blockEnd;
     }
+}
 
-    if (computeExtremes) {
-        glm_vec3_copy(locMin, minPoint);
-        glm_vec3_copy(locMax, maxPoint);
-        *extremesValid = true;
+/**
+ * Samples a rectangle of the regular surface sample grid row by row.
+ *
+ * @param axis Sample axis table of the resolution
+ * @param patches Patches of the surface
+ * @param dest Output vertices, row-major with lastT - firstT + 1 per row
+ * @param firstS First sample row
+ * @param lastS Last sample row (inclusive)
+ * @param firstT First sample column
+ * @param lastT Last sample column (inclusive)
+ * @param stepX Control point spacing in X
+ * @param stepZ Control point spacing in Z
+ * @param textureTiling Texture repeat factor
+ * @param kernel Kernel for the batch evaluation
+ */
+static void sampleSurfaceRect(const SampleAxisTable *axis, Patch *patches, Vertex *dest,
+    int firstS, int lastS, int firstT, int lastT,
+    float stepX, float stepZ, float textureTiling, SimdKernel kernel) {
+    int patchCount = axis->patchCount;
+    int width = lastT - firstT + 1;
+
+    for (int i = firstS; i <= lastS; ++i) {
+        Patch *patchRow = &patches[axis->data[i].patch * patchCount];
+        sampleSurfaceRow(axis, patchRow, i, firstT, lastT, stepX, stepZ, textureTiling, kernel,
+            &dest[(i - firstS) * width]);
+    }
+}
+
+/**
+ * Recomputes the height pyramid leaves of the patches loS..hiS × loT..hiT
+ * from a sampled rectangle containing all of their samples,
+ * then recombines the nodes above them.
+ * Extreme points are based on the interpolated surface.
+ *
+ * @param heights Height pyramid of the surface
+ * @param axis Sample axis table of the resolution
+ * @param vertices Sampled rectangle, row-major with lastT - firstT + 1 per row
+ * @param firstS First sample row
+ * @param lastS Last sample row (inclusive)
+ * @param firstT First sample column
+ * @param lastT Last sample column (inclusive)
+ * @param loS First patch row
+ * @param hiS Last patch row (inclusive)
+ * @param loT First patch column
+ * @param hiT Last patch column (inclusive)
+ */
+static void updateHeights(HeightPyramid *heights, const SampleAxisTable *axis, const Vertex *vertices,
+    int firstS, int lastS, int firstT, int lastT, int loS, int hiS, int loT, int hiT) {
+    int width = lastT - firstT + 1;
+    heights_clear(heights, loS, hiS, loT, hiT);
+
+    for (int i = firstS; i <= lastS; ++i) {
+        int patchS = axis->data[i].patch;
+        if (patchS < loS || patchS > hiS) continue;
+
+        const Vertex *row = &vertices[(i - firstS) * width];
+        for (int j = firstT; j <= lastT; ++j) {
+            int patchT = axis->data[j].patch;
+            if (patchT < loT || patchT > hiT) continue;
+            heights_addSample(heights_leaf(heights, patchS, patchT), row[j - firstT].position);
+        }
     }
 
-    model_updateSurface(positions, normals, texcoords, gridSize);
-    free(positions);
-    free(normals);
-    free(texcoords);
+    heights_update(heights, loS, hiS, loT, hiT);
 }
 
 /**
- * Complete surface rebuild: updates control points, recalculates patches,
- * and generates new surface mesh.
+ * Input of the parallel surface sampling.
+ */
+typedef struct {
+    const SampleAxisTable *axis;
+    Patch *patches;
+    Vertex *vertices;
+    int gridSize;
+    float stepX, stepZ;
+    float textureTiling;
+    SimdKernel kernel;
+} SampleJob;
+
+/**
+ * Samples all vertices of the sample rows [begin, end).
  *
- * @param cp Control points array
- * @param dimension Control point grid dimension
- * @param samples Surface sampling resolution
- * @param cpOffset Control point spacing offset
+ * @param begin First sample row
+ * @param end One past the last sample row
+ * @param chunk Chunk index (unused)
+ * @param userData SampleJob
+ */
+static void sampleRowsJob(int begin, int end, int chunk, void *userData) {
+    (void) chunk;
+    SampleJob *job = userData;
+    Vertex *rows = &job->vertices[begin * job->gridSize];
+
+    sampleSurfaceRect(job->axis, job->patches, rows, begin, end - 1, 0, job->gridSize - 1,
+        job->stepX, job->stepZ, job->textureTiling, job->kernel);
+}
+
+/**
+ * Samples the complete regular sample grid of a surface.
+ * Computes positions, normals, and texture coordinates for all vertices
+ * and the complete height pyramid. Only writes to its outputs.
+ *
+ * @param axis Sample axis table of the resolution
+ * @param patches Patches of the surface
+ * @param eval Evaluation constants of the surface
+ * @param vertices Output: axis->gridSize^2 vertices
  * @param textureTiling Texture repeat factor
- * @param minPoint Output: lowest point on surface
- * @param maxPoint Output: highest point on surface
- * @param extremesValid Output: whether extreme points are valid
+ * @param kernel Kernel for the batch evaluation
+ * @param heights Output: height pyramid of the surface
+ */
+static void sampleSurface(const SampleAxisTable *axis, Patch *patches, const SurfaceEval *eval, Vertex *vertices,
+    float textureTiling, SimdKernel kernel, HeightPyramid *heights) {
+    SampleJob job = {
+        .axis = axis,
+        .patches = patches,
+        .vertices = vertices,
+        .gridSize = axis->gridSize,
+        .stepX = eval->stepX,
+        .stepZ = eval->stepZ,
+        .textureTiling = textureTiling,
+        .kernel = kernel
+    };
+
+    // Sample surface at regular grid intervals, rows are split across threads
+    jobs_parallelFor(job.gridSize, SAMPLE_ROWS_PER_CHUNK, sampleRowsJob, &job);
+
+    int last = job.gridSize - 1;
+    heights_resize(heights, axis->patchCount);
+    updateHeights(heights, axis, vertices, 0, last, 0, last, 0, axis->patchCount - 1, 0, axis->patchCount - 1);
+}
+
+/**
+ * Copies the extremes of the current surface into the input data.
+ *
+ * @param data Input data
+ */
+static void updateExtremes(InputData *data) {
+    const HeightBounds *root = heights_root(&g_heights);
+    glm_vec3_copy((float*) root->minPoint, data->surface.minPoint);
+    glm_vec3_copy((float*) root->maxPoint, data->surface.maxPoint);
+    data->surface.extremesValid = true;
+}
+
+/**
+ * Checks whether the sampled mesh has to follow surface edits. It is not
+ * drawn while the surface is tessellated, unless the GPU ball physics
+ * samples its heightmap.
+ *
+ * @param data Input data
+ * @return True if edits must update the mesh
  */
-static void rebuildSurface(Vec3Arr *cp, int dimension, int samples, float cpOffset, float textureTiling, vec3 minPoint,
-    vec3 maxPoint, bool *extremesValid) {
-    updateControlPoints(cp, dimension, cpOffset);
-    updatePatchesFromControlPoints(cp, dimension);
-    generateSurfaceVertices(cp, samples, dimension, textureTiling, minPoint, maxPoint, extremesValid, true);
+static bool needsSampledMesh(InputData *data) {
+    return data->physics.gpu
+        || !model_isSurfaceTessellated(data->quality.surfaceNormals, data->surface.tessellate);
 }
 
 /**
- * Recalculates minimum and maximum points based on control point heights.
- * Used when control points are manually adjusted.
+ * Resamples and uploads the complete mesh of the current surface.
+ * Only valid while no background rebuild is pending, the current
+ * surface then matches the input data.
+ * The compute shader samples the uploaded patches straight into the
+ * vertex buffer, the height pyramid and the baked occlusion already
+ * follow every local edit.
  *
- * @param cp Control points array
- * @param minPoint Output: lowest control point
- * @param maxPoint Output: highest control point
- * @param extremesValid Output: set to true if calculation succeeded
+ * @param data Input data
  */
-static void recalculateExtremes(Vec3Arr *cp, vec3 minPoint, vec3 maxPoint, bool *extremesValid) {
-    if (cp->size == 0) {
-        *extremesValid = false;
+static void generateSurfaceVertices(InputData *data) {
+    TIMELINE_BEGIN("Generate Surface");
+    PERFCOUNT_BEGIN("Generate Surface");
+    g_surfaceScratch.meshStale = false;
+
+    int gridSize = (data->surface.resolution < 2) ? 2 : data->surface.resolution;
+    if (data->surface.gpuMesh && model_generateSurface(gridSize, data->surface.minPoint, data->surface.maxPoint)) {
+        data->surface.extremesValid = true;
+        PERFCOUNT_END();
+        TIMELINE_END();
         return;
     }
 
-    float minHeight = 1e10f;
-    float maxHeight = -1e10f;
-    vec3 minPos, maxPos;
+    Vertex *vertices = reserveSurfaceScratch(gridSize * gridSize);
+
+    updateSampleAxis(&g_sampleAxis, gridSize, g_surfaceEval.patchCount);
+    sampleSurface(&g_sampleAxis, g_patches.data, &g_surfaceEval, vertices, data->surface.textureTiling,
+        data->surface.kernel, &g_heights);
+    updateExtremes(data);
+
+    model_updateSurface(vertices, gridSize);
+    PERFCOUNT_END();
+    TIMELINE_END();
+}
+
+/**
+ * Complete surface build: recalculates patches, the sample axis table
+ * and the surface mesh. Only touches the request and the build.
+ *
+ * @param req Build parameters
+ * @param build Output: the built surface
+ */
+static void buildSurface(RebuildRequest *req, SurfaceBuild *build) {
+    TIMELINE_BEGIN("Build Surface");
+    int gridSize = (req->resolution < 2) ? 2 : req->resolution;
+
+    computePatches(&req->controlPoints, req->dimension, &build->patches, &build->eval);
+    updateSampleAxis(&build->axis, gridSize, build->eval.patchCount);
+    reserveVertices(&build->vertices, &build->capacity, gridSize * gridSize);
+    sampleSurface(&build->axis, build->patches.data, &build->eval, build->vertices,
+        req->textureTiling, req->kernel, &build->heights);
+    build->gridSize = gridSize;
+
+    int rebaked[4];
+    aobake_resize(&build->ao, gridSize, build->eval.maxX, build->eval.maxZ);
+    aobake_update(&build->ao, build->vertices, 0, gridSize - 1, 0, gridSize - 1, rebaked);
+
+    if (req->normalMap) {
+        int last = build->eval.patchCount - 1;
+        normalbake_resize(&build->normals, build->eval.patchCount, build->eval.stepX, build->eval.stepZ,
+            build->eval.maxX, build->eval.maxZ);
+        normalbake_update(&build->normals, build->patches.data, 0, last, 0, last, rebaked);
+    } else {
+        normalbake_free(&build->normals);
+    }
+    TIMELINE_END();
+}
 
-    for (size_t i = 0; i < cp->size; ++i) {
-        float height = cp->data[i][1];
-        
-        if (height > maxHeight) {
-            maxHeight = height;
-            glm_vec3_copy(cp->data[i], maxPos);
+/**
+ * Frees all buffers of a surface build.
+ *
+ * @param build Build to free
+ */
+static void freeSurfaceBuild(SurfaceBuild *build) {
+    PatchArr_free(&build->patches);
+    TRACKED_FREE(build->axis.data);
+    TRACKED_FREE(build->axis.local);
+    TRACKED_FREE(build->vertices);
+    heights_free(&build->heights);
+    aobake_free(&build->ao);
+    normalbake_free(&build->normals);
+    *build = (SurfaceBuild) {0};
+}
+
+/**
+ * Builds the pending request and publishes it as the result.
+ * Must be called with the rebuild mutex held, it is released during the build.
+ */
+static void processRebuild(void) {
+    RebuildRequest tmp = g_rebuild.current;
+    g_rebuild.current = g_rebuild.request;
+    g_rebuild.request = tmp;
+    g_rebuild.requested = false;
+    g_rebuild.busy = true;
+    MUTEX_UNLOCK(&g_rebuild.mutex);
+
+    buildSurface(&g_rebuild.current, &g_rebuild.work);
+
+    MUTEX_LOCK(&g_rebuild.mutex);
+    SurfaceBuild done = g_rebuild.work;
+    g_rebuild.work = g_rebuild.result;
+    g_rebuild.result = done;
+
+    // An unconsumed result is replaced, its reset and shift must not get lost
+    g_rebuild.resultStructural = g_rebuild.resultStructural || g_rebuild.current.structural;
+    glm_vec3_add(g_rebuild.resultShift, g_rebuild.current.shift, g_rebuild.resultShift);
+    g_rebuild.ready = true;
+    g_rebuild.busy = false;
+    COND_BROADCAST(&g_rebuild.cond);
+}
+
+/**
+ * Writes the PLY header of a surface mesh.
+ *
+ * @param f Destination
+ * @param gridSize Number of samples per axis
+ * @param numVertices Number of written vertices
+ * @param numFaces Number of written triangles
+ */
+static void writePlyHeader(FILE *f, int gridSize, long numVertices, long numFaces) {
+    fprintf(f, "ply\nformat binary_little_endian 1.0\n");
+    fprintf(f, "comment sampled spline surface, %dx%d samples\n", gridSize, gridSize);
+    fprintf(f, "element vertex %ld\n", numVertices);
+    fprintf(f, "property float x\nproperty float y\nproperty float z\n");
+    fprintf(f, "property float nx\nproperty float ny\nproperty float nz\n");
+    fprintf(f, "property float s\nproperty float t\n");
+    fprintf(f, "element face %ld\n", numFaces);
+    fprintf(f, "property list uchar int vertex_indices\nend_header\n");
+}
+
+/**
+ * Writes the two triangles of every quad of one sample row strip,
+ * with the winding of the drawn surface.
+ *
+ * @param f Destination
+ * @param gridSize Number of samples per axis
+ * @param y Upper sample row of the strip
+ * @param faces Scratch of EXPORT_FACE_SIZE bytes per triangle of the strip
+ */
+static void writeFaceRow(FILE *f, int gridSize, int y, unsigned char *faces) {
+    unsigned char *dest = faces;
+    for (int x = 0; x < gridSize - 1; ++x) {
+        int32_t v0 = y * gridSize + x;
+        int32_t v1 = v0 + 1;
+        int32_t v2 = v0 + gridSize;
+        int32_t v3 = v2 + 1;
+        int32_t tris[2][3] = { { v0, v2, v1 }, { v2, v3, v1 } };
+
+        for (int k = 0; k < 2; ++k) {
+            dest[0] = 3;
+            memcpy(dest + 1, tris[k], sizeof(tris[k]));
+            dest += EXPORT_FACE_SIZE;
+        }
+    }
+    fwrite(faces, 1, dest - faces, f);
+}
+
+/**
+ * Simplifies a range of export chunks to the kept share of their triangles.
+ *
+ * @param begin First chunk
+ * @param end Chunk after the last one
+ * @param chunk Index of the job chunk
+ * @param userData The ExportDecimation
+ */
+static void exportDecimateJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    const ExportDecimation *job = userData;
+    GLuint *scratch = TRACKED_MALLOC(DECIMATE_MAX_CHUNK_QUADS * DECIMATE_MAX_CHUNK_QUADS * 6 * sizeof(GLuint));
+    assert(scratch && "malloc failed in exportDecimateJob");
+
+    for (int i = begin; i < end; ++i) {
+        ExportChunk *c = &job->chunks[i];
+        int budget = (int) ((long) 2 * (c->x1 - c->x0) * (c->z1 - c->z0) * g_export.percent / 100);
+        int offsets[2];
+        decimate_chunk(&job->grid[0].position[1], sizeof(Vertex), job->gridSize, job->spacing,
+                       c->x0, c->z0, c->x1, c->z1, &budget, 1, scratch, offsets);
+
+        c->count = offsets[1];
+        c->indices = TRACKED_MALLOC(c->count * sizeof(GLuint));
+        assert(c->indices && "malloc failed in exportDecimateJob");
+        memcpy(c->indices, scratch, c->count * sizeof(GLuint));
+    }
+    TRACKED_FREE(scratch);
+}
+
+/**
+ * Writes a quadric simplified mesh of the sampled grid, the chunks are
+ * simplified in parallel with their borders kept, so the mesh stays closed.
+ * Only the vertices still referenced are written.
+ *
+ * @param f Destination
+ * @param gridSize Number of samples per axis
+ * @param grid All samples, row by row
+ */
+static void writeDecimatedMesh(FILE *f, int gridSize, const Vertex *grid) {
+    int quads = gridSize - 1;
+    int perAxis = (quads + DECIMATE_MAX_CHUNK_QUADS - 1) / DECIMATE_MAX_CHUNK_QUADS;
+    ExportChunk *chunks = TRACKED_MALLOC(perAxis * perAxis * sizeof(ExportChunk));
+    int32_t *remap = TRACKED_MALLOC((size_t) gridSize * gridSize * sizeof(int32_t));
+    assert(chunks && remap && "malloc failed in writeDecimatedMesh");
+
+    for (int i = 0; i < perAxis; ++i) {
+        for (int j = 0; j < perAxis; ++j) {
+            ExportChunk *c = &chunks[i * perAxis + j];
+            c->x0 = j * DECIMATE_MAX_CHUNK_QUADS;
+            c->z0 = i * DECIMATE_MAX_CHUNK_QUADS;
+            c->x1 = glm_imin(c->x0 + DECIMATE_MAX_CHUNK_QUADS, quads);
+            c->z1 = glm_imin(c->z0 + DECIMATE_MAX_CHUNK_QUADS, quads);
+        }
+    }
+
+    const float *last = grid[(size_t) gridSize * gridSize - 1].position;
+    ExportDecimation job = {
+        .grid = grid,
+        .gridSize = gridSize,
+        .spacing = { (last[0] - grid[0].position[0]) / quads, (last[2] - grid[0].position[2]) / quads },
+        .chunks = chunks
+    };
+    jobs_parallelFor(perAxis * perAxis, 1, exportDecimateJob, &job);
+
+    // Referenced vertices keep their grid order
+    long numFaces = 0;
+    memset(remap, 0, (size_t) gridSize * gridSize * sizeof(int32_t));
+    for (int i = 0; i < perAxis * perAxis; ++i) {
+        for (int k = 0; k < chunks[i].count; ++k) {
+            remap[chunks[i].indices[k]] = 1;
         }
-        if (height < minHeight) {
-            minHeight = height;
-            glm_vec3_copy(cp->data[i], minPos);
+        numFaces += chunks[i].count / 3;
+    }
+    int32_t numVertices = 0;
+    for (long v = 0; v < (long) gridSize * gridSize; ++v) {
+        remap[v] = remap[v] ? numVertices++ : -1;
+    }
+
+    writePlyHeader(f, gridSize, numVertices, numFaces);
+    for (long v = 0; v < (long) gridSize * gridSize; ++v) {
+        if (remap[v] >= 0) {
+            fwrite(&grid[v], sizeof(Vertex), 1, f);
+        }
+    }
+
+    unsigned char face[EXPORT_FACE_SIZE];
+    face[0] = 3;
+    for (int i = 0; i < perAxis * perAxis; ++i) {
+        for (int k = 0; k < chunks[i].count; k += 3) {
+            int32_t tri[3] = {
+                remap[chunks[i].indices[k]], remap[chunks[i].indices[k + 1]], remap[chunks[i].indices[k + 2]]
+            };
+            memcpy(face + 1, tri, sizeof(tri));
+            fwrite(face, 1, EXPORT_FACE_SIZE, f);
         }
+        TRACKED_FREE(chunks[i].indices);
     }
 
-    glm_vec3_copy(minPos, minPoint);
-    glm_vec3_copy(maxPos, maxPoint);
-    *extremesValid = true;
+    TRACKED_FREE(chunks);
+    TRACKED_FREE(remap);
+}
+
+/**
+ * Samples the snapshot row by row into a binary PLY file. Only the patch
+ * row of the current sample row and one row of vertices are held, the
+ * patches are computed when the sample rows cross into the next patch row.
+ * A simplified export needs all counts before the header, it samples the
+ * whole grid into memory first.
+ *
+ * @return false if the file could not be written
+ */
+static bool exportSurface(void) {
+    int dimension = g_export.dimension;
+    int gridSize = g_export.gridSize;
+    int patchCount = dimension - 3;
+    Vec3Arr *cp = &g_export.controlPoints;
+
+    FILE *f = fopen(g_export.path, "wb");
+    if (!f) {
+        return false;
+    }
+    setvbuf(f, NULL, _IOFBF, EXPORT_BUFFER_SIZE);
+    bool decimated = g_export.percent < 100;
+    if (!decimated) {
+        writePlyHeader(f, gridSize, (long) gridSize * gridSize, (long) (gridSize - 1) * (gridSize - 1) * 2);
+    }
+
+    SampleAxisTable axis = {0};
+    updateSampleAxis(&axis, gridSize, patchCount);
+    float stepX = cp->data[dimension - 1][0] / (patchCount * 3.0f);
+    float stepZ = cp->data[(dimension - 1) * dimension][2] / (patchCount * 3.0f);
+
+    Patch *patchRow = TRACKED_MALLOC(patchCount * sizeof(Patch));
+    Vertex *row = TRACKED_MALLOC((size_t) gridSize * (decimated ? gridSize : 1) * sizeof(Vertex));
+    unsigned char *faces = TRACKED_MALLOC((size_t)(gridSize - 1) * 2 * EXPORT_FACE_SIZE);
+    assert(patchRow && row && faces && "malloc failed in exportSurface");
+
+    // Vertex is eight packed floats, the layout of the vertex element
+    int rowPatch = -1;
+    for (int i = 0; i < gridSize; ++i) {
+        if (axis.data[i].patch != rowPatch) {
+            rowPatch = axis.data[i].patch;
+            for (int j = 0; j < patchCount; ++j) {
+                computePatch(cp, dimension, rowPatch, j, &patchRow[j]);
+            }
+        }
+        Vertex *dest = decimated ? row + (size_t) i * gridSize : row;
+        sampleSurfaceRow(&axis, patchRow, i, 0, gridSize - 1, stepX, stepZ,
+            g_export.textureTiling, g_export.kernel, dest);
+        if (!decimated) {
+            fwrite(row, sizeof(Vertex), gridSize, f);
+        }
+    }
+
+    if (decimated) {
+        writeDecimatedMesh(f, gridSize, row);
+    } else {
+        for (int y = 0; y < gridSize - 1; ++y) {
+            writeFaceRow(f, gridSize, y, faces);
+        }
+    }
+
+    TRACKED_FREE(patchRow);
+    TRACKED_FREE(row);
+    TRACKED_FREE(faces);
+    TRACKED_FREE(axis.data);
+    TRACKED_FREE(axis.local);
+
+    bool ok = !ferror(f);
+    return (fclose(f) == 0) && ok;
+}
+
+/**
+ * Export thread entry, runs one export and ends.
+ */
+static THREAD_ENTRY(exportMain) {
+    (void) arg;
+    timeline_setThreadName("Surface Export");
+    TIMELINE_BEGIN("Export Surface");
+    double start = glfwGetTime();
+    bool ok = exportSurface();
+    TIMELINE_END();
+
+    if (ok) {
+        printf("Surface exported to %s (%dx%d samples, %.0f ms)\n", g_export.path,
+            g_export.gridSize, g_export.gridSize, (glfwGetTime() - start) * 1000.0);
+    } else {
+        printf("Surface could not be exported to %s\n", g_export.path);
+    }
+    ATOMIC_EXCHANGE(&g_export.running, 0);
+    THREAD_RETURN;
+}
+
+/**
+ * Waits for the export thread to end.
+ */
+static void joinExport(void) {
+    if (g_export.threadStarted) {
+        THREAD_JOIN(g_export.thread);
+        g_export.threadStarted = false;
+    }
+}
+
+/**
+ * Rebuild worker thread entry.
+ */
+static THREAD_ENTRY(rebuildMain) {
+    (void) arg;
+    timeline_setThreadName("Surface Rebuild");
+    MUTEX_LOCK(&g_rebuild.mutex);
+    for (;;) {
+        while (g_rebuild.running && !g_rebuild.requested) {
+            COND_WAIT(&g_rebuild.cond, &g_rebuild.mutex);
+        }
+        if (!g_rebuild.running) {
+            break;
+        }
+        processRebuild();
+    }
+    MUTEX_UNLOCK(&g_rebuild.mutex);
+    THREAD_RETURN;
 }
 
 /**
  * Checks for control point selection input and updates heights accordingly.
- * Handles up/down arrow key presses to adjust selected control point height.
+ * Handles up/down arrow key presses to adjust selected control point height
+ * and flags the edit as surface.heightsChanged.
  *
  * @param data input data
  */
 static void checkSelectionState(InputData *data) {
-    bool heightChanged = false;
-
     if (data->selection.pressingUp) {
         data->surface.controlPoints.data[data->selection.selectedCp][1] += data->selection.selectedYChange;
-        data->surface.dimensionChanged = true;
-        heightChanged = true;
+        data->surface.heightsChanged = true;
     }
 
     if (data->selection.pressingDown) {
         data->surface.controlPoints.data[data->selection.selectedCp][1] -= data->selection.selectedYChange;
-        data->surface.dimensionChanged = true;
-        heightChanged = true;
-    }
-
-    // Recalculate extremes if height was manually changed
-    if (heightChanged) {
-        recalculateExtremes(
-            &data->surface.controlPoints,
-            data->surface.minPoint,
-            data->surface.maxPoint,
-            &data->surface.extremesValid
-        );
+        data->surface.heightsChanged = true;
     }
 }
 
@@ -313,13 +1133,12 @@ static void checkSelectionState(InputData *data) {
  * Converts global (T_s, T_t) coordinates to local patch coordinates
  * and evaluates the corresponding polynomial.
  *
- * @param dimension Control point grid dimension
  * @param T_s Normalized s coordinate [0,1]
  * @param T_t Normalized t coordinate [0,1]
  * @return Height value at specified position
  */
-static float evalSurfaceAt(int dimension, float T_s, float T_t) {
-    int patchCount = dimension - 3;
+static float evalSurfaceAt(float T_s, float T_t) {
+    int patchCount = g_surfaceEval.patchCount;
 
     float global_s = T_s * patchCount;
     int patch_s = (int)floor(global_s);
@@ -339,60 +1158,655 @@ static float evalSurfaceAt(int dimension, float T_s, float T_t) {
     return res.value;
 }
 
+/**
+ * Finds the patch and local params of global params using the cached surface constants.
+ *
+ * @param gT Global t-parameter X-direction
+ * @param gS Global s-parameter Z-direction
+ * @param patchS Output: patch index in s-direction
+ * @param patchT Output: patch index in t-direction
+ * @param localS Output: local s-parameter
+ * @param localT Output: local t-parameter
+ */
+static inline void locateSplineCached(float gT, float gS, int *patchS, int *patchT, float *localS, float *localT) {
+    int patchCount = g_surfaceEval.patchCount;
+
+    // Convert global params to patch indices and local params
+    float global_s = gS * patchCount;
+    int patch_s = (int) floorf(global_s);
+    *patchS = CLAMP(patch_s, 0, patchCount - 1);
+    *localS = global_s - *patchS;
+
+    float global_t = gT * patchCount;
+    int patch_t = (int) floorf(global_t);
+    *patchT = CLAMP(patch_t, 0, patchCount - 1);
+    *localT = global_t - *patchT;
+}
+
+/**
+ * Converts a patch evaluation into world position and normal.
+ *
+ * @param patchS Patch index in s-direction
+ * @param patchT Patch index in t-direction
+ * @param localS Local s-parameter
+ * @param localT Local t-parameter
+ * @param res Evaluation of the patch at localS, localT
+ * @param posDest world-space position
+ * @param normalDest surface normal
+ */
+static inline void splinePointCached(int patchS, int patchT, float localS, float localT,
+    const PatchEvalResult *res, vec3 posDest, vec3 normalDest) {
+    posDest[0] = (patchT * 3 + localT * 3) * g_surfaceEval.stepX;
+    posDest[1] = res->value;
+    posDest[2] = (patchS * 3 + localS * 3) * g_surfaceEval.stepZ;
+    utils_getNormal(res->dsd, res->dtd, g_surfaceEval.stepX, g_surfaceEval.stepZ, normalDest);
+}
+
+/**
+ * Evaluates the surface at global params using the cached surface constants.
+ *
+ * @param gT Global t-parameter X-direction
+ * @param gS Global s-parameter Z-direction
+ * @param posDest world-space position
+ * @param normalDest surface normal
+ */
+static inline void evalSplineCached(float gT, float gS, vec3 posDest, vec3 normalDest) {
+    int patchS, patchT;
+    float localS, localT;
+    locateSplineCached(gT, gS, &patchS, &patchT, &localS, &localT);
+
+    // Evaluate patch at local coordinates
+    Patch *p = &g_patches.data[patchS * g_surfaceEval.patchCount + patchT];
+    PatchEvalResult res = utils_evalPatchLocal(p, localS, localT);
+    splinePointCached(patchS, patchT, localS, localT, &res, posDest, normalDest);
+}
+
+/**
+ * Projects a world position into normalized surface coords
+ * using the cached surface extents.
+ *
+ * @param worldPos Position in world space
+ * @param outS normalized s-coordinate
+ * @param outT normalized t-coordinate
+ */
+static inline void projectCached(const vec3 worldPos, float *outS, float *outT) {
+    float gT = worldPos[0] / g_surfaceEval.maxX;
+    float gS = worldPos[2] / g_surfaceEval.maxZ;
+    *outT = CLAMP(gT, 0.0f, 1.0f);
+    *outS = CLAMP(gS, 0.0f, 1.0f);
+}
+
+/**
+ * Refines normalized surface coords to the closest surface point of a world position.
+ * Runs Gauss-Newton steps on |P(s,t) - worldPos|² with the patch polynomial,
+ * where P(s,t) = (t * maxX, q(s,t), s * maxZ). Starting from a nearby
+ * guess (e.g. the last contact) it converges in one or two steps.
+ *
+ * @param worldPos Position in world space
+ * @param s In: start s-coordinate, out: refined s-coordinate
+ * @param t In: start t-coordinate, out: refined t-coordinate
+ */
+static void projectNewton(const vec3 worldPos, float *s, float *t) {
+    int patchCount = g_surfaceEval.patchCount;
+    if (patchCount <= 0) {
+        return;
+    }
+
+    float maxX = g_surfaceEval.maxX;
+    float maxZ = g_surfaceEval.maxZ;
+    float maxStep = 1.0f / patchCount;
+
+    float gS = CLAMP(*s, 0.0f, 1.0f);
+    float gT = CLAMP(*t, 0.0f, 1.0f);
+
+    for (int it = 0; it < PROJECT_ITERATIONS; ++it) {
+        int patchS, patchT;
+        float localS, localT;
+        locateSplineCached(gT, gS, &patchS, &patchT, &localS, &localT);
+        Patch *p = &g_patches.data[patchS * patchCount + patchT];
+        PatchEvalResult res = utils_evalPatchLocal(p, localS, localT);
+
+        // Residual and tangents in normalized params
+        vec3 r = { gT * maxX - worldPos[0], res.value - worldPos[1], gS * maxZ - worldPos[2] };
+        float hS = res.dsd * patchCount;
+        float hT = res.dtd * patchCount;
+
+        // Normal equations (J^T J) d = -J^T r with J = [dP/ds, dP/dt]
+        float aa = hS * hS + maxZ * maxZ;
+        float bb = hT * hT + maxX * maxX;
+        float ab = hS * hT;
+        float ga = hS * r[1] + maxZ * r[2];
+        float gb = maxX * r[0] + hT * r[1];
+        float det = aa * bb - ab * ab;
+        if (det <= 0.0f) {
+            break;
+        }
+
+        // Limit the step to one patch so the polynomial stays meaningful
+        float dS = -(bb * ga - ab * gb) / det;
+        float dT = -(aa * gb - ab * ga) / det;
+        dS = CLAMP(dS, -maxStep, maxStep);
+        dT = CLAMP(dT, -maxStep, maxStep);
+
+        float newS = CLAMP(gS + dS, 0.0f, 1.0f);
+        float newT = CLAMP(gT + dT, 0.0f, 1.0f);
+        bool converged = fabsf(newS - gS) < PROJECT_EPSILON && fabsf(newT - gT) < PROJECT_EPSILON;
+        gS = newS;
+        gT = newT;
+        if (converged) {
+            break;
+        }
+    }
+
+    *s = gS;
+    *t = gT;
+}
+
+/**
+ * Places all obstacles on the surface at their global params.
+ *
+ * @param data Input data containing obstacle array
+ */
 static void updateObstacles(InputData *data) {
-    for (int i = 0; i < OBSTACLE_COUNT; ++i) {
-        Obstacle *o = &data->game.obstacles[i];
-        logic_evalSplineGlobal(o->gT, o->gS, o->center, o->normal);
+    ObstacleArr *obstacles = &data->game.obstacles;
+    int count = (int) obstacles->size;
+    if (count == 0) {
+        return;
+    }
+
+    float *gT = TRACKED_MALLOC(count * sizeof(float));
+    float *gS = TRACKED_MALLOC(count * sizeof(float));
+    vec3 *centers = TRACKED_MALLOC(count * sizeof(vec3));
+    vec3 *normals = TRACKED_MALLOC(count * sizeof(vec3));
+    assert(gT && gS && centers && normals && "malloc failed in updateObstacles");
+
+    for (int i = 0; i < count; ++i) {
+        gT[i] = obstacles->data[i].gT;
+        gS[i] = obstacles->data[i].gS;
+    }
+
+    SimParams params;
+    input_getSimParams(data, &params);
+    if (logic_evalSplineBatch(&params, count, gT, gS, centers, normals)) {
+        for (int i = 0; i < count; ++i) {
+            Obstacle *o = &obstacles->data[i];
+            glm_vec3_copy(centers[i], o->center);
+            glm_vec3_copy(normals[i], o->normal);
+        }
+        data->game.obstaclesChanged = true;
+    }
+
+    TRACKED_FREE(gT);
+    TRACKED_FREE(gS);
+    TRACKED_FREE(centers);
+    TRACKED_FREE(normals);
+}
+
+/**
+ * Returns the range of sample indices on one axis that are evaluated
+ * from the patches lo..hi. The range is widened by one sample on each
+ * side, resampling an unchanged vertex is harmless.
+ *
+ * @param lo First patch index
+ * @param hi Last patch index
+ * @param patchCount Number of patches per axis
+ * @param gridSize Number of samples per axis
+ * @param first Output: first sample index
+ * @param last Output: last sample index
+ */
+static void patchSampleRange(int lo, int hi, int patchCount, int gridSize, int *first, int *last) {
+    float samplesPerPatch = (float)(gridSize - 1) / patchCount;
+    *first = (int)floorf(lo * samplesPerPatch) - 1;
+    *last = (int)ceilf((hi + 1) * samplesPerPatch) + 1;
+    *first = CLAMP(*first, 0, gridSize - 1);
+    *last = CLAMP(*last, 0, gridSize - 1);
+}
+
+/**
+ * Recalculates and uploads the up to 4×4 patches influenced by a control point.
+ *
+ * @param data Input data
+ * @param cpIdx Index of the changed control point
+ * @param loS Output: first patch row
+ * @param hiS Output: last patch row
+ * @param loT Output: first patch column
+ * @param hiT Output: last patch column
+ */
+static void updatePatchesLocal(InputData *data, int cpIdx, int *loS, int *hiS, int *loT, int *hiT) {
+    Vec3Arr *cp = &data->surface.controlPoints;
+    int dimension = data->surface.dimension;
+    int patchCount = dimension - 3;
+
+    int cpS = cpIdx / dimension;
+    int cpT = cpIdx % dimension;
+    *loS = CLAMP(cpS - 3, 0, patchCount - 1);
+    *hiS = CLAMP(cpS, 0, patchCount - 1);
+    *loT = CLAMP(cpT - 3, 0, patchCount - 1);
+    *hiT = CLAMP(cpT, 0, patchCount - 1);
+
+    for (int i = *loS; i <= *hiS; ++i) {
+        for (int j = *loT; j <= *hiT; ++j) {
+            computePatch(cp, dimension, i, j, &g_patches.data[i * patchCount + j]);
+        }
+    }
+
+    // Rows of patches are contiguous in the coefficient buffer
+    int firstPatch = *loS * patchCount;
+    model_updateSurfacePatches(&g_patches.data[firstPatch], firstPatch, (*hiS - *loS + 1) * patchCount,
+        patchCount, g_surfaceEval.stepX, g_surfaceEval.stepZ);
+}
+
+/**
+ * Updates the surface after the height of a single control point changed.
+ * A control point only influences the up to 4×4 patches containing it,
+ * so only those patches are recalculated and only the vertex rectangle
+ * sampled from them is resampled and uploaded.
+ * The extremes follow from the height pyramid, whose nodes above the
+ * patches are recombined in O(log n).
+ *
+ * @param data Input data
+ * @param cpIdx Index of the changed control point
+ */
+static void updateSurfaceLocal(InputData *data, int cpIdx) {
+    int patchCount = data->surface.dimension - 3;
+    int gridSize = (data->surface.resolution < 2) ? 2 : data->surface.resolution;
+    float textureTiling = data->surface.textureTiling;
+
+    // 1. Recalculate the influenced patches
+    int loS, hiS, loT, hiT;
+    updatePatchesLocal(data, cpIdx, &loS, &hiS, &loT, &hiT);
+
+    // 2. Resample the vertex rectangle evaluated from those patches
+    int firstS, lastS, firstT, lastT;
+    patchSampleRange(loS, hiS, patchCount, gridSize, &firstS, &lastS);
+    patchSampleRange(loT, hiT, patchCount, gridSize, &firstT, &lastT);
+    int width = lastT - firstT + 1;
+    int height = lastS - firstS + 1;
+
+    float stepX = g_surfaceEval.stepX;
+    float stepZ = g_surfaceEval.stepZ;
+
+    Vertex *region = reserveSurfaceScratch(width * height);
+
+    updateSampleAxis(&g_sampleAxis, gridSize, patchCount);
+    sampleSurfaceRect(&g_sampleAxis, g_patches.data, region, firstS, lastS, firstT, lastT, stepX, stepZ, textureTiling,
+        data->surface.kernel);
+
+    // 3. Update the pyramid above the changed patches, the extremes are its root
+    updateHeights(&g_heights, &g_sampleAxis, region, firstS, lastS, firstT, lastT, loS, hiS, loT, hiT);
+    updateExtremes(data);
+
+    // 4. Rebake the occlusion the changed heights can reach
+    int rebaked[4];
+    aobake_update(&g_ao, region, firstS, lastS, firstT, lastT, rebaked);
+    model_updateAmbientOcclusion(g_ao.ao, gridSize, g_ao.extent, rebaked[0], rebaked[1], rebaked[2], rebaked[3]);
+
+    // 5. Rebake the normals of the changed patches
+    if (g_normals.size > 0) {
+        normalbake_update(&g_normals, g_patches.data, loS, hiS, loT, hiT, rebaked);
+        model_updateNormalMap(g_normals.normals, g_normals.size, g_normals.extent,
+            rebaked[0], rebaked[1], rebaked[2], rebaked[3]);
+    }
+
+    if (!needsSampledMesh(data)) {
+        // The rectangle was only needed for the extremes
+        g_surfaceScratch.meshStale = true;
+    } else {
+        model_updateSurfaceRegion(region, gridSize, firstT, firstS, width, height);
+    }
+}
+
+/**
+ * Updates what follows the surface heights (light, obstacles)
+ * after control point heights were edited. Keeps the physics state.
+ *
+ * @param data Input data
+ */
+static void surfaceHeightsChanged(InputData *data) {
+    vec3 center;
+    glm_vec3_add(data->surface.controlPoints.data[0],
+                data->surface.controlPoints.data[data->surface.controlPoints.size - 1], center);
+    glm_vec3_scale(center, 0.5f, center);
+    center[1] += LIGHT_OFFSET_Y;
+    glm_vec3_copy(center, data->pointLight.center);
+
+    updateObstacles(data);
+
+    // resting balls have to react to the new heights
+    physics_wakeAll();
+}
+
+/**
+ * Refreshes everything that depends on the surface after a structural rebuild:
+ * light, camera flight, physics (reset) and obstacles.
+ *
+ * @param data Input data
+ */
+static void surfaceChanged(InputData *data) {
+    logic_initCameraFlight(data);
+    physics_init();
+    surfaceHeightsChanged(data);
+}
+
+/**
+ * Checks whether a background rebuild is requested, running or waiting to be swapped in.
+ *
+ * @return true while the current surface may not match the input data
+ */
+static bool rebuildPending(void) {
+    MUTEX_LOCK(&g_rebuild.mutex);
+    bool pending = g_rebuild.requested || g_rebuild.busy || g_rebuild.ready;
+    MUTEX_UNLOCK(&g_rebuild.mutex);
+    return pending;
+}
+
+/**
+ * Requests a complete rebuild of the surface from the current input data.
+ * Replaces a request the worker did not pick up yet.
+ * Builds on the calling thread if the worker could not be started.
+ *
+ * @param data Input data
+ * @param structural Whether dimension or offset changed
+ * @param shift Translation of the terrain since the last request, usually zero
+ */
+static void submitRebuild(InputData *data, bool structural, const vec3 shift) {
+    MUTEX_LOCK(&g_rebuild.mutex);
+    RebuildRequest *req = &g_rebuild.request;
+    Vec3Arr *cp = &data->surface.controlPoints;
+
+    Vec3Arr_clear(&req->controlPoints);
+    Vec3Arr_appendN(&req->controlPoints, cp->data, cp->size);
+
+    req->dimension = data->surface.dimension;
+    req->resolution = data->surface.resolution;
+    req->textureTiling = data->surface.textureTiling;
+    req->kernel = data->surface.kernel;
+    req->normalMap = data->surface.normalMap;
+    req->structural = (g_rebuild.requested && req->structural) || structural;
+    if (!g_rebuild.requested) {
+        glm_vec3_zero(req->shift);
+    }
+    glm_vec3_add(req->shift, (float*) shift, req->shift);
+    g_rebuild.requested = true;
+
+    if (g_rebuild.running) {
+        COND_BROADCAST(&g_rebuild.cond);
+    } else {
+        processRebuild();
+    }
+    MUTEX_UNLOCK(&g_rebuild.mutex);
+}
+
+/**
+ * Swaps a finished background build in as the current surface
+ * and uploads it.
+ *
+ * @param data Input data
+ * @param wait Whether to wait for a requested or running build
+ */
+static void collectRebuild(InputData *data, bool wait) {
+    MUTEX_LOCK(&g_rebuild.mutex);
+    while (wait && !g_rebuild.ready && (g_rebuild.requested || g_rebuild.busy)) {
+        COND_WAIT(&g_rebuild.cond, &g_rebuild.mutex);
+    }
+    if (!g_rebuild.ready) {
+        MUTEX_UNLOCK(&g_rebuild.mutex);
+        return;
+    }
+
+    SurfaceBuild *build = &g_rebuild.result;
+    PatchArr patches = g_patches;
+    g_patches = build->patches;
+    build->patches = patches;
+
+    SampleAxisTable axis = g_sampleAxis;
+    g_sampleAxis = build->axis;
+    build->axis = axis;
+
+    Vertex *vertices = g_surfaceScratch.data;
+    int capacity = g_surfaceScratch.capacity;
+    g_surfaceScratch.data = build->vertices;
+    g_surfaceScratch.capacity = build->capacity;
+    build->vertices = vertices;
+    build->capacity = capacity;
+
+    HeightPyramid heights = g_heights;
+    g_heights = build->heights;
+    build->heights = heights;
+
+    AoBake ao = g_ao;
+    g_ao = build->ao;
+    build->ao = ao;
+
+    NormalBake normals = g_normals;
+    g_normals = build->normals;
+    build->normals = normals;
+
+    g_surfaceEval = build->eval;
+    int gridSize = build->gridSize;
+
+    bool structural = g_rebuild.resultStructural;
+    g_rebuild.resultStructural = false;
+    vec3 shift;
+    glm_vec3_copy(g_rebuild.resultShift, shift);
+    glm_vec3_zero(g_rebuild.resultShift);
+    g_rebuild.ready = false;
+    MUTEX_UNLOCK(&g_rebuild.mutex);
+    metrics_count(METRIC_REBUILDS, 1);
+
+    updateExtremes(data);
+    g_surfaceScratch.meshStale = false;
+    model_updateSurfacePatches(g_patches.data, 0, g_patches.size, g_surfaceEval.patchCount,
+        g_surfaceEval.stepX, g_surfaceEval.stepZ);
+    model_updateSurface(g_surfaceScratch.data, gridSize);
+    model_updateAmbientOcclusion(g_ao.ao, gridSize, g_ao.extent, 0, 0, gridSize, gridSize);
+    if (g_normals.size > 0) {
+        model_updateNormalMap(g_normals.normals, g_normals.size, g_normals.extent, 0, 0, g_normals.size, g_normals.size);
+    }
+
+    if (structural) {
+        surfaceChanged(data);
+    } else {
+        if (!glm_vec3_eq(shift, 0.0f)) {
+            physics_translate(shift);
+            input_translateCamera(shift);
+        }
+        logic_initCameraFlight(data);
+        surfaceHeightsChanged(data);
+    }
+}
+
+/**
+ * Rebuilds the picking pyramid after the control point grid changed.
+ *
+ * @param data Input data
+ */
+static void rebuildControlPointPick(InputData *data) {
+    Vec3Arr *cp = &data->surface.controlPoints;
+    int dimension = data->surface.dimension;
+
+    g_cpPick.dimension = dimension;
+    g_cpPick.step = cp->data[1][0] - cp->data[0][0];
+    heights_resize(&g_cpPick.heights, dimension);
+    heights_clear(&g_cpPick.heights, 0, dimension - 1, 0, dimension - 1);
+
+    for (int i = 0; i < dimension; ++i) {
+        for (int j = 0; j < dimension; ++j) {
+            heights_addSample(heights_leaf(&g_cpPick.heights, i, j), cp->data[i * dimension + j]);
+        }
+    }
+    heights_update(&g_cpPick.heights, 0, dimension - 1, 0, dimension - 1);
+}
+
+/**
+ * Updates the picking pyramid after the height of one control point changed.
+ *
+ * @param data Input data
+ * @param cpIdx Index of the changed control point
+ */
+static void updateControlPointPick(InputData *data, int cpIdx) {
+    int i = cpIdx / g_cpPick.dimension;
+    int j = cpIdx % g_cpPick.dimension;
+
+    heights_clear(&g_cpPick.heights, i, i, j, j);
+    heights_addSample(heights_leaf(&g_cpPick.heights, i, j), data->surface.controlPoints.data[cpIdx]);
+    heights_update(&g_cpPick.heights, i, i, j, j);
+}
+
+/**
+ * Current best hit of a pick query.
+ */
+typedef struct {
+    vec3 origin;
+    vec3 dir;      // normalized
+    float radius;  // shrinks to the distance of the best hit
+    float rayT;
+    int index;
+} PickQuery;
+
+/**
+ * Intersects the ray of a pick query with an axis aligned box (slab test).
+ *
+ * @param q Pick query
+ * @param lo Box corner with the smallest coordinates
+ * @param hi Box corner with the largest coordinates
+ * @return Ray parameter where the box is entered, negative if it is missed
+ */
+static float rayBoxEntry(const PickQuery *q, const vec3 lo, const vec3 hi) {
+    float tNear = 0.0f, tFar = FLT_MAX;
+    for (int a = 0; a < 3; ++a) {
+        if (fabsf(q->dir[a]) < 1e-8f) {
+            if (q->origin[a] < lo[a] || q->origin[a] > hi[a]) return -1.0f;
+            continue;
+        }
+        float inv = 1.0f / q->dir[a];
+        float t0 = (lo[a] - q->origin[a]) * inv;
+        float t1 = (hi[a] - q->origin[a]) * inv;
+        if (t0 > t1) { float tmp = t0; t0 = t1; t1 = tmp; }
+        tNear = fmaxf(tNear, t0);
+        tFar = fminf(tFar, t1);
+        if (tNear > tFar) return -1.0f;
+    }
+    return tNear;
+}
+
+/**
+ * Descends the picking pyramid below a node, skipping nodes whose box,
+ * widened by the current best distance, the ray misses.
+ * Children are visited front to back, so close hits shrink the radius early.
+ *
+ * @param q Pick query
+ * @param level Level of the node
+ * @param s Node row
+ * @param t Node column
+ */
+static void pickNode(PickQuery *q, int level, int s, int t) {
+    const HeightPyramid *p = &g_cpPick.heights;
+    const HeightBounds *b = heights_node(p, level, s, t);
+
+    if (level == 0) {
+        vec3 rel, cross;
+        glm_vec3_sub((float*) b->minPoint, q->origin, rel);
+        float rayT = glm_vec3_dot(rel, q->dir);
+        glm_vec3_cross(rel, q->dir, cross);
+        float dist = glm_vec3_norm(cross);
+        if (rayT >= 0.0f && (dist < q->radius || (dist == q->radius && rayT < q->rayT))) {
+            q->radius = dist;
+            q->rayT = rayT;
+            q->index = s * g_cpPick.dimension + t;
+        }
+        return;
+    }
+
+    int childSize = p->size[level - 1];
+    struct { int s, t; float entry; } children[4];
+    int count = 0;
+
+    for (int cs = 2 * s; cs <= 2 * s + 1 && cs < childSize; ++cs) {
+        for (int ct = 2 * t; ct <= 2 * t + 1 && ct < childSize; ++ct) {
+            // Leaves covered by the child, clamped to the grid
+            int span = 1 << (level - 1);
+            int lastS = glm_min((cs + 1) * span, g_cpPick.dimension) - 1;
+            int lastT = glm_min((ct + 1) * span, g_cpPick.dimension) - 1;
+            const HeightBounds *cb = heights_node(p, level - 1, cs, ct);
+
+            vec3 lo = {ct * span * g_cpPick.step, cb->minPoint[1], cs * span * g_cpPick.step};
+            vec3 hi = {lastT * g_cpPick.step, cb->maxPoint[1], lastS * g_cpPick.step};
+            glm_vec3_subs(lo, q->radius, lo);
+            glm_vec3_adds(hi, q->radius, hi);
+
+            float entry = rayBoxEntry(q, lo, hi);
+            if (entry < 0.0f) continue;
+
+            // Insertion sort by entry distance
+            int k = count++;
+            while (k > 0 && children[k - 1].entry > entry) {
+                children[k] = children[k - 1];
+                --k;
+            }
+            children[k].s = cs;
+            children[k].t = ct;
+            children[k].entry = entry;
+        }
+    }
+
+    for (int c = 0; c < count; ++c) {
+        pickNode(q, level - 1, children[c].s, children[c].t);
     }
 }
 
 ////////////////////////    PUBLIC    ////////////////////////////
 
 void logic_update(InputData *data) {
+    // Swap in a finished background build
+    collectRebuild(data, false);
+    bool pending = rebuildPending();
+
+    // The pool must not be restarted under a running build
+    if (!pending && data->surface.threadCount != jobs_getThreadCount()) {
+        jobs_setThreadCount(data->surface.threadCount);
+        data->surface.threadCount = jobs_getThreadCount();
+    }
+
+    profiler_pushScope("Surface");
+
+    // A height edit only touches the patches around the control point and keeps
+    // the physics state. Everything else, and height edits while the current
+    // surface lags behind, is rebuilt in the background from a snapshot
     checkSelectionState(data);
+    bool heightsEdited = data->surface.heightsChanged;
+    data->surface.heightsChanged = false;
+
+    bool structural = data->surface.dimensionChanged || data->surface.offsetChanged;
+    if (structural) {
+        updateControlPoints(&data->surface.controlPoints, data->surface.dimension, data->surface.controlPointOffset);
+        rebuildControlPointPick(data);
+    } else if (heightsEdited) {
+        updateControlPointPick(data, data->selection.selectedCp);
+    }
 
-    // Calculate all polynomials if geometry matrix changed
-    if (data->surface.dimensionChanged || data->surface.offsetChanged) {
-        rebuildSurface(
-            &data->surface.controlPoints,
-            data->surface.dimension,
-            data->surface.resolution,
-            data->surface.controlPointOffset,
-            data->surface.textureTiling,
-            data->surface.minPoint,
-            data->surface.maxPoint,
-            &data->surface.extremesValid
-        );
+    if (structural || data->surface.resolutionChanged || (heightsEdited && pending)) {
+        submitRebuild(data, structural, GLM_VEC3_ZERO);
         data->surface.offsetChanged = false;
         data->surface.dimensionChanged = false;
         data->surface.resolutionChanged = false;
+        pending = true;
+    } else if (heightsEdited) {
+        updateSurfaceLocal(data, data->selection.selectedCp);
+        surfaceHeightsChanged(data);
+    }
 
-        vec3 center;
-        glm_vec3_add(data->surface.controlPoints.data[0],
-                    data->surface.controlPoints.data[data->surface.controlPoints.size - 1], center);
-        glm_vec3_scale(center, 0.5f, center);
-        center[1] += LIGHT_OFFSET_Y;
-        glm_vec3_copy(center, data->pointLight.center);
+    // Without a surface there is nothing to show meanwhile
+    if (g_patches.size == 0) {
+        collectRebuild(data, true);
+        pending = rebuildPending();
+    }
 
-        logic_initCameraFlight(data);
-        physics_init();
-        updateObstacles(data);
-    }
-
-    if (data->surface.resolutionChanged) {
-        generateSurfaceVertices(
-            &data->surface.controlPoints,
-            data->surface.resolution,
-            data->surface.dimension,
-            data->surface.textureTiling,
-            data->surface.minPoint,
-            data->surface.maxPoint,
-            &data->surface.extremesValid,
-            true
-        );
-        data->surface.resolutionChanged = false;
-        logic_initCameraFlight(data);
+    // Catch the sampled mesh up once it is drawn again
+    if (!pending && g_surfaceScratch.meshStale && needsSampledMesh(data)) {
+        generateSurfaceVertices(data);
     }
+    profiler_popScope();
 
     // Initialize camera flight when started
     static bool wasFlying = false;
@@ -406,7 +1820,53 @@ void logic_update(InputData *data) {
         logic_updateCameraFlight(data, data->deltaTime);
     }
 
+    profiler_pushScope("Physics");
+    TIMELINE_BEGIN("Physics");
     physics_update();
+    TIMELINE_END();
+    profiler_popScope();
+}
+
+void logic_shiftSurface(InputData *data, const vec3 shift) {
+    rebuildControlPointPick(data);
+    submitRebuild(data, false, shift);
+}
+
+void logic_finishRebuild(InputData *data) {
+    collectRebuild(data, true);
+}
+
+bool logic_isRebuildPending(void) {
+    return rebuildPending();
+}
+
+bool logic_exportSurface(const char *path, InputData *data) {
+    if (ATOMIC_LOAD(&g_export.running)) {
+        return false;
+    }
+    joinExport();
+
+    Vec3Arr *cp = &data->surface.controlPoints;
+    Vec3Arr_clear(&g_export.controlPoints);
+    Vec3Arr_appendN(&g_export.controlPoints, cp->data, cp->size);
+    g_export.dimension = data->surface.dimension;
+    g_export.gridSize = (data->surface.resolution < 2) ? 2 : data->surface.resolution;
+    g_export.textureTiling = data->surface.textureTiling;
+    g_export.kernel = data->surface.kernel;
+    g_export.percent = glm_imax(glm_imin(data->surface.exportPercent, 100), 1);
+    snprintf(g_export.path, sizeof(g_export.path), "%s", path);
+
+    ATOMIC_EXCHANGE(&g_export.running, 1);
+    g_export.threadStarted = THREAD_CREATE(&g_export.thread, exportMain);
+    if (!g_export.threadStarted) {
+        printf("Failed to start the surface export thread, exporting synchronously.\n");
+        exportMain(NULL);
+    }
+    return true;
+}
+
+bool logic_isExporting(void) {
+    return ATOMIC_LOAD(&g_export.running) != 0;
 }
 
 void logic_printPolynomials(void) {
@@ -427,11 +1887,69 @@ void logic_printPolynomials(void) {
 
 void logic_init(void) {
     PatchArr_init(&g_patches);
+    jobs_init(getInputData()->surface.threadCount);
+    getInputData()->surface.threadCount = jobs_getThreadCount();
+
+    MUTEX_INIT(&g_rebuild.mutex);
+    COND_INIT(&g_rebuild.cond);
+    Vec3Arr_init(&g_rebuild.request.controlPoints);
+    Vec3Arr_init(&g_rebuild.current.controlPoints);
+
+    // Without the worker, rebuilds run synchronously in submitRebuild
+    g_rebuild.running = true;
+    g_rebuild.threadStarted = THREAD_CREATE(&g_rebuild.thread, rebuildMain);
+    if (!g_rebuild.threadStarted) {
+        printf("Failed to start the surface rebuild thread, rebuilding synchronously.\n");
+        g_rebuild.running = false;
+    }
 }
 
 void logic_cleanup(void) {
+    MUTEX_LOCK(&g_rebuild.mutex);
+    g_rebuild.running = false;
+    COND_BROADCAST(&g_rebuild.cond);
+    MUTEX_UNLOCK(&g_rebuild.mutex);
+    if (g_rebuild.threadStarted) {
+        THREAD_JOIN(g_rebuild.thread);
+        g_rebuild.threadStarted = false;
+    }
+    MUTEX_DESTROY(&g_rebuild.mutex);
+    COND_DESTROY(&g_rebuild.cond);
+    Vec3Arr_free(&g_rebuild.request.controlPoints);
+    Vec3Arr_free(&g_rebuild.current.controlPoints);
+    freeSurfaceBuild(&g_rebuild.work);
+    freeSurfaceBuild(&g_rebuild.result);
+    g_rebuild.requested = false;
+    g_rebuild.busy = false;
+    g_rebuild.ready = false;
+    g_rebuild.resultStructural = false;
+
+    joinExport();
+    Vec3Arr_free(&g_export.controlPoints);
+
     PatchArr_free(&g_patches);
-    vec3arr_free(&getInputData()->surface.controlPoints);
+    heights_free(&g_heights);
+    aobake_free(&g_ao);
+    normalbake_free(&g_normals);
+    heights_free(&g_cpPick.heights);
+    g_cpPick.dimension = 0;
+    jobs_cleanup();
+    TRACKED_FREE(g_surfaceScratch.data);
+    g_surfaceScratch.data = NULL;
+    g_surfaceScratch.capacity = 0;
+    Vec3Arr_free(&g_cpResample.points);
+    TRACKED_FREE(g_cpResample.rows);
+    TRACKED_FREE(g_cpResample.taps);
+    g_cpResample.rows = NULL;
+    g_cpResample.taps = NULL;
+    g_cpResample.rowsCapacity = 0;
+    g_cpResample.tapsCapacity = 0;
+    TRACKED_FREE(g_sampleAxis.data);
+    TRACKED_FREE(g_sampleAxis.local);
+    g_sampleAxis.data = NULL;
+    g_sampleAxis.local = NULL;
+    g_sampleAxis.gridSize = 0;
+    Vec3Arr_free(&getInputData()->surface.controlPoints);
     physics_cleanup();
 }
 
@@ -460,18 +1978,19 @@ void logic_initCameraFlight(InputData *data) {
     data->cam.flight.p2[2] = data->cam.flight.p0[2] + 2.0f * line[2] / 3.0f;
 
     // Calculate y coordinates from surface at those x,z positions
-    float maxX = data->surface.controlPoints.data[data->surface.dimension-1][0];
-    float maxZ = data->surface.controlPoints.data[(data->surface.dimension-1)*data->surface.dimension][2];
+    // The current surface may lag behind the control points during a rebuild
+    float maxX = g_surfaceEval.maxX;
+    float maxZ = g_surfaceEval.maxZ;
 
     // For P1: convert world coords to normalized surface coords, then evaluate
     float T_s1 = data->cam.flight.p1[2] / maxZ;
     float T_t1 = data->cam.flight.p1[0] / maxX;
-    data->cam.flight.p1[1] = evalSurfaceAt(data->surface.dimension, T_s1, T_t1) + CAMERA_HEIGHT_OFFSET;
+    data->cam.flight.p1[1] = evalSurfaceAt(T_s1, T_t1) + CAMERA_HEIGHT_OFFSET;
 
     // For P2
     float T_s2 = data->cam.flight.p2[2] / maxZ;
     float T_t2 = data->cam.flight.p2[0] / maxX;
-    data->cam.flight.p2[1] = evalSurfaceAt(data->surface.dimension, T_s2, T_t2) + CAMERA_HEIGHT_OFFSET;
+    data->cam.flight.p2[1] = evalSurfaceAt(T_s2, T_t2) + CAMERA_HEIGHT_OFFSET;
 
     // Reset time parameter
     data->cam.flight.t = 0.0f;
@@ -518,53 +2037,64 @@ void logic_evalSplineGlobal(float gT, float gS, vec3 posDest, vec3 normalDest) {
         return;
     }
 
-    int dimension = data->surface.dimension;
-    int patchCount = dimension - 3;
-
-    float maxX = data->surface.controlPoints.data[dimension-1][0];
-    float maxZ = data->surface.controlPoints.data[(dimension-1)*dimension][2];
-    float stepX = maxX / (patchCount * 3.0f);
-    float stepZ = maxZ / (patchCount * 3.0f);
-
-    // Convert global params to patch indices and local params
-    float global_s = gS * patchCount;
-    int patch_s = (int) floor(global_s);
-    patch_s = CLAMP(patch_s, 0, patchCount - 1);
-    float local_s = global_s - patch_s;
+    evalSplineCached(gT, gS, posDest, normalDest);
+}
 
-    float global_t = gT * patchCount;
-    int patch_t = (int) floor(global_t);
-    patch_t = CLAMP(patch_t, 0, patchCount - 1);
-    float local_t = global_t - patch_t;
+bool logic_evalSplineBatch(const SimParams *params, int count, const float *gT, const float *gS,
+    vec3 *posDest, vec3 *normalDest) {
+    if (!params->surfaceReady) {
+        return false;
+    }
 
-    // Evaluate patch at local coordinates
-    Patch *p = &g_patches.data[patch_s * patchCount + patch_t];
-    PatchEvalResult res = utils_evalPatchLocal(p, local_s, local_t);
+    // Consecutive points on the same patch are evaluated as one batch
+    int i = 0;
+    while (i < count) {
+        int patchS[EVALUATE_MAX_BATCH], patchT[EVALUATE_MAX_BATCH];
+        float localS[EVALUATE_MAX_BATCH], localT[EVALUATE_MAX_BATCH];
+        PatchEvalResult res[EVALUATE_MAX_BATCH];
+
+        locateSplineCached(gT[i], gS[i], &patchS[0], &patchT[0], &localS[0], &localT[0]);
+        int n = 1;
+        while (i + n < count && n < EVALUATE_MAX_BATCH) {
+            locateSplineCached(gT[i + n], gS[i + n], &patchS[n], &patchT[n], &localS[n], &localT[n]);
+            if (patchS[n] != patchS[0] || patchT[n] != patchT[0]) {
+                break;
+            }
+            ++n;
+        }
 
-    vec3 pos = {
-        (patch_t * 3 + local_t * 3) * stepX,
-        res.value,
-        (patch_s * 3 + local_s * 3) * stepZ
-    };
+        Patch *p = &g_patches.data[patchS[0] * g_surfaceEval.patchCount + patchT[0]];
+        evaluate_patchPoints(params->kernel, p, localS, localT, n, res);
 
-    glm_vec3_copy(pos, posDest);
-    utils_getNormal(res.dsd, res.dtd, stepX, stepZ, normalDest);
+        for (int k = 0; k < n; ++k) {
+            splinePointCached(patchS[k], patchT[k], localS[k], localT[k], &res[k], posDest[i + k], normalDest[i + k]);
+        }
+        i += n;
+    }
+    return true;
 }
 
 void logic_closestSplinePointTo(vec3 worldPos, float *outS, float *outT) {
-    InputData *data = getInputData();
-    int dimension = data->surface.dimension;
+    projectCached(worldPos, outS, outT);
+    projectNewton(worldPos, outS, outT);
+}
 
-    // Get surface bounds
-    float maxX = data->surface.controlPoints.data[dimension-1][0];
-    float maxZ = data->surface.controlPoints.data[(dimension-1)*dimension][2];
+void logic_closestSplinePointsTo(int count, vec3 *worldPos, float *s, float *t) {
+    for (int i = 0; i < count; ++i) {
+        projectNewton(worldPos[i], &s[i], &t[i]);
+    }
+}
+
+int logic_pickControlPoint(const vec3 origin, const vec3 dir, float radius) {
+    if (g_cpPick.dimension == 0) {
+        return -1;
+    }
 
-    // Project world pos to normalized coords
-    float gT = worldPos[0] / maxX;
-    float gS = worldPos[2] / maxZ;
-    gT = CLAMP(gT, 0.0f, 1.0f);
-    gS = CLAMP(gS, 0.0f, 1.0f);
+    PickQuery q = { .radius = radius, .rayT = FLT_MAX, .index = -1 };
+    glm_vec3_copy((float*) origin, q.origin);
+    glm_vec3_normalize_to((float*) dir, q.dir);
 
-    *outS = gS;
-    *outT = gT;
+    const HeightPyramid *p = &g_cpPick.heights;
+    pickNode(&q, p->levelCount - 1, 0, 0);
+    return q.index;
 }
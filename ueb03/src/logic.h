@@ -13,6 +13,9 @@
 #include <fhwcg/fhwcg.h>
 #include "input.h"
 
+/** File the GUI exports the sampled surface to */
+#define LOGIC_EXPORT_FILE "surface.ply"
+
 typedef struct {
     mat4 coeffsY;
     int degS, degT;
@@ -46,6 +49,49 @@ void logic_init(void);
  */
 void logic_cleanup(void);
 
+/**
+ * Rebuilds the surface in the background after all control point heights
+ * were replaced by a part of the terrain shifted against the current one.
+ * Balls and camera are moved by the shift once the new surface is swapped
+ * in, so they keep their place on the terrain.
+ *
+ * @param data Input data holding the new heights
+ * @param shift World translation of the terrain
+ */
+void logic_shiftSurface(InputData *data, const vec3 shift);
+
+/**
+ * Waits for a requested surface rebuild and swaps it in.
+ * Used by the headless benchmark, the render loop never blocks on a build.
+ *
+ * @param data Input data
+ */
+void logic_finishRebuild(InputData *data);
+
+/**
+ * Checks whether a background rebuild is requested, running or waiting to be swapped in.
+ *
+ * @return true while the displayed surface may still change without input
+ */
+bool logic_isRebuildPending(void);
+
+/**
+ * Exports the sampled surface as a binary PLY mesh on a background thread.
+ * The control points and parameters are copied, editing goes on meanwhile.
+ *
+ * @param path File to write
+ * @param data Input data with the surface to export
+ * @return false if an export is still running
+ */
+bool logic_exportSurface(const char *path, InputData *data);
+
+/**
+ * Checks whether a surface export is running.
+ *
+ * @return true until the export thread wrote the file
+ */
+bool logic_isExporting(void);
+
 /**
  * Debug function to print polynomial equations for all patches.
  * Outputs equations in the form: q(s,t) = c₀₀ + c₀₁*s + c₀₂*s² + ...
@@ -78,7 +124,8 @@ void logic_updateCameraFlight(InputData *data, float deltaTime);
  * Converts global params gT and gS into patch indices and local
  * spline, then the corresponding polynomial patch
  *
- * Used by game objects such as obstacles to orient themselves according to surface
+ * Used by game objects such as obstacles to orient themselves according to surface.
+ * Reads the live surface state, the physics step uses logic_evalSplineBatch.
  *
  * @param gT Global t-parameter X-direction
  * @param gS Global s-parameter Z-direction
@@ -87,9 +134,25 @@ void logic_updateCameraFlight(InputData *data, float deltaTime);
  */
 void logic_evalSplineGlobal(float gT, float gS, vec3 posDest, vec3 normalDest);
 
+/**
+ * Evaluates the spline surface for an array of global params in one call.
+ * Patch lookup constants are computed once per surface rebuild.
+ *
+ * @param params Parameters of the step, for the kernel and surface state
+ * @param count Number of params
+ * @param gT Global t-parameters X-direction
+ * @param gS Global s-parameters Z-direction
+ * @param posDest world-space positions
+ * @param normalDest surface normals
+ * @return false if the surface is being rebuilt and nothing was written
+ */
+bool logic_evalSplineBatch(const SimParams *params, int count, const float *gT, const float *gS,
+    vec3 *posDest, vec3 *normalDest);
+
 /**
  * Projects world position into the spline surfance and determines
- * the normalized coords.
+ * the normalized coords of the closest surface point.
+ * Starts from the planar x/z projection.
  *
  * @param worldPos Position in world space
  * @param outS normalized s-coordinate
@@ -97,4 +160,28 @@ void logic_evalSplineGlobal(float gT, float gS, vec3 posDest, vec3 normalDest);
  */
 void logic_closestSplinePointTo(vec3 worldPos, float *outS, float *outT);
 
+/**
+ * Projects an array of world positions into the spline surface.
+ * Each projection is warm-started from the given coords,
+ * e.g. the previous contact of a ball.
+ *
+ * @param count Number of positions
+ * @param worldPos Positions in world space
+ * @param s In: start s-coordinates, out: normalized s-coordinates
+ * @param t In: start t-coordinates, out: normalized t-coordinates
+ */
+void logic_closestSplinePointsTo(int count, vec3 *worldPos, float *s, float *t);
+
+/**
+ * Picks the control point closest to a ray, e.g. through the mouse cursor.
+ * Descends a min/max pyramid over the control points, so only the nodes
+ * along the ray are tested.
+ *
+ * @param origin Ray origin in world space
+ * @param dir Ray direction (not necessarily normalized)
+ * @param radius Maximum distance of a control point to the ray
+ * @return Index of the picked control point or -1 if none is in range
+ */
+int logic_pickControlPoint(const vec3 origin, const vec3 dir, float radius);
+
 #endif // LOGIC_H
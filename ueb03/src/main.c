@@ -10,10 +10,34 @@
 
 #include <fhwcg/fhwcg.h>
 #include "gui.h"
+#include "guicache.h"
 #include "input.h"
+#include "idle.h"
 #include "rendering.h"
 #include "model.h"
+#include "shader.h"
 #include "logic.h"
+#include "physics.h"
+#include "profiler.h"
+#include "glstate.h"
+#include "texstream.h"
+#include "upload.h"
+#include "gpuprim.h"
+#include "arena.h"
+#include "gpumem.h"
+#include "alloctrack.h"
+#include "quality.h"
+#include "resscale.h"
+#include "timeline.h"
+#include "hitch.h"
+#include "sampler.h"
+#include "perfcount.h"
+#include "metrics.h"
+#include "rendbench.h"
+#include "headless.h"
+#include "ballcompute.h"
+#include "terraintiles.h"
+#include "resarchive.h"
 
 #define DEFAULT_WINDOW_WIDTH 800
 #define DEFAULT_WINDOW_HEIGHT 500
@@ -25,13 +49,88 @@
  * @param ctx The Program Context.
  */
 static void init(ProgContext ctx) {
+    timeline_setThreadName("Main");
+    hitch_init();
+    sampler_init();
+    perfcount_init();
+    arena_init();
+    profiler_init();
+    metrics_init("ueb03");
     input_init(ctx);
     input_registerCallbacks(ctx);
     logic_init();
     gui_init(ctx);
+    // Missing without the build step, the files are loaded then
+    resarchive_open(RESARCHIVE_PATH);
+    texstream_init();
+    upload_init();
+    gpuprim_init(COMMON_RESOURCE_PATH "res/shader/gpuprim/");
     model_init();
+    ballcompute_init();
     rendering_init();
-    rendering_resize(DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT);
+    resscale_init(shader_setUpscaleData);
+    int width, height;
+    window_getFramebufferSize(ctx, &width, &height);
+    rendering_resize(width, height);
+
+    // Rebuilds, the physics and the governor change these without input
+    InputData *d = getInputData();
+    guicache_watch(&d->game, sizeof(d->game));
+    guicache_watch(&d->surface, sizeof(d->surface));
+    guicache_watch(&d->quality.level, sizeof(d->quality.level));
+
+    // A benchmark compares fixed settings, the governor would adapt them to the run
+    if (rendbench_isPlaying()) {
+        d->quality.enabled = false;
+        d->resolution.enabled = false;
+    }
+}
+
+/**
+ * Feeds the work time of the last frame to the quality governor and
+ * derives the settings to draw with from its level.
+ */
+static void updateQuality(void) {
+    InputData *d = getInputData();
+
+    float cpuMs, gpuMs;
+    profiler_getLastFrameWork(&cpuMs, &gpuMs);
+
+    // The resolution takes GPU load first, the governor only sees it
+    // once the scale is at its minimum
+    if (d->resolution.enabled) {
+        d->resolution.scale = resscale_update(gpuMs, d->quality.budgetMs, d->resolution.minScale);
+        if (d->resolution.scale > d->resolution.minScale + 1e-4f) {
+            gpuMs = 0.0f;
+        }
+    } else {
+        resscale_reset();
+        d->resolution.scale = 1.0f;
+    }
+
+    if (d->quality.enabled) {
+        d->quality.level = (QualityLevel) quality_update(fmaxf(cpuMs, gpuMs), d->quality.budgetMs, QL_COUNT - 1);
+        d->quality.workMs = quality_getSmoothedMs();
+    } else {
+        quality_reset();
+        d->quality.level = QL_FULL;
+        d->quality.workMs = 0.0f;
+    }
+
+    d->quality.surfaceNormals = d->showNormals && d->quality.level < QL_NO_NORMALS;
+    d->quality.objectNormals = d->showNormals && d->quality.level < QL_SURFACE_NORMALS;
+}
+
+/**
+ * Checks whether the scene changes without input: the light, the camera
+ * flight and the balls move until paused, background surface rebuilds,
+ * streamed textures and budgeted uploads arrive at any time.
+ *
+ * @return true if the next frame differs from the last one
+ */
+static bool isSceneBusy(void) {
+    return !getInputData()->paused || logic_isRebuildPending() || texstream_getPendingCount() > 0
+        || upload_getPendingCount() > 0 || rendbench_isPlaying() || headless_isActive();
 }
 
 /**
@@ -39,10 +138,29 @@ static void init(ProgContext ctx) {
  * @param ctx The Program Context.
  */
 static void cleanup(ProgContext ctx) {
+    // The shutdown is left out of the samples
+    sampler_cleanup();
     gui_cleanup(ctx);
+    texstream_cleanup();
+    upload_cleanup();
+    ballcompute_cleanup();
+    gpuprim_cleanup();
     model_cleanup();
+    resscale_cleanup();
+    guicache_cleanup();
     rendering_cleanup();
+    terraintiles_close();
     logic_cleanup();
+    rendbench_cleanup();
+    profiler_cleanup();
+    arena_cleanup();
+    headless_cleanup();
+    resarchive_close();
+    gpumem_cleanup();
+    metrics_cleanup();
+    perfcount_cleanup();
+    alloctrack_cleanup();
+    timeline_cleanup();
     window_cleanup(ctx);
 }
 
@@ -50,11 +168,15 @@ static void cleanup(ProgContext ctx) {
 
 int main(void) {
 
+    rendbench_init("ueb03");
+    headless_init();
+    int width = DEFAULT_WINDOW_WIDTH, height = DEFAULT_WINDOW_HEIGHT;
+    headless_windowSize(&width, &height);
     ProgContext ctx = window_init(
-        PROGRAM_NAME, 
-        DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT, 
-        1, 
-        HELP_SERVER_FLAGS | WINDOW_FLAGS_VSYNC
+        PROGRAM_NAME,
+        width, height,
+        1,
+        headless_windowFlags(rendbench_windowFlags(HELP_SERVER_FLAGS | WINDOW_FLAGS_VSYNC))
     );
 
     init(ctx);
@@ -63,21 +185,64 @@ int main(void) {
 
     // rendering loop
     while (window_startNewFrame(ctx)) {
+        profiler_beginFrame();
+        glstate_beginFrame();
+        headless_beginFrame(ctx);
+        input_flushEvents(ctx);
+        arena_beginFrame();
+        alloctrack_beginFrame();
+        texstream_update();
+        TIMELINE_BEGIN("Frame");
         InputData *d = getInputData();
-        float dt = (float) window_getDeltaTime(ctx);
+        upload_setBudget((size_t) d->surface.uploadBudgetKB << 10);
+        upload_update();
+        float awakeTime = idle_frameTime((float) window_getDeltaTime(ctx));
+        hitch_frame(awakeTime * 1000.0f);
+        float dt = rendbench_frameTime(awakeTime);
         d->deltaTime = d->paused ? 0.0f : dt;
         camera_updateCamera(d->cam.data, dt);
+        updateQuality();
+        profiler_pushScope("Logic");
+        physics_lock();
+        terraintiles_update(d);
         logic_update(d);
+        metrics_frame(dt * 1000.0f, d->physics.dtAccumulator * 1000.0f, physics_getBallCount(), 0);
+        physics_unlock();
+        profiler_popScope();
+
+        // The scene is drawn at the dynamic resolution, the GUI natively
+        int fbWidth, fbHeight;
+        window_getFramebufferSize(ctx, &fbWidth, &fbHeight);
+        resscale_begin(fbWidth, fbHeight);
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        profiler_pushScope("Rendering");
         rendering_draw();
-        gui_render(ctx, gui_renderContent);
+        resscale_end(d->resolution.sharpness);
+        profiler_popScope();
+
+        profiler_pushScope("GUI");
+        physics_lock();
+        guicache_render(ctx, gui_renderContent, shader_setGuiComposite);
+        physics_unlock();
+        profiler_popScope();
+
+        profiler_endFrame();
 
         // switch front- and back-buffer
         window_swapBuffers(ctx);
+        TIMELINE_END();
+        if (!rendbench_endFrame()) {
+            window_shouldCloseWindow(ctx);
+        }
+        if (!headless_endFrame()) {
+            window_shouldCloseWindow(ctx);
+        }
+        idle_endFrame(isSceneBusy());
+        idle_wait();
     }
 
     cleanup(ctx);
-    return EXIT_SUCCESS;
+    return rendbench_exitCode();
 }
@@ -13,21 +13,67 @@
 #include "shader.h"
 #include "rendering.h"
 #include "input.h"
+#include "instanced.h"
+#include "multidraw.h"
+#include "glstate.h"
+#include "texstream.h"
+#include "arena.h"
+#include "gpumem.h"
+#include "timeline.h"
+#include "alloctrack.h"
+#include "metrics.h"
+#include "decimate.h"
+#include "jobs.h"
+#include "upload.h"
+
+#include <float.h>
 
 #define SPHERE_NUM_SLICES 12
 #define SPHERE_NUM_STACKS SPHERE_NUM_SLICES
 
 #define SURFACE_DEFAULT_SIZE 16
+#define SURFACE_CHUNK_QUADS 32   // quads per chunk side, multiple of the coarsest stride
+#define SURFACE_CHUNK_LODS 6     // strides 1, 2, 4, ..., SURFACE_CHUNK_QUADS
+#define SURFACE_CHUNK_SLOT (SURFACE_CHUNK_QUADS * SURFACE_CHUNK_QUADS * 6)
+#define SURFACE_QUADRIC_KEY -2  // edge key of chunks holding quadric levels, no edge stitching
+#define SURFACE_LOD_PIXELS 8.0f  // projected length of a mesh segment before coarsening
+#define INDEX_STRIP_QUADS 7      // quads per column strip, two vertex rows fill a 16 entry cache
 #define NUM_TEXTURES 3
+#define NORMAL_GROUP_SIZE 64     // must match normalLines.comp
+#define HEIGHTMAP_GROUP_SIZE 16  // must match heightmapBake.comp
+#define HEIGHT_NOISE_GROUP_SIZE 16 // must match heightNoise.comp
+#define SURFACE_GEN_GROUP_SIZE 16  // must match surfaceGen.comp
+#define SURFACE_UPLOAD_DEADLINE 8  // frames a rebuilt surface may take through the upload budget
+#define HEIGHTMAP_UNIT 1         // height texture, the gradient uses the next unit
+#define HEIGHTMAP_MINMAX_UNIT 6  // min/max pyramid of the ray march, must match shader.c
+#define HEIGHT_BAND_TEXELS 256   // lookup texels over the height span of the bands
+#define HEIGHT_BAND_ROWS 4       // color, ambient, specular, emission, must match model.frag
+#define HEIGHT_BAND_MARGIN 0.05f // span below the second and above the last band start
 
 ///////////////////////    LOCAL    ////////////////////////////
 
 /** Array of pointers to mesh models (circle, square, star, triangle) */
 static Mesh *g_models[MODEL_MESH_COUNT];
 
+/** Same models as instanced meshes, drawn once per object class */
+static CGMesh *g_instancedModels[MODEL_MESH_COUNT];
+
+/** Ids of the same models in the shared multi-draw buffers */
+static int g_multiDrawModels[MODEL_MESH_COUNT];
+
 /** Texture IDs for surface textures */
 static GLuint g_textureIds[NUM_TEXTURES] = {0};
 
+/**
+ * Compact vertex of the sampled surface, must match model.vert and normalLines.comp.
+ * x, z and the texture coordinates follow from the grid index, so only
+ * the height and the octahedral encoded normal are stored.
+ */
+typedef struct {
+    GLfloat height;
+    GLshort normal[2];  // snorm, read back by unpackSnorm2x16
+} SurfaceVertex;
+
 /**
  * Surface mesh data.
  */
@@ -37,14 +83,486 @@ static struct {
     size_t indexBufferSize;
     int numVertices;
     int numIndices;
+    int indexDim;
+    bool cacheOrder;    // indices in column strips, see emitGridQuads
+    vec2 extent;        // x and z of the last grid vertex, the first one is at the origin
+    unsigned revision;  // counts the surface uploads, for caches drawn from the surface
 } g_surface = {
     .vao = 0, .vbo = 0, .ebo = 0,
-    .vertexBufferSize = SURFACE_DEFAULT_SIZE * sizeof(Vertex),
+    .vertexBufferSize = SURFACE_DEFAULT_SIZE * sizeof(SurfaceVertex),
     .indexBufferSize = SURFACE_DEFAULT_SIZE * 6 * sizeof(GLuint),
     .numVertices = 0,
-    .numIndices = 0
+    .numIndices = 0,
+    .indexDim = 0,
+    .cacheOrder = true
 };
 
+/**
+ * Tessellated surface data.
+ * One mat4 of coefficients per patch in a shader storage buffer,
+ * drawn as one vertex per patch without vertex attributes.
+ */
+static struct {
+    GLuint vao, ssbo;
+    size_t bufferSize;
+    int patchCount;
+    vec2 step;
+} g_surfaceTess = {0};
+
+/**
+ * One patch aligned chunk of the sampled surface mesh.
+ * Neighbouring chunks share their border vertices.
+ */
+typedef struct {
+    int x0, x1, z0, z1;  // vertex range, inclusive
+    vec3 bounds[2];      // bounding box of the vertices
+    int lod;             // stride exponent chosen this frame
+    int key[5];          // lod and edge strides of the cached indices, -1 if invalid
+    int numIndices;
+    bool dirty;          // heights changed since the quadric levels were built
+    GLuint *quadric;     // quadric levels back to back, NULL until built
+    int quadricOffsets[SURFACE_CHUNK_LODS + 1];
+} SurfaceChunk;
+
+/**
+ * Chunked LOD data of the sampled surface mesh.
+ * Shares the vertex buffer of g_surface, every chunk owns a fixed
+ * slot of SURFACE_CHUNK_SLOT indices in its own index buffer.
+ * The levels are strided grids, or quadric simplified meshes cached
+ * on the CPU until the heights of the chunk change.
+ */
+static struct {
+    GLuint vao, ebo;
+    SurfaceChunk *chunks;
+    int perAxis;
+    int dim;
+    bool quadric;       // quadric levels instead of strided grids
+    GLsizei *counts;
+    const void **offsets;
+    GLuint *scratch;
+} g_surfaceChunks = {0};
+
+/**
+ * One vertex of a normal line, must match LineVertex in normalLines.comp.
+ */
+typedef struct {
+    vec4 pos;       // w: 0 at the base, 1 at the tip
+    vec4 normal;
+} NormalVertex;
+
+/**
+ * Normal lines of a model, two vertices per shown normal drawn as GL_LINES.
+ */
+typedef struct {
+    GLuint vao, vbo;
+    size_t bufferSize;
+    int numVertices;
+} NormalLines;
+
+/** Normal lines of the mesh models, built once */
+static NormalLines g_modelNormals[MODEL_MESH_COUNT];
+
+/**
+ * Normal lines of the sampled surface mesh.
+ * Rebuilt by the compute shader when drawn after the surface or the stride changed.
+ */
+static struct {
+    NormalLines lines;
+    int stride;
+    bool stale;
+} g_surfaceNormals = {0};
+
+/**
+ * Heightmap of the sampled surface, one texel per grid vertex:
+ * R32F heights and RG16F derivatives dh/dx, dh/dz.
+ * Baked from the surface vertex buffer by a compute shader
+ * when drawn after the surface changed.
+ * The ray march also needs the RG32F min/max pyramid, one texel per grid
+ * cell at level 0, built on its first use after a bake.
+ */
+static struct {
+    GLuint height, gradient;
+    int dim;            // texture size, 0 before the first bake
+    bool stale;
+
+    GLuint minMax;
+    int minMaxCells;    // size of level 0, 0 before the first build
+    int minMaxLevels;
+    bool minMaxStale;
+    GLuint marchVao;    // empty, the fullscreen triangle is built from the vertex id
+} g_heightmap = {0};
+
+/**
+ * Height range of one LOD chunk, must match ChunkRange in surfaceBounds.comp.
+ */
+typedef struct {
+    GLfloat lo, hi;
+    GLint loIndex, hiIndex;     // vertex index of the lowest and highest sample
+} ChunkRange;
+
+/**
+ * Readback buffer of the chunk reduction after a GPU surface generation.
+ */
+static struct {
+    GLuint rangeBuffer;
+    size_t rangeBufferSize;
+} g_surfaceGen = {0};
+
+/**
+ * Full surface upload through the upload scheduler. The vertices go into
+ * the back buffer while the old surface is still drawn, once all bytes
+ * arrived the buffers are swapped and the rest of the surface state follows.
+ */
+static struct {
+    GLuint vbo;                 // back buffer, swapped with g_surface.vbo when done
+    size_t vertexBufferSize;
+    SurfaceVertex *packed;      // source of the job
+    size_t packedCapacity;
+    const Vertex *vertices;     // of the caller, read once done
+    int dim;
+    int job;                    // UPLOAD_NONE if no upload is pending
+} g_surfaceUpload = { .job = UPLOAD_NONE };
+
+/**
+ * Height bands baked into a lookup texture, one row per material part:
+ * color and shininess, ambient, specular, emission.
+ * Linear filtering blends neighbouring bands over one texel.
+ */
+static struct {
+    GLuint texture;
+    vec2 range;         // height of the left texture edge, 1 / height span
+} g_heightBands = {0};
+
+/**
+ * Baked occlusion of the surface, one texel per grid sample.
+ */
+static struct {
+    GLuint texture;
+    int dim;
+    vec2 extent;        // x and z of the last grid sample
+} g_ao = {0};
+
+/**
+ * Baked normals of the surface, x and z per texel.
+ */
+static struct {
+    GLuint texture;
+    int dim;
+    vec2 extent;        // x and z of the last texel
+} g_normalMap = {0};
+
+/**
+ * Line strip drawn via the Simple-Shader, e.g. the camera flight path.
+ * Only uploaded when its points change, drawing it is a single call.
+ */
+static struct {
+    GLuint vao, vbo;
+    int capacity;       // points the buffer can hold
+    int numVertices;
+} g_path = {0};
+
+/**
+ * Creates the vao and vbo of normal lines.
+ * @param lines The normal lines to initialize.
+ */
+static void initNormalLines(NormalLines *lines) {
+    glGenVertexArrays(1, &lines->vao);
+    glGenBuffers(1, &lines->vbo);
+    lines->bufferSize = 0;
+    lines->numVertices = 0;
+
+    glstate_bindVertexArray(lines->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, lines->vbo);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(NormalVertex), (void*)offsetof(NormalVertex, pos));
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(NormalVertex), (void*)offsetof(NormalVertex, normal));
+
+    glstate_bindVertexArray(0);
+}
+
+/**
+ * Creates the vao and vbo of the line strip, positions only.
+ */
+static void initPath(void) {
+    glGenVertexArrays(1, &g_path.vao);
+    glGenBuffers(1, &g_path.vbo);
+    g_path.capacity = 0;
+    g_path.numVertices = 0;
+
+    glstate_bindVertexArray(g_path.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, g_path.vbo);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
+
+    glstate_bindVertexArray(0);
+}
+
+/**
+ * Deletes the vao and vbo of normal lines.
+ * @param lines The normal lines to delete.
+ */
+static void deleteNormalLines(NormalLines *lines) {
+    gpumem_deleteBuffers(1, &lines->vbo);
+    glDeleteVertexArrays(1, &lines->vao);
+    memset(lines, 0, sizeof(NormalLines));
+}
+
+/**
+ * Builds one normal line per vertex of a static mesh model.
+ * @param model The model the vertices belong to.
+ * @param vertices The vertices of the model.
+ * @param numVertices Number of vertices.
+ */
+static void initModelNormals(ModelType model, const Vertex *vertices, int numVertices) {
+    NormalLines *lines = &g_modelNormals[model];
+    initNormalLines(lines);
+
+    Arena *scratch = arena_rebuild();
+    ArenaMark mark = arena_mark(scratch);
+    NormalVertex *dest = arena_alloc(scratch, 2 * numVertices * sizeof(NormalVertex));
+
+    for (int i = 0; i < numVertices; ++i) {
+        const Vertex *v = &vertices[i];
+        for (int tip = 0; tip < 2; ++tip) {
+            NormalVertex *nv = &dest[2 * i + tip];
+            memcpy(nv->pos, v->position, sizeof(v->position));
+            memcpy(nv->normal, v->normal, sizeof(v->normal));
+            nv->pos[3] = (float) tip;
+            nv->normal[3] = 0.0f;
+        }
+    }
+
+    lines->bufferSize = 2 * numVertices * sizeof(NormalVertex);
+    lines->numVertices = 2 * numVertices;
+    glBindBuffer(GL_ARRAY_BUFFER, lines->vbo);
+    glBufferData(GL_ARRAY_BUFFER, lines->bufferSize, dest, GL_STATIC_DRAW);
+    gpumem_setBuffer(GPUMEM_GEOMETRY, lines->vbo, lines->bufferSize);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    arena_release(scratch, mark);
+}
+
+/**
+ * Rebuilds the surface normal lines on the GPU if the surface or the stride changed.
+ * Every stride-th vertex per axis gets a line, so large grids stay readable.
+ * @param stride Distance between two shown normals in vertices.
+ * @return False if there are no lines to draw.
+ */
+static bool updateSurfaceNormals(int stride) {
+    int dim = g_surface.indexDim;
+    NormalLines *lines = &g_surfaceNormals.lines;
+    stride = stride < 1 ? 1 : stride;
+
+    if (dim <= 0 || g_surface.numVertices != dim * dim) {
+        return false;
+    }
+    if (!g_surfaceNormals.stale && g_surfaceNormals.stride == stride) {
+        return lines->numVertices > 0;
+    }
+    if (!shader_setNormalGen(dim, stride, g_surface.extent)) {
+        return false;
+    }
+
+    int perAxis = (dim + stride - 1) / stride;
+    int numLines = perAxis * perAxis;
+    size_t required = 2 * numLines * sizeof(NormalVertex);
+
+    if (required > lines->bufferSize) {
+        lines->bufferSize = required;
+        glBindBuffer(GL_ARRAY_BUFFER, lines->vbo);
+        glBufferData(GL_ARRAY_BUFFER, lines->bufferSize, NULL, GL_DYNAMIC_COPY);
+        gpumem_setBuffer(GPUMEM_GEOMETRY, lines->vbo, lines->bufferSize);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // The compact surface vertices are read as raw words
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, g_surface.vbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, lines->vbo);
+    glDispatchCompute((numLines + NORMAL_GROUP_SIZE - 1) / NORMAL_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    lines->numVertices = 2 * numLines;
+    g_surfaceNormals.stride = stride;
+    g_surfaceNormals.stale = false;
+    return true;
+}
+
+/**
+ * Rebakes the heightmap if the surface changed since the last bake.
+ * @return False if there is no heightmap to sample.
+ */
+static bool updateHeightmap(void) {
+    int dim = g_surface.indexDim;
+    if (dim <= 0 || g_surface.numVertices != dim * dim) {
+        return false;
+    }
+    if (!g_heightmap.stale && g_heightmap.dim == dim) {
+        return true;
+    }
+    if (!shader_setHeightmapBake(dim)) {
+        return false;
+    }
+
+    // Immutable storage, a new dimension needs new textures
+    if (g_heightmap.dim != dim) {
+        gpumem_deleteTextures(1, &g_heightmap.height);
+        gpumem_deleteTextures(1, &g_heightmap.gradient);
+        glGenTextures(1, &g_heightmap.height);
+        glGenTextures(1, &g_heightmap.gradient);
+
+        // Linear for the ball physics, the vertex fetch reads single texels
+        GLuint textures[2] = { g_heightmap.height, g_heightmap.gradient };
+        GLenum formats[2] = { GL_R32F, GL_RG16F };
+        for (int i = 0; i < 2; ++i) {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], dim, dim);
+            gpumem_setTexture(GPUMEM_TEXTURES, textures[i], gpumem_imageBytes(formats[i], dim, dim, 1));
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        g_heightmap.dim = dim;
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, g_surface.vbo);
+    glBindImageTexture(0, g_heightmap.height, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindImageTexture(1, g_heightmap.gradient, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+    int groups = (dim + HEIGHTMAP_GROUP_SIZE - 1) / HEIGHTMAP_GROUP_SIZE;
+    glDispatchCompute(groups, groups, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    g_heightmap.stale = false;
+    g_heightmap.minMaxStale = true;
+    return true;
+}
+
+/**
+ * Rebuilds the min/max pyramid of the heightmap if the heightmap was rebaked since.
+ * @return False if there is no heightmap or no pyramid shader.
+ */
+static bool updateHeightMinMax(void) {
+    if (!updateHeightmap()) {
+        return false;
+    }
+    if (!g_heightmap.minMaxStale && g_heightmap.minMaxCells == g_heightmap.dim - 1) {
+        return true;
+    }
+
+    int cells = g_heightmap.dim - 1;
+    if (cells < 1 || !shader_setHeightMinMax(0, g_heightmap.dim, cells)) {
+        return false;
+    }
+
+    // Immutable storage with the full mip chain down to one texel
+    if (g_heightmap.minMaxCells != cells) {
+        int levels = 1;
+        while ((cells >> levels) > 0) {
+            ++levels;
+        }
+
+        gpumem_deleteTextures(1, &g_heightmap.minMax);
+        glGenTextures(1, &g_heightmap.minMax);
+        glBindTexture(GL_TEXTURE_2D, g_heightmap.minMax);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_RG32F, cells, cells);
+        size_t bytes = 0;
+        for (int level = 0; level < levels; ++level) {
+            bytes += gpumem_imageBytes(GL_RG32F, cells >> level, cells >> level, 1);
+        }
+        gpumem_setTexture(GPUMEM_TEXTURES, g_heightmap.minMax, bytes);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        g_heightmap.minMaxCells = cells;
+        g_heightmap.minMaxLevels = levels;
+    }
+
+    // Level 0 reads the heightmap, every further level the one below
+    glActiveTexture(GL_TEXTURE0 + HEIGHTMAP_UNIT);
+    glBindTexture(GL_TEXTURE_2D, g_heightmap.height);
+    glActiveTexture(GL_TEXTURE0);
+
+    int srcSize = g_heightmap.dim;
+    for (int level = 0; level < g_heightmap.minMaxLevels; ++level) {
+        int size = cells >> level;
+        shader_setHeightMinMax(level, srcSize, size);
+        glBindImageTexture(0, g_heightmap.minMax, level > 0 ? level - 1 : 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+        glBindImageTexture(1, g_heightmap.minMax, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+        int groups = (size + HEIGHTMAP_GROUP_SIZE - 1) / HEIGHTMAP_GROUP_SIZE;
+        glDispatchCompute(groups, groups, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        srcSize = size;
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    g_heightmap.minMaxStale = false;
+    return true;
+}
+
+/**
+ * Binds the heightmap textures, read by model.vert and ballPhysics.comp.
+ */
+static void bindHeightmap(void) {
+    glActiveTexture(GL_TEXTURE0 + HEIGHTMAP_UNIT);
+    glBindTexture(GL_TEXTURE_2D, g_heightmap.height);
+    glActiveTexture(GL_TEXTURE0 + HEIGHTMAP_UNIT + 1);
+    glBindTexture(GL_TEXTURE_2D, g_heightmap.gradient);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+/**
+ * Draws normal lines in a single call via the Normal-Shader.
+ * @param lines The normal lines to draw.
+ */
+static void drawNormalLines(const NormalLines *lines) {
+    shader_setNormals();
+    glstate_bindVertexArray(lines->vao);
+    glDrawArrays(GL_LINES, 0, lines->numVertices);
+}
+
+/**
+ * Emits the two triangles of every quad of a vertex grid.
+ * In cache order the quads are visited in column strips of INDEX_STRIP_QUADS,
+ * row by row within a strip, so the vertex row shared with the previous
+ * quad row is still in the post-transform vertex cache. Otherwise the
+ * quads are visited row by row across the whole grid, which misses the
+ * cache for almost every vertex once a row is longer than the cache.
+ * @param first Index of the first vertex of the grid.
+ * @param rowStride Index distance between two vertex rows.
+ * @param quadsX Quads per row.
+ * @param quadsY Quad rows.
+ * @param cacheOrder Visit the quads in column strips.
+ * @param dest Output with room for quadsX * quadsY * 6 indices.
+ * @return Number of written indices.
+ */
+static int emitGridQuads(GLuint first, int rowStride, int quadsX, int quadsY, bool cacheOrder, GLuint *dest) {
+    int strip = cacheOrder ? INDEX_STRIP_QUADS : quadsX;
+    int idx = 0;
+    for (int x0 = 0; x0 < quadsX; x0 += strip) {
+        int x1 = glm_imin(x0 + strip, quadsX);
+        for (int y = 0; y < quadsY; y++) {
+            for (int x = x0; x < x1; x++) {
+                GLuint v0 = first + y * rowStride + x;
+                GLuint v1 = v0 + 1;
+                GLuint v2 = v0 + rowStride;
+                GLuint v3 = v2 + 1;
+
+                dest[idx++] = v0; dest[idx++] = v2; dest[idx++] = v1;
+                dest[idx++] = v2; dest[idx++] = v3; dest[idx++] = v1;
+            }
+        }
+    }
+    return idx;
+}
+
 /**
  * Creates a unit Sphere mesh.
  * Center: (0,0)
@@ -54,6 +572,47 @@ static void model_initSphere(void) {
     g_models[MODEL_SPHERE] = mesh_createSphere(SPHERE_NUM_SLICES, SPHERE_NUM_STACKS);
 }
 
+/**
+ * Creates a unit sphere as instanced mesh.
+ * Same tessellation as mesh_createSphere, the indices in cache order.
+ */
+static void model_initInstancedSphere(void) {
+    int numSlices = SPHERE_NUM_SLICES;
+    int numStacks = SPHERE_NUM_STACKS;
+    int numVertices = (numSlices + 1) * (numStacks + 1);
+    int numIndices = numSlices * numStacks * 6;
+
+    Arena *scratch = arena_rebuild();
+    ArenaMark mark = arena_mark(scratch);
+    Vertex *vertices = arena_alloc(scratch, sizeof(Vertex) * numVertices);
+    GLuint *indices = arena_alloc(scratch, sizeof(GLuint) * numIndices);
+
+    int iv = 0;
+    for (int stack = 0; stack <= numStacks; stack++) {
+        float stackAngle = ((float)M_PI) / 2 - stack * ((float)M_PI) / numStacks;
+        float xy = cosf(stackAngle);
+        float z = sinf(stackAngle);
+
+        for (int slice = 0; slice <= numSlices; slice++) {
+            float sliceAngle = ((float)M_PI) * slice * 2 / numSlices;
+            float x = xy * cosf(sliceAngle);
+            float y = xy * sinf(sliceAngle);
+
+            // Unit sphere: the position is the normal
+            vertices[iv++] = (Vertex) {
+                {x, y, z}, {x, y, z},
+                {((float)slice) / numSlices, ((float)stack) / numStacks}
+            };
+        }
+    }
+    emitGridQuads(0, numSlices + 1, numSlices, numStacks, true, indices);
+
+    g_instancedModels[MODEL_SPHERE] = instanced_createMesh(vertices, numVertices, indices, numIndices, GL_TRIANGLES);
+    g_multiDrawModels[MODEL_SPHERE] = multidraw_addMesh(vertices, numVertices, indices, numIndices);
+    initModelNormals(MODEL_SPHERE, vertices, numVertices);
+    arena_release(scratch, mark);
+}
+
 /**
  * Creates a unit Cube mesh.
  */
@@ -121,46 +680,619 @@ static void model_initCube(void) {
     }
 
     g_models[MODEL_CUBE] = mesh_createMesh("Cube", vertices, 24, indices, 36, GL_TRIANGLES);
+    g_instancedModels[MODEL_CUBE] = instanced_createMesh(vertices, 24, indices, 36, GL_TRIANGLES);
+    g_multiDrawModels[MODEL_CUBE] = multidraw_addMesh(vertices, 24, indices, 36);
+    initModelNormals(MODEL_CUBE, vertices, 24);
+}
+
+/**
+ * Sets up the vertex attributes of the surface vertex buffer.
+ * Expects the vao to be bound.
+ */
+static void setupSurfaceAttribs(void) {
+    glBindBuffer(GL_ARRAY_BUFFER, g_surface.vbo);
+
+    // pos.x carries the height, norm.xy the octahedral normal, model.vert rebuilds the rest
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, sizeof(SurfaceVertex), (void*)offsetof(SurfaceVertex, height));
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(SurfaceVertex), (void*)offsetof(SurfaceVertex, normal));
+}
+
+/**
+ * Encodes a unit normal on the octahedron, folding the lower half over its diagonals.
+ * @param n The normal.
+ * @param out Output, both components as snorm.
+ */
+static void encodeOctNormal(const GLfloat *n, GLshort out[2]) {
+    float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    float x = l1 > 0.0f ? n[0] / l1 : 0.0f;
+    float y = l1 > 0.0f ? n[1] / l1 : 0.0f;
+
+    if (n[2] < 0.0f) {
+        float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+
+    out[0] = (GLshort) lroundf(glm_clamp(x, -1.0f, 1.0f) * 32767.0f);
+    out[1] = (GLshort) lroundf(glm_clamp(y, -1.0f, 1.0f) * 32767.0f);
+}
+
+/**
+ * Converts sampled surface vertices into the compact upload format.
+ * @param vertices The full vertices.
+ * @param count Number of vertices.
+ * @param dest Output for count compact vertices.
+ */
+static void packSurfaceVertices(const Vertex *vertices, int count, SurfaceVertex *dest) {
+    for (int i = 0; i < count; ++i) {
+        dest[i].height = vertices[i].position[1];
+        encodeOctNormal(vertices[i].normal, dest[i].normal);
+    }
+}
+
+/**
+ * Writes the coordinates of a chunk edge at a stride, both ends included.
+ * @param lo First coordinate.
+ * @param hi Last coordinate.
+ * @param stride Distance between the points.
+ * @param dest Output with room for SURFACE_CHUNK_QUADS + 1 coordinates.
+ * @return Number of points.
+ */
+static int edgePoints(int lo, int hi, int stride, int *dest) {
+    int count = 0;
+    for (int v = lo; v < hi; v += stride) {
+        dest[count++] = v;
+    }
+    dest[count++] = hi;
+    return count;
+}
+
+/**
+ * Emits one triangle with the winding of updateSurfaceIndices.
+ * @param dim The dimension of the 2D-Surface.
+ * @param xz X and z coordinates of the three vertices.
+ * @param dest Output indices.
+ * @return Number of written indices.
+ */
+static int emitChunkTriangle(int dim, const int xz[3][2], GLuint *dest) {
+    int cross = (xz[1][0] - xz[0][0]) * (xz[2][1] - xz[0][1]) - (xz[1][1] - xz[0][1]) * (xz[2][0] - xz[0][0]);
+    if (cross == 0) {
+        return 0;
+    }
+
+    // Grid quads are emitted with a negative cross product in x/z
+    int second = cross < 0 ? 1 : 2;
+    dest[0] = xz[0][1] * dim + xz[0][0];
+    dest[1] = xz[second][1] * dim + xz[second][0];
+    dest[2] = xz[3 - second][1] * dim + xz[3 - second][0];
+    return 3;
+}
+
+/**
+ * Triangulates the strip between two parallel point rows by always
+ * advancing on the row whose next point comes first.
+ * @param dim The dimension of the 2D-Surface.
+ * @param alongX Whether the rows run along x (otherwise along z).
+ * @param a Coordinates of the first row.
+ * @param na Number of points of the first row.
+ * @param lineA Fixed coordinate of the first row.
+ * @param b Coordinates of the second row.
+ * @param nb Number of points of the second row.
+ * @param lineB Fixed coordinate of the second row.
+ * @param dest Output indices.
+ * @return Number of written indices.
+ */
+static int zipChunkStrip(int dim, bool alongX, const int *a, int na, int lineA,
+                         const int *b, int nb, int lineB, GLuint *dest) {
+    int along = alongX ? 0 : 1;
+    int count = 0;
+    int i = 0, j = 0;
+
+    while (i < na - 1 || j < nb - 1) {
+        bool advanceA = j == nb - 1 || (i < na - 1 && a[i + 1] <= b[j + 1]);
+        int tri[3][2];
+        tri[0][along] = a[i];     tri[0][1 - along] = lineA;
+        tri[2][along] = b[j];     tri[2][1 - along] = lineB;
+        if (advanceA) {
+            tri[1][along] = a[++i]; tri[1][1 - along] = lineA;
+        } else {
+            tri[1][along] = b[++j]; tri[1][1 - along] = lineB;
+        }
+        count += emitChunkTriangle(dim, (const int (*)[2]) tri, &dest[count]);
+    }
+    return count;
+}
+
+/**
+ * Builds the indices of a chunk at an interior stride.
+ * The interior is a regular grid, a ring of strips connects it to the
+ * edges, which use the coarser stride of the two chunks sharing them.
+ * Both chunks along an edge then have the same vertices on it,
+ * so the mesh stays free of cracks.
+ * @param c The chunk.
+ * @param dim The dimension of the 2D-Surface.
+ * @param stride Interior stride.
+ * @param edge Strides of the left, right, top and bottom edge.
+ * @param dest Output with room for SURFACE_CHUNK_SLOT indices.
+ * @return Number of written indices.
+ */
+static int buildChunkIndices(const SurfaceChunk *c, int dim, int stride, const int edge[4], GLuint *dest) {
+    int px[SURFACE_CHUNK_QUADS + 1], pz[SURFACE_CHUNK_QUADS + 1];
+    int left[SURFACE_CHUNK_QUADS + 1], right[SURFACE_CHUNK_QUADS + 1];
+    int top[SURFACE_CHUNK_QUADS + 1], bottom[SURFACE_CHUNK_QUADS + 1];
+
+    int nx = edgePoints(c->x0, c->x1, stride, px);
+    int nz = edgePoints(c->z0, c->z1, stride, pz);
+    int nl = edgePoints(c->z0, c->z1, edge[0], left);
+    int nr = edgePoints(c->z0, c->z1, edge[1], right);
+    int nt = edgePoints(c->x0, c->x1, edge[2], top);
+    int nb = edgePoints(c->x0, c->x1, edge[3], bottom);
+
+    // Without an interior the chunk is a single strip between two edges
+    if (nx < 3) {
+        return zipChunkStrip(dim, false, left, nl, c->x0, right, nr, c->x1, dest);
+    }
+    if (nz < 3) {
+        return zipChunkStrip(dim, true, top, nt, c->z0, bottom, nb, c->z1, dest);
+    }
+
+    // Interior quads in the order of emitGridQuads
+    int count = 0;
+    int strip = g_surface.cacheOrder ? INDEX_STRIP_QUADS : nx;
+    for (int x0 = 1; x0 < nx - 2; x0 += strip) {
+        int x1 = glm_imin(x0 + strip, nx - 2);
+        for (int zi = 1; zi < nz - 2; ++zi) {
+            for (int xi = x0; xi < x1; ++xi) {
+                const int t0[3][2] = {{px[xi], pz[zi]}, {px[xi], pz[zi + 1]}, {px[xi + 1], pz[zi]}};
+                const int t1[3][2] = {{px[xi], pz[zi + 1]}, {px[xi + 1], pz[zi + 1]}, {px[xi + 1], pz[zi]}};
+                count += emitChunkTriangle(dim, t0, &dest[count]);
+                count += emitChunkTriangle(dim, t1, &dest[count]);
+            }
+        }
+    }
+
+    // The ring between the edges and the border of the interior
+    count += zipChunkStrip(dim, true, top, nt, c->z0, &px[1], nx - 2, pz[1], &dest[count]);
+    count += zipChunkStrip(dim, true, bottom, nb, c->z1, &px[1], nx - 2, pz[nz - 2], &dest[count]);
+    count += zipChunkStrip(dim, false, left, nl, c->x0, &pz[1], nz - 2, px[1], &dest[count]);
+    count += zipChunkStrip(dim, false, right, nr, c->x1, &pz[1], nz - 2, px[nx - 2], &dest[count]);
+    return count;
+}
+
+/**
+ * Frees the cached quadric levels of all chunks.
+ */
+static void freeQuadricLevels(void) {
+    for (int i = 0; i < g_surfaceChunks.perAxis * g_surfaceChunks.perAxis; ++i) {
+        TRACKED_FREE(g_surfaceChunks.chunks[i].quadric);
+        g_surfaceChunks.chunks[i].quadric = NULL;
+    }
+}
+
+/**
+ * Splits the surface grid into chunks, if the dimension changed.
+ * Cached chunk indices are invalidated.
+ * @param dim The dimension of the 2D-Surface (#vertices == dim^2).
+ */
+static void updateSurfaceChunks(int dim) {
+    if (dim == g_surfaceChunks.dim) {
+        return;
+    }
+
+    int quads = dim - 1;
+    int perAxis = (quads + SURFACE_CHUNK_QUADS - 1) / SURFACE_CHUNK_QUADS;
+    int count = perAxis * perAxis;
+
+    freeQuadricLevels();
+    TRACKED_FREE(g_surfaceChunks.chunks);
+    TRACKED_FREE(g_surfaceChunks.counts);
+    TRACKED_FREE(g_surfaceChunks.offsets);
+    g_surfaceChunks.chunks = TRACKED_MALLOC(count * sizeof(SurfaceChunk));
+    g_surfaceChunks.counts = TRACKED_MALLOC(count * sizeof(GLsizei));
+    g_surfaceChunks.offsets = TRACKED_MALLOC(count * sizeof(void*));
+    if (!g_surfaceChunks.scratch) {
+        g_surfaceChunks.scratch = TRACKED_MALLOC(SURFACE_CHUNK_SLOT * sizeof(GLuint));
+    }
+    assert(g_surfaceChunks.chunks && g_surfaceChunks.counts && g_surfaceChunks.offsets
+        && g_surfaceChunks.scratch && "malloc failed in updateSurfaceChunks");
+
+    for (int i = 0; i < perAxis; ++i) {
+        for (int j = 0; j < perAxis; ++j) {
+            SurfaceChunk *c = &g_surfaceChunks.chunks[i * perAxis + j];
+            c->x0 = j * SURFACE_CHUNK_QUADS;
+            c->z0 = i * SURFACE_CHUNK_QUADS;
+            c->x1 = glm_imin(c->x0 + SURFACE_CHUNK_QUADS, quads);
+            c->z1 = glm_imin(c->z0 + SURFACE_CHUNK_QUADS, quads);
+            c->lod = 0;
+            c->key[0] = -1;
+            c->numIndices = 0;
+            c->dirty = true;
+            c->quadric = NULL;
+        }
+    }
+
+    glstate_bindVertexArray(g_surfaceChunks.vao);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t) count * SURFACE_CHUNK_SLOT * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+    gpumem_setBuffer(GPUMEM_GEOMETRY, g_surfaceChunks.ebo, (size_t) count * SURFACE_CHUNK_SLOT * sizeof(GLuint));
+    glstate_bindVertexArray(0);
+
+    g_surfaceChunks.perAxis = perAxis;
+    g_surfaceChunks.dim = dim;
+}
+
+/**
+ * Recomputes the bounding boxes of the chunks overlapping a vertex rectangle.
+ * @param vertices The vertices of the rectangle (width * height, row by row).
+ * @param x First column of the rectangle.
+ * @param y First row of the rectangle.
+ * @param width Number of columns of the rectangle.
+ * @param height Number of rows of the rectangle.
+ * @param grow Extend the existing boxes instead of replacing them,
+ *             for rectangles that only cover a part of a chunk.
+ */
+static void updateChunkBounds(const Vertex *vertices, int x, int y, int width, int height, bool grow) {
+    int perAxis = g_surfaceChunks.perAxis;
+    int firstI = glm_clamp((y - 1) / SURFACE_CHUNK_QUADS, 0, perAxis - 1);
+    int lastI = glm_clamp((y + height - 1) / SURFACE_CHUNK_QUADS, 0, perAxis - 1);
+    int firstJ = glm_clamp((x - 1) / SURFACE_CHUNK_QUADS, 0, perAxis - 1);
+    int lastJ = glm_clamp((x + width - 1) / SURFACE_CHUNK_QUADS, 0, perAxis - 1);
+
+    for (int i = firstI; i <= lastI; ++i) {
+        for (int j = firstJ; j <= lastJ; ++j) {
+            SurfaceChunk *c = &g_surfaceChunks.chunks[i * perAxis + j];
+            int z0 = glm_imax(c->z0, y), z1 = glm_imin(c->z1, y + height - 1);
+            int x0 = glm_imax(c->x0, x), x1 = glm_imin(c->x1, x + width - 1);
+            if (z0 > z1 || x0 > x1) continue;
+
+            c->dirty = true;
+            if (!grow) {
+                glm_vec3_fill(c->bounds[0], FLT_MAX);
+                glm_vec3_fill(c->bounds[1], -FLT_MAX);
+            }
+            for (int z = z0; z <= z1; ++z) {
+                for (int xi = x0; xi <= x1; ++xi) {
+                    const GLfloat *p = vertices[(z - y) * width + (xi - x)].position;
+                    glm_vec3_minv(c->bounds[0], (float*) p, c->bounds[0]);
+                    glm_vec3_maxv(c->bounds[1], (float*) p, c->bounds[1]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Sets the chunk bounds from the chunk reduction of a GPU generated surface
+ * and finds the lowest and highest sample of the whole surface.
+ * x and z follow from the vertex indices and the extent.
+ * @param ranges Height range of every chunk.
+ * @param dim The dimension of the surface.
+ * @param minPoint Output: lowest sample.
+ * @param maxPoint Output: highest sample.
+ */
+static void applyChunkRanges(const ChunkRange *ranges, int dim, vec3 minPoint, vec3 maxPoint) {
+    float sx = g_surface.extent[0] / (dim - 1);
+    float sz = g_surface.extent[1] / (dim - 1);
+    int lo = 0, hi = 0;
+
+    int count = g_surfaceChunks.perAxis * g_surfaceChunks.perAxis;
+    for (int i = 0; i < count; ++i) {
+        SurfaceChunk *c = &g_surfaceChunks.chunks[i];
+        glm_vec3_copy((vec3) { c->x0 * sx, ranges[i].lo, c->z0 * sz }, c->bounds[0]);
+        glm_vec3_copy((vec3) { c->x1 * sx, ranges[i].hi, c->z1 * sz }, c->bounds[1]);
+        c->dirty = true;
+
+        if (ranges[i].lo < ranges[lo].lo) lo = i;
+        if (ranges[i].hi > ranges[hi].hi) hi = i;
+    }
+
+    int v = ranges[lo].loIndex;
+    glm_vec3_copy((vec3) { (v % dim) * sx, ranges[lo].lo, (v / dim) * sz }, minPoint);
+    v = ranges[hi].hiIndex;
+    glm_vec3_copy((vec3) { (v % dim) * sx, ranges[hi].hi, (v / dim) * sz }, maxPoint);
+}
+
+/**
+ * Input of the quadric level jobs.
+ */
+typedef struct {
+    const SurfaceVertex *vertices;  // the whole grid, read back from the vertex buffer
+    vec2 spacing;
+    const int *chunks;              // indices of the chunks to rebuild
+} QuadricJob;
+
+/**
+ * Builds the quadric levels of a range of chunks, level l keeps about
+ * a quarter of the triangles of level l - 1 like the strided grids.
+ * @param begin First entry of the chunk list.
+ * @param end Entry after the last one.
+ * @param chunk Index of the job chunk.
+ * @param userData The QuadricJob.
+ */
+static void quadricLevelsJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    const QuadricJob *job = userData;
+    GLuint *scratch = TRACKED_MALLOC(SURFACE_CHUNK_LODS * SURFACE_CHUNK_SLOT * sizeof(GLuint));
+    assert(scratch && "malloc failed in quadricLevelsJob");
+
+    for (int i = begin; i < end; ++i) {
+        SurfaceChunk *c = &g_surfaceChunks.chunks[job->chunks[i]];
+        int budgets[SURFACE_CHUNK_LODS];
+        for (int l = 0; l < SURFACE_CHUNK_LODS; ++l) {
+            budgets[l] = (2 * (c->x1 - c->x0) * (c->z1 - c->z0)) >> (2 * l);
+        }
+        decimate_chunk(&job->vertices[0].height, sizeof(SurfaceVertex), g_surfaceChunks.dim, job->spacing,
+                       c->x0, c->z0, c->x1, c->z1, budgets, SURFACE_CHUNK_LODS, scratch, c->quadricOffsets);
+
+        size_t bytes = c->quadricOffsets[SURFACE_CHUNK_LODS] * sizeof(GLuint);
+        c->quadric = TRACKED_REALLOC(c->quadric, bytes);
+        assert(c->quadric && "realloc failed in quadricLevelsJob");
+        memcpy(c->quadric, scratch, bytes);
+        c->dirty = false;
+        c->key[0] = -1;
+    }
+    TRACKED_FREE(scratch);
+}
+
+/**
+ * Rebuilds the quadric levels of the chunks whose heights changed, the
+ * chunks in parallel. The heights are read back from the vertex buffer,
+ * so CPU and GPU generated surfaces are handled alike.
+ */
+static void updateQuadricLevels(void) {
+    int count = g_surfaceChunks.perAxis * g_surfaceChunks.perAxis;
+    int dim = g_surfaceChunks.dim;
+    Arena *scratch = arena_rebuild();
+    ArenaMark mark = arena_mark(scratch);
+
+    int *chunks = arena_alloc(scratch, count * sizeof(int));
+    int numChunks = 0;
+    for (int i = 0; i < count; ++i) {
+        if (g_surfaceChunks.chunks[i].dirty || !g_surfaceChunks.chunks[i].quadric) {
+            chunks[numChunks++] = i;
+        }
+    }
+
+    if (numChunks > 0 && g_surface.numVertices == dim * dim) {
+        TIMELINE_BEGIN("Quadric LOD");
+        size_t size = (size_t) dim * dim * sizeof(SurfaceVertex);
+        SurfaceVertex *vertices = arena_alloc(scratch, size);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_ARRAY_BUFFER, g_surface.vbo);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        QuadricJob job = {
+            .vertices = vertices,
+            .spacing = { g_surface.extent[0] / (dim - 1), g_surface.extent[1] / (dim - 1) },
+            .chunks = chunks
+        };
+        jobs_parallelFor(numChunks, 1, quadricLevelsJob, &job);
+        TIMELINE_END();
+    }
+    arena_release(scratch, mark);
+}
+
+/**
+ * Chooses the stride of every chunk from its projected sample spacing,
+ * rebuilds changed chunk indices and collects the visible chunks.
+ * Expects the chunk vao to be bound.
+ * @return Number of chunks to draw.
+ */
+static int selectSurfaceChunks(void) {
+    mat4 mvp, mv, proj;
+    vec4 planes[6];
+    scene_getMVP(mvp);
+    scene_getMV(mv);
+    scene_getP(proj);
+    glm_frustum_planes(mvp, planes);
+
+    // Camera position in model space
+    glm_mat4_inv(mv, mv);
+    vec3 cameraPos;
+    glm_vec3_copy(mv[3], cameraPos);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    float pixelsPerUnit = proj[1][1] * 0.5f * viewport[3];
+
+    int perAxis = g_surfaceChunks.perAxis;
+    int dim = g_surfaceChunks.dim;
+    SurfaceChunk *chunks = g_surfaceChunks.chunks;
+
+    // 1. Stride per chunk, one sample step should stay below SURFACE_LOD_PIXELS
+    for (int i = 0; i < perAxis * perAxis; ++i) {
+        SurfaceChunk *c = &chunks[i];
+        vec3 nearest;
+        glm_vec3_maxv(c->bounds[0], cameraPos, nearest);
+        glm_vec3_minv(c->bounds[1], nearest, nearest);
+        float dist = fmaxf(glm_vec3_distance(nearest, cameraPos), 1e-4f);
+
+        float spacing = (c->bounds[1][0] - c->bounds[0][0]) / (float) glm_imax(c->x1 - c->x0, 1);
+        float pixels = spacing * pixelsPerUnit / dist;
+
+        int lod = 0;
+        while (lod + 1 < SURFACE_CHUNK_LODS && pixels * (float) (2 << lod) <= SURFACE_LOD_PIXELS) {
+            ++lod;
+        }
+        c->lod = lod;
+    }
+
+    // Quadric levels keep the chunk borders, they need no stitching
+    bool quadric = g_surfaceChunks.quadric;
+    if (quadric) {
+        updateQuadricLevels();
+    }
+
+    // 2. Stitch every edge to the coarser neighbour, rebuild changed chunks, cull.
+    //    The chunk vao is bound, so its index buffer is the element array buffer
+    int drawCount = 0;
+    for (int i = 0; i < perAxis; ++i) {
+        for (int j = 0; j < perAxis; ++j) {
+            int idx = i * perAxis + j;
+            SurfaceChunk *c = &chunks[idx];
+            int lod = c->lod;
+
+            int edge[4] = {
+                1 << (j > 0 ? glm_imax(lod, chunks[idx - 1].lod) : lod),
+                1 << (j < perAxis - 1 ? glm_imax(lod, chunks[idx + 1].lod) : lod),
+                1 << (i > 0 ? glm_imax(lod, chunks[idx - perAxis].lod) : lod),
+                1 << (i < perAxis - 1 ? glm_imax(lod, chunks[idx + perAxis].lod) : lod)
+            };
+
+            if (quadric && c->quadric) {
+                if (c->key[0] != lod || c->key[1] != SURFACE_QUADRIC_KEY) {
+                    c->numIndices = c->quadricOffsets[lod + 1] - c->quadricOffsets[lod];
+                    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr) idx * SURFACE_CHUNK_SLOT * sizeof(GLuint),
+                        c->numIndices * sizeof(GLuint), c->quadric + c->quadricOffsets[lod]);
+                    c->key[0] = lod;
+                    c->key[1] = SURFACE_QUADRIC_KEY;
+                }
+            } else if (c->key[0] != lod || memcmp(&c->key[1], edge, sizeof(edge)) != 0) {
+                c->numIndices = buildChunkIndices(c, dim, 1 << lod, edge, g_surfaceChunks.scratch);
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr) idx * SURFACE_CHUNK_SLOT * sizeof(GLuint),
+                    c->numIndices * sizeof(GLuint), g_surfaceChunks.scratch);
+                c->key[0] = lod;
+                memcpy(&c->key[1], edge, sizeof(edge));
+            }
+
+            if (c->numIndices > 0 && glm_aabb_frustum(c->bounds, planes)) {
+                g_surfaceChunks.counts[drawCount] = c->numIndices;
+                g_surfaceChunks.offsets[drawCount] = (const void*) ((size_t) idx * SURFACE_CHUNK_SLOT * sizeof(GLuint));
+                ++drawCount;
+            }
+        }
+    }
+    return drawCount;
 }
 
 /**
  * Initializes the vao, vbo and ebo for the surface mesh.
- * VBO and EBO are supposed to change dynamically.
+ * The VBO changes dynamically, the EBO only with the surface dimension.
  */
 static void model_initSurface(void) {
     glGenVertexArrays(1, &g_surface.vao);
     glGenBuffers(1, &g_surface.vbo);
     glGenBuffers(1, &g_surface.ebo);
+    glGenBuffers(1, &g_surfaceUpload.vbo);
+    g_surface.indexDim = 0;
 
-    glBindVertexArray(g_surface.vao);
+    glGenVertexArrays(1, &g_surfaceTess.vao);
+    glGenBuffers(1, &g_surfaceTess.ssbo);
+
+    initNormalLines(&g_surfaceNormals.lines);
+    g_surfaceNormals.stale = true;
+
+    glstate_bindVertexArray(g_surface.vao);
 
     // Vertex Buffer (Dynamic)
     glBindBuffer(GL_ARRAY_BUFFER, g_surface.vbo);
     glBufferData(GL_ARRAY_BUFFER, g_surface.vertexBufferSize, NULL, GL_DYNAMIC_DRAW);
+    gpumem_setBuffer(GPUMEM_GEOMETRY, g_surface.vbo, g_surface.vertexBufferSize);
 
-    // Index Buffer (Dynamic)
+    // Index Buffer (only rewritten when the dimension changes)
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_surface.ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_surface.indexBufferSize, NULL, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_surface.indexBufferSize, NULL, GL_STATIC_DRAW);
+    gpumem_setBuffer(GPUMEM_GEOMETRY, g_surface.ebo, g_surface.indexBufferSize);
 
     // Vertex Attribute Layout
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    setupSurfaceAttribs();
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    // Chunked LOD uses the same vertices with its own index buffer
+    glGenVertexArrays(1, &g_surfaceChunks.vao);
+    glGenBuffers(1, &g_surfaceChunks.ebo);
+    glstate_bindVertexArray(g_surfaceChunks.vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_surfaceChunks.ebo);
+    setupSurfaceAttribs();
 
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+    glstate_bindVertexArray(0);
+}
+
+/**
+ * Regenerates the triangle indices of the surface grid.
+ * Expects the surface vao to be bound.
+ * @param dim The dimension of the 2D-Surface (#vertices == dim^2).
+ */
+static void updateSurfaceIndices(int dim) {
+    int numIndices = (dim - 1) * (dim - 1) * 6;
+    Arena *scratch = arena_rebuild();
+    ArenaMark mark = arena_mark(scratch);
+    GLuint *indices = arena_alloc(scratch, numIndices * sizeof(GLuint));
+    emitGridQuads(0, dim, dim - 1, dim - 1, g_surface.cacheOrder, indices);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_surface.ebo);
 
-    glBindVertexArray(0);
+    if (numIndices * sizeof(GLuint) > g_surface.indexBufferSize) {
+        g_surface.indexBufferSize = numIndices * sizeof(GLuint);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_surface.indexBufferSize, NULL, GL_STATIC_DRAW);
+        gpumem_setBuffer(GPUMEM_GEOMETRY, g_surface.ebo, g_surface.indexBufferSize);
+    }
+
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, numIndices * sizeof(GLuint), indices);
+
+    g_surface.numIndices = numIndices;
+    g_surface.indexDim = dim;
+
+    arena_release(scratch, mark);
+}
+
+/**
+ * Swaps in the uploaded surface and updates everything derived from its
+ * vertices. Done callback of the surface upload.
+ * @param userData Unused.
+ */
+static void surfaceUploadDone(void *userData) {
+    NK_UNUSED(userData);
+    const Vertex *vertices = g_surfaceUpload.vertices;
+    int dim = g_surfaceUpload.dim;
+    int numVertices = dim * dim;
+    g_surfaceUpload.job = UPLOAD_NONE;
+    ++g_surface.revision;
+
+    GLuint vbo = g_surface.vbo;
+    size_t vertexBufferSize = g_surface.vertexBufferSize;
+    g_surface.vbo = g_surfaceUpload.vbo;
+    g_surface.vertexBufferSize = g_surfaceUpload.vertexBufferSize;
+    g_surfaceUpload.vbo = vbo;
+    g_surfaceUpload.vertexBufferSize = vertexBufferSize;
+
+    // Both vertex arrays read the surface vertices
+    glstate_bindVertexArray(g_surfaceChunks.vao);
+    setupSurfaceAttribs();
+    glstate_bindVertexArray(g_surface.vao);
+    setupSurfaceAttribs();
+
+    g_surface.extent[0] = vertices[numVertices - 1].position[0];
+    g_surface.extent[1] = vertices[numVertices - 1].position[2];
+
+    // Topology only depends on the dimension
+    if (dim != g_surface.indexDim) {
+        updateSurfaceIndices(dim);
+    }
+
+    glstate_bindVertexArray(0);
+
+    updateSurfaceChunks(dim);
+    updateChunkBounds(vertices, 0, 0, dim, dim, false);
+
+    g_surface.numVertices = numVertices;
+    g_surfaceNormals.stale = true;
+    g_heightmap.stale = true;
 }
 
 ///////////////////////    PUBLIC    ////////////////////////////
 
 void model_init(void) {
+    instanced_init();
+    multidraw_init();
     model_initSphere();
+    model_initInstancedSphere();
     model_initCube();
     model_initSurface();
+    initPath();
     model_loadTextures();
 }
 
@@ -172,18 +1304,9 @@ void model_loadTextures(void) {
     };
     
     for (int i = 0; i < NUM_TEXTURES; i++) {
-        g_textureIds[i] = texture_loadTexture(texturePaths[i], GL_REPEAT);
-        
-        // Set texture parameters
-        glBindTexture(GL_TEXTURE_2D, g_textureIds[i]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        // Streamed in through the cache, the JPEGs have no alpha
+        g_textureIds[i] = texstream_loadTexture(texturePaths[i], GL_REPEAT, TC_BC1);
     }
-    
-    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 GLuint model_getTextureId(int index) {
@@ -202,17 +1325,67 @@ void model_cleanup(void) {
         mesh_disposeMesh(&(g_models[i]));
         g_models[i] = NULL;
     }
+
+    for (int i = 0; i < MODEL_MESH_COUNT; ++i) {
+        if (g_instancedModels[i] != NULL) {
+            instanced_disposeMesh(g_instancedModels[i]);
+            g_instancedModels[i] = NULL;
+        }
+        deleteNormalLines(&g_modelNormals[i]);
+    }
+    instanced_cleanup();
+    multidraw_cleanup();
     
     // Cleanup textures
     for (int i = 0; i < NUM_TEXTURES; i++) {
         if (g_textureIds[i] != 0) {
-            texture_deleteTexture(&g_textureIds[i]);
+            gpumem_deleteTextures(1, &g_textureIds[i]);
+            g_textureIds[i] = 0;
         }
     }
     
-    glDeleteBuffers(1, &g_surface.vbo);
-    glDeleteBuffers(1, &g_surface.ebo);
+    gpumem_deleteBuffers(1, &g_surface.vbo);
+    gpumem_deleteBuffers(1, &g_surface.ebo);
     glDeleteVertexArrays(1, &g_surface.vao);
+    upload_cancel(g_surfaceUpload.job);
+    gpumem_deleteBuffers(1, &g_surfaceUpload.vbo);
+    TRACKED_FREE(g_surfaceUpload.packed);
+    memset(&g_surfaceUpload, 0, sizeof(g_surfaceUpload));
+    g_surfaceUpload.job = UPLOAD_NONE;
+
+    gpumem_deleteBuffers(1, &g_surfaceTess.ssbo);
+    glDeleteVertexArrays(1, &g_surfaceTess.vao);
+    gpumem_deleteBuffers(1, &g_surfaceGen.rangeBuffer);
+    g_surfaceGen.rangeBufferSize = 0;
+    deleteNormalLines(&g_surfaceNormals.lines);
+    g_surfaceTess.bufferSize = 0;
+    g_surfaceTess.patchCount = 0;
+
+    gpumem_deleteTextures(1, &g_heightmap.height);
+    gpumem_deleteTextures(1, &g_heightmap.gradient);
+    gpumem_deleteTextures(1, &g_heightmap.minMax);
+    glDeleteVertexArrays(1, &g_heightmap.marchVao);
+    memset(&g_heightmap, 0, sizeof(g_heightmap));
+
+    gpumem_deleteBuffers(1, &g_surfaceChunks.ebo);
+    glDeleteVertexArrays(1, &g_surfaceChunks.vao);
+    freeQuadricLevels();
+    TRACKED_FREE(g_surfaceChunks.chunks);
+    TRACKED_FREE(g_surfaceChunks.counts);
+    TRACKED_FREE(g_surfaceChunks.offsets);
+    TRACKED_FREE(g_surfaceChunks.scratch);
+    memset(&g_surfaceChunks, 0, sizeof(g_surfaceChunks));
+
+    gpumem_deleteBuffers(1, &g_path.vbo);
+    glDeleteVertexArrays(1, &g_path.vao);
+
+    gpumem_deleteTextures(1, &g_heightBands.texture);
+    memset(&g_heightBands, 0, sizeof(g_heightBands));
+    gpumem_deleteTextures(1, &g_ao.texture);
+    memset(&g_ao, 0, sizeof(g_ao));
+    gpumem_deleteTextures(1, &g_normalMap.texture);
+    memset(&g_normalMap, 0, sizeof(g_normalMap));
+    memset(&g_path, 0, sizeof(g_path));
 }
 
 void model_draw(ModelType model, const Material *mat, bool drawNormals, mat4 *viewMat, mat4 *modelviewMat) {
@@ -220,12 +1393,12 @@ void model_draw(ModelType model, const Material *mat, bool drawNormals, mat4 *vi
         return;
     }
 
-    shader_setMVP(viewMat, modelviewMat, mat);
+    shader_setMVP(viewMat, modelviewMat, mat, false);
     mesh_drawMesh(g_models[model]);
+    glstate_forgetVertexArray();
 
     if (drawNormals) {
-        shader_setNormals();
-        mesh_drawMesh(g_models[model]);
+        drawNormalLines(&g_modelNormals[model]);
     }
 }
 
@@ -234,80 +1407,515 @@ void model_drawSimple(ModelType model) {
         return;
     }
 
-    shader_setSimpleMVP();
+    shader_setSimpleMVP(false);
     mesh_drawMesh(g_models[model]);
+    glstate_forgetVertexArray();
 }
 
-void model_drawSurface(bool drawNormals, mat4 *viewMat, mat4 *modelviewMat) {
-    glBindVertexArray(g_surface.vao);
+void model_drawInstanced(ModelType model, const Material *mat, mat4 *viewMat) {
+    if (model >= MODEL_MESH_COUNT) {
+        return;
+    }
 
-    shader_setMVP(viewMat, modelviewMat, NULL);
-    glDrawElements(GL_TRIANGLES, g_surface.numIndices, GL_UNSIGNED_INT, 0);
+    // Instances are placed in the space of the current matrix
+    shader_setMVP(viewMat, viewMat, mat, true);
+    instanced_draw(g_instancedModels[model]);
+}
 
-    if (drawNormals) {
-        shader_setNormals();
-        glDrawElements(GL_TRIANGLES, g_surface.numIndices, GL_UNSIGNED_INT, 0);
+void model_drawSimpleInstanced(ModelType model) {
+    if (model >= MODEL_MESH_COUNT) {
+        return;
     }
 
-    glBindVertexArray(0);
+    shader_setSimpleMVP(true);
+    instanced_draw(g_instancedModels[model]);
 }
 
-void model_updateSurface(vec3 *vertices, vec3 *normals, vec2 *texcoords, int dim) {
-    int numVertices = dim * dim;
-    int numIndices = (dim - 1) * (dim - 1) * 6;
+void model_drawInstancedBuffer(ModelType model, const Material *mat, mat4 *viewMat,
+                               GLuint buffer, GLsizei stride, int count) {
+    if (model >= MODEL_MESH_COUNT) {
+        return;
+    }
+
+    shader_setMVP(viewMat, viewMat, mat, true);
+    instanced_drawBuffer(g_instancedModels[model], buffer, stride, count);
+}
+
+void model_addMultiDraw(ModelType model, const Material *mat, vec3 pos, float scale, vec3 color) {
+    if (model >= MODEL_MESH_COUNT) {
+        return;
+    }
+
+    multidraw_add(g_multiDrawModels[model], pos, scale, color, mat ? shader_getMaterialIndex(mat) : -1);
+}
+
+void model_drawMultiDraw(mat4 *viewMat, bool occlusionCull) {
+    multidraw_prepare(occlusionCull);
+    shader_setMultiDrawMVP(viewMat);
+    multidraw_draw();
+}
+
+void model_drawSimpleMultiDraw(bool occlusionCull) {
+    multidraw_prepare(occlusionCull);
+    shader_setSimpleMVP(true);
+    multidraw_draw();
+}
+
+void model_updatePath(const vec3 *points, int count) {
+    g_path.numVertices = count > 0 ? count : 0;
+    if (count <= 0) {
+        return;
+    }
 
-    Vertex *vdata = malloc(numVertices * sizeof(Vertex));
-    GLuint *indices = malloc(numIndices * sizeof(GLuint));
+    glBindBuffer(GL_ARRAY_BUFFER, g_path.vbo);
+    if (count > g_path.capacity) {
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(vec3), points, GL_DYNAMIC_DRAW);
+        gpumem_setBuffer(GPUMEM_GEOMETRY, g_path.vbo, count * sizeof(vec3));
+        g_path.capacity = count;
+    } else {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(vec3), points);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void model_drawPath(void) {
+    if (g_path.numVertices < 2) {
+        return;
+    }
+
+    shader_setSimpleMVP(false);
+    glstate_bindVertexArray(g_path.vao);
+    glDrawArrays(GL_LINE_STRIP, 0, g_path.numVertices);
+}
+
+void model_drawSurface(bool drawNormals, int normalStride, bool tessellate, bool chunkLod, bool heightmap,
+                       bool rayMarch, float textureTiling, mat4 *viewMat, mat4 *modelviewMat) {
+    if (model_isSurfaceTessellated(drawNormals, tessellate)
+        && shader_setSurfaceTessData(viewMat, modelviewMat, g_surfaceTess.patchCount, g_surfaceTess.step, textureTiling)) {
+        glstate_bindVertexArray(g_surfaceTess.vao);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, g_surfaceTess.ssbo);
+        glPatchParameteri(GL_PATCH_VERTICES, 1);
+        glDrawArrays(GL_PATCHES, 0, g_surfaceTess.patchCount * g_surfaceTess.patchCount);
+        return;
+    }
 
-    for (int y = 0; y < dim; y++) {
-        for (int x = 0; x < dim; x++) {
-            int i = y * dim + x;
+    // One fullscreen triangle, its cost depends on the pixels and not on the grid
+    if (rayMarch && updateHeightMinMax() && shader_setHeightMarchData(
+            viewMat, modelviewMat, g_heightmap.dim, g_surface.extent, g_heightmap.minMaxLevels, textureTiling)) {
+        bindHeightmap();
+        glActiveTexture(GL_TEXTURE0 + HEIGHTMAP_MINMAX_UNIT);
+        glBindTexture(GL_TEXTURE_2D, g_heightmap.minMax);
+        glActiveTexture(GL_TEXTURE0);
+
+        if (!g_heightmap.marchVao) {
+            glGenVertexArrays(1, &g_heightmap.marchVao);
+        }
+        glstate_bindVertexArray(g_heightmap.marchVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
 
-            glm_vec3_copy(vertices[i], vdata[i].position);
-            glm_vec3_copy(normals[i], vdata[i].normal);
-            glm_vec2_copy(texcoords[i], vdata[i].texCoords);
+        if (drawNormals && updateSurfaceNormals(normalStride)) {
+            drawNormalLines(&g_surfaceNormals.lines);
         }
+        return;
     }
 
-    // Indizes erzeugen
-    int idx = 0;
-    for (int y = 0; y < dim - 1; y++) {
-        for (int x = 0; x < dim - 1; x++) {
-            GLuint v0 = y * dim + x;
-            GLuint v1 = v0 + 1;
-            GLuint v2 = v0 + dim;
-            GLuint v3 = v2 + 1;
-
-            indices[idx++] = v0; indices[idx++] = v2; indices[idx++] = v1;
-            indices[idx++] = v2; indices[idx++] = v3; indices[idx++] = v1;
+    // The vertex buffer stays bound, the heightmap draw only ignores it
+    heightmap = heightmap && updateHeightmap();
+    if (heightmap) {
+        bindHeightmap();
+    }
+
+    if (chunkLod && g_surfaceChunks.dim > 0) {
+        glstate_bindVertexArray(g_surfaceChunks.vao);
+        int drawCount = selectSurfaceChunks();
+
+        shader_setMVP(viewMat, modelviewMat, NULL, false);
+        shader_setSurfaceGrid(g_surface.indexDim, g_surface.extent, textureTiling, heightmap);
+        glMultiDrawElements(GL_TRIANGLES, g_surfaceChunks.counts, GL_UNSIGNED_INT, g_surfaceChunks.offsets, drawCount);
+    } else {
+        glstate_bindVertexArray(g_surface.vao);
+
+        shader_setMVP(viewMat, modelviewMat, NULL, false);
+        shader_setSurfaceGrid(g_surface.indexDim, g_surface.extent, textureTiling, heightmap);
+        glDrawElements(GL_TRIANGLES, g_surface.numIndices, GL_UNSIGNED_INT, 0);
+    }
+
+    if (drawNormals && updateSurfaceNormals(normalStride)) {
+        drawNormalLines(&g_surfaceNormals.lines);
+    }
+}
+
+void model_updateHeightBands(const HeightBand *bands, int count) {
+    assert(count >= 2);
+
+    // The first band has no lower bound, the span covers all band starts
+    float lo = bands[1].height;
+    float hi = fmaxf(bands[count - 1].height, lo + 1e-3f);
+    float margin = (hi - lo) * HEIGHT_BAND_MARGIN;
+    lo -= margin;
+    hi += margin;
+
+    vec4 texels[HEIGHT_BAND_ROWS][HEIGHT_BAND_TEXELS];
+    int band = 0;
+    for (int i = 0; i < HEIGHT_BAND_TEXELS; ++i) {
+        float height = lo + (i + 0.5f) / HEIGHT_BAND_TEXELS * (hi - lo);
+        while (band + 1 < count && height >= bands[band + 1].height) {
+            ++band;
         }
+
+        const HeightBand *b = &bands[band];
+        glm_vec4((float*) b->color, b->shininess, texels[0][i]);
+        glm_vec4((float*) b->ambient, 0.0f, texels[1][i]);
+        glm_vec4((float*) b->specular, 0.0f, texels[2][i]);
+        glm_vec4((float*) b->emission, 0.0f, texels[3][i]);
+    }
+
+    if (!g_heightBands.texture) {
+        glGenTextures(1, &g_heightBands.texture);
+        glBindTexture(GL_TEXTURE_2D, g_heightBands.texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, HEIGHT_BAND_TEXELS, HEIGHT_BAND_ROWS);
+        gpumem_setTexture(GPUMEM_TEXTURES, g_heightBands.texture,
+            gpumem_imageBytes(GL_RGBA32F, HEIGHT_BAND_TEXELS, HEIGHT_BAND_ROWS, 1));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, g_heightBands.texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, HEIGHT_BAND_TEXELS, HEIGHT_BAND_ROWS, GL_RGBA, GL_FLOAT, texels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    g_heightBands.range[0] = lo;
+    g_heightBands.range[1] = 1.0f / (hi - lo);
+}
+
+GLuint model_getHeightBands(vec2 range) {
+    glm_vec2_copy(g_heightBands.range, range);
+    return g_heightBands.texture;
+}
+
+void model_updateAmbientOcclusion(const uint8_t *ao, int dim, vec2 extent, int x, int y, int width, int height) {
+    if (dim != g_ao.dim) {
+        gpumem_deleteTextures(1, &g_ao.texture);
+        glGenTextures(1, &g_ao.texture);
+        glBindTexture(GL_TEXTURE_2D, g_ao.texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, dim, dim);
+        gpumem_setTexture(GPUMEM_TEXTURES, g_ao.texture, gpumem_imageBytes(GL_R8, dim, dim, 1));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        g_ao.dim = dim;
+
+        // A new texture has no contents yet
+        x = 0;
+        y = 0;
+        width = dim;
+        height = dim;
     }
+    glm_vec2_copy(extent, g_ao.extent);
 
-    glBindVertexArray(g_surface.vao);
+    glBindTexture(GL_TEXTURE_2D, g_ao.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, dim);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RED, GL_UNSIGNED_BYTE, &ao[y * dim + x]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+GLuint model_getAmbientOcclusion(vec4 transform) {
+    glm_vec4_zero(transform);
+    if (!g_ao.texture) {
+        return 0;
+    }
 
-    if (numVertices * sizeof(Vertex) > g_surface.vertexBufferSize) {
-        g_surface.vertexBufferSize = numVertices * sizeof(Vertex);
+    // World xz to the texel centers of the first and the last sample
+    for (int i = 0; i < 2; ++i) {
+        transform[i] = (g_ao.dim - 1) / (g_ao.extent[i] * g_ao.dim);
+        transform[2 + i] = 0.5f / g_ao.dim;
+    }
+    return g_ao.texture;
+}
+
+void model_updateNormalMap(const uint8_t *normals, int dim, vec2 extent, int x, int y, int width, int height) {
+    if (dim != g_normalMap.dim) {
+        gpumem_deleteTextures(1, &g_normalMap.texture);
+        glGenTextures(1, &g_normalMap.texture);
+        glBindTexture(GL_TEXTURE_2D, g_normalMap.texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG8, dim, dim);
+        gpumem_setTexture(GPUMEM_TEXTURES, g_normalMap.texture, gpumem_imageBytes(GL_RG8, dim, dim, 1));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        g_normalMap.dim = dim;
+
+        // A new texture has no contents yet
+        x = 0;
+        y = 0;
+        width = dim;
+        height = dim;
+    }
+    glm_vec2_copy(extent, g_normalMap.extent);
+
+    glBindTexture(GL_TEXTURE_2D, g_normalMap.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, dim);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RG, GL_UNSIGNED_BYTE, &normals[2 * (y * dim + x)]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+GLuint model_getNormalMap(vec4 transform) {
+    glm_vec4_zero(transform);
+    if (!g_normalMap.texture) {
+        return 0;
+    }
+
+    // World xz to the texel centers of the first and the last texel
+    for (int i = 0; i < 2; ++i) {
+        transform[i] = (g_normalMap.dim - 1) / (g_normalMap.extent[i] * g_normalMap.dim);
+        transform[2 + i] = 0.5f / g_normalMap.dim;
+    }
+    return g_normalMap.texture;
+}
+
+bool model_bindHeightmap(vec2 extent) {
+    if (!updateHeightmap()) {
+        return false;
+    }
+    bindHeightmap();
+    glm_vec2_copy(g_surface.extent, extent);
+    return true;
+}
+
+bool model_generateNoiseHeights(vec3 *controlPoints, int dim, uint32_t seed, const NoiseSettings *noise) {
+    if (!shader_setHeightNoise(dim, seed, noise)) {
+        return false;
+    }
+
+    // The shader only writes the heights, x and z go through unchanged
+    GLsizeiptr size = (GLsizeiptr) dim * dim * sizeof(vec3);
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, controlPoints, GL_STREAM_COPY);
+    gpumem_setBuffer(GPUMEM_COMPUTE, buffer, (size_t) size);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+
+    int groups = (dim + HEIGHT_NOISE_GROUP_SIZE - 1) / HEIGHT_NOISE_GROUP_SIZE;
+    glDispatchCompute(groups, groups, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, controlPoints);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    gpumem_deleteBuffers(1, &buffer);
+    return true;
+}
+
+bool model_isSurfaceTessellated(bool drawNormals, bool tessellate) {
+    return tessellate && !drawNormals && g_surfaceTess.patchCount > 0 && shader_hasSurfaceTess();
+}
+
+void model_updateSurfacePatches(const Patch *patches, int first, int count, int patchCount, float stepX, float stepZ) {
+    ++g_surface.revision;
+    size_t required = (size_t) patchCount * patchCount * sizeof(mat4);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_surfaceTess.ssbo);
+    if (required > g_surfaceTess.bufferSize) {
+        g_surfaceTess.bufferSize = required;
+        glBufferData(GL_SHADER_STORAGE_BUFFER, g_surfaceTess.bufferSize, NULL, GL_DYNAMIC_DRAW);
+        gpumem_setBuffer(GPUMEM_GEOMETRY, g_surfaceTess.ssbo, g_surfaceTess.bufferSize);
+    }
+
+    if (count > 0) {
+        mat4 *dest = glMapBufferRange(
+            GL_SHADER_STORAGE_BUFFER, first * sizeof(mat4), count * sizeof(mat4),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+        );
+        if (dest) {
+            for (int i = 0; i < count; ++i) {
+                memcpy(dest[i], patches[i].coeffsY, sizeof(mat4));
+            }
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+            metrics_count(METRIC_UPLOAD_BYTES, (long) (count * sizeof(mat4)));
+        }
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    g_surfaceTess.patchCount = patchCount;
+    g_surfaceTess.step[0] = stepX;
+    g_surfaceTess.step[1] = stepZ;
+}
+
+void model_updateSurface(const Vertex *vertices, int dim) {
+    TIMELINE_BEGIN("Upload Surface");
+    int numVertices = dim * dim;
+    size_t bytes = numVertices * sizeof(SurfaceVertex);
+
+    // A newer surface supersedes the pending one, the back buffer is rewritten
+    upload_cancel(g_surfaceUpload.job);
+
+    if (bytes > g_surfaceUpload.vertexBufferSize) {
+        g_surfaceUpload.vertexBufferSize = bytes;
+        glBindBuffer(GL_ARRAY_BUFFER, g_surfaceUpload.vbo);
+        glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_DYNAMIC_DRAW);
+        gpumem_setBuffer(GPUMEM_GEOMETRY, g_surfaceUpload.vbo, bytes);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    if (bytes > g_surfaceUpload.packedCapacity) {
+        g_surfaceUpload.packed = TRACKED_REALLOC(g_surfaceUpload.packed, bytes);
+        g_surfaceUpload.packedCapacity = bytes;
+    }
+    packSurfaceVertices(vertices, numVertices, g_surfaceUpload.packed);
+
+    g_surfaceUpload.vertices = vertices;
+    g_surfaceUpload.dim = dim;
+    g_surfaceUpload.job = upload_submit(&(UploadDesc) {
+        .buffer = g_surfaceUpload.vbo,
+        .data = g_surfaceUpload.packed,
+        .bytes = bytes,
+        .deadline = SURFACE_UPLOAD_DEADLINE,
+        .done = surfaceUploadDone
+    });
+    TIMELINE_END();
+}
+
+bool model_generateSurface(int dim, vec3 minPoint, vec3 maxPoint) {
+    ++g_surface.revision;
+    int patchCount = g_surfaceTess.patchCount;
+    if (patchCount <= 0 || dim < 2 || !shader_hasSurfaceGen()) {
+        return false;
+    }
+
+    // Written in place, a pending upload of an older surface is dropped
+    upload_cancel(g_surfaceUpload.job);
+    g_surfaceUpload.job = UPLOAD_NONE;
+
+    TIMELINE_BEGIN("Generate Surface GPU");
+    int numVertices = dim * dim;
+
+    if (numVertices * sizeof(SurfaceVertex) > g_surface.vertexBufferSize) {
+        g_surface.vertexBufferSize = numVertices * sizeof(SurfaceVertex);
         glBindBuffer(GL_ARRAY_BUFFER, g_surface.vbo);
         glBufferData(GL_ARRAY_BUFFER, g_surface.vertexBufferSize, NULL, GL_DYNAMIC_DRAW);
+        gpumem_setBuffer(GPUMEM_GEOMETRY, g_surface.vbo, g_surface.vertexBufferSize);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
-    if (numIndices * sizeof(GLuint) > g_surface.indexBufferSize) {
-        g_surface.indexBufferSize = numIndices * sizeof(GLuint);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_surface.ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_surface.indexBufferSize, NULL, GL_DYNAMIC_DRAW);
+    // The patches are already uploaded for the tessellated surface
+    shader_setSurfaceGen(dim, patchCount, g_surfaceTess.step);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, g_surface.vbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, g_surfaceTess.ssbo);
+    int groups = (dim + SURFACE_GEN_GROUP_SIZE - 1) / SURFACE_GEN_GROUP_SIZE;
+    glDispatchCompute(groups, groups, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    g_surface.extent[0] = patchCount * 3 * g_surfaceTess.step[0];
+    g_surface.extent[1] = patchCount * 3 * g_surfaceTess.step[1];
+
+    if (dim != g_surface.indexDim) {
+        glstate_bindVertexArray(g_surface.vao);
+        updateSurfaceIndices(dim);
+        glstate_bindVertexArray(0);
     }
+    updateSurfaceChunks(dim);
 
-    glBindBuffer(GL_ARRAY_BUFFER, g_surface.vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, numVertices * sizeof(Vertex), vdata);
+    // One work group per chunk, only the small range buffer is read back
+    int numChunks = g_surfaceChunks.perAxis * g_surfaceChunks.perAxis;
+    size_t rangeSize = numChunks * sizeof(ChunkRange);
+    if (!g_surfaceGen.rangeBuffer) {
+        glGenBuffers(1, &g_surfaceGen.rangeBuffer);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_surfaceGen.rangeBuffer);
+    if (rangeSize > g_surfaceGen.rangeBufferSize) {
+        g_surfaceGen.rangeBufferSize = rangeSize;
+        glBufferData(GL_SHADER_STORAGE_BUFFER, rangeSize, NULL, GL_DYNAMIC_READ);
+        gpumem_setBuffer(GPUMEM_COMPUTE, g_surfaceGen.rangeBuffer, rangeSize);
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_surface.ebo);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, numIndices * sizeof(GLuint), indices);
+    shader_setSurfaceBounds(dim, SURFACE_CHUNK_QUADS, g_surfaceChunks.perAxis);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, g_surfaceGen.rangeBuffer);
+    glDispatchCompute(numChunks, 1, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
 
-    glBindVertexArray(0);
+    Arena *scratch = arena_rebuild();
+    ArenaMark mark = arena_mark(scratch);
+    ChunkRange *ranges = arena_alloc(scratch, rangeSize);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, rangeSize, ranges);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    applyChunkRanges(ranges, dim, minPoint, maxPoint);
+    arena_release(scratch, mark);
 
     g_surface.numVertices = numVertices;
-    g_surface.numIndices  = numIndices;
+    g_surfaceNormals.stale = true;
+    g_heightmap.stale = true;
+    TIMELINE_END();
+    return true;
+}
+
+void model_updateSurfaceRegion(const Vertex *vertices, int dim, int x, int y, int width, int height) {
+    upload_finish(g_surfaceUpload.job);
+    assert(g_surface.numVertices == dim * dim);
+    ++g_surface.revision;
+
+    Arena *scratch = arena_rebuild();
+    ArenaMark mark = arena_mark(scratch);
+    SurfaceVertex *packed = arena_alloc(scratch, width * height * sizeof(SurfaceVertex));
+    packSurfaceVertices(vertices, width * height, packed);
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_surface.vbo);
+    if (width == dim) {
+        // Full rows are contiguous in the buffer
+        glBufferSubData(GL_ARRAY_BUFFER, y * dim * sizeof(SurfaceVertex), width * height * sizeof(SurfaceVertex), packed);
+    } else {
+        for (int row = 0; row < height; ++row) {
+            GLintptr offset = ((y + row) * dim + x) * sizeof(SurfaceVertex);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, width * sizeof(SurfaceVertex), packed + row * width);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    arena_release(scratch, mark);
+    metrics_count(METRIC_UPLOAD_BYTES, (long) (width * height * sizeof(SurfaceVertex)));
+
+    updateChunkBounds(vertices, x, y, width, height, true);
+    g_surfaceNormals.stale = true;
+    g_heightmap.stale = true;
+}
+
+unsigned model_getSurfaceRevision(void) {
+    return g_surface.revision;
+}
+
+void model_setSurfaceCacheOrder(bool cacheOrder) {
+    if (cacheOrder == g_surface.cacheOrder) {
+        return;
+    }
+    g_surface.cacheOrder = cacheOrder;
+
+    if (g_surface.indexDim > 0) {
+        glstate_bindVertexArray(g_surface.vao);
+        updateSurfaceIndices(g_surface.indexDim);
+        glstate_bindVertexArray(0);
+    }
 
-    free(vdata);
-    free(indices);
+    // Chunks rebuild their indices on the next draw
+    for (int i = 0; i < g_surfaceChunks.perAxis * g_surfaceChunks.perAxis; ++i) {
+        g_surfaceChunks.chunks[i].key[0] = -1;
+    }
+}
+
+void model_setSurfaceQuadricLod(bool quadric) {
+    if (quadric == g_surfaceChunks.quadric) {
+        return;
+    }
+    g_surfaceChunks.quadric = quadric;
+
+    // Chunks rebuild their indices on the next draw, the quadric levels stay cached
+    for (int i = 0; i < g_surfaceChunks.perAxis * g_surfaceChunks.perAxis; ++i) {
+        g_surfaceChunks.chunks[i].key[0] = -1;
+    }
 }
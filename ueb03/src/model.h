@@ -12,6 +12,7 @@
 #define MODEL_H
 
 #include <fhwcg/fhwcg.h>
+#include "logic.h"
 
 /**
  * Enum of model types.
@@ -85,21 +86,259 @@ void model_draw(ModelType model, const Material *mat, bool drawNormals, mat4 *vi
  */
 void model_drawSimple(ModelType model);
 
+/**
+ * Draws all instances staged with instanced_add via the Model-Shader.
+ * Uses one draw call, all instances share the material.
+ *
+ * @param model The model type to draw
+ * @note @param model must be < MODEL_MESH_COUNT
+ * @param mat The material of all instances
+ * @param viewMat The current Model-View-Matrix, instances are placed in its space.
+ */
+void model_drawInstanced(ModelType model, const Material *mat, mat4 *viewMat);
+
+/**
+ * Draws all instances staged with instanced_add via the Simple-Shader.
+ * Uses one draw call, every instance has its own color.
+ * @param model The type of the model to draw.
+ */
+void model_drawSimpleInstanced(ModelType model);
+
+/**
+ * Draws instances whose translation and scale already are in a GPU buffer
+ * via the Model-Shader, e.g. balls stepped by a compute shader.
+ * @param model The model type to draw, must be < MODEL_MESH_COUNT.
+ * @param mat The material of all instances.
+ * @param viewMat The current Model-View-Matrix, instances are placed in its space.
+ * @param buffer Buffer with a vec4 (xyz translation, w scale) at the start of every record.
+ * @param stride Size of one record in bytes.
+ * @param count Number of instances.
+ */
+void model_drawInstancedBuffer(ModelType model, const Material *mat, mat4 *viewMat,
+                               GLuint buffer, GLsizei stride, int count);
+
+/**
+ * Stages a model for the next multi-draw. Staged models of all types
+ * and materials are drawn together.
+ * @param model The model type, must be < MODEL_MESH_COUNT.
+ * @param mat Material for the Model-Shader, NULL for the Simple-Shader.
+ * @param pos Translation of the model.
+ * @param scale Uniform scale of the model.
+ * @param color Color for the Simple-Shader, unused with a material.
+ */
+void model_addMultiDraw(ModelType model, const Material *mat, vec3 pos, float scale, vec3 color);
+
+/**
+ * Draws all models staged with model_addMultiDraw via the Model-Shader
+ * with one glMultiDrawElementsIndirect. All of them need a material.
+ * @param viewMat The current Model-View-Matrix, models are placed in its space.
+ * @param occlusionCull If models hidden behind the Hi-Z pyramid are skipped.
+ */
+void model_drawMultiDraw(mat4 *viewMat, bool occlusionCull);
+
+/**
+ * Draws all models staged with model_addMultiDraw via the Simple-Shader
+ * with one glMultiDrawElementsIndirect, every model has its own color.
+ * @param occlusionCull If models hidden behind the Hi-Z pyramid are skipped.
+ */
+void model_drawSimpleMultiDraw(bool occlusionCull);
+
+/**
+ * Uploads the points of the line strip drawn by model_drawPath.
+ * Only needs to be called when the points change.
+ * @param points The points in drawing order.
+ * @param count Number of points.
+ */
+void model_updatePath(const vec3 *points, int count);
+
+/**
+ * Draws the uploaded line strip via the Simple-Shader in a single call.
+ * The color is set with shader_setColor before.
+ */
+void model_drawPath(void);
+
 /**
  * Draws the Surface via the Model-Shader.
+ * Tessellated drawing evaluates the uploaded patches on the GPU and
+ * falls back to the sampled mesh if unavailable or normals are drawn.
+ * The sampled mesh can be drawn in chunks, each culled against the view
+ * frustum and drawn at a grid stride chosen from its screen-space size.
+ * The sampled mesh can also take height and normal from the heightmap,
+ * a texture baked from the surface vertices once per change.
+ * Instead of the mesh, the heightmap can be ray-marched in a fullscreen
+ * pass that skips empty space with a min/max pyramid and writes the depth
+ * of the hit, at a bounded number of steps per pixel for any grid size.
+ * Normals are drawn as one line buffer, rebuilt by a compute shader
+ * only after the surface or the stride changed.
  * @param drawNormals If the Normals of the surface should be drawn.
+ * @param normalStride Distance between two shown normals in vertices.
+ * @param tessellate If the surface should be tessellated on the GPU.
+ * @param chunkLod If the sampled mesh should be drawn as culled LOD chunks.
+ * @param heightmap If the sampled mesh should fetch height and normal from the heightmap.
+ * @param rayMarch If the heightmap should be ray-marched instead of drawing the mesh.
+ * @param textureTiling Texture repeat factor.
  * @param viewMat The View-Matrix for the Model-Shader.
  * @param modelviewMat The Model-View-Matrix for the Model-Shader.
  */
-void model_drawSurface(bool drawNormals, mat4 *viewMat, mat4 *modelviewMat);
+void model_drawSurface(bool drawNormals, int normalStride, bool tessellate, bool chunkLod, bool heightmap,
+                       bool rayMarch, float textureTiling, mat4 *viewMat, mat4 *modelviewMat);
+
+/**
+ * Bakes the height bands of the surface shading into their lookup texture.
+ * Only needs to be called when the bands change.
+ * @param bands The bands, ascending by height.
+ * @param count Number of bands, at least 2.
+ */
+void model_updateHeightBands(const HeightBand *bands, int count);
+
+/**
+ * Returns the height band lookup texture, see model_updateHeightBands.
+ * @param range Destination for the height of the left texture edge and 1 / the height span.
+ * @return The texture, 0 before the first bake.
+ */
+GLuint model_getHeightBands(vec2 range);
+
+/**
+ * Uploads a rectangle of the baked surface occlusion, the whole grid if
+ * its size changed.
+ * @param ao Occlusion of all grid samples, row-major, 255 is unoccluded.
+ * @param dim Samples per axis.
+ * @param extent x and z of the last grid sample.
+ * @param x First column of the rectangle.
+ * @param y First row of the rectangle.
+ * @param width Columns of the rectangle.
+ * @param height Rows of the rectangle.
+ */
+void model_updateAmbientOcclusion(const uint8_t *ao, int dim, vec2 extent, int x, int y, int width, int height);
+
+/**
+ * Returns the baked occlusion texture of the surface.
+ * @param transform Destination for the scale (xy) and offset (zw) from
+ *                  world x and z to texture coordinates.
+ * @return The texture, 0 before the first upload.
+ */
+GLuint model_getAmbientOcclusion(vec4 transform);
+
+/**
+ * Uploads a rectangle of the baked surface normals, the whole grid if
+ * its size changed.
+ * @param normals x and z of all texels, row-major, 0 is -1 and 255 is 1.
+ * @param dim Texels per axis.
+ * @param extent x and z of the last texel.
+ * @param x First column of the rectangle.
+ * @param y First row of the rectangle.
+ * @param width Columns of the rectangle.
+ * @param height Rows of the rectangle.
+ */
+void model_updateNormalMap(const uint8_t *normals, int dim, vec2 extent, int x, int y, int width, int height);
+
+/**
+ * Returns the baked normal map of the surface.
+ * @param transform Destination for the scale (xy) and offset (zw) from
+ *                  world x and z to texture coordinates.
+ * @return The texture, 0 before the first upload.
+ */
+GLuint model_getNormalMap(vec4 transform);
+
+/**
+ * Returns a number that changes with every upload or generation of the
+ * surface, so caches drawn from the surface know when they are outdated.
+ * @return The revision of the surface.
+ */
+unsigned model_getSurfaceRevision(void);
+
+/**
+ * Binds the heightmap of the sampled surface to the texture units read
+ * by the model and ball physics shaders, rebaked first if the surface changed.
+ * The texture coordinates (0, 0) and (1, 1) are the first and the last grid vertex.
+ * @param extent Destination for x and z of the last grid vertex.
+ * @return False if there is no sampled surface or no bake shader.
+ */
+bool model_bindHeightmap(vec2 extent);
+
+/**
+ * Writes noise heights into the control points with a compute shader.
+ * The grid is uploaded, generated and read back in one synchronous call.
+ * @param controlPoints dim * dim control points, only the heights change.
+ * @param dim The dimension of the control point grid.
+ * @param seed Seed of the noise lattice.
+ * @param noise Octaves, frequency and scale of the noise.
+ * @return False if the shader is not available, the control points are untouched.
+ */
+bool model_generateNoiseHeights(vec3 *controlPoints, int dim, uint32_t seed, const NoiseSettings *noise);
+
+/**
+ * Returns if model_drawSurface draws the tessellated surface with these settings.
+ * The sampled surface mesh is not drawn then and does not need to be up to date.
+ * @param drawNormals If the Normals of the surface should be drawn.
+ * @param tessellate If the surface should be tessellated on the GPU.
+ * @return true if the tessellated surface is drawn.
+ */
+bool model_isSurfaceTessellated(bool drawNormals, bool tessellate);
+
+/**
+ * Uploads polynomial patch coefficients for the tessellated surface.
+ * @param patches The patches to upload.
+ * @param first Index of the first patch to upload.
+ * @param count Number of patches to upload.
+ * @param patchCount Number of patches per axis.
+ * @param stepX Control point spacing in X.
+ * @param stepZ Control point spacing in Z.
+ */
+void model_updateSurfacePatches(const Patch *patches, int first, int count, int patchCount, float stepX, float stepZ);
 
 /**
  * Dynamically updates the surface mesh based on the given main vertices.
- * @param vertices The main vertices of the surface (no indice vertices).
- * @param normals The normals belonging to the vertices.
- * @param texcoords The texture coordinates belonging to the vertices.
+ * Only height and normal are uploaded, packed into 8 bytes per vertex;
+ * x and z must be spaced evenly from the origin to the last vertex.
+ * The upload goes through the upload scheduler into a second buffer, the
+ * old surface is drawn until it arrived. The vertices are read again then,
+ * so they must stay valid until the next surface update.
+ * @param vertices The interleaved vertices of the surface (no indice vertices).
  * @param dim The dimension of the 2D-Surface (#vertices == dim^2).
  */
-void model_updateSurface(vec3 *vertices, vec3 *normals, vec2 *texcoords, int dim);
+void model_updateSurface(const Vertex *vertices, int dim);
+
+/**
+ * Samples the uploaded surface patches into the surface mesh on the GPU,
+ * replacing model_updateSurface without a CPU copy of the vertices.
+ * A second pass reduces the heights per LOD chunk, only those ranges are read back.
+ * @param dim The dimension of the 2D-Surface (#vertices == dim^2).
+ * @param minPoint Output: lowest sample of the surface.
+ * @param maxPoint Output: highest sample of the surface.
+ * @return False if there are no patches or the shaders are missing, nothing changed then.
+ */
+bool model_generateSurface(int dim, vec3 minPoint, vec3 maxPoint);
+
+/**
+ * Uploads a rectangle of surface vertices into the current surface mesh.
+ * The surface dimension must match the last model_updateSurface call.
+ * @param vertices The vertices of the rectangle (width * height, row by row).
+ * @param dim The dimension of the 2D-Surface (#vertices == dim^2).
+ * @param x First column of the rectangle.
+ * @param y First row of the rectangle.
+ * @param width Number of columns of the rectangle.
+ * @param height Number of rows of the rectangle.
+ */
+void model_updateSurfaceRegion(const Vertex *vertices, int dim, int x, int y, int width, int height);
+
+/**
+ * Selects the triangle order of the sampled surface mesh. The cache order
+ * visits the grid in narrow column strips, which lets the post-transform
+ * vertex cache reuse the shared vertex row of two quad rows. Row order is
+ * kept to compare the vertex shader invocations of both.
+ * Changing the order rebuilds the surface and chunk indices.
+ * @param cacheOrder Emit the indices in cache order.
+ */
+void model_setSurfaceCacheOrder(bool cacheOrder);
+
+/**
+ * Selects quadric simplified levels for the chunked surface instead of
+ * strided grids. A level is built per chunk in parallel with borders kept
+ * at full resolution, so chunks need no stitching, and stays cached until
+ * the heights of its chunk change.
+ * @param quadric Draw the quadric levels.
+ */
+void model_setSurfaceQuadricLod(bool quadric);
 
 #endif // MODEL_H
\ No newline at end of file
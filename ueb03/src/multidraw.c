@@ -0,0 +1,347 @@
+/**
+ * @file multidraw.c
+ * @brief Implementation of the multi-draw-indirect submission
+ *
+ * Fetching a per-command material via gl_DrawID would need GL 4.6, so the
+ * objects of a mesh are grouped into one command instead, and baseInstance
+ * points every command at its first object in the instance buffer, which
+ * also holds the material index. The objects keep their submission order
+ * within a mesh, so a front-to-back order survives.
+ *
+ * With occlusion culling, the sorted objects go to a storage buffer instead
+ * and a compute pass writes only the visible ones into the instance buffer,
+ * counting them in the commands. The order within a mesh is lost then.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "multidraw.h"
+#include "instanced.h"
+#include "shader.h"
+#include "hiz.h"
+#include "glstate.h"
+#include "gpumem.h"
+#include "metrics.h"
+
+/** Initial number of staged objects */
+#define START_CAPACITY 64
+
+/** Work group size of occlusionCull.comp */
+#define CULL_GROUP_SIZE 64
+
+/** Storage buffer bindings of occlusionCull.comp */
+#define CULL_BINDING_OBJECTS 0
+#define CULL_BINDING_VISIBLE 1
+#define CULL_BINDING_COMMANDS 2
+
+/**
+ * Layout of glMultiDrawElementsIndirect.
+ */
+typedef struct {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+} DrawElementsIndirectCommand;
+
+/**
+ * Per-instance data, xyz translation and w uniform scale,
+ * padded to a multiple of 16 bytes. Command and radius are only
+ * read by the occlusion cull pass, must match occlusionCull.comp.
+ */
+typedef struct {
+    vec4 offsetScale;
+    vec4 color;
+    GLint material;
+    GLint command;
+    GLfloat radius;     // bounding sphere around the translation
+    GLint pad;
+} MultiDrawInstance;
+
+/**
+ * Range of a mesh in the shared buffers.
+ */
+typedef struct {
+    GLuint firstIndex, numIndices;
+    GLint baseVertex;
+    float radius;       // bounding sphere around the origin at scale 1
+} MeshRange;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Shared buffers, their CPU copies and the staging.
+ */
+static struct {
+    GLuint vao, vbo, ebo, instanceBuffer, commandBuffer;
+    GLuint cullBuffer;      // sorted objects read by the occlusion cull pass
+    int numCommands;        // of the last multidraw_prepare
+
+    Vertex *vertices;
+    GLuint *indices;
+    int numVertices, numIndices;
+    MeshRange meshes[MULTIDRAW_MAX_MESHES];
+    int meshCount;
+
+    MultiDrawInstance *staged, *sorted;
+    int *stagedMesh;
+    int size;
+    int capacity;
+} g_multi = { 0 };
+
+/**
+ * Grows the staging to hold at least count objects.
+ * @param count Required number of objects.
+ */
+static void reserve(int count) {
+    if (count <= g_multi.capacity) {
+        return;
+    }
+
+    int capacity = g_multi.capacity ? g_multi.capacity * 2 : START_CAPACITY;
+    if (capacity < count) capacity = count;
+
+    MultiDrawInstance *staged = realloc(g_multi.staged, capacity * sizeof(MultiDrawInstance));
+    assert(staged && "realloc failed in multidraw reserve");
+    g_multi.staged = staged;
+
+    MultiDrawInstance *sorted = realloc(g_multi.sorted, capacity * sizeof(MultiDrawInstance));
+    assert(sorted && "realloc failed in multidraw reserve");
+    g_multi.sorted = sorted;
+
+    int *stagedMesh = realloc(g_multi.stagedMesh, capacity * sizeof(int));
+    assert(stagedMesh && "realloc failed in multidraw reserve");
+    g_multi.stagedMesh = stagedMesh;
+
+    g_multi.capacity = capacity;
+}
+
+/**
+ * Sets up the vertex array on the shared buffers.
+ */
+static void setupVertexArray(void) {
+    glstate_bindVertexArray(g_multi.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_multi.vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+
+    // Per-instance attributes, the buffer keeps its name when it is re-specified
+    glBindBuffer(GL_ARRAY_BUFFER, g_multi.instanceBuffer);
+    glEnableVertexAttribArray(INSTANCED_LOC_OFFSET_SCALE);
+    glVertexAttribPointer(INSTANCED_LOC_OFFSET_SCALE, 4, GL_FLOAT, GL_FALSE, sizeof(MultiDrawInstance),
+        (void*)offsetof(MultiDrawInstance, offsetScale));
+    glVertexAttribDivisor(INSTANCED_LOC_OFFSET_SCALE, 1);
+    glEnableVertexAttribArray(INSTANCED_LOC_COLOR);
+    glVertexAttribPointer(INSTANCED_LOC_COLOR, 4, GL_FLOAT, GL_FALSE, sizeof(MultiDrawInstance),
+        (void*)offsetof(MultiDrawInstance, color));
+    glVertexAttribDivisor(INSTANCED_LOC_COLOR, 1);
+    glEnableVertexAttribArray(MULTIDRAW_LOC_MATERIAL);
+    glVertexAttribIPointer(MULTIDRAW_LOC_MATERIAL, 1, GL_INT, sizeof(MultiDrawInstance),
+        (void*)offsetof(MultiDrawInstance, material));
+    glVertexAttribDivisor(MULTIDRAW_LOC_MATERIAL, 1);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_multi.ebo);
+    glstate_bindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+ * Uploads the sorted objects and runs the occlusion cull pass on them, which
+ * writes the visible objects to the instance buffer and counts them in the commands.
+ * @param count Number of sorted objects.
+ * @param commands Commands of the sorted objects, their instance counts are reset.
+ * @param numCommands Number of commands.
+ * @return False if there is no pyramid or no cull shader, nothing was uploaded then.
+ */
+static bool cullOccluded(int count, DrawElementsIndirectCommand *commands, int numCommands) {
+    vec2 hizSize;
+    int hizLevels;
+    if (!hiz_bind(hizSize, &hizLevels) || !shader_setOcclusionCull(count, hizSize, hizLevels)) {
+        return false;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_multi.cullBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(MultiDrawInstance), g_multi.sorted, GL_STREAM_DRAW);
+    gpumem_setBuffer(GPUMEM_INSTANCES, g_multi.cullBuffer, count * sizeof(MultiDrawInstance));
+    metrics_count(METRIC_UPLOAD_BYTES, (long) (count * sizeof(MultiDrawInstance)));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Room for all objects, the pass writes the visible ones behind baseInstance
+    glBindBuffer(GL_ARRAY_BUFFER, g_multi.instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(MultiDrawInstance), NULL, GL_STREAM_DRAW);
+    gpumem_setBuffer(GPUMEM_INSTANCES, g_multi.instanceBuffer, count * sizeof(MultiDrawInstance));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    for (int c = 0; c < numCommands; ++c) {
+        commands[c].instanceCount = 0;
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_multi.commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, numCommands * sizeof(DrawElementsIndirectCommand), commands, GL_STREAM_DRAW);
+    gpumem_setBuffer(GPUMEM_INSTANCES, g_multi.commandBuffer, numCommands * sizeof(DrawElementsIndirectCommand));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_OBJECTS, g_multi.cullBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_VISIBLE, g_multi.instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BINDING_COMMANDS, g_multi.commandBuffer);
+    glDispatchCompute((count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    return true;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void multidraw_init(void) {
+    glGenVertexArrays(1, &g_multi.vao);
+    glGenBuffers(1, &g_multi.vbo);
+    glGenBuffers(1, &g_multi.ebo);
+    glGenBuffers(1, &g_multi.instanceBuffer);
+    glGenBuffers(1, &g_multi.commandBuffer);
+    glGenBuffers(1, &g_multi.cullBuffer);
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_multi.instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, START_CAPACITY * sizeof(MultiDrawInstance), NULL, GL_STREAM_DRAW);
+    gpumem_setBuffer(GPUMEM_INSTANCES, g_multi.instanceBuffer, START_CAPACITY * sizeof(MultiDrawInstance));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    setupVertexArray();
+    reserve(START_CAPACITY);
+}
+
+void multidraw_cleanup(void) {
+    gpumem_deleteBuffers(1, &g_multi.vbo);
+    gpumem_deleteBuffers(1, &g_multi.ebo);
+    gpumem_deleteBuffers(1, &g_multi.instanceBuffer);
+    gpumem_deleteBuffers(1, &g_multi.commandBuffer);
+    gpumem_deleteBuffers(1, &g_multi.cullBuffer);
+    glDeleteVertexArrays(1, &g_multi.vao);
+    free(g_multi.vertices);
+    free(g_multi.indices);
+    free(g_multi.staged);
+    free(g_multi.sorted);
+    free(g_multi.stagedMesh);
+    memset(&g_multi, 0, sizeof(g_multi));
+}
+
+int multidraw_addMesh(const Vertex *vertices, int numVerts, const GLuint *indices, int numInd) {
+    assert(g_multi.meshCount < MULTIDRAW_MAX_MESHES && "too many meshes for the multi-draw buffers");
+
+    Vertex *v = realloc(g_multi.vertices, (g_multi.numVertices + numVerts) * sizeof(Vertex));
+    assert(v && "realloc failed in multidraw_addMesh");
+    GLuint *i = realloc(g_multi.indices, (g_multi.numIndices + numInd) * sizeof(GLuint));
+    assert(i && "realloc failed in multidraw_addMesh");
+    memcpy(v + g_multi.numVertices, vertices, numVerts * sizeof(Vertex));
+    memcpy(i + g_multi.numIndices, indices, numInd * sizeof(GLuint));
+    g_multi.vertices = v;
+    g_multi.indices = i;
+
+    float radius2 = 0.0f;
+    for (int k = 0; k < numVerts; ++k) {
+        radius2 = glm_max(radius2, glm_vec3_norm2((float*) vertices[k].position));
+    }
+
+    // Indices stay relative to the mesh, baseVertex offsets them
+    int id = g_multi.meshCount++;
+    g_multi.meshes[id] = (MeshRange) { g_multi.numIndices, numInd, g_multi.numVertices, sqrtf(radius2) };
+    g_multi.numVertices += numVerts;
+    g_multi.numIndices += numInd;
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_multi.vbo);
+    glBufferData(GL_ARRAY_BUFFER, g_multi.numVertices * sizeof(Vertex), g_multi.vertices, GL_STATIC_DRAW);
+    gpumem_setBuffer(GPUMEM_GEOMETRY, g_multi.vbo, g_multi.numVertices * sizeof(Vertex));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glstate_bindVertexArray(g_multi.vao);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_multi.numIndices * sizeof(GLuint), g_multi.indices, GL_STATIC_DRAW);
+    gpumem_setBuffer(GPUMEM_GEOMETRY, g_multi.ebo, g_multi.numIndices * sizeof(GLuint));
+    glstate_bindVertexArray(0);
+    return id;
+}
+
+void multidraw_add(int mesh, vec3 pos, float scale, vec3 color, int material) {
+    assert(mesh >= 0 && mesh < g_multi.meshCount && "unknown multi-draw mesh");
+    reserve(g_multi.size + 1);
+
+    MultiDrawInstance *inst = &g_multi.staged[g_multi.size];
+    glm_vec4(pos, scale, inst->offsetScale);
+    glm_vec4(color, 1.0f, inst->color);
+    inst->material = material;
+    inst->radius = g_multi.meshes[mesh].radius * scale;
+    g_multi.stagedMesh[g_multi.size++] = mesh;
+}
+
+void multidraw_prepare(bool occlusionCull) {
+    int count = g_multi.size;
+    g_multi.size = 0;
+    g_multi.numCommands = 0;
+    if (count == 0) {
+        return;
+    }
+
+    // Counting sort by mesh, every mesh becomes one command
+    int first[MULTIDRAW_MAX_MESHES + 1] = { 0 };
+    for (int i = 0; i < count; ++i) {
+        ++first[g_multi.stagedMesh[i] + 1];
+    }
+    for (int m = 0; m < g_multi.meshCount; ++m) {
+        first[m + 1] += first[m];
+    }
+
+    DrawElementsIndirectCommand commands[MULTIDRAW_MAX_MESHES];
+    int numCommands = 0;
+    for (int m = 0; m < g_multi.meshCount; ++m) {
+        int instances = first[m + 1] - first[m];
+        if (instances > 0) {
+            const MeshRange *r = &g_multi.meshes[m];
+            commands[numCommands++] = (DrawElementsIndirectCommand) {
+                r->numIndices, (GLuint) instances, r->firstIndex, r->baseVertex, (GLuint) first[m]
+            };
+        }
+    }
+
+    // Command of every mesh, for the cull pass
+    int commandOf[MULTIDRAW_MAX_MESHES];
+    for (int c = 0, m = 0; m < g_multi.meshCount; ++m) {
+        commandOf[m] = first[m + 1] > first[m] ? c++ : -1;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        int mesh = g_multi.stagedMesh[i];
+        MultiDrawInstance *inst = &g_multi.sorted[first[mesh]++];
+        *inst = g_multi.staged[i];
+        inst->command = commandOf[mesh];
+    }
+    g_multi.numCommands = numCommands;
+
+    if (occlusionCull && cullOccluded(count, commands, numCommands)) {
+        return;
+    }
+
+    // Orphan the previous contents instead of waiting for draws still reading them
+    glBindBuffer(GL_ARRAY_BUFFER, g_multi.instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(MultiDrawInstance), g_multi.sorted, GL_STREAM_DRAW);
+    gpumem_setBuffer(GPUMEM_INSTANCES, g_multi.instanceBuffer, count * sizeof(MultiDrawInstance));
+    metrics_count(METRIC_UPLOAD_BYTES, (long) (count * sizeof(MultiDrawInstance)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_multi.commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, numCommands * sizeof(DrawElementsIndirectCommand), commands, GL_STREAM_DRAW);
+    gpumem_setBuffer(GPUMEM_INSTANCES, g_multi.commandBuffer, numCommands * sizeof(DrawElementsIndirectCommand));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void multidraw_draw(void) {
+    if (g_multi.numCommands == 0) {
+        return;
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_multi.commandBuffer);
+    glstate_bindVertexArray(g_multi.vao);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*) 0, g_multi.numCommands, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,77 @@
+/**
+ * @file multidraw.h
+ * @brief Multi-draw-indirect submission of many objects of several meshes
+ *
+ * All registered meshes share one vertex and one index buffer. Objects
+ * are staged with multidraw_add, and multidraw_draw writes one
+ * DrawElementsIndirectCommand per mesh and submits all of them with a
+ * single glMultiDrawElementsIndirect. Every object carries its translation,
+ * uniform scale, color and material index as instance attributes, so the
+ * objects of one submission may differ in mesh and material.
+ * Optionally, a compute pass drops the objects hidden behind the depth
+ * drawn so far (see hiz.h) before they reach the indirect commands.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef MULTIDRAW_H
+#define MULTIDRAW_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Attribute location of the per-instance material index in model.vert */
+#define MULTIDRAW_LOC_MATERIAL 5
+
+/** Most meshes in the shared buffers */
+#define MULTIDRAW_MAX_MESHES 8
+
+/**
+ * Creates the shared vertex array and the instance and command buffers.
+ * Must be called before the first multidraw_addMesh.
+ */
+void multidraw_init(void);
+
+/**
+ * Frees the buffers and the staged objects.
+ */
+void multidraw_cleanup(void);
+
+/**
+ * Appends an indexed triangle mesh to the shared buffers.
+ * Only meant for startup, every call re-specifies the buffers.
+ * @param vertices Array of vertex data.
+ * @param numVerts Number of vertices.
+ * @param indices Array of indices.
+ * @param numInd Number of indices.
+ * @return Id of the mesh for multidraw_add.
+ */
+int multidraw_addMesh(const Vertex *vertices, int numVerts, const GLuint *indices, int numInd);
+
+/**
+ * Stages one object for the next multidraw_draw.
+ * @param mesh Id returned by multidraw_addMesh.
+ * @param pos Translation of the object.
+ * @param scale Uniform scale of the object.
+ * @param color Color of the object (used by the simple shader).
+ * @param material Index into the material buffer (used by the model shader).
+ */
+void multidraw_add(int mesh, vec3 pos, float scale, vec3 color, int material);
+
+/**
+ * Uploads the staged objects and their commands for multidraw_draw.
+ * The staging is empty afterwards.
+ * Occlusion culling tests the bounding sphere of every object against the
+ * Hi-Z pyramid, only the visible objects are drawn. It is skipped if the
+ * pyramid is not valid. Binds a compute program.
+ * @param occlusionCull If hidden objects should be culled.
+ */
+void multidraw_prepare(bool occlusionCull);
+
+/**
+ * Draws the objects of the last multidraw_prepare with one
+ * glMultiDrawElementsIndirect.
+ * The program must be set up for instanced drawing.
+ */
+void multidraw_draw(void);
+
+#endif // MULTIDRAW_H
@@ -0,0 +1,149 @@
+/**
+ * @file normalbake.c
+ * @brief Implementation of the baked surface normals
+ *
+ * A texel row has a single local s per patch row, so the patch is
+ * contracted with the s basis once per patch it crosses and every texel
+ * only needs the dot products of utils_evalPatchRowAt.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "normalbake.h"
+#include "utils.h"
+#include "jobs.h"
+#include "alloctrack.h"
+#include "timeline.h"
+
+#define NORMALBAKE_ROWS_PER_CHUNK 16
+
+/**
+ * Input of the parallel bake.
+ */
+typedef struct {
+    NormalBake *bake;
+    Patch *patches;
+    int firstRow;
+    int firstCol, lastCol;
+} BakeJob;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Finds the patch and local parameter of a texel along one axis.
+ * @param texel Texel index.
+ * @param size Texels per axis.
+ * @param patchCount Patches per axis.
+ * @param local Output: local parameter in the patch.
+ * @return Patch index.
+ */
+static int locateTexel(int texel, int size, int patchCount, float *local) {
+    float global = (float) texel * patchCount / (size - 1);
+    int patch = glm_imin((int) global, patchCount - 1);
+    *local = global - patch;
+    return patch;
+}
+
+/**
+ * Finds the texels evaluated from a range of patches along one axis,
+ * grown by one texel since the borders are shared with the neighbors.
+ * @param lo First patch.
+ * @param hi Last patch (inclusive).
+ * @param size Texels per axis.
+ * @param patchCount Patches per axis.
+ * @param first Output: first texel.
+ * @param last Output: last texel (inclusive).
+ */
+static void patchTexelRange(int lo, int hi, int size, int patchCount, int *first, int *last) {
+    float texelsPerPatch = (float) (size - 1) / patchCount;
+    *first = glm_imax((int) floorf(lo * texelsPerPatch) - 1, 0);
+    *last = glm_imin((int) ceilf((hi + 1) * texelsPerPatch) + 1, size - 1);
+}
+
+/**
+ * Bakes the normals of a chunk of rows.
+ * @param begin First row relative to the first rebaked row.
+ * @param end One past the last row.
+ * @param chunk Unused.
+ * @param userData The BakeJob.
+ */
+static void bakeRowsJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    const BakeJob *job = userData;
+    NormalBake *bake = job->bake;
+    int size = bake->size;
+    int patchCount = bake->patchCount;
+
+    for (int i = job->firstRow + begin; i < job->firstRow + end; ++i) {
+        float localS;
+        int patchS = locateTexel(i, size, patchCount, &localS);
+        PatchBasis basisS;
+        utils_patchBasis(localS, &basisS);
+
+        int current = -1;
+        vec4 row, rowDs;
+        uint8_t *dest = &bake->normals[2 * (i * size + job->firstCol)];
+
+        for (int j = job->firstCol; j <= job->lastCol; ++j) {
+            float localT;
+            int patchT = locateTexel(j, size, patchCount, &localT);
+            if (patchT != current) {
+                utils_evalPatchRow(&job->patches[patchS * patchCount + patchT], &basisS, row, rowDs);
+                current = patchT;
+            }
+
+            PatchBasis basisT;
+            utils_patchBasis(localT, &basisT);
+            PatchEvalResult res = utils_evalPatchRowAt(row, rowDs, &basisT);
+
+            vec3 normal;
+            utils_getNormal(res.dsd, res.dtd, bake->stepX, bake->stepZ, normal);
+            *dest++ = (uint8_t) (normal[0] * 127.5f + 128.0f);
+            *dest++ = (uint8_t) (normal[2] * 127.5f + 128.0f);
+        }
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void normalbake_resize(NormalBake *bake, int patchCount, float stepX, float stepZ, float extentX, float extentZ) {
+    assert(patchCount >= 1 && "no patches in normalbake_resize");
+    int size = patchCount * NORMALBAKE_TEXELS_PER_PATCH + 1;
+    size = glm_imax(glm_imin(size, NORMALBAKE_MAX_SIZE), NORMALBAKE_MIN_SIZE);
+
+    int count = size * size;
+    if (count > bake->capacity) {
+        uint8_t *normals = TRACKED_REALLOC(bake->normals, count * 2 * sizeof(uint8_t));
+        assert(normals && "realloc failed in normalbake_resize");
+        bake->normals = normals;
+        bake->capacity = count;
+    }
+    bake->size = size;
+    bake->patchCount = patchCount;
+    bake->stepX = stepX;
+    bake->stepZ = stepZ;
+    bake->extent[0] = extentX;
+    bake->extent[1] = extentZ;
+}
+
+void normalbake_free(NormalBake *bake) {
+    TRACKED_FREE(bake->normals);
+    *bake = (NormalBake) {0};
+}
+
+void normalbake_update(NormalBake *bake, Patch *patches, int loS, int hiS, int loT, int hiT, int rebaked[4]) {
+    TIMELINE_BEGIN("Bake Normals");
+    int firstRow, lastRow;
+    BakeJob job = { .bake = bake, .patches = patches };
+    patchTexelRange(loS, hiS, bake->size, bake->patchCount, &firstRow, &lastRow);
+    patchTexelRange(loT, hiT, bake->size, bake->patchCount, &job.firstCol, &job.lastCol);
+    job.firstRow = firstRow;
+
+    jobs_parallelFor(lastRow - firstRow + 1, NORMALBAKE_ROWS_PER_CHUNK, bakeRowsJob, &job);
+
+    rebaked[0] = job.firstCol;
+    rebaked[1] = firstRow;
+    rebaked[2] = job.lastCol - job.firstCol + 1;
+    rebaked[3] = lastRow - firstRow + 1;
+    TIMELINE_END();
+}
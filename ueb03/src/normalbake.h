@@ -0,0 +1,75 @@
+/**
+ * @file normalbake.h
+ * @brief Normal map of the surface baked from its patches
+ *
+ * The analytic normals of the patches are evaluated on a grid that is
+ * independent of the mesh resolution, with NORMALBAKE_TEXELS_PER_PATCH
+ * texels per patch and axis. Sampled per pixel they light a coarse mesh
+ * like a fine one, so the resolution only has to follow the silhouette.
+ * Rows are baked in parallel on the job pool.
+ *
+ * The normals of a heightfield point up, only their x and z are stored,
+ * y follows from the unit length.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef NORMALBAKE_H
+#define NORMALBAKE_H
+
+#include <fhwcg/fhwcg.h>
+#include "logic.h"
+
+/** Texels per patch and axis */
+#define NORMALBAKE_TEXELS_PER_PATCH 16
+
+/** Texels per axis of surfaces with few patches */
+#define NORMALBAKE_MIN_SIZE 64
+
+/** Texels per axis of surfaces with many patches */
+#define NORMALBAKE_MAX_SIZE 2048
+
+/**
+ * Normal grid, row-major with the rows along z like the surface vertices.
+ */
+typedef struct {
+    uint8_t *normals;   // x and z per texel, 0 is -1 and 255 is 1
+    int capacity;
+    int size;           // texels per axis, 0 while nothing is baked
+    int patchCount;
+    float stepX, stepZ; // evaluation steps of the surface, see utils_getNormal
+    vec2 extent;        // x and z of the last texel, the first one is at the origin
+} NormalBake;
+
+/**
+ * Resizes the grid for a surface of patchCount×patchCount patches.
+ * Keeps the contents if the size did not change, otherwise they are
+ * undefined until the whole grid was updated.
+ * @param bake Bake to resize.
+ * @param patchCount Patches per axis, at least 1.
+ * @param stepX Evaluation step in x.
+ * @param stepZ Evaluation step in z.
+ * @param extentX x of the last texel column.
+ * @param extentZ z of the last texel row.
+ */
+void normalbake_resize(NormalBake *bake, int patchCount, float stepX, float stepZ, float extentX, float extentZ);
+
+/**
+ * Frees the grid.
+ * @param bake Bake to free.
+ */
+void normalbake_free(NormalBake *bake);
+
+/**
+ * Rebakes the texels evaluated from a rectangle of patches.
+ * @param bake Bake, resized to the surface.
+ * @param patches All patches of the surface, row-major.
+ * @param loS First patch row.
+ * @param hiS Last patch row (inclusive).
+ * @param loT First patch column.
+ * @param hiT Last patch column (inclusive).
+ * @param rebaked Output: x, y, width and height of the rebaked texels.
+ */
+void normalbake_update(NormalBake *bake, Patch *patches, int loS, int hiS, int loT, int hiT, int rebaked[4]);
+
+#endif // NORMALBAKE_H
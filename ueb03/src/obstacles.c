@@ -0,0 +1,239 @@
+/**
+ * @file obstacles.c
+ * @brief Implementation of the obstacle placement, generation and import
+ *
+ * The maze is a depth-first search over the cells with an explicit stack,
+ * the walls it did not break through become the obstacles. Walls are
+ * stretched by their thickness, so they close the corners between them.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "obstacles.h"
+#include "logic.h"
+#include "utils.h"
+#include "alloctrack.h"
+
+/** Half extents of random obstacles, the short and the long side */
+#define RANDOM_SHORT_SIDE 0.05f
+#define RANDOM_LONG_SIDE 0.2f
+
+/** Wall thickness as share of a maze cell */
+#define MAZE_WALL_THICKNESS 0.15f
+
+/** Smallest side of a loaded obstacle */
+#define MIN_SIDE 0.005f
+
+/** Longest line of an obstacle file */
+#define LINE_LENGTH 256
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Returns the world space extent of the surface along x (t) and z (s).
+ *
+ * @param extentX Output: x extent
+ * @param extentZ Output: z extent
+ */
+static void surfaceExtent(float *extentX, float *extentZ) {
+    vec3 p0 = {0}, p1 = {0}, normal;
+    logic_evalSplineGlobal(0.0f, 0.0f, p0, normal);
+    logic_evalSplineGlobal(1.0f, 1.0f, p1, normal);
+
+    // Not evaluated while the surface is rebuilt, the maze then spans a unit square
+    *extentX = fabsf(p1[0] - p0[0]) > 1e-4f ? fabsf(p1[0] - p0[0]) : 1.0f;
+    *extentZ = fabsf(p1[2] - p0[2]) > 1e-4f ? fabsf(p1[2] - p0[2]) : 1.0f;
+}
+
+/**
+ * Appends an obstacle standing on the surface at global params.
+ *
+ * @param data Input data
+ * @param gT Global t-param
+ * @param gS Global s-param
+ * @param length Half extent along x
+ * @param width Half extent along z
+ */
+static void addObstacle(InputData *data, float gT, float gS, float length, float width) {
+    Obstacle o = {
+        .gT = gT,
+        .gS = gS,
+        .length = length,
+        .width = width,
+        .height = OBSTACLE_HEIGHT
+    };
+    ObstacleArr_push(&data->game.obstacles, o);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void obstacles_randomize(InputData *data, int count) {
+    count = CLAMP(count, 0, OBSTACLES_MAX);
+    ObstacleArr_clear(&data->game.obstacles);
+    ObstacleArr_reserve(&data->game.obstacles, (size_t) count);
+
+    for (int i = 0; i < count; ++i) {
+        bool isParallel = 3 * i >= 2 * count;
+        float length = isParallel ? RANDOM_SHORT_SIDE : RANDOM_LONG_SIDE;
+        float width = isParallel ? RANDOM_LONG_SIDE : RANDOM_SHORT_SIDE;
+        float gS = RAND01;
+        float gT = RAND01;
+        addObstacle(data, gT, gS, length, width);
+    }
+    obstacles_place(data);
+}
+
+void obstacles_generateMaze(InputData *data, int cells) {
+    int n = CLAMP(cells, 2, OBSTACLES_MAZE_MAX_CELLS);
+    int cellCount = n * n;
+
+    // openX[x * n + z]: passage between (x, z) and (x + 1, z), openZ[x * n + z] between (x, z) and (x, z + 1)
+    bool *visited = TRACKED_MALLOC(cellCount * sizeof(bool));
+    bool *openX = TRACKED_MALLOC(cellCount * sizeof(bool));
+    bool *openZ = TRACKED_MALLOC(cellCount * sizeof(bool));
+    int *stack = TRACKED_MALLOC(cellCount * sizeof(int));
+    assert(visited && openX && openZ && stack && "malloc failed in obstacles_generateMaze");
+    memset(visited, 0, cellCount * sizeof(bool));
+    memset(openX, 0, cellCount * sizeof(bool));
+    memset(openZ, 0, cellCount * sizeof(bool));
+
+    int top = 0;
+    stack[top++] = 0;
+    visited[0] = true;
+    while (top > 0) {
+        int c = stack[top - 1];
+        int x = c / n;
+        int z = c % n;
+
+        int next[4];
+        int nextCount = 0;
+        if (x > 0 && !visited[c - n]) next[nextCount++] = c - n;
+        if (x < n - 1 && !visited[c + n]) next[nextCount++] = c + n;
+        if (z > 0 && !visited[c - 1]) next[nextCount++] = c - 1;
+        if (z < n - 1 && !visited[c + 1]) next[nextCount++] = c + 1;
+        if (nextCount == 0) {
+            --top;
+            continue;
+        }
+
+        int k = glm_imin((int) (RAND01 * nextCount), nextCount - 1);
+        int m = next[k];
+        if (m == c - n) openX[m] = true;
+        else if (m == c + n) openX[c] = true;
+        else if (m == c - 1) openZ[m] = true;
+        else openZ[c] = true;
+
+        visited[m] = true;
+        stack[top++] = m;
+    }
+
+    float extentX, extentZ;
+    surfaceExtent(&extentX, &extentZ);
+    float cellX = extentX / n;
+    float cellZ = extentZ / n;
+    float halfThickness = 0.5f * MAZE_WALL_THICKNESS * fminf(cellX, cellZ);
+
+    ObstacleArr_clear(&data->game.obstacles);
+    ObstacleArr_reserve(&data->game.obstacles, (size_t) (n - 1) * (n - 1));
+    for (int x = 0; x < n; ++x) {
+        for (int z = 0; z < n; ++z) {
+            int c = x * n + z;
+            if (x < n - 1 && !openX[c]) {
+                addObstacle(data, (x + 1.0f) / n, (z + 0.5f) / n, halfThickness, 0.5f * cellZ + halfThickness);
+            }
+            if (z < n - 1 && !openZ[c]) {
+                addObstacle(data, (x + 0.5f) / n, (z + 1.0f) / n, 0.5f * cellX + halfThickness, halfThickness);
+            }
+        }
+    }
+
+    TRACKED_FREE(visited);
+    TRACKED_FREE(openX);
+    TRACKED_FREE(openZ);
+    TRACKED_FREE(stack);
+    obstacles_place(data);
+}
+
+void obstacles_regenerate(InputData *data) {
+    switch (data->game.layout) {
+        case OL_MAZE:
+            obstacles_generateMaze(data, data->game.mazeCells);
+            break;
+        case OL_FILE:
+            obstacles_place(data);
+            break;
+        default:
+            obstacles_randomize(data, data->game.randomCount);
+            break;
+    }
+}
+
+void obstacles_place(InputData *data) {
+    ObstacleArr *obstacles = &data->game.obstacles;
+    for (size_t i = 0; i < obstacles->size; ++i) {
+        Obstacle *o = &obstacles->data[i];
+        logic_evalSplineGlobal(o->gT, o->gS, o->center, o->normal);
+    }
+    data->game.selectedIdx = glm_imin(data->game.selectedIdx, glm_imax((int) obstacles->size - 1, 0));
+    data->game.obstaclesChanged = true;
+}
+
+bool obstacles_save(const char *path, const InputData *data) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        printf("Could not create %s!\n", path);
+        return false;
+    }
+
+    fprintf(file, "# s t width length height\n");
+    const ObstacleArr *obstacles = &data->game.obstacles;
+    for (size_t i = 0; i < obstacles->size; ++i) {
+        const Obstacle *o = &obstacles->data[i];
+        fprintf(file, "%.6f %.6f %.6f %.6f %.6f\n", o->gS, o->gT, o->width, o->length, o->height);
+    }
+
+    bool ok = !ferror(file);
+    fclose(file);
+    if (!ok) {
+        printf("Could not write %s!\n", path);
+    }
+    return ok;
+}
+
+bool obstacles_load(const char *path, InputData *data) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("Could not open %s!\n", path);
+        return false;
+    }
+
+    ObstacleArr loaded;
+    ObstacleArr_init(&loaded);
+
+    char line[LINE_LENGTH];
+    while (fgets(line, sizeof(line), file) && loaded.size < OBSTACLES_MAX) {
+        Obstacle o = { .height = OBSTACLE_HEIGHT };
+        if (line[0] == '#' || sscanf(line, "%f %f %f %f %f", &o.gS, &o.gT, &o.width, &o.length, &o.height) < 4) {
+            continue;
+        }
+        o.gS = CLAMP(o.gS, 0.0f, 1.0f);
+        o.gT = CLAMP(o.gT, 0.0f, 1.0f);
+        o.width = fmaxf(o.width, MIN_SIDE);
+        o.length = fmaxf(o.length, MIN_SIDE);
+        o.height = fmaxf(o.height, MIN_SIDE);
+        ObstacleArr_push(&loaded, o);
+    }
+    fclose(file);
+
+    if (loaded.size == 0) {
+        printf("No obstacles in %s!\n", path);
+        ObstacleArr_free(&loaded);
+        return false;
+    }
+
+    ObstacleArr_free(&data->game.obstacles);
+    data->game.obstacles = loaded;
+    data->game.layout = OL_FILE;
+    obstacles_place(data);
+    return true;
+}
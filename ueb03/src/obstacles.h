@@ -0,0 +1,85 @@
+/**
+ * @file obstacles.h
+ * @brief Placement, generation and import of the obstacles
+ *
+ * Obstacles are boxes standing on the surface at global params (gS, gT),
+ * their count is only limited by OBSTACLES_MAX. Every function that adds,
+ * removes or moves obstacles places them on the surface and marks them
+ * changed, so the physics rebuilds its obstacle grid once before the next
+ * step. Call with the physics locked.
+ *
+ * Obstacle files are text, one obstacle per line as "s t width length height"
+ * with the sizes as half extents, lines starting with '#' are comments.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef OBSTACLES_H
+#define OBSTACLES_H
+
+#include "input.h"
+
+/** File written and read by the GUI */
+#define OBSTACLES_FILE "obstacles.txt"
+
+/** Most obstacles generated or loaded at once */
+#define OBSTACLES_MAX 16384
+
+/** Largest maze, cells per axis */
+#define OBSTACLES_MAZE_MAX_CELLS 96
+
+/**
+ * Replaces the obstacles by count randomly placed ones. Two thirds are
+ * long across the surface's x axis, the rest along it.
+ *
+ * @param data Input data
+ * @param count Number of obstacles
+ */
+void obstacles_randomize(InputData *data, int count);
+
+/**
+ * Replaces the obstacles by the inner walls of a random maze of
+ * cells² cells spanning the surface. Every cell can be reached from
+ * every other, a maze of n² cells has (n - 1)² walls.
+ *
+ * @param data Input data
+ * @param cells Cells per axis
+ */
+void obstacles_generateMaze(InputData *data, int cells);
+
+/**
+ * Lays the obstacles out anew as selected by game.layout: new random
+ * boxes, a new maze or the loaded ones placed again.
+ *
+ * @param data Input data
+ */
+void obstacles_regenerate(InputData *data);
+
+/**
+ * Places all obstacles on the surface at their global params.
+ *
+ * @param data Input data
+ */
+void obstacles_place(InputData *data);
+
+/**
+ * Writes the obstacles to a text file.
+ *
+ * @param path File to write
+ * @param data Input data
+ * @return false if the file can't be written
+ */
+bool obstacles_save(const char *path, const InputData *data);
+
+/**
+ * Replaces the obstacles by the ones of a text file and switches the
+ * layout to OL_FILE. Params are clamped to the surface, sizes to a small
+ * minimum. The obstacles stay unchanged if the file can't be read.
+ *
+ * @param path File to read
+ * @param data Input data
+ * @return false if the file can't be read or holds no obstacle
+ */
+bool obstacles_load(const char *path, InputData *data);
+
+#endif // OBSTACLES_H
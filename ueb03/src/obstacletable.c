@@ -0,0 +1,210 @@
+/**
+ * @file obstacletable.c
+ * @brief Implementation of the packed obstacle bounds and their kernels
+ *
+ * The kernels broadcast the sphere center, clamp it into 4 or 8 bounds per
+ * iteration and compare the squared distances against the squared radius.
+ * Lanes that hit are written out from the compare mask, the exact distance
+ * and normal are left to the caller. The scalar kernel is the reference.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "obstacletable.h"
+#include "evaluate.h"
+#include "alloctrack.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define OBSTACLETABLE_X86 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #define TARGET_AVX
+    #else
+        #define TARGET_AVX __attribute__((target("avx")))
+    #endif
+#endif
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Grows the table to hold at least count slots.
+ * @param t Table.
+ * @param count Required number of slots.
+ */
+static void reserve(ObstacleTable *t, int count) {
+    if (t->capacity >= count) {
+        return;
+    }
+
+    int newCap = t->capacity ? t->capacity * 2 : 16;
+    if (newCap < count) newCap = count;
+
+    // One block for all six bound arrays
+    float *bounds = TRACKED_REALLOC(t->minX, 6 * newCap * sizeof(float));
+    assert(bounds && "realloc failed in obstacletable reserve");
+    int *obstacle = TRACKED_REALLOC(t->obstacle, newCap * sizeof(int));
+    assert(obstacle && "realloc failed in obstacletable reserve");
+
+    t->minX = bounds;
+    t->minY = bounds + newCap;
+    t->minZ = bounds + 2 * newCap;
+    t->maxX = bounds + 3 * newCap;
+    t->maxY = bounds + 4 * newCap;
+    t->maxZ = bounds + 5 * newCap;
+    t->obstacle = obstacle;
+    t->capacity = newCap;
+}
+
+/**
+ * Squared distance of a point to the bounds of a slot.
+ * @param t Table.
+ * @param slot Slot of the obstacle.
+ * @param p Point.
+ * @return Squared distance, 0 inside the bounds.
+ */
+static inline float distance2(const ObstacleTable *t, int slot, const vec3 p) {
+    vec3 closest, diff;
+    obstacletable_closestPoint(t, slot, p, closest);
+    glm_vec3_sub((float*) p, closest, diff);
+    return glm_vec3_norm2(diff);
+}
+
+/**
+ * Reference kernel, one slot at a time.
+ * @param t Table.
+ * @param begin First slot.
+ * @param end One past the last slot.
+ * @param center Sphere center.
+ * @param radius2 Squared sphere radius.
+ * @param dest Output slots.
+ * @return Number of slots written.
+ */
+static int contactsScalar(const ObstacleTable *t, int begin, int end, const vec3 center, float radius2, int *dest) {
+    int n = 0;
+    for (int i = begin; i < end; ++i) {
+        if (distance2(t, i, center) < radius2) {
+            dest[n++] = i;
+        }
+    }
+    return n;
+}
+
+#ifdef OBSTACLETABLE_X86
+
+/**
+ * SSE kernel, 4 slots per iteration.
+ */
+static int contactsSse(const ObstacleTable *t, int begin, int end, const vec3 center, float radius2, int *dest) {
+    const __m128 cx = _mm_set1_ps(center[0]);
+    const __m128 cy = _mm_set1_ps(center[1]);
+    const __m128 cz = _mm_set1_ps(center[2]);
+    const __m128 r2 = _mm_set1_ps(radius2);
+
+    int n = 0;
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 dx = _mm_sub_ps(cx, _mm_max_ps(_mm_min_ps(cx, _mm_loadu_ps(t->maxX + i)), _mm_loadu_ps(t->minX + i)));
+        __m128 dy = _mm_sub_ps(cy, _mm_max_ps(_mm_min_ps(cy, _mm_loadu_ps(t->maxY + i)), _mm_loadu_ps(t->minY + i)));
+        __m128 dz = _mm_sub_ps(cz, _mm_max_ps(_mm_min_ps(cz, _mm_loadu_ps(t->maxZ + i)), _mm_loadu_ps(t->minZ + i)));
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+        int mask = _mm_movemask_ps(_mm_cmplt_ps(d2, r2));
+        for (int lane = 0; mask != 0; ++lane, mask >>= 1) {
+            if (mask & 1) {
+                dest[n++] = i + lane;
+            }
+        }
+    }
+
+    return n + contactsScalar(t, i, end, center, radius2, dest + n);
+}
+
+/**
+ * AVX kernel, 8 slots per iteration, see contactsSse.
+ */
+TARGET_AVX static int contactsAvx(const ObstacleTable *t, int begin, int end, const vec3 center, float radius2,
+    int *dest) {
+    const __m256 cx = _mm256_set1_ps(center[0]);
+    const __m256 cy = _mm256_set1_ps(center[1]);
+    const __m256 cz = _mm256_set1_ps(center[2]);
+    const __m256 r2 = _mm256_set1_ps(radius2);
+
+    int n = 0;
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 dx = _mm256_sub_ps(cx, _mm256_max_ps(_mm256_min_ps(cx, _mm256_loadu_ps(t->maxX + i)),
+            _mm256_loadu_ps(t->minX + i)));
+        __m256 dy = _mm256_sub_ps(cy, _mm256_max_ps(_mm256_min_ps(cy, _mm256_loadu_ps(t->maxY + i)),
+            _mm256_loadu_ps(t->minY + i)));
+        __m256 dz = _mm256_sub_ps(cz, _mm256_max_ps(_mm256_min_ps(cz, _mm256_loadu_ps(t->maxZ + i)),
+            _mm256_loadu_ps(t->minZ + i)));
+        __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LT_OQ));
+        for (int lane = 0; mask != 0; ++lane, mask >>= 1) {
+            if (mask & 1) {
+                dest[n++] = i + lane;
+            }
+        }
+    }
+
+    return n + contactsSse(t, i, end, center, radius2, dest + n);
+}
+
+#endif // OBSTACLETABLE_X86
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void obstacletable_build(ObstacleTable *t, const Obstacle *obstacles, const int *order, int count) {
+    reserve(t, count);
+
+    for (int i = 0; i < count; ++i) {
+        const Obstacle *o = &obstacles[order[i]];
+        t->minX[i] = o->center[0] - o->length;
+        t->maxX[i] = o->center[0] + o->length;
+        t->minY[i] = o->center[1] - o->height;
+        t->maxY[i] = o->center[1] + o->height;
+        t->minZ[i] = o->center[2] - o->width;
+        t->maxZ[i] = o->center[2] + o->width;
+        t->obstacle[i] = order[i];
+    }
+    t->count = count;
+}
+
+int obstacletable_findContacts(SimdKernel kernel, const ObstacleTable *t, int begin, int end,
+    const vec3 center, float radius, int *dest) {
+    assert(begin >= 0 && end <= t->count && "slot range outside of the obstacle table");
+
+    if (!evaluate_isSupported(kernel)) {
+        kernel = SK_SCALAR;
+    }
+
+    float radius2 = radius * radius;
+    switch (kernel) {
+#ifdef OBSTACLETABLE_X86
+        case SK_AVX:
+            // Ranges without a full batch skip the 256 bit state entirely
+            if (end - begin >= 8) {
+                return contactsAvx(t, begin, end, center, radius2, dest);
+            }
+            return contactsSse(t, begin, end, center, radius2, dest);
+        case SK_SSE:
+            return contactsSse(t, begin, end, center, radius2, dest);
+#endif
+        case SK_SCALAR:
+        default:
+            return contactsScalar(t, begin, end, center, radius2, dest);
+    }
+}
+
+void obstacletable_closestPoint(const ObstacleTable *t, int slot, const vec3 p, vec3 dest) {
+    dest[0] = glm_clamp(p[0], t->minX[slot], t->maxX[slot]);
+    dest[1] = glm_clamp(p[1], t->minY[slot], t->maxY[slot]);
+    dest[2] = glm_clamp(p[2], t->minZ[slot], t->maxZ[slot]);
+}
+
+void obstacletable_free(ObstacleTable *t) {
+    TRACKED_FREE(t->minX);
+    TRACKED_FREE(t->obstacle);
+    memset(t, 0, sizeof(*t));
+}
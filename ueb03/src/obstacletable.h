@@ -0,0 +1,70 @@
+/**
+ * @file obstacletable.h
+ * @brief Packed obstacle bounds and SIMD kernels for the ball-obstacle tests
+ *
+ * The table is derived from the Obstacle structs whenever they change and
+ * only holds the world space bounds per axis, one array each. Its slots
+ * follow the sorted order of the obstacle grid, so the cells of one grid row
+ * are a contiguous slot range that a kernel tests 4 (SSE) or 8 (AVX) at a time.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef OBSTACLETABLE_H
+#define OBSTACLETABLE_H
+
+#include <fhwcg/fhwcg.h>
+#include "input.h"
+
+/**
+ * Axis-aligned bounds of the obstacles, structure of arrays.
+ */
+typedef struct {
+    float *minX, *minY, *minZ;
+    float *maxX, *maxY, *maxZ;
+    int *obstacle;      // obstacle index per slot
+    int count;
+    int capacity;
+} ObstacleTable;
+
+/**
+ * Rebuilds the table from the obstacles.
+ * @param t Table to rebuild.
+ * @param obstacles Obstacle array.
+ * @param order Obstacle index per slot, e.g. the sortedIdx of a grid.
+ * @param count Number of slots.
+ */
+void obstacletable_build(ObstacleTable *t, const Obstacle *obstacles, const int *order, int count);
+
+/**
+ * Finds the obstacles of a slot range that a sphere penetrates.
+ * The squared distance to the closest point rejects all others before any sqrt.
+ * Unsupported kernels fall back to SK_SCALAR.
+ * @param kernel Kernel to use.
+ * @param t Table.
+ * @param begin First slot.
+ * @param end One past the last slot.
+ * @param center Sphere center.
+ * @param radius Sphere radius.
+ * @param dest Output with room for end - begin slots.
+ * @return Number of slots written to dest, in ascending order.
+ */
+int obstacletable_findContacts(SimdKernel kernel, const ObstacleTable *t, int begin, int end,
+    const vec3 center, float radius, int *dest);
+
+/**
+ * Returns the closest point of a slot's bounds to a point.
+ * @param t Table.
+ * @param slot Slot of the obstacle.
+ * @param p Point.
+ * @param dest Destination for the closest point.
+ */
+void obstacletable_closestPoint(const ObstacleTable *t, int slot, const vec3 p, vec3 dest);
+
+/**
+ * Frees all table memory.
+ * @param t Table to free.
+ */
+void obstacletable_free(ObstacleTable *t);
+
+#endif // OBSTACLETABLE_H
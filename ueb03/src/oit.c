@@ -0,0 +1,157 @@
+/**
+ * @file oit.c
+ * @brief Implementation of the weighted blended transparency
+ *
+ * The targets are transient textures of the frame graph, which grow to the
+ * largest viewport seen and are drawn to from the lower left corner, so the
+ * dynamic resolution does not reallocate them. The depth copy needs a depth
+ * format equal to the scene's, which is checked on the first pass. If it
+ * fails the pass reports itself unavailable and the caller falls back to
+ * sorting.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "oit.h"
+#include "shader.h"
+#include "glstate.h"
+#include "gpumem.h"
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Targets of the accumulation pass.
+ */
+static struct {
+    GLuint fbo, accum, revealage, depth;
+    GLuint vao;             // empty, the composite triangle comes from gl_VertexID
+    bool checked;           // the framebuffer was complete once
+    bool verified;          // the depth copy worked once
+    bool unsupported;
+
+    GLint sceneFbo;         // framebuffer bound at oit_begin
+    int drawWidth, drawHeight;
+} g_oit = { 0 };
+
+/**
+ * Attaches the targets to the framebuffer of the pass. The completeness
+ * only depends on the formats, it is checked once.
+ * @return False if the framebuffer is not complete.
+ */
+static bool attachTargets(void) {
+    if (!g_oit.fbo) {
+        glGenFramebuffers(1, &g_oit.fbo);
+        glGenVertexArrays(1, &g_oit.vao);
+    }
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g_oit.fbo);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, g_oit.accum, 0);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, g_oit.revealage, 0);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, g_oit.depth, 0);
+    GLenum status = GL_FRAMEBUFFER_COMPLETE;
+    if (!g_oit.checked) {
+        GLenum buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, buffers);
+        status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+        g_oit.checked = true;
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g_oit.sceneFbo);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Transparency targets incomplete (0x%x), sorting instead\n", status);
+        g_oit.unsupported = true;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Copies the scene depth into the pass, checks the copy on the first use.
+ * @return False if the depth formats do not match.
+ */
+static bool copyDepth(void) {
+    if (!g_oit.verified) {
+        while (glGetError() != GL_NO_ERROR) {}
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, g_oit.sceneFbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g_oit.fbo);
+    glBlitFramebuffer(0, 0, g_oit.drawWidth, g_oit.drawHeight, 0, 0, g_oit.drawWidth, g_oit.drawHeight,
+                      GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    if (!g_oit.verified) {
+        if (glGetError() != GL_NO_ERROR) {
+            printf("Scene depth cannot be copied, sorting transparency instead\n");
+            glBindFramebuffer(GL_FRAMEBUFFER, g_oit.sceneFbo);
+            g_oit.unsupported = true;
+            return false;
+        }
+        g_oit.verified = true;
+    }
+    return true;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void oit_cleanup(void) {
+    glDeleteFramebuffers(1, &g_oit.fbo);
+    glstate_forgetVertexArray();
+    glDeleteVertexArrays(1, &g_oit.vao);
+    memset(&g_oit, 0, sizeof(g_oit));
+}
+
+bool oit_isSupported(void) {
+    return !g_oit.unsupported;
+}
+
+bool oit_begin(GLuint accum, GLuint revealage, GLuint depth) {
+    if (g_oit.unsupported || !accum || !revealage || !depth) {
+        return false;
+    }
+    g_oit.accum = accum;
+    g_oit.revealage = revealage;
+    g_oit.depth = depth;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &g_oit.sceneFbo);
+    g_oit.drawWidth = viewport[2];
+    g_oit.drawHeight = viewport[3];
+
+    if (!attachTargets() || !copyDepth()) {
+        return false;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, g_oit.fbo);
+    static const GLfloat zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    static const GLfloat one[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 1, one);
+
+    // Sum of weighted colors, product of transmissions
+    glstate_setEnabled(GL_BLEND, true);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+    glstate_setEnabled(GL_DEPTH_TEST, true);
+    glstate_depthMask(false);
+
+    shader_setOit(true);
+    return true;
+}
+
+void oit_end(void) {
+    shader_setOit(false);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_oit.sceneFbo);
+    glstate_depthMask(true);
+
+    // Average color over the scene by the total coverage
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if (shader_setOitComposite(g_oit.accum, g_oit.revealage)) {
+        glstate_setEnabled(GL_DEPTH_TEST, false);
+        glstate_polygonMode(GL_FILL);
+        glstate_bindVertexArray(g_oit.vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glstate_setEnabled(GL_DEPTH_TEST, true);
+    }
+    glstate_setEnabled(GL_BLEND, false);
+}
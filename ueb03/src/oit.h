@@ -0,0 +1,53 @@
+/**
+ * @file oit.h
+ * @brief Weighted blended order-independent transparency
+ *
+ * Transparent items are drawn unsorted into two targets: the accumulation
+ * target sums the premultiplied colors and alphas scaled by a depth weight,
+ * the revealage target multiplies the remaining transmission. The composite
+ * pass divides the sums and blends the average over the opaque scene by the
+ * total coverage. The weight only approximates the order, which is fine for
+ * the few, mostly uniformly tinted layers of the scene.
+ *
+ * The opaque depth is copied into the pass, transparent fragments behind
+ * opaque geometry are rejected without writing depth.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef OIT_H
+#define OIT_H
+
+#include <fhwcg/fhwcg.h>
+
+/**
+ * Deletes the framebuffer of the pass.
+ */
+void oit_cleanup(void);
+
+/**
+ * Returns if the pass can run, false after the targets or the depth copy
+ * failed once.
+ * @return true if oit_begin may succeed.
+ */
+bool oit_isSupported(void);
+
+/**
+ * Starts the accumulation pass for the current framebuffer and viewport:
+ * copies the depth, clears the targets and sets up blending. Items drawn
+ * with the Model-Shader until oit_end go to the targets.
+ * All targets have at least the viewport size.
+ * @param accum Accumulation target, GL_RGBA16F.
+ * @param revealage Revealage target, GL_R8.
+ * @param depth Depth target, GL_DEPTH24_STENCIL8 like the scene.
+ * @return False if the pass cannot run, nothing was changed then.
+ */
+bool oit_begin(GLuint accum, GLuint revealage, GLuint depth);
+
+/**
+ * Ends the accumulation pass and composites the result over the
+ * framebuffer that was bound at oit_begin.
+ */
+void oit_end(void);
+
+#endif // OIT_H
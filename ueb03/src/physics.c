@@ -1,6 +1,6 @@
 /**
  * @file physics.c
- * @brief Physics with Euler-Integration, walls, ball collisions (penalty method), black holes and goal
+ * @brief Physics with Euler-Integration, walls, ball collisions (penalty method or XPBD), black holes and goal
  *
  * @authors Nikolaos Tsetsas, Noah Schmidt
  */
@@ -10,8 +10,19 @@
 #include "input.h"
 #include "logic.h"
 #include "model.h"
-
-#define RAND01 ((float)rand() / RAND_MAX)
+#include "grid.h"
+#include "obstacletable.h"
+#include "obstacles.h"
+#include "renderqueue.h"
+#include "trace.h"
+#include "thread.h"
+#include "jobs.h"
+#include "fastmath.h"
+#include "ballcompute.h"
+#include "alloctrack.h"
+#include "timeline.h"
+#include "perfcount.h"
+#include "metrics.h"
 
 #define WALL_CNT 4
 #define DEFAULT_BALL_NUM 10
@@ -21,6 +32,42 @@
 #define DEFAULT_BLACKHOLE_COUNT 5
 #define GOAL_RADIUS 0.3f
 
+/** Trace file written by RM_RECORD and read by RM_REPLAY */
+#define TRACE_FILE "balls.trace"
+
+/** Snapshots of the threaded mode: one written, one shared, one read */
+#define SNAPSHOT_COUNT 3
+
+/** Set in the shared snapshot index until the main thread took it */
+#define SNAPSHOT_FRESH 4L
+
+/** Sleep of the simulation thread when no step is due */
+#define SIM_SLEEP_MS 1
+
+/** Fewer balls are solved on the calling thread */
+#define PARALLEL_MIN_BALLS 256
+
+/** Minimum balls per chunk of a parallel pass */
+#define BALLS_PER_CHUNK 64
+
+/** Balls moving less than this share of their radius per substep are not swept */
+#define SWEEP_MIN_DISTANCE 0.5f
+
+/** Distance a swept ball stops before the time of impact */
+#define SWEEP_SKIN 1e-4f
+
+/** Share of the radius two bodies may be apart and still count as an XPBD contact */
+#define XPBD_SLOP 0.02f
+
+/** Over-relaxation of the averaged Jacobi corrections */
+#define XPBD_JACOBI_RELAXATION 1.5f
+
+/** Minimum contacts per chunk of a parallel Jacobi pass */
+#define CONTACTS_PER_CHUNK 256
+
+/** Obstacle table slots tested per narrow phase call, bounds the stack hit buffers */
+#define OBSTACLE_SLOTS_PER_CHUNK 64
+
 /**
  * Macro to init ball with defaults
  *
@@ -66,21 +113,258 @@ typedef struct {
  */
 typedef struct {
     vec3 center;
+    vec3 prevCenter;
     vec3 acceleration;
     vec3 velocity;
     ContactInfo contact;
-    bool active;
+    int restSteps;  // consecutive steps below the sleep velocity
+    int level;  // takes 2^level substeps per fixed step
+    float stiffness;  // stiffest contact spring since the level was chosen
+    bool sleeping;  // skipped by forces, integration and the broad phase
+    bool active;  // cleared on capture, removed by compactBalls
 } Ball;
 
+/**
+ * Per-ball state of the multi-stage integrators at the start of a step.
+ */
+typedef struct {
+    vec3 center;
+    vec3 velocity;
+    vec3 acceleration;
+    vec3 kx, kv;            // derivatives of the last stage
+    vec3 sumX, sumV;        // weighted sum of the stage derivatives
+} StageState;
+
 DEFINE_ARRAY_TYPE(Ball, BallArr);
 DEFINE_ARRAY_TYPE(BlackHole, BlackHoleArr);
+DEFINE_ARRAY_BASE(StageState, StageStateArr);
+
+/**
+ * Touching pair whose impulse is applied after the parallel force pass
+ */
+typedef struct {
+    int i1, i2;
+} BallPair;
+
+DEFINE_ARRAY_TYPE(BallPair, BallPairArr);
+
+/**
+ * Game state besides the balls stored with every traced step.
+ * The balls themselves are traced as Ball records.
+ */
+typedef struct {
+    int32_t capturedBalls;
+    uint32_t goalReached;
+} TraceGlobals;
+
+/**
+ * Balls after a fixed step published by the simulation thread.
+ */
+typedef struct {
+    BallArr balls;
+    double time;        // wall-clock time of the step
+} Snapshot;
 
-/** Global array of all balls in simulation */
+/** Global array of all live balls in simulation, captured balls are swap-removed */
 static BallArr g_balls;
 
+/** Number of balls captured by black holes since the last respawn */
+static int g_capturedBalls = 0;
+
+/** Trace mode that is currently running */
+static ReplayMode g_activeReplayMode = RM_OFF;
+
+/** Next step shown by RM_REPLAY */
+static int g_replayFrame = 0;
+
 /** Global array of all black holes */
 static BlackHoleArr g_blackHoles;
 
+/**
+ * Threaded mode: the fixed steps run on their own thread and hand
+ * snapshots of the balls to the main thread through a lock-free triple buffer.
+ * The mutex keeps surface and GUI edits of the main thread off the state
+ * during a step, see physics_lock.
+ */
+static struct {
+    bool running;
+    volatile long stop;
+    Thread thread;
+    Mutex mutex;
+
+    Snapshot snapshots[SNAPSHOT_COUNT];
+    volatile long shared;   // snapshot index, SNAPSHOT_FRESH if not taken yet
+    int back;               // written by the simulation thread
+    int front;              // read by the main thread
+} g_sim = { 0 };
+
+/** Stage states of IG_VERLET and IG_RK4, reused across steps */
+static StageStateArr g_stages = { 0 };
+
+/**
+ * Per-chunk buffers of the parallel ball-ball solve. Chunk c owns
+ * accel[c * ballCount, (c + 1) * ballCount) and contacts[c].
+ */
+static struct {
+    vec3 *accel;
+    size_t capacity;
+    int chunks;
+    int ballCount;
+    BallPairArr contacts[JOBS_MAX_THREADS];
+} g_pairSolve = {0};
+
+/**
+ * Parameters of a pass over all balls
+ */
+typedef struct {
+    const SimParams *params;
+    Obstacle *obstacles;
+    bool impulses;
+    bool parallel;
+} BallPass;
+
+/**
+ * Stable dt of an undamped spring is factor / omega, omega = sqrt(k / m).
+ * Explicit Euler gains energy on every step.
+ */
+static const float g_stabilityFactor[IG_COUNT] = {
+    [IG_EULER] = 0.0f,
+    [IG_SYMPLECTIC] = 2.0f,
+    [IG_VERLET] = 2.0f,
+    [IG_RK4] = 2.785f
+};
+
+/**
+ * Multi-rate stepping: a ball of level l takes 2^l substeps of
+ * fixedDt / 2^l. The fixed step is split into 2^maxLevel substeps and a
+ * ball steps on every 2^(maxLevel - l)-th of them, so all levels meet at
+ * the end of the fixed step. Between its substeps a ball keeps its state
+ * and only serves as contact partner.
+ */
+static struct {
+    int maxLevel;       // 0 without multi-rate stepping
+    int substep;        // substep in [0, 2^maxLevel)
+    int topLevel;       // highest level of an awake ball
+    int ballSubsteps;   // ball integrations of the running fixed step
+    int lastSubsteps;   // ball integrations of the last fixed step
+} g_multiRate = {0};
+
+/**
+ * Broad phase for ball-ball collisions, rebuilt every step
+ * over the x/z positions of all awake balls
+ */
+static struct {
+    Grid grid;
+    vec2 *points;
+    int *ballIdx;       // ball of every grid point
+    int count;
+    int capacity;
+} g_ballGrid = {0};
+
+/**
+ * Broad phase over the x/z centers of static entries (obstacles or black holes).
+ * Only rebuilt when entries are added, moved or randomized or when
+ * their reach changes, the cell size is the largest reach of an entry.
+ */
+typedef struct {
+    Grid grid;
+    vec2 *points;
+    int capacity;
+    float reach;
+    bool dirty;
+} StaticGrid;
+
+/** Broad phase for ball-obstacle collisions */
+static StaticGrid g_obstacleGrid = { .dirty = true };
+
+/** Obstacle bounds in the slot order of g_obstacleGrid */
+static ObstacleTable g_obstacleTable = {0};
+
+/** Largest x/z diagonal of an obstacle, only recomputed when obstacles change */
+static float g_obstacleExtent = 0.0f;
+
+/** Broad phase for black hole attraction */
+static StaticGrid g_blackHoleGrid = { .dirty = true };
+
+/**
+ * Scratch arrays for projecting all moved contact points
+ * onto the surface in one batched call
+ */
+static struct {
+    int *ballIdx;
+    vec3 *points;
+    vec3 *normals;
+    float *s, *t;
+    int capacity;
+} g_contactBatch = {0};
+
+/** Contact points of all balls before the integration of a substep, for the sweeps and the XPBD velocities */
+static Vec3Arr g_sweepStart = {0};
+
+/**
+ * Kind of an XPBD contact.
+ */
+typedef enum {
+    XC_WALL,
+    XC_OBSTACLE,
+    XC_BALL
+} XpbdContactKind;
+
+/**
+ * Non-penetration constraint of the XPBD solve, C >= 0.
+ * Ball i2 moves along the normal, ball i1 against it.
+ */
+typedef struct {
+    XpbdContactKind kind;
+    int i1;             // first ball of a ball pair, -1 for walls and obstacles
+    int i2;
+    int index;          // wall or obstacle table slot
+    float damping;      // restitution of the velocity pass
+    float lambda;       // accumulated multiplier of the step, >= 0
+    float dLambda;      // multiplier change of the last Jacobi iteration
+    vec3 normal;        // constraint gradient of ball i2 at the last evaluation
+} XpbdContact;
+
+DEFINE_ARRAY_TYPE(XpbdContact, XpbdContactArr);
+
+/**
+ * Contacts of the XPBD solve, found once per substep at the predicted
+ * centers. Chunk c of the parallel search collects into chunkContacts[c].
+ * The Jacobi solve gathers the corrections of a ball through first and
+ * adjacency, the contact indices of ball i are adjacency[first[i], first[i + 1]).
+ */
+static struct {
+    XpbdContactArr contacts;
+    XpbdContactArr chunkContacts[JOBS_MAX_THREADS];
+    Vec3Arr velocity;   // predicted velocities, for the restitution
+    int *first;
+    int *adjacency;
+    int ballCapacity;
+    int adjacencyCapacity;
+    float compliance;   // compliance over dt^2
+} g_xpbd = {0};
+
+/**
+ * GPU mode: while active the balls live in the buffers of ballcompute.c
+ * and g_balls is stale. The balls are read back whenever the CPU needs
+ * them, e.g. to add one or after switching back to the CPU solve.
+ */
+static struct {
+    bool active;
+    int count;          // uploaded balls, captured ones included
+    int captured;       // captured since the upload, from the event readback
+    GpuBall *staging;
+    int capacity;
+} g_gpuBalls = {0};
+
+/**
+ * Accumulated time of every step phase, taken by the benchmark
+ */
+static struct {
+    double seconds[PP_COUNT];
+    int steps;
+} g_phaseTimes = {0};
+
 /**
  * Wall boundaries defining play area.
  * Four walls prevent balls from rolling off the surface
@@ -136,6 +420,32 @@ static const Material GOAL_MAT = {
 
 ////////////////////////    LOCAL    ////////////////////////////
 
+/**
+ * Adds the time since start to a phase.
+ *
+ * @param phase Phase that ran since start
+ * @param start Timestamp the phase started at
+ * @return Current timestamp, start of the next phase
+ */
+static double endPhase(PhysicsPhase phase, double start) {
+    double now = glfwGetTime();
+    g_phaseTimes.seconds[phase] += now - start;
+    return now;
+}
+
+/**
+ * Sums the time of all force phases.
+ *
+ * @return Seconds spent in force evaluation
+ */
+static double forcePhaseSeconds(void) {
+    double sum = 0.0;
+    for (int p = PP_EXTERN; p <= PP_BLACK_HOLE; ++p) {
+        sum += g_phaseTimes.seconds[p];
+    }
+    return sum;
+}
+
 /**
  * Init four walls placed at the edges of the surface to prevent balls from falling off.
  *
@@ -179,6 +489,7 @@ static void initWalls(void) {
  */
 static void initBlackHoles(void) {
     BlackHoleArr_clear(&g_blackHoles);
+    g_blackHoleGrid.dirty = true;
 
     for (int i = 0; i < DEFAULT_BLACKHOLE_COUNT; i++) {
         BlackHole bh;
@@ -237,6 +548,17 @@ static void applyContactPoint(Ball *b, float radius) {
     glm_vec3_add(b->contact.point, center, b->center);
 }
 
+/**
+ * Adds a newly placed ball.
+ * It starts at rest for interpolation, so it does not blend in from the origin.
+ *
+ * @param b Ball to add
+ */
+static void spawnBall(Ball *b) {
+    glm_vec3_copy(b->center, b->prevCenter);
+    BallArr_push(&g_balls, *b);
+}
+
 /**
  * Applies penalty force on ball when collision with wall
  *
@@ -246,10 +568,11 @@ static void applyContactPoint(Ball *b, float radius) {
  * @param penetration Penetration depth (must be > 0)
  * @param springConst Spring value
  * @param wallDamping Velocity damping factor [0,1]
+ * @param impulses Also reflect the velocity, off for extra force evaluations
  */
 static void applyWallPenalty(
     Ball *b, Wall *w, float ballMass, float penetration,
-    float springConst, float wallDamping
+    float springConst, float wallDamping, bool impulses
 ) {
     assert(b != NULL && w != NULL);
     assert(penetration > 0.0f);
@@ -267,7 +590,7 @@ static void applyWallPenalty(
 
     // Reflect velocity if moving into wall
     float velDotNormal = glm_vec3_dot(b->velocity, w->normal);
-    if (velDotNormal < 0.0f) {
+    if (impulses && velDotNormal < 0.0f) {
         vec3 reflected;
         glm_vec3_reflect(b->velocity, w->normal, reflected);
         glm_vec3_scale(reflected, wallDamping, b->velocity);
@@ -278,21 +601,22 @@ static void applyWallPenalty(
  * Checks and handles wall collisions for a ball.
  * Tests penetration against all four boundary walls
  *
- * @param data Input data containing physics
+ * @param params Parameters of the step
  * @param b Ball to check
+ * @param impulses Also change velocities, off for extra force evaluations
  */
-static void handleWallCollision(InputData *data, Ball *b) {
+static void handleWallCollision(const SimParams *params, Ball *b, bool impulses) {
     assert(b != NULL);
     assert(g_walls.initialized);
 
-    if (!data->physics.wall.enabled) {
+    if (!params->wall.enabled) {
         return;
     }
 
-    float springConst = data->physics.wall.spring;
-    float ballRadius = data->physics.ballRadius;
-    float ballMass = data->physics.mass;
-    float wallDamping = data->physics.wall.damping;
+    float springConst = params->wall.spring;
+    float ballRadius = params->ballRadius;
+    float ballMass = params->mass;
+    float wallDamping = params->wall.damping;
 
     for (int i = 0; i < WALL_CNT; i++) {
         Wall *wall = &g_walls.walls[i];
@@ -302,13 +626,39 @@ static void handleWallCollision(InputData *data, Ball *b) {
         float penetrationDepth = ballRadius - signedDist;
 
         if (penetrationDepth > 0.0f) {
-            applyWallPenalty(b, wall, ballMass, penetrationDepth, springConst, wallDamping);
+            applyWallPenalty(b, wall, ballMass, penetrationDepth, springConst, wallDamping, impulses);
+            b->stiffness = fmaxf(b->stiffness, springConst);
         }
     }
 }
 
+/**
+ * Reflects the approach velocity of two touching balls.
+ *
+ * @param b1 First ball
+ * @param b2 Second ball
+ * @param normal Unit vector from b1 to b2
+ * @param ballDamping Damping coefficient [0,1]
+ */
+static void applyBallImpulse(Ball *b1, Ball *b2, vec3 normal, float ballDamping) {
+    vec3 relativeVelocity;
+    glm_vec3_sub(b1->velocity, b2->velocity, relativeVelocity);
+    float velocityAlongNormal = glm_vec3_dot(relativeVelocity, normal);
+    if (velocityAlongNormal > 0.0f) {
+        // Balls are separating, apply impulse
+        float impulseScale = (1.0f + ballDamping) * velocityAlongNormal * 0.5f;
+        vec3 impulse;
+        glm_vec3_scale(normal, impulseScale, impulse);
+
+        glm_vec3_sub(b1->velocity, impulse, b1->velocity);
+        glm_vec3_add(b2->velocity, impulse, b2->velocity);
+    }
+}
+
 /**
  * Applies penalty force when two balls collide.
+ * The accelerations to change are either the ones of the balls
+ * or the chunk buffers of the parallel solve.
  *
  * @param b1 First ball
  * @param b2 Second ball
@@ -317,10 +667,14 @@ static void handleWallCollision(InputData *data, Ball *b) {
  * @param springConst Spring constant k
  * @param mass Ball mass
  * @param ballDamping Damping coefficient [0,1]
+ * @param impulses Also apply the separation impulse, off for extra force evaluations
+ * @param acc1 Acceleration of b1 to change
+ * @param acc2 Acceleration of b2 to change
  */
 static void applyBallPenalty(
     Ball *b1, Ball *b2, float penetration, vec3 b1ToB2,
-    float springConst, float mass, float ballDamping
+    float springConst, float mass, float ballDamping, bool impulses,
+    vec3 acc1, vec3 acc2
 ) {
     assert(b1 != NULL && b2 != NULL);
     assert(penetration > 0.0f);
@@ -336,211 +690,589 @@ static void applyBallPenalty(
     glm_vec3_scale(normal, counterForce, penaltyForce);
     glm_vec3_scale(penaltyForce, 1.0f / mass, penaltyAccel);
 
-    glm_vec3_sub(b1->acceleration, penaltyAccel, b1->acceleration);
-    glm_vec3_add(b2->acceleration, penaltyAccel, b2->acceleration);
+    glm_vec3_sub(acc1, penaltyAccel, acc1);
+    glm_vec3_add(acc2, penaltyAccel, acc2);
+    if (impulses) {
+        applyBallImpulse(b1, b2, normal, ballDamping);
+    }
+}
 
-    // Velocity impulse for separation
-    vec3 relativeVelocity;
-    glm_vec3_sub(b1->velocity, b2->velocity, relativeVelocity);
-    float velocityAlongNormal = glm_vec3_dot(relativeVelocity, normal);
-    if (velocityAlongNormal > 0.0f) {
-        // Balls are separating, apply impulse
-        float impulseScale = (1.0f + ballDamping) * velocityAlongNormal * 0.5f;
-        vec3 impulse;
-        glm_vec3_scale(normal, impulseScale, impulse);
+/**
+ * Rebuilds the ball broad-phase grid from the current centers of the awake balls.
+ * Cells are one ball diameter wide, so touching balls are always
+ * in the same or a neighbouring cell.
+ *
+ * @param params Parameters of the step
+ */
+static void buildBallGrid(const SimParams *params) {
+    if (g_ballGrid.capacity < g_balls.size) {
+        int newCap = g_ballGrid.capacity ? g_ballGrid.capacity * 2 : 64;
+        if (newCap < g_balls.size) newCap = g_balls.size;
+
+        vec2 *points = TRACKED_REALLOC(g_ballGrid.points, newCap * sizeof(vec2));
+        int *ballIdx = TRACKED_REALLOC(g_ballGrid.ballIdx, newCap * sizeof(int));
+        assert(points && ballIdx && "realloc failed in buildBallGrid");
+        g_ballGrid.points = points;
+        g_ballGrid.ballIdx = ballIdx;
+        g_ballGrid.capacity = newCap;
+    }
 
-        glm_vec3_sub(b1->velocity, impulse, b1->velocity);
-        glm_vec3_add(b2->velocity, impulse, b2->velocity);
+    int count = 0;
+    for (int i = 0; i < g_balls.size; ++i) {
+        if (g_balls.data[i].sleeping) {
+            continue;
+        }
+        g_ballGrid.points[count][0] = g_balls.data[i].center[0];
+        g_ballGrid.points[count][1] = g_balls.data[i].center[2];
+        g_ballGrid.ballIdx[count] = i;
+        ++count;
     }
+    g_ballGrid.count = count;
+
+    grid_build(&g_ballGrid.grid, g_ballGrid.points, count, 2.0f * params->ballRadius);
 }
 
 /**
- * Checks and handles collisions between a ball and all other balls.
- * Only checks balls with index > i1 to avoid duplicate pair checks.
+ * Wakes a ball, it takes part in the next step again.
  *
- * @param data Input data containing physics
- * @param b1 Ball to check
- * @param i1 Index of b1 in array
+ * @param b Ball to wake
  */
-static void handleBallCollisions(InputData *data, Ball *b1, int i1) {
-    assert(b1 != NULL);
+static void wakeBall(Ball *b) {
+    b->sleeping = false;
+    b->restSteps = 0;
+}
 
-    if (!data->physics.ball.enabled) {
-        return;
+/**
+ * Wakes every sleeping ball.
+ */
+static void wakeAllBalls(void) {
+    for (int i = 0; i < g_balls.size; ++i) {
+        wakeBall(&g_balls.data[i]);
     }
+}
 
-    float radius = data->physics.ballRadius;
-    float springConst = data->physics.ball.spring;
-    float ballDamping = data->physics.ball.damping;
-    float mass = data->physics.mass;
+/**
+ * Wakes the sleeping balls touched by an awake ball of the ball grid.
+ *
+ * @param params Parameters of the step
+ * @return Number of balls woken
+ */
+static int wakeTouchedBalls(const SimParams *params) {
+    float diameter = 2.0f * params->ballRadius;
+    const Grid *grid = &g_ballGrid.grid;
+    int woken = 0;
 
-    for (int i2 = i1 + 1; i2 < g_balls.size; ++i2) {
-        Ball *b2 = &g_balls.data[i2];
+    for (int i = 0; i < g_balls.size; ++i) {
+        Ball *b = &g_balls.data[i];
+        if (!b->sleeping) {
+            continue;
+        }
+
+        int cell[2];
+        grid_cellCoords(grid, (vec2) { b->center[0], b->center[2] }, cell);
 
-        if (!b2->active) continue;
+        for (int y = cell[1] - 1; y <= cell[1] + 1 && b->sleeping; ++y) {
+            if (y < 0 || y >= grid->dimY) continue;
 
-        vec3 b1ToB2;
-        glm_vec3_sub(b2->center, b1->center, b1ToB2);
+            for (int x = cell[0] - 1; x <= cell[0] + 1 && b->sleeping; ++x) {
+                if (x < 0 || x >= grid->dimX) continue;
 
-        float dist = glm_vec3_norm(b1ToB2);
-        float diameter = 2.0f * radius;
-        float penetrationDepth = diameter - dist;
+                int begin, end;
+                grid_cellRange(grid, x, y, &begin, &end);
 
-        if (penetrationDepth > 0.0f && dist > 0.0001f) {
-            applyBallPenalty(
-                b1, b2, penetrationDepth,
-                b1ToB2, springConst, mass, ballDamping
-            );
+                for (int slot = begin; slot < end; ++slot) {
+                    Ball *other = &g_balls.data[g_ballGrid.ballIdx[grid->sortedIdx[slot]]];
+                    if (glm_vec3_distance2(b->center, other->center) < diameter * diameter) {
+                        wakeBall(b);
+                        ++woken;
+                        break;
+                    }
+                }
+            }
         }
     }
+    return woken;
 }
 
 /**
- * Applies penalty force when ball collides with an obstacle
+ * Counts the steps every awake ball stays below the sleep velocity
+ * and puts it to sleep after enough of them.
  *
- * @param b Ball in collision
- * @param o Obstacle (bounding box)
- * @param dist Distance from ball to closest point
- * @param diff Vector from closest point to ball center
- * @param springConst Spring constant
- * @param penetration Penetration depth
- * @param ballMass Ball mass
- * @param obstacleDamping Damping coefficient
+ * @param params Parameters of the step
  */
-static void applyObstaclePenalty(
-    Ball *b, Obstacle *o, float dist, vec3 diff, float springConst,
-    float penetration, float ballMass, float obstacleDamping
-) {
-    assert(b != NULL && o != NULL);
-
-    vec3 normal;
-    utils_getAABBNormal(o, b->center, dist, diff, normal);
-
-    // Spring force: F = k * d
-    float counterforce = springConst * penetration;
+static void updateSleep(const SimParams *params) {
+    if (!params->sleep.enabled) {
+        return;
+    }
 
-    vec3 penaltyForce, additionalAcceleration;
-    glm_vec3_scale(normal, counterforce, penaltyForce);
-    glm_vec3_scale(penaltyForce, 1.0f / ballMass, additionalAcceleration);
+    float threshold2 = params->sleep.velocity * params->sleep.velocity;
+    for (int i = 0; i < g_balls.size; ++i) {
+        Ball *b = &g_balls.data[i];
+        if (b->sleeping) {
+            continue;
+        }
 
-    glm_vec3_add(additionalAcceleration, b->acceleration, b->acceleration);
+        if (glm_vec3_norm2(b->velocity) >= threshold2) {
+            b->restSteps = 0;
+            continue;
+        }
 
-    // Reflect velocity if moving into obstacle
-    float velDotNormal = glm_vec3_dot(b->velocity, normal);
-    if (velDotNormal < 0.0f) {
-        vec3 reflected;
-        glm_vec3_reflect(b->velocity, normal, reflected);
-        glm_vec3_scale(reflected, obstacleDamping, b->velocity);
+        if (++b->restSteps >= params->sleep.steps) {
+            b->sleeping = true;
+            glm_vec3_zero(b->velocity);
+            glm_vec3_zero(b->acceleration);
+        }
     }
 }
 
 /**
- * Checks and handles collisions between ball and all obstacles.
- * Each obstacle is an axis-aligned bounding box on the surface.
+ * Checks whether a ball takes part in the current substep.
  *
- * @param data Input data containing physics and obstacle data
  * @param b Ball to check
+ * @return True if the ball is awake and its level steps now
  */
-static void handleObstacleCollisions(InputData *data, Ball *b) {
-    assert(b != NULL);
+static bool isStepping(const Ball *b) {
+    int period = 1 << (g_multiRate.maxLevel - b->level);
+    return !b->sleeping && (g_multiRate.substep & (period - 1)) == 0;
+}
 
-    if (!data->physics.obs.enabled) {
-        return;
+/**
+ * Finds the level whose substep is stable for a contact spring.
+ *
+ * @param params Parameters of the step
+ * @param stiffness Stiffest contact spring of the ball, 0 without contacts
+ * @return Level in [0, maxLevel]
+ */
+static int requiredLevel(const SimParams *params, float stiffness) {
+    if (stiffness <= 0.0f || g_multiRate.maxLevel == 0) {
+        return 0;
     }
 
-    float radius = data->physics.ballRadius;
-    float springConst = data->physics.obs.spring;
-    float obstacleDamping = data->physics.obs.damping;
-    float mass = data->physics.mass;
-
-    for (int i = 0; i < data->game.obstacleCnt; i++) {
-        Obstacle *o = &data->game.obstacles[i];
+    // Explicit Euler is unstable at any dt, it gets the finest level
+    float factor = g_stabilityFactor[params->integrator];
+    if (factor <= 0.0f) {
+        return g_multiRate.maxLevel;
+    }
 
-        vec3 closest;
-        utils_closestPointOnAABB(b->center, o, closest);
+    float stableDt = params->multiRate.safety * factor / sqrtf(stiffness / params->mass);
+    int level = (int) ceilf(log2f(params->fixedDt / stableDt));
+    return glm_imin(glm_imax(level, 0), g_multiRate.maxLevel);
+}
 
-        vec3 diff;
-        glm_vec3_sub(b->center, closest, diff);
-        float dist = glm_vec3_norm(diff);
-        float penetrationDepth = radius - dist;
+/**
+ * Chooses the level of every ball for the fixed step from the contacts
+ * of the last one. The multi-stage integrators move all balls per stage
+ * and always take a single substep, so do the XPBD solvers, which are
+ * stable without substeps.
+ *
+ * @param params Parameters of the step
+ */
+static void assignLevels(const SimParams *params) {
+    bool singleStage = params->integrator == IG_EULER || params->integrator == IG_SYMPLECTIC;
+    bool penalty = params->solver == CS_PENALTY;
+    g_multiRate.maxLevel = params->multiRate.enabled && singleStage && penalty
+        ? glm_imin(glm_imax(params->multiRate.maxLevel, 0), PHYSICS_MAX_SUBSTEP_LEVEL)
+        : 0;
+    g_multiRate.substep = 0;
+    g_multiRate.topLevel = 0;
+    g_multiRate.ballSubsteps = 0;
 
-        if (penetrationDepth > 0.0f) {
-            applyObstaclePenalty(
-                b, o, dist, diff, springConst,
-                penetrationDepth, mass, obstacleDamping
-            );
+    for (int i = 0; i < g_balls.size; ++i) {
+        Ball *b = &g_balls.data[i];
+        b->level = requiredLevel(params, b->stiffness);
+        b->stiffness = 0.0f;
+        if (!b->sleeping) {
+            g_multiRate.topLevel = glm_imax(g_multiRate.topLevel, b->level);
         }
     }
 }
 
 /**
- * Applies attractive force from black holes to ball.
- * Force increases with proximity.
- *
- * Balls within capture radius are immediately deactivated.
- *
- * Force formula: F = strength / distance²
- * Acceleration: a = F / m
+ * Raises the level of the stepping balls that met stiffer contacts.
+ * A substep of a level is aligned with every finer level, so a ball can
+ * switch to a finer one at any of its substeps.
  *
- * @param data Input data containing black hole parameters
- * @param b Ball to affect
+ * @param params Parameters of the step
  */
-static void handleBlackHoleAttraction(InputData *data, Ball *b) {
-    assert(b != NULL);
-    float ballMass = data->physics.mass;
-    float captureRadius = data->physics.blackHoleCaptureRadius;
-    float holeStrength = data->physics.blackHoleStrength;
-    float holeRadius = data->physics.blackHoleRadius;
-
-    for (int i = 0; i < g_blackHoles.size; i++) {
-        BlackHole *bh = &g_blackHoles.data[i];
-
-        vec3 toBlackHole;
-        glm_vec3_sub(bh->position, b->center, toBlackHole);
-        float dist = glm_vec3_norm(toBlackHole);
-
-        // Capture ball if too close
-        if (dist < captureRadius) {
-            b->active = false;
-            return;
+static void promoteLevels(const SimParams *params) {
+    for (int i = 0; i < g_balls.size; ++i) {
+        Ball *b = &g_balls.data[i];
+        if (!isStepping(b)) {
+            continue;
         }
 
-        // Apply inverse-square attraction force
-        if (dist < holeRadius && dist > 0.0001f) {
-            vec3 direction;
-            glm_vec3_normalize_to(toBlackHole, direction);
-
-            // F = strength / dist²
-            float forceMagnitude = holeStrength / (dist * dist);
-
-            // a = F / m
-            vec3 attraction;
-            glm_vec3_scale(direction, forceMagnitude / ballMass, attraction);
-            glm_vec3_add(b->acceleration, attraction, b->acceleration);
-        }
+        b->level = glm_imax(b->level, requiredLevel(params, b->stiffness));
+        g_multiRate.topLevel = glm_imax(g_multiRate.topLevel, b->level);
+        ++g_multiRate.ballSubsteps;
     }
 }
 
 /**
- * Checks if ball has reached the goal.
- * Sets global goal.reached flag on first ball to enter goal radius.
+ * Rebuilds a static grid from the x/z centers in its points array.
  *
- * @param b Ball to check
+ * @param sg Static grid, points must hold count entries
+ * @param count Number of entries
+ * @param reach Largest x/z distance at which an entry affects a ball
  */
-static void checkGoalReached(Ball *b) {
-    assert(b != NULL);
+static void buildStaticGrid(StaticGrid *sg, int count, float reach) {
+    grid_build(&sg->grid, sg->points, count, reach);
+    sg->reach = reach;
+    sg->dirty = false;
+}
 
-    if (g_goal.reached) {
+/**
+ * Grows the points array of a static grid.
+ *
+ * @param sg Static grid
+ * @param count Required number of entries
+ */
+static void reserveStaticGrid(StaticGrid *sg, int count) {
+    if (sg->capacity >= count) {
         return;
     }
 
-    vec3 toGoal;
-    glm_vec3_sub(g_goal.position, b->center, toGoal);
-    float dist = glm_vec3_norm(toGoal);
+    int newCap = sg->capacity ? sg->capacity * 2 : 16;
+    if (newCap < count) newCap = count;
 
-    if (dist < g_goal.radius) {
-        g_goal.reached = true;
-    }
+    vec2 *points = TRACKED_REALLOC(sg->points, newCap * sizeof(vec2));
+    assert(points && "realloc failed in reserveStaticGrid");
+    sg->points = points;
+    sg->capacity = newCap;
+}
+
+/**
+ * Rebuilds the obstacle grid and the obstacle table in its slot order
+ * if obstacles changed or their reach changed.
+ * The reach is the x/z diagonal of the largest obstacle plus the ball radius,
+ * the obstacles are only walked again when they changed.
+ *
+ * @param data Input data containing obstacle data
+ * @param params Parameters of the step
+ * @return True if the grid was rebuilt
+ */
+static bool updateObstacleGrid(InputData *data, const SimParams *params) {
+    const ObstacleArr *obstacles = &data->game.obstacles;
+    int count = (int) obstacles->size;
+    bool changed = g_obstacleGrid.dirty || data->game.obstaclesChanged;
+    if (changed) {
+        g_obstacleExtent = 0.0f;
+        for (int i = 0; i < count; ++i) {
+            const Obstacle *o = &obstacles->data[i];
+            g_obstacleExtent = fmaxf(g_obstacleExtent, sqrtf(o->length * o->length + o->width * o->width));
+        }
+    }
+    float reach = g_obstacleExtent + params->ballRadius;
+
+    if (!changed && g_obstacleGrid.reach == reach) {
+        return false;
+    }
+
+    reserveStaticGrid(&g_obstacleGrid, count);
+    for (int i = 0; i < count; ++i) {
+        g_obstacleGrid.points[i][0] = obstacles->data[i].center[0];
+        g_obstacleGrid.points[i][1] = obstacles->data[i].center[2];
+    }
+    buildStaticGrid(&g_obstacleGrid, count, reach);
+    obstacletable_build(&g_obstacleTable, obstacles->data, g_obstacleGrid.grid.sortedIdx, count);
+    data->game.obstaclesChanged = false;
+    return true;
+}
+
+/**
+ * Rebuilds the black hole grid if holes were added or removed
+ * or the attraction or capture radius changed.
+ *
+ * @param params Parameters of the step
+ * @return True if the grid was rebuilt
+ */
+static bool updateBlackHoleGrid(const SimParams *params) {
+    float reach = fmaxf(params->blackHoleRadius, params->blackHoleCaptureRadius);
+    if (!g_blackHoleGrid.dirty && g_blackHoleGrid.reach == reach) {
+        return false;
+    }
+
+    reserveStaticGrid(&g_blackHoleGrid, g_blackHoles.size);
+    for (int i = 0; i < g_blackHoles.size; ++i) {
+        g_blackHoleGrid.points[i][0] = g_blackHoles.data[i].position[0];
+        g_blackHoleGrid.points[i][1] = g_blackHoles.data[i].position[2];
+    }
+    buildStaticGrid(&g_blackHoleGrid, g_blackHoles.size, reach);
+    return true;
+}
+
+/**
+ * Checks and handles collisions between a ball and all other balls
+ * in the neighbouring grid cells.
+ * Only checks balls with index > i1 to avoid duplicate pair checks.
+ *
+ * @param params Parameters of the step
+ * @param b1 Ball to check
+ * @param i1 Index of b1 in array
+ * @param impulses Also change velocities, off for extra force evaluations
+ * @param accel Acceleration buffer indexed by ball, NULL to change the balls in place
+ * @param contacts Collects the pairs for the impulses when accel is given
+ */
+static void handleBallCollisions(const SimParams *params, Ball *b1, int i1, bool impulses,
+                                 vec3 *accel, BallPairArr *contacts) {
+    assert(b1 != NULL);
+
+    float radius = params->ballRadius;
+    float springConst = params->ball.spring;
+    float ballDamping = params->ball.damping;
+    float mass = params->mass;
+    float diameter = 2.0f * radius;
+    bool fast = params->fastMath;
+
+    const Grid *grid = &g_ballGrid.grid;
+    int cell[2];
+    grid_cellCoords(grid, (vec2) { b1->center[0], b1->center[2] }, cell);
+
+    for (int y = cell[1] - 1; y <= cell[1] + 1; ++y) {
+        if (y < 0 || y >= grid->dimY) continue;
+
+        for (int x = cell[0] - 1; x <= cell[0] + 1; ++x) {
+            if (x < 0 || x >= grid->dimX) continue;
+
+            int begin, end;
+            grid_cellRange(grid, x, y, &begin, &end);
+
+            for (int slot = begin; slot < end; ++slot) {
+                int i2 = g_ballGrid.ballIdx[grid->sortedIdx[slot]];
+                Ball *b2 = &g_balls.data[i2];
+
+                // Every pair once: in the pass of its lower ball, or of the
+                // upper one while the lower ball does not step
+                if (i2 == i1 || (i2 < i1 && isStepping(b2))) continue;
+
+                vec3 b1ToB2;
+                glm_vec3_sub(b2->center, b1->center, b1ToB2);
+
+                float dist;
+                if (fast) {
+                    float dist2 = glm_vec3_norm2(b1ToB2);
+                    if (dist2 >= diameter * diameter) continue;
+                    dist = dist2 * fastmath_rsqrt(dist2);
+                } else {
+                    dist = glm_vec3_norm(b1ToB2);
+                }
+                float penetrationDepth = diameter - dist;
+
+                if (penetrationDepth > 0.0f && dist > 0.0001f) {
+                    if (!accel) {
+                        applyBallPenalty(
+                            b1, b2, penetrationDepth, b1ToB2, springConst, mass, ballDamping, impulses,
+                            b1->acceleration, b2->acceleration
+                        );
+                        b1->stiffness = fmaxf(b1->stiffness, 2.0f * springConst);
+                        b2->stiffness = fmaxf(b2->stiffness, 2.0f * springConst);
+                        continue;
+                    }
+
+                    applyBallPenalty(
+                        b1, b2, penetrationDepth, b1ToB2, springConst, mass, ballDamping, false,
+                        accel[i1], accel[i2]
+                    );
+                    if (impulses) {
+                        BallPairArr_push(contacts, (BallPair) { i1, i2 });
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Applies penalty force when ball collides with an obstacle
+ *
+ * @param b Ball in collision
+ * @param o Obstacle (bounding box)
+ * @param dist Distance from ball to closest point
+ * @param diff Vector from closest point to ball center
+ * @param springConst Spring constant
+ * @param penetration Penetration depth
+ * @param ballMass Ball mass
+ * @param obstacleDamping Damping coefficient
+ * @param impulses Also reflect the velocity, off for extra force evaluations
+ */
+static void applyObstaclePenalty(
+    Ball *b, Obstacle *o, float dist, vec3 diff, float springConst,
+    float penetration, float ballMass, float obstacleDamping, bool impulses
+) {
+    assert(b != NULL && o != NULL);
+
+    vec3 normal;
+    utils_getAABBNormal(o, b->center, dist, diff, normal);
+
+    // Spring force: F = k * d
+    float counterforce = springConst * penetration;
+
+    vec3 penaltyForce, additionalAcceleration;
+    glm_vec3_scale(normal, counterforce, penaltyForce);
+    glm_vec3_scale(penaltyForce, 1.0f / ballMass, additionalAcceleration);
+
+    glm_vec3_add(additionalAcceleration, b->acceleration, b->acceleration);
+
+    // Reflect velocity if moving into obstacle
+    float velDotNormal = glm_vec3_dot(b->velocity, normal);
+    if (impulses && velDotNormal < 0.0f) {
+        vec3 reflected;
+        glm_vec3_reflect(b->velocity, normal, reflected);
+        glm_vec3_scale(reflected, obstacleDamping, b->velocity);
+    }
+}
+
+/**
+ * Checks and handles collisions between ball and the obstacles
+ * in the neighbouring cells of the obstacle grid.
+ * Each obstacle is an axis-aligned bounding box on the surface.
+ * The three cells of a grid row are one slot range of the obstacle table,
+ * which the selected kernel tests in chunks of OBSTACLE_SLOTS_PER_CHUNK slots.
+ *
+ * @param params Parameters of the step
+ * @param obstacles Obstacle array
+ * @param b Ball to check
+ * @param impulses Also change velocities, off for extra force evaluations
+ */
+static void handleObstacleCollisions(const SimParams *params, Obstacle *obstacles, Ball *b, bool impulses) {
+    assert(b != NULL);
+
+    if (!params->obs.enabled) {
+        return;
+    }
+
+    float radius = params->ballRadius;
+    float springConst = params->obs.spring;
+    float obstacleDamping = params->obs.damping;
+    float mass = params->mass;
+
+    const Grid *grid = &g_obstacleGrid.grid;
+    const ObstacleTable *table = &g_obstacleTable;
+    int cell[2];
+    grid_cellCoords(grid, (vec2) { b->center[0], b->center[2] }, cell);
+    int xLo = glm_imax(cell[0] - 1, 0);
+    int xHi = glm_imin(cell[0] + 1, grid->dimX - 1);
+
+    int hits[OBSTACLE_SLOTS_PER_CHUNK];
+    for (int y = cell[1] - 1; y <= cell[1] + 1; ++y) {
+        if (y < 0 || y >= grid->dimY) continue;
+
+        int rowBegin, rowEnd, unused;
+        grid_cellRange(grid, xLo, y, &rowBegin, &unused);
+        grid_cellRange(grid, xHi, y, &unused, &rowEnd);
+
+        for (int begin = rowBegin; begin < rowEnd; begin += OBSTACLE_SLOTS_PER_CHUNK) {
+            int end = glm_imin(begin + OBSTACLE_SLOTS_PER_CHUNK, rowEnd);
+            int count = obstacletable_findContacts(params->kernel, table, begin, end, b->center, radius, hits);
+            for (int k = 0; k < count; ++k) {
+                vec3 closest, diff;
+                obstacletable_closestPoint(table, hits[k], b->center, closest);
+                glm_vec3_sub(b->center, closest, diff);
+                float dist2 = glm_vec3_norm2(diff);
+
+                // A center inside the bounds has dist2 == 0, which the rsqrt can't take
+                Obstacle *o = &obstacles[table->obstacle[hits[k]]];
+                float dist = params->fastMath && dist2 > 0.0f ? dist2 * fastmath_rsqrt(dist2) : sqrtf(dist2);
+                applyObstaclePenalty(
+                    b, o, dist, diff, springConst,
+                    radius - dist, mass, obstacleDamping, impulses
+                );
+                b->stiffness = fmaxf(b->stiffness, springConst);
+            }
+        }
+    }
+}
+
+/**
+ * Applies attractive force from the black holes in the
+ * neighbouring cells of the black hole grid to ball.
+ * Force increases with proximity.
+ *
+ * Balls within capture radius are immediately deactivated.
+ *
+ * Force formula: F = strength / distance²
+ * Acceleration: a = F / m
+ *
+ * @param params Parameters of the step
+ * @param b Ball to affect
+ * @param capture Deactivate captured balls, off for extra force evaluations
+ */
+static void handleBlackHoleAttraction(const SimParams *params, Ball *b, bool capture) {
+    assert(b != NULL);
+    float ballMass = params->mass;
+    float captureRadius = params->blackHoleCaptureRadius;
+    float holeStrength = params->blackHoleStrength;
+    float holeRadius = params->blackHoleRadius;
+
+    float reach2 = g_blackHoleGrid.reach * g_blackHoleGrid.reach;
+
+    const Grid *grid = &g_blackHoleGrid.grid;
+    int cell[2];
+    grid_cellCoords(grid, (vec2) { b->center[0], b->center[2] }, cell);
+
+    for (int y = cell[1] - 1; y <= cell[1] + 1; ++y) {
+        if (y < 0 || y >= grid->dimY) continue;
+
+        for (int x = cell[0] - 1; x <= cell[0] + 1; ++x) {
+            if (x < 0 || x >= grid->dimX) continue;
+
+            int begin, end;
+            grid_cellRange(grid, x, y, &begin, &end);
+
+            for (int slot = begin; slot < end; ++slot) {
+                BlackHole *bh = &g_blackHoles.data[grid->sortedIdx[slot]];
+
+                vec3 toBlackHole;
+                glm_vec3_sub(bh->position, b->center, toBlackHole);
+                float dist2 = glm_vec3_norm2(toBlackHole);
+                if (dist2 >= reach2) {
+                    continue;
+                }
+
+                // Capture ball if too close
+                if (capture && dist2 < captureRadius * captureRadius) {
+                    b->active = false;
+                    return;
+                }
+
+                // Apply inverse-square attraction force
+                if (dist2 < holeRadius * holeRadius && dist2 > 0.0001f * 0.0001f) {
+                    vec3 direction;
+                    float invDist = params->fastMath ? fastmath_rsqrt(dist2) : 1.0f / sqrtf(dist2);
+                    glm_vec3_scale(toBlackHole, invDist, direction);
+
+                    // F = strength / dist²
+                    float forceMagnitude = holeStrength / dist2;
+
+                    // a = F / m
+                    vec3 attraction;
+                    glm_vec3_scale(direction, forceMagnitude / ballMass, attraction);
+                    glm_vec3_add(b->acceleration, attraction, b->acceleration);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Checks if ball has reached the goal.
+ * Sets global goal.reached flag on first ball to enter goal radius.
+ *
+ * @param b Ball to check
+ */
+static void checkGoalReached(Ball *b) {
+    assert(b != NULL);
+
+    if (g_goal.reached) {
+        return;
+    }
+
+    vec3 toGoal;
+    glm_vec3_sub(g_goal.position, b->center, toGoal);
+    float dist = glm_vec3_norm(toGoal);
+
+    if (dist < g_goal.radius) {
+        g_goal.reached = true;
+    }
 }
 
 /**
@@ -551,115 +1283,1614 @@ static void checkGoalReached(Ball *b) {
  * @param gravity Gravity vector
  * @param mass Ball mass
  */
-static void applyExternForces(Ball *b, vec3 gravity, float mass) {
-    assert(b != NULL);
+static void applyExternForces(Ball *b, vec3 gravity, float mass) {
+    assert(b != NULL);
+
+    // Decompose gravity into normal and tangential components
+    vec3 l, f;
+    float gDotN = glm_vec3_dot(gravity, b->contact.normal);
+    glm_vec3_scale(b->contact.normal, gDotN, l); // normal comp.
+    glm_vec3_sub(gravity, l, f); // tangent comp
+
+    // force to accel: a = f / m
+    glm_vec3_scale(f, 1.0f / mass, b->acceleration);
+}
+
+/**
+ * Performs one semi-implicit Euler integration step for ball physics.
+ * The moved contact point is projected back onto the surface
+ * for all balls at once by projectContacts.
+ *
+ * @param b Ball to update
+ * @param dt Time step
+ * @param friction Velocity damping factor
+ */
+static void applyIntegration(Ball *b, float dt, float friction) {
+    assert(b != NULL);
+
+    // Euler integration: v += a * dt
+    vec3 accelDt;
+    glm_vec3_scale(b->acceleration, dt, accelDt);
+    glm_vec3_add(b->velocity, accelDt, b->velocity);
+
+    // Apply friction
+    glm_vec3_scale(b->velocity, friction, b->velocity);
+
+    // Euler integration: s += v * dt
+    vec3 vMulDt = {0};
+    glm_vec3_scale(b->velocity, dt, vMulDt);
+    glm_vec3_add(b->contact.point, vMulDt, b->contact.point);
+}
+
+/**
+ * Performs one explicit Euler integration step, the position
+ * moves with the velocity from the start of the step.
+ *
+ * @param b Ball to update
+ * @param dt Time step
+ * @param friction Velocity damping factor
+ */
+static void applyExplicitIntegration(Ball *b, float dt, float friction) {
+    assert(b != NULL);
+
+    glm_vec3_muladds(b->velocity, dt, b->contact.point);
+    glm_vec3_muladds(b->acceleration, dt, b->velocity);
+    glm_vec3_scale(b->velocity, friction, b->velocity);
+}
+
+/**
+ * Checks whether the passes over all balls run on the job pool.
+ *
+ * @param params Parameters of the step
+ * @return True with more than one thread and enough balls
+ */
+static bool useParallelSolve(const SimParams *params) {
+    return params->parallel && jobs_getThreadCount() > 1 && g_balls.size >= PARALLEL_MIN_BALLS;
+}
+
+/**
+ * Runs a per-ball job over all balls, on the job pool or in one call.
+ *
+ * @param pass Pass parameters, handed to the job
+ * @param fn Job processing a range of balls
+ */
+static void runBallPass(BallPass *pass, JobFn fn) {
+    if (pass->parallel) {
+        jobs_parallelFor(g_balls.size, BALLS_PER_CHUNK, fn, pass);
+    } else {
+        fn(0, g_balls.size, 0, pass);
+    }
+}
+
+/**
+ * Applies gravity to a range of balls, clears sleeping balls.
+ */
+static void externJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    BallPass *pass = userData;
+    const SimParams *params = pass->params;
+
+    for (int i = begin; i < end; ++i) {
+        Ball *b = &g_balls.data[i];
+        if (b->sleeping) {
+            glm_vec3_zero(b->acceleration);
+        } else if (isStepping(b)) {
+            applyExternForces(b, (float*) params->gravity, params->mass);
+        }
+    }
+}
+
+/**
+ * Handles the wall contacts of a range of balls.
+ */
+static void wallJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    BallPass *pass = userData;
+
+    for (int i = begin; i < end; ++i) {
+        if (isStepping(&g_balls.data[i])) {
+            handleWallCollision(pass->params, &g_balls.data[i], pass->impulses);
+        }
+    }
+}
+
+/**
+ * Handles the obstacle contacts of a range of balls.
+ */
+static void obstacleJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    BallPass *pass = userData;
+
+    for (int i = begin; i < end; ++i) {
+        if (isStepping(&g_balls.data[i])) {
+            handleObstacleCollisions(pass->params, pass->obstacles, &g_balls.data[i], pass->impulses);
+        }
+    }
+}
+
+/**
+ * Applies the black hole attraction to a range of balls.
+ * Captured balls are only flagged, compactBalls counts them.
+ */
+static void blackHoleJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    BallPass *pass = userData;
+
+    for (int i = begin; i < end; ++i) {
+        if (isStepping(&g_balls.data[i])) {
+            handleBlackHoleAttraction(pass->params, &g_balls.data[i], pass->impulses);
+        }
+    }
+}
+
+/**
+ * Adds the ball-ball penalty forces of a range of balls to the buffer
+ * of the chunk and collects the touching pairs for the impulses.
+ */
+static void ballPairsJob(int begin, int end, int chunk, void *userData) {
+    BallPass *pass = userData;
+    vec3 *accel = &g_pairSolve.accel[(size_t) chunk * g_pairSolve.ballCount];
+    BallPairArr *contacts = &g_pairSolve.contacts[chunk];
+    memset(accel, 0, g_pairSolve.ballCount * sizeof(vec3));
+    BallPairArr_clear(contacts);
+
+    for (int i = begin; i < end; ++i) {
+        if (isStepping(&g_balls.data[i])) {
+            handleBallCollisions(pass->params, &g_balls.data[i], i, pass->impulses, accel, contacts);
+        }
+    }
+}
+
+/**
+ * Adds the accelerations of all chunks to a range of balls, in chunk order.
+ */
+static void reduceAccelJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    NK_UNUSED(userData);
+
+    for (int i = begin; i < end; ++i) {
+        Ball *b = &g_balls.data[i];
+        for (int c = 0; c < g_pairSolve.chunks; ++c) {
+            glm_vec3_add(b->acceleration, g_pairSolve.accel[(size_t) c * g_pairSolve.ballCount + i],
+                b->acceleration);
+        }
+    }
+}
+
+/**
+ * Handles all ball-ball contacts. Every pair writes to both balls, so the
+ * parallel solve gives every chunk its own acceleration buffer and sums
+ * them up afterwards. The impulses depend on the velocities changed by the
+ * earlier pairs, so they are applied on the calling thread in the order of
+ * the sequential solve, chunk by chunk.
+ *
+ * @param pass Pass parameters
+ */
+static void solveBallPairs(BallPass *pass) {
+    const SimParams *params = pass->params;
+    if (!params->ball.enabled) {
+        return;
+    }
+
+    if (!pass->parallel) {
+        for (int i = 0; i < g_balls.size; ++i) {
+            if (isStepping(&g_balls.data[i])) {
+                handleBallCollisions(params, &g_balls.data[i], i, pass->impulses, NULL, NULL);
+            }
+        }
+        return;
+    }
+
+    int count = g_balls.size;
+    int chunks = jobs_chunkCount(count, BALLS_PER_CHUNK);
+    size_t needed = (size_t) chunks * count;
+    if (g_pairSolve.capacity < needed) {
+        vec3 *accel = TRACKED_REALLOC(g_pairSolve.accel, needed * sizeof(vec3));
+        assert(accel && "realloc failed in solveBallPairs");
+        g_pairSolve.accel = accel;
+        g_pairSolve.capacity = needed;
+    }
+    g_pairSolve.chunks = chunks;
+    g_pairSolve.ballCount = count;
+
+    jobs_parallelFor(count, BALLS_PER_CHUNK, ballPairsJob, pass);
+    jobs_parallelFor(count, BALLS_PER_CHUNK, reduceAccelJob, pass);
+
+    if (!pass->impulses) {
+        return;
+    }
+
+    // The centers did not move, the normals are those of the force pass
+    for (int c = 0; c < chunks; ++c) {
+        BallPairArr *contacts = &g_pairSolve.contacts[c];
+        for (size_t k = 0; k < contacts->size; ++k) {
+            Ball *b1 = &g_balls.data[contacts->data[k].i1];
+            Ball *b2 = &g_balls.data[contacts->data[k].i2];
+
+            vec3 normal;
+            glm_vec3_sub(b2->center, b1->center, normal);
+            glm_vec3_normalize(normal);
+            applyBallImpulse(b1, b2, normal, params->ball.damping);
+            b1->stiffness = fmaxf(b1->stiffness, 2.0f * params->ball.spring);
+            b2->stiffness = fmaxf(b2->stiffness, 2.0f * params->ball.spring);
+        }
+    }
+}
+
+/**
+ * Integrates the stepping balls of a range with the single-stage
+ * integrator of the step, each over the substep of its level.
+ */
+static void integrateJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    BallPass *pass = userData;
+    const SimParams *params = pass->params;
+    bool explicitEuler = params->integrator == IG_EULER;
+
+    // Friction is per fixed step, the substeps of a level take their share of it
+    float friction[PHYSICS_MAX_SUBSTEP_LEVEL + 1];
+    for (int l = 0; l <= g_multiRate.maxLevel; ++l) {
+        friction[l] = powf(params->frictionFactor, ldexpf(1.0f, -l));
+    }
+
+    for (int i = begin; i < end; ++i) {
+        Ball *b = &g_balls.data[i];
+        if (!isStepping(b)) {
+            continue;
+        }
+
+        float dt = ldexpf(params->fixedDt, -b->level);
+        if (explicitEuler) {
+            applyExplicitIntegration(b, dt, friction[b->level]);
+        } else {
+            applyIntegration(b, dt, friction[b->level]);
+        }
+    }
+}
+
+/**
+ * Evaluates the acceleration of every ball at its current center and velocity:
+ * gravity, penalty springs and black hole attraction. The XPBD solvers
+ * skip the springs.
+ * The first evaluation of a step also applies the velocity impulses and
+ * captures, the extra evaluations of the multi-stage integrators only
+ * sample the forces. The broad phases must be up to date.
+ *
+ * @param params Parameters of the step
+ * @param obstacles Obstacle array
+ * @param impulses First evaluation of the step
+ */
+static void evaluateForces(const SimParams *params, Obstacle *obstacles, bool impulses) {
+    BallPass pass = {
+        .params = params,
+        .obstacles = obstacles,
+        .impulses = impulses,
+        .parallel = useParallelSolve(params)
+    };
+    double t = glfwGetTime();
+
+    // One pass per phase, every pair is handled in its lower ball's pass
+    runBallPass(&pass, externJob);
+    t = endPhase(PP_EXTERN, t);
+
+    // The XPBD solve handles the contacts after the integration
+    if (params->solver == CS_PENALTY) {
+        runBallPass(&pass, wallJob);
+        t = endPhase(PP_WALL, t);
+
+        solveBallPairs(&pass);
+        t = endPhase(PP_BALL, t);
+
+        runBallPass(&pass, obstacleJob);
+        t = endPhase(PP_OBSTACLE, t);
+    }
+
+    // Black holes run last, a captured ball already took part in all contacts
+    runBallPass(&pass, blackHoleJob);
+    endPhase(PP_BLACK_HOLE, t);
+}
+
+/**
+ * Moves every ball center by the stage derivatives from the start of the step.
+ *
+ * @param h Stage offset in time
+ */
+static void setStage(float h) {
+    for (int i = 0; i < g_balls.size; ++i) {
+        Ball *b = &g_balls.data[i];
+        StageState *st = &g_stages.data[i];
+
+        glm_vec3_copy(st->center, b->center);
+        glm_vec3_muladds(st->kx, h, b->center);
+        glm_vec3_copy(st->velocity, b->velocity);
+        glm_vec3_muladds(st->kv, h, b->velocity);
+    }
+}
+
+/**
+ * Performs one velocity Verlet step for all balls.
+ * The acceleration at the end of the step is evaluated at the moved centers,
+ * the surface normal is kept from the start of the step.
+ *
+ * @param params Parameters of the step
+ * @param obstacles Obstacle array
+ */
+static void integrateVerlet(const SimParams *params, Obstacle *obstacles) {
+    float dt = params->fixedDt;
+    float friction = params->frictionFactor;
+    StageState *stages = StageStateArr_resizeUninit(&g_stages, g_balls.size);
+
+    for (int i = 0; i < g_balls.size; ++i) {
+        Ball *b = &g_balls.data[i];
+        StageState *st = &stages[i];
+        glm_vec3_copy(b->velocity, st->velocity);
+        glm_vec3_copy(b->acceleration, st->acceleration);
+
+        // x += v * dt + a * dt^2 / 2
+        vec3 dx;
+        glm_vec3_scale(b->velocity, dt, dx);
+        glm_vec3_muladds(b->acceleration, 0.5f * dt * dt, dx);
+        glm_vec3_add(b->contact.point, dx, b->contact.point);
+        glm_vec3_add(b->center, dx, b->center);
+    }
+
+    evaluateForces(params, obstacles, false);
+
+    // v += (a0 + a1) * dt / 2
+    for (int i = 0; i < g_balls.size; ++i) {
+        Ball *b = &g_balls.data[i];
+        StageState *st = &stages[i];
+
+        vec3 sum;
+        glm_vec3_add(st->acceleration, b->acceleration, sum);
+        glm_vec3_copy(st->velocity, b->velocity);
+        glm_vec3_muladds(sum, 0.5f * dt, b->velocity);
+        glm_vec3_scale(b->velocity, friction, b->velocity);
+    }
+}
+
+/**
+ * Performs one classic Runge-Kutta step for all balls, with three extra
+ * force evaluations at the stage centers. The surface normal is kept from
+ * the start of the step, the stages move in its tangent plane.
+ *
+ * @param params Parameters of the step
+ * @param obstacles Obstacle array
+ */
+static void integrateRk4(const SimParams *params, Obstacle *obstacles) {
+    float dt = params->fixedDt;
+    float friction = params->frictionFactor;
+    StageState *stages = StageStateArr_resizeUninit(&g_stages, g_balls.size);
+
+    // k1 from the evaluation of the step
+    for (int i = 0; i < g_balls.size; ++i) {
+        Ball *b = &g_balls.data[i];
+        StageState *st = &stages[i];
+        glm_vec3_copy(b->center, st->center);
+        glm_vec3_copy(b->velocity, st->velocity);
+        glm_vec3_copy(b->velocity, st->kx);
+        glm_vec3_copy(b->acceleration, st->kv);
+        glm_vec3_copy(st->kx, st->sumX);
+        glm_vec3_copy(st->kv, st->sumV);
+    }
+
+    const float offsets[3] = { 0.5f, 0.5f, 1.0f };
+    const float weights[3] = { 2.0f, 2.0f, 1.0f };
+
+    for (int s = 0; s < 3; ++s) {
+        setStage(offsets[s] * dt);
+        evaluateForces(params, obstacles, false);
+
+        for (int i = 0; i < g_balls.size; ++i) {
+            Ball *b = &g_balls.data[i];
+            StageState *st = &stages[i];
+            glm_vec3_copy(b->velocity, st->kx);
+            glm_vec3_copy(b->acceleration, st->kv);
+            glm_vec3_muladds(st->kx, weights[s], st->sumX);
+            glm_vec3_muladds(st->kv, weights[s], st->sumV);
+        }
+    }
+
+    for (int i = 0; i < g_balls.size; ++i) {
+        Ball *b = &g_balls.data[i];
+        StageState *st = &stages[i];
+
+        glm_vec3_muladds(st->sumX, dt / 6.0f, b->contact.point);
+        glm_vec3_copy(st->velocity, b->velocity);
+        glm_vec3_muladds(st->sumV, dt / 6.0f, b->velocity);
+        glm_vec3_scale(b->velocity, friction, b->velocity);
+
+        // Mean acceleration of the step, as traced
+        glm_vec3_scale(st->sumV, 1.0f / 6.0f, b->acceleration);
+    }
+}
+
+/**
+ * Sweeps a sphere along a displacement against a wall plane.
+ *
+ * @param w Wall
+ * @param c0 Sphere center at the start
+ * @param d Displacement of the center
+ * @param radius Sphere radius
+ * @param toi In: earliest impact so far, out: updated if the wall is hit earlier
+ * @return True if the wall is hit before toi
+ */
+static bool sweepWall(const Wall *w, const vec3 c0, const vec3 d, float radius, float *toi) {
+    float s0 = glm_vec3_dot((float*) w->normal, (float*) c0) + w->distance - radius;
+    float s1 = s0 + glm_vec3_dot((float*) w->normal, (float*) d);
+
+    // Only a ball crossing from outside, overlaps are left to the penalty spring
+    if (s0 < 0.0f || s1 >= 0.0f) {
+        return false;
+    }
+
+    float t = s0 / (s0 - s1);
+    if (t >= *toi) {
+        return false;
+    }
+    *toi = t;
+    return true;
+}
+
+/**
+ * Sweeps a sphere along a displacement against an obstacle box.
+ * The box is grown by the radius on every side, which rounds the
+ * Minkowski sum of box and sphere up to a box: near the edges the
+ * impact is found slightly early.
+ *
+ * @param t Obstacle table
+ * @param slot Slot of the obstacle
+ * @param c0 Sphere center at the start
+ * @param d Displacement of the center
+ * @param radius Sphere radius
+ * @param toi In: earliest impact so far, out: updated if the box is hit earlier
+ * @param normal Output: face normal of the impact, only written on a hit
+ * @return True if the box is hit before toi
+ */
+static bool sweepBox(const ObstacleTable *t, int slot, const vec3 c0, const vec3 d, float radius,
+                     float *toi, vec3 normal) {
+    const float lo[3] = { t->minX[slot] - radius, t->minY[slot] - radius, t->minZ[slot] - radius };
+    const float hi[3] = { t->maxX[slot] + radius, t->maxY[slot] + radius, t->maxZ[slot] + radius };
+
+    // Slab test of the center segment, an overlap at the start is left to the penalty spring
+    float tEnter = -FLT_MAX;
+    float tExit = FLT_MAX;
+    int axis = -1;
+    for (int a = 0; a < 3; ++a) {
+        if (fabsf(d[a]) < 1e-8f) {
+            if (c0[a] < lo[a] || c0[a] > hi[a]) return false;
+            continue;
+        }
+
+        float t1 = (lo[a] - c0[a]) / d[a];
+        float t2 = (hi[a] - c0[a]) / d[a];
+        if (t1 > t2) {
+            float tmp = t1;
+            t1 = t2;
+            t2 = tmp;
+        }
+        if (t1 > tEnter) {
+            tEnter = t1;
+            axis = a;
+        }
+        tExit = fminf(tExit, t2);
+        if (tEnter > tExit) return false;
+    }
+
+    if (axis < 0 || tEnter < 0.0f || tEnter >= *toi) {
+        return false;
+    }
+
+    *toi = tEnter;
+    glm_vec3_zero(normal);
+    normal[axis] = d[axis] > 0.0f ? -1.0f : 1.0f;
+    return true;
+}
+
+/**
+ * Sweeps a ball along the displacement of its contact point in the last
+ * integration against the walls and obstacles. On an impact the ball
+ * stops there and its velocity is reflected like by the penalty contact,
+ * the rest of the substep is dropped.
+ *
+ * @param params Parameters of the step
+ * @param b Ball to sweep
+ * @param start Contact point before the integration
+ */
+static void sweepBall(const SimParams *params, Ball *b, const vec3 start) {
+    float radius = params->ballRadius;
+    vec3 d;
+    glm_vec3_sub(b->contact.point, (float*) start, d);
+    float minDist = SWEEP_MIN_DISTANCE * radius;
+    if (glm_vec3_norm2(d) < minDist * minDist) {
+        return;
+    }
+
+    // The normal is kept during the integration, so is the center offset
+    vec3 c0;
+    glm_vec3_scale(b->contact.normal, radius, c0);
+    glm_vec3_add(c0, (float*) start, c0);
+
+    float toi = 1.0f;
+    float damping = 1.0f;
+    vec3 normal;
+    if (params->wall.enabled) {
+        for (int i = 0; i < WALL_CNT; ++i) {
+            if (sweepWall(&g_walls.walls[i], c0, d, radius, &toi)) {
+                glm_vec3_copy(g_walls.walls[i].normal, normal);
+                damping = params->wall.damping;
+            }
+        }
+    }
+    if (params->obs.enabled) {
+        // The cells around the x/z bounds of the segment hold every box it can reach
+        const Grid *grid = &g_obstacleGrid.grid;
+        int lo[2], hi[2];
+        grid_cellCoords(grid, (vec2) { c0[0] + fminf(d[0], 0.0f), c0[2] + fminf(d[2], 0.0f) }, lo);
+        grid_cellCoords(grid, (vec2) { c0[0] + fmaxf(d[0], 0.0f), c0[2] + fmaxf(d[2], 0.0f) }, hi);
+        int xLo = glm_imax(lo[0] - 1, 0);
+        int xHi = glm_imin(hi[0] + 1, grid->dimX - 1);
+        int yLo = glm_imax(lo[1] - 1, 0);
+        int yHi = glm_imin(hi[1] + 1, grid->dimY - 1);
+
+        for (int y = yLo; y <= yHi; ++y) {
+            int begin, end, unused;
+            grid_cellRange(grid, xLo, y, &begin, &unused);
+            grid_cellRange(grid, xHi, y, &unused, &end);
+            for (int slot = begin; slot < end; ++slot) {
+                if (sweepBox(&g_obstacleTable, slot, c0, d, radius, &toi, normal)) {
+                    damping = params->obs.damping;
+                }
+            }
+        }
+    }
+    if (toi >= 1.0f) {
+        return;
+    }
+
+    float len = glm_vec3_norm(d);
+    float t = fmaxf(toi - SWEEP_SKIN / len, 0.0f);
+    glm_vec3_copy((float*) start, b->contact.point);
+    glm_vec3_muladds(d, t, b->contact.point);
+
+    if (glm_vec3_dot(b->velocity, normal) < 0.0f) {
+        vec3 reflected;
+        glm_vec3_reflect(b->velocity, normal, reflected);
+        glm_vec3_scale(reflected, damping, b->velocity);
+    }
+}
+
+/**
+ * Sweeps the stepping balls of a range, see sweepBall.
+ */
+static void sweepJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    BallPass *pass = userData;
+
+    for (int i = begin; i < end; ++i) {
+        if (isStepping(&g_balls.data[i])) {
+            sweepBall(pass->params, &g_balls.data[i], g_sweepStart.data[i]);
+        }
+    }
+}
+
+/**
+ * Moves a ball whose center was predicted by the integration,
+ * the contact point follows so the velocity sees the move.
+ *
+ * @param b Ball to move
+ * @param dir Direction
+ * @param s Distance along dir
+ */
+static void moveXpbdBall(Ball *b, const vec3 dir, float s) {
+    glm_vec3_muladds((float*) dir, s, b->center);
+    glm_vec3_muladds((float*) dir, s, b->contact.point);
+}
+
+/**
+ * Evaluates the constraint of a contact at the current centers and
+ * updates its normal.
+ *
+ * @param params Parameters of the step
+ * @param c The contact
+ * @return Distance of the surfaces, negative while they penetrate
+ */
+static float evalXpbdContact(const SimParams *params, XpbdContact *c) {
+    float radius = params->ballRadius;
+    const float *center = g_balls.data[c->i2].center;
+
+    switch (c->kind) {
+        case XC_WALL: {
+            const Wall *w = &g_walls.walls[c->index];
+            glm_vec3_copy((float*) w->normal, c->normal);
+            return glm_vec3_dot((float*) w->normal, (float*) center) + w->distance - radius;
+        }
+        case XC_OBSTACLE: {
+            const ObstacleTable *t = &g_obstacleTable;
+            int slot = c->index;
+            vec3 closest, diff;
+            obstacletable_closestPoint(t, slot, center, closest);
+            glm_vec3_sub((float*) center, closest, diff);
+            float dist2 = glm_vec3_norm2(diff);
+            if (dist2 > 1e-12f) {
+                float dist = sqrtf(dist2);
+                glm_vec3_scale(diff, 1.0f / dist, c->normal);
+                return dist - radius;
+            }
+
+            // Center inside the bounds, out through the nearest face
+            const float lo[3] = { t->minX[slot], t->minY[slot], t->minZ[slot] };
+            const float hi[3] = { t->maxX[slot], t->maxY[slot], t->maxZ[slot] };
+            float depth = FLT_MAX;
+            for (int a = 0; a < 3; ++a) {
+                float toLo = center[a] - lo[a];
+                float toHi = hi[a] - center[a];
+                if (fminf(toLo, toHi) < depth) {
+                    depth = fminf(toLo, toHi);
+                    glm_vec3_zero(c->normal);
+                    c->normal[a] = toHi < toLo ? 1.0f : -1.0f;
+                }
+            }
+            return -depth - radius;
+        }
+        case XC_BALL:
+        default: {
+            vec3 diff;
+            glm_vec3_sub((float*) center, g_balls.data[c->i1].center, diff);
+            float dist = glm_vec3_norm(diff);
+            if (dist > 1e-6f) {
+                glm_vec3_scale(diff, 1.0f / dist, c->normal);
+            } else {
+                glm_vec3_copy((vec3) { 1.0f, 0.0f, 0.0f }, c->normal);
+            }
+            return dist - 2.0f * radius;
+        }
+    }
+}
+
+/**
+ * Computes the multiplier change of a contact at the current centers,
+ * the accumulated multiplier stays >= 0 so contacts only push.
+ *
+ * @param params Parameters of the step
+ * @param c The contact, lambda and dLambda are updated
+ */
+static void solveXpbdContact(const SimParams *params, XpbdContact *c) {
+    float w = 1.0f / params->mass;
+    float wSum = c->i1 >= 0 ? 2.0f * w : w;
+    float C = evalXpbdContact(params, c);
+
+    float dLambda = (-C - g_xpbd.compliance * c->lambda) / (wSum + g_xpbd.compliance);
+    dLambda = fmaxf(c->lambda + dLambda, 0.0f) - c->lambda;
+    c->lambda += dLambda;
+    c->dLambda = dLambda;
+}
+
+/**
+ * Finds the contacts of a stepping ball at its predicted center: walls,
+ * obstacles in the neighbouring cells of the obstacle grid and balls of
+ * the neighbouring cells of the ball grid, every pair once.
+ *
+ * @param params Parameters of the step
+ * @param i Index of the ball
+ * @param dest Destination of the contacts
+ */
+static void findXpbdContacts(const SimParams *params, int i, XpbdContactArr *dest) {
+    Ball *b = &g_balls.data[i];
+    float radius = params->ballRadius;
+    float slop = XPBD_SLOP * radius;
+
+    if (params->wall.enabled) {
+        for (int k = 0; k < WALL_CNT; ++k) {
+            const Wall *w = &g_walls.walls[k];
+            if (glm_vec3_dot((float*) w->normal, b->center) + w->distance - radius < slop) {
+                XpbdContactArr_push(dest, (XpbdContact) {
+                    .kind = XC_WALL, .i1 = -1, .i2 = i, .index = k, .damping = params->wall.damping
+                });
+            }
+        }
+    }
+
+    if (params->obs.enabled) {
+        const Grid *grid = &g_obstacleGrid.grid;
+        int cell[2];
+        grid_cellCoords(grid, (vec2) { b->center[0], b->center[2] }, cell);
+        int xLo = glm_imax(cell[0] - 1, 0);
+        int xHi = glm_imin(cell[0] + 1, grid->dimX - 1);
+
+        int hits[OBSTACLE_SLOTS_PER_CHUNK];
+        for (int y = cell[1] - 1; y <= cell[1] + 1; ++y) {
+            if (y < 0 || y >= grid->dimY) continue;
+
+            int rowBegin, rowEnd, unused;
+            grid_cellRange(grid, xLo, y, &rowBegin, &unused);
+            grid_cellRange(grid, xHi, y, &unused, &rowEnd);
+
+            for (int begin = rowBegin; begin < rowEnd; begin += OBSTACLE_SLOTS_PER_CHUNK) {
+                int end = glm_imin(begin + OBSTACLE_SLOTS_PER_CHUNK, rowEnd);
+                int count = obstacletable_findContacts(params->kernel, &g_obstacleTable, begin, end, b->center,
+                    radius + slop, hits);
+                for (int k = 0; k < count; ++k) {
+                    XpbdContactArr_push(dest, (XpbdContact) {
+                        .kind = XC_OBSTACLE, .i1 = -1, .i2 = i, .index = hits[k], .damping = params->obs.damping
+                    });
+                }
+            }
+        }
+    }
+
+    if (params->ball.enabled) {
+        float reach = 2.0f * radius + slop;
+        const Grid *grid = &g_ballGrid.grid;
+        int cell[2];
+        grid_cellCoords(grid, (vec2) { b->center[0], b->center[2] }, cell);
+
+        for (int y = cell[1] - 1; y <= cell[1] + 1; ++y) {
+            if (y < 0 || y >= grid->dimY) continue;
+
+            for (int x = cell[0] - 1; x <= cell[0] + 1; ++x) {
+                if (x < 0 || x >= grid->dimX) continue;
+
+                int begin, end;
+                grid_cellRange(grid, x, y, &begin, &end);
+
+                for (int slot = begin; slot < end; ++slot) {
+                    int i2 = g_ballGrid.ballIdx[grid->sortedIdx[slot]];
+                    if (i2 <= i || glm_vec3_distance2(b->center, g_balls.data[i2].center) >= reach * reach) {
+                        continue;
+                    }
+                    XpbdContactArr_push(dest, (XpbdContact) {
+                        .kind = XC_BALL, .i1 = i, .i2 = i2, .damping = params->ball.damping
+                    });
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Finds the XPBD contacts of a range of balls into the list of the chunk.
+ */
+static void xpbdContactsJob(int begin, int end, int chunk, void *userData) {
+    BallPass *pass = userData;
+    XpbdContactArr *dest = &g_xpbd.chunkContacts[chunk];
+    XpbdContactArr_clear(dest);
+
+    for (int i = begin; i < end; ++i) {
+        if (isStepping(&g_balls.data[i])) {
+            findXpbdContacts(pass->params, i, dest);
+        }
+    }
+}
+
+/**
+ * Computes the multiplier changes of a range of contacts, the Jacobi
+ * iteration reads the centers of the last one only.
+ */
+static void xpbdSolveJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    BallPass *pass = userData;
+
+    for (int k = begin; k < end; ++k) {
+        solveXpbdContact(pass->params, &g_xpbd.contacts.data[k]);
+    }
+}
+
+/**
+ * Moves a range of balls by the average correction of their contacts.
+ */
+static void xpbdGatherJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    BallPass *pass = userData;
+    float w = 1.0f / pass->params->mass;
+
+    for (int i = begin; i < end; ++i) {
+        int count = g_xpbd.first[i + 1] - g_xpbd.first[i];
+        if (count == 0) {
+            continue;
+        }
+
+        vec3 sum = GLM_VEC3_ZERO_INIT;
+        for (int a = g_xpbd.first[i]; a < g_xpbd.first[i + 1]; ++a) {
+            const XpbdContact *c = &g_xpbd.contacts.data[g_xpbd.adjacency[a]];
+            glm_vec3_muladds((float*) c->normal, c->i2 == i ? c->dLambda : -c->dLambda, sum);
+        }
+        moveXpbdBall(&g_balls.data[i], sum, w * XPBD_JACOBI_RELAXATION / count);
+    }
+}
+
+/**
+ * Builds the contact indices per ball for the Jacobi gather.
+ */
+static void buildXpbdAdjacency(void) {
+    int balls = g_balls.size;
+    int entries = 2 * (int) g_xpbd.contacts.size;
+    if (g_xpbd.ballCapacity < balls + 1) {
+        g_xpbd.ballCapacity = (balls + 1) * 2;
+        g_xpbd.first = TRACKED_REALLOC(g_xpbd.first, g_xpbd.ballCapacity * sizeof(int));
+        assert(g_xpbd.first && "realloc failed in buildXpbdAdjacency");
+    }
+    if (g_xpbd.adjacencyCapacity < entries) {
+        g_xpbd.adjacencyCapacity = entries * 2;
+        g_xpbd.adjacency = TRACKED_REALLOC(g_xpbd.adjacency, g_xpbd.adjacencyCapacity * sizeof(int));
+        assert(g_xpbd.adjacency && "realloc failed in buildXpbdAdjacency");
+    }
+
+    // Counts shifted by one, the prefix sum turns them into the first index
+    memset(g_xpbd.first, 0, (balls + 1) * sizeof(int));
+    for (size_t k = 0; k < g_xpbd.contacts.size; ++k) {
+        const XpbdContact *c = &g_xpbd.contacts.data[k];
+        ++g_xpbd.first[c->i2 + 1];
+        if (c->i1 >= 0) {
+            ++g_xpbd.first[c->i1 + 1];
+        }
+    }
+    for (int i = 0; i < balls; ++i) {
+        g_xpbd.first[i + 1] += g_xpbd.first[i];
+    }
+
+    // Filled back to front, first[i + 1] ends at the start of ball i
+    int total = g_xpbd.first[balls];
+    for (int k = (int) g_xpbd.contacts.size - 1; k >= 0; --k) {
+        const XpbdContact *c = &g_xpbd.contacts.data[k];
+        g_xpbd.adjacency[--g_xpbd.first[c->i2 + 1]] = k;
+        if (c->i1 >= 0) {
+            g_xpbd.adjacency[--g_xpbd.first[c->i1 + 1]] = k;
+        }
+    }
+    for (int i = 0; i < balls; ++i) {
+        g_xpbd.first[i] = g_xpbd.first[i + 1];
+    }
+    g_xpbd.first[balls] = total;
+}
+
+/**
+ * Extended position-based contact solve of the stepping balls, after the
+ * integration moved them by gravity and black holes only. The contacts
+ * are found once at the predicted centers and solved as position
+ * constraints, one after another (Gauss-Seidel) or all from the same
+ * centers with averaged corrections per ball (Jacobi, on the job pool).
+ * The velocity is then the move over the substep, touching bodies that
+ * approached each other bounce off with the damping of their collision.
+ *
+ * @param params Parameters of the step
+ */
+static void solveXpbdContacts(const SimParams *params) {
+    double t = glfwGetTime();
+    float radius = params->ballRadius;
+    float dt = params->fixedDt;
+    g_xpbd.compliance = params->compliance / (dt * dt);
+
+    // The normal is kept during the integration, so is the center offset
+    vec3 *velocity = Vec3Arr_resizeUninit(&g_xpbd.velocity, g_balls.size);
+    for (int i = 0; i < g_balls.size; ++i) {
+        Ball *b = &g_balls.data[i];
+        if (isStepping(b)) {
+            glm_vec3_copy(b->contact.normal, b->center);
+            glm_vec3_scale(b->center, radius, b->center);
+            glm_vec3_add(b->center, b->contact.point, b->center);
+        }
+        glm_vec3_copy(b->velocity, velocity[i]);
+    }
+
+    if (params->ball.enabled) {
+        buildBallGrid(params);
+    }
+
+    BallPass pass = {
+        .params = params,
+        .parallel = useParallelSolve(params)
+    };
+    runBallPass(&pass, xpbdContactsJob);
+
+    XpbdContactArr_clear(&g_xpbd.contacts);
+    int chunks = pass.parallel ? jobs_chunkCount(g_balls.size, BALLS_PER_CHUNK) : 1;
+    for (int c = 0; c < chunks; ++c) {
+        XpbdContactArr_appendN(&g_xpbd.contacts, g_xpbd.chunkContacts[c].data, g_xpbd.chunkContacts[c].size);
+    }
+
+    int count = (int) g_xpbd.contacts.size;
+    int iterations = glm_imin(glm_imax(params->solverIterations, 1), PHYSICS_MAX_SOLVER_ITERATIONS);
+    float w = 1.0f / params->mass;
+
+    if (params->solver == CS_XPBD_JACOBI) {
+        buildXpbdAdjacency();
+        bool parallel = pass.parallel && count >= CONTACTS_PER_CHUNK;
+        for (int it = 0; it < iterations; ++it) {
+            if (parallel) {
+                jobs_parallelFor(count, CONTACTS_PER_CHUNK, xpbdSolveJob, &pass);
+            } else {
+                xpbdSolveJob(0, count, 0, &pass);
+            }
+            runBallPass(&pass, xpbdGatherJob);
+        }
+    } else {
+        for (int it = 0; it < iterations; ++it) {
+            for (int k = 0; k < count; ++k) {
+                XpbdContact *c = &g_xpbd.contacts.data[k];
+                solveXpbdContact(params, c);
+                moveXpbdBall(&g_balls.data[c->i2], c->normal, w * c->dLambda);
+                if (c->i1 >= 0) {
+                    moveXpbdBall(&g_balls.data[c->i1], c->normal, -w * c->dLambda);
+                }
+            }
+        }
+    }
+
+    // Velocity from the move, the substep starts are those of the sweep
+    for (int i = 0; i < g_balls.size; ++i) {
+        Ball *b = &g_balls.data[i];
+        if (isStepping(b)) {
+            glm_vec3_sub(b->contact.point, g_sweepStart.data[i], b->velocity);
+            glm_vec3_scale(b->velocity, 1.0f / dt, b->velocity);
+        }
+    }
+
+    // Restitution of the contacts that are still touching
+    float slop = XPBD_SLOP * radius;
+    for (int k = 0; k < count; ++k) {
+        XpbdContact *c = &g_xpbd.contacts.data[k];
+        if (evalXpbdContact(params, c) >= slop) {
+            continue;
+        }
+
+        Ball *b2 = &g_balls.data[c->i2];
+        Ball *b1 = c->i1 >= 0 ? &g_balls.data[c->i1] : NULL;
+        float approach = glm_vec3_dot(velocity[c->i2], c->normal);
+        float current = glm_vec3_dot(b2->velocity, c->normal);
+        if (b1) {
+            approach -= glm_vec3_dot(velocity[c->i1], c->normal);
+            current -= glm_vec3_dot(b1->velocity, c->normal);
+        }
+        if (approach >= 0.0f) {
+            continue;
+        }
+
+        float dv = -c->damping * approach - current;
+        if (b1) {
+            glm_vec3_muladds(c->normal, 0.5f * dv, b2->velocity);
+            glm_vec3_muladds(c->normal, -0.5f * dv, b1->velocity);
+        } else {
+            glm_vec3_muladds(c->normal, dv, b2->velocity);
+        }
+    }
+    endPhase(PP_BALL, t);
+}
+
+/**
+ * Grows the contact batch scratch arrays.
+ *
+ * @param count Required number of entries
+ */
+static void reserveContactBatch(int count) {
+    if (g_contactBatch.capacity >= count) {
+        return;
+    }
+
+    int newCap = g_contactBatch.capacity ? g_contactBatch.capacity * 2 : 64;
+    if (newCap < count) newCap = count;
+
+    g_contactBatch.ballIdx = TRACKED_REALLOC(g_contactBatch.ballIdx, newCap * sizeof(int));
+    g_contactBatch.points = TRACKED_REALLOC(g_contactBatch.points, newCap * sizeof(vec3));
+    g_contactBatch.normals = TRACKED_REALLOC(g_contactBatch.normals, newCap * sizeof(vec3));
+    g_contactBatch.s = TRACKED_REALLOC(g_contactBatch.s, newCap * sizeof(float));
+    g_contactBatch.t = TRACKED_REALLOC(g_contactBatch.t, newCap * sizeof(float));
+    assert(g_contactBatch.ballIdx && g_contactBatch.points && g_contactBatch.normals
+        && g_contactBatch.s && g_contactBatch.t && "realloc failed in reserveContactBatch");
+    g_contactBatch.capacity = newCap;
+}
+
+/**
+ * Projects the contact points of all balls back onto the surface
+ * in one batched call and updates the ball centers.
+ * Each projection is warm-started from the last contact of the ball.
+ *
+ * @param params Parameters of the step
+ */
+static void projectContacts(const SimParams *params) {
+    reserveContactBatch(g_balls.size);
+
+    int count = 0;
+    for (int i = 0; i < g_balls.size; ++i) {
+        if (!isStepping(&g_balls.data[i])) {
+            continue;
+        }
+        g_contactBatch.ballIdx[count] = i;
+        glm_vec3_copy(g_balls.data[i].contact.point, g_contactBatch.points[count]);
+        g_contactBatch.s[count] = g_balls.data[i].contact.s;
+        g_contactBatch.t[count] = g_balls.data[i].contact.t;
+        ++count;
+    }
+
+    logic_closestSplinePointsTo(count, g_contactBatch.points, g_contactBatch.s, g_contactBatch.t);
+    bool evaluated = logic_evalSplineBatch(
+        params, count, g_contactBatch.t, g_contactBatch.s,
+        g_contactBatch.points, g_contactBatch.normals
+    );
+
+    for (int k = 0; k < count; ++k) {
+        Ball *b = &g_balls.data[g_contactBatch.ballIdx[k]];
+        b->contact.s = g_contactBatch.s[k];
+        b->contact.t = g_contactBatch.t[k];
+
+        if (evaluated) {
+            glm_vec3_copy(g_contactBatch.points[k], b->contact.point);
+            glm_vec3_copy(g_contactBatch.normals[k], b->contact.normal);
+        }
+
+        applyContactPoint(b, params->ballRadius);
+    }
+}
+
+/**
+ * Swap-removes all balls captured in this step,
+ * so later passes only iterate live balls.
+ */
+static void compactBalls(void) {
+    int i = 0;
+    while (i < (int) g_balls.size) {
+        if (g_balls.data[i].active) {
+            ++i;
+            continue;
+        }
+        BallArr_removeSwap(&g_balls, i);
+        ++g_capturedBalls;
+    }
+}
+
+/**
+ * Runs one substep: broad phase, forces, integration and contact
+ * projection of the balls stepping on it.
+ *
+ * @param data Input data containing obstacle data
+ * @param params Parameters of the step
+ * @param first First substep of the fixed step
+ */
+static void stepBalls(InputData *data, const SimParams *params, bool first) {
+    TIMELINE_BEGIN("Broad Phase");
+    PERFCOUNT_BEGIN("Broad Phase");
+    double t = glfwGetTime();
+
+    // moved obstacles or black holes can push resting balls
+    if (first) {
+        bool staticChanged = params->obs.enabled && updateObstacleGrid(data, params);
+        staticChanged |= updateBlackHoleGrid(params);
+        if (staticChanged || !params->sleep.enabled) {
+            wakeAllBalls();
+        }
+    }
+
+    if (params->ball.enabled) {
+        buildBallGrid(params);
+        if (first && wakeTouchedBalls(params) > 0) {
+            buildBallGrid(params);
+        }
+    }
+    endPhase(PP_BROAD_PHASE, t);
+    PERFCOUNT_END();
+    TIMELINE_END();
+
+    // apply all collision forces and black hole attraction
+    TIMELINE_BEGIN("Forces");
+    PERFCOUNT_BEGIN("Forces");
+    Obstacle *obstacles = data->game.obstacles.data;
+    evaluateForces(params, obstacles, true);
+    promoteLevels(params);
+
+    int liveBalls = g_balls.size;
+    compactBalls();
+    PERFCOUNT_END();
+    TIMELINE_END();
+
+    Integrator integrator = params->integrator;
+    bool multiStage = integrator == IG_VERLET || integrator == IG_RK4;
+
+    // The extra evaluations need the grid over the compacted indices
+    TIMELINE_BEGIN("Integrate");
+    PERFCOUNT_BEGIN("Integrate");
+    t = glfwGetTime();
+    if (multiStage && params->ball.enabled && g_balls.size != liveBalls) {
+        buildBallGrid(params);
+    }
+    t = endPhase(PP_BROAD_PHASE, t);
+    double nestedForces = forcePhaseSeconds();
+
+    bool xpbd = params->solver != CS_PENALTY;
+    if (params->sweep || xpbd) {
+        vec3 *start = Vec3Arr_resizeUninit(&g_sweepStart, g_balls.size);
+        for (int i = 0; i < g_balls.size; ++i) {
+            glm_vec3_copy(g_balls.data[i].contact.point, start[i]);
+        }
+    }
+
+    // integrate with new acceleration
+    switch (integrator) {
+        case IG_VERLET:
+            integrateVerlet(params, obstacles);
+            break;
+        case IG_RK4:
+            integrateRk4(params, obstacles);
+            break;
+        case IG_EULER:
+        case IG_SYMPLECTIC:
+        default: {
+            BallPass pass = {
+                .params = params,
+                .parallel = useParallelSolve(params)
+            };
+            runBallPass(&pass, integrateJob);
+            break;
+        }
+    }
+
+    // Fast balls must not pass through what the penalty springs only see at the end
+    if (params->sweep) {
+        BallPass pass = {
+            .params = params,
+            .parallel = useParallelSolve(params)
+        };
+        runBallPass(&pass, sweepJob);
+    }
+
+    if (xpbd) {
+        solveXpbdContacts(params);
+    }
+    PERFCOUNT_END();
+    TIMELINE_END();
+
+    TIMELINE_BEGIN("Contacts");
+    projectContacts(params);
+    TIMELINE_END();
+
+    // The stage evaluations already counted to the force phases
+    endPhase(PP_INTEGRATE, t);
+    g_phaseTimes.seconds[PP_INTEGRATE] -= forcePhaseSeconds() - nestedForces;
+}
+
+/**
+ * Main ball physics update using the selected integrator and penalty method.
+ * Without stiff contacts every ball takes one substep, balls in stiff
+ * contacts take the substeps of their level.
+ *
+ * @param data Input data containing obstacle data
+ * @param params Parameters of the step
+ */
+static void updateBalls(InputData *data, const SimParams *params) {
+    TIMELINE_BEGIN("Ball Step");
+    PERFCOUNT_BEGIN("Ball Step");
+
+    // keep the last state for render interpolation
+    for (int i = 0; i < g_balls.size; ++i) {
+        glm_vec3_copy(g_balls.data[i].center, g_balls.data[i].prevCenter);
+    }
+
+    assignLevels(params);
+    int substeps = 1 << g_multiRate.maxLevel;
+    for (int s = 0; s < substeps; ++s) {
+        // Substeps no awake ball steps on are skipped
+        int period = 1 << (g_multiRate.maxLevel - g_multiRate.topLevel);
+        if (s & (period - 1)) {
+            continue;
+        }
+
+        g_multiRate.substep = s;
+        stepBalls(data, params, s == 0);
+    }
+    g_multiRate.substep = 0;
+    g_multiRate.lastSubsteps = g_multiRate.ballSubsteps;
+
+    TIMELINE_BEGIN("Contacts");
+    double t = glfwGetTime();
+    updateSleep(params);
+
+    for (int i = 0; i < g_balls.size; ++i) {
+        if (!g_balls.data[i].sleeping) {
+            checkGoalReached(&g_balls.data[i]);
+        }
+    }
+    endPhase(PP_INTEGRATE, t);
+    ++g_phaseTimes.steps;
+    TIMELINE_END();
+    PERFCOUNT_END();
+    TIMELINE_END();
+}
+
+/**
+ * Appends the balls after a fixed step to the recording.
+ * The ball array is traced as is, without copying.
+ */
+static void recordStep(void) {
+    TraceGlobals globals = {
+        .capturedBalls = g_capturedBalls,
+        .goalReached = g_goal.reached
+    };
+    trace_recordFrame(&globals, g_balls.data, (uint32_t) g_balls.size);
+}
 
-    // Decompose gravity into normal and tangential components
-    vec3 l, f;
-    float gDotN = glm_vec3_dot(gravity, b->contact.normal);
-    glm_vec3_scale(b->contact.normal, gDotN, l); // normal comp.
-    glm_vec3_sub(gravity, l, f); // tangent comp
+/**
+ * Replaces the integration of a fixed step with the next recorded step.
+ * The replay loops back to the first step at the end.
+ */
+static void replayStep(void) {
+    const void *globals;
+    uint32_t count;
+    const Ball *balls = trace_readFrame(g_replayFrame, &globals, &count);
+    g_replayFrame = (g_replayFrame + 1) % trace_getReplayFrames();
+    if (!balls) {
+        return;
+    }
 
-    // force to accel: a = f / m
-    glm_vec3_scale(f, 1.0f / mass, b->acceleration);
+    memcpy(BallArr_resizeUninit(&g_balls, count), balls, count * sizeof(Ball));
+
+    const TraceGlobals *g = globals;
+    g_capturedBalls = g->capturedBalls;
+    g_goal.reached = g->goalReached != 0;
 }
 
 /**
- * Performs one Euler integration step for ball physics.
+ * Starts or stops recording and replay if the requested trace mode changed.
+ * A replay takes over the fixed dt of the trace,
+ * a mode that fails to start falls back to RM_OFF.
  *
- * @param b Ball to update
- * @param dt Time step
- * @param friction Velocity damping factor
- * @param ballRadius Ball radius
+ * @param data Input data containing the requested trace mode
  */
-static void applyIntegration(Ball *b, float dt, float friction, float ballRadius) {
-    assert(b != NULL);
+static void syncReplayMode(InputData *data) {
+    if (data->physics.replayMode == g_activeReplayMode) {
+        return;
+    }
 
-    // Euler integration: v += a * dt
-    vec3 accelDt;
-    glm_vec3_scale(b->acceleration, dt, accelDt);
-    glm_vec3_add(b->velocity, accelDt, b->velocity);
+    if (g_activeReplayMode == RM_RECORD) {
+        trace_endRecord();
+        printf("Recorded %d steps to %s\n", trace_getRecordedFrames(), TRACE_FILE);
+    } else if (g_activeReplayMode == RM_REPLAY) {
+        trace_closeReplay();
+    }
+    g_activeReplayMode = RM_OFF;
+
+    TraceLayout layout = {
+        .kind = TRACE_BALLS,
+        .globalsSize = sizeof(TraceGlobals),
+        .recordSize = sizeof(Ball),
+        .fixedDt = data->physics.fixedDt,
+        .delta = data->physics.traceDelta
+    };
+
+    if (data->physics.replayMode == RM_RECORD && trace_beginRecord(TRACE_FILE, &layout)) {
+        g_activeReplayMode = RM_RECORD;
+    } else if (data->physics.replayMode == RM_REPLAY && trace_openReplay(TRACE_FILE, &layout)) {
+        g_activeReplayMode = RM_REPLAY;
+        g_replayFrame = 0;
+        data->physics.fixedDt = layout.fixedDt;
+    }
 
-    // Apply friction
-    glm_vec3_scale(b->velocity, friction, b->velocity);
+    data->physics.replayMode = g_activeReplayMode;
+}
 
-    // Euler integration: s += v * dt
-    vec3 vMulDt = {0};
-    glm_vec3_scale(b->velocity, dt, vMulDt);
-    glm_vec3_add(b->contact.point, vMulDt, b->contact.point);
+/**
+ * Grows the staging of the GPU ball transfers to hold count balls.
+ *
+ * @param count Required number of balls
+ */
+static void reserveGpuStaging(int count) {
+    if (g_gpuBalls.capacity >= count) {
+        return;
+    }
 
-    // Project contact point back onto surface
-    logic_closestSplinePointTo(b->contact.point, &b->contact.s, &b->contact.t);
-    logic_evalSplineGlobal(b->contact.t, b->contact.s, b->contact.point, b->contact.normal);
+    int newCap = g_gpuBalls.capacity ? g_gpuBalls.capacity * 2 : 64;
+    if (newCap < count) newCap = count;
 
-    // Update ball center
-    applyContactPoint(b, ballRadius);
+    g_gpuBalls.staging = TRACKED_REALLOC(g_gpuBalls.staging, newCap * sizeof(GpuBall));
+    assert(g_gpuBalls.staging && "realloc failed in reserveGpuStaging");
+    g_gpuBalls.capacity = newCap;
 }
 
 /**
- * Main ball physics update using Euler integration and penalty method.
+ * Hands all balls to the GPU solve, sleeping balls wake up.
  *
  * @param data Input data containing physics
  */
-static void updateBalls(InputData *data) {
-    float dt = data->physics.fixedDt;
-    vec3 gravity = {0, -data->physics.gravity, 0};
-    float friction = data->physics.frictionFactor;
-    float radius = data->physics.ballRadius;
-    float mass = data->physics.mass;
+static void uploadGpuBalls(InputData *data) {
+    int count = (int) g_balls.size;
+    reserveGpuStaging(count);
 
-    // update acceleration
-    for (int i = 0; i < g_balls.size; ++i) {
-        if (!g_balls.data[i].active) continue;
-        applyExternForces(&g_balls.data[i], gravity, mass);
+    for (int i = 0; i < count; ++i) {
+        Ball *b = &g_balls.data[i];
+        GpuBall *g = &g_gpuBalls.staging[i];
+        glm_vec4(b->center, data->physics.ballRadius, g->center);
+        glm_vec4(b->velocity, 0.0f, g->velocity);
+        glm_vec4(b->contact.point, 0.0f, g->contact);
+        glm_vec4(b->contact.normal, 0.0f, g->normal);
     }
+    ballcompute_upload(count, g_gpuBalls.staging);
 
-    // apply all collision forces and black hole attraction
-    for (int i = 0; i < g_balls.size; ++i) {
-        Ball *b = &g_balls.data[i];
-        if (!b->active) continue;
+    g_gpuBalls.count = count;
+    g_gpuBalls.captured = 0;
+    g_gpuBalls.active = true;
+}
 
-        handleWallCollision(data, b);
-        handleBallCollisions(data, b, i);
-        handleObstacleCollisions(data, b);
-        handleBlackHoleAttraction(data, b);
+/**
+ * Takes the balls back from the GPU solve if it has them.
+ * Captured balls are dropped and counted, the surface coords of the
+ * contacts are recovered by projecting onto the spline.
+ */
+static void downloadGpuBalls(void) {
+    if (!g_gpuBalls.active) {
+        return;
     }
+    g_gpuBalls.active = false;
 
-    // integrate with new acceleration
-    for (int i = 0; i < g_balls.size; ++i) {
-        if (!g_balls.data[i].active) continue;
-        applyIntegration(&g_balls.data[i], dt, friction, radius);
-        checkGoalReached(&g_balls.data[i]);
+    int count = g_gpuBalls.count;
+    reserveGpuStaging(count);
+    ballcompute_download(count, g_gpuBalls.staging);
+
+    BallArr_clear(&g_balls);
+    BallArr_reserve(&g_balls, count);
+    for (int i = 0; i < count; ++i) {
+        GpuBall *g = &g_gpuBalls.staging[i];
+        if (g->center[3] == 0.0f) {
+            ++g_capturedBalls;
+            continue;
+        }
+
+        Ball b = { .active = true };
+        glm_vec3_copy(g->center, b.center);
+        glm_vec3_copy(g->velocity, b.velocity);
+        glm_vec3_copy(g->contact, b.contact.point);
+        glm_vec3_copy(g->normal, b.contact.normal);
+        logic_closestSplinePointTo(b.contact.point, &b.contact.s, &b.contact.t);
+        spawnBall(&b);
+    }
+}
+
+/**
+ * Runs the fixed steps due after dt and caps the backlog.
+ *
+ * @param data Input data containing simulation parameters
+ * @param dt Elapsed time
+ * @return Number of steps run
+ */
+static int runFixedSteps(InputData *data, float dt) {
+    data->physics.dtAccumulator += dt;
+
+    int steps = 0;
+    while (data->physics.dtAccumulator >= data->physics.fixedDt && steps < data->physics.maxSteps) {
+        if (g_gpuBalls.active) {
+            ballcompute_step();
+        } else if (g_activeReplayMode == RM_REPLAY) {
+            replayStep();
+        } else {
+            // One snapshot per step, the GUI may change the live values meanwhile
+            SimParams params;
+            input_getSimParams(data, &params);
+            updateBalls(data, &params);
+            if (g_activeReplayMode == RM_RECORD) {
+                recordStep();
+            }
+        }
+        data->physics.dtAccumulator -= data->physics.fixedDt;
+        ++steps;
+    }
+
+    // Catch-up cap: keep at most one frame budget of backlog, drop the rest
+    float maxBacklog = data->physics.maxSteps * data->physics.fixedDt;
+    if (data->physics.dtAccumulator > maxBacklog) {
+        data->physics.dtAccumulator = maxBacklog;
+    }
+    metrics_count(METRIC_STEPS, steps);
+    return steps;
+}
+
+/**
+ * Copies the current balls into a snapshot.
+ *
+ * @param s Destination
+ * @param time Wall-clock time of the state
+ */
+static void fillSnapshot(Snapshot *s, double time) {
+    BallArr_clear(&s->balls);
+    BallArr_appendN(&s->balls, g_balls.data, g_balls.size);
+    s->time = time;
+}
+
+/**
+ * Publishes the balls after the last step, runs on the simulation thread.
+ * Never blocks, the previous shared snapshot becomes the next back buffer.
+ *
+ * @param time Wall-clock time of the state
+ */
+static void publishSnapshot(double time) {
+    fillSnapshot(&g_sim.snapshots[g_sim.back], time);
+
+    long prev = ATOMIC_EXCHANGE(&g_sim.shared, g_sim.back | SNAPSHOT_FRESH);
+    g_sim.back = (int) (prev & ~SNAPSHOT_FRESH);
+}
+
+/**
+ * Runs the fixed steps at wall-clock rate until the thread is stopped.
+ */
+static void simLoop(void) {
+    InputData *data = getInputData();
+    double last = glfwGetTime();
+
+    while (!ATOMIC_LOAD(&g_sim.stop)) {
+        double now = glfwGetTime();
+        bool paused = data->game.paused || data->paused;
+        float dt = paused ? 0.0f : (float) (now - last);
+        last = now;
+
+        MUTEX_LOCK(&g_sim.mutex);
+        syncReplayMode(data);
+        int steps = runFixedSteps(data, dt);
+        if (steps > 0) {
+            publishSnapshot(now);
+        }
+        MUTEX_UNLOCK(&g_sim.mutex);
+
+        if (steps == 0) {
+            THREAD_SLEEP_MS(SIM_SLEEP_MS);
+        }
+    }
+}
+
+/**
+ * Simulation thread entry.
+ */
+static THREAD_ENTRY(simMain) {
+    NK_UNUSED(arg);
+    timeline_setThreadName("Simulation");
+    simLoop();
+    THREAD_RETURN;
+}
+
+/**
+ * Starts the simulation thread, all snapshots start from the current balls.
+ *
+ * @return False if the thread could not be created
+ */
+static bool startSimThread(void) {
+    double now = glfwGetTime();
+    for (int i = 0; i < SNAPSHOT_COUNT; ++i) {
+        fillSnapshot(&g_sim.snapshots[i], now);
+    }
+    g_sim.front = 0;
+    g_sim.shared = 1;
+    g_sim.back = 2;
+    g_sim.stop = 0;
+
+    MUTEX_INIT(&g_sim.mutex);
+    g_sim.running = true;
+    if (!THREAD_CREATE(&g_sim.thread, simMain)) {
+        printf("Could not create the simulation thread, stepping on the render thread!\n");
+        MUTEX_DESTROY(&g_sim.mutex);
+        g_sim.running = false;
+    }
+    return g_sim.running;
+}
+
+/**
+ * Stops the simulation thread, the main thread owns the state again.
+ * Must not be called between physics_lock and physics_unlock.
+ */
+static void stopSimThread(void) {
+    if (!g_sim.running) {
+        return;
+    }
+
+    ATOMIC_EXCHANGE(&g_sim.stop, 1);
+    THREAD_JOIN(g_sim.thread);
+    MUTEX_DESTROY(&g_sim.mutex);
+    g_sim.running = false;
+}
+
+/**
+ * Steps the balls on the GPU. Tracing is not supported there,
+ * the balls are neither interpolated nor put to sleep.
+ *
+ * @param data Input data containing simulation parameters
+ * @return False if the GPU solve is not available
+ */
+static bool updateGpuBalls(InputData *data) {
+    data->physics.replayMode = RM_OFF;
+    syncReplayMode(data);
+
+    if (!g_gpuBalls.active) {
+        uploadGpuBalls(data);
+    }
+
+    vec3 holes[BALLCOMPUTE_MAX_BLACK_HOLES];
+    int holeCount = glm_imin((int) g_blackHoles.size, BALLCOMPUTE_MAX_BLACK_HOLES);
+    for (int i = 0; i < holeCount; ++i) {
+        glm_vec3_copy(g_blackHoles.data[i].position, holes[i]);
+    }
+    vec2 walls = { g_walls.walls[1].distance, g_walls.walls[3].distance };
+
+    if (!ballcompute_setParams(data, holes, holeCount, g_goal.position, g_goal.radius, walls)) {
+        downloadGpuBalls();
+        return false;
+    }
+
+    if (!data->game.paused && !data->paused) {
+        runFixedSteps(data, data->deltaTime);
     }
+
+    int captured;
+    bool goalReached;
+    if (ballcompute_readEvents(&captured, &goalReached)) {
+        g_gpuBalls.captured = captured;
+        g_goal.reached |= goalReached;
+    }
+    return true;
 }
 
 /**
- * Randomizes all obstacle positions on the surface.
- * Obstacles 0-3 are perpendicular to surface axes.
- * Obstacles 4-5 are parallel to surface axes.
+ * Takes the latest snapshot if there is a new one. Lock-free, except
+ * while paused, where the main thread copies the edited balls itself.
  *
- * @param data Input data containing obstacle array
+ * @param data Input data containing the pause state
+ */
+static void presentSnapshot(InputData *data) {
+    if (ATOMIC_LOAD(&g_sim.shared) & SNAPSHOT_FRESH) {
+        long shared = ATOMIC_EXCHANGE(&g_sim.shared, g_sim.front);
+        g_sim.front = (int) (shared & ~SNAPSHOT_FRESH);
+    } else if (data->game.paused || data->paused) {
+        // Called under physics_lock, no step can run meanwhile
+        fillSnapshot(&g_sim.snapshots[g_sim.front], glfwGetTime());
+    }
+}
+
+/**
+ * Input of the parallel ball submission.
  */
-static void randomizeObstacles(InputData *data) {
-    for (int i = 0; i < OBSTACLE_COUNT; ++i) {
-        Obstacle *o = &data->game.obstacles[i];
+typedef struct {
+    const BallArr *balls;
+    float alpha;
+    float radius;
+    RenderBatch batch;
+} DrawBallsJob;
 
-        bool isParallel = (i >= 4);
-        o->gS = RAND01;
-        o->gT = RAND01;
-        o->width = isParallel ? 0.2f : 0.05f;
-        o->length = isParallel ? 0.05f : 0.2f;
-        o->height = OBSTACLE_HEIGHT;
-        logic_evalSplineGlobal(o->gT, o->gS, o->center, o->normal);
+/**
+ * Records the interpolated balls of a chunk into the render queue.
+ *
+ * @param begin First ball
+ * @param end One past the last ball
+ * @param chunk Chunk index (unused)
+ * @param userData DrawBallsJob
+ */
+static void drawBallsJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    const DrawBallsJob *job = userData;
+    for (int i = begin; i < end; ++i) {
+        const Ball *b = &job->balls->data[i];
+        vec3 center;
+        glm_vec3_lerp((float*) b->prevCenter, (float*) b->center, job->alpha, center);
+        renderqueue_setModel(&job->batch, i, center, job->radius, VEC3X(1));
     }
 }
 
+/**
+ * Draws the balls of the GPU solve straight from its ball buffer,
+ * called by the render queue.
+ *
+ * @param userData Unused
+ */
+static void drawGpuBallsItem(void *userData) {
+    NK_UNUSED(userData);
+
+    mat4 viewMat;
+    scene_getMV(viewMat);
+    model_drawInstancedBuffer(
+        MODEL_SPHERE, &BALL_MAT, &viewMat, ballcompute_getBallBuffer(), sizeof(GpuBall), g_gpuBalls.count
+    );
+}
+
 ////////////////////////    PUBLIC    ////////////////////////////
 
 void physics_init(void) {
     InputData *data = getInputData();
     data->physics.dtAccumulator = 0.0f;
     g_balls.size = DEFAULT_BALL_NUM;
+    g_capturedBalls = 0;
+    g_gpuBalls.active = false;
 
     physics_orderBallsAroundMax();
     initWalls();
@@ -668,20 +2899,26 @@ void physics_init(void) {
     BlackHoleArr_init(&g_blackHoles);
     initBlackHoles();
     initGoal();
-    randomizeObstacles(data);
+    obstacles_regenerate(data);
 }
 
 void physics_addBall(void) {
+    downloadGpuBalls();
     Ball b = DEFAULT_BALL((float) DEFAULT_BALL_NUM * RAND01);
 
     logic_evalSplineGlobal(b.contact.t, b.contact.s, b.contact.point, b.contact.normal);
     applyContactPoint(&b, getInputData()->physics.ballRadius);
 
-    BallArr_push(&g_balls, b);
+    spawnBall(&b);
 }
 
 void physics_removeBall(void) {
-    BallArr_popBack(&g_balls);
+    downloadGpuBalls();
+    if (g_balls.size > 0) {
+        BallArr_popBack(&g_balls);
+    } else if (g_capturedBalls > 0) {
+        --g_capturedBalls;
+    }
 }
 
 void physics_addBlackHole(void) {
@@ -694,115 +2931,156 @@ void physics_addBlackHole(void) {
     logic_evalSplineGlobal(t, s, bh.position, normal);
 
     BlackHoleArr_push(&g_blackHoles, bh);
+    g_blackHoleGrid.dirty = true;
 }
 
 void physics_removeBlackHole(void) {
     BlackHoleArr_popBack(&g_blackHoles);
+    g_blackHoleGrid.dirty = true;
 }
 
 void physics_update(void) {
     InputData *data = getInputData();
-    if (data->game.paused || data->paused) {
+    if (g_sim.running) {
+        presentSnapshot(data);
         return;
     }
 
-    data->physics.dtAccumulator += data->deltaTime;
+    if (data->physics.gpu && !updateGpuBalls(data)) {
+        printf("GPU ball physics not available, stepping on the CPU!\n");
+        data->physics.gpu = false;
+    }
+    if (data->physics.gpu) {
+        return;
+    }
+    downloadGpuBalls();
 
-    while (data->physics.dtAccumulator >= data->physics.fixedDt) {
-        updateBalls(data);
-        data->physics.dtAccumulator -= data->physics.fixedDt;
+    if (data->game.paused || data->paused) {
+        return;
     }
+
+    syncReplayMode(data);
+    runFixedSteps(data, data->deltaTime);
 }
 
 void physics_cleanup(void) {
+    stopSimThread();
+    for (int i = 0; i < SNAPSHOT_COUNT; ++i) {
+        BallArr_free(&g_sim.snapshots[i].balls);
+    }
+    getInputData()->physics.threaded = false;
+
+    trace_endRecord();
+    trace_closeReplay();
+    g_activeReplayMode = RM_OFF;
+
     BallArr_free(&g_balls);
+    StageStateArr_free(&g_stages);
+    g_capturedBalls = 0;
     BlackHoleArr_free(&g_blackHoles);
+    ObstacleArr_free(&getInputData()->game.obstacles);
+    grid_free(&g_ballGrid.grid);
+    TRACKED_FREE(g_ballGrid.points);
+    TRACKED_FREE(g_ballGrid.ballIdx);
+    TRACKED_FREE(g_pairSolve.accel);
+    for (int c = 0; c < JOBS_MAX_THREADS; ++c) {
+        BallPairArr_free(&g_pairSolve.contacts[c]);
+    }
+    memset(&g_pairSolve, 0, sizeof(g_pairSolve));
+    g_ballGrid.points = NULL;
+    g_ballGrid.ballIdx = NULL;
+    g_ballGrid.capacity = 0;
+    Vec3Arr_free(&g_sweepStart);
+    XpbdContactArr_free(&g_xpbd.contacts);
+    for (int c = 0; c < JOBS_MAX_THREADS; ++c) {
+        XpbdContactArr_free(&g_xpbd.chunkContacts[c]);
+    }
+    Vec3Arr_free(&g_xpbd.velocity);
+    TRACKED_FREE(g_xpbd.first);
+    TRACKED_FREE(g_xpbd.adjacency);
+    memset(&g_xpbd, 0, sizeof(g_xpbd));
+    TRACKED_FREE(g_contactBatch.ballIdx);
+    TRACKED_FREE(g_contactBatch.points);
+    TRACKED_FREE(g_contactBatch.normals);
+    TRACKED_FREE(g_contactBatch.s);
+    TRACKED_FREE(g_contactBatch.t);
+    memset(&g_contactBatch, 0, sizeof(g_contactBatch));
+    grid_free(&g_obstacleGrid.grid);
+    grid_free(&g_blackHoleGrid.grid);
+    TRACKED_FREE(g_obstacleGrid.points);
+    TRACKED_FREE(g_blackHoleGrid.points);
+    obstacletable_free(&g_obstacleTable);
+    g_obstacleExtent = 0.0f;
+    g_obstacleGrid = (StaticGrid) { .dirty = true };
+    g_blackHoleGrid = (StaticGrid) { .dirty = true };
     g_walls.initialized = false;
+    TRACKED_FREE(g_gpuBalls.staging);
+    memset(&g_gpuBalls, 0, sizeof(g_gpuBalls));
 }
 
 void physics_drawBalls(void) {
     assert(g_balls.data != NULL);
-    debug_pushRenderScope("Balls");
-
-    InputData *data = getInputData();
-    bool showNormals = data->showNormals;
-    float radius = data->physics.ballRadius;
-
-    mat4 modelviewMat, viewMat;
-    scene_getMV(viewMat);
-
-    for (int i = 0; i < g_balls.size; ++i) {
-        if (!g_balls.data[i].active) continue;
 
-        scene_pushMatrix();
-
-        scene_translateV(g_balls.data[i].center);
-        scene_scaleV(VEC3X(radius));
-        scene_getMV(modelviewMat);
+    // The goal stands in for the depth order of the balls spread over the surface
+    if (g_gpuBalls.active) {
+        renderqueue_addCustom(drawGpuBallsItem, NULL, g_goal.position);
+        return;
+    }
 
-        model_draw(MODEL_SPHERE, &BALL_MAT, showNormals, &viewMat, &modelviewMat);
-        scene_popMatrix();
+    InputData *data = getInputData();
+    bool showNormals = data->quality.objectNormals;
+
+    // Blend between the last two steps by the time left in the accumulator,
+    // or by the time since the presented step of the simulation thread
+    BallArr *balls = &g_balls;
+    float t = data->physics.dtAccumulator;
+    if (g_sim.running) {
+        Snapshot *snap = &g_sim.snapshots[g_sim.front];
+        balls = &snap->balls;
+        t = (float) (glfwGetTime() - snap->time);
     }
 
-    debug_popRenderScope();
+    float alpha = data->physics.interpolate
+        ? glm_clamp(t / data->physics.fixedDt, 0.0f, 1.0f)
+        : 1.0f;
+
+    // Only the reservation touches the queue, the items are recorded on all threads
+    DrawBallsJob job = {
+        .balls = balls,
+        .alpha = alpha,
+        .radius = data->physics.ballRadius,
+        .batch = renderqueue_reserveModels(MODEL_SPHERE, &BALL_MAT, (int) balls->size, showNormals)
+    };
+    jobs_parallelFor((int) balls->size, BALLS_PER_CHUNK, drawBallsJob, &job);
 }
 
 void physics_drawBlackHoles(void) {
-    debug_pushRenderScope("BlackHoles");
-
     InputData *data = getInputData();
-    bool showNormals = data->showNormals;
-    glEnable(GL_BLEND);
-
-    mat4 modelviewMat, viewMat;
-    scene_getMV(viewMat);
+    float scale = data->physics.blackHoleRadius * 0.7f;
 
     for (int i = 0; i < g_blackHoles.size; ++i) {
-        scene_pushMatrix();
-
-        scene_translateV(g_blackHoles.data[i].position);
-        scene_scaleV(VEC3X(data->physics.blackHoleRadius * 0.7f));
-        scene_getMV(modelviewMat);
-
-        model_draw(MODEL_SPHERE, &BLACKHOLE_MAT, showNormals, &viewMat, &modelviewMat);
-        scene_popMatrix();
+        renderqueue_addModel(
+            MODEL_SPHERE, &BLACKHOLE_MAT, g_blackHoles.data[i].position, scale, VEC3X(1), data->quality.objectNormals
+        );
     }
-
-    glDisable(GL_BLEND);
-    debug_popRenderScope();
 }
 
 void physics_drawGoal(void) {
-    debug_pushRenderScope("Goal");
-
     InputData *data = getInputData();
-    bool showNormals = data->showNormals;
-
-    mat4 modelviewMat, viewMat;
-    scene_getMV(viewMat);
-
-    glEnable(GL_BLEND);
-    scene_pushMatrix();
-
-    scene_translateV(g_goal.position);
-    scene_scaleV(VEC3X(g_goal.radius));
-    scene_getMV(modelviewMat);
-
-    model_draw(MODEL_SPHERE, &GOAL_MAT, showNormals, &viewMat, &modelviewMat);
-    scene_popMatrix();
-
-    glDisable(GL_BLEND);
-    debug_popRenderScope();
+    renderqueue_addModel(
+        MODEL_SPHERE, &GOAL_MAT, g_goal.position, g_goal.radius, VEC3X(1), data->quality.objectNormals
+    );
 }
 
 void physics_orderBallsDiagonally(void) {
+    downloadGpuBalls();
     InputData *data = getInputData();
     data->physics.dtAccumulator = 0.0f;
     float radius = data->physics.ballRadius;
 
-    int count = (int) g_balls.size;
-    BallArr_free(&g_balls);
-    BallArr_init(&g_balls);
+    int count = (int) g_balls.size + g_capturedBalls;
+    g_capturedBalls = 0;
+    BallArr_clear(&g_balls);
     BallArr_reserve(&g_balls, count);
 
     for (int i = 0; i < count; ++i) {
@@ -811,20 +3089,21 @@ void physics_orderBallsDiagonally(void) {
         logic_evalSplineGlobal(b.contact.t, b.contact.s, b.contact.point, b.contact.normal);
         applyContactPoint(&b, radius);
 
-        BallArr_push(&g_balls, b);
+        spawnBall(&b);
     }
 
     g_goal.reached = false;
 }
 
 void physics_orderBallsRandom(void) {
+    downloadGpuBalls();
     InputData *data = getInputData();
     data->physics.dtAccumulator = 0.0f;
     float radius = data->physics.ballRadius;
 
-    int count = (int) g_balls.size;
-    BallArr_free(&g_balls);
-    BallArr_init(&g_balls);
+    int count = (int) g_balls.size + g_capturedBalls;
+    g_capturedBalls = 0;
+    BallArr_clear(&g_balls);
     BallArr_reserve(&g_balls, count);
 
     for (int i = 0; i < count; ++i) {
@@ -833,21 +3112,22 @@ void physics_orderBallsRandom(void) {
         logic_evalSplineGlobal(b.contact.t, b.contact.s, b.contact.point, b.contact.normal);
         applyContactPoint(&b, radius);
 
-        BallArr_push(&g_balls, b);
+        spawnBall(&b);
     }
 
     g_goal.reached = false;
 }
 
 void physics_orderBallsAroundMax(void) {
+    downloadGpuBalls();
     InputData *data = getInputData();
     data->physics.dtAccumulator = 0.0f;
     float radius = data->physics.ballRadius;
     float spawnRadius = data->physics.ballSpawnRadius;
 
-    int count = (int) g_balls.size;
-    BallArr_free(&g_balls);
-    BallArr_init(&g_balls);
+    int count = (int) g_balls.size + g_capturedBalls;
+    g_capturedBalls = 0;
+    BallArr_clear(&g_balls);
     BallArr_reserve(&g_balls, count);
 
     vec3 maxPoint;
@@ -877,7 +3157,7 @@ void physics_orderBallsAroundMax(void) {
         logic_evalSplineGlobal(b.contact.t, b.contact.s, b.contact.point, b.contact.normal);
         applyContactPoint(&b, radius);
 
-        BallArr_push(&g_balls, b);
+        spawnBall(&b);
     }
 
     g_goal.reached = false;
@@ -889,13 +3169,7 @@ bool physics_isGameWon(void) {
 
 bool physics_isGameLost(void) {
     // Game lost when all balls are inside black holes
-    int activeBalls = 0;
-    for (int i = 0; i < g_balls.size; i++) {
-        if (g_balls.data[i].active) {
-            activeBalls++;
-        }
-    }
-    return activeBalls == 0 && !g_goal.reached;
+    return physics_getBallCount() == 0 && !g_goal.reached;
 }
 
 void physics_resetGame(void) {
@@ -907,13 +3181,96 @@ void physics_resetGame(void) {
 }
 
 int physics_getBallCount(void) {
+    if (g_gpuBalls.active) {
+        return g_gpuBalls.count - g_gpuBalls.captured;
+    }
+    return (int) g_balls.size;
+}
+
+int physics_getCapturedBallCount(void) {
+    return g_capturedBalls + (g_gpuBalls.active ? g_gpuBalls.captured : 0);
+}
+
+int physics_getSleepingBallCount(void) {
+    if (g_gpuBalls.active) {
+        return 0;
+    }
+
+    int count = 0;
+    for (int i = 0; i < g_balls.size; ++i) {
+        count += g_balls.data[i].sleeping;
+    }
+    return count;
+}
+
+int physics_countInvalidBalls(void) {
+    if (g_gpuBalls.active || !g_walls.initialized) {
+        return 0;
+    }
+
+    InputData *data = getInputData();
+    float radius = data->physics.ballRadius;
+    int walls = data->physics.wall.enabled ? WALL_CNT : 0;
     int count = 0;
-    for (int i = 0; i < g_balls.size; i++) {
-        if (g_balls.data[i].active) count++;
+    for (int i = 0; i < g_balls.size; ++i) {
+        Ball *b = &g_balls.data[i];
+        bool valid = true;
+        for (int c = 0; c < 3; ++c) {
+            valid &= isfinite(b->center[c]) && isfinite(b->velocity[c]);
+        }
+        for (int w = 0; w < walls; ++w) {
+            Wall *wall = &g_walls.walls[w];
+            valid &= glm_vec3_dot(b->center, wall->normal) + wall->distance >= -radius;
+        }
+        count += !valid;
     }
     return count;
 }
 
+void physics_wakeAll(void) {
+    wakeAllBalls();
+}
+
+void physics_translate(const vec3 delta) {
+    downloadGpuBalls();
+
+    InputData *data = getInputData();
+    int dimension = data->surface.dimension;
+    float maxX = data->surface.controlPoints.data[dimension - 1][0];
+    float maxZ = data->surface.controlPoints.data[(dimension - 1) * dimension][2];
+
+    // Balls on the part that slid out of the surface are gone with it
+    int i = 0;
+    while (i < (int) g_balls.size) {
+        Ball *b = &g_balls.data[i];
+        glm_vec3_add(b->center, (float*) delta, b->center);
+        glm_vec3_add(b->prevCenter, (float*) delta, b->prevCenter);
+        glm_vec3_add(b->contact.point, (float*) delta, b->contact.point);
+        if (b->center[0] < 0.0f || b->center[0] > maxX || b->center[2] < 0.0f || b->center[2] > maxZ) {
+            BallArr_removeSwap(&g_balls, i);
+            continue;
+        }
+        logic_closestSplinePointTo(b->contact.point, &b->contact.s, &b->contact.t);
+        wakeBall(b);
+        ++i;
+    }
+
+    // Black holes keep their place on the terrain as long as it is on the surface
+    for (int h = 0; h < (int) g_blackHoles.size; ++h) {
+        BlackHole *bh = &g_blackHoles.data[h];
+        glm_vec3_add(bh->position, (float*) delta, bh->position);
+        bh->position[0] = glm_clamp(bh->position[0], 0.0f, maxX);
+        bh->position[2] = glm_clamp(bh->position[2], 0.0f, maxZ);
+
+        float s, t;
+        vec3 normal;
+        logic_closestSplinePointTo(bh->position, &s, &t);
+        logic_evalSplineGlobal(t, s, bh->position, normal);
+    }
+    g_blackHoleGrid.dirty = true;
+    initGoal();
+}
+
 int physics_getBlackHoleCount(void) {
     return (int)g_blackHoles.size;
 }
@@ -924,16 +3281,12 @@ void physics_kickBall(void) {
         return;
     }
 
-    Ball *b = NULL;
-    for (int i = 0; i < g_balls.size && b == NULL; ++i) {
-        if (g_balls.data[i].active) {
-            b = &g_balls.data[i];
-        }
-    }
-
-    if (b == NULL) {
+    downloadGpuBalls();
+    if (g_balls.size == 0) {
         return;
     }
+    Ball *b = &g_balls.data[0];
+    wakeBall(b);
 
     float angle = RAND01 * 2.0f * (float) M_PI;
     vec3 dir = {cosf(angle), 0.0f, sinf(angle)};
@@ -942,3 +3295,68 @@ void physics_kickBall(void) {
     glm_vec3_scale(dir, data->physics.kickStrength, velocityKick);
     glm_vec3_add(b->velocity, velocityKick, b->velocity);
 }
+
+int physics_getBallSubsteps(void) {
+    return g_multiRate.lastSubsteps;
+}
+
+float physics_getStableDt(void) {
+    InputData *data = getInputData();
+
+    // Position constraints have no spring to resolve
+    if (data->physics.solver != CS_PENALTY) {
+        return FLT_MAX;
+    }
+
+    // Two touching balls form a spring over the reduced mass m / 2
+    float stiffness = 0.0f;
+    if (data->physics.wall.enabled) stiffness = fmaxf(stiffness, data->physics.wall.spring);
+    if (data->physics.obs.enabled) stiffness = fmaxf(stiffness, data->physics.obs.spring);
+    if (data->physics.ball.enabled) stiffness = fmaxf(stiffness, 2.0f * data->physics.ball.spring);
+    if (stiffness <= 0.0f) {
+        return FLT_MAX;
+    }
+
+    float omega = sqrtf(stiffness / data->physics.mass);
+    return g_stabilityFactor[data->physics.integrator] / omega;
+}
+
+int physics_getPhaseTimes(double seconds[PP_COUNT]) {
+    for (int p = 0; p < PP_COUNT; ++p) {
+        seconds[p] = g_phaseTimes.seconds[p];
+    }
+    return g_phaseTimes.steps;
+}
+
+void physics_resetPhaseTimes(void) {
+    memset(&g_phaseTimes, 0, sizeof(g_phaseTimes));
+}
+
+void physics_lock(void) {
+    InputData *data = getInputData();
+    data->physics.threaded &= !data->physics.gpu;
+    if (data->physics.threaded != g_sim.running) {
+        if (data->physics.threaded) {
+            data->physics.threaded = startSimThread();
+        } else {
+            stopSimThread();
+        }
+    }
+
+    if (g_sim.running) {
+        MUTEX_LOCK(&g_sim.mutex);
+    }
+}
+
+void physics_unlock(void) {
+    if (g_sim.running) {
+        MUTEX_UNLOCK(&g_sim.mutex);
+    }
+}
+
+int physics_getTraceFrames(void) {
+    if (g_activeReplayMode == RM_RECORD) {
+        return trace_getRecordedFrames();
+    }
+    return trace_getReplayFrames();
+}
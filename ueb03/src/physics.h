@@ -10,6 +10,26 @@
 
 #include <fhwcg/fhwcg.h>
 
+/** Finest multi-rate level, a fixed step splits into at most 2^level substeps */
+#define PHYSICS_MAX_SUBSTEP_LEVEL 6
+
+/** Most iterations of the XPBD position solve */
+#define PHYSICS_MAX_SOLVER_ITERATIONS 32
+
+/**
+ * Timed phases of a fixed step.
+ */
+typedef enum {
+    PP_EXTERN,          // gravity
+    PP_WALL,
+    PP_BALL,            // ball-ball contacts
+    PP_OBSTACLE,
+    PP_BLACK_HOLE,
+    PP_BROAD_PHASE,     // grid builds, contact wake
+    PP_INTEGRATE,       // integration, contact projection, sleep and goal checks
+    PP_COUNT
+} PhysicsPhase;
+
 /**
  * Initializes the physics system
  */
@@ -17,6 +37,7 @@ void physics_init(void);
 
 /**
  * Updates physics simulation for one frame.
+ * With the simulation thread running, only takes its latest state.
  */
 void physics_update(void);
 
@@ -27,20 +48,20 @@ void physics_update(void);
 void physics_cleanup(void);
 
 /**
- * Renders all active balls as spheres.
+ * Submits all active balls as spheres to the render queue.
  * Uses ball radius from physics parameters.
  * Inactive balls (captured by black holes) are not drawn.
  */
 void physics_drawBalls(void);
 
 /**
- * Renders all black holes as semi-transparent dark spheres.
+ * Submits all black holes as semi-transparent dark spheres to the render queue.
  * Uses black hole radius from physics params.
  */
 void physics_drawBlackHoles(void);
 
 /**
- * Renders the goal as a semi-transparent green sphere.
+ * Submits the goal as a semi-transparent green sphere to the render queue.
  * Goal is positioned at the lowest point on the surface.
  */
 void physics_drawGoal(void);
@@ -116,6 +137,44 @@ void physics_resetGame(void);
  */
 int physics_getBallCount(void);
 
+/**
+ * Counts the balls captured by black holes since the balls were last (re)spawned.
+ *
+ * @return Number of captured balls
+ */
+int physics_getCapturedBallCount(void);
+
+/**
+ * Counts the balls that rest and are skipped by the simulation.
+ *
+ * @return Number of sleeping balls
+ */
+int physics_getSleepingBallCount(void);
+
+/**
+ * Counts the balls with a non-finite center or velocity or a center
+ * more than one radius beyond an enabled wall. Always 0 in a valid state,
+ * checked by the benchmark. The balls of the GPU backend are not read back.
+ *
+ * @return Number of invalid balls
+ */
+int physics_countInvalidBalls(void);
+
+/**
+ * Wakes all sleeping balls, e.g. after the surface changed under them.
+ */
+void physics_wakeAll(void);
+
+/**
+ * Moves balls and black holes with the terrain when the surface shows a
+ * shifted part of a larger terrain. Balls that leave the surface are
+ * removed, black holes are clamped onto it and the goal is placed anew.
+ * Call after the shifted surface was swapped in.
+ *
+ * @param delta World translation of the terrain
+ */
+void physics_translate(const vec3 delta);
+
 /**
  * Gets the total number of black holes in the simulation.
  *
@@ -128,4 +187,57 @@ int physics_getBlackHoleCount(void);
  */
 void physics_kickBall(void);
 
+/**
+ * Returns the number of steps of the running recording or replay.
+ *
+ * @return Step count, 0 without trace
+ */
+int physics_getTraceFrames(void);
+
+/**
+ * Estimates the largest stable fixed dt of the selected integrator
+ * for the stiffest enabled penalty spring.
+ *
+ * @return Stable dt limit, 0 if the integrator is unstable at any dt,
+ *         FLT_MAX without springs or with an XPBD contact solver
+ */
+float physics_getStableDt(void);
+
+/**
+ * Counts the ball integrations of the last fixed step. Without multi-rate
+ * stepping this is the number of awake balls, every ball in a stiff
+ * contact adds the substeps it takes.
+ *
+ * @return Ball substeps of the last fixed step
+ */
+int physics_getBallSubsteps(void);
+
+/**
+ * Returns the time spent in every phase since the last reset.
+ * Forces evaluated by the stages of multi-stage integrators count
+ * to their force phase, not to PP_INTEGRATE.
+ *
+ * @param seconds Destination, indexed by PhysicsPhase
+ * @return Number of steps simulated since the last reset
+ */
+int physics_getPhaseTimes(double seconds[PP_COUNT]);
+
+/**
+ * Resets the phase times.
+ */
+void physics_resetPhaseTimes(void);
+
+/**
+ * Keeps the simulation thread from stepping while the main thread edits
+ * the balls, black holes or the surface. Starts or stops the thread first
+ * if physics.threaded changed. Does not lock without simulation thread.
+ * Not reentrant, pair every call with physics_unlock.
+ */
+void physics_lock(void);
+
+/**
+ * Lets the simulation thread step again.
+ */
+void physics_unlock(void);
+
 #endif // PHYSICS_H
@@ -3,6 +3,7 @@
  * @brief Implementation of rendering and visual effects.
  *
  * Manages entire rendering system including surface, balls, black holes, and goal.
+ * All scene objects are submitted to the render queue and drawn sorted by state.
  *
  * @authors Nikolaos Tsetsas, Noah Schmidt
  */
@@ -14,6 +15,14 @@
 #include "utils.h"
 #include "logic.h"
 #include "physics.h"
+#include "profiler.h"
+#include "glstate.h"
+#include "renderqueue.h"
+#include "timeline.h"
+#include "rendbench.h"
+#include "lightgrid.h"
+#include "shadow.h"
+#include "rng.h"
 
 /** Projection data*/
 #define NEAR_PLANE 0.01f
@@ -22,6 +31,18 @@
 
 /** Colors*/
 #define SELECTED_COLOR VEC3(1, 0, 0)
+#define FLIGHT_PATH_COLOR VEC3(1, 1, 0)
+
+/** Line segments the camera flight path is sampled into */
+#define FLIGHT_PATH_SEGMENTS 128
+
+/** Maximum distance of a picked control point to the cursor ray */
+#define CP_PICK_RADIUS 0.03f
+
+/** Clustered lights: seed of their anchors, orbit in surface parameters, marker size */
+#define CLUSTER_LIGHT_SEED 0x11947ull
+#define CLUSTER_LIGHT_ORBIT 0.02f
+#define CLUSTER_LIGHT_MARKER 0.02f
 
 /**
  * Rendering viewport and projection data.
@@ -58,6 +79,21 @@ static const Material OBSTACLE_MAT_SELECTED = {
 /** Global rendering data (viewport, projection bounds, screen resolution) */
 static RenderingData g_renderingData;
 
+/** Anchors of the clustered lights in surface parameters, drawn once */
+static struct {
+    vec2 param[LIGHTGRID_MAX_LIGHTS];   // global t and s
+    vec3 color[LIGHTGRID_MAX_LIGHTS];
+    float phase[LIGHTGRID_MAX_LIGHTS];
+    float orbit;                        // orbits done since the start
+    bool initialized;
+} g_clusterLights = {0};
+
+/** Control points the path buffer was last sampled from */
+static struct {
+    vec3 ctrl[4];
+    bool uploaded;
+} g_flightPath = {0};
+
 /**
  * Sets the View-Matrix based on the current active camera.
  */
@@ -66,6 +102,7 @@ static void updateCamera(InputData *data) {
         camera_getPosition(data->cam.data, data->cam.pos);
         camera_getFront(data->cam.data, data->cam.dir);
     }
+    rendbench_camera(data->cam.pos, data->cam.dir);
 
     scene_look(data->cam.pos, data->cam.dir, GLM_YUP);
     shader_setCamPos(data->cam.pos);
@@ -94,45 +131,146 @@ static void updatePointLight(InputData *data) {
     );
 
     if (data->pointLight.visualize) {
-        scene_pushMatrix();
-        {
-        scene_translateV(data->pointLight.posWS);
-        scene_scale(0.1f, 0.1f, 0.1f);
-        shader_setColor(data->pointLight.color);
-        shader_setSimpleMVP();
-        model_drawSimple(MODEL_SPHERE);
+        renderqueue_addModel(MODEL_SPHERE, NULL, data->pointLight.posWS, 0.1f, data->pointLight.color, false);
+    }
+}
+
+/**
+ * Draws the anchors and colors of the clustered lights.
+ * Colors are random with their largest channel at one.
+ */
+static void initClusterLights(void) {
+    Rng rng;
+    rng_seed(&rng, CLUSTER_LIGHT_SEED);
+    for (int i = 0; i < LIGHTGRID_MAX_LIGHTS; ++i) {
+        g_clusterLights.param[i][0] = rng_float(&rng);
+        g_clusterLights.param[i][1] = rng_float(&rng);
+        g_clusterLights.phase[i] = rng_float(&rng);
+
+        vec3 *color = &g_clusterLights.color[i];
+        glm_vec3_copy(VEC3(rng_float(&rng), rng_float(&rng), rng_float(&rng)), *color);
+        glm_vec3_scale(*color, 1.0f / glm_max(glm_vec3_max(*color), 0.01f), *color);
+    }
+    g_clusterLights.initialized = true;
+}
+
+/**
+ * Moves the clustered lights along their orbits over the surface and
+ * bins them into the light grid. Called after the camera is set.
+ * @param data The InputData.
+ */
+static void updateClusterLights(InputData *data) {
+    int count = glm_min(data->clusterLights.count, LIGHTGRID_MAX_LIGHTS);
+    if (count <= 0 || !data->surface.showSurface) {
+        lightgrid_build(NULL, 0);
+        return;
+    }
+    if (!g_clusterLights.initialized) {
+        initClusterLights();
+    }
+    g_clusterLights.orbit += data->clusterLights.speed * data->deltaTime;
+
+    LightGridLight lights[LIGHTGRID_MAX_LIGHTS];
+    for (int i = 0; i < count; ++i) {
+        float angle = (g_clusterLights.phase[i] + g_clusterLights.orbit) * 2.0f * GLM_PIf;
+        float gT = glm_clamp(g_clusterLights.param[i][0] + cosf(angle) * CLUSTER_LIGHT_ORBIT, 0.0f, 1.0f);
+        float gS = glm_clamp(g_clusterLights.param[i][1] + sinf(angle) * CLUSTER_LIGHT_ORBIT, 0.0f, 1.0f);
+
+        LightGridLight *l = &lights[i];
+        vec3 normal;
+        logic_evalSplineGlobal(gT, gS, l->pos, normal);
+        l->pos[1] += data->clusterLights.height;
+        l->radius = data->clusterLights.radius;
+        glm_vec3_scale(g_clusterLights.color[i], data->clusterLights.intensity, l->color);
+
+        if (data->clusterLights.visualize) {
+            renderqueue_addModel(MODEL_SPHERE, NULL, l->pos, CLUSTER_LIGHT_MARKER, g_clusterLights.color[i], false);
         }
-        scene_popMatrix();
     }
+    lightgrid_build(lights, count);
 }
 
 /**
- * Draws the camera flight path as a series of small spheres.
- * Shows the Bezier curve from highest to lowest point.
+ * Resamples the camera flight path into the path buffer after
+ * logic_initCameraFlight moved its control points.
+ *
+ * @param data Input data containing flight path control points
+ */
+static void updateCamFlightPath(InputData *data) {
+    vec3 ctrl[4];
+    glm_vec3_copy(data->cam.flight.p0, ctrl[0]);
+    glm_vec3_copy(data->cam.flight.p1, ctrl[1]);
+    glm_vec3_copy(data->cam.flight.p2, ctrl[2]);
+    glm_vec3_copy(data->cam.flight.p3, ctrl[3]);
+    if (g_flightPath.uploaded && memcmp(ctrl, g_flightPath.ctrl, sizeof(ctrl)) == 0) {
+        return;
+    }
+
+    vec3 points[FLIGHT_PATH_SEGMENTS + 1];
+    for (int i = 0; i <= FLIGHT_PATH_SEGMENTS; ++i) {
+        float t = (float)i / (float)FLIGHT_PATH_SEGMENTS;
+        utils_evalBezier3D(ctrl[0], ctrl[1], ctrl[2], ctrl[3], t, points[i]);
+    }
+    model_updatePath(points, FLIGHT_PATH_SEGMENTS + 1);
+
+    memcpy(g_flightPath.ctrl, ctrl, sizeof(ctrl));
+    g_flightPath.uploaded = true;
+}
+
+/**
+ * Render queue callback drawing the cached flight path as one line strip.
+ *
+ * @param userData Unused
+ */
+static void drawCamFlightPathItem(void *userData) {
+    (void) userData;
+    shader_setColor(FLIGHT_PATH_COLOR);
+    model_drawPath();
+}
+
+/**
+ * Submits the camera flight path, the Bezier curve from highest to lowest point.
  *
  * @param data Input data containing flight path control points
  */
 static void drawCamFlightPath(InputData *data) {
-    const int SEG = 128;
-    vec3 p;
-    for (int i = 0; i <= SEG; ++i) {
-        float t = (float)i / (float)SEG;
-        utils_evalBezier3D(
-            data->cam.flight.p0,
-            data->cam.flight.p1,
-            data->cam.flight.p2,
-            data->cam.flight.p3,
-            t, p
-        );
+    updateCamFlightPath(data);
 
-        scene_pushMatrix();
-        {
-            scene_translateV(p);
-            scene_scaleV(VEC3X(0.003f));
-            shader_setColor(VEC3(1, 1, 0));
-            model_drawSimple(MODEL_SPHERE);
-        }
-        scene_popMatrix();
+    vec3 center;
+    glm_vec3_center(data->cam.flight.p0, data->cam.flight.p3, center);
+    renderqueue_addCustom(drawCamFlightPathItem, NULL, center);
+}
+
+/**
+ * Selects the control point under the cursor if a pick was requested.
+ * Unprojects the cursor with the current MVP into a world space ray.
+ *
+ * @param data Input data
+ */
+static void pickControlPoint(InputData *data) {
+    if (!data->selection.pickRequested) {
+        return;
+    }
+    data->selection.pickRequested = false;
+
+    mat4 mvp, inv;
+    scene_getMVP(mvp);
+    glm_mat4_inv(mvp, inv);
+
+    float ndcX = data->selection.cursor[0] * 2.0f - 1.0f;
+    float ndcY = 1.0f - data->selection.cursor[1] * 2.0f;
+    vec4 nearPoint = {ndcX, ndcY, -1.0f, 1.0f};
+    vec4 farPoint = {ndcX, ndcY, 1.0f, 1.0f};
+    glm_mat4_mulv(inv, nearPoint, nearPoint);
+    glm_mat4_mulv(inv, farPoint, farPoint);
+    glm_vec4_scale(nearPoint, 1.0f / nearPoint[3], nearPoint);
+    glm_vec4_scale(farPoint, 1.0f / farPoint[3], farPoint);
+
+    vec3 dir;
+    glm_vec3_sub(farPoint, nearPoint, dir);
+    int idx = logic_pickControlPoint(nearPoint, dir, CP_PICK_RADIUS);
+    if (idx >= 0) {
+        data->selection.selectedCp = idx;
     }
 }
 
@@ -144,33 +282,27 @@ static void drawCamFlightPath(InputData *data) {
  */
 static void drawControlPoints(InputData *data) {
     for (int i = 0; i < data->surface.controlPoints.size; ++i) {
-        scene_pushMatrix();
-
         bool isSelected = data->selection.selectedCp == i;
 
-        scene_translateV(data->surface.controlPoints.data[i]);
-        scene_scaleV(isSelected ? VEC3X(0.1f) : VEC3X(0.01f));
-        vec3 *idxColor = (data->selection.selectedCp == i) ?
+        vec3 *idxColor = isSelected ?
             &SELECTED_COLOR : &VEC3X(i / data->surface.controlPoints.size)
         ;
 
-        shader_setColor(*idxColor);
-        model_drawSimple(MODEL_SPHERE);
-
-        scene_popMatrix();
+        renderqueue_addModel(
+            MODEL_SPHERE, NULL, data->surface.controlPoints.data[i], isSelected ? 0.1f : 0.01f, *idxColor, false
+        );
     }
 }
 
 /**
- * Draws the B-spline surface with optional texturing.
- * Updates point light before rendering if enabled.
+ * Render queue callback drawing the B-spline surface with optional texturing.
  *
- * @param data Input data containing surface and lighting settings
+ * @param userData Input data containing surface settings
  */
-static void drawSurface(InputData *data) {
+static void drawSurfaceItem(void *userData) {
+    InputData *data = userData;
     mat4 modelviewMat, viewMat;
     scene_getMV(viewMat);
-    updatePointLight(data);
     scene_getMV(modelviewMat);
 
     // Set texture if enabled
@@ -181,37 +313,108 @@ static void drawSurface(InputData *data) {
         shader_setTexture(0, false);
     }
 
-    model_drawSurface(data->showNormals, &viewMat, &modelviewMat);
+    if (data->surface.bandsChanged) {
+        model_updateHeightBands(data->surface.bands, HEIGHT_BAND_COUNT);
+        data->surface.bandsChanged = false;
+    }
+    vec2 bandRange;
+    GLuint bands = model_getHeightBands(bandRange);
+    shader_setHeightBands(bands, bandRange);
+    vec4 aoTransform;
+    GLuint ao = model_getAmbientOcclusion(aoTransform);
+    shader_setAmbientOcclusion(ao, aoTransform, ao ? data->surface.aoStrength : 0.0f);
+    vec4 normalTransform;
+    GLuint normalMap = model_getNormalMap(normalTransform);
+    shader_setNormalMap(data->surface.normalMap ? normalMap : 0, normalTransform, viewMat);
+
+    model_setSurfaceCacheOrder(data->surface.cacheOrder);
+    model_setSurfaceQuadricLod(data->surface.quadricLod);
+    model_drawSurface(
+        data->quality.surfaceNormals, data->surface.normalStride, data->surface.tessellate, data->surface.chunkLod,
+        data->surface.heightmap, data->surface.rayMarch, data->surface.textureTiling, &viewMat, &modelviewMat
+    );
 }
 
 /**
- * Draws all obstacles as oriented boxes on the surface.
- * Selected obstacle is highlighted with different material.
+ * Submits the B-spline surface to the render queue.
+ * Updates point light before, the light is only animated while the surface is shown.
  *
- * @param data Input data containing obstacle array
+ * @param data Input data containing surface and lighting settings
  */
-static void drawObstacles(InputData *data) {
-    scene_pushMatrix();
-
-    bool showNormals = data->showNormals;
-    mat4 modelviewMat, viewMat;
-    scene_getMV(viewMat);
+static void drawSurface(InputData *data) {
+    updatePointLight(data);
 
-    for (int i = 0; i < OBSTACLE_COUNT; ++i) {
-        scene_pushMatrix();
+    // The control points span a grid, its corners give the center
+    Vec3Arr *cps = &data->surface.controlPoints;
+    vec3 center = GLM_VEC3_ZERO_INIT;
+    if (cps->size > 0) {
+        glm_vec3_center(cps->data[0], cps->data[cps->size - 1], center);
+    }
+    renderqueue_addCustom(drawSurfaceItem, data, center);
+}
 
-        Obstacle *o = &data->game.obstacles[i];
-        scene_translateV(o->center);
-        scene_scale(o->length, o->height, o->width);
-        scene_getMV(modelviewMat);
+/**
+ * Shadow callback drawing the static geometry, the surface.
+ *
+ * @param userData Input data containing surface settings
+ */
+static void drawShadowStatic(void *userData) {
+    InputData *data = userData;
+    if (data->surface.showSurface) {
+        drawSurfaceItem(data);
+    }
+}
 
-        const Material *m = (i == data->game.selectedIdx) ? &OBSTACLE_MAT_SELECTED : &OBSTACLE_MAT;
-        model_draw(MODEL_CUBE, m, showNormals, &viewMat, &modelviewMat);
+/**
+ * Shadow callback drawing the dynamic geometry, the submitted models.
+ *
+ * @param userData Unused
+ */
+static void drawShadowDynamic(void *userData) {
+    (void) userData;
+    renderqueue_drawShadowCasters();
+}
 
-        scene_popMatrix();
+/**
+ * Updates the shadow cube of the point light after everything was submitted.
+ * The camera is taken off the matrix stack for the cube faces and applied again.
+ *
+ * @param data Input data containing lighting and surface settings
+ */
+static void updateShadows(InputData *data) {
+    if (!data->pointLight.enabled || !data->pointLight.shadows) {
+        shadow_disable();
+        return;
     }
 
+    // Everything the surface is drawn with changes the static depth
+    uint64_t staticKey = ((uint64_t) model_getSurfaceRevision() << 8)
+        | (data->surface.showSurface << 0) | (data->surface.tessellate << 1) | (data->surface.chunkLod << 2)
+        | (data->surface.heightmap << 3) | (data->surface.rayMarch << 4) | (data->surface.quadricLod << 5);
+    RenderCallback dynamic = renderqueue_sortShadowCasters() > 0 ? drawShadowDynamic : NULL;
+
     scene_popMatrix();
+    scene_pushMatrix();
+    glstate_polygonMode(GL_FILL);
+    shadow_update(data->pointLight.posWS, staticKey, drawShadowStatic, dynamic, data);
+    glstate_polygonMode(data->showWireframe ? GL_LINE : GL_FILL);
+    scene_look(data->cam.pos, data->cam.dir, GLM_YUP);
+}
+
+/**
+ * Submits all obstacles as oriented boxes on the surface.
+ * Selected obstacle is highlighted with different material.
+ *
+ * @param data Input data containing obstacle array
+ */
+static void drawObstacles(InputData *data) {
+    for (size_t i = 0; i < data->game.obstacles.size; ++i) {
+        Obstacle *o = &data->game.obstacles.data[i];
+        const Material *m = ((int) i == data->game.selectedIdx) ? &OBSTACLE_MAT_SELECTED : &OBSTACLE_MAT;
+        renderqueue_addScaledModel(
+            MODEL_CUBE, m, o->center, VEC3(o->length, o->height, o->width), data->quality.objectNormals
+        );
+    }
 }
 
 ////////////////////////    PUBLIC    ////////////////////////////
@@ -220,30 +423,31 @@ void rendering_init(void) {
     memset(&g_renderingData, 0, sizeof(RenderingData));
 
     // OpenGL Flags
-    glCullFace(GL_BACK);
+    glstate_cullFace(GL_BACK);
     glFrontFace(GL_CCW);
     shader_load();
 }
 
 void rendering_draw(void) {
     InputData* data = getInputData();
+    TIMELINE_BEGIN("Rendering");
 
-    if(data->showWireframe) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        glDisable(GL_CULL_FACE);
-    } else {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glEnable(GL_CULL_FACE);
-    }
-    glEnable(GL_DEPTH_TEST);
+    glstate_polygonMode(data->showWireframe ? GL_LINE : GL_FILL);
+    glstate_setEnabled(GL_CULL_FACE, !data->showWireframe);
+    glstate_setEnabled(GL_DEPTH_TEST, true);
 
-    debug_pushRenderScope("Scene");
+    profiler_pushScope("Scene");
     scene_pushMatrix();
 
     updateCamera(data);
+    renderqueue_begin();
+    updateClusterLights(data);
 
     if (data->surface.showControlPoints) {
+        pickControlPoint(data);
         drawControlPoints(data);
+    } else {
+        data->selection.pickRequested = false;
     }
 
     if (data->surface.showSurface) {
@@ -262,13 +466,20 @@ void rendering_draw(void) {
     physics_drawBlackHoles();
     physics_drawGoal();
 
+    updateShadows(data);
+    renderqueue_flush(data->depthPrepass, data->oit, data->multiDraw, data->occlusionCull);
+
     scene_popMatrix();
-    debug_popRenderScope();
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    profiler_popScope();
+    glstate_polygonMode(GL_FILL);
+    TIMELINE_END();
 }
 
 void rendering_cleanup(void) {
     shader_cleanup();
+    lightgrid_cleanup();
+    shadow_cleanup();
+    renderqueue_cleanup();
     camera_deleteCamera(&getInputData()->cam.data);
 }
 
@@ -0,0 +1,694 @@
+/**
+ * @file renderqueue.c
+ * @brief Implementation of the render queue
+ *
+ * Every item gets a 64 bit sort key. Opaque keys hold, from the most
+ * significant bit, the item kind, model, material slot and view depth,
+ * so equal state is drawn together and front-to-back within it for
+ * early depth rejection. Transparent keys have the top bit set and the
+ * inverted depth before the state, which orders them back-to-front.
+ * With weighted blended transparency the order does not matter, their
+ * keys leave out the depth and equal state is drawn in one instanced run.
+ *
+ * The optional depth pre-pass draws the opaque items without color first.
+ * Their shading pass then uses GL_EQUAL without depth writes, which is
+ * exact since both passes issue the same draws with the same programs.
+ *
+ * With multi-draw, ranges whose order does not matter stage all their
+ * instanceable items of a shader into one multi-draw-indirect instead of
+ * one instanced draw per run. Items of other kinds are still drawn one by
+ * one, before the multi-draws, items scaled per axis in instanced runs.
+ *
+ * Instanced runs of the Model-Shader pass the scale per axis in the color
+ * attribute, which only the Simple-Shader reads.
+ *
+ * Material slots are assigned on submission, on the main thread, so the
+ * keys of large queues are built in parallel without shared state.
+ *
+ * Occlusion culling builds a Hi-Z pyramid from the depth of the first
+ * items drawn one by one, mostly the surface, and lets the multi-draws
+ * skip what is hidden behind it. The pyramid is kept for the rest of the
+ * flush, so the pre-pass and the shading pass cull the same items.
+ *
+ * A flush is a frame graph of occluders, Hi-Z, depth pre-pass, opaque,
+ * transparent and composite passes. Switched off features cull their
+ * passes, and the Hi-Z depth copy shares its texture with the
+ * transparency depth, their passes never overlap.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "renderqueue.h"
+#include "shader.h"
+#include "instanced.h"
+#include "profiler.h"
+#include "glstate.h"
+#include "oit.h"
+#include "hiz.h"
+#include "framegraph.h"
+#include "jobs.h"
+
+/** Initial number of items */
+#define START_CAPACITY 256
+
+/** Items per chunk of the parallel key building */
+#define KEYS_PER_CHUNK 1024
+
+/** Number of material slots in a key, slot 0 means no material */
+#define MAX_MATERIAL_SLOTS 256
+
+/** Key bit of transparent items */
+#define KEY_TRANSPARENT (1ull << 63)
+
+/** Shift of the depth inside opaque and transparent keys */
+#define OPAQUE_DEPTH_SHIFT 16
+#define TRANSPARENT_DEPTH_SHIFT 31
+
+/**
+ * How an item is drawn, sorted in this order within a layer.
+ */
+typedef enum {
+    ITEM_CUSTOM,
+    ITEM_MODEL,
+    ITEM_SIMPLE
+} ItemKind;
+
+/**
+ * One submitted item.
+ */
+typedef struct {
+    ItemKind kind;
+    ModelType model;
+    const Material *mat;
+    int slot;           // material slot, see materialSlot
+    vec3 pos;
+    vec3 scale;
+    vec3 color;
+    bool drawNormals;
+    bool instanceable;
+    bool axisScaled;    // scale differs per axis, never multi-drawn
+    RenderCallback draw;
+    void *userData;
+} RenderItem;
+
+/**
+ * Sort key of an item.
+ */
+typedef struct {
+    uint64_t key;
+    int item;
+} SortEntry;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global queue state.
+ */
+static struct {
+    RenderItem *items;
+    SortEntry *entries;
+    int size;
+    int capacity;
+
+    mat4 view;
+    const Material *materials[MAX_MATERIAL_SLOTS];
+    int materialCount;
+    bool occlusionCull;
+    bool depthPrepass;
+    bool oit;
+    bool oitActive;     // the transparency targets hold this flush's items
+    bool multiDraw;
+    int opaqueCount;
+    FgTexture hizDepth, hizPyramid;
+    FgTexture oitAccum, oitRevealage, oitDepth;
+    int casterCount;    // sorted entries of renderqueue_sortShadowCasters
+    bool shadowPass;
+} g_queue = { 0 };
+
+/**
+ * Grows the item storage to hold at least count items.
+ * @param count Required number of items.
+ */
+static void reserve(int count) {
+    if (count <= g_queue.capacity) {
+        return;
+    }
+
+    int capacity = g_queue.capacity ? g_queue.capacity * 2 : START_CAPACITY;
+    if (capacity < count) capacity = count;
+
+    RenderItem *items = realloc(g_queue.items, capacity * sizeof(RenderItem));
+    assert(items && "realloc failed in renderqueue reserve");
+    g_queue.items = items;
+
+    SortEntry *entries = realloc(g_queue.entries, capacity * sizeof(SortEntry));
+    assert(entries && "realloc failed in renderqueue reserve");
+    g_queue.entries = entries;
+
+    g_queue.capacity = capacity;
+}
+
+/**
+ * Returns the key slot of a material, materials are numbered in
+ * the order of their first submission since renderqueue_begin.
+ * @param mat The material, may be NULL.
+ * @return The slot, 0 for NULL.
+ */
+static int materialSlot(const Material *mat) {
+    if (!mat) {
+        return 0;
+    }
+
+    for (int i = 0; i < g_queue.materialCount; ++i) {
+        if (g_queue.materials[i] == mat) {
+            return i + 1;
+        }
+    }
+
+    // Further materials share the last slot, that only costs sorting quality
+    if (g_queue.materialCount >= MAX_MATERIAL_SLOTS - 1) {
+        return MAX_MATERIAL_SLOTS - 1;
+    }
+    g_queue.materials[g_queue.materialCount++] = mat;
+    return g_queue.materialCount;
+}
+
+/**
+ * Returns the view depth of a world space position as sortable bits.
+ * The bit pattern of non-negative floats is ordered like their values.
+ * @param pos World space position.
+ * @return Depth bits, 0 for positions behind the camera.
+ */
+static uint64_t depthBits(vec3 pos) {
+    vec3 viewPos;
+    glm_mat4_mulv3(g_queue.view, pos, 1.0f, viewPos);
+    float depth = glm_max(-viewPos[2], 0.0f);
+
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    return bits;
+}
+
+/**
+ * Builds the sort key of an item.
+ * @param item The item.
+ * @param sortTransparent If transparent items are ordered back-to-front.
+ * @return The key.
+ */
+static uint64_t makeKey(const RenderItem *item, bool sortTransparent) {
+    uint64_t state = ((uint64_t) item->kind << 12) | ((uint64_t) item->model << 8) | (uint64_t) item->slot;
+    uint64_t depth = depthBits((float*) item->pos);
+
+    if (item->mat && item->mat->alpha < 1.0f) {
+        uint64_t order = sortTransparent ? (~depth & 0xffffffffull) << TRANSPARENT_DEPTH_SHIFT : 0;
+        return KEY_TRANSPARENT | order | (state << 16);
+    }
+    return (state << 48) | (depth << OPAQUE_DEPTH_SHIFT);
+}
+
+/**
+ * Removes the depth from a key.
+ * @param key The key.
+ * @return The state bits of the key.
+ */
+static uint64_t stateOf(uint64_t key) {
+    int shift = (key & KEY_TRANSPARENT) ? TRANSPARENT_DEPTH_SHIFT : OPAQUE_DEPTH_SHIFT;
+    return key & ~(0xffffffffull << shift);
+}
+
+/**
+ * Orders sort entries by key, equal keys by submission.
+ */
+static int compareEntries(const void *a, const void *b) {
+    const SortEntry *ea = a;
+    const SortEntry *eb = b;
+    if (ea->key != eb->key) {
+        return ea->key < eb->key ? -1 : 1;
+    }
+    return ea->item - eb->item;
+}
+
+/**
+ * Builds the sort keys of a range of items.
+ * @param begin First item.
+ * @param end One past the last item.
+ * @param chunk Unused.
+ * @param userData Pointer to a bool, if transparent items are ordered back-to-front.
+ */
+static void makeKeysJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    bool sortTransparent = *(const bool*) userData;
+    for (int i = begin; i < end; ++i) {
+        g_queue.entries[i].key = makeKey(&g_queue.items[i], sortTransparent);
+        g_queue.entries[i].item = i;
+    }
+}
+
+/**
+ * Appends an item.
+ * @return The new item, zero initialized.
+ */
+static RenderItem* addItem(void) {
+    reserve(g_queue.size + 1);
+    RenderItem *item = &g_queue.items[g_queue.size++];
+    memset(item, 0, sizeof(RenderItem));
+    return item;
+}
+
+/**
+ * Draws one item that cannot be instanced.
+ * @param item The item.
+ */
+static void drawItem(const RenderItem *item) {
+    if (item->kind == ITEM_CUSTOM) {
+        item->draw(item->userData);
+        return;
+    }
+
+    scene_pushMatrix();
+    scene_translateV((float*) item->pos);
+    scene_scaleV((float*) item->scale);
+
+    if (item->mat) {
+        mat4 modelviewMat;
+        scene_getMV(modelviewMat);
+        model_draw(item->model, item->mat, item->drawNormals && !g_queue.shadowPass, &g_queue.view, &modelviewMat);
+    } else {
+        shader_setColor((float*) item->color);
+        model_drawSimple(item->model);
+    }
+
+    scene_popMatrix();
+}
+
+/**
+ * Stages a run of instanceable items with equal state and draws it.
+ * @param first Index of the first sort entry of the run.
+ * @param last Index after the last sort entry the run may reach.
+ * @return Index of the first entry after the run.
+ */
+static int drawRun(int first, int last) {
+    const RenderItem *head = &g_queue.items[g_queue.entries[first].item];
+    uint64_t state = stateOf(g_queue.entries[first].key);
+
+    int end = first;
+    while (end < last) {
+        const RenderItem *item = &g_queue.items[g_queue.entries[end].item];
+        if (!item->instanceable || item->axisScaled != head->axisScaled
+            || stateOf(g_queue.entries[end].key) != state) {
+            break;
+        }
+        if (item->mat) {
+            instanced_add((float*) item->pos, 1.0f, (float*) item->scale);
+        } else {
+            instanced_add((float*) item->pos, item->scale[0], (float*) item->color);
+        }
+        ++end;
+    }
+
+    if (head->mat) {
+        model_drawInstanced(head->model, head->mat, &g_queue.view);
+    } else {
+        model_drawSimpleInstanced(head->model);
+    }
+    return end;
+}
+
+/**
+ * Draws the items of [first, last) that cannot be multi-drawn, one by one
+ * or in instanced runs if scaled per axis.
+ * @param first Index of the first sort entry.
+ * @param last Index after the last sort entry.
+ */
+static void drawSingles(int first, int last) {
+    for (int i = first; i < last; ) {
+        const RenderItem *item = &g_queue.items[g_queue.entries[i].item];
+        if (!item->instanceable) {
+            drawItem(item);
+            ++i;
+        } else if (item->axisScaled) {
+            i = drawRun(i, last);
+        } else {
+            ++i;
+        }
+    }
+}
+
+/**
+ * Draws the instanceable items of [first, last) with one multi-draw per shader.
+ * Only for ranges whose order does not matter.
+ * @param first Index of the first sort entry.
+ * @param last Index after the last sort entry.
+ */
+static void drawBatched(int first, int last) {
+    bool simple = false;
+    for (int i = first; i < last; ++i) {
+        const RenderItem *item = &g_queue.items[g_queue.entries[i].item];
+        if (!item->instanceable || item->axisScaled) {
+            continue;
+        } else if (item->mat) {
+            model_addMultiDraw(item->model, item->mat, (float*) item->pos, item->scale[0], (float*) item->color);
+        } else {
+            simple = true;
+        }
+    }
+    bool cull = g_queue.occlusionCull && hiz_isValid();
+    model_drawMultiDraw(&g_queue.view, cull);
+
+    if (simple) {
+        for (int i = first; i < last; ++i) {
+            const RenderItem *item = &g_queue.items[g_queue.entries[i].item];
+            if (item->instanceable && !item->mat) {
+                model_addMultiDraw(item->model, NULL, (float*) item->pos, item->scale[0], (float*) item->color);
+            }
+        }
+        model_drawSimpleMultiDraw(cull);
+    }
+}
+
+/**
+ * Draws the sorted entries in [first, last), the items that cannot be
+ * instanced one by one first, then one multi-draw per shader.
+ * Only for ranges whose order does not matter.
+ * @param first Index of the first sort entry.
+ * @param last Index after the last sort entry.
+ */
+static void drawRangeMulti(int first, int last) {
+    drawSingles(first, last);
+    drawBatched(first, last);
+}
+
+/**
+ * Draws the sorted entries in [first, last).
+ * @param first Index of the first sort entry.
+ * @param last Index after the last sort entry.
+ */
+static void drawRange(int first, int last) {
+    for (int i = first; i < last; ) {
+        const RenderItem *item = &g_queue.items[g_queue.entries[i].item];
+        if (item->instanceable) {
+            i = drawRun(i, last);
+        } else {
+            drawItem(item);
+            ++i;
+        }
+    }
+}
+
+/**
+ * Pass drawing the opaque items that cannot be multi-drawn, the occluders
+ * of the Hi-Z pyramid. Without color if the depth pre-pass follows.
+ * @param userData Unused.
+ */
+static void occludersPass(void *userData) {
+    NK_UNUSED(userData);
+    profiler_pushCountedScope("Occluders");
+    glstate_colorMask(!g_queue.depthPrepass);
+    drawSingles(0, g_queue.opaqueCount);
+    glstate_colorMask(true);
+    profiler_popScope();
+}
+
+/**
+ * Pass building the Hi-Z pyramid from the depth drawn by the occluders.
+ * @param userData Unused.
+ */
+static void hizPass(void *userData) {
+    NK_UNUSED(userData);
+    hiz_build(framegraph_getTexture(g_queue.hizDepth), framegraph_getTexture(g_queue.hizPyramid));
+}
+
+/**
+ * Pass drawing the opaque depth, the shading pass then uses GL_EQUAL.
+ * With multi-draw the occluders are already drawn.
+ * @param userData Unused.
+ */
+static void depthPrepassPass(void *userData) {
+    NK_UNUSED(userData);
+    profiler_pushCountedScope("Depth Pre-Pass");
+    glstate_colorMask(false);
+    if (g_queue.multiDraw) {
+        drawBatched(0, g_queue.opaqueCount);
+    } else {
+        drawRange(0, g_queue.opaqueCount);
+    }
+    glstate_colorMask(true);
+    glstate_depthMask(false);
+    glstate_depthFunc(GL_EQUAL);
+    profiler_popScope();
+}
+
+/**
+ * Pass shading the opaque items. With multi-draw the occluders are only
+ * drawn again if the depth pre-pass drew them without color.
+ * @param userData Unused.
+ */
+static void opaquePass(void *userData) {
+    NK_UNUSED(userData);
+    profiler_pushCountedScope("Opaque");
+    if (!g_queue.multiDraw) {
+        drawRange(0, g_queue.opaqueCount);
+    } else {
+        if (g_queue.depthPrepass) {
+            drawSingles(0, g_queue.opaqueCount);
+        }
+        drawBatched(0, g_queue.opaqueCount);
+    }
+    profiler_popScope();
+}
+
+/**
+ * Pass drawing the transparent items, into the transparency targets if
+ * the pass is available, else sorted and blended over the scene.
+ * @param userData Unused.
+ */
+static void transparentPass(void *userData) {
+    NK_UNUSED(userData);
+    profiler_pushCountedScope("Transparent");
+    int first = g_queue.opaqueCount;
+    int count = g_queue.size;
+
+    g_queue.oitActive = g_queue.oit && oit_begin(framegraph_getTexture(g_queue.oitAccum),
+        framegraph_getTexture(g_queue.oitRevealage), framegraph_getTexture(g_queue.oitDepth));
+    if (g_queue.oitActive) {
+        if (g_queue.multiDraw) {
+            drawRangeMulti(first, count);
+        } else {
+            drawRange(first, count);
+        }
+    } else {
+        // Without the pass the transparent items need their order after all
+        if (g_queue.oit) {
+            for (int i = first; i < count; ++i) {
+                g_queue.entries[i].key = makeKey(&g_queue.items[g_queue.entries[i].item], true);
+            }
+            qsort(g_queue.entries + first, count - first, sizeof(SortEntry), compareEntries);
+        }
+
+        glstate_setEnabled(GL_BLEND, true);
+        drawRange(first, count);
+        glstate_setEnabled(GL_BLEND, false);
+    }
+    profiler_popScope();
+}
+
+/**
+ * Pass blending the transparency targets over the scene.
+ * @param userData Unused.
+ */
+static void oitCompositePass(void *userData) {
+    NK_UNUSED(userData);
+    if (g_queue.oitActive) {
+        oit_end();
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void renderqueue_cleanup(void) {
+    oit_cleanup();
+    hiz_cleanup();
+    framegraph_cleanup();
+    free(g_queue.items);
+    free(g_queue.entries);
+    memset(&g_queue, 0, sizeof(g_queue));
+}
+
+void renderqueue_begin(void) {
+    g_queue.size = 0;
+    g_queue.materialCount = 0;
+    scene_getMV(g_queue.view);
+}
+
+void renderqueue_addModel(ModelType model, const Material *mat, vec3 pos, float scale, vec3 color, bool drawNormals) {
+    RenderItem *item = addItem();
+    item->kind = mat ? ITEM_MODEL : ITEM_SIMPLE;
+    item->model = model;
+    item->mat = mat;
+    item->slot = materialSlot(mat);
+    glm_vec3_copy(pos, item->pos);
+    glm_vec3_fill(item->scale, scale);
+    glm_vec3_copy(color, item->color);
+    item->drawNormals = drawNormals;
+
+    // The normals shader is not instanced
+    item->instanceable = !drawNormals;
+}
+
+void renderqueue_addScaledModel(ModelType model, const Material *mat, vec3 pos, vec3 scale, bool drawNormals) {
+    assert(mat && "scaled models are drawn with the Model-Shader");
+
+    RenderItem *item = addItem();
+    item->kind = ITEM_MODEL;
+    item->model = model;
+    item->mat = mat;
+    item->slot = materialSlot(mat);
+    glm_vec3_copy(pos, item->pos);
+    glm_vec3_copy(scale, item->scale);
+    item->drawNormals = drawNormals;
+    item->instanceable = !drawNormals;
+    item->axisScaled = true;
+}
+
+RenderBatch renderqueue_reserveModels(ModelType model, const Material *mat, int count, bool drawNormals) {
+    RenderBatch batch = {
+        .first = g_queue.size,
+        .count = count,
+        .model = model,
+        .mat = mat,
+        .slot = materialSlot(mat),
+        .drawNormals = drawNormals
+    };
+    reserve(g_queue.size + count);
+    g_queue.size += count;
+    return batch;
+}
+
+void renderqueue_setModel(const RenderBatch *batch, int idx, vec3 pos, float scale, vec3 color) {
+    assert(idx >= 0 && idx < batch->count && "index out of the batch in renderqueue_setModel");
+
+    RenderItem *item = &g_queue.items[batch->first + idx];
+    *item = (RenderItem) {
+        .kind = batch->mat ? ITEM_MODEL : ITEM_SIMPLE,
+        .model = batch->model,
+        .mat = batch->mat,
+        .slot = batch->slot,
+        .drawNormals = batch->drawNormals,
+        .instanceable = !batch->drawNormals
+    };
+    glm_vec3_copy(pos, item->pos);
+    glm_vec3_fill(item->scale, scale);
+    glm_vec3_copy(color, item->color);
+}
+
+void renderqueue_addCustom(RenderCallback draw, void *userData, vec3 center) {
+    RenderItem *item = addItem();
+    item->kind = ITEM_CUSTOM;
+    item->model = MODEL_SURFACE;
+    glm_vec3_copy(center, item->pos);
+    item->draw = draw;
+    item->userData = userData;
+}
+
+void renderqueue_flush(bool depthPrepass, bool oit, bool multiDraw, bool occlusionCull) {
+    g_queue.depthPrepass = depthPrepass;
+    g_queue.oit = oit;
+    g_queue.multiDraw = multiDraw;
+    g_queue.occlusionCull = multiDraw && occlusionCull;
+    hiz_invalidate();
+
+    int count = g_queue.size;
+    bool sortTransparent = !oit;
+    jobs_parallelFor(count, KEYS_PER_CHUNK, makeKeysJob, &sortTransparent);
+    qsort(g_queue.entries, count, sizeof(SortEntry), compareEntries);
+
+    int opaqueCount = 0;
+    while (opaqueCount < count && !(g_queue.entries[opaqueCount].key & KEY_TRANSPARENT)) {
+        ++opaqueCount;
+    }
+    g_queue.opaqueCount = opaqueCount;
+    bool transparent = opaqueCount < count;
+    bool useOit = oit && oit_isSupported();
+
+    // Targets at the viewport size, the graph shares the ones whose passes do not overlap
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    framegraph_begin();
+    FgTexture hizDepth = framegraph_texture("Hi-Z Depth", GL_DEPTH24_STENCIL8, viewport[2], viewport[3], false);
+    FgTexture hizPyramid = framegraph_texture("Hi-Z Pyramid", GL_R32F, viewport[2], viewport[3], true);
+    FgTexture oitAccum = framegraph_texture("OIT Accum", GL_RGBA16F, viewport[2], viewport[3], false);
+    FgTexture oitRevealage = framegraph_texture("OIT Revealage", GL_R8, viewport[2], viewport[3], false);
+    FgTexture oitDepth = framegraph_texture("OIT Depth", GL_DEPTH24_STENCIL8, viewport[2], viewport[3], false);
+    g_queue.hizDepth = hizDepth;
+    g_queue.hizPyramid = hizPyramid;
+    g_queue.oitAccum = oitAccum;
+    g_queue.oitRevealage = oitRevealage;
+    g_queue.oitDepth = oitDepth;
+
+    int pass = framegraph_pass("Occluders", multiDraw && opaqueCount > 0, occludersPass, NULL);
+    framegraph_write(pass, FRAMEGRAPH_SCENE);
+
+    // Culled without a pass that reads the pyramid
+    pass = framegraph_pass("Hi-Z", g_queue.occlusionCull, hizPass, NULL);
+    framegraph_write(pass, hizDepth);
+    framegraph_read(pass, hizDepth);
+    framegraph_write(pass, hizPyramid);
+
+    pass = framegraph_pass("Depth Pre-Pass", depthPrepass && opaqueCount > 0, depthPrepassPass, NULL);
+    framegraph_write(pass, FRAMEGRAPH_SCENE);
+    if (g_queue.occlusionCull) {
+        framegraph_read(pass, hizPyramid);
+    }
+
+    pass = framegraph_pass("Opaque", opaqueCount > 0, opaquePass, NULL);
+    framegraph_write(pass, FRAMEGRAPH_SCENE);
+    if (g_queue.occlusionCull) {
+        framegraph_read(pass, hizPyramid);
+    }
+
+    pass = framegraph_pass("Transparent", transparent, transparentPass, NULL);
+    framegraph_write(pass, FRAMEGRAPH_SCENE);
+    if (useOit) {
+        if (g_queue.occlusionCull) {
+            framegraph_read(pass, hizPyramid);
+        }
+        framegraph_write(pass, oitAccum);
+        framegraph_write(pass, oitRevealage);
+        framegraph_write(pass, oitDepth);
+    }
+
+    pass = framegraph_pass("OIT Composite", transparent && useOit, oitCompositePass, NULL);
+    framegraph_read(pass, oitAccum);
+    framegraph_read(pass, oitRevealage);
+    framegraph_write(pass, FRAMEGRAPH_SCENE);
+
+    framegraph_execute();
+
+    // glClear respects the depth mask, so it must be restored every frame
+    glstate_depthFunc(GL_LESS);
+    glstate_depthMask(true);
+
+    g_queue.size = 0;
+    g_queue.casterCount = 0;
+}
+
+int renderqueue_sortShadowCasters(void) {
+    int count = 0;
+    for (int i = 0; i < g_queue.size; ++i) {
+        const RenderItem *item = &g_queue.items[i];
+        if (item->kind == ITEM_MODEL && item->mat->alpha >= 1.0f) {
+            g_queue.entries[count].key = makeKey(item, false);
+            g_queue.entries[count].item = i;
+            ++count;
+        }
+    }
+    qsort(g_queue.entries, count, sizeof(SortEntry), compareEntries);
+    g_queue.casterCount = count;
+    return count;
+}
+
+void renderqueue_drawShadowCasters(void) {
+    g_queue.shadowPass = true;
+    drawRange(0, g_queue.casterCount);
+    g_queue.shadowPass = false;
+}
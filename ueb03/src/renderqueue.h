@@ -0,0 +1,138 @@
+/**
+ * @file renderqueue.h
+ * @brief Sort-by-state render queue for the scene objects
+ *
+ * Scene objects are submitted as keyed items instead of being drawn in
+ * a fixed order. On flush, opaque items are sorted by program, model and
+ * material and front-to-back within equal state, transparent items
+ * (material alpha below 1) back-to-front or, with weighted blended
+ * transparency, by state only. Runs of equal state are merged into one
+ * instanced draw where possible, or all instanceable items of a pass into
+ * one multi-draw-indirect per shader.
+ *
+ * Items only hold plain data until the flush, so large groups of them can
+ * be recorded on worker threads: the main thread reserves a batch of
+ * models with equal state and any thread fills its items by index, e.g.
+ * in a jobs_parallelFor. Only the flush issues GL calls.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <fhwcg/fhwcg.h>
+#include "model.h"
+
+/**
+ * Draws an item that is not a plain model, e.g. the surface.
+ * Called with the view matrix on top of the scene stack.
+ * @param userData The pointer given on submission.
+ */
+typedef void (*RenderCallback)(void *userData);
+
+/**
+ * Reserved items of equal model and material, filled by renderqueue_setModel.
+ */
+typedef struct {
+    int first;              // index of the first item
+    int count;
+    ModelType model;
+    const Material *mat;
+    int slot;               // material slot of the sort key
+    bool drawNormals;
+} RenderBatch;
+
+/**
+ * Frees the item storage.
+ */
+void renderqueue_cleanup(void);
+
+/**
+ * Starts collecting items for a new flush.
+ * The current Model-View-Matrix is taken as the view matrix, item
+ * positions are given in its world space.
+ */
+void renderqueue_begin(void);
+
+/**
+ * Submits a model at a position with uniform scale.
+ * Consecutive items with equal state are drawn instanced.
+ * @param model The model type, must be < MODEL_MESH_COUNT.
+ * @param mat Material for the Model-Shader, NULL draws with the Simple-Shader in color.
+ * @param pos World space translation.
+ * @param scale Uniform scale.
+ * @param color Color for the Simple-Shader, unused with a material.
+ * @param drawNormals If the normals should be drawn, such items are drawn one by one.
+ */
+void renderqueue_addModel(ModelType model, const Material *mat, vec3 pos, float scale, vec3 color, bool drawNormals);
+
+/**
+ * Submits a model at a position with a per-axis scale.
+ * Such items are instanced unless their normals are drawn, but never multi-drawn.
+ * @param model The model type, must be < MODEL_MESH_COUNT.
+ * @param mat Material for the Model-Shader, must not be NULL.
+ * @param pos World space translation.
+ * @param scale Scale per axis.
+ * @param drawNormals If the normals should be drawn.
+ */
+void renderqueue_addScaledModel(ModelType model, const Material *mat, vec3 pos, vec3 scale, bool drawNormals);
+
+/**
+ * Reserves items for models with equal state, see renderqueue_addModel.
+ * Every item must be set before the flush, no other item may be
+ * submitted while they are set.
+ * @param model The model type, must be < MODEL_MESH_COUNT.
+ * @param mat Material for the Model-Shader, NULL draws with the Simple-Shader.
+ * @param count Number of items.
+ * @param drawNormals If the normals should be drawn.
+ * @return The reserved items.
+ */
+RenderBatch renderqueue_reserveModels(ModelType model, const Material *mat, int count, bool drawNormals);
+
+/**
+ * Sets a reserved item, safe from any thread for distinct items.
+ * @param batch The reserved items.
+ * @param idx Index in [0, batch->count).
+ * @param pos World space translation.
+ * @param scale Uniform scale.
+ * @param color Color for the Simple-Shader, unused with a material.
+ */
+void renderqueue_setModel(const RenderBatch *batch, int idx, vec3 pos, float scale, vec3 color);
+
+/**
+ * Submits opaque geometry drawn by a callback, e.g. with the Model-Shader.
+ * @param draw The draw callback.
+ * @param userData Passed to the callback.
+ * @param center World space position used for the depth order.
+ */
+void renderqueue_addCustom(RenderCallback draw, void *userData, vec3 center);
+
+/**
+ * Sorts and draws all submitted items, then empties the queue.
+ * Blending is enabled for the transparent items only.
+ * @param depthPrepass If the opaque items should be drawn depth-only first
+ *                     and then shaded with GL_EQUAL.
+ * @param oit If the transparent items are drawn unsorted with weighted
+ *            blended transparency, sorted if the pass is not available.
+ * @param multiDraw If the instanceable items of the opaque and the unsorted
+ *                  transparent items are drawn with one multi-draw per shader.
+ * @param occlusionCull If the multi-drawn items hidden behind the depth of the
+ *                      items drawn one by one are culled on the GPU.
+ */
+void renderqueue_flush(bool depthPrepass, bool oit, bool multiDraw, bool occlusionCull);
+
+/**
+ * Sorts the submitted shadow casters, the opaque items drawn with the
+ * Model-Shader. Custom and simple items cast no shadows.
+ * @return Number of shadow casters.
+ */
+int renderqueue_sortShadowCasters(void);
+
+/**
+ * Draws the casters of the last renderqueue_sortShadowCasters with the
+ * current matrices, without normals. The queue keeps its items.
+ */
+void renderqueue_drawShadowCasters(void);
+
+#endif // RENDERQUEUE_H
@@ -6,7 +6,26 @@
  * Manages three shader programs:
  * - simple (colored rendering),
  * - model (lighting and materials),
- * - normal (normal vector visualization with geometry shader).
+ * - normal (precomputed normal lines, tips moved out in view space),
+ * - normal generation (compute shader building the surface normal lines),
+ * - heightmap bake (compute shader writing the surface heightmap),
+ * - height noise (compute shader writing noise heights into the control points),
+ * - surface tessellation (model shading, surface evaluated on the GPU),
+ * - heightmap min/max (compute shader building the pyramid of height ranges),
+ * - heightmap march (model shading, fullscreen ray march of the heightmap),
+ * - Hi-Z build and occlusion cull (compute shaders culling the multi-draw objects).
+ *
+ * Per-draw uniforms are set through cached locations. Camera, light,
+ * shadow cube and the light cluster parameters live in a per-frame uniform
+ * buffer, all materials in a second one that is indexed per draw.
+ *
+ * The programs sharing the model fragment stage are built once per
+ * variant key. shader_setTexture selects the variant the following
+ * draws use, the fragment stage has no texture branch.
+ *
+ * The lit variants and the compute programs are built on the GL directly
+ * (glprogram.h), their stages may come from the resource archive. The
+ * other programs are fhwcg shaders.
  *
  * @authors Nikolaos Tsetsas, Noah Schmidt
  */
@@ -16,13 +35,126 @@
 #include "shader.h"
 #include "rendering.h"
 #include "model.h"
+#include "glstate.h"
+#include "gpumem.h"
+#include "timeline.h"
+#include "shadervariant.h"
+#include "gpuprim.h"
 
 #define NORMAL_COLOR ((vec3) {1, 0, 0})
 #define NORMAL_LENGTH 0.1f
+#define TESS_PIXELS_PER_SEGMENT 8.0f
+#define TESS_MAX_LEVEL 64.0f
+#define HEIGHTMAP_UNIT 1    // must match model.c
+#define HEIGHT_BANDS_UNIT 3
+#define OIT_ACCUM_UNIT 4
+#define OIT_REVEALAGE_UNIT 5
+#define HEIGHTMAP_MINMAX_UNIT 6  // must match model.c
+#define HIZ_UNIT 7               // must match hiz.c
+#define SHADOW_UNIT 8
+#define AO_UNIT 9
+#define NORMAL_MAP_UNIT 10
+
+/** Uniform buffer bindings and size of the material array, must match model.frag */
+#define FRAME_UBO_BINDING 0
+#define MATERIAL_UBO_BINDING 1
+#define MAX_MATERIALS 32
+
+/** Variant keys of the lit programs, the march bit only selects the ray march program */
+#define LIT_VARIANT_TEXTURE 1
+#define LIT_VARIANTS 2
+#define LIT_VARIANT_MARCH 2
+
+/** Defines of the lit variant keys, bit i defines entry i */
+static const char *const g_litFlags[] = { "USE_TEXTURE", "HEIGHTMAP_MARCH" };
+
+/**
+ * Uniforms set per draw call, their locations are cached per shader.
+ */
+typedef enum {
+    U_MVP,
+    U_VIEW,
+    U_MODELVIEW,
+    U_INSTANCED,
+    U_MATERIAL_INDEX,
+    U_MULTI_DRAW,
+    U_COLOR,
+    U_NORMAL_MODELVIEW,
+    U_NORMAL_MATRIX,
+    U_PROJ,
+    U_GRID_DIM,
+    U_GRID_EXTENT,
+    U_TEXTURE_TILING,
+    U_HEIGHTMAP,
+    U_COUNT
+} UniformId;
+
+/** Uniform names indexed by UniformId */
+static const char *g_uniformNames[U_COUNT] = {
+    "u_mvpMatrix",
+    "u_viewMatrix",
+    "u_modelviewMatrix",
+    "u_instanced",
+    "u_materialIndex",
+    "u_multiDraw",
+    "u_color",
+    "u_modelViewMatrix",
+    "u_normalMatrix",
+    "u_projMatrix",
+    "u_gridDim",
+    "u_gridExtent",
+    "u_textureTiling",
+    "u_heightmap"
+};
+
+/**
+ * std140 layout of the per-frame block (FrameData in model.frag).
+ */
+typedef struct {
+    vec4 camPosVS;
+    vec4 lightPosVS;    // w: enabled
+    vec4 lightColor;    // w: ambient factor
+    vec4 lightFalloff;  // x: constant, y: linear, z: quadratic
+    vec4 clusterProj;   // xy: projection scale, z: first slice depth, w: slices per log depth
+    vec4 shadowLight;   // xyz: world space position of the shadow cube, w: 1 if it is sampled
+    vec4 shadowParams;  // x: near, y: far, z: bias, w: 1 while drawing into the shadow cube
+    GLint clusterLightCount;
+    GLint padding[3];
+} FrameBlock;
+
+/**
+ * std140 layout of one material (MaterialData in model.frag).
+ */
+typedef struct {
+    vec4 ambient;   // w: shininess
+    vec4 diffuse;   // w: alpha
+    vec4 specular;
+    vec4 emission;
+} MaterialBlock;
+
+static Shader *simpleShader, *normalShader, *upscaleShader, *oitCompositeShader, *guiCompositeShader;
+
+/** Programs built by glprogram, their stages may come from the resource archive */
+static GlProgram *normalGenShader, *heightmapShader, *ballPhysicsShader, *heightNoiseShader;
+static GlProgram *heightMinMaxShader, *hizBuildShader, *occlusionCullShader;
+static GlProgram *surfaceGenShader, *surfaceBoundsShader;
+
+/** Lit programs per variant key, and the ones of the selected key */
+static GlProgram *modelShaders[LIT_VARIANTS], *surfaceTessShaders[LIT_VARIANTS], *heightMarchShaders[LIT_VARIANTS];
+static GlProgram *modelShader, *surfaceTessShader, *heightMarchShader;
+static int g_litVariant = 0;
 
-////////////////////////    LOCAL    ////////////////////////////
+/** Cached uniform locations, indexed by UniformId (-1 if unused by the shader) */
+static GLint modelVariantLocs[LIT_VARIANTS][U_COUNT], simpleLocs[U_COUNT], normalLocs[U_COUNT];
+static GLint *modelLocs = modelVariantLocs[0];
 
-static Shader *modelShader, *simpleShader, *normalShader;
+/** Uniform buffers with their CPU copies */
+static struct {
+    GLuint frameUbo, materialUbo;
+    FrameBlock frame;
+    const Material *materials[MAX_MATERIALS];
+    int materialCount;
+} g_ubo;
 
 /**
  * Helper function to delete a shader and set pointer to NULL.
@@ -31,11 +163,92 @@ static Shader *modelShader, *simpleShader, *normalShader;
  */
 static void cleanup(Shader *s) {
     if (s) {
+        // The address may be reused by the next shader
+        glstate_invalidate();
         shader_deleteShader(&s);
         s = NULL;
     }
 }
 
+/**
+ * Helper function to delete a program built by glprogram and set the pointer to NULL.
+ *
+ * @param p Pointer to the program pointer to clean up
+ */
+static void cleanupProgram(GlProgram **p) {
+    if (*p) {
+        // The address may be reused by the next program
+        glstate_invalidate();
+        glprogram_delete(p);
+    }
+}
+
+/**
+ * Looks up the locations of all UniformId names in a shader.
+ * @param s The shader, may be NULL.
+ * @param locs Output for U_COUNT locations.
+ */
+static void cacheLocations(Shader *s, GLint *locs) {
+    for (int i = 0; i < U_COUNT; ++i) {
+        locs[i] = -1;
+    }
+    if (!s) {
+        return;
+    }
+
+    // fhwcg hides the program name, read it back from the bound program
+    GLint program = 0;
+    glstate_useShader(s);
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    for (int i = 0; i < U_COUNT; ++i) {
+        locs[i] = glGetUniformLocation((GLuint) program, g_uniformNames[i]);
+    }
+}
+
+/**
+ * Looks up the locations of all UniformId names in a program.
+ * @param p The program, may be NULL.
+ * @param locs Output for U_COUNT locations.
+ */
+static void cacheProgramLocations(GlProgram *p, GLint *locs) {
+    for (int i = 0; i < U_COUNT; ++i) {
+        locs[i] = p ? glprogram_location(p, g_uniformNames[i]) : -1;
+    }
+}
+
+/**
+ * Creates the uniform buffers and binds them to their binding points.
+ * Does nothing if they already exist.
+ */
+static void initUniformBuffers(void) {
+    if (g_ubo.frameUbo) {
+        return;
+    }
+
+    glGenBuffers(1, &g_ubo.frameUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, g_ubo.frameUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), &g_ubo.frame, GL_DYNAMIC_DRAW);
+    gpumem_setBuffer(GPUMEM_UNIFORMS, g_ubo.frameUbo, sizeof(FrameBlock));
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UBO_BINDING, g_ubo.frameUbo);
+
+    glGenBuffers(1, &g_ubo.materialUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, g_ubo.materialUbo);
+    glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(MaterialBlock), NULL, GL_STATIC_DRAW);
+    gpumem_setBuffer(GPUMEM_UNIFORMS, g_ubo.materialUbo, MAX_MATERIALS * sizeof(MaterialBlock));
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_UBO_BINDING, g_ubo.materialUbo);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/**
+ * Uploads the CPU copy of the per-frame block.
+ */
+static void uploadFrameBlock(void) {
+    glBindBuffer(GL_UNIFORM_BUFFER, g_ubo.frameUbo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameBlock), &g_ubo.frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 /**
  * Transforms the given vec3 from world to view space based on 
  * the current Stack.
@@ -52,16 +265,257 @@ static void worldToView(vec3 vec, vec3 dest, bool isPos) {
     glm_vec3_copy((vec3) {vecWS[0], vecWS[1], vecWS[2]}, dest);
 }
 
+/**
+ * Creates and compiles a variant of the model shader.
+ * @param key Variant key.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createModelShader(int key) {
+    GlProgram* shader = glprogram_create();
+    shadervariant_attachFile(shader, GL_VERTEX_SHADER,   RESOURCE_PATH "shader/model/model.vert", key, g_litFlags);
+    shadervariant_attachFile(shader, GL_FRAGMENT_SHADER, RESOURCE_PATH "shader/model/model.frag", key, g_litFlags);
+
+    if (!glprogram_link(key ? "model textured" : "model", shader)) {
+        glprogram_delete(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Creates and compiles a variant of the surface tessellation shader.
+ * Shares the fragment stage with the model shader.
+ * @param key Variant key.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createSurfaceTessShader(int key) {
+    GlProgram* shader = glprogram_create();
+    shadervariant_attachFile(shader, GL_VERTEX_SHADER,          RESOURCE_PATH "shader/surfaceTess/surfaceTess.vert", 0, NULL);
+    shadervariant_attachFile(shader, GL_TESS_CONTROL_SHADER,    RESOURCE_PATH "shader/surfaceTess/surfaceTess.tesc", 0, NULL);
+    shadervariant_attachFile(shader, GL_TESS_EVALUATION_SHADER, RESOURCE_PATH "shader/surfaceTess/surfaceTess.tese", 0, NULL);
+    shadervariant_attachFile(shader, GL_FRAGMENT_SHADER, RESOURCE_PATH "shader/model/model.frag", key, g_litFlags);
+
+    if (!glprogram_link(key ? "surface tessellation textured" : "surface tessellation", shader)) {
+        glprogram_delete(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Creates and compiles a variant of the heightmap ray march shader.
+ * A fullscreen triangle with the model fragment stage marching the heightmap.
+ * @param key Variant key, without LIT_VARIANT_MARCH.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createHeightMarchShader(int key) {
+    GlProgram* shader = glprogram_create();
+    shadervariant_attachFile(shader, GL_VERTEX_SHADER, RESOURCE_PATH "shader/upscale/upscale.vert", 0, NULL);
+    shadervariant_attachFile(shader, GL_FRAGMENT_SHADER, RESOURCE_PATH "shader/model/model.frag",
+        key | LIT_VARIANT_MARCH, g_litFlags);
+
+    if (!glprogram_link(key ? "heightmap march textured" : "heightmap march", shader)) {
+        glprogram_delete(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Selects the lit programs the following draws use.
+ * @param key Variant key.
+ */
+static void selectLitVariant(int key) {
+    g_litVariant = key;
+    modelShader = modelShaders[key];
+    surfaceTessShader = surfaceTessShaders[key];
+    heightMarchShader = heightMarchShaders[key];
+    modelLocs = modelVariantLocs[key];
+}
+
+/**
+ * Creates and compiles the compute shader building the surface normal lines.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createNormalGenShader(void) {
+    GlProgram* shader = glprogram_create();
+    shadervariant_attachFile(shader, GL_COMPUTE_SHADER, RESOURCE_PATH "shader/normalLines/normalLines.comp", 0, NULL);
+
+    if (!glprogram_link("normal generation", shader)) {
+        glprogram_delete(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Creates and compiles the compute shader sampling the surface patches into the vertex buffer.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createSurfaceGenShader(void) {
+    GlProgram* shader = glprogram_create();
+    shadervariant_attachFile(shader, GL_COMPUTE_SHADER, RESOURCE_PATH "shader/surfaceGen/surfaceGen.comp", 0, NULL);
+
+    if (!glprogram_link("surface generation", shader)) {
+        glprogram_delete(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Creates and compiles the compute shader reducing the surface heights per chunk.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createSurfaceBoundsShader(void) {
+    GlProgram* shader = glprogram_create();
+    shadervariant_attachFile(shader, GL_COMPUTE_SHADER, RESOURCE_PATH "shader/surfaceGen/surfaceBounds.comp", 0, NULL);
+
+    if (!glprogram_link("surface bounds", shader)) {
+        glprogram_delete(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Creates and compiles the compute shader baking the surface heightmap.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createHeightmapShader(void) {
+    GlProgram* shader = glprogram_create();
+    shadervariant_attachFile(shader, GL_COMPUTE_SHADER, RESOURCE_PATH "shader/heightmap/heightmapBake.comp", 0, NULL);
+
+    if (!glprogram_link("heightmap bake", shader)) {
+        glprogram_delete(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Creates and compiles the compute shader building the min/max pyramid of the heightmap.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createHeightMinMaxShader(void) {
+    GlProgram* shader = glprogram_create();
+    shadervariant_attachFile(shader, GL_COMPUTE_SHADER, RESOURCE_PATH "shader/heightmap/heightmapMinMax.comp", 0, NULL);
+
+    if (!glprogram_link("heightmap min/max", shader)) {
+        glprogram_delete(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Creates and compiles the compute shader building one level of the Hi-Z pyramid.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createHizBuildShader(void) {
+    GlProgram* shader = glprogram_create();
+    shadervariant_attachFile(shader, GL_COMPUTE_SHADER, RESOURCE_PATH "shader/occlusion/hizBuild.comp", 0, NULL);
+
+    if (!glprogram_link("hi-z build", shader)) {
+        glprogram_delete(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Creates and compiles the compute shader culling the multi-draw objects against the Hi-Z pyramid.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createOcclusionCullShader(void) {
+    GlProgram* shader = glprogram_create();
+    shadervariant_attachFile(shader, GL_COMPUTE_SHADER, RESOURCE_PATH "shader/occlusion/occlusionCull.comp", 0, NULL);
+
+    if (!glprogram_link("occlusion cull", shader)) {
+        glprogram_delete(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Creates and compiles the compute shader writing noise heights into the control points.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createHeightNoiseShader(void) {
+    GlProgram* shader = glprogram_create();
+    shadervariant_attachFile(shader, GL_COMPUTE_SHADER, RESOURCE_PATH "shader/heightmap/heightNoise.comp", 0, NULL);
+
+    if (!glprogram_link("height noise", shader)) {
+        glprogram_delete(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Creates and compiles the compute shader running the passes of the GPU ball physics.
+ * @return Pointer to the compiled shader or NULL on failure.
+ */
+static GlProgram* createBallPhysicsShader(void) {
+    GlProgram* shader = glprogram_create();
+    shadervariant_attachFile(shader, GL_COMPUTE_SHADER, RESOURCE_PATH "shader/ballPhysics/ballPhysics.comp", 0, NULL);
+
+    if (!glprogram_link("ball physics", shader)) {
+        glprogram_delete(&shader);
+        return NULL;
+    }
+    return shader;
+}
+
+/**
+ * Collects the shaders of all variants using the model fragment stage.
+ * @param dest Output for the shaders, 3 * LIT_VARIANTS entries.
+ * @return Number of available shaders.
+ */
+static int getLitShaders(GlProgram **dest) {
+    int count = 0;
+    for (int i = 0; i < LIT_VARIANTS; ++i) {
+        if (modelShaders[i]) dest[count++] = modelShaders[i];
+        if (surfaceTessShaders[i]) dest[count++] = surfaceTessShaders[i];
+        if (heightMarchShaders[i]) dest[count++] = heightMarchShaders[i];
+    }
+    return count;
+}
+
 ////////////////////////    PUBLIC    ////////////////////////////
 
 void shader_cleanup(void) {
-    cleanup(modelShader);
+    for (int i = 0; i < LIT_VARIANTS; ++i) {
+        cleanupProgram(&modelShaders[i]);
+        cleanupProgram(&surfaceTessShaders[i]);
+        cleanupProgram(&heightMarchShaders[i]);
+    }
     cleanup(simpleShader);
     cleanup(normalShader);
+    cleanupProgram(&normalGenShader);
+    cleanupProgram(&surfaceGenShader);
+    cleanupProgram(&surfaceBoundsShader);
+    cleanupProgram(&heightmapShader);
+    cleanupProgram(&heightMinMaxShader);
+    cleanupProgram(&hizBuildShader);
+    cleanupProgram(&occlusionCullShader);
+    cleanupProgram(&ballPhysicsShader);
+    cleanupProgram(&heightNoiseShader);
+    cleanup(upscaleShader);
+    cleanup(oitCompositeShader);
+    cleanup(guiCompositeShader);
+
+    gpumem_deleteBuffers(1, &g_ubo.frameUbo);
+    gpumem_deleteBuffers(1, &g_ubo.materialUbo);
+    memset(&g_ubo, 0, sizeof(g_ubo));
 }
 
 void shader_load(void) {
+    TIMELINE_BEGIN("Load Shaders");
     Shader *newShader = NULL;
+    GlProgram *newProgram = NULL;
+    initUniformBuffers();
 
     newShader = shader_createVeFrShader(
         "simple", 
@@ -73,96 +527,586 @@ void shader_load(void) {
         simpleShader = newShader;
     }
 
-    newShader = shader_createVeFrShader(
-        "model", 
-        RESOURCE_PATH "shader/model/model.vert", 
-        RESOURCE_PATH "shader/model/model.frag"
-    );
-    if (newShader) {
-        cleanup(modelShader);
-        modelShader = newShader;
+    for (int key = 0; key < LIT_VARIANTS; ++key) {
+        newProgram = createModelShader(key);
+        if (newProgram) {
+            cleanupProgram(&modelShaders[key]);
+            modelShaders[key] = newProgram;
+
+            glstate_useProgram(newProgram);
+            glprogram_setInt(newProgram, "u_heightTexture", HEIGHTMAP_UNIT);
+            glprogram_setInt(newProgram, "u_gradientTexture", HEIGHTMAP_UNIT + 1);
+            if (key & LIT_VARIANT_TEXTURE) {
+                glprogram_setInt(newProgram, "u_texture", 0);
+            }
+        }
+
+        newProgram = createSurfaceTessShader(key);
+        if (newProgram) {
+            cleanupProgram(&surfaceTessShaders[key]);
+            surfaceTessShaders[key] = newProgram;
+
+            if (key & LIT_VARIANT_TEXTURE) {
+                glstate_useProgram(newProgram);
+                glprogram_setInt(newProgram, "u_texture", 0);
+            }
+        }
+
+        newProgram = createHeightMarchShader(key);
+        if (newProgram) {
+            cleanupProgram(&heightMarchShaders[key]);
+            heightMarchShaders[key] = newProgram;
+
+            glstate_useProgram(newProgram);
+            glprogram_setInt(newProgram, "u_heightTexture", HEIGHTMAP_UNIT);
+            glprogram_setInt(newProgram, "u_gradientTexture", HEIGHTMAP_UNIT + 1);
+            glprogram_setInt(newProgram, "u_minMaxTexture", HEIGHTMAP_MINMAX_UNIT);
+            if (key & LIT_VARIANT_TEXTURE) {
+                glprogram_setInt(newProgram, "u_texture", 0);
+            }
+        }
     }
 
-    newShader = shader_createNormalsShader(FHWCG_SHADER_PATH);
+    newShader = shader_createVeFrShader(
+        "normal lines",
+        RESOURCE_PATH "shader/normalLines/normalLines.vert",
+        RESOURCE_PATH "shader/normalLines/normalLines.frag"
+    );
     if (newShader) {
         cleanup(normalShader);
         normalShader = newShader;
 
-        shader_useShader(normalShader);
+        glstate_useShader(normalShader);
         shader_setFloat(normalShader, "u_normalLength", NORMAL_LENGTH);
         shader_setVec3(normalShader, "u_color", &NORMAL_COLOR);
     }
+
+    newProgram = createNormalGenShader();
+    if (newProgram) {
+        cleanupProgram(&normalGenShader);
+        normalGenShader = newProgram;
+    }
+
+    newProgram = createSurfaceGenShader();
+    if (newProgram) {
+        cleanupProgram(&surfaceGenShader);
+        surfaceGenShader = newProgram;
+    }
+
+    newProgram = createSurfaceBoundsShader();
+    if (newProgram) {
+        cleanupProgram(&surfaceBoundsShader);
+        surfaceBoundsShader = newProgram;
+    }
+
+    newProgram = createHeightmapShader();
+    if (newProgram) {
+        cleanupProgram(&heightmapShader);
+        heightmapShader = newProgram;
+    }
+
+    newProgram = createHeightMinMaxShader();
+    if (newProgram) {
+        cleanupProgram(&heightMinMaxShader);
+        heightMinMaxShader = newProgram;
+
+        glstate_useProgram(heightMinMaxShader);
+        glprogram_setInt(heightMinMaxShader, "u_heightTexture", HEIGHTMAP_UNIT);
+    }
+
+    newProgram = createHizBuildShader();
+    if (newProgram) {
+        cleanupProgram(&hizBuildShader);
+        hizBuildShader = newProgram;
+
+        glstate_useProgram(hizBuildShader);
+        glprogram_setInt(hizBuildShader, "u_depthTexture", HIZ_UNIT);
+    }
+
+    newProgram = createOcclusionCullShader();
+    if (newProgram) {
+        cleanupProgram(&occlusionCullShader);
+        occlusionCullShader = newProgram;
+
+        glstate_useProgram(occlusionCullShader);
+        glprogram_setInt(occlusionCullShader, "u_hiz", HIZ_UNIT);
+    }
+
+    newProgram = createHeightNoiseShader();
+    if (newProgram) {
+        cleanupProgram(&heightNoiseShader);
+        heightNoiseShader = newProgram;
+    }
+
+    newProgram = createBallPhysicsShader();
+    if (newProgram) {
+        cleanupProgram(&ballPhysicsShader);
+        ballPhysicsShader = newProgram;
+
+        glstate_useProgram(ballPhysicsShader);
+        glprogram_setInt(ballPhysicsShader, "u_heightTexture", HEIGHTMAP_UNIT);
+        glprogram_setInt(ballPhysicsShader, "u_gradientTexture", HEIGHTMAP_UNIT + 1);
+    }
+
+    newShader = shader_createVeFrShader(
+        "upscale",
+        RESOURCE_PATH "shader/upscale/upscale.vert",
+        RESOURCE_PATH "shader/upscale/upscale.frag"
+    );
+    if (newShader) {
+        cleanup(upscaleShader);
+        upscaleShader = newShader;
+
+        glstate_useShader(upscaleShader);
+        shader_setInt(upscaleShader, "u_scene", 0);
+    }
+
+    // Shares the fullscreen triangle of the upscale shader
+    newShader = shader_createVeFrShader(
+        "oit composite",
+        RESOURCE_PATH "shader/upscale/upscale.vert",
+        RESOURCE_PATH "shader/oitComposite/oitComposite.frag"
+    );
+    if (newShader) {
+        cleanup(oitCompositeShader);
+        oitCompositeShader = newShader;
+
+        glstate_useShader(oitCompositeShader);
+        shader_setInt(oitCompositeShader, "u_accum", OIT_ACCUM_UNIT);
+        shader_setInt(oitCompositeShader, "u_revealage", OIT_REVEALAGE_UNIT);
+    }
+
+    newShader = shader_createVeFrShader(
+        "gui composite",
+        RESOURCE_PATH "shader/upscale/upscale.vert",
+        RESOURCE_PATH "shader/guiComposite/guiComposite.frag"
+    );
+    if (newShader) {
+        cleanup(guiCompositeShader);
+        guiCompositeShader = newShader;
+
+        glstate_useShader(guiCompositeShader);
+        shader_setInt(guiCompositeShader, "u_gui", 0);
+    }
+
+    // Samplers of different types must not share a unit, the shadow cube gets its own
+    GlProgram *lit[3 * LIT_VARIANTS];
+    int litCount = getLitShaders(lit);
+    for (int i = 0; i < litCount; ++i) {
+        glstate_useProgram(lit[i]);
+        glprogram_setInt(lit[i], "u_shadowMap", SHADOW_UNIT);
+    }
+
+    for (int key = 0; key < LIT_VARIANTS; ++key) {
+        cacheProgramLocations(modelShaders[key], modelVariantLocs[key]);
+    }
+    selectLitVariant(g_litVariant);
+    cacheLocations(simpleShader, simpleLocs);
+    cacheLocations(normalShader, normalLocs);
+    gpuprim_reload();
+    TIMELINE_END();
+}
+
+int shader_getMaterialIndex(const Material *m) {
+    for (int i = 0; i < g_ubo.materialCount; ++i) {
+        if (g_ubo.materials[i] == m) {
+            return i;
+        }
+    }
+
+    assert(g_ubo.materialCount < MAX_MATERIALS && "too many materials for the material buffer");
+    int idx = g_ubo.materialCount++;
+    g_ubo.materials[idx] = m;
+
+    MaterialBlock block = {
+        {m->ambient[0], m->ambient[1], m->ambient[2], m->shininess},
+        {m->diffuse[0], m->diffuse[1], m->diffuse[2], m->alpha},
+        {m->specular[0], m->specular[1], m->specular[2], 0.0f},
+        {m->emission[0], m->emission[1], m->emission[2], 0.0f}
+    };
+
+    glBindBuffer(GL_UNIFORM_BUFFER, g_ubo.materialUbo);
+    glBufferSubData(GL_UNIFORM_BUFFER, idx * sizeof(MaterialBlock), sizeof(MaterialBlock), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return idx;
 }
 
-void shader_setMVP(mat4 *viewMat, mat4 *modelviewMat, const Material *m) {
-    shader_useShader(modelShader);
+void shader_setMVP(mat4 *viewMat, mat4 *modelviewMat, const Material *m, bool instanced) {
+    glstate_useProgram(modelShader);
 
     mat4 mat;
     scene_getMVP(mat);
-    shader_setMat4(modelShader, "u_mvpMatrix", &mat);
-    shader_setMat4(modelShader, "u_viewMatrix", viewMat);
-    shader_setMat4(modelShader, "u_modelviewMatrix", modelviewMat);
+    glUniformMatrix4fv(modelLocs[U_MVP], 1, GL_FALSE, (const GLfloat*) mat);
+    glUniformMatrix4fv(modelLocs[U_VIEW], 1, GL_FALSE, (const GLfloat*) *viewMat);
+    glUniformMatrix4fv(modelLocs[U_MODELVIEW], 1, GL_FALSE, (const GLfloat*) *modelviewMat);
+    glUniform1i(modelLocs[U_INSTANCED], instanced);
+    glUniform1i(modelLocs[U_MATERIAL_INDEX], m ? shader_getMaterialIndex(m) : -1);
+    glUniform1i(modelLocs[U_MULTI_DRAW], false);
+    glUniform1i(modelLocs[U_GRID_DIM], 0);
+}
 
-    bool useMat = m != NULL;
-    shader_setBool(modelShader, "u_useMaterial", useMat);
-    if (useMat) {
-        shader_setVec3(modelShader, "u_material.ambient", (vec3*)m->ambient);
-        shader_setVec3(modelShader, "u_material.diffuse", (vec3*)m->diffuse);
-        shader_setVec3(modelShader, "u_material.specular", (vec3*)m->specular);
-        shader_setVec3(modelShader, "u_material.emission", (vec3*)m->emission);
-        shader_setFloat(modelShader, "u_material.shininess", m->shininess);
-        shader_setFloat(modelShader, "u_material.alpha", m->alpha);
-    }
+void shader_setMultiDrawMVP(mat4 *viewMat) {
+    shader_setMVP(viewMat, viewMat, NULL, true);
+    glUniform1i(modelLocs[U_MULTI_DRAW], true);
+}
+
+void shader_setSurfaceGrid(int dim, vec2 extent, float textureTiling, bool heightmap) {
+    glstate_useProgram(modelShader);
+    glUniform1i(modelLocs[U_GRID_DIM], dim);
+    glUniform2fv(modelLocs[U_GRID_EXTENT], 1, extent);
+    glUniform1f(modelLocs[U_TEXTURE_TILING], textureTiling);
+    glUniform1i(modelLocs[U_HEIGHTMAP], heightmap);
 }
 
 void shader_setColor(vec3 color) {
-    shader_useShader(simpleShader);
-    shader_setVec3(simpleShader, "u_color", (vec3*) color);
+    glstate_useShader(simpleShader);
+    glUniform3fv(simpleLocs[U_COLOR], 1, color);
 }
 
 void shader_setNormals(void) {
-    shader_useShader(normalShader);
+    glstate_useShader(normalShader);
     mat4 mat;
     scene_getMV(mat);
-    shader_setMat4(normalShader, "u_modelViewMatrix", &mat);
+    glUniformMatrix4fv(normalLocs[U_NORMAL_MODELVIEW], 1, GL_FALSE, (const GLfloat*) mat);
     scene_getN(mat);
-    shader_setMat4(normalShader, "u_normalMatrix", &mat);
+    glUniformMatrix4fv(normalLocs[U_NORMAL_MATRIX], 1, GL_FALSE, (const GLfloat*) mat);
     scene_getP(mat);
-    shader_setMat4(normalShader, "u_projMatrix", &mat);
+    glUniformMatrix4fv(normalLocs[U_PROJ], 1, GL_FALSE, (const GLfloat*) mat);
 }
 
-void shader_setSimpleMVP(void) {
-    shader_useShader(simpleShader);
+void shader_setSimpleMVP(bool instanced) {
+    glstate_useShader(simpleShader);
 
     mat4 mat;
     scene_getMVP(mat);
-    shader_setMat4(simpleShader, "u_mvpMatrix", &mat);
+    glUniformMatrix4fv(simpleLocs[U_MVP], 1, GL_FALSE, (const GLfloat*) mat);
+    glUniform1i(simpleLocs[U_INSTANCED], instanced);
 }
 
 void shader_setTexture(GLuint textureId, bool useTexture) {
-    shader_useShader(modelShader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textureId);
 
+    selectLitVariant(useTexture ? LIT_VARIANT_TEXTURE : 0);
+}
+
+void shader_setHeightBands(GLuint textureId, vec2 range) {
+    glActiveTexture(GL_TEXTURE0 + HEIGHT_BANDS_UNIT);
+    glBindTexture(GL_TEXTURE_2D, textureId);
     glActiveTexture(GL_TEXTURE0);
+
+    GlProgram *lit[3 * LIT_VARIANTS];
+    int count = getLitShaders(lit);
+    for (int i = 0; i < count; ++i) {
+        glstate_useProgram(lit[i]);
+        glprogram_setInt(lit[i], "u_heightBands", HEIGHT_BANDS_UNIT);
+        glprogram_setVec2(lit[i], "u_heightBandRange", (vec2*) range);
+    }
+}
+
+void shader_setAmbientOcclusion(GLuint textureId, vec4 transform, float strength) {
+    glActiveTexture(GL_TEXTURE0 + AO_UNIT);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glActiveTexture(GL_TEXTURE0);
+
+    GlProgram *lit[3 * LIT_VARIANTS];
+    int count = getLitShaders(lit);
+    for (int i = 0; i < count; ++i) {
+        glstate_useProgram(lit[i]);
+        glprogram_setInt(lit[i], "u_aoTexture", AO_UNIT);
+        glprogram_setVec4(lit[i], "u_aoTransform", (vec4*) transform);
+        glprogram_setFloat(lit[i], "u_aoStrength", strength);
+    }
+}
+
+void shader_setNormalMap(GLuint textureId, vec4 transform, mat4 viewMat) {
+    glActiveTexture(GL_TEXTURE0 + NORMAL_MAP_UNIT);
     glBindTexture(GL_TEXTURE_2D, textureId);
+    glActiveTexture(GL_TEXTURE0);
+
+    // The surface is drawn without a model matrix and the view is rigid
+    mat3 normalMat;
+    glm_mat4_pick3(viewMat, normalMat);
 
-    shader_setInt(modelShader, "u_texture", 0);
-    shader_setBool(modelShader, "u_useTexture", useTexture);
+    GlProgram *lit[3 * LIT_VARIANTS];
+    int count = getLitShaders(lit);
+    for (int i = 0; i < count; ++i) {
+        glstate_useProgram(lit[i]);
+        glprogram_setBool(lit[i], "u_normalMap", textureId != 0);
+        glprogram_setInt(lit[i], "u_normalTexture", NORMAL_MAP_UNIT);
+        glprogram_setVec4(lit[i], "u_normalTransform", (vec4*) transform);
+        glprogram_setMat3(lit[i], "u_normalViewMatrix", &normalMat);
+    }
 }
 
 void shader_setCamPos(vec3 camPosWS) {
-    shader_useShader(modelShader);
-    vec3 camPosVS = {0};
-    worldToView(camPosWS, camPosVS, true);
-    shader_setVec3(modelShader, "u_camPosVS", (vec3*)camPosVS);
+    worldToView(camPosWS, g_ubo.frame.camPosVS, true);
+    uploadFrameBlock();
 }
 
 void shader_setPointLight(vec3 color, vec3 posWS, vec3 falloff, bool enabled, float ambientFactor) {
-    shader_useShader(modelShader);
-    vec3 posVS = {0};
-    worldToView(posWS, posVS, true);
-    shader_setVec3(modelShader, "u_pointLight.posVS", &posVS);
-    shader_setVec3(modelShader, "u_pointLight.color", (vec3*)color);
-    shader_setVec3(modelShader, "u_pointLight.falloff", (vec3*)falloff);
-    shader_setBool(modelShader, "u_pointLight.enabled", enabled);
-    shader_setFloat(modelShader, "u_pointLight.ambientFactor", ambientFactor);
-}
\ No newline at end of file
+    FrameBlock *f = &g_ubo.frame;
+    worldToView(posWS, f->lightPosVS, true);
+    f->lightPosVS[3] = enabled ? 1.0f : 0.0f;
+    glm_vec3_copy(color, f->lightColor);
+    f->lightColor[3] = ambientFactor;
+    glm_vec3_copy(falloff, f->lightFalloff);
+    uploadFrameBlock();
+}
+
+void shader_setShadow(GLuint cubeMap, vec3 lightPosWS, float nearZ, float farZ, float bias) {
+    glActiveTexture(GL_TEXTURE0 + SHADOW_UNIT);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+    glActiveTexture(GL_TEXTURE0);
+
+    FrameBlock *f = &g_ubo.frame;
+    glm_vec3_copy(lightPosWS, f->shadowLight);
+    f->shadowLight[3] = cubeMap ? 1.0f : 0.0f;
+    f->shadowParams[0] = nearZ;
+    f->shadowParams[1] = farZ;
+    f->shadowParams[2] = bias;
+    uploadFrameBlock();
+}
+
+void shader_setShadowPass(bool active) {
+    // The cube drawn into must not stay bound for sampling
+    if (active) {
+        glActiveTexture(GL_TEXTURE0 + SHADOW_UNIT);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        glActiveTexture(GL_TEXTURE0);
+        g_ubo.frame.shadowLight[3] = 0.0f;
+    }
+    g_ubo.frame.shadowParams[3] = active ? 1.0f : 0.0f;
+    uploadFrameBlock();
+}
+
+void shader_setLightClusters(vec4 proj, int lightCount) {
+    glm_vec4_copy(proj, g_ubo.frame.clusterProj);
+    g_ubo.frame.clusterLightCount = lightCount;
+    uploadFrameBlock();
+}
+
+bool shader_setNormalGen(int dim, int stride, vec2 extent) {
+    if (!normalGenShader) {
+        return false;
+    }
+
+    glstate_useProgram(normalGenShader);
+    glprogram_setInt(normalGenShader, "u_dim", dim);
+    glprogram_setInt(normalGenShader, "u_stride", stride);
+    glprogram_setVec2(normalGenShader, "u_gridExtent", (vec2*) extent);
+    return true;
+}
+
+bool shader_hasSurfaceGen(void) {
+    return surfaceGenShader != NULL && surfaceBoundsShader != NULL;
+}
+
+bool shader_setSurfaceGen(int dim, int patchCount, vec2 step) {
+    if (!surfaceGenShader) {
+        return false;
+    }
+
+    glstate_useProgram(surfaceGenShader);
+    glprogram_setInt(surfaceGenShader, "u_dim", dim);
+    glprogram_setInt(surfaceGenShader, "u_patchCount", patchCount);
+    glprogram_setVec2(surfaceGenShader, "u_step", (vec2*) step);
+    return true;
+}
+
+bool shader_setSurfaceBounds(int dim, int chunkQuads, int perAxis) {
+    if (!surfaceBoundsShader) {
+        return false;
+    }
+
+    glstate_useProgram(surfaceBoundsShader);
+    glprogram_setInt(surfaceBoundsShader, "u_dim", dim);
+    glprogram_setInt(surfaceBoundsShader, "u_chunkQuads", chunkQuads);
+    glprogram_setInt(surfaceBoundsShader, "u_perAxis", perAxis);
+    return true;
+}
+
+bool shader_setHeightmapBake(int dim) {
+    if (!heightmapShader) {
+        return false;
+    }
+
+    glstate_useProgram(heightmapShader);
+    glprogram_setInt(heightmapShader, "u_dim", dim);
+    return true;
+}
+
+bool shader_setHeightMinMax(int level, int srcSize, int dstSize) {
+    if (!heightMinMaxShader) {
+        return false;
+    }
+
+    glstate_useProgram(heightMinMaxShader);
+    glprogram_setInt(heightMinMaxShader, "u_level", level);
+    glprogram_setInt(heightMinMaxShader, "u_srcSize", srcSize);
+    glprogram_setInt(heightMinMaxShader, "u_dstSize", dstSize);
+    return true;
+}
+
+bool shader_setHizBuild(int level, int srcWidth, int srcHeight, int width, int height) {
+    if (!hizBuildShader) {
+        return false;
+    }
+
+    glstate_useProgram(hizBuildShader);
+    vec4 sizes = {(float) srcWidth, (float) srcHeight, (float) width, (float) height};
+    glprogram_setInt(hizBuildShader, "u_level", level);
+    glprogram_setVec4(hizBuildShader, "u_sizes", &sizes);
+    return true;
+}
+
+bool shader_setOcclusionCull(int count, vec2 hizSize, int hizLevels) {
+    if (!occlusionCullShader) {
+        return false;
+    }
+
+    GlProgram *s = occlusionCullShader;
+    glstate_useProgram(s);
+
+    mat4 mat;
+    scene_getMVP(mat);
+    glprogram_setMat4(s, "u_mvpMatrix", &mat);
+    glprogram_setInt(s, "u_count", count);
+    glprogram_setVec2(s, "u_hizSize", (vec2*) hizSize);
+    glprogram_setInt(s, "u_hizLevels", hizLevels);
+    return true;
+}
+
+bool shader_setHeightNoise(int dim, uint32_t seed, const NoiseSettings *noise) {
+    if (!heightNoiseShader) {
+        return false;
+    }
+
+    glstate_useProgram(heightNoiseShader);
+    glprogram_setInt(heightNoiseShader, "u_dim", dim);
+    glprogram_setInt(heightNoiseShader, "u_seed", (int) seed);
+    glprogram_setInt(heightNoiseShader, "u_octaves", noise->octaves);
+    glprogram_setFloat(heightNoiseShader, "u_frequency", noise->frequency);
+    glprogram_setFloat(heightNoiseShader, "u_amplitude", noise->amplitude);
+    glprogram_setFloat(heightNoiseShader, "u_gain", noise->gain);
+    return true;
+}
+
+bool shader_setBallPhysicsPass(int pass) {
+    if (!ballPhysicsShader) {
+        return false;
+    }
+
+    glstate_useProgram(ballPhysicsShader);
+    glprogram_setInt(ballPhysicsShader, "u_pass", pass);
+    return true;
+}
+
+bool shader_hasSurfaceTess(void) {
+    return surfaceTessShader != NULL;
+}
+
+bool shader_setSurfaceTessData(mat4 *viewMat, mat4 *modelviewMat, int patchCount, vec2 step, float textureTiling) {
+    if (!surfaceTessShader) {
+        return false;
+    }
+
+    GlProgram *s = surfaceTessShader;
+    glstate_useProgram(s);
+
+    mat4 mat;
+    scene_getMVP(mat);
+    glprogram_setMat4(s, "u_mvpMatrix", &mat);
+    glprogram_setMat4(s, "u_viewMatrix", viewMat);
+    glprogram_setMat4(s, "u_modelviewMatrix", modelviewMat);
+    glprogram_setInt(s, "u_materialIndex", -1);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    vec2 viewportSize = {(float) viewport[2], (float) viewport[3]};
+
+    glprogram_setInt(s, "u_patchCount", patchCount);
+    glprogram_setVec2(s, "u_step", (vec2*) step);
+    glprogram_setVec2(s, "u_viewport", &viewportSize);
+    glprogram_setFloat(s, "u_pixelsPerSegment", TESS_PIXELS_PER_SEGMENT);
+    glprogram_setFloat(s, "u_maxLevel", TESS_MAX_LEVEL);
+    glprogram_setFloat(s, "u_textureTiling", textureTiling);
+    return true;
+}
+
+bool shader_setHeightMarchData(mat4 *viewMat, mat4 *modelviewMat, int dim, vec2 extent, int levels,
+    float textureTiling) {
+    if (!heightMarchShader) {
+        return false;
+    }
+
+    GlProgram *s = heightMarchShader;
+    glstate_useProgram(s);
+
+    mat4 mvp, invMvp;
+    scene_getMVP(mvp);
+    glm_mat4_inv(mvp, invMvp);
+    glprogram_setMat4(s, "u_mvpMatrix", &mvp);
+    glprogram_setMat4(s, "u_invMvpMatrix", &invMvp);
+    glprogram_setMat4(s, "u_viewMatrix", viewMat);
+    glprogram_setMat4(s, "u_modelviewMatrix", modelviewMat);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    vec4 viewportRect = {(float) viewport[0], (float) viewport[1], (float) viewport[2], (float) viewport[3]};
+    glprogram_setVec4(s, "u_viewport", &viewportRect);
+
+    glprogram_setInt(s, "u_gridDim", dim);
+    glprogram_setVec2(s, "u_gridExtent", (vec2*) extent);
+    glprogram_setInt(s, "u_minMaxLevels", levels);
+    glprogram_setFloat(s, "u_textureTiling", textureTiling);
+    return true;
+}
+
+bool shader_setUpscaleData(GLuint textureId, vec2 uvScale, vec2 texelSize, float sharpness) {
+    if (!upscaleShader) {
+        return false;
+    }
+
+    glstate_useShader(upscaleShader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    shader_setVec2(upscaleShader, "u_uvScale", (vec2*) uvScale);
+    shader_setVec2(upscaleShader, "u_texelSize", (vec2*) texelSize);
+    shader_setFloat(upscaleShader, "u_sharpness", sharpness);
+    return true;
+}
+
+void shader_setOit(bool enabled) {
+    for (int i = 0; i < LIT_VARIANTS; ++i) {
+        if (modelShaders[i]) {
+            glstate_useProgram(modelShaders[i]);
+            glprogram_setBool(modelShaders[i], "u_oit", enabled);
+        }
+    }
+}
+
+bool shader_setOitComposite(GLuint accumId, GLuint revealageId) {
+    if (!oitCompositeShader) {
+        return false;
+    }
+
+    glstate_useShader(oitCompositeShader);
+    glActiveTexture(GL_TEXTURE0 + OIT_ACCUM_UNIT);
+    glBindTexture(GL_TEXTURE_2D, accumId);
+    glActiveTexture(GL_TEXTURE0 + OIT_REVEALAGE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, revealageId);
+    glActiveTexture(GL_TEXTURE0);
+    return true;
+}
+
+bool shader_setGuiComposite(GLuint textureId) {
+    if (!guiCompositeShader) {
+        return false;
+    }
+
+    glstate_useShader(guiCompositeShader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    return true;
+}
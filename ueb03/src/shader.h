@@ -3,7 +3,7 @@
  * @brief Shader program management and uniforms.
  *
  * Has functions to load, activate and configure shader programs.
- * Manages simple color shader, gradient shader and normal visualization shader.
+ * Manages simple color shader, gradient shader and normal visualization shaders.
  *
  * @authors Nikolaos Tsetsas, Noah Schmidt
  */
@@ -34,9 +34,37 @@ void shader_load(void);
  * @param viewMat pointer to the View-Matrix
  * @param modelviewMat pointer to the combined Model-View-Matrix
  * @param m pointer to the Material the lighting should use
+ * @param instanced If the vertices are placed by the instance attributes
  * @note @param m can be NULL if the Material is height dependent!
+ * @note Materials are uploaded once and identified by address,
+ *       their contents must not change afterwards.
  */
-void shader_setMVP(mat4 *viewMat, mat4 *modelviewMat, const Material *m);
+void shader_setMVP(mat4 *viewMat, mat4 *modelviewMat, const Material *m, bool instanced);
+
+/**
+ * Activates the Model-Shader for a multi-draw, every instance places
+ * its vertices and picks its material by the instance attributes.
+ * @param viewMat pointer to the View-Matrix, instances are placed in its space
+ */
+void shader_setMultiDrawMVP(mat4 *viewMat);
+
+/**
+ * Returns the index of a material in the material buffer.
+ * Materials are identified by address and uploaded on first use.
+ * @param m The material.
+ * @return Index into the material array.
+ */
+int shader_getMaterialIndex(const Material *m);
+
+/**
+ * Switches the Model-Shader to the compact surface vertices until the next shader_setMVP.
+ * Position x and z and the texture coordinates are rebuilt from the vertex index.
+ * @param dim The dimension of the sampled surface (#vertices == dim^2).
+ * @param extent x and z of the last surface vertex.
+ * @param textureTiling Texture repeat factor.
+ * @param heightmap If height and normal are fetched from the heightmap instead.
+ */
+void shader_setSurfaceGrid(int dim, vec2 extent, float textureTiling, bool heightmap);
 
 /**
  * Sets the color uniform in the simple shader.
@@ -47,30 +75,147 @@ void shader_setColor(vec3 color);
 
 /**
  * Activates the normal shader and sets uniforms
- * Prepares matrices for geometry shader which generates visible normal vectors.
+ * Prepares matrices for the vertex shader which moves out the tips of the normal lines.
  */
 void shader_setNormals(void);
 
+/**
+ * Activates the compute shader building the surface normal lines and sets its uniforms.
+ * @param dim The dimension of the sampled surface (#vertices == dim^2).
+ * @param stride Distance between two shown normals in vertices.
+ * @param extent x and z of the last surface vertex.
+ * @return False if the shader is not available.
+ */
+bool shader_setNormalGen(int dim, int stride, vec2 extent);
+
+/**
+ * Returns if the surface generation and bounds shaders were built successfully.
+ * @return true if both shaders are available.
+ */
+bool shader_hasSurfaceGen(void);
+
+/**
+ * Activates the compute shader sampling the surface patches into the vertex buffer.
+ * @param dim The dimension of the sampled surface (#vertices == dim^2).
+ * @param patchCount Number of patches per axis.
+ * @param step Control point spacing in x and z.
+ * @return False if the shader is not available.
+ */
+bool shader_setSurfaceGen(int dim, int patchCount, vec2 step);
+
+/**
+ * Activates the compute shader reducing the surface heights per LOD chunk.
+ * @param dim The dimension of the sampled surface (#vertices == dim^2).
+ * @param chunkQuads Quads per chunk side.
+ * @param perAxis Number of chunks per axis.
+ * @return False if the shader is not available.
+ */
+bool shader_setSurfaceBounds(int dim, int chunkQuads, int perAxis);
+
+/**
+ * Activates the compute shader baking the surface heightmap and sets its uniforms.
+ * @param dim The dimension of the sampled surface (#vertices == dim^2).
+ * @return False if the shader is not available.
+ */
+bool shader_setHeightmapBake(int dim);
+
+/**
+ * Activates the compute shader building one level of the heightmap min/max pyramid.
+ * @param level Level to build, 0 reads the heightmap.
+ * @param srcSize Size of the level below, the heightmap size for level 0.
+ * @param dstSize Size of the level.
+ * @return False if the shader is not available.
+ */
+bool shader_setHeightMinMax(int level, int srcSize, int dstSize);
+
+/**
+ * Activates the compute shader building one level of the Hi-Z pyramid.
+ * @param level Level to build, 0 reads the depth copy.
+ * @param srcWidth Width of the level below, the depth width for level 0.
+ * @param srcHeight Height of the level below, the depth height for level 0.
+ * @param width Width of the level.
+ * @param height Height of the level.
+ * @return False if the shader is not available.
+ */
+bool shader_setHizBuild(int level, int srcWidth, int srcHeight, int width, int height);
+
+/**
+ * Activates the compute shader culling the multi-draw objects against the
+ * Hi-Z pyramid, with the current Model-View-Projection-Matrix.
+ * @param count Number of objects.
+ * @param hizSize Size of level 0 of the pyramid.
+ * @param hizLevels Number of built levels.
+ * @return False if the shader is not available.
+ */
+bool shader_setOcclusionCull(int count, vec2 hizSize, int hizLevels);
+
+/**
+ * Activates the compute shader writing noise heights into the control points and sets its uniforms.
+ * @param dim The dimension of the control point grid.
+ * @param seed Seed of the noise lattice.
+ * @param noise Octaves, frequency and scale of the noise.
+ * @return False if the shader is not available.
+ */
+bool shader_setHeightNoise(int dim, uint32_t seed, const NoiseSettings *noise);
+
+/**
+ * Activates the compute shader of the GPU ball physics for one of its passes.
+ * The parameters come from a uniform block, see ballcompute.c.
+ * @param pass Pass to run, see ballPhysics.comp.
+ * @return False if the shader is not available.
+ */
+bool shader_setBallPhysicsPass(int pass);
+
 /**
  * Sets the current Stack MVP-Matrix for the Simple-Shader.
+ * @param instanced If position and color come from the instance attributes
  */
-void shader_setSimpleMVP(void);
+void shader_setSimpleMVP(bool instanced);
 
 /**
- * Sets which texture to use for the Model-Shader.
+ * Sets which texture to use for the Model- and Surface-Tessellation-Shader.
+ * Selects their textured or untextured variant for the following draws.
  * @param textureId The id to use from now on.
  * @param useTexture If the texture should be used.
  */
 void shader_setTexture(GLuint textureId, bool useTexture);
 
 /**
- * Sets the camera position for the Model-Shader.
+ * Sets the height band lookup texture shading the surface
+ * for the Model- and Surface-Tessellation-Shader.
+ * @param textureId The lookup texture, see model_updateHeightBands.
+ * @param range Height of the left texture edge and 1 / the height span.
+ */
+void shader_setHeightBands(GLuint textureId, vec2 range);
+
+/**
+ * Sets the baked occlusion darkening the surface
+ * for the Model- and Surface-Tessellation-Shader.
+ * @param textureId The occlusion texture, see model_updateAmbientOcclusion.
+ * @param transform Scale (xy) and offset (zw) from world x and z to texture coordinates.
+ * @param strength Share of the occlusion applied, 0 turns it off.
+ */
+void shader_setAmbientOcclusion(GLuint textureId, vec4 transform, float strength);
+
+/**
+ * Sets the baked normals replacing the interpolated ones of the surface
+ * for the Model- and Surface-Tessellation-Shader.
+ * @param textureId The normal map, see model_updateNormalMap, 0 turns it off.
+ * @param transform Scale (xy) and offset (zw) from world x and z to texture coordinates.
+ * @param viewMat The view matrix.
+ */
+void shader_setNormalMap(GLuint textureId, vec4 transform, mat4 viewMat);
+
+/**
+ * Sets the camera position for the Model- and Surface-Tessellation-Shader.
+ * Written to the per-frame uniform buffer shared by both.
  * @param camPosWS The camera world position.
  */
 void shader_setCamPos(vec3 camPosWS);
 
 /**
- * Sets all point light attributes for the Model-Shader.
+ * Sets all point light attributes for the Model- and Surface-Tessellation-Shader.
+ * Written to the per-frame uniform buffer shared by both.
  * @param color The color of the light.
  * @param posWS The camera position in world space.
  * @param falloff The attenuation falloff values.
@@ -79,4 +224,95 @@ void shader_setCamPos(vec3 camPosWS);
  */
 void shader_setPointLight(vec3 color, vec3 posWS, vec3 falloff, bool enabled, float ambientFactor);
 
+/**
+ * Sets how the lit shaders find the cluster of a fragment, written to the
+ * per-frame uniform buffer. The light grid itself is bound by lightgrid.c.
+ * @param proj x, y: projection scale of x and y, z: depth of the first slice,
+ *             w: slices per logarithmic depth unit.
+ * @param lightCount Number of clustered lights, 0 turns them off.
+ */
+void shader_setLightClusters(vec4 proj, int lightCount);
+
+/**
+ * Binds the shadow cube of the point light for the lit shaders.
+ * @param cubeMap Depth cube map with comparison, 0 turns the shadows off.
+ * @param lightPosWS World space position the cube was drawn from.
+ * @param nearZ Near plane of the cube faces.
+ * @param farZ Far plane of the cube faces.
+ * @param bias Distance towards the light a fragment is compared at.
+ */
+void shader_setShadow(GLuint cubeMap, vec3 lightPosWS, float nearZ, float farZ, float bias);
+
+/**
+ * Switches the lit shaders to only write the depth, for drawing the
+ * shadow cube. Unbinds the shadow cube while active, shader_setShadow
+ * binds it again.
+ * @param active True while drawing into the shadow cube.
+ */
+void shader_setShadowPass(bool active);
+
+/**
+ * Returns if the surface tessellation shader was built successfully.
+ * @return true if the shader is available.
+ */
+bool shader_hasSurfaceTess(void);
+
+/**
+ * Activates the surface tessellation shader and sets its uniforms.
+ * Lighting, camera and texture are shared with the Model-Shader setters.
+ * @param viewMat pointer to the View-Matrix
+ * @param modelviewMat pointer to the combined Model-View-Matrix
+ * @param patchCount Number of patches per axis.
+ * @param step Control point spacing in X and Z.
+ * @param textureTiling Texture repeat factor.
+ * @return False if the shader is not available.
+ */
+bool shader_setSurfaceTessData(mat4 *viewMat, mat4 *modelviewMat, int patchCount, vec2 step, float textureTiling);
+
+/**
+ * Activates the heightmap ray march shader and sets its uniforms.
+ * Lighting, camera and texture are shared with the Model-Shader setters.
+ * @param viewMat pointer to the View-Matrix
+ * @param modelviewMat pointer to the combined Model-View-Matrix
+ * @param dim The dimension of the heightmap.
+ * @param extent x and z of the last surface vertex.
+ * @param levels Number of levels of the min/max pyramid.
+ * @param textureTiling Texture repeat factor.
+ * @return False if the shader is not available.
+ */
+bool shader_setHeightMarchData(mat4 *viewMat, mat4 *modelviewMat, int dim, vec2 extent, int levels,
+    float textureTiling);
+
+/**
+ * Activates the upscale shader and binds the scene target to unit 0.
+ * @param textureId Color texture of the scene target.
+ * @param uvScale Drawn part of the target in uv.
+ * @param texelSize Size of one target texel in uv.
+ * @param sharpness Strength of the sharpening, 0 for plain bilinear.
+ * @return False if the shader is not available.
+ */
+bool shader_setUpscaleData(GLuint textureId, vec2 uvScale, vec2 texelSize, float sharpness);
+
+/**
+ * Switches the Model-Shader between plain output and the weighted blended
+ * transparency targets.
+ * @param enabled If the transparency targets are written.
+ */
+void shader_setOit(bool enabled);
+
+/**
+ * Activates the transparency composite shader and binds its targets.
+ * @param accumId Accumulation texture.
+ * @param revealageId Revealage texture.
+ * @return False if the shader is not available.
+ */
+bool shader_setOitComposite(GLuint accumId, GLuint revealageId);
+
+/**
+ * Activates the GUI composite shader and binds the cached GUI to unit 0.
+ * @param textureId Color texture of the GUI cache.
+ * @return False if the shader is not available.
+ */
+bool shader_setGuiComposite(GLuint textureId);
+
 #endif // SHADER_H
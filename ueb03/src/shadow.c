@@ -0,0 +1,181 @@
+/**
+ * @file shadow.c
+ * @brief Implementation of the cached shadow cube
+ *
+ * Both cubes are depth textures with comparison enabled. The faces use the
+ * usual cube map orientations, so a direction from the light samples the
+ * face and texel it was drawn into. The copy of the static cube is one
+ * glCopyImageSubData over all six faces. Without dynamic objects the
+ * static cube is sampled directly and nothing is copied.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "shadow.h"
+#include "shader.h"
+#include "glstate.h"
+#include "gpumem.h"
+#include "profiler.h"
+
+/** Slope scaled depth offset of the shadow faces */
+#define SHADOW_OFFSET_FACTOR 2.0f
+#define SHADOW_OFFSET_UNITS 4.0f
+
+/** View directions and up vectors of the cube faces, in GL face order */
+static const vec3 FACE_DIRS[6] = {
+    { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+};
+static const vec3 FACE_UPS[6] = {
+    { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 }
+};
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Cubes, framebuffer and what the static cube was drawn from.
+ */
+static struct {
+    GLuint fbo;
+    GLuint staticCube, dynamicCube;
+
+    bool staticValid;
+    uint64_t staticKey;
+    vec3 lightPos;
+    int staticRedraws;
+} g_shadow = { 0 };
+
+/**
+ * Creates a depth cube map with comparison sampling.
+ * @return The texture.
+ */
+static GLuint createCube(void) {
+    GLuint cube;
+    glGenTextures(1, &cube);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cube);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, GL_DEPTH_COMPONENT32F, SHADOW_SIZE, SHADOW_SIZE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    gpumem_setTexture(GPUMEM_TARGETS, cube, (size_t) SHADOW_SIZE * SHADOW_SIZE * 6 * sizeof(float));
+    return cube;
+}
+
+/**
+ * Creates the cubes and the framebuffer, if they do not exist yet.
+ */
+static void initTargets(void) {
+    if (g_shadow.fbo) {
+        return;
+    }
+
+    g_shadow.staticCube = createCube();
+    g_shadow.dynamicCube = createCube();
+    glGenFramebuffers(1, &g_shadow.fbo);
+
+    // Filtering across the face borders
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+}
+
+/**
+ * Draws geometry into all faces of a cube.
+ * @param cube Target cube.
+ * @param clear Whether the faces are cleared first.
+ * @param draw Draws the geometry.
+ * @param userData Passed to draw.
+ */
+static void drawFaces(GLuint cube, bool clear, RenderCallback draw, void *userData) {
+    for (int face = 0; face < 6; ++face) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+            GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cube, 0);
+        if (clear) {
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+
+        scene_pushMatrix();
+        scene_look(g_shadow.lightPos, (float*) FACE_DIRS[face], (float*) FACE_UPS[face]);
+        draw(userData);
+        scene_popMatrix();
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void shadow_cleanup(void) {
+    glDeleteFramebuffers(1, &g_shadow.fbo);
+    gpumem_deleteTextures(1, &g_shadow.staticCube);
+    gpumem_deleteTextures(1, &g_shadow.dynamicCube);
+    memset(&g_shadow, 0, sizeof(g_shadow));
+}
+
+void shadow_update(vec3 lightPos, uint64_t staticKey, RenderCallback drawStatic,
+                   RenderCallback drawDynamic, void *userData) {
+    initTargets();
+
+    bool moved = glm_vec3_distance(lightPos, g_shadow.lightPos) > SHADOW_MOVE_THRESHOLD;
+    bool redrawStatic = !g_shadow.staticValid || moved || staticKey != g_shadow.staticKey;
+
+    GLint sceneFbo, viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &sceneFbo);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    mat4 sceneProj;
+    scene_getP(sceneProj);
+
+    profiler_pushScope("Shadows");
+    glBindFramebuffer(GL_FRAMEBUFFER, g_shadow.fbo);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glViewport(0, 0, SHADOW_SIZE, SHADOW_SIZE);
+    scene_perspective(90.0f, 1.0f, SHADOW_NEAR, SHADOW_FAR);
+
+    glstate_depthMask(true);
+    glstate_depthFunc(GL_LESS);
+    glstate_colorMask(false);
+    glstate_setEnabled(GL_POLYGON_OFFSET_FILL, true);
+    glPolygonOffset(SHADOW_OFFSET_FACTOR, SHADOW_OFFSET_UNITS);
+    shader_setShadowPass(true);
+
+    if (redrawStatic) {
+        glm_vec3_copy(lightPos, g_shadow.lightPos);
+        g_shadow.staticKey = staticKey;
+        g_shadow.staticValid = true;
+        ++g_shadow.staticRedraws;
+        drawFaces(g_shadow.staticCube, true, drawStatic, userData);
+    }
+
+    GLuint sampled = g_shadow.staticCube;
+    if (drawDynamic) {
+        glCopyImageSubData(g_shadow.staticCube, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
+                           g_shadow.dynamicCube, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
+                           SHADOW_SIZE, SHADOW_SIZE, 6);
+        drawFaces(g_shadow.dynamicCube, false, drawDynamic, userData);
+        sampled = g_shadow.dynamicCube;
+    }
+
+    shader_setShadowPass(false);
+    glstate_setEnabled(GL_POLYGON_OFFSET_FILL, false);
+    glstate_colorMask(true);
+
+    // The projection is only set by fovy, aspect and depth range, read them back
+    float fovy = 2.0f * atanf(1.0f / sceneProj[1][1]);
+    float nearZ = sceneProj[3][2] / (sceneProj[2][2] - 1.0f);
+    float farZ = sceneProj[3][2] / (sceneProj[2][2] + 1.0f);
+    scene_perspective(glm_deg(fovy), sceneProj[1][1] / sceneProj[0][0], nearZ, farZ);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    profiler_popScope();
+
+    shader_setShadow(sampled, g_shadow.lightPos, SHADOW_NEAR, SHADOW_FAR, SHADOW_BIAS);
+}
+
+void shadow_disable(void) {
+    shader_setShadow(0, GLM_VEC3_ZERO, SHADOW_NEAR, SHADOW_FAR, SHADOW_BIAS);
+}
+
+int shadow_getStaticRedraws(void) {
+    return g_shadow.staticRedraws;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file shadow.h
+ * @brief Cached shadow cube of the point light
+ *
+ * The static geometry, the surface, is drawn into a depth cube only when
+ * it changed or the light moved farther than SHADOW_MOVE_THRESHOLD. Every
+ * frame the static cube is copied and only the dynamic objects are drawn
+ * on top of the copy, so the per-frame cost follows the dynamic content.
+ * The lit shaders sample the cube with the light position it was drawn
+ * from, so a light moving below the threshold keeps its shadows in place.
+ *
+ * The faces are drawn with the normal lit programs, which only write the
+ * depth while the shadow pass is active.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <fhwcg/fhwcg.h>
+#include "renderqueue.h"
+
+/** Side of one cube face in texels */
+#define SHADOW_SIZE 1024
+
+/** Depth range of the cube faces */
+#define SHADOW_NEAR 0.01f
+#define SHADOW_FAR 50.0f
+
+/** Distance the light may move before the static cube is drawn again */
+#define SHADOW_MOVE_THRESHOLD 0.05f
+
+/** Distance towards the light a fragment is compared at, against acne */
+#define SHADOW_BIAS 0.01f
+
+/**
+ * Deletes the cubes and the framebuffer.
+ */
+void shadow_cleanup(void);
+
+/**
+ * Draws what is outdated of the shadow cube and hands it to the lit shaders.
+ * Must be called with the camera not applied to the matrix stack, every
+ * face pushes its own view onto it. Changes the framebuffer and viewport
+ * only while drawing, they are restored afterwards.
+ * @param lightPos Position of the point light in world space.
+ * @param staticKey Changes whenever the static geometry changes.
+ * @param drawStatic Draws the static geometry.
+ * @param drawDynamic Draws the dynamic geometry, NULL if there is none.
+ * @param userData Passed to both draw callbacks.
+ */
+void shadow_update(vec3 lightPos, uint64_t staticKey, RenderCallback drawStatic,
+                   RenderCallback drawDynamic, void *userData);
+
+/**
+ * Stops the lit shaders from sampling the shadow cube.
+ * The cached static cube is kept.
+ */
+void shadow_disable(void);
+
+/**
+ * Returns how often the static cube was drawn.
+ * @return Number of static redraws since the start.
+ */
+int shadow_getStaticRedraws(void);
+
+#endif // SHADOW_H
@@ -0,0 +1,211 @@
+/**
+ * @file surfacefile.c
+ * @brief Implementation of the binary surface files
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "surfacefile.h"
+#include "jobs.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/** Heights staged per write when saving */
+#define SAVE_CHUNK_HEIGHTS 16384
+
+/** Control point rows filled per job when loading */
+#define LOAD_ROWS_PER_CHUNK 16
+
+/**
+ * Input of the parallel control point fill.
+ */
+typedef struct {
+    const float *heights;
+    vec3 *controlPoints;
+    int dimension;
+    float step;
+} LoadJob;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Fills the control point rows [begin, end) from the mapped heights.
+ *
+ * @param begin First row
+ * @param end One past the last row
+ * @param chunk Chunk index (unused)
+ * @param userData LoadJob
+ */
+static void loadRowsJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    const LoadJob *job = userData;
+    int dim = job->dimension;
+
+    for (int i = begin; i < end; ++i) {
+        const float *heights = &job->heights[i * dim];
+        vec3 *row = &job->controlPoints[i * dim];
+        for (int j = 0; j < dim; ++j) {
+            row[j][0] = j * job->step;
+            row[j][1] = heights[j];
+            row[j][2] = i * job->step;
+        }
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool surfacefile_map(const char *path, FileMapping *map) {
+    memset(map, 0, sizeof(FileMapping));
+#ifdef _WIN32
+    map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(map->file, &size);
+    map->size = (size_t) size.QuadPart;
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    map->base = map->mapping ? MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!map->base) {
+        if (map->mapping) {
+            CloseHandle(map->mapping);
+        }
+        CloseHandle(map->file);
+        return false;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    map->size = (size_t) st.st_size;
+    void *base = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    map->base = base;
+#endif
+    return true;
+}
+
+void surfacefile_unmap(FileMapping *map) {
+#ifdef _WIN32
+    UnmapViewOfFile(map->base);
+    CloseHandle(map->mapping);
+    CloseHandle(map->file);
+#else
+    munmap((void*) map->base, map->size);
+#endif
+    memset(map, 0, sizeof(FileMapping));
+}
+
+bool surfacefile_save(const char *path, InputData *data) {
+    int dimension = data->surface.dimension;
+    const Vec3Arr *cp = &data->surface.controlPoints;
+    if ((int) cp->size != dimension * dimension) {
+        printf("Surface: the control points don't match the dimension, not saved\n");
+        return false;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        printf("Surface: can't write %s!\n", path);
+        return false;
+    }
+
+    SurfaceFileHeader header = {
+        .magic = SURFACEFILE_MAGIC,
+        .version = SURFACEFILE_VERSION,
+        .dimension = (uint32_t) dimension,
+        .controlPointOffset = data->surface.controlPointOffset,
+        .textureTiling = data->surface.textureTiling
+    };
+    fwrite(&header, sizeof(header), 1, f);
+
+    // The heights are strided in the control points, they are packed chunk by chunk
+    static float staging[SAVE_CHUNK_HEIGHTS];
+    size_t count = cp->size;
+    for (size_t first = 0; first < count; first += SAVE_CHUNK_HEIGHTS) {
+        size_t n = count - first < SAVE_CHUNK_HEIGHTS ? count - first : SAVE_CHUNK_HEIGHTS;
+        for (size_t k = 0; k < n; ++k) {
+            staging[k] = cp->data[first + k][1];
+        }
+        fwrite(staging, sizeof(float), n, f);
+    }
+
+    bool ok = !ferror(f);
+    ok = (fclose(f) == 0) && ok;
+    if (ok) {
+        printf("Surface: saved %dx%d control points to %s\n", dimension, dimension, path);
+    } else {
+        printf("Surface: can't write %s!\n", path);
+    }
+    return ok;
+}
+
+bool surfacefile_load(const char *path, InputData *data) {
+    FileMapping map;
+    if (!surfacefile_map(path, &map)) {
+        printf("Surface: can't open %s!\n", path);
+        return false;
+    }
+
+    SurfaceFileHeader header;
+    bool valid = map.size >= sizeof(header);
+    if (valid) {
+        memcpy(&header, map.base, sizeof(header));
+        size_t dim = header.dimension;
+        valid = header.magic == SURFACEFILE_MAGIC && header.version == SURFACEFILE_VERSION
+            && dim >= 4 && dim <= SURFACEFILE_MAX_DIMENSION
+            && map.size == sizeof(header) + dim * dim * sizeof(float);
+    }
+    if (!valid) {
+        printf("Surface: %s is no valid surface file!\n", path);
+        surfacefile_unmap(&map);
+        return false;
+    }
+
+    int dimension = (int) header.dimension;
+    Vec3Arr *cp = &data->surface.controlPoints;
+    Vec3Arr_resizeUninit(cp, dimension * dimension);
+
+    // The header keeps the heights 4-byte aligned in the page-aligned mapping
+    LoadJob job = {
+        .heights = (const float*) (map.base + sizeof(header)),
+        .controlPoints = cp->data,
+        .dimension = dimension,
+        .step = 1.0f / (dimension - 1) + header.controlPointOffset
+    };
+    jobs_parallelFor(dimension, LOAD_ROWS_PER_CHUNK, loadRowsJob, &job);
+    surfacefile_unmap(&map);
+
+    data->surface.dimension = dimension;
+    data->surface.controlPointOffset = header.controlPointOffset;
+    data->surface.textureTiling = header.textureTiling;
+    data->selection.selectedCp = glm_imin(data->selection.selectedCp, (int) cp->size - 1);
+
+    // The grid already has the new dimension, the rebuild keeps its heights
+    data->surface.dimensionChanged = true;
+    data->surface.resolutionChanged = true;
+    data->surface.offsetChanged = true;
+
+    printf("Surface: loaded %dx%d control points from %s\n", dimension, dimension, path);
+    return true;
+}
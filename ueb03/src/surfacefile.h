@@ -0,0 +1,98 @@
+/**
+ * @file surfacefile.h
+ * @brief Binary save and load of the control point grid
+ *
+ * A surface file is a SurfaceFileHeader followed by dimension² float
+ * heights, row-major like the control points. The x and z coordinates
+ * follow from dimension and offset and are not stored. All values are
+ * little-endian.
+ *
+ * Saving streams the heights through a fixed staging buffer, loading maps
+ * the file and writes the mapped heights straight into the control points.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef SURFACEFILE_H
+#define SURFACEFILE_H
+
+#include "input.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+#endif
+
+/** File written and read by the GUI */
+#define SURFACE_FILE "surface.cgs"
+
+/** Identifies a surface file, "CGSF" read as little-endian */
+#define SURFACEFILE_MAGIC 0x46534743u
+
+/** Format version, files of other versions are rejected */
+#define SURFACEFILE_VERSION 1u
+
+/** Largest dimension accepted by the loader, the GUI limit */
+#define SURFACEFILE_MAX_DIMENSION 500
+
+/**
+ * Header at the start of a surface file.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dimension;
+    float controlPointOffset;
+    float textureTiling;
+    uint32_t reserved;
+} SurfaceFileHeader;
+
+/**
+ * Read-only mapping of a file.
+ */
+typedef struct {
+    const unsigned char *base;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} FileMapping;
+
+/**
+ * Maps a file read-only into memory. Pages are read on first access,
+ * so the file may be larger than the memory.
+ *
+ * @param path Path of the file
+ * @param map Output: the mapping
+ * @return false if the file could not be mapped
+ */
+bool surfacefile_map(const char *path, FileMapping *map);
+
+/**
+ * Unmaps a file mapped by surfacefile_map.
+ *
+ * @param map The mapping
+ */
+void surfacefile_unmap(FileMapping *map);
+
+/**
+ * Writes the control point heights and the surface parameters to a file.
+ *
+ * @param path File to write
+ * @param data Input data holding the surface
+ * @return false if the file could not be written
+ */
+bool surfacefile_save(const char *path, InputData *data);
+
+/**
+ * Replaces the control points and the surface parameters by a file and
+ * requests a structural rebuild. The surface is unchanged if the file
+ * can't be read or is invalid.
+ *
+ * @param path File to read
+ * @param data Input data receiving the surface
+ * @return false if the file was not loaded
+ */
+bool surfacefile_load(const char *path, InputData *data);
+
+#endif // SURFACEFILE_H
@@ -0,0 +1,480 @@
+/**
+ * @file terraintiles.c
+ * @brief Implementation of the tile file and its paging
+ *
+ * The slots are a fixed array with a heights buffer each, allocated when
+ * the file is opened. A slot is empty, queued for the loader or ready.
+ * Only the main thread requests tiles and reuses slots, only the loader
+ * fills queued ones, the states and the queue are guarded by the mutex.
+ * A ready slot is only read and reused by the main thread, so its heights
+ * are read without the mutex.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "terraintiles.h"
+#include "surfacefile.h"
+#include "logic.h"
+#include "utils.h"
+#include "jobs.h"
+#include "thread.h"
+#include "rng.h"
+#include "timeline.h"
+#include "alloctrack.h"
+
+/** Heights of one tile */
+#define TILE_HEIGHTS (TERRAINTILES_TILE_SIZE * TERRAINTILES_TILE_SIZE)
+
+/** Control points per axis of the window */
+#define WINDOW_DIMENSION (TERRAINTILES_WINDOW_TILES * TERRAINTILES_TILE_SIZE)
+
+/**
+ * State of a resident slot.
+ */
+typedef enum {
+    TS_EMPTY,
+    TS_QUEUED,      // waits for or is being read by the loader
+    TS_READY
+} TileState;
+
+/**
+ * A resident tile.
+ */
+typedef struct {
+    int x, z;           // tile coordinates in the file
+    float *heights;     // TILE_HEIGHTS, row by row
+    TileState state;
+    long lastUsed;      // frame of the last request, -1 if never used
+} TileSlot;
+
+/**
+ * Input of the parallel tile generation.
+ */
+typedef struct {
+    float *heights;     // one row of tiles
+    const NoiseSettings *noise;
+    uint32_t seed;
+    int tileZ;
+} CreateJob;
+
+/**
+ * Mapping, resident slots and loader of the open tile file.
+ */
+static struct {
+    bool open;
+    FileMapping map;
+    TerrainTileHeader header;
+
+    TileSlot slots[TERRAINTILES_RESIDENT_TILES];
+    int queue[TERRAINTILES_RESIDENT_TILES];   // ring of queued slot indices
+    int queueHead, queueCount;
+
+    Thread thread;
+    Mutex mutex;
+    Cond cond;
+    bool threadStarted;
+    bool stop;
+
+    long frame;
+    int originX, originZ;   // window origin in tiles, -1 before the first window
+    int dimension;          // surface dimension and offset of the window
+    float offset;
+    long loads, shifts;
+} g_tiles = { .originX = -1, .originZ = -1 };
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Generates the tiles [begin, end) of one tile row.
+ *
+ * @param begin First tile column
+ * @param end One past the last tile column
+ * @param chunk Chunk index (unused)
+ * @param userData CreateJob
+ */
+static void createTilesJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    const CreateJob *job = userData;
+
+    for (int tx = begin; tx < end; ++tx) {
+        float *tile = &job->heights[(size_t) tx * TILE_HEIGHTS];
+        for (int z = 0; z < TERRAINTILES_TILE_SIZE; ++z) {
+            float gz = (float) (job->tileZ * TERRAINTILES_TILE_SIZE + z);
+            for (int x = 0; x < TERRAINTILES_TILE_SIZE; ++x) {
+                float gx = (float) (tx * TERRAINTILES_TILE_SIZE + x);
+                tile[z * TERRAINTILES_TILE_SIZE + x] = utils_noiseHeight(job->noise, job->seed, gx, gz);
+            }
+        }
+    }
+}
+
+/**
+ * Copies a tile out of the mapping, the pages are read from the file here.
+ *
+ * @param slot Slot with the tile coordinates set
+ */
+static void readTile(TileSlot *slot) {
+    size_t index = (size_t) slot->z * g_tiles.header.tilesPerAxis + (size_t) slot->x;
+    const unsigned char *src = g_tiles.map.base + sizeof(TerrainTileHeader) + index * TILE_HEIGHTS * sizeof(float);
+    memcpy(slot->heights, src, TILE_HEIGHTS * sizeof(float));
+}
+
+/**
+ * Loader thread, reads the queued tiles in request order.
+ */
+static THREAD_ENTRY(loaderMain) {
+    (void) arg;
+    timeline_setThreadName("Terrain Tiles");
+    MUTEX_LOCK(&g_tiles.mutex);
+    for (;;) {
+        while (!g_tiles.stop && g_tiles.queueCount == 0) {
+            COND_WAIT(&g_tiles.cond, &g_tiles.mutex);
+        }
+        if (g_tiles.stop) {
+            break;
+        }
+
+        TileSlot *slot = &g_tiles.slots[g_tiles.queue[g_tiles.queueHead]];
+        g_tiles.queueHead = (g_tiles.queueHead + 1) % TERRAINTILES_RESIDENT_TILES;
+        --g_tiles.queueCount;
+        MUTEX_UNLOCK(&g_tiles.mutex);
+
+        readTile(slot);
+
+        MUTEX_LOCK(&g_tiles.mutex);
+        slot->state = TS_READY;
+        ++g_tiles.loads;
+    }
+    MUTEX_UNLOCK(&g_tiles.mutex);
+    THREAD_RETURN;
+}
+
+/**
+ * Requests a tile for this frame. A tile that is not resident gets the
+ * least recently used slot not requested this frame and is queued, or read
+ * right away without the loader. Must be called with the mutex held.
+ *
+ * @param x Tile column
+ * @param z Tile row
+ * @return The slot if the tile is ready, NULL otherwise
+ */
+static TileSlot* requestTile(int x, int z) {
+    TileSlot *lru = NULL;
+    for (int i = 0; i < TERRAINTILES_RESIDENT_TILES; ++i) {
+        TileSlot *s = &g_tiles.slots[i];
+        if (s->state != TS_EMPTY && s->x == x && s->z == z) {
+            s->lastUsed = g_tiles.frame;
+            return s->state == TS_READY ? s : NULL;
+        }
+        if (s->state != TS_QUEUED && s->lastUsed != g_tiles.frame && (!lru || s->lastUsed < lru->lastUsed)) {
+            lru = s;
+        }
+    }
+    if (!lru) {
+        return NULL;
+    }
+
+    lru->x = x;
+    lru->z = z;
+    lru->lastUsed = g_tiles.frame;
+    if (!g_tiles.threadStarted) {
+        readTile(lru);
+        lru->state = TS_READY;
+        ++g_tiles.loads;
+        return lru;
+    }
+
+    lru->state = TS_QUEUED;
+    int tail = (g_tiles.queueHead + g_tiles.queueCount) % TERRAINTILES_RESIDENT_TILES;
+    g_tiles.queue[tail] = (int) (lru - g_tiles.slots);
+    ++g_tiles.queueCount;
+    COND_BROADCAST(&g_tiles.cond);
+    return NULL;
+}
+
+/**
+ * Requests the window at a tile origin and the ring of tiles around it.
+ * The window comes first, so the loader reads it before the ring.
+ * Must be called with the mutex held.
+ *
+ * @param originX First tile column of the window
+ * @param originZ First tile row of the window
+ * @param window Output: the ready slots of the window, row by row
+ * @return true if all tiles of the window are ready
+ */
+static bool requestWindow(int originX, int originZ, TileSlot *window[]) {
+    bool ready = true;
+    for (int z = 0; z < TERRAINTILES_WINDOW_TILES; ++z) {
+        for (int x = 0; x < TERRAINTILES_WINDOW_TILES; ++x) {
+            TileSlot *slot = requestTile(originX + x, originZ + z);
+            window[z * TERRAINTILES_WINDOW_TILES + x] = slot;
+            ready &= slot != NULL;
+        }
+    }
+
+    int tiles = (int) g_tiles.header.tilesPerAxis;
+    for (int z = -1; z <= TERRAINTILES_WINDOW_TILES; ++z) {
+        for (int x = -1; x <= TERRAINTILES_WINDOW_TILES; ++x) {
+            bool ring = x < 0 || z < 0 || x == TERRAINTILES_WINDOW_TILES || z == TERRAINTILES_WINDOW_TILES;
+            int tx = originX + x;
+            int tz = originZ + z;
+            if (ring && tx >= 0 && tz >= 0 && tx < tiles && tz < tiles) {
+                requestTile(tx, tz);
+            }
+        }
+    }
+    return ready;
+}
+
+/**
+ * Copies the heights of the window tiles into the control points.
+ *
+ * @param cp Control points, resized to the window
+ * @param window Ready slots of the window, row by row
+ * @param step Control point spacing
+ */
+static void fillWindow(Vec3Arr *cp, TileSlot *const window[], float step) {
+    Vec3Arr_resizeUninit(cp, WINDOW_DIMENSION * WINDOW_DIMENSION);
+
+    for (int i = 0; i < WINDOW_DIMENSION; ++i) {
+        vec3 *row = &cp->data[i * WINDOW_DIMENSION];
+        TileSlot *const *tileRow = &window[(i / TERRAINTILES_TILE_SIZE) * TERRAINTILES_WINDOW_TILES];
+        int z = i % TERRAINTILES_TILE_SIZE;
+        for (int j = 0; j < WINDOW_DIMENSION; ++j) {
+            const float *heights = tileRow[j / TERRAINTILES_TILE_SIZE]->heights;
+            row[j][0] = j * step;
+            row[j][1] = heights[z * TERRAINTILES_TILE_SIZE + j % TERRAINTILES_TILE_SIZE];
+            row[j][2] = i * step;
+        }
+    }
+}
+
+/**
+ * Returns the window origin along one axis that centers the window on the
+ * camera, the current one while the camera is in the inner tiles.
+ *
+ * @param origin Current origin in tiles
+ * @param camTile Window tile the camera is over, may lie outside
+ * @return The new origin, clamped to the file
+ */
+static int followCamera(int origin, int camTile) {
+    if (camTile >= 1 && camTile <= TERRAINTILES_WINDOW_TILES - 2) {
+        return origin;
+    }
+    int maxOrigin = (int) g_tiles.header.tilesPerAxis - TERRAINTILES_WINDOW_TILES;
+    return glm_imax(glm_imin(origin + camTile - TERRAINTILES_WINDOW_TILES / 2, maxOrigin), 0);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool terraintiles_create(const char *path, int tilesPerAxis, InputData *data) {
+    if (tilesPerAxis < TERRAINTILES_WINDOW_TILES || tilesPerAxis > TERRAINTILES_MAX_TILES) {
+        printf("Terrain: %d tiles per axis out of range!\n", tilesPerAxis);
+        return false;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        printf("Terrain: can't write %s!\n", path);
+        return false;
+    }
+
+    TerrainTileHeader header = {
+        .magic = TERRAINTILES_MAGIC,
+        .version = TERRAINTILES_VERSION,
+        .tileSize = TERRAINTILES_TILE_SIZE,
+        .tilesPerAxis = (uint32_t) tilesPerAxis,
+        .controlPointOffset = data->surface.controlPointOffset,
+        .textureTiling = data->surface.textureTiling
+    };
+    fwrite(&header, sizeof(header), 1, f);
+
+    // One row of tiles at a time, the rows are consecutive in the file
+    size_t rowHeights = (size_t) tilesPerAxis * TILE_HEIGHTS;
+    CreateJob job = {
+        .heights = TRACKED_MALLOC(rowHeights * sizeof(float)),
+        .noise = &data->surface.noise,
+        .seed = rng_next(rng_thread())
+    };
+    bool ok = true;
+    for (int tz = 0; tz < tilesPerAxis && ok; ++tz) {
+        job.tileZ = tz;
+        jobs_parallelFor(tilesPerAxis, 1, createTilesJob, &job);
+        ok = fwrite(job.heights, sizeof(float), rowHeights, f) == rowHeights;
+    }
+    TRACKED_FREE(job.heights);
+
+    ok = (fclose(f) == 0) && ok;
+    if (ok) {
+        int points = tilesPerAxis * TERRAINTILES_TILE_SIZE;
+        printf("Terrain: generated %dx%d control points in %s\n", points, points, path);
+    } else {
+        printf("Terrain: can't write %s!\n", path);
+    }
+    return ok;
+}
+
+bool terraintiles_open(const char *path) {
+    terraintiles_close();
+
+    FileMapping map;
+    if (!surfacefile_map(path, &map)) {
+        printf("Terrain: can't open %s!\n", path);
+        return false;
+    }
+
+    TerrainTileHeader header;
+    bool valid = map.size >= sizeof(header);
+    if (valid) {
+        memcpy(&header, map.base, sizeof(header));
+        size_t tiles = header.tilesPerAxis;
+        valid = header.magic == TERRAINTILES_MAGIC && header.version == TERRAINTILES_VERSION
+            && header.tileSize == TERRAINTILES_TILE_SIZE
+            && tiles >= TERRAINTILES_WINDOW_TILES && tiles <= TERRAINTILES_MAX_TILES
+            && map.size == sizeof(header) + tiles * tiles * TILE_HEIGHTS * sizeof(float);
+    }
+    if (!valid) {
+        printf("Terrain: %s is no valid tile file!\n", path);
+        surfacefile_unmap(&map);
+        return false;
+    }
+
+    g_tiles.map = map;
+    g_tiles.header = header;
+    for (int i = 0; i < TERRAINTILES_RESIDENT_TILES; ++i) {
+        g_tiles.slots[i] = (TileSlot) {
+            .heights = TRACKED_MALLOC(TILE_HEIGHTS * sizeof(float)),
+            .state = TS_EMPTY,
+            .lastUsed = -1
+        };
+    }
+
+    MUTEX_INIT(&g_tiles.mutex);
+    COND_INIT(&g_tiles.cond);
+    g_tiles.threadStarted = THREAD_CREATE(&g_tiles.thread, loaderMain);
+    if (!g_tiles.threadStarted) {
+        printf("Failed to start the terrain tile loader, reading tiles synchronously.\n");
+    }
+    g_tiles.open = true;
+
+    int points = (int) header.tilesPerAxis * TERRAINTILES_TILE_SIZE;
+    printf("Terrain: opened %dx%d control points from %s\n", points, points, path);
+    return true;
+}
+
+void terraintiles_close(void) {
+    if (!g_tiles.open) {
+        return;
+    }
+
+    if (g_tiles.threadStarted) {
+        MUTEX_LOCK(&g_tiles.mutex);
+        g_tiles.stop = true;
+        COND_BROADCAST(&g_tiles.cond);
+        MUTEX_UNLOCK(&g_tiles.mutex);
+        THREAD_JOIN(g_tiles.thread);
+    }
+    MUTEX_DESTROY(&g_tiles.mutex);
+    COND_DESTROY(&g_tiles.cond);
+
+    for (int i = 0; i < TERRAINTILES_RESIDENT_TILES; ++i) {
+        TRACKED_FREE(g_tiles.slots[i].heights);
+    }
+    surfacefile_unmap(&g_tiles.map);
+
+    memset(&g_tiles, 0, sizeof(g_tiles));
+    g_tiles.originX = -1;
+    g_tiles.originZ = -1;
+}
+
+bool terraintiles_isOpen(void) {
+    return g_tiles.open;
+}
+
+void terraintiles_update(InputData *data) {
+    if (!g_tiles.open) {
+        return;
+    }
+
+    bool first = g_tiles.originX < 0;
+    if (!first && (data->surface.dimension != g_tiles.dimension || data->surface.controlPointOffset != g_tiles.offset)) {
+        printf("Terrain: the surface was changed, tile file closed\n");
+        terraintiles_close();
+        return;
+    }
+
+    // The first window is the center of the file, then the window follows the camera
+    int tiles = (int) g_tiles.header.tilesPerAxis;
+    float offset = first ? g_tiles.header.controlPointOffset : g_tiles.offset;
+    float step = 1.0f / (WINDOW_DIMENSION - 1) + offset;
+    int targetX = (tiles - TERRAINTILES_WINDOW_TILES) / 2;
+    int targetZ = targetX;
+    if (!first) {
+        targetX = g_tiles.originX;
+        targetZ = g_tiles.originZ;
+        if (!data->cam.isFlying) {
+            vec3 pos;
+            camera_getPosition(data->cam.data, pos);
+            float tileExtent = TERRAINTILES_TILE_SIZE * step;
+            targetX = followCamera(g_tiles.originX, (int) floorf(pos[0] / tileExtent));
+            targetZ = followCamera(g_tiles.originZ, (int) floorf(pos[2] / tileExtent));
+        }
+    }
+
+    TileSlot *window[TERRAINTILES_WINDOW_TILES * TERRAINTILES_WINDOW_TILES];
+    MUTEX_LOCK(&g_tiles.mutex);
+    ++g_tiles.frame;
+    bool ready = requestWindow(targetX, targetZ, window);
+    MUTEX_UNLOCK(&g_tiles.mutex);
+
+    bool moved = first || targetX != g_tiles.originX || targetZ != g_tiles.originZ;
+    if (!ready || !moved || logic_isRebuildPending()) {
+        return;
+    }
+
+    fillWindow(&data->surface.controlPoints, window, step);
+    if (first) {
+        // Like a loaded surface file: the grid already has the new dimension
+        data->surface.dimension = WINDOW_DIMENSION;
+        data->surface.controlPointOffset = offset;
+        data->surface.textureTiling = g_tiles.header.textureTiling;
+        data->selection.selectedCp = glm_imin(data->selection.selectedCp, WINDOW_DIMENSION * WINDOW_DIMENSION - 1);
+        data->surface.dimensionChanged = true;
+        data->surface.resolutionChanged = true;
+        data->surface.offsetChanged = true;
+    } else {
+        float tileExtent = TERRAINTILES_TILE_SIZE * step;
+        vec3 shift = {
+            -(targetX - g_tiles.originX) * tileExtent,
+            0.0f,
+            -(targetZ - g_tiles.originZ) * tileExtent
+        };
+        logic_shiftSurface(data, shift);
+        ++g_tiles.shifts;
+    }
+
+    g_tiles.originX = targetX;
+    g_tiles.originZ = targetZ;
+    g_tiles.dimension = WINDOW_DIMENSION;
+    g_tiles.offset = offset;
+}
+
+void terraintiles_getStats(TerrainTileStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->open = g_tiles.open;
+    stats->originX = g_tiles.originX;
+    stats->originZ = g_tiles.originZ;
+    if (!g_tiles.open) {
+        return;
+    }
+
+    stats->tilesPerAxis = (int) g_tiles.header.tilesPerAxis;
+    stats->shifts = g_tiles.shifts;
+    MUTEX_LOCK(&g_tiles.mutex);
+    for (int i = 0; i < TERRAINTILES_RESIDENT_TILES; ++i) {
+        stats->resident += g_tiles.slots[i].state == TS_READY;
+    }
+    stats->queued = g_tiles.queueCount;
+    stats->loads = g_tiles.loads;
+    MUTEX_UNLOCK(&g_tiles.mutex);
+}
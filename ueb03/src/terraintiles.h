@@ -0,0 +1,131 @@
+/**
+ * @file terraintiles.h
+ * @brief Out-of-core terrain paged into the surface around the camera
+ *
+ * A tile file holds the control point heights of a terrain far larger than
+ * the surface dimension, split into square tiles of TERRAINTILES_TILE_SIZE²
+ * heights. The tiles are contiguous in the file, so one tile is a single
+ * read from the mapping. The file is mapped read-only and may be larger
+ * than the memory, only the resident tiles are copied out of it.
+ *
+ * The surface shows a window of TERRAINTILES_WINDOW_TILES² tiles. Once the
+ * camera enters the outer tiles of the window, the window is moved by whole
+ * tiles to center it again. A loader thread pages the tiles of the new
+ * window and a ring of tiles around it into a fixed set of resident slots,
+ * least recently used slots are reused. When all tiles of the new window
+ * are resident, the heights are copied into the control points and the
+ * surface is rebuilt in the background, balls and camera are moved back by
+ * the shift so they keep their place on the terrain.
+ *
+ * Patches, LOD chunks, height pyramids and physics all work on the window
+ * as on any other surface. Height edits are not written back to the file
+ * and get lost once their tiles leave the window.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef TERRAINTILES_H
+#define TERRAINTILES_H
+
+#include "input.h"
+
+/** File generated and opened by the GUI */
+#define TERRAINTILES_FILE "terrain.cgt"
+
+/** Identifies a tile file, "CGST" read as little-endian */
+#define TERRAINTILES_MAGIC 0x54534743u
+
+/** Format version, files of other versions are rejected */
+#define TERRAINTILES_VERSION 1u
+
+/** Control points per tile axis */
+#define TERRAINTILES_TILE_SIZE 64
+
+/** Tiles per axis of the window, the surface dimension is 384 */
+#define TERRAINTILES_WINDOW_TILES 6
+
+/** Resident tile slots: the window, the prefetch ring around it and spare ones */
+#define TERRAINTILES_RESIDENT_TILES 96
+
+/** Tiles per axis of a generated file by default, 4096² control points */
+#define TERRAINTILES_DEFAULT_TILES 64
+
+/** Largest tiles per axis of a generated file, 16 GiB of heights */
+#define TERRAINTILES_MAX_TILES 1024
+
+/**
+ * Header at the start of a tile file, followed by tilesPerAxis² tiles
+ * row by row, each tileSize² heights row by row. Little-endian.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t tileSize;
+    uint32_t tilesPerAxis;
+    float controlPointOffset;
+    float textureTiling;
+} TerrainTileHeader;
+
+/**
+ * Counts of the tile paging.
+ */
+typedef struct {
+    bool open;
+    int tilesPerAxis;
+    int originX, originZ;   // window origin in tiles, -1 before the first window
+    int resident;           // slots holding a tile
+    int queued;             // tiles waiting for the loader
+    long loads;             // tiles read from the file
+    long shifts;            // window moves
+} TerrainTileStats;
+
+/**
+ * Generates a tile file from the noise height function, tile row by tile
+ * row, so the terrain never has to fit into memory.
+ *
+ * @param path File to write
+ * @param tilesPerAxis Tiles per axis, at least the window
+ * @param data Input data with noise settings, offset and texture tiling
+ * @return false if the file could not be written
+ */
+bool terraintiles_create(const char *path, int tilesPerAxis, InputData *data);
+
+/**
+ * Maps a tile file and starts paging the window around its center.
+ * The surface switches to the window once its tiles are resident.
+ * An open file is closed first.
+ *
+ * @param path File to open
+ * @return false if the file can't be mapped or is invalid
+ */
+bool terraintiles_open(const char *path);
+
+/**
+ * Stops the loader and unmaps the file. The surface keeps the last window.
+ */
+void terraintiles_close(void);
+
+/**
+ * Checks whether a tile file is open.
+ *
+ * @return true while the surface follows the camera over the tile file
+ */
+bool terraintiles_isOpen(void);
+
+/**
+ * Requests the tiles around the camera and moves the window once they are
+ * resident. Closes the file if dimension or offset were changed by hand.
+ * Call once per frame before logic_update, with the physics locked.
+ *
+ * @param data Input data
+ */
+void terraintiles_update(InputData *data);
+
+/**
+ * Returns the counts of the tile paging.
+ *
+ * @param stats Destination
+ */
+void terraintiles_getStats(TerrainTileStats *stats);
+
+#endif // TERRAINTILES_H
@@ -5,7 +5,8 @@
  * Implements B-spline surface evaluation
  *
  * Additional utilities:
- * - Height functions for surface initialization
+ * - Height functions for surface initialization, generated row by row on
+ *   the job pool from precomputed per-column terms, noise also on the GPU
  * - Cubic Bezier curve evaluation for camera path
  *
  * @authors Nikolaos Tsetsas, Noah Schmidt
@@ -15,11 +16,46 @@
 #include "rendering.h"
 #include "input.h"
 #include "logic.h"
+#include "model.h"
+#include "jobs.h"
 
 ////////////////////////    LOCAL    ////////////////////////////
 
-/** Function pointer type for height modification functions */
-typedef void (*HeightFunc)(vec3 *cp, int x, int z, int dimension);
+/** Rows of control points per height generator job */
+#define HEIGHT_ROWS_PER_CHUNK 8
+
+/** Smallest grid generated by the noise compute shader, below it the readback costs more */
+#define HEIGHT_NOISE_GPU_MIN_POINTS (128 * 128)
+
+typedef struct HeightGen HeightGen;
+
+/** Fills the per-column terms of a height function, may be NULL */
+typedef void (*HeightColumnFunc)(HeightGen *gen);
+
+/** Writes the heights of one row of control points */
+typedef void (*HeightRowFunc)(const HeightGen *gen, vec3 *row, int z);
+
+/**
+ * Batch generator of a height function.
+ */
+typedef struct {
+    HeightColumnFunc columns;
+    HeightRowFunc row;
+} HeightFunc;
+
+/**
+ * Shared state of one height function application.
+ * The per-column terms only depend on x and are computed once,
+ * so the rows only combine them with their own per-row term.
+ */
+struct HeightGen {
+    vec3 *controlPoints;
+    int dimension;
+    HeightRowFunc row;
+    float *columns;                 // per-column term, dimension entries
+    uint32_t seed;                  // random and noise generators
+    const NoiseSettings *noise;
+};
 
 /**
  * B-spline basis matrix (transposed).
@@ -44,177 +80,241 @@ static mat4 splineMatrix = {
 };
 
 /**
- * Height function: Flat plane at y=0.
+ * Integer hash of a lattice point, must match heightNoise.comp.
+ *
+ * @param x Lattice x
+ * @param z Lattice z
+ * @param seed Seed of the lattice
+ * @return Hash value
+ */
+static inline uint32_t hashLattice(int x, int z, uint32_t seed) {
+    uint32_t h = (uint32_t) x * 0x8da6b343u ^ (uint32_t) z * 0xd8163841u ^ seed * 0xcb1ab31fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * Dot product with one of four diagonal gradients.
+ */
+static inline float noiseGradient(uint32_t h, float dx, float dz) {
+    return ((h & 1u) ? -dx : dx) + ((h & 2u) ? -dz : dz);
+}
+
+/**
+ * Gradient noise with a quintic fade, roughly in [-1, 1].
+ * Same as perlin in heightNoise.comp.
  *
- * @param cp Pointer to control point to modify
- * @param x X grid index
- * @param z Z grid index
- * @param dimension Grid dimension
+ * @param x Position in lattice units
+ * @param z Position in lattice units
+ * @param seed Seed of the lattice
+ * @return Noise value
+ */
+static float perlin(float x, float z, uint32_t seed) {
+    float cellX = floorf(x);
+    float cellZ = floorf(z);
+    int ix = (int) cellX;
+    int iz = (int) cellZ;
+    float fx = x - cellX;
+    float fz = z - cellZ;
+    float u = fx * fx * fx * (fx * (fx * 6.0f - 15.0f) + 10.0f);
+    float v = fz * fz * fz * (fz * (fz * 6.0f - 15.0f) + 10.0f);
+
+    float n00 = noiseGradient(hashLattice(ix, iz, seed), fx, fz);
+    float n10 = noiseGradient(hashLattice(ix + 1, iz, seed), fx - 1.0f, fz);
+    float n01 = noiseGradient(hashLattice(ix, iz + 1, seed), fx, fz - 1.0f);
+    float n11 = noiseGradient(hashLattice(ix + 1, iz + 1, seed), fx - 1.0f, fz - 1.0f);
+    return glm_lerp(glm_lerp(n00, n10, u), glm_lerp(n01, n11, u), v);
+}
+
+/**
+ * Height function: Flat plane at y=0.
  */
-static void height_flat(vec3 *cp, int x, int z, int dimension) {
-    NK_UNUSED(dimension);
-    NK_UNUSED(x);
+static void height_flat(const HeightGen *gen, vec3 *row, int z) {
     NK_UNUSED(z);
 
-    (*cp)[1] = 0.0f;
+    for (int x = 0; x < gen->dimension; ++x) {
+        row[x][1] = 0.0f;
+    }
 }
 
 /**
  * Height function: Sinus pattern.
  * Creates a wave surface using sin(x)·cos(z).
- *
- * @param cp Pointer to control point to modify
- * @param x X grid index
- * @param z Z grid index
- * @param dimension Grid dimension
  */
-static void height_sin(vec3 *cp, int x, int z, int dimension) {
-    NK_UNUSED(dimension);
+static void columns_sin(HeightGen *gen) {
+    for (int x = 0; x < gen->dimension; ++x) {
+        gen->columns[x] = sinf(x * 0.5f) * 2.0f;
+    }
+}
 
-    float freq = 0.5f;
-    (*cp)[1] = sinf(x * freq) * cosf(z * freq) * 2.0f;
+static void height_sin(const HeightGen *gen, vec3 *row, int z) {
+    float c = cosf(z * 0.5f);
+    for (int x = 0; x < gen->dimension; ++x) {
+        row[x][1] = gen->columns[x] * c;
+    }
 }
 
 /**
  * Height function: Cosine pattern.
  * Creates rolling hills using cos(x) + sin(z).
- *
- * @param cp Pointer to control point to modify
- * @param x X grid index
- * @param z Z grid index
- * @param dimension Grid dimension
  */
-static void height_cos(vec3 *cp, int x, int z, int dimension) {
-    NK_UNUSED(dimension);
+static void columns_cos(HeightGen *gen) {
+    for (int x = 0; x < gen->dimension; ++x) {
+        gen->columns[x] = cosf(x * 0.4f);
+    }
+}
 
-    float freq = 0.4f;
-    (*cp)[1] = cosf(x * freq) + sinf(z * freq);
+static void height_cos(const HeightGen *gen, vec3 *row, int z) {
+    float s = sinf(z * 0.4f);
+    for (int x = 0; x < gen->dimension; ++x) {
+        row[x][1] = gen->columns[x] + s;
+    }
 }
 
 /**
  * Height function: Gauss bell curve.
  * Creates a smooth peak at the center of the surface.
- *
- * @param cp Pointer to control point to modify
- * @param x X grid index
- * @param z Z grid index
- * @param dimension Grid dimension
+ * The bell is separable: exp(-(dx² + dz²) / 2σ²) = exp(-dx² / 2σ²) · exp(-dz² / 2σ²).
  */
-static void height_gauss(vec3 *cp, int x, int z, int dimension) {
-    float cx = (dimension - 1) / 2.0f;
-    float cz = (dimension - 1) / 2.0f;
+static float gaussFactor(int i, int dimension) {
+    float c = (dimension - 1) / 2.0f;
     float sigma = dimension / 4.0f;
+    float d = i - c;
+    return expf(-d * d / (2.0f * sigma * sigma));
+}
 
-    float dx = x - cx;
-    float dz = z - cz;
-    float dist2 = dx * dx + dz * dz;
+static void columns_gauss(HeightGen *gen) {
+    for (int x = 0; x < gen->dimension; ++x) {
+        gen->columns[x] = gaussFactor(x, gen->dimension);
+    }
+}
 
-    (*cp)[1] = expf(-dist2 / (2.0f * sigma * sigma)) * 5.0f;
+static void height_gauss(const HeightGen *gen, vec3 *row, int z) {
+    float g = gaussFactor(z, gen->dimension) * 5.0f;
+    for (int x = 0; x < gen->dimension; ++x) {
+        row[x][1] = gen->columns[x] * g;
+    }
 }
 
 /**
  * Height function: Random noise.
  * Generates random heights for a rough, irregular surface.
- *
- * @param cp Pointer to control point to modify
- * @param x X grid index
- * @param z Z grid index
- * @param dimension Grid dimension
+ * Every row has its own generator seeded from the row,
+ * so the result does not depend on the thread count.
  */
-static void height_random(vec3 *cp, int x, int z, int dimension) {
-    NK_UNUSED(dimension);
-    NK_UNUSED(x);
-    NK_UNUSED(z);
-
-    float r = ((float)rand() / RAND_MAX) * 5.0f - 2.5f;
-    (*cp)[1] = r;
+static void height_random(const HeightGen *gen, vec3 *row, int z) {
+    Rng rng;
+    rng_seed(&rng, ((uint64_t) gen->seed << 32) | (uint32_t) z);
+    for (int x = 0; x < gen->dimension; ++x) {
+        row[x][1] = rng_float(&rng) * 5.0f - 2.5f;
+    }
 }
 
 /**
  * Height function: hill.
  * Creates a smooth hill that rises from edges to center
- *
- * @param cp Pointer to control point to modify
- * @param x X grid index
- * @param z Z grid index
- * @param dimension Grid dimension
  */
-static void height_hill(vec3 *cp, int x, int z, int dimension) {
-    float cx = (dimension - 1) / 2.0f;
-    float cz = (dimension - 1) / 2.0f;
+static void columns_hill(HeightGen *gen) {
+    float c = (gen->dimension - 1) / 2.0f;
+    for (int x = 0; x < gen->dimension; ++x) {
+        float dx = (x - c) / c;
+        gen->columns[x] = dx * dx;
+    }
+}
 
-    float dx = (x - cx) / cx;
-    float dz = (z - cz) / cz;
-    float dist = sqrtf(dx * dx + dz * dz);
+static void height_hill(const HeightGen *gen, vec3 *row, int z) {
+    float c = (gen->dimension - 1) / 2.0f;
+    float dz = (z - c) / c;
+    float dz2 = dz * dz;
 
-    float height = cosf(dist * (float)M_PI / 2.0f);
-    if (height < 0.0f) height = 0.0f;
-    (*cp)[1] = height * 5.0f;
+    for (int x = 0; x < gen->dimension; ++x) {
+        float height = cosf(sqrtf(gen->columns[x] + dz2) * (float) M_PI / 2.0f);
+        row[x][1] = fmaxf(height, 0.0f) * 5.0f;
+    }
 }
 
 /**
  * Height function: Exponential.
  * Creates a sharp peak at origin with exponential falloff.
- *
- * @param cp Pointer to control point to modify
- * @param x X grid index
- * @param z Z grid index
- * @param dimension Grid dimension
  */
-static void height_exp(vec3 *cp, int x, int z, int dimension) {
-    NK_UNUSED(dimension);
-    float exp = expf(-(x * x + z * z) / 100.0f);
-    (*cp)[1] = exp * 10.0f;
+static void columns_exp(HeightGen *gen) {
+    for (int x = 0; x < gen->dimension; ++x) {
+        gen->columns[x] = expf(-(x * x) / 100.0f);
+    }
+}
+
+static void height_exp(const HeightGen *gen, vec3 *row, int z) {
+    float e = expf(-(z * z) / 100.0f) * 10.0f;
+    for (int x = 0; x < gen->dimension; ++x) {
+        row[x][1] = gen->columns[x] * e;
+    }
 }
 
 /**
  * Height function: Tilt along X axis.
  * Creates a linear slope in the X direction.
- *
- * @param cp Pointer to control point to modify
- * @param x X grid index
- * @param z Z grid index
- * @param dimension Grid dimension
  */
-static void height_tiltX(vec3 *cp, int x, int z, int dimension) {
-    NK_UNUSED(dimension);
+static void height_tiltX(const HeightGen *gen, vec3 *row, int z) {
     NK_UNUSED(z);
 
-    (*cp)[1] -= 0.02f * x;
+    for (int x = 0; x < gen->dimension; ++x) {
+        row[x][1] -= 0.02f * x;
+    }
 }
 
 /**
  * Height function: Tilt along Z axis.
  * Creates a linear slope in the Z direction.
- *
- * @param cp Pointer to control point to modify
- * @param x X grid index
- * @param z Z grid index
- * @param dimension Grid dimension
  */
-static void height_tiltZ(vec3 *cp, int x, int z, int dimension) {
-    NK_UNUSED(dimension);
-    NK_UNUSED(x);
-
-    (*cp)[1] -= 0.02f * z;
+static void height_tiltZ(const HeightGen *gen, vec3 *row, int z) {
+    float tilt = 0.02f * z;
+    for (int x = 0; x < gen->dimension; ++x) {
+        row[x][1] -= tilt;
+    }
 }
 
+/**
+ * Height function: Noise terrain.
+ * Fractal Brownian motion over gradient noise, see NoiseSettings.
+ */
+static void height_noise(const HeightGen *gen, vec3 *row, int z) {
+    for (int x = 0; x < gen->dimension; ++x) {
+        row[x][1] = utils_noiseHeight(gen->noise, gen->seed, (float) x, (float) z);
+    }
+}
 
 /**
- * Array of height function pointers, indexed by HeightFuncType enum.
+ * Batch generators, indexed by HeightFuncType enum.
  */
-static HeightFunc g_heightFuncs[HF_COUNT] = {
-    height_flat,   // HF_FLAT
-    height_sin,    // HF_SIN
-    height_cos,    // HF_COS
-    height_gauss,  // HF_GAUSS
-    height_random, // HF_RANDOM
-    height_hill,   // HF_HILL
-    height_exp,    // HF_EXP
-    height_tiltX,  // HF_TILT_X
-    height_tiltZ   // HF_TILT_Z
+static const HeightFunc g_heightFuncs[HF_COUNT] = {
+    { NULL,          height_flat   }, // HF_FLAT
+    { columns_sin,   height_sin    }, // HF_SIN
+    { columns_cos,   height_cos    }, // HF_COS
+    { columns_gauss, height_gauss  }, // HF_GAUSS
+    { NULL,          height_random }, // HF_RANDOM
+    { columns_hill,  height_hill   }, // HF_HILL
+    { columns_exp,   height_exp    }, // HF_EXP
+    { NULL,          height_tiltX  }, // HF_TILT_X
+    { NULL,          height_tiltZ  }, // HF_TILT_Z
+    { NULL,          height_noise  }  // HF_NOISE
 };
 
+/**
+ * Job writing the heights of a range of rows.
+ */
+static void heightRowsJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    const HeightGen *gen = userData;
+
+    for (int z = begin; z < end; ++z) {
+        gen->row(gen, &gen->controlPoints[z * gen->dimension], z);
+    }
+}
+
 ////////////////////////    PUBLIC    ////////////////////////////
 
 void utils_applyHeightFunction(HeightFuncType funcType) {
@@ -225,12 +325,30 @@ void utils_applyHeightFunction(HeightFuncType funcType) {
     InputData *data = getInputData();
     int dimension = data->surface.dimension;
 
-    // Apply height function to all control points
-    for (int z = 0; z < dimension; ++z) {
-        for (int x = 0; x < dimension; ++x) {
-            int idx = z * dimension + x;
-            g_heightFuncs[funcType](&data->surface.controlPoints.data[idx], x, z, dimension);
+    HeightGen gen = {
+        .controlPoints = data->surface.controlPoints.data,
+        .dimension = dimension,
+        .seed = rng_next(rng_thread()),
+        .noise = &data->surface.noise
+    };
+
+    // Large noise grids go to the compute shader, the CPU path is the fallback
+    bool generated = false;
+    if (funcType == HF_NOISE && data->surface.noise.gpu && dimension * dimension >= HEIGHT_NOISE_GPU_MIN_POINTS) {
+        generated = model_generateNoiseHeights(gen.controlPoints, dimension, gen.seed, gen.noise);
+    }
+
+    if (!generated) {
+        const HeightFunc *func = &g_heightFuncs[funcType];
+        if (func->columns) {
+            gen.columns = malloc(dimension * sizeof(float));
+            assert(gen.columns && "malloc failed in utils_applyHeightFunction");
+            func->columns(&gen);
         }
+
+        gen.row = func->row;
+        jobs_parallelFor(dimension, HEIGHT_ROWS_PER_CHUNK, heightRowsJob, &gen);
+        free(gen.columns);
     }
 
     // Mark surface as changed
@@ -239,6 +357,18 @@ void utils_applyHeightFunction(HeightFuncType funcType) {
     data->surface.offsetChanged = true;
 }
 
+float utils_noiseHeight(const NoiseSettings *noise, uint32_t seed, float x, float z) {
+    float sum = 0.0f;
+    float amplitude = 1.0f;
+    float frequency = noise->frequency;
+    for (int o = 0; o < noise->octaves; ++o) {
+        sum += amplitude * perlin(x * frequency, z * frequency, seed + (uint32_t) o);
+        frequency *= 2.0f;
+        amplitude *= noise->gain;
+    }
+    return sum * noise->amplitude;
+}
+
 void utils_calculatePolynomialPatch(Patch *p, mat4 geometryTerm) {
     mat4 tmp, result;
 
@@ -280,6 +410,19 @@ PatchEvalResult utils_evalPatchLocal(Patch *p, float s, float t) {
     return r;
 }
 
+void utils_patchBasis(float u, PatchBasis *dest) {
+    glm_vec4_copy((vec4) { u*u*u, u*u, u, 1.0f }, dest->value);
+    glm_vec4_copy((vec4) { 3*u*u, 2*u, 1.0f, 0.0f }, dest->deriv);
+}
+
+void utils_evalPatchRow(Patch *p, const PatchBasis *s, vec4 row, vec4 rowDs) {
+    // Column k of C dotted with the s basis gives component k of s^T * C
+    for (int k = 0; k < 4; ++k) {
+        row[k]   = glm_vec4_dot(p->coeffsY[k], (float*) s->value);
+        rowDs[k] = glm_vec4_dot(p->coeffsY[k], (float*) s->deriv);
+    }
+}
+
 void utils_evalBezier3D(vec3 p0, vec3 p1, vec3 p2, vec3 p3, float t, vec3 out) {
     // Cubic Bezier: B(t) = (1-t)³p0 + 3(1-t)²t*p1 + 3(1-t)t²p2 + t³p3
     float t2 = t * t;
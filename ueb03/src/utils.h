@@ -17,6 +17,8 @@
 #define UTILS_H
 
 #include <fhwcg/fhwcg.h>
+#include "array.h"
+#include "rng.h"
 #include "rendering.h"
 #include "input.h"
 #include "logic.h"
@@ -25,62 +27,16 @@
 #define VEC3X(x) ((vec3){(float) x, (float) x, (float) x})
 #define VEC2(x, y) ((vec2) {x, y})
 #define CLAMP(x, min, max) ((x < min) ? min : (x > max) ? max : x)
+#define RAND01 rng_float(rng_thread())
 
 /**
- * Defines a dynamic array type with init, free, clear, reserve, push
- * and popBack functions for any given element TYPE.
- *
- * @param TYPE Element type stored in the array
- * @param NAME Name of the generated array type
+ * Cubic power basis of one local patch parameter u.
+ * Precomputed once per sample position for regular grids.
  */
-#define DEFINE_ARRAY_TYPE(TYPE, NAME)                                          \
-typedef struct {                                                               \
-    TYPE *data;                                                                \
-    size_t size;                                                               \
-    size_t capacity;                                                           \
-} NAME;                                                                        \
-                                                                               \
-static inline void NAME##_init(NAME *arr) {                                    \
-    arr->data = NULL;                                                          \
-    arr->size = 0;                                                             \
-    arr->capacity = 0;                                                         \
-}                                                                              \
-                                                                               \
-static inline void NAME##_free(NAME *arr) {                                    \
-    free(arr->data);                                                           \
-    arr->data = NULL;                                                          \
-    arr->size = 0;                                                             \
-    arr->capacity = 0;                                                         \
-}                                                                              \
-                                                                               \
-static inline void NAME##_clear(NAME *arr) {                                   \
-    arr->size = 0;                                                             \
-}                                                                              \
-                                                                               \
-static inline void NAME##_reserve(NAME *arr, size_t min_capacity) {            \
-    if (arr->capacity < min_capacity) {                                        \
-        size_t new_cap = arr->capacity ? arr->capacity * 2 : 8;                \
-        if (new_cap < min_capacity) new_cap = min_capacity;                    \
-        TYPE *new_data = malloc(new_cap * sizeof(TYPE));                       \
-        assert(new_data && "malloc failed in " #NAME "_reserve");              \
-        if (arr->data) memcpy(new_data, arr->data, arr->size * sizeof(TYPE));  \
-        free(arr->data);                                                       \
-        arr->data = new_data;                                                  \
-        arr->capacity = new_cap;                                               \
-    }                                                                          \
-}                                                                              \
-                                                                               \
-static inline void NAME##_push(NAME *arr, TYPE value) {                        \
-    if (arr->size >= arr->capacity)                                            \
-        NAME##_reserve(arr, arr->size + 1);                                    \
-    arr->data[arr->size++] = value;                                            \
-}                                                                              \
-                                                                               \
-static inline void NAME##_popBack(NAME *arr) {                                 \
-    if (arr->size > 0) {                                                       \
-        arr->size--;                                                           \
-    }                                                                          \
-}                                                                              \
+typedef struct {
+    vec4 value;  // (u³, u², u, 1)
+    vec4 deriv;  // (3u², 2u, 1, 0)
+} PatchBasis;
 
 /**
  * Enumerates available height modification functions used to
@@ -96,6 +52,7 @@ typedef enum {
     HF_EXP,
     HF_TILT_X,
     HF_TILT_Z,
+    HF_NOISE,
     HF_COUNT
 } HeightFuncType;
 
@@ -110,76 +67,22 @@ typedef struct {
     float duration;       // total duration in seconds
 } BezierCameraPath;
 
-/**
- * Initializes a vec3 array.
- * @param arr Pointer to the vec3 array.
- */
-static inline void vec3arr_init(Vec3Arr *arr) {
-    arr->size = 0;
-    arr->capacity = 0;
-    arr->data = NULL;
-}
-
-/**
- * Frees a vec3 array.
- * @param arr Pointer to the vec3 array.
- */
-static inline void vec3arr_free(Vec3Arr *arr) {
-    free(arr->data);
-    arr->data = NULL;
-    arr->size = 0;
-    arr->capacity = 0;
-}
-
-/**
- * Resets a vec3 array.
- * @warning Does not free the elements.
- * @param arr Pointer to the vec3 array.
- */
-static inline void vec3arr_clear(Vec3Arr *arr) {
-    arr->size = 0;
-}
-
-/**
- * Reserves the given amount for elements of a vec3 array.
- * Does not reduce the current capacity!
- * @param arr Pointer to the vec3 array.
- * @param min_capacity The new capacity of the array.
- */
-static inline void vec3arr_reserve(Vec3Arr *arr, size_t min_capacity) {
-    if (arr->capacity < min_capacity) {
-        size_t new_cap = arr->capacity ? arr->capacity * 2 : 8;
-        if (new_cap < min_capacity)
-            new_cap = min_capacity;
-        vec3 *new_data = (vec3*) malloc(new_cap * sizeof(vec3));
-        assert(new_data && "vec3arr_reserve: malloc failed");
-        if (arr->data) {
-            memcpy(new_data, arr->data, arr->size * sizeof(vec3));
-            free(arr->data);
-        }
-        arr->data = new_data;
-        arr->capacity = new_cap;
-    }
-}
-
-/**
- * Adds a new element to the vec3 array.
- * @param arr Pointer to the vec3 array.
- * @param value The new Element of the array.
- */
-static inline void vec3arr_push(Vec3Arr *arr, vec3 value) {
-    if (arr->size >= arr->capacity) {
-        vec3arr_reserve(arr, arr->size + 1);
-    }
-    glm_vec3_copy(value, arr->data[arr->size++]);
-}
-
 /**
  * Applies the given heigth modification to all control points of the surface.
  * @param funcType The Type of the Height-Function. 
  */
 void utils_applyHeightFunction(HeightFuncType funcType);
 
+/**
+ * Height of the noise height function at a control point.
+ * @param noise Octaves, frequency and amplitude of the noise.
+ * @param seed Seed of the lattice.
+ * @param x Control point column, may lie outside the grid.
+ * @param z Control point row, may lie outside the grid.
+ * @return The height.
+ */
+float utils_noiseHeight(const NoiseSettings *noise, uint32_t seed, float x, float z);
+
 /**
  * Calculates the polynomial for the given control points and 
  * saves it in the given patch.
@@ -200,6 +103,40 @@ void utils_calculatePolynomialPatch(Patch *p, mat4 geometryTerm);
  */
 PatchEvalResult utils_evalPatchLocal(Patch *p, float s, float t);
 
+/**
+ * Computes the power basis and its derivative for a local parameter.
+ * @param u Local s or t value.
+ * @param dest Output basis.
+ */
+void utils_patchBasis(float u, PatchBasis *dest);
+
+/**
+ * Contracts the given patch with the basis of a fixed local s.
+ * All samples of a patch on the same s then only need
+ * utils_evalPatchRowAt, which replaces both mat4 products.
+ * @param p Pointer to the Polynomial Patch.
+ * @param s Basis of the local s value.
+ * @param row Output: s^T * C.
+ * @param rowDs Output: ds^T * C.
+ */
+void utils_evalPatchRow(Patch *p, const PatchBasis *s, vec4 row, vec4 rowDs);
+
+/**
+ * Evaluates a patch row from utils_evalPatchRow at a local t.
+ * Same result as utils_evalPatchLocal for the s the row was built from.
+ * @param row s^T * C of the patch.
+ * @param rowDs ds^T * C of the patch.
+ * @param t Basis of the local t value.
+ * @returns the 2D B-Spline for t,s and both partial derivatives.
+ */
+static inline PatchEvalResult utils_evalPatchRowAt(vec4 row, vec4 rowDs, const PatchBasis *t) {
+    PatchEvalResult r;
+    r.value = glm_vec4_dot(row, (float*) t->value);
+    r.dsd   = glm_vec4_dot(rowDs, (float*) t->value);
+    r.dtd   = glm_vec4_dot(row, (float*) t->deriv);
+    return r;
+}
+
 /**
  * Bezier Curve evaluation for a vec3.
  * @param p0, p1, p2, p3 The Control Points for the bezier interpolation.
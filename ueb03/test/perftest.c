@@ -0,0 +1,259 @@
+/**
+ * @file perftest.c
+ * @brief Regression tests of the surface rebuild and the ball physics
+ *
+ * Runs deterministic workloads without a window and asserts their
+ * invariants with cmocka: the surface rebuilt at dimension 100 and
+ * resolution 200 evaluates without NaN, and 1000 balls stay finite and
+ * inside the walls over a fixed-seed stress run. The rebuild and step times
+ * are collected as a result (benchresult.h) and compared to the baseline
+ * given as the first argument: a time more than the tolerance slower than
+ * the baseline, and significantly so, fails. A missing baseline is written
+ * from the run and the comparison is skipped. GL-bound modules are replaced
+ * by bench/stubs.c.
+ *
+ * Usage: cg2_ueb03_perftest [baseline] [tolerance]
+ *   baseline   JSON result of an earlier run, written if missing
+ *   tolerance  allowed slowdown in percent, default PERFTEST_TOLERANCE
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <fhwcg/fhwcg.h>
+#include "input.h"
+#include "logic.h"
+#include "physics.h"
+#include "utils.h"
+#include "rng.h"
+#include "benchresult.h"
+
+#define PERFTEST_SEED 42
+#define PERFTEST_TOLERANCE 25.0
+
+#define SURFACE_DIMENSION 100
+#define SURFACE_RESOLUTION 200
+#define SURFACE_REPEATS 3
+
+/** Samples per direction of the surface NaN check */
+#define SURFACE_CHECK_SAMPLES 64
+
+#define STRESS_BALLS 1000
+#define STRESS_BLACKHOLES 5
+#define STRESS_STEPS 200
+#define STRESS_WARMUP 20
+#define STRESS_REPEATS 5
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/** Baseline file, NULL to only check the invariants */
+static const char *g_baselinePath = NULL;
+
+/** Allowed slowdown against the baseline in percent */
+static double g_tolerance = PERFTEST_TOLERANCE;
+
+/** Times of all workloads */
+static BenchResult g_result;
+
+/**
+ * Builds the surface of the given size with the hill height function and
+ * waits for it. The height function is applied to the fresh control
+ * points, so the surface is built twice.
+ * @param dimension Control points per axis.
+ * @param resolution Samples per axis.
+ * @return Time of the second build in microseconds.
+ */
+static double buildSurface(int dimension, int resolution) {
+    InputData *data = getInputData();
+    rng_setSeed(PERFTEST_SEED);
+
+    data->surface.dimension = dimension;
+    data->surface.dimensionChanged = true;
+    data->surface.resolution = resolution;
+    data->surface.resolutionChanged = true;
+    logic_update(data);
+    logic_finishRebuild(data);
+
+    double start = glfwGetTime();
+    utils_applyHeightFunction(HF_HILL);
+    logic_update(data);
+    logic_finishRebuild(data);
+    return (glfwGetTime() - start) * 1e6;
+}
+
+/**
+ * Samples the surface on a regular grid. Every sample evaluates the
+ * PatchEvalResult of its patch into a position and a normal.
+ * @return Number of samples with a NaN position or normal.
+ */
+static int countInvalidSurfacePoints(void) {
+    int count = 0;
+    for (int i = 0; i < SURFACE_CHECK_SAMPLES; ++i) {
+        for (int j = 0; j < SURFACE_CHECK_SAMPLES; ++j) {
+            vec3 pos = {0}, normal = {0};
+            logic_evalSplineGlobal((float) i / (SURFACE_CHECK_SAMPLES - 1), (float) j / (SURFACE_CHECK_SAMPLES - 1),
+                pos, normal);
+            bool valid = true;
+            for (int c = 0; c < 3; ++c) {
+                valid &= isfinite(pos[c]) && isfinite(normal[c]);
+            }
+            count += !valid;
+        }
+    }
+    return count;
+}
+
+/**
+ * Respawns the balls and black holes of the stress run from the seed.
+ */
+static void spawnScenario(void) {
+    rng_setSeed(PERFTEST_SEED);
+    physics_init();
+
+    while (physics_getBlackHoleCount() > STRESS_BLACKHOLES) {
+        physics_removeBlackHole();
+    }
+    while (physics_getBlackHoleCount() < STRESS_BLACKHOLES) {
+        physics_addBlackHole();
+    }
+    while (physics_getBallCount() > STRESS_BALLS) {
+        physics_removeBall();
+    }
+    while (physics_getBallCount() < STRESS_BALLS) {
+        physics_addBall();
+    }
+    physics_orderBallsRandom();
+}
+
+/**
+ * Runs exactly one fixed physics step.
+ * @param data Input state.
+ */
+static void runStep(InputData *data) {
+    data->deltaTime = 0.0f;
+    data->physics.dtAccumulator = data->physics.fixedDt;
+    physics_update();
+}
+
+/**
+ * Sets up the defaults, the timer and the logic shared by all tests.
+ * @param state Unused.
+ * @return 0 on success.
+ */
+static int setupGroup(void **state) {
+    NK_UNUSED(state);
+    input_initDefaults();
+    // Only the timer is used, no window is created
+    if (!glfwInit()) {
+        return -1;
+    }
+    getInputData()->game.paused = false;
+    logic_init();
+    benchresult_init(&g_result, PROGRAM_NAME, 0, NULL);
+    return 0;
+}
+
+/**
+ * Frees the logic and the result.
+ * @param state Unused.
+ * @return 0 on success.
+ */
+static int teardownGroup(void **state) {
+    NK_UNUSED(state);
+    benchresult_free(&g_result);
+    logic_cleanup();
+    glfwTerminate();
+    return 0;
+}
+
+/**
+ * Rebuilds the surface at dimension 100 and resolution 200 and checks it for NaN.
+ * @param state Unused.
+ */
+static void test_surfaceRebuild(void **state) {
+    NK_UNUSED(state);
+    double rebuildUs[SURFACE_REPEATS];
+    for (int r = 0; r < SURFACE_REPEATS; ++r) {
+        rebuildUs[r] = buildSurface(SURFACE_DIMENSION, SURFACE_RESOLUTION);
+    }
+    benchresult_add(&g_result, "surface rebuild", "us", false, rebuildUs, SURFACE_REPEATS);
+
+    assert_int_equal(countInvalidSurfacePoints(), 0);
+}
+
+/**
+ * Runs 1000 balls on the rebuilt surface and checks that none left the walls or turned NaN.
+ * @param state Unused.
+ */
+static void test_ballStress(void **state) {
+    NK_UNUSED(state);
+    InputData *data = getInputData();
+
+    // Every repetition starts the same scenario again, all of them are checked
+    double stepUs[STRESS_REPEATS];
+    for (int r = 0; r < STRESS_REPEATS; ++r) {
+        spawnScenario();
+        for (int i = 0; i < STRESS_WARMUP; ++i) {
+            runStep(data);
+        }
+
+        double start = glfwGetTime();
+        for (int i = 0; i < STRESS_STEPS; ++i) {
+            runStep(data);
+        }
+        stepUs[r] = (glfwGetTime() - start) * 1e6 / STRESS_STEPS;
+
+        // Black holes swallow balls, the remaining ones must be valid
+        assert_int_equal(physics_countInvalidBalls(), 0);
+    }
+    benchresult_add(&g_result, "1000 balls step", "us", false, stepUs, STRESS_REPEATS);
+}
+
+/**
+ * Compares the times of the tests before to the baseline.
+ * @param state Unused.
+ */
+static void test_throughputFloors(void **state) {
+    NK_UNUSED(state);
+    if (!g_baselinePath) {
+        skip();
+    }
+
+    FILE *f = fopen(g_baselinePath, "r");
+    if (!f) {
+        assert_true(benchresult_write(&g_result, g_baselinePath));
+        print_message("Baseline written to %s\n", g_baselinePath);
+        skip();
+    }
+    fclose(f);
+
+    BenchResult baseline;
+    assert_true(benchresult_load(&baseline, g_baselinePath));
+    int regressed = benchresult_compare(&baseline, &g_result, g_tolerance);
+    benchresult_free(&baseline);
+    assert_int_equal(regressed, 0);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        g_baselinePath = argv[1];
+    }
+    if (argc > 2) {
+        g_tolerance = atof(argv[2]);
+    }
+
+    // The throughput test compares the times of all tests before it
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_surfaceRebuild),
+        cmocka_unit_test(test_ballStress),
+        cmocka_unit_test(test_throughputFloors),
+    };
+    return cmocka_run_group_tests(tests, setupGroup, teardownGroup);
+}
@@ -0,0 +1,611 @@
+/**
+ * @file bench.c
+ * @brief Headless benchmark for the fixed-step particle update
+ *
+ * Runs the CPU particle update without a window for a set of particle
+ * counts and target modes and prints steps per second and nanoseconds
+ * per particle step. GL-bound modules are replaced by stubs.c.
+ *
+ * Every run is repeated from the same start, every repetition is one
+ * sample of the time per particle step, the printed row shows their mean.
+ * The samples of all runs can be written as a result (benchresult.h).
+ *
+ * Every run of physics.c checks that no particle left the room or turned
+ * NaN. With a baseline, the JSON result or the saved output of an earlier
+ * run with the same options, the time per particle step of the matching
+ * rows must not exceed it by more than the tolerance. Against a JSON result
+ * the slowdown has to be significant beyond the noise of the repetitions
+ * as well. Failed checks are printed to stderr and make the exit code
+ * non-zero, so the benchmark doubles as a regression test.
+ *
+ * Usage: cg2_ueb04_bench [-s steps] [-w warmup] [-i repeats] [-c counts] [-m modes]
+ *                        [-t threads] [-k kernel] [-r seed] [-f field] [-x fastmath] [-n swarms]
+ *                        [-o obstacles] [-e reorder] [-d ranks] [-j output] [-b baseline] [-p tolerance]
+ *   repeats runs per count and mode from the same start
+ *   counts  comma separated list, e.g. 1000,5000,20000
+ *   modes   comma separated list of spheres, center, leader, box, flock, gravity
+ *   kernel  scalar, sse or avx
+ *   field   1 to sample the attractor force field in spheres
+ *   fastmath 1 to run with the fastmath approximations, checks their error bounds first
+ *   swarms  number of swarms the particles are split into, all with the same target mode
+ *   obstacles 1 to steer around the obstacles, waits for the distance volume first
+ *   reorder fixed steps between two Morton order reorders, 0 for off
+ *   ranks   slab domains the room is split into (domain.c), 0 runs physics.c;
+ *           spheres, center and flock only, the attractors stand still
+ *   output    JSON result of the run
+ *   baseline  JSON result or output of an earlier run
+ *   tolerance allowed slowdown against the baseline in percent
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include <fhwcg/fhwcg.h>
+#include "input.h"
+#include "physics.h"
+#include "jobs.h"
+#include "integrate.h"
+#include "rng.h"
+#include "fastmath.h"
+#include "thread.h"
+#include "domain.h"
+#include "benchresult.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+#define DEFAULT_STEPS 500
+#define DEFAULT_WARMUP 50
+#define DEFAULT_REPEATS 5
+#define MAX_REPEATS 64
+#define DEFAULT_SEED 42
+#define MAX_RUNS 16
+#define DEFAULT_TOLERANCE 25.0f
+
+/** Rows read from a baseline */
+#define MAX_BASELINE_ROWS 64
+
+/** Samples of the fastmath error sweeps */
+#define FASTMATH_SAMPLES 1000000
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/** Names accepted for -m, indexed by TargetMode */
+static const char *g_modeNames[] = {"spheres", "center", "leader", "box", "flock", "gravity"};
+
+/** Names accepted for -k, indexed by SimdKernel */
+static const char *g_kernelNames[] = {"scalar", "sse", "avx"};
+
+/**
+ * Benchmark configuration parsed from the command line.
+ */
+typedef struct {
+    int steps;
+    int warmup;
+    int repeats;
+    int threads;
+    SimdKernel kernel;
+    bool field;
+    bool fastMath;
+    bool obstacles;
+    int reorder;
+    int swarms;
+    int ranks;
+    uint64_t seed;
+    int counts[MAX_RUNS];
+    int numCounts;
+    TargetMode modes[MAX_RUNS];
+    int numModes;
+    const char *output;
+    const char *baseline;
+    float tolerance;    // percent
+} BenchConfig;
+
+/**
+ * Time of one run of a baseline.
+ */
+typedef struct {
+    char mode[16];
+    int count;
+    int threads;
+    double nsPerParticle;
+} BaselineRow;
+
+/** Rows of a text baseline, empty without -b */
+static BaselineRow g_baseline[MAX_BASELINE_ROWS];
+static int g_baselineRows = 0;
+
+/** Samples of all runs */
+static BenchResult g_result;
+
+/** JSON baseline, compared once all runs are done */
+static BenchResult g_baselineResult;
+static bool g_hasBaselineResult = false;
+
+/**
+ * Returns a monotonic timestamp.
+ * @return Time in seconds.
+ */
+static double now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/**
+ * Looks up a name in a table.
+ * @param name Name to look up.
+ * @param names Table of accepted names.
+ * @param count Number of entries in the table.
+ * @return Index of the name or -1 if unknown.
+ */
+static int findName(const char *name, const char **names, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Parses a comma separated list of particle counts.
+ * @param arg Argument string (modified).
+ * @param cfg Configuration to fill.
+ * @return False if an entry is invalid.
+ */
+static bool parseCounts(char *arg, BenchConfig *cfg) {
+    cfg->numCounts = 0;
+    for (char *tok = strtok(arg, ","); tok && cfg->numCounts < MAX_RUNS; tok = strtok(NULL, ",")) {
+        int count = atoi(tok);
+        if (count <= 0) {
+            printf("Invalid particle count '%s'!\n", tok);
+            return false;
+        }
+        cfg->counts[cfg->numCounts++] = count;
+    }
+    return cfg->numCounts > 0;
+}
+
+/**
+ * Parses a comma separated list of target mode names.
+ * @param arg Argument string (modified).
+ * @param cfg Configuration to fill.
+ * @return False if an entry is unknown.
+ */
+static bool parseModes(char *arg, BenchConfig *cfg) {
+    cfg->numModes = 0;
+    for (char *tok = strtok(arg, ","); tok && cfg->numModes < MAX_RUNS; tok = strtok(NULL, ",")) {
+        int mode = findName(tok, g_modeNames, NK_LEN(g_modeNames));
+        if (mode < 0) {
+            printf("Unknown target mode '%s'!\n", tok);
+            return false;
+        }
+        cfg->modes[cfg->numModes++] = (TargetMode)mode;
+    }
+    return cfg->numModes > 0;
+}
+
+/**
+ * Prints the usage string.
+ */
+static void printUsage(void) {
+    printf("Usage: " PROGRAM_NAME " [-s steps] [-w warmup] [-i repeats] [-c counts] [-m modes] [-t threads] [-k kernel] [-r seed] [-f field] [-x fastmath] [-n swarms] [-o obstacles] [-e reorder] [-d ranks] [-j output] [-b baseline] [-p tolerance]\n");
+    printf("  repeats runs per count and mode from the same start, 1 to %d\n", MAX_REPEATS);
+    printf("  counts  comma separated, e.g. 1000,5000,20000\n");
+    printf("  modes   comma separated list of spheres, center, leader, box, flock, gravity\n");
+    printf("  kernel  scalar, sse or avx\n");
+    printf("  field   1 to sample the attractor force field in spheres\n");
+    printf("  fastmath 1 to run with the fastmath approximations\n");
+    printf("  swarms  1 to %d swarms sharing the particles\n", MAX_SWARMS);
+    printf("  obstacles 1 to steer around the obstacles\n");
+    printf("  reorder fixed steps between two Morton order reorders, 0 for off\n");
+    printf("  ranks   1 to %d slab domains exchanging ghosts and migrants, 0 for off\n", DOMAIN_MAX_RANKS);
+    printf("  output    JSON result of the run\n");
+    printf("  baseline  JSON result or output of an earlier run, slower rows fail\n");
+    printf("  tolerance allowed slowdown in percent, default %.0f\n", DEFAULT_TOLERANCE);
+}
+
+/**
+ * Parses the command line into a configuration.
+ * @param argc Argument count.
+ * @param argv Argument values.
+ * @param cfg Configuration to fill, prefilled with defaults.
+ * @return False if the arguments are invalid.
+ */
+static bool parseArgs(int argc, char **argv, BenchConfig *cfg) {
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0' || i + 1 >= argc) {
+            return false;
+        }
+
+        char *arg = argv[++i];
+        switch (opt[1]) {
+            case 's': cfg->steps = atoi(arg); break;
+            case 'w': cfg->warmup = atoi(arg); break;
+            case 'i': cfg->repeats = atoi(arg); break;
+            case 't': cfg->threads = atoi(arg); break;
+            case 'r': cfg->seed = strtoull(arg, NULL, 10); break;
+            case 'f': cfg->field = atoi(arg) != 0; break;
+            case 'x': cfg->fastMath = atoi(arg) != 0; break;
+            case 'n': cfg->swarms = atoi(arg); break;
+            case 'o': cfg->obstacles = atoi(arg) != 0; break;
+            case 'e': cfg->reorder = atoi(arg); break;
+            case 'd': cfg->ranks = atoi(arg); break;
+            case 'j': cfg->output = arg; break;
+            case 'b': cfg->baseline = arg; break;
+            case 'p': cfg->tolerance = (float)atof(arg); break;
+            case 'c':
+                if (!parseCounts(arg, cfg)) return false;
+                break;
+            case 'm':
+                if (!parseModes(arg, cfg)) return false;
+                break;
+            case 'k': {
+                int kernel = findName(arg, g_kernelNames, NK_LEN(g_kernelNames));
+                if (kernel < 0) {
+                    printf("Unknown kernel '%s'!\n", arg);
+                    return false;
+                }
+                cfg->kernel = (SimdKernel)kernel;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return cfg->steps > 0 && cfg->warmup >= 0 && cfg->repeats >= 1 && cfg->repeats <= MAX_REPEATS
+        && cfg->swarms >= 1 && cfg->swarms <= MAX_SWARMS
+        && cfg->reorder >= 0 && cfg->ranks >= 0 && cfg->ranks <= DOMAIN_MAX_RANKS && cfg->tolerance >= 0.0f;
+}
+
+/**
+ * Reads a JSON result or the result rows of a saved benchmark output,
+ * all other lines are skipped.
+ * @param path Baseline file.
+ * @return False if the file cannot be read.
+ */
+static bool loadBaseline(const char *path) {
+    if (benchresult_isResultFile(path)) {
+        g_hasBaselineResult = benchresult_load(&g_baselineResult, path);
+        return g_hasBaselineResult;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        printf("Failed to open '%s'!\n", path);
+        return false;
+    }
+
+    char line[256];
+    while (g_baselineRows < MAX_BASELINE_ROWS && fgets(line, sizeof(line), f)) {
+        BaselineRow *row = &g_baseline[g_baselineRows];
+        double stepsPerSec;
+        if (sscanf(line, "%15s %d %d %lf %lf", row->mode, &row->count, &row->threads,
+                &stepsPerSec, &row->nsPerParticle) == 5) {
+            ++g_baselineRows;
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+
+/**
+ * Prints the row of a run and adds its samples to the result.
+ * @param mode Target mode.
+ * @param count Number of particles.
+ * @param threads Worker threads of the run.
+ * @param nsPerParticle Time per particle step of every repetition.
+ * @param repeats Number of repetitions.
+ * @return Mean time per particle step.
+ */
+static double recordRun(TargetMode mode, int count, int threads, const double *nsPerParticle, int repeats) {
+    double sum = 0.0;
+    for (int i = 0; i < repeats; ++i) {
+        sum += nsPerParticle[i];
+    }
+    double mean = sum / repeats;
+    double variance = 0.0;
+    for (int i = 0; i < repeats; ++i) {
+        variance += (nsPerParticle[i] - mean) * (nsPerParticle[i] - mean);
+    }
+    double stddev = repeats > 1 ? sqrt(variance / (repeats - 1)) : 0.0;
+
+    printf("%-8s %10d %8d %12.1f %14.2f %7.1f%%\n", g_modeNames[mode], count, threads,
+        1e9 / (mean * count), mean, 100.0 * stddev / mean);
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s %d t%d", g_modeNames[mode], count, threads);
+    benchresult_add(&g_result, name, "ns/particle", false, nsPerParticle, repeats);
+    return mean;
+}
+
+/**
+ * Checks the particles after a run and compares its time to the baseline.
+ * @param cfg Benchmark configuration.
+ * @param mode Target mode.
+ * @param count Number of particles.
+ * @param threads Worker threads of the run.
+ * @param nsPerParticle Measured time per particle step.
+ * @param particles True to check the particles of physics.c.
+ * @return Number of failed checks.
+ */
+static int checkRun(const BenchConfig *cfg, TargetMode mode, int count, int threads, double nsPerParticle, bool particles) {
+    int failed = 0;
+    int invalid = particles ? physics_countInvalidParticles() : 0;
+    if (invalid > 0) {
+        fprintf(stderr, "FAIL %s %d: %d particles outside the room or NaN\n", g_modeNames[mode], count, invalid);
+        ++failed;
+    }
+
+    if (!cfg->baseline || g_hasBaselineResult) {
+        return failed;
+    }
+    for (int i = 0; i < g_baselineRows; ++i) {
+        const BaselineRow *row = &g_baseline[i];
+        if (strcmp(row->mode, g_modeNames[mode]) != 0 || row->count != count || row->threads != threads) {
+            continue;
+        }
+        if (nsPerParticle > row->nsPerParticle * (1.0 + cfg->tolerance / 100.0)) {
+            fprintf(stderr, "FAIL %s %d: %.2f ns/particle, baseline %.2f (+%.0f%%)\n", g_modeNames[mode], count,
+                nsPerParticle, row->nsPerParticle, 100.0 * (nsPerParticle / row->nsPerParticle - 1.0));
+            ++failed;
+        }
+        return failed;
+    }
+    fprintf(stderr, "No baseline for %s %d\n", g_modeNames[mode], count);
+    return failed;
+}
+
+/**
+ * Measures the largest relative errors of the fastmath functions against
+ * libm over their documented ranges and compares them to the bounds.
+ * @return False if a bound is exceeded.
+ */
+static bool checkFastMath(void) {
+    double expError = 0.0, rsqrtError = 0.0, normError = 0.0;
+
+    for (int i = 0; i <= FASTMATH_SAMPLES; ++i) {
+        float x = FASTMATH_EXP_MIN + (FASTMATH_EXP_MAX - FASTMATH_EXP_MIN) * i / FASTMATH_SAMPLES;
+        double ref = exp((double)x);
+        expError = fmax(expError, fabs(fastmath_exp(x) - ref) / ref);
+
+        // Log-uniform over the normal floats in (1e-30, 1e30)
+        float y = (float)pow(10.0, -30.0 + 60.0 * i / FASTMATH_SAMPLES);
+        ref = 1.0 / sqrt((double)y);
+        rsqrtError = fmax(rsqrtError, fabs(fastmath_rsqrt(y) - ref) / ref);
+
+        Rng *rng = rng_thread();
+        vec3 v = { rng_float(rng) * 2.0f - 1.0f, rng_float(rng) * 2.0f - 1.0f, rng_float(rng) * 2.0f - 1.0f };
+        if (glm_vec3_norm(v) > FASTMATH_MIN_LENGTH) {
+            fastmath_vec3_normalize(v, v);
+            normError = fmax(normError, fabs(glm_vec3_norm(v) - 1.0));
+        }
+    }
+
+    printf("fastmath max rel error: exp %.2e (< %.0e), rsqrt %.2e (< %.0e), normalize %.2e\n",
+        expError, FASTMATH_EXP_MAX_REL_ERROR, rsqrtError, FASTMATH_RSQRT_MAX_REL_ERROR, normError);
+
+    // The length picks up float rounding on top of the rsqrt error
+    return expError < FASTMATH_EXP_MAX_REL_ERROR
+        && rsqrtError < FASTMATH_RSQRT_MAX_REL_ERROR
+        && normError < FASTMATH_RSQRT_MAX_REL_ERROR + 2.0 * FLT_EPSILON;
+}
+
+/**
+ * Runs exactly one fixed physics step.
+ * @param data Input state.
+ */
+static void runStep(InputData *data) {
+    data->deltaTime = 0.0f;
+    data->physics.dtAccumulator = data->physics.fixedDt;
+    physics_update();
+}
+
+/**
+ * Benchmarks one particle count and target mode on the slab decomposed update.
+ * Prints the message traffic of the last step below the timing row.
+ * @param cfg Benchmark configuration.
+ * @param count Number of particles.
+ * @param mode Target mode.
+ * @return Number of failed checks.
+ */
+static int runDomainBenchmark(const BenchConfig *cfg, int count, TargetMode mode) {
+    InputData *data = getInputData();
+    jobs_init(cfg->threads);
+    data->physics.threadCount = jobs_getThreadCount();
+
+    float h = data->rendering.roomSize;
+    vec3 spheres[2] = { { -0.5f * h, 0.0f, 0.0f }, { 0.5f * h, 0.2f * h, 0.0f } };
+
+    // Every repetition starts the same simulation again, the last one is checked
+    double samples[MAX_REPEATS];
+    for (int r = 0; r < cfg->repeats; ++r) {
+        if (r > 0) {
+            domain_cleanup();
+        }
+        rng_setSeed(cfg->seed);
+        if (!domain_init(data, cfg->ranks)) {
+            printf("%-8s not supported with ranks\n", g_modeNames[mode]);
+            jobs_cleanup();
+            return 0;
+        }
+
+        bool ok = true;
+        for (int i = 0; i < cfg->warmup && ok; ++i) {
+            ok = domain_step(data, spheres, 2);
+        }
+
+        double start = now();
+        for (int i = 0; i < cfg->steps && ok; ++i) {
+            ok = domain_step(data, spheres, 2);
+        }
+        samples[r] = (now() - start) * 1e9 / ((double)cfg->steps * count);
+
+        if (!ok) {
+            printf("%-8s lost a rank process\n", g_modeNames[mode]);
+            domain_cleanup();
+            jobs_cleanup();
+            return 1;
+        }
+    }
+
+    DomainStats stats;
+    domain_getStats(&stats);
+    int gathered = domain_getGathered(NULL, NULL);
+
+    double nsPerParticle = recordRun(mode, count, data->physics.threadCount, samples, cfg->repeats);
+    printf("         %d ranks (%s): %.1f KB/step, %d ghosts, %d migrants, %d gathered\n",
+        cfg->ranks, domain_usesProcesses() ? "processes" : "jobs", stats.bytes / 1024.0, stats.ghosts,
+        stats.migrants, gathered);
+    int failed = checkRun(cfg, mode, count, data->physics.threadCount, nsPerParticle, false);
+
+    domain_cleanup();
+    jobs_cleanup();
+    return failed;
+}
+
+/**
+ * Benchmarks one particle count and target mode on a fresh simulation.
+ * @param cfg Benchmark configuration.
+ * @param count Number of particles.
+ * @param mode Target mode.
+ * @return Number of failed checks.
+ */
+static int runBenchmark(const BenchConfig *cfg, int count, TargetMode mode) {
+    InputData *data = getInputData();
+
+    // The remainder of the split goes to swarm 0
+    data->particles.swarmCount = cfg->swarms;
+    for (int s = 0; s < cfg->swarms; ++s) {
+        data->particles.swarms[s].count = count / cfg->swarms + (s == 0 ? count % cfg->swarms : 0);
+        data->particles.swarms[s].targetMode = mode;
+    }
+    data->physics.threadCount = cfg->threads;
+    data->physics.kernel = cfg->kernel;
+    data->particles.attractorField = cfg->field;
+    data->physics.fastMath = cfg->fastMath;
+    data->physics.obstacles = cfg->obstacles;
+    data->physics.reorderInterval = cfg->reorder;
+    if (cfg->ranks > 0) {
+        return runDomainBenchmark(cfg, count, mode);
+    }
+
+    // Every repetition starts the same simulation again, the last one is checked
+    double samples[MAX_REPEATS];
+    for (int r = 0; r < cfg->repeats; ++r) {
+        if (r > 0) {
+            physics_cleanup();
+        }
+        rng_setSeed(cfg->seed);
+        physics_init();
+
+        // The bake runs on a worker thread, timed steps must all see the obstacles
+        while (cfg->obstacles && !physics_obstaclesReady()) {
+            THREAD_SLEEP_MS(1);
+        }
+
+        for (int i = 0; i < cfg->warmup; ++i) {
+            runStep(data);
+        }
+
+        double start = now();
+        for (int i = 0; i < cfg->steps; ++i) {
+            runStep(data);
+        }
+        samples[r] = (now() - start) * 1e9 / ((double)cfg->steps * count);
+    }
+
+    double nsPerParticle = recordRun(mode, count, data->physics.threadCount, samples, cfg->repeats);
+    int failed = checkRun(cfg, mode, count, data->physics.threadCount, nsPerParticle, true);
+
+    physics_cleanup();
+    return failed;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+int main(int argc, char **argv) {
+    input_initDefaults();
+    InputData *data = getInputData();
+
+    BenchConfig cfg = {
+        .steps = DEFAULT_STEPS,
+        .warmup = DEFAULT_WARMUP,
+        .repeats = DEFAULT_REPEATS,
+        .threads = data->physics.threadCount,
+        .kernel = data->physics.kernel,
+        .reorder = data->physics.reorderInterval,
+        .swarms = 1,
+        .seed = DEFAULT_SEED,
+        .counts = {1000, 5000, 20000, 100000},
+        .numCounts = 4,
+        .modes = {TM_SPHERES, TM_LEADER, TM_FLOCK},
+        .numModes = 3,
+        .output = NULL,
+        .baseline = NULL,
+        .tolerance = DEFAULT_TOLERANCE
+    };
+
+    // The lists are split in place by the parser
+    benchresult_init(&g_result, PROGRAM_NAME, argc, argv);
+    if (!parseArgs(argc, argv, &cfg)) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    if (cfg.baseline && !loadBaseline(cfg.baseline)) {
+        return EXIT_FAILURE;
+    }
+
+    if (!integrate_isSupported(cfg.kernel)) {
+        printf("Kernel '%s' not supported on this CPU, using '%s'.\n",
+            g_kernelNames[cfg.kernel], g_kernelNames[integrate_bestKernel()]);
+        cfg.kernel = integrate_bestKernel();
+    }
+
+    if (cfg.fastMath && !checkFastMath()) {
+        printf("fastmath error bound exceeded!\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%d x %d steps (+%d warmup), kernel %s, dt %.4f, seed %llu\n", cfg.repeats,
+        cfg.steps, cfg.warmup, g_kernelNames[cfg.kernel], data->physics.fixedDt, (unsigned long long)cfg.seed);
+    printf("%-8s %10s %8s %12s %14s %8s\n", "mode", "particles", "threads", "steps/s", "ns/particle", "cv");
+    benchresult_setInfo(&g_result, BS_CONFIG, "kernel", g_kernelNames[cfg.kernel]);
+
+    int failed = 0;
+    for (int m = 0; m < cfg.numModes; ++m) {
+        for (int c = 0; c < cfg.numCounts; ++c) {
+            failed += runBenchmark(&cfg, cfg.counts[c], cfg.modes[m]);
+        }
+    }
+
+    if (cfg.output && !benchresult_write(&g_result, cfg.output)) {
+        ++failed;
+    }
+    if (g_hasBaselineResult) {
+        printf("\n");
+        failed += benchresult_compare(&g_baselineResult, &g_result, cfg.tolerance);
+        benchresult_free(&g_baselineResult);
+    }
+    benchresult_free(&g_result);
+
+    if (failed > 0) {
+        fprintf(stderr, "%d checks failed\n", failed);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file mathbench.c
+ * @brief Benchmarks of the basis, movement and fastmath kernels
+ *
+ * Every kernel cycles through MICROBENCH_INPUTS prepared inputs, so one
+ * batch does not evaluate the same point over and over. The fastmath
+ * approximations are timed next to the libm and cglm functions they
+ * replace, their accuracy is checked by bench.c.
+ *
+ * Usage: cg2_ueb04_mathbench [-s samples] [-w warmup] [-f filter]
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include <fhwcg/fhwcg.h>
+#include "utils.h"
+#include "fastmath.h"
+#include "microbench.h"
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Inputs of all kernels.
+ */
+typedef struct {
+    vec3 velocity[MICROBENCH_INPUTS];
+    vec3 acceleration[MICROBENCH_INPUTS];
+    vec3 vectors[MICROBENCH_INPUTS];
+    float exponents[MICROBENCH_INPUTS];
+    float positives[MICROBENCH_INPUTS];
+} MathInput;
+
+/**
+ * Updates a particle basis, the up vector carries over as in the physics.
+ * @param ctx MathInput.
+ * @param iterations Updates.
+ */
+static void benchUpdateBasis(void *ctx, int iterations) {
+    MathInput *in = ctx;
+    vec3 forward, up = {0.0f, 1.0f, 0.0f}, right;
+    for (int i = 0; i < iterations; ++i) {
+        int k = i & (MICROBENCH_INPUTS - 1);
+        utils_updateBasis(in->velocity[k], in->acceleration[k], forward, up, right);
+    }
+    microbench_consume(forward[0] + up[1] + right[2]);
+}
+
+/**
+ * Moves a point towards the prepared targets.
+ * @param ctx MathInput.
+ * @param iterations Moves.
+ */
+static void benchMoveTowards(void *ctx, int iterations) {
+    MathInput *in = ctx;
+    vec3 curr = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < iterations; ++i) {
+        utils_moveTowards(curr, in->vectors[i & (MICROBENCH_INPUTS - 1)], 0.5f);
+    }
+    microbench_consume(curr[0] + curr[1] + curr[2]);
+}
+
+/**
+ * Computes exp with fastmath_exp.
+ * @param ctx MathInput.
+ * @param iterations Evaluations.
+ */
+static void benchFastExp(void *ctx, int iterations) {
+    MathInput *in = ctx;
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        sum += fastmath_exp(in->exponents[i & (MICROBENCH_INPUTS - 1)]);
+    }
+    microbench_consume(sum);
+}
+
+/**
+ * Computes exp with expf.
+ * @param ctx MathInput.
+ * @param iterations Evaluations.
+ */
+static void benchExpf(void *ctx, int iterations) {
+    MathInput *in = ctx;
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        sum += expf(in->exponents[i & (MICROBENCH_INPUTS - 1)]);
+    }
+    microbench_consume(sum);
+}
+
+/**
+ * Computes 1 / sqrt with fastmath_rsqrt.
+ * @param ctx MathInput.
+ * @param iterations Evaluations.
+ */
+static void benchFastRsqrt(void *ctx, int iterations) {
+    MathInput *in = ctx;
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        sum += fastmath_rsqrt(in->positives[i & (MICROBENCH_INPUTS - 1)]);
+    }
+    microbench_consume(sum);
+}
+
+/**
+ * Computes 1 / sqrt with sqrtf.
+ * @param ctx MathInput.
+ * @param iterations Evaluations.
+ */
+static void benchRsqrt(void *ctx, int iterations) {
+    MathInput *in = ctx;
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        sum += 1.0f / sqrtf(in->positives[i & (MICROBENCH_INPUTS - 1)]);
+    }
+    microbench_consume(sum);
+}
+
+/**
+ * Normalizes vectors with fastmath_vec3_normalize.
+ * @param ctx MathInput.
+ * @param iterations Normalizations.
+ */
+static void benchFastNormalize(void *ctx, int iterations) {
+    MathInput *in = ctx;
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        vec3 n;
+        fastmath_vec3_normalize(in->vectors[i & (MICROBENCH_INPUTS - 1)], n);
+        sum += n[0];
+    }
+    microbench_consume(sum);
+}
+
+/**
+ * Normalizes vectors with glm_vec3_normalize_to.
+ * @param ctx MathInput.
+ * @param iterations Normalizations.
+ */
+static void benchNormalize(void *ctx, int iterations) {
+    MathInput *in = ctx;
+    float sum = 0.0f;
+    for (int i = 0; i < iterations; ++i) {
+        vec3 n;
+        glm_vec3_normalize_to(in->vectors[i & (MICROBENCH_INPUTS - 1)], n);
+        sum += n[0];
+    }
+    microbench_consume(sum);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+int main(int argc, char **argv) {
+    MicroBenchConfig cfg;
+    if (!microbench_parseArgs(PROGRAM_NAME, argc, argv, &cfg)) {
+        return EXIT_FAILURE;
+    }
+
+    static MathInput in;
+    for (int i = 0; i < MICROBENCH_INPUTS; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            in.velocity[i][c] = microbench_random() * 2.0f - 1.0f;
+            in.acceleration[i][c] = microbench_random() * 2.0f - 1.0f;
+            in.vectors[i][c] = microbench_random() * 4.0f - 2.0f;
+        }
+        in.exponents[i] = microbench_random() * 20.0f - 10.0f;
+        in.positives[i] = microbench_random() * 100.0f + 1e-3f;
+    }
+
+    microbench_run(&cfg, "updateBasis", benchUpdateBasis, &in);
+    microbench_run(&cfg, "moveTowards", benchMoveTowards, &in);
+    microbench_run(&cfg, "fastmath_exp", benchFastExp, &in);
+    microbench_run(&cfg, "expf", benchExpf, &in);
+    microbench_run(&cfg, "fastmath_rsqrt", benchFastRsqrt, &in);
+    microbench_run(&cfg, "1 / sqrtf", benchRsqrt, &in);
+    microbench_run(&cfg, "fastmath_vec3_normalize", benchFastNormalize, &in);
+    microbench_run(&cfg, "glm_vec3_normalize_to", benchNormalize, &in);
+    return microbench_finish(&cfg);
+}
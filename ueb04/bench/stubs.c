@@ -0,0 +1,220 @@
+/**
+ * @file stubs.c
+ * @brief No-op replacements for the GL-bound modules used by the benchmark
+ *
+ * The physics module talks to the instancing layer, the compute integrator,
+ * the trail ring buffer, the translucent draw, the profiler, the GL state filter and the draw helpers. None of them can
+ * run without a GL context, so the benchmark links these stubs instead.
+ * Only the CPU backend is available, compute_step always reports failure.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "instanced.h"
+#include "compute.h"
+#include "trail.h"
+#include "translucent.h"
+#include "profiler.h"
+#include "model.h"
+#include "shader.h"
+#include "rendering.h"
+#include "glstate.h"
+#include "guicache.h"
+
+/** Sink for the instance columns so the upload cannot be optimized away */
+volatile float g_benchSink = 0.0f;
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void instanced_resize(int count) {
+    NK_UNUSED(count);
+}
+
+void instanced_update(int count, vec3* pos, vec3* acceleration, vec3* up, vec3* forward, int* swarm) {
+    NK_UNUSED(acceleration);
+    NK_UNUSED(up);
+    NK_UNUSED(forward);
+    NK_UNUSED(swarm);
+    if (count > 0) {
+        g_benchSink += pos[count - 1][0];
+    }
+}
+
+bool instanced_beginCull(int leaderIdx, float radius, int lodCount) {
+    NK_UNUSED(leaderIdx);
+    NK_UNUSED(radius);
+    NK_UNUSED(lodCount);
+    return false;
+}
+
+bool instanced_buildRotations(void) {
+    return false;
+}
+
+void instanced_endCull(void) {}
+
+void trail_init(void) {}
+
+void trail_cleanup(void) {}
+
+void trail_reset(void) {}
+
+void trail_record(int count, int length) {
+    NK_UNUSED(count);
+    NK_UNUSED(length);
+}
+
+bool trail_draw(int leaderIdx) {
+    NK_UNUSED(leaderIdx);
+    return false;
+}
+
+TranslucentOrder translucent_draw(ModelType model, vec3 scale, int leaderIdx, bool hardColor) {
+    NK_UNUSED(model);
+    NK_UNUSED(scale);
+    NK_UNUSED(leaderIdx);
+    NK_UNUSED(hardColor);
+    return TO_NONE;
+}
+
+void compute_init(void) {}
+
+void compute_cleanup(void) {}
+
+void compute_upload(int count, vec3 *pos, vec3 *velocity, vec3 *right, float *kWeak, float *kV) {
+    NK_UNUSED(count);
+    NK_UNUSED(pos);
+    NK_UNUSED(velocity);
+    NK_UNUSED(right);
+    NK_UNUSED(kWeak);
+    NK_UNUSED(kV);
+}
+
+void compute_download(int count, vec3 *pos, vec3 *acceleration, vec3 *up, vec3 *forward,
+                      vec3 *velocity, vec3 *right) {
+    NK_UNUSED(count);
+    NK_UNUSED(pos);
+    NK_UNUSED(acceleration);
+    NK_UNUSED(up);
+    NK_UNUSED(forward);
+    NK_UNUSED(velocity);
+    NK_UNUSED(right);
+}
+
+bool compute_readParticle(int idx, vec3 pos, vec3 up, vec3 forward) {
+    NK_UNUSED(idx);
+    NK_UNUSED(pos);
+    NK_UNUSED(up);
+    NK_UNUSED(forward);
+    return false;
+}
+
+bool compute_step(InputData *data, vec3 *spheres, int numSpheres, vec3 manualCenter, const SdfVolume *sdf) {
+    NK_UNUSED(data);
+    NK_UNUSED(spheres);
+    NK_UNUSED(numSpheres);
+    NK_UNUSED(manualCenter);
+    NK_UNUSED(sdf);
+    return false;
+}
+
+bool compute_readSwarmStats(SwarmSummary *dest) {
+    NK_UNUSED(dest);
+    return false;
+}
+
+void compute_finishSteps(int count, float alpha) {
+    NK_UNUSED(count);
+    NK_UNUSED(alpha);
+}
+
+void (profiler_pushScope)(const char *name) {
+    NK_UNUSED(name);
+}
+
+void (profiler_pushCountedScope)(const char *name) {
+    NK_UNUSED(name);
+}
+
+void (profiler_popScope)(void) {}
+
+void glstate_setEnabled(GLenum cap, bool enabled) {
+    NK_UNUSED(cap);
+    NK_UNUSED(enabled);
+}
+
+void model_drawSimple(ModelType model) {
+    NK_UNUSED(model);
+}
+
+void model_drawInstanced(ModelType model, int lod) {
+    NK_UNUSED(model);
+    NK_UNUSED(lod);
+}
+
+void model_drawImpostors(int lod) {
+    NK_UNUSED(lod);
+}
+
+bool model_drawWithShadow(ModelType model, int lod) {
+    NK_UNUSED(model);
+    NK_UNUSED(lod);
+    return false;
+}
+
+void model_drawParticleVis(bool lines, int lod) {
+    NK_UNUSED(lines);
+    NK_UNUSED(lod);
+}
+
+void model_draw(ModelType model, bool instanced, int lod) {
+    NK_UNUSED(model);
+    NK_UNUSED(instanced);
+    NK_UNUSED(lod);
+}
+
+void shader_load(void) {}
+
+void shader_setColor(vec3 color) {
+    NK_UNUSED(color);
+}
+
+void shader_setSimpleInstanceData(vec3 scale, int leaderIdx, bool hardColor) {
+    NK_UNUSED(scale);
+    NK_UNUSED(leaderIdx);
+    NK_UNUSED(hardColor);
+}
+
+bool shader_setParticleVisData(vec3 scale, bool lines) {
+    NK_UNUSED(scale);
+    NK_UNUSED(lines);
+    return false;
+}
+
+bool shader_setParticleShadowData(vec3 scale, int leaderIdx, bool hardColor, float groundHeight) {
+    NK_UNUSED(scale);
+    NK_UNUSED(leaderIdx);
+    NK_UNUSED(hardColor);
+    NK_UNUSED(groundHeight);
+    return false;
+}
+
+bool shader_setParticleImpostorData(float radius, int leaderIdx) {
+    NK_UNUSED(radius);
+    NK_UNUSED(leaderIdx);
+    return false;
+}
+
+void shader_setDropShadowData(vec3 scale, int leaderIdx, bool drawInstanced, float groundHeight) {
+    NK_UNUSED(scale);
+    NK_UNUSED(leaderIdx);
+    NK_UNUSED(drawInstanced);
+    NK_UNUSED(groundHeight);
+}
+
+void rendering_resize(int width, int height) {
+    NK_UNUSED(width);
+    NK_UNUSED(height);
+}
+
+void guicache_onInput(void) {}
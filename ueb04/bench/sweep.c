@@ -0,0 +1,500 @@
+/**
+ * @file sweep.c
+ * @brief Headless parameter sweep of the particle simulation
+ *
+ * Runs the CPU particle update for every combination of a parameter grid
+ * and writes one row per combination: the grid values, the cohesion of
+ * the swarms, the wall-hit rate and the time per step. Cohesion is the mean
+ * distance of a particle to the center of its swarm relative to the room
+ * size, the wall-hit rate the mean share of particles inside the wall
+ * margin per step, both averaged over the measured steps.
+ *
+ * physics.c keeps its state in file-static globals, so every combination
+ * runs in a process of its own: up to jobs forked processes at a time,
+ * each with a single simulation thread, report their row through shared
+ * memory. Without fork, on Windows, the combinations run one after another.
+ *
+ * Usage: cg2_ueb04_sweep -g name=v1,v2,... [-g ...] [-s steps] [-w warmup] [-c count]
+ *                        [-m mode] [-n swarms] [-j jobs] [-r seed] [-o output]
+ *   name    gaussianConst, leaderKv, roomForce, fixedDt, kvMin, kvMax, kWeakMin or kWeakMax,
+ *           the kV and kWeak ranges are set for every swarm
+ *   mode    spheres, center, leader, box or flock
+ *   jobs    simulations run at once, the hardware threads by default
+ *   output  tab separated results table, sweep.tsv by default
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include <fhwcg/fhwcg.h>
+#include "input.h"
+#include "physics.h"
+#include "jobs.h"
+#include "rng.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <time.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/wait.h>
+    #define SWEEP_FORK
+#endif
+
+#define DEFAULT_STEPS 1000
+#define DEFAULT_WARMUP 100
+#define DEFAULT_COUNT 2000
+#define DEFAULT_SEED 42
+#define DEFAULT_OUTPUT "sweep.tsv"
+
+/** Values per swept parameter */
+#define MAX_VALUES 16
+
+/** Largest grid, the product of all value counts */
+#define MAX_COMBINATIONS 4096
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Parameters that can be swept.
+ */
+typedef enum {
+    SP_GAUSSIAN_CONST,
+    SP_LEADER_KV,
+    SP_ROOM_FORCE,
+    SP_FIXED_DT,
+    SP_KV_MIN,
+    SP_KV_MAX,
+    SP_KWEAK_MIN,
+    SP_KWEAK_MAX,
+    SP_COUNT
+} SweepParam;
+
+/** Names accepted for -g, indexed by SweepParam */
+static const char *g_paramNames[] = {
+    "gaussianConst", "leaderKv", "roomForce", "fixedDt", "kvMin", "kvMax", "kWeakMin", "kWeakMax"
+};
+
+/** Names accepted for -m, indexed by TargetMode */
+static const char *g_modeNames[] = {"spheres", "center", "leader", "box", "flock"};
+
+/**
+ * Values of one swept parameter.
+ */
+typedef struct {
+    SweepParam param;
+    float values[MAX_VALUES];
+    int numValues;
+} SweepAxis;
+
+/**
+ * Sweep configuration parsed from the command line.
+ */
+typedef struct {
+    int steps;
+    int warmup;
+    int count;
+    TargetMode mode;
+    int swarms;
+    int jobs;
+    uint64_t seed;
+    const char *output;
+    SweepAxis axes[SP_COUNT];
+    int numAxes;
+} SweepConfig;
+
+/**
+ * Result of one combination.
+ */
+typedef struct {
+    bool done;
+    float cohesion;
+    float wallHitRate;
+    int invalid;
+    double msPerStep;
+} SweepResult;
+
+/**
+ * Returns a monotonic timestamp.
+ * @return Time in seconds.
+ */
+static double now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/**
+ * Looks up a name in a table.
+ * @param name Name to look up.
+ * @param names Table of accepted names.
+ * @param count Number of entries in the table.
+ * @return Index of the name or -1 if unknown.
+ */
+static int findName(const char *name, const char **names, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Parses one "name=v1,v2,..." grid axis.
+ * @param arg Argument string (modified).
+ * @param cfg Configuration to add the axis to.
+ * @return False if the name is unknown, repeated or a value is invalid.
+ */
+static bool parseAxis(char *arg, SweepConfig *cfg) {
+    char *values = strchr(arg, '=');
+    if (!values) {
+        printf("Expected name=values, got '%s'!\n", arg);
+        return false;
+    }
+    *values++ = '\0';
+
+    int param = findName(arg, g_paramNames, NK_LEN(g_paramNames));
+    if (param < 0) {
+        printf("Unknown parameter '%s'!\n", arg);
+        return false;
+    }
+    for (int a = 0; a < cfg->numAxes; ++a) {
+        if (cfg->axes[a].param == (SweepParam)param) {
+            printf("Parameter '%s' given twice!\n", arg);
+            return false;
+        }
+    }
+
+    SweepAxis *axis = &cfg->axes[cfg->numAxes];
+    axis->param = (SweepParam)param;
+    axis->numValues = 0;
+    for (char *tok = strtok(values, ","); tok && axis->numValues < MAX_VALUES; tok = strtok(NULL, ",")) {
+        char *end;
+        float value = strtof(tok, &end);
+        if (end == tok || *end != '\0' || !isfinite(value)) {
+            printf("Invalid value '%s' for %s!\n", tok, g_paramNames[param]);
+            return false;
+        }
+        axis->values[axis->numValues++] = value;
+    }
+    if (axis->numValues == 0) {
+        return false;
+    }
+    ++cfg->numAxes;
+    return true;
+}
+
+/**
+ * Prints the usage string.
+ */
+static void printUsage(void) {
+    printf("Usage: " PROGRAM_NAME " -g name=v1,v2,... [-g ...] [-s steps] [-w warmup] [-c count] [-m mode] [-n swarms] [-j jobs] [-r seed] [-o output]\n");
+    printf("  name    gaussianConst, leaderKv, roomForce, fixedDt, kvMin, kvMax, kWeakMin or kWeakMax\n");
+    printf("  mode    spheres, center, leader, box or flock\n");
+    printf("  swarms  1 to %d swarms sharing the particles\n", MAX_SWARMS);
+    printf("  jobs    simulations run at once, hardware threads by default\n");
+    printf("  output  tab separated results table, default " DEFAULT_OUTPUT "\n");
+}
+
+/**
+ * Parses the command line into a configuration.
+ * @param argc Argument count.
+ * @param argv Argument values.
+ * @param cfg Configuration to fill, prefilled with defaults.
+ * @return False if the arguments are invalid.
+ */
+static bool parseArgs(int argc, char **argv, SweepConfig *cfg) {
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0' || i + 1 >= argc) {
+            return false;
+        }
+
+        char *arg = argv[++i];
+        switch (opt[1]) {
+            case 's': cfg->steps = atoi(arg); break;
+            case 'w': cfg->warmup = atoi(arg); break;
+            case 'c': cfg->count = atoi(arg); break;
+            case 'n': cfg->swarms = atoi(arg); break;
+            case 'j': cfg->jobs = atoi(arg); break;
+            case 'r': cfg->seed = strtoull(arg, NULL, 10); break;
+            case 'o': cfg->output = arg; break;
+            case 'g':
+                if (cfg->numAxes >= SP_COUNT || !parseAxis(arg, cfg)) return false;
+                break;
+            case 'm': {
+                int mode = findName(arg, g_modeNames, NK_LEN(g_modeNames));
+                if (mode < 0) {
+                    printf("Unknown target mode '%s'!\n", arg);
+                    return false;
+                }
+                cfg->mode = (TargetMode)mode;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return cfg->numAxes > 0 && cfg->steps > 0 && cfg->warmup >= 0 && cfg->count > 0
+        && cfg->swarms >= 1 && cfg->swarms <= MAX_SWARMS && cfg->jobs >= 1;
+}
+
+/**
+ * Counts the combinations of the grid.
+ * @param cfg Sweep configuration.
+ * @return Product of the value counts, 0 if the grid is too large.
+ */
+static int countCombinations(const SweepConfig *cfg) {
+    int combinations = 1;
+    for (int a = 0; a < cfg->numAxes; ++a) {
+        combinations *= cfg->axes[a].numValues;
+        if (combinations > MAX_COMBINATIONS) {
+            return 0;
+        }
+    }
+    return combinations;
+}
+
+/**
+ * Returns the value of an axis in a combination, the first axis varies slowest.
+ * @param cfg Sweep configuration.
+ * @param combination Index of the combination.
+ * @param axis Index of the axis.
+ * @return The value.
+ */
+static float axisValue(const SweepConfig *cfg, int combination, int axis) {
+    for (int a = cfg->numAxes - 1; a > axis; --a) {
+        combination /= cfg->axes[a].numValues;
+    }
+    return cfg->axes[axis].values[combination % cfg->axes[axis].numValues];
+}
+
+/**
+ * Writes a parameter into the input state.
+ * @param data Input state.
+ * @param param Parameter.
+ * @param value New value.
+ */
+static void setParam(InputData *data, SweepParam param, float value) {
+    for (int s = 0; s < MAX_SWARMS; ++s) {
+        SwarmSettings *swarm = &data->particles.swarms[s];
+        switch (param) {
+            case SP_KV_MIN: swarm->kvMin = value; break;
+            case SP_KV_MAX: swarm->kvMax = value; break;
+            case SP_KWEAK_MIN: swarm->kWeakMin = value; break;
+            case SP_KWEAK_MAX: swarm->kWeakMax = value; break;
+            default: break;
+        }
+    }
+
+    switch (param) {
+        case SP_GAUSSIAN_CONST: data->particles.gaussianConst = value; break;
+        case SP_LEADER_KV: data->particles.leaderKv = value; break;
+        case SP_ROOM_FORCE: data->physics.roomForce = value; break;
+        case SP_FIXED_DT: data->physics.fixedDt = value; break;
+        default: break;
+    }
+}
+
+/**
+ * Runs exactly one fixed physics step.
+ * @param data Input state.
+ */
+static void runStep(InputData *data) {
+    data->deltaTime = 0.0f;
+    data->physics.dtAccumulator = data->physics.fixedDt;
+    physics_update();
+}
+
+/**
+ * Simulates one combination on a fresh simulation.
+ * @param cfg Sweep configuration.
+ * @param combination Index of the combination.
+ * @param result Measured result.
+ */
+static void runCombination(const SweepConfig *cfg, int combination, SweepResult *result) {
+    input_initDefaults();
+    InputData *data = getInputData();
+    rng_setSeed(cfg->seed);
+
+    // The remainder of the split goes to swarm 0
+    data->particles.swarmCount = cfg->swarms;
+    for (int s = 0; s < cfg->swarms; ++s) {
+        data->particles.swarms[s].count = cfg->count / cfg->swarms + (s == 0 ? cfg->count % cfg->swarms : 0);
+        data->particles.swarms[s].targetMode = cfg->mode;
+    }
+    data->physics.threadCount = 1;
+    for (int a = 0; a < cfg->numAxes; ++a) {
+        setParam(data, cfg->axes[a].param, axisValue(cfg, combination, a));
+    }
+    physics_init();
+
+    for (int i = 0; i < cfg->warmup; ++i) {
+        runStep(data);
+    }
+
+    double cohesion = 0.0, wallFraction = 0.0, elapsed = 0.0;
+    for (int i = 0; i < cfg->steps; ++i) {
+        double start = now();
+        runStep(data);
+        elapsed += now() - start;
+
+        PhysicsMetrics metrics;
+        physics_measure(&metrics);
+        cohesion += metrics.cohesion;
+        wallFraction += metrics.wallFraction;
+    }
+
+    result->cohesion = (float)(cohesion / cfg->steps);
+    result->wallHitRate = (float)(wallFraction / cfg->steps);
+    result->invalid = physics_countInvalidParticles();
+    result->msPerStep = elapsed * 1e3 / cfg->steps;
+    result->done = true;
+
+    physics_cleanup();
+}
+
+/**
+ * Runs all combinations, up to cfg->jobs at once.
+ * @param cfg Sweep configuration.
+ * @param results One result per combination, shared with the processes.
+ * @param combinations Number of combinations.
+ */
+static void runAll(const SweepConfig *cfg, SweepResult *results, int combinations) {
+#ifdef SWEEP_FORK
+    int running = 0;
+    for (int c = 0; c < combinations; ++c) {
+        if (running == cfg->jobs) {
+            wait(NULL);
+            --running;
+        }
+
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            runCombination(cfg, c, &results[c]);
+            _exit(EXIT_SUCCESS);
+        }
+        if (pid < 0) {
+            // Out of processes, run it here
+            runCombination(cfg, c, &results[c]);
+            continue;
+        }
+        ++running;
+    }
+    while (running-- > 0) {
+        wait(NULL);
+    }
+#else
+    for (int c = 0; c < combinations; ++c) {
+        runCombination(cfg, c, &results[c]);
+    }
+#endif
+}
+
+/**
+ * Writes the results as a tab separated table.
+ * @param cfg Sweep configuration.
+ * @param results One result per combination.
+ * @param combinations Number of combinations.
+ * @param file Destination.
+ */
+static void writeTable(const SweepConfig *cfg, const SweepResult *results, int combinations, FILE *file) {
+    for (int a = 0; a < cfg->numAxes; ++a) {
+        fprintf(file, "%s\t", g_paramNames[cfg->axes[a].param]);
+    }
+    fprintf(file, "cohesion\twallHitRate\tinvalid\tmsPerStep\n");
+
+    for (int c = 0; c < combinations; ++c) {
+        for (int a = 0; a < cfg->numAxes; ++a) {
+            fprintf(file, "%g\t", axisValue(cfg, c, a));
+        }
+        const SweepResult *r = &results[c];
+        if (r->done) {
+            fprintf(file, "%.4f\t%.4f\t%d\t%.3f\n", r->cohesion, r->wallHitRate, r->invalid, r->msPerStep);
+        } else {
+            fprintf(file, "failed\tfailed\tfailed\tfailed\n");
+        }
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+int main(int argc, char **argv) {
+    SweepConfig cfg = {
+        .steps = DEFAULT_STEPS,
+        .warmup = DEFAULT_WARMUP,
+        .count = DEFAULT_COUNT,
+        .mode = TM_SPHERES,
+        .swarms = 1,
+        .jobs = jobs_getHardwareThreads(),
+        .seed = DEFAULT_SEED,
+        .output = DEFAULT_OUTPUT,
+        .numAxes = 0
+    };
+
+    if (!parseArgs(argc, argv, &cfg)) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    int combinations = countCombinations(&cfg);
+    if (combinations == 0) {
+        printf("More than %d combinations!\n", MAX_COMBINATIONS);
+        return EXIT_FAILURE;
+    }
+
+    size_t bytes = combinations * sizeof(SweepResult);
+#ifdef SWEEP_FORK
+    SweepResult *results = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        printf("Failed to map the results!\n");
+        return EXIT_FAILURE;
+    }
+#else
+    SweepResult *results = calloc(1, bytes);
+    assert(results && "calloc failed in main");
+#endif
+
+    printf("%d combinations, %d particles %s, %d steps (+%d warmup), %d jobs\n",
+        combinations, cfg.count, g_modeNames[cfg.mode], cfg.steps, cfg.warmup, cfg.jobs);
+    double start = now();
+    runAll(&cfg, results, combinations);
+    printf("Finished in %.1f s\n", now() - start);
+
+    writeTable(&cfg, results, combinations, stdout);
+    FILE *file = fopen(cfg.output, "w");
+    if (file) {
+        writeTable(&cfg, results, combinations, file);
+        fclose(file);
+        printf("Results written to %s\n", cfg.output);
+    } else {
+        printf("Failed to open '%s'!\n", cfg.output);
+    }
+
+    int failed = 0;
+    for (int c = 0; c < combinations; ++c) {
+        failed += !results[c].done;
+    }
+
+#ifdef SWEEP_FORK
+    munmap(results, bytes);
+#else
+    free(results);
+#endif
+
+    if (failed > 0) {
+        fprintf(stderr, "%d combinations failed\n", failed);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
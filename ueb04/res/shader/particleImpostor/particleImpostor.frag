@@ -0,0 +1,37 @@
+#version 430 core
+
+out vec4 fragColor;
+
+uniform mat4 u_projMatrix;
+uniform mat4 u_invProjMatrix;
+uniform vec4 u_viewport;
+uniform float u_radius;
+
+flat in int isLeader;
+flat in vec3 vCenter;
+flat in vec3 vColor;
+
+const float ambient = 0.3;
+
+void main() {
+    // View ray through this fragment, the camera is at the origin
+    vec2 ndc = (gl_FragCoord.xy - u_viewport.xy) / u_viewport.zw * 2.0 - 1.0;
+    vec4 near = u_invProjMatrix * vec4(ndc, -1.0, 1.0);
+    vec3 dir = normalize(near.xyz / near.w);
+
+    float b = dot(dir, vCenter);
+    float disc = b * b - dot(vCenter, vCenter) + u_radius * u_radius;
+    if (disc < 0.0) {
+        discard;
+    }
+
+    vec3 hit = dir * (b - sqrt(disc));
+    vec3 normal = (hit - vCenter) / u_radius;
+
+    vec4 clip = u_projMatrix * vec4(hit, 1.0);
+    gl_FragDepth = (gl_DepthRange.diff * (clip.z / clip.w) + gl_DepthRange.near + gl_DepthRange.far) * 0.5;
+
+    vec3 color = (isLeader == 0) ? vec3(1.0, 0.0, 0.0) : vColor;
+    float diffuse = max(dot(normal, -dir), 0.0);
+    fragColor = vec4(color * (ambient + (1.0 - ambient) * diffuse), 1.0);
+}
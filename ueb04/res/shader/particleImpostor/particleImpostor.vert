@@ -0,0 +1,35 @@
+#version 430 core
+
+/**
+ * One point sprite per particle, sized to cover the projected sphere.
+ * particleImpostor.frag ray-casts the sphere inside of it.
+ */
+
+#include "../pull.glsl"
+
+uniform mat4 u_mvMatrix;
+uniform mat4 u_projMatrix;
+uniform float u_radius;
+uniform float u_viewportHeight;
+uniform int u_leaderIdx;
+
+flat out int isLeader;
+flat out vec3 vCenter;
+flat out vec3 vColor;
+
+// Covers the perspective stretch of spheres away from the view axis
+const float spriteMargin = 1.15;
+
+void main() {
+    vec4 center = u_mvMatrix * vec4(vertexPosition() + instanceOffset(), 1.0);
+    vCenter = center.xyz;
+    isLeader = ((u_leaderIdx != -1) && (gl_InstanceID == u_leaderIdx)) ? 0 : 1;
+    vColor = u_swarmColors[instanceSwarm()];
+
+    // Projected radius of the sphere from its nearest point
+    float dist = max(-center.z - u_radius, 1e-3);
+    float pixelRadius = u_radius * u_projMatrix[1][1] * 0.5 * u_viewportHeight / dist;
+    gl_PointSize = 2.0 * pixelRadius * spriteMargin;
+
+    gl_Position = u_projMatrix * center;
+}
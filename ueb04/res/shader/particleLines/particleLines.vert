@@ -0,0 +1,34 @@
+#version 430 core
+
+/**
+ * Particle vector visualization without a geometry stage.
+ * Drawn as a static 4 vertex GL_LINES mesh instanced per particle.
+ * gl_VertexID picks the line (0-1 acceleration, 2-3 up) and its end,
+ * the mesh starts at a multiple of 4 in the mesh pool.
+ */
+
+#include "../pull.glsl"
+
+#define ACCELERATION_SCALE 0.2
+
+uniform mat4 u_mvpMatrix;
+
+out vec3 vColor;
+
+void main() {
+    vec3 upVec = instanceUp();
+    vec3 fwd = instanceForward();
+    unpackBasis(upVec, fwd);
+
+    // Origin of the particle and its orthonormalized up vector
+    vec3 worldPos = vec3(0.0);
+    transform(worldPos, fwd, upVec, vec3(1.0), instanceOffset());
+
+    bool isUp = (gl_VertexID & 2) != 0;
+    float end = float(gl_VertexID & 1);
+
+    vec3 dir = isUp ? upVec : instanceAcceleration() * ACCELERATION_SCALE;
+    vColor = isUp ? vec3(0, 0, 1) : vec3(1, 0, 0);
+
+    gl_Position = u_mvpMatrix * vec4(worldPos + dir * end, 1.0);
+}
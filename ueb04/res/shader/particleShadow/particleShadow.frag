@@ -0,0 +1,30 @@
+#version 430 core
+
+out vec4 fragColor;
+
+uniform bool u_hardColor;
+
+in vec3 vBary;
+flat in int isLeader;
+flat in int isShadow;
+flat in vec3 vBaseColor;
+in vec3 vColor;
+
+const vec3 shadowColor = vec3(0.9, 0.9, 0.9);
+
+void main() {
+    vec3 color;
+
+    if (isLeader == 0) {
+        color = vec3(1.0, 0.0, 0.0);
+    } else if (isShadow == 1) {
+        color = shadowColor;
+    } else if (u_hardColor) {
+        float t = smoothstep(-0.2, 0.2, vBary.x - vBary.y);
+        color = mix(vBaseColor, vec3(1.0) - vBaseColor, t);
+    } else {
+        color = vColor;
+    }
+
+    fragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,43 @@
+#version 430 core
+
+/**
+ * Draws a particle and its drop shadow in one instanced draw.
+ * The mesh holds its vertices twice, every vertex from
+ * u_shadowVertexStart on belongs to the projected shadow copy.
+ * Like gl_VertexID, it includes the base vertex of the mesh.
+ */
+
+#include "../pull.glsl"
+
+uniform mat4 u_mvpMatrix;
+uniform vec3 u_localScale;
+uniform int u_leaderIdx;
+uniform float u_groundHeight;
+uniform int u_shadowVertexStart;
+
+flat out int isLeader;
+flat out int isShadow;
+flat out vec3 vBaseColor;
+out vec3 vColor;
+out vec3 vBary;
+
+const float shadowOffset = 0.01f;
+
+void main() {
+    vec3 worldPos = vertexPosition();
+
+    transformInstance(worldPos, instanceRotation(), instanceForward(), instanceUp(), u_localScale, instanceOffset());
+    isLeader = ((u_leaderIdx != -1) && (gl_InstanceID == u_leaderIdx)) ? 0 : 1;
+    isShadow = (gl_VertexID >= u_shadowVertexStart) ? 1 : 0;
+
+    if (isShadow == 1) {
+        worldPos.y = u_groundHeight + shadowOffset;
+    }
+
+    gl_Position = u_mvpMatrix * vec4(worldPos, 1.0);
+
+    int id = gl_VertexID % 3;
+    vBary = vec3(id == 1 ? 1 : 0, id == 2 ? 1 : 0, id == 0 ? 1 : 0);
+    vBaseColor = u_swarmColors[instanceSwarm()];
+    vColor = (id == 0) ? vBaseColor : vec3(1.0) - vBaseColor;
+}
@@ -0,0 +1,36 @@
+#version 430 core
+
+/**
+ * Motion trails from the ring buffer of trail.c, no vertex attributes.
+ * One line strip per particle (gl_InstanceID), gl_VertexID is the age
+ * of the position, 0 being the newest one.
+ */
+
+#include "../utils.glsl"
+
+#define LOAD3(arr, i) vec3(arr[3 * (i)], arr[3 * (i) + 1], arr[3 * (i) + 2])
+
+// Slot-major ring, u_length slots of u_count positions
+layout(std430, binding = 0) readonly buffer TrailBuf { float trail[]; };
+layout(std430, binding = 1) readonly buffer SwarmBuf { int swarmIds[]; };
+
+uniform mat4 u_mvpMatrix;
+uniform int u_head;
+uniform int u_length;
+uniform int u_count;
+uniform int u_base;
+uniform int u_leaderIdx;
+
+out vec4 vColor;
+
+void main() {
+    int slot = (u_head - gl_VertexID + u_length) % u_length;
+    vec3 pos = LOAD3(trail, slot * u_count + gl_InstanceID);
+
+    bool isLeader = gl_InstanceID == u_leaderIdx;
+    vec3 color = isLeader ? vec3(1.0, 0.0, 0.0) : u_swarmColors[swarmIds[u_base + gl_InstanceID]];
+    float fade = 1.0 - float(gl_VertexID) / float(u_length - 1);
+    vColor = vec4(color, fade);
+
+    gl_Position = u_mvpMatrix * vec4(pos, 1.0);
+}
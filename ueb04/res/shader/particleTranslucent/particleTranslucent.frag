@@ -0,0 +1,54 @@
+#version 430 core
+
+uniform bool u_hardColor;
+uniform float u_alpha;
+
+in vec3 vBary;
+flat in int isLeader;
+flat in vec3 vBaseColor;
+in vec3 vColor;
+in float vDepth;
+
+#ifdef DRAW_OIT
+layout(location = 0) out vec4 fragAccum;
+layout(location = 1) out float fragRevealage;
+#else
+out vec4 fragColor;
+#endif
+
+/**
+ * Weight of a translucent fragment, favors near fragments
+ * (McGuire and Bavoil, equation 7).
+ * @param depth     view depth of the fragment
+ * @param alpha     coverage of the fragment
+ *
+ * @returns the weight of the fragment
+ */
+float oitWeight(float depth, float alpha) {
+    float w = 10.0 / (1e-5 + pow(depth / 5.0, 2.0) + pow(depth / 200.0, 6.0));
+    return alpha * clamp(w, 1e-2, 3e3);
+}
+
+void main() {
+    vec3 color;
+
+    if (u_hardColor) {
+        float t = smoothstep(-0.2, 0.2, vBary.x - vBary.y);
+        color = mix(vBaseColor, vec3(1.0) - vBaseColor, t);
+    } else {
+        color = vColor;
+    }
+
+    if (isLeader == 0) {
+        color = vec3(1.0, 0.0, 0.0);
+    }
+
+    // Premultiplied, blended with GL_ONE, GL_ONE_MINUS_SRC_ALPHA
+    vec4 premultiplied = vec4(color * u_alpha, u_alpha);
+#ifdef DRAW_OIT
+    fragAccum = premultiplied * oitWeight(vDepth, u_alpha);
+    fragRevealage = u_alpha;
+#else
+    fragColor = premultiplied;
+#endif
+}
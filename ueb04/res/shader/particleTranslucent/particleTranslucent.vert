@@ -0,0 +1,36 @@
+#version 430 core
+
+// The sorted draw reads its instances back to front from the order buffer,
+// the weighted blended one needs no order
+#ifndef DRAW_OIT
+#define PULL_ORDERED
+#endif
+
+#include "../pull.glsl"
+
+uniform mat4 u_mvpMatrix;
+uniform vec3 u_localScale;
+uniform int u_leaderIdx;
+
+flat out int isLeader;
+flat out vec3 vBaseColor;
+out vec3 vColor;
+out vec3 vBary;
+out float vDepth;
+
+void main() {
+    vec3 worldPos = vertexPosition();
+
+    vBaseColor = u_swarmColors[instanceSwarm()];
+    transformInstance(worldPos, instanceRotation(), instanceForward(), instanceUp(), u_localScale, instanceOffset());
+    isLeader = ((u_leaderIdx != -1) && (pullInstance() == u_leaderIdx)) ? 0 : 1;
+
+    gl_Position = u_mvpMatrix * vec4(worldPos, 1.0);
+
+    // View depth of a perspective projection
+    vDepth = gl_Position.w;
+
+    int id = gl_VertexID % 3;
+    vBary = vec3(id == 1 ? 1 : 0, id == 2 ? 1 : 0, id == 0 ? 1 : 0);
+    vColor = (id == 0) ? vBaseColor : vec3(1.0) - vBaseColor;
+}
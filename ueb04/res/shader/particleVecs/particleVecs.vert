@@ -1,14 +1,6 @@
 #version 430 core
 
-#include "../utils.glsl"
-
-layout(location = 0) in vec3 pos;
-
-// Instance
-layout(location = 4) in vec3 offset;
-layout(location = 5) in vec3 acceleration;
-layout(location = 6) in vec3 up;
-layout(location = 7) in vec3 forward;
+#include "../pull.glsl"
 
 uniform mat4 u_mvpMatrix;
 uniform vec3 u_localScale;
@@ -20,12 +12,14 @@ out VS_OUT {
 } vs_out;
 
 void main() {
-    vec3 upVec = up;
-    vec3 worldPos = pos;
-    transform(worldPos, forward, upVec, u_localScale, offset);
+    vec3 upVec = instanceUp();
+    vec3 fwd = instanceForward();
+    unpackBasis(upVec, fwd);
+    vec3 worldPos = vertexPosition();
+    transform(worldPos, fwd, upVec, u_localScale, instanceOffset());
     
     vs_out.worldPos = worldPos;
-    vs_out.acceleration = acceleration;
+    vs_out.acceleration = instanceAcceleration();
     vs_out.up = upVec;
 
     gl_Position = u_mvpMatrix * vec4(vs_out.worldPos, 1.0);
@@ -0,0 +1,102 @@
+ /**
+  * Programmable vertex pulling for the mesh pool of instanced.c.
+  * The draws bind one empty VAO, vertices and instance columns are read
+  * from storage buffers by gl_VertexID and gl_InstanceID. gl_VertexID
+  * includes the base vertex of the mesh, the instance columns are bound
+  * from the first drawn instance on.
+  *
+  * With PULL_ORDERED defined before the include, the draw reads its
+  * instances in the order of the order buffer instead of gl_InstanceID.
+  */
+
+#include "utils.glsl"
+
+ // Must match the PULL_* bindings of instanced.c
+ layout(std430, binding = 11) readonly buffer PullVertexBuf { float pullVertices[]; };
+ layout(std430, binding = 12) readonly buffer PullPosBuf { float pullPos[]; };
+ layout(std430, binding = 13) readonly buffer PullAccBuf { uint pullAcc[]; };
+ layout(std430, binding = 14) readonly buffer PullUpBuf { uint pullUp[]; };
+ layout(std430, binding = 15) readonly buffer PullForwardBuf { uint pullForward[]; };
+ layout(std430, binding = 16) readonly buffer PullSwarmBuf { int pullSwarm[]; };
+ layout(std430, binding = 17) readonly buffer PullRotationBuf { uint pullRotation[]; };
+
+ #ifdef PULL_ORDERED
+ layout(std430, binding = 18) readonly buffer PullOrderBuf { uint pullOrder[]; };
+
+ /**
+  * Instance drawn by this invocation, relative to the first drawn instance.
+  */
+ int pullInstance() {
+    return int(pullOrder[gl_InstanceID]);
+ }
+ #else
+ int pullInstance() {
+    return gl_InstanceID;
+ }
+ #endif
+
+ // Floats per CGVertex: position, normal, texCoords
+ #define PULL_VERTEX_FLOATS 8
+
+ vec3 vertexPosition() {
+    int b = gl_VertexID * PULL_VERTEX_FLOATS;
+    return vec3(pullVertices[b], pullVertices[b + 1], pullVertices[b + 2]);
+ }
+
+ vec3 vertexNormal() {
+    int b = gl_VertexID * PULL_VERTEX_FLOATS + 3;
+    return vec3(pullVertices[b], pullVertices[b + 1], pullVertices[b + 2]);
+ }
+
+ vec2 vertexTexCoords() {
+    int b = gl_VertexID * PULL_VERTEX_FLOATS + 6;
+    return vec2(pullVertices[b], pullVertices[b + 1]);
+ }
+
+ vec3 instanceOffset() {
+    int b = 3 * pullInstance();
+    return vec3(pullPos[b], pullPos[b + 1], pullPos[b + 2]);
+ }
+
+ /**
+  * Packed: 4 half floats, the last one unused.
+  */
+ vec3 instanceAcceleration() {
+    if (u_packedInstances) {
+        int b = 2 * pullInstance();
+        return vec3(unpackHalf2x16(pullAcc[b]), unpackHalf2x16(pullAcc[b + 1]).x);
+    }
+    int b = 3 * pullInstance();
+    return uintBitsToFloat(uvec3(pullAcc[b], pullAcc[b + 1], pullAcc[b + 2]));
+ }
+
+ /**
+  * Packed: octahedral snorm16 pair in xy, decoded by unpackBasis.
+  */
+ vec3 instanceUp() {
+    if (u_packedInstances) {
+        return vec3(unpackSnorm2x16(pullUp[pullInstance()]), 0.0);
+    }
+    int b = 3 * pullInstance();
+    return uintBitsToFloat(uvec3(pullUp[b], pullUp[b + 1], pullUp[b + 2]));
+ }
+
+ vec3 instanceForward() {
+    if (u_packedInstances) {
+        return vec3(unpackSnorm2x16(pullForward[pullInstance()]), 0.0);
+    }
+    int b = 3 * pullInstance();
+    return uintBitsToFloat(uvec3(pullForward[b], pullForward[b + 1], pullForward[b + 2]));
+ }
+
+ int instanceSwarm() {
+    return pullSwarm[pullInstance()];
+ }
+
+ /**
+  * Quaternion of particleBasis.comp, 4 x snorm16.
+  */
+ vec4 instanceRotation() {
+    int b = 2 * pullInstance();
+    return vec4(unpackSnorm2x16(pullRotation[b]), unpackSnorm2x16(pullRotation[b + 1]));
+ }
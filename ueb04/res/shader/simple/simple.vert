@@ -1,39 +1,31 @@
 #version 430 core
 
-#include "../utils.glsl"
-
-layout(location = 0) in vec3 pos;
-layout(location = 1) in vec3 normal;
-layout(location = 2) in vec3 texCoords;
-
-// Instance
-layout(location = 4) in vec3 offset;
-layout(location = 5) in vec3 acceleration;
-layout(location = 6) in vec3 up;
-layout(location = 7) in vec3 forward;
+#include "../pull.glsl"
 
 uniform mat4 u_mvpMatrix;
-uniform bool u_drawInstanced;
 uniform vec3 u_localScale;
 uniform int u_leaderIdx;
-uniform vec3 u_color;
+uniform vec3 u_color;   // non-instanced draws only
 
 flat out int isLeader;
+flat out vec3 vBaseColor;
 out vec3 vColor;
 out vec3 vBary;
 
 void main() {
-    vec3 worldPos = pos;
-    vec3 upVec = up;
+    vec3 worldPos = vertexPosition();
 
-    if (u_drawInstanced) {
-        transform(worldPos, forward, upVec, u_localScale, offset);
-        isLeader = ((u_leaderIdx != -1) && (gl_InstanceID == u_leaderIdx)) ? 0 : 1;
-    }
+#ifdef DRAW_INSTANCED
+    vBaseColor = u_swarmColors[instanceSwarm()];
+    transformInstance(worldPos, instanceRotation(), instanceForward(), instanceUp(), u_localScale, instanceOffset());
+    isLeader = ((u_leaderIdx != -1) && (gl_InstanceID == u_leaderIdx)) ? 0 : 1;
+#else
+    vBaseColor = u_color;
+#endif
 
     gl_Position = u_mvpMatrix * vec4(worldPos, 1.0);
 
     int id = gl_VertexID % 3;
     vBary = vec3(id == 1 ? 1 : 0, id == 2 ? 1 : 0, id == 0 ? 1 : 0);
-    vColor = (id == 0) ? u_color : vec3(1.0) - u_color;
+    vColor = (id == 0) ? vBaseColor : vec3(1.0) - vBaseColor;
 }
\ No newline at end of file
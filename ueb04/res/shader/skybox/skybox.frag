@@ -0,0 +1,11 @@
+#version 430 core
+
+out vec4 fragColor;
+
+in vec3 texDir;
+
+uniform samplerCube u_skybox;
+
+void main() {
+    fragColor = texture(u_skybox, texDir);
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#version 430 core
+
+#include "../pull.glsl"
+
+out vec3 texDir;
+
+uniform mat4 u_vpMatrix;
+
+void main() {
+    vec3 pos = vertexPosition();
+    texDir = pos;
+
+    // z = w puts the cube on the far plane after the perspective divide
+    vec4 clipPos = u_vpMatrix * vec4(pos, 1.0);
+    gl_Position = clipPos.xyww;
+}
\ No newline at end of file
@@ -1,13 +1,12 @@
 #version 430 core
 
-layout (location = 0) in vec3 pos;
-layout (location = 2) in vec2 tex;
+#include "../pull.glsl"
 
 out vec2 texCoords;
 
 uniform mat4 u_mvpMatrix;
 
 void main() {
-    texCoords = tex;
-    gl_Position = u_mvpMatrix * vec4(pos, 1.0);
+    texCoords = vertexTexCoords();
+    gl_Position = u_mvpMatrix * vec4(vertexPosition(), 1.0);
 }
\ No newline at end of file
@@ -2,6 +2,37 @@
   * Functions used by more than one shader.
   */
 
+ // Set if up and forward arrive octahedral encoded (InstanceFormat IF_PACKED)
+ uniform bool u_packedInstances;
+
+ // Set if particleBasis.comp built the rotation of every drawn instance
+ uniform bool u_instanceRotations;
+
+ // Must match MAX_SWARMS in input.h
+ #define MAX_SWARMS 4
+
+ // Color of every swarm, picked by the swarm id of an instance
+ uniform vec3 u_swarmColors[MAX_SWARMS];
+
+ vec2 signNotZero(vec2 v) {
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+ }
+
+ vec3 octDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(v.yx)) * signNotZero(v.xy);
+    }
+    return normalize(v);
+ }
+
+ void unpackBasis(inout vec3 up, inout vec3 forward) {
+    if (u_packedInstances) {
+        up = octDecode(up.xy);
+        forward = octDecode(forward.xy);
+    }
+ }
+
  void transform(inout vec3 pos, in vec3 forward, inout vec3 up, in vec3 localScale, in vec3 instanceOffset) {
     vec3 f = normalize(forward);
     vec3 u = normalize(up);
@@ -12,3 +43,49 @@
     pos = rot * (pos * localScale) + instanceOffset;
     up = u;
 }
+
+ vec3 quatRotate(vec4 q, vec3 v) {
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+ }
+
+ /**
+  * Rotation of the basis that transform() builds, as unit quaternion.
+  */
+ vec4 basisToQuat(vec3 forward, vec3 up) {
+    vec3 f = normalize(forward);
+    vec3 r = normalize(cross(f, normalize(up)));
+    vec3 u = cross(r, f);
+
+    // mat3(r, u, f), column major
+    float trace = r.x + u.y + f.z;
+    vec4 q;
+    if (trace > 0.0) {
+        float s = 2.0 * sqrt(trace + 1.0);
+        q = vec4((u.z - f.y) / s, (f.x - r.z) / s, (r.y - u.x) / s, 0.25 * s);
+    } else if (r.x > u.y && r.x > f.z) {
+        float s = 2.0 * sqrt(1.0 + r.x - u.y - f.z);
+        q = vec4(0.25 * s, (u.x + r.y) / s, (f.x + r.z) / s, (u.z - f.y) / s);
+    } else if (u.y > f.z) {
+        float s = 2.0 * sqrt(1.0 + u.y - r.x - f.z);
+        q = vec4((u.x + r.y) / s, 0.25 * s, (f.y + u.z) / s, (f.x - r.z) / s);
+    } else {
+        float s = 2.0 * sqrt(1.0 + f.z - r.x - u.y);
+        q = vec4((f.x + r.z) / s, (f.y + u.z) / s, 0.25 * s, (r.y - u.x) / s);
+    }
+    return normalize(q);
+ }
+
+ /**
+  * Places an instance vertex with the prebuilt rotation if there is one,
+  * otherwise unpacks up and forward and builds the basis per vertex.
+  */
+ void transformInstance(inout vec3 pos, in vec4 rotation, in vec3 forward, in vec3 up,
+                        in vec3 localScale, in vec3 instanceOffset) {
+    if (u_instanceRotations) {
+        pos = quatRotate(rotation, pos * localScale) + instanceOffset;
+        return;
+    }
+
+    unpackBasis(up, forward);
+    transform(pos, forward, up, localScale, instanceOffset);
+ }
@@ -0,0 +1,490 @@
+/**
+ * @file capture.c
+ * @brief Implementation of the frame capture
+ *
+ * Slots cycle through free, reading (GPU copy in flight, fenced) and queued
+ * (owned by the writer). The main thread owns free and reading slots, the
+ * writer only touches queued ones, so the mutex only guards the states.
+ * With GL 4.4 buffer storage the slots stay persistently mapped and the
+ * writer reads straight from them, otherwise a finished slot is copied out
+ * once on the main thread.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "capture.h"
+#include "thread.h"
+#include "utils.h"
+#include "gpumem.h"
+
+#ifdef _WIN32
+    #include <direct.h>
+    #define MAKE_DIR(path) _mkdir(path)
+#else
+    #include <sys/stat.h>
+    #define MAKE_DIR(path) mkdir(path, 0755)
+#endif
+
+/** Nominal frame rate written to the Y4M header */
+#define CAPTURE_FPS 60
+
+/** Maximum length of an output path */
+#define CAPTURE_PATH_LEN 256
+
+// GL 4.4 / ARB_buffer_storage is not part of the generated loader
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+/** glBufferStorage function pointer type */
+typedef void (APIENTRYP BufferStorageFn)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+/**
+ * State of a pack buffer slot.
+ */
+typedef enum {
+    SLOT_FREE,
+    SLOT_READING,
+    SLOT_QUEUED
+} SlotState;
+
+/**
+ * One pixel pack buffer.
+ */
+typedef struct {
+    SlotState state;
+    GLuint pbo;
+    GLsync fence;
+    unsigned char *mapped;      // persistent mapping or NULL
+    unsigned char *copy;        // CPU copy without persistent mapping
+    const unsigned char *pixels;// what the writer reads, bottom-up RGBA
+    int frame;
+} Slot;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global capture state.
+ */
+static struct {
+    bool running;
+    CaptureFormat format;
+    int width;
+    int height;
+    size_t frameSize;           // bytes of one RGBA frame
+
+    Slot slots[CAPTURE_SLOTS];
+    int head;                   // slot of the next readback
+    int collect;                // oldest slot still reading
+    int written;
+    int dropped;
+
+    FILE *file;                 // stream formats only
+    unsigned char *rgb;         // writer scratch, top-down RGB
+    unsigned char *yuv;         // writer scratch, I420
+
+    Thread thread;
+    bool hasThread;
+    Mutex mutex;
+    Cond cond;
+    bool stop;
+} g_capture = { 0 };
+
+/** glBufferStorage entry point, NULL if not supported by the context */
+static BufferStorageFn g_bufferStorage = NULL;
+
+/**
+ * Converts a bottom-up RGBA frame to top-down RGB.
+ * @param src Pixels read by glReadPixels.
+ */
+static void toTopDownRgb(const unsigned char *src) {
+    int w = g_capture.width;
+    int h = g_capture.height;
+
+    for (int y = 0; y < h; ++y) {
+        const unsigned char *in = src + (size_t) (h - 1 - y) * w * 4;
+        unsigned char *out = g_capture.rgb + (size_t) y * w * 3;
+        for (int x = 0; x < w; ++x) {
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+            in += 4;
+            out += 3;
+        }
+    }
+}
+
+/**
+ * Converts the RGB scratch to full-range BT.601 I420.
+ * Chroma is taken from the top left pixel of every 2x2 block.
+ */
+static void rgbToI420(void) {
+    int w = g_capture.width;
+    int h = g_capture.height;
+    int cw = (w + 1) / 2;
+    int ch = (h + 1) / 2;
+    unsigned char *yPlane = g_capture.yuv;
+    unsigned char *uPlane = yPlane + (size_t) w * h;
+    unsigned char *vPlane = uPlane + (size_t) cw * ch;
+
+    for (int y = 0; y < h; ++y) {
+        const unsigned char *in = g_capture.rgb + (size_t) y * w * 3;
+        for (int x = 0; x < w; ++x) {
+            int r = in[0], g = in[1], b = in[2];
+            yPlane[(size_t) y * w + x] = (unsigned char) ((77 * r + 150 * g + 29 * b + 128) >> 8);
+
+            if ((x & 1) == 0 && (y & 1) == 0) {
+                size_t c = (size_t) (y / 2) * cw + x / 2;
+                int u = ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
+                int v = ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
+                uPlane[c] = (unsigned char) CLAMP(u, 0, 255);
+                vPlane[c] = (unsigned char) CLAMP(v, 0, 255);
+            }
+            in += 3;
+        }
+    }
+}
+
+/**
+ * Writes one frame in the capture format, runs on the writer thread.
+ * @param slot Queued slot.
+ */
+static void writeSlot(const Slot *slot) {
+    int w = g_capture.width;
+    int h = g_capture.height;
+    toTopDownRgb(slot->pixels);
+
+    switch (g_capture.format) {
+        case CF_PNG: {
+            char path[CAPTURE_PATH_LEN];
+            snprintf(path, sizeof(path), CAPTURE_DIR "/frame_%05d.png", slot->frame);
+            if (!stbi_write_png(path, w, h, 3, g_capture.rgb, w * 3)) {
+                printf("Could not write %s!\n", path);
+            }
+            break;
+        }
+        case CF_Y4M: {
+            int cw = (w + 1) / 2;
+            int ch = (h + 1) / 2;
+            rgbToI420();
+            fputs("FRAME\n", g_capture.file);
+            fwrite(g_capture.yuv, 1, (size_t) w * h + 2 * (size_t) cw * ch, g_capture.file);
+            break;
+        }
+        default:
+            fwrite(g_capture.rgb, 1, (size_t) w * h * 3, g_capture.file);
+            break;
+    }
+}
+
+/**
+ * Writes the queued slots in frame order until the capture stops.
+ */
+static void writerLoop(void) {
+    int next = 0;
+
+    MUTEX_LOCK(&g_capture.mutex);
+    while (true) {
+        Slot *slot = &g_capture.slots[next];
+        while (!g_capture.stop && slot->state != SLOT_QUEUED) {
+            COND_WAIT(&g_capture.cond, &g_capture.mutex);
+        }
+
+        if (slot->state != SLOT_QUEUED) {
+            break;
+        }
+        MUTEX_UNLOCK(&g_capture.mutex);
+
+        writeSlot(slot);
+
+        MUTEX_LOCK(&g_capture.mutex);
+        slot->state = SLOT_FREE;
+        next = (next + 1) % CAPTURE_SLOTS;
+        COND_BROADCAST(&g_capture.cond);
+    }
+    MUTEX_UNLOCK(&g_capture.mutex);
+}
+
+/**
+ * Writer thread entry.
+ */
+static THREAD_ENTRY(writerMain) {
+    NK_UNUSED(arg);
+    writerLoop();
+    THREAD_RETURN;
+}
+
+/**
+ * Returns the state of a slot as seen by the main thread.
+ * @param slot The slot.
+ * @return Its state.
+ */
+static SlotState slotState(const Slot *slot) {
+    MUTEX_LOCK(&g_capture.mutex);
+    SlotState state = slot->state;
+    MUTEX_UNLOCK(&g_capture.mutex);
+    return state;
+}
+
+/**
+ * Hands a slot whose readback finished to the writer.
+ * Without persistent mapping the pixels are copied out of the buffer first.
+ * @param slot Slot in the reading state.
+ */
+static void queueSlot(Slot *slot) {
+    glDeleteSync(slot->fence);
+    slot->fence = NULL;
+
+    if (slot->mapped) {
+        slot->pixels = slot->mapped;
+    } else {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+        const void *src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, g_capture.frameSize, GL_MAP_READ_BIT);
+        if (src) {
+            memcpy(slot->copy, src, g_capture.frameSize);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot->pixels = slot->copy;
+    }
+
+    if (!g_capture.hasThread) {
+        writeSlot(slot);
+        slot->state = SLOT_FREE;
+        return;
+    }
+
+    MUTEX_LOCK(&g_capture.mutex);
+    slot->state = SLOT_QUEUED;
+    COND_BROADCAST(&g_capture.cond);
+    MUTEX_UNLOCK(&g_capture.mutex);
+}
+
+/**
+ * Queues the finished readbacks in order.
+ * @param wait Block until every readback in flight finished.
+ */
+static void collectSlots(bool wait) {
+    while (true) {
+        Slot *slot = &g_capture.slots[g_capture.collect];
+        if (slotState(slot) != SLOT_READING) {
+            return;
+        }
+
+        GLenum res = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+        if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED) {
+            return;
+        }
+
+        queueSlot(slot);
+        g_capture.collect = (g_capture.collect + 1) % CAPTURE_SLOTS;
+    }
+}
+
+/**
+ * Creates the pack buffers of all slots.
+ */
+static void createSlots(void) {
+    for (int i = 0; i < CAPTURE_SLOTS; ++i) {
+        Slot *slot = &g_capture.slots[i];
+        memset(slot, 0, sizeof(Slot));
+
+        glGenBuffers(1, &slot->pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+        if (g_bufferStorage) {
+            GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            g_bufferStorage(GL_PIXEL_PACK_BUFFER, g_capture.frameSize, NULL, flags);
+            slot->mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, g_capture.frameSize, flags);
+        } else {
+            glBufferData(GL_PIXEL_PACK_BUFFER, g_capture.frameSize, NULL, GL_STREAM_READ);
+            slot->copy = malloc(g_capture.frameSize);
+            assert(slot->copy && "malloc failed in createSlots");
+        }
+        gpumem_setBuffer(GPUMEM_STAGING, slot->pbo, g_capture.frameSize);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+/**
+ * Deletes the pack buffers of all slots, the writer must be stopped.
+ */
+static void deleteSlots(void) {
+    for (int i = 0; i < CAPTURE_SLOTS; ++i) {
+        Slot *slot = &g_capture.slots[i];
+        if (slot->fence) {
+            glDeleteSync(slot->fence);
+        }
+        gpumem_deleteBuffers(1, &slot->pbo);
+        free(slot->copy);
+        memset(slot, 0, sizeof(Slot));
+    }
+}
+
+/**
+ * Opens the output of the capture format.
+ * @return False if the output file could not be created.
+ */
+static bool openOutput(void) {
+    MAKE_DIR(CAPTURE_DIR);
+
+    const char *path = NULL;
+    switch (g_capture.format) {
+        case CF_PNG:
+            return true;
+        case CF_Y4M:
+            path = CAPTURE_DIR "/capture.y4m";
+            break;
+        default:
+            path = CAPTURE_DIR "/capture.rgb";
+            break;
+    }
+
+    g_capture.file = fopen(path, "wb");
+    if (!g_capture.file) {
+        printf("Could not create %s!\n", path);
+        return false;
+    }
+
+    if (g_capture.format == CF_Y4M) {
+        fprintf(g_capture.file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+            g_capture.width, g_capture.height, CAPTURE_FPS);
+    } else {
+        printf("Capturing raw rgb24 %dx%d to %s\n", g_capture.width, g_capture.height, path);
+    }
+    return true;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void capture_init(void) {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+    bool supported = (major > 4 || (major == 4 && minor >= 4))
+        || glfwExtensionSupported("GL_ARB_buffer_storage");
+
+    g_bufferStorage = supported ? (BufferStorageFn)glfwGetProcAddress("glBufferStorage") : NULL;
+}
+
+void capture_cleanup(void) {
+    capture_stop();
+}
+
+bool capture_start(CaptureFormat format, int width, int height) {
+    capture_stop();
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+
+    g_capture.format = format;
+    g_capture.width = width;
+    g_capture.height = height;
+    g_capture.frameSize = (size_t) width * height * 4;
+    if (!openOutput()) {
+        return false;
+    }
+
+    g_capture.rgb = malloc((size_t) width * height * 3);
+    assert(g_capture.rgb && "malloc failed in capture_start");
+    if (format == CF_Y4M) {
+        g_capture.yuv = malloc((size_t) width * height + 2 * (size_t) ((width + 1) / 2) * ((height + 1) / 2));
+        assert(g_capture.yuv && "malloc failed in capture_start");
+    }
+
+    createSlots();
+    g_capture.head = 0;
+    g_capture.collect = 0;
+    g_capture.written = 0;
+    g_capture.dropped = 0;
+
+    MUTEX_INIT(&g_capture.mutex);
+    COND_INIT(&g_capture.cond);
+    g_capture.stop = false;
+    g_capture.hasThread = THREAD_CREATE(&g_capture.thread, writerMain);
+    if (!g_capture.hasThread) {
+        printf("Could not create capture writer thread, writing synchronously!\n");
+    }
+
+    g_capture.running = true;
+    return true;
+}
+
+void capture_stop(void) {
+    if (!g_capture.running) {
+        return;
+    }
+
+    collectSlots(true);
+
+    MUTEX_LOCK(&g_capture.mutex);
+    g_capture.stop = true;
+    COND_BROADCAST(&g_capture.cond);
+    MUTEX_UNLOCK(&g_capture.mutex);
+
+    if (g_capture.hasThread) {
+        THREAD_JOIN(g_capture.thread);
+        g_capture.hasThread = false;
+    }
+
+    COND_DESTROY(&g_capture.cond);
+    MUTEX_DESTROY(&g_capture.mutex);
+
+    deleteSlots();
+    if (g_capture.file) {
+        fclose(g_capture.file);
+        g_capture.file = NULL;
+    }
+    free(g_capture.rgb);
+    free(g_capture.yuv);
+    g_capture.rgb = NULL;
+    g_capture.yuv = NULL;
+
+    printf("Captured %d frames, %d dropped\n", g_capture.written, g_capture.dropped);
+    g_capture.running = false;
+}
+
+void capture_frame(int width, int height) {
+    if (!g_capture.running) {
+        return;
+    }
+
+    if (width != g_capture.width || height != g_capture.height) {
+        printf("Framebuffer resized, stopping capture!\n");
+        capture_stop();
+        return;
+    }
+
+    collectSlots(false);
+
+    Slot *slot = &g_capture.slots[g_capture.head];
+    if (slotState(slot) != SLOT_FREE) {
+        ++g_capture.dropped;
+        return;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->frame = g_capture.written++;
+
+    MUTEX_LOCK(&g_capture.mutex);
+    slot->state = SLOT_READING;
+    MUTEX_UNLOCK(&g_capture.mutex);
+    g_capture.head = (g_capture.head + 1) % CAPTURE_SLOTS;
+}
+
+bool capture_isRunning(void) {
+    return g_capture.running;
+}
+
+void capture_getCounts(int *written, int *dropped) {
+    *written = g_capture.written;
+    *dropped = g_capture.dropped;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file capture.h
+ * @brief Offline frame capture to disk without stalling the render loop
+ *
+ * Every captured frame is read into one of CAPTURE_SLOTS pixel pack buffers
+ * with glReadPixels, which returns at once. A slot is handed to the writer
+ * thread once its fence signaled, usually two frames later, and the writer
+ * converts and writes it while the render loop goes on. If no slot is free
+ * the frame is dropped instead of waiting.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <fhwcg/fhwcg.h>
+#include "input.h"
+
+/** Pixel pack buffers in flight, readback latency plus the one being written */
+#define CAPTURE_SLOTS 4
+
+/** Output directory of the captures */
+#define CAPTURE_DIR "capture"
+
+/**
+ * Queries whether persistently mapped pack buffers are supported.
+ * Call once after the GL context was created.
+ */
+void capture_init(void);
+
+/**
+ * Stops a running capture.
+ */
+void capture_cleanup(void);
+
+/**
+ * Starts capturing frames of the given size.
+ * @param format Output format.
+ * @param width Framebuffer width.
+ * @param height Framebuffer height.
+ * @return False if the output file or the writer could not be created.
+ */
+bool capture_start(CaptureFormat format, int width, int height);
+
+/**
+ * Finishes the frames in flight, then stops the writer and closes the output.
+ */
+void capture_stop(void);
+
+/**
+ * Reads the current back buffer into the next free slot and hands finished
+ * slots to the writer. Call after the scene was drawn, before the GUI.
+ * A changed framebuffer size stops the capture.
+ * @param width Current framebuffer width.
+ * @param height Current framebuffer height.
+ */
+void capture_frame(int width, int height);
+
+/**
+ * Returns whether a capture is running.
+ * @return True while capturing.
+ */
+bool capture_isRunning(void);
+
+/**
+ * Returns the number of frames written and dropped by the last capture.
+ * @param written Output: frames handed to the writer.
+ * @param dropped Output: frames skipped because no slot was free.
+ */
+void capture_getCounts(int *written, int *dropped);
+
+#endif // CAPTURE_H
@@ -0,0 +1,439 @@
+/**
+ * @file compute.c
+ * @brief Implementation of the GPU particle integrator
+ *
+ * Particle state lives in shader storage buffers. The instance columns
+ * of instanced.c are bound directly, so the integrator writes the data
+ * the instanced draws read without a round trip through the CPU.
+ * Only the positions are kept apart: the integrator steps the state
+ * positions and keeps the previous ones, a blend pass then writes the
+ * interpolated positions into the position column once per frame.
+ * The swarm id column keeps the ids of the last upload, the integrator
+ * steers a single swarm.
+ * The obstacle distance volume is uploaded once as a 3D texture.
+ * The particle camera gets its particle through a fenced copy that is
+ * read a frame later, so following it costs no sync point.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "compute.h"
+#include "instanced.h"
+#include "shader.h"
+#include "arena.h"
+#include "gpumem.h"
+#include "metrics.h"
+
+/** Must match GROUP_SIZE in the compute shaders */
+#define GROUP_SIZE 256
+
+/** Result entries of the swarm buffer, must match swarmReduce.comp */
+#define SWARM_CENTROID 0
+#define SWARM_BOUNDS_MIN 2
+#define SWARM_BOUNDS_MAX 3
+
+/** Reserved entries in front of the partials in the swarm buffer */
+#define SWARM_PARTIALS 4
+
+/** Entries per work group partial (sum, min, max) */
+#define PARTIAL_SIZE 3
+
+/** Storage buffer bindings, must match the compute shaders */
+#define BINDING_VELOCITY 4
+#define BINDING_RIGHT 5
+#define BINDING_PARAMS 6
+#define BINDING_SWARM 7
+#define BINDING_STATE_POS 8
+#define BINDING_PREV_POS 9
+
+/** Layout of the particle readback buffer */
+#define READBACK_POS 0
+#define READBACK_UP 1
+#define READBACK_FORWARD 2
+#define READBACK_COUNT 3
+
+/** Texture unit of the obstacle distance volume */
+#define SDF_TEXTURE_UNIT 0
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * GPU simulation state that is not part of the instance columns.
+ */
+static struct {
+    GLuint pos;
+    GLuint prevPos;
+    GLuint velocity;
+    GLuint right;
+    GLuint params;
+    GLuint swarm;
+    int capacity;
+
+    GLuint sdfTexture;
+    const SdfVolume *sdfUploaded;
+
+    // Fenced copy of one particle, read once the GPU is done
+    GLuint readback;
+    GLsync readbackFence;
+    int readbackIdx;
+
+    // Fenced copy of the swarm results
+    GLuint statsReadback;
+    GLsync statsFence;
+} g_state = { 0 };
+
+/**
+ * Returns the number of work groups needed for the given particle count.
+ * @param count Number of particles.
+ * @return Number of work groups.
+ */
+static int numGroups(int count) {
+    return (count + GROUP_SIZE - 1) / GROUP_SIZE;
+}
+
+/**
+ * Uploads the distance volume into a linearly filtered 3D texture,
+ * only if it is not the one uploaded last.
+ * @param sdf Baked distance volume.
+ */
+static void ensureSdfTexture(const SdfVolume *sdf) {
+    if (g_state.sdfUploaded == sdf) {
+        return;
+    }
+
+    if (!g_state.sdfTexture) {
+        glGenTextures(1, &g_state.sdfTexture);
+    }
+    glBindTexture(GL_TEXTURE_3D, g_state.sdfTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, sdf->dim, sdf->dim, sdf->dim, 0, GL_RED, GL_FLOAT, sdf->dist);
+    gpumem_setTexture(GPUMEM_TEXTURES, g_state.sdfTexture, gpumem_imageBytes(GL_R32F, sdf->dim, sdf->dim, sdf->dim));
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    g_state.sdfUploaded = sdf;
+}
+
+/**
+ * Queues a copy of one vec3 into a slot of the particle readback buffer.
+ * @param src Buffer to copy from.
+ * @param idx Element index in src.
+ * @param slot Destination slot, see READBACK_POS.
+ */
+static void copyToReadback(GLuint src, int idx, int slot) {
+    glBindBuffer(GL_COPY_READ_BUFFER, src);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+        (GLintptr) idx * sizeof(vec3), (GLintptr) slot * sizeof(vec3), sizeof(vec3));
+}
+
+/**
+ * (Re)allocates a storage buffer with optional initial data.
+ * @param buffer Buffer name.
+ * @param size Size in bytes.
+ * @param data Initial contents or NULL.
+ */
+static void allocBuffer(GLuint buffer, GLsizeiptr size, const void *data) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_DYNAMIC_COPY);
+    gpumem_setBuffer(GPUMEM_COMPUTE, buffer, (size_t) size);
+}
+
+/**
+ * Grows all state buffers to hold at least count particles.
+ * Contents are undefined after growing.
+ * @param count Required number of particles.
+ */
+static void ensureCapacity(int count) {
+    if (count <= g_state.capacity) {
+        return;
+    }
+
+    int capacity = g_state.capacity * 2;
+    if (capacity < count) capacity = count;
+
+    allocBuffer(g_state.pos, capacity * sizeof(vec3), NULL);
+    allocBuffer(g_state.prevPos, capacity * sizeof(vec3), NULL);
+    allocBuffer(g_state.velocity, capacity * sizeof(vec3), NULL);
+    allocBuffer(g_state.right, capacity * sizeof(vec3), NULL);
+    allocBuffer(g_state.params, capacity * sizeof(vec2), NULL);
+    allocBuffer(g_state.swarm, (SWARM_PARTIALS + PARTIAL_SIZE * numGroups(capacity)) * sizeof(vec4), NULL);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    g_state.capacity = capacity;
+}
+
+/**
+ * Uploads data to the start of a storage buffer.
+ * @param buffer Buffer name.
+ * @param size Size in bytes.
+ * @param data Source data.
+ */
+static void uploadBuffer(GLuint buffer, GLsizeiptr size, const void *data) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+    metrics_count(METRIC_UPLOAD_BYTES, (long) size);
+}
+
+/**
+ * Binds all storage buffers to their shader bindings.
+ */
+static void bindBuffers(void) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IC_POS, instanced_getColumnBuffer(IC_POS));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IC_ACCELERATION, instanced_getColumnBuffer(IC_ACCELERATION));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IC_UP, instanced_getColumnBuffer(IC_UP));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IC_FORWARD, instanced_getColumnBuffer(IC_FORWARD));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_VELOCITY, g_state.velocity);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_RIGHT, g_state.right);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_PARAMS, g_state.params);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_SWARM, g_state.swarm);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_STATE_POS, g_state.pos);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_PREV_POS, g_state.prevPos);
+}
+
+/**
+ * Reads count vec3 values from an instance column at the active region.
+ * @param column Source column.
+ * @param first First particle index.
+ * @param count Number of values to read.
+ * @param dst Destination array.
+ */
+static void readColumn(InstanceColumn column, int first, int count, vec3 *dst) {
+    GLintptr offset = (GLintptr)(instanced_getBaseInstance() + first) * sizeof(vec3);
+    glBindBuffer(GL_ARRAY_BUFFER, instanced_getColumnBuffer(column));
+    glGetBufferSubData(GL_ARRAY_BUFFER, offset, count * sizeof(vec3), dst);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void compute_init(void) {
+    glGenBuffers(1, &g_state.pos);
+    glGenBuffers(1, &g_state.prevPos);
+    glGenBuffers(1, &g_state.velocity);
+    glGenBuffers(1, &g_state.right);
+    glGenBuffers(1, &g_state.params);
+    glGenBuffers(1, &g_state.swarm);
+    g_state.capacity = 0;
+
+    glGenBuffers(1, &g_state.readback);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, g_state.readback);
+    glBufferData(GL_COPY_WRITE_BUFFER, READBACK_COUNT * sizeof(vec3), NULL, GL_STREAM_READ);
+    gpumem_setBuffer(GPUMEM_STAGING, g_state.readback, READBACK_COUNT * sizeof(vec3));
+    g_state.readbackFence = NULL;
+
+    glGenBuffers(1, &g_state.statsReadback);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, g_state.statsReadback);
+    glBufferData(GL_COPY_WRITE_BUFFER, SWARM_PARTIALS * sizeof(vec4), NULL, GL_STREAM_READ);
+    gpumem_setBuffer(GPUMEM_STAGING, g_state.statsReadback, SWARM_PARTIALS * sizeof(vec4));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    g_state.statsFence = NULL;
+}
+
+void compute_cleanup(void) {
+    gpumem_deleteBuffers(1, &g_state.pos);
+    gpumem_deleteBuffers(1, &g_state.prevPos);
+    gpumem_deleteBuffers(1, &g_state.velocity);
+    gpumem_deleteBuffers(1, &g_state.right);
+    gpumem_deleteBuffers(1, &g_state.params);
+    gpumem_deleteBuffers(1, &g_state.swarm);
+    gpumem_deleteTextures(1, &g_state.sdfTexture);
+    if (g_state.readbackFence) {
+        glDeleteSync(g_state.readbackFence);
+    }
+    gpumem_deleteBuffers(1, &g_state.readback);
+    if (g_state.statsFence) {
+        glDeleteSync(g_state.statsFence);
+    }
+    gpumem_deleteBuffers(1, &g_state.statsReadback);
+    memset(&g_state, 0, sizeof(g_state));
+}
+
+void compute_upload(int count, vec3 *pos, vec3 *velocity, vec3 *right, float *kWeak, float *kV) {
+    ensureCapacity(count);
+
+    // Interleaved (kWeak, kV), only needed until the upload
+    vec2 *params = arena_alloc(arena_frame(), count * sizeof(vec2));
+    for (int i = 0; i < count; ++i) {
+        params[i][0] = kWeak[i];
+        params[i][1] = kV[i];
+    }
+
+    // No step taken yet, the previous positions are the current ones
+    uploadBuffer(g_state.pos, count * sizeof(vec3), pos);
+    uploadBuffer(g_state.prevPos, count * sizeof(vec3), pos);
+    uploadBuffer(g_state.velocity, count * sizeof(vec3), velocity);
+    uploadBuffer(g_state.right, count * sizeof(vec3), right);
+    uploadBuffer(g_state.params, count * sizeof(vec2), params);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void compute_download(int count, vec3 *pos, vec3 *acceleration, vec3 *up, vec3 *forward,
+    vec3 *velocity, vec3 *right
+) {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    readColumn(IC_ACCELERATION, 0, count, acceleration);
+    readColumn(IC_UP, 0, count, up);
+    readColumn(IC_FORWARD, 0, count, forward);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_state.pos);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(vec3), pos);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_state.velocity);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(vec3), velocity);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_state.right);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(vec3), right);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+bool compute_readParticle(int idx, vec3 pos, vec3 up, vec3 forward) {
+    bool read = false;
+    if (g_state.readbackFence) {
+        GLenum res = glClientWaitSync(g_state.readbackFence, 0, 0);
+        if (res == GL_TIMEOUT_EXPIRED) {
+            return false;
+        }
+
+        // A copy of a previous leader is dropped
+        if (g_state.readbackIdx == idx) {
+            vec3 record[READBACK_COUNT];
+            glBindBuffer(GL_COPY_READ_BUFFER, g_state.readback);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(record), record);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+            glm_vec3_copy(record[READBACK_POS], pos);
+            glm_vec3_copy(record[READBACK_UP], up);
+            glm_vec3_copy(record[READBACK_FORWARD], forward);
+            read = true;
+        }
+
+        glDeleteSync(g_state.readbackFence);
+        g_state.readbackFence = NULL;
+    }
+
+    // Queue the copy of this frame
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    int inst = instanced_getBaseInstance() + idx;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, g_state.readback);
+    copyToReadback(g_state.pos, idx, READBACK_POS);
+    copyToReadback(instanced_getColumnBuffer(IC_UP), inst, READBACK_UP);
+    copyToReadback(instanced_getColumnBuffer(IC_FORWARD), inst, READBACK_FORWARD);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    g_state.readbackIdx = idx;
+    g_state.readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return read;
+}
+
+bool compute_readSwarmStats(SwarmSummary *dest) {
+    bool read = false;
+    if (g_state.statsFence) {
+        if (glClientWaitSync(g_state.statsFence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            return false;
+        }
+
+        vec4 results[SWARM_PARTIALS];
+        glBindBuffer(GL_COPY_READ_BUFFER, g_state.statsReadback);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(results), results);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        // A reduction without the group pass has no particles in it
+        dest->valid = results[SWARM_CENTROID][3] > 0.0f;
+        if (dest->valid) {
+            glm_vec3_copy(results[SWARM_CENTROID], dest->centroid);
+            glm_vec3_copy(results[SWARM_BOUNDS_MIN], dest->boundsMin);
+            glm_vec3_copy(results[SWARM_BOUNDS_MAX], dest->boundsMax);
+            dest->meanSpeed = results[SWARM_BOUNDS_MIN][3];
+            dest->leaderDistance = results[SWARM_BOUNDS_MAX][3];
+        }
+        read = true;
+
+        glDeleteSync(g_state.statsFence);
+        g_state.statsFence = NULL;
+    }
+
+    if (g_state.capacity == 0) {
+        return read;
+    }
+
+    // Queue the copy of this frame
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, g_state.swarm);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, g_state.statsReadback);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, SWARM_PARTIALS * sizeof(vec4));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    g_state.statsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return read;
+}
+
+bool compute_step(InputData *data, vec3 *spheres, int numSpheres, vec3 manualCenter, const SdfVolume *sdf) {
+    int count = data->particles.count;
+    if (count <= 0 || count > g_state.capacity) {
+        return false;
+    }
+
+    // Steers swarm 0 only, physics.c keeps more swarms on the CPU
+    SwarmSettings *swarm = &data->particles.swarms[0];
+    int base = instanced_getBaseInstance();
+    int groups = numGroups(count);
+    bindBuffers();
+
+    // Aggregate stage: group partials (only needed for TM_CENTER/TM_FLOCK/TM_GRAVITY or the GUI statistics),
+    // then the results and the leader snapshot
+    bool needCentroid = swarm->targetMode == TM_CENTER || swarm->targetMode == TM_FLOCK
+        || swarm->targetMode == TM_GRAVITY || data->physics.swarmStats;
+    if (needCentroid) {
+        if (!shader_setSwarmReduceData(0, count, groups, swarm->leaderIdx)) {
+            return false;
+        }
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    if (!shader_setSwarmReduceData(1, count, needCentroid ? groups : 0, swarm->leaderIdx)) {
+        return false;
+    }
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // Integrate stage
+    if (sdf) {
+        ensureSdfTexture(sdf);
+        glActiveTexture(GL_TEXTURE0 + SDF_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_3D, g_state.sdfTexture);
+    }
+    if (!shader_setParticleIntegrateData(data, base, spheres, numSpheres, manualCenter, sdf, SDF_TEXTURE_UNIT)) {
+        return false;
+    }
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    return true;
+}
+
+void compute_finishSteps(int count, float alpha) {
+    if (count <= 0 || count > g_state.capacity) {
+        return;
+    }
+
+    bindBuffers();
+    if (shader_setParticleBlendData(count, instanced_getBaseInstance(), alpha)) {
+        glDispatchCompute(numGroups(count), 1, 1);
+    } else {
+        // Without the blend pass the latest step is drawn
+        GLintptr offset = (GLintptr) instanced_getBaseInstance() * sizeof(vec3);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glBindBuffer(GL_COPY_READ_BUFFER, g_state.pos);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, instanced_getColumnBuffer(IC_POS));
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, count * sizeof(vec3));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
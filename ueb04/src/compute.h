@@ -0,0 +1,94 @@
+/**
+ * @file compute.h
+ * @brief GPU particle integrator using compute shaders
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef COMPUTE_H
+#define COMPUTE_H
+
+#include <fhwcg/fhwcg.h>
+#include "input.h"
+#include "sdf.h"
+
+/**
+ * Creates the GPU simulation state buffers.
+ */
+void compute_init(void);
+
+/**
+ * Frees the GPU simulation state buffers.
+ */
+void compute_cleanup(void);
+
+/**
+ * Uploads the simulation state that is not part of the instance columns.
+ * The instance columns themselves are uploaded with instanced_update.
+ * The positions are also the previous positions until the first step.
+ * @param count Number of particles.
+ * @param pos Particle positions.
+ * @param velocity Particle velocities.
+ * @param right Particle right vectors.
+ * @param kWeak Particle steering strengths.
+ * @param kV Particle speeds.
+ */
+void compute_upload(int count, vec3 *pos, vec3 *velocity, vec3 *right, float *kWeak, float *kV);
+
+/**
+ * Reads the complete simulation state back into client memory.
+ * @param count Number of particles.
+ * @param pos Destination for positions.
+ * @param acceleration Destination for accelerations.
+ * @param up Destination for up vectors.
+ * @param forward Destination for forward vectors.
+ * @param velocity Destination for velocities.
+ * @param right Destination for right vectors.
+ */
+void compute_download(int count, vec3 *pos, vec3 *acceleration, vec3 *up, vec3 *forward,
+    vec3 *velocity, vec3 *right);
+
+/**
+ * Reads position and basis of a single particle without a sync point.
+ * Queues a fenced copy of the current state and returns the copy queued
+ * in an earlier call once the GPU is done with it, so the result is
+ * usually one frame old. Call once per frame.
+ * @param idx Particle index.
+ * @param pos Destination for the position.
+ * @param up Destination for the up vector.
+ * @param forward Destination for the forward vector.
+ * @return False if no copy of this particle is done yet, the destinations are untouched.
+ */
+bool compute_readParticle(int idx, vec3 pos, vec3 up, vec3 forward);
+
+/**
+ * Reads the swarm statistics of the last reduction without a sync point,
+ * fenced like compute_readParticle, so they are usually one frame old.
+ * Only complete while physics.swarmStats is set during the steps.
+ * Call once per frame.
+ * @param dest Destination for the statistics.
+ * @return False if no copy is done yet, dest is untouched.
+ */
+bool compute_readSwarmStats(SwarmSummary *dest);
+
+/**
+ * Runs one fixed simulation step on the GPU.
+ * @param data Input state containing simulation parameters.
+ * @param spheres Positions of the wandering spheres.
+ * @param numSpheres Number of spheres.
+ * @param manualCenter Target for TM_BOX_CENTER.
+ * @param sdf Baked obstacle volume, uploaded on first use, or NULL without obstacles.
+ * @return False if the compute shaders are not available.
+ */
+bool compute_step(InputData *data, vec3 *spheres, int numSpheres, vec3 manualCenter, const SdfVolume *sdf);
+
+/**
+ * Writes the drawn positions, blended between the last two steps,
+ * and makes the results of all steps visible to the instanced draws.
+ * Call once per frame, also when no step was run.
+ * @param count Number of particles.
+ * @param alpha Blend factor from the previous (0) to the current (1) step.
+ */
+void compute_finishSteps(int count, float alpha);
+
+#endif // COMPUTE_H
@@ -0,0 +1,1144 @@
+/**
+ * @file domain.c
+ * @brief Implementation of the slab decomposed particle update
+ *
+ * A step has three phases, each one job per rank, and a rank only reads
+ * the mailboxes addressed to it that were written in the phase before:
+ * 1. send partial swarm sums to every rank, ghosts to the slab neighbors
+ * 2. steer and integrate the owned particles, send the instance data
+ *    to rank 0 and the particles that left the slab to the neighbor
+ * 3. take in the migrated particles, rank 0 decodes the instance data
+ * Two sets of mailboxes alternate, so a phase never reads what it writes.
+ *
+ * On POSIX systems every rank but 0 is a worker process forked by
+ * domain_init, connected to every other rank by a Unix stream socket.
+ * Between the phases each rank sends its outgoing mailboxes to their
+ * receivers and appends what arrives to its incoming ones, so the phases
+ * run unchanged on the rank of their process. Rank 0 also drives the
+ * workers: a step command carries the inputs, the worker answers with its
+ * traffic. On Windows, or if the workers can't be started, all ranks are
+ * jobs of the thread pool and the mailboxes are shared memory.
+ * Multi-byte values are stored in host order, all targets are little-endian.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "domain.h"
+#include "grid.h"
+#include "jobs.h"
+#include "integrate.h"
+#include "utils.h"
+
+#ifndef _WIN32
+    #include <errno.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <sys/socket.h>
+    #include <sys/wait.h>
+
+    #define DOMAIN_PROCESSES 1
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/** First byte of every message */
+#define WIRE_MAGIC 0xD5
+
+/** Magic, kind, sender (16 bit) and record count (32 bit) */
+#define WIRE_HEADER_SIZE 8
+
+/** Record sizes in bytes */
+#define WIRE_SUMS_SIZE (MAX_SWARMS * 16)   // per swarm: position sum, count
+#define WIRE_GHOST_SIZE 28                  // position, velocity, swarm
+#define WIRE_MIGRANT_SIZE 36                // position, velocity, kWeak, kV, swarm
+#define WIRE_GATHER_SIZE 13                 // position, swarm as one byte
+
+/** Neighbors considered per particle in TM_FLOCK, see physics.c */
+#define MAX_NEIGHBORS 64
+
+#define EPS 1e-6f
+
+/** Mailbox sets, written and read by alternating phases */
+#define MAIL_SETS 2
+
+/** Commands of rank 0 to the worker processes */
+#define COMMAND_STEP 1
+#define COMMAND_QUIT 2
+
+/** Kinds of messages */
+typedef enum {
+    MSG_SUMS,
+    MSG_GHOSTS,
+    MSG_MIGRANTS,
+    MSG_GATHER
+} MessageKind;
+
+/**
+ * Encoded messages from one rank to another.
+ * Appended to in one phase, drained by the receiver in the next.
+ */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} Mailbox;
+
+/**
+ * One slab of the room and the particles inside of it.
+ * The particles [0, owned) are stepped, [owned, size) are ghosts of the neighbors.
+ */
+typedef struct {
+    float lo, hi;
+    int owned;
+    int size;
+    int capacity;
+
+    vec3 *pos;
+    vec3 *velocity;
+    vec3 *acceleration;
+    float *kWeak;
+    float *kV;
+    int *swarm;
+
+    Grid grid;
+    vec3 sum[MAX_SWARMS];
+    int count[MAX_SWARMS];
+    DomainStats stats;
+} Rank;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/** All ranks, their mailboxes and the instance data gathered on rank 0 */
+static struct {
+    int ranks;
+    Rank rank[DOMAIN_MAX_RANKS];
+    Mailbox mail[MAIL_SETS][DOMAIN_MAX_RANKS][DOMAIN_MAX_RANKS];   // [set][from][to]
+
+    vec3 *gatherPos;
+    int *gatherSwarm;
+    int gathered;
+    int total;
+
+    // Inputs of the current step
+    InputData *data;
+    vec3 *spheres;
+    int numSpheres;
+
+#ifdef DOMAIN_PROCESSES
+    // Ranks 1.. run in worker processes, this process runs rank self
+    bool processes;
+    int self;
+    int fd[DOMAIN_MAX_RANKS];           // socket to every other rank, -1 for self
+    pid_t pid[DOMAIN_MAX_RANKS];
+#endif
+} g_domain = { 0 };
+
+/**
+ * Makes room for at least count particles in a rank.
+ * @param r Rank.
+ * @param count Required number of particles.
+ */
+static void ensureCapacity(Rank *r, int count) {
+    if (count <= r->capacity) {
+        return;
+    }
+
+    int capacity = glm_imax(count, r->capacity * 2);
+    r->pos = realloc(r->pos, capacity * sizeof(vec3));
+    r->velocity = realloc(r->velocity, capacity * sizeof(vec3));
+    r->acceleration = realloc(r->acceleration, capacity * sizeof(vec3));
+    r->kWeak = realloc(r->kWeak, capacity * sizeof(float));
+    r->kV = realloc(r->kV, capacity * sizeof(float));
+    r->swarm = realloc(r->swarm, capacity * sizeof(int));
+    assert(r->pos && r->velocity && r->acceleration && r->kWeak && r->kV && r->swarm
+        && "realloc failed in domain ensureCapacity");
+    r->capacity = capacity;
+}
+
+/**
+ * Returns the rank owning a position.
+ * @param x Position along the slab axis.
+ * @return Rank index, positions outside the room belong to the outer slabs.
+ */
+static int rankOf(float x) {
+    float halfSize = g_domain.data->rendering.roomSize;
+    int r = (int)((x + halfSize) / (2.0f * halfSize) * g_domain.ranks);
+    return CLAMP(r, 0, g_domain.ranks - 1);
+}
+
+/**
+ * Appends bytes to a mailbox.
+ * @param m Mailbox.
+ * @param bytes Number of bytes.
+ * @return Start of the appended bytes, valid until the next reserve.
+ */
+static uint8_t* mailReserve(Mailbox *m, size_t bytes) {
+    if (m->size + bytes > m->capacity) {
+        size_t capacity = m->capacity ? m->capacity : 1024;
+        while (capacity < m->size + bytes) {
+            capacity *= 2;
+        }
+        m->data = realloc(m->data, capacity);
+        assert(m->data && "realloc failed in mailReserve");
+        m->capacity = capacity;
+    }
+
+    uint8_t *p = m->data + m->size;
+    m->size += bytes;
+    return p;
+}
+
+static inline uint8_t* putF32(uint8_t *p, float v) { memcpy(p, &v, 4); return p + 4; }
+static inline uint8_t* putI32(uint8_t *p, int32_t v) { memcpy(p, &v, 4); return p + 4; }
+static inline uint8_t* putVec3(uint8_t *p, const vec3 v) { memcpy(p, v, 12); return p + 12; }
+static inline const uint8_t* getF32(const uint8_t *p, float *v) { memcpy(v, p, 4); return p + 4; }
+static inline const uint8_t* getI32(const uint8_t *p, int32_t *v) { memcpy(v, p, 4); return p + 4; }
+static inline const uint8_t* getVec3(const uint8_t *p, vec3 v) { memcpy(v, p, 12); return p + 12; }
+
+/**
+ * Starts a message, the record count is patched in by endMessage.
+ * @param m Mailbox of the receiver.
+ * @param kind Message kind.
+ * @param from Sending rank.
+ * @return Offset of the header in the mailbox.
+ */
+static size_t beginMessage(Mailbox *m, MessageKind kind, int from) {
+    size_t at = m->size;
+    uint8_t *p = mailReserve(m, WIRE_HEADER_SIZE);
+    uint16_t sender = (uint16_t) from;
+    p[0] = WIRE_MAGIC;
+    p[1] = (uint8_t) kind;
+    memcpy(p + 2, &sender, 2);
+    putI32(p + 4, 0);
+    return at;
+}
+
+/**
+ * Finishes a message started with beginMessage.
+ * @param m Mailbox of the receiver.
+ * @param at Offset returned by beginMessage.
+ * @param count Number of records written.
+ * @param stats Traffic of the sender.
+ */
+static void endMessage(Mailbox *m, size_t at, int count, DomainStats *stats) {
+    putI32(m->data + at + 4, count);
+    stats->bytes += m->size - at;
+}
+
+/**
+ * Returns the size of one record of a message kind.
+ * @param kind Message kind.
+ * @return Size in bytes.
+ */
+static size_t recordSize(MessageKind kind) {
+    switch (kind) {
+        case MSG_SUMS: return WIRE_SUMS_SIZE;
+        case MSG_GHOSTS: return WIRE_GHOST_SIZE;
+        case MSG_MIGRANTS: return WIRE_MIGRANT_SIZE;
+        case MSG_GATHER: return WIRE_GATHER_SIZE;
+        default: return 0;
+    }
+}
+
+/**
+ * Decodes one received record into a rank.
+ * @param r Receiving rank.
+ * @param kind Message kind.
+ * @param p Encoded record.
+ */
+static void decodeRecord(Rank *r, MessageKind kind, const uint8_t *p) {
+    switch (kind) {
+        case MSG_SUMS:
+            for (int s = 0; s < MAX_SWARMS; ++s) {
+                vec3 sum;
+                int32_t count;
+                p = getVec3(p, sum);
+                p = getI32(p, &count);
+                glm_vec3_add(r->sum[s], sum, r->sum[s]);
+                r->count[s] += count;
+            }
+            break;
+
+        case MSG_GHOSTS:
+        case MSG_MIGRANTS: {
+            ensureCapacity(r, r->size + 1);
+            int i = r->size++;
+            int32_t swarm;
+            p = getVec3(p, r->pos[i]);
+            p = getVec3(p, r->velocity[i]);
+            if (kind == MSG_MIGRANTS) {
+                p = getF32(p, &r->kWeak[i]);
+                p = getF32(p, &r->kV[i]);
+            }
+            getI32(p, &swarm);
+            r->swarm[i] = swarm;
+            glm_vec3_zero(r->acceleration[i]);
+            break;
+        }
+
+        case MSG_GATHER: {
+            int i = g_domain.gathered++;
+            assert(i < g_domain.total && "more particles gathered than spawned");
+            p = getVec3(p, g_domain.gatherPos[i]);
+            g_domain.gatherSwarm[i] = *p;
+            break;
+        }
+    }
+}
+
+/**
+ * Decodes and empties all mailboxes of a set addressed to a rank.
+ * @param set Mailbox set.
+ * @param to Receiving rank.
+ */
+static void drainMail(int set, int to) {
+    Rank *r = &g_domain.rank[to];
+    for (int from = 0; from < g_domain.ranks; ++from) {
+        Mailbox *m = &g_domain.mail[set][from][to];
+        size_t at = 0;
+        while (at < m->size) {
+            const uint8_t *h = m->data + at;
+            assert(h[0] == WIRE_MAGIC && "corrupt domain message");
+            MessageKind kind = (MessageKind) h[1];
+            int32_t count;
+            getI32(h + 4, &count);
+
+            size_t size = recordSize(kind);
+            const uint8_t *p = h + WIRE_HEADER_SIZE;
+            for (int i = 0; i < count; ++i, p += size) {
+                decodeRecord(r, kind, p);
+            }
+            at += WIRE_HEADER_SIZE + count * size;
+        }
+        m->size = 0;
+    }
+}
+
+/**
+ * Appends the particles of a rank within a distance of one slab border
+ * to the mailbox of the neighbor behind it as ghosts.
+ * @param r Sending rank index.
+ * @param to Neighbor rank index.
+ * @param halo Ghost distance from the border.
+ */
+static void sendGhosts(int r, int to, float halo) {
+    Rank *rank = &g_domain.rank[r];
+    Mailbox *m = &g_domain.mail[0][r][to];
+    bool left = to < r;
+
+    size_t at = beginMessage(m, MSG_GHOSTS, r);
+    int count = 0;
+    for (int i = 0; i < rank->owned; ++i) {
+        float x = rank->pos[i][0];
+        if (left ? x >= rank->lo + halo : x <= rank->hi - halo) {
+            continue;
+        }
+
+        uint8_t *p = mailReserve(m, WIRE_GHOST_SIZE);
+        p = putVec3(p, rank->pos[i]);
+        p = putVec3(p, rank->velocity[i]);
+        putI32(p, rank->swarm[i]);
+        count++;
+    }
+    endMessage(m, at, count, &rank->stats);
+    rank->stats.ghosts += count;
+}
+
+/**
+ * Flocking acceleration of an owned particle from owned and ghost
+ * neighbors, same rules as getFlockAcceleration in physics.c.
+ * @param r Rank.
+ * @param i Owned particle.
+ * @param dest Output acceleration.
+ */
+static void flockAcceleration(Rank *r, int i, vec3 dest) {
+    InputData *data = g_domain.data;
+    Grid *g = &r->grid;
+    float radius2 = data->particles.flock.radius * data->particles.flock.radius;
+
+    vec3 separation = {0, 0, 0}, avgVel = {0, 0, 0}, avgPos = {0, 0, 0};
+    int neighbors = 0;
+
+    int c[3];
+    grid_cellCoords(g, r->pos[i], c);
+    for (int z = glm_imax(c[2] - 1, 0); z <= glm_imin(c[2] + 1, g->dim - 1); ++z) {
+        for (int y = glm_imax(c[1] - 1, 0); y <= glm_imin(c[1] + 1, g->dim - 1); ++y) {
+            for (int x = glm_imax(c[0] - 1, 0); x <= glm_imin(c[0] + 1, g->dim - 1); ++x) {
+                int begin, end;
+                grid_cellRange(g, x, y, z, &begin, &end);
+
+                for (int s = begin; s < end && neighbors < MAX_NEIGHBORS; ++s) {
+                    int other = g->sortedIdx[s];
+                    if (other == i || r->swarm[other] != r->swarm[i]) {
+                        continue;
+                    }
+
+                    vec3 diff;
+                    glm_vec3_sub(r->pos[i], g->sortedPos[s], diff);
+                    float d2 = glm_vec3_norm2(diff);
+                    if (d2 >= radius2 || d2 < EPS) {
+                        continue;
+                    }
+
+                    glm_vec3_muladds(diff, 1.0f / d2, separation);
+                    glm_vec3_add(avgVel, g->sortedVel[s], avgVel);
+                    glm_vec3_add(avgPos, g->sortedPos[s], avgPos);
+                    neighbors++;
+                }
+            }
+        }
+    }
+
+    glm_vec3_zero(dest);
+    if (neighbors == 0) {
+        return;
+    }
+
+    float inv = 1.0f / neighbors;
+    vec3 alignment, cohesion;
+    glm_vec3_scale(avgVel, inv, avgVel);
+    glm_vec3_scale(avgPos, inv, avgPos);
+    glm_vec3_sub(avgVel, r->velocity[i], alignment);
+    glm_vec3_sub(avgPos, r->pos[i], cohesion);
+
+    glm_vec3_muladds(separation, data->particles.flock.separation, dest);
+    glm_vec3_muladds(alignment, data->particles.flock.alignment, dest);
+    glm_vec3_muladds(cohesion, data->particles.flock.cohesion, dest);
+
+    float kWeak = r->kWeak[i];
+    if (glm_vec3_norm2(dest) > kWeak * kWeak) {
+        glm_vec3_scale_as(dest, kWeak, dest);
+    }
+}
+
+/**
+ * Steering towards a target, scaled to kWeak.
+ * @param r Rank.
+ * @param i Owned particle.
+ * @param target Target position.
+ * @param dest Output acceleration.
+ */
+static void targetAcceleration(Rank *r, int i, const vec3 target, vec3 dest) {
+    vec3 diff;
+    glm_vec3_sub((float*) target, r->pos[i], diff);
+    float dist = glm_vec3_norm(diff);
+    if (dist > 1e-5f) {
+        glm_vec3_scale(diff, r->kWeak[i] / dist, dest);
+    } else {
+        glm_vec3_zero(dest);
+    }
+}
+
+/**
+ * Target acceleration of an owned particle for the mode of its swarm.
+ * @param r Rank.
+ * @param i Owned particle.
+ * @param dest Output acceleration.
+ */
+static void computeAcceleration(Rank *r, int i, vec3 dest) {
+    InputData *data = g_domain.data;
+    int swarm = r->swarm[i];
+    glm_vec3_zero(dest);
+
+    switch (data->particles.swarms[swarm].targetMode) {
+        case TM_SPHERES:
+            for (int j = 0; j < g_domain.numSpheres; ++j) {
+                vec3 acc;
+                targetAcceleration(r, i, g_domain.spheres[j], acc);
+                float g = expf(-glm_vec3_distance2(g_domain.spheres[j], r->pos[i]) / data->particles.gaussianConst);
+                glm_vec3_muladds(acc, g, dest);
+            }
+            break;
+
+        case TM_CENTER:
+            if (r->count[swarm] > 0) {
+                vec3 centroid;
+                glm_vec3_scale(r->sum[swarm], 1.0f / r->count[swarm], centroid);
+                targetAcceleration(r, i, centroid, dest);
+            }
+            break;
+
+        case TM_FLOCK:
+            flockAcceleration(r, i, dest);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * Phase 1: partial swarm sums to every rank, ghosts to the slab neighbors.
+ * @param begin First rank.
+ * @param end One past the last rank.
+ * @param chunk Unused.
+ * @param userData Unused.
+ */
+static void sendJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    NK_UNUSED(userData);
+    InputData *data = g_domain.data;
+    bool flock = input_swarmsUseMode(data, TM_FLOCK);
+
+    for (int r = begin; r < end; ++r) {
+        Rank *rank = &g_domain.rank[r];
+        memset(&rank->stats, 0, sizeof(rank->stats));
+
+        vec3 sum[MAX_SWARMS] = { 0 };
+        int count[MAX_SWARMS] = { 0 };
+        for (int i = 0; i < rank->owned; ++i) {
+            glm_vec3_add(sum[rank->swarm[i]], rank->pos[i], sum[rank->swarm[i]]);
+            count[rank->swarm[i]]++;
+        }
+
+        for (int to = 0; to < g_domain.ranks; ++to) {
+            Mailbox *m = &g_domain.mail[0][r][to];
+            size_t at = beginMessage(m, MSG_SUMS, r);
+            uint8_t *p = mailReserve(m, WIRE_SUMS_SIZE);
+            for (int s = 0; s < MAX_SWARMS; ++s) {
+                p = putVec3(p, sum[s]);
+                p = putI32(p, count[s]);
+            }
+            endMessage(m, at, 1, &rank->stats);
+        }
+
+        // Slabs narrower than the radius miss neighbors two slabs away
+        if (flock) {
+            float halo = data->particles.flock.radius;
+            if (r > 0) {
+                sendGhosts(r, r - 1, halo);
+            }
+            if (r < g_domain.ranks - 1) {
+                sendGhosts(r, r + 1, halo);
+            }
+        }
+    }
+}
+
+/**
+ * Phase 2: steers and integrates the owned particles, sends the instance
+ * data to rank 0 and the particles that left the slab to its neighbors.
+ * @param begin First rank.
+ * @param end One past the last rank.
+ * @param chunk Unused.
+ * @param userData Unused.
+ */
+static void stepJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    NK_UNUSED(userData);
+    InputData *data = g_domain.data;
+
+    for (int r = begin; r < end; ++r) {
+        Rank *rank = &g_domain.rank[r];
+        memset(rank->sum, 0, sizeof(rank->sum));
+        memset(rank->count, 0, sizeof(rank->count));
+        drainMail(0, r);
+
+        // Owned particles and ghosts
+        if (input_swarmsUseMode(data, TM_FLOCK)) {
+            grid_build(&rank->grid, rank->pos, rank->velocity, rank->size,
+                data->rendering.roomSize, data->particles.flock.radius);
+        }
+
+        for (int i = 0; i < rank->owned; ++i) {
+            computeAcceleration(rank, i, rank->acceleration[i]);
+        }
+        rank->size = rank->owned;
+
+        IntegrateParams params = {
+            .pos = rank->pos,
+            .velocity = rank->velocity,
+            .acceleration = rank->acceleration,
+            .kV = rank->kV,
+            .dt = data->physics.fixedDt,
+            .halfSize = data->rendering.roomSize,
+            .roomForce = data->physics.roomForce,
+            .integrator = data->physics.integrator,
+            .leaderIdx = -1,
+            .leaderKv = data->particles.leaderKv
+        };
+        integrate_run(data->physics.kernel, &params, 0, rank->owned);
+
+        // Instance data to rank 0, before anything migrates
+        Mailbox *gather = &g_domain.mail[1][r][0];
+        size_t at = beginMessage(gather, MSG_GATHER, r);
+        uint8_t *p = mailReserve(gather, rank->owned * WIRE_GATHER_SIZE);
+        for (int i = 0; i < rank->owned; ++i) {
+            p = putVec3(p, rank->pos[i]);
+            *p++ = (uint8_t) rank->swarm[i];
+        }
+        endMessage(gather, at, rank->owned, &rank->stats);
+
+        // Particles that left the slab move to the neighbor, the last one fills the gap
+        int to[2] = { r - 1, r + 1 };
+        size_t msg[2] = { 0, 0 };
+        int sent[2] = { 0, 0 };
+        for (int side = 0; side < 2; ++side) {
+            if (to[side] >= 0 && to[side] < g_domain.ranks) {
+                msg[side] = beginMessage(&g_domain.mail[1][r][to[side]], MSG_MIGRANTS, r);
+            }
+        }
+
+        for (int i = rank->owned - 1; i >= 0; --i) {
+            float x = rank->pos[i][0];
+            int side = (x < rank->lo && r > 0) ? 0 : (x >= rank->hi && r < g_domain.ranks - 1) ? 1 : -1;
+            if (side < 0) {
+                continue;
+            }
+
+            p = mailReserve(&g_domain.mail[1][r][to[side]], WIRE_MIGRANT_SIZE);
+            p = putVec3(p, rank->pos[i]);
+            p = putVec3(p, rank->velocity[i]);
+            p = putF32(p, rank->kWeak[i]);
+            p = putF32(p, rank->kV[i]);
+            putI32(p, rank->swarm[i]);
+            sent[side]++;
+
+            int last = --rank->owned;
+            glm_vec3_copy(rank->pos[last], rank->pos[i]);
+            glm_vec3_copy(rank->velocity[last], rank->velocity[i]);
+            glm_vec3_copy(rank->acceleration[last], rank->acceleration[i]);
+            rank->kWeak[i] = rank->kWeak[last];
+            rank->kV[i] = rank->kV[last];
+            rank->swarm[i] = rank->swarm[last];
+        }
+        rank->size = rank->owned;
+
+        for (int side = 0; side < 2; ++side) {
+            if (to[side] >= 0 && to[side] < g_domain.ranks) {
+                endMessage(&g_domain.mail[1][r][to[side]], msg[side], sent[side], &rank->stats);
+                rank->stats.migrants += sent[side];
+            }
+        }
+    }
+}
+
+/**
+ * Phase 3: takes in the migrated particles, rank 0 also the instance data.
+ * @param begin First rank.
+ * @param end One past the last rank.
+ * @param chunk Unused.
+ * @param userData Unused.
+ */
+static void receiveJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    NK_UNUSED(userData);
+
+    for (int r = begin; r < end; ++r) {
+        Rank *rank = &g_domain.rank[r];
+        if (r == 0) {
+            g_domain.gathered = 0;
+        }
+
+        drainMail(1, r);
+        rank->owned = rank->size;
+    }
+}
+
+#ifdef DOMAIN_PROCESSES
+
+/** Progress of the exchange with one peer */
+typedef struct {
+    uint8_t outHeader[4];
+    uint8_t inHeader[4];
+    size_t outSize;     // payload of the outgoing mailbox
+    size_t sent;        // header and payload bytes sent
+    size_t inSize;      // payload announced by the peer
+    size_t received;    // header and payload bytes received
+    uint8_t *in;        // payload destination in the incoming mailbox
+} Exchange;
+
+/**
+ * Writes all bytes to a blocking socket.
+ * @param fd Socket.
+ * @param bytes Data.
+ * @param size Number of bytes.
+ * @return False if the peer is gone.
+ */
+static bool writeAll(int fd, const void *bytes, size_t size) {
+    const uint8_t *p = bytes;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= (size_t) n;
+    }
+    return true;
+}
+
+/**
+ * Reads exactly size bytes from a blocking socket.
+ * @param fd Socket.
+ * @param bytes Destination.
+ * @param size Number of bytes.
+ * @return False if the peer is gone.
+ */
+static bool readAll(int fd, void *bytes, size_t size) {
+    uint8_t *p = bytes;
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= (size_t) n;
+    }
+    return true;
+}
+
+/**
+ * Sends what is left of the mailbox to a peer without blocking.
+ * @param e Exchange with the peer.
+ * @param fd Socket of the peer.
+ * @param m Outgoing mailbox.
+ * @return False if the peer is gone.
+ */
+static bool sendSome(Exchange *e, int fd, const Mailbox *m) {
+    const uint8_t *p = e->sent < 4 ? e->outHeader + e->sent : m->data + (e->sent - 4);
+    size_t size = e->sent < 4 ? 4 - e->sent : e->outSize - (e->sent - 4);
+    ssize_t n = send(fd, p, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    e->sent += (size_t) n;
+    return true;
+}
+
+/**
+ * Receives what is available from a peer without blocking. The payload
+ * is appended to the incoming mailbox once its length is known.
+ * @param e Exchange with the peer.
+ * @param fd Socket of the peer.
+ * @param m Incoming mailbox.
+ * @return False if the peer is gone.
+ */
+static bool receiveSome(Exchange *e, int fd, Mailbox *m) {
+    uint8_t *p = e->received < 4 ? e->inHeader + e->received : e->in + (e->received - 4);
+    size_t size = e->received < 4 ? 4 - e->received : e->inSize - (e->received - 4);
+    ssize_t n = recv(fd, p, size, MSG_DONTWAIT);
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    if (n == 0) {
+        return false;
+    }
+
+    e->received += (size_t) n;
+    if (e->received == 4) {
+        uint32_t length;
+        memcpy(&length, e->inHeader, 4);
+        e->inSize = length;
+        e->in = mailReserve(m, length);
+    }
+    return true;
+}
+
+/**
+ * Moves a mailbox set between this process and all other ranks. Every
+ * peer gets the mailbox addressed to it as one length prefixed payload,
+ * empty ones included, so both sides know when the exchange is over.
+ * All peers are served at once, a full socket never blocks the others.
+ * @param set Mailbox set.
+ * @return False if a peer is gone.
+ */
+static bool exchangeMail(int set) {
+    int self = g_domain.self;
+    Exchange exchange[DOMAIN_MAX_RANKS] = { 0 };
+    for (int peer = 0; peer < g_domain.ranks; ++peer) {
+        uint32_t length = (uint32_t) g_domain.mail[set][self][peer].size;
+        memcpy(exchange[peer].outHeader, &length, 4);
+        exchange[peer].outSize = length;
+    }
+
+    for (;;) {
+        struct pollfd fds[DOMAIN_MAX_RANKS];
+        int peers[DOMAIN_MAX_RANKS];
+        int count = 0;
+        for (int peer = 0; peer < g_domain.ranks; ++peer) {
+            Exchange *e = &exchange[peer];
+            short events = 0;
+            if (peer != self && e->sent < 4 + e->outSize) {
+                events |= POLLOUT;
+            }
+            if (peer != self && (e->received < 4 || e->received < 4 + e->inSize)) {
+                events |= POLLIN;
+            }
+            if (events) {
+                fds[count] = (struct pollfd) { .fd = g_domain.fd[peer], .events = events };
+                peers[count++] = peer;
+            }
+        }
+        if (count == 0) {
+            break;
+        }
+
+        if (poll(fds, count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            int peer = peers[i];
+            short revents = fds[i].revents;
+            if ((revents & (POLLERR | POLLNVAL)) || ((revents & POLLHUP) && !(revents & POLLIN))) {
+                return false;
+            }
+            if ((revents & POLLOUT) && !sendSome(&exchange[peer], fds[i].fd, &g_domain.mail[set][self][peer])) {
+                return false;
+            }
+            if ((revents & POLLIN) && !receiveSome(&exchange[peer], fds[i].fd, &g_domain.mail[set][peer][self])) {
+                return false;
+            }
+        }
+    }
+
+    for (int peer = 0; peer < g_domain.ranks; ++peer) {
+        if (peer != self) {
+            g_domain.mail[set][self][peer].size = 0;
+        }
+    }
+    return true;
+}
+
+/**
+ * Runs the three phases of one step on the rank of this process.
+ * @return False if a peer is gone.
+ */
+static bool stepProcess(void) {
+    int self = g_domain.self;
+    sendJob(self, self + 1, 0, NULL);
+    if (!exchangeMail(0)) {
+        return false;
+    }
+    stepJob(self, self + 1, 0, NULL);
+    if (!exchangeMail(1)) {
+        return false;
+    }
+    receiveJob(self, self + 1, 0, NULL);
+    return true;
+}
+
+/**
+ * Command loop of a worker process, runs its rank until rank 0 quits or is gone.
+ * @param self Rank of the worker.
+ */
+static void runWorker(int self) {
+    InputData data;
+    vec3 *spheres = NULL;
+    g_domain.self = self;
+    g_domain.data = &data;
+
+    for (;;) {
+        uint32_t command;
+        int32_t numSpheres;
+        if (!readAll(g_domain.fd[0], &command, 4) || command != COMMAND_STEP
+            || !readAll(g_domain.fd[0], &data, sizeof(InputData))
+            || !readAll(g_domain.fd[0], &numSpheres, 4)) {
+            break;
+        }
+
+        spheres = realloc(spheres, glm_imax(numSpheres, 1) * sizeof(vec3));
+        assert(spheres && "realloc failed in domain runWorker");
+        if (!readAll(g_domain.fd[0], spheres, numSpheres * sizeof(vec3))) {
+            break;
+        }
+        g_domain.spheres = spheres;
+        g_domain.numSpheres = numSpheres;
+
+        if (!stepProcess() || !writeAll(g_domain.fd[0], &g_domain.rank[self].stats, sizeof(DomainStats))) {
+            break;
+        }
+    }
+
+    // Only the memory of this process, nothing is flushed twice
+    _exit(0);
+}
+
+/**
+ * Frees the particles of a rank that runs in another process.
+ * @param r Rank.
+ */
+static void releaseRank(Rank *r) {
+    free(r->pos);
+    free(r->velocity);
+    free(r->acceleration);
+    free(r->kWeak);
+    free(r->kV);
+    free(r->swarm);
+    float lo = r->lo, hi = r->hi;
+    memset(r, 0, sizeof(Rank));
+    r->lo = lo;
+    r->hi = hi;
+}
+
+/**
+ * Quits the worker processes and waits for them.
+ */
+static void stopWorkers(void) {
+    uint32_t command = COMMAND_QUIT;
+    for (int r = 0; r < g_domain.ranks; ++r) {
+        if (g_domain.fd[r] >= 0) {
+            writeAll(g_domain.fd[r], &command, 4);
+            close(g_domain.fd[r]);
+        }
+    }
+    for (int r = 1; r < g_domain.ranks; ++r) {
+        waitpid(g_domain.pid[r], NULL, 0);
+    }
+    g_domain.processes = false;
+}
+
+/**
+ * Forks a worker process for every rank but 0 and connects all ranks with
+ * each other. The spawned particles are inherited, every process then
+ * frees the ranks it doesn't run.
+ * @return False if a socket or process could not be created, all ranks
+ *         stay in this process then.
+ */
+static bool startWorkers(void) {
+    int ranks = g_domain.ranks;
+    int fds[DOMAIN_MAX_RANKS][DOMAIN_MAX_RANKS];   // [own rank][peer]
+    memset(fds, -1, sizeof(fds));
+
+    bool ok = true;
+    for (int a = 0; a < ranks && ok; ++a) {
+        for (int b = a + 1; b < ranks && ok; ++b) {
+            int pair[2];
+            ok = socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0;
+            if (ok) {
+                fds[a][b] = pair[0];
+                fds[b][a] = pair[1];
+            }
+        }
+    }
+
+    // Both ends of every pair stay open until all workers are forked
+    for (int r = 1; r < ranks && ok; ++r) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            ok = false;
+            break;
+        }
+        if (pid == 0) {
+            for (int a = 0; a < ranks; ++a) {
+                for (int b = 0; b < ranks; ++b) {
+                    if (a != r && fds[a][b] >= 0) {
+                        close(fds[a][b]);
+                    }
+                }
+                g_domain.fd[a] = fds[r][a];
+                g_domain.pid[a] = 0;
+                if (a != r) {
+                    releaseRank(&g_domain.rank[a]);
+                }
+            }
+            free(g_domain.gatherPos);
+            free(g_domain.gatherSwarm);
+            g_domain.gatherPos = NULL;
+            g_domain.gatherSwarm = NULL;
+            g_domain.processes = true;
+            runWorker(r);
+        }
+        g_domain.pid[r] = pid;
+    }
+
+    // Without rank 0 on the other end the workers already forked exit
+    for (int a = 0; a < ranks; ++a) {
+        for (int b = 0; b < ranks; ++b) {
+            if ((a != 0 || !ok) && fds[a][b] >= 0) {
+                close(fds[a][b]);
+            }
+        }
+    }
+    if (!ok) {
+        for (int r = 1; r < ranks; ++r) {
+            if (g_domain.pid[r] > 0) {
+                waitpid(g_domain.pid[r], NULL, 0);
+                g_domain.pid[r] = 0;
+            }
+        }
+        return false;
+    }
+
+    for (int r = 0; r < ranks; ++r) {
+        g_domain.fd[r] = fds[0][r];
+        if (r > 0) {
+            releaseRank(&g_domain.rank[r]);
+        }
+    }
+    g_domain.processes = true;
+    return true;
+}
+
+/**
+ * Runs one step with the ranks in worker processes, driven by rank 0.
+ * @return False if a worker is gone.
+ */
+static bool stepWorkers(void) {
+    uint32_t command = COMMAND_STEP;
+    int32_t numSpheres = g_domain.numSpheres;
+    for (int r = 1; r < g_domain.ranks; ++r) {
+        int fd = g_domain.fd[r];
+        if (!writeAll(fd, &command, 4) || !writeAll(fd, g_domain.data, sizeof(InputData))
+            || !writeAll(fd, &numSpheres, 4) || !writeAll(fd, g_domain.spheres, numSpheres * sizeof(vec3))) {
+            return false;
+        }
+    }
+
+    if (!stepProcess()) {
+        return false;
+    }
+
+    // The answers also mark the end of the step on every worker
+    for (int r = 1; r < g_domain.ranks; ++r) {
+        if (!readAll(g_domain.fd[r], &g_domain.rank[r].stats, sizeof(DomainStats))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif // DOMAIN_PROCESSES
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool domain_init(InputData *data, int ranks) {
+    for (int s = 0; s < data->particles.swarmCount; ++s) {
+        TargetMode mode = data->particles.swarms[s].targetMode;
+        if (mode != TM_SPHERES && mode != TM_CENTER && mode != TM_FLOCK) {
+            return false;
+        }
+    }
+
+    domain_cleanup();
+    g_domain.ranks = CLAMP(ranks, 1, DOMAIN_MAX_RANKS);
+    g_domain.data = data;
+
+    float halfSize = data->rendering.roomSize;
+    float width = 2.0f * halfSize / g_domain.ranks;
+    for (int r = 0; r < g_domain.ranks; ++r) {
+        g_domain.rank[r].lo = -halfSize + r * width;
+        g_domain.rank[r].hi = -halfSize + (r + 1) * width;
+    }
+
+    g_domain.total = 0;
+    for (int s = 0; s < data->particles.swarmCount; ++s) {
+        SwarmSettings *settings = &data->particles.swarms[s];
+        for (int n = 0; n < settings->count; ++n) {
+            vec3 pos = { RAND(-0.95f, 0.95f), RAND(-0.95f, 0.95f), RAND(-0.95f, 0.95f) };
+            glm_vec3_scale(pos, halfSize, pos);
+
+            Rank *r = &g_domain.rank[rankOf(pos[0])];
+            ensureCapacity(r, r->owned + 1);
+            int i = r->owned++;
+            glm_vec3_copy(pos, r->pos[i]);
+            vec3 dir = { RAND(-1, 1), RAND(-1, 1), RAND(-1, 1) };
+            glm_vec3_normalize_to(dir, r->velocity[i]);
+            glm_vec3_zero(r->acceleration[i]);
+            r->kWeak[i] = RAND(settings->kWeakMin, settings->kWeakMax);
+            r->kV[i] = RAND(settings->kvMin, settings->kvMax);
+            r->swarm[i] = s;
+            r->size = r->owned;
+        }
+        g_domain.total += settings->count;
+    }
+
+    g_domain.gatherPos = malloc(glm_imax(g_domain.total, 1) * sizeof(vec3));
+    g_domain.gatherSwarm = malloc(glm_imax(g_domain.total, 1) * sizeof(int));
+    assert(g_domain.gatherPos && g_domain.gatherSwarm && "malloc failed in domain_init");
+
+#ifdef DOMAIN_PROCESSES
+    memset(g_domain.fd, -1, sizeof(g_domain.fd));
+    if (g_domain.ranks > 1 && !startWorkers()) {
+        printf("Domain: worker processes not started, running the ranks as jobs\n");
+    }
+#endif
+    return true;
+}
+
+bool domain_step(InputData *data, vec3 *spheres, int numSpheres) {
+    g_domain.data = data;
+    g_domain.spheres = spheres;
+    g_domain.numSpheres = numSpheres;
+
+#ifdef DOMAIN_PROCESSES
+    if (g_domain.processes) {
+        return stepWorkers();
+    }
+#endif
+
+    // Every phase finishes on all ranks before the next one starts
+    jobs_parallelFor(g_domain.ranks, 1, sendJob, NULL);
+    jobs_parallelFor(g_domain.ranks, 1, stepJob, NULL);
+    jobs_parallelFor(g_domain.ranks, 1, receiveJob, NULL);
+    return true;
+}
+
+bool domain_usesProcesses(void) {
+#ifdef DOMAIN_PROCESSES
+    return g_domain.processes;
+#else
+    return false;
+#endif
+}
+
+int domain_getGathered(vec3 **pos, int **swarm) {
+    if (pos) {
+        *pos = g_domain.gatherPos;
+    }
+    if (swarm) {
+        *swarm = g_domain.gatherSwarm;
+    }
+    return g_domain.gathered;
+}
+
+void domain_getStats(DomainStats *stats) {
+    memset(stats, 0, sizeof(DomainStats));
+    for (int r = 0; r < g_domain.ranks; ++r) {
+        stats->ghosts += g_domain.rank[r].stats.ghosts;
+        stats->migrants += g_domain.rank[r].stats.migrants;
+        stats->bytes += g_domain.rank[r].stats.bytes;
+    }
+}
+
+void domain_cleanup(void) {
+#ifdef DOMAIN_PROCESSES
+    if (g_domain.processes) {
+        stopWorkers();
+    }
+#endif
+
+    for (int r = 0; r < DOMAIN_MAX_RANKS; ++r) {
+        Rank *rank = &g_domain.rank[r];
+        free(rank->pos);
+        free(rank->velocity);
+        free(rank->acceleration);
+        free(rank->kWeak);
+        free(rank->kV);
+        free(rank->swarm);
+        grid_free(&rank->grid);
+
+        for (int set = 0; set < MAIL_SETS; ++set) {
+            for (int to = 0; to < DOMAIN_MAX_RANKS; ++to) {
+                free(g_domain.mail[set][r][to].data);
+            }
+        }
+    }
+
+    free(g_domain.gatherPos);
+    free(g_domain.gatherSwarm);
+    memset(&g_domain, 0, sizeof(g_domain));
+}
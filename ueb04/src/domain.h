@@ -0,0 +1,81 @@
+/**
+ * @file domain.h
+ * @brief Particle update decomposed into slabs owned by separate ranks
+ *
+ * The room is cut along x into one slab per rank. Every rank owns the
+ * particles inside its slab in its own structure-of-arrays store and only
+ * talks to the others through messages in a compact binary wire format:
+ * ghosts near the slab borders, particles migrating into a neighbor slab,
+ * partial swarm sums and, for rank 0, the instance data to draw.
+ *
+ * On POSIX systems the ranks 1.. run in worker processes and the messages
+ * travel over sockets, rank 0 runs in the calling process. Elsewhere, or
+ * if the workers can't be started, all ranks are jobs of the thread pool.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#include <fhwcg/fhwcg.h>
+#include "input.h"
+
+/** Upper bound of ranks */
+#define DOMAIN_MAX_RANKS 16
+
+/** Traffic of the last step */
+typedef struct {
+    int ghosts;         // ghost particles sent
+    int migrants;       // particles that changed their slab
+    size_t bytes;       // encoded bytes of all messages
+} DomainStats;
+
+/**
+ * Splits the room into slabs and spawns the swarms of the input state,
+ * every particle into the rank owning its position, then starts the
+ * worker processes that take over the ranks 1.. with their particles.
+ * Supports TM_SPHERES, TM_CENTER and TM_FLOCK.
+ * @param data Input state with the swarms and simulation parameters.
+ * @param ranks Number of ranks, at most DOMAIN_MAX_RANKS.
+ * @return False if a swarm uses an unsupported target mode.
+ */
+bool domain_init(InputData *data, int ranks);
+
+/**
+ * Runs one fixed step on all ranks, returns when every rank is done.
+ * Exchanges ghosts, steers and integrates the owned particles, migrates
+ * the particles that left their slab and gathers the instance data on rank 0.
+ * @param data Input state containing simulation parameters.
+ * @param spheres Attractor positions for TM_SPHERES.
+ * @param numSpheres Number of attractors.
+ * @return False if a worker process is gone, the particles of its rank are lost.
+ */
+bool domain_step(InputData *data, vec3 *spheres, int numSpheres);
+
+/**
+ * Returns if the ranks 1.. run in worker processes.
+ * @return False if all ranks are jobs of the thread pool.
+ */
+bool domain_usesProcesses(void);
+
+/**
+ * Returns the instance data gathered on rank 0 by the last step.
+ * @param pos Destination for the position column, may be NULL.
+ * @param swarm Destination for the swarm id column, may be NULL.
+ * @return Number of gathered particles.
+ */
+int domain_getGathered(vec3 **pos, int **swarm);
+
+/**
+ * Returns the message traffic of the last step.
+ * @param stats Destination for the traffic.
+ */
+void domain_getStats(DomainStats *stats);
+
+/**
+ * Quits the worker processes and frees all ranks and their mailboxes.
+ */
+void domain_cleanup(void);
+
+#endif // DOMAIN_H
@@ -0,0 +1,117 @@
+/**
+ * @file field.c
+ * @brief Implementation of the attractor force field
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "field.h"
+#include "utils.h"
+
+/** Weight below which an attractor is not splatted, exp(-9.2) ~ 1e-4 */
+#define FIELD_CUTOFF_EXP 9.2f
+
+/** Minimum distance for a direction, see getTargetAcceleration */
+#define FIELD_MIN_DIST 1e-5f
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Converts a coordinate into continuous node space.
+ * @param f Field.
+ * @param v Coordinate.
+ * @return Node coordinate in [0, dim - 1].
+ */
+static inline float toNode(const ForceField *f, float v) {
+    float n = (v + f->halfSize) / f->nodeSpacing;
+    return CLAMP(n, 0.0f, (float)(f->dim - 1));
+}
+
+/**
+ * Adds one attractor to all nodes within its cutoff radius.
+ * @param f Field.
+ * @param center Attractor position.
+ * @param gaussianConst Weight falloff.
+ */
+static void splat(ForceField *f, const vec3 center, float gaussianConst) {
+    int dim = f->dim;
+    float radius = sqrtf(FIELD_CUTOFF_EXP * gaussianConst);
+
+    int lo[3], hi[3];
+    for (int a = 0; a < 3; ++a) {
+        lo[a] = (int)floorf(toNode(f, center[a] - radius));
+        hi[a] = (int)ceilf(toNode(f, center[a] + radius));
+    }
+
+    for (int z = lo[2]; z <= hi[2]; ++z) {
+        for (int y = lo[1]; y <= hi[1]; ++y) {
+            for (int x = lo[0]; x <= hi[0]; ++x) {
+                vec3 node = {
+                    -f->halfSize + x * f->nodeSpacing,
+                    -f->halfSize + y * f->nodeSpacing,
+                    -f->halfSize + z * f->nodeSpacing
+                };
+
+                vec3 diff;
+                glm_vec3_sub((float*)center, node, diff);
+                float dist2 = glm_vec3_norm2(diff);
+                float dist = sqrtf(dist2);
+                if (dist <= FIELD_MIN_DIST) {
+                    continue;
+                }
+
+                float g = expf(-dist2 / gaussianConst);
+                glm_vec3_muladds(diff, g / dist, f->force[(z * dim + y) * dim + x]);
+            }
+        }
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void field_build(ForceField *f, vec3 *centers, int count, float halfSize, float gaussianConst) {
+    int dim = FIELD_DIM;
+    int numNodes = dim * dim * dim;
+
+    if (f->capacity < numNodes) {
+        free(f->force);
+        f->force = malloc(numNodes * sizeof(vec3));
+        assert(f->force && "malloc failed in field_build");
+        f->capacity = numNodes;
+    }
+
+    f->dim = dim;
+    f->halfSize = halfSize;
+    f->nodeSpacing = 2.0f * halfSize / (dim - 1);
+
+    memset(f->force, 0, numNodes * sizeof(vec3));
+    for (int i = 0; i < count; ++i) {
+        splat(f, centers[i], gaussianConst);
+    }
+}
+
+void field_sample(const ForceField *f, const vec3 pos, vec3 dest) {
+    int dim = f->dim;
+    float n[3] = { toNode(f, pos[0]), toNode(f, pos[1]), toNode(f, pos[2]) };
+
+    // Lower corner of the cell, the last node only as upper corner
+    int c[3];
+    float t[3];
+    for (int a = 0; a < 3; ++a) {
+        c[a] = (int)n[a] < dim - 2 ? (int)n[a] : dim - 2;
+        t[a] = n[a] - c[a];
+    }
+
+    glm_vec3_zero(dest);
+    for (int corner = 0; corner < 8; ++corner) {
+        int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+        float w = (dx ? t[0] : 1.0f - t[0]) * (dy ? t[1] : 1.0f - t[1]) * (dz ? t[2] : 1.0f - t[2]);
+        int idx = ((c[2] + dz) * dim + c[1] + dy) * dim + c[0] + dx;
+        glm_vec3_muladds(f->force[idx], w, dest);
+    }
+}
+
+void field_free(ForceField *f) {
+    free(f->force);
+    memset(f, 0, sizeof(ForceField));
+}
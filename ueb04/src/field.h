@@ -0,0 +1,56 @@
+/**
+ * @file field.h
+ * @brief Attractor force field on a uniform node grid, rebuilt every step
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef FIELD_H
+#define FIELD_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Nodes per axis of the force field */
+#define FIELD_DIM 32
+
+/**
+ * Gaussian weighted attractor directions sampled at dim^3 nodes
+ * spanning the cube [-halfSize, halfSize]^3, first node at a corner.
+ * A sample is the TM_SPHERES acceleration of a particle with kWeak 1.
+ */
+typedef struct {
+    int dim;
+    float halfSize;
+    float nodeSpacing;
+
+    vec3 *force;        // dim^3 entries, x fastest
+    int capacity;
+} ForceField;
+
+/**
+ * Rebuilds the field from the current attractor positions.
+ * Every attractor is splatted into the nodes where its weight is not negligible,
+ * so the cost is independent of the number of particles.
+ * @param f Field to rebuild.
+ * @param centers Attractor positions.
+ * @param count Number of attractors.
+ * @param halfSize Half-extent of the room.
+ * @param gaussianConst Weight falloff, g = exp(-dist^2 / gaussianConst).
+ */
+void field_build(ForceField *f, vec3 *centers, int count, float halfSize, float gaussianConst);
+
+/**
+ * Samples the field trilinearly, positions outside are clamped to the room.
+ * @param f Built field.
+ * @param pos Position to sample.
+ * @param dest Destination for the force.
+ */
+void field_sample(const ForceField *f, const vec3 pos, vec3 dest);
+
+/**
+ * Frees all field memory.
+ * @param f Field to free.
+ */
+void field_free(ForceField *f);
+
+#endif // FIELD_H
@@ -0,0 +1,216 @@
+/**
+ * @file framepacer.c
+ * @brief Implementation of the low-latency frame pacing
+ *
+ * A frame counts as presented once the fence placed after its swap has
+ * signaled. With one frame in flight the wait for that fence follows the
+ * flip, so its time anchors the vsync prediction. With more frames in
+ * flight, or with the mode disabled, fences are only polled and the
+ * measured latency is an upper bound of up to one frame.
+ *
+ * Sleeps are done in 1 ms steps, which the scheduler may overshoot on some
+ * systems; the adaptive margin covers that as well.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "framepacer.h"
+#include "profiler.h"
+#include "thread.h"
+
+/** Fences tracked at once, more frames in flight are waited for */
+#define FENCE_RING 8
+
+/** Longest wait for a fence in ns, a lost fence must not hang the loop */
+#define FENCE_TIMEOUT_NS 100000000ull
+
+/** Refresh rate if the monitor reports none */
+#define DEFAULT_REFRESH_HZ 60
+
+/** Weight of the newest frame in the smoothed estimates */
+#define SMOOTHING 0.1f
+
+/** Margin limits and steps in ms */
+#define MARGIN_MIN_MS 0.5f
+#define MARGIN_MISS_STEP_MS 1.0f
+#define MARGIN_HIT_STEP_MS 0.01f
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * A swapped frame whose fence has not been seen signaled yet.
+ */
+typedef struct {
+    GLsync fence;
+    double sampleTime;
+} PendingFrame;
+
+/**
+ * Pacer state.
+ */
+static struct {
+    bool enabled;
+    int maxQueued;
+    double period;              // vsync period in seconds
+
+    PendingFrame pending[FENCE_RING];
+    int first, count;
+
+    double sampleTime;          // input sample of the current frame
+    double lastPresent;         // 0 until the first frame was presented
+    float workMs;
+
+    FramePacerStats stats;
+} g_pacer = {
+    .enabled = false,
+    .maxQueued = 1,
+    .stats.marginMs = FRAMEPACER_MARGIN_MS
+};
+
+/**
+ * Updates the estimates for a presented frame.
+ * @param sampleTime Input sample of the frame.
+ * @param now Time the frame was seen presented.
+ */
+static void presentFrame(double sampleTime, double now) {
+    FramePacerStats *s = &g_pacer.stats;
+    if (g_pacer.lastPresent > 0.0) {
+        double interval = now - g_pacer.lastPresent;
+        s->frameMs += SMOOTHING * ((float) (interval * 1000.0) - s->frameMs);
+
+        // Longer gaps are sleeps of the idle mode, not misses
+        if (g_pacer.enabled && interval < g_pacer.period * 4.0) {
+            float maxMargin = (float) (g_pacer.period * 500.0);
+            if (interval > g_pacer.period * 1.5) {
+                s->marginMs = glm_min(s->marginMs + MARGIN_MISS_STEP_MS, maxMargin);
+            } else {
+                s->marginMs = glm_max(s->marginMs - MARGIN_HIT_STEP_MS, MARGIN_MIN_MS);
+            }
+        }
+    }
+    s->latencyMs += SMOOTHING * ((float) ((now - sampleTime) * 1000.0) - s->latencyMs);
+    g_pacer.lastPresent = now;
+}
+
+/**
+ * Retires signaled fences, waiting for the oldest ones while more than
+ * keep frames are in flight.
+ * @param keep Frames that may stay in flight.
+ */
+static void retireFrames(int keep) {
+    while (g_pacer.count > 0) {
+        PendingFrame *f = &g_pacer.pending[g_pacer.first];
+        bool wait = g_pacer.count > keep;
+        GLenum result = glClientWaitSync(f->fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? FENCE_TIMEOUT_NS : 0);
+        if (result == GL_TIMEOUT_EXPIRED && !wait) {
+            break;
+        }
+
+        // A fence that timed out or failed is dropped without an estimate
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+            presentFrame(f->sampleTime, glfwGetTime());
+        }
+        glDeleteSync(f->fence);
+        g_pacer.first = (g_pacer.first + 1) % FENCE_RING;
+        --g_pacer.count;
+    }
+}
+
+/**
+ * Sleeps until the given time, the last FRAMEPACER_SPIN_MS are spun.
+ * @param wake Time to return at.
+ */
+static void sleepUntil(double wake) {
+    while (wake - glfwGetTime() > FRAMEPACER_SPIN_MS / 1000.0) {
+        THREAD_SLEEP_MS(1);
+    }
+    while (glfwGetTime() < wake) {
+        // spin
+    }
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void framepacer_init(void) {
+    GLFWmonitor *monitor = glfwGetPrimaryMonitor();
+    const GLFWvidmode *mode = monitor ? glfwGetVideoMode(monitor) : NULL;
+    int hz = mode && mode->refreshRate > 0 ? mode->refreshRate : DEFAULT_REFRESH_HZ;
+    g_pacer.period = 1.0 / hz;
+}
+
+void framepacer_cleanup(void) {
+    while (g_pacer.count > 0) {
+        glDeleteSync(g_pacer.pending[g_pacer.first].fence);
+        g_pacer.first = (g_pacer.first + 1) % FENCE_RING;
+        --g_pacer.count;
+    }
+}
+
+void framepacer_beginFrame(void) {
+    g_pacer.sampleTime = glfwGetTime();
+}
+
+void framepacer_endFrame(void) {
+    float cpuMs = (float) ((glfwGetTime() - g_pacer.sampleTime) * 1000.0);
+    float profCpuMs, gpuMs;
+    profiler_getLastFrameWork(&profCpuMs, &gpuMs);
+
+    // Rises at once, so a slow frame does not miss the next vsync as well
+    float workMs = fmaxf(cpuMs, gpuMs);
+    if (workMs > g_pacer.workMs) {
+        g_pacer.workMs = workMs;
+    } else {
+        g_pacer.workMs += SMOOTHING * (workMs - g_pacer.workMs);
+    }
+    g_pacer.stats.workMs = g_pacer.workMs;
+}
+
+void framepacer_wait(bool idle) {
+    if (g_pacer.count == FENCE_RING) {
+        retireFrames(FENCE_RING - 1);
+    }
+    int slot = (g_pacer.first + g_pacer.count) % FENCE_RING;
+    g_pacer.pending[slot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    g_pacer.pending[slot].sampleTime = g_pacer.sampleTime;
+    ++g_pacer.count;
+
+    retireFrames(g_pacer.enabled ? g_pacer.maxQueued - 1 : FENCE_RING);
+    g_pacer.stats.queued = g_pacer.count;
+
+    if (!g_pacer.enabled || idle || g_pacer.lastPresent <= 0.0) {
+        g_pacer.stats.sleepMs = 0.0f;
+        return;
+    }
+
+    // The first vsync the next frame can still make, less its work and the margin
+    double lead = (g_pacer.workMs + g_pacer.stats.marginMs) / 1000.0;
+    double now = glfwGetTime();
+    double deadline = g_pacer.lastPresent + g_pacer.period;
+    while (deadline - lead < now) {
+        deadline += g_pacer.period;
+    }
+    double wake = deadline - lead;
+    sleepUntil(wake);
+    g_pacer.stats.sleepMs += SMOOTHING * ((float) ((wake - now) * 1000.0) - g_pacer.stats.sleepMs);
+}
+
+void framepacer_setEnabled(bool enabled) {
+    g_pacer.enabled = enabled;
+    g_pacer.stats.marginMs = FRAMEPACER_MARGIN_MS;
+}
+
+bool framepacer_isEnabled(void) {
+    return g_pacer.enabled;
+}
+
+void framepacer_setMaxQueued(int frames) {
+    g_pacer.maxQueued = glm_imin(glm_imax(frames, 1), FRAMEPACER_MAX_QUEUED);
+}
+
+int framepacer_getMaxQueued(void) {
+    return g_pacer.maxQueued;
+}
+
+void framepacer_getStats(FramePacerStats *stats) {
+    *stats = g_pacer.stats;
+}
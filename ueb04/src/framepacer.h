@@ -0,0 +1,107 @@
+/**
+ * @file framepacer.h
+ * @brief Low-latency frame pacing with late input latching
+ *
+ * Without pacing the loop polls input, draws and swaps as early as it can,
+ * so with vsync the driver queues finished frames and the input of a frame
+ * reaches the screen one or more refreshes later. In the low-latency mode
+ * a fence after every swap limits the frames in flight, and the loop sleeps
+ * until the work of the next frame just fits before the predicted vsync.
+ * Events are polled, and the camera and physics sampled, only after that
+ * sleep.
+ *
+ * The vsync is predicted from the refresh rate of the monitor and the time
+ * the fence of the last frame signaled. A missed refresh widens the margin
+ * kept before the deadline, every frame on time narrows it again.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Most frames in flight that can be selected */
+#define FRAMEPACER_MAX_QUEUED 3
+
+/** Margin before the deadline in ms, the start of the adaptation */
+#define FRAMEPACER_MARGIN_MS 2.0f
+
+/** Sleeps end this many ms early, the rest is spun for precision */
+#define FRAMEPACER_SPIN_MS 1.5
+
+/**
+ * Timing estimates, all smoothed over the recent frames.
+ */
+typedef struct {
+    float frameMs;              // time between two presented frames
+    float latencyMs;            // input sample to present of the same frame
+    float workMs;               // predicted CPU or GPU time of a frame, whichever is longer
+    float marginMs;             // kept before the predicted vsync
+    float sleepMs;              // slept before the input sample
+    int queued;                 // frames in flight after the last swap
+} FramePacerStats;
+
+/**
+ * Initializes the pacer, needs a current GL context.
+ */
+void framepacer_init(void);
+
+/**
+ * Deletes the pending fences.
+ */
+void framepacer_cleanup(void);
+
+/**
+ * Marks the input sample of the frame, call right after window_startNewFrame.
+ */
+void framepacer_beginFrame(void);
+
+/**
+ * Ends the work of the frame, call after profiler_endFrame and right
+ * before window_swapBuffers.
+ */
+void framepacer_endFrame(void);
+
+/**
+ * Fences the swapped frame, waits until at most the selected number of
+ * frames is in flight and sleeps until the next frame just fits before the
+ * predicted vsync. Call after window_swapBuffers and before idle_wait.
+ * Disabled, only the fence is placed.
+ * @param idle Whether the loop goes idle, it sleeps in idle_wait instead.
+ */
+void framepacer_wait(bool idle);
+
+/**
+ * Enables or disables the low-latency mode. Disabled, the frames are
+ * still fenced to measure the latency, but never waited for.
+ * @param enabled True to pace the frames.
+ */
+void framepacer_setEnabled(bool enabled);
+
+/**
+ * Returns whether the low-latency mode is enabled.
+ * @return True if the frames are paced.
+ */
+bool framepacer_isEnabled(void);
+
+/**
+ * Sets the most frames in flight in the low-latency mode.
+ * @param frames Frames, clamped to [1, FRAMEPACER_MAX_QUEUED].
+ */
+void framepacer_setMaxQueued(int frames);
+
+/**
+ * Returns the most frames in flight in the low-latency mode.
+ * @return Frames.
+ */
+int framepacer_getMaxQueued(void);
+
+/**
+ * Returns the timing estimates.
+ * @param stats Receives the estimates.
+ */
+void framepacer_getStats(FramePacerStats *stats);
+
+#endif // FRAMEPACER_H
@@ -0,0 +1,124 @@
+/**
+ * @file grid.c
+ * @brief Implementation of the uniform neighbor grid
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "grid.h"
+#include "utils.h"
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Grows an array to at least the given number of elements.
+ * Contents are not preserved.
+ * @param ptr Pointer to the array pointer.
+ * @param capacity Current capacity, updated on growth.
+ * @param required Required number of elements.
+ * @param elemSize Size of one element.
+ */
+static void ensureCapacity(void **ptr, int *capacity, int required, size_t elemSize) {
+    if (*capacity >= required) {
+        return;
+    }
+
+    int newCap = *capacity ? *capacity * 2 : 64;
+    if (newCap < required) newCap = required;
+
+    free(*ptr);
+    *ptr = malloc(newCap * elemSize);
+    assert(*ptr && "malloc failed in grid ensureCapacity");
+    *capacity = newCap;
+}
+
+/**
+ * Converts one coordinate into a clamped cell coordinate.
+ * @param g Grid.
+ * @param v Coordinate.
+ * @return Cell coordinate in [0, dim).
+ */
+static inline int toCell(const Grid *g, float v) {
+    int c = (int)floorf((v + g->halfSize) / g->cellSize);
+    return CLAMP(c, 0, g->dim - 1);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void grid_build(Grid *g, vec3 *pos, vec3 *vel, int count, float halfSize, float cellSize) {
+    float size = 2.0f * halfSize;
+    int dim = (int)ceilf(size / fmaxf(cellSize, 1e-3f));
+    dim = CLAMP(dim, 1, GRID_MAX_DIM);
+
+    g->dim = dim;
+    g->halfSize = halfSize;
+    g->cellSize = size / dim;
+    g->count = count;
+
+    int numCells = dim * dim * dim;
+    int cellCap = g->cellCapacity;
+    ensureCapacity((void**)&g->cellStart, &cellCap, numCells + 1, sizeof(int));
+    g->cellCapacity = cellCap;
+
+    // All particle arrays share one capacity
+    if (g->particleCapacity < count) {
+        int cap = g->particleCapacity;
+        ensureCapacity((void**)&g->cellOf, &cap, count, sizeof(int));
+        cap = g->particleCapacity;
+        ensureCapacity((void**)&g->sortedIdx, &cap, count, sizeof(int));
+        cap = g->particleCapacity;
+        ensureCapacity((void**)&g->sortedPos, &cap, count, sizeof(vec3));
+        cap = g->particleCapacity;
+        ensureCapacity((void**)&g->sortedVel, &cap, count, sizeof(vec3));
+        g->particleCapacity = cap;
+    }
+
+    // 1. Count particles per cell
+    memset(g->cellStart, 0, (numCells + 1) * sizeof(int));
+    for (int i = 0; i < count; ++i) {
+        int c[3];
+        grid_cellCoords(g, pos[i], c);
+        int cell = (c[2] * dim + c[1]) * dim + c[0];
+        g->cellOf[i] = cell;
+        g->cellStart[cell + 1]++;
+    }
+
+    // 2. Prefix sum -> start of each cell
+    for (int c = 0; c < numCells; ++c) {
+        g->cellStart[c + 1] += g->cellStart[c];
+    }
+
+    // 3. Scatter, cellStart[c] is used as write cursor and restored below
+    for (int i = 0; i < count; ++i) {
+        int slot = g->cellStart[g->cellOf[i]]++;
+        g->sortedIdx[slot] = i;
+        glm_vec3_copy(pos[i], g->sortedPos[slot]);
+        glm_vec3_copy(vel[i], g->sortedVel[slot]);
+    }
+
+    for (int c = numCells; c > 0; --c) {
+        g->cellStart[c] = g->cellStart[c - 1];
+    }
+    g->cellStart[0] = 0;
+}
+
+void grid_cellCoords(const Grid *g, const vec3 pos, int cell[3]) {
+    cell[0] = toCell(g, pos[0]);
+    cell[1] = toCell(g, pos[1]);
+    cell[2] = toCell(g, pos[2]);
+}
+
+void grid_cellRange(const Grid *g, int x, int y, int z, int *begin, int *end) {
+    int cell = (z * g->dim + y) * g->dim + x;
+    *begin = g->cellStart[cell];
+    *end = g->cellStart[cell + 1];
+}
+
+void grid_free(Grid *g) {
+    free(g->cellStart);
+    free(g->cellOf);
+    free(g->sortedIdx);
+    free(g->sortedPos);
+    free(g->sortedVel);
+    memset(g, 0, sizeof(Grid));
+}
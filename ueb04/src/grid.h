@@ -0,0 +1,75 @@
+/**
+ * @file grid.h
+ * @brief Uniform grid for neighbor queries, rebuilt every step
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef GRID_H
+#define GRID_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Upper bound for cells per axis */
+#define GRID_MAX_DIM 64
+
+/**
+ * Uniform grid over the cube [-halfSize, halfSize]^3.
+ * Built with a counting sort: cellStart[c]..cellStart[c + 1] indexes
+ * the particles of cell c in the sorted arrays.
+ */
+typedef struct {
+    int dim;
+    float cellSize;
+    float halfSize;
+
+    int *cellStart;     // dim^3 + 1 entries
+    int *cellOf;        // cell index per particle
+    int *sortedIdx;     // particle index per sorted slot
+    vec3 *sortedPos;    // positions in sorted order
+    vec3 *sortedVel;    // velocities in sorted order
+
+    int cellCapacity;
+    int particleCapacity;
+    int count;
+} Grid;
+
+/**
+ * Rebuilds the grid from the current particle state.
+ * Positions and velocities are copied into cell order, so queries never
+ * read the columns that are being integrated.
+ * @param g Grid to rebuild.
+ * @param pos Particle positions.
+ * @param vel Particle velocities.
+ * @param count Number of particles.
+ * @param halfSize Half-extent of the room.
+ * @param cellSize Requested cell size (usually the neighbor radius).
+ */
+void grid_build(Grid *g, vec3 *pos, vec3 *vel, int count, float halfSize, float cellSize);
+
+/**
+ * Returns the clamped cell coordinates of a position.
+ * @param g Grid.
+ * @param pos Position to look up.
+ * @param cell Destination for x, y and z cell coordinates.
+ */
+void grid_cellCoords(const Grid *g, const vec3 pos, int cell[3]);
+
+/**
+ * Returns the sorted slot range of a cell.
+ * @param g Grid.
+ * @param x Cell x coordinate.
+ * @param y Cell y coordinate.
+ * @param z Cell z coordinate.
+ * @param begin Destination for the first slot.
+ * @param end Destination for one past the last slot.
+ */
+void grid_cellRange(const Grid *g, int x, int y, int z, int *begin, int *end);
+
+/**
+ * Frees all grid memory.
+ * @param g Grid to free.
+ */
+void grid_free(Grid *g);
+
+#endif // GRID_H
@@ -7,10 +7,33 @@
 
 #include "gui.h"
 #include "input.h"
+#include "idle.h"
+#include "guicache.h"
+#include "framepacer.h"
 #include "physics.h"
+#include "instanced.h"
+#include "utils.h"
+#include "jobs.h"
+#include "integrate.h"
+#include "profiler.h"
+#include "perfcount.h"
+#include "instrument.h"
+#include "glstate.h"
+#include "arena.h"
+#include "gpumem.h"
+#include "capture.h"
+#include "stream.h"
+#include "trail.h"
+#include "resscale.h"
+#include "translucent.h"
 
 #define GUI_WINDOW_HELP "window_help"
 #define GUI_WINDOW_MENU "window_menu"
+#define GUI_WINDOW_PROFILER "window_profiler"
+
+#define MAX_PARTICLES_CPU 5000
+#define MAX_PARTICLES_GPU 500000
+#define MAX_PARTICLES_EXTREME 2000000
 
 ////////////////////////    LOCAL    ////////////////////////////
 
@@ -21,6 +44,8 @@ static const GuiHelpLine help[] = {
     {"Toggle Fullscreen", "F2"},
     {"Toggle Wireframe", "F3"},
     {"Toggle Menu", "F4"},
+    {"Toggle Profiler", "F5"},
+    {"Timeline Capture", "F6"},
     {"Reload Shaders", "R"},
     {"Pause", "P"},
     {"Change Texture", "T"},
@@ -30,12 +55,62 @@ static const GuiHelpLine help[] = {
 
 /** Dropdown options for particle visualization mode */
 static const char *visModeDropdown[] = {
-    "Sphere", "Line", "Triangle"
+    "Sphere", "Line", "Triangle", "Impostor"
 };
 
 /** Dropdown options for particle target mode */
 static const char *targetModeDropdown[] = {
-    "Spheres", "Center", "Leader", "Box Center"
+    "Spheres", "Center", "Leader", "Box Center", "Flock", "Gravity"
+};
+
+/** Dropdown options for the CPU integrate kernel */
+static const char *kernelDropdown[] = {
+    "Scalar", "SSE", "AVX"
+};
+
+/** Dropdown options for the time integrator */
+static const char *integratorDropdown[] = {
+    "Euler", "Symplectic Euler", "Verlet", "RK4"
+};
+
+/** Dropdown options for the physics backend */
+static const char *backendDropdown[] = {
+    "CPU", "GPU"
+};
+
+/** Dropdown options for the frame capture format */
+static const char *captureFormatDropdown[] = {
+    "Raw RGB", "Y4M", "PNG"
+};
+
+/** Dropdown options for the trace mode */
+static const char *replayModeDropdown[] = {
+    "Off", "Record", "Replay"
+};
+
+/** Dropdown options for instance upload mode */
+static const char *instanceUploadDropdown[] = {
+    "SubData", "Persistent"
+};
+
+/** Dropdown options for the instance column format */
+static const char *instanceFormatDropdown[] = {
+    "Float", "Packed"
+};
+
+/** Names of the translucent particle orders */
+static const char *translucentOrderNames[] = {
+    "-", "Sorted", "Weighted Blended"
+};
+
+/** Dropdown options for the instrumentation level, cut at INSTRUMENT_LEVEL */
+static const char *instrumentDropdown[] = {
+    "Off", "Labels", "Full"
+};
+
+/** Names of the quality governor levels */
+static const char *qualityLevelNames[] = {
+    "Full", "No Vectors", "Near LOD", "No Shadows", "Flat Spheres"
 };
 
 /**
@@ -58,6 +133,395 @@ static void gui_renderHelp(ProgContext ctx, InputData *input) {
     input->showHelp = gui_widgetHelp(ctx, help, NK_LEN(help), nk_rect(x, y, width, height));
 }
 
+/**
+ * Renders one profiler row with average and maximum timings.
+ * @param ctx Program context.
+ * @param stats Timings to show.
+ * @param showGpu Whether the GPU column is filled.
+ */
+static void renderProfilerRow(ProgContext ctx, const ProfilerStats *stats, bool showGpu) {
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), "%*s%s", stats->depth * 2, "", stats->name);
+    gui_label(ctx, buf, NK_TEXT_LEFT);
+
+    snprintf(buf, sizeof(buf), "%.2f / %.2f", stats->cpuAvg, stats->cpuMax);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    if (showGpu) {
+        snprintf(buf, sizeof(buf), "%.2f / %.2f", stats->gpuAvg, stats->gpuMax);
+    } else {
+        snprintf(buf, sizeof(buf), "%d fps", stats->cpuAvg > 0.0f ? (int)(1000.0f / stats->cpuAvg) : 0);
+    }
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+}
+
+/**
+ * Formats a pipeline counter with a k or M suffix.
+ * @param buf Destination string.
+ * @param size Size of the destination.
+ * @param count Counter value.
+ */
+static void formatCount(char *buf, size_t size, GLuint64 count) {
+    if (count >= 1000000) {
+        snprintf(buf, size, "%.1fM", count / 1.0e6);
+    } else if (count >= 1000) {
+        snprintf(buf, size, "%.1fk", count / 1.0e3);
+    } else {
+        snprintf(buf, size, "%d", (int) count);
+    }
+}
+
+/**
+ * Renders the pipeline counters of a counted scope below its timings:
+ * primitives, vertex and fragment shader invocations if supported, and
+ * the samples that passed the depth test.
+ * @param ctx Program context.
+ * @param stats Counters to show.
+ */
+static void renderCounterRow(ProgContext ctx, const ProfilerStats *stats) {
+    char buf[64], a[16], b[16];
+
+    formatCount(a, sizeof(a), stats->primitives);
+    snprintf(buf, sizeof(buf), "%*s%s prim", stats->depth * 2 + 2, "", a);
+    gui_label(ctx, buf, NK_TEXT_LEFT);
+
+    if (profiler_hasPipelineStats()) {
+        formatCount(a, sizeof(a), stats->vertexInvocations);
+        formatCount(b, sizeof(b), stats->fragmentInvocations);
+        snprintf(buf, sizeof(buf), "%s vs %s fs", a, b);
+    } else {
+        buf[0] = '\0';
+    }
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    formatCount(a, sizeof(a), stats->samples);
+    snprintf(buf, sizeof(buf), "%s px", a);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+}
+
+/**
+ * Renders one profiler row with the issued and skipped GL calls of the last frame.
+ * @param ctx Program context.
+ * @param name Row label.
+ * @param issued Number of calls passed to OpenGL.
+ * @param skipped Number of redundant calls that were filtered.
+ */
+static void renderGlStateRow(ProgContext ctx, const char *name, int issued, int skipped) {
+    char buf[64];
+    gui_label(ctx, name, NK_TEXT_LEFT);
+
+    snprintf(buf, sizeof(buf), "%d set", issued);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    snprintf(buf, sizeof(buf), "%d skipped", skipped);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+}
+
+/**
+ * Renders the heap allocations of the scratch arenas and the frame arena use.
+ * Steady-state frames should show 0 allocations.
+ * @param ctx Program context
+ */
+static void renderArenaRow(ProgContext ctx) {
+    ArenaStats stats;
+    arena_getStats(&stats);
+
+    char buf[64];
+    gui_label(ctx, "Heap allocs", NK_TEXT_LEFT);
+
+    snprintf(buf, sizeof(buf), "%d", stats.heapAllocs);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    snprintf(buf, sizeof(buf), "%u / %u KB", (unsigned) (stats.frameBytes / 1024),
+        (unsigned) (stats.frameCapacity / 1024));
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+}
+
+/**
+ * Renders the GPU memory of every used category and the total,
+ * each with its high-water mark.
+ * @param ctx Program context
+ */
+static void renderGpuMemRows(ProgContext ctx) {
+    GpuMemStats stats;
+    gpumem_getStats(&stats);
+
+    char buf[64];
+    gui_label(ctx, "GPU memory", NK_TEXT_LEFT);
+    gui_label(ctx, "MB", NK_TEXT_RIGHT);
+    gui_label(ctx, "Peak MB", NK_TEXT_RIGHT);
+
+    for (int i = 0; i < GPUMEM_COUNT; ++i) {
+        if (stats.peak[i] == 0) {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "  %s", gpumem_categoryName((GpuMemCategory) i));
+        gui_label(ctx, buf, NK_TEXT_LEFT);
+
+        snprintf(buf, sizeof(buf), "%.2f", stats.bytes[i] / (1024.0 * 1024.0));
+        gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+        snprintf(buf, sizeof(buf), "%.2f", stats.peak[i] / (1024.0 * 1024.0));
+        gui_label(ctx, buf, NK_TEXT_RIGHT);
+    }
+
+    snprintf(buf, sizeof(buf), "  Total (%d)", stats.objects);
+    gui_label(ctx, buf, NK_TEXT_LEFT);
+
+    snprintf(buf, sizeof(buf), "%.2f", stats.totalBytes / (1024.0 * 1024.0));
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    snprintf(buf, sizeof(buf), "%.2f", stats.totalPeak / (1024.0 * 1024.0));
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+}
+
+/**
+ * Renders the frame time and latency estimates of the frame pacer.
+ * @param ctx Program context.
+ */
+static void renderPacingRows(ProgContext ctx) {
+    FramePacerStats stats;
+    framepacer_getStats(&stats);
+
+    char buf[64];
+    gui_label(ctx, "Frame / latency", NK_TEXT_LEFT);
+    snprintf(buf, sizeof(buf), "%.2f", stats.frameMs);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+    snprintf(buf, sizeof(buf), "%.2f", stats.latencyMs);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    gui_label(ctx, "Work / sleep", NK_TEXT_LEFT);
+    snprintf(buf, sizeof(buf), "%.2f", stats.workMs);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+    snprintf(buf, sizeof(buf), "%.2f", stats.sleepMs);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+    gui_label(ctx, "Margin / queued", NK_TEXT_LEFT);
+    snprintf(buf, sizeof(buf), "%.2f", stats.marginMs);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+    snprintf(buf, sizeof(buf), "%d", stats.queued);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+}
+
+/**
+ * Formats the misses per thousand instructions of the L1 data cache, the
+ * last level cache and the branches, "-" for unavailable counters.
+ * @param buf Destination string.
+ * @param size Size of the destination.
+ * @param phase Counts of a phase.
+ */
+static void formatMpki(char *buf, size_t size, const PerfPhase *phase) {
+    double perKilo = phase->counts[PC_INSTRUCTIONS] > 0 ? 1000.0 / phase->counts[PC_INSTRUCTIONS] : 0.0;
+    int used = 0;
+    for (int c = PC_L1D_MISSES; c <= PC_BRANCH_MISSES && used < (int) size; ++c) {
+        const char *sep = c > PC_L1D_MISSES ? "/" : "";
+        if (perfcount_hasCounter((PerfCounter) c)) {
+            used += snprintf(buf + used, size - used, "%s%.1f", sep, phase->counts[c] * perKilo);
+        } else {
+            used += snprintf(buf + used, size - used, "%s-", sep);
+        }
+    }
+}
+
+/**
+ * Renders the hardware counters of every phase in the last window:
+ * million cycles per frame, instructions per cycle and the misses per
+ * thousand instructions. Only shown with PERF_COUNTERS set.
+ * @param ctx Program context.
+ */
+static void renderPerfCountRows(ProgContext ctx) {
+    if (!perfcount_isEnabled()) {
+        return;
+    }
+
+    char buf[64];
+    gui_label(ctx, "HW counters", NK_TEXT_LEFT);
+    gui_label(ctx, "Mcyc / IPC", NK_TEXT_RIGHT);
+    gui_label(ctx, "MPKI L1/LL/br", NK_TEXT_RIGHT);
+
+    for (int i = 0; i < perfcount_getPhaseCount(); ++i) {
+        PerfPhase phase;
+        perfcount_getWindow(i, &phase);
+        if (phase.frames == 0 || phase.calls == 0) {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "  %s", phase.name);
+        gui_label(ctx, buf, NK_TEXT_LEFT);
+
+        long cycles = phase.counts[PC_CYCLES];
+        snprintf(buf, sizeof(buf), "%.2f / %.2f", cycles / 1.0e6 / phase.frames,
+            cycles > 0 ? (double) phase.counts[PC_INSTRUCTIONS] / cycles : 0.0);
+        gui_label(ctx, buf, NK_TEXT_RIGHT);
+
+        formatMpki(buf, sizeof(buf), &phase);
+        gui_label(ctx, buf, NK_TEXT_RIGHT);
+    }
+}
+
+/**
+ * Renders the profiler overlay with per scope CPU and GPU timings.
+ * @param ctx Program context.
+ * @param input Input state containing visibility flag.
+ */
+static void renderProfiler(ProgContext ctx, InputData *input) {
+    if (!input->showProfiler) {
+        return;
+    }
+
+    int w;
+    window_getRealSize(ctx, &w, NULL);
+    float width = 330.0f;
+
+    if (gui_beginTitled(ctx, GUI_WINDOW_PROFILER, "Profiler (avg / max ms)",
+        nk_rect(w - width - 15, 15, width, 300),
+        NK_WINDOW_BORDER | NK_WINDOW_MOVABLE | NK_WINDOW_SCALABLE |
+        NK_WINDOW_MINIMIZABLE | NK_WINDOW_TITLE))
+    {
+        gui_layoutRowDynamic(ctx, 25, 2);
+        gui_label(ctx, "Instrumentation:", NK_TEXT_LEFT);
+        int level = gui_dropdown(ctx, instrumentDropdown, INSTRUMENT_LEVEL + 1,
+            instrument_getLevel(), 20, nk_vec2(200, 200)
+        );
+        if (level != instrument_getLevel()) {
+            instrument_setLevel(level);
+        }
+
+        gui_layoutRowDynamic(ctx, 18, 3);
+        gui_label(ctx, "Scope", NK_TEXT_LEFT);
+        gui_label(ctx, "CPU", NK_TEXT_RIGHT);
+        gui_label(ctx, "GPU", NK_TEXT_RIGHT);
+
+        ProfilerStats stats;
+        profiler_getFrameStats(&stats);
+        renderProfilerRow(ctx, &stats, false);
+
+        for (int i = 0; i < profiler_getScopeCount(); ++i) {
+            profiler_getScopeStats(i, &stats);
+            renderProfilerRow(ctx, &stats, true);
+            if (stats.counted) {
+                renderCounterRow(ctx, &stats);
+            }
+        }
+
+        GlStateStats glStats;
+        glstate_getStats(&glStats);
+        renderGlStateRow(ctx, "GL state", glStats.stateChanges, glStats.stateSkipped);
+        renderGlStateRow(ctx, "GL binds", glStats.binds, glStats.bindsSkipped);
+        renderArenaRow(ctx);
+        renderGpuMemRows(ctx);
+        renderPacingRows(ctx);
+        renderPerfCountRows(ctx);
+    }
+    gui_end(ctx);
+}
+
+/**
+ * Renders the GPU-reduced statistics of swarm 0 if they are enabled.
+ * @param ctx Program context.
+ * @param input Input state containing the statistics.
+ */
+static void renderSwarmStats(ProgContext ctx, InputData *input) {
+    gui_checkbox(ctx, "swarm statistics", &input->physics.swarmStats);
+    const SwarmSummary *stats = &input->physics.stats;
+    if (!input->physics.swarmStats || !stats->valid) {
+        return;
+    }
+
+    char buf[48];
+    gui_layoutRowDynamic(ctx, 20, 2);
+    gui_label(ctx, "Centroid:", NK_TEXT_LEFT);
+    snprintf(buf, sizeof(buf), "%.1f %.1f %.1f", stats->centroid[0], stats->centroid[1], stats->centroid[2]);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+    gui_label(ctx, "Extent:", NK_TEXT_LEFT);
+    snprintf(buf, sizeof(buf), "%.1f %.1f %.1f", stats->boundsMax[0] - stats->boundsMin[0],
+        stats->boundsMax[1] - stats->boundsMin[1], stats->boundsMax[2] - stats->boundsMin[2]);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+    gui_label(ctx, "Mean Speed:", NK_TEXT_LEFT);
+    snprintf(buf, sizeof(buf), "%.2f", stats->meanSpeed);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+    gui_label(ctx, "Leader Distance:", NK_TEXT_LEFT);
+    snprintf(buf, sizeof(buf), "%.2f", stats->leaderDistance);
+    gui_label(ctx, buf, NK_TEXT_RIGHT);
+    gui_layoutRowDynamic(ctx, 25, 1);
+}
+
+/**
+ * Renders the swarm count and the settings of every active swarm.
+ * Counts, kV ranges and emitter switches are applied to the particle store right away.
+ * @param ctx Program context.
+ * @param input Input state containing the swarm settings.
+ * @param gpu If the GPU backend is selected, which allows more particles.
+ */
+static void renderSwarms(ProgContext ctx, InputData *input, bool gpu) {
+    bool extreme = input->particles.extremeScale;
+    int maxCount = extreme ? MAX_PARTICLES_EXTREME : gpu ? MAX_PARTICLES_GPU : MAX_PARTICLES_CPU;
+    int countStep = extreme ? 10000 : gpu ? 1000 : 1;
+
+    // The extreme scale mode steps a single swarm on the GPU
+    int swarmCount = input->particles.swarmCount;
+    if (!extreme) {
+        gui_propertyInt(ctx, "swarms", 1, &swarmCount, MAX_SWARMS, 1, 0.05f);
+    }
+    bool changed = swarmCount != input->particles.swarmCount;
+    input->particles.swarmCount = swarmCount;
+
+    for (int i = 0; i < swarmCount; ++i) {
+        SwarmSettings *swarm = &input->particles.swarms[i];
+        char title[24];
+        snprintf(title, sizeof(title), "Swarm %d", i);
+        if (!gui_treePushId(ctx, NK_TREE_NODE, title, NK_MINIMIZED, i)) {
+            continue;
+        }
+
+        int count = CLAMP(swarm->count, 1, maxCount);
+        gui_propertyInt(ctx, swarm->emitter ? "capacity" : "particles", 1, &count, maxCount, countStep, countStep * 0.1f);
+        float kvMin = swarm->kvMin, kvMax = swarm->kvMax;
+        gui_propertyFloat(ctx, "kV min", 0.1f, &kvMin, kvMax, 0.05f, 0.01f);
+        gui_propertyFloat(ctx, "kV max", kvMin, &kvMax, 10.0f, 0.05f, 0.01f);
+
+        changed |= count != swarm->count || kvMin != swarm->kvMin || kvMax != swarm->kvMax;
+        swarm->count = count;
+        swarm->kvMin = kvMin;
+        swarm->kvMax = kvMax;
+
+        vec4 color = {swarm->color[0], swarm->color[1], swarm->color[2], 1.0f};
+        gui_widgetColor(ctx, "color", color);
+        glm_vec3_copy(color, swarm->color);
+
+        gui_layoutRowDynamic(ctx, 25, 2);
+        gui_label(ctx, "Target:", NK_TEXT_LEFT);
+        swarm->targetMode = gui_dropdown(ctx, targetModeDropdown, NK_LEN(targetModeDropdown),
+            swarm->targetMode, 20, nk_vec2(200, 200)
+        );
+        gui_layoutRowDynamic(ctx, 25, 1);
+
+        // Emitters run on the CPU backend, the extreme scale mode has none
+        if (!extreme) {
+            bool emitter = swarm->emitter;
+            gui_checkbox(ctx, "emitter", &swarm->emitter);
+            changed |= emitter != swarm->emitter;
+        }
+        if (swarm->emitter) {
+            gui_propertyFloat(ctx, "spawn rate", 0.0f, &swarm->spawnRate, 5000.0f, 1.0f, 0.5f);
+            gui_propertyFloat(ctx, "lifetime", 0.0f, &swarm->lifetime, 60.0f, 0.1f, 0.05f);
+            gui_propertyInt(ctx, "burst", 0, &swarm->burstCount, maxCount, 10, 1.0f);
+            gui_propertyFloat(ctx, "burst interval", 0.1f, &swarm->burstInterval, 30.0f, 0.1f, 0.05f);
+            gui_layoutRowDynamic(ctx, 25, 3);
+            gui_propertyFloat(ctx, "#x", -1.0f, &swarm->emitterPos[0], 1.0f, 0.05f, 0.01f);
+            gui_propertyFloat(ctx, "#y", -1.0f, &swarm->emitterPos[1], 1.0f, 0.05f, 0.01f);
+            gui_propertyFloat(ctx, "#z", -1.0f, &swarm->emitterPos[2], 1.0f, 0.05f, 0.01f);
+            gui_layoutRowDynamic(ctx, 25, 1);
+        }
+
+        gui_treePop(ctx);
+    }
+
+    if (changed) {
+        physics_updateSwarms();
+    }
+}
+
 /**
  * Renders physics settings in the menu.
  * @param ctx Program context.
@@ -69,6 +533,7 @@ static void renderPhysics(ProgContext ctx, InputData *input) {
         if (gui_treePush(ctx, NK_TREE_NODE, "Spheres", NK_MINIMIZED)) {
             gui_propertyFloat(ctx, "Speed", 0.1f, &input->physics.sphereSpeed, 15.0f, 0.1f, 0.1f);
             gui_propertyFloat(ctx, "radius", 0.01f, &input->physics.sphereRadius, 1.0f, 0.01f, 0.01f);
+            gui_checkbox(ctx, "sinks for emitters", &input->particles.sphereSinks);
             if (gui_button(ctx, "toggle wander")) {
                 physics_toggleWander();
             }
@@ -78,6 +543,64 @@ static void renderPhysics(ProgContext ctx, InputData *input) {
 
         gui_propertyFloat(ctx, "fixed dt", 0.001f, &input->physics.fixedDt, 0.1f, 0.001f, 0.001f);
         gui_propertyFloat(ctx, "sim speed", 0.0f, &input->physics.simulationSpeed, 10.0f, 0.01f, 0.1f);
+        gui_propertyInt(ctx, "max steps", 1, &input->physics.maxSteps, 64, 1, 0.1f);
+        gui_checkbox(ctx, "interpolate", &input->physics.interpolate);
+        gui_checkbox(ctx, "sim thread", &input->physics.threaded);
+        gui_propertyInt(ctx, "reorder steps", 0, &input->physics.reorderInterval, 1000, 10, 1.0f);
+        gui_checkbox(ctx, "temporal LOD", &input->physics.temporalLod.enabled);
+        if (input->physics.temporalLod.enabled) {
+            gui_propertyFloat(ctx, "fidelity", 0.0f, &input->physics.temporalLod.fidelity, 1.0f, 0.05f, 0.005f);
+            gui_propertyFloat(ctx, "LOD distance", 0.5f, &input->physics.temporalLod.distance, 50.0f, 0.5f, 0.05f);
+            gui_checkbox(ctx, "reduce off-screen", &input->physics.temporalLod.offscreen);
+
+            char lodInfo[48];
+            snprintf(lodInfo, sizeof(lodInfo), "every %d steps: %d",
+                input->physics.temporalLod.interval, input->physics.temporalLod.reduced);
+            gui_label(ctx, lodInfo, NK_TEXT_LEFT);
+        }
+        gui_checkbox(ctx, "fast math", &input->physics.fastMath);
+        gui_propertyInt(ctx, "threads", 1, &input->physics.threadCount, jobs_getHardwareThreads(), 1, 0.1f);
+
+        gui_layoutRowDynamic(ctx, 25, 2);
+        gui_label(ctx, "Kernel:", NK_TEXT_LEFT);
+        SimdKernel kernel = gui_dropdown(ctx, kernelDropdown, NK_LEN(kernelDropdown),
+            input->physics.kernel, 20, nk_vec2(200, 200)
+        );
+        if (integrate_isSupported(kernel)) {
+            input->physics.kernel = kernel;
+        }
+
+        gui_label(ctx, "Integrator:", NK_TEXT_LEFT);
+        input->physics.integrator = gui_dropdown(ctx, integratorDropdown, NK_LEN(integratorDropdown),
+            input->physics.integrator, 20, nk_vec2(200, 200)
+        );
+
+        char stable[24];
+        float stableDt = physics_getStableDt();
+        if (stableDt <= 0.0f) {
+            snprintf(stable, sizeof(stable), "unstable");
+        } else {
+            snprintf(stable, sizeof(stable), "%s%.4f", input->physics.fixedDt < stableDt ? "< " : "! < ", stableDt);
+        }
+        gui_label(ctx, "Stable dt:", NK_TEXT_LEFT);
+        gui_label(ctx, stable, NK_TEXT_RIGHT);
+
+        char steps[16];
+        snprintf(steps, sizeof(steps), "%d", input->physics.stepsLastFrame);
+        gui_label(ctx, "Steps/Frame:", NK_TEXT_LEFT);
+        gui_label(ctx, steps, NK_TEXT_RIGHT);
+
+        gui_label(ctx, "Trace:", NK_TEXT_LEFT);
+        input->physics.replayMode = gui_dropdown(ctx, replayModeDropdown, NK_LEN(replayModeDropdown),
+            input->physics.replayMode, 20, nk_vec2(200, 200)
+        );
+
+        char frames[16];
+        snprintf(frames, sizeof(frames), "%d", physics_getTraceFrames());
+        gui_label(ctx, "Trace Steps:", NK_TEXT_LEFT);
+        gui_label(ctx, frames, NK_TEXT_RIGHT);
+        gui_layoutRowDynamic(ctx, 25, 1);
+        gui_checkbox(ctx, "delta trace", &input->physics.traceDelta);
 
         gui_treePop(ctx);
     }
@@ -93,9 +616,81 @@ static void renderSettings(ProgContext ctx, InputData *input) {
         gui_layoutRowDynamic(ctx, 25, 1);
 
         gui_checkbox(ctx, "Wireframe", &input->showWireframe);
+        gui_checkbox(ctx, "Depth Pre-Pass", &input->rendering.depthPrepass);
         gui_checkbox(ctx, "Drop Shadows", &input->rendering.dropShadows);
+        gui_checkbox(ctx, "Merged Shadows", &input->rendering.mergedShadows);
+        gui_checkbox(ctx, "GPU Culling", &input->rendering.gpuCulling);
+        gui_checkbox(ctx, "Instance Rotations", &input->rendering.instanceRotations);
+        gui_checkbox(ctx, "Sphere LOD", &input->rendering.sphereLod);
+        gui_propertyFloat(ctx, "LOD Distance", 0.5f, &input->rendering.lodDistance, 50.0f, 0.5f, 0.05f);
         gui_checkbox(ctx, "Texture Order", &input->rendering.texOrder1);
+        gui_checkbox(ctx, "Skybox", &input->rendering.skybox);
+        gui_checkbox(ctx, "Trails", &input->rendering.trails);
+        if (input->rendering.trails) {
+            gui_propertyInt(ctx, "Trail Length", 2, &input->rendering.trailLength, TRAIL_MAX_LENGTH, 1, 0.1f);
+        }
         gui_propertyFloat(ctx, "Room Size", 0.1f, &input->rendering.roomSize, 25.0f, 0.1f, 0.05f);
+        gui_checkbox(ctx, "Prewarm Shaders", &input->rendering.prewarmShaders);
+        gui_checkbox(ctx, "Translucent Particles", &input->rendering.translucent);
+        if (input->rendering.translucent) {
+            gui_propertyFloat(ctx, "Opacity", 0.05f, &input->rendering.particleAlpha, 1.0f, 0.05f, 0.005f);
+            gui_propertyInt(ctx, "Sort Budget", 0, &input->rendering.sortBudget, 1 << 24, 1 << 14, 1000.0f);
+        }
+
+        gui_layoutRowDynamic(ctx, 25, 2);
+        gui_label(ctx, "Upload:", NK_TEXT_LEFT);
+        input->rendering.instanceUpload = gui_dropdown(ctx, instanceUploadDropdown, NK_LEN(instanceUploadDropdown),
+            input->rendering.instanceUpload, 20, nk_vec2(200, 200)
+        );
+
+        gui_label(ctx, "Active:", NK_TEXT_LEFT);
+        gui_label(ctx, instanceUploadDropdown[instanced_getUploadMode()], NK_TEXT_RIGHT);
+
+        gui_label(ctx, "Format:", NK_TEXT_LEFT);
+        input->rendering.instanceFormat = gui_dropdown(ctx, instanceFormatDropdown, NK_LEN(instanceFormatDropdown),
+            input->rendering.instanceFormat, 20, nk_vec2(200, 200)
+        );
+
+        gui_label(ctx, "Active:", NK_TEXT_LEFT);
+        gui_label(ctx, instanceFormatDropdown[instanced_getFormat()], NK_TEXT_RIGHT);
+
+        if (input->rendering.translucent) {
+            gui_label(ctx, "Order:", NK_TEXT_LEFT);
+            gui_label(ctx, translucentOrderNames[translucent_getOrder()], NK_TEXT_RIGHT);
+        }
+
+        int lodCounts[INSTANCED_MAX_LODS];
+        int lodCount = instanced_getLodCounts(lodCounts);
+        for (int i = 0; i < lodCount; ++i) {
+            char label[32], value[32];
+            snprintf(label, sizeof(label), "LOD %d:", i);
+            snprintf(value, sizeof(value), "%d", lodCounts[i]);
+            gui_label(ctx, label, NK_TEXT_LEFT);
+            gui_label(ctx, value, NK_TEXT_RIGHT);
+        }
+        gui_layoutRowDynamic(ctx, 25, 1);
+
+        gui_checkbox(ctx, "Quality Governor", &input->quality.enabled);
+        gui_propertyFloat(ctx, "Budget ms", 1.0f, &input->quality.budgetMs, 100.0f, 0.5f, 0.05f);
+
+        gui_layoutRowDynamic(ctx, 25, 2);
+        char work[32];
+        snprintf(work, sizeof(work), "%.2f ms", input->quality.workMs);
+        gui_label(ctx, "Quality:", NK_TEXT_LEFT);
+        gui_label(ctx, qualityLevelNames[input->quality.level], NK_TEXT_RIGHT);
+        gui_label(ctx, "Work:", NK_TEXT_LEFT);
+        gui_label(ctx, work, NK_TEXT_RIGHT);
+        gui_layoutRowDynamic(ctx, 25, 1);
+
+        gui_checkbox(ctx, "Dynamic Resolution", &input->resolution.enabled);
+        gui_propertyFloat(ctx, "Min Scale", RESSCALE_MIN_SCALE, &input->resolution.minScale, 1.0f, RESSCALE_STEP, 0.01f);
+        gui_propertyFloat(ctx, "Sharpen", 0.0f, &input->resolution.sharpness, 1.0f, 0.05f, 0.01f);
+
+        gui_layoutRowDynamic(ctx, 25, 2);
+        char scale[32];
+        snprintf(scale, sizeof(scale), "%.0f %%", input->resolution.scale * 100.0f);
+        gui_label(ctx, "Scale:", NK_TEXT_LEFT);
+        gui_label(ctx, scale, NK_TEXT_RIGHT);
 
         gui_treePop(ctx);
     }
@@ -106,20 +701,52 @@ static void renderSettings(ProgContext ctx, InputData *input) {
         }
 
         gui_checkbox(ctx, "show vectors", &input->particles.visVectors);
+        gui_checkbox(ctx, "instanced lines", &input->particles.vectorLines);
 
         gui_propertyFloat(ctx, "Gaussian Const", 1.0f, &input->particles.gaussianConst, 150.0f, 0.1f, 0.5f);
+        gui_checkbox(ctx, "attractor field", &input->particles.attractorField);
+        gui_checkbox(ctx, "obstacles", &input->physics.obstacles);
+        if (input->physics.obstacles) {
+            gui_propertyFloat(ctx, "Obstacle Force", 0.0f, &input->physics.obstacleForce, 50.0f, 0.1f, 0.1f);
+        }
 
-        if (input->particles.targetMode == TM_LEADER) {
+        if (input_swarmsUseMode(input, TM_LEADER)) {
             gui_propertyFloat(ctx, "LeaderKv", 2.0f, &input->particles.leaderKv, 10.0f, 0.01f, 0.05f);
             if (gui_button(ctx, "New Random Leader")) {
                 physics_setNewLeader();
             }
         }
 
-        int count = input->particles.count;
-        gui_propertyInt(ctx, "particles", 1, &count, 5000, 1, 0.1f);
-        if (count != input->particles.count) {
-            physics_updateParticleCount(count);
+        gui_checkbox(ctx, "extreme scale", &input->particles.extremeScale);
+
+        gui_layoutRowDynamic(ctx, 25, 2);
+        if (!input->particles.extremeScale) {
+            gui_label(ctx, "Backend:", NK_TEXT_LEFT);
+            input->physics.backend = gui_dropdown(ctx, backendDropdown, NK_LEN(backendDropdown),
+                input->physics.backend, 20, nk_vec2(200, 200)
+            );
+        }
+
+        char throughput[24];
+        snprintf(throughput, sizeof(throughput), "%.2f M/s", input->physics.throughput * 1e-6f);
+        gui_label(ctx, "Particle Steps:", NK_TEXT_LEFT);
+        gui_label(ctx, throughput, NK_TEXT_RIGHT);
+        gui_layoutRowDynamic(ctx, 25, 1);
+
+        bool gpu = input->physics.backend == PB_GPU;
+        if (gpu) {
+            renderSwarmStats(ctx, input);
+        }
+        if (input_swarmsUseMode(input, TM_FLOCK)) {
+            gui_propertyFloat(ctx, "radius", 0.1f, &input->particles.flock.radius, 5.0f, 0.05f, 0.01f);
+            gui_propertyFloat(ctx, "separation", 0.0f, &input->particles.flock.separation, 10.0f, 0.05f, 0.01f);
+            gui_propertyFloat(ctx, "alignment", 0.0f, &input->particles.flock.alignment, 10.0f, 0.05f, 0.01f);
+            gui_propertyFloat(ctx, "cohesion", 0.0f, &input->particles.flock.cohesion, 10.0f, 0.05f, 0.01f);
+        }
+        if (input_swarmsUseMode(input, TM_GRAVITY)) {
+            gui_propertyFloat(ctx, "theta", 0.0f, &input->particles.gravity.theta, 1.5f, 0.05f, 0.01f);
+            gui_propertyFloat(ctx, "strength", 0.0f, &input->particles.gravity.strength, 500.0f, 1.0f, 0.5f);
+            gui_propertyFloat(ctx, "softening", 0.01f, &input->particles.gravity.softening, 5.0f, 0.05f, 0.01f);
         }
 
         gui_layoutRowDynamic(ctx, 25, 2);
@@ -127,14 +754,10 @@ static void renderSettings(ProgContext ctx, InputData *input) {
         input->particles.sphereVis = gui_dropdown(ctx, visModeDropdown, NK_LEN(visModeDropdown), 
             input->particles.sphereVis, 20, nk_vec2(200, 200)
         );
-
-        gui_label(ctx, "Target:", NK_TEXT_LEFT);
-        input->particles.targetMode = gui_dropdown(ctx, targetModeDropdown, NK_LEN(targetModeDropdown), 
-            input->particles.targetMode, 20, nk_vec2(200, 200)
-        );
-
         gui_layoutRowDynamic(ctx, 25, 1);
 
+        renderSwarms(ctx, input, gpu);
+
         gui_treePop(ctx);
     }
 }
@@ -161,6 +784,76 @@ static void renderGeneral(ProgContext ctx, InputData *input) {
             input->paused = !input->paused;
         }
 
+        gui_layoutRowDynamic(ctx, 20, 2);
+        bool idleEnabled = idle_isEnabled();
+        if (gui_checkbox(ctx, "Idle", &idleEnabled)) {
+            idle_setEnabled(idleEnabled);
+        }
+        gui_label(ctx, idle_isIdle() ? "sleeping" : "rendering", NK_TEXT_RIGHT);
+        gui_layoutRowDynamic(ctx, 20, 2);
+        bool guiCacheEnabled = guicache_isEnabled();
+        if (gui_checkbox(ctx, "GUI Cache", &guiCacheEnabled)) {
+            guicache_setEnabled(guiCacheEnabled);
+        }
+        char reuseStr[24];
+        snprintf(reuseStr, sizeof(reuseStr), "%.0f%% reused", guicache_getReuse() * 100.0f);
+        gui_label(ctx, reuseStr, NK_TEXT_RIGHT);
+        gui_layoutRowDynamic(ctx, 20, 1);
+        float guiRate = guicache_getRate();
+        gui_propertyFloat(ctx, "GUI Hz", 0.0f, &guiRate, 120.0f, 5.0f, 1.0f);
+        guicache_setRate(guiRate);
+
+        gui_layoutRowDynamic(ctx, 20, 2);
+        bool lowLatency = framepacer_isEnabled();
+        if (gui_checkbox(ctx, "Low Latency", &lowLatency)) {
+            framepacer_setEnabled(lowLatency);
+        }
+        int maxQueued = framepacer_getMaxQueued();
+        gui_propertyInt(ctx, "queued", 1, &maxQueued, FRAMEPACER_MAX_QUEUED, 1, 0.05f);
+        framepacer_setMaxQueued(maxQueued);
+        gui_layoutRowDynamic(ctx, 20, 1);
+        gui_checkbox(ctx, "Profiler", &input->showProfiler);
+        gui_checkbox(ctx, "Capture", &input->capture.enabled);
+
+        gui_layoutRowDynamic(ctx, 20, 2);
+        gui_label(ctx, "Format:", NK_TEXT_LEFT);
+        if (!input->capture.enabled) {
+            input->capture.format = gui_dropdown(ctx, captureFormatDropdown, NK_LEN(captureFormatDropdown),
+                input->capture.format, 20, nk_vec2(200, 200)
+            );
+        } else {
+            gui_label(ctx, captureFormatDropdown[input->capture.format], NK_TEXT_RIGHT);
+        }
+
+        int written, dropped;
+        capture_getCounts(&written, &dropped);
+        char counts[32];
+        snprintf(counts, sizeof(counts), "%d / %d", written, dropped);
+        gui_label(ctx, "Frames / Dropped:", NK_TEXT_LEFT);
+        gui_label(ctx, counts, NK_TEXT_RIGHT);
+        gui_layoutRowDynamic(ctx, 20, 1);
+
+        gui_checkbox(ctx, "Remote Viewer", &input->stream.enabled);
+        gui_layoutRowDynamic(ctx, 20, 2);
+        if (!input->stream.enabled) {
+            gui_propertyInt(ctx, "port", 1024, &input->stream.port, 65535, 1, 1.0f);
+            gui_checkbox(ctx, "Any Interface", &input->stream.anyInterface);
+        } else {
+            StreamStats stats;
+            stream_getStats(&stats);
+            char sent[32];
+            snprintf(sent, sizeof(sent), "%d / %d", stats.sent, stats.dropped);
+            gui_label(ctx, stats.client ? "Client:" : "Waiting:", NK_TEXT_LEFT);
+            gui_label(ctx, sent, NK_TEXT_RIGHT);
+            char encode[48];
+            snprintf(encode, sizeof(encode), "%.1f ms / %d KiB", stats.encodeMs, stats.lastBytes / 1024);
+            gui_label(ctx, "Encode:", NK_TEXT_LEFT);
+            gui_label(ctx, encode, NK_TEXT_RIGHT);
+        }
+        gui_propertyInt(ctx, "JPEG", 1, &input->stream.quality, 100, 5, 0.5f);
+        gui_checkbox(ctx, "Half Size", &input->stream.halfSize);
+        gui_layoutRowDynamic(ctx, 20, 1);
+
         if (gui_treePush(ctx, NK_TREE_TAB, "Camera", NK_MAXIMIZED)) {
             gui_layoutRowDynamic(ctx, 20, 2);
             gui_label(ctx, "Camera:", NK_TEXT_LEFT);
@@ -211,4 +904,5 @@ void gui_renderContent(ProgContext ctx) {
 
     gui_renderHelp(ctx, input);
     gui_renderMenu(ctx, input);
+    renderProfiler(ctx, input);
 }
\ No newline at end of file
@@ -6,9 +6,16 @@
  */
 
 #include "input.h"
+#include "idle.h"
+#include "guicache.h"
+#include "timeline.h"
 #include "rendering.h"
 #include "shader.h"
 #include "physics.h"
+#include "jobs.h"
+#include "integrate.h"
+#include "inputqueue.h"
+#include "translucent.h"
 
 #define CAM_SPEED 2.0f
 #define CAM_FAST_SPEED (CAM_SPEED * 6.0f)
@@ -20,17 +27,72 @@
 
 #define SIMULATION_SPEED 3.0f
 #define SIMULATION_FPS 120.0f
+#define MAX_STEPS_PER_FRAME 8
+#define REORDER_INTERVAL 0
+#define TEMPORAL_LOD_DISTANCE 8.0f
+#define TEMPORAL_LOD_FIDELITY 0.5f
 
 #define GAUSSIAN_CONST 60.0f
 #define LEADER_KV 5.0f
 
+#define FLOCK_RADIUS 1.0f
+#define FLOCK_SEPARATION 1.5f
+#define FLOCK_ALIGNMENT 1.0f
+#define FLOCK_COHESION 1.0f
+
+#define GRAVITY_THETA 0.5f
+#define GRAVITY_STRENGTH 50.0f
+#define GRAVITY_SOFTENING 0.5f
+
+#define OBSTACLE_FORCE 10.0f
+
+#define SWARM_KV_MIN 1.0f
+#define SWARM_KV_MAX 2.0f
+#define SWARM_KWEAK_MIN 0.5f
+#define SWARM_KWEAK_MAX 10.0f
+
+#define EMITTER_SPAWN_RATE 40.0f
+#define EMITTER_LIFETIME 6.0f
+#define EMITTER_BURST_COUNT 0
+#define EMITTER_BURST_INTERVAL 2.0f
+
+#define LOD_DISTANCE 6.0f
+#define QUALITY_BUDGET_MS 14.0f
+#define RESOLUTION_MIN_SCALE 0.5f
+#define RESOLUTION_SHARPNESS 0.25f
+
 #define CENTER_MOVE_SPEED 0.2f
 
+#define TRAIL_LENGTH 24
+
+#define PARTICLE_ALPHA 0.35f
+
+#define STREAM_SCROLL_SCALE 0.01
+
 ////////////////////////    LOCAL    ////////////////////////////
 
 /** Global input state */
 static InputData g_input = {0};
 
+/** Target modes of the swarms, swarm 0 starts as the single active one */
+static const TargetMode g_swarmModes[MAX_SWARMS] = { TM_SPHERES, TM_CENTER, TM_FLOCK, TM_LEADER };
+
+/** Colors of the swarms, none of them red so the leader stays visible */
+static const vec3 g_swarmColors[MAX_SWARMS] = {
+    {0.4f, 0.0f, 1.0f},
+    {0.0f, 0.7f, 0.9f},
+    {1.0f, 0.6f, 0.0f},
+    {0.3f, 0.8f, 0.2f}
+};
+
+/** Emitter positions of the swarms, in units of the room half-extent */
+static const vec3 g_emitterPositions[MAX_SWARMS] = {
+    { 0.0f,  0.8f,  0.0f},
+    {-0.8f,  0.0f,  0.0f},
+    { 0.8f,  0.0f,  0.0f},
+    { 0.0f, -0.8f,  0.0f}
+};
+
 /**
  * Keyboard event callback.
  * Handles key presses for camera movement, toggles, and center control.
@@ -41,16 +103,22 @@ static InputData g_input = {0};
  */
 static void input_keyEvent(ProgContext ctx, int key, int action, int mods) {
     NK_UNUSED(mods);
+    idle_onInput(action);
+    guicache_onInput();
 
+    // The camera only needs changes of the held state, the center
+    // movement below still steps on every repeat
     InputData *data = getInputData();
-    camera_keyboardCallback(data->cam.data, key, action);
+    if (inputqueue_key(key, action)) {
+        camera_keyboardCallback(data->cam.data, key, action);
+    }
 
     if (action != GLFW_PRESS && action != GLFW_REPEAT) {
         return;
     }
 
     // Arrow keys for center movement (when in CENTER mode)
-    if (data->particles.targetMode == TM_BOX_CENTER) {
+    if (input_swarmsUseMode(data, TM_BOX_CENTER)) {
         vec3 delta = {0, 0, 0};
         switch (key) {
             case GLFW_KEY_LEFT:
@@ -106,6 +174,14 @@ static void input_keyEvent(ProgContext ctx, int key, int action, int mods) {
             data->showMenu = !data->showMenu;
             break;
 
+        case GLFW_KEY_F5:
+            data->showProfiler = !data->showProfiler;
+            break;
+
+        case GLFW_KEY_F6:
+            timeline_toggle();
+            break;
+
         case GLFW_KEY_R:
             shader_load();
             break;
@@ -119,7 +195,7 @@ static void input_keyEvent(ProgContext ctx, int key, int action, int mods) {
             break;
 
         case GLFW_KEY_L:
-            if (data->particles.targetMode == TM_LEADER) {
+            if (input_swarmsUseMode(data, TM_LEADER)) {
                 physics_setNewLeader();
             }
             break;
@@ -149,6 +225,17 @@ static void input_frameBufferSizeEvent(ProgContext ctx, int width, int height) {
     rendering_resize(width, height);
 }
 
+/**
+ * Handles the mouse movement coalesced over a frame, the camera turns
+ * once by the whole movement.
+ * @param ctx Program context.
+ * @param move Last position and summed movement.
+ */
+static void input_handleMouseMove(ProgContext ctx, const InputMove *move) {
+    InputData *data = getInputData();
+    camera_mouseMoveCallback(data->cam.data, ctx, move->x, move->y);
+}
+
 /**
  * Mouse button event callback.
  * @param ctx Program context.
@@ -158,41 +245,66 @@ static void input_frameBufferSizeEvent(ProgContext ctx, int width, int height) {
  */
 static void input_mouseButtonEvent(ProgContext ctx, int button, int action, int mods) {
     NK_UNUSED(mods);
-    NK_UNUSED(ctx);
+    idle_onInput(action);
+    guicache_onInput();
+    inputqueue_flush(ctx, input_handleMouseMove);
 
     InputData *data = getInputData();
     camera_mouseButtonCallback(data->cam.data, button, action);
 }
 
 /**
- * Mouse movement event callback.
+ * Mouse movement event callback, only records the position for
+ * input_flushEvents.
  * @param ctx Program context.
  * @param x Mouse X position.
  * @param y Mouse Y position.
  */
 static void input_mouseMoveEvent(ProgContext ctx, double x, double y) {
-    InputData *data = getInputData();
-    camera_mouseMoveCallback(data->cam.data, ctx, (float)x, (float)y);
+    NK_UNUSED(ctx);
+    guicache_onInput();
+    inputqueue_mouseMove(x, y);
+}
+
+/**
+ * Callback for mouse wheel events, only the GUI reacts to them.
+ *
+ * @param ctx Program context.
+ * @param x Horizontal scroll offset.
+ * @param y Vertical scroll offset.
+ */
+static void input_mouseScrollEvent(ProgContext ctx, double x, double y) {
+    NK_UNUSED(ctx);
+    NK_UNUSED(x);
+    NK_UNUSED(y);
+    guicache_onInput();
+}
+
+/**
+ * Callback for text input, only the GUI reacts to it.
+ *
+ * @param ctx Program context.
+ * @param codepoint Unicode codepoint of the typed character.
+ */
+static void input_textEvent(ProgContext ctx, unsigned int codepoint) {
+    NK_UNUSED(ctx);
+    NK_UNUSED(codepoint);
+    guicache_onInput();
 }
 
 ////////////////////////    PUBLIC    ////////////////////////////
 
-void input_init(ProgContext ctx) {
-    glLineWidth(0.5f);
+void input_initDefaults(void) {
     g_input.isFullscreen = false;
     g_input.showHelp = false;
     g_input.showMenu = true;
+    g_input.showProfiler = false;
     g_input.showWireframe = false;
     g_input.paused = false;
 
     vec3 startPos = {0.0f, 1.5f, 3.0f};
-    g_input.cam.data = camera_createCamera(
-        ctx, startPos,
-        CAM_SPEED, CAM_FAST_SPEED,
-        CAM_SENSITIVITY, CAM_YAW, CAM_PITCH
-    );
-    camera_getPosition(g_input.cam.data, g_input.cam.pos);
-    camera_getFront(g_input.cam.data, g_input.cam.dir);
+    glm_vec3_copy(startPos, g_input.cam.pos);
+    glm_vec3_copy((vec3){0, 0, -1}, g_input.cam.dir);
     g_input.cam.mode = CAM_FREE;
     g_input.cam.aboveDistance = CAM_ABOVE_DISTANCE;
     g_input.cam.behindDistance = CAM_BEHIND_DISTANCE;
@@ -205,29 +317,168 @@ void input_init(ProgContext ctx) {
     g_input.rendering.texOrder1 = false;
     g_input.rendering.roomSize = 10.0f;
     g_input.rendering.dropShadows = true;
+    g_input.rendering.instanceUpload = IU_PERSISTENT;
+    g_input.rendering.instanceFormat = IF_PACKED;
+    g_input.rendering.gpuCulling = true;
+    g_input.rendering.mergedShadows = true;
+    g_input.rendering.instanceRotations = true;
+    g_input.rendering.sphereLod = true;
+    g_input.rendering.lodDistance = LOD_DISTANCE;
+    g_input.rendering.depthPrepass = false;
+    g_input.rendering.skybox = true;
+    g_input.rendering.trails = false;
+    g_input.rendering.trailLength = TRAIL_LENGTH;
+    g_input.rendering.prewarmShaders = true;
+    g_input.rendering.translucent = false;
+    g_input.rendering.particleAlpha = PARTICLE_ALPHA;
+    g_input.rendering.sortBudget = TRANSLUCENT_SORT_BUDGET;
+
+    g_input.capture.enabled = false;
+    g_input.capture.format = CF_Y4M;
+
+    g_input.stream.enabled = false;
+    g_input.stream.port = STREAM_DEFAULT_PORT;
+    g_input.stream.anyInterface = false;
+    g_input.stream.quality = STREAM_DEFAULT_QUALITY;
+    g_input.stream.halfSize = false;
+
+    g_input.quality.enabled = true;
+    g_input.quality.budgetMs = QUALITY_BUDGET_MS;
+    g_input.quality.level = QL_FULL;
+
+    g_input.resolution.enabled = true;
+    g_input.resolution.minScale = RESOLUTION_MIN_SCALE;
+    g_input.resolution.sharpness = RESOLUTION_SHARPNESS;
+    g_input.resolution.scale = 1.0f;
 
     g_input.physics.fixedDt = 1.0f / SIMULATION_FPS;
     g_input.physics.sphereRadius = 0.5f;
     g_input.physics.dtAccumulator = 0.0f;
     g_input.physics.simulationSpeed = SIMULATION_SPEED;
+    g_input.physics.maxSteps = MAX_STEPS_PER_FRAME;
+    g_input.physics.stepsLastFrame = 0;
+    g_input.physics.throughput = 0.0f;
+    g_input.physics.interpolate = true;
+    g_input.physics.threaded = false;
+    g_input.physics.reorderInterval = REORDER_INTERVAL;
+    g_input.physics.temporalLod.enabled = false;
+    g_input.physics.temporalLod.distance = TEMPORAL_LOD_DISTANCE;
+    g_input.physics.temporalLod.offscreen = true;
+    g_input.physics.temporalLod.fidelity = TEMPORAL_LOD_FIDELITY;
+    g_input.physics.temporalLod.interval = 1;
+    g_input.physics.temporalLod.reduced = 0;
     g_input.physics.roomForce = 10.0f;
+    g_input.physics.obstacles = true;
+    g_input.physics.obstacleForce = OBSTACLE_FORCE;
+    g_input.physics.backend = PB_CPU;
+    g_input.physics.threadCount = jobs_getHardwareThreads();
+    g_input.physics.kernel = integrate_bestKernel();
+    g_input.physics.integrator = IG_SYMPLECTIC;
+    g_input.physics.fastMath = false;
+    g_input.physics.replayMode = RM_OFF;
+    g_input.physics.traceDelta = true;
+    g_input.physics.swarmStats = false;
+    g_input.physics.stats.valid = false;
 
     g_input.particles.count = START_NUM_PARTICLES;
     g_input.particles.gaussianConst = GAUSSIAN_CONST;
+    g_input.particles.attractorField = false;
+    g_input.particles.extremeScale = false;
     g_input.particles.leaderKv = LEADER_KV;
     g_input.particles.sphereVis = SV_SPHERE;
-    g_input.particles.targetMode = TM_SPHERES;
     g_input.particles.visVectors = true;
-    g_input.particles.leaderIdx = 0;
+    g_input.particles.vectorLines = true;
+    g_input.particles.sphereSinks = true;
+    g_input.particles.flock.radius = FLOCK_RADIUS;
+    g_input.particles.flock.separation = FLOCK_SEPARATION;
+    g_input.particles.flock.alignment = FLOCK_ALIGNMENT;
+    g_input.particles.flock.cohesion = FLOCK_COHESION;
+    g_input.particles.gravity.theta = GRAVITY_THETA;
+    g_input.particles.gravity.strength = GRAVITY_STRENGTH;
+    g_input.particles.gravity.softening = GRAVITY_SOFTENING;
+
+    g_input.particles.swarmCount = 1;
+    for (int i = 0; i < MAX_SWARMS; ++i) {
+        SwarmSettings *s = &g_input.particles.swarms[i];
+        s->count = START_NUM_PARTICLES;
+        s->targetMode = g_swarmModes[i];
+        s->kvMin = SWARM_KV_MIN;
+        s->kvMax = SWARM_KV_MAX;
+        s->kWeakMin = SWARM_KWEAK_MIN;
+        s->kWeakMax = SWARM_KWEAK_MAX;
+        s->leaderIdx = 0;
+        glm_vec3_copy((float*) g_swarmColors[i], s->color);
+
+        s->emitter = false;
+        s->spawnRate = EMITTER_SPAWN_RATE;
+        s->lifetime = EMITTER_LIFETIME;
+        s->burstCount = EMITTER_BURST_COUNT;
+        s->burstInterval = EMITTER_BURST_INTERVAL;
+        glm_vec3_copy((float*) g_emitterPositions[i], s->emitterPos);
+    }
+}
+
+void input_init(ProgContext ctx) {
+    glLineWidth(0.5f);
+    input_initDefaults();
+
+    g_input.cam.data = camera_createCamera(
+        ctx, g_input.cam.pos,
+        CAM_SPEED, CAM_FAST_SPEED,
+        CAM_SENSITIVITY, CAM_YAW, CAM_PITCH
+    );
+    camera_getPosition(g_input.cam.data, g_input.cam.pos);
+    camera_getFront(g_input.cam.data, g_input.cam.dir);
 }
 
 InputData* getInputData(void) {
     return &g_input;
 }
 
+bool input_swarmsUseMode(InputData *data, TargetMode mode) {
+    for (int i = 0; i < data->particles.swarmCount; ++i) {
+        if (data->particles.swarms[i].targetMode == mode) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool input_swarmsEmit(InputData *data) {
+    for (int i = 0; i < data->particles.swarmCount; ++i) {
+        if (data->particles.swarms[i].emitter) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void input_flushEvents(ProgContext ctx) {
+    inputqueue_flush(ctx, input_handleMouseMove);
+}
+
+void input_remoteEvent(ProgContext ctx, const StreamEvent *event) {
+    switch (event->type) {
+        case SE_KEY:
+            input_keyEvent(ctx, event->a, event->b, event->c);
+            break;
+        case SE_MOUSE_BUTTON:
+            input_mouseButtonEvent(ctx, event->a, event->b, event->c);
+            break;
+        case SE_MOUSE_MOVE:
+            input_mouseMoveEvent(ctx, event->a, event->b);
+            break;
+        case SE_SCROLL:
+            input_mouseScrollEvent(ctx, event->a * STREAM_SCROLL_SCALE, event->b * STREAM_SCROLL_SCALE);
+            break;
+    }
+}
+
 void input_registerCallbacks(ProgContext ctx) {
     window_setKeyboardCallback(ctx, input_keyEvent);
     window_setMouseButtonCallback(ctx, input_mouseButtonEvent);
     window_setMouseMovementCallback(ctx, input_mouseMoveEvent);
+    window_setMouseScrollCallback(ctx, input_mouseScrollEvent);
+    window_setTextCallback(ctx, input_textEvent);
     window_setFramebufferSizeCallback(ctx, input_frameBufferSizeEvent);
 }
\ No newline at end of file
@@ -9,9 +9,13 @@
 #define INPUT_H
 
 #include <fhwcg/fhwcg.h>
+#include "stream.h"
 
 #define START_NUM_PARTICLES 100
 
+/** Maximum number of independent swarms */
+#define MAX_SWARMS 4
+
 /**
  * Target mode for particles - determines what particles move toward.
  */
@@ -19,7 +23,10 @@ typedef enum {
     TM_SPHERES,
     TM_CENTER, 
     TM_LEADER,
-    TM_BOX_CENTER
+    TM_BOX_CENTER,
+    TM_FLOCK,
+    TM_GRAVITY,
+    TM_COUNT
 } TargetMode;
 
 /**
@@ -28,9 +35,92 @@ typedef enum {
 typedef enum {
     SV_SPHERE, 
     SV_LINE, 
-    SV_TRIANGLE
+    SV_TRIANGLE,
+    SV_IMPOSTOR     // ray-cast sphere on one point sprite per particle
 } SphereVis;
 
+/**
+ * Upload path for per-instance particle data.
+ */
+typedef enum {
+    IU_SUBDATA,
+    IU_PERSISTENT
+} InstanceUpload;
+
+/**
+ * Storage format of the per-instance particle columns.
+ * IF_PACKED stores acceleration as half floats and up/forward
+ * octahedral encoded in snorm16 (28 instead of 48 bytes per instance).
+ */
+typedef enum {
+    IF_FLOAT,
+    IF_PACKED,
+    IF_COUNT
+} InstanceFormat;
+
+/**
+ * Backend running the fixed-step particle update.
+ */
+typedef enum {
+    PB_CPU,
+    PB_GPU
+} PhysicsBackend;
+
+/**
+ * Trace mode of the fixed-step update.
+ * RM_REPLAY shows recorded steps instead of integrating.
+ */
+typedef enum {
+    RM_OFF,
+    RM_RECORD,
+    RM_REPLAY
+} ReplayMode;
+
+/**
+ * Time integration scheme of the fixed step.
+ * The stability limits are for the penalty springs, see physics_getStableDt.
+ */
+typedef enum {
+    IG_EULER,           // explicit Euler, unstable for undamped springs
+    IG_SYMPLECTIC,      // semi-implicit Euler, dt < 2 / omega
+    IG_VERLET,          // velocity Verlet, dt < 2 / omega
+    IG_RK4,             // classic Runge-Kutta, dt < 2.78 / omega
+    IG_COUNT
+} Integrator;
+
+/**
+ * Kernel used for the Euler integrate + collision step on the CPU.
+ */
+typedef enum {
+    SK_SCALAR,
+    SK_SSE,
+    SK_AVX,
+    SK_COUNT
+} SimdKernel;
+
+/**
+ * Output format of the frame capture.
+ * CF_RAW streams rgb24 frames, CF_Y4M a 4:2:0 video, CF_PNG one image per frame.
+ */
+typedef enum {
+    CF_RAW,
+    CF_Y4M,
+    CF_PNG,
+    CF_COUNT
+} CaptureFormat;
+
+/**
+ * Levels of the quality governor, every level keeps the reductions of the levels below.
+ */
+typedef enum {
+    QL_FULL,
+    QL_NO_VECTORS,      // no velocity and acceleration vectors
+    QL_NEAR_LOD,        // sphere LODs forced on, switched at a shorter distance
+    QL_NO_SHADOWS,      // no drop shadow pass
+    QL_FLAT_SPHERES,    // SV_SPHERE drawn as SV_TRIANGLE
+    QL_COUNT
+} QualityLevel;
+
 /**
  * Camera mode - either free or following lead particle.
  */
@@ -39,12 +129,49 @@ typedef enum {
     CAM_PARTICLE
 } CameraMode;
 
+/**
+ * Settings of one swarm. The swarms are stored back to back in the
+ * particle store in this order, count particles each.
+ * A swarm with an emitter spawns and kills its particles continuously
+ * (CPU backend only), count is then the most it ever holds.
+ */
+typedef struct {
+    int count;
+    TargetMode targetMode;
+    float kvMin;
+    float kvMax;
+    float kWeakMin;     // steering strength range of newly spawned particles
+    float kWeakMax;
+    int leaderIdx;      // index into the whole particle store, inside the swarm's range
+    vec3 color;
+
+    bool emitter;
+    float spawnRate;        // particles per second
+    float lifetime;         // seconds, 0 lives until a sink takes it
+    int burstCount;         // particles spawned at once every burstInterval, 0 for no bursts
+    float burstInterval;
+    vec3 emitterPos;        // in units of the room half-extent
+} SwarmSettings;
+
+/**
+ * Statistics of swarm 0 reduced on the GPU, one frame old.
+ */
+typedef struct {
+    vec3 centroid;
+    vec3 boundsMin;
+    vec3 boundsMax;
+    float meanSpeed;
+    float leaderDistance;   // distance of the leader to the centroid
+    bool valid;             // false until the first reduction was read back
+} SwarmSummary;
+
 /** Application state containing all settings and input data */
 typedef struct {
     bool isFullscreen;
     bool showWireframe;
     bool showHelp;
     bool showMenu;
+    bool showProfiler;
     bool paused;
     float deltaTime;
 
@@ -66,27 +193,134 @@ typedef struct {
         bool texOrder1;
         float roomSize;
         bool dropShadows;
+        InstanceUpload instanceUpload;
+        InstanceFormat instanceFormat;
+        bool gpuCulling;
+        bool mergedShadows;
+        bool instanceRotations;  // Instance rotations built once per frame by a compute pre-pass
+        bool sphereLod;
+        float lodDistance;
+        bool depthPrepass;  // Room depth-only first, shaded with GL_EQUAL after the scene
+        bool skybox;        // Gloomy room as floor and cubemap skybox instead of textured walls
+        bool trails;        // Motion trails from a GPU ring buffer of past positions
+        int trailLength;
+        bool prewarmShaders; // Builds likely needed shader programs ahead of their first use
+        bool translucent;   // Particles blended back to front, sorted on the GPU
+        float particleAlpha;
+        int sortBudget;     // Particles sorted per frame, more are weighted blended
     } rendering;
 
+    struct {
+        bool enabled;
+        CaptureFormat format;
+    } capture;
+
+    // Remote viewer server
+    struct {
+        bool enabled;
+        int port;
+        bool anyInterface;  // listen beyond localhost, no authentication
+        int quality;    // JPEG quality
+        bool halfSize;  // frames downsampled by two per axis
+    } stream;
+
+    // Quality governor, the settings below level are derived every frame
+    // from rendering and particles and are the ones to draw with
+    struct {
+        bool enabled;
+        float budgetMs;
+        QualityLevel level;
+        float workMs;
+
+        bool visVectors;
+        bool sphereLod;
+        float lodDistance;
+        bool dropShadows;
+        SphereVis sphereVis;
+    } quality;
+
+    // Dynamic resolution of the scene, scale is derived every frame
+    // from the GPU time and the quality budget
+    struct {
+        bool enabled;
+        float minScale;
+        float sharpness;    // Unsharp mask strength of the upscale
+        float scale;
+    } resolution;
+
     struct {
         float fixedDt;
         float simulationSpeed;
         float dtAccumulator;
 
+        // Step budget per frame, the backlog is capped to one budget
+        int maxSteps;
+        int stepsLastFrame;
+        float throughput;   // Particle steps per second, smoothed
+        bool interpolate;
+        bool threaded;      // Step on a simulation thread at wall-clock rate (CPU only)
+        int reorderInterval;    // Fixed steps between two Morton order reorders of the particles, 0 for off
+
+        // Temporal LOD: far or off-screen particles are stepped every interval-th step
+        // with a scaled dt, in round-robin buckets (CPU only)
+        struct {
+            bool enabled;
+            float distance;     // particles farther from the camera are reduced
+            bool offscreen;     // particles outside the view are reduced at any distance
+            float fidelity;     // 1 steps every particle at full rate, 0 at the longest interval
+            int interval;       // interval of the last step, capped by the stable dt
+            int reduced;        // particles not stepped at full rate in the last step
+        } temporalLod;
+
         float sphereRadius;
         float sphereSpeed;
 
         float roomForce;
+        bool obstacles;         // Particles steer around the static obstacles of the distance volume
+        float obstacleForce;
+        PhysicsBackend backend;
+        int threadCount;
+        SimdKernel kernel;
+        Integrator integrator;
+        bool fastMath;      // fastmath approximations of exp and normalize in the target modes
+
+        ReplayMode replayMode;
+        bool traceDelta;    // Delta-compress recorded steps against the previous one
+
+        bool swarmStats;    // Reduce and read back a SwarmSummary (GPU only)
+        SwarmSummary stats;
     } physics;
 
     struct {
-        int count;
+        int count;              // all swarms together
         float gaussianConst;
+        bool attractorField;    // TM_SPHERES samples a force field splatted once per step (CPU only)
+        bool extremeScale;      // GPU-only state, one swarm as point sprites, no per-frame transfers
         SphereVis sphereVis;
-        TargetMode targetMode;
         float leaderKv;
-        int leaderIdx;
         bool visVectors;
+        bool vectorLines;
+        bool sphereSinks;       // particles of emitting swarms die inside the spheres
+
+        // TM_FLOCK
+        struct {
+            float radius;
+            float separation;
+            float alignment;
+            float cohesion;
+        } flock;
+
+        // TM_GRAVITY, every swarm has a total mass of 1
+        struct {
+            float theta;        // Barnes-Hut opening angle, 0 is exact
+            float strength;
+            float softening;
+        } gravity;
+
+        // Swarm 0 is the one the GPU backend runs and the particle camera follows,
+        // more than one swarm is CPU only
+        int swarmCount;
+        SwarmSettings swarms[MAX_SWARMS];
     } particles;
 
 } InputData;
@@ -97,16 +331,52 @@ typedef struct {
  */
 void input_init(ProgContext ctx);
 
+/**
+ * Sets the default values that do not need a GL context or camera.
+ * Called by input_init, used on its own by the headless benchmark.
+ */
+void input_initDefaults(void);
+
 /**
  * Returns pointer to global input data
  * @return Pointer to InputData
  */
 InputData* getInputData(void);
 
+/**
+ * Returns if any of the active swarms steers with the given target mode.
+ * @param data Input state.
+ * @param mode Target mode to look for.
+ * @return True if at least one active swarm uses mode.
+ */
+bool input_swarmsUseMode(InputData *data, TargetMode mode);
+
+/**
+ * Returns if any of the active swarms has an emitter.
+ * @param data Input state.
+ * @return True if at least one active swarm emits.
+ */
+bool input_swarmsEmit(InputData *data);
+
 /**
  * Registers all input callbacks with GLFW
  * @param ctx Program context
  */
 void input_registerCallbacks(ProgContext ctx);
 
+/**
+ * Handles the mouse movement recorded since the last call, call once per
+ * frame after the events were polled.
+ * @param ctx Program context
+ */
+void input_flushEvents(ProgContext ctx);
+
+/**
+ * Hands an input event of a remote viewer to the callbacks of the window
+ * events. Remote cursor movement is coalesced with the local one.
+ * @param ctx Program context
+ * @param event The event
+ */
+void input_remoteEvent(ProgContext ctx, const StreamEvent *event);
+
 #endif // INPUT_H
\ No newline at end of file
@@ -1,25 +1,115 @@
 #include "instanced.h"
 #include <fhwcg/fhwcg.h>
 #include "input.h"
+#include "shader.h"
+#include "utils.h"
+#include "glstate.h"
+#include "arena.h"
+#include "gpumem.h"
+#include "alloctrack.h"
+#include "metrics.h"
 
 /**
- * Mesh structure containing OpenGL buffer objects.
+ * Range of a mesh in the static mesh pool.
  */
 struct CGMesh {
-    GLuint vao, vbo, ebo;
+    GLint baseVertex;
+    GLuint firstIndex;
     GLsizei numVertices, numIndices;
-    GLenum mode; 
+    GLenum mode;
 };
 
+/** Number of ring regions used by the persistent upload path */
+#define STREAM_REGIONS 3
+
+/**
+ * Base vertices in the mesh pool are multiples of this. gl_VertexID includes
+ * the base vertex, the shaders deriving corners from it modulo 2, 3 or 4
+ * then see the same values as from a buffer of their own.
+ */
+#define MESH_POOL_ALIGN 12
+
+/** Work group size of particleCull.comp */
+#define CULL_GROUP_SIZE 256
+
+/** SSBO binding of the indirect command in particleCull.comp */
+#define CULL_COMMAND_BINDING 10
+
+/** Work group size of particleBasis.comp */
+#define BASIS_GROUP_SIZE 256
+
+/** Layout of the rotation quaternion, 4 x snorm16 */
+#define ROTATION_STRIDE (4 * sizeof(GLshort))
+
+/** Storage buffer bindings read by pull.glsl, above those of the compute passes */
+#define PULL_VERTEX_BINDING 11
+#define PULL_COLUMN_BINDING 12
+#define PULL_ROTATION_BINDING (PULL_COLUMN_BINDING + IC_COUNT)
+#define PULL_ORDER_BINDING (PULL_ROTATION_BINDING + 1)
+
+/** Timeout per fence wait in nanoseconds */
+#define FENCE_TIMEOUT_NS 1000000ULL
+
+// GL 4.4 / ARB_buffer_storage is not part of the generated loader
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+/** Layout of DrawElementsIndirectCommand */
+typedef struct {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLuint baseVertex;
+    GLuint baseInstance;
+} DrawElementsCommand;
+
+/** Layout of DrawArraysIndirectCommand */
+typedef struct {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+} DrawArraysCommand;
+
 /**
- * Per-instance data structure for particle rendering.
+ * Contents of the indirect command buffer, one command per LOD.
+ * The cull pass counts into the elements commands, the counts are
+ * then copied into the arrays commands on the GPU.
  */
 typedef struct {
-    vec3 pos;
-    vec3 acceleration;
-    vec3 up;
-    vec3 forward;
-} ParticleInstance;
+    DrawElementsCommand elements[INSTANCED_MAX_LODS];
+    DrawArraysCommand arrays[INSTANCED_MAX_LODS];
+} CommandBlock;
+
+/**
+ * Bytes per instance of every column per InstanceFormat, pull.glsl decodes them.
+ * Packed: acceleration as 4 half floats, up and forward octahedral
+ * encoded into 2 x snorm16. 32 instead of 52 bytes per instance.
+ * The swarm id is an integer in both formats.
+ */
+static const GLsizei g_columnStrides[IF_COUNT][IC_COUNT] = {
+    [IF_FLOAT] = {
+        [IC_POS] = 3 * sizeof(GLfloat),
+        [IC_ACCELERATION] = 3 * sizeof(GLfloat),
+        [IC_UP] = 3 * sizeof(GLfloat),
+        [IC_FORWARD] = 3 * sizeof(GLfloat),
+        [IC_SWARM] = sizeof(GLint)
+    },
+    [IF_PACKED] = {
+        [IC_POS] = 3 * sizeof(GLfloat),
+        [IC_ACCELERATION] = 4 * sizeof(GLhalf),
+        [IC_UP] = 2 * sizeof(GLshort),
+        [IC_FORWARD] = 2 * sizeof(GLshort),
+        [IC_SWARM] = sizeof(GLint)
+    }
+};
+
+/** glBufferStorage function pointer type */
+typedef void (APIENTRYP BufferStorageFn)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
 
 ////////////////////////    LOCAL    ////////////////////////////
 
@@ -27,15 +117,464 @@ typedef struct {
  * Global instance buffer state.
  */
 static struct {
-    GLuint buffer;
-    ParticleInstance *instances;
+    GLuint buffers[IC_COUNT];
     int size;
+    int capacity;
+
+    InstanceUpload mode;
+    InstanceUpload requested;
+    InstanceFormat format;
+
+    // Persistent path: mapped ring with one fence per region
+    char *mapped[IC_COUNT];
+    GLsync fences[STREAM_REGIONS];
+    int region;
+
+    // Rotation of every instance built by the basis pre-pass, one buffer per column set,
+    // only valid between instanced_buildRotations and instanced_endCull
+    GLuint rotations, culledRotations;
+    bool rotationsBuilt;
+
+    // Culling: compacted copy of the columns (one range per LOD) and the indirect commands
+    GLuint culled[IC_COUNT];
+    GLuint commands;
+    bool cullActive;
+
+    // Delayed readback of the per-LOD instance counts
+    GLuint readback;
+    GLsync readbackFence;
+    int lodCounts[INSTANCED_MAX_LODS];
+    int lodCount;
 } g_vbo = {
-    .buffer = 0,
+    .buffers = { 0 },
     .size = 0,
-    .instances = NULL
+    .capacity = 0,
+    .mode = IU_SUBDATA,
+    .requested = IU_SUBDATA,
+    .format = IF_FLOAT,
+    .region = 0,
+    .cullActive = false
 };
 
+/**
+ * Static mesh pool: the vertices and indices of all meshes in one immutable
+ * buffer each. The vertices are pulled from a storage buffer, the only VAO
+ * holds no attributes and just the index buffer.
+ * Meshes are staged on the CPU until instanced_init uploads them.
+ */
+static struct {
+    GLuint vao, vbo, ebo;
+    CGVertex *vertices;
+    GLuint *indices;
+    int numVertices, numIndices;
+    bool uploaded;
+
+    // Instances per capacity step, keeps every column range at the storage buffer offset alignment
+    int instanceAlign;
+
+    // Column set and first instance bound for pulling, NULL after the columns changed
+    const GLuint *boundColumns;
+    GLuint boundFirst;
+} g_pool = { 0 };
+
+/** glBufferStorage entry point, NULL if not supported by the context */
+static BufferStorageFn g_bufferStorage = NULL;
+
+/**
+ * Loads glBufferStorage if the context supports GL 4.4 or ARB_buffer_storage.
+ */
+static void loadBufferStorage(void) {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+    bool supported = (major > 4 || (major == 4 && minor >= 4))
+        || glfwExtensionSupported("GL_ARB_buffer_storage");
+
+    g_bufferStorage = supported ? (BufferStorageFn)glfwGetProcAddress("glBufferStorage") : NULL;
+}
+
+/**
+ * Blocks until the GPU finished reading the given ring region.
+ * @param region Region index.
+ */
+static void waitRegion(int region) {
+    GLsync fence = g_vbo.fences[region];
+    if (!fence) {
+        return;
+    }
+
+    GLenum res;
+    do {
+        res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+    } while (res == GL_TIMEOUT_EXPIRED);
+
+    glDeleteSync(fence);
+    g_vbo.fences[region] = NULL;
+}
+
+/**
+ * Binds the pool vertices and a set of instance columns to the storage
+ * buffer bindings of pull.glsl and the empty VAO. The columns are bound
+ * from the first drawn instance on, so gl_InstanceID indexes them directly
+ * and switching between column sets or ring regions is a range rebind.
+ * Skipped while the same range is bound, no other pass uses these bindings.
+ * @param columns One buffer per InstanceColumn.
+ * @param rotations Rotation buffer of the same column set.
+ * @param first First drawn instance, a multiple of the capacity.
+ */
+static void bindPull(const GLuint *columns, GLuint rotations, GLuint first) {
+    glstate_bindVertexArray(g_pool.vao);
+    if (g_pool.boundColumns == columns && g_pool.boundFirst == first) {
+        return;
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PULL_VERTEX_BINDING, g_pool.vbo);
+    for (int i = 0; i < IC_COUNT; ++i) {
+        GLsizei stride = g_columnStrides[g_vbo.format][i];
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, PULL_COLUMN_BINDING + i, columns[i],
+            (GLintptr)first * stride, (GLsizeiptr)g_vbo.capacity * stride);
+    }
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, PULL_ROTATION_BINDING, rotations,
+        (GLintptr)first * ROTATION_STRIDE, (GLsizeiptr)g_vbo.capacity * ROTATION_STRIDE);
+
+    g_pool.boundColumns = columns;
+    g_pool.boundFirst = first;
+}
+
+/**
+ * Creates a buffer the GPU only reads, immutable where glBufferStorage is available.
+ * @param target Binding point used for the upload.
+ * @param size Size in bytes, at least 1.
+ * @param data Contents of the buffer.
+ * @return The buffer.
+ */
+static GLuint createStaticBuffer(GLenum target, GLsizeiptr size, const void *data) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    if (g_bufferStorage) {
+        g_bufferStorage(target, size, data, 0);
+    } else {
+        glBufferData(target, size, data, GL_STATIC_DRAW);
+    }
+    gpumem_setBuffer(GPUMEM_GEOMETRY, buffer, (size_t) size);
+    glBindBuffer(target, 0);
+    return buffer;
+}
+
+/**
+ * Uploads the staged meshes into the pool buffers and creates the empty VAO.
+ */
+static void uploadPool(void) {
+    assert(!g_pool.uploaded && "mesh pool uploaded twice");
+
+    // Draws leave their VAO bound, which must not pick up the index buffer
+    glstate_bindVertexArray(0);
+    g_pool.vbo = createStaticBuffer(GL_SHADER_STORAGE_BUFFER,
+        (GLsizeiptr) glm_imax(g_pool.numVertices, 1) * sizeof(CGVertex), g_pool.vertices);
+    g_pool.ebo = createStaticBuffer(GL_ELEMENT_ARRAY_BUFFER,
+        (GLsizeiptr) glm_imax(g_pool.numIndices, 1) * sizeof(GLuint), g_pool.indices);
+
+    // No attributes, the index buffer is the only state
+    glGenVertexArrays(1, &g_pool.vao);
+    glstate_bindVertexArray(g_pool.vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_pool.ebo);
+    glstate_bindVertexArray(0);
+
+    // Column ranges start at multiples of the capacity, the smallest stride is one word
+    GLint alignment = 1;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    g_pool.instanceAlign = glm_imax(alignment / (GLint) sizeof(GLuint), 1);
+
+    TRACKED_FREE(g_pool.vertices);
+    TRACKED_FREE(g_pool.indices);
+    g_pool.vertices = NULL;
+    g_pool.indices = NULL;
+    g_pool.uploaded = true;
+}
+
+/**
+ * Unmaps and deletes all column buffers and pending fences.
+ */
+static void destroyColumns(void) {
+    for (int r = 0; r < STREAM_REGIONS; ++r) {
+        waitRegion(r);
+    }
+
+    for (int i = 0; i < IC_COUNT; ++i) {
+        if (g_vbo.mapped[i]) {
+            glBindBuffer(GL_ARRAY_BUFFER, g_vbo.buffers[i]);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            g_vbo.mapped[i] = NULL;
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    gpumem_deleteBuffers(IC_COUNT, g_vbo.buffers);
+    memset(g_vbo.buffers, 0, sizeof(g_vbo.buffers));
+    gpumem_deleteBuffers(IC_COUNT, g_vbo.culled);
+    memset(g_vbo.culled, 0, sizeof(g_vbo.culled));
+    gpumem_deleteBuffers(1, &g_vbo.rotations);
+    gpumem_deleteBuffers(1, &g_vbo.culledRotations);
+    g_vbo.rotations = 0;
+    g_vbo.culledRotations = 0;
+    g_vbo.rotationsBuilt = false;
+    g_vbo.region = 0;
+}
+
+/**
+ * (Re)creates all column buffers for the given mode and capacity.
+ * Falls back to IU_SUBDATA if persistent mapping is not available.
+ * @param mode Requested upload mode.
+ * @param capacity Number of instances per column (and per region).
+ */
+static void createColumns(InstanceUpload mode, int capacity) {
+    destroyColumns();
+    if (mode == IU_PERSISTENT && !g_bufferStorage) {
+        mode = IU_SUBDATA;
+    }
+    capacity = (capacity + g_pool.instanceAlign - 1) / g_pool.instanceAlign * g_pool.instanceAlign;
+    g_pool.boundColumns = NULL;
+
+    glGenBuffers(IC_COUNT, g_vbo.buffers);
+    glGenBuffers(IC_COUNT, g_vbo.culled);
+    g_vbo.capacity = capacity;
+    g_vbo.mode = mode;
+
+    GLsizeiptr columnSize = (GLsizeiptr)capacity * sizeof(vec3);
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    for (int i = 0; i < IC_COUNT; ++i) {
+        glBindBuffer(GL_ARRAY_BUFFER, g_vbo.buffers[i]);
+
+        if (mode == IU_PERSISTENT) {
+            GLsizeiptr ringSize = columnSize * STREAM_REGIONS;
+            g_bufferStorage(GL_ARRAY_BUFFER, ringSize, NULL, flags);
+            gpumem_setBuffer(GPUMEM_INSTANCES, g_vbo.buffers[i], (size_t) ringSize);
+            g_vbo.mapped[i] = glMapBufferRange(GL_ARRAY_BUFFER, 0, ringSize, flags);
+
+            if (!g_vbo.mapped[i]) {
+                printf("Could not map instance buffer, falling back to glBufferSubData!\n");
+                createColumns(IU_SUBDATA, capacity);
+                return;
+            }
+        } else {
+            glBufferData(GL_ARRAY_BUFFER, columnSize, NULL, GL_DYNAMIC_DRAW);
+            gpumem_setBuffer(GPUMEM_INSTANCES, g_vbo.buffers[i], (size_t) columnSize);
+        }
+
+        // Only written by the cull pass, so no ring regions but one range per LOD
+        glBindBuffer(GL_ARRAY_BUFFER, g_vbo.culled[i]);
+        glBufferData(GL_ARRAY_BUFFER, columnSize * INSTANCED_MAX_LODS, NULL, GL_DYNAMIC_COPY);
+        gpumem_setBuffer(GPUMEM_INSTANCES, g_vbo.culled[i], (size_t) columnSize * INSTANCED_MAX_LODS);
+    }
+
+    // Written on the GPU only, with the same slots as the columns they belong to
+    GLsizeiptr rotationSize = (GLsizeiptr)capacity * ROTATION_STRIDE;
+    glGenBuffers(1, &g_vbo.rotations);
+    glBindBuffer(GL_ARRAY_BUFFER, g_vbo.rotations);
+    glBufferData(GL_ARRAY_BUFFER, rotationSize * (mode == IU_PERSISTENT ? STREAM_REGIONS : 1), NULL, GL_DYNAMIC_COPY);
+    gpumem_setBuffer(GPUMEM_INSTANCES, g_vbo.rotations,
+        (size_t) rotationSize * (mode == IU_PERSISTENT ? STREAM_REGIONS : 1));
+    glGenBuffers(1, &g_vbo.culledRotations);
+    glBindBuffer(GL_ARRAY_BUFFER, g_vbo.culledRotations);
+    glBufferData(GL_ARRAY_BUFFER, rotationSize * INSTANCED_MAX_LODS, NULL, GL_DYNAMIC_COPY);
+    gpumem_setBuffer(GPUMEM_INSTANCES, g_vbo.culledRotations, (size_t) rotationSize * INSTANCED_MAX_LODS);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+ * Converts a float to IEEE half precision.
+ * Rounds to nearest, flushes denormals to zero and saturates to infinity.
+ * @param f Value to convert.
+ * @return The half float bits.
+ */
+static GLhalf packHalf(float f) {
+    union { float f; GLuint u; } v = { f };
+    GLuint sign = (v.u >> 16) & 0x8000u;
+    int exp = (int)((v.u >> 23) & 0xffu) - 127 + 15;
+    GLuint mant = v.u & 0x7fffffu;
+
+    if (exp <= 0) {
+        return (GLhalf)sign;
+    }
+    if (exp >= 31) {
+        return (GLhalf)(sign | 0x7c00u);
+    }
+
+    // A carry out of the mantissa correctly bumps the exponent
+    GLuint bits = ((GLuint)exp << 10) + ((mant + 0x1000u) >> 13);
+    return (GLhalf)(sign | (bits > 0x7c00u ? 0x7c00u : bits));
+}
+
+/**
+ * Octahedral encoding of a unit vector into two snorm16 values.
+ * Decoded by octDecode in utils.glsl.
+ * @param v Unit vector.
+ * @param dst Destination for the two components.
+ */
+static void packOct(vec3 v, GLshort *dst) {
+    float l1 = fabsf(v[0]) + fabsf(v[1]) + fabsf(v[2]);
+    float x = l1 > 0.0f ? v[0] / l1 : 0.0f;
+    float y = l1 > 0.0f ? v[1] / l1 : 0.0f;
+
+    if (v[2] < 0.0f) {
+        float ox = x;
+        x = (1.0f - fabsf(y)) * (ox >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - fabsf(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    dst[0] = (GLshort)roundf(CLAMP(x, -1.0f, 1.0f) * 32767.0f);
+    dst[1] = (GLshort)roundf(CLAMP(y, -1.0f, 1.0f) * 32767.0f);
+}
+
+/**
+ * Writes one column in the packed format.
+ * @param column Column, selects the encoding.
+ * @param count Number of instances.
+ * @param src Source array with at least count elements.
+ * @param dst Destination with room for count packed elements.
+ */
+static void packColumn(InstanceColumn column, int count, vec3 *src, void *dst) {
+    switch (column) {
+        case IC_ACCELERATION: {
+            GLhalf *out = dst;
+            for (int i = 0; i < count; ++i) {
+                out[4 * i] = packHalf(src[i][0]);
+                out[4 * i + 1] = packHalf(src[i][1]);
+                out[4 * i + 2] = packHalf(src[i][2]);
+                out[4 * i + 3] = 0;
+            }
+            break;
+        }
+        case IC_UP:
+        case IC_FORWARD: {
+            GLshort *out = dst;
+            for (int i = 0; i < count; ++i) {
+                packOct(src[i], out + 2 * i);
+            }
+            break;
+        }
+        case IC_POS:
+        default:
+            memcpy(dst, src, count * sizeof(vec3));
+            break;
+    }
+}
+
+/**
+ * Uploads one column from client memory into the active buffer region.
+ * @param column Target column.
+ * @param count Number of instances to upload.
+ * @param src Source array with at least count elements, vec3 except for IC_SWARM.
+ */
+static void uploadColumn(InstanceColumn column, int count, const void *src) {
+    GLsizei stride = g_columnStrides[g_vbo.format][column];
+    size_t size = (size_t)count * stride;
+    bool packed = g_vbo.format == IF_PACKED && column != IC_POS && column != IC_SWARM;
+    metrics_count(METRIC_UPLOAD_BYTES, (long) size);
+
+    if (g_vbo.mode == IU_PERSISTENT) {
+        char *dst = g_vbo.mapped[column] + (size_t)g_vbo.region * g_vbo.capacity * stride;
+        if (packed) {
+            packColumn(column, count, (vec3*) src, dst);
+        } else {
+            memcpy(dst, src, size);
+        }
+        return;
+    }
+
+    // glBufferSubData copies the data, so the staging memory is released right after
+    Arena *frame = arena_frame();
+    ArenaMark mark = arena_mark(frame);
+    const void *data = src;
+    if (packed) {
+        void *scratch = arena_alloc(frame, size);
+        packColumn(column, count, (vec3*) src, scratch);
+        data = scratch;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_vbo.buffers[column]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+    arena_release(frame, mark);
+}
+
+/**
+ * Returns the first instance of the region the GPU should read from.
+ * @return Base instance for instanced draw calls.
+ */
+static GLuint baseInstance(void) {
+    return g_vbo.mode == IU_PERSISTENT ? (GLuint)(g_vbo.region * g_vbo.capacity) : 0;
+}
+
+/**
+ * Fetches the per-LOD counts of an earlier cull pass once the GPU is done
+ * and queues a copy of the current commands for a later frame.
+ */
+static void updateLodCounts(void) {
+    if (g_vbo.readbackFence) {
+        GLenum res = glClientWaitSync(g_vbo.readbackFence, 0, 0);
+        if (res == GL_TIMEOUT_EXPIRED) {
+            return;
+        }
+
+        CommandBlock block;
+        glBindBuffer(GL_COPY_READ_BUFFER, g_vbo.readback);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(CommandBlock), &block);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        for (int l = 0; l < INSTANCED_MAX_LODS; ++l) {
+            g_vbo.lodCounts[l] = (int)block.elements[l].instanceCount;
+        }
+
+        glDeleteSync(g_vbo.readbackFence);
+        g_vbo.readbackFence = NULL;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, g_vbo.commands);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, g_vbo.readback);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(CommandBlock));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    g_vbo.readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/**
+ * Draws the culled instances of one LOD range with its indirect command.
+ * @param m Mesh to draw.
+ * @param lod LOD range to draw.
+ */
+static void drawIndirect(CGMesh *m, int lod) {
+    bindPull(g_vbo.culled, g_vbo.culledRotations, (GLuint)(lod * g_vbo.capacity));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_vbo.commands);
+
+    // The instance count was written by the cull pass, count and range are per mesh
+    GLintptr cmdOffset;
+    if (m->numIndices) {
+        cmdOffset = offsetof(CommandBlock, elements) + lod * sizeof(DrawElementsCommand);
+        GLuint count = (GLuint)m->numIndices;
+        GLuint range[2] = { m->firstIndex, (GLuint)m->baseVertex };
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, cmdOffset, sizeof(GLuint), &count);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, cmdOffset + offsetof(DrawElementsCommand, firstIndex),
+            sizeof(range), range);
+    } else {
+        cmdOffset = offsetof(CommandBlock, arrays) + lod * sizeof(DrawArraysCommand);
+        GLuint count = (GLuint)m->numVertices;
+        GLuint first = (GLuint)m->baseVertex;
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, cmdOffset, sizeof(GLuint), &count);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, cmdOffset + offsetof(DrawArraysCommand, first),
+            sizeof(GLuint), &first);
+    }
+
+    if (m->numIndices) {
+        glDrawElementsIndirect(m->mode, GL_UNSIGNED_INT, (void*)cmdOffset);
+    } else {
+        glDrawArraysIndirect(m->mode, (void*)cmdOffset);
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
 ////////////////////////    PUBLIC    ////////////////////////////
 
 CGMesh* instanced_createMesh(
@@ -43,180 +582,303 @@ CGMesh* instanced_createMesh(
     const GLuint* indices, const int numInd, 
     GLenum mode
 ) {
-    CGMesh *m = malloc(sizeof(CGMesh));
-
-    GLuint vao, vbo, ebo;
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(CGVertex) * numVerts, vertices, GL_DYNAMIC_DRAW);
-
-    // Position
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CGVertex), (void*)offsetof(CGVertex, position));
-
-    // Normal
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(CGVertex), (void*)offsetof(CGVertex, normal));
-
-    // Tex Coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(CGVertex), (void*)offsetof(CGVertex, texCoords));
+    assert(!g_pool.uploaded && "meshes must be created before instanced_init");
+    CGMesh *m = TRACKED_MALLOC(sizeof(CGMesh));
+    assert(m && "malloc failed in instanced_createMesh");
+
+    int base = (g_pool.numVertices + MESH_POOL_ALIGN - 1) / MESH_POOL_ALIGN * MESH_POOL_ALIGN;
+    CGVertex *v = TRACKED_REALLOC(g_pool.vertices, (size_t)(base + numVerts) * sizeof(CGVertex));
+    assert(v && "realloc failed in instanced_createMesh");
+    memset(v + g_pool.numVertices, 0, (size_t)(base - g_pool.numVertices) * sizeof(CGVertex));
+    memcpy(v + base, vertices, (size_t)numVerts * sizeof(CGVertex));
+    g_pool.vertices = v;
+
+    if (numInd) {
+        GLuint *i = TRACKED_REALLOC(g_pool.indices, (size_t)(g_pool.numIndices + numInd) * sizeof(GLuint));
+        assert(i && "realloc failed in instanced_createMesh");
+        memcpy(i + g_pool.numIndices, indices, (size_t)numInd * sizeof(GLuint));
+        g_pool.indices = i;
+    }
 
+    // Indices stay relative to the mesh, baseVertex offsets them
+    m->baseVertex = base;
+    m->firstIndex = (GLuint)g_pool.numIndices;
     m->numVertices = numVerts;
-    m->vao = vao;
-    m->vbo = vbo;
-
-    glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) *numInd, indices, GL_DYNAMIC_DRAW);
-    m->mode = mode;
     m->numIndices = numInd;
-    m->ebo = ebo;
-
-    glBindVertexArray(0);
+    m->mode = mode;
+    g_pool.numVertices = base + numVerts;
+    g_pool.numIndices += numInd;
 
     return m;
 }
 
 void instanced_disposeMesh(CGMesh *m) {
-    if (m->vbo) {
-        glDeleteBuffers(1, &(m->vbo));
-        m->vbo = 0;
-    }
+    TRACKED_FREE(m);
+}
 
-    if (m->ebo) { 
-        glDeleteBuffers(1, &(m->ebo));
-        m->ebo = 0;
-    }
+int instanced_getBaseVertex(const CGMesh *m) {
+    return m->baseVertex;
+}
 
-    if (m->vao) {
-        glDeleteVertexArrays(1, &(m->vao));
-        m->vao = 0;
+void instanced_draw(CGMesh *m, bool instanced, int lod) {
+    if (instanced && g_vbo.cullActive) {
+        drawIndirect(m, lod);
+        return;
     }
 
-    free(m);
-}
+    // Without the cull pass everything is in LOD 0
+    if (instanced && lod > 0) {
+        return;
+    }
 
-void instanced_draw(CGMesh *m, bool instanced) {
-    glBindVertexArray(m->vao);
+    bindPull(g_vbo.buffers, g_vbo.rotations, baseInstance());
 
+    const void *first = (const void*)(m->firstIndex * sizeof(GLuint));
     if (m->numIndices) {
         if (instanced) {
-            glDrawElementsInstanced(m->mode, m->numIndices, GL_UNSIGNED_INT, 0, g_vbo.size);
+            glDrawElementsInstancedBaseVertex(m->mode, m->numIndices, GL_UNSIGNED_INT, first,
+                g_vbo.size, m->baseVertex);
         } else {
-            glDrawElements(m->mode, m->numIndices, GL_UNSIGNED_INT, 0);
+            glDrawElementsBaseVertex(m->mode, m->numIndices, GL_UNSIGNED_INT, first, m->baseVertex);
         }
     } else {
         if (instanced) {
-            glDrawArraysInstanced(m->mode, 0, m->numVertices, g_vbo.size);
+            glDrawArraysInstanced(m->mode, m->baseVertex, m->numVertices, g_vbo.size);
         } else {
-            glDrawArrays(m->mode, 0, m->numVertices);
+            glDrawArrays(m->mode, m->baseVertex, m->numVertices);
         }
     }
-
-    glBindVertexArray(0);
 }
 
-void instanced_drawParticleVis(CGMesh *m) {
-    glBindVertexArray(m->vao);
+void instanced_drawParticleVis(CGMesh *m, int lod) {
+    if (g_vbo.cullActive) {
+        drawIndirect(m, lod);
+        return;
+    }
+
+    if (lod > 0) {
+        return;
+    }
+
+    bindPull(g_vbo.buffers, g_vbo.rotations, baseInstance());
 
     if (m->numIndices) {
-        glDrawElementsInstanced(m->mode, m->numIndices, GL_UNSIGNED_INT, 0, g_vbo.size);
+        glDrawElementsInstancedBaseVertex(m->mode, m->numIndices, GL_UNSIGNED_INT,
+            (const void*)(m->firstIndex * sizeof(GLuint)), g_vbo.size, m->baseVertex);
     } else {
-        glDrawArraysInstanced(m->mode, 0, m->numVertices, g_vbo.size);
+        glDrawArraysInstanced(m->mode, m->baseVertex, m->numVertices, g_vbo.size);
     }
+}
 
-    glBindVertexArray(0);
+void instanced_drawOrdered(CGMesh *m, GLuint order) {
+    bindPull(g_vbo.buffers, g_vbo.rotations, baseInstance());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PULL_ORDER_BINDING, order);
+
+    if (m->numIndices) {
+        glDrawElementsInstancedBaseVertex(m->mode, m->numIndices, GL_UNSIGNED_INT,
+            (const void*)(m->firstIndex * sizeof(GLuint)), g_vbo.size, m->baseVertex);
+    } else {
+        glDrawArraysInstanced(m->mode, m->baseVertex, m->numVertices, g_vbo.size);
+    }
 }
 
 void instanced_init(void) {
+    loadBufferStorage();
+    uploadPool();
+
+    CommandBlock block = { 0 };
+    glGenBuffers(1, &g_vbo.commands);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_vbo.commands);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(CommandBlock), &block, GL_DYNAMIC_DRAW);
+    gpumem_setBuffer(GPUMEM_INSTANCES, g_vbo.commands, sizeof(CommandBlock));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glGenBuffers(1, &g_vbo.readback);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, g_vbo.readback);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(CommandBlock), NULL, GL_STREAM_READ);
+    gpumem_setBuffer(GPUMEM_STAGING, g_vbo.readback, sizeof(CommandBlock));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
     g_vbo.size = START_NUM_PARTICLES;
-    g_vbo.instances = malloc(g_vbo.size * sizeof(ParticleInstance));
-    glGenBuffers(1, &g_vbo.buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, g_vbo.buffer);
-    glBufferData(GL_ARRAY_BUFFER, g_vbo.size * sizeof(ParticleInstance), NULL, GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    g_vbo.requested = getInputData()->rendering.instanceUpload;
+    createColumns(g_vbo.requested, g_vbo.size);
 }
 
-void instanced_bindAttrib(CGMesh *m) {
-    glBindVertexArray(m->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, g_vbo.buffer);
-
-    // Offset Position
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(
-        4, 3, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance),
-        (void*)offsetof(ParticleInstance, pos)
-    );
-    glVertexAttribDivisor(4, 1);
-
-    // Acceleration
-    glEnableVertexAttribArray(5);
-    glVertexAttribPointer(
-        5, 3, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance),
-        (void*)offsetof(ParticleInstance, acceleration)
-    );
-    glVertexAttribDivisor(5, 1);
-
-    // Up
-    glEnableVertexAttribArray(6);
-    glVertexAttribPointer(
-        6, 3, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance),
-        (void*)offsetof(ParticleInstance, up)
-    );
-    glVertexAttribDivisor(6, 1);
-
-    // Forward
-    glEnableVertexAttribArray(7);
-    glVertexAttribPointer(
-        7, 3, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance),
-        (void*)offsetof(ParticleInstance, forward)
-    );
-    glVertexAttribDivisor(7, 1);
+void instanced_resize(int count) {
+    g_vbo.size = count;
+    if (count <= g_vbo.capacity) {
+        return;
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    // Grow geometrically, shrinking only changes the drawn count
+    int capacity = g_vbo.capacity * 2;
+    if (capacity < count) capacity = count;
+    createColumns(g_vbo.requested, capacity);
 }
 
-void instanced_resize(int count) {
-    if (g_vbo.size == count) {
-        return;
+void instanced_update(int count, vec3* pos, vec3* acceleration, vec3* up, vec3* forward, int* swarm) {
+    InputData *data = getInputData();
+    InstanceUpload requested = data->rendering.instanceUpload;
+
+    // The GPU integrator reads and writes the columns as floats
+    InstanceFormat format = data->physics.backend == PB_CPU ? data->rendering.instanceFormat : IF_FLOAT;
+
+    if (requested != g_vbo.requested || format != g_vbo.format) {
+        g_vbo.requested = requested;
+        g_vbo.format = format;
+        createColumns(requested, g_vbo.capacity);
     }
 
-    g_vbo.size = count;
-    ParticleInstance *tmp = realloc(g_vbo.instances, g_vbo.size * sizeof(ParticleInstance));
-    if (!tmp) {
-        printf("Could not allocate memory in instanced_resize!");
-        return;
+    instanced_resize(count);
+
+    if (g_vbo.mode == IU_PERSISTENT) {
+        // Draws issued since the last update read the current region
+        if (g_vbo.fences[g_vbo.region]) {
+            glDeleteSync(g_vbo.fences[g_vbo.region]);
+        }
+        g_vbo.fences[g_vbo.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        g_vbo.region = (g_vbo.region + 1) % STREAM_REGIONS;
+        waitRegion(g_vbo.region);
     }
 
-    g_vbo.instances = tmp;
-    glBindBuffer(GL_ARRAY_BUFFER, g_vbo.buffer);
-    glBufferData(GL_ARRAY_BUFFER, g_vbo.size * sizeof(ParticleInstance), NULL, GL_DYNAMIC_DRAW);
+    uploadColumn(IC_POS, count, pos);
+    uploadColumn(IC_ACCELERATION, count, acceleration);
+    uploadColumn(IC_UP, count, up);
+    uploadColumn(IC_FORWARD, count, forward);
+    uploadColumn(IC_SWARM, count, swarm);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void instanced_update(int count, vec3* pos, vec3* acceleration, vec3* up, vec3* forward) {
-    instanced_resize(count);
+InstanceUpload instanced_getUploadMode(void) {
+    return g_vbo.mode;
+}
 
-    for (int i = 0; i < count; ++i) {
-        glm_vec3_copy(pos[i], g_vbo.instances[i].pos);
-        glm_vec3_copy(acceleration[i], g_vbo.instances[i].acceleration);
-        glm_vec3_copy(up[i], g_vbo.instances[i].up);
-        glm_vec3_copy(forward[i], g_vbo.instances[i].forward);
+InstanceFormat instanced_getFormat(void) {
+    return g_vbo.format;
+}
+
+GLuint instanced_getColumnBuffer(InstanceColumn column) {
+    return g_vbo.buffers[column];
+}
+
+int instanced_getBaseInstance(void) {
+    return (int)baseInstance();
+}
+
+int instanced_getCount(void) {
+    return g_vbo.size;
+}
+
+bool instanced_beginCull(int leaderIdx, float radius, int lodCount) {
+    g_vbo.cullActive = false;
+    g_vbo.lodCount = 0;
+    lodCount = CLAMP(lodCount, 1, INSTANCED_MAX_LODS);
+    const GLsizei *strides = g_columnStrides[g_vbo.format];
+    int accWords = strides[IC_ACCELERATION] / (int)sizeof(GLuint);
+    int basisWords = strides[IC_UP] / (int)sizeof(GLuint);
+    if (g_vbo.size <= 0 || !shader_setParticleCullData(
+            getInputData(), g_vbo.size, (int)baseInstance(), leaderIdx, radius, lodCount, g_vbo.capacity,
+            accWords, basisWords)) {
+        return false;
     }
 
-    glBindBuffer(GL_ARRAY_BUFFER, g_vbo.buffer);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, g_vbo.size * sizeof(ParticleInstance), g_vbo.instances);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Slot 0 of LOD 0 is reserved for the leader, its counter starts behind it.
+    // The base instance stays 0, the draws bind the range of their LOD instead.
+    bool hasLeader = leaderIdx >= 0 && leaderIdx < g_vbo.size;
+    CommandBlock block = { 0 };
+    block.elements[0].instanceCount = hasLeader ? 1 : 0;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_vbo.commands);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(CommandBlock), &block);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    for (int i = 0; i < IC_COUNT; ++i) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, g_vbo.buffers[i]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IC_COUNT + i, g_vbo.culled[i]);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COMMAND_BINDING, g_vbo.commands);
+
+    GLuint groups = (GLuint)((g_vbo.size + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    // Non-indexed meshes read the same counts from their own commands
+    glBindBuffer(GL_COPY_READ_BUFFER, g_vbo.commands);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, g_vbo.commands);
+    for (int l = 0; l < lodCount; ++l) {
+        GLintptr src = offsetof(CommandBlock, elements) + l * sizeof(DrawElementsCommand)
+            + offsetof(DrawElementsCommand, instanceCount);
+        GLintptr dst = offsetof(CommandBlock, arrays) + l * sizeof(DrawArraysCommand)
+            + offsetof(DrawArraysCommand, instanceCount);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src, dst, sizeof(GLuint));
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    updateLodCounts();
+    g_vbo.lodCount = lodCount;
+    g_vbo.cullActive = true;
+    return true;
+}
+
+int instanced_getLodCounts(int *counts) {
+    memcpy(counts, g_vbo.lodCounts, sizeof(g_vbo.lodCounts));
+    return g_vbo.lodCount;
+}
+
+bool instanced_buildRotations(void) {
+    g_vbo.rotationsBuilt = false;
+
+    // The culled columns are compacted into one range per LOD, all ranges are covered
+    int first = g_vbo.cullActive ? 0 : (int)baseInstance();
+    int count = g_vbo.cullActive ? g_vbo.capacity * g_vbo.lodCount : g_vbo.size;
+    const GLuint *columns = g_vbo.cullActive ? g_vbo.culled : g_vbo.buffers;
+    GLuint rotations = g_vbo.cullActive ? g_vbo.culledRotations : g_vbo.rotations;
+
+    int basisWords = g_columnStrides[g_vbo.format][IC_UP] / (int)sizeof(GLuint);
+    if (count <= 0 || !shader_setParticleBasisData(first, count, basisWords)) {
+        return false;
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, columns[IC_UP]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, columns[IC_FORWARD]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, rotations);
+
+    GLuint groups = (GLuint)((count + BASIS_GROUP_SIZE - 1) / BASIS_GROUP_SIZE);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    g_vbo.rotationsBuilt = true;
+    return true;
+}
+
+bool instanced_hasRotations(void) {
+    return g_vbo.rotationsBuilt;
+}
+
+void instanced_endCull(void) {
+    g_vbo.cullActive = false;
+    g_vbo.rotationsBuilt = false;
 }
 
 void instanced_cleanup(void) {
-    glDeleteBuffers(1, &g_vbo.buffer);
-    g_vbo.buffer = 0;
+    destroyColumns();
+    gpumem_deleteBuffers(1, &g_vbo.commands);
+    g_vbo.commands = 0;
+    if (g_vbo.readbackFence) {
+        glDeleteSync(g_vbo.readbackFence);
+        g_vbo.readbackFence = NULL;
+    }
+    gpumem_deleteBuffers(1, &g_vbo.readback);
+    g_vbo.readback = 0;
+    g_vbo.lodCount = 0;
+    g_vbo.cullActive = false;
     g_vbo.size = 0;
-    free(g_vbo.instances);
-    g_vbo.instances = NULL;
+    g_vbo.capacity = 0;
+
+    gpumem_deleteBuffers(1, &g_pool.vbo);
+    gpumem_deleteBuffers(1, &g_pool.ebo);
+    glDeleteVertexArrays(1, &g_pool.vao);
+    memset(&g_pool, 0, sizeof(g_pool));
 }
@@ -11,7 +11,24 @@
 #include <fhwcg/fhwcg.h>
 #include "input.h"
 
-/** mesh struct */
+/**
+ * Per-instance columns, pulled by the vertex shaders (pull.glsl).
+ * Each column lives in its own buffer so the particle store's
+ * structure-of-arrays columns can be uploaded without repacking.
+ */
+typedef enum {
+    IC_POS,
+    IC_ACCELERATION,
+    IC_UP,
+    IC_FORWARD,
+    IC_SWARM,
+    IC_COUNT
+} InstanceColumn;
+
+/** Maximum number of LOD ranges filled by the cull pass */
+#define INSTANCED_MAX_LODS 4
+
+/** Range of a mesh in the static mesh pool */
 typedef struct CGMesh CGMesh;
 
 /**
@@ -25,6 +42,10 @@ typedef struct {
 
 /**
  * Creates a mesh from vertex and index data.
+ * All meshes share one immutable vertex and index buffer and one empty
+ * VAO, draws select a mesh by base vertex and first index and the vertex
+ * shaders pull the vertices from the storage buffer by gl_VertexID. The data is staged
+ * until instanced_init uploads it, so meshes are created before.
  * @param vertices Array of vertex data.
  * @param numVerts Number of vertices.
  * @param indices Array of indices (NULL for non-indexed).
@@ -39,28 +60,47 @@ CGMesh* instanced_createMesh(
 );
 
 /**
- * Frees a mesh and its GPU resources.
+ * Frees a mesh, its range in the pool stays until instanced_cleanup.
  * @param m Pointer to mesh to dispose.
  */
 void instanced_disposeMesh(CGMesh  *m);
 
+/**
+ * Returns the first vertex of a mesh in the pool.
+ * gl_VertexID counts from there, not from 0.
+ * @param m The mesh.
+ * @return The base vertex, a multiple of 12.
+ */
+int instanced_getBaseVertex(const CGMesh *m);
+
 /**
  * Draws a mesh, optionally using instanced rendering.
  * @param m Mesh to draw.
  * @param instanced If true, uses instanced rendering with current instance buffer.
+ * @param lod LOD range to draw while culling is active, everything is in LOD 0 otherwise.
  */
-void instanced_draw(CGMesh *m, bool instanced);
+void instanced_draw(CGMesh *m, bool instanced, int lod);
 
 /**
  * Draws a mesh with particle visualization shader.
  * Always uses instanced rendering.
  * @param m Mesh to draw.
+ * @param lod LOD range to draw while culling is active, everything is in LOD 0 otherwise.
+ */
+void instanced_drawParticleVis(CGMesh *m, int lod);
+
+/**
+ * Draws all instances in the order of an order buffer, for the shaders
+ * defining PULL_ORDERED. Ignores the cull pass.
+ * @param m Mesh to draw.
+ * @param order One uint per instance, the instance drawn at that position
+ *              relative to the first instance of the region.
  */
-void instanced_drawParticleVis(CGMesh *m);
+void instanced_drawOrdered(CGMesh *m, GLuint order);
 
 /**
  * Initializes the instanced rendering system.
- * Allocates the instance buffer with default particle count.
+ * Uploads the mesh pool and allocates the instance buffer with default particle count.
  */
 void instanced_init(void);
 
@@ -70,26 +110,102 @@ void instanced_init(void);
 void instanced_cleanup(void);
 
 /**
- * Binds instance attributes to a mesh.
- * Sets up vertex attribute pointers for instanced data.
- * @param m Mesh to bind attributes to.
- */
-void instanced_bindAttrib(CGMesh *m);
-
-/**
- * Resizes the instance buffer to accommodate a new particle count.
+ * Sets the number of drawn instances.
+ * Buffers only grow (geometrically), their contents are undefined
+ * after growing until the next instanced_update.
  * @param count New number of instances.
  */
 void instanced_resize(int count);
 
 /**
- * Updates instance buffer with new particle data.
+ * Updates instance buffers with new particle data.
+ * Each array is uploaded as-is into its own column buffer.
+ * The swarm ids let a single draw color every swarm.
+ * In IU_PERSISTENT mode the data is written into the next ring
+ * region of the mapped buffers after waiting on its fence.
  * @param count Number of particles.
  * @param pos Array of particle positions.
  * @param acceleration Array of particle accelerations.
  * @param up Array of particle up vectors.
  * @param forward Array of particle forward vectors.
+ * @param swarm Array of particle swarm ids.
+ */
+void instanced_update(int count, vec3* pos, vec3* acceleration, vec3* up, vec3* forward, int* swarm);
+
+/**
+ * Returns the upload path currently in use.
+ * May differ from the requested mode if persistent mapping is unsupported.
+ * @return Active instance upload mode.
+ */
+InstanceUpload instanced_getUploadMode(void);
+
+/**
+ * Returns the instance column format currently in use.
+ * May differ from the requested format while the GPU backend owns the columns.
+ * @return Active instance format.
+ */
+InstanceFormat instanced_getFormat(void);
+
+/**
+ * Returns the buffer object backing an instance column.
+ * Lets other passes (e.g. compute shaders) write instance data in place.
+ * @param column Instance column.
+ * @return OpenGL buffer name.
+ */
+GLuint instanced_getColumnBuffer(InstanceColumn column);
+
+/**
+ * Returns the first instance of the region read by instanced draws.
+ * @return Base instance (0 unless IU_PERSISTENT is active).
+ */
+int instanced_getBaseInstance(void);
+
+/**
+ * Returns the number of drawn instances.
+ * @return Instance count of the last instanced_resize.
+ */
+int instanced_getCount(void);
+
+/**
+ * Runs the GPU culling and LOD pre-pass on the current instance data.
+ * Visible instances are bucketed by camera distance into lodCount ranges.
+ * Until instanced_endCull, instanced draws only draw the instances of the
+ * requested LOD range through an indirect draw command.
+ * Frustum tests, drop shadows and LOD distance come from the render settings.
+ * @param leaderIdx Particle that is always kept and moved to instance 0 of LOD 0 (-1 if none).
+ * @param radius Bounding radius of one instance.
+ * @param lodCount Number of LOD ranges, at most INSTANCED_MAX_LODS.
+ * @return False if the pass is not available, draws then use all instances.
+ */
+bool instanced_beginCull(int leaderIdx, float radius, int lodCount);
+
+/**
+ * Returns the instance counts per LOD range of a recent cull pass.
+ * The counts are read back a few frames late to avoid stalls.
+ * @param counts Destination with INSTANCED_MAX_LODS entries.
+ * @return Number of LOD ranges used by the last pass, 0 if it did not run.
+ */
+int instanced_getLodCounts(int *counts);
+
+/**
+ * Builds the rotation of every drawn instance once with a compute pre-pass,
+ * so the simple and shadow shaders do not rebuild the basis per vertex.
+ * Covers the culled columns while culling is active, so it has to follow
+ * instanced_beginCull. The rotations stay valid until instanced_endCull.
+ * @return False if the pass is not available, the shaders then build the basis per vertex.
+ */
+bool instanced_buildRotations(void);
+
+/**
+ * Returns if the drawn instances currently have rotations from instanced_buildRotations.
+ * @return True between a successful instanced_buildRotations and instanced_endCull.
+ */
+bool instanced_hasRotations(void);
+
+/**
+ * Switches instanced draws back to all instances.
+ * Also drops the rotations of instanced_buildRotations.
  */
-void instanced_update(int count, vec3* pos, vec3* acceleration, vec3* up, vec3* forward);
+void instanced_endCull(void);
 
 #endif // INSTANCED_H
@@ -0,0 +1,477 @@
+/**
+ * @file integrate.c
+ * @brief Implementation of the particle integrate kernels
+ *
+ * The SIMD kernels transpose 4 (SSE) or 8 (AVX) particles from the
+ * vec3 columns into x/y/z registers, run the whole chain there and use
+ * branchless wall forces. The scalar kernel is the reference version.
+ * The other integrators differ only in how the stiff room force is
+ * stepped and run one scalar kernel.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "integrate.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define INTEGRATE_X86 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define TARGET_AVX
+    #else
+        #define TARGET_AVX __attribute__((target("avx")))
+    #endif
+#endif
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Computes the soft collision force at room boundaries.
+ * Uses a margin zone near walls to gradually push particles inward.
+ * @param p Kernel constants.
+ * @param pos Particle position.
+ * @param force Output: force (unit mass).
+ */
+static void roomForce(const IntegrateParams *p, const vec3 pos, vec3 force) {
+    float halfSize = p->halfSize;
+    float margin = 0.05f * halfSize;
+
+    glm_vec3_zero(force);
+    float k = p->roomForce;
+
+    // Check X boundaries
+    float dx = pos[0];
+    if (dx > halfSize - margin) force[0] = -k * (dx - (halfSize - margin)) / margin;
+    else if (dx < -halfSize + margin) force[0] = -k * (dx + (halfSize - margin)) / margin;
+
+    // Check Y boundaries
+    float dy = pos[1];
+    if (dy > halfSize - margin) force[1] = -k * (dy - (halfSize - margin)) / margin;
+    else if (dy < -halfSize + margin) force[1] = -k * (dy + (halfSize - margin)) / margin;
+
+    // Check Z boundaries
+    float dz = pos[2];
+    if (dz > halfSize - margin) force[2] = -k * (dz - (halfSize - margin)) / margin;
+    else if (dz < -halfSize + margin) force[2] = -k * (dz + (halfSize - margin)) / margin;
+}
+
+/**
+ * Applies soft collision forces at room boundaries.
+ * @param p Kernel constants.
+ * @param pos Particle position.
+ * @param velocity Particle velocity, modified in place.
+ */
+static void applyRoomCollision(const IntegrateParams *p, vec3 pos, vec3 velocity) {
+    vec3 force;
+    roomForce(p, pos, force);
+
+    // Apply force to velocity
+    glm_vec3_scale(force, p->dt, force);
+    glm_vec3_add(force, velocity, velocity);
+}
+
+/**
+ * Steps position and velocity under the room force alone.
+ * @param p Kernel constants selecting the integrator.
+ * @param pos Particle position, modified in place.
+ * @param velocity Particle velocity, modified in place.
+ */
+static void stepRoom(const IntegrateParams *p, vec3 pos, vec3 velocity) {
+    float dt = p->dt;
+    vec3 a0, tmp;
+
+    switch (p->integrator) {
+        case IG_EULER: {
+            // Both updates use the state at the start of the step
+            roomForce(p, pos, a0);
+            glm_vec3_muladds(velocity, dt, pos);
+            glm_vec3_muladds(a0, dt, velocity);
+            break;
+        }
+
+        case IG_VERLET: {
+            vec3 a1;
+            roomForce(p, pos, a0);
+            glm_vec3_muladds(velocity, dt, pos);
+            glm_vec3_muladds(a0, 0.5f * dt * dt, pos);
+
+            roomForce(p, pos, a1);
+            glm_vec3_add(a0, a1, tmp);
+            glm_vec3_muladds(tmp, 0.5f * dt, velocity);
+            break;
+        }
+
+        case IG_RK4: {
+            // x'' = f(x): k_i = (velocity, force) at the stage states
+            vec3 x, v, sumX, sumV, kx, kv;
+            const float weights[4] = { 1.0f, 2.0f, 2.0f, 1.0f };
+            const float offsets[4] = { 0.0f, 0.5f, 0.5f, 1.0f };
+
+            glm_vec3_zero(sumX);
+            glm_vec3_zero(sumV);
+            glm_vec3_zero(kx);
+            glm_vec3_zero(kv);
+
+            for (int s = 0; s < 4; ++s) {
+                glm_vec3_copy(pos, x);
+                glm_vec3_muladds(kx, offsets[s] * dt, x);
+                glm_vec3_copy(velocity, v);
+                glm_vec3_muladds(kv, offsets[s] * dt, v);
+
+                glm_vec3_copy(v, kx);
+                roomForce(p, x, kv);
+                glm_vec3_muladds(kx, weights[s], sumX);
+                glm_vec3_muladds(kv, weights[s], sumV);
+            }
+
+            glm_vec3_muladds(sumX, dt / 6.0f, pos);
+            glm_vec3_muladds(sumV, dt / 6.0f, velocity);
+            break;
+        }
+
+        case IG_SYMPLECTIC:
+        default:
+            applyRoomCollision(p, pos, velocity);
+            glm_vec3_muladds(velocity, dt, pos);
+            break;
+    }
+}
+
+/**
+ * Scalar kernel of the integrators besides IG_SYMPLECTIC.
+ * Steering and speed rescale match the reference kernel.
+ * @param p Columns and constants.
+ * @param begin First particle.
+ * @param end One past the last particle.
+ */
+static void integrateScalarOrder(const IntegrateParams *p, int begin, int end) {
+    float dt = p->dt;
+
+    for (int i = begin; i < end; ++i) {
+        float *velocity = p->velocity[i];
+
+        glm_vec3_muladds(p->acceleration[i], dt, velocity);
+        glm_vec3_normalize(velocity);
+        float currentKv = (i == p->leaderIdx) ? p->leaderKv : p->kV[i];
+        glm_vec3_scale(velocity, currentKv, velocity);
+
+        stepRoom(p, p->pos[i], velocity);
+    }
+}
+
+/**
+ * Reference kernel, one particle at a time.
+ * @param p Columns and constants.
+ * @param begin First particle.
+ * @param end One past the last particle.
+ */
+static void integrateScalar(const IntegrateParams *p, int begin, int end) {
+    float dt = p->dt;
+
+    for (int i = begin; i < end; ++i) {
+        float *pos = p->pos[i];
+        float *velocity = p->velocity[i];
+
+        // 1. Update Velocity based on Acceleration (Euler)
+        vec3 deltaA;
+        glm_vec3_scale(p->acceleration[i], dt, deltaA);
+        glm_vec3_add(velocity, deltaA, velocity);
+
+        // 2. Enforce fixed speed (kV)
+        glm_vec3_normalize(velocity);
+        float currentKv = (i == p->leaderIdx) ? p->leaderKv : p->kV[i];
+        glm_vec3_scale(velocity, currentKv, velocity);
+
+        // 3. Apply Room Collision
+        applyRoomCollision(p, pos, velocity);
+
+        // 4. Update Position
+        vec3 deltaV;
+        glm_vec3_scale(velocity, dt, deltaV);
+        glm_vec3_add(pos, deltaV, pos);
+    }
+}
+
+#ifdef INTEGRATE_X86
+
+/**
+ * Loads 4 consecutive vec3 and transposes them into x, y and z lanes.
+ * @param src First of 4 vec3.
+ * @param x Destination for the x components.
+ * @param y Destination for the y components.
+ * @param z Destination for the z components.
+ */
+static inline void load3x4(const float *src, __m128 *x, __m128 *y, __m128 *z) {
+    __m128 a = _mm_loadu_ps(src);       // x0 y0 z0 x1
+    __m128 b = _mm_loadu_ps(src + 4);   // y1 z1 x2 y2
+    __m128 c = _mm_loadu_ps(src + 8);   // z2 x3 y3 z3
+
+    __m128 bc = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+    *x = _mm_shuffle_ps(a, bc, _MM_SHUFFLE(2, 0, 3, 0));
+
+    __m128 ab = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+    bc = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+    *y = _mm_shuffle_ps(ab, bc, _MM_SHUFFLE(2, 0, 2, 0));
+
+    ab = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+    __m128 cc = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+    *z = _mm_shuffle_ps(ab, cc, _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+/**
+ * Inverse of load3x4, stores x, y and z lanes as 4 consecutive vec3.
+ * @param dst First of 4 vec3.
+ * @param x The x components.
+ * @param y The y components.
+ * @param z The z components.
+ */
+static inline void store3x4(float *dst, __m128 x, __m128 y, __m128 z) {
+    __m128 xy = _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0));
+    __m128 zx = _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0));
+    _mm_storeu_ps(dst, _mm_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0)));
+
+    __m128 yz = _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1));
+    xy = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2));
+    _mm_storeu_ps(dst + 4, _mm_shuffle_ps(yz, xy, _MM_SHUFFLE(2, 0, 2, 0)));
+
+    zx = _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2));
+    yz = _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3));
+    _mm_storeu_ps(dst + 8, _mm_shuffle_ps(zx, yz, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+/**
+ * Copies kV for a block of particles and applies the leader override.
+ * @param p Columns and constants.
+ * @param i First particle of the block.
+ * @param width Block width.
+ * @param dst Destination with at least width elements.
+ */
+static inline void loadKv(const IntegrateParams *p, int i, int width, float *dst) {
+    memcpy(dst, p->kV + i, width * sizeof(float));
+    if (p->leaderIdx >= i && p->leaderIdx < i + width) {
+        dst[p->leaderIdx - i] = p->leaderKv;
+    }
+}
+
+/**
+ * Branchless soft wall force for one axis of 4 particles.
+ * force = -k / margin * sign(x) * max(|x| - inner, 0)
+ */
+static inline __m128 wallForce4(__m128 x, __m128 inner, __m128 scale, __m128 signMask) {
+    __m128 excess = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(signMask, x), inner), _mm_setzero_ps());
+    return _mm_mul_ps(scale, _mm_or_ps(excess, _mm_and_ps(signMask, x)));
+}
+
+/**
+ * SSE kernel, 4 particles per iteration.
+ * @param p Columns and constants.
+ * @param begin First particle.
+ * @param end One past the last particle.
+ */
+static void integrateSse(const IntegrateParams *p, int begin, int end) {
+    float margin = 0.05f * p->halfSize;
+    __m128 dt = _mm_set1_ps(p->dt);
+    __m128 inner = _mm_set1_ps(p->halfSize - margin);
+    __m128 scale = _mm_set1_ps(-p->roomForce / margin * p->dt);
+    __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 zero = _mm_setzero_ps();
+
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 px, py, pz, vx, vy, vz, ax, ay, az;
+        load3x4(p->pos[i], &px, &py, &pz);
+        load3x4(p->velocity[i], &vx, &vy, &vz);
+        load3x4(p->acceleration[i], &ax, &ay, &az);
+
+        // 1. v += a * dt
+        vx = _mm_add_ps(vx, _mm_mul_ps(ax, dt));
+        vy = _mm_add_ps(vy, _mm_mul_ps(ay, dt));
+        vz = _mm_add_ps(vz, _mm_mul_ps(az, dt));
+
+        // 2. v = normalize(v) * kV (zero stays zero)
+        float kvBuf[4];
+        loadKv(p, i, 4, kvBuf);
+        __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+        __m128 len = _mm_sqrt_ps(len2);
+        __m128 valid = _mm_cmpgt_ps(len, zero);
+        __m128 s = _mm_and_ps(valid, _mm_div_ps(_mm_loadu_ps(kvBuf), _mm_or_ps(len, _mm_andnot_ps(valid, _mm_set1_ps(1.0f)))));
+        vx = _mm_mul_ps(vx, s);
+        vy = _mm_mul_ps(vy, s);
+        vz = _mm_mul_ps(vz, s);
+
+        // 3. Room collision
+        vx = _mm_add_ps(vx, wallForce4(px, inner, scale, signMask));
+        vy = _mm_add_ps(vy, wallForce4(py, inner, scale, signMask));
+        vz = _mm_add_ps(vz, wallForce4(pz, inner, scale, signMask));
+
+        // 4. pos += v * dt
+        px = _mm_add_ps(px, _mm_mul_ps(vx, dt));
+        py = _mm_add_ps(py, _mm_mul_ps(vy, dt));
+        pz = _mm_add_ps(pz, _mm_mul_ps(vz, dt));
+
+        store3x4(p->velocity[i], vx, vy, vz);
+        store3x4(p->pos[i], px, py, pz);
+    }
+
+    integrateScalar(p, i, end);
+}
+
+/**
+ * Loads 8 consecutive vec3 as x, y and z lanes.
+ */
+TARGET_AVX static inline void load3x8(const float *src, __m256 *x, __m256 *y, __m256 *z) {
+    __m128 xl, yl, zl, xh, yh, zh;
+    load3x4(src, &xl, &yl, &zl);
+    load3x4(src + 12, &xh, &yh, &zh);
+    *x = _mm256_insertf128_ps(_mm256_castps128_ps256(xl), xh, 1);
+    *y = _mm256_insertf128_ps(_mm256_castps128_ps256(yl), yh, 1);
+    *z = _mm256_insertf128_ps(_mm256_castps128_ps256(zl), zh, 1);
+}
+
+/**
+ * Stores x, y and z lanes as 8 consecutive vec3.
+ */
+TARGET_AVX static inline void store3x8(float *dst, __m256 x, __m256 y, __m256 z) {
+    store3x4(dst, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z));
+    store3x4(dst + 12, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1));
+}
+
+/**
+ * Branchless soft wall force for one axis of 8 particles.
+ */
+TARGET_AVX static inline __m256 wallForce8(__m256 x, __m256 inner, __m256 scale, __m256 signMask) {
+    __m256 excess = _mm256_max_ps(_mm256_sub_ps(_mm256_andnot_ps(signMask, x), inner), _mm256_setzero_ps());
+    return _mm256_mul_ps(scale, _mm256_or_ps(excess, _mm256_and_ps(signMask, x)));
+}
+
+/**
+ * AVX kernel, 8 particles per iteration.
+ * @param p Columns and constants.
+ * @param begin First particle.
+ * @param end One past the last particle.
+ */
+TARGET_AVX static void integrateAvx(const IntegrateParams *p, int begin, int end) {
+    float margin = 0.05f * p->halfSize;
+    __m256 dt = _mm256_set1_ps(p->dt);
+    __m256 inner = _mm256_set1_ps(p->halfSize - margin);
+    __m256 scale = _mm256_set1_ps(-p->roomForce / margin * p->dt);
+    __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 px, py, pz, vx, vy, vz, ax, ay, az;
+        load3x8(p->pos[i], &px, &py, &pz);
+        load3x8(p->velocity[i], &vx, &vy, &vz);
+        load3x8(p->acceleration[i], &ax, &ay, &az);
+
+        // 1. v += a * dt
+        vx = _mm256_add_ps(vx, _mm256_mul_ps(ax, dt));
+        vy = _mm256_add_ps(vy, _mm256_mul_ps(ay, dt));
+        vz = _mm256_add_ps(vz, _mm256_mul_ps(az, dt));
+
+        // 2. v = normalize(v) * kV (zero stays zero)
+        float kvBuf[8];
+        loadKv(p, i, 8, kvBuf);
+        __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)), _mm256_mul_ps(vz, vz));
+        __m256 len = _mm256_sqrt_ps(len2);
+        __m256 valid = _mm256_cmp_ps(len, zero, _CMP_GT_OQ);
+        __m256 s = _mm256_and_ps(valid, _mm256_div_ps(_mm256_loadu_ps(kvBuf), _mm256_blendv_ps(one, len, valid)));
+        vx = _mm256_mul_ps(vx, s);
+        vy = _mm256_mul_ps(vy, s);
+        vz = _mm256_mul_ps(vz, s);
+
+        // 3. Room collision
+        vx = _mm256_add_ps(vx, wallForce8(px, inner, scale, signMask));
+        vy = _mm256_add_ps(vy, wallForce8(py, inner, scale, signMask));
+        vz = _mm256_add_ps(vz, wallForce8(pz, inner, scale, signMask));
+
+        // 4. pos += v * dt
+        px = _mm256_add_ps(px, _mm256_mul_ps(vx, dt));
+        py = _mm256_add_ps(py, _mm256_mul_ps(vy, dt));
+        pz = _mm256_add_ps(pz, _mm256_mul_ps(vz, dt));
+
+        store3x8(p->velocity[i], vx, vy, vz);
+        store3x8(p->pos[i], px, py, pz);
+    }
+
+    integrateSse(p, i, end);
+}
+
+/**
+ * Checks for AVX support of CPU and operating system.
+ * @return True if AVX instructions can be used.
+ */
+static bool cpuHasAvx(void) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    return osxsave && avx && ((_xgetbv(0) & 0x6) == 0x6);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+#endif
+}
+
+#endif // INTEGRATE_X86
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+bool integrate_isSupported(SimdKernel kernel) {
+    switch (kernel) {
+        case SK_SCALAR:
+            return true;
+#ifdef INTEGRATE_X86
+        case SK_SSE:
+            return true;
+        case SK_AVX: {
+            static int hasAvx = -1;
+            if (hasAvx < 0) {
+                hasAvx = cpuHasAvx() ? 1 : 0;
+            }
+            return hasAvx == 1;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+SimdKernel integrate_bestKernel(void) {
+    for (int k = SK_COUNT - 1; k > SK_SCALAR; --k) {
+        if (integrate_isSupported((SimdKernel)k)) {
+            return (SimdKernel)k;
+        }
+    }
+    return SK_SCALAR;
+}
+
+void integrate_run(SimdKernel kernel, const IntegrateParams *p, int begin, int end) {
+    if (!integrate_isSupported(kernel)) {
+        kernel = SK_SCALAR;
+    }
+
+    if (p->integrator != IG_SYMPLECTIC) {
+        integrateScalarOrder(p, begin, end);
+        return;
+    }
+
+    switch (kernel) {
+#ifdef INTEGRATE_X86
+        case SK_AVX:
+            integrateAvx(p, begin, end);
+            break;
+        case SK_SSE:
+            integrateSse(p, begin, end);
+            break;
+#endif
+        case SK_SCALAR:
+        default:
+            integrateScalar(p, begin, end);
+            break;
+    }
+}
@@ -0,0 +1,59 @@
+/**
+ * @file integrate.h
+ * @brief Scalar and SIMD kernels for the particle integrate step
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef INTEGRATE_H
+#define INTEGRATE_H
+
+#include <fhwcg/fhwcg.h>
+#include "input.h"
+
+/**
+ * Column pointers and constants for one integrate call.
+ */
+typedef struct {
+    vec3 *pos;
+    vec3 *velocity;
+    vec3 *acceleration;
+    float *kV;
+
+    float dt;
+    float halfSize;
+    float roomForce;
+    Integrator integrator;
+
+    int leaderIdx;      // -1 if no particle uses leaderKv
+    float leaderKv;
+} IntegrateParams;
+
+/**
+ * Checks whether the CPU can run a kernel.
+ * @param kernel Kernel to check.
+ * @return True if the kernel is available.
+ */
+bool integrate_isSupported(SimdKernel kernel);
+
+/**
+ * Returns the widest kernel supported by the CPU.
+ * @return Best available kernel.
+ */
+SimdKernel integrate_bestKernel(void);
+
+/**
+ * Integrates the particles [begin, end) with the given kernel:
+ * velocity += acceleration * dt, rescale to kV, soft room collision,
+ * pos += velocity * dt. Unsupported kernels fall back to SK_SCALAR.
+ * The steering acceleration is constant over the step, the room force
+ * is integrated with p->integrator. Only IG_SYMPLECTIC has SIMD kernels,
+ * the others always run the scalar kernel.
+ * @param kernel Kernel to use.
+ * @param p Columns and constants.
+ * @param begin First particle.
+ * @param end One past the last particle.
+ */
+void integrate_run(SimdKernel kernel, const IntegrateParams *p, int begin, int end);
+
+#endif // INTEGRATE_H
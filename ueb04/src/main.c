@@ -7,13 +7,38 @@
 
 #include <fhwcg/fhwcg.h>
 #include "gui.h"
+#include "guicache.h"
 #include "input.h"
+#include "idle.h"
+#include "framepacer.h"
 #include "rendering.h"
 #include "model.h"
 #include "physics.h"
+#include "profiler.h"
+#include "glstate.h"
+#include "texstream.h"
+#include "shader.h"
+#include "arena.h"
+#include "gpumem.h"
+#include "alloctrack.h"
+#include "capture.h"
+#include "stream.h"
+#include "quality.h"
+#include "resscale.h"
+#include "timeline.h"
+#include "hitch.h"
+#include "sampler.h"
+#include "perfcount.h"
+#include "metrics.h"
+#include "rendbench.h"
+#include "headless.h"
+#include "gpuprim.h"
+#include "translucent.h"
+#include "resarchive.h"
 
 #define DEFAULT_WINDOW_WIDTH 1024
 #define DEFAULT_WINDOW_HEIGHT 612
+#define QUALITY_LOD_SCALE 0.5f
 
 ////////////////////////    LOCAL    ////////////////////////////
 
@@ -22,13 +47,142 @@
  * @param ctx Program context
  */
 static void init(ProgContext ctx) {
+    timeline_setThreadName("Main");
+    hitch_init();
+    sampler_init();
+    perfcount_init();
+    arena_init();
+    profiler_init();
+    metrics_init("ueb04");
     input_init(ctx);
     input_registerCallbacks(ctx);
     gui_init(ctx);
+    // Missing without the build step, the files are loaded then
+    resarchive_open(RESARCHIVE_PATH);
+    texstream_init();
+    gpuprim_init(COMMON_RESOURCE_PATH "res/shader/gpuprim/");
     model_init();
     physics_init();
     rendering_init();
-    rendering_resize(DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT);
+    resscale_init(shader_setUpscaleData);
+    int width, height;
+    window_getFramebufferSize(ctx, &width, &height);
+    rendering_resize(width, height);
+    capture_init();
+    stream_init();
+    framepacer_init();
+
+    // The governor changes these without input
+    InputData *d = getInputData();
+    guicache_watch(&d->particles, sizeof(d->particles));
+    guicache_watch(&d->quality.level, sizeof(d->quality.level));
+
+    // A benchmark compares fixed settings, the governor would adapt them to the run
+    if (rendbench_isPlaying()) {
+        d->quality.enabled = false;
+        d->resolution.enabled = false;
+    }
+}
+
+/**
+ * Starts or stops the frame capture as requested and captures the
+ * current back buffer.
+ * @param ctx Program context
+ */
+static void updateCapture(ProgContext ctx) {
+    InputData *d = getInputData();
+    int width, height;
+    window_getRealSize(ctx, &width, &height);
+
+    if (d->capture.enabled && !capture_isRunning()) {
+        d->capture.enabled = capture_start(d->capture.format, width, height);
+    } else if (!d->capture.enabled && capture_isRunning()) {
+        capture_stop();
+    }
+
+    capture_frame(width, height);
+    d->capture.enabled = capture_isRunning();
+}
+
+/**
+ * Starts or stops the remote viewer server as requested and hands the
+ * current back buffer to it. A failed start clears the request.
+ * @param ctx Program context
+ */
+static void updateStream(ProgContext ctx) {
+    InputData *d = getInputData();
+    if (d->stream.enabled && !stream_isRunning()) {
+        d->stream.enabled = stream_start(d->stream.port, d->stream.anyInterface);
+    } else if (!d->stream.enabled && stream_isRunning()) {
+        stream_stop();
+    }
+
+    int width, height;
+    window_getRealSize(ctx, &width, &height);
+    stream_setEncoding(d->stream.quality, d->stream.halfSize);
+    stream_frame(width, height);
+}
+
+/**
+ * Feeds the work time of the last frame to the quality governor and
+ * derives the settings to draw with from its level.
+ */
+static void updateQuality(void) {
+    InputData *d = getInputData();
+
+    float cpuMs, gpuMs;
+    profiler_getLastFrameWork(&cpuMs, &gpuMs);
+
+    // The resolution takes GPU load first, the governor only sees it
+    // once the scale is at its minimum
+    if (d->resolution.enabled) {
+        d->resolution.scale = resscale_update(gpuMs, d->quality.budgetMs, d->resolution.minScale);
+        if (d->resolution.scale > d->resolution.minScale + 1e-4f) {
+            gpuMs = 0.0f;
+        }
+    } else {
+        resscale_reset();
+        d->resolution.scale = 1.0f;
+    }
+
+    if (d->quality.enabled) {
+        d->quality.level = (QualityLevel) quality_update(fmaxf(cpuMs, gpuMs), d->quality.budgetMs, QL_COUNT - 1);
+        d->quality.workMs = quality_getSmoothedMs();
+    } else {
+        quality_reset();
+        d->quality.level = QL_FULL;
+        d->quality.workMs = 0.0f;
+    }
+
+    QualityLevel level = d->quality.level;
+    d->quality.visVectors = d->particles.visVectors && level < QL_NO_VECTORS;
+    d->quality.sphereLod = d->rendering.sphereLod || level >= QL_NEAR_LOD;
+    d->quality.lodDistance = d->rendering.lodDistance * (level >= QL_NEAR_LOD ? QUALITY_LOD_SCALE : 1.0f);
+    d->quality.dropShadows = d->rendering.dropShadows && level < QL_NO_SHADOWS;
+    d->quality.sphereVis = d->particles.sphereVis;
+    if (d->quality.sphereVis == SV_SPHERE && level >= QL_FLAT_SPHERES) {
+        d->quality.sphereVis = SV_TRIANGLE;
+    }
+
+    // Only positions and swarm ids are drawn, as point sprites
+    if (d->particles.extremeScale) {
+        d->quality.visVectors = false;
+        d->quality.sphereLod = false;
+        d->quality.dropShadows = false;
+        d->quality.sphereVis = SV_IMPOSTOR;
+    }
+}
+
+/**
+ * Checks whether the scene changes without input: the particles move
+ * until paused, a running capture, a remote viewer and streamed textures
+ * need frames.
+ *
+ * @return true if the next frame differs from the last one
+ */
+static bool isSceneBusy(void) {
+    return !getInputData()->paused || capture_isRunning() || stream_hasClient() || texstream_getPendingCount() > 0
+        || rendbench_isPlaying() || headless_isActive();
 }
 
 /**
@@ -36,21 +190,45 @@ static void init(ProgContext ctx) {
  * @param ctx Program context
  */
 static void cleanup(ProgContext ctx) {
+    // The shutdown is left out of the samples
+    sampler_cleanup();
     gui_cleanup(ctx);
+    capture_cleanup();
+    stream_cleanup();
+    texstream_cleanup();
     model_cleanup();
     physics_cleanup();
+    translucent_cleanup();
+    gpuprim_cleanup();
+    resscale_cleanup();
+    guicache_cleanup();
+    framepacer_cleanup();
     rendering_cleanup();
+    rendbench_cleanup();
+    profiler_cleanup();
+    arena_cleanup();
+    headless_cleanup();
+    resarchive_close();
+    gpumem_cleanup();
+    metrics_cleanup();
+    perfcount_cleanup();
+    alloctrack_cleanup();
+    timeline_cleanup();
     window_cleanup(ctx);
 }
 
 ////////////////////////    PUBLIC    ////////////////////////////
 
 int main(void) {
+    rendbench_init("ueb04");
+    headless_init();
+    int width = DEFAULT_WINDOW_WIDTH, height = DEFAULT_WINDOW_HEIGHT;
+    headless_windowSize(&width, &height);
     ProgContext ctx = window_init(
         PROGRAM_NAME,
-        DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT,
+        width, height,
         1,
-        HELP_SERVER_FLAGS | WINDOW_FLAGS_VSYNC
+        headless_windowFlags(rendbench_windowFlags(HELP_SERVER_FLAGS | WINDOW_FLAGS_VSYNC))
     );
 
     init(ctx);
@@ -59,21 +237,73 @@ int main(void) {
 
     // Main rendering loop
     while (window_startNewFrame(ctx)) {
+        framepacer_beginFrame();
+        profiler_beginFrame();
+        glstate_beginFrame();
+        headless_beginFrame(ctx);
+        stream_pollEvents(ctx, input_remoteEvent);
+        input_flushEvents(ctx);
+        arena_beginFrame();
+        alloctrack_beginFrame();
+        texstream_update();
+        TIMELINE_BEGIN("Frame");
         InputData *d = getInputData();
-        float dt = (float)window_getDeltaTime(ctx);
+        float frameTime = (float)window_getDeltaTime(ctx);
+        float awakeTime = idle_frameTime(frameTime);
+        hitch_frame(awakeTime * 1000.0f);
+        float dt = rendbench_frameTime(awakeTime);
         d->deltaTime = d->paused ? 0.0f : dt;
 
         camera_updateCamera(d->cam.data, dt);
+        shader_watch(frameTime);
+        shader_prewarm(d->rendering.prewarmShaders);
+        profiler_pushScope("Physics");
+        TIMELINE_BEGIN("Physics");
         physics_update();
+        TIMELINE_END();
+        profiler_popScope();
+        metrics_frame(frameTime * 1000.0f, d->physics.dtAccumulator * 1000.0f, 0, physics_getParticleCount());
+        updateQuality();
+
+        // The scene is drawn at the dynamic resolution, the GUI natively
+        int fbWidth, fbHeight;
+        window_getFramebufferSize(ctx, &fbWidth, &fbHeight);
+        resscale_begin(fbWidth, fbHeight);
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        profiler_pushScope("Rendering");
         rendering_draw();
-        gui_render(ctx, gui_renderContent);
+        resscale_end(d->resolution.sharpness);
+        profiler_popScope();
+
+        profiler_pushScope("Capture");
+        updateCapture(ctx);
+        updateStream(ctx);
+        profiler_popScope();
 
+        profiler_pushScope("GUI");
+        guicache_render(ctx, gui_renderContent, shader_setGuiComposite);
+        profiler_popScope();
+
+        profiler_endFrame();
+        framepacer_endFrame();
         window_swapBuffers(ctx);
+        TIMELINE_END();
+        if (!rendbench_endFrame()) {
+            window_shouldCloseWindow(ctx);
+        }
+        if (!headless_endFrame()) {
+            window_shouldCloseWindow(ctx);
+        }
+        idle_endFrame(isSceneBusy());
+
+        // Input, camera and physics of the next frame are sampled after the pacing sleep,
+        // a benchmark measures the frames without it
+        framepacer_wait(idle_isIdle() || rendbench_isPlaying());
+        idle_wait();
     }
 
     cleanup(ctx);
-    return EXIT_SUCCESS;
+    return rendbench_exitCode();
 }
\ No newline at end of file
@@ -2,6 +2,11 @@
  * @file model.c
  * @brief Implementation of model creation and management
  *
+ * The meshes are built at startup, they share the one static pool that
+ * is uploaded once. Textures and the skybox cubemap are requested on
+ * their first draw, so room textures that the current room does not show
+ * are never loaded.
+ *
  * @authors Nikolaos Tsetsas, Noah Schmidt
  */
 
@@ -10,9 +15,14 @@
 #include "shader.h"
 #include "rendering.h"
 #include "instanced.h"
+#include "glstate.h"
+#include "texstream.h"
+#include "arena.h"
+#include "gpumem.h"
+#include "resarchive.h"
 
-#define SPHERE_NUM_SLICES 20
-#define SPHERE_NUM_STACKS 20
+/** Slices and stacks of the sphere, one entry per LOD */
+static const int g_sphereLodRes[MODEL_SPHERE_LODS] = {20, 10, 6};
 
 #define TEXTURE_COUNT 3
 
@@ -23,29 +33,100 @@
 #define SKYBOX_PATH TEXTURE_PATH "gloomy_skybox/"
 #define TEX2 SKYBOX_PATH "gloomy_up.png" 
 
+/** Index of the floor in the cube faces and the texture orders */
+#define FLOOR_FACE 3
+
 ////////////////////////    LOCAL    ////////////////////////////
 
 /** Array of mesh models */
 static CGMesh *g_models[MODEL_MESH_COUNT];
+
+/** Sphere LOD meshes, LOD 0 is g_models[MODEL_SPHERE] */
+static CGMesh *g_sphereLods[MODEL_SPHERE_LODS];
+
+/** Acceleration and up line per instance, endpoints are picked by gl_VertexID */
+static CGMesh *g_vectorLines;
+
+/** Floor face of the room, drawn alone under the skybox */
+static CGMesh *g_floor;
+
+/** Cubemap of the gloomy skybox */
+static GLuint g_skybox;
+
+/**
+ * Mesh holding a model twice, the second copy is drawn as drop shadow.
+ */
+typedef struct {
+    CGMesh *mesh;
+    int shadowVertexStart;
+} ShadowPair;
+
+/** Shadow pairs of the particle models, MODEL_SPHERE is sphere LOD 0 */
+static ShadowPair g_shadowPairs[MODEL_MESH_COUNT];
+static ShadowPair g_sphereLodPairs[MODEL_SPHERE_LODS];
 static GLuint g_textures[TEXTURE_COUNT];
 
+/** Image files of the room textures */
+static const char *g_textureFiles[TEXTURE_COUNT] = { TEX0, TEX1, TEX2 };
+
 // Texture Idx used for the 6 sides of a cube
 static int g_cubeOrder1[] = {0, 0, 0, 1, 0, 0};
 static int g_cubeOrder2[] = {2, 2, 2, 1, 2, 2};
  
+/**
+ * Creates a mesh that contains the given geometry twice.
+ * The shader projects every vertex of the second copy onto the ground.
+ * @param vertices Vertex data.
+ * @param numVerts Number of vertices.
+ * @param indices Index data (NULL for non-indexed).
+ * @param numInd Number of indices (0 for non-indexed).
+ * @param mode OpenGL primitive mode.
+ * @return The pair of mesh and first shadow vertex.
+ */
+static ShadowPair model_createShadowPair(
+    const CGVertex *vertices, int numVerts,
+    const GLuint *indices, int numInd, GLenum mode
+) {
+    Arena *scratch = arena_rebuild();
+    ArenaMark mark = arena_mark(scratch);
+
+    CGVertex *pairVertices = arena_alloc(scratch, sizeof(CGVertex) * numVerts * 2);
+    memcpy(pairVertices, vertices, sizeof(CGVertex) * numVerts);
+    memcpy(pairVertices + numVerts, vertices, sizeof(CGVertex) * numVerts);
+
+    GLuint *pairIndices = NULL;
+    if (numInd) {
+        pairIndices = arena_alloc(scratch, sizeof(GLuint) * numInd * 2);
+        for (int i = 0; i < numInd; ++i) {
+            pairIndices[i] = indices[i];
+            pairIndices[numInd + i] = indices[i] + numVerts;
+        }
+    }
+
+    ShadowPair pair = {
+        .mesh = instanced_createMesh(pairVertices, numVerts * 2, pairIndices, numInd * 2, mode),
+        .shadowVertexStart = numVerts
+    };
+    arena_release(scratch, mark);
+    return pair;
+}
+
 /**
  * Creates a sphere mesh
  * Generates vertices with position, normal and texture coordinates.
+ * @param numSlices Number of slices around the axis.
+ * @param numStacks Number of stacks from pole to pole.
+ * @param pair Destination for the shadow pair of the sphere.
+ * @return The created mesh.
  */
-static void model_initSphere(void) {
-    int numSlices = SPHERE_NUM_SLICES;
-    int numStacks = SPHERE_NUM_STACKS;
-
+static CGMesh* model_createSphere(int numSlices, int numStacks, ShadowPair *pair) {
     GLuint numVertices = (numSlices + 1) * (numStacks + 1);
     GLuint numIndices = numSlices * numStacks * 6;
 
-    CGVertex* vertices = malloc(sizeof(CGVertex) * numVertices);
-    GLuint* indices = malloc(sizeof(GLuint) * numIndices);
+    Arena *scratch = arena_rebuild();
+    ArenaMark mark = arena_mark(scratch);
+    CGVertex* vertices = arena_alloc(scratch, sizeof(CGVertex) * numVertices);
+    GLuint* indices = arena_alloc(scratch, sizeof(GLuint) * numIndices);
 
     int indexVA = 0;
     int indexIA = 0;
@@ -84,9 +165,48 @@ static void model_initSphere(void) {
         }
     }
 
-    g_models[MODEL_SPHERE] = instanced_createMesh(vertices, numVertices, indices, numIndices, GL_TRIANGLES);
-    free(vertices);
-    free(indices);
+    CGMesh *m = instanced_createMesh(vertices, numVertices, indices, numIndices, GL_TRIANGLES);
+    *pair = model_createShadowPair(vertices, numVertices, indices, numIndices, GL_TRIANGLES);
+    arena_release(scratch, mark);
+    return m;
+}
+
+/**
+ * Creates the sphere mesh and its LODs.
+ */
+static void model_initSphere(void) {
+    for (int i = 0; i < MODEL_SPHERE_LODS; ++i) {
+        g_sphereLods[i] = model_createSphere(g_sphereLodRes[i], g_sphereLodRes[i], &g_sphereLodPairs[i]);
+    }
+    g_models[MODEL_SPHERE] = g_sphereLods[0];
+    g_shadowPairs[MODEL_SPHERE] = g_sphereLodPairs[0];
+}
+
+/**
+ * Returns the mesh of a model for a LOD range.
+ * Only the sphere has LODs, every other model uses its single mesh.
+ * @param model Model type.
+ * @param lod LOD range.
+ * @return The mesh to draw.
+ */
+static CGMesh* model_getLodMesh(ModelType model, int lod) {
+    if (model == MODEL_SPHERE && lod > 0 && lod < MODEL_SPHERE_LODS) {
+        return g_sphereLods[lod];
+    }
+    return g_models[model];
+}
+
+/**
+ * Returns the shadow pair of a model for a LOD range.
+ * @param model Model type.
+ * @param lod LOD range.
+ * @return The shadow pair, its mesh is NULL if the model has none.
+ */
+static ShadowPair* model_getShadowPair(ModelType model, int lod) {
+    if (model == MODEL_SPHERE && lod > 0 && lod < MODEL_SPHERE_LODS) {
+        return &g_sphereLodPairs[lod];
+    }
+    return &g_shadowPairs[model];
 }
 
 /**
@@ -97,6 +217,15 @@ static void model_initPoint(void) {
     g_models[MODEL_POINT] = instanced_createMesh(&point, 1, NULL, 0, GL_POINTS);
 }
 
+/**
+ * Creates the 4 vertex line mesh of the vector visualization.
+ * The vertices carry no data, the shader positions them.
+ */
+static void model_initVectorLines(void) {
+    CGVertex lines[4] = { 0 };
+    g_vectorLines = instanced_createMesh(lines, 4, NULL, 0, GL_LINES);
+}
+
 /**
  * Creates Triangle mesh
  */
@@ -108,6 +237,7 @@ static void model_initTriangle(void) {
     };
 
     g_models[MODEL_TRIANGLE] = instanced_createMesh(triangleVertices, 3, NULL, 0, GL_TRIANGLES);
+    g_shadowPairs[MODEL_TRIANGLE] = model_createShadowPair(triangleVertices, 3, NULL, 0, GL_TRIANGLES);
 }
 
 /**
@@ -120,6 +250,7 @@ static void model_initLine(void) {
     };
     
     g_models[MODEL_LINE] = instanced_createMesh(lineVertices, 2, NULL, 0, GL_LINES);
+    g_shadowPairs[MODEL_LINE] = model_createShadowPair(lineVertices, 2, NULL, 0, GL_LINES);
 }
 
 /**
@@ -179,6 +310,20 @@ static void model_initCube(void) {
     }
 
     g_models[MODEL_CUBE] = instanced_createMesh(vertices, 24, indices, 36, GL_TRIANGLES);
+    g_floor = instanced_createMesh(vertices + FLOOR_FACE * 4, 4, indices, 6, GL_TRIANGLES);
+}
+
+/**
+ * Returns a room texture, requesting it on its first use.
+ * It is streamed in and shows the placeholder until uploaded.
+ * @param idx Index of the texture.
+ * @return The OpenGL texture.
+ */
+static GLuint model_getTexture(int idx) {
+    if (!g_textures[idx]) {
+        g_textures[idx] = texstream_loadTexture(g_textureFiles[idx], GL_REPEAT, TC_BC1);
+    }
+    return g_textures[idx];
 }
 
 /**
@@ -188,29 +333,87 @@ static void model_initCube(void) {
 static void model_bindCubeTextures(bool useOrder1) {
     int *order = useOrder1 ? g_cubeOrder1 : g_cubeOrder2;
     int units[6] = {0, 1, 2, 3, 4, 5};
-    Shader *shader = shader_getTextureShader();
-    shader_useShader(shader);
+    GlProgram *shader = shader_getTextureShader();
+    glstate_useProgram(shader);
     for (int i = 0; i < 6; ++i) {
         glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, g_textures[order[i]]);
+        glBindTexture(GL_TEXTURE_2D, model_getTexture(order[i]));
     }
 
-    shader_setIntN(shader, "u_textures", units, 6);
+    glprogram_setIntN(shader, "u_textures", units, 6);
+
+    mat4 mat;
+    scene_getMVP(mat);
+    glprogram_setMat4(shader, "u_mvpMatrix", &mat);
+}
+
+/**
+ * Binds the floor texture for the texture shader.
+ * The floor mesh has one face, so every sampler points to unit 0.
+ * @param useOrder1 Which texture order is wanted.
+ */
+static void model_bindFloorTexture(bool useOrder1) {
+    int *order = useOrder1 ? g_cubeOrder1 : g_cubeOrder2;
+    int units[6] = {0, 0, 0, 0, 0, 0};
+    GlProgram *shader = shader_getTextureShader();
+    glstate_useProgram(shader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, model_getTexture(order[FLOOR_FACE]));
+
+    glprogram_setIntN(shader, "u_textures", units, 6);
 
     mat4 mat;
     scene_getMVP(mat);
-    shader_setMat4(shader, "u_mvpMatrix", &mat);
+    glprogram_setMat4(shader, "u_mvpMatrix", &mat);
 }
 
 /**
- * Loads textures for room
+ * Loads the six gloomy skybox images into a cubemap, on the first skybox draw.
+ * Cubemap faces have their origin top left, so the images are not flipped.
+ * Faces packed into the resource archive are uploaded from the mapping.
  */
-static void model_loadTextures(void) {
-    g_textures[0] = texture_loadTexture(TEX0, GL_REPEAT);
-    g_textures[1] = texture_loadTexture(TEX1, GL_REPEAT);
-    g_textures[2] = texture_loadTexture(TEX2, GL_REPEAT);
+static void model_loadSkybox(void) {
+    const char *faces[6] = {
+        SKYBOX_PATH "gloomy_rt.png", SKYBOX_PATH "gloomy_lf.png",
+        SKYBOX_PATH "gloomy_up.png", SKYBOX_PATH "gloomy_dn.png",
+        SKYBOX_PATH "gloomy_ft.png", SKYBOX_PATH "gloomy_bk.png"
+    };
+
+    glGenTextures(1, &g_skybox);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, g_skybox);
+
+    stbi_set_flip_vertically_on_load_thread(0);
+    for (int i = 0; i < 6; ++i) {
+        const ResArchiveEntry *entry = resarchive_find(faces[i]);
+        const ResArchiveTexture *tex = entry && entry->kind == RES_TEXTURE ? resarchive_data(entry) : NULL;
+        if (tex && !(tex->flags & RESARCHIVE_TEX_FLIPPED)) {
+            const ResArchiveLevel *l = &tex->levels[0];
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA8, l->width, l->height, 0,
+                GL_RGBA, GL_UNSIGNED_BYTE, (const unsigned char*) tex + l->offset);
+            continue;
+        }
+
+        int width, height, channels;
+        unsigned char *data = stbi_load(faces[i], &width, &height, &channels, 4);
+        if (!data) {
+            printf("Error: Could not read image file %s\n", faces[i]);
+            continue;
+        }
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA8, width, height, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, data);
+        stbi_image_free(data);
+    }
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    gpumem_trackTexture(GPUMEM_TEXTURES, GL_TEXTURE_CUBE_MAP, g_skybox);
 }
 
+
 ////////////////////////    PUBLIC    ////////////////////////////
 
 void model_init(void) {
@@ -218,17 +421,48 @@ void model_init(void) {
     model_initCube();
     model_initTriangle();
     model_initLine();
-    model_loadTextures();
     model_initPoint();
+    model_initVectorLines();
 
+    // Uploads all meshes created above into the static pool
     instanced_init();
-    instanced_bindAttrib(g_models[MODEL_SPHERE]);
-    instanced_bindAttrib(g_models[MODEL_LINE]);
-    instanced_bindAttrib(g_models[MODEL_TRIANGLE]);
-    instanced_bindAttrib(g_models[MODEL_POINT]);
 }
 
 void model_cleanup(void) {
+    // LOD 0 is disposed with the other models
+    for (int i = 1; i < MODEL_SPHERE_LODS; ++i) {
+        if (g_sphereLods[i] != NULL) {
+            instanced_disposeMesh(g_sphereLods[i]);
+        }
+        g_sphereLods[i] = NULL;
+    }
+    g_sphereLods[0] = NULL;
+
+    for (int i = 0; i < MODEL_SPHERE_LODS; ++i) {
+        if (g_sphereLodPairs[i].mesh != NULL) {
+            instanced_disposeMesh(g_sphereLodPairs[i].mesh);
+        }
+        g_sphereLodPairs[i].mesh = NULL;
+    }
+    g_shadowPairs[MODEL_SPHERE].mesh = NULL;
+
+    for (int i = 0; i < MODEL_MESH_COUNT; ++i) {
+        if (g_shadowPairs[i].mesh != NULL) {
+            instanced_disposeMesh(g_shadowPairs[i].mesh);
+            g_shadowPairs[i].mesh = NULL;
+        }
+    }
+
+    if (g_vectorLines != NULL) {
+        instanced_disposeMesh(g_vectorLines);
+        g_vectorLines = NULL;
+    }
+
+    if (g_floor != NULL) {
+        instanced_disposeMesh(g_floor);
+        g_floor = NULL;
+    }
+
     for (int i = 0; i < MODEL_MESH_COUNT; ++i) {
         if (g_models[i] != NULL) {
             instanced_disposeMesh(g_models[i]);
@@ -237,9 +471,11 @@ void model_cleanup(void) {
     }
 
     for (int i = 0; i < TEXTURE_COUNT; ++i) {
-        glDeleteTextures(1, &g_textures[i]);
+        gpumem_deleteTextures(1, &g_textures[i]);
         g_textures[i] = 0;
     }
+    gpumem_deleteTextures(1, &g_skybox);
+    g_skybox = 0;
 
     instanced_cleanup();
 }
@@ -250,7 +486,23 @@ void model_drawTextured(ModelType model, bool texOrder1) {
     }
 
     model_bindCubeTextures(texOrder1);
-    instanced_draw(g_models[model], false);
+    instanced_draw(g_models[model], false, 0);
+}
+
+void model_drawFloor(bool texOrder1) {
+    model_bindFloorTexture(texOrder1);
+    instanced_draw(g_floor, false, 0);
+}
+
+void model_drawSkybox(void) {
+    if (!g_skybox) {
+        model_loadSkybox();
+    }
+
+    shader_setSkyboxData();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, g_skybox);
+    instanced_draw(g_models[MODEL_CUBE], false, 0);
 }
 
 void model_drawSimple(ModelType model) {
@@ -259,26 +511,55 @@ void model_drawSimple(ModelType model) {
     }
 
     shader_setSimpleMVP(false);
-    instanced_draw(g_models[model], false);
+    instanced_draw(g_models[model], false, 0);
 }
 
-void model_drawInstanced(ModelType model) {
+void model_drawInstanced(ModelType model, int lod) {
     if (model >= MODEL_MESH_COUNT) {
         return;
     }
 
     shader_setSimpleMVP(true);
-    instanced_draw(g_models[model], true);
+    instanced_draw(model_getLodMesh(model, lod), true, lod);
+}
+
+void model_drawImpostors(int lod) {
+    glstate_setEnabled(GL_PROGRAM_POINT_SIZE, true);
+    instanced_draw(g_models[MODEL_POINT], true, lod);
+    glstate_setEnabled(GL_PROGRAM_POINT_SIZE, false);
+}
+
+bool model_drawWithShadow(ModelType model, int lod) {
+    if (model >= MODEL_MESH_COUNT) {
+        return false;
+    }
+
+    ShadowPair *pair = model_getShadowPair(model, lod);
+    if (!pair->mesh) {
+        return false;
+    }
+
+    shader_setShadowVertexStart(instanced_getBaseVertex(pair->mesh) + pair->shadowVertexStart);
+    instanced_draw(pair->mesh, true, lod);
+    return true;
+}
+
+void model_drawOrdered(ModelType model, GLuint order) {
+    if (model >= MODEL_MESH_COUNT) {
+        return;
+    }
+
+    instanced_drawOrdered(g_models[model], order);
 }
 
-void model_drawParticleVis(void) {
-    instanced_drawParticleVis(g_models[MODEL_POINT]);
+void model_drawParticleVis(bool lines, int lod) {
+    instanced_drawParticleVis(lines ? g_vectorLines : g_models[MODEL_POINT], lod);
 }
 
-void model_draw(ModelType model, bool instanced) {
+void model_draw(ModelType model, bool instanced, int lod) {
     if (model >= MODEL_MESH_COUNT) {
         return;
     }
 
-    instanced_draw(g_models[model], instanced);
+    instanced_draw(model_getLodMesh(model, lod), instanced, lod);
 }
\ No newline at end of file
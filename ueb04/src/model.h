@@ -10,6 +10,9 @@
 
 #include <fhwcg/fhwcg.h>
 
+/** Number of LODs of the sphere model */
+#define MODEL_SPHERE_LODS 3
+
 /** Available model types */
 typedef enum {
     MODEL_SPHERE,
@@ -36,21 +39,68 @@ void model_cleanup(void);
  */
 void model_drawTextured(ModelType model, bool texOrder1);
 
+/**
+ * Draws the floor face of the room with the textured shader
+ * @param texOrder1 Which texture order is wanted
+ */
+void model_drawFloor(bool texOrder1);
+
+/**
+ * Draws the skybox cube with the cubemap at the far plane
+ * Expects depth func GL_LEQUAL and inside-out culling
+ */
+void model_drawSkybox(void);
+
 /**
  * Draws a model with simple color shader
  * @param model Model type to draw
  */
 void model_drawSimple(ModelType model);
 
-void model_drawInstanced(ModelType model);
+/**
+ * Draws the instances of one LOD range with the simple shader
+ * @param model Model type to draw
+ * @param lod LOD range, selects the sphere LOD mesh
+ */
+void model_drawInstanced(ModelType model, int lod);
 
-void model_drawParticleVis(void);
+/**
+ * Draws the instances of one LOD range as ray-cast sphere point sprites.
+ * Expects shader_setParticleImpostorData to be set.
+ * @param lod LOD range
+ */
+void model_drawImpostors(int lod);
+
+/**
+ * Draws the instances of one LOD range together with their drop shadows
+ * in a single draw. Expects shader_setParticleShadowData to be set.
+ * @param model Model type to draw
+ * @param lod LOD range, selects the sphere LOD mesh
+ * @return False if the model has no shadow pair mesh
+ */
+bool model_drawWithShadow(ModelType model, int lod);
+
+/**
+ * Draws all instances in the order of an order buffer, without setting any Shader Data.
+ * Expects shader_setParticleTranslucentData to be set.
+ * @param model Model type to draw
+ * @param order One uint per instance, see instanced_drawOrdered
+ */
+void model_drawOrdered(ModelType model, GLuint order);
+
+/**
+ * Draws the vector visualization for the instances of one LOD range
+ * @param lines Draw the instanced line mesh instead of points for the geometry shader
+ * @param lod LOD range
+ */
+void model_drawParticleVis(bool lines, int lod);
 
 /**
  * Draws without setting any Shader Data instanced or not.
  * @param model Model type to draw
  * @param instanced If the instancing vbo should be used.
+ * @param lod LOD range, selects the sphere LOD mesh
  */
-void model_draw(ModelType model, bool instanced);
+void model_draw(ModelType model, bool instanced, int lod);
 
 #endif // MODEL_H
\ No newline at end of file
@@ -0,0 +1,119 @@
+/**
+ * @file morton.c
+ * @brief Implementation of the Morton order sort
+ *
+ * The radix sort runs over 8 bit digits of the 30 bit codes. A digit that
+ * all keys share is skipped, which saves the top passes for particles that
+ * gathered in one part of the room.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "morton.h"
+#include "alloctrack.h"
+
+/** Bits per radix sort pass */
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Spreads the lower MORTON_BITS bits of v to every third bit.
+ * @param v Value to spread.
+ * @return Spread value.
+ */
+static inline uint32_t spreadBits(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+/**
+ * Grows the sort arrays to hold at least count entries.
+ * @param s Sort state.
+ * @param count Required number of entries.
+ */
+static void reserve(MortonSort *s, int count) {
+    if (s->capacity >= count) {
+        return;
+    }
+
+    int capacity = s->capacity ? s->capacity * 2 : 1024;
+    if (capacity < count) capacity = count;
+
+    TRACKED_FREE(s->keys);
+    TRACKED_FREE(s->tmpKeys);
+    TRACKED_FREE(s->order);
+    TRACKED_FREE(s->tmpOrder);
+    s->keys = TRACKED_MALLOC(capacity * sizeof(uint32_t));
+    s->tmpKeys = TRACKED_MALLOC(capacity * sizeof(uint32_t));
+    s->order = TRACKED_MALLOC(capacity * sizeof(int));
+    s->tmpOrder = TRACKED_MALLOC(capacity * sizeof(int));
+    assert(s->keys && s->tmpKeys && s->order && s->tmpOrder && "malloc failed in morton reserve");
+    s->capacity = capacity;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+uint32_t morton_encode(const vec3 pos, float halfSize) {
+    const float scale = (float) (1 << MORTON_BITS) / (2.0f * halfSize);
+    const float maxCell = (float) ((1 << MORTON_BITS) - 1);
+
+    uint32_t cell[3];
+    for (int i = 0; i < 3; ++i) {
+        cell[i] = (uint32_t) glm_clamp((pos[i] + halfSize) * scale, 0.0f, maxCell);
+    }
+    return spreadBits(cell[0]) | (spreadBits(cell[1]) << 1) | (spreadBits(cell[2]) << 2);
+}
+
+const int* morton_sort(MortonSort *s, const vec3 *pos, int count, float halfSize) {
+    reserve(s, count);
+
+    for (int i = 0; i < count; ++i) {
+        s->keys[i] = morton_encode(pos[i], halfSize);
+        s->order[i] = i;
+    }
+
+    for (int shift = 0; shift < 3 * MORTON_BITS; shift += RADIX_BITS) {
+        int histogram[RADIX_SIZE] = { 0 };
+        for (int i = 0; i < count; ++i) {
+            ++histogram[(s->keys[i] >> shift) & (RADIX_SIZE - 1)];
+        }
+        if (count == 0 || histogram[(s->keys[0] >> shift) & (RADIX_SIZE - 1)] == count) {
+            continue;
+        }
+
+        int offset = 0;
+        for (int d = 0; d < RADIX_SIZE; ++d) {
+            int n = histogram[d];
+            histogram[d] = offset;
+            offset += n;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            int slot = histogram[(s->keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+            s->tmpKeys[slot] = s->keys[i];
+            s->tmpOrder[slot] = s->order[i];
+        }
+
+        uint32_t *keys = s->keys;
+        s->keys = s->tmpKeys;
+        s->tmpKeys = keys;
+        int *order = s->order;
+        s->order = s->tmpOrder;
+        s->tmpOrder = order;
+    }
+    return s->order;
+}
+
+void morton_free(MortonSort *s) {
+    TRACKED_FREE(s->keys);
+    TRACKED_FREE(s->tmpKeys);
+    TRACKED_FREE(s->order);
+    TRACKED_FREE(s->tmpOrder);
+    memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,53 @@
+/**
+ * @file morton.h
+ * @brief Morton order of particle positions, sorted with an LSD radix sort
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <fhwcg/fhwcg.h>
+#include <stdint.h>
+
+/** Bits per axis of a Morton code, 3 * MORTON_BITS fit into 32 bits */
+#define MORTON_BITS 10
+
+/**
+ * Keys and the permutation of the last sort with their radix sort scratch.
+ * Grows with the largest sorted range and never shrinks.
+ */
+typedef struct {
+    uint32_t *keys, *tmpKeys;
+    int *order, *tmpOrder;
+    int capacity;
+} MortonSort;
+
+/**
+ * Returns the Morton code of a position in the cube [-halfSize, halfSize]^3,
+ * positions outside are clamped to it.
+ * @param pos Position.
+ * @param halfSize Half-extent of the cube.
+ * @return Interleaved MORTON_BITS per axis, x in the lowest bit.
+ */
+uint32_t morton_encode(const vec3 pos, float halfSize);
+
+/**
+ * Sorts positions by their Morton code, equal codes keep their order.
+ * @param s Sort state, its order array holds the result.
+ * @param pos Positions to sort.
+ * @param count Number of positions.
+ * @param halfSize Half-extent of the cube.
+ * @return order[k] is the index of the k-th position in Morton order,
+ *         valid until the next call.
+ */
+const int* morton_sort(MortonSort *s, const vec3 *pos, int count, float halfSize);
+
+/**
+ * Frees all sort memory.
+ * @param s Sort state to free.
+ */
+void morton_free(MortonSort *s);
+
+#endif // MORTON_H
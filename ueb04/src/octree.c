@@ -0,0 +1,358 @@
+/**
+ * @file octree.c
+ * @brief Implementation of the Barnes-Hut octree
+ *
+ * The children of a node are found by binary searches for the next
+ * Morton digit in its sorted range. Every subtree is built depth first
+ * into its own node array, with the subtree root at index 0. Joining
+ * lays the tree out as the root, the level 1 cells, the subtree roots
+ * and then the remaining nodes of every subtree, so the children of
+ * every node stay contiguous.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "octree.h"
+#include "jobs.h"
+#include "alloctrack.h"
+#include "timeline.h"
+
+/** Positions per chunk of the parallel gather */
+#define GATHER_PER_CHUNK 4096
+
+/** Deepest walk: every level below the root pushes at most 7 siblings on the current node */
+#define STACK_SIZE (8 * (MORTON_BITS + 1))
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Grows an array to hold at least count elements, keeping its contents.
+ * @param ptr The array.
+ * @param capacity Capacity of the array in elements.
+ * @param count Required number of elements.
+ * @param elemSize Size of one element.
+ */
+static void reserve(void **ptr, int *capacity, int count, size_t elemSize) {
+    if (*capacity >= count) {
+        return;
+    }
+
+    int newCapacity = *capacity ? *capacity * 2 : 1024;
+    if (newCapacity < count) newCapacity = count;
+    void *grown = TRACKED_REALLOC(*ptr, newCapacity * elemSize);
+    assert(grown && "realloc failed in octree reserve");
+    *ptr = grown;
+    *capacity = newCapacity;
+}
+
+/**
+ * Finds the first sorted key not below a value.
+ * @param keys Sorted keys.
+ * @param lo First index of the range.
+ * @param hi One past the last index.
+ * @param value Value to look for.
+ * @return Index in [lo, hi].
+ */
+static int lowerBound(const uint32_t *keys, int lo, int hi, uint32_t value) {
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (keys[mid] < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Squared edge length of the cells of a level.
+ * @param t Tree.
+ * @param level Level, 0 is the root.
+ * @return Squared edge length.
+ */
+static float cellSize2(const Octree *t, int level) {
+    float size = 2.0f * t->halfSize / (float) (1 << level);
+    return size * size;
+}
+
+/**
+ * Sets the center of mass of a node from its children.
+ * @param node The node.
+ * @param children Its children.
+ */
+static void mergeChildren(OctreeNode *node, const OctreeNode *children) {
+    glm_vec3_zero(node->center);
+    node->mass = 0.0f;
+    for (int k = 0; k < node->childCount; ++k) {
+        glm_vec3_muladds((float*) children[k].center, children[k].mass, node->center);
+        node->mass += children[k].mass;
+    }
+    glm_vec3_scale(node->center, 1.0f / node->mass, node->center);
+}
+
+/**
+ * Builds a node and everything below it into a subtree.
+ * @param t Tree with sorted keys and positions.
+ * @param sub Subtree the node belongs to.
+ * @param idx Index of the node in the subtree, already allocated.
+ * @param first First sorted position of the node.
+ * @param count Number of positions, at least one.
+ * @param level Level of the node.
+ */
+static void buildNode(const Octree *t, OctreeSubtree *sub, int idx, int first, int count, int level) {
+    OctreeNode *node = &sub->data[idx];
+    node->first = first;
+    node->count = count;
+    node->size2 = cellSize2(t, level);
+    node->firstChild = -1;
+    node->childCount = 0;
+
+    if (count <= OCTREE_LEAF_SIZE || level == MORTON_BITS) {
+        glm_vec3_zero(node->center);
+        for (int i = first; i < first + count; ++i) {
+            glm_vec3_add(node->center, t->sortedPos[i], node->center);
+        }
+        node->mass = (float) count;
+        glm_vec3_scale(node->center, 1.0f / node->mass, node->center);
+        return;
+    }
+
+    // Split the range at the next digit, all keys share the digits above
+    const uint32_t *keys = t->sort.keys;
+    int shift = 3 * (MORTON_BITS - level - 1);
+    uint32_t prefix = (keys[first] >> (shift + 3)) << (shift + 3);
+    int bounds[9];
+    bounds[0] = first;
+    bounds[8] = first + count;
+    for (int d = 1; d < 8; ++d) {
+        bounds[d] = lowerBound(keys, bounds[d - 1], first + count, prefix | ((uint32_t) d << shift));
+    }
+
+    int childCount = 0;
+    for (int d = 0; d < 8; ++d) {
+        childCount += bounds[d + 1] > bounds[d];
+    }
+
+    // Growing may move the nodes, so they are only accessed by index from here on
+    int firstChild = sub->size;
+    reserve((void**) &sub->data, &sub->capacity, sub->size + childCount, sizeof(OctreeNode));
+    sub->size += childCount;
+    sub->data[idx].firstChild = firstChild;
+    sub->data[idx].childCount = childCount;
+
+    int child = firstChild;
+    for (int d = 0; d < 8; ++d) {
+        if (bounds[d + 1] > bounds[d]) {
+            buildNode(t, sub, child++, bounds[d], bounds[d + 1] - bounds[d], level + 1);
+        }
+    }
+    mergeChildren(&sub->data[idx], &sub->data[firstChild]);
+}
+
+/**
+ * Copies the positions of a chunk into Morton order.
+ * @param begin First sorted position.
+ * @param end One past the last sorted position.
+ * @param chunk Unused.
+ * @param userData Pointer to an array of the tree and the unsorted positions.
+ */
+static void gatherJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    void **args = userData;
+    Octree *t = args[0];
+    const vec3 *pos = args[1];
+    for (int i = begin; i < end; ++i) {
+        glm_vec3_copy((float*) pos[t->sort.order[i]], t->sortedPos[i]);
+    }
+}
+
+/**
+ * Builds the subtrees of a chunk of split level cells.
+ * @param begin First cell.
+ * @param end One past the last cell.
+ * @param chunk Unused.
+ * @param userData The tree.
+ */
+static void subtreeJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    Octree *t = userData;
+    for (int b = begin; b < end; ++b) {
+        OctreeSubtree *sub = &t->subtrees[b];
+        int first = t->subtreeFirst[b];
+        int count = t->subtreeFirst[b + 1] - first;
+        sub->size = 0;
+        if (count == 0) {
+            continue;
+        }
+
+        reserve((void**) &sub->data, &sub->capacity, 1, sizeof(OctreeNode));
+        sub->size = 1;
+        buildNode(t, sub, 0, first, count, OCTREE_SPLIT_LEVEL);
+    }
+}
+
+/**
+ * Copies the built subtrees into the tree and moves their child indices
+ * along, see the layout in the file comment.
+ * @param begin First cell.
+ * @param end One past the last cell.
+ * @param chunk Unused.
+ * @param userData Pointer to an array of the tree, the slot of every
+ *                 subtree root and the start of its remaining nodes.
+ */
+static void joinJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    void **args = userData;
+    Octree *t = args[0];
+    const int *rootSlot = args[1];
+    const int *restFirst = args[2];
+
+    for (int b = begin; b < end; ++b) {
+        const OctreeSubtree *sub = &t->subtrees[b];
+        for (int i = 0; i < sub->size; ++i) {
+            OctreeNode *dest = &t->nodes[i == 0 ? rootSlot[b] : restFirst[b] + i - 1];
+            *dest = sub->data[i];
+            if (dest->firstChild >= 0) {
+                dest->firstChild += restFirst[b] - 1;
+            }
+        }
+    }
+}
+
+/**
+ * Adds the pull of a mass to a sum.
+ * @param d Distance vector from the pulled position to the mass.
+ * @param mass The mass.
+ * @param eps2 Squared softening length.
+ * @param dest The sum.
+ */
+static inline void addPull(const vec3 d, float mass, float eps2, vec3 dest) {
+    float invDist = 1.0f / sqrtf(glm_vec3_norm2((float*) d) + eps2);
+    glm_vec3_muladds((float*) d, mass * invDist * invDist * invDist, dest);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void octree_build(Octree *t, const vec3 *pos, int count, float halfSize) {
+    TIMELINE_BEGIN("Octree");
+    t->count = count;
+    t->halfSize = halfSize;
+    t->nodeCount = 0;
+    if (count == 0) {
+        TIMELINE_END();
+        return;
+    }
+
+    // 1. Sort by Morton code and gather the positions in that order
+    morton_sort(&t->sort, pos, count, halfSize);
+    reserve((void**) &t->sortedPos, &t->posCapacity, count, sizeof(vec3));
+    void *gather[] = { t, (void*) pos };
+    jobs_parallelFor(count, GATHER_PER_CHUNK, gatherJob, gather);
+
+    // 2. Subtrees of the split level cells, side by side
+    int shift = 3 * (MORTON_BITS - OCTREE_SPLIT_LEVEL);
+    for (int b = 0; b <= OCTREE_SUBTREES; ++b) {
+        t->subtreeFirst[b] = (b == OCTREE_SUBTREES) ? count : lowerBound(t->sort.keys, 0, count, (uint32_t) b << shift);
+    }
+    jobs_parallelFor(OCTREE_SUBTREES, 1, subtreeJob, t);
+
+    // 3. Layout of the top levels, the subtree roots are the children of the level 1 cells
+    int level1[8];
+    int level1Count = 0;
+    int rootSlot[OCTREE_SUBTREES];
+    int restFirst[OCTREE_SUBTREES];
+    int rootCount = 0;
+    for (int b = 0; b < OCTREE_SUBTREES; ++b) {
+        rootCount += t->subtrees[b].size > 0;
+    }
+    for (int c = 0; c < 8; ++c) {
+        level1[c] = t->subtreeFirst[(c + 1) * 8] > t->subtreeFirst[c * 8] ? 1 + level1Count++ : -1;
+    }
+
+    int next = 1 + level1Count;
+    int rest = next + rootCount;
+    for (int b = 0; b < OCTREE_SUBTREES; ++b) {
+        rootSlot[b] = t->subtrees[b].size > 0 ? next++ : -1;
+        restFirst[b] = rest;
+        rest += glm_imax(t->subtrees[b].size - 1, 0);
+    }
+    reserve((void**) &t->nodes, &t->nodeCapacity, rest, sizeof(OctreeNode));
+    t->nodeCount = rest;
+
+    void *join[] = { t, rootSlot, restFirst };
+    jobs_parallelFor(OCTREE_SUBTREES, 1, joinJob, join);
+
+    // 4. The level 1 cells and the root from their children
+    for (int c = 0; c < 8; ++c) {
+        if (level1[c] < 0) {
+            continue;
+        }
+        OctreeNode *node = &t->nodes[level1[c]];
+        node->first = t->subtreeFirst[c * 8];
+        node->count = t->subtreeFirst[(c + 1) * 8] - node->first;
+        node->size2 = cellSize2(t, 1);
+        node->firstChild = -1;
+        node->childCount = 0;
+        for (int b = c * 8; b < (c + 1) * 8; ++b) {
+            if (rootSlot[b] < 0) {
+                continue;
+            }
+            if (node->childCount++ == 0) {
+                node->firstChild = rootSlot[b];
+            }
+        }
+        mergeChildren(node, &t->nodes[node->firstChild]);
+    }
+
+    OctreeNode *root = &t->nodes[0];
+    root->first = 0;
+    root->count = count;
+    root->size2 = cellSize2(t, 0);
+    root->firstChild = 1;
+    root->childCount = level1Count;
+    mergeChildren(root, &t->nodes[1]);
+    TIMELINE_END();
+}
+
+void octree_pull(const Octree *t, const vec3 pos, float theta, float softening, vec3 dest) {
+    glm_vec3_zero(dest);
+    if (t->nodeCount == 0) {
+        return;
+    }
+
+    float theta2 = theta * theta;
+    float eps2 = softening * softening;
+    int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const OctreeNode *node = &t->nodes[stack[--top]];
+        vec3 d;
+        glm_vec3_sub((float*) node->center, (float*) pos, d);
+
+        if (node->firstChild < 0) {
+            for (int i = node->first; i < node->first + node->count; ++i) {
+                glm_vec3_sub(t->sortedPos[i], (float*) pos, d);
+                addPull(d, 1.0f, eps2, dest);
+            }
+        } else if (node->size2 < theta2 * glm_vec3_norm2(d)) {
+            addPull(d, node->mass, eps2, dest);
+        } else {
+            for (int k = node->childCount - 1; k >= 0; --k) {
+                stack[top++] = node->firstChild + k;
+            }
+        }
+    }
+}
+
+void octree_free(Octree *t) {
+    TRACKED_FREE(t->nodes);
+    TRACKED_FREE(t->sortedPos);
+    for (int b = 0; b < OCTREE_SUBTREES; ++b) {
+        TRACKED_FREE(t->subtrees[b].data);
+    }
+    morton_free(&t->sort);
+    memset(t, 0, sizeof(Octree));
+}
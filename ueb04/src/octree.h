@@ -0,0 +1,102 @@
+/**
+ * @file octree.h
+ * @brief Barnes-Hut octree over particle positions, rebuilt every step
+ *
+ * A linear octree: the positions are sorted by their Morton code, every
+ * node covers a contiguous range of the sorted positions and the children
+ * of a node are stored next to each other. The cells of level
+ * OCTREE_SPLIT_LEVEL are built as independent subtrees on the job pool
+ * and then joined below the shared top levels.
+ *
+ * A far node pulls with the mass at its center of mass once its cell
+ * appears smaller than the opening angle theta, so the pull on one
+ * particle costs O(log n) instead of O(n).
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include <fhwcg/fhwcg.h>
+#include "morton.h"
+
+/** Most particles in a leaf, fewer are not split further */
+#define OCTREE_LEAF_SIZE 8
+
+/** Level of the cells built as independent subtrees */
+#define OCTREE_SPLIT_LEVEL 2
+
+/** Cells of OCTREE_SPLIT_LEVEL */
+#define OCTREE_SUBTREES (1 << (3 * OCTREE_SPLIT_LEVEL))
+
+/**
+ * One cell of the tree, each particle has mass 1.
+ */
+typedef struct {
+    vec3 center;        // center of mass
+    float mass;
+    float size2;        // squared edge length of the cell
+    int firstChild;     // -1 for leaves
+    int childCount;
+    int first;          // range of the sorted positions
+    int count;
+} OctreeNode;
+
+/**
+ * Nodes of one subtree while it is built, indices are local to it.
+ */
+typedef struct {
+    OctreeNode *data;
+    int size;
+    int capacity;
+} OctreeSubtree;
+
+/**
+ * Octree over the cube [-halfSize, halfSize]^3, the root is node 0.
+ * All memory grows with the largest tree and never shrinks.
+ */
+typedef struct {
+    OctreeNode *nodes;
+    int nodeCount;
+    int nodeCapacity;
+
+    vec3 *sortedPos;    // positions in Morton order
+    int posCapacity;
+    int count;
+    float halfSize;
+
+    MortonSort sort;
+    OctreeSubtree subtrees[OCTREE_SUBTREES];
+    int subtreeFirst[OCTREE_SUBTREES + 1];  // sorted range of every subtree
+} Octree;
+
+/**
+ * Rebuilds the tree from the current positions.
+ * Positions are copied into Morton order, so queries never read the
+ * columns that are being integrated.
+ * @param t Tree to rebuild.
+ * @param pos Particle positions.
+ * @param count Number of particles.
+ * @param halfSize Half-extent of the room, positions outside count as on its border.
+ */
+void octree_build(Octree *t, const vec3 *pos, int count, float halfSize);
+
+/**
+ * Sums the gravitational pull of all particles on a position,
+ * m * d / (|d|^2 + softening^2)^(3/2) per particle with distance vector d.
+ * @param t Built tree.
+ * @param pos Position to pull.
+ * @param theta Opening angle, 0 visits every particle.
+ * @param softening Length that bounds the pull of close particles.
+ * @param dest Destination for the pull.
+ */
+void octree_pull(const Octree *t, const vec3 pos, float theta, float softening, vec3 dest);
+
+/**
+ * Frees all tree memory.
+ * @param t Tree to free.
+ */
+void octree_free(Octree *t);
+
+#endif // OCTREE_H
@@ -11,17 +11,73 @@
 #include "shader.h"
 #include "utils.h"
 #include "instanced.h"
+#include "compute.h"
+#include "jobs.h"
+#include "integrate.h"
+#include "grid.h"
+#include "field.h"
+#include "morton.h"
+#include "octree.h"
+#include "sdf.h"
+#include "alloctrack.h"
+#include "bigalloc.h"
+#include "trail.h"
+#include "translucent.h"
+#include "fastmath.h"
+#include "profiler.h"
+#include "glstate.h"
+#include "trace.h"
+#include "thread.h"
+#include "timeline.h"
+#include "perfcount.h"
+#include "metrics.h"
 
 #define NUM_SPHERES 2
 #define SPHERE_MAX_WAIT_SEC 10.0f
 #define SPHERE_MIN_WAIT_SEC 2.0f
 #define SPHERE_SPEED 0.5f
 
-#define SPHERE_COLOR VEC3(0.4f, 0, 1)
 #define CENTER_SPHERE_COLOR VEC3(0.3f, 1.0f, 0.3f)
+#define OBSTACLE_COLOR VEC3(0.55f, 0.55f, 0.6f)
 
 #define EPS 1e-6f
 
+/** Neighbors considered per particle in TM_FLOCK */
+#define MAX_NEIGHBORS 64
+
+/** Cull radius covering the acceleration and up vectors of a particle */
+#define CULL_VIS_RADIUS 1.5f
+
+/** Particles per batch of the fast TM_SPHERES path */
+#define SPHERES_BATCH 64
+
+/** Weight of the newest frame in the smoothed particle throughput */
+#define THROUGHPUT_SMOOTHING 0.05f
+
+/** Minimum number of particles handled by one job */
+#define PARTICLES_PER_CHUNK 256
+
+/** Trace file written by RM_RECORD and read by RM_REPLAY */
+#define TRACE_FILE "particles.trace"
+
+/** Snapshots of the threaded mode: one written, one shared, one read */
+#define SNAPSHOT_COUNT 3
+
+/** Set in the shared snapshot index until the main thread took it */
+#define SNAPSHOT_FRESH 4L
+
+/** Sleep of the simulation thread when no step is due */
+#define SIM_SLEEP_MS 1
+
+/** Half-extent of the box emitters spawn in, relative to the room */
+#define EMITTER_SPREAD 0.05f
+
+/** Longest step interval of the temporal LOD, at fidelity 0 */
+#define TEMPORAL_LOD_MAX_INTERVAL 8
+
+/** Particles of one round-robin bucket of the temporal LOD, neighbours share a step */
+#define TEMPORAL_LOD_BUCKET 32
+
 /**
  * Generates a random position within a box.
  * @param dst Destination vector.
@@ -62,32 +118,399 @@ typedef struct {
     vec3 color;
 } Sphere;
 
+/**
+ * Structure-of-arrays particle store.
+ * pos, acceleration, up and forward are the per-instance columns
+ * and are handed to the instance buffers without repacking.
+ * prevPos and renderPos are only used for render interpolation.
+ * The swarms are stored back to back, swarm holds the swarm of every particle.
+ * age is only advanced for swarms with an emitter.
+ */
+typedef struct {
+    vec3 *pos;
+    vec3 *prevPos;
+    vec3 *renderPos;
+    vec3 *acceleration;
+    vec3 *velocity;
+    vec3 *forward;
+    vec3 *up;
+    vec3 *right;
+    float *kWeak;
+    float *kV;
+    float *age;
+    int *swarm;
+    int size;
+    int capacity;
+} ParticleStore;
+
+/**
+ * Full state of one particle in a trace.
+ */
 typedef struct {
     vec3 pos;
-    float kWeak, kV;
     vec3 acceleration;
     vec3 velocity;
+    vec3 forward;
+    vec3 up;
+    vec3 right;
+    float kWeak;
+    float kV;
+    int swarm;
+} ParticleRecord;
+
+DEFINE_ARRAY_TYPE(ParticleRecord, ParticleRecordArr)
+
+/**
+ * State besides the particles stored with every traced step.
+ */
+typedef struct {
+    vec3 spheres[NUM_SPHERES];
+    vec3 manualCenter;
+} TraceGlobals;
 
-    struct {
-        vec3 forward;
-        vec3 up;
-        vec3 right;
-    } basis;
-} Particle;
+/**
+ * State after a fixed step published by the simulation thread.
+ * Holds everything the main thread needs to upload and draw the swarm.
+ */
+typedef struct {
+    vec3 *pos;
+    vec3 *prevPos;
+    vec3 *acceleration;
+    vec3 *up;
+    vec3 *forward;
+    int *swarm;
+    int size;
+    int capacity;
+
+    vec3 spheres[NUM_SPHERES];
+    vec3 manualCenter;
+    int leader;         // leader of swarm 0, a reorder may have moved it since
+    double time;        // wall-clock time of the step
+    int steps;          // steps since the previous published snapshot
+} Snapshot;
+
+/**
+ * Swarm-wide reductions computed once per fixed step.
+ * Shared by all particles so target modes never loop over the swarm.
+ */
+typedef struct {
+    vec3 centroid;
+    vec3 bboxMin;
+    vec3 bboxMax;
+    vec3 meanVelocity;
+    vec3 leaderPos;
+    int count;
+} SwarmStats;
 
-DEFINE_ARRAY_TYPE(Particle, ParticleArr);
+/**
+ * Range of one swarm in the particle store, the kV range
+ * its particles were spawned with and the state of its emitter.
+ */
+typedef struct {
+    int first;
+    int count;
+    float kvMin;
+    float kvMax;
+    float spawnCredit;      // fractional particles owed by the spawn rate
+    float burstTimer;       // seconds since the last burst
+} SwarmRange;
 
 ////////////////////////    LOCAL    ////////////////////////////
 
+/**
+ * Stable dt of an undamped spring is factor / omega, omega = sqrt(k / m).
+ * Explicit Euler gains energy on every step.
+ */
+static const float g_stabilityFactor[IG_COUNT] = {
+    [IG_EULER] = 0.0f,
+    [IG_SYMPLECTIC] = 2.0f,
+    [IG_VERLET] = 2.0f,
+    [IG_RK4] = 2.785f
+};
+
 /** Global sphere array */
 static Sphere g_spheres[NUM_SPHERES] = { 0 };
 
-/** Global particle array */
-static ParticleArr g_particles;
+/** Global particle store */
+static ParticleStore g_particles = { 0 };
+
+/** Second store the particles are gathered into in Morton order, swapped with g_particles */
+static ParticleStore g_reorderStore = { 0 };
+
+/** Morton order of the swarm that is being reordered */
+static MortonSort g_morton = { 0 };
+
+/** Fixed steps since the particles were last put in Morton order */
+static int g_stepsSinceReorder = 0;
 
 /** Manual center position for TM_BOX_CENTER mode */
 static vec3 g_manualCenter = {0.0f, 0.0f, 0.0f};
 
+/** Ranges of the swarms in g_particles, empty for inactive swarms */
+static SwarmRange g_ranges[MAX_SWARMS] = { 0 };
+
+/** Aggregates of the current fixed step, one per swarm */
+static SwarmStats g_swarm[MAX_SWARMS] = { 0 };
+
+/** Per-chunk partial aggregates, merged into g_swarm */
+static SwarmStats g_swarmPartials[JOBS_MAX_THREADS][MAX_SWARMS];
+
+/** Task graph of one fixed step, rebuilt every step */
+static JobGraph g_stepGraph;
+
+/** Neighbor grid for TM_FLOCK, rebuilt every step */
+static Grid g_grid = { 0 };
+
+/** Barnes-Hut tree of every TM_GRAVITY swarm, rebuilt every step */
+static Octree g_octrees[MAX_SWARMS] = { 0 };
+
+/** Swarm index of each octree build task */
+static int g_octreeSwarms[MAX_SWARMS] = { 0, 1, 2, 3 };
+
+/** Attractor force field for TM_SPHERES, rebuilt every step if enabled */
+static ForceField g_field = { 0 };
+
+/** If g_field was built for the current step */
+static bool g_fieldActive = false;
+
+/** Static obstacles as fractions of the room size, two pillars and a sphere */
+static const SdfObstacle g_obstacleLayout[] = {
+    { SO_BOX,    { -0.5f,  0.0f, -0.5f }, { 0.08f, 1.0f, 0.08f } },
+    { SO_BOX,    {  0.5f,  0.0f,  0.3f }, { 0.08f, 1.0f, 0.08f } },
+    { SO_SPHERE, {  0.0f, -0.4f,  0.5f }, { 0.2f,  0.0f, 0.0f  } }
+};
+
+/** Obstacles placed in the room at load time */
+static SdfObstacle g_obstacles[NK_LEN(g_obstacleLayout)];
+
+/** Distance volume of g_obstacles, baked on a worker thread */
+static SdfVolume g_sdf = { 0 };
+
+/** If particles steer around the obstacles in the current step */
+static bool g_sdfActive = false;
+
+/** Backend that currently owns the particle state */
+static PhysicsBackend g_activeBackend = PB_CPU;
+
+/** Trace mode that is currently running */
+static ReplayMode g_activeReplayMode = RM_OFF;
+
+/** Next step shown by RM_REPLAY */
+static int g_replayFrame = 0;
+
+/** Records of the traced step, reused across steps */
+static ParticleRecordArr g_traceRecords = { 0 };
+
+/**
+ * Rate of a particle under the temporal LOD.
+ */
+typedef enum {
+    LR_FULL,        // near and visible, every step
+    LR_SCALED,      // far, its bucket is due: one step of interval * dt
+    LR_SKIP         // far, waits for its bucket
+} LodRate;
+
+/**
+ * View the temporal LOD classifies against. Written by the main thread
+ * whenever the particles are drawn, copied by every step, so a simulation
+ * thread never reads it while it changes.
+ */
+static struct {
+    Mutex mutex;
+    bool initialized;
+    bool valid;
+    vec3 eye;
+    vec4 planes[6];
+} g_lodView = { 0 };
+
+/**
+ * Temporal LOD state of the running step.
+ */
+static struct {
+    bool active;
+    int interval;
+    int step;               // counts the steps, selects the due bucket
+    float distance2;
+    bool offscreen;
+    vec3 eye;
+    vec4 planes[6];
+    volatile long reduced;  // summed by the integrate jobs
+} g_lod = { 0 };
+
+/**
+ * Threaded mode: the fixed steps run on their own thread and hand
+ * snapshots to the main thread through a lock-free triple buffer.
+ * The mutex only keeps GUI edits off the state during a step.
+ */
+static struct {
+    bool running;
+    volatile long stop;
+    Thread thread;
+    Mutex mutex;
+
+    Snapshot snapshots[SNAPSHOT_COUNT];
+    volatile long shared;   // snapshot index, SNAPSHOT_FRESH if not taken yet
+    int back;               // written by the simulation thread
+    int front;              // read by the main thread
+    int unreadSteps;        // steps of a snapshot replaced before it was taken
+
+    vec3 *renderPos;        // interpolated positions, main thread
+    int renderCapacity;
+    int instanceCount;      // particle instances allocated on the GPU
+} g_sim = { 0 };
+
+/**
+ * Frees all columns of the particle store.
+ * @param ps Store to free.
+ */
+static void particleStoreFree(ParticleStore *ps) {
+    bigalloc_free(ps->pos);
+    bigalloc_free(ps->prevPos);
+    bigalloc_free(ps->renderPos);
+    bigalloc_free(ps->acceleration);
+    bigalloc_free(ps->velocity);
+    bigalloc_free(ps->forward);
+    bigalloc_free(ps->up);
+    bigalloc_free(ps->right);
+    bigalloc_free(ps->kWeak);
+    bigalloc_free(ps->kV);
+    bigalloc_free(ps->age);
+    bigalloc_free(ps->swarm);
+    memset(ps, 0, sizeof(ParticleStore));
+}
+
+/**
+ * Grows a column to the given capacity, keeping its contents.
+ * @param ptr Pointer to the column pointer.
+ * @param capacity New number of elements.
+ * @param elemSize Size of one element.
+ */
+static void growColumn(void **ptr, int capacity, size_t elemSize) {
+    void *tmp = BIG_REALLOC(*ptr, capacity * elemSize);
+    assert(tmp && "realloc failed in growColumn");
+    assert(ARRAY_IS_ALIGNED(tmp) && "particle column is not aligned");
+    *ptr = tmp;
+}
+
+/**
+ * Makes sure the store can hold at least minCapacity particles.
+ * Grows geometrically and never shrinks, existing particles are kept.
+ * @param ps Store to grow.
+ * @param minCapacity Required number of particles.
+ */
+static void particleStoreReserve(ParticleStore *ps, int minCapacity) {
+    if (ps->capacity >= minCapacity) {
+        return;
+    }
+
+    int capacity = ps->capacity ? ps->capacity * 2 : START_NUM_PARTICLES;
+    if (capacity < minCapacity) capacity = minCapacity;
+
+    growColumn((void**)&ps->pos, capacity, sizeof(vec3));
+    growColumn((void**)&ps->prevPos, capacity, sizeof(vec3));
+    growColumn((void**)&ps->renderPos, capacity, sizeof(vec3));
+    growColumn((void**)&ps->acceleration, capacity, sizeof(vec3));
+    growColumn((void**)&ps->velocity, capacity, sizeof(vec3));
+    growColumn((void**)&ps->forward, capacity, sizeof(vec3));
+    growColumn((void**)&ps->up, capacity, sizeof(vec3));
+    growColumn((void**)&ps->right, capacity, sizeof(vec3));
+    growColumn((void**)&ps->kWeak, capacity, sizeof(float));
+    growColumn((void**)&ps->kV, capacity, sizeof(float));
+    growColumn((void**)&ps->age, capacity, sizeof(float));
+    growColumn((void**)&ps->swarm, capacity, sizeof(int));
+
+    ps->capacity = capacity;
+}
+
+/**
+ * Copies particles between stores, the render positions are not copied.
+ * Within one store the ranges may overlap.
+ * @param dst Destination store with room for the particles.
+ * @param d First destination particle.
+ * @param src Source store.
+ * @param s First source particle.
+ * @param n Number of particles.
+ */
+static void particleStoreCopy(ParticleStore *dst, int d, const ParticleStore *src, int s, int n) {
+    if (n <= 0) {
+        return;
+    }
+
+    memmove(dst->pos + d, src->pos + s, n * sizeof(vec3));
+    memmove(dst->prevPos + d, src->prevPos + s, n * sizeof(vec3));
+    memmove(dst->acceleration + d, src->acceleration + s, n * sizeof(vec3));
+    memmove(dst->velocity + d, src->velocity + s, n * sizeof(vec3));
+    memmove(dst->forward + d, src->forward + s, n * sizeof(vec3));
+    memmove(dst->up + d, src->up + s, n * sizeof(vec3));
+    memmove(dst->right + d, src->right + s, n * sizeof(vec3));
+    memmove(dst->kWeak + d, src->kWeak + s, n * sizeof(float));
+    memmove(dst->kV + d, src->kV + s, n * sizeof(float));
+    memmove(dst->age + d, src->age + s, n * sizeof(float));
+    memmove(dst->swarm + d, src->swarm + s, n * sizeof(int));
+}
+
+/**
+ * Copies particles between stores in the given order, the render positions are not copied.
+ * @param dst Destination store with room for the particles.
+ * @param d First destination particle.
+ * @param src Source store.
+ * @param s First source particle.
+ * @param order Source particle of every destination particle, relative to s.
+ * @param n Number of particles.
+ */
+static void particleStoreGather(ParticleStore *dst, int d, const ParticleStore *src, int s, const int *order, int n) {
+    for (int k = 0; k < n; ++k) {
+        int i = s + order[k];
+        int j = d + k;
+        glm_vec3_copy(src->pos[i], dst->pos[j]);
+        glm_vec3_copy(src->prevPos[i], dst->prevPos[j]);
+        glm_vec3_copy(src->acceleration[i], dst->acceleration[j]);
+        glm_vec3_copy(src->velocity[i], dst->velocity[j]);
+        glm_vec3_copy(src->forward[i], dst->forward[j]);
+        glm_vec3_copy(src->up[i], dst->up[j]);
+        glm_vec3_copy(src->right[i], dst->right[j]);
+        dst->kWeak[j] = src->kWeak[i];
+        dst->kV[j] = src->kV[i];
+        dst->age[j] = src->age[i];
+        dst->swarm[j] = src->swarm[i];
+    }
+}
+
+/**
+ * Spawns a particle at a random position with random parameters.
+ * @param ps Store holding the particle.
+ * @param i Index of the particle to initialize.
+ * @param swarm Swarm of the particle.
+ * @param settings Settings of the swarm, the kWeak and kV ranges are taken from them.
+ * @param roomSize Half-extent of the room.
+ */
+static void spawnParticle(ParticleStore *ps, int i, int swarm, SwarmSettings *settings, float roomSize) {
+    RAND_IN_BOX(ps->pos[i], roomSize);
+    glm_vec3_copy(ps->pos[i], ps->prevPos[i]);
+    RAND_DIR(ps->velocity[i]);
+    glm_vec3_zero(ps->acceleration[i]);
+
+    ps->kWeak[i] = RAND(settings->kWeakMin, settings->kWeakMax);
+    ps->kV[i] = RAND(settings->kvMin, settings->kvMax);
+    ps->age[i] = 0.0f;
+    ps->swarm[i] = swarm;
+
+    glm_vec3_copy(GLM_YUP, ps->up[i]);
+    glm_vec3_copy(GLM_ZUP, ps->forward[i]);
+    glm_vec3_copy(GLM_XUP, ps->right[i]);
+}
+
+/**
+ * Picks a random leader inside the range of a swarm.
+ * @param settings Settings of the swarm receiving the leader.
+ * @param range Range of the swarm.
+ */
+static void pickLeader(SwarmSettings *settings, const SwarmRange *range) {
+    settings->leaderIdx = range->count > 0
+        ? range->first + (int)(RAND01 * (range->count - 1))
+        : -1;
+}
+
 /**
  * Updates all wandering spheres.
  * Handles movement toward target and wait states.
@@ -123,234 +546,1517 @@ static void updateSpheres(InputData *data) {
 }
 
 /**
- * Computes acceleration toward a target with distance-based scaling.
- * @param p Particle to compute acceleration for.
- * @param target Target position.
- * @param dest Output acceleration vector.
+ * Computes acceleration toward a target with distance-based scaling.
+ * @param i Index of the particle to compute acceleration for.
+ * @param target Target position.
+ * @param fast Normalize with the fastmath approximation.
+ * @param dest Output acceleration vector.
+ */
+static inline void getTargetAcceleration(int i, vec3 target, bool fast, vec3 dest) {
+    vec3 diff;
+    glm_vec3_sub(target, g_particles.pos[i], diff);
+
+    if (fast) {
+        fastmath_vec3_normalize(diff, dest);
+        glm_vec3_scale(dest, g_particles.kWeak[i], dest);
+        return;
+    }
+
+    float dist = glm_vec3_norm(diff);
+
+    // Normalize
+    if (dist > 1e-5f) {
+        glm_vec3_scale(diff, 1.0f / dist, dest);
+    } else {
+        glm_vec3_copy(VEC3X(0), dest);
+    }
+
+    // Scale by kWeak
+    glm_vec3_scale(dest, g_particles.kWeak[i], dest);
+}
+
+/**
+ * Computes local flocking acceleration (separation, alignment, cohesion)
+ * from the neighbors of the same swarm found in the grid, limited to kWeak.
+ * @param data Input state containing flocking weights.
+ * @param i Index of the particle to compute acceleration for.
+ * @param dest Output acceleration vector.
+ */
+static void getFlockAcceleration(InputData *data, int i, vec3 dest) {
+    float *pos = g_particles.pos[i];
+    int swarm = g_particles.swarm[i];
+    float radius2 = data->particles.flock.radius * data->particles.flock.radius;
+
+    vec3 separation = {0, 0, 0};
+    vec3 avgVel = {0, 0, 0};
+    vec3 avgPos = {0, 0, 0};
+    int neighbors = 0;
+
+    int c[3];
+    grid_cellCoords(&g_grid, pos, c);
+
+    for (int z = c[2] - 1; z <= c[2] + 1 && neighbors < MAX_NEIGHBORS; ++z) {
+        for (int y = c[1] - 1; y <= c[1] + 1 && neighbors < MAX_NEIGHBORS; ++y) {
+            for (int x = c[0] - 1; x <= c[0] + 1 && neighbors < MAX_NEIGHBORS; ++x) {
+                if (x < 0 || y < 0 || z < 0 || x >= g_grid.dim || y >= g_grid.dim || z >= g_grid.dim) {
+                    continue;
+                }
+
+                int begin, end;
+                grid_cellRange(&g_grid, x, y, z, &begin, &end);
+
+                for (int s = begin; s < end && neighbors < MAX_NEIGHBORS; ++s) {
+                    int other = g_grid.sortedIdx[s];
+                    if (other == i || g_particles.swarm[other] != swarm) {
+                        continue;
+                    }
+
+                    vec3 diff;
+                    glm_vec3_sub(pos, g_grid.sortedPos[s], diff);
+                    float d2 = glm_vec3_norm2(diff);
+                    if (d2 >= radius2 || d2 < EPS) {
+                        continue;
+                    }
+
+                    // Separation falls off with 1 / distance
+                    glm_vec3_muladds(diff, 1.0f / d2, separation);
+                    glm_vec3_add(avgVel, g_grid.sortedVel[s], avgVel);
+                    glm_vec3_add(avgPos, g_grid.sortedPos[s], avgPos);
+                    neighbors++;
+                }
+            }
+        }
+    }
+
+    glm_vec3_zero(dest);
+    if (neighbors == 0) {
+        return;
+    }
+
+    float inv = 1.0f / neighbors;
+    glm_vec3_scale(avgVel, inv, avgVel);
+    glm_vec3_scale(avgPos, inv, avgPos);
+
+    vec3 alignment, cohesion;
+    glm_vec3_sub(avgVel, g_particles.velocity[i], alignment);
+    glm_vec3_sub(avgPos, pos, cohesion);
+
+    glm_vec3_muladds(separation, data->particles.flock.separation, dest);
+    glm_vec3_muladds(alignment, data->particles.flock.alignment, dest);
+    glm_vec3_muladds(cohesion, data->particles.flock.cohesion, dest);
+
+    // Limit steering to kWeak
+    float kWeak = g_particles.kWeak[i];
+    if (glm_vec3_norm2(dest) > kWeak * kWeak) {
+        glm_vec3_scale_as(dest, kWeak, dest);
+    }
+}
+
+/**
+ * Computes the pull of all particles of the same swarm from its octree.
+ * The swarm has a total mass of 1 no matter its size, the pull is limited
+ * to kWeak like the flock steering.
+ * @param data Input state containing the gravity settings.
+ * @param i Index of the particle.
+ * @param dest Output acceleration vector.
+ */
+static void getGravityAcceleration(InputData *data, int i, vec3 dest) {
+    const Octree *tree = &g_octrees[g_particles.swarm[i]];
+    if (tree->count == 0) {
+        glm_vec3_zero(dest);
+        return;
+    }
+
+    octree_pull(tree, g_particles.pos[i], data->particles.gravity.theta, data->particles.gravity.softening, dest);
+    glm_vec3_scale(dest, data->particles.gravity.strength / tree->count, dest);
+
+    float kWeak = g_particles.kWeak[i];
+    if (glm_vec3_norm2(dest) > kWeak * kWeak) {
+        glm_vec3_scale_as(dest, kWeak, dest);
+    }
+}
+
+/**
+ * Computes acceleration for a particle based on target mode.
+ * Only called with constant mode and flags by the kernels of
+ * DEFINE_ACCEL_KERNEL, inlined there so each kernel keeps only its own case.
+ * @param mode Target mode.
+ * @param field TM_SPHERES samples the attractor field instead of the spheres.
+ * @param fast Use the fastmath approximations.
+ * @param data Input state.
+ * @param stats Aggregates of the particle's swarm.
+ * @param i Index of the particle to compute acceleration for.
+ * @param dest Output acceleration vector.
+ */
+static inline void computeAcceleration(TargetMode mode, bool field, bool fast, InputData *data, SwarmStats *stats,
+                                       int i, vec3 dest) {
+    switch (mode) {
+        case TM_SPHERES: {
+            if (field) {
+                field_sample(&g_field, g_particles.pos[i], dest);
+                glm_vec3_scale(dest, g_particles.kWeak[i], dest);
+                break;
+            }
+
+            glm_vec3_zero(dest);
+            vec3 tempAcc;
+            for (int j = 0; j < NUM_SPHERES; j++) {
+                Sphere *s = &g_spheres[j];
+                getTargetAcceleration(i, s->currPos, fast, tempAcc);
+
+                // Gaussian weighting: g = exp(-dist^2 / const)
+                float dist2 = glm_vec3_distance2(s->currPos, g_particles.pos[i]);
+                float x = -dist2 / data->particles.gaussianConst;
+                float g = fast ? fastmath_exp(x) : expf(x);
+
+                glm_vec3_scale(tempAcc, g, tempAcc);
+                glm_vec3_add(tempAcc, dest, dest);
+            }
+            break;
+        }
+
+        case TM_LEADER: {
+            // Non-leaders follow the leader, a missing leader is handled by the caller
+            getTargetAcceleration(i, stats->leaderPos, fast, dest);
+            break;
+        }
+
+        case TM_CENTER: {
+            getTargetAcceleration(i, stats->centroid, fast, dest);
+            break;
+        }
+
+        case TM_BOX_CENTER: {
+            getTargetAcceleration(i, g_manualCenter, fast, dest);
+            break;
+        }
+
+        case TM_FLOCK: {
+            getFlockAcceleration(data, i, dest);
+            break;
+        }
+
+        case TM_GRAVITY: {
+            getGravityAcceleration(data, i, dest);
+            break;
+        }
+
+        default:
+            glm_vec3_zero(dest);
+            break;
+    }
+}
+
+/**
+ * TM_SPHERES acceleration of the particles [begin, end) with the fastmath
+ * batch functions. Same result as computeAcceleration within the fastmath
+ * error bounds, but the exp and normalize run over whole batches.
+ * @param data Input state.
+ * @param begin First particle.
+ * @param end One past the last particle.
+ */
+static void computeSpheresAccelerationFast(InputData *data, int begin, int end) {
+    float invConst = -1.0f / data->particles.gaussianConst;
+    vec3 dir[SPHERES_BATCH];
+    float weight[SPHERES_BATCH];
+
+    for (int b = begin; b < end; b += SPHERES_BATCH) {
+        int n = (end - b < SPHERES_BATCH) ? end - b : SPHERES_BATCH;
+        vec3 *acc = &g_particles.acceleration[b];
+        memset(acc, 0, n * sizeof(vec3));
+
+        for (int j = 0; j < NUM_SPHERES; ++j) {
+            for (int k = 0; k < n; ++k) {
+                glm_vec3_sub(g_spheres[j].currPos, g_particles.pos[b + k], dir[k]);
+                weight[k] = glm_vec3_norm2(dir[k]) * invConst;
+            }
+
+            fastmath_expBatch(weight, weight, n);
+            fastmath_normalizeBatch(dir, n);
+
+            for (int k = 0; k < n; ++k) {
+                glm_vec3_muladds(dir[k], weight[k] * g_particles.kWeak[b + k], acc[k]);
+            }
+        }
+    }
+}
+
+/**
+ * Acceleration kernel over the particles [begin, end) of one swarm.
+ */
+typedef void (*AccelKernel)(InputData *data, SwarmStats *stats, int begin, int end);
+
+/**
+ * Defines the acceleration kernel of a target mode, field and fastmath
+ * flag (0 or 1). All kernels are this loop around computeAcceleration,
+ * the constant arguments leave one tight loop per mode without a dispatch
+ * per particle.
+ */
+#define DEFINE_ACCEL_KERNEL(mode, field, fast)                                                      \
+    static void accel_##mode##_##field##_##fast(InputData *data, SwarmStats *stats, int begin, int end) { \
+        for (int i = begin; i < end; ++i) {                                                         \
+            computeAcceleration(mode, field, fast, data, stats, i, g_particles.acceleration[i]);    \
+        }                                                                                           \
+    }
+
+DEFINE_ACCEL_KERNEL(TM_SPHERES, 0, 0)
+DEFINE_ACCEL_KERNEL(TM_SPHERES, 1, 0)
+DEFINE_ACCEL_KERNEL(TM_SPHERES, 1, 1)
+DEFINE_ACCEL_KERNEL(TM_CENTER, 0, 0)
+DEFINE_ACCEL_KERNEL(TM_CENTER, 0, 1)
+DEFINE_ACCEL_KERNEL(TM_LEADER, 0, 0)
+DEFINE_ACCEL_KERNEL(TM_LEADER, 0, 1)
+DEFINE_ACCEL_KERNEL(TM_BOX_CENTER, 0, 0)
+DEFINE_ACCEL_KERNEL(TM_BOX_CENTER, 0, 1)
+DEFINE_ACCEL_KERNEL(TM_FLOCK, 0, 0)
+DEFINE_ACCEL_KERNEL(TM_FLOCK, 0, 1)
+DEFINE_ACCEL_KERNEL(TM_GRAVITY, 0, 0)
+DEFINE_ACCEL_KERNEL(TM_GRAVITY, 0, 1)
+
+/**
+ * TM_SPHERES kernel with fastmath and without the field.
+ * @param data Input state.
+ * @param stats Unused.
+ * @param begin First particle.
+ * @param end One past the last particle.
+ */
+static void accelSpheresBatch(InputData *data, SwarmStats *stats, int begin, int end) {
+    NK_UNUSED(stats);
+    computeSpheresAccelerationFast(data, begin, end);
+}
+
+/** Modes other than TM_SPHERES ignore the field flag */
+#define ACCEL_KERNELS(mode) { { accel_##mode##_0_0, accel_##mode##_0_1 }, { accel_##mode##_0_0, accel_##mode##_0_1 } }
+
+/** Acceleration kernels by target mode, field flag and fastmath flag */
+static const AccelKernel g_accelKernels[TM_COUNT][2][2] = {
+    [TM_SPHERES] = { { accel_TM_SPHERES_0_0, accelSpheresBatch }, { accel_TM_SPHERES_1_0, accel_TM_SPHERES_1_1 } },
+    [TM_CENTER] = ACCEL_KERNELS(TM_CENTER),
+    [TM_LEADER] = ACCEL_KERNELS(TM_LEADER),
+    [TM_BOX_CENTER] = ACCEL_KERNELS(TM_BOX_CENTER),
+    [TM_FLOCK] = ACCEL_KERNELS(TM_FLOCK),
+    [TM_GRAVITY] = ACCEL_KERNELS(TM_GRAVITY)
+};
+
+/**
+ * Aggregate stage job: reduces one chunk into its partial slots,
+ * one per swarm the chunk overlaps.
+ * Centroid and mean velocity hold plain sums until merged.
+ * @param begin First particle of the chunk.
+ * @param end One past the last particle of the chunk.
+ * @param chunk Chunk index selecting the partial slots.
+ * @param userData Unused.
+ */
+static void swarmStatsJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(userData);
+
+    for (int s = 0; s < MAX_SWARMS; ++s) {
+        SwarmStats *st = &g_swarmPartials[chunk][s];
+        int first = glm_imax(begin, g_ranges[s].first);
+        int last = glm_imin(end, g_ranges[s].first + g_ranges[s].count);
+
+        st->count = glm_imax(last - first, 0);
+        if (st->count == 0) {
+            continue;
+        }
+
+        glm_vec3_zero(st->centroid);
+        glm_vec3_zero(st->meanVelocity);
+        glm_vec3_copy(g_particles.pos[first], st->bboxMin);
+        glm_vec3_copy(g_particles.pos[first], st->bboxMax);
+
+        for (int i = first; i < last; ++i) {
+            glm_vec3_add(st->centroid, g_particles.pos[i], st->centroid);
+            glm_vec3_add(st->meanVelocity, g_particles.velocity[i], st->meanVelocity);
+            glm_vec3_minv(st->bboxMin, g_particles.pos[i], st->bboxMin);
+            glm_vec3_maxv(st->bboxMax, g_particles.pos[i], st->bboxMax);
+        }
+    }
+}
+
+/**
+ * Aggregate stage task: merges the partials of swarmStatsJob into the
+ * reductions of every swarm (centroid, bounding box, mean velocity).
+ * Also snapshots the leaders so the integrate stage never reads
+ * positions being written.
+ * @param userData Input state containing the leader indices.
+ */
+static void reduceSwarmStatsTask(void *userData) {
+    InputData *data = userData;
+    int numChunks = jobs_chunkCount(g_particles.size, PARTICLES_PER_CHUNK);
+
+    for (int s = 0; s < MAX_SWARMS; ++s) {
+        SwarmStats *st = &g_swarm[s];
+        glm_vec3_zero(st->centroid);
+        glm_vec3_zero(st->meanVelocity);
+        glm_vec3_zero(st->bboxMin);
+        glm_vec3_zero(st->bboxMax);
+        glm_vec3_zero(st->leaderPos);
+        st->count = 0;
+
+        for (int c = 0; c < numChunks; ++c) {
+            SwarmStats *part = &g_swarmPartials[c][s];
+            if (part->count == 0) {
+                continue;
+            }
+
+            if (st->count == 0) {
+                glm_vec3_copy(part->bboxMin, st->bboxMin);
+                glm_vec3_copy(part->bboxMax, st->bboxMax);
+            }
+            glm_vec3_add(st->centroid, part->centroid, st->centroid);
+            glm_vec3_add(st->meanVelocity, part->meanVelocity, st->meanVelocity);
+            glm_vec3_minv(st->bboxMin, part->bboxMin, st->bboxMin);
+            glm_vec3_maxv(st->bboxMax, part->bboxMax, st->bboxMax);
+            st->count += part->count;
+        }
+
+        if (st->count == 0) {
+            continue;
+        }
+
+        float invCount = 1.0f / st->count;
+        glm_vec3_scale(st->centroid, invCount, st->centroid);
+        glm_vec3_scale(st->meanVelocity, invCount, st->meanVelocity);
+
+        int leaderIdx = data->particles.swarms[s].leaderIdx;
+        if (leaderIdx >= 0 && leaderIdx < g_particles.size) {
+            glm_vec3_copy(g_particles.pos[leaderIdx], st->leaderPos);
+        }
+    }
+}
+
+/**
+ * Updates particle's local coordinate basis based on velocity and acceleration.
+ * Maintains temporal continuity to prevent sudden flips.
+ * @param i Index of the particle to update basis for.
+ */
+static void updateBasis(int i) {
+    utils_updateBasis(g_particles.velocity[i], g_particles.acceleration[i],
+                      g_particles.forward[i], g_particles.up[i], g_particles.right[i]);
+}
+
+/**
+ * Pack stage job: blends the positions of one chunk between the last
+ * two steps.
+ * @param begin First particle of the chunk.
+ * @param end One past the last particle of the chunk.
+ * @param chunk Unused.
+ * @param userData Pointer to the blend factor.
+ */
+static void interpolateJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    float alpha = *(float*) userData;
+    for (int i = begin; i < end; ++i) {
+        glm_vec3_lerp(g_particles.prevPos[i], g_particles.pos[i], alpha, g_particles.renderPos[i]);
+    }
+}
+
+/**
+ * Uploads the instance columns of the particle store to the GPU.
+ * The columns are passed directly, no intermediate copies are made,
+ * only interpolated positions are packed on the job pool first.
+ * @param interpolate Upload positions blended between the last two steps.
+ * @param alpha Blend factor from the previous (0) to the current (1) step.
+ */
+static void updateParticleInstances(bool interpolate, float alpha) {
+    vec3 *pos = g_particles.pos;
+    if (interpolate) {
+        jobs_parallelFor(g_particles.size, PARTICLES_PER_CHUNK, interpolateJob, &alpha);
+        pos = g_particles.renderPos;
+    }
+
+    instanced_update(
+        g_particles.size, pos, g_particles.acceleration,
+        g_particles.up, g_particles.forward, g_particles.swarm
+    );
+}
+
+/**
+ * Steers a particle away from the obstacles once it gets closer than the margin.
+ * The push grows linearly towards the surface and keeps growing inside an obstacle.
+ * @param data Input state containing simulation parameters.
+ * @param i Index of the particle.
+ */
+static void addObstacleAvoidance(InputData *data, int i) {
+    vec3 gradient;
+    float dist = sdf_sample(&g_sdf, g_particles.pos[i], gradient);
+    float margin = SDF_AVOID_MARGIN * g_sdf.halfSize;
+    if (dist >= margin) {
+        return;
+    }
+
+    glm_vec3_normalize(gradient);
+    float push = data->physics.obstacleForce * (margin - dist) / margin;
+    glm_vec3_muladds(gradient, push, g_particles.acceleration[i]);
+}
+
+/**
+ * Integrates the particles [begin, end) of one swarm.
+ * Accelerations and the basis are computed per particle, the integrate
+ * and collision chain runs in the selected (SIMD) kernel.
+ * @param data Input state containing simulation parameters.
+ * @param swarm Swarm of all particles in the range.
+ * @param begin First particle.
+ * @param end One past the last particle.
+ * @param dt Time step of the range.
+ */
+static void integrateSwarm(InputData *data, int swarm, int begin, int end, float dt) {
+    SwarmSettings *settings = &data->particles.swarms[swarm];
+    SwarmStats *stats = &g_swarm[swarm];
+    TargetMode mode = settings->targetMode;
+    int leaderIdx = (mode == TM_LEADER) ? settings->leaderIdx : -1;
+
+    // 1. Acceleration, leader follows spheres in its own pass, others follow the swarm's target mode
+    int field = g_fieldActive;
+    int fast = data->physics.fastMath;
+    AccelKernel kernel = g_accelKernels[mode][field][fast];
+    if (mode == TM_LEADER && (leaderIdx < 0 || leaderIdx >= g_particles.size)) {
+        memset(g_particles.acceleration[begin], 0, (end - begin) * sizeof(vec3));
+    } else if (leaderIdx >= begin && leaderIdx < end) {
+        kernel(data, stats, begin, leaderIdx);
+        g_accelKernels[TM_SPHERES][field][fast](data, stats, leaderIdx, leaderIdx + 1);
+        kernel(data, stats, leaderIdx + 1, end);
+    } else {
+        kernel(data, stats, begin, end);
+    }
+
+    if (g_sdfActive) {
+        for (int i = begin; i < end; ++i) {
+            addObstacleAvoidance(data, i);
+        }
+    }
+
+    // 2. Velocity, fixed speed (kV), room collision and position
+    IntegrateParams params = {
+        .pos = g_particles.pos,
+        .velocity = g_particles.velocity,
+        .acceleration = g_particles.acceleration,
+        .kV = g_particles.kV,
+        .dt = dt,
+        .halfSize = data->rendering.roomSize,
+        .roomForce = data->physics.roomForce,
+        .integrator = data->physics.integrator,
+        .leaderIdx = leaderIdx,
+        .leaderKv = data->particles.leaderKv
+    };
+    integrate_run(data->physics.kernel, &params, begin, end);
+
+    // 3. Orientation basis
+    for (int i = begin; i < end; ++i) {
+        updateBasis(i);
+    }
+}
+
+/**
+ * Classifies a particle for the temporal LOD. A particle is far beyond the
+ * distance or, if enabled, outside the view. Far particles are bucketed by
+ * their index, one bucket in interval is due per step.
+ * @param i Index of the particle.
+ * @param leaderIdx Leader of the particle's swarm, always at full rate.
+ * @return Rate of the particle in this step.
+ */
+static LodRate lodRate(int i, int leaderIdx) {
+    const float *p = g_particles.pos[i];
+    bool far = glm_vec3_distance2(g_lod.eye, (float*) p) > g_lod.distance2;
+    if (!far && g_lod.offscreen) {
+        for (int k = 0; k < 6 && !far; ++k) {
+            far = glm_vec3_dot(g_lod.planes[k], (float*) p) + g_lod.planes[k][3] < -CULL_VIS_RADIUS;
+        }
+    }
+    if (!far || i == leaderIdx) {
+        return LR_FULL;
+    }
+    return (i / TEMPORAL_LOD_BUCKET + g_lod.step) % g_lod.interval == 0 ? LR_SCALED : LR_SKIP;
+}
+
+/**
+ * Integrates the particles [begin, end) of one swarm under the temporal LOD.
+ * Runs of equal rate go to integrateSwarm together, skipped runs keep their
+ * state, so spatially sorted particles (reorder steps) keep long SIMD runs.
+ * @param data Input state containing simulation parameters.
+ * @param swarm Swarm of all particles in the range.
+ * @param begin First particle.
+ * @param end One past the last particle.
+ * @return Number of particles not stepped at full rate.
+ */
+static int integrateSwarmLod(InputData *data, int swarm, int begin, int end) {
+    float dt = data->physics.fixedDt;
+    if (!g_lod.active) {
+        integrateSwarm(data, swarm, begin, end, dt);
+        return 0;
+    }
+
+    SwarmSettings *settings = &data->particles.swarms[swarm];
+    int leaderIdx = (settings->targetMode == TM_LEADER) ? settings->leaderIdx : -1;
+    float scaledDt = dt * (float) g_lod.interval;
+
+    int reduced = 0;
+    int runBegin = begin;
+    LodRate rate = lodRate(begin, leaderIdx);
+    for (int i = begin + 1; i <= end; ++i) {
+        LodRate next = i < end ? lodRate(i, leaderIdx) : LR_FULL;
+        if (i < end && next == rate) {
+            continue;
+        }
+
+        if (rate != LR_FULL) {
+            reduced += i - runBegin;
+        }
+        if (rate != LR_SKIP) {
+            integrateSwarm(data, swarm, runBegin, i, rate == LR_FULL ? dt : scaledDt);
+        }
+        runBegin = i;
+        rate = next;
+    }
+    return reduced;
+}
+
+/**
+ * Integrate stage job: Euler integration for one chunk of particles.
+ * A chunk may span several swarms, it is split at the swarm boundaries.
+ * @param begin First particle of the chunk.
+ * @param end One past the last particle of the chunk.
+ * @param chunk Unused.
+ * @param userData Input state containing simulation parameters.
+ */
+static void integrateJob(int begin, int end, int chunk, void *userData) {
+    NK_UNUSED(chunk);
+    InputData *data = userData;
+
+    int reduced = 0;
+    for (int s = 0; s < MAX_SWARMS; ++s) {
+        int first = glm_imax(begin, g_ranges[s].first);
+        int last = glm_imin(end, g_ranges[s].first + g_ranges[s].count);
+        if (first < last) {
+            reduced += integrateSwarmLod(data, s, first, last);
+        }
+    }
+    if (reduced > 0) {
+        ATOMIC_ADD(&g_lod.reduced, reduced);
+    }
+}
+
+/**
+ * Copies the view and settings of the temporal LOD for the next step.
+ * Stays inactive without a drawn view, i.e. headless, or at interval 1.
+ * The interval follows the fidelity, capped so the scaled dt stays stable.
+ * @param data Input state containing the temporal LOD settings.
+ */
+static void beginTemporalLod(InputData *data) {
+    g_lod.active = false;
+    g_lod.reduced = 0;
+
+    float fidelity = glm_clamp(data->physics.temporalLod.fidelity, 0.0f, 1.0f);
+    int interval = 1 + (int) roundf((1.0f - fidelity) * (TEMPORAL_LOD_MAX_INTERVAL - 1));
+    float fixedDt = glm_max(data->physics.fixedDt, EPS);
+    interval = glm_imin(interval, glm_imax((int) (physics_getStableDt() / fixedDt), 1));
+    data->physics.temporalLod.interval = interval;
+
+    if (!data->physics.temporalLod.enabled || interval <= 1 || !g_lodView.initialized) {
+        return;
+    }
+
+    MUTEX_LOCK(&g_lodView.mutex);
+    g_lod.active = g_lodView.valid;
+    glm_vec3_copy(g_lodView.eye, g_lod.eye);
+    memcpy(g_lod.planes, g_lodView.planes, sizeof(g_lod.planes));
+    MUTEX_UNLOCK(&g_lodView.mutex);
+
+    g_lod.interval = interval;
+    g_lod.distance2 = data->physics.temporalLod.distance * data->physics.temporalLod.distance;
+    g_lod.offscreen = data->physics.temporalLod.offscreen;
+    ++g_lod.step;
+}
+
+/**
+ * Stores the current camera for the temporal LOD of the next steps.
+ * Call with the view matrix of the scene set.
+ */
+static void captureLodView(void) {
+    mat4 modelview, mvp, inverse;
+    scene_getMV(modelview);
+    scene_getMVP(mvp);
+    glm_mat4_inv(modelview, inverse);
+
+    MUTEX_LOCK(&g_lodView.mutex);
+    glm_frustum_planes(mvp, g_lodView.planes);
+    glm_vec3_copy(inverse[3], g_lodView.eye);
+    g_lodView.valid = true;
+    MUTEX_UNLOCK(&g_lodView.mutex);
+}
+
+/**
+ * Task building the neighbour grid of the flocking swarms.
+ * @param userData Input state containing room size and flock radius.
+ */
+static void buildGridTask(void *userData) {
+    InputData *data = userData;
+    grid_build(
+        &g_grid, g_particles.pos, g_particles.velocity, g_particles.size,
+        data->rendering.roomSize, data->particles.flock.radius
+    );
+}
+
+/**
+ * Task building the octree of one gravity swarm.
+ * @param userData Index of the swarm in g_octreeSwarms.
+ */
+static void buildOctreeTask(void *userData) {
+    int s = *(int *) userData;
+    InputData *data = getInputData();
+    octree_build(&g_octrees[s], g_particles.pos + g_ranges[s].first, g_ranges[s].count, data->rendering.roomSize);
+}
+
+/**
+ * Task building the attractor field of the spheres.
+ * @param userData Input state containing room size and gaussian constant.
+ */
+static void buildFieldTask(void *userData) {
+    InputData *data = userData;
+    vec3 centers[NUM_SPHERES];
+    for (int i = 0; i < NUM_SPHERES; ++i) {
+        glm_vec3_copy(g_spheres[i].currPos, centers[i]);
+    }
+    field_build(&g_field, centers, NUM_SPHERES, data->rendering.roomSize, data->particles.gaussianConst);
+}
+
+/**
+ * Updates all particles using Euler integration on the job pool.
+ * One step is a task graph: the aggregate stage and the grid, octree and field
+ * builds only read the particles and run side by side, the integrate
+ * stage starts once all of them finished. All swarms are stepped by the
+ * same pass, far particles at the rate of the temporal LOD.
+ * @param data Input state containing simulation parameters.
+ */
+static void updateParticles(InputData *data) {
+    TIMELINE_BEGIN("Particle step");
+    PERFCOUNT_BEGIN("Particle step");
+    JobGraph *graph = &g_stepGraph;
+    jobs_graphReset(graph);
+    int deps[3 + MAX_SWARMS];
+    int depCount = 0;
+
+    // Aggregate stage: swarm-wide values are read by every particle
+    int stats = jobs_graphAddParallel(graph, g_particles.size, PARTICLES_PER_CHUNK, swarmStatsJob, NULL);
+    deps[depCount++] = jobs_graphAdd(graph, reduceSwarmStatsTask, data);
+    jobs_graphDepend(graph, deps[0], stats);
+
+    if (input_swarmsUseMode(data, TM_FLOCK)) {
+        deps[depCount++] = jobs_graphAdd(graph, buildGridTask, data);
+    }
+
+    // One tree per gravity swarm, each build is parallel on its own
+    for (int s = 0; s < data->particles.swarmCount; ++s) {
+        if (data->particles.swarms[s].targetMode == TM_GRAVITY) {
+            deps[depCount++] = jobs_graphAdd(graph, buildOctreeTask, &g_octreeSwarms[s]);
+        }
+    }
+
+    // Only worth it if a whole swarm samples it, leaders of TM_LEADER swarms then sample it as well
+    g_fieldActive = data->particles.attractorField && input_swarmsUseMode(data, TM_SPHERES);
+    if (g_fieldActive) {
+        deps[depCount++] = jobs_graphAdd(graph, buildFieldTask, data);
+    }
+
+    g_sdfActive = data->physics.obstacles && sdf_isReady(&g_sdf);
+    beginTemporalLod(data);
+
+    // Integrate stage
+    int integrate = jobs_graphAddParallel(graph, g_particles.size, PARTICLES_PER_CHUNK, integrateJob, data);
+    for (int i = 0; i < depCount; ++i) {
+        jobs_graphDepend(graph, integrate, deps[i]);
+    }
+    jobs_graphRun(graph);
+    data->physics.temporalLod.reduced = (int) g_lod.reduced;
+    PERFCOUNT_END();
+    TIMELINE_END();
+}
+
+/**
+ * Runs one fixed step of the particle update on the GPU.
+ * Falls back to the CPU backend if the compute shaders are unavailable.
+ * @param data Input state containing simulation parameters.
+ * @return False if the step could not be run on the GPU.
+ */
+static bool updateParticlesGpu(InputData *data) {
+    vec3 spheres[NUM_SPHERES];
+    for (int i = 0; i < NUM_SPHERES; ++i) {
+        glm_vec3_copy(g_spheres[i].currPos, spheres[i]);
+    }
+
+    SdfVolume *sdf = (data->physics.obstacles && sdf_isReady(&g_sdf)) ? &g_sdf : NULL;
+    if (!compute_step(data, spheres, NUM_SPHERES, g_manualCenter, sdf)) {
+        printf("GPU integrator unavailable, falling back to CPU!\n");
+        data->physics.backend = PB_CPU;
+        data->particles.extremeScale = false;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Pins the settings the extreme scale mode needs: the GPU backend steps
+ * a single swarm without emitter, everything that would move state to the CPU is off.
+ * @param data Input state.
+ */
+static void syncExtremeScale(InputData *data) {
+    if (!data->particles.extremeScale) {
+        return;
+    }
+
+    data->physics.backend = PB_GPU;
+    data->physics.threaded = false;
+    data->physics.replayMode = RM_OFF;
+    if (data->particles.swarmCount > 1 || data->particles.swarms[0].emitter) {
+        data->particles.swarmCount = 1;
+        data->particles.swarms[0].emitter = false;
+        physics_updateSwarms();
+    }
+}
+
+/**
+ * Smooths the number of particle steps per second of the last frame.
+ * @param data Input state receiving the throughput.
+ * @param steps Fixed steps run in the last frame.
+ */
+static void updateThroughput(InputData *data, int steps) {
+    float rate = data->deltaTime > 0.0f ? (float) steps * g_particles.size / data->deltaTime : 0.0f;
+    data->physics.throughput = glm_lerp(data->physics.throughput, rate, THROUGHPUT_SMOOTHING);
+}
+
+/**
+ * Hands the particle state over if the requested backend changed.
+ * @param data Input state containing the requested backend.
+ */
+static void syncBackend(InputData *data) {
+    if (data->physics.backend == g_activeBackend) {
+        return;
+    }
+
+    if (data->physics.backend == PB_GPU) {
+        updateParticleInstances(false, 1.0f);
+        compute_upload(
+            g_particles.size, g_particles.pos, g_particles.velocity, g_particles.right,
+            g_particles.kWeak, g_particles.kV
+        );
+    } else {
+        compute_download(
+            g_particles.size, g_particles.pos, g_particles.acceleration,
+            g_particles.up, g_particles.forward,
+            g_particles.velocity, g_particles.right
+        );
+        memcpy(g_particles.prevPos, g_particles.pos, g_particles.size * sizeof(vec3));
+    }
+
+    g_activeBackend = data->physics.backend;
+}
+
+/**
+ * Appends the state after a fixed step to the recording.
+ * The GPU backend downloads the full state for every step.
+ */
+static void recordStep(void) {
+    if (g_activeBackend == PB_GPU) {
+        compute_download(
+            g_particles.size, g_particles.pos, g_particles.acceleration,
+            g_particles.up, g_particles.forward,
+            g_particles.velocity, g_particles.right
+        );
+    }
+
+    ParticleRecord *records = ParticleRecordArr_resizeUninit(&g_traceRecords, g_particles.size);
+    for (int i = 0; i < g_particles.size; ++i) {
+        ParticleRecord *r = &records[i];
+        glm_vec3_copy(g_particles.pos[i], r->pos);
+        glm_vec3_copy(g_particles.acceleration[i], r->acceleration);
+        glm_vec3_copy(g_particles.velocity[i], r->velocity);
+        glm_vec3_copy(g_particles.forward[i], r->forward);
+        glm_vec3_copy(g_particles.up[i], r->up);
+        glm_vec3_copy(g_particles.right[i], r->right);
+        r->kWeak = g_particles.kWeak[i];
+        r->kV = g_particles.kV[i];
+        r->swarm = g_particles.swarm[i];
+    }
+
+    TraceGlobals globals;
+    for (int i = 0; i < NUM_SPHERES; ++i) {
+        glm_vec3_copy(g_spheres[i].currPos, globals.spheres[i]);
+    }
+    glm_vec3_copy(g_manualCenter, globals.manualCenter);
+
+    trace_recordFrame(&globals, records, (uint32_t) g_particles.size);
+}
+
+/**
+ * Derives the swarm ranges and the swarm settings' counts from the swarm
+ * column, used when a replay brings its own swarm layout.
+ * Leaders outside of their swarm are replaced.
+ * @param data Input state receiving the counts.
+ */
+static void rangesFromStore(InputData *data) {
+    for (int s = 0; s < MAX_SWARMS; ++s) {
+        g_ranges[s].first = 0;
+        g_ranges[s].count = 0;
+    }
+
+    int swarmCount = 1;
+    for (int i = 0; i < g_particles.size; ++i) {
+        int s = g_particles.swarm[i];
+        if (g_ranges[s].count++ == 0) {
+            g_ranges[s].first = i;
+        }
+        swarmCount = glm_imax(swarmCount, s + 1);
+    }
+
+    data->particles.swarmCount = swarmCount;
+    data->particles.count = g_particles.size;
+    for (int s = 0; s < swarmCount; ++s) {
+        SwarmSettings *settings = &data->particles.swarms[s];
+        SwarmRange *range = &g_ranges[s];
+        settings->count = range->count;
+        range->kvMin = settings->kvMin;
+        range->kvMax = settings->kvMax;
+
+        int leader = settings->leaderIdx;
+        if (leader < range->first || leader >= range->first + range->count) {
+            pickLeader(settings, range);
+        }
+    }
+}
+
+/**
+ * Replaces the integration of a fixed step with the next recorded step.
+ * The replay loops back to the first step at the end.
+ * @param data Input state, the particle and swarm counts follow the trace.
+ */
+static void replayStep(InputData *data) {
+    const void *globals;
+    uint32_t count;
+    // The decoded frame is only read, cglm takes no const vectors
+    ParticleRecord *records = (ParticleRecord*) trace_readFrame(g_replayFrame, &globals, &count);
+    g_replayFrame = (g_replayFrame + 1) % trace_getReplayFrames();
+    if (!records) {
+        return;
+    }
+
+    if ((int) count != g_particles.size) {
+        particleStoreReserve(&g_particles, count);
+        g_particles.size = count;
+        // The main thread resizes the instances from the snapshot
+        if (!g_sim.running) {
+            instanced_resize(count);
+        }
+    }
+
+    for (int i = 0; i < g_particles.size; ++i) {
+        ParticleRecord *r = &records[i];
+        glm_vec3_copy(r->pos, g_particles.pos[i]);
+        glm_vec3_copy(r->acceleration, g_particles.acceleration[i]);
+        glm_vec3_copy(r->velocity, g_particles.velocity[i]);
+        glm_vec3_copy(r->forward, g_particles.forward[i]);
+        glm_vec3_copy(r->up, g_particles.up[i]);
+        glm_vec3_copy(r->right, g_particles.right[i]);
+        g_particles.kWeak[i] = r->kWeak;
+        g_particles.kV[i] = r->kV;
+        g_particles.age[i] = 0.0f;
+        g_particles.swarm[i] = r->swarm;
+    }
+    rangesFromStore(data);
+
+    TraceGlobals *g = (TraceGlobals*) globals;
+    for (int i = 0; i < NUM_SPHERES; ++i) {
+        glm_vec3_copy(g->spheres[i], g_spheres[i].currPos);
+    }
+    glm_vec3_copy(g->manualCenter, g_manualCenter);
+}
+
+/**
+ * Starts or stops recording and replay if the requested trace mode changed.
+ * A replay takes over the fixed dt of the trace and runs on the CPU backend,
+ * a mode that fails to start falls back to RM_OFF.
+ * @param data Input state containing the requested trace mode.
+ */
+static void syncReplayMode(InputData *data) {
+    if (data->physics.replayMode == g_activeReplayMode) {
+        return;
+    }
+
+    if (g_activeReplayMode == RM_RECORD) {
+        trace_endRecord();
+        printf("Recorded %d steps to %s\n", trace_getRecordedFrames(), TRACE_FILE);
+    } else if (g_activeReplayMode == RM_REPLAY) {
+        trace_closeReplay();
+    }
+    g_activeReplayMode = RM_OFF;
+
+    TraceLayout layout = {
+        .kind = TRACE_PARTICLES,
+        .globalsSize = sizeof(TraceGlobals),
+        .recordSize = sizeof(ParticleRecord),
+        .fixedDt = data->physics.fixedDt,
+        .delta = data->physics.traceDelta
+    };
+
+    if (data->physics.replayMode == RM_RECORD && trace_beginRecord(TRACE_FILE, &layout)) {
+        g_activeReplayMode = RM_RECORD;
+    } else if (data->physics.replayMode == RM_REPLAY && trace_openReplay(TRACE_FILE, &layout)) {
+        g_activeReplayMode = RM_REPLAY;
+        g_replayFrame = 0;
+        data->physics.fixedDt = layout.fixedDt;
+    }
+
+    data->physics.replayMode = g_activeReplayMode;
+}
+
+/**
+ * Applies the requested job thread count.
+ * @param data Input state containing the thread count.
+ */
+static void syncJobs(InputData *data) {
+    if (data->physics.threadCount != jobs_getThreadCount()) {
+        jobs_setThreadCount(data->physics.threadCount);
+        data->physics.threadCount = jobs_getThreadCount();
+    }
+}
+
+/**
+ * Puts the particles of every swarm in Morton order of their positions
+ * every reorderInterval steps, so particles close in the room are close in
+ * the columns for the neighbor grid, the kernels and the vertex fetch.
+ * The swarm ranges stay in place, the leaders are remapped.
+ * Skipped while the GPU owns the state, a trace runs or trails are shown,
+ * which all keep particles at fixed indices across steps.
+ * @param data Input state containing the interval and the leaders.
+ */
+static void reorderParticles(InputData *data) {
+    int interval = data->physics.reorderInterval;
+    if (interval <= 0 || ++g_stepsSinceReorder < interval) {
+        return;
+    }
+    g_stepsSinceReorder = 0;
+
+    if (g_activeBackend != PB_CPU || g_activeReplayMode != RM_OFF || data->rendering.trails) {
+        return;
+    }
+
+    TIMELINE_BEGIN("Reorder");
+    PERFCOUNT_BEGIN("Reorder");
+    particleStoreReserve(&g_reorderStore, g_particles.size);
+    float halfSize = data->rendering.roomSize;
+
+    for (int s = 0; s < MAX_SWARMS; ++s) {
+        const SwarmRange *range = &g_ranges[s];
+        if (range->count == 0) {
+            continue;
+        }
+
+        const int *order = morton_sort(&g_morton, g_particles.pos + range->first, range->count, halfSize);
+        particleStoreGather(&g_reorderStore, range->first, &g_particles, range->first, order, range->count);
+
+        int *leaderIdx = &data->particles.swarms[s].leaderIdx;
+        for (int k = 0; k < range->count; ++k) {
+            if (range->first + order[k] == *leaderIdx) {
+                *leaderIdx = range->first + k;
+                break;
+            }
+        }
+    }
+
+    // The render positions are rebuilt from prevPos and pos before they are read
+    ParticleStore sorted = g_reorderStore;
+    sorted.size = g_particles.size;
+    g_reorderStore = g_particles;
+    g_particles = sorted;
+    PERFCOUNT_END();
+    TIMELINE_END();
+}
+
+/**
+ * Removes a particle without leaving a gap. The last particle of its swarm
+ * takes its place and every later swarm moves down by one slot, its last
+ * particle going to the slot freed in front of it. Costs one copy per swarm
+ * and keeps the store and the instances packed. Leaders that move are
+ * remapped, a dying leader leaves leaderIdx at -1.
+ * @param data Input state containing the leaders.
+ * @param swarm Swarm of the particle.
+ * @param i Index of the particle.
+ */
+static void killParticle(InputData *data, int swarm, int i) {
+    SwarmRange *range = &g_ranges[swarm];
+    int *leaderIdx = &data->particles.swarms[swarm].leaderIdx;
+    int last = range->first + range->count - 1;
+
+    if (*leaderIdx == i) {
+        *leaderIdx = -1;
+    } else if (*leaderIdx == last) {
+        *leaderIdx = i;
+    }
+    if (i != last) {
+        particleStoreCopy(&g_particles, i, &g_particles, last, 1);
+    }
+    --range->count;
+
+    int hole = last;
+    for (int s = swarm + 1; s < MAX_SWARMS; ++s) {
+        range = &g_ranges[s];
+        int first = hole;
+        if (range->count > 0) {
+            last = range->first + range->count - 1;
+            particleStoreCopy(&g_particles, hole, &g_particles, last, 1);
+            leaderIdx = &data->particles.swarms[s].leaderIdx;
+            if (*leaderIdx == last) {
+                *leaderIdx = hole;
+            }
+            hole = last;
+        }
+        range->first = first;
+    }
+    --g_particles.size;
+}
+
+/**
+ * Frees the slot after the last particle of a swarm, the mirror of
+ * killParticle: every later swarm moves up by one slot, its first particle
+ * going to the slot after its end. The store needs room for one more particle.
+ * @param data Input state containing the leaders.
+ * @param swarm Swarm receiving the slot.
+ * @return Index of the free slot, counted into the swarm's range.
+ */
+static int insertSlot(InputData *data, int swarm) {
+    assert(g_particles.size < g_particles.capacity && "emitter spawned beyond the reserved capacity");
+
+    int hole = g_particles.size;
+    for (int s = MAX_SWARMS - 1; s > swarm; --s) {
+        SwarmRange *range = &g_ranges[s];
+        if (range->count > 0) {
+            int first = range->first;
+            particleStoreCopy(&g_particles, hole, &g_particles, first, 1);
+            int *leaderIdx = &data->particles.swarms[s].leaderIdx;
+            if (*leaderIdx == first) {
+                *leaderIdx = hole;
+            }
+            hole = first;
+        }
+        range->first = hole + 1;
+    }
+
+    ++g_particles.size;
+    ++g_ranges[swarm].count;
+    return hole;
+}
+
+/**
+ * Checks whether a particle of an emitting swarm dies in this step.
+ * @param data Input state containing the sphere radius and sink switch.
+ * @param settings Settings of the particle's swarm.
+ * @param i Index of the particle.
+ * @return True if the lifetime ran out or the particle is inside a sphere sink.
  */
-static void getTargetAcceleration(Particle *p, vec3 target, vec3 dest) {
-    vec3 diff;
-    glm_vec3_sub(target, p->pos, diff);
-    float dist = glm_vec3_norm(diff);
-
-    // Normalize
-    if (dist > 1e-5f) {
-        glm_vec3_scale(diff, 1.0f / dist, dest);
-    } else {
-        glm_vec3_copy(VEC3X(0), dest);
+static bool particleDies(InputData *data, const SwarmSettings *settings, int i) {
+    if (settings->lifetime > 0.0f && g_particles.age[i] >= settings->lifetime) {
+        return true;
     }
-
-    // Scale by kWeak
-    glm_vec3_scale(dest, p->kWeak, dest);
+    if (data->particles.sphereSinks) {
+        float radius2 = data->physics.sphereRadius * data->physics.sphereRadius;
+        for (int k = 0; k < NUM_SPHERES; ++k) {
+            if (glm_vec3_distance2(g_particles.pos[i], g_spheres[k].currPos) < radius2) {
+                return true;
+            }
+        }
+    }
+    return false;
 }
 
 /**
- * Computes acceleration for a particle based on target mode.
- * @param mode Current target mode.
- * @param data Input state.
- * @param p Particle to compute acceleration for.
- * @param dest Output acceleration vector.
+ * Runs the emitters after a fixed step: ages the particles of emitting
+ * swarms, kills the ones past their lifetime or inside a sphere sink and
+ * spawns the particles due from the rate and the bursts at the emitter.
+ * A swarm never grows beyond its count, which physics_updateSwarms reserved,
+ * so neither spawns nor deaths allocate. Dead leaders are replaced.
+ * Skipped while trails are shown, they keep particles at fixed indices.
+ * @param data Input state containing the swarm settings.
  */
-static void computeAcceleration(TargetMode mode, InputData *data, Particle *p, vec3 dest) {
-    glm_vec3_zero(dest);
-
-    switch (mode) {
-        case TM_SPHERES: {
-            vec3 tempAcc;
-            for (int i = 0; i < NUM_SPHERES; i++) {
-                Sphere *s = &g_spheres[i];
-                getTargetAcceleration(p, s->currPos, tempAcc);
+static void runEmitters(InputData *data) {
+    if (data->rendering.trails) {
+        return;
+    }
 
-                // Gaussian weighting: g = exp(-dist^2 / const)
-                float dist2 = glm_vec3_distance2(s->currPos, p->pos);
-                float g = expf(-dist2 / data->particles.gaussianConst);
+    float dt = data->physics.fixedDt;
+    float roomSize = data->rendering.roomSize;
 
-                glm_vec3_scale(tempAcc, g, tempAcc);
-                glm_vec3_add(tempAcc, dest, dest);
-            }
-            break;
+    for (int s = 0; s < data->particles.swarmCount; ++s) {
+        SwarmSettings *settings = &data->particles.swarms[s];
+        SwarmRange *range = &g_ranges[s];
+        if (!settings->emitter) {
+            continue;
         }
 
-        case TM_LEADER: {
-            // In leader mode, non-leaders follow the leader
-            int leaderIdx = data->particles.leaderIdx;
-            if (leaderIdx >= 0 && leaderIdx < g_particles.size) {
-                getTargetAcceleration(p, g_particles.data[leaderIdx].pos, dest);
+        // The last particle moves into a killed one's slot, so the index is checked again
+        int i = range->first;
+        while (i < range->first + range->count) {
+            g_particles.age[i] += dt;
+            if (particleDies(data, settings, i)) {
+                killParticle(data, s, i);
+            } else {
+                ++i;
             }
-            break;
         }
 
-        case TM_CENTER: {
-            vec3 center = {0, 0, 0};
-            for (int i = 0; i < g_particles.size; ++i) {
-                glm_vec3_add(center, g_particles.data[i].pos, center);
-            }
+        range->spawnCredit += settings->spawnRate * dt;
+        int due = (int) range->spawnCredit;
+        range->spawnCredit -= (float) due;
 
-            glm_vec3_scale(center, 1.0f / g_particles.size, center);
-            getTargetAcceleration(p, center, dest);
-            break;
+        range->burstTimer += dt;
+        if (settings->burstCount > 0 && range->burstTimer >= settings->burstInterval) {
+            range->burstTimer = 0.0f;
+            due += settings->burstCount;
         }
 
-        case TM_BOX_CENTER: {
-            getTargetAcceleration(p, g_manualCenter, dest);
-            break;
+        due = glm_imin(due, settings->count - range->count);
+        for (int k = 0; k < due; ++k) {
+            int slot = insertSlot(data, s);
+            spawnParticle(&g_particles, slot, s, settings, roomSize);
+
+            vec3 offset;
+            RAND_IN_BOX(offset, EMITTER_SPREAD * roomSize);
+            glm_vec3_scale(settings->emitterPos, roomSize, g_particles.pos[slot]);
+            glm_vec3_add(g_particles.pos[slot], offset, g_particles.pos[slot]);
+            glm_vec3_copy(g_particles.pos[slot], g_particles.prevPos[slot]);
         }
 
-        default:
-            break;
+        if (settings->leaderIdx < 0) {
+            pickLeader(settings, range);
+        }
     }
+
+    data->particles.count = g_particles.size;
 }
 
 /**
- * Applies soft collision forces at room boundaries.
- * Uses a margin zone near walls to gradually push particles inward.
- * @param data Input state containing room size and force parameters.
- * @param p Particle to apply collision to.
+ * Runs the fixed steps due after dt and caps the backlog.
+ * @param data Input state containing simulation parameters.
+ * @param dt Elapsed time.
+ * @param interpolate Keep the previous positions for interpolation.
+ * @return Number of steps run.
  */
-static void applyRoomCollision(InputData *data, Particle *p) {
-    float halfSize = data->rendering.roomSize;
-    float margin = 0.05f * halfSize;
-
-    vec3 force = { 0, 0, 0 };
-    float k = data->physics.roomForce;
+static int runFixedSteps(InputData *data, float dt, bool interpolate) {
+    float fixedDt = data->physics.fixedDt;
+    data->physics.dtAccumulator += dt * data->physics.simulationSpeed;
+
+    int steps = 0;
+    while (data->physics.dtAccumulator >= fixedDt && steps < data->physics.maxSteps) {
+        if (interpolate) {
+            memcpy(g_particles.prevPos, g_particles.pos, g_particles.size * sizeof(vec3));
+        }
 
-    // Check X boundaries
-    float dx = p->pos[0];
-    if (dx > halfSize - margin) force[0] = -k * (dx - (halfSize - margin)) / margin;
-    else if (dx < -halfSize + margin) force[0] = -k * (dx + (halfSize - margin)) / margin;
+        if (g_activeReplayMode == RM_REPLAY) {
+            replayStep(data);
+        } else {
+            reorderParticles(data);
+            updateSpheres(data);
+
+            if (g_activeBackend == PB_GPU) {
+                if (!updateParticlesGpu(data)) {
+                    syncBackend(data);
+                    updateParticles(data);
+                }
+            } else {
+                updateParticles(data);
+                runEmitters(data);
+            }
 
-    // Check Y boundaries
-    float dy = p->pos[1];
-    if (dy > halfSize - margin) force[1] = -k * (dy - (halfSize - margin)) / margin;
-    else if (dy < -halfSize + margin) force[1] = -k * (dy + (halfSize - margin)) / margin;
+            if (g_activeReplayMode == RM_RECORD) {
+                recordStep();
+            }
+        }
 
-    // Check Z boundaries
-    float dz = p->pos[2];
-    if (dz > halfSize - margin) force[2] = -k * (dz - (halfSize - margin)) / margin;
-    else if (dz < -halfSize + margin) force[2] = -k * (dz + (halfSize - margin)) / margin;
+        data->physics.dtAccumulator -= fixedDt;
+        ++steps;
+    }
 
-    // Apply force to velocity
-    glm_vec3_scale(force, data->physics.fixedDt, force);
-    glm_vec3_add(force, p->velocity, p->velocity);
+    // Catch-up cap: keep at most one frame budget of backlog, drop the rest
+    float maxBacklog = data->physics.maxSteps * fixedDt;
+    if (data->physics.dtAccumulator > maxBacklog) {
+        data->physics.dtAccumulator = maxBacklog;
+    }
+    metrics_count(METRIC_STEPS, steps);
+    return steps;
 }
 
 /**
- * Updates particle's local coordinate basis based on velocity and acceleration.
- * Maintains temporal continuity to prevent sudden flips.
- * @param p Particle to update basis for.
+ * Grows the columns of a snapshot.
+ * @param s Snapshot to grow.
+ * @param count Required number of particles.
  */
-static void updateBasis(Particle *p) {
-    vec3 upRef = {0, 1, 0};
-
-    // If no velocity we have no forward -> return 
-    if (glm_vec3_norm2(p->velocity) < EPS) {
+static void snapshotReserve(Snapshot *s, int count) {
+    if (s->capacity >= count) {
         return;
     }
 
-    vec3 prevUp;
-    glm_vec3_copy(p->basis.up, prevUp);
+    int capacity = s->capacity ? s->capacity * 2 : START_NUM_PARTICLES;
+    if (capacity < count) capacity = count;
 
-    // velocity -> forward
-    glm_vec3_normalize_to(p->velocity, p->basis.forward);
+    growColumn((void**)&s->pos, capacity, sizeof(vec3));
+    growColumn((void**)&s->prevPos, capacity, sizeof(vec3));
+    growColumn((void**)&s->acceleration, capacity, sizeof(vec3));
+    growColumn((void**)&s->up, capacity, sizeof(vec3));
+    growColumn((void**)&s->forward, capacity, sizeof(vec3));
+    growColumn((void**)&s->swarm, capacity, sizeof(int));
+    s->capacity = capacity;
+}
 
-    vec3 tmpRight;
-    bool valid = false;
+/**
+ * Copies the current state into a snapshot.
+ * @param s Destination.
+ * @param time Wall-clock time of the state.
+ * @param steps Steps since the previous snapshot.
+ */
+static void fillSnapshot(Snapshot *s, double time, int steps) {
+    int count = g_particles.size;
+    snapshotReserve(s, count);
+
+    memcpy(s->pos, g_particles.pos, count * sizeof(vec3));
+    memcpy(s->prevPos, g_particles.prevPos, count * sizeof(vec3));
+    memcpy(s->acceleration, g_particles.acceleration, count * sizeof(vec3));
+    memcpy(s->up, g_particles.up, count * sizeof(vec3));
+    memcpy(s->forward, g_particles.forward, count * sizeof(vec3));
+    memcpy(s->swarm, g_particles.swarm, count * sizeof(int));
+    s->size = count;
 
-    if (glm_vec3_norm2(p->acceleration) >= EPS) {
-        glm_vec3_cross(p->basis.forward, p->acceleration, tmpRight);
-        if (glm_vec3_norm2(tmpRight) >= EPS) {
-            valid = true;
-        }
+    for (int i = 0; i < NUM_SPHERES; ++i) {
+        glm_vec3_copy(g_spheres[i].currPos, s->spheres[i]);
     }
+    glm_vec3_copy(g_manualCenter, s->manualCenter);
+    s->leader = getInputData()->particles.swarms[0].leaderIdx;
+    s->time = time;
+    s->steps = steps;
+}
 
-    // Fallback to previous up or world up
-    if (!valid) {
-        glm_vec3_cross(p->basis.forward, prevUp, tmpRight);
-        if (glm_vec3_norm2(tmpRight) < EPS) {
-            glm_vec3_cross(p->basis.forward, upRef, tmpRight);
-        }
-    }
+/**
+ * Publishes the state after the last step, runs on the simulation thread.
+ * Never blocks, the previous shared snapshot becomes the next back buffer.
+ * @param time Wall-clock time of the state.
+ * @param steps Steps since the previous snapshot.
+ */
+static void publishSnapshot(double time, int steps) {
+    fillSnapshot(&g_sim.snapshots[g_sim.back], time, steps + g_sim.unreadSteps);
 
-    glm_normalize_to(tmpRight, p->basis.right);
+    long prev = ATOMIC_EXCHANGE(&g_sim.shared, g_sim.back | SNAPSHOT_FRESH);
+    g_sim.back = (int) (prev & ~SNAPSHOT_FRESH);
+    g_sim.unreadSteps = (prev & SNAPSHOT_FRESH) ? g_sim.snapshots[g_sim.back].steps : 0;
+}
 
-    // Recompute up
-    glm_vec3_cross(p->basis.right, p->basis.forward, p->basis.up);
-    glm_vec3_normalize(p->basis.up);
+/**
+ * Runs the fixed steps at wall-clock rate until the thread is stopped.
+ */
+static void simLoop(void) {
+    InputData *data = getInputData();
+    double last = glfwGetTime();
+
+    while (!ATOMIC_LOAD(&g_sim.stop)) {
+        double now = glfwGetTime();
+        float dt = data->paused ? 0.0f : (float) (now - last);
+        last = now;
+
+        MUTEX_LOCK(&g_sim.mutex);
+        syncJobs(data);
+        syncReplayMode(data);
+        int steps = runFixedSteps(data, dt, data->physics.interpolate);
+        if (steps > 0) {
+            publishSnapshot(now, steps);
+        }
+        MUTEX_UNLOCK(&g_sim.mutex);
 
-    // Enforce temporal continuity (up can't suddenly flip)
-    // (r, u, f) == (-r, -u, f)
-    if (glm_vec3_dot(p->basis.up, prevUp) < 0.0f) {
-        glm_vec3_scale(p->basis.up, -1.0f, p->basis.up);
-        glm_vec3_scale(p->basis.right, -1.0f, p->basis.right);
+        if (steps == 0) {
+            THREAD_SLEEP_MS(SIM_SLEEP_MS);
+        }
     }
 }
 
 /**
- * Updates instance buffer with current particle data.
- * Copies position, acceleration, and basis vectors to GPU.
+ * Simulation thread entry.
  */
-static void updateParticleInstances(void) {
-    vec3 *pos          = malloc(g_particles.size * sizeof(vec3));
-    vec3 *acceleration = malloc(g_particles.size * sizeof(vec3));
-    vec3 *up           = malloc(g_particles.size * sizeof(vec3));
-    vec3 *forward      = malloc(g_particles.size * sizeof(vec3));
+static THREAD_ENTRY(simMain) {
+    NK_UNUSED(arg);
+    timeline_setThreadName("Simulation");
+    simLoop();
+    THREAD_RETURN;
+}
 
-    for (int i = 0; i < g_particles.size; ++i) {
-        glm_vec3_copy(g_particles.data[i].pos, pos[i]);
-        glm_vec3_copy(g_particles.data[i].acceleration, acceleration[i]);
-        glm_vec3_copy(g_particles.data[i].basis.up, up[i]);
-        glm_vec3_copy(g_particles.data[i].basis.forward, forward[i]);
+/**
+ * Starts the simulation thread. The state moves to the CPU backend,
+ * which is the only one that can run off the GL thread.
+ * @param data Input state.
+ * @return False if the thread could not be created.
+ */
+static bool startSimThread(InputData *data) {
+    data->physics.backend = PB_CPU;
+    syncBackend(data);
+
+    // All snapshots start from the current state, so the first read is valid
+    memcpy(g_particles.prevPos, g_particles.pos, g_particles.size * sizeof(vec3));
+    double now = glfwGetTime();
+    for (int i = 0; i < SNAPSHOT_COUNT; ++i) {
+        fillSnapshot(&g_sim.snapshots[i], now, 0);
+    }
+    g_sim.front = 0;
+    g_sim.shared = 1;
+    g_sim.back = 2;
+    g_sim.unreadSteps = 0;
+    g_sim.stop = 0;
+    g_sim.instanceCount = g_particles.size;
+
+    MUTEX_INIT(&g_sim.mutex);
+    g_sim.running = true;
+    if (!THREAD_CREATE(&g_sim.thread, simMain)) {
+        printf("Could not create the simulation thread, stepping on the render thread!\n");
+        MUTEX_DESTROY(&g_sim.mutex);
+        g_sim.running = false;
     }
+    return g_sim.running;
+}
 
-    instanced_update((int)g_particles.size, pos, acceleration, up, forward);
+/**
+ * Stops the simulation thread, the main thread owns the state again.
+ */
+static void stopSimThread(void) {
+    if (!g_sim.running) {
+        return;
+    }
 
-    free(pos);
-    free(acceleration);
-    free(up);
-    free(forward);
+    ATOMIC_EXCHANGE(&g_sim.stop, 1);
+    THREAD_JOIN(g_sim.thread);
+    MUTEX_DESTROY(&g_sim.mutex);
+    g_sim.running = false;
 }
 
 /**
- * Updates all particles using Euler integration.
- * Handles acceleration, velocity, position updates and collision.
- * @param data Input state containing simulation parameters.
+ * Frees the snapshots and the interpolation buffer.
  */
+static void freeSnapshots(void) {
+    for (int i = 0; i < SNAPSHOT_COUNT; ++i) {
+        Snapshot *s = &g_sim.snapshots[i];
+        bigalloc_free(s->pos);
+        bigalloc_free(s->prevPos);
+        bigalloc_free(s->acceleration);
+        bigalloc_free(s->up);
+        bigalloc_free(s->forward);
+        bigalloc_free(s->swarm);
+        memset(s, 0, sizeof(Snapshot));
+    }
+    bigalloc_free(g_sim.renderPos);
+    g_sim.renderPos = NULL;
+    g_sim.renderCapacity = 0;
+}
 
-static void updateParticles(InputData *data) {
-    float dt = data->physics.fixedDt;
-    float leaderKv = data->particles.leaderKv;
-    bool isLeaderMode = (data->particles.targetMode == TM_LEADER);
-    int leaderIdx = data->particles.leaderIdx;
+/**
+ * Takes the latest snapshot if there is a new one and uploads it.
+ * Lock-free unless paused, the simulation thread is never waited for.
+ * @param data Input state.
+ */
+static void presentSnapshot(InputData *data) {
+    data->physics.stepsLastFrame = 0;
+    if (ATOMIC_LOAD(&g_sim.shared) & SNAPSHOT_FRESH) {
+        long shared = ATOMIC_EXCHANGE(&g_sim.shared, g_sim.front);
+        g_sim.front = (int) (shared & ~SNAPSHOT_FRESH);
+        data->physics.stepsLastFrame = g_sim.snapshots[g_sim.front].steps;
+    } else if (data->paused) {
+        // No steps while paused, copy GUI edits of the state over
+        MUTEX_LOCK(&g_sim.mutex);
+        fillSnapshot(&g_sim.snapshots[g_sim.front], glfwGetTime(), 0);
+        MUTEX_UNLOCK(&g_sim.mutex);
+    }
 
-    for (int i = 0; i < g_particles.size; ++i) {
-        Particle *p = &g_particles.data[i];
-        bool isThisLeader = (isLeaderMode && leaderIdx == i);
+    Snapshot *s = &g_sim.snapshots[g_sim.front];
+    if (s->size != g_sim.instanceCount) {
+        instanced_resize(s->size);
+        g_sim.instanceCount = s->size;
+    }
 
-        // Leader follows spheres, others follow current target mode
-        TargetMode effectiveMode = isThisLeader ? TM_SPHERES : data->particles.targetMode;
+    vec3 *pos = s->pos;
 
-        computeAcceleration(effectiveMode, data, p, p->acceleration);
+    if (data->physics.interpolate) {
+        if (g_sim.renderCapacity < s->size) {
+            growColumn((void**)&g_sim.renderPos, s->size, sizeof(vec3));
+            g_sim.renderCapacity = s->size;
+        }
+
+        float stepTime = data->physics.fixedDt / glm_max(data->physics.simulationSpeed, EPS);
+        float alpha = glm_clamp((float) (glfwGetTime() - s->time) / stepTime, 0.0f, 1.0f);
+        for (int i = 0; i < s->size; ++i) {
+            glm_vec3_lerp(s->prevPos[i], s->pos[i], alpha, g_sim.renderPos[i]);
+        }
+        pos = g_sim.renderPos;
+    }
+
+    instanced_update(s->size, pos, s->acceleration, s->up, s->forward, s->swarm);
+}
+
+/**
+ * Starts or stops the simulation thread if the requested mode changed.
+ * @param data Input state containing the requested mode.
+ */
+static void syncSimThread(InputData *data) {
+    if (data->physics.threaded == g_sim.running) {
+        return;
+    }
+
+    if (data->physics.threaded) {
+        data->physics.threaded = startSimThread(data);
+    } else {
+        stopSimThread();
+    }
+}
 
-        // 1. Update Velocity based on Acceleration (Euler)
-        vec3 deltaA;
-        glm_vec3_scale(p->acceleration, dt, deltaA);
-        glm_vec3_add(p->velocity, deltaA, p->velocity);
+/**
+ * Returns the leader of swarm 0 in the drawn state. While the simulation
+ * thread steps, that is the presented snapshot, whose particles may be in
+ * another order than the live state.
+ * @param data Input state containing the leaders.
+ * @return Index of the leader in the drawn particles.
+ */
+static int presentedLeader(InputData *data) {
+    return g_sim.running ? g_sim.snapshots[g_sim.front].leader : data->particles.swarms[0].leaderIdx;
+}
 
-        // 2. Enforce fixed speed (kV)
-        glm_vec3_normalize(p->velocity);
-        float currentKv = isThisLeader ? leaderKv : p->kV;
-        glm_vec3_scale(p->velocity, currentKv, p->velocity);
+/**
+ * Keeps the GUI off the simulation state while the thread steps.
+ */
+static void lockSim(void) {
+    if (g_sim.running) {
+        MUTEX_LOCK(&g_sim.mutex);
+    }
+}
 
-        // 3. Apply Room Collision
-        applyRoomCollision(data, p);
+/**
+ * Releases the lock taken by lockSim.
+ */
+static void unlockSim(void) {
+    if (g_sim.running) {
+        MUTEX_UNLOCK(&g_sim.mutex);
+    }
+}
 
-        // 4. Update Position
-        vec3 deltaV;
-        glm_vec3_scale(p->velocity, dt, deltaV);
-        glm_vec3_add(p->pos, deltaV, p->pos);
+/**
+ * Appends the drawn positions of this frame to the trails, if they are shown.
+ * @param data Input state containing the trail settings.
+ */
+static void recordTrail(InputData *data) {
+    if (data->rendering.trails) {
+        trail_record(g_particles.size, data->rendering.trailLength);
+    }
+}
 
-        // 5. Update Orientation Basis
-        updateBasis(p);
+/**
+ * Places the obstacle layout in a room of the given size.
+ * @param halfSize Half-extent of the room.
+ */
+static void placeObstacles(float halfSize) {
+    for (int i = 0; i < (int) NK_LEN(g_obstacles); ++i) {
+        g_obstacles[i] = g_obstacleLayout[i];
+        glm_vec3_scale(g_obstacles[i].center, halfSize, g_obstacles[i].center);
+        glm_vec3_scale(g_obstacles[i].extent, halfSize, g_obstacles[i].extent);
     }
 }
 
@@ -370,31 +2076,111 @@ void physics_init(void) {
     }
 
     glm_vec3_zero(g_manualCenter);
-    physics_updateParticleCount(data->particles.count);
+    if (!g_lodView.initialized) {
+        MUTEX_INIT(&g_lodView.mutex);
+        g_lodView.initialized = true;
+    }
+    g_lodView.valid = false;
+    placeObstacles(data->rendering.roomSize);
+    sdf_beginBuild(&g_sdf, g_obstacles, NK_LEN(g_obstacles), data->rendering.roomSize);
+    metrics_count(METRIC_REBUILDS, 1);
+
+    jobs_init(data->physics.threadCount);
+    data->physics.threadCount = jobs_getThreadCount();
+    compute_init();
+    trail_init();
+    physics_updateSwarms();
+    physics_setNewLeader();
 }
 
 void physics_update(void) {
     InputData *data = getInputData();
+    syncExtremeScale(data);
+    syncSimThread(data);
+    if (g_sim.running) {
+        data->physics.backend = PB_CPU;
+        presentSnapshot(data);
+        recordTrail(data);
+        return;
+    }
+
     if (data->paused) {
         return;
     }
 
-    data->physics.dtAccumulator += data->deltaTime * data->physics.simulationSpeed;
+    syncJobs(data);
+    syncReplayMode(data);
 
-    while (data->physics.dtAccumulator >= data->physics.fixedDt) {
-        updateSpheres(data);
-        updateParticles(data);
-        data->physics.dtAccumulator -= data->physics.fixedDt;
+    // The GPU integrator steers a single swarm and runs no emitters
+    if (g_activeReplayMode == RM_REPLAY || data->particles.swarmCount > 1 || input_swarmsEmit(data)) {
+        data->physics.backend = PB_CPU;
     }
 
-    updateParticleInstances();
+    syncBackend(data);
+
+    // The GPU integrator keeps its previous positions itself
+    bool interpolate = data->physics.interpolate && g_activeBackend == PB_CPU;
+
+    int steps = runFixedSteps(data, data->deltaTime, interpolate);
+    data->physics.stepsLastFrame = steps;
+    updateThroughput(data, steps);
+    float alpha = data->physics.interpolate
+        ? glm_clamp(data->physics.dtAccumulator / data->physics.fixedDt, 0.0f, 1.0f)
+        : 1.0f;
+
+    if (g_activeBackend == PB_GPU) {
+        compute_finishSteps(g_particles.size, alpha);
+
+        // Only the leader is needed on the CPU (particle camera), it arrives a frame late
+        // without stalling on the GPU
+        int leader = data->particles.swarms[0].leaderIdx;
+        if (data->cam.mode == CAM_PARTICLE && leader >= 0 && leader < g_particles.size) {
+            compute_readParticle(leader, g_particles.pos[leader], g_particles.up[leader], g_particles.forward[leader]);
+        }
+        if (data->physics.swarmStats) {
+            compute_readSwarmStats(&data->physics.stats);
+        }
+    } else {
+        updateParticleInstances(interpolate, alpha);
+    }
+    recordTrail(data);
 }
 
 void physics_cleanup(void) {
-    ParticleArr_free(&g_particles);
+    stopSimThread();
+    freeSnapshots();
+    getInputData()->physics.threaded = false;
+
+    trace_endRecord();
+    trace_closeReplay();
+    g_activeReplayMode = RM_OFF;
+    ParticleRecordArr_free(&g_traceRecords);
+
+    jobs_cleanup();
+    grid_free(&g_grid);
+    field_free(&g_field);
+    sdf_free(&g_sdf);
+    g_sdfActive = false;
+    trail_cleanup();
+    compute_cleanup();
+    particleStoreFree(&g_particles);
+    particleStoreFree(&g_reorderStore);
+    morton_free(&g_morton);
+    for (int s = 0; s < MAX_SWARMS; ++s) {
+        octree_free(&g_octrees[s]);
+    }
+    g_stepsSinceReorder = 0;
+    memset(g_ranges, 0, sizeof(g_ranges));
+
+    if (g_lodView.initialized) {
+        MUTEX_DESTROY(&g_lodView.mutex);
+        g_lodView.initialized = false;
+        g_lodView.valid = false;
+    }
 }
 
 void physics_toggleWander(void) {
+    lockSim();
     for (int i = 0; i < NUM_SPHERES; ++i) {
         Sphere *s = &g_spheres[i];
 
@@ -405,12 +2191,17 @@ void physics_toggleWander(void) {
         s->waitSec = 0.0f;
         s->waiting = wander;
     }
+    unlockSim();
+}
+
+bool physics_obstaclesReady(void) {
+    return sdf_isReady(&g_sdf);
 }
 
 void physics_setNewLeader(void) {
     InputData *data = getInputData();
-    if (data->particles.count > 0) {
-        data->particles.leaderIdx = (int)(RAND01 * (data->particles.count - 1));
+    for (int s = 0; s < data->particles.swarmCount; ++s) {
+        pickLeader(&data->particles.swarms[s], &g_ranges[s]);
     }
 }
 
@@ -418,24 +2209,29 @@ void physics_moveCenterManual(vec3 delta) {
     InputData *data = getInputData();
     float halfSize = data->rendering.roomSize * 0.9f;
 
+    lockSim();
     glm_vec3_add(g_manualCenter, delta, g_manualCenter);
 
     // Clamp to room bounds
     g_manualCenter[0] = glm_clamp(g_manualCenter[0], -halfSize, halfSize);
     g_manualCenter[1] = glm_clamp(g_manualCenter[1], -halfSize, halfSize);
     g_manualCenter[2] = glm_clamp(g_manualCenter[2], -halfSize, halfSize);
+    unlockSim();
 }
 
 void physics_drawSpheres(void) {
-    debug_pushRenderScope("Spheres");
+    profiler_pushCountedScope("Spheres");
 
     InputData *data = getInputData();
     float radius = data->physics.sphereRadius;
 
+    // The simulation thread moves the spheres, draw the presented state
+    Snapshot *snap = g_sim.running ? &g_sim.snapshots[g_sim.front] : NULL;
+
     for (int i = 0; i < NUM_SPHERES; i++) {
         scene_pushMatrix();
 
-        scene_translateV(g_spheres[i].currPos);
+        scene_translateV(snap ? snap->spheres[i] : g_spheres[i].currPos);
         scene_scaleV(VEC3X(radius));
 
         shader_setColor(g_spheres[i].color);
@@ -444,11 +2240,23 @@ void physics_drawSpheres(void) {
         scene_popMatrix();
     }
 
-    // Draw center sphere if in CENTER mode
-    if (data->particles.targetMode == TM_BOX_CENTER) {
+    shader_setColor(OBSTACLE_COLOR);
+    for (int i = 0; i < (int) NK_LEN(g_obstacles); ++i) {
+        SdfObstacle *o = &g_obstacles[i];
+        scene_pushMatrix();
+
+        scene_translateV(o->center);
+        scene_scaleV(o->shape == SO_SPHERE ? VEC3X(o->extent[0]) : o->extent);
+        model_drawSimple(o->shape == SO_SPHERE ? MODEL_SPHERE : MODEL_CUBE);
+
+        scene_popMatrix();
+    }
+
+    // Draw center sphere if a swarm is in BOX_CENTER mode
+    if (input_swarmsUseMode(data, TM_BOX_CENTER)) {
         scene_pushMatrix();
 
-        scene_translateV(g_manualCenter);
+        scene_translateV(snap ? snap->manualCenter : g_manualCenter);
         scene_scaleV(VEC3X(radius * 0.8f));
 
         shader_setColor(CENTER_SPHERE_COLOR);
@@ -457,92 +2265,275 @@ void physics_drawSpheres(void) {
         scene_popMatrix();
     }
 
-    debug_popRenderScope();
+    profiler_popScope();
 }
 
-void physics_drawParticles(void) {
-    debug_pushRenderScope("Particles");
-    scene_pushMatrix();
-
-    InputData *data = getInputData();
-
-    vec3 scale;
-    ModelType model;
-    bool hardColor;
-    switch (data->particles.sphereVis) {
+/**
+ * Picks the mesh and coloring the particles are drawn with.
+ * Triangles are seen from both sides, face culling is switched off for them.
+ * @param data Input state containing the sphere visualization.
+ * @param scale Destination of the local scale of one instance.
+ * @param hardColor Destination, whether to use the hard two-tone coloring.
+ * @param impostor Destination, whether the spheres are ray-cast point sprites.
+ * @return Model type of the particles.
+ */
+static ModelType particleShape(InputData *data, vec3 scale, bool *hardColor, bool *impostor) {
+    *impostor = false;
+    switch (data->quality.sphereVis) {
+        case SV_IMPOSTOR:
+            *impostor = true;
+            // Shadows and culling keep using the sphere meshes
+            // fall through
         case SV_SPHERE:
-            model = MODEL_SPHERE;
             glm_vec3_copy(VEC3X(0.1f), scale);
-            hardColor = false;
-            break;
+            *hardColor = false;
+            return MODEL_SPHERE;
         case SV_TRIANGLE:
-            glDisable(GL_CULL_FACE);
-            model = MODEL_TRIANGLE;
+            glstate_setEnabled(GL_CULL_FACE, false);
             glm_vec3_copy(VEC3(0.1f, 0.05f, 1.0f), scale);
-            hardColor = true;
-            break;
+            *hardColor = true;
+            return MODEL_TRIANGLE;
         case SV_LINE:
         default:
-            model = MODEL_LINE;
             glm_vec3_copy(VEC3(0.2f, 0.2f, 1.0f), scale);
-            hardColor = false;
-            break;
+            *hardColor = false;
+            return MODEL_LINE;
+    }
+}
+
+void physics_drawParticles(void) {
+    profiler_pushCountedScope("Particles");
+    InputData *data = getInputData();
+    if (data->physics.temporalLod.enabled && g_lodView.initialized) {
+        captureLodView();
+    }
+    scene_pushMatrix();
+
+    vec3 scale;
+    bool hardColor, impostor;
+    ModelType model = particleShape(data, scale, &hardColor, &impostor);
+
+    // Translucent particles are drawn after the opaque scene, only their shadows and vectors are drawn here
+    bool translucent = data->rendering.translucent;
+
+    // Only the leader of swarm 0 is highlighted, the one the particle camera follows
+    SwarmSettings *first = &data->particles.swarms[0];
+    int leaderIdx = (first->targetMode == TM_LEADER) ? presentedLeader(data) : -1;
+    float groundHeight = -data->rendering.roomSize;
+    int lodCount = (model == MODEL_SPHERE && data->quality.sphereLod) ? MODEL_SPHERE_LODS : 1;
+    bool culled = false;
+
+    if (data->rendering.gpuCulling || lodCount > 1) {
+        float radius = glm_vec3_max(scale);
+        if (data->quality.visVectors) {
+            radius = glm_max(radius, CULL_VIS_RADIUS);
+        }
+        culled = instanced_beginCull(leaderIdx, radius, lodCount);
+    }
+
+    // Without the pre-pass everything is drawn as LOD 0,
+    // with it the leader is instance 0 of LOD 0
+    if (!culled) {
+        lodCount = 1;
+    } else if (leaderIdx >= 0) {
+        leaderIdx = 0;
     }
 
-    int leaderIdx = (data->particles.targetMode == TM_LEADER) ? data->particles.leaderIdx : -1;
+    // Falls back to the per vertex basis if the pre-pass is not available
+    if (data->rendering.instanceRotations) {
+        instanced_buildRotations();
+    }
+
+    // Particles and drop shadows in one draw per LOD if possible
+    bool mergeShadows = data->quality.dropShadows && data->rendering.mergedShadows && !translucent;
+    bool merged = false;
+    for (int lod = 0; lod < lodCount && !translucent; ++lod) {
+        int lodLeader = lod == 0 ? leaderIdx : -1;
+        if (impostor && shader_setParticleImpostorData(scale[0], lodLeader)) {
+            model_drawImpostors(lod);
+            continue;
+        }
+
+        if (mergeShadows && shader_setParticleShadowData(scale, lodLeader, hardColor, groundHeight)) {
+            merged = model_drawWithShadow(model, lod);
+        }
+
+        if (!merged) {
+            shader_setSimpleInstanceData(scale, lodLeader, hardColor);
+            model_drawInstanced(model, lod);
+        }
+    }
 
-    shader_setColor(SPHERE_COLOR);
-    shader_setSimpleInstanceData(scale, leaderIdx, hardColor);
-    model_drawInstanced(model);
+    if (data->quality.visVectors) {
+        // Falls back to the geometry shader if the line shader did not build
+        bool lines = data->particles.vectorLines;
+        if (!shader_setParticleVisData(scale, lines)) {
+            lines = false;
+            shader_setParticleVisData(scale, lines);
+        }
+        for (int lod = 0; lod < lodCount; ++lod) {
+            model_drawParticleVis(lines, lod);
+        }
+    }
 
-    if (data->particles.visVectors) {
-        shader_setParticleVisData(scale);
-        model_drawParticleVis();
+    if (data->quality.dropShadows && !merged) {
+        for (int lod = 0; lod < lodCount; ++lod) {
+            shader_setDropShadowData(scale, lod == 0 ? leaderIdx : -1, true, groundHeight);
+            model_draw(model, true, lod);
+        }
     }
 
-    if (data->rendering.dropShadows) {
-        float groundHeight = -data->rendering.roomSize;
-        shader_setDropShadowData(scale, leaderIdx, true, groundHeight);
-        model_draw(model, true);
+    instanced_endCull();
+    glstate_setEnabled(GL_CULL_FACE, !data->showWireframe);
+    scene_popMatrix();
+    profiler_popScope();
+}
+
+void physics_drawTranslucentParticles(void) {
+    InputData *data = getInputData();
+    if (!data->rendering.translucent) {
+        return;
     }
 
-    glEnable(GL_CULL_FACE);
+    profiler_pushCountedScope("Translucent Particles");
+    scene_pushMatrix();
+
+    vec3 scale;
+    bool hardColor, impostor;
+    ModelType model = particleShape(data, scale, &hardColor, &impostor);
+
+    // Impostors are drawn as spheres, the cull pass is over so the leader keeps its index
+    SwarmSettings *first = &data->particles.swarms[0];
+    translucent_draw(model, scale, (first->targetMode == TM_LEADER) ? presentedLeader(data) : -1, hardColor);
+
+    glstate_setEnabled(GL_CULL_FACE, !data->showWireframe);
     scene_popMatrix();
-    debug_popRenderScope();
+    profiler_popScope();
+}
+
+void physics_drawTrails(void) {
+    InputData *data = getInputData();
+    if (!data->rendering.trails) {
+        return;
+    }
+
+    profiler_pushCountedScope("Trails");
+    SwarmSettings *first = &data->particles.swarms[0];
+    trail_draw((first->targetMode == TM_LEADER) ? presentedLeader(data) : -1);
+    profiler_popScope();
 }
 
-void physics_updateParticleCount(int count) {
+void physics_updateSwarms(void) {
     InputData *data = getInputData();
     float roomSize = data->rendering.roomSize;
-    ParticleArr_free(&g_particles);
-    ParticleArr_init(&g_particles);
-    ParticleArr_reserve(&g_particles, count);
 
-    for (int i = 0; i < count; ++i) {
-        Particle p = { 0 };
-        RAND_IN_BOX(p.pos, roomSize);
-        RAND_DIR(p.velocity);
+    lockSim();
+
+    // The GPU owns the state, fetch it so existing particles survive
+    if (g_activeBackend == PB_GPU && g_particles.size > 0) {
+        compute_download(
+            g_particles.size, g_particles.pos, g_particles.acceleration,
+            g_particles.up, g_particles.forward,
+            g_particles.velocity, g_particles.right
+        );
+    }
+
+    // Growing spawns new particles, shrinking only drops the tail,
+    // emitters spawn their particles themselves. The counts of emitting
+    // swarms are their capacity, reserved up front.
+    int counts[MAX_SWARMS], kept[MAX_SWARMS], firsts[MAX_SWARMS];
+    int capacity = 0, count = 0;
+    for (int s = 0; s < MAX_SWARMS; ++s) {
+        SwarmSettings *settings = &data->particles.swarms[s];
+        int swarmCount = s < data->particles.swarmCount ? settings->count : 0;
+        capacity += swarmCount;
+        kept[s] = glm_imin(swarmCount, g_ranges[s].count);
+        counts[s] = settings->emitter ? kept[s] : swarmCount;
+        firsts[s] = count;
+        count += counts[s];
+    }
+
+    // Grows in place, only reallocates when the capacity goes up
+    particleStoreReserve(&g_particles, capacity);
+
+    // Swarms after a resized one move. Those moving down go first, front to
+    // back, then those moving up, back to front, so no kept particle is
+    // overwritten before it moved.
+    for (int s = 0; s < MAX_SWARMS; ++s) {
+        if (firsts[s] < g_ranges[s].first) {
+            particleStoreCopy(&g_particles, firsts[s], &g_particles, g_ranges[s].first, kept[s]);
+        }
+    }
+    for (int s = MAX_SWARMS - 1; s >= 0; --s) {
+        if (firsts[s] > g_ranges[s].first) {
+            particleStoreCopy(&g_particles, firsts[s], &g_particles, g_ranges[s].first, kept[s]);
+        }
+    }
+
+    for (int s = 0; s < MAX_SWARMS; ++s) {
+        SwarmSettings *settings = &data->particles.swarms[s];
+        SwarmRange *range = &g_ranges[s];
+        int first = firsts[s];
 
-        p.kWeak = RAND(0.5f, 10.0f);
-        p.kV = RAND(1.0f, 2.0f);
+        for (int i = first + kept[s]; i < first + counts[s]; ++i) {
+            spawnParticle(&g_particles, i, s, settings, roomSize);
+        }
 
-        glm_vec3_copy(GLM_YUP, p.basis.up);
-        glm_vec3_copy(GLM_ZUP, p.basis.forward);
-        glm_vec3_copy(GLM_XUP, p.basis.right);
+        if (settings->kvMin != range->kvMin || settings->kvMax != range->kvMax) {
+            for (int i = first; i < first + kept[s]; ++i) {
+                g_particles.kV[i] = RAND(settings->kvMin, settings->kvMax);
+            }
+        }
 
-        ParticleArr_push(&g_particles, p);
+        // The leader stays the same particle if it was kept
+        int leader = settings->leaderIdx - range->first;
+        range->first = first;
+        range->count = counts[s];
+        range->kvMin = settings->kvMin;
+        range->kvMax = settings->kvMax;
+        if (leader >= 0 && leader < kept[s]) {
+            settings->leaderIdx = first + leader;
+        } else {
+            pickLeader(settings, range);
+        }
     }
 
+    g_particles.size = count;
     data->particles.count = count;
-    physics_setNewLeader();
-    instanced_resize(count);
+
+    // Particles may have moved to other indices
+    trail_reset();
+
+    // The main thread resizes the instances from the snapshot,
+    // growing to the capacity first so emitters never grow the buffers
+    if (!g_sim.running) {
+        instanced_resize(capacity);
+        instanced_resize(count);
+    }
+
+    if (g_activeBackend == PB_GPU) {
+        updateParticleInstances(false, 1.0f);
+        compute_upload(count, g_particles.pos, g_particles.velocity, g_particles.right, g_particles.kWeak, g_particles.kV);
+    }
+    unlockSim();
 }
 
 void physics_getParticleCamera(vec3 outPos, vec3 outDir, vec3 outUp) {
     InputData *data = getInputData();
 
-    if (g_particles.size == 0 || data->particles.leaderIdx < 0 ||
-        data->particles.leaderIdx >= g_particles.size) {
+    // Follow the presented state while the simulation thread steps
+    int size = g_particles.size;
+    vec3 *pos = g_particles.pos, *forward = g_particles.forward, *up = g_particles.up;
+    if (g_sim.running) {
+        Snapshot *snap = &g_sim.snapshots[g_sim.front];
+        size = snap->size;
+        pos = snap->pos;
+        forward = snap->forward;
+        up = snap->up;
+    }
+
+    int leader = presentedLeader(data);
+    if (size == 0 || leader < 0 || leader >= size) {
         // Fallback to default cam
         glm_vec3_copy((vec3){0, 2, 5}, outPos);
         glm_vec3_copy((vec3){0, 0, -1}, outDir);
@@ -550,21 +2541,90 @@ void physics_getParticleCamera(vec3 outPos, vec3 outDir, vec3 outUp) {
         return;
     }
 
-    Particle *leader = &g_particles.data[data->particles.leaderIdx];
     vec3 behind, above;
 
     // Position behind the particle
-    glm_vec3_negate_to(leader->basis.forward, behind);
+    glm_vec3_negate_to(forward[leader], behind);
     glm_vec3_scale(behind, data->cam.behindDistance, behind);
 
     // Position above the particle
-    glm_vec3_scale_as(leader->basis.up, data->cam.aboveDistance, above);
+    glm_vec3_scale_as(up[leader], data->cam.aboveDistance, above);
 
     // Combine above and behind for final cam pos
-    glm_vec3_add(leader->pos, behind, outPos);
+    glm_vec3_add(pos[leader], behind, outPos);
     glm_vec3_add(outPos, above, outPos);
 
     // cam looks in move dir and has particle up vector 
-    glm_vec3_copy(leader->basis.forward, outDir);
-    glm_vec3_copy(leader->basis.up, outUp);
+    glm_vec3_copy(forward[leader], outDir);
+    glm_vec3_copy(up[leader], outUp);
+}
+
+float physics_getStableDt(void) {
+    InputData *data = getInputData();
+    Integrator integrator = g_activeBackend == PB_GPU ? IG_SYMPLECTIC : data->physics.integrator;
+
+    // The room force ramps up to roomForce over the wall margin, unit mass
+    float margin = 0.05f * data->rendering.roomSize;
+    float stiffness = data->physics.roomForce / glm_max(margin, EPS);
+    return g_stabilityFactor[integrator] / sqrtf(glm_max(stiffness, EPS));
+}
+
+int physics_countInvalidParticles(void) {
+    if (g_activeBackend == PB_GPU) {
+        return 0;
+    }
+
+    float limit = getInputData()->rendering.roomSize * (1.0f + PHYSICS_ROOM_SLACK);
+    int count = 0;
+    for (int i = 0; i < g_particles.size; ++i) {
+        bool valid = true;
+        for (int c = 0; c < 3; ++c) {
+            valid &= isfinite(g_particles.pos[i][c]) && isfinite(g_particles.velocity[i][c])
+                && fabsf(g_particles.pos[i][c]) <= limit;
+        }
+        count += !valid;
+    }
+    return count;
+}
+
+void physics_measure(PhysicsMetrics *metrics) {
+    memset(metrics, 0, sizeof(PhysicsMetrics));
+    if (g_activeBackend == PB_GPU || g_particles.size == 0) {
+        return;
+    }
+
+    vec3 center[MAX_SWARMS] = { 0 };
+    int members[MAX_SWARMS] = { 0 };
+    for (int i = 0; i < g_particles.size; ++i) {
+        glm_vec3_add(center[g_particles.swarm[i]], g_particles.pos[i], center[g_particles.swarm[i]]);
+        ++members[g_particles.swarm[i]];
+    }
+    for (int s = 0; s < MAX_SWARMS; ++s) {
+        glm_vec3_scale(center[s], 1.0f / glm_max((float) members[s], 1.0f), center[s]);
+    }
+
+    // Same margin as the room force of integrate.c
+    float roomSize = getInputData()->rendering.roomSize;
+    float inner = 0.95f * roomSize;
+    double distance = 0.0;
+    int inMargin = 0;
+    for (int i = 0; i < g_particles.size; ++i) {
+        float *p = g_particles.pos[i];
+        distance += glm_vec3_distance(p, center[g_particles.swarm[i]]);
+        inMargin += fabsf(p[0]) > inner || fabsf(p[1]) > inner || fabsf(p[2]) > inner;
+    }
+
+    metrics->cohesion = (float) (distance / g_particles.size) / glm_max(roomSize, EPS);
+    metrics->wallFraction = (float) inMargin / g_particles.size;
+}
+
+int physics_getParticleCount(void) {
+    return g_particles.size;
+}
+
+int physics_getTraceFrames(void) {
+    if (g_activeReplayMode == RM_RECORD) {
+        return trace_getRecordedFrames();
+    }
+    return trace_getReplayFrames();
 }
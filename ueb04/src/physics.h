@@ -10,6 +10,17 @@
 
 #include <fhwcg/fhwcg.h>
 
+/** Overshoot past the room wall allowed by physics_countInvalidParticles, relative to the room size */
+#define PHYSICS_ROOM_SLACK 0.1f
+
+/**
+ * Swarm behavior of the current state, compared across parameter sweeps.
+ */
+typedef struct {
+    float cohesion;         // mean distance of the particles to the center of their swarm, relative to the room size
+    float wallFraction;     // share of the particles inside the wall margin, where the room force pushes back
+} PhysicsMetrics;
+
 /**
  * Initializes physics system with two spheres
  */
@@ -36,11 +47,12 @@ void physics_drawSpheres(void);
 void physics_toggleWander(void);
 
 /**
- * Updates the number of particles in the simulation.
- * Reallocates particle arrays and reinitializes positions.
- * @param count New number of particles.
+ * Lays the particle store out for the swarm settings of the input state.
+ * Every swarm keeps the particles it already had (up to its new count),
+ * missing ones are spawned. Particles of a swarm whose kV range changed
+ * get new speeds from the range.
  */
-void physics_updateParticleCount(int count);
+void physics_updateSwarms(void);
 
 /**
  * Renders all particles
@@ -48,7 +60,25 @@ void physics_updateParticleCount(int count);
 void physics_drawParticles(void);
 
 /**
- * Sets a new random leader particle
+ * Renders all particles translucent, if enabled. Tested against the
+ * opaque scene without writing depth, so it is drawn after it.
+ */
+void physics_drawTranslucentParticles(void);
+
+/**
+ * Renders the motion trails of all particles, if enabled.
+ * Blended, so it is drawn after the opaque scene.
+ */
+void physics_drawTrails(void);
+
+/**
+ * Checks if the obstacle distance volume has finished baking.
+ * @return True once particles can steer around the obstacles.
+ */
+bool physics_obstaclesReady(void);
+
+/**
+ * Sets a new random leader particle in every swarm
  */
 void physics_setNewLeader(void);
 
@@ -66,4 +96,41 @@ void physics_moveCenterManual(vec3 delta);
  */
 void physics_getParticleCamera(vec3 outPos, vec3 outDir, vec3 outUp);
 
+/**
+ * Returns the number of simulated particles.
+ * @return Particle count.
+ */
+int physics_getParticleCount(void);
+
+/**
+ * Returns the number of steps of the running recording or replay.
+ * @return Step count, 0 without trace.
+ */
+int physics_getTraceFrames(void);
+
+/**
+ * Estimates the largest stable fixed dt of the selected integrator for the
+ * stiffest penalty spring, the room force. The GPU backend always integrates
+ * with symplectic Euler.
+ * @return Stable dt limit, 0 if the integrator is unstable at any dt.
+ */
+float physics_getStableDt(void);
+
+/**
+ * Counts the particles with a non-finite position or velocity or a position
+ * more than PHYSICS_ROOM_SLACK of the room size outside the room. The room
+ * force only pushes back, so particles may overshoot its wall a little.
+ * Always 0 in a valid state, checked by the benchmark. The particles of the
+ * GPU backend are not read back.
+ * @return Number of invalid particles.
+ */
+int physics_countInvalidParticles(void);
+
+/**
+ * Measures the cohesion and wall contact of the current state. The
+ * particles of the GPU backend are not read back, all metrics are 0.
+ * @param metrics Measured metrics.
+ */
+void physics_measure(PhysicsMetrics *metrics);
+
 #endif // PHYSICS_H
\ No newline at end of file
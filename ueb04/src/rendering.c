@@ -10,6 +10,10 @@
 #include "model.h"
 #include "shader.h"
 #include "physics.h"
+#include "profiler.h"
+#include "glstate.h"
+#include "timeline.h"
+#include "rendbench.h"
 
 #define NEAR_PLANE 0.01f
 #define FAR_PLANE 200.0f
@@ -30,12 +34,14 @@ static RenderingData g_renderingData;
 
 /**
  * Updates the camera view matrix based on current camera mode.
+ * A benchmark playback replaces either mode by its camera path.
  * @param data Input state containing camera configuration.
  */
 static void updateCamera(InputData *data) {
-    if (data->cam.mode == CAM_FREE) {
+    if (data->cam.mode == CAM_FREE || rendbench_isPlaying()) {
         camera_getPosition(data->cam.data, data->cam.pos);
         camera_getFront(data->cam.data, data->cam.dir);
+        rendbench_camera(data->cam.pos, data->cam.dir);
         scene_look(data->cam.pos, data->cam.dir, GLM_YUP);
     } 
     else {
@@ -54,22 +60,89 @@ static void updateCamera(InputData *data) {
 
 
 /**
- * Draws the entire room (floor, ceiling, walls)
+ * Checks if the gloomy room is drawn as floor and skybox.
+ * @param data Input state containing the texture order
+ * @return True if the walls and ceiling come from the skybox
+ */
+static bool useSkybox(InputData *data) {
+    return data->rendering.skybox && !data->rendering.texOrder1;
+}
+
+/**
+ * Draws the entire room (floor, ceiling, walls), only the floor if the
+ * skybox replaces the rest.
  * Uses inside-out culling
  * @param data Input state containing room size and texture order
  */
 static void drawRoom(InputData *data) {
-    debug_pushRenderScope("Room");
     scene_pushMatrix();
 
-    glCullFace(GL_FRONT);
+    glstate_cullFace(GL_FRONT);
     float s = data->rendering.roomSize;
     scene_scale(s, s, s);
-    model_drawTextured(MODEL_CUBE, data->rendering.texOrder1);
-    glCullFace(GL_BACK);
+    if (useSkybox(data)) {
+        model_drawFloor(data->rendering.texOrder1);
+    } else {
+        model_drawTextured(MODEL_CUBE, data->rendering.texOrder1);
+    }
+    glstate_cullFace(GL_BACK);
 
     scene_popMatrix();
-    debug_popRenderScope();
+}
+
+/**
+ * Draws the skybox on the far plane after the opaque scene, so only
+ * pixels nothing else covered run its fragment shader.
+ * @param data Input state containing the texture order
+ */
+static void drawSky(InputData *data) {
+    if (!useSkybox(data)) {
+        return;
+    }
+
+    profiler_pushCountedScope("Skybox");
+    glstate_depthFunc(GL_LEQUAL);
+    glstate_depthMask(false);
+    glstate_cullFace(GL_FRONT);
+    model_drawSkybox();
+    glstate_cullFace(GL_BACK);
+    glstate_depthMask(true);
+    glstate_depthFunc(GL_LESS);
+    profiler_popScope();
+}
+
+/**
+ * Writes the depth of the room without shading it.
+ * @param data Input state containing room size and texture order
+ */
+static void drawRoomDepth(InputData *data) {
+    profiler_pushCountedScope("Room Pre-Pass");
+    glstate_colorMask(false);
+    drawRoom(data);
+    glstate_colorMask(true);
+    profiler_popScope();
+}
+
+/**
+ * Shades the room. After the pre-pass only fragments whose depth is still
+ * the room's pass GL_EQUAL, everything the scene drew in front is rejected
+ * before the fragment shader runs.
+ * @param data Input state containing room size and texture order
+ * @param prepassed Whether drawRoomDepth ran before the scene.
+ */
+static void shadeRoom(InputData *data, bool prepassed) {
+    profiler_pushCountedScope("Room");
+    if (prepassed) {
+        glstate_depthMask(false);
+        glstate_depthFunc(GL_EQUAL);
+    }
+
+    drawRoom(data);
+
+    // glClear respects the depth mask, so it must be restored every frame
+    glstate_depthFunc(GL_LESS);
+    glstate_depthMask(true);
+    profiler_popScope();
 }
 
 ////////////////////////    PUBLIC    ////////////////////////////
@@ -77,38 +150,50 @@ static void drawRoom(InputData *data) {
 void rendering_init(void) {
     memset(&g_renderingData, 0, sizeof(RenderingData));
 
-    glCullFace(GL_BACK);
+    glstate_cullFace(GL_BACK);
     glFrontFace(GL_CCW);
-    glEnable(GL_DEPTH_TEST);
+    glstate_setEnabled(GL_DEPTH_TEST, true);
 
     shader_load();
 }
 
 void rendering_draw(void) {
     InputData *data = getInputData();
+    TIMELINE_BEGIN("Rendering");
 
-    if (data->showWireframe) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        glDisable(GL_CULL_FACE);
-    } else {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glEnable(GL_CULL_FACE);
-    }
-
-    glEnable(GL_DEPTH_TEST);
+    glstate_polygonMode(data->showWireframe ? GL_LINE : GL_FILL);
+    glstate_setEnabled(GL_CULL_FACE, !data->showWireframe);
+    glstate_setEnabled(GL_DEPTH_TEST, true);
 
-    debug_pushRenderScope("Scene");
+    profiler_pushScope("Scene");
     scene_pushMatrix();
 
     updateCamera(data);
-    drawRoom(data);
+
+    // Same program and geometry in both passes, so GL_EQUAL is exact. The
+    // room is shaded after the opaque scene, shadows are not blended.
+    bool prepass = data->rendering.depthPrepass;
+    if (prepass) {
+        drawRoomDepth(data);
+    } else {
+        shadeRoom(data, false);
+    }
+
     physics_drawSpheres();
     physics_drawParticles();
 
+    if (prepass) {
+        shadeRoom(data, true);
+    }
+    drawSky(data);
+    physics_drawTranslucentParticles();
+    physics_drawTrails();
+
     scene_popMatrix();
-    debug_popRenderScope();
+    profiler_popScope();
 
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glstate_polygonMode(GL_FILL);
+    TIMELINE_END();
 }
 
 void rendering_cleanup(void) {
@@ -0,0 +1,171 @@
+/**
+ * @file sdf.c
+ * @brief Implementation of the obstacle distance volume
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "sdf.h"
+#include "utils.h"
+#include "thread.h"
+
+/** A bake in flight, the thread entry takes no argument */
+typedef struct {
+    Thread thread;
+    bool running;
+
+    SdfVolume *target;
+    SdfObstacle obstacles[SDF_MAX_OBSTACLES];
+    int count;
+} SdfBuild;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/** The single bake, volumes are baked once at load time */
+static SdfBuild g_build = { 0 };
+
+/**
+ * Converts a coordinate into continuous node space.
+ * @param v Volume.
+ * @param x Coordinate.
+ * @return Node coordinate in [0, dim - 1].
+ */
+static inline float toNode(const SdfVolume *v, float x) {
+    float n = (x + v->halfSize) / v->nodeSpacing;
+    return CLAMP(n, 0.0f, (float)(v->dim - 1));
+}
+
+/**
+ * Writes the minimum obstacle distance into every node.
+ * @param b Bake to run.
+ */
+static void bake(SdfBuild *b) {
+    SdfVolume *v = b->target;
+    int dim = v->dim;
+
+    for (int z = 0; z < dim; ++z) {
+        for (int y = 0; y < dim; ++y) {
+            for (int x = 0; x < dim; ++x) {
+                vec3 node = {
+                    -v->halfSize + x * v->nodeSpacing,
+                    -v->halfSize + y * v->nodeSpacing,
+                    -v->halfSize + z * v->nodeSpacing
+                };
+
+                // Without obstacles every node is as far away as the room allows
+                float dist = 2.0f * v->halfSize;
+                for (int i = 0; i < b->count; ++i) {
+                    dist = fminf(dist, sdf_obstacleDistance(&b->obstacles[i], node));
+                }
+                v->dist[(z * dim + y) * dim + x] = dist;
+            }
+        }
+    }
+}
+
+/**
+ * Worker thread entry, bakes g_build and publishes the volume.
+ */
+static THREAD_ENTRY(buildMain) {
+    NK_UNUSED(arg);
+    bake(&g_build);
+    ATOMIC_EXCHANGE(&g_build.target->ready, 1);
+    THREAD_RETURN;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void sdf_beginBuild(SdfVolume *v, const SdfObstacle *obstacles, int count, float halfSize) {
+    // A previous bake has to publish its volume first
+    if (g_build.running) {
+        THREAD_JOIN(g_build.thread);
+        g_build.running = false;
+    }
+    assert(count <= SDF_MAX_OBSTACLES && "too many obstacles in sdf_beginBuild");
+
+    int dim = SDF_DIM;
+    if (!v->dist) {
+        v->dist = malloc(dim * dim * dim * sizeof(float));
+        assert(v->dist && "malloc failed in sdf_beginBuild");
+    }
+
+    v->dim = dim;
+    v->halfSize = halfSize;
+    v->nodeSpacing = 2.0f * halfSize / (dim - 1);
+    v->ready = 0;
+
+    g_build.target = v;
+    g_build.count = count;
+    memcpy(g_build.obstacles, obstacles, count * sizeof(SdfObstacle));
+
+    g_build.running = THREAD_CREATE(&g_build.thread, buildMain);
+    if (!g_build.running) {
+        bake(&g_build);
+        v->ready = 1;
+    }
+}
+
+bool sdf_isReady(SdfVolume *v) {
+    return ATOMIC_LOAD(&v->ready) != 0;
+}
+
+float sdf_sample(const SdfVolume *v, const vec3 pos, vec3 gradient) {
+    int dim = v->dim;
+    float n[3] = { toNode(v, pos[0]), toNode(v, pos[1]), toNode(v, pos[2]) };
+
+    // Lower corner of the cell, the last node only as upper corner
+    int c[3];
+    float t[3];
+    for (int a = 0; a < 3; ++a) {
+        c[a] = (int)n[a] < dim - 2 ? (int)n[a] : dim - 2;
+        t[a] = n[a] - c[a];
+    }
+
+    // Distance and the analytic derivative of the trilinear weights
+    float dist = 0.0f;
+    vec3 grad = GLM_VEC3_ZERO_INIT;
+    for (int corner = 0; corner < 8; ++corner) {
+        int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+        float wx = dx ? t[0] : 1.0f - t[0];
+        float wy = dy ? t[1] : 1.0f - t[1];
+        float wz = dz ? t[2] : 1.0f - t[2];
+        float d = v->dist[((c[2] + dz) * dim + c[1] + dy) * dim + c[0] + dx];
+
+        dist += wx * wy * wz * d;
+        grad[0] += (dx ? 1.0f : -1.0f) * wy * wz * d;
+        grad[1] += (dy ? 1.0f : -1.0f) * wx * wz * d;
+        grad[2] += (dz ? 1.0f : -1.0f) * wx * wy * d;
+    }
+
+    if (gradient) {
+        glm_vec3_scale(grad, 1.0f / v->nodeSpacing, gradient);
+    }
+    return dist;
+}
+
+float sdf_obstacleDistance(const SdfObstacle *o, const vec3 pos) {
+    vec3 p;
+    glm_vec3_sub((float*)pos, (float*)o->center, p);
+
+    if (o->shape == SO_SPHERE) {
+        return glm_vec3_norm(p) - o->extent[0];
+    }
+
+    // Box, outside part plus the (negative) inside part
+    vec3 q;
+    glm_vec3_abs(p, q);
+    glm_vec3_sub(q, (float*)o->extent, q);
+    float inside = fminf(glm_vec3_max(q), 0.0f);
+    glm_vec3_maxv(q, GLM_VEC3_ZERO, q);
+    return glm_vec3_norm(q) + inside;
+}
+
+void sdf_free(SdfVolume *v) {
+    if (g_build.running && g_build.target == v) {
+        THREAD_JOIN(g_build.thread);
+        g_build.running = false;
+    }
+
+    free(v->dist);
+    memset(v, 0, sizeof(SdfVolume));
+}
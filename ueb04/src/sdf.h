@@ -0,0 +1,89 @@
+/**
+ * @file sdf.h
+ * @brief Signed distance volume of static obstacles, baked once on a worker thread
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef SDF_H
+#define SDF_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Nodes per axis of the distance volume */
+#define SDF_DIM 64
+
+/** Distance below which particles steer away, fraction of the half-size */
+#define SDF_AVOID_MARGIN 0.1f
+
+/** Maximum number of obstacles baked into one volume */
+#define SDF_MAX_OBSTACLES 8
+
+/** Shape of a static obstacle */
+typedef enum {
+    SO_SPHERE,
+    SO_BOX
+} SdfShape;
+
+/** Analytic obstacle, baked into the volume */
+typedef struct {
+    SdfShape shape;
+    vec3 center;
+    vec3 extent;        // radius in x for SO_SPHERE, half extents for SO_BOX
+} SdfObstacle;
+
+/**
+ * Signed distances to the nearest obstacle sampled at dim^3 nodes
+ * spanning the cube [-halfSize, halfSize]^3, first node at a corner.
+ * Negative inside an obstacle. Only read once ready is set.
+ */
+typedef struct {
+    int dim;
+    float halfSize;
+    float nodeSpacing;
+
+    float *dist;        // dim^3 entries, x fastest
+    volatile long ready;
+} SdfVolume;
+
+/**
+ * Starts baking the volume on a worker thread and returns immediately.
+ * Bakes synchronously if no thread can be created.
+ * @param v Volume to bake, waits for a previous bake first.
+ * @param obstacles Obstacles, copied.
+ * @param count Number of obstacles, at most SDF_MAX_OBSTACLES.
+ * @param halfSize Half-extent of the room.
+ */
+void sdf_beginBuild(SdfVolume *v, const SdfObstacle *obstacles, int count, float halfSize);
+
+/**
+ * Checks without blocking if the bake has finished.
+ * @param v Volume.
+ * @return True if the volume can be sampled.
+ */
+bool sdf_isReady(SdfVolume *v);
+
+/**
+ * Samples distance and gradient trilinearly, positions outside are clamped to the room.
+ * @param v Baked volume.
+ * @param pos Position to sample.
+ * @param gradient Destination for the distance gradient, may be NULL.
+ * @return Signed distance to the nearest obstacle.
+ */
+float sdf_sample(const SdfVolume *v, const vec3 pos, vec3 gradient);
+
+/**
+ * Exact signed distance of a single obstacle.
+ * @param o Obstacle.
+ * @param pos Position.
+ * @return Signed distance, negative inside.
+ */
+float sdf_obstacleDistance(const SdfObstacle *o, const vec3 pos);
+
+/**
+ * Waits for a running bake and frees all volume memory.
+ * @param v Volume to free.
+ */
+void sdf_free(SdfVolume *v);
+
+#endif // SDF_H
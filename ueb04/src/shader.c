@@ -8,6 +8,26 @@
  * - model (lighting and materials),
  * - normal (normal vector visualization with geometry shader).
  *
+ * The programs are listed in a table together with the files they were
+ * built from, including the shared utils.glsl. The watcher compares the
+ * file timestamps and rebuilds only the programs that depend on an
+ * edited file.
+ *
+ * Programs with variant flags are built once per key, the draw selects
+ * the program of its key instead of setting a uniform bool.
+ *
+ * Nothing is compiled at startup. A variant is built the first time a
+ * draw or dispatch asks for it, so programs of features that are switched
+ * off, like the vector visualization or the GPU backend, never cost
+ * startup time. The prewarm list builds the variants likely to be toggled
+ * later one per frame after the first, before a toggle hitches on them.
+ *
+ * Stages packed into the resource archive are compiled from it, their
+ * dependencies and timestamps come from the archive as well, so a build
+ * opens no file. A reload, by hand or by the watcher after an edit,
+ * invalidates the archived shaders, every later build reads the files.
+ * The programs are built on the GL directly (glprogram.h), not by fhwcg.
+ *
  * @authors Nikolaos Tsetsas, Noah Schmidt
  */
 
@@ -16,14 +36,58 @@
 #include "shader.h"
 #include "rendering.h"
 #include "model.h"
+#include "instanced.h"
+#include "glstate.h"
+#include "timeline.h"
+#include "shadervariant.h"
+#include "metrics.h"
+#include "gpuprim.h"
+#include "resarchive.h"
+
+#include <sys/stat.h>
+#include <time.h>
 
 #define NORMAL_COLOR ((vec3) {1, 0, 0})
 #define NORMAL_LENGTH 0.1f
 
+/** Directory of the shader sources */
+#define SHADER_DIR RESOURCE_PATH "shader/"
+
+/** Upper bound of stages per program */
+#define MAX_STAGES 3
+
+/** Upper bound of files a program depends on, stages and includes */
+#define MAX_DEPENDENCIES 8
+
+/** Upper bound of a shader file path */
+#define MAX_PATH_LENGTH 256
+
+/** Seconds between two checks of the shader file timestamps */
+#define WATCH_INTERVAL 0.5f
+
+/** Variant key of the instanced draws, defines DRAW_INSTANCED */
+#define VARIANT_INSTANCED 1
+
+/** Variant key of the weighted blended translucent draw, defines DRAW_OIT */
+#define VARIANT_OIT 1
+
+/** Texture units of the translucency composite */
+#define OIT_ACCUM_UNIT 0
+#define OIT_REVEALAGE_UNIT 1
+
+/** Frames drawn before prewarming starts, the first frame stays lean */
+#define PREWARM_DELAY 1
+
 ////////////////////////    LOCAL    ////////////////////////////
 
 // Shaders & Material struct
-static Shader *pVecsShader, *simpleShader, *dropShadowShader, *textureShader;
+static GlProgram *pVecsShader, *particleShadowShader, *textureShader;
+static GlProgram *simpleShaders[2], *dropShadowShaders[2];
+static GlProgram *particleLinesShader, *skyboxShader;
+static GlProgram *swarmReduceShader, *particleIntegrateShader, *particleBlendShader, *particleCullShader;
+static GlProgram *particleBasisShader, *particleImpostorShader, *particleTrailShader;
+static GlProgram *upscaleShader, *guiCompositeShader;
+static GlProgram *particleDepthShader, *particleTranslucentShaders[2], *oitCompositeShader;
 struct Material;
 
 /**
@@ -31,119 +95,801 @@ struct Material;
  *
  * @param s Pointer to shader pointer to clean up
  */
-static void cleanup(Shader *s) {
+static void cleanup(GlProgram *s) {
     if (s) {
-        shader_deleteShader(&s);
-        s = NULL;
+        // The address may be reused by the next shader
+        glstate_invalidate();
+        glprogram_delete(&s);
+    }
+}
+
+/**
+ * Index of a program in the table.
+ */
+typedef enum {
+    PROGRAM_SIMPLE,
+    PROGRAM_DROP_SHADOW,
+    PROGRAM_PARTICLE_SHADOW,
+    PROGRAM_PARTICLE_VECS,
+    PROGRAM_PARTICLE_LINES,
+    PROGRAM_TEXTURE,
+    PROGRAM_SKYBOX,
+    PROGRAM_SWARM_REDUCE,
+    PROGRAM_PARTICLE_INTEGRATE,
+    PROGRAM_PARTICLE_BLEND,
+    PROGRAM_PARTICLE_CULL,
+    PROGRAM_PARTICLE_BASIS,
+    PROGRAM_PARTICLE_IMPOSTOR,
+    PROGRAM_PARTICLE_TRAIL,
+    PROGRAM_UPSCALE,
+    PROGRAM_GUI_COMPOSITE,
+    PROGRAM_PARTICLE_DEPTH,
+    PROGRAM_PARTICLE_TRANSLUCENT,
+    PROGRAM_OIT_COMPOSITE,
+    PROGRAM_COUNT
+} ProgramId;
+
+/**
+ * Stage of a program table entry.
+ */
+typedef struct {
+    GLenum type;
+    const char *file;
+} ShaderStage;
+
+/**
+ * A program with its stages and the files it was built from.
+ * The dependencies are the stage files and everything they include.
+ * With flags, shader points to one program per variant key.
+ * A variant is built on its first use, attempted has a bit per key that
+ * was built once, successful or not.
+ */
+typedef struct {
+    const char *name;
+    GlProgram **shader;
+    ShaderStage stages[MAX_STAGES];
+    const char *flags[SHADERVARIANT_MAX_FLAGS];
+
+    char deps[MAX_DEPENDENCIES][MAX_PATH_LENGTH];
+    time_t mtimes[MAX_DEPENDENCIES];
+    int depCount;
+    unsigned attempted;
+} ProgramEntry;
+
+/**
+ * All programs, indexed by their id.
+ */
+static ProgramEntry g_programs[] = {
+    [PROGRAM_SIMPLE] = { "simple", simpleShaders, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "simple/simple.vert" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "simple/simple.frag" } },
+        { "DRAW_INSTANCED" } },
+    [PROGRAM_DROP_SHADOW] = { "drop shadow", dropShadowShaders, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "dropShadow/dropShadow.vert" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "dropShadow/dropShadow.frag" } },
+        { "DRAW_INSTANCED" } },
+    [PROGRAM_PARTICLE_SHADOW] = { "particle shadow", &particleShadowShader, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "particleShadow/particleShadow.vert" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "particleShadow/particleShadow.frag" } } },
+    [PROGRAM_PARTICLE_VECS] = { "Particle Vectors", &pVecsShader, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "particleVecs/particleVecs.vert" },
+        { GL_GEOMETRY_SHADER, SHADER_DIR "particleVecs/particleVecs.geom" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "particleVecs/particleVecs.frag" } } },
+    [PROGRAM_PARTICLE_LINES] = { "particle lines", &particleLinesShader, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "particleLines/particleLines.vert" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "particleLines/particleLines.frag" } } },
+    [PROGRAM_TEXTURE] = { "texture", &textureShader, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "textured/textured.vert" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "textured/textured.frag" } } },
+    [PROGRAM_SKYBOX] = { "skybox", &skyboxShader, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "skybox/skybox.vert" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "skybox/skybox.frag" } } },
+    [PROGRAM_SWARM_REDUCE] = { "swarm reduce", &swarmReduceShader, {
+        { GL_COMPUTE_SHADER,  SHADER_DIR "swarmReduce/swarmReduce.comp" } } },
+    [PROGRAM_PARTICLE_INTEGRATE] = { "particle integrate", &particleIntegrateShader, {
+        { GL_COMPUTE_SHADER,  SHADER_DIR "particleIntegrate/particleIntegrate.comp" } } },
+    [PROGRAM_PARTICLE_BLEND] = { "particle blend", &particleBlendShader, {
+        { GL_COMPUTE_SHADER,  SHADER_DIR "particleBlend/particleBlend.comp" } } },
+    [PROGRAM_PARTICLE_CULL] = { "particle cull", &particleCullShader, {
+        { GL_COMPUTE_SHADER,  SHADER_DIR "particleCull/particleCull.comp" } } },
+    [PROGRAM_PARTICLE_BASIS] = { "particle basis", &particleBasisShader, {
+        { GL_COMPUTE_SHADER,  SHADER_DIR "particleBasis/particleBasis.comp" } } },
+    [PROGRAM_PARTICLE_IMPOSTOR] = { "particle impostor", &particleImpostorShader, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "particleImpostor/particleImpostor.vert" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "particleImpostor/particleImpostor.frag" } } },
+    [PROGRAM_PARTICLE_TRAIL] = { "particle trail", &particleTrailShader, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "particleTrail/particleTrail.vert" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "particleTrail/particleTrail.frag" } } },
+    [PROGRAM_UPSCALE] = { "upscale", &upscaleShader, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "upscale/upscale.vert" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "upscale/upscale.frag" } } },
+    [PROGRAM_GUI_COMPOSITE] = { "gui composite", &guiCompositeShader, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "upscale/upscale.vert" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "guiComposite/guiComposite.frag" } } },
+    [PROGRAM_PARTICLE_DEPTH] = { "particle depth", &particleDepthShader, {
+        { GL_COMPUTE_SHADER,  SHADER_DIR "particleDepth/particleDepth.comp" } } },
+    [PROGRAM_PARTICLE_TRANSLUCENT] = { "particle translucent", particleTranslucentShaders, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "particleTranslucent/particleTranslucent.vert" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "particleTranslucent/particleTranslucent.frag" } },
+        { "DRAW_OIT" } },
+    [PROGRAM_OIT_COMPOSITE] = { "oit composite", &oitCompositeShader, {
+        { GL_VERTEX_SHADER,   SHADER_DIR "upscale/upscale.vert" },
+        { GL_FRAGMENT_SHADER, SHADER_DIR "oitComposite/oitComposite.frag" } } }
+};
+
+_Static_assert(sizeof(g_programs) / sizeof(g_programs[0]) == PROGRAM_COUNT, "program table out of sync");
+
+/**
+ * A variant to build ahead of its first use.
+ */
+typedef struct {
+    ProgramId id;
+    int key;
+} PrewarmEntry;
+
+/**
+ * Variants of features that are off or not drawn in the first frame but
+ * may be switched on any time, most likely first.
+ */
+static const PrewarmEntry g_prewarm[] = {
+    { PROGRAM_DROP_SHADOW, 0 },
+    { PROGRAM_DROP_SHADOW, VARIANT_INSTANCED },
+    { PROGRAM_PARTICLE_SHADOW, 0 },
+    { PROGRAM_PARTICLE_IMPOSTOR, 0 },
+    { PROGRAM_TEXTURE, 0 },
+    { PROGRAM_SKYBOX, 0 },
+    { PROGRAM_PARTICLE_TRAIL, 0 },
+    { PROGRAM_PARTICLE_LINES, 0 },
+    { PROGRAM_PARTICLE_VECS, 0 }
+};
+
+/** Seconds since the file timestamps were last checked */
+static float g_watchTimer = 0.0f;
+
+/** Calls of shader_prewarm so far */
+static int g_prewarmFrames = 0;
+
+/** Next entry of the prewarm list */
+static int g_prewarmNext = 0;
+
+/**
+ * Returns the modification time of a file.
+ * @param file Path of the file.
+ * @return The time, 0 if the file does not exist.
+ */
+static time_t fileTime(const char *file) {
+    struct stat st;
+    return stat(file, &st) == 0 ? st.st_mtime : 0;
+}
+
+/**
+ * Adds a file and, recursively, the files it includes to the dependencies.
+ * Include paths are relative to the including file like in stb_include.
+ * @param entry The program entry.
+ * @param file Path of the file.
+ */
+static void addDependency(ProgramEntry *entry, const char *file) {
+    for (int i = 0; i < entry->depCount; ++i) {
+        if (strcmp(entry->deps[i], file) == 0) {
+            return;
+        }
+    }
+    if (entry->depCount >= MAX_DEPENDENCIES) {
+        return;
+    }
+
+    int idx = entry->depCount++;
+    snprintf(entry->deps[idx], MAX_PATH_LENGTH, "%s", file);
+    entry->mtimes[idx] = fileTime(file);
+
+    FILE *f = fopen(file, "r");
+    if (!f) {
+        return;
+    }
+
+    // Directory part of the path, including the last separator
+    const char *slash = strrchr(file, '/');
+    int dirLength = slash ? (int) (slash - file + 1) : 0;
+
+    char line[MAX_PATH_LENGTH];
+    while (fgets(line, sizeof(line), f)) {
+        const char *p = line;
+        while (*p == ' ' || *p == '\t') ++p;
+        if (strncmp(p, "#include", 8) != 0) {
+            continue;
+        }
+
+        const char *open = strchr(p, '"');
+        const char *close = open ? strchr(open + 1, '"') : NULL;
+        if (close) {
+            char path[MAX_PATH_LENGTH];
+            snprintf(path, sizeof(path), "%.*s%.*s", dirLength, file, (int) (close - open - 1), open + 1);
+            addDependency(entry, path);
+        }
+    }
+    fclose(f);
+}
+
+/**
+ * Adds an archived stage and the files it was resolved from to the
+ * dependencies, with their timestamps when the archive was packed.
+ * A file edited since then differs on the next check of the watcher.
+ * @param entry The program entry.
+ * @param file Path of the stage.
+ * @return False if the archive does not hold the stage.
+ */
+static bool addArchivedDependency(ProgramEntry *entry, const char *file) {
+    const ResArchiveEntry *archived = resarchive_find(file);
+    if (!archived || archived->kind != RES_SHADER) {
+        return false;
+    }
+
+    for (int i = -1; i < (int) archived->dependencyCount && entry->depCount < MAX_DEPENDENCIES; ++i) {
+        int64_t mtime = archived->mtime;
+        const char *dep = i < 0 ? file : resarchive_dependency(archived, (uint32_t) i, &mtime);
+
+        bool known = false;
+        for (int j = 0; j < entry->depCount && !known; ++j) {
+            known = strcmp(entry->deps[j], dep) == 0;
+        }
+        if (!known) {
+            int idx = entry->depCount++;
+            snprintf(entry->deps[idx], MAX_PATH_LENGTH, "%s", dep);
+            entry->mtimes[idx] = (time_t) mtime;
+        }
+    }
+    return true;
+}
+
+/**
+ * Collects the dependencies of a program and their current timestamps.
+ * @param entry The program entry.
+ */
+static void scanDependencies(ProgramEntry *entry) {
+    entry->depCount = 0;
+    for (int i = 0; i < MAX_STAGES && entry->stages[i].file; ++i) {
+        if (!addArchivedDependency(entry, entry->stages[i].file)) {
+            addDependency(entry, entry->stages[i].file);
+        }
+    }
+}
+
+/**
+ * Checks if a dependency of a program changed since its last build.
+ * @param entry The program entry.
+ * @return True if a file was modified, created or removed.
+ */
+static bool dependenciesChanged(const ProgramEntry *entry) {
+    for (int i = 0; i < entry->depCount; ++i) {
+        if (fileTime(entry->deps[i]) != entry->mtimes[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns the number of variant keys of a program.
+ * @param entry The program entry.
+ * @return 2^flags, 1 without flags.
+ */
+static int variantCount(const ProgramEntry *entry) {
+    int flags = 0;
+    while (flags < SHADERVARIANT_MAX_FLAGS && entry->flags[flags]) {
+        ++flags;
+    }
+    return 1 << flags;
+}
+
+/**
+ * Builds one variant of a program, it replaces its previous one on success.
+ * A failed build keeps the previous program and is only retried after
+ * the next edit.
+ * @param entry The program entry.
+ * @param key Variant key.
+ */
+static void buildVariant(ProgramEntry *entry, int key) {
+    entry->attempted |= 1u << key;
+
+    GlProgram *program = glprogram_create();
+    for (int i = 0; i < MAX_STAGES && entry->stages[i].file; ++i) {
+        shadervariant_attachFile(program, entry->stages[i].type, entry->stages[i].file, key, entry->flags);
+    }
+
+    char name[MAX_PATH_LENGTH];
+    snprintf(name, sizeof(name), key ? "%s %d" : "%s", entry->name, key);
+    if (!glprogram_link(name, program)) {
+        glprogram_delete(&program);
+        return;
+    }
+
+    cleanup(entry->shader[key]);
+    entry->shader[key] = program;
+}
+
+/**
+ * Builds the variants of a program that were built before again, the
+ * timestamps are taken first so a failed build waits for the next edit.
+ * @param entry The program entry.
+ * @return True if the program had built variants.
+ */
+static bool rebuildProgram(ProgramEntry *entry) {
+    unsigned attempted = entry->attempted;
+    if (!attempted) {
+        return false;
+    }
+
+    // The archive may be older than the edited files
+    resarchive_invalidateKind(RES_SHADER);
+    scanDependencies(entry);
+    for (int key = 0; key < variantCount(entry); ++key) {
+        if (attempted & (1u << key)) {
+            buildVariant(entry, key);
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns a variant of a program, building it on its first use.
+ * @param id The program.
+ * @param key Variant key.
+ * @return The program, NULL if it failed to build.
+ */
+static GlProgram* getProgram(ProgramId id, int key) {
+    ProgramEntry *entry = &g_programs[id];
+    assert(key < variantCount(entry) && "variant key out of range");
+
+    if (!(entry->attempted & (1u << key))) {
+        TIMELINE_BEGIN("Build Shader");
+        if (!entry->attempted) {
+            scanDependencies(entry);
+        }
+        buildVariant(entry, key);
+        TIMELINE_END();
     }
+    return entry->shader[key];
+}
+
+/**
+ * Tells a vertex shader of the instanced draws how up and forward are stored.
+ * @param s Active shader including utils.glsl.
+ */
+static void setPackedInstances(GlProgram *s) {
+    glprogram_setBool(s, "u_packedInstances", instanced_getFormat() == IF_PACKED);
 }
 
 /**
- * Creates and compiles the particle vectors shader.
- * Uses vertex, geometry, and fragment shaders.
- * @return Pointer to the compiled shader.
+ * Tells a vertex shader of the instanced draws if the instance rotations are built.
+ * @param s Active shader including utils.glsl.
  */
-static Shader* createParticleVecsShader(void) {
-    Shader* shader = shader_createShader();
-    shader_attachShaderFile(shader, GL_VERTEX_SHADER,   RESOURCE_PATH "shader/particleVecs/particleVecs.vert");
-    shader_attachShaderFile(shader, GL_GEOMETRY_SHADER, RESOURCE_PATH "shader/particleVecs/particleVecs.geom");
-    shader_attachShaderFile(shader, GL_FRAGMENT_SHADER, RESOURCE_PATH "shader/particleVecs/particleVecs.frag");
+static void setInstanceRotations(GlProgram *s) {
+    glprogram_setBool(s, "u_instanceRotations", instanced_hasRotations());
+}
 
-    shader_buildShader("Particle Vectors", shader);
-    return shader;
+/**
+ * Sets the colors of all swarms, picked per instance by its swarm id.
+ * @param s Active shader with a u_swarmColors[MAX_SWARMS] uniform.
+ */
+static void setSwarmColors(GlProgram *s) {
+    InputData *data = getInputData();
+    vec3 colors[MAX_SWARMS];
+    for (int i = 0; i < MAX_SWARMS; ++i) {
+        glm_vec3_copy(data->particles.swarms[i].color, colors[i]);
+    }
+    glprogram_setVec3N(s, "u_swarmColors", colors, MAX_SWARMS);
 }
 ////////////////////////    PUBLIC    ////////////////////////////
 
 void shader_cleanup(void) {
-    cleanup(pVecsShader);
-    cleanup(simpleShader);
-    cleanup(textureShader);
-    cleanup(dropShadowShader);
+    for (int i = 0; i < PROGRAM_COUNT; ++i) {
+        ProgramEntry *entry = &g_programs[i];
+        for (int key = 0; key < variantCount(entry); ++key) {
+            cleanup(entry->shader[key]);
+            entry->shader[key] = NULL;
+        }
+        entry->attempted = 0;
+    }
+    g_prewarmFrames = 0;
+    g_prewarmNext = 0;
 }
 
 void shader_load(void) {
-    Shader *newShader = NULL;
+    TIMELINE_BEGIN("Load Shaders");
+    for (int i = 0; i < PROGRAM_COUNT; ++i) {
+        rebuildProgram(&g_programs[i]);
+    }
+    gpuprim_reload();
+    TIMELINE_END();
+}
 
-    newShader = shader_createVeFrShader(
-        "simple",
-        RESOURCE_PATH "shader/simple/simple.vert",
-        RESOURCE_PATH "shader/simple/simple.frag"
-    );
-    if (newShader) {
-        cleanup(simpleShader);
-        simpleShader = newShader;
+int shader_reloadChanged(void) {
+    int rebuilt = 0;
+    for (int i = 0; i < PROGRAM_COUNT; ++i) {
+        if (dependenciesChanged(&g_programs[i]) && rebuildProgram(&g_programs[i])) {
+            ++rebuilt;
+        }
     }
+    return rebuilt;
+}
 
-    newShader = shader_createVeFrShader(
-        "drop shadow",
-        RESOURCE_PATH "shader/dropShadow/dropShadow.vert",
-        RESOURCE_PATH "shader/dropShadow/dropShadow.frag"
-    );
-    if (newShader) {
-        cleanup(dropShadowShader);
-        dropShadowShader = newShader;
+void shader_prewarm(bool enabled) {
+    if (!enabled || g_prewarmFrames++ < PREWARM_DELAY) {
+        return;
     }
 
-    newShader = createParticleVecsShader();
-    if (newShader) {
-        cleanup(pVecsShader);
-        pVecsShader = newShader;
+    // Skips variants a draw already built, at most one build per frame
+    while (g_prewarmNext < (int) NK_LEN(g_prewarm)) {
+        const PrewarmEntry *p = &g_prewarm[g_prewarmNext++];
+        if (!(g_programs[p->id].attempted & (1u << p->key))) {
+            getProgram(p->id, p->key);
+            break;
+        }
     }
+}
 
-    newShader = shader_createVeFrShader(
-        "texture",
-        RESOURCE_PATH "shader/textured/textured.vert",
-        RESOURCE_PATH "shader/textured/textured.frag"
-    );
-    if (newShader) {
-        cleanup(textureShader);
-        textureShader = newShader;
+void shader_watch(float dt) {
+    g_watchTimer += dt;
+    if (g_watchTimer < WATCH_INTERVAL) {
+        return;
     }
+
+    g_watchTimer = 0.0f;
+    metrics_count(METRIC_REBUILDS, shader_reloadChanged());
 }
 
 void shader_setColor(vec3 color) {
-    shader_useShader(simpleShader);
-    shader_setVec3(simpleShader, "u_color", (vec3*) color);
+    GlProgram *s = getProgram(PROGRAM_SIMPLE, 0);
+    glstate_useProgram(s);
+    glprogram_setVec3(s, "u_color", (vec3*) color);
 }
 
 void shader_setSimpleMVP(bool drawInstanced) {
-    shader_useShader(simpleShader);
+    GlProgram *s = getProgram(PROGRAM_SIMPLE, drawInstanced ? VARIANT_INSTANCED : 0);
+    glstate_useProgram(s);
 
     mat4 mat;
     scene_getMVP(mat);
-    shader_setMat4(simpleShader, "u_mvpMatrix", &mat);
-    shader_setBool(simpleShader, "u_drawInstanced", drawInstanced);
+    glprogram_setMat4(s, "u_mvpMatrix", &mat);
+    if (drawInstanced) {
+        setPackedInstances(s);
+        setInstanceRotations(s);
+    }
 }
 
 void shader_setSimpleInstanceData(vec3 scale, int leaderIdx, bool hardColor) {
-    shader_useShader(simpleShader);
-    shader_setVec3(simpleShader, "u_localScale", (vec3*) scale);
-    shader_setInt(simpleShader, "u_leaderIdx", leaderIdx);
-    shader_setBool(simpleShader, "u_hardColor", hardColor);
+    GlProgram *s = getProgram(PROGRAM_SIMPLE, VARIANT_INSTANCED);
+    glstate_useProgram(s);
+    glprogram_setVec3(s, "u_localScale", (vec3*) scale);
+    glprogram_setInt(s, "u_leaderIdx", leaderIdx);
+    glprogram_setBool(s, "u_hardColor", hardColor);
+    setSwarmColors(s);
 }
 
-void shader_setParticleVisData(vec3 scale) {
-    shader_useShader(pVecsShader);
-    
-    shader_setVec3(pVecsShader, "u_localScale", (vec3*) scale);
+bool shader_setParticleVisData(vec3 scale, bool lines) {
     mat4 mat;
     scene_getMVP(mat);
-    shader_setMat4(pVecsShader, "u_mvpMatrix", &mat);
+
+    if (lines) {
+        GlProgram *s = getProgram(PROGRAM_PARTICLE_LINES, 0);
+        if (!s) {
+            return false;
+        }
+        glstate_useProgram(s);
+        glprogram_setMat4(s, "u_mvpMatrix", &mat);
+        setPackedInstances(s);
+        return true;
+    }
+
+    GlProgram *s = getProgram(PROGRAM_PARTICLE_VECS, 0);
+    glstate_useProgram(s);
+    
+    glprogram_setVec3(s, "u_localScale", (vec3*) scale);
+    glprogram_setMat4(s, "u_mvpMatrix", &mat);
+    setPackedInstances(s);
+    return true;
+}
+
+bool shader_setParticleImpostorData(float radius, int leaderIdx) {
+    GlProgram *s = getProgram(PROGRAM_PARTICLE_IMPOSTOR, 0);
+    if (!s) {
+        return false;
+    }
+
+    glstate_useProgram(s);
+
+    mat4 mv, proj, invProj;
+    scene_getMV(mv);
+    scene_getP(proj);
+    glm_mat4_inv(proj, invProj);
+    glprogram_setMat4(s, "u_mvMatrix", &mv);
+    glprogram_setMat4(s, "u_projMatrix", &proj);
+    glprogram_setMat4(s, "u_invProjMatrix", &invProj);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    vec4 vp = {(float)viewport[0], (float)viewport[1], (float)viewport[2], (float)viewport[3]};
+    glprogram_setVec4(s, "u_viewport", &vp);
+    glprogram_setFloat(s, "u_viewportHeight", vp[3]);
+
+    glprogram_setFloat(s, "u_radius", radius);
+    glprogram_setInt(s, "u_leaderIdx", leaderIdx);
+    setSwarmColors(s);
+    return true;
 }
 
 void shader_setDropShadowData(vec3 scale, int leaderIdx, bool drawInstanced, float groundHeight) {
-    shader_useShader(dropShadowShader);
+    GlProgram *s = getProgram(PROGRAM_DROP_SHADOW, drawInstanced ? VARIANT_INSTANCED : 0);
+    glstate_useProgram(s);
+    glprogram_setFloat(s, "u_groundHeight", groundHeight);
+
+    mat4 mat;
+    scene_getMVP(mat);
+    glprogram_setMat4(s, "u_mvpMatrix", &mat);
+    if (drawInstanced) {
+        glprogram_setVec3(s, "u_localScale", (vec3*) scale);
+        glprogram_setInt(s, "u_leaderIdx", leaderIdx);
+        setPackedInstances(s);
+        setInstanceRotations(s);
+    }
+}
+
+bool shader_setParticleShadowData(vec3 scale, int leaderIdx, bool hardColor, float groundHeight) {
+    GlProgram *s = getProgram(PROGRAM_PARTICLE_SHADOW, 0);
+    if (!s) {
+        return false;
+    }
+
+    glstate_useProgram(s);
+    glprogram_setVec3(s, "u_localScale", (vec3*) scale);
+    glprogram_setInt(s, "u_leaderIdx", leaderIdx);
+    glprogram_setBool(s, "u_hardColor", hardColor);
+    glprogram_setFloat(s, "u_groundHeight", groundHeight);
+    setSwarmColors(s);
+
+    mat4 mat;
+    scene_getMVP(mat);
+    glprogram_setMat4(s, "u_mvpMatrix", &mat);
+    setPackedInstances(s);
+    setInstanceRotations(s);
+    return true;
+}
+
+void shader_setShadowVertexStart(int start) {
+    GlProgram *s = getProgram(PROGRAM_PARTICLE_SHADOW, 0);
+    glstate_useProgram(s);
+    glprogram_setInt(s, "u_shadowVertexStart", start);
+}
+
+GlProgram* shader_getTextureShader(void) {
+    return getProgram(PROGRAM_TEXTURE, 0);
+}
+
+void shader_setSkyboxData(void) {
+    GlProgram *s = getProgram(PROGRAM_SKYBOX, 0);
+    glstate_useProgram(s);
+
+    // Rotation of the view only, the sky stays at infinity
+    mat4 view, proj, mat;
+    scene_getMV(view);
+    glm_vec3_zero(view[3]);
+    scene_getP(proj);
+    glm_mat4_mul(proj, view, mat);
+    glprogram_setMat4(s, "u_vpMatrix", &mat);
+    glprogram_setInt(s, "u_skybox", 0);
+}
+
+bool shader_setSwarmReduceData(int pass, int count, int numGroups, int leaderIdx) {
+    GlProgram *s = getProgram(PROGRAM_SWARM_REDUCE, 0);
+    if (!s) {
+        return false;
+    }
+
+    glstate_useProgram(s);
+    glprogram_setInt(s, "u_pass", pass);
+    glprogram_setInt(s, "u_count", count);
+    glprogram_setInt(s, "u_numGroups", numGroups);
+    glprogram_setInt(s, "u_leaderIdx", leaderIdx);
+    return true;
+}
+
+bool shader_setParticleIntegrateData(InputData *data, int base, vec3 *spheres, int numSpheres, vec3 manualCenter,
+                                     const SdfVolume *sdf, int sdfUnit) {
+    GlProgram *s = getProgram(PROGRAM_PARTICLE_INTEGRATE, 0);
+    if (!s) {
+        return false;
+    }
+
+    glstate_useProgram(s);
+    glprogram_setInt(s, "u_count", data->particles.count);
+    glprogram_setInt(s, "u_base", base);
+    glprogram_setInt(s, "u_targetMode", data->particles.swarms[0].targetMode);
+    glprogram_setInt(s, "u_leaderIdx", data->particles.swarms[0].leaderIdx);
+    glprogram_setFloat(s, "u_dt", data->physics.fixedDt);
+    glprogram_setFloat(s, "u_leaderKv", data->particles.leaderKv);
+    glprogram_setFloat(s, "u_gaussianConst", data->particles.gaussianConst);
+    glprogram_setFloat(s, "u_roomSize", data->rendering.roomSize);
+    glprogram_setFloat(s, "u_roomForce", data->physics.roomForce);
+    glprogram_setVec3N(s, "u_spheres", spheres, numSpheres);
+    glprogram_setVec3(s, "u_manualCenter", (vec3*) manualCenter);
+    glprogram_setBool(s, "u_writeBasis", !data->particles.extremeScale);
+    glprogram_setBool(s, "u_obstacles", sdf != NULL);
+    if (sdf) {
+        glprogram_setInt(s, "u_sdf", sdfUnit);
+        glprogram_setInt(s, "u_sdfDim", sdf->dim);
+        glprogram_setFloat(s, "u_sdfHalfSize", sdf->halfSize);
+        glprogram_setFloat(s, "u_obstacleMargin", SDF_AVOID_MARGIN * sdf->halfSize);
+        glprogram_setFloat(s, "u_obstacleForce", data->physics.obstacleForce);
+    }
+    return true;
+}
+
+bool shader_setParticleBlendData(int count, int base, float alpha) {
+    GlProgram *s = getProgram(PROGRAM_PARTICLE_BLEND, 0);
+    if (!s) {
+        return false;
+    }
+
+    glstate_useProgram(s);
+    glprogram_setInt(s, "u_count", count);
+    glprogram_setInt(s, "u_base", base);
+    glprogram_setFloat(s, "u_alpha", alpha);
+    return true;
+}
+
+bool shader_setParticleCullData(InputData *data, int count, int base, int leaderIdx, float radius,
+                                int lodCount, int lodStride, int accWords, int basisWords) {
+    GlProgram *s = getProgram(PROGRAM_PARTICLE_CULL, 0);
+    if (!s) {
+        return false;
+    }
+
+    mat4 mvp, mv;
+    vec4 planes[6];
+    scene_getMVP(mvp);
+    glm_frustum_planes(mvp, planes);
+
+    // Camera position in model space
+    scene_getMV(mv);
+    glm_mat4_inv(mv, mv);
+    vec3 cameraPos;
+    glm_vec3_copy(mv[3], cameraPos);
+
+    glstate_useProgram(s);
+    glprogram_setInt(s, "u_count", count);
+    glprogram_setInt(s, "u_base", base);
+    glprogram_setInt(s, "u_leaderIdx", leaderIdx);
+    glprogram_setFloat(s, "u_radius", radius);
+    glprogram_setBool(s, "u_shadows", data->quality.dropShadows);
+    glprogram_setFloat(s, "u_groundHeight", -data->rendering.roomSize);
+    glprogram_setVec4N(s, "u_planes", planes, 6);
+    glprogram_setBool(s, "u_cullFrustum", data->rendering.gpuCulling);
+    glprogram_setVec3(s, "u_cameraPos", (vec3*) cameraPos);
+    glprogram_setInt(s, "u_lodCount", lodCount);
+    glprogram_setInt(s, "u_lodStride", lodStride);
+    glprogram_setFloat(s, "u_lodDistance", data->quality.lodDistance);
+    glprogram_setInt(s, "u_accWords", accWords);
+    glprogram_setInt(s, "u_basisWords", basisWords);
+    return true;
+}
+
+bool shader_setParticleBasisData(int first, int count, int basisWords) {
+    GlProgram *s = getProgram(PROGRAM_PARTICLE_BASIS, 0);
+    if (!s) {
+        return false;
+    }
+
+    glstate_useProgram(s);
+    glprogram_setInt(s, "u_first", first);
+    glprogram_setInt(s, "u_count", count);
+    glprogram_setInt(s, "u_basisWords", basisWords);
+    return true;
+}
 
-    shader_setVec3(dropShadowShader, "u_localScale", (vec3*) scale);
-    shader_setInt(dropShadowShader, "u_leaderIdx", leaderIdx);
-    shader_setFloat(dropShadowShader, "u_groundHeight", groundHeight);
+bool shader_setParticleTrailData(int head, int length, int count, int base, int leaderIdx) {
+    GlProgram *s = getProgram(PROGRAM_PARTICLE_TRAIL, 0);
+    if (!s) {
+        return false;
+    }
+
+    glstate_useProgram(s);
+
+    mat4 mat;
+    scene_getMVP(mat);
+    glprogram_setMat4(s, "u_mvpMatrix", &mat);
+    glprogram_setInt(s, "u_head", head);
+    glprogram_setInt(s, "u_length", length);
+    glprogram_setInt(s, "u_count", count);
+    glprogram_setInt(s, "u_base", base);
+    glprogram_setInt(s, "u_leaderIdx", leaderIdx);
+    setSwarmColors(s);
+    return true;
+}
+
+bool shader_setUpscaleData(GLuint textureId, vec2 uvScale, vec2 texelSize, float sharpness) {
+    GlProgram *s = getProgram(PROGRAM_UPSCALE, 0);
+    if (!s) {
+        return false;
+    }
+
+    glstate_useProgram(s);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glprogram_setInt(s, "u_scene", 0);
+    glprogram_setVec2(s, "u_uvScale", (vec2*) uvScale);
+    glprogram_setVec2(s, "u_texelSize", (vec2*) texelSize);
+    glprogram_setFloat(s, "u_sharpness", sharpness);
+    return true;
+}
+
+bool shader_setGuiComposite(GLuint textureId) {
+    GlProgram *s = getProgram(PROGRAM_GUI_COMPOSITE, 0);
+    if (!s) {
+        return false;
+    }
+
+    glstate_useProgram(s);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glprogram_setInt(s, "u_gui", 0);
+    return true;
+}
+
+bool shader_setParticleDepthData(int count, int base, int keyBits) {
+    GlProgram *s = getProgram(PROGRAM_PARTICLE_DEPTH, 0);
+    if (!s) {
+        return false;
+    }
+
+    mat4 mv, proj;
+    scene_getMV(mv);
+    scene_getP(proj);
+    float farPlane;
+    glm_persp_decomp_far(proj, &farPlane);
+
+    glstate_useProgram(s);
+    glprogram_setInt(s, "u_count", count);
+    glprogram_setInt(s, "u_base", base);
+    glprogram_setMat4(s, "u_mvMatrix", &mv);
+    glprogram_setFloat(s, "u_farPlane", farPlane);
+    glprogram_setInt(s, "u_keyBits", keyBits);
+    return true;
+}
+
+bool shader_setParticleTranslucentData(vec3 scale, int leaderIdx, bool hardColor, float alpha, bool oit) {
+    GlProgram *s = getProgram(PROGRAM_PARTICLE_TRANSLUCENT, oit ? VARIANT_OIT : 0);
+    if (!s) {
+        return false;
+    }
+
+    glstate_useProgram(s);
+    glprogram_setVec3(s, "u_localScale", (vec3*) scale);
+    glprogram_setInt(s, "u_leaderIdx", leaderIdx);
+    glprogram_setBool(s, "u_hardColor", hardColor);
+    glprogram_setFloat(s, "u_alpha", alpha);
+    setSwarmColors(s);
 
     mat4 mat;
     scene_getMVP(mat);
-    shader_setMat4(dropShadowShader, "u_mvpMatrix", &mat);
-    shader_setBool(dropShadowShader, "u_drawInstanced", drawInstanced);
+    glprogram_setMat4(s, "u_mvpMatrix", &mat);
+    setPackedInstances(s);
+    setInstanceRotations(s);
+    return true;
 }
 
-Shader* shader_getTextureShader(void) {
-    return textureShader;
+bool shader_setOitComposite(GLuint accumId, GLuint revealageId) {
+    GlProgram *s = getProgram(PROGRAM_OIT_COMPOSITE, 0);
+    if (!s) {
+        return false;
+    }
+
+    glstate_useProgram(s);
+    glActiveTexture(GL_TEXTURE0 + OIT_ACCUM_UNIT);
+    glBindTexture(GL_TEXTURE_2D, accumId);
+    glActiveTexture(GL_TEXTURE0 + OIT_REVEALAGE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, revealageId);
+    glActiveTexture(GL_TEXTURE0);
+    glprogram_setInt(s, "u_accum", OIT_ACCUM_UNIT);
+    glprogram_setInt(s, "u_revealage", OIT_REVEALAGE_UNIT);
+    return true;
 }
@@ -12,6 +12,9 @@
 #define SHADER_H
 
 #include <fhwcg/fhwcg.h>
+#include "glprogram.h"
+#include "input.h"
+#include "sdf.h"
 
 /**
  * Deletes all shaders and frees GPU memory.
@@ -19,12 +22,33 @@
 void shader_cleanup(void);
 
 /**
- * Loads and compiles all shader programs.
- * Creates simple shader, gradient shader and normal shader.
+ * Compiles the shader programs that were built so far again.
+ * Programs are built on their first use, so at startup this does nothing.
  * If compilation succeeds, replaces existing shaders.
  */
 void shader_load(void);
 
+/**
+ * Rebuilds the programs whose source files or included files changed
+ * since their last build.
+ * @return Number of rebuilt programs.
+ */
+int shader_reloadChanged(void);
+
+/**
+ * Checks the shader file timestamps in a fixed interval and rebuilds
+ * changed programs, call once per frame.
+ * @param dt Seconds since the last call.
+ */
+void shader_watch(float dt);
+
+/**
+ * Builds the next not yet used program of the prewarm list, at most one
+ * per frame and none in the first frame. Call once per frame.
+ * @param enabled False skips prewarming, programs are then only built on first use.
+ */
+void shader_prewarm(bool enabled);
+
 /**
  * Sets the color uniform in the simple shader.
  *
@@ -40,12 +64,13 @@ void shader_setNormals(void);
 
 /**
  * Sets the current Stack MVP-Matrix for the Simple-Shader.
- * @param drawInstanced Whether instanced drawing is enabled.
+ * @param drawInstanced Selects the instanced variant of the shader.
  */
 void shader_setSimpleMVP(bool drawInstanced);
 
 /**
  * Sets instance-specific data for the simple shader.
+ * Instances are colored by their swarm, u_color only applies to non-instanced draws.
  * @param scale Local scale vector for instances.
  * @param leaderIdx Index of the leader particle (-1 if none).
  * @param hardColor If the color should have a noticable seam.
@@ -55,22 +80,173 @@ void shader_setSimpleInstanceData(vec3 scale, int leaderIdx, bool hardColor);
 /**
  * Sets visualization data for particle vectors.
  * @param scale Local scale vector for particle visualization.
+ * @param lines Use the instanced line shader instead of the geometry shader.
+ * @return False if the requested shader is not available.
+ */
+bool shader_setParticleVisData(vec3 scale, bool lines);
+
+/**
+ * Activates the sphere impostor shader and sets its uniforms.
+ * The particles are colored by their swarm.
+ * @param radius Radius of the ray-cast spheres.
+ * @param leaderIdx Index of the leader particle (-1 if none).
+ * @return False if the shader is not available.
  */
-void shader_setParticleVisData(vec3 scale);
+bool shader_setParticleImpostorData(float radius, int leaderIdx);
 
 /**
  * Sets drop shadow rendering parameters.
  * @param scale Local scale vector for instances.
  * @param leaderIdx Index of the leader particle (-1 if none).
- * @param drawInstanced Whether instanced drawing is enabled.
+ * @param drawInstanced Selects the instanced variant of the shader.
  * @param groundHeight Height of the ground plane for shadow projection.
  */
 void shader_setDropShadowData(vec3 scale, int leaderIdx, bool drawInstanced, float groundHeight);
 
+/**
+ * Activates the merged particle and drop shadow shader and sets its uniforms.
+ * The particles are colored by their swarm.
+ * @param scale Local scale vector for instances.
+ * @param leaderIdx Index of the leader particle (-1 if none).
+ * @param hardColor Whether to use the hard two-tone coloring.
+ * @param groundHeight Height of the ground plane for shadow projection.
+ * @return False if the shader is not available.
+ */
+bool shader_setParticleShadowData(vec3 scale, int leaderIdx, bool hardColor, float groundHeight);
+
+/**
+ * Sets the first vertex of the shadow copy in a shadow pair mesh.
+ * @param start Base vertex of the mesh plus the number of vertices of the particle copy.
+ */
+void shader_setShadowVertexStart(int start);
+
 /**
  * Retrieves the Shader for drawing textured models.
  * @return Pointer to the texture shader.
  */
-Shader* shader_getTextureShader(void);
+GlProgram* shader_getTextureShader(void);
+
+/**
+ * Activates the skybox shader and sets its matrix from the current view.
+ * The cubemap is expected on texture unit 0.
+ */
+void shader_setSkyboxData(void);
+
+/**
+ * Activates the swarm reduction compute shader and sets its uniforms.
+ * @param pass 0 for per-group partial sums, 1 for the final reduction.
+ * @param count Number of particles.
+ * @param numGroups Number of partial sums written by pass 0.
+ * @param leaderIdx Index of the leader particle (-1 if none).
+ * @return False if the shader is not available.
+ */
+bool shader_setSwarmReduceData(int pass, int count, int numGroups, int leaderIdx);
+
+/**
+ * Activates the particle integration compute shader and sets its uniforms.
+ * @param data Input state containing simulation parameters.
+ * @param base First instance of the active buffer region.
+ * @param spheres Positions of the wandering spheres.
+ * @param numSpheres Number of spheres.
+ * @param manualCenter Target for TM_BOX_CENTER.
+ * @param sdf Obstacle volume bound to sdfUnit, or NULL without obstacles.
+ * @param sdfUnit Texture unit of the obstacle volume.
+ * @return False if the shader is not available.
+ */
+bool shader_setParticleIntegrateData(InputData *data, int base, vec3 *spheres, int numSpheres, vec3 manualCenter,
+                                     const SdfVolume *sdf, int sdfUnit);
+
+/**
+ * Activates the position blend compute shader and sets its uniforms.
+ * @param count Number of particles.
+ * @param base First instance of the active buffer region.
+ * @param alpha Blend factor from the previous (0) to the current (1) step.
+ * @return False if the shader is not available.
+ */
+bool shader_setParticleBlendData(int count, int base, float alpha);
+
+/**
+ * Activates the particle culling compute shader and sets its uniforms.
+ * The frustum planes and camera position are taken from the current matrices.
+ * @param data Input state containing the culling and LOD settings.
+ * @param count Number of particles.
+ * @param base First instance of the active buffer region.
+ * @param leaderIdx Index of the leader particle kept in slot 0 (-1 if none).
+ * @param radius Bounding radius of one instance.
+ * @param lodCount Number of LOD ranges to bucket into.
+ * @param lodStride Number of slots per LOD range.
+ * @param accWords 32 bit words per instance of the acceleration column.
+ * @param basisWords 32 bit words per instance of the up and forward columns.
+ * @return False if the shader is not available.
+ */
+bool shader_setParticleCullData(InputData *data, int count, int base, int leaderIdx, float radius,
+                                int lodCount, int lodStride, int accWords, int basisWords);
+
+/**
+ * Activates the instance rotation compute shader and sets its uniforms.
+ * @param first First instance slot to build.
+ * @param count Number of slots.
+ * @param basisWords 32 bit words per instance of the up and forward columns.
+ * @return False if the shader is not available.
+ */
+bool shader_setParticleBasisData(int first, int count, int basisWords);
+
+/**
+ * Activates the particle trail shader and sets its uniforms.
+ * @param head Ring slot of the newest positions.
+ * @param length Slots of the ring.
+ * @param count Particles per slot.
+ * @param base First instance of the active buffer region, for the swarm ids.
+ * @param leaderIdx Particle drawn in the leader color (-1 if none).
+ * @return False if the shader is not available.
+ */
+bool shader_setParticleTrailData(int head, int length, int count, int base, int leaderIdx);
+
+/**
+ * Activates the particle depth compute shader and sets its uniforms.
+ * The view and far plane are taken from the current matrices.
+ * @param count Number of particles.
+ * @param base First instance of the active buffer region.
+ * @param keyBits Bits of the quantized depth keys, less than 32.
+ * @return False if the shader is not available.
+ */
+bool shader_setParticleDepthData(int count, int base, int keyBits);
+
+/**
+ * Activates the translucent particle shader and sets its uniforms.
+ * The particles are colored by their swarm.
+ * @param scale Local scale vector for instances.
+ * @param leaderIdx Index of the leader particle (-1 if none).
+ * @param hardColor Whether to use the hard two-tone coloring.
+ * @param alpha Opacity of the particles.
+ * @param oit Selects the weighted blended variant, the sorted one reads the order buffer.
+ * @return False if the shader is not available.
+ */
+bool shader_setParticleTranslucentData(vec3 scale, int leaderIdx, bool hardColor, float alpha, bool oit);
+
+/**
+ * Activates the translucency composite shader and binds its targets.
+ * @param accumId Accumulation target of the weighted blended pass.
+ * @param revealageId Revealage target of the weighted blended pass.
+ * @return False if the shader is not available.
+ */
+bool shader_setOitComposite(GLuint accumId, GLuint revealageId);
+
+/**
+ * Activates the upscale shader and binds the scene target to unit 0.
+ * @param textureId Color texture of the scene target.
+ * @param uvScale Drawn part of the target in uv.
+ * @param texelSize Size of one target texel in uv.
+ * @param sharpness Strength of the sharpening, 0 for plain bilinear.
+ * @return False if the shader is not available.
+ */
+bool shader_setUpscaleData(GLuint textureId, vec2 uvScale, vec2 texelSize, float sharpness);
+
+/**
+ * Activates the GUI composite shader and binds the cached GUI to unit 0.
+ * @param textureId Color texture of the GUI cache.
+ * @return False if the shader is not available.
+ */
+bool shader_setGuiComposite(GLuint textureId);
 
 #endif // SHADER_H
@@ -0,0 +1,860 @@
+/**
+ * @file stream.c
+ * @brief Implementation of the remote viewer
+ *
+ * Slots cycle through free, reading (GPU copy in flight, fenced), ready
+ * (newest finished frame, waiting for the encoder) and encoding. The main
+ * thread owns free and reading slots, the encoder only takes the ready one,
+ * so the mutex only guards the states, the ready index and the client.
+ * Unlike the capture the slots are not handed over in ring order, the ready
+ * slot is simply the last one that finished.
+ *
+ * The network thread owns the sockets. Closing the client waits until the
+ * encoder finished sending to it, a failed send only shuts the socket down,
+ * which the network thread then sees as a disconnect.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+// Winsock has to come before windows.h, which thread.h includes
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#endif
+
+#include "stream.h"
+#include "thread.h"
+#include "timeline.h"
+#include "gpumem.h"
+#include "utils.h"
+
+#ifdef _WIN32
+    typedef SOCKET Socket;
+    #define SOCKET_INVALID INVALID_SOCKET
+    #define SOCKET_CLOSE(s) closesocket(s)
+    #define SOCKET_SHUTDOWN(s) shutdown(s, SD_BOTH)
+#else
+    #include <sys/socket.h>
+    #include <sys/select.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+
+    typedef int Socket;
+    #define SOCKET_INVALID (-1)
+    #define SOCKET_CLOSE(s) close(s)
+    #define SOCKET_SHUTDOWN(s) shutdown(s, SHUT_RDWR)
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/** How long the network thread waits for a socket before checking for stop */
+#define STREAM_POLL_MS 100
+
+/** A send blocked longer than this disconnects the client */
+#define STREAM_SEND_TIMEOUT_MS 1000
+
+/** Input events buffered between two frames, further ones are dropped */
+#define STREAM_MAX_EVENTS 256
+
+/** Bytes of a frame header and of an input event on the wire */
+#define STREAM_HEADER_SIZE 16
+#define STREAM_EVENT_SIZE 16
+
+// GL 4.4 / ARB_buffer_storage is not part of the generated loader
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+/** glBufferStorage function pointer type */
+typedef void (APIENTRYP BufferStorageFn)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+/**
+ * State of a pack buffer slot.
+ */
+typedef enum {
+    SLOT_FREE,
+    SLOT_READING,
+    SLOT_READY,
+    SLOT_ENCODING
+} SlotState;
+
+/**
+ * One pixel pack buffer.
+ */
+typedef struct {
+    SlotState state;
+    GLuint pbo;
+    GLsync fence;
+    unsigned char *mapped;      // persistent mapping or NULL
+    unsigned char *copy;        // CPU copy without persistent mapping
+    const unsigned char *pixels;// what the encoder reads, bottom-up RGBA
+    int width;
+    int height;
+    int frame;                  // readback order
+} Slot;
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Global server state.
+ */
+static struct {
+    bool running;
+    int width;                  // size of the slots, 0 before the first frame
+    int height;
+    size_t frameSize;           // bytes of one RGBA frame
+
+    Slot slots[STREAM_SLOTS];
+    int ready;                  // slot waiting for the encoder, -1 if none
+    int frames;                 // readbacks started
+    int sent;
+    int dropped;                // main thread only
+    int replaced;               // ready slots freed by a newer one, guarded
+    float encodeMs;
+    int lastBytes;
+
+    int quality;                // guarded, read by the encoder per frame
+    bool halfSize;
+
+    unsigned char *rgb;         // encoder scratch, top-down RGB
+    unsigned char *jpeg;        // encoder output
+    size_t jpegSize;
+    size_t jpegCapacity;
+
+    Socket listener;
+    Socket client;              // guarded, written by the network thread only
+    bool sending;               // encoder uses the client socket
+
+    StreamEvent events[STREAM_MAX_EVENTS];
+    int eventCount;
+
+    Thread encoder;
+    Thread network;
+    bool hasEncoder;
+    bool hasNetwork;
+    Mutex mutex;
+    Cond cond;
+    bool stop;
+} g_stream = { .ready = -1, .listener = SOCKET_INVALID, .client = SOCKET_INVALID };
+
+/** glBufferStorage entry point, NULL if not supported by the context */
+static BufferStorageFn g_bufferStorage = NULL;
+
+/**
+ * Writes a 32 bit little-endian integer.
+ * @param dst Destination, 4 bytes.
+ * @param value The value.
+ */
+static void writeLe32(unsigned char *dst, uint32_t value) {
+    dst[0] = (unsigned char) value;
+    dst[1] = (unsigned char) (value >> 8);
+    dst[2] = (unsigned char) (value >> 16);
+    dst[3] = (unsigned char) (value >> 24);
+}
+
+/**
+ * Reads a 32 bit little-endian integer.
+ * @param src Source, 4 bytes.
+ * @return The value.
+ */
+static int32_t readLe32(const unsigned char *src) {
+    return (int32_t) ((uint32_t) src[0] | (uint32_t) src[1] << 8 | (uint32_t) src[2] << 16 | (uint32_t) src[3] << 24);
+}
+
+/**
+ * Converts a bottom-up RGBA frame to top-down RGB, averaging 2x2 blocks
+ * when downsampling.
+ * @param slot Slot with the pixels.
+ * @param half Downsample by two per axis.
+ * @param width Output: width of the converted frame.
+ * @param height Output: height of the converted frame.
+ */
+static void toTopDownRgb(const Slot *slot, bool half, int *width, int *height) {
+    int w = slot->width;
+    int h = slot->height;
+    const unsigned char *src = slot->pixels;
+
+    if (!half || w < 2 || h < 2) {
+        for (int y = 0; y < h; ++y) {
+            const unsigned char *in = src + (size_t) (h - 1 - y) * w * 4;
+            unsigned char *out = g_stream.rgb + (size_t) y * w * 3;
+            for (int x = 0; x < w; ++x) {
+                out[0] = in[0];
+                out[1] = in[1];
+                out[2] = in[2];
+                in += 4;
+                out += 3;
+            }
+        }
+        *width = w;
+        *height = h;
+        return;
+    }
+
+    int hw = w / 2;
+    int hh = h / 2;
+    for (int y = 0; y < hh; ++y) {
+        const unsigned char *in0 = src + (size_t) (h - 1 - 2 * y) * w * 4;
+        const unsigned char *in1 = in0 - (size_t) w * 4;
+        unsigned char *out = g_stream.rgb + (size_t) y * hw * 3;
+        for (int x = 0; x < hw; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                out[c] = (unsigned char) ((in0[c] + in0[4 + c] + in1[c] + in1[4 + c] + 2) >> 2);
+            }
+            in0 += 8;
+            in1 += 8;
+            out += 3;
+        }
+    }
+    *width = hw;
+    *height = hh;
+}
+
+/**
+ * stb write callback, appends to the JPEG buffer.
+ * @param context Unused.
+ * @param data Encoded bytes.
+ * @param size Number of bytes.
+ */
+static void appendJpeg(void *context, void *data, int size) {
+    NK_UNUSED(context);
+    size_t needed = g_stream.jpegSize + (size_t) size;
+    if (needed > g_stream.jpegCapacity) {
+        size_t capacity = needed > g_stream.jpegCapacity * 2 ? needed : g_stream.jpegCapacity * 2;
+        unsigned char *jpeg = realloc(g_stream.jpeg, capacity);
+        assert(jpeg && "realloc failed in appendJpeg");
+        g_stream.jpeg = jpeg;
+        g_stream.jpegCapacity = capacity;
+    }
+    memcpy(g_stream.jpeg + g_stream.jpegSize, data, (size_t) size);
+    g_stream.jpegSize = needed;
+}
+
+/**
+ * Sends a whole buffer, runs on the encoder thread.
+ * @param s Client socket.
+ * @param data Bytes to send.
+ * @param size Number of bytes.
+ * @return False if the client is gone or the send timed out.
+ */
+static bool sendAll(Socket s, const unsigned char *data, size_t size) {
+    while (size > 0) {
+        int chunk = size > (size_t) INT32_MAX ? INT32_MAX : (int) size;
+        int n = (int) send(s, (const char*) data, chunk, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= (size_t) n;
+    }
+    return true;
+}
+
+/**
+ * Encodes one frame and sends it to the client, runs on the encoder thread.
+ * The client is marked as in use while sending so it is not closed meanwhile.
+ * @param slot Slot in the encoding state.
+ * @param quality JPEG quality.
+ * @param half Downsample by two per axis.
+ */
+static void encodeSlot(const Slot *slot, int quality, bool half) {
+    double start = glfwGetTime();
+    int w, h;
+    toTopDownRgb(slot, half, &w, &h);
+
+    g_stream.jpegSize = 0;
+    unsigned char header[STREAM_HEADER_SIZE] = { 0 };
+    appendJpeg(NULL, header, STREAM_HEADER_SIZE);
+    if (!stbi_write_jpg_to_func(appendJpeg, NULL, w, h, 3, g_stream.rgb, quality)) {
+        return;
+    }
+
+    writeLe32(g_stream.jpeg, STREAM_MAGIC);
+    writeLe32(g_stream.jpeg + 4, (uint32_t) (g_stream.jpegSize - STREAM_HEADER_SIZE));
+    writeLe32(g_stream.jpeg + 8, (uint32_t) w);
+    writeLe32(g_stream.jpeg + 12, (uint32_t) h);
+    float encodeMs = (float) ((glfwGetTime() - start) * 1000.0);
+
+    MUTEX_LOCK(&g_stream.mutex);
+    Socket s = g_stream.client;
+    g_stream.sending = s != SOCKET_INVALID;
+    MUTEX_UNLOCK(&g_stream.mutex);
+
+    if (s == SOCKET_INVALID) {
+        return;
+    }
+
+    bool ok = sendAll(s, g_stream.jpeg, g_stream.jpegSize);
+    if (!ok) {
+        SOCKET_SHUTDOWN(s);
+    }
+
+    MUTEX_LOCK(&g_stream.mutex);
+    g_stream.sending = false;
+    if (ok) {
+        ++g_stream.sent;
+        g_stream.encodeMs = encodeMs;
+        g_stream.lastBytes = (int) g_stream.jpegSize;
+    }
+    COND_BROADCAST(&g_stream.cond);
+    MUTEX_UNLOCK(&g_stream.mutex);
+}
+
+/**
+ * Encodes the ready slot whenever there is one until the server stops.
+ */
+static void encoderLoop(void) {
+    MUTEX_LOCK(&g_stream.mutex);
+    while (true) {
+        while (!g_stream.stop && g_stream.ready < 0) {
+            COND_WAIT(&g_stream.cond, &g_stream.mutex);
+        }
+        if (g_stream.stop) {
+            break;
+        }
+
+        Slot *slot = &g_stream.slots[g_stream.ready];
+        slot->state = SLOT_ENCODING;
+        g_stream.ready = -1;
+        int quality = g_stream.quality;
+        bool half = g_stream.halfSize;
+        MUTEX_UNLOCK(&g_stream.mutex);
+
+        TIMELINE_BEGIN("Encode Frame");
+        encodeSlot(slot, quality, half);
+        TIMELINE_END();
+
+        MUTEX_LOCK(&g_stream.mutex);
+        slot->state = SLOT_FREE;
+        COND_BROADCAST(&g_stream.cond);
+    }
+    MUTEX_UNLOCK(&g_stream.mutex);
+}
+
+/**
+ * Encoder thread entry.
+ */
+static THREAD_ENTRY(encoderMain) {
+    NK_UNUSED(arg);
+    timeline_setThreadName("Stream Encoder");
+    encoderLoop();
+    THREAD_RETURN;
+}
+
+/**
+ * Waits until a socket is readable or the poll interval passed.
+ * @param s The socket.
+ * @return True if it is readable.
+ */
+static bool waitReadable(Socket s) {
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(s, &set);
+    struct timeval timeout = { 0, STREAM_POLL_MS * 1000 };
+    return select((int) s + 1, &set, NULL, NULL, &timeout) > 0;
+}
+
+/**
+ * Accepts a waiting client, disables Nagle for it and bounds its sends.
+ */
+static void acceptClient(void) {
+    Socket s = accept(g_stream.listener, NULL, NULL);
+    if (s == SOCKET_INVALID) {
+        return;
+    }
+
+    int noDelay = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*) &noDelay, sizeof(noDelay));
+#ifdef _WIN32
+    DWORD timeout = STREAM_SEND_TIMEOUT_MS;
+#else
+    struct timeval timeout = { STREAM_SEND_TIMEOUT_MS / 1000, (STREAM_SEND_TIMEOUT_MS % 1000) * 1000 };
+#endif
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*) &timeout, sizeof(timeout));
+
+    MUTEX_LOCK(&g_stream.mutex);
+    g_stream.client = s;
+    g_stream.eventCount = 0;
+    MUTEX_UNLOCK(&g_stream.mutex);
+    printf("Stream: client connected\n");
+}
+
+/**
+ * Closes the client once the encoder no longer sends to it.
+ */
+static void closeClient(void) {
+    MUTEX_LOCK(&g_stream.mutex);
+    Socket s = g_stream.client;
+    g_stream.client = SOCKET_INVALID;
+    while (g_stream.sending) {
+        COND_WAIT(&g_stream.cond, &g_stream.mutex);
+    }
+    MUTEX_UNLOCK(&g_stream.mutex);
+
+    SOCKET_CLOSE(s);
+    printf("Stream: client disconnected\n");
+}
+
+/**
+ * Decodes complete events from the receive buffer into the event queue.
+ * @param buffer Received bytes.
+ * @param size Number of bytes, a partial event at the end is kept.
+ * @return Number of bytes consumed.
+ */
+static size_t queueEvents(const unsigned char *buffer, size_t size) {
+    size_t used = 0;
+
+    MUTEX_LOCK(&g_stream.mutex);
+    while (size - used >= STREAM_EVENT_SIZE) {
+        const unsigned char *in = buffer + used;
+        int type = readLe32(in);
+        used += STREAM_EVENT_SIZE;
+        if (type < SE_KEY || type > SE_SCROLL || g_stream.eventCount == STREAM_MAX_EVENTS) {
+            continue;
+        }
+
+        StreamEvent *e = &g_stream.events[g_stream.eventCount++];
+        e->type = (StreamEventType) type;
+        e->a = readLe32(in + 4);
+        e->b = readLe32(in + 8);
+        e->c = readLe32(in + 12);
+    }
+    MUTEX_UNLOCK(&g_stream.mutex);
+    return used;
+}
+
+/**
+ * Accepts clients and receives their events until the server stops.
+ */
+static void networkLoop(void) {
+    unsigned char buffer[STREAM_EVENT_SIZE * 64];
+    size_t pending = 0;
+
+    while (true) {
+        MUTEX_LOCK(&g_stream.mutex);
+        bool stop = g_stream.stop;
+        Socket client = g_stream.client;
+        MUTEX_UNLOCK(&g_stream.mutex);
+        if (stop) {
+            break;
+        }
+
+        if (client == SOCKET_INVALID) {
+            if (waitReadable(g_stream.listener)) {
+                acceptClient();
+                pending = 0;
+            }
+            continue;
+        }
+
+        if (!waitReadable(client)) {
+            continue;
+        }
+        int n = (int) recv(client, (char*) buffer + pending, (int) (sizeof(buffer) - pending), 0);
+        if (n <= 0) {
+            closeClient();
+            continue;
+        }
+
+        pending += (size_t) n;
+        size_t used = queueEvents(buffer, pending);
+        memmove(buffer, buffer + used, pending - used);
+        pending -= used;
+    }
+
+    if (g_stream.client != SOCKET_INVALID) {
+        closeClient();
+    }
+}
+
+/**
+ * Network thread entry.
+ */
+static THREAD_ENTRY(networkMain) {
+    NK_UNUSED(arg);
+    timeline_setThreadName("Stream Network");
+    networkLoop();
+    THREAD_RETURN;
+}
+
+/**
+ * Opens the listening socket.
+ * @param port TCP port.
+ * @param anyInterface Listen on all interfaces instead of the loopback only.
+ * @return False if the port can't be bound.
+ */
+static bool openListener(int port, bool anyInterface) {
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        printf("Stream: could not start Winsock!\n");
+        return false;
+    }
+#endif
+
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(anyInterface ? INADDR_ANY : INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short) port);
+
+    Socket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s != SOCKET_INVALID) {
+        int reuse = 1;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*) &reuse, sizeof(reuse));
+        if (bind(s, (const struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(s, 1) != 0) {
+            SOCKET_CLOSE(s);
+            s = SOCKET_INVALID;
+        }
+    }
+
+    if (s == SOCKET_INVALID) {
+        printf("Stream: could not listen on port %d!\n", port);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return false;
+    }
+
+    g_stream.listener = s;
+    printf("Stream: listening on %s port %d\n", anyInterface ? "all interfaces," : "localhost", port);
+    return true;
+}
+
+/**
+ * Closes the listening socket.
+ */
+static void closeListener(void) {
+    SOCKET_CLOSE(g_stream.listener);
+    g_stream.listener = SOCKET_INVALID;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+/**
+ * Returns the state of a slot as seen by the main thread.
+ * @param slot The slot.
+ * @return Its state.
+ */
+static SlotState slotState(const Slot *slot) {
+    MUTEX_LOCK(&g_stream.mutex);
+    SlotState state = slot->state;
+    MUTEX_UNLOCK(&g_stream.mutex);
+    return state;
+}
+
+/**
+ * Makes a slot whose readback finished the ready one, a ready slot the
+ * encoder did not take yet is freed and counts as dropped.
+ * Without persistent mapping the pixels are copied out of the buffer first.
+ * @param index Index of the slot in the reading state.
+ */
+static void readySlot(int index) {
+    Slot *slot = &g_stream.slots[index];
+    glDeleteSync(slot->fence);
+    slot->fence = NULL;
+
+    if (slot->mapped) {
+        slot->pixels = slot->mapped;
+    } else {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+        const void *src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, g_stream.frameSize, GL_MAP_READ_BIT);
+        if (src) {
+            memcpy(slot->copy, src, g_stream.frameSize);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot->pixels = slot->copy;
+    }
+
+    MUTEX_LOCK(&g_stream.mutex);
+    if (g_stream.ready >= 0) {
+        g_stream.slots[g_stream.ready].state = SLOT_FREE;
+        ++g_stream.replaced;
+    }
+    slot->state = SLOT_READY;
+    g_stream.ready = index;
+    COND_BROADCAST(&g_stream.cond);
+    MUTEX_UNLOCK(&g_stream.mutex);
+}
+
+/**
+ * Makes every finished readback ready, oldest first so the newest wins.
+ */
+static void collectSlots(void) {
+    while (true) {
+        int oldest = -1;
+        for (int i = 0; i < STREAM_SLOTS; ++i) {
+            Slot *slot = &g_stream.slots[i];
+            if (slotState(slot) == SLOT_READING
+                && (oldest < 0 || slot->frame < g_stream.slots[oldest].frame)) {
+                oldest = i;
+            }
+        }
+        if (oldest < 0) {
+            return;
+        }
+
+        GLenum res = glClientWaitSync(g_stream.slots[oldest].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED) {
+            return;
+        }
+        readySlot(oldest);
+    }
+}
+
+/**
+ * Creates the pack buffers of all slots for a framebuffer size.
+ * @param width Framebuffer width.
+ * @param height Framebuffer height.
+ */
+static void createSlots(int width, int height) {
+    g_stream.width = width;
+    g_stream.height = height;
+    g_stream.frameSize = (size_t) width * height * 4;
+
+    for (int i = 0; i < STREAM_SLOTS; ++i) {
+        Slot *slot = &g_stream.slots[i];
+        memset(slot, 0, sizeof(Slot));
+        slot->width = width;
+        slot->height = height;
+
+        glGenBuffers(1, &slot->pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+        if (g_bufferStorage) {
+            GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            g_bufferStorage(GL_PIXEL_PACK_BUFFER, g_stream.frameSize, NULL, flags);
+            slot->mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, g_stream.frameSize, flags);
+        } else {
+            glBufferData(GL_PIXEL_PACK_BUFFER, g_stream.frameSize, NULL, GL_STREAM_READ);
+            slot->copy = malloc(g_stream.frameSize);
+            assert(slot->copy && "malloc failed in createSlots");
+        }
+        gpumem_setBuffer(GPUMEM_STAGING, slot->pbo, g_stream.frameSize);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    g_stream.rgb = realloc(g_stream.rgb, (size_t) width * height * 3);
+    assert(g_stream.rgb && "realloc failed in createSlots");
+}
+
+/**
+ * Deletes the pack buffers of all slots unless the encoder still reads one.
+ * A ready slot is taken back from the encoder first.
+ * @return False if a slot is being encoded, try again next frame.
+ */
+static bool deleteSlots(void) {
+    MUTEX_LOCK(&g_stream.mutex);
+    bool encoding = false;
+    for (int i = 0; i < STREAM_SLOTS; ++i) {
+        encoding |= g_stream.slots[i].state == SLOT_ENCODING;
+    }
+    if (!encoding) {
+        g_stream.ready = -1;
+    }
+    MUTEX_UNLOCK(&g_stream.mutex);
+    if (encoding) {
+        return false;
+    }
+
+    for (int i = 0; i < STREAM_SLOTS; ++i) {
+        Slot *slot = &g_stream.slots[i];
+        if (slot->fence) {
+            glDeleteSync(slot->fence);
+        }
+        if (slot->pbo) {
+            gpumem_deleteBuffers(1, &slot->pbo);
+        }
+        free(slot->copy);
+        memset(slot, 0, sizeof(Slot));
+    }
+    g_stream.width = 0;
+    g_stream.height = 0;
+    return true;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void stream_init(void) {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+    bool supported = (major > 4 || (major == 4 && minor >= 4))
+        || glfwExtensionSupported("GL_ARB_buffer_storage");
+
+    g_bufferStorage = supported ? (BufferStorageFn)glfwGetProcAddress("glBufferStorage") : NULL;
+    g_stream.quality = STREAM_DEFAULT_QUALITY;
+}
+
+void stream_cleanup(void) {
+    stream_stop();
+    free(g_stream.jpeg);
+    g_stream.jpeg = NULL;
+    g_stream.jpegCapacity = 0;
+}
+
+bool stream_start(int port, bool anyInterface) {
+    stream_stop();
+    if (!openListener(port, anyInterface)) {
+        return false;
+    }
+
+    MUTEX_INIT(&g_stream.mutex);
+    COND_INIT(&g_stream.cond);
+    g_stream.stop = false;
+    g_stream.ready = -1;
+    g_stream.frames = 0;
+    g_stream.sent = 0;
+    g_stream.dropped = 0;
+    g_stream.replaced = 0;
+    g_stream.eventCount = 0;
+
+    g_stream.hasEncoder = THREAD_CREATE(&g_stream.encoder, encoderMain);
+    g_stream.hasNetwork = g_stream.hasEncoder && THREAD_CREATE(&g_stream.network, networkMain);
+    g_stream.running = true;
+    if (!g_stream.hasNetwork) {
+        printf("Stream: could not create the server threads!\n");
+        stream_stop();
+        return false;
+    }
+    return true;
+}
+
+void stream_stop(void) {
+    if (!g_stream.running) {
+        return;
+    }
+
+    MUTEX_LOCK(&g_stream.mutex);
+    g_stream.stop = true;
+    COND_BROADCAST(&g_stream.cond);
+    MUTEX_UNLOCK(&g_stream.mutex);
+
+    if (g_stream.hasNetwork) {
+        THREAD_JOIN(g_stream.network);
+        g_stream.hasNetwork = false;
+    }
+    if (g_stream.hasEncoder) {
+        THREAD_JOIN(g_stream.encoder);
+        g_stream.hasEncoder = false;
+    }
+
+    // Locks the mutex, the encoder is joined so no slot is in use
+    deleteSlots();
+    COND_DESTROY(&g_stream.cond);
+    MUTEX_DESTROY(&g_stream.mutex);
+
+    closeListener();
+    free(g_stream.rgb);
+    g_stream.rgb = NULL;
+
+    printf("Streamed %d frames, %d dropped\n", g_stream.sent, g_stream.dropped + g_stream.replaced);
+    g_stream.running = false;
+}
+
+void stream_setEncoding(int quality, bool halfSize) {
+    if (!g_stream.running) {
+        return;
+    }
+    MUTEX_LOCK(&g_stream.mutex);
+    g_stream.quality = CLAMP(quality, 1, 100);
+    g_stream.halfSize = halfSize;
+    MUTEX_UNLOCK(&g_stream.mutex);
+}
+
+void stream_frame(int width, int height) {
+    if (!g_stream.running || width <= 0 || height <= 0) {
+        return;
+    }
+
+    if (width != g_stream.width || height != g_stream.height) {
+        if (!deleteSlots()) {
+            return;
+        }
+        createSlots(width, height);
+    }
+
+    collectSlots();
+    if (!stream_hasClient()) {
+        return;
+    }
+
+    Slot *slot = NULL;
+    for (int i = 0; i < STREAM_SLOTS && !slot; ++i) {
+        if (slotState(&g_stream.slots[i]) == SLOT_FREE) {
+            slot = &g_stream.slots[i];
+        }
+    }
+    if (!slot) {
+        ++g_stream.dropped;
+        return;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->frame = g_stream.frames++;
+
+    MUTEX_LOCK(&g_stream.mutex);
+    slot->state = SLOT_READING;
+    MUTEX_UNLOCK(&g_stream.mutex);
+}
+
+void stream_pollEvents(ProgContext ctx, StreamEventFn fn) {
+    if (!g_stream.running) {
+        return;
+    }
+
+    StreamEvent events[STREAM_MAX_EVENTS];
+    MUTEX_LOCK(&g_stream.mutex);
+    int count = g_stream.eventCount;
+    memcpy(events, g_stream.events, (size_t) count * sizeof(StreamEvent));
+    g_stream.eventCount = 0;
+    bool half = g_stream.halfSize;
+    MUTEX_UNLOCK(&g_stream.mutex);
+
+    for (int i = 0; i < count; ++i) {
+        if (events[i].type == SE_MOUSE_MOVE && half) {
+            events[i].a *= 2;
+            events[i].b *= 2;
+        }
+        fn(ctx, &events[i]);
+    }
+}
+
+bool stream_isRunning(void) {
+    return g_stream.running;
+}
+
+bool stream_hasClient(void) {
+    if (!g_stream.running) {
+        return false;
+    }
+    MUTEX_LOCK(&g_stream.mutex);
+    bool client = g_stream.client != SOCKET_INVALID;
+    MUTEX_UNLOCK(&g_stream.mutex);
+    return client;
+}
+
+void stream_getStats(StreamStats *stats) {
+    memset(stats, 0, sizeof(StreamStats));
+    if (!g_stream.running) {
+        return;
+    }
+    MUTEX_LOCK(&g_stream.mutex);
+    stats->client = g_stream.client != SOCKET_INVALID;
+    stats->sent = g_stream.sent;
+    stats->dropped = g_stream.dropped + g_stream.replaced;
+    stats->encodeMs = g_stream.encodeMs;
+    stats->lastBytes = g_stream.lastBytes;
+    MUTEX_UNLOCK(&g_stream.mutex);
+}
@@ -0,0 +1,147 @@
+/**
+ * @file stream.h
+ * @brief Remote viewer: compressed frames out, input events in, over TCP
+ *
+ * The back buffer is read into pixel pack buffers as for the frame capture,
+ * but only the newest finished readback matters: an encoder thread takes it,
+ * compresses it to JPEG and sends it to the connected client. A readback
+ * that finishes while an older one still waits for the encoder replaces it,
+ * and a frame finding no free buffer is not read at all. A slow client or
+ * encoder therefore costs frames, never render time.
+ *
+ * A network thread accepts one client at a time and receives its input
+ * events, the main thread hands them to the input callbacks once per frame.
+ * There is no authentication, so the server listens on the loopback
+ * interface unless asked otherwise. Reach it from another machine through
+ * an SSH tunnel, e.g. ssh -L 7420:localhost:7420 host.
+ *
+ * Wire format, all integers 32 bit little-endian:
+ * - server to client, per frame: magic STREAM_MAGIC, JPEG size in bytes,
+ *   width, height, then the JPEG data
+ * - client to server, per event: type (StreamEventType), a, b, c
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Pixel pack buffers: readback latency, the newest finished one and the one being encoded */
+#define STREAM_SLOTS 4
+
+/** Default TCP port of the server */
+#define STREAM_DEFAULT_PORT 7420
+
+/** Default JPEG quality, 1 to 100 */
+#define STREAM_DEFAULT_QUALITY 75
+
+/** Identifies a frame header, "CGSF" read as little-endian */
+#define STREAM_MAGIC 0x46534743u
+
+/**
+ * Type of an input event sent by the client.
+ */
+typedef enum {
+    SE_KEY = 1,         // a: GLFW key, b: action, c: mods
+    SE_MOUSE_BUTTON,    // a: GLFW button, b: action, c: mods
+    SE_MOUSE_MOVE,      // a, b: cursor position in pixels of the streamed image
+    SE_SCROLL           // a, b: scroll offset in 1/100 steps
+} StreamEventType;
+
+/**
+ * One input event of the client.
+ */
+typedef struct {
+    StreamEventType type;
+    int a, b, c;
+} StreamEvent;
+
+/**
+ * Handler of a client input event, runs on the main thread.
+ * @param ctx Program context.
+ * @param event The event, cursor positions already scaled to the window.
+ */
+typedef void (*StreamEventFn)(ProgContext ctx, const StreamEvent *event);
+
+/**
+ * Counts of the running server.
+ */
+typedef struct {
+    bool client;        // a client is connected
+    int sent;           // frames sent to clients
+    int dropped;        // frames not read or replaced before encoding
+    float encodeMs;     // encode time of the last frame
+    int lastBytes;      // size of the last JPEG
+} StreamStats;
+
+/**
+ * Queries whether persistently mapped pack buffers are supported.
+ * Call once after the GL context was created.
+ */
+void stream_init(void);
+
+/**
+ * Stops a running server.
+ */
+void stream_cleanup(void);
+
+/**
+ * Opens the listening socket and starts the network and encoder threads.
+ * A running server is stopped first.
+ * @param port TCP port to listen on.
+ * @param anyInterface Accept clients from other machines too. Anyone
+ *        reaching the port can then control the program.
+ * @return False if the socket or a thread could not be created.
+ */
+bool stream_start(int port, bool anyInterface);
+
+/**
+ * Disconnects the client, stops the threads and deletes the pack buffers.
+ */
+void stream_stop(void);
+
+/**
+ * Sets how frames are encoded, takes effect with the next frame.
+ * @param quality JPEG quality, 1 to 100.
+ * @param halfSize Downsample the frames by two per axis before encoding.
+ */
+void stream_setEncoding(int quality, bool halfSize);
+
+/**
+ * Hands finished readbacks to the encoder and reads the current back buffer
+ * into a free slot. Does nothing while no client is connected.
+ * Call after the scene was drawn, before the GUI.
+ * @param width Current framebuffer width.
+ * @param height Current framebuffer height.
+ */
+void stream_frame(int width, int height);
+
+/**
+ * Runs the handler for every input event received since the last call.
+ * Call once per frame before the input events are flushed.
+ * @param ctx Program context.
+ * @param fn Handler of the events.
+ */
+void stream_pollEvents(ProgContext ctx, StreamEventFn fn);
+
+/**
+ * Returns whether the server is running.
+ * @return True between stream_start and stream_stop.
+ */
+bool stream_isRunning(void);
+
+/**
+ * Returns whether a client is connected.
+ * @return True while frames are streamed.
+ */
+bool stream_hasClient(void);
+
+/**
+ * Returns the counts of the server.
+ * @param stats Destination.
+ */
+void stream_getStats(StreamStats *stats);
+
+#endif // STREAM_H
@@ -0,0 +1,120 @@
+/**
+ * @file trail.c
+ * @brief Implementation of the particle trail ring buffer
+ *
+ * The ring holds length slots of count positions each, slot-major, so
+ * recording a frame is a single buffer copy out of the position column.
+ * The draw has no vertex attributes: particleTrail.vert picks the
+ * position from gl_InstanceID (particle) and gl_VertexID (age).
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "trail.h"
+#include "instanced.h"
+#include "shader.h"
+#include "glstate.h"
+#include "gpumem.h"
+#include "utils.h"
+
+/** Storage buffer bindings, must match particleTrail.vert */
+#define BINDING_TRAIL 0
+#define BINDING_SWARM 1
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Ring buffer state.
+ */
+static struct {
+    GLuint buffer;
+    GLuint vao;
+    int capacity;       // positions the buffer can hold
+
+    int count;          // particles per slot
+    int length;         // slots
+    int head;           // slot of the newest positions
+    int filled;         // slots recorded since the last restart
+} g_trail = { 0 };
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void trail_init(void) {
+    glGenBuffers(1, &g_trail.buffer);
+    glGenVertexArrays(1, &g_trail.vao);
+    g_trail.capacity = 0;
+    trail_reset();
+}
+
+void trail_cleanup(void) {
+    gpumem_deleteBuffers(1, &g_trail.buffer);
+    glDeleteVertexArrays(1, &g_trail.vao);
+    memset(&g_trail, 0, sizeof(g_trail));
+}
+
+void trail_reset(void) {
+    g_trail.head = -1;
+    g_trail.filled = 0;
+}
+
+void trail_record(int count, int length) {
+    length = CLAMP(length, 2, TRAIL_MAX_LENGTH);
+    if (count <= 0) {
+        return;
+    }
+
+    if (count != g_trail.count || length != g_trail.length) {
+        g_trail.count = count;
+        g_trail.length = length;
+        trail_reset();
+    }
+
+    // Grows geometrically, the old positions are not worth keeping
+    int needed = count * length;
+    if (needed > g_trail.capacity) {
+        int capacity = glm_imax(needed, g_trail.capacity * 2);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, g_trail.buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity * sizeof(vec3), NULL, GL_DYNAMIC_COPY);
+        gpumem_setBuffer(GPUMEM_GEOMETRY, g_trail.buffer, capacity * sizeof(vec3));
+        g_trail.capacity = capacity;
+        trail_reset();
+    }
+
+    g_trail.head = (g_trail.head + 1) % length;
+    g_trail.filled = glm_imin(g_trail.filled + 1, length);
+
+    GLintptr src = (GLintptr) instanced_getBaseInstance() * sizeof(vec3);
+    GLintptr dst = (GLintptr) g_trail.head * count * sizeof(vec3);
+    glBindBuffer(GL_COPY_READ_BUFFER, instanced_getColumnBuffer(IC_POS));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, g_trail.buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src, dst, count * sizeof(vec3));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+bool trail_draw(int leaderIdx) {
+    if (g_trail.filled < 2) {
+        return false;
+    }
+
+    if (!shader_setParticleTrailData(g_trail.head, g_trail.length, g_trail.count,
+                                     instanced_getBaseInstance(), leaderIdx)) {
+        return false;
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_TRAIL, g_trail.buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_SWARM, instanced_getColumnBuffer(IC_SWARM));
+
+    // Trails fade out, they neither hide each other nor the particles
+    glstate_setEnabled(GL_BLEND, true);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glstate_depthMask(false);
+
+    glstate_bindVertexArray(g_trail.vao);
+    glDrawArraysInstanced(GL_LINE_STRIP, 0, g_trail.filled, g_trail.count);
+    glstate_bindVertexArray(0);
+
+    glstate_depthMask(true);
+    glstate_setEnabled(GL_BLEND, false);
+    return true;
+}
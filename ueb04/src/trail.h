@@ -0,0 +1,47 @@
+/**
+ * @file trail.h
+ * @brief GPU-resident ring buffer of past particle positions, drawn as motion trails
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef TRAIL_H
+#define TRAIL_H
+
+#include <fhwcg/fhwcg.h>
+
+/** Upper bound of positions kept per particle */
+#define TRAIL_MAX_LENGTH 64
+
+/**
+ * Creates the ring buffer and the empty vertex array of the trail draw.
+ */
+void trail_init(void);
+
+/**
+ * Frees the ring buffer.
+ */
+void trail_cleanup(void);
+
+/**
+ * Forgets all recorded positions, e.g. after the particles were respawned.
+ */
+void trail_reset(void);
+
+/**
+ * Copies the drawn positions of this frame from the position instance column
+ * into the next ring slot. The copy stays on the GPU.
+ * A different count or length than last time restarts the trails.
+ * @param count Number of particles.
+ * @param length Positions kept per particle, at most TRAIL_MAX_LENGTH.
+ */
+void trail_record(int count, int length);
+
+/**
+ * Draws one line strip per particle from the newest to the oldest position.
+ * @param leaderIdx Particle drawn in the leader color (-1 if none).
+ * @return False if the trail shader is not available or nothing is recorded yet.
+ */
+bool trail_draw(int leaderIdx);
+
+#endif // TRAIL_H
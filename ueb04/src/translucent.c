@@ -0,0 +1,340 @@
+/**
+ * @file translucent.c
+ * @brief Implementation of the translucent particle draw
+ *
+ * Sorted: particleDepth.comp writes the key of every particle and the
+ * identity order, gpuprim_sort moves the order along with the keys and
+ * the draw pulls its instances through it (PULL_ORDERED in pull.glsl).
+ * Nothing is read back, the order never leaves the GPU. The sort is
+ * stable, particles in the same depth bucket keep their index order.
+ *
+ * Weighted blended: the same accumulation and composite as the
+ * transparent items of ueb03. The targets grow to the largest viewport
+ * seen and are drawn from the lower left corner, so the dynamic
+ * resolution does not reallocate them.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include "translucent.h"
+#include "instanced.h"
+#include "input.h"
+#include "shader.h"
+#include "glstate.h"
+#include "gpumem.h"
+#include "gpuprim.h"
+
+/** Storage buffer bindings, must match particleDepth.comp */
+#define BINDING_POS 0
+#define BINDING_KEYS 1
+#define BINDING_ORDER 2
+
+/** Work group size of particleDepth.comp */
+#define DEPTH_GROUP_SIZE 256
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/**
+ * Sort buffers and targets of the weighted blended pass.
+ */
+static struct {
+    GLuint keys, order;
+    int capacity;           // particles the sort buffers can hold
+
+    GLuint fbo, accum, revealage, depth;
+    GLuint vao;             // empty, the composite triangle comes from gl_VertexID
+    int width, height;      // size of the targets
+    bool verified;          // the depth copy worked once
+    bool unsupported;       // the targets or the depth copy failed
+
+    GLint sceneFbo;         // framebuffer bound when the pass started
+    int drawWidth, drawHeight;
+
+    TranslucentOrder lastOrder;
+} g_tl = { 0 };
+
+/**
+ * Grows the key and order buffers to at least count particles.
+ * @param count Number of particles.
+ */
+static void ensureSortBuffers(int count) {
+    if (count <= g_tl.capacity) {
+        return;
+    }
+
+    // Grows geometrically, the contents are rewritten every frame
+    int capacity = glm_imax(count, g_tl.capacity * 2);
+    GLsizeiptr size = (GLsizeiptr) capacity * sizeof(GLuint);
+    if (!g_tl.keys) {
+        glGenBuffers(1, &g_tl.keys);
+        glGenBuffers(1, &g_tl.order);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_tl.keys);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_COPY);
+    gpumem_setBuffer(GPUMEM_COMPUTE, g_tl.keys, (size_t) size);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_tl.order);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_COPY);
+    gpumem_setBuffer(GPUMEM_COMPUTE, g_tl.order, (size_t) size);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    g_tl.capacity = capacity;
+}
+
+/**
+ * Writes the depth keys of all particles and sorts the order by them,
+ * farthest first.
+ * @param count Number of particles.
+ * @return False if a program is not available, the order is undefined then.
+ */
+static bool sortByDepth(int count) {
+    if (!shader_setParticleDepthData(count, instanced_getBaseInstance(), TRANSLUCENT_KEY_BITS)) {
+        return false;
+    }
+
+    ensureSortBuffers(count);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_POS, instanced_getColumnBuffer(IC_POS));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_KEYS, g_tl.keys);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_ORDER, g_tl.order);
+    glDispatchCompute((GLuint) ((count + DEPTH_GROUP_SIZE - 1) / DEPTH_GROUP_SIZE), 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    return gpuprim_sort(g_tl.keys, g_tl.order, count, TRANSLUCENT_KEY_BITS);
+}
+
+/**
+ * Deletes the targets and the framebuffer of the weighted blended pass.
+ */
+static void deleteTargets(void) {
+    glDeleteFramebuffers(1, &g_tl.fbo);
+    gpumem_deleteTextures(1, &g_tl.accum);
+    gpumem_deleteTextures(1, &g_tl.revealage);
+    gpumem_deleteRenderbuffers(1, &g_tl.depth);
+    g_tl.fbo = g_tl.accum = g_tl.revealage = g_tl.depth = 0;
+    g_tl.width = g_tl.height = 0;
+}
+
+/**
+ * Creates a target texture sampled by texelFetch.
+ * @param format Internal format.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @return The texture.
+ */
+static GLuint createTarget(GLenum format, int width, int height) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+    gpumem_setTexture(GPUMEM_TARGETS, texture, gpumem_imageBytes(format, width, height, 1));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+/**
+ * Creates the targets if they are smaller than the drawn viewport.
+ * The depth matches the scene targets, GL_DEPTH24_STENCIL8.
+ * @return False if the framebuffer is not complete.
+ */
+static bool ensureTargets(void) {
+    if (g_tl.fbo && g_tl.width >= g_tl.drawWidth && g_tl.height >= g_tl.drawHeight) {
+        return true;
+    }
+
+    int width = glm_imax(g_tl.drawWidth, g_tl.width);
+    int height = glm_imax(g_tl.drawHeight, g_tl.height);
+    deleteTargets();
+
+    g_tl.accum = createTarget(GL_RGBA16F, width, height);
+    g_tl.revealage = createTarget(GL_R8, width, height);
+
+    glGenRenderbuffers(1, &g_tl.depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, g_tl.depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    gpumem_setRenderbuffer(GPUMEM_TARGETS, g_tl.depth, gpumem_imageBytes(GL_DEPTH24_STENCIL8, width, height, 1));
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &g_tl.fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g_tl.fbo);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, g_tl.accum, 0);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, g_tl.revealage, 0);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, g_tl.depth);
+    GLenum buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, buffers);
+    GLenum status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g_tl.sceneFbo);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Translucency targets incomplete (0x%x), sorting instead\n", status);
+        deleteTargets();
+        g_tl.unsupported = true;
+        return false;
+    }
+
+    g_tl.width = width;
+    g_tl.height = height;
+    return true;
+}
+
+/**
+ * Copies the scene depth into the pass, checks the copy on the first use.
+ * @return False if the depth formats do not match.
+ */
+static bool copyDepth(void) {
+    if (!g_tl.verified) {
+        while (glGetError() != GL_NO_ERROR) {}
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, g_tl.sceneFbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g_tl.fbo);
+    glBlitFramebuffer(0, 0, g_tl.drawWidth, g_tl.drawHeight, 0, 0, g_tl.drawWidth, g_tl.drawHeight,
+                      GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    if (!g_tl.verified) {
+        if (glGetError() != GL_NO_ERROR) {
+            printf("Scene depth cannot be copied, sorting translucent particles instead\n");
+            glBindFramebuffer(GL_FRAMEBUFFER, g_tl.sceneFbo);
+            g_tl.unsupported = true;
+            return false;
+        }
+        g_tl.verified = true;
+    }
+    return true;
+}
+
+/**
+ * Starts the accumulation pass for the current framebuffer and viewport:
+ * copies the depth, clears the targets and sets up blending.
+ * @return False if the pass cannot run, nothing was changed then.
+ */
+static bool beginOit(void) {
+    if (g_tl.unsupported) {
+        return false;
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &g_tl.sceneFbo);
+    g_tl.drawWidth = viewport[2];
+    g_tl.drawHeight = viewport[3];
+
+    if (!ensureTargets() || !copyDepth()) {
+        return false;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, g_tl.fbo);
+    static const GLfloat zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    static const GLfloat one[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 1, one);
+
+    // Sum of weighted colors, product of transmissions
+    glstate_setEnabled(GL_BLEND, true);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+    return true;
+}
+
+/**
+ * Ends the accumulation pass and composites the result over the
+ * framebuffer that was bound at beginOit.
+ */
+static void endOit(void) {
+    glBindFramebuffer(GL_FRAMEBUFFER, g_tl.sceneFbo);
+
+    // Average color over the scene by the total coverage
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if (shader_setOitComposite(g_tl.accum, g_tl.revealage)) {
+        if (!g_tl.vao) {
+            glGenVertexArrays(1, &g_tl.vao);
+        }
+        glstate_setEnabled(GL_DEPTH_TEST, false);
+        glstate_polygonMode(GL_FILL);
+        glstate_bindVertexArray(g_tl.vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glstate_setEnabled(GL_DEPTH_TEST, true);
+    }
+}
+
+/**
+ * Draws the particles back to front, blended premultiplied.
+ * @param model Model type to draw.
+ * @param scale Local scale vector for instances.
+ * @param leaderIdx Index of the leader particle (-1 if none).
+ * @param hardColor Whether to use the hard two-tone coloring.
+ * @param alpha Opacity of the particles.
+ * @return False if a program is not available.
+ */
+static bool drawSorted(ModelType model, vec3 scale, int leaderIdx, bool hardColor, float alpha) {
+    if (!sortByDepth(instanced_getCount())
+        || !shader_setParticleTranslucentData(scale, leaderIdx, hardColor, alpha, false)) {
+        return false;
+    }
+
+    glstate_setEnabled(GL_BLEND, true);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    model_drawOrdered(model, g_tl.order);
+    return true;
+}
+
+/**
+ * Draws the particles unsorted into the weighted blended targets and
+ * composites them.
+ * @param model Model type to draw.
+ * @param scale Local scale vector for instances.
+ * @param leaderIdx Index of the leader particle (-1 if none).
+ * @param hardColor Whether to use the hard two-tone coloring.
+ * @param alpha Opacity of the particles.
+ * @return False if the pass or a program is not available.
+ */
+static bool drawOit(ModelType model, vec3 scale, int leaderIdx, bool hardColor, float alpha) {
+    if (!shader_setParticleTranslucentData(scale, leaderIdx, hardColor, alpha, true) || !beginOit()) {
+        return false;
+    }
+
+    model_draw(model, true, 0);
+    endOit();
+    return true;
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+void translucent_cleanup(void) {
+    gpumem_deleteBuffers(1, &g_tl.keys);
+    gpumem_deleteBuffers(1, &g_tl.order);
+    deleteTargets();
+    glstate_forgetVertexArray();
+    glDeleteVertexArrays(1, &g_tl.vao);
+    memset(&g_tl, 0, sizeof(g_tl));
+}
+
+TranslucentOrder translucent_draw(ModelType model, vec3 scale, int leaderIdx, bool hardColor) {
+    InputData *data = getInputData();
+    int count = instanced_getCount();
+    g_tl.lastOrder = TO_NONE;
+    if (count <= 0) {
+        return TO_NONE;
+    }
+
+    float alpha = data->rendering.particleAlpha;
+    bool sort = count <= data->rendering.sortBudget;
+
+    // Tested against the scene, hidden from each other only by the blending
+    glstate_depthMask(false);
+    if (sort && drawSorted(model, scale, leaderIdx, hardColor, alpha)) {
+        g_tl.lastOrder = TO_SORTED;
+    } else if (drawOit(model, scale, leaderIdx, hardColor, alpha)) {
+        g_tl.lastOrder = TO_OIT;
+    } else if (!sort && drawSorted(model, scale, leaderIdx, hardColor, alpha)) {
+        g_tl.lastOrder = TO_SORTED;
+    }
+    glstate_setEnabled(GL_BLEND, false);
+    glstate_depthMask(true);
+
+    return g_tl.lastOrder;
+}
+
+TranslucentOrder translucent_getOrder(void) {
+    return g_tl.lastOrder;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file translucent.h
+ * @brief Translucent particles, depth sorted on the GPU or weighted blended
+ *
+ * Blending translucent particles is only right back to front. Sorting a
+ * hundred thousand instances on the CPU every frame is too slow, so the
+ * view depth of every particle is quantized into a key on the GPU, the
+ * instance indices are radix sorted by it (gpuprim.h) and the draw reads
+ * its instances through the sorted indices.
+ *
+ * Above the sort budget the particles are drawn unsorted with weighted
+ * blended order-independent transparency instead, which only approximates
+ * the order by a depth weight but costs one pass regardless of the count.
+ * If its targets or the depth copy fail once, everything is sorted.
+ *
+ * The particles are tested against the opaque scene but write no depth,
+ * so they are drawn after it. The cull pass and the LOD meshes are not
+ * used, every particle is drawn with the full mesh.
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#ifndef TRANSLUCENT_H
+#define TRANSLUCENT_H
+
+#include <fhwcg/fhwcg.h>
+#include "model.h"
+
+/** Default number of particles sorted per frame, more are weighted blended */
+#define TRANSLUCENT_SORT_BUDGET (1 << 18)
+
+/** Bits of the quantized view depth, 4 radix sort passes */
+#define TRANSLUCENT_KEY_BITS 16
+
+/**
+ * How the translucent particles of a frame were ordered.
+ */
+typedef enum {
+    TO_NONE,    // nothing drawn
+    TO_SORTED,
+    TO_OIT
+} TranslucentOrder;
+
+/**
+ * Deletes the sort buffers and the targets of the weighted blended pass.
+ */
+void translucent_cleanup(void);
+
+/**
+ * Draws all particles translucent over the current framebuffer with the
+ * opacity and sort budget of the render settings.
+ * @param model Model type to draw, without LODs.
+ * @param scale Local scale vector for instances.
+ * @param leaderIdx Index of the leader particle (-1 if none).
+ * @param hardColor Whether to use the hard two-tone coloring.
+ * @return How the particles were ordered, TO_NONE if no program was available.
+ */
+TranslucentOrder translucent_draw(ModelType model, vec3 scale, int leaderIdx, bool hardColor);
+
+/**
+ * Returns how the particles were ordered in the last translucent draw.
+ * @return The order, TO_NONE before the first draw.
+ */
+TranslucentOrder translucent_getOrder(void);
+
+#endif // TRANSLUCENT_H
@@ -8,6 +8,9 @@
 #include "utils.h"
 #include <fhwcg/fhwcg.h>
 
+/** Squared lengths below are treated as zero by the basis update */
+#define BASIS_EPS 1e-6f
+
 void utils_moveTowards(vec3 curr, vec3 target, float speed) {
     vec3 delta;
     glm_vec3_sub(target, curr, delta);
@@ -21,3 +24,49 @@ void utils_moveTowards(vec3 curr, vec3 target, float speed) {
         glm_vec3_add(curr, delta, curr);
     }
 }
+
+void utils_updateBasis(vec3 velocity, vec3 acceleration, vec3 forward, vec3 up, vec3 right) {
+    vec3 upRef = {0, 1, 0};
+
+    // If no velocity we have no forward -> return 
+    if (glm_vec3_norm2(velocity) < BASIS_EPS) {
+        return;
+    }
+
+    vec3 prevUp;
+    glm_vec3_copy(up, prevUp);
+
+    // velocity -> forward
+    glm_vec3_normalize_to(velocity, forward);
+
+    vec3 tmpRight;
+    bool valid = false;
+
+    if (glm_vec3_norm2(acceleration) >= BASIS_EPS) {
+        glm_vec3_cross(forward, acceleration, tmpRight);
+        if (glm_vec3_norm2(tmpRight) >= BASIS_EPS) {
+            valid = true;
+        }
+    }
+
+    // Fallback to previous up or world up
+    if (!valid) {
+        glm_vec3_cross(forward, prevUp, tmpRight);
+        if (glm_vec3_norm2(tmpRight) < BASIS_EPS) {
+            glm_vec3_cross(forward, upRef, tmpRight);
+        }
+    }
+
+    glm_normalize_to(tmpRight, right);
+
+    // Recompute up
+    glm_vec3_cross(right, forward, up);
+    glm_vec3_normalize(up);
+
+    // Enforce temporal continuity (up can't suddenly flip)
+    // (r, u, f) == (-r, -u, f)
+    if (glm_vec3_dot(up, prevUp) < 0.0f) {
+        glm_vec3_scale(up, -1.0f, up);
+        glm_vec3_scale(right, -1.0f, right);
+    }
+}
@@ -9,6 +9,8 @@
 #define UTILS_H
 
 #include <fhwcg/fhwcg.h>
+#include "array.h"
+#include "rng.h"
 
 /** Vector creation macros */
 #define VEC3(x, y, z) ((vec3){(float)(x), (float)(y), (float)(z)})
@@ -17,65 +19,9 @@
 
 /** Math utilities */
 #define CLAMP(x, min, max) ((x < min) ? min : (x > max) ? max : x)
-#define RAND01 ((float)rand() / RAND_MAX)
+#define RAND01 rng_float(rng_thread())
 #define RAND(min, max) ((min) + RAND01 * ((max) - (min)))
 
-/**
- * Defines a dynamic array type with init, free, clear, reserve, push
- * and popBack functions for any given element TYPE.
- *
- * @param TYPE Element type stored in the array
- * @param NAME Name of the generated array type
- */
-#define DEFINE_ARRAY_TYPE(TYPE, NAME)                                          \
-typedef struct {                                                               \
-    TYPE *data;                                                                \
-    size_t size;                                                               \
-    size_t capacity;                                                           \
-} NAME;                                                                        \
-                                                                               \
-static inline void NAME##_init(NAME *arr) {                                    \
-    arr->data = NULL;                                                          \
-    arr->size = 0;                                                             \
-    arr->capacity = 0;                                                         \
-}                                                                              \
-                                                                               \
-static inline void NAME##_free(NAME *arr) {                                    \
-    free(arr->data);                                                           \
-    arr->data = NULL;                                                          \
-    arr->size = 0;                                                             \
-    arr->capacity = 0;                                                         \
-}                                                                              \
-                                                                               \
-static inline void NAME##_clear(NAME *arr) {                                   \
-    arr->size = 0;                                                             \
-}                                                                              \
-                                                                               \
-static inline void NAME##_reserve(NAME *arr, size_t min_capacity) {            \
-    if (arr->capacity < min_capacity) {                                        \
-        size_t new_cap = arr->capacity ? arr->capacity * 2 : 8;                \
-        if (new_cap < min_capacity) new_cap = min_capacity;                    \
-        TYPE *new_data = malloc(new_cap * sizeof(TYPE));                       \
-        assert(new_data && "malloc failed in " #NAME "_reserve");              \
-        if (arr->data) memcpy(new_data, arr->data, arr->size * sizeof(TYPE));  \
-        free(arr->data);                                                       \
-        arr->data = new_data;                                                  \
-        arr->capacity = new_cap;                                               \
-    }                                                                          \
-}                                                                              \
-                                                                               \
-static inline void NAME##_push(NAME *arr, TYPE value) {                        \
-    if (arr->size >= arr->capacity)                                            \
-        NAME##_reserve(arr, arr->size + 1);                                    \
-    arr->data[arr->size++] = value;                                            \
-}                                                                              \
-                                                                               \
-static inline void NAME##_popBack(NAME *arr) {                                 \
-    if (arr->size > 0) {                                                       \
-        arr->size--;                                                           \
-    }                                                                          \
-}                                                                              \
-
 /**
  * Moves curr towards target at the given speed.
  * If the distance is less / equal speed sets curr to target.
@@ -85,4 +31,16 @@ static inline void NAME##_popBack(NAME *arr) {                                 \
  */
 void utils_moveTowards(vec3 curr, vec3 target, float speed);
 
+/**
+ * Updates a local coordinate basis from velocity and acceleration.
+ * Keeps the basis if there is no velocity and never flips up against
+ * its previous direction.
+ * @param velocity Velocity, gives the forward direction.
+ * @param acceleration Acceleration, turns the basis into the curve.
+ * @param forward Forward direction, written.
+ * @param up Up direction, read as the previous up and written.
+ * @param right Right direction, written.
+ */
+void utils_updateBasis(vec3 velocity, vec3 acceleration, vec3 forward, vec3 up, vec3 right);
+
 #endif // UTILS_H
\ No newline at end of file
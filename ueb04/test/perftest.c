@@ -0,0 +1,204 @@
+/**
+ * @file perftest.c
+ * @brief Regression tests of the particle update
+ *
+ * Runs fixed-seed particle simulations without a window and asserts with
+ * cmocka that every particle stays finite and inside the room. The time
+ * per particle step is collected as a result (benchresult.h) and compared
+ * to the baseline given as the first argument: a time more than the
+ * tolerance slower than the baseline, and significantly so, fails. A
+ * missing baseline is written from the run and the comparison is skipped.
+ * GL-bound modules are replaced by bench/stubs.c.
+ *
+ * Usage: cg2_ueb04_perftest [baseline] [tolerance]
+ *   baseline   JSON result of an earlier run, written if missing
+ *   tolerance  allowed slowdown in percent, default PERFTEST_TOLERANCE
+ *
+ * @authors Nikolaos Tsetsas, Noah Schmidt
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <fhwcg/fhwcg.h>
+#include "input.h"
+#include "physics.h"
+#include "rng.h"
+#include "benchresult.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+#define PERFTEST_SEED 42
+#define PERFTEST_TOLERANCE 25.0
+
+#define SIM_PARTICLES 20000
+#define SIM_STEPS 200
+#define SIM_WARMUP 20
+#define SIM_REPEATS 5
+
+////////////////////////    LOCAL    ////////////////////////////
+
+/** Baseline file, NULL to only check the invariants */
+static const char *g_baselinePath = NULL;
+
+/** Allowed slowdown against the baseline in percent */
+static double g_tolerance = PERFTEST_TOLERANCE;
+
+/** Times of all workloads */
+static BenchResult g_result;
+
+/**
+ * Returns a monotonic timestamp.
+ * @return Time in seconds.
+ */
+static double now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/**
+ * Runs exactly one fixed physics step.
+ * @param data Input state.
+ */
+static void runStep(InputData *data) {
+    data->deltaTime = 0.0f;
+    data->physics.dtAccumulator = data->physics.fixedDt;
+    physics_update();
+}
+
+/**
+ * Runs one swarm of SIM_PARTICLES from the seed, checks the particles after
+ * every repetition and adds the time per particle step to the result.
+ * @param mode Target mode of the swarm.
+ * @param name Name of the metric.
+ */
+static void runSimulation(TargetMode mode, const char *name) {
+    InputData *data = getInputData();
+    data->particles.swarmCount = 1;
+    data->particles.swarms[0].count = SIM_PARTICLES;
+    data->particles.swarms[0].targetMode = mode;
+
+    // Every repetition starts the same simulation again, all of them are checked
+    double nsPerParticle[SIM_REPEATS];
+    for (int r = 0; r < SIM_REPEATS; ++r) {
+        rng_setSeed(PERFTEST_SEED);
+        physics_init();
+        for (int i = 0; i < SIM_WARMUP; ++i) {
+            runStep(data);
+        }
+
+        double start = now();
+        for (int i = 0; i < SIM_STEPS; ++i) {
+            runStep(data);
+        }
+        nsPerParticle[r] = (now() - start) * 1e9 / ((double)SIM_STEPS * SIM_PARTICLES);
+
+        int count = physics_getParticleCount();
+        int invalid = physics_countInvalidParticles();
+        physics_cleanup();
+        assert_int_equal(count, SIM_PARTICLES);
+        assert_int_equal(invalid, 0);
+    }
+    benchresult_add(&g_result, name, "ns/particle", false, nsPerParticle, SIM_REPEATS);
+}
+
+/**
+ * Sets up the defaults and the result shared by all tests.
+ * @param state Unused.
+ * @return 0 on success.
+ */
+static int setupGroup(void **state) {
+    NK_UNUSED(state);
+    input_initDefaults();
+    benchresult_init(&g_result, PROGRAM_NAME, 0, NULL);
+    return 0;
+}
+
+/**
+ * Frees the result.
+ * @param state Unused.
+ * @return 0 on success.
+ */
+static int teardownGroup(void **state) {
+    NK_UNUSED(state);
+    benchresult_free(&g_result);
+    return 0;
+}
+
+/**
+ * Runs a swarm heading for the wandering spheres.
+ * @param state Unused.
+ */
+static void test_spheres(void **state) {
+    NK_UNUSED(state);
+    runSimulation(TM_SPHERES, "spheres 20000");
+}
+
+/**
+ * Runs a flocking swarm, the neighbour search dominates.
+ * @param state Unused.
+ */
+static void test_flock(void **state) {
+    NK_UNUSED(state);
+    runSimulation(TM_FLOCK, "flock 20000");
+}
+
+/**
+ * Compares the times of the tests before to the baseline.
+ * @param state Unused.
+ */
+static void test_throughputFloors(void **state) {
+    NK_UNUSED(state);
+    if (!g_baselinePath) {
+        skip();
+    }
+
+    FILE *f = fopen(g_baselinePath, "r");
+    if (!f) {
+        assert_true(benchresult_write(&g_result, g_baselinePath));
+        print_message("Baseline written to %s\n", g_baselinePath);
+        skip();
+    }
+    fclose(f);
+
+    BenchResult baseline;
+    assert_true(benchresult_load(&baseline, g_baselinePath));
+    int regressed = benchresult_compare(&baseline, &g_result, g_tolerance);
+    benchresult_free(&baseline);
+    assert_int_equal(regressed, 0);
+}
+
+////////////////////////    PUBLIC    ////////////////////////////
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        g_baselinePath = argv[1];
+    }
+    if (argc > 2) {
+        g_tolerance = atof(argv[2]);
+    }
+
+    // The throughput test compares the times of all tests before it
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_spheres),
+        cmocka_unit_test(test_flock),
+        cmocka_unit_test(test_throughputFloors),
+    };
+    return cmocka_run_group_tests(tests, setupGroup, teardownGroup);
+}